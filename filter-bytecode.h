@@ -44,6 +44,16 @@ struct literal_string {
 	char string[0];
 } __attribute__((packed));
 
+/*
+ * Data of a string literal load, once specialized: the literal and its
+ * compiled matcher are stored in the runtime data, at data_offset. len
+ * is the length of the original literal, including the final '\0'.
+ */
+struct load_string_matcher {
+	uint16_t len;
+	uint16_t data_offset;
+} __attribute__((packed));
+
 enum filter_op {
 	FILTER_OP_UNKNOWN			= 0,
 
@@ -189,6 +199,17 @@ enum filter_op {
 
 	FILTER_OP_RETURN_S64			= 99,
 
+	/*
+	 * Membership of the s64 value at the top of stack in a constant
+	 * set or inclusive range, replaced by 1 or 0.
+	 */
+	FILTER_OP_IN_SET_S64			= 100,
+	FILTER_OP_IN_SET_BITMAP_S64		= 101,	/* Specialized IN_SET_S64 */
+	FILTER_OP_IN_RANGE_S64			= 102,
+
+	/* Specialized LOAD_STRING and LOAD_STAR_GLOB_STRING */
+	FILTER_OP_LOAD_STRING_MATCHER		= 103,
+
 	NR_FILTER_OPS,
 };
 
@@ -222,4 +243,24 @@ struct return_op {
 	filter_opcode_t op;
 } __attribute__((packed));
 
+/*
+ * The set values follow the instruction, sorted in increasing order
+ * without duplicates. data_offset is 0 in the bytecode received from
+ * user-space. The specializer stores a bitmap of close values in the
+ * runtime data, at data_offset.
+ */
+struct set_op {
+	filter_opcode_t op;
+	uint16_t nr_values;
+	uint16_t data_offset;
+	int64_t values[0];
+} __attribute__((packed));
+
+/* Inclusive range: lo <= value <= hi */
+struct range_op {
+	filter_opcode_t op;
+	int64_t lo;
+	int64_t hi;
+} __attribute__((packed));
+
 #endif /* _FILTER_BYTECODE_H */
@@ -27,6 +27,44 @@ LTTNG_TRACEPOINT_EVENT_MAP(kvm_entry, kvm_x86_entry,
 	)
 )
 
+/*
+ * Time spent in the host by the exits of a vcpu for an exit reason over
+ * a period, from each kvm_exit to the next kvm_entry of the vcpu thread.
+ * Recorded at the first entry on a cpu after the end of a period, with
+ * the count, total and maximum duration, and the log2 histogram of the
+ * durations, in trace clock units, of the exits measured on this cpu
+ * during the period. Requires the probe module to be loaded with
+ * kvm_exit_aggregation=1.
+ */
+LTTNG_TRACEPOINT_EVENT_CODE_MAP(kvm_entry, kvm_x86_exit_summary,
+	TP_PROTO(unsigned int vcpu_id),
+	TP_ARGS(vcpu_id),
+
+	TP_locvar(
+		const struct lttng_kvm_exit_slot *slot;
+	),
+
+	TP_code_pre(
+		tp_locvar->slot = lttng_kvm_exit_summary();
+		if (!tp_locvar->slot)
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_integer(int, pid, tp_locvar->slot->pid)
+		ctf_integer(unsigned int, vcpu_id, vcpu_id)
+		ctf_integer(unsigned int, exit_reason,
+			tp_locvar->slot->exit_reason)
+		ctf_integer(uint64_t, count, tp_locvar->slot->period.last.count)
+		ctf_integer(uint64_t, total, tp_locvar->slot->period.last.total)
+		ctf_integer(uint64_t, max, tp_locvar->slot->period.last.max)
+		ctf_array(uint32_t, hist, tp_locvar->slot->period.last.hist,
+			LTTNG_KERNEL_AGGREGATION_HIST_BUCKETS)
+	),
+
+	TP_code_post()
+)
+
 /*
  * Tracepoint for hypercall.
  */
@@ -418,6 +418,48 @@ LTTNG_TRACEPOINT_EVENT_INSTANCE(block_rq_with_error, block_rq_complete,
 
 #endif /* #else #if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,15,0)) */
 
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,12,0))
+/**
+ * block_rq_latency - block IO operation completed, with its latency
+ * @rq: block operations request
+ * @error: completion status
+ * @nr_bytes: number of completed bytes
+ *
+ * Recorded at completion of the requests whose issue has been seen by
+ * the probe module loaded with block_latency=1, with the time elapsed
+ * since the issue in trace clock units. Other completions are dropped.
+ */
+LTTNG_TRACEPOINT_EVENT_CODE_MAP(block_rq_complete, block_rq_latency,
+
+	TP_PROTO(struct request *rq, int error, unsigned int nr_bytes),
+
+	TP_ARGS(rq, error, nr_bytes),
+
+	TP_locvar(
+		uint64_t latency;
+	),
+
+	TP_code_pre(
+		tp_locvar->latency = lttng_block_rq_latency(rq);
+		if (!tp_locvar->latency)
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_integer(dev_t, dev,
+			rq->rq_disk ? disk_devt(rq->rq_disk) : 0)
+		ctf_integer(sector_t, sector, blk_rq_pos(rq))
+		ctf_integer(unsigned int, nr_sector, nr_bytes >> 9)
+		ctf_integer(int, error, error)
+		blk_rwbs_ctf_integer(unsigned int, rwbs,
+			lttng_req_op(rq), lttng_req_rw(rq), nr_bytes)
+		ctf_integer(uint64_t, latency, tp_locvar->latency)
+	),
+
+	TP_code_post()
+)
+#endif
+
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,12,0))
 LTTNG_TRACEPOINT_EVENT_CLASS(block_rq,
 
@@ -152,6 +152,107 @@ LTTNG_TRACEPOINT_EVENT_MAP(mm_compaction_migratepages,
 )
 #endif /* #else #if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,16,0)) */
 
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,0,0))
+/**
+ * mm_compaction_latency - zone compaction lasting at least the threshold
+ * @zone_start:		first pfn of the zone
+ * @migrate_pfn:	pfn of the migration scanner
+ * @free_pfn:		pfn of the free scanner
+ * @zone_end:		end pfn of the zone
+ * @sync:		whether the compaction is synchronous
+ * @status:		compaction status
+ *
+ * Recorded at the end of the zone compactions lasting at least
+ * compaction_latency_threshold_us, with the order and gfp flags of
+ * their direct compaction (order -1 for kcompactd), their status and
+ * their duration in trace clock units. Requires the probe module to be
+ * loaded with compaction_latency=1.
+ */
+LTTNG_TRACEPOINT_EVENT_CODE_MAP(mm_compaction_end,
+
+	mm_compaction_latency,
+
+	TP_PROTO(unsigned long zone_start, unsigned long migrate_pfn,
+		unsigned long free_pfn, unsigned long zone_end, bool sync,
+		int status),
+
+	TP_ARGS(zone_start, migrate_pfn, free_pfn, zone_end, sync, status),
+
+	TP_locvar(
+		int order;
+		gfp_t gfp_flags;
+		uint64_t duration;
+	),
+
+	TP_code_pre(
+		if (!lttng_compaction_latency(&tp_locvar->order,
+				&tp_locvar->gfp_flags, &tp_locvar->duration))
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_integer(int, order, tp_locvar->order)
+		ctf_integer(gfp_t, gfp_flags, tp_locvar->gfp_flags)
+		ctf_integer(int, sync, sync)
+		ctf_integer(int, status, status)
+		ctf_integer(uint64_t, duration, tp_locvar->duration)
+	),
+
+	TP_code_post()
+)
+
+/**
+ * mm_compaction_summary - durations of the zone compactions over a period
+ * @zone_start:		first pfn of the zone
+ * @migrate_pfn:	pfn of the migration scanner
+ * @free_pfn:		pfn of the free scanner
+ * @zone_end:		end pfn of the zone
+ * @sync:		whether the compaction is synchronous
+ * @status:		compaction status
+ *
+ * Recorded at the first end of a zone compaction on a cpu after the end
+ * of a period, with the count, total and maximum duration, and the log2
+ * histogram of the durations, in trace clock units, of the compactions
+ * on this cpu during the period. With compaction_latency_per_cgroup=1,
+ * the statistics are those of the cgroup of the compacting task,
+ * otherwise cgroup_id is 0. Requires the probe module to be loaded with
+ * compaction_latency=1.
+ */
+LTTNG_TRACEPOINT_EVENT_CODE_MAP(mm_compaction_end,
+
+	mm_compaction_summary,
+
+	TP_PROTO(unsigned long zone_start, unsigned long migrate_pfn,
+		unsigned long free_pfn, unsigned long zone_end, bool sync,
+		int status),
+
+	TP_ARGS(zone_start, migrate_pfn, free_pfn, zone_end, sync, status),
+
+	TP_locvar(
+		uint64_t cgroup_id;
+		const struct lttng_duration_stats *stats;
+	),
+
+	TP_code_pre(
+		tp_locvar->stats = lttng_compaction_summary(
+				&tp_locvar->cgroup_id);
+		if (!tp_locvar->stats)
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_integer(uint64_t, cgroup_id, tp_locvar->cgroup_id)
+		ctf_integer(uint64_t, count, tp_locvar->stats->count)
+		ctf_integer(uint64_t, total, tp_locvar->stats->total)
+		ctf_integer(uint64_t, max, tp_locvar->stats->max)
+		ctf_array(uint32_t, hist, tp_locvar->stats->hist,
+			LTTNG_KERNEL_AGGREGATION_HIST_BUCKETS)
+	),
+
+	TP_code_post()
+)
+#endif /* #if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,0,0)) */
+
 #endif /* LTTNG_TRACE_COMPACTION_H */
 
 /* This part must be outside protection */
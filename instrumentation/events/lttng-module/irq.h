@@ -120,6 +120,151 @@ LTTNG_TRACEPOINT_EVENT_INSTANCE_MAP(irq_softirq, softirq_raise,
 	TP_ARGS(vec_nr)
 )
 
+/**
+ * irq_handler_summary - durations of an irq handler over a period
+ * @irq: irq number
+ * @action: pointer to struct irqaction
+ * @ret: return value
+ *
+ * Recorded at the first exit of an irq handler on a cpu after the end of
+ * a period, with the count, total and maximum duration, and the log2
+ * histogram of the durations, in trace clock units, of the handlers of
+ * this irq on this cpu during the period. Requires the probe module to
+ * be loaded with irq_duration=1.
+ */
+LTTNG_TRACEPOINT_EVENT_CODE_MAP(irq_handler_exit, irq_handler_summary,
+
+	TP_PROTO(int irq, struct irqaction *action, int ret),
+
+	TP_ARGS(irq, action, ret),
+
+	TP_locvar(
+		const struct lttng_duration_stats *stats;
+	),
+
+	TP_code_pre(
+		tp_locvar->stats = lttng_irq_handler_summary();
+		if (!tp_locvar->stats)
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_integer(int, irq, irq)
+		ctf_integer(uint64_t, count, tp_locvar->stats->count)
+		ctf_integer(uint64_t, total, tp_locvar->stats->total)
+		ctf_integer(uint64_t, max, tp_locvar->stats->max)
+		ctf_array(uint32_t, hist, tp_locvar->stats->hist,
+			LTTNG_KERNEL_AGGREGATION_HIST_BUCKETS)
+	),
+
+	TP_code_post()
+)
+
+/**
+ * irq_handler_duration - irq handler lasting at least the duration threshold
+ * @irq: irq number
+ * @action: pointer to struct irqaction
+ * @ret: return value
+ *
+ * Recorded at the exit of the handlers lasting at least
+ * irq_duration_threshold_us, with their duration in trace clock units.
+ * Requires the probe module to be loaded with irq_duration=1.
+ */
+LTTNG_TRACEPOINT_EVENT_CODE_MAP(irq_handler_exit, irq_handler_duration,
+
+	TP_PROTO(int irq, struct irqaction *action, int ret),
+
+	TP_ARGS(irq, action, ret),
+
+	TP_locvar(
+		uint64_t duration;
+	),
+
+	TP_code_pre(
+		tp_locvar->duration = lttng_irq_handler_duration();
+		if (!tp_locvar->duration)
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_integer(int, irq, irq)
+		ctf_integer(int, ret, ret)
+		ctf_integer(uint64_t, duration, tp_locvar->duration)
+	),
+
+	TP_code_post()
+)
+
+/**
+ * softirq_summary - durations of a softirq handler over a period
+ * @vec_nr:  softirq vector number
+ *
+ * Recorded at the first exit of a softirq handler on a cpu after the end of
+ * a period, with the count, total and maximum duration, and the log2
+ * histogram of the durations, in trace clock units, of the handlers of
+ * this vector on this cpu during the period. Requires the probe module to
+ * be loaded with irq_duration=1.
+ */
+LTTNG_TRACEPOINT_EVENT_CODE_MAP(softirq_exit, softirq_summary,
+
+	TP_PROTO(unsigned int vec_nr),
+
+	TP_ARGS(vec_nr),
+
+	TP_locvar(
+		const struct lttng_duration_stats *stats;
+	),
+
+	TP_code_pre(
+		tp_locvar->stats = lttng_softirq_summary();
+		if (!tp_locvar->stats)
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_integer(unsigned int, vec, vec_nr)
+		ctf_integer(uint64_t, count, tp_locvar->stats->count)
+		ctf_integer(uint64_t, total, tp_locvar->stats->total)
+		ctf_integer(uint64_t, max, tp_locvar->stats->max)
+		ctf_array(uint32_t, hist, tp_locvar->stats->hist,
+			LTTNG_KERNEL_AGGREGATION_HIST_BUCKETS)
+	),
+
+	TP_code_post()
+)
+
+/**
+ * softirq_duration - softirq handler lasting at least the duration threshold
+ * @vec_nr:  softirq vector number
+ *
+ * Recorded at the exit of the handlers lasting at least
+ * irq_duration_threshold_us, with their duration in trace clock units.
+ * Requires the probe module to be loaded with irq_duration=1.
+ */
+LTTNG_TRACEPOINT_EVENT_CODE_MAP(softirq_exit, softirq_duration,
+
+	TP_PROTO(unsigned int vec_nr),
+
+	TP_ARGS(vec_nr),
+
+	TP_locvar(
+		uint64_t duration;
+	),
+
+	TP_code_pre(
+		tp_locvar->duration = lttng_softirq_duration();
+		if (!tp_locvar->duration)
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_integer(unsigned int, vec, vec_nr)
+		ctf_integer(uint64_t, duration, tp_locvar->duration)
+	),
+
+	TP_code_post()
+)
+
 #endif /*  LTTNG_TRACE_IRQ_H */
 
 /* This part must be outside protection */
@@ -115,6 +115,162 @@ LTTNG_TRACEPOINT_EVENT_INSTANCE(kmem_free, kmem_cache_free,
 	TP_ARGS(call_site, ptr)
 )
 
+/*
+ * Counters of the allocations and frees of a call site with given
+ * allocation flags on a cpu over a period, recorded at the first
+ * allocation or free of this call site after the end of the period.
+ * Requires the probe module to be loaded with kmem_aggregation=1.
+ */
+LTTNG_TRACEPOINT_EVENT_CLASS_CODE(kmem_alloc_summary,
+
+	TP_PROTO(unsigned long call_site, const void *ptr,
+		 size_t bytes_req, size_t bytes_alloc, gfp_t gfp_flags),
+
+	TP_ARGS(call_site, ptr, bytes_req, bytes_alloc, gfp_flags),
+
+	TP_locvar(
+		const struct lttng_kmem_site_stats *stats;
+		gfp_t gfp_flags;
+	),
+
+	TP_code_pre(
+		tp_locvar->stats = lttng_kmem_summary(&tp_locvar->gfp_flags);
+		if (!tp_locvar->stats)
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_integer_hex(unsigned long, call_site, call_site)
+		ctf_integer(gfp_t, gfp_flags, tp_locvar->gfp_flags)
+		ctf_integer(uint64_t, allocs, tp_locvar->stats->allocs)
+		ctf_integer(uint64_t, frees, tp_locvar->stats->frees)
+		ctf_integer(uint64_t, bytes_req, tp_locvar->stats->bytes_req)
+		ctf_integer(uint64_t, bytes_alloc, tp_locvar->stats->bytes_alloc)
+	),
+
+	TP_code_post()
+)
+
+LTTNG_TRACEPOINT_EVENT_INSTANCE_MAP(kmem_alloc_summary, kmalloc,
+
+	kmem_kmalloc_summary,
+
+	TP_PROTO(unsigned long call_site, const void *ptr,
+		 size_t bytes_req, size_t bytes_alloc, gfp_t gfp_flags),
+
+	TP_ARGS(call_site, ptr, bytes_req, bytes_alloc, gfp_flags)
+)
+
+LTTNG_TRACEPOINT_EVENT_INSTANCE_MAP(kmem_alloc_summary, kmem_cache_alloc,
+
+	kmem_cache_alloc_summary,
+
+	TP_PROTO(unsigned long call_site, const void *ptr,
+		 size_t bytes_req, size_t bytes_alloc, gfp_t gfp_flags),
+
+	TP_ARGS(call_site, ptr, bytes_req, bytes_alloc, gfp_flags)
+)
+
+LTTNG_TRACEPOINT_EVENT_CLASS_CODE(kmem_alloc_node_summary,
+
+	TP_PROTO(unsigned long call_site, const void *ptr,
+		 size_t bytes_req, size_t bytes_alloc,
+		 gfp_t gfp_flags, int node),
+
+	TP_ARGS(call_site, ptr, bytes_req, bytes_alloc, gfp_flags, node),
+
+	TP_locvar(
+		const struct lttng_kmem_site_stats *stats;
+		gfp_t gfp_flags;
+	),
+
+	TP_code_pre(
+		tp_locvar->stats = lttng_kmem_summary(&tp_locvar->gfp_flags);
+		if (!tp_locvar->stats)
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_integer_hex(unsigned long, call_site, call_site)
+		ctf_integer(gfp_t, gfp_flags, tp_locvar->gfp_flags)
+		ctf_integer(uint64_t, allocs, tp_locvar->stats->allocs)
+		ctf_integer(uint64_t, frees, tp_locvar->stats->frees)
+		ctf_integer(uint64_t, bytes_req, tp_locvar->stats->bytes_req)
+		ctf_integer(uint64_t, bytes_alloc, tp_locvar->stats->bytes_alloc)
+	),
+
+	TP_code_post()
+)
+
+LTTNG_TRACEPOINT_EVENT_INSTANCE_MAP(kmem_alloc_node_summary, kmalloc_node,
+
+	kmem_kmalloc_node_summary,
+
+	TP_PROTO(unsigned long call_site, const void *ptr,
+		 size_t bytes_req, size_t bytes_alloc,
+		 gfp_t gfp_flags, int node),
+
+	TP_ARGS(call_site, ptr, bytes_req, bytes_alloc, gfp_flags, node)
+)
+
+LTTNG_TRACEPOINT_EVENT_INSTANCE_MAP(kmem_alloc_node_summary, kmem_cache_alloc_node,
+
+	kmem_cache_alloc_node_summary,
+
+	TP_PROTO(unsigned long call_site, const void *ptr,
+		 size_t bytes_req, size_t bytes_alloc,
+		 gfp_t gfp_flags, int node),
+
+	TP_ARGS(call_site, ptr, bytes_req, bytes_alloc, gfp_flags, node)
+)
+
+LTTNG_TRACEPOINT_EVENT_CLASS_CODE(kmem_free_summary,
+
+	TP_PROTO(unsigned long call_site, const void *ptr),
+
+	TP_ARGS(call_site, ptr),
+
+	TP_locvar(
+		const struct lttng_kmem_site_stats *stats;
+		gfp_t gfp_flags;
+	),
+
+	TP_code_pre(
+		tp_locvar->stats = lttng_kmem_summary(&tp_locvar->gfp_flags);
+		if (!tp_locvar->stats)
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_integer_hex(unsigned long, call_site, call_site)
+		ctf_integer(gfp_t, gfp_flags, tp_locvar->gfp_flags)
+		ctf_integer(uint64_t, allocs, tp_locvar->stats->allocs)
+		ctf_integer(uint64_t, frees, tp_locvar->stats->frees)
+		ctf_integer(uint64_t, bytes_req, tp_locvar->stats->bytes_req)
+		ctf_integer(uint64_t, bytes_alloc, tp_locvar->stats->bytes_alloc)
+	),
+
+	TP_code_post()
+)
+
+LTTNG_TRACEPOINT_EVENT_INSTANCE_MAP(kmem_free_summary, kfree,
+
+	kmem_kfree_summary,
+
+	TP_PROTO(unsigned long call_site, const void *ptr),
+
+	TP_ARGS(call_site, ptr)
+)
+
+LTTNG_TRACEPOINT_EVENT_INSTANCE_MAP(kmem_free_summary, kmem_cache_free,
+
+	kmem_cache_free_summary,
+
+	TP_PROTO(unsigned long call_site, const void *ptr),
+
+	TP_ARGS(call_site, ptr)
+)
+
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,3,0))
 LTTNG_TRACEPOINT_EVENT_MAP(mm_page_free, kmem_mm_page_free,
 #else
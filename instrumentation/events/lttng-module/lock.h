@@ -61,6 +61,83 @@ LTTNG_TRACEPOINT_EVENT_INSTANCE(lock, lock_acquired,
 	TP_ARGS(lock, ip)
 )
 
+/**
+ * lock_contention_summary - waits for a lock class at a call site over a period
+ * @lock: lock being acquired
+ * @ip: call site of the acquisition
+ *
+ * Recorded at the first acquisition on a cpu after the end of a period,
+ * with the count, total and maximum wait, and the log2 histogram of the
+ * waits, in trace clock units, of the contended acquisitions of this
+ * lock class at this call site on this cpu during the period. Requires
+ * the probe module to be loaded with lock_contention=1.
+ */
+LTTNG_TRACEPOINT_EVENT_CODE_MAP(lock_acquired, lock_contention_summary,
+
+	TP_PROTO(struct lockdep_map *lock, unsigned long ip),
+
+	TP_ARGS(lock, ip),
+
+	TP_locvar(
+		const struct lttng_duration_stats *stats;
+	),
+
+	TP_code_pre(
+		tp_locvar->stats = lttng_lock_contention_summary();
+		if (!tp_locvar->stats)
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_string(name, lock->name)
+		ctf_integer_hex(void *, lock_class, lock->key)
+		ctf_integer_hex(unsigned long, ip, ip)
+		ctf_integer(uint64_t, count, tp_locvar->stats->count)
+		ctf_integer(uint64_t, total, tp_locvar->stats->total)
+		ctf_integer(uint64_t, max, tp_locvar->stats->max)
+		ctf_array(uint32_t, hist, tp_locvar->stats->hist,
+			LTTNG_KERNEL_AGGREGATION_HIST_BUCKETS)
+	),
+
+	TP_code_post()
+)
+
+/**
+ * lock_wait - contended acquisition waiting at least the wait threshold
+ * @lock: lock being acquired
+ * @ip: call site of the acquisition
+ *
+ * Recorded at the acquisitions which waited at least
+ * lock_contention_threshold_us, with their wait in trace clock units.
+ * Requires the probe module to be loaded with lock_contention=1.
+ */
+LTTNG_TRACEPOINT_EVENT_CODE_MAP(lock_acquired, lock_wait,
+
+	TP_PROTO(struct lockdep_map *lock, unsigned long ip),
+
+	TP_ARGS(lock, ip),
+
+	TP_locvar(
+		uint64_t wait;
+	),
+
+	TP_code_pre(
+		tp_locvar->wait = lttng_lock_wait();
+		if (!tp_locvar->wait)
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_string(name, lock->name)
+		ctf_integer_hex(void *, lockdep_addr, lock)
+		ctf_integer_hex(void *, lock_class, lock->key)
+		ctf_integer_hex(unsigned long, ip, ip)
+		ctf_integer(uint64_t, wait, tp_locvar->wait)
+	),
+
+	TP_code_post()
+)
+
 #endif /* CONFIG_LOCK_STAT */
 
 #endif /* CONFIG_LOCKDEP */
@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM lttng_breaker
+
+#if !defined(LTTNG_TRACE_LTTNG_BREAKER_H) || defined(TRACE_HEADER_MULTI_READ)
+#define LTTNG_TRACE_LTTNG_BREAKER_H
+
+#include <probes/lttng-tracepoint-event.h>
+#include <linux/types.h>
+
+/*
+ * Emitted when event id of stream stream_id is disarmed by its circuit
+ * breaker, after count records or cycles probe cycles within a window
+ * on cpu tripped_cpu, for cooldown_ms milliseconds (0: until its breaker
+ * is set again).
+ */
+LTTNG_TRACEPOINT_EVENT(lttng_breaker_trip,
+	TP_PROTO(struct lttng_session *session, unsigned int stream_id,
+		uint32_t id, unsigned int tripped_cpu, uint64_t count,
+		uint64_t cycles, unsigned int cooldown_ms),
+	TP_ARGS(session, stream_id, id, tripped_cpu, count, cycles,
+		cooldown_ms),
+	TP_FIELDS(
+		ctf_integer(unsigned int, stream_id, stream_id)
+		ctf_integer(uint32_t, id, id)
+		ctf_integer(unsigned int, tripped_cpu, tripped_cpu)
+		ctf_integer(uint64_t, count, count)
+		ctf_integer(uint64_t, cycles, cycles)
+		ctf_integer(unsigned int, cooldown_ms, cooldown_ms)
+	)
+)
+
+/*
+ * Emitted when event id of stream stream_id is armed again once its
+ * cooldown is over, having been tripped nr_trips times.
+ */
+LTTNG_TRACEPOINT_EVENT(lttng_breaker_reset,
+	TP_PROTO(struct lttng_session *session, unsigned int stream_id,
+		uint32_t id, uint64_t nr_trips),
+	TP_ARGS(session, stream_id, id, nr_trips),
+	TP_FIELDS(
+		ctf_integer(unsigned int, stream_id, stream_id)
+		ctf_integer(uint32_t, id, id)
+		ctf_integer(uint64_t, nr_trips, nr_trips)
+	)
+)
+
+#endif /*  LTTNG_TRACE_LTTNG_BREAKER_H */
+
+/* This part must be outside protection */
+#include <probes/define_trace.h>
@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM lttng_callstack
+
+#if !defined(LTTNG_TRACE_LTTNG_CALLSTACK_H) || defined(TRACE_HEADER_MULTI_READ)
+#define LTTNG_TRACE_LTTNG_CALLSTACK_H
+
+#include <probes/lttng-tracepoint-event.h>
+#include <linux/types.h>
+
+/*
+ * Emitted once per stack by the callstack_kernel_id and
+ * callstack_user_id contexts. Ids are per stream (stream_id) and per
+ * context.
+ */
+LTTNG_TRACEPOINT_EVENT(lttng_callstack_id,
+	TP_PROTO(struct lttng_session *session, unsigned int stream_id,
+		const char *context, uint32_t id,
+		const unsigned long *entries, unsigned int nr_entries),
+	TP_ARGS(session, stream_id, context, id, entries, nr_entries),
+	TP_FIELDS(
+		ctf_integer(unsigned int, stream_id, stream_id)
+		ctf_string(context, context)
+		ctf_integer(uint32_t, id, id)
+		ctf_sequence_hex(unsigned long, stack, entries,
+			unsigned int, nr_entries)
+	)
+)
+
+#endif /*  LTTNG_TRACE_LTTNG_CALLSTACK_H */
+
+/* This part must be outside protection */
+#include <probes/define_trace.h>
@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM lttng_coalesce
+
+#if !defined(LTTNG_TRACE_LTTNG_COALESCE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define LTTNG_TRACE_LTTNG_COALESCE_H
+
+#include <probes/lttng-tracepoint-event.h>
+#include <linux/types.h>
+
+/*
+ * Emitted on the stream (stream_id and cpu) of a run of identical
+ * records of an event in coalesce mode, once the run ends: count
+ * repeats of the record of event id were discarded, the last one
+ * timestamped last_timestamp.
+ */
+LTTNG_TRACEPOINT_EVENT(lttng_coalesce_repeats,
+	TP_PROTO(struct lttng_session *session, unsigned int stream_id,
+		uint32_t id, uint64_t count, uint64_t last_timestamp),
+	TP_ARGS(session, stream_id, id, count, last_timestamp),
+	TP_FIELDS(
+		ctf_integer(unsigned int, stream_id, stream_id)
+		ctf_integer(uint32_t, id, id)
+		ctf_integer(uint64_t, count, count)
+		ctf_integer(uint64_t, last_timestamp, last_timestamp)
+	)
+)
+
+#endif /*  LTTNG_TRACE_LTTNG_COALESCE_H */
+
+/* This part must be outside protection */
+#include <probes/define_trace.h>
@@ -76,6 +76,20 @@ LTTNG_TRACEPOINT_EVENT(lttng_statedump_process_state,
 	)
 )
 
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,8,0))
+LTTNG_TRACEPOINT_EVENT(lttng_statedump_pid_ns,
+	TP_PROTO(struct lttng_session *session,
+		struct pid_namespace *pid_ns),
+	TP_ARGS(session, pid_ns),
+	TP_FIELDS(
+		ctf_integer(unsigned int, ns_inum, pid_ns->lttng_proc_inum)
+		ctf_integer(int, ns_level, pid_ns->level)
+		ctf_integer(unsigned int, parent_ns_inum,
+			pid_ns->parent ? pid_ns->parent->lttng_proc_inum : 0)
+	)
+)
+#endif
+
 LTTNG_TRACEPOINT_EVENT(lttng_statedump_file_descriptor,
 	TP_PROTO(struct lttng_session *session,
 		struct task_struct *p, int fd, const char *filename,
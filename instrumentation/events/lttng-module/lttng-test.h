@@ -52,6 +52,82 @@ LTTNG_TRACEPOINT_EVENT(lttng_test_filter_event,
 	)
 )
 
+/*
+ * Serialization benchmark events, each exercising one kind of field.
+ * Fired in loops through the lttng-test-event-loop proc file.
+ */
+LTTNG_TRACEPOINT_ENUM(
+	lttng_test_event_enum,
+	TP_ENUM_VALUES(
+		ctf_enum_value("ZERO", 0)
+		ctf_enum_value("ONE", 1)
+		ctf_enum_range("SMALL", 2, 15)
+		ctf_enum_range("LARGE", 16, 255)
+	)
+)
+
+LTTNG_TRACEPOINT_EVENT(lttng_test_event_integers,
+	TP_PROTO(uint64_t value),
+	TP_ARGS(value),
+	TP_FIELDS(
+		ctf_integer(uint8_t, u8field, value)
+		ctf_integer(uint16_t, u16field, value)
+		ctf_integer(uint32_t, u32field, value)
+		ctf_integer(uint64_t, u64field, value)
+		ctf_integer(int64_t, s64field, value)
+		ctf_integer_hex(uint64_t, hexfield, value)
+		ctf_integer_network(uint32_t, netfield, value)
+	)
+)
+
+LTTNG_TRACEPOINT_EVENT(lttng_test_event_string,
+	TP_PROTO(const char *str),
+	TP_ARGS(str),
+	TP_FIELDS(
+		ctf_string(stringfield, str)
+	)
+)
+
+LTTNG_TRACEPOINT_EVENT(lttng_test_event_string_bounded,
+	TP_PROTO(const char *str),
+	TP_ARGS(str),
+	TP_FIELDS(
+		ctf_string_bounded(stringfield, str, 513)
+	)
+)
+
+LTTNG_TRACEPOINT_EVENT(lttng_test_event_user_string,
+	TP_PROTO(const char __user *str),
+	TP_ARGS(str),
+	TP_FIELDS(
+		ctf_user_string_bounded(stringfield, str, 513)
+	)
+)
+
+LTTNG_TRACEPOINT_EVENT(lttng_test_event_sequence,
+	TP_PROTO(const uint32_t *values, size_t len),
+	TP_ARGS(values, len),
+	TP_FIELDS(
+		ctf_sequence(uint32_t, seqfield, values, size_t, len)
+	)
+)
+
+LTTNG_TRACEPOINT_EVENT(lttng_test_event_array,
+	TP_PROTO(const uint64_t *values),
+	TP_ARGS(values),
+	TP_FIELDS(
+		ctf_array(uint64_t, arrfield, values, 16)
+	)
+)
+
+LTTNG_TRACEPOINT_EVENT(lttng_test_event_enum,
+	TP_PROTO(int value),
+	TP_ARGS(value),
+	TP_FIELDS(
+		ctf_enum(lttng_test_event_enum, int, enumfield, value)
+	)
+)
+
 #endif /*  LTTNG_TRACE_LTTNG_TEST_H */
 
 /* This part must be outside protection */
@@ -15,6 +15,14 @@ LTTNG_TRACEPOINT_EVENT(lttng_logger,
 	)
 )
 
+LTTNG_TRACEPOINT_EVENT(lttng_calibrate,
+	TP_PROTO(unsigned int iteration),
+	TP_ARGS(iteration),
+	TP_FIELDS(
+		ctf_integer(unsigned int, iteration, iteration)
+	)
+)
+
 #endif /* LTTNG_TRACE_LTTNG_H */
 
 /* This part must be outside protection */
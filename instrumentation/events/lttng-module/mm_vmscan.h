@@ -221,6 +221,89 @@ LTTNG_TRACEPOINT_EVENT_INSTANCE(mm_vmscan_direct_reclaim_end_template, mm_vmscan
 	TP_ARGS(nr_reclaimed)
 )
 
+/**
+ * mm_vmscan_direct_reclaim_latency - direct reclaim lasting the threshold
+ * @nr_reclaimed:	number of pages reclaimed
+ *
+ * Recorded at the end of the direct reclaims lasting at least
+ * reclaim_latency_threshold_us, with their order, gfp flags and
+ * duration in trace clock units. Requires the probe module to be
+ * loaded with reclaim_latency=1.
+ */
+LTTNG_TRACEPOINT_EVENT_CODE_MAP(mm_vmscan_direct_reclaim_end,
+
+	mm_vmscan_direct_reclaim_latency,
+
+	TP_PROTO(unsigned long nr_reclaimed),
+
+	TP_ARGS(nr_reclaimed),
+
+	TP_locvar(
+		int order;
+		gfp_t gfp_flags;
+		uint64_t duration;
+	),
+
+	TP_code_pre(
+		if (!lttng_vmscan_direct_reclaim_latency(&tp_locvar->order,
+				&tp_locvar->gfp_flags, &tp_locvar->duration))
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_integer(int, order, tp_locvar->order)
+		ctf_integer(gfp_t, gfp_flags, tp_locvar->gfp_flags)
+		ctf_integer(unsigned long, nr_reclaimed, nr_reclaimed)
+		ctf_integer(uint64_t, duration, tp_locvar->duration)
+	),
+
+	TP_code_post()
+)
+
+/**
+ * mm_vmscan_direct_reclaim_summary - direct reclaim durations over a period
+ * @nr_reclaimed:	number of pages reclaimed
+ *
+ * Recorded at the first end of a direct reclaim on a cpu after the end
+ * of a period, with the count, total and maximum duration, and the log2
+ * histogram of the durations, in trace clock units, of the direct
+ * reclaims on this cpu during the period. With
+ * reclaim_latency_per_cgroup=1, the statistics are those of the cgroup
+ * of the reclaiming task, otherwise cgroup_id is 0. Requires the probe
+ * module to be loaded with reclaim_latency=1.
+ */
+LTTNG_TRACEPOINT_EVENT_CODE_MAP(mm_vmscan_direct_reclaim_end,
+
+	mm_vmscan_direct_reclaim_summary,
+
+	TP_PROTO(unsigned long nr_reclaimed),
+
+	TP_ARGS(nr_reclaimed),
+
+	TP_locvar(
+		uint64_t cgroup_id;
+		const struct lttng_duration_stats *stats;
+	),
+
+	TP_code_pre(
+		tp_locvar->stats = lttng_vmscan_direct_reclaim_summary(
+				&tp_locvar->cgroup_id);
+		if (!tp_locvar->stats)
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_integer(uint64_t, cgroup_id, tp_locvar->cgroup_id)
+		ctf_integer(uint64_t, count, tp_locvar->stats->count)
+		ctf_integer(uint64_t, total, tp_locvar->stats->total)
+		ctf_integer(uint64_t, max, tp_locvar->stats->max)
+		ctf_array(uint32_t, hist, tp_locvar->stats->hist,
+			LTTNG_KERNEL_AGGREGATION_HIST_BUCKETS)
+	),
+
+	TP_code_post()
+)
+
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,16,0))
 LTTNG_TRACEPOINT_EVENT_MAP(mm_shrink_slab_start,
 
@@ -553,6 +553,108 @@ LTTNG_TRACEPOINT_EVENT_INSTANCE_MAP(net_dev_template,
 
 	TP_ARGS(skb)
 )
+
+/**
+ * net_dev_xmit_flow_summary - packets transmitted by a flow over a period
+ * @skb:	pointer to struct sk_buff
+ * @rc:		return value from dev_hard_start_xmit
+ * @dev:	pointer to struct net_device
+ * @skb_len:	length of the packet
+ *
+ * Recorded at the first transmission of a flow on a cpu after the end
+ * of a period, with the 5-tuple of the flow, IPv4 addresses being
+ * mapped into IPv6, and the packets and bytes it transmitted on this
+ * cpu during the period, with the count, total and maximum of their
+ * queuing latencies in trace clock units. Requires the probe module to
+ * be loaded with net_flow=1.
+ */
+LTTNG_TRACEPOINT_EVENT_CODE_MAP(net_dev_xmit,
+
+	net_dev_xmit_flow_summary,
+
+	TP_PROTO(struct sk_buff *skb,
+		 int rc,
+		 struct net_device *dev,
+		 unsigned int skb_len),
+
+	TP_ARGS(skb, rc, dev, skb_len),
+
+	TP_locvar(
+		const struct lttng_net_flow *flow;
+	),
+
+	TP_code_pre(
+		tp_locvar->flow = lttng_net_flow_summary();
+		if (!tp_locvar->flow)
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_integer(int, ifindex, tp_locvar->flow->key.ifindex)
+		ctf_integer(uint8_t, family, tp_locvar->flow->key.family)
+		ctf_integer(uint8_t, protocol, tp_locvar->flow->key.protocol)
+		ctf_array_network_hex(uint16_t, saddr,
+			tp_locvar->flow->key.saddr.s6_addr16, 8)
+		ctf_array_network_hex(uint16_t, daddr,
+			tp_locvar->flow->key.daddr.s6_addr16, 8)
+		ctf_integer_network(uint16_t, sport, tp_locvar->flow->key.sport)
+		ctf_integer_network(uint16_t, dport, tp_locvar->flow->key.dport)
+		ctf_integer(uint64_t, packets, tp_locvar->flow->last.packets)
+		ctf_integer(uint64_t, bytes, tp_locvar->flow->last.bytes)
+		ctf_integer(uint64_t, latency_packets,
+			tp_locvar->flow->last.latency_packets)
+		ctf_integer(uint64_t, latency_total,
+			tp_locvar->flow->last.latency_total)
+		ctf_integer(uint64_t, latency_max,
+			tp_locvar->flow->last.latency_max)
+	),
+
+	TP_code_post()
+)
+
+/**
+ * net_if_receive_skb_flow_summary - packets received by a flow over a period
+ * @skb:	pointer to struct sk_buff
+ *
+ * Recorded at the first reception of a flow on a cpu after the end of
+ * a period, with the 5-tuple of the flow and the packets and bytes it
+ * received on this cpu during the period. Requires the probe module to
+ * be loaded with net_flow=1.
+ */
+LTTNG_TRACEPOINT_EVENT_CODE_MAP(netif_receive_skb,
+
+	net_if_receive_skb_flow_summary,
+
+	TP_PROTO(struct sk_buff *skb),
+
+	TP_ARGS(skb),
+
+	TP_locvar(
+		const struct lttng_net_flow *flow;
+	),
+
+	TP_code_pre(
+		tp_locvar->flow = lttng_net_flow_summary();
+		if (!tp_locvar->flow)
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_integer(int, ifindex, tp_locvar->flow->key.ifindex)
+		ctf_integer(uint8_t, family, tp_locvar->flow->key.family)
+		ctf_integer(uint8_t, protocol, tp_locvar->flow->key.protocol)
+		ctf_array_network_hex(uint16_t, saddr,
+			tp_locvar->flow->key.saddr.s6_addr16, 8)
+		ctf_array_network_hex(uint16_t, daddr,
+			tp_locvar->flow->key.daddr.s6_addr16, 8)
+		ctf_integer_network(uint16_t, sport, tp_locvar->flow->key.sport)
+		ctf_integer_network(uint16_t, dport, tp_locvar->flow->key.dport)
+		ctf_integer(uint64_t, packets, tp_locvar->flow->last.packets)
+		ctf_integer(uint64_t, bytes, tp_locvar->flow->last.bytes)
+	),
+
+	TP_code_post()
+)
 #endif /* LTTNG_TRACE_NET_H */
 
 /* This part must be outside protection */
@@ -46,6 +46,94 @@ LTTNG_TRACEPOINT_EVENT_INSTANCE_MAP(power_cpu, cpu_frequency,
 	TP_ARGS(frequency, cpu_id)
 )
 
+/**
+ * power_cpu_idle_residency - residency of a cpu in an idle state
+ * @state:	PWR_EVENT_EXIT
+ * @cpu_id:	cpu exiting the idle state
+ *
+ * Recorded at the first exit of an idle state of a cpu after the end of
+ * a period, with the count, total and maximum residency, and the log2
+ * histogram of the residencies, in trace clock units, of the cpu in
+ * this idle state during the period. Requires the probe module to be
+ * loaded with power_residency=1.
+ */
+LTTNG_TRACEPOINT_EVENT_CODE_MAP(cpu_idle,
+
+	power_cpu_idle_residency,
+
+	TP_PROTO(unsigned int state, unsigned int cpu_id),
+
+	TP_ARGS(state, cpu_id),
+
+	TP_locvar(
+		unsigned int idle_state;
+		const struct lttng_duration_stats *stats;
+	),
+
+	TP_code_pre(
+		tp_locvar->stats = lttng_power_cpu_idle_residency(state,
+				cpu_id, &tp_locvar->idle_state);
+		if (!tp_locvar->stats)
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_integer(u32, cpu_id, cpu_id)
+		ctf_integer(u32, state, tp_locvar->idle_state)
+		ctf_integer(uint64_t, count, tp_locvar->stats->count)
+		ctf_integer(uint64_t, total, tp_locvar->stats->total)
+		ctf_integer(uint64_t, max, tp_locvar->stats->max)
+		ctf_array(uint32_t, hist, tp_locvar->stats->hist,
+			LTTNG_KERNEL_AGGREGATION_HIST_BUCKETS)
+	),
+
+	TP_code_post()
+)
+
+/**
+ * power_cpu_frequency_residency - residency of a cpu at a frequency
+ * @frequency:	new frequency of the cpu
+ * @cpu_id:	cpu changing frequency
+ *
+ * Recorded at the first change of a cpu from a frequency after the end
+ * of a period, with the count, total and maximum residency, and the log2
+ * histogram of the residencies, in trace clock units, of the cpu at
+ * this frequency during the period. Requires the probe module to be
+ * loaded with power_residency=1.
+ */
+LTTNG_TRACEPOINT_EVENT_CODE_MAP(cpu_frequency,
+
+	power_cpu_frequency_residency,
+
+	TP_PROTO(unsigned int frequency, unsigned int cpu_id),
+
+	TP_ARGS(frequency, cpu_id),
+
+	TP_locvar(
+		unsigned int freq;
+		const struct lttng_duration_stats *stats;
+	),
+
+	TP_code_pre(
+		tp_locvar->stats = lttng_power_cpu_frequency_residency(frequency,
+				cpu_id, &tp_locvar->freq);
+		if (!tp_locvar->stats)
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_integer(u32, cpu_id, cpu_id)
+		ctf_integer(u32, frequency, tp_locvar->freq)
+		ctf_integer(uint64_t, count, tp_locvar->stats->count)
+		ctf_integer(uint64_t, total, tp_locvar->stats->total)
+		ctf_integer(uint64_t, max, tp_locvar->stats->max)
+		ctf_array(uint32_t, hist, tp_locvar->stats->hist,
+			LTTNG_KERNEL_AGGREGATION_HIST_BUCKETS)
+	),
+
+	TP_code_post()
+)
+
 LTTNG_TRACEPOINT_EVENT_MAP(machine_suspend,
 
 	power_machine_suspend,
@@ -264,6 +264,165 @@ LTTNG_TRACEPOINT_EVENT(sched_switch,
 	)
 )
 
+/*
+ * Compact variant of sched_switch, to enable instead of it on busy
+ * systems: 12 bytes of payload instead of 56. The task states fit in
+ * 16 bits, and priorities, from -101 (deadline) to 39, in 8 bits.
+ *
+ * The comms are not recorded: the comm of the previous task is given
+ * by the procname_interned context, which records each comm once per
+ * packet and cpu, and the comm of the next task by its next switch
+ * out, sched_process_exec and the state dump.
+ */
+LTTNG_TRACEPOINT_EVENT_MAP(sched_switch,
+
+	sched_switch_compact,
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,4,0))
+	TP_PROTO(bool preempt,
+		 struct task_struct *prev,
+		 struct task_struct *next),
+
+	TP_ARGS(preempt, prev, next),
+#else
+	TP_PROTO(struct task_struct *prev,
+		 struct task_struct *next),
+
+	TP_ARGS(prev, next),
+#endif /* #if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,4,0)) */
+
+	TP_FIELDS(
+		ctf_integer(pid_t, prev_tid, prev->pid)
+		ctf_integer(pid_t, next_tid, next->pid)
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,4,0))
+		ctf_integer(uint16_t, prev_state, __trace_sched_switch_state(preempt, prev))
+#else
+		ctf_integer(uint16_t, prev_state, __trace_sched_switch_state(prev))
+#endif
+		ctf_integer(int8_t, prev_prio, prev->prio - MAX_RT_PRIO)
+		ctf_integer(int8_t, next_prio, next->prio - MAX_RT_PRIO)
+	)
+)
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,4,0))
+/*
+ * Blocked times of the tasks of a process in a kernel stack over a
+ * period, recorded at the first switch in of one of its tasks blocked
+ * in this stack on a cpu after the end of the period: count, total and
+ * maximum blocked time, and their log2 histogram, in trace clock units.
+ * Requires the probe module to be loaded with offcpu=1.
+ */
+LTTNG_TRACEPOINT_EVENT_CODE_MAP(sched_switch,
+
+	sched_offcpu_summary,
+
+	TP_PROTO(bool preempt,
+		 struct task_struct *prev,
+		 struct task_struct *next),
+
+	TP_ARGS(preempt, prev, next),
+
+	TP_locvar(
+		const struct lttng_offcpu_slot *slot;
+	),
+
+	TP_code_pre(
+		tp_locvar->slot = lttng_sched_offcpu_summary();
+		if (!tp_locvar->slot)
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_integer(pid_t, pid, tp_locvar->slot->pid)
+		ctf_sequence_hex(unsigned long, stack,
+			tp_locvar->slot->stack.entries, unsigned int,
+			tp_locvar->slot->stack.nr_entries)
+		ctf_integer(uint64_t, count, tp_locvar->slot->period.last.count)
+		ctf_integer(uint64_t, total, tp_locvar->slot->period.last.total)
+		ctf_integer(uint64_t, max, tp_locvar->slot->period.last.max)
+		ctf_array(uint32_t, hist, tp_locvar->slot->period.last.hist,
+			LTTNG_KERNEL_AGGREGATION_HIST_BUCKETS)
+	),
+
+	TP_code_post()
+)
+
+/*
+ * Run queue latency of a task woken up, recorded when it is switched
+ * in if it waited at least the threshold since its wakeup, in trace
+ * clock units. Requires the probe module to be loaded with
+ * wakeup_latency=1.
+ */
+LTTNG_TRACEPOINT_EVENT_CODE_MAP(sched_switch,
+
+	sched_wakeup_latency,
+
+	TP_PROTO(bool preempt,
+		 struct task_struct *prev,
+		 struct task_struct *next),
+
+	TP_ARGS(preempt, prev, next),
+
+	TP_locvar(
+		uint64_t latency;
+		pid_t waker_tid;
+	),
+
+	TP_code_pre(
+		if (!lttng_sched_wakeup_latency(&tp_locvar->latency,
+				&tp_locvar->waker_tid))
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_integer(pid_t, tid, next->pid)
+		ctf_integer(int, prio, next->prio - MAX_RT_PRIO)
+		ctf_integer(uint64_t, latency, tp_locvar->latency)
+		ctf_integer(int, target_cpu, task_cpu(next))
+		ctf_integer(pid_t, waker_tid, tp_locvar->waker_tid)
+	),
+
+	TP_code_post()
+)
+
+/*
+ * Run queue latencies of the tasks switched in on a cpu over a period,
+ * recorded at the first switch in after the end of the period: count,
+ * total and maximum latency, and their log2 histogram, in trace clock
+ * units. Requires the probe module to be loaded with wakeup_latency=1.
+ */
+LTTNG_TRACEPOINT_EVENT_CODE_MAP(sched_switch,
+
+	sched_wakeup_latency_summary,
+
+	TP_PROTO(bool preempt,
+		 struct task_struct *prev,
+		 struct task_struct *next),
+
+	TP_ARGS(preempt, prev, next),
+
+	TP_locvar(
+		const struct lttng_duration_stats *stats;
+	),
+
+	TP_code_pre(
+		tp_locvar->stats = lttng_sched_wakeup_latency_summary();
+		if (!tp_locvar->stats)
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_integer(uint64_t, count, tp_locvar->stats->count)
+		ctf_integer(uint64_t, total, tp_locvar->stats->total)
+		ctf_integer(uint64_t, max, tp_locvar->stats->max)
+		ctf_array(uint32_t, hist, tp_locvar->stats->hist,
+			LTTNG_KERNEL_AGGREGATION_HIST_BUCKETS)
+	),
+
+	TP_code_post()
+)
+#endif /* #if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,4,0)) */
+
 /*
  * Tracepoint for a task being migrated:
  */
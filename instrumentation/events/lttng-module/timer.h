@@ -124,6 +124,84 @@ LTTNG_TRACEPOINT_EVENT_INSTANCE(timer_class, timer_expire_exit,
 	TP_ARGS(timer)
 )
 
+/**
+ * timer_callback_duration - timer callback lasting at least the threshold
+ * @timer:	pointer to struct timer_list
+ *
+ * Recorded at the end of the timer callbacks lasting at least
+ * timer_duration_threshold_us, with their function and duration in
+ * trace clock units. Requires the probe module to be loaded with
+ * timer_duration=1.
+ */
+LTTNG_TRACEPOINT_EVENT_CODE_MAP(timer_expire_exit,
+
+	timer_callback_duration,
+
+	TP_PROTO(struct timer_list *timer),
+
+	TP_ARGS(timer),
+
+	TP_locvar(
+		void *func;
+		uint64_t duration;
+	),
+
+	TP_code_pre(
+		if (!lttng_timer_callback_duration(&tp_locvar->func,
+				&tp_locvar->duration))
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_integer_hex(void *, timer, timer)
+		ctf_integer_hex(void *, function, tp_locvar->func)
+		ctf_integer(uint64_t, duration, tp_locvar->duration)
+	),
+
+	TP_code_post()
+)
+
+/**
+ * timer_callback_summary - durations of a timer function over a period
+ * @timer:	pointer to struct timer_list
+ *
+ * Recorded at the first end of a timer callback on a cpu after the end
+ * of a period, with the count, total and maximum duration, and the log2
+ * histogram of the durations, in trace clock units, of the callbacks of
+ * this function on this cpu during the period. Requires the probe
+ * module to be loaded with timer_duration=1.
+ */
+LTTNG_TRACEPOINT_EVENT_CODE_MAP(timer_expire_exit,
+
+	timer_callback_summary,
+
+	TP_PROTO(struct timer_list *timer),
+
+	TP_ARGS(timer),
+
+	TP_locvar(
+		void *func;
+		const struct lttng_duration_stats *stats;
+	),
+
+	TP_code_pre(
+		tp_locvar->stats = lttng_timer_callback_summary(&tp_locvar->func);
+		if (!tp_locvar->stats)
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_integer_hex(void *, function, tp_locvar->func)
+		ctf_integer(uint64_t, count, tp_locvar->stats->count)
+		ctf_integer(uint64_t, total, tp_locvar->stats->total)
+		ctf_integer(uint64_t, max, tp_locvar->stats->max)
+		ctf_array(uint32_t, hist, tp_locvar->stats->hist,
+			LTTNG_KERNEL_AGGREGATION_HIST_BUCKETS)
+	),
+
+	TP_code_post()
+)
+
 /**
  * timer_cancel - called when the timer is canceled
  * @timer:	pointer to struct timer_list
@@ -251,6 +329,84 @@ LTTNG_TRACEPOINT_EVENT_INSTANCE_MAP(timer_hrtimer_class, hrtimer_expire_exit,
 	TP_ARGS(hrtimer)
 )
 
+/**
+ * timer_hrtimer_callback_duration - hrtimer callback lasting at least the threshold
+ * @hrtimer:	pointer to struct hrtimer
+ *
+ * Recorded at the end of the hrtimer callbacks lasting at least
+ * timer_duration_threshold_us, with their function and duration in
+ * trace clock units. Requires the probe module to be loaded with
+ * timer_duration=1.
+ */
+LTTNG_TRACEPOINT_EVENT_CODE_MAP(hrtimer_expire_exit,
+
+	timer_hrtimer_callback_duration,
+
+	TP_PROTO(struct hrtimer *hrtimer),
+
+	TP_ARGS(hrtimer),
+
+	TP_locvar(
+		void *func;
+		uint64_t duration;
+	),
+
+	TP_code_pre(
+		if (!lttng_timer_callback_duration(&tp_locvar->func,
+				&tp_locvar->duration))
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_integer_hex(void *, hrtimer, hrtimer)
+		ctf_integer_hex(void *, function, tp_locvar->func)
+		ctf_integer(uint64_t, duration, tp_locvar->duration)
+	),
+
+	TP_code_post()
+)
+
+/**
+ * timer_hrtimer_callback_summary - durations of a hrtimer function over a period
+ * @hrtimer:	pointer to struct hrtimer
+ *
+ * Recorded at the first end of a hrtimer callback on a cpu after the end
+ * of a period, with the count, total and maximum duration, and the log2
+ * histogram of the durations, in trace clock units, of the callbacks of
+ * this function on this cpu during the period. Requires the probe
+ * module to be loaded with timer_duration=1.
+ */
+LTTNG_TRACEPOINT_EVENT_CODE_MAP(hrtimer_expire_exit,
+
+	timer_hrtimer_callback_summary,
+
+	TP_PROTO(struct hrtimer *hrtimer),
+
+	TP_ARGS(hrtimer),
+
+	TP_locvar(
+		void *func;
+		const struct lttng_duration_stats *stats;
+	),
+
+	TP_code_pre(
+		tp_locvar->stats = lttng_timer_callback_summary(&tp_locvar->func);
+		if (!tp_locvar->stats)
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_integer_hex(void *, function, tp_locvar->func)
+		ctf_integer(uint64_t, count, tp_locvar->stats->count)
+		ctf_integer(uint64_t, total, tp_locvar->stats->total)
+		ctf_integer(uint64_t, max, tp_locvar->stats->max)
+		ctf_array(uint32_t, hist, tp_locvar->stats->hist,
+			LTTNG_KERNEL_AGGREGATION_HIST_BUCKETS)
+	),
+
+	TP_code_post()
+)
+
 /**
  * hrtimer_cancel - called when the hrtimer is canceled
  * @hrtimer:	pointer to struct hrtimer
@@ -105,6 +105,84 @@ LTTNG_TRACEPOINT_EVENT_INSTANCE(workqueue_work, workqueue_execute_end,
 	TP_ARGS(work)
 )
 
+/**
+ * workqueue_callback_duration - work callback lasting at least the threshold
+ * @work:	pointer to struct work_struct
+ *
+ * Recorded at the end of the callbacks lasting at least
+ * work_duration_threshold_us, with their function and duration in trace
+ * clock units. Requires the probe module to be loaded with
+ * work_duration=1.
+ */
+LTTNG_TRACEPOINT_EVENT_CODE_MAP(workqueue_execute_end,
+
+	workqueue_callback_duration,
+
+	TP_PROTO(struct work_struct *work),
+
+	TP_ARGS(work),
+
+	TP_locvar(
+		void *func;
+		uint64_t duration;
+	),
+
+	TP_code_pre(
+		if (!lttng_workqueue_callback_duration(&tp_locvar->func,
+				&tp_locvar->duration))
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_integer_hex(void *, work, work)
+		ctf_integer_hex(void *, function, tp_locvar->func)
+		ctf_integer(uint64_t, duration, tp_locvar->duration)
+	),
+
+	TP_code_post()
+)
+
+/**
+ * workqueue_callback_summary - durations of a work function over a period
+ * @work:	pointer to struct work_struct
+ *
+ * Recorded at the first end of a callback on a cpu after the end of a
+ * period, with the count, total and maximum duration, and the log2
+ * histogram of the durations, in trace clock units, of the callbacks of
+ * this function on this cpu during the period. Requires the probe
+ * module to be loaded with work_duration=1.
+ */
+LTTNG_TRACEPOINT_EVENT_CODE_MAP(workqueue_execute_end,
+
+	workqueue_callback_summary,
+
+	TP_PROTO(struct work_struct *work),
+
+	TP_ARGS(work),
+
+	TP_locvar(
+		void *func;
+		const struct lttng_duration_stats *stats;
+	),
+
+	TP_code_pre(
+		tp_locvar->stats = lttng_workqueue_callback_summary(&tp_locvar->func);
+		if (!tp_locvar->stats)
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_integer_hex(void *, function, tp_locvar->func)
+		ctf_integer(uint64_t, count, tp_locvar->stats->count)
+		ctf_integer(uint64_t, total, tp_locvar->stats->total)
+		ctf_integer(uint64_t, max, tp_locvar->stats->max)
+		ctf_array(uint32_t, hist, tp_locvar->stats->hist,
+			LTTNG_KERNEL_AGGREGATION_HIST_BUCKETS)
+	),
+
+	TP_code_post()
+)
+
 #endif /*  LTTNG_TRACE_WORKQUEUE_H */
 
 /* This part must be outside protection */
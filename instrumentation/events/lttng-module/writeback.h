@@ -726,6 +726,58 @@ LTTNG_TRACEPOINT_EVENT_INSTANCE(writeback_single_inode_template, writeback_singl
 )
 #endif
 
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,3,0))
+/**
+ * writeback_bdi_summary - writeback activity of a domain over a period
+ * @inode:		inode written back
+ * @wbc:		writeback control of the inode writeback
+ * @nr_to_write:	pages to write at the start of the inode writeback
+ *
+ * Recorded at the first writeback of an inode of a writeback domain (a
+ * backing device, and with writeback_summary_per_cgroup=1 a memory
+ * cgroup, 0 otherwise) after the end of a period, with the pages
+ * dirtied and written, the time the inodes written waited dirty, and
+ * the time tasks were throttled dirtying pages, in nanoseconds, during
+ * the period. Requires the probe module to be loaded with
+ * writeback_summary=1.
+ */
+LTTNG_TRACEPOINT_EVENT_CODE_MAP(writeback_single_inode,
+
+	writeback_bdi_summary,
+
+	TP_PROTO(struct inode *inode,
+		 struct writeback_control *wbc,
+		 unsigned long nr_to_write),
+
+	TP_ARGS(inode, wbc, nr_to_write),
+
+	TP_locvar(
+		const struct lttng_wb_summary *summary;
+	),
+
+	TP_code_pre(
+		tp_locvar->summary = lttng_writeback_bdi_summary(inode);
+		if (!tp_locvar->summary)
+			goto __post;
+	),
+
+	TP_FIELDS(
+		ctf_array_text(char, name, tp_locvar->summary->bdi, 32)
+		ctf_integer(uint64_t, cgroup_id, tp_locvar->summary->cgroup_id)
+		ctf_integer(uint64_t, dirtied,
+			tp_locvar->summary->counters[LTTNG_WB_DIRTIED])
+		ctf_integer(uint64_t, written,
+			tp_locvar->summary->counters[LTTNG_WB_WRITTEN])
+		ctf_integer(uint64_t, wait_ns,
+			tp_locvar->summary->counters[LTTNG_WB_WAIT_NS])
+		ctf_integer(uint64_t, throttle_ns,
+			tp_locvar->summary->counters[LTTNG_WB_THROTTLE_NS])
+	),
+
+	TP_code_post()
+)
+#endif /* #if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,3,0)) */
+
 #endif /* LTTNG_TRACE_WRITEBACK_H */
 
 /* This part must be outside protection */
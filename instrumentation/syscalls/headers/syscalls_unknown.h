@@ -47,6 +47,56 @@ LTTNG_TRACEPOINT_EVENT(compat_syscall_exit_unknown,
 		ctf_array(unsigned long, args, args, UNKNOWN_SYSCALL_NRARGS)
 	)
 )
+
+/* Entry and exit of a system call, recorded at exit (latency mode). */
+LTTNG_TRACEPOINT_EVENT(syscall_exit_latency,
+	TP_PROTO(int id, long ret, uint64_t duration, unsigned long *args),
+	TP_ARGS(id, ret, duration, args),
+	TP_FIELDS(
+		ctf_integer(int, id, id)
+		ctf_integer(long, ret, ret)
+		ctf_integer(uint64_t, duration, duration)
+		ctf_array(unsigned long, args, args, UNKNOWN_SYSCALL_NRARGS)
+	)
+)
+LTTNG_TRACEPOINT_EVENT(compat_syscall_exit_latency,
+	TP_PROTO(int id, long ret, uint64_t duration, unsigned long *args),
+	TP_ARGS(id, ret, duration, args),
+	TP_FIELDS(
+		ctf_integer(int, id, id)
+		ctf_integer(long, ret, ret)
+		ctf_integer(uint64_t, duration, duration)
+		ctf_array(unsigned long, args, args, UNKNOWN_SYSCALL_NRARGS)
+	)
+)
+
+/* Per-process system call counters and durations (summary mode). */
+LTTNG_TRACEPOINT_EVENT(syscall_summary,
+	TP_PROTO(int pid, int id, uint64_t count, uint64_t errors,
+		uint64_t total, uint64_t max),
+	TP_ARGS(pid, id, count, errors, total, max),
+	TP_FIELDS(
+		ctf_integer(int, pid, pid)
+		ctf_integer(int, id, id)
+		ctf_integer(uint64_t, count, count)
+		ctf_integer(uint64_t, errors, errors)
+		ctf_integer(uint64_t, total, total)
+		ctf_integer(uint64_t, max, max)
+	)
+)
+LTTNG_TRACEPOINT_EVENT(compat_syscall_summary,
+	TP_PROTO(int pid, int id, uint64_t count, uint64_t errors,
+		uint64_t total, uint64_t max),
+	TP_ARGS(pid, id, count, errors, total, max),
+	TP_FIELDS(
+		ctf_integer(int, pid, pid)
+		ctf_integer(int, id, id)
+		ctf_integer(uint64_t, count, count)
+		ctf_integer(uint64_t, errors, errors)
+		ctf_integer(uint64_t, total, total)
+		ctf_integer(uint64_t, max, max)
+	)
+)
 #endif /*  _TRACE_SYSCALLS_UNKNOWN_H */
 
 /* This part must be outside protection */
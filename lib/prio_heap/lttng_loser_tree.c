@@ -0,0 +1,103 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * lttng_loser_tree.c
+ *
+ * Tournament tree of losers, merging streams by lowest 64-bit key.
+ *
+ * Copyright 2026 - agent <agent@local>
+ */
+
+#include <linux/slab.h>
+#include <linux/log2.h>
+#include <lib/prio_heap/lttng_loser_tree.h>
+#include <wrapper/vmalloc.h>
+
+/*
+ * Leaf l is node nr_leaves + l: the parent of node n is n / 2, and the
+ * root is node 1.
+ */
+static
+unsigned int leaf_parent(const struct lttng_loser_tree *tree, unsigned int slot)
+{
+	return (tree->nr_leaves + slot) >> 1;
+}
+
+/* Lowest key among the losers on the path of the winner. */
+static
+void update_runner_up(struct lttng_loser_tree *tree)
+{
+	unsigned int n;
+	u64 runner_up = U64_MAX;
+
+	for (n = leaf_parent(tree, tree->nodes[0]); n; n >>= 1)
+		runner_up = min(runner_up, tree->keys[tree->nodes[n]]);
+	tree->runner_up = runner_up;
+}
+
+int lttng_loser_tree_init(struct lttng_loser_tree *tree,
+		unsigned int nr_slots, gfp_t gfpmask)
+{
+	unsigned int nr_leaves = roundup_pow_of_two(max(nr_slots, 1U)), i;
+	size_t len;
+	char *p;
+
+	len = nr_leaves * (sizeof(*tree->keys) + sizeof(*tree->ptrs)
+			+ sizeof(*tree->nodes) + sizeof(*tree->winners));
+	p = lttng_kvmalloc(len, gfpmask);
+	if (!p)
+		return -ENOMEM;
+	tree->nr_leaves = nr_leaves;
+	tree->nr_slots = nr_slots;
+	tree->keys = (u64 *) p;
+	p += nr_leaves * sizeof(*tree->keys);
+	tree->ptrs = (void **) p;
+	p += nr_leaves * sizeof(*tree->ptrs);
+	tree->nodes = (unsigned int *) p;
+	p += nr_leaves * sizeof(*tree->nodes);
+	tree->winners = (unsigned int *) p;
+	for (i = 0; i < nr_leaves; i++)
+		lttng_loser_tree_set(tree, i, NULL, 0);
+	lttng_loser_tree_build(tree);
+	return 0;
+}
+
+void lttng_loser_tree_free(struct lttng_loser_tree *tree)
+{
+	lttng_kvfree(tree->keys);
+}
+
+void lttng_loser_tree_build(struct lttng_loser_tree *tree)
+{
+	unsigned int nr_leaves = tree->nr_leaves, n, a, b;
+
+	/* Play the matches bottom-up, keeping the winners aside. */
+	for (n = nr_leaves - 1; n; n--) {
+		a = 2 * n >= nr_leaves ? 2 * n - nr_leaves : tree->winners[2 * n];
+		b = 2 * n + 1 >= nr_leaves ?
+			2 * n + 1 - nr_leaves : tree->winners[2 * n + 1];
+		if (tree->keys[b] < tree->keys[a]) {
+			tree->winners[n] = b;
+			tree->nodes[n] = a;
+		} else {
+			tree->winners[n] = a;
+			tree->nodes[n] = b;
+		}
+	}
+	tree->nodes[0] = nr_leaves > 1 ? tree->winners[1] : 0;
+	update_runner_up(tree);
+}
+
+void lttng_loser_tree_replay(struct lttng_loser_tree *tree)
+{
+	unsigned int winner = tree->nodes[0], loser, n;
+
+	for (n = leaf_parent(tree, winner); n; n >>= 1) {
+		loser = tree->nodes[n];
+		if (tree->keys[loser] < tree->keys[winner]) {
+			tree->nodes[n] = winner;
+			winner = loser;
+		}
+	}
+	tree->nodes[0] = winner;
+	update_runner_up(tree);
+}
@@ -0,0 +1,152 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * lttng_loser_tree.h
+ *
+ * Tournament tree of losers, merging streams by lowest 64-bit key.
+ *
+ * Copyright 2026 - agent <agent@local>
+ */
+
+#ifndef _LTTNG_LOSER_TREE_H
+#define _LTTNG_LOSER_TREE_H
+
+#include <linux/types.h>
+#include <linux/gfp.h>
+
+/*
+ * Each stream owns a fixed slot (leaf) of the tree, holding its key
+ * inline. Internal nodes hold the slot losing the match played at this
+ * node, and node 0 the overall winner, i.e. the slot with the lowest
+ * key. Empty slots have a NULL pointer and the highest key.
+ *
+ * Replacing the key of the winner only replays the matches on its path
+ * to the root, comparing keys read from a single array, and is skipped
+ * altogether while the new key does not exceed the runner-up key: runs
+ * of records of the same stream are then merged in constant time.
+ * Changing another slot requires lttng_loser_tree_build().
+ */
+struct lttng_loser_tree {
+	unsigned int nr_leaves;		/* Power of 2 */
+	unsigned int nr_slots;
+	u64 runner_up;			/* Lowest key of the other slots */
+	u64 *keys;			/* Per slot */
+	void **ptrs;			/* Per slot, NULL: empty */
+	unsigned int *nodes;		/* Node 0: winner, others: losers */
+	unsigned int *winners;		/* Scratch space for builds */
+};
+
+/**
+ * lttng_loser_tree_init - initialize the tree
+ * @tree: the tree to initialize
+ * @nr_slots: number of slots, all empty
+ * @gfpmask: allocation flags
+ *
+ * Returns -ENOMEM if out of memory.
+ */
+extern int lttng_loser_tree_init(struct lttng_loser_tree *tree,
+		unsigned int nr_slots, gfp_t gfpmask);
+
+/**
+ * lttng_loser_tree_free - free the tree
+ * @tree: the tree to free
+ */
+extern void lttng_loser_tree_free(struct lttng_loser_tree *tree);
+
+/**
+ * lttng_loser_tree_build - play all the matches of the tree
+ * @tree: the tree to be operated on
+ *
+ * Must be called after slots are changed with lttng_loser_tree_set(),
+ * before the winner is read again. Linear in the number of slots.
+ */
+extern void lttng_loser_tree_build(struct lttng_loser_tree *tree);
+
+/*
+ * Replay the matches of the winner after its key increased beyond the
+ * runner-up key.
+ */
+extern void lttng_loser_tree_replay(struct lttng_loser_tree *tree);
+
+/**
+ * lttng_loser_tree_winner - return the element with the lowest key
+ * @tree: the tree to be operated on
+ *
+ * Returns NULL if the tree is empty.
+ */
+static inline void *lttng_loser_tree_winner(const struct lttng_loser_tree *tree)
+{
+	return tree->ptrs[tree->nodes[0]];
+}
+
+/**
+ * lttng_loser_tree_runner_up - return the lowest key of the other elements
+ * @tree: the tree to be operated on
+ *
+ * The winner stays the winner as long as its key does not exceed this
+ * key, which lets readers consume runs of elements from one stream.
+ */
+static inline u64 lttng_loser_tree_runner_up(const struct lttng_loser_tree *tree)
+{
+	return tree->runner_up;
+}
+
+/**
+ * lttng_loser_tree_update_winner - replace the key of the winner
+ * @tree: the tree to be operated on
+ * @key: the new key of the winner
+ */
+static inline void lttng_loser_tree_update_winner(struct lttng_loser_tree *tree,
+		u64 key)
+{
+	tree->keys[tree->nodes[0]] = key;
+	if (key > tree->runner_up)
+		lttng_loser_tree_replay(tree);
+}
+
+/**
+ * lttng_loser_tree_remove_winner - remove the element with the lowest key
+ * @tree: the tree to be operated on
+ *
+ * Returns the element removed, or NULL if the tree is empty.
+ */
+static inline void *lttng_loser_tree_remove_winner(struct lttng_loser_tree *tree)
+{
+	unsigned int slot = tree->nodes[0];
+	void *p = tree->ptrs[slot];
+
+	if (!p)
+		return NULL;
+	tree->ptrs[slot] = NULL;
+	tree->keys[slot] = U64_MAX;
+	lttng_loser_tree_replay(tree);
+	return p;
+}
+
+/**
+ * lttng_loser_tree_set - set the element of a slot
+ * @tree: the tree to be operated on
+ * @slot: the slot
+ * @p: the element, NULL to empty the slot
+ * @key: the key of the element
+ *
+ * lttng_loser_tree_build() must be called to take the change into account.
+ */
+static inline void lttng_loser_tree_set(struct lttng_loser_tree *tree,
+		unsigned int slot, void *p, u64 key)
+{
+	tree->ptrs[slot] = p;
+	tree->keys[slot] = p ? key : U64_MAX;
+}
+
+/**
+ * lttng_loser_tree_get - return the element of a slot
+ * @tree: the tree to be operated on
+ * @slot: the slot, out of range slots are empty
+ */
+static inline void *lttng_loser_tree_get(const struct lttng_loser_tree *tree,
+		unsigned int slot)
+{
+	return slot < tree->nr_slots ? tree->ptrs[slot] : NULL;
+}
+
+#endif /* _LTTNG_LOSER_TREE_H */
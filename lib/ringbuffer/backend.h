@@ -22,6 +22,7 @@
 #include <linux/fs.h>
 #include <linux/mm.h>
 #include <linux/uaccess.h>
+#include <asm/word-at-a-time.h>
 
 /* Internal helpers */
 #include <wrapper/ringbuffer/backend_internal.h>
@@ -58,6 +59,19 @@ extern void *
 lib_ring_buffer_read_offset_address(struct lib_ring_buffer_backend *bufb,
 				    size_t offset);
 
+/* Pages reserved at load time for RING_BUFFER_STATIC buffers */
+extern unsigned long lib_ring_buffer_static_reserve_pages(void);
+
+/* Pages of the buffer, and how many of them are on a memory node */
+extern unsigned long
+lib_ring_buffer_backend_node_pages(struct lib_ring_buffer_backend *bufb,
+				   int node, unsigned long *nr_pages);
+
+/* Page arrays and sub-buffer tables of the buffer, and its page bytes */
+extern size_t
+lib_ring_buffer_backend_mem_usage(struct lib_ring_buffer_backend *bufb,
+				  size_t *data_bytes);
+
 /**
  * lib_ring_buffer_write - write data to a buffer backend
  * @config : ring buffer instance configuration
@@ -68,7 +82,7 @@ lib_ring_buffer_read_offset_address(struct lib_ring_buffer_backend *bufb,
  * This function copies "len" bytes of data from a source pointer to a buffer
  * backend, at the current context offset. This is more or less a buffer
  * backend-specific memcpy() operation. Calls the slow path (_ring_buffer_write)
- * if copy is crossing a page boundary.
+ * if copy is crossing a page boundary, or is large enough to bypass the cache.
  */
 static inline __attribute__((always_inline))
 void lib_ring_buffer_write(const struct lib_ring_buffer_config *config,
@@ -77,7 +91,8 @@ void lib_ring_buffer_write(const struct lib_ring_buffer_config *config,
 {
 	struct lib_ring_buffer_backend *bufb = &ctx->buf->backend;
 	struct channel_backend *chanb = &ctx->chan->backend;
-	size_t index, pagecpy;
+	size_t pagecpy;
+	char *dest;
 	size_t offset = ctx->buf_offset;
 	struct lib_ring_buffer_backend_pages *backend_pages;
 
@@ -86,13 +101,11 @@ void lib_ring_buffer_write(const struct lib_ring_buffer_config *config,
 	backend_pages =
 		lib_ring_buffer_get_backend_pages_from_ctx(config, ctx);
 	offset &= chanb->buf_size - 1;
-	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
-	pagecpy = min_t(size_t, len, (-offset) & ~PAGE_MASK);
-	if (likely(pagecpy == len))
-		lib_ring_buffer_do_copy(config,
-					backend_pages->p[index].virt
-					    + (offset & ~PAGE_MASK),
-					src, len);
+	dest = lib_ring_buffer_backend_dest(config, chanb, backend_pages,
+			offset, len, &pagecpy);
+	if (likely(pagecpy == len) && (__builtin_constant_p(len)
+			|| likely(len < chanb->nocache_threshold)))
+		lib_ring_buffer_do_copy(config, dest, src, len);
 	else
 		_lib_ring_buffer_write(bufb, offset, src, len, 0);
 	ctx->buf_offset += len;
@@ -118,7 +131,8 @@ void lib_ring_buffer_memset(const struct lib_ring_buffer_config *config,
 
 	struct lib_ring_buffer_backend *bufb = &ctx->buf->backend;
 	struct channel_backend *chanb = &ctx->chan->backend;
-	size_t index, pagecpy;
+	size_t pagecpy;
+	char *dest;
 	size_t offset = ctx->buf_offset;
 	struct lib_ring_buffer_backend_pages *backend_pages;
 
@@ -127,12 +141,10 @@ void lib_ring_buffer_memset(const struct lib_ring_buffer_config *config,
 	backend_pages =
 		lib_ring_buffer_get_backend_pages_from_ctx(config, ctx);
 	offset &= chanb->buf_size - 1;
-	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
-	pagecpy = min_t(size_t, len, (-offset) & ~PAGE_MASK);
+	dest = lib_ring_buffer_backend_dest(config, chanb, backend_pages,
+			offset, len, &pagecpy);
 	if (likely(pagecpy == len))
-		lib_ring_buffer_do_memset(backend_pages->p[index].virt
-					  + (offset & ~PAGE_MASK),
-					  c, len);
+		lib_ring_buffer_do_memset(dest, c, len);
 	else
 		_lib_ring_buffer_memset(bufb, offset, c, len, 0);
 	ctx->buf_offset += len;
@@ -142,20 +154,51 @@ void lib_ring_buffer_memset(const struct lib_ring_buffer_config *config,
  * Copy up to @len string bytes from @src to @dest. Stop whenever a NULL
  * terminating character is found in @src. Returns the number of bytes
  * copied. Does *not* terminate @dest with NULL terminating character.
+ *
+ * Once @src is aligned, it is scanned a word at a time. Aligned words
+ * never cross a page boundary, so the bytes read past the terminating
+ * character are always mapped.
  */
 static inline __attribute__((always_inline))
 size_t lib_ring_buffer_do_strcpy(const struct lib_ring_buffer_config *config,
 		char *dest, const char *src, size_t len)
 {
-	size_t count;
+	const struct word_at_a_time constants = WORD_AT_A_TIME_CONSTANTS;
+	size_t count = 0;
 
-	for (count = 0; count < len; count++) {
+	for (; count < len && !IS_ALIGNED((unsigned long) &src[count],
+			sizeof(unsigned long)); count++) {
 		char c;
 
 		/*
 		 * Only read source character once, in case it is
 		 * modified concurrently.
 		 */
+		c = READ_ONCE(src[count]);
+		if (!c)
+			return count;
+		lib_ring_buffer_do_copy(config, &dest[count], &c, 1);
+	}
+	for (; len - count >= sizeof(unsigned long);
+			count += sizeof(unsigned long)) {
+		unsigned long c, data;
+
+		c = lttng_read_word_at_a_time(&src[count]);
+		if (has_zero(c, &data, &constants)) {
+			size_t nr_bytes;
+
+			data = prep_zero_mask(c, data, &constants);
+			data = create_zero_mask(data);
+			nr_bytes = find_zero(data);
+			lib_ring_buffer_do_copy(config, &dest[count], &c,
+					nr_bytes);
+			return count + nr_bytes;
+		}
+		lib_ring_buffer_do_copy(config, &dest[count], &c, sizeof(c));
+	}
+	for (; count < len; count++) {
+		char c;
+
 		c = READ_ONCE(src[count]);
 		if (!c)
 			break;
@@ -170,6 +213,10 @@ size_t lib_ring_buffer_do_strcpy(const struct lib_ring_buffer_config *config,
  * Returns the number of bytes copied. Does *not* terminate @dest with
  * NULL terminating character.
  *
+ * Once @src is aligned, it is copied a word at a time. A fault on an
+ * aligned word means its whole page is not accessible: the remaining
+ * bytes are then copied one at a time, which stops at the first one.
+ *
  * This function deals with userspace pointers, it should never be called
  * directly without having the src pointer checked with access_ok()
  * previously.
@@ -178,9 +225,38 @@ static inline __attribute__((always_inline))
 size_t lib_ring_buffer_do_strcpy_from_user_inatomic(const struct lib_ring_buffer_config *config,
 		char *dest, const char __user *src, size_t len)
 {
-	size_t count;
+	const struct word_at_a_time constants = WORD_AT_A_TIME_CONSTANTS;
+	size_t count = 0;
 
-	for (count = 0; count < len; count++) {
+	for (; count < len && !IS_ALIGNED((unsigned long) &src[count],
+			sizeof(unsigned long)); count++) {
+		int ret;
+		char c;
+
+		ret = __copy_from_user_inatomic(&c, src + count, 1);
+		if (ret || !c)
+			return count;
+		lib_ring_buffer_do_copy(config, &dest[count], &c, 1);
+	}
+	for (; len - count >= sizeof(unsigned long);
+			count += sizeof(unsigned long)) {
+		unsigned long c, data;
+
+		if (__copy_from_user_inatomic(&c, src + count, sizeof(c)))
+			break;
+		if (has_zero(c, &data, &constants)) {
+			size_t nr_bytes;
+
+			data = prep_zero_mask(c, data, &constants);
+			data = create_zero_mask(data);
+			nr_bytes = find_zero(data);
+			lib_ring_buffer_do_copy(config, &dest[count], &c,
+					nr_bytes);
+			return count + nr_bytes;
+		}
+		lib_ring_buffer_do_copy(config, &dest[count], &c, sizeof(c));
+	}
+	for (; count < len; count++) {
 		int ret;
 		char c;
 
@@ -215,7 +291,8 @@ void lib_ring_buffer_strcpy(const struct lib_ring_buffer_config *config,
 {
 	struct lib_ring_buffer_backend *bufb = &ctx->buf->backend;
 	struct channel_backend *chanb = &ctx->chan->backend;
-	size_t index, pagecpy;
+	size_t pagecpy;
+	char *dest;
 	size_t offset = ctx->buf_offset;
 	struct lib_ring_buffer_backend_pages *backend_pages;
 
@@ -224,29 +301,19 @@ void lib_ring_buffer_strcpy(const struct lib_ring_buffer_config *config,
 	backend_pages =
 		lib_ring_buffer_get_backend_pages_from_ctx(config, ctx);
 	offset &= chanb->buf_size - 1;
-	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
-	pagecpy = min_t(size_t, len, (-offset) & ~PAGE_MASK);
+	dest = lib_ring_buffer_backend_dest(config, chanb, backend_pages,
+			offset, len, &pagecpy);
 	if (likely(pagecpy == len)) {
 		size_t count;
 
 		count = lib_ring_buffer_do_strcpy(config,
-					backend_pages->p[index].virt
-					    + (offset & ~PAGE_MASK),
-					src, len - 1);
-		offset += count;
+					dest, src, len - 1);
 		/* Padding */
-		if (unlikely(count < len - 1)) {
-			size_t pad_len = len - 1 - count;
-
-			lib_ring_buffer_do_memset(backend_pages->p[index].virt
-						+ (offset & ~PAGE_MASK),
-					pad, pad_len);
-			offset += pad_len;
-		}
+		if (unlikely(count < len - 1))
+			lib_ring_buffer_do_memset(dest + count, pad,
+					len - 1 - count);
 		/* Ending '\0' */
-		lib_ring_buffer_do_memset(backend_pages->p[index].virt
-					+ (offset & ~PAGE_MASK),
-				'\0', 1);
+		lib_ring_buffer_do_memset(dest + len - 1, '\0', 1);
 	} else {
 		_lib_ring_buffer_strcpy(bufb, offset, src, len, 0, pad);
 	}
@@ -263,7 +330,8 @@ void lib_ring_buffer_strcpy(const struct lib_ring_buffer_config *config,
  * This function copies "len" bytes of data from a userspace pointer to a
  * buffer backend, at the current context offset. This is more or less a buffer
  * backend-specific memcpy() operation. Calls the slow path
- * (_ring_buffer_write_from_user_inatomic) if copy is crossing a page boundary.
+ * (_ring_buffer_write_from_user_inatomic) if copy is crossing a page boundary,
+ * or is large enough to bypass the cache.
  * Disable the page fault handler to ensure we never try to take the mmap_sem.
  */
 static inline __attribute__((always_inline))
@@ -273,7 +341,8 @@ void lib_ring_buffer_copy_from_user_inatomic(const struct lib_ring_buffer_config
 {
 	struct lib_ring_buffer_backend *bufb = &ctx->buf->backend;
 	struct channel_backend *chanb = &ctx->chan->backend;
-	size_t index, pagecpy;
+	size_t pagecpy;
+	char *dest;
 	size_t offset = ctx->buf_offset;
 	struct lib_ring_buffer_backend_pages *backend_pages;
 	unsigned long ret;
@@ -284,17 +353,16 @@ void lib_ring_buffer_copy_from_user_inatomic(const struct lib_ring_buffer_config
 	backend_pages =
 		lib_ring_buffer_get_backend_pages_from_ctx(config, ctx);
 	offset &= chanb->buf_size - 1;
-	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
-	pagecpy = min_t(size_t, len, (-offset) & ~PAGE_MASK);
+	dest = lib_ring_buffer_backend_dest(config, chanb, backend_pages,
+			offset, len, &pagecpy);
 
 	set_fs(KERNEL_DS);
 	pagefault_disable();
 	if (unlikely(!access_ok(VERIFY_READ, src, len)))
 		goto fill_buffer;
 
-	if (likely(pagecpy == len)) {
-		ret = lib_ring_buffer_do_copy_from_user_inatomic(
-			backend_pages->p[index].virt + (offset & ~PAGE_MASK),
+	if (likely(pagecpy == len) && likely(len < chanb->nocache_threshold)) {
+		ret = lib_ring_buffer_do_copy_from_user_inatomic(dest,
 			src, len);
 		if (unlikely(ret > 0)) {
 			/* Copy failed. */
@@ -344,7 +412,8 @@ void lib_ring_buffer_strcpy_from_user_inatomic(const struct lib_ring_buffer_conf
 {
 	struct lib_ring_buffer_backend *bufb = &ctx->buf->backend;
 	struct channel_backend *chanb = &ctx->chan->backend;
-	size_t index, pagecpy;
+	size_t pagecpy;
+	char *dest;
 	size_t offset = ctx->buf_offset;
 	struct lib_ring_buffer_backend_pages *backend_pages;
 	mm_segment_t old_fs = get_fs();
@@ -354,8 +423,8 @@ void lib_ring_buffer_strcpy_from_user_inatomic(const struct lib_ring_buffer_conf
 	backend_pages =
 		lib_ring_buffer_get_backend_pages_from_ctx(config, ctx);
 	offset &= chanb->buf_size - 1;
-	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
-	pagecpy = min_t(size_t, len, (-offset) & ~PAGE_MASK);
+	dest = lib_ring_buffer_backend_dest(config, chanb, backend_pages,
+			offset, len, &pagecpy);
 
 	set_fs(KERNEL_DS);
 	pagefault_disable();
@@ -366,23 +435,13 @@ void lib_ring_buffer_strcpy_from_user_inatomic(const struct lib_ring_buffer_conf
 		size_t count;
 
 		count = lib_ring_buffer_do_strcpy_from_user_inatomic(config,
-					backend_pages->p[index].virt
-					    + (offset & ~PAGE_MASK),
-					src, len - 1);
-		offset += count;
+					dest, src, len - 1);
 		/* Padding */
-		if (unlikely(count < len - 1)) {
-			size_t pad_len = len - 1 - count;
-
-			lib_ring_buffer_do_memset(backend_pages->p[index].virt
-						+ (offset & ~PAGE_MASK),
-					pad, pad_len);
-			offset += pad_len;
-		}
+		if (unlikely(count < len - 1))
+			lib_ring_buffer_do_memset(dest + count, pad,
+					len - 1 - count);
 		/* Ending '\0' */
-		lib_ring_buffer_do_memset(backend_pages->p[index].virt
-					+ (offset & ~PAGE_MASK),
-				'\0', 1);
+		lib_ring_buffer_do_memset(dest + len - 1, '\0', 1);
 	} else {
 		_lib_ring_buffer_strcpy_from_user_inatomic(bufb, offset, src,
 					len, 0, pad);
@@ -405,6 +464,103 @@ fill_buffer:
 	_lib_ring_buffer_memset(bufb, offset, '\0', 1, 0);
 }
 
+/**
+ * lib_ring_buffer_strscpy - write bounded string data to a buffer backend
+ * @config : ring buffer instance configuration
+ * @ctx: ring buffer context
+ * @src : source pointer to copy from
+ * @len : maximum length of data to copy, including the terminating '\0'
+ *
+ * This function copies at most @len - 1 bytes of string data from a
+ * source pointer to a buffer backend, followed by a terminating '\0'
+ * character, at the current context offset, in a single pass over
+ * @src. Unlike lib_ring_buffer_strcpy(), the string is not padded:
+ * the context offset only advances past the bytes actually written,
+ * which are returned. Calls the slow path (_ring_buffer_strscpy) if copy
+ * is crossing a page boundary.
+ */
+static inline
+size_t lib_ring_buffer_strscpy(const struct lib_ring_buffer_config *config,
+			       struct lib_ring_buffer_ctx *ctx,
+			       const char *src, size_t len)
+{
+	struct lib_ring_buffer_backend *bufb = &ctx->buf->backend;
+	struct channel_backend *chanb = &ctx->chan->backend;
+	size_t pagecpy, count;
+	char *dest;
+	size_t offset = ctx->buf_offset;
+	struct lib_ring_buffer_backend_pages *backend_pages;
+
+	if (unlikely(!len))
+		return 0;
+	backend_pages =
+		lib_ring_buffer_get_backend_pages_from_ctx(config, ctx);
+	offset &= chanb->buf_size - 1;
+	dest = lib_ring_buffer_backend_dest(config, chanb, backend_pages,
+			offset, len, &pagecpy);
+	if (likely(pagecpy == len)) {
+		count = lib_ring_buffer_do_strcpy(config, dest, src, len - 1);
+		/* Ending '\0' */
+		lib_ring_buffer_do_memset(dest + count, '\0', 1);
+	} else {
+		count = _lib_ring_buffer_strscpy(bufb, offset, src, len);
+	}
+	ctx->buf_offset += count + 1;
+	return count + 1;
+}
+
+/**
+ * lib_ring_buffer_strscpy_from_user_inatomic - write bounded userspace string data to a buffer backend
+ * @config : ring buffer instance configuration
+ * @ctx: ring buffer context
+ * @src : userspace source pointer to copy from
+ * @len : maximum length of data to copy, including the terminating '\0'
+ *
+ * Userspace counterpart of lib_ring_buffer_strscpy(). The string is cut
+ * at the first fault, and is empty if @src is not accessible. Disable
+ * the page fault handler to ensure we never try to take the mmap_sem.
+ */
+static inline
+size_t lib_ring_buffer_strscpy_from_user_inatomic(const struct lib_ring_buffer_config *config,
+		struct lib_ring_buffer_ctx *ctx,
+		const void __user *src, size_t len)
+{
+	struct lib_ring_buffer_backend *bufb = &ctx->buf->backend;
+	struct channel_backend *chanb = &ctx->chan->backend;
+	size_t pagecpy, count;
+	char *dest;
+	size_t offset = ctx->buf_offset;
+	struct lib_ring_buffer_backend_pages *backend_pages;
+	mm_segment_t old_fs = get_fs();
+
+	if (unlikely(!len))
+		return 0;
+	backend_pages =
+		lib_ring_buffer_get_backend_pages_from_ctx(config, ctx);
+	offset &= chanb->buf_size - 1;
+	dest = lib_ring_buffer_backend_dest(config, chanb, backend_pages,
+			offset, len, &pagecpy);
+
+	set_fs(KERNEL_DS);
+	pagefault_disable();
+	if (unlikely(!access_ok(VERIFY_READ, src, len))) {
+		count = 0;
+		lib_ring_buffer_do_memset(dest, '\0', 1);
+	} else if (likely(pagecpy == len)) {
+		count = lib_ring_buffer_do_strcpy_from_user_inatomic(config,
+					dest, src, len - 1);
+		/* Ending '\0' */
+		lib_ring_buffer_do_memset(dest + count, '\0', 1);
+	} else {
+		count = _lib_ring_buffer_strscpy_from_user_inatomic(bufb,
+					offset, src, len);
+	}
+	pagefault_enable();
+	set_fs(old_fs);
+	ctx->buf_offset += count + 1;
+	return count + 1;
+}
+
 /*
  * This accessor counts the number of unread records in a buffer.
  * It only provides a consistent value if no reads not writes are performed
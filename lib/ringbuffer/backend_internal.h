@@ -25,14 +25,35 @@ int lib_ring_buffer_backend_create(struct lib_ring_buffer_backend *bufb,
 				   struct channel_backend *chan, int cpu);
 void channel_backend_unregister_notifiers(struct channel_backend *chanb);
 void lib_ring_buffer_backend_free(struct lib_ring_buffer_backend *bufb);
+int lib_ring_buffer_backend_resize_alloc(struct lib_ring_buffer_backend *new_bufb,
+					 const struct lib_ring_buffer_backend *bufb,
+					 size_t subbuf_size, size_t num_subbuf);
+void lib_ring_buffer_backend_resize_free(struct lib_ring_buffer_backend *new_bufb,
+					 size_t num_subbuf);
+void lib_ring_buffer_backend_resize_swap(struct lib_ring_buffer_backend *bufb,
+					 struct lib_ring_buffer_backend *new_bufb);
+int lib_ring_buffer_static_reserve_init(void);
+void lib_ring_buffer_static_reserve_exit(void);
 int channel_backend_init(struct channel_backend *chanb,
 			 const char *name,
 			 const struct lib_ring_buffer_config *config,
 			 void *priv, size_t subbuf_size,
-			 size_t num_subbuf);
+			 size_t num_subbuf,
+			 enum lib_ring_buffer_numa_policy numa_policy,
+			 int numa_node, unsigned int flags,
+			 const struct cpumask *cpu_mask);
+int channel_backend_check_geometry(const struct lib_ring_buffer_config *config,
+				   size_t subbuf_size, size_t num_subbuf);
+void channel_backend_set_geometry(struct channel_backend *chanb,
+				  size_t subbuf_size, size_t num_subbuf);
 void channel_backend_free(struct channel_backend *chanb);
 
 void lib_ring_buffer_backend_reset(struct lib_ring_buffer_backend *bufb);
+
+struct page *lib_ring_buffer_page_pool_get(struct lib_ring_buffer_page_pool *pool);
+void lib_ring_buffer_page_pool_put(struct lib_ring_buffer_page_pool *pool,
+				   struct page *page);
+void lib_ring_buffer_page_pool_release(struct kref *kref);
 void channel_backend_reset(struct channel_backend *chanb);
 
 int lib_ring_buffer_backend_init(void);
@@ -53,6 +74,10 @@ extern void _lib_ring_buffer_copy_from_user_inatomic(struct lib_ring_buffer_back
 extern void _lib_ring_buffer_strcpy_from_user_inatomic(struct lib_ring_buffer_backend *bufb,
 		size_t offset, const char __user *src, size_t len,
 		size_t pagecpy, int pad);
+extern size_t _lib_ring_buffer_strscpy(struct lib_ring_buffer_backend *bufb,
+		size_t offset, const char *src, size_t len);
+extern size_t _lib_ring_buffer_strscpy_from_user_inatomic(struct lib_ring_buffer_backend *bufb,
+		size_t offset, const char __user *src, size_t len);
 
 /*
  * Subbuffer ID bits for overwrite mode. Need to fit within a single word to be
@@ -220,6 +245,30 @@ struct lib_ring_buffer_backend_pages *
 	return ctx->backend_pages;
 }
 
+/*
+ * Destination address of @offset within the sub-buffer described by
+ * @backend_pages. *@pagecpy is set to the number of bytes of @len which
+ * can be copied there at once: up to the end of the page, or all of
+ * them with RING_BUFFER_VMAP, since sub-buffers are mapped contiguously
+ * and records never cross sub-buffer boundaries.
+ */
+static inline __attribute__((always_inline))
+void *lib_ring_buffer_backend_dest(const struct lib_ring_buffer_config *config,
+		struct channel_backend *chanb,
+		struct lib_ring_buffer_backend_pages *backend_pages,
+		size_t offset, size_t len, size_t *pagecpy)
+{
+	size_t index;
+
+	if (config->backend == RING_BUFFER_VMAP) {
+		*pagecpy = len;
+		return backend_pages->vaddr + (offset & (chanb->subbuf_size - 1));
+	}
+	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
+	*pagecpy = min_t(size_t, len, (-offset) & ~PAGE_MASK);
+	return backend_pages->p[index].virt + (offset & ~PAGE_MASK);
+}
+
 /*
  * The ring buffer can count events recorded and overwritten per buffer,
  * but it is disabled by default due to its performance overhead.
@@ -516,6 +565,36 @@ unsigned long lib_ring_buffer_do_copy_from_user_inatomic(void *dest,
 	return __copy_from_user_inatomic(dest, src, len);
 }
 
+/*
+ * Copies of at least chanb->nocache_threshold bytes use non-temporal
+ * stores, so large payloads do not evict the data of the traced code
+ * from the cache. The stores are weakly ordered: they are fenced before
+ * the record is committed.
+ */
+static inline
+void lib_ring_buffer_do_copy_nocache(void *dest, const void *src, size_t len)
+{
+#if defined(CONFIG_X86_64) && defined(CONFIG_ARCH_HAS_UACCESS_FLUSHCACHE)
+	memcpy_flushcache(dest, src, len);
+#else
+	memcpy(dest, src, len);
+#endif
+}
+
+static inline
+unsigned long lib_ring_buffer_do_copy_from_user_inatomic_nocache(void *dest,
+						const void __user *src,
+						unsigned long len)
+{
+	return __copy_from_user_inatomic_nocache(dest, src, len);
+}
+
+static inline
+void lib_ring_buffer_nocache_fence(void)
+{
+	wmb();
+}
+
 /*
  * write len bytes to dest with c
  */
@@ -12,9 +12,35 @@
 
 #include <linux/cpumask.h>
 #include <linux/types.h>
+#include <linux/kref.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
 #include <lttng-kernel-version.h>
 #include <lttng-cpuhotplug.h>
 
+/*
+ * NUMA placement of buffer memory.
+ */
+enum lib_ring_buffer_numa_policy {
+	RING_BUFFER_NUMA_LOCAL,		/* Node of the buffer cpu */
+	RING_BUFFER_NUMA_INTERLEAVE,	/* Pages spread over online nodes */
+	RING_BUFFER_NUMA_NODE,		/* Fixed node */
+};
+
+/*
+ * channel_create() flags.
+ *
+ * RING_BUFFER_CHANNEL_LAZY_ALLOC: per-cpu buffers are allocated when a
+ * writer first tries to reserve space in them, rather than at channel
+ * creation. Per-cpu channels only.
+ *
+ * RING_BUFFER_CHANNEL_HOUSEKEEPING: the buffers of nohz_full cpus are not
+ * sent IPIs, and their timers run on housekeeping cpus. Per-cpu channels
+ * only.
+ */
+#define RING_BUFFER_CHANNEL_LAZY_ALLOC	(1U << 0)
+#define RING_BUFFER_CHANNEL_HOUSEKEEPING	(1U << 1)
+
 struct lib_ring_buffer_backend_page {
 	void *virt;			/* page virtual address (cached) */
 	unsigned long pfn;		/* page frame number */
@@ -25,6 +51,7 @@ struct lib_ring_buffer_backend_pages {
 	union v_atomic records_commit;	/* current records committed count */
 	union v_atomic records_unread;	/* records to read */
 	unsigned long data_size;	/* Amount of data to read from subbuf */
+	void *vaddr;			/* Contiguous mapping (RING_BUFFER_VMAP) */
 	struct lib_ring_buffer_backend_page p[];
 };
 
@@ -43,6 +70,21 @@ struct lib_ring_buffer_backend_counts {
 	uint64_t seq_cnt;		/* packet sequence number */
 };
 
+/*
+ * Pool of free pages used to replace the buffer pages moved into a splice
+ * pipe. Pages are returned to the pool when the pipe releases them. The
+ * pool is referenced by its buffer and by each page lent to a pipe, since
+ * pipe buffers can outlive the ring buffer.
+ */
+struct lib_ring_buffer_page_pool {
+	struct kref ref;
+	spinlock_t lock;		/* Protects pages and nr_pages */
+	struct list_head pages;		/* Free pages, linked through page->lru */
+	unsigned int nr_pages;
+	unsigned int max_pages;
+	int node;			/* NUMA node of new pages */
+};
+
 /*
  * Forward declaration of frontend-specific channel and ring_buffer.
  */
@@ -62,10 +104,14 @@ struct lib_ring_buffer_backend {
 	 */
 	struct lib_ring_buffer_backend_pages **array;
 	unsigned int num_pages_per_subbuf;
+	/* Replacement pages for splice (RING_BUFFER_SPLICE only) */
+	struct lib_ring_buffer_page_pool *page_pool;
 
 	struct channel *chan;		/* Associated channel */
 	int cpu;			/* This buffer's cpu. -1 if global. */
+	int node;			/* Memory node of this buffer */
 	union v_atomic records_read;	/* Number of records read */
+	uint64_t seq_base;		/* Packets delivered before last resize */
 	unsigned int allocated:1;	/* is buffer allocated ? */
 };
 
@@ -79,7 +125,13 @@ struct channel_backend {
 					 */
 	unsigned int buf_size_order;	/* Order of buffer size */
 	unsigned int extra_reader_sb:1;	/* has extra reader subbuffer ? */
+	unsigned int lazy_alloc:1;	/* buffers allocated on first write ? */
+	unsigned int cpu_filter:1;	/* only trace traced_cpumask cpus ? */
+	unsigned int housekeeping:1;	/* spare nohz_full cpus ? */
+	unsigned long nocache_threshold;	/* Copy size bypassing the cache */
 	struct lib_ring_buffer *buf;	/* Channel per-cpu buffers */
+	enum lib_ring_buffer_numa_policy numa_policy;
+	int numa_node;			/* RING_BUFFER_NUMA_NODE only */
 
 	unsigned long num_subbuf;	/* Number of sub-buffers for writer */
 	u64 start_tsc;			/* Channel creation TSC value */
@@ -98,6 +150,7 @@ struct channel_backend {
 	 */
 	struct lib_ring_buffer_config config; /* Ring buffer configuration */
 	cpumask_var_t cpumask;		/* Allocated per-cpu buffers cpumask */
+	cpumask_var_t traced_cpumask;	/* Cpus with a buffer, if cpu_filter */
 	char name[NAME_MAX];		/* Channel name */
 };
 
@@ -105,6 +105,22 @@ struct lib_ring_buffer_client_cb {
  *
  * RING_BUFFER_WAKEUP_NONE does not perform any wakeup whatsoever. The client
  * has the responsibility to perform wakeups.
+
+ *
+ * backend:
+ *
+ * RING_BUFFER_PAGE writes records page by page, splitting copies crossing
+ * page boundaries.
+ *
+ * RING_BUFFER_VMAP also maps each sub-buffer contiguously in the kernel
+ * address space, so each copy is a single memcpy. It uses vmalloc address
+ * space for the whole buffer, and pages moved into a splice pipe are
+ * copied rather than replaced in the buffer.
+ *
+ * RING_BUFFER_STATIC takes the buffer pages from the reserve allocated when
+ * the ring buffer module is loaded (static_reserve_mb parameter), rather
+ * than from the page allocator. Writes are performed as with
+ * RING_BUFFER_PAGE.
  */
 struct lib_ring_buffer_config {
 	enum {
@@ -128,8 +144,8 @@ struct lib_ring_buffer_config {
 	} output;
 	enum {
 		RING_BUFFER_PAGE,
-		RING_BUFFER_VMAP,		/* TODO */
-		RING_BUFFER_STATIC,		/* TODO */
+		RING_BUFFER_VMAP,		/* Sub-buffers mapped contiguously */
+		RING_BUFFER_STATIC,		/* Pages from the load-time reserve */
 	} backend;
 	enum {
 		RING_BUFFER_NO_OOPS_CONSISTENCY,
@@ -172,6 +188,11 @@ struct lib_ring_buffer_ctx {
 					 * in the payload
 					 */
 	int cpu;			/* processor id */
+	int packed;			/* no alignment within the record */
+	int critical;			/*
+					 * may use the channel critical
+					 * reserve (discard mode)
+					 */
 
 	/* output from lib_ring_buffer_reserve() */
 	struct lib_ring_buffer *buf;	/*
@@ -212,6 +233,8 @@ void lib_ring_buffer_ctx_init(struct lib_ring_buffer_ctx *ctx,
 	ctx->data_size = data_size;
 	ctx->largest_align = largest_align;
 	ctx->cpu = cpu;
+	ctx->packed = 0;
+	ctx->critical = 0;
 	ctx->rflags = 0;
 	ctx->backend_pages = NULL;
 }
@@ -273,16 +296,31 @@ unsigned int lib_ring_buffer_align(size_t align_drift, size_t size_of_type)
 
 #endif
 
+/*
+ * Calculate the offset needed to align a record field. Packed records
+ * have no padding between their fields.
+ */
+static inline
+unsigned int lib_ring_buffer_record_align(int packed, size_t align_drift,
+					  size_t size_of_type)
+{
+	if (packed)
+		return 0;
+	return lib_ring_buffer_align(align_drift, size_of_type);
+}
+
 /**
  * lib_ring_buffer_align_ctx - Align context offset on "alignment"
  * @ctx: ring buffer context.
+ *
+ * Does nothing for packed records.
  */
 static inline
 void lib_ring_buffer_align_ctx(struct lib_ring_buffer_ctx *ctx,
 			   size_t alignment)
 {
-	ctx->buf_offset += lib_ring_buffer_align(ctx->buf_offset,
-						 alignment);
+	ctx->buf_offset += lib_ring_buffer_record_align(ctx->packed,
+						ctx->buf_offset, alignment);
 }
 
 /*
@@ -292,12 +330,16 @@ void lib_ring_buffer_align_ctx(struct lib_ring_buffer_ctx *ctx,
 static inline
 int lib_ring_buffer_check_config(const struct lib_ring_buffer_config *config,
 			     unsigned int switch_timer_interval,
-			     unsigned int read_timer_interval)
+			     unsigned int read_timer_interval,
+			     unsigned int read_timer_max_interval)
 {
 	if (config->alloc == RING_BUFFER_ALLOC_GLOBAL
 	    && config->sync == RING_BUFFER_SYNC_PER_CPU
 	    && switch_timer_interval)
 		return -EINVAL;
+	if (read_timer_max_interval
+	    && read_timer_max_interval < read_timer_interval)
+		return -EINVAL;
 	return 0;
 }
 
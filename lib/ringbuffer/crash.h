@@ -0,0 +1,123 @@
+/* SPDX-License-Identifier: (GPL-2.0 OR LGPL-2.1)
+ *
+ * lib/ringbuffer/crash.h
+ *
+ * Ring buffer crash descriptors, locating the buffers in a kernel crash
+ * dump.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#ifndef _LIB_RING_BUFFER_CRASH_H
+#define _LIB_RING_BUFFER_CRASH_H
+
+#include <linux/types.h>
+
+/*
+ * Channels created with RING_BUFFER_OOPS_CONSISTENCY are described in
+ * memory by a stable layout, so their buffers can be extracted from a
+ * vmcore, or from a memory dump restricted to the pages it references,
+ * without debug information for the modules.
+ *
+ * When the ring buffer library is loaded, the vmcoreinfo note receives
+ * the line:
+ *
+ *   LTTNG_RING_BUFFER_CRASH=<hex kernel address of the crash root>
+ *
+ * The note is copied when the crash kernel is loaded on some kernels:
+ * the library must then be loaded before it. Each load of the library
+ * appends a line, the last one being current. The root magic is cleared
+ * when the library is unloaded.
+ *
+ * All fields have a fixed size and are naturally aligned. Addresses are
+ * kernel virtual addresses, in the crashed kernel byte order. The root holds the descriptor list
+ * head and, in its layout, the offsets of the live ring buffer fields
+ * needed to extract a buffer of the list:
+ *
+ * - the buffer addresses of a descriptor do not change during its
+ *   lifetime. A buffer is allocated if its backend array is not NULL.
+ * - each of the num_subbuf writer sub-buffers buf_wsb[i].id, masked with
+ *   sb_id_index_mask in overwrite mode, as is in discard mode, indexes
+ *   into array the backend pages of the
+ *   sub-buffer, whose pfns are adjacent p[] entries, subbuf_size bytes in
+ *   all. The sub-buffer of buf_rsb.id is held by the reader.
+ * - sub-buffers are ordered by the packet header sequence number, and
+ *   their content is consistent up to commit_hot[i].seq, taken modulo
+ *   subbuf_size: 0 means full or never written, as told by the packet
+ *   header. commit_hot, buf_wsb and buf_cnt are arrays of num_subbuf
+ *   elements.
+ * - offset and consumed, taken modulo subbuf_size * num_subbuf, are the
+ *   write and read positions.
+ *
+ * The geometry of a descriptor is updated when its channel is resized.
+ * Counters (union v_atomic, atomic_long_t) are longs. Descriptors are
+ * linked and unlinked with a single pointer store: an extractor should
+ * still check each descriptor magic and bound its list walk.
+ */
+
+#define LIB_RING_BUFFER_CRASH_ROOT_MAGIC	0x4c54544e47435254ULL	/* "LTTNGCRT" */
+#define LIB_RING_BUFFER_CRASH_DESC_MAGIC	0x4c54544e47434453ULL	/* "LTTNGCDS" */
+#define LIB_RING_BUFFER_CRASH_VERSION		1
+#define LIB_RING_BUFFER_CRASH_NAME_LEN		256
+
+/* Offsets and sizes of the ring buffer structures, in bytes. */
+struct lib_ring_buffer_crash_layout {
+	/* struct lib_ring_buffer */
+	uint32_t buf_offset;
+	uint32_t buf_consumed;
+	uint32_t buf_commit_hot;
+	uint32_t buf_backend;
+	/* struct commit_counters_hot */
+	uint32_t cc_hot_size;
+	uint32_t cc_hot_seq;
+	/* struct lib_ring_buffer_backend */
+	uint32_t backend_buf_wsb;
+	uint32_t backend_buf_rsb;
+	uint32_t backend_buf_cnt;
+	uint32_t backend_array;
+	uint32_t backend_num_pages_per_subbuf;
+	/* struct lib_ring_buffer_backend_subbuffer */
+	uint32_t wsb_size;
+	uint32_t wsb_id;
+	/* struct lib_ring_buffer_backend_counts */
+	uint32_t cnt_size;
+	uint32_t cnt_seq_cnt;
+	/* struct lib_ring_buffer_backend_pages */
+	uint32_t pages_data_size;
+	uint32_t pages_p;
+	/* struct lib_ring_buffer_backend_page */
+	uint32_t page_size;
+	uint32_t page_pfn;
+	uint32_t page_shift;		/* PAGE_SHIFT */
+	uint64_t sb_id_index_mask;	/* Overwrite sub-buffer id to index */
+};
+
+struct lib_ring_buffer_crash_root {
+	uint64_t magic;			/* LIB_RING_BUFFER_CRASH_ROOT_MAGIC */
+	uint32_t version;		/* LIB_RING_BUFFER_CRASH_VERSION */
+	uint32_t layout_size;		/* sizeof(struct ..._crash_layout) */
+	uint64_t head;			/* First descriptor, 0: none */
+	struct lib_ring_buffer_crash_layout layout;
+};
+
+struct lib_ring_buffer_crash_desc {
+	uint64_t magic;			/* LIB_RING_BUFFER_CRASH_DESC_MAGIC */
+	uint64_t next;			/* Next descriptor, 0: last */
+	uint64_t chan;			/* struct channel */
+	uint64_t subbuf_size;
+	uint64_t num_subbuf;
+	uint32_t mode;			/* 0: discard, 1: overwrite */
+	uint32_t nr_bufs;		/* nr_cpu_ids, 1 for global channels */
+	char name[LIB_RING_BUFFER_CRASH_NAME_LEN];	/* Channel name */
+	uint64_t bufs[];		/* struct lib_ring_buffer by cpu, 0: none */
+};
+
+struct channel;
+
+int lib_ring_buffer_crash_register(struct channel *chan);
+void lib_ring_buffer_crash_unregister(struct channel *chan);
+void lib_ring_buffer_crash_resize(struct channel *chan);
+int lib_ring_buffer_crash_init(void);
+void lib_ring_buffer_crash_exit(void);
+
+#endif /* _LIB_RING_BUFFER_CRASH_H */
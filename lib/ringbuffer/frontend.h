@@ -46,9 +46,18 @@
  *
  * read_timer_interval is the time interval (in us) to wake up pending readers.
  *
+ * read_timer_max_interval, if non-zero, makes the read timer adaptive: its
+ * period is scaled with the sub-buffer production rate of each buffer,
+ * between read_timer_interval and read_timer_max_interval (in us).
+ *
  * buf_addr is a pointer the the beginning of the preallocated buffer contiguous
  * address mapping. It is used only by RING_BUFFER_STATIC configuration. It can
  * be set to NULL for other backends.
+ *
+ * flags is a mask of RING_BUFFER_CHANNEL_* flags.
+ *
+ * cpu_mask, if non-NULL, restricts a per-cpu channel to the buffers of
+ * these cpus. Writers on other cpus do not record anything.
  */
 
 extern
@@ -57,7 +66,11 @@ struct channel *channel_create(const struct lib_ring_buffer_config *config,
 			       void *buf_addr,
 			       size_t subbuf_size, size_t num_subbuf,
 			       unsigned int switch_timer_interval,
-			       unsigned int read_timer_interval);
+			       unsigned int read_timer_interval,
+			       unsigned int read_timer_max_interval,
+			       enum lib_ring_buffer_numa_policy numa_policy,
+			       int numa_node, unsigned int flags,
+			       const struct cpumask *cpu_mask);
 
 /*
  * channel_destroy returns the private data pointer. It finalizes all channel's
@@ -67,6 +80,65 @@ struct channel *channel_create(const struct lib_ring_buffer_config *config,
 extern
 void *channel_destroy(struct channel *chan);
 
+/*
+ * channel_resize changes the sub-buffer size and count of all the channel
+ * buffers. Writers must be stopped, and each buffer fully consumed and
+ * released by its reader. Returns -EBUSY otherwise.
+ */
+extern
+int channel_resize(struct channel *chan, size_t subbuf_size,
+		   size_t num_subbuf);
+
+/*
+ * channel_set_critical_reserve keeps the last pct percent of the last
+ * sub-buffer free for writing to the records flagged critical in their
+ * context. Discard mode only: returns -EINVAL otherwise.
+ */
+extern
+int channel_set_critical_reserve(struct channel *chan, unsigned int pct);
+
+/*
+ * channel_set_blocking_timeout makes writers in task context wait up to
+ * timeout_us for the reader when the buffer is full, rather than drop
+ * the record. Discard mode only: returns -EINVAL otherwise.
+ */
+#define RING_BUFFER_MAX_BLOCKING_TIMEOUT	10000	/* usecs */
+
+extern
+int channel_set_blocking_timeout(struct channel *chan, unsigned int timeout_us);
+
+/*
+ * channel_set_writer_barrier makes the writers of RING_BUFFER_IPI_BARRIER
+ * channels order their commits with a write barrier, so that the reader
+ * sends them no IPI. Writers must be quiescent.
+ */
+extern
+int channel_set_writer_barrier(struct channel *chan, int enable);
+
+/*
+ * channel_set_live_latency makes the switch timer deliver records within
+ * latency_us instead of flushing the buffers every switch timer
+ * interval. Requires a switch timer: returns -EINVAL otherwise.
+ */
+extern
+int channel_set_live_latency(struct channel *chan, unsigned int latency_us);
+
+/*
+ * channel_get_ready_cpus fills a cpumask with the cpus of the buffers
+ * holding data to read, and returns their number. Readers are woken up
+ * through the channel read_wait queue.
+ */
+extern
+int channel_get_ready_cpus(struct channel *chan, struct cpumask *ready);
+
+/*
+ * channel_flush switches the current sub-buffer of all the channel
+ * buffers in a single pass, and returns the sequence number of the
+ * packet following the switch of each buffer, indexed by cpu.
+ */
+extern
+int channel_flush(struct channel *chan, int empty, uint64_t *seq_num);
+
 
 /* Buffer read operations */
 
@@ -81,11 +153,26 @@ void *channel_destroy(struct channel *chan);
 		({ (cpu) = cpumask_next(cpu, (chan)->backend.cpumask);	\
 		   smp_read_barrier_depends(); (cpu) < nr_cpu_ids; });)
 
+/*
+ * Whether the channel has a buffer for this cpu, allocated or not yet.
+ * Writers can test it before doing any work for the event.
+ */
+static inline
+int lib_ring_buffer_channel_cpu_traced(struct channel *chan, int cpu)
+{
+	return likely(!chan->backend.cpu_filter)
+		|| cpumask_test_cpu(cpu, chan->backend.traced_cpumask);
+}
+
 extern struct lib_ring_buffer *channel_get_ring_buffer(
 				const struct lib_ring_buffer_config *config,
 				struct channel *chan, int cpu);
 extern int lib_ring_buffer_open_read(struct lib_ring_buffer *buf);
 extern void lib_ring_buffer_release_read(struct lib_ring_buffer *buf);
+extern int lib_ring_buffer_open_read_secondary(struct lib_ring_buffer *buf);
+extern void lib_ring_buffer_release_read_secondary(struct lib_ring_buffer *buf);
+extern int lib_ring_buffer_get_next_subbuf_secondary(struct lib_ring_buffer *buf);
+extern void lib_ring_buffer_put_next_subbuf_secondary(struct lib_ring_buffer *buf);
 
 /*
  * Read sequence: snapshot, many get_subbuf/put_subbuf, move_consumer.
@@ -103,9 +190,17 @@ extern void lib_ring_buffer_move_consumer(struct lib_ring_buffer *buf,
 extern int lib_ring_buffer_get_subbuf(struct lib_ring_buffer *buf,
 				      unsigned long consumed);
 extern void lib_ring_buffer_put_subbuf(struct lib_ring_buffer *buf);
+extern int lib_ring_buffer_get_subbuf_run(struct lib_ring_buffer *buf,
+					  unsigned long consumed,
+					  unsigned long *nr);
+extern unsigned long lib_ring_buffer_get_run_padded_size(struct lib_ring_buffer *buf);
+extern size_t lib_ring_buffer_ctrl_len(struct lib_ring_buffer *buf);
+extern size_t lib_ring_buffer_mem_usage(struct lib_ring_buffer *buf,
+					size_t *data_bytes);
 
 void lib_ring_buffer_set_quiescent_channel(struct channel *chan);
 void lib_ring_buffer_clear_quiescent_channel(struct channel *chan);
+int lib_ring_buffer_clear_channel(struct channel *chan);
 
 /*
  * lib_ring_buffer_get_next_subbuf/lib_ring_buffer_put_next_subbuf are helpers
@@ -130,6 +225,57 @@ static inline void lib_ring_buffer_put_next_subbuf(struct lib_ring_buffer *buf)
 						    buf->backend.chan));
 }
 
+/*
+ * Discard mode only: get the run of up to *nr consecutive ready
+ * sub-buffers following the consumed position, spliced in one call, and
+ * move the consumer past the whole run on put.
+ */
+static inline int lib_ring_buffer_get_next_subbuf_run(struct lib_ring_buffer *buf,
+						      unsigned long *nr)
+{
+	int ret;
+
+	ret = lib_ring_buffer_snapshot(buf, &buf->cons_snapshot,
+				       &buf->prod_snapshot);
+	if (ret)
+		return ret;
+	return lib_ring_buffer_get_subbuf_run(buf, buf->cons_snapshot, nr);
+}
+
+static inline void lib_ring_buffer_put_next_subbuf_run(struct lib_ring_buffer *buf)
+{
+	struct channel *chan = buf->backend.chan;
+	unsigned long nr = buf->get_subbuf_run ? : 1;
+
+	lib_ring_buffer_put_subbuf(buf);
+	lib_ring_buffer_move_consumer(buf, subbuf_align(buf->cons_snapshot, chan)
+			+ ((nr - 1) << chan->backend.subbuf_size_order));
+}
+
+/*
+ * Discard mode only: move the consumer past the packet at position
+ * "consumed", read in place through the mmap control area rather than
+ * taken with lib_ring_buffer_get_subbuf(). Fails as the latter if the
+ * packet is not ready.
+ */
+static inline int lib_ring_buffer_put_consumed(struct lib_ring_buffer *buf,
+					       unsigned long consumed)
+{
+	struct channel *chan = buf->backend.chan;
+	int ret;
+
+	if (chan->backend.config.mode != RING_BUFFER_DISCARD)
+		return -EINVAL;
+	if (buf->get_subbuf)
+		return -EBUSY;
+	ret = lib_ring_buffer_get_subbuf(buf, consumed);
+	if (ret)
+		return ret;
+	lib_ring_buffer_put_subbuf(buf);
+	lib_ring_buffer_move_consumer(buf, subbuf_align(consumed, chan));
+	return 0;
+}
+
 extern void channel_reset(struct channel *chan);
 extern void lib_ring_buffer_reset(struct lib_ring_buffer *buf);
 
@@ -169,10 +315,17 @@ int lib_ring_buffer_channel_is_finalized(const struct channel *chan)
 	return chan->finalized;
 }
 
+/*
+ * Frozen channels reject writers like disabled channels, but can still
+ * be read. Freezes are counted in record_disabled from this bias up.
+ */
+#define RING_BUFFER_RECORD_FROZEN	(1 << 20)
+
 static inline
 int lib_ring_buffer_channel_is_disabled(const struct channel *chan)
 {
-	return atomic_read(&chan->record_disabled);
+	return atomic_read(&chan->record_disabled)
+		& (RING_BUFFER_RECORD_FROZEN - 1);
 }
 
 static inline
@@ -183,6 +336,14 @@ unsigned long lib_ring_buffer_get_read_data_size(
 	return subbuffer_get_read_data_size(config, &buf->backend);
 }
 
+static inline
+unsigned long lib_ring_buffer_get_secondary_read_data_size(
+				const struct lib_ring_buffer_config *config,
+				struct lib_ring_buffer *buf)
+{
+	return buf->backend.array[buf->secondary_sb_bindex]->data_size;
+}
+
 static inline
 unsigned long lib_ring_buffer_get_records_count(
 				const struct lib_ring_buffer_config *config,
@@ -223,6 +384,56 @@ unsigned long lib_ring_buffer_get_records_lost_big(
 	return v_read(config, &buf->records_lost_big);
 }
 
+/*
+ * Fill level telemetry: the high-water mark is reset when read, and
+ * poll reports POLLPRI once the fill threshold is reached.
+ */
+extern
+unsigned long lib_ring_buffer_get_fill_hwm(struct lib_ring_buffer *buf);
+extern
+int lib_ring_buffer_set_fill_threshold(struct lib_ring_buffer *buf,
+				       unsigned long threshold);
+
+static inline
+unsigned long lib_ring_buffer_get_reserve_retries(
+				const struct lib_ring_buffer_config *config,
+				struct lib_ring_buffer *buf)
+{
+	return v_read(config, &buf->reserve_retries);
+}
+
+static inline
+unsigned long lib_ring_buffer_get_reserve_slow(
+				const struct lib_ring_buffer_config *config,
+				struct lib_ring_buffer *buf)
+{
+	return v_read(config, &buf->reserve_slow);
+}
+
+static inline
+unsigned long lib_ring_buffer_get_subbuf_switches(
+				const struct lib_ring_buffer_config *config,
+				struct lib_ring_buffer *buf)
+{
+	return v_read(config, &buf->subbuf_switches);
+}
+
+static inline
+unsigned long lib_ring_buffer_get_commit_overflows(
+				const struct lib_ring_buffer_config *config,
+				struct lib_ring_buffer *buf)
+{
+	return v_read(config, &buf->commit_overflows);
+}
+
+static inline
+unsigned long lib_ring_buffer_get_reader_blocked(
+				const struct lib_ring_buffer_config *config,
+				struct lib_ring_buffer *buf)
+{
+	return v_read(config, &buf->reader_blocked);
+}
+
 static inline
 unsigned long lib_ring_buffer_get_records_read(
 				const struct lib_ring_buffer_config *config,
@@ -119,6 +119,10 @@ int lib_ring_buffer_try_reserve(const struct lib_ring_buffer_config *config,
 		 */
 		return 1;
 
+	/* The slow path drops the record. */
+	if (unlikely(lib_ring_buffer_critical_full(config, ctx, *o_end)))
+		return 1;
+
 	return 0;
 }
 
@@ -155,8 +159,13 @@ int lib_ring_buffer_reserve(const struct lib_ring_buffer_config *config,
 		buf = per_cpu_ptr(chan->backend.buf, ctx->cpu);
 	else
 		buf = chan->backend.buf;
-	if (unlikely(atomic_read(&buf->record_disabled)))
+	if (unlikely(atomic_read(&buf->record_disabled))) {
+		if (unlikely(!buf->backend.allocated))
+			lib_ring_buffer_lazy_alloc_request(chan, ctx->cpu);
 		return -EAGAIN;
+	}
+	if (unlikely(READ_ONCE(buf->switch_pending)))
+		lib_ring_buffer_switch_pending(buf);
 	ctx->buf = buf;
 
 	/*
@@ -167,8 +176,10 @@ int lib_ring_buffer_reserve(const struct lib_ring_buffer_config *config,
 		goto slow_path;
 
 	if (unlikely(v_cmpxchg(config, &ctx->buf->offset, o_old, o_end)
-		     != o_old))
+		     != o_old)) {
+		v_inc(config, &ctx->buf->reserve_retries);
 		goto slow_path;
+	}
 
 	/*
 	 * Atomically update last_tsc. This update races against concurrent
@@ -243,19 +254,8 @@ void lib_ring_buffer_commit(const struct lib_ring_buffer_config *config,
 	 */
 	subbuffer_count_record(config, &buf->backend, endidx);
 
-	/*
-	 * Order all writes to buffer before the commit count update that will
-	 * determine that the subbuffer is full.
-	 */
-	if (config->ipi == RING_BUFFER_IPI_BARRIER) {
-		/*
-		 * Must write slot data before incrementing commit count.  This
-		 * compiler barrier is upgraded into a smp_mb() by the IPI sent
-		 * by get_subbuf().
-		 */
-		barrier();
-	} else
-		smp_wmb();
+	/* Must write slot data before incrementing commit count. */
+	lib_ring_buffer_commit_barrier(config, buf);
 
 	v_add(config, ctx->slot_size, &cc_hot->cc);
 
@@ -327,6 +327,39 @@ int lib_ring_buffer_try_discard_reserve(const struct lib_ring_buffer_config *con
 		return 0;
 }
 
+/**
+ * lib_ring_buffer_try_shrink_reserve - Try shrinking a reserved record.
+ * @config: ring buffer instance configuration.
+ * @ctx: ring buffer context.
+ * @end_offset: new end of the record, before the reserved end.
+ *
+ * Gives back the unused tail of a record reserved for an upper bound of
+ * its size, before it is committed. Only succeeds if no other record has
+ * been reserved after the record to shrink, and if the reservation did
+ * not end the sub-buffer. ctx->slot_size is then updated, so the commit
+ * accounts for the shrunk record. If shrink fails, the whole reserved
+ * slot must be written and committed.
+ *
+ * Returns 0 upon success, -EPERM if the record cannot be shrunk.
+ */
+static inline
+int lib_ring_buffer_try_shrink_reserve(const struct lib_ring_buffer_config *config,
+				       struct lib_ring_buffer_ctx *ctx,
+				       unsigned long end_offset)
+{
+	struct lib_ring_buffer *buf = ctx->buf;
+	unsigned long reserved_end = ctx->pre_offset + ctx->slot_size;
+
+	/* The reserve slow path already switched out the sub-buffer. */
+	if (unlikely(!subbuf_offset(reserved_end, ctx->chan)))
+		return -EPERM;
+	if (v_cmpxchg(config, &buf->offset, reserved_end, end_offset)
+			!= reserved_end)
+		return -EPERM;
+	ctx->slot_size = end_offset - ctx->pre_offset;
+	return 0;
+}
+
 static inline
 void channel_record_disable(const struct lib_ring_buffer_config *config,
 			    struct channel *chan)
@@ -341,6 +374,20 @@ void channel_record_enable(const struct lib_ring_buffer_config *config,
 	atomic_dec(&chan->record_disabled);
 }
 
+static inline
+void channel_record_freeze(const struct lib_ring_buffer_config *config,
+			   struct channel *chan)
+{
+	atomic_add(RING_BUFFER_RECORD_FROZEN, &chan->record_disabled);
+}
+
+static inline
+void channel_record_thaw(const struct lib_ring_buffer_config *config,
+			 struct channel *chan)
+{
+	atomic_sub(RING_BUFFER_RECORD_FROZEN, &chan->record_disabled);
+}
+
 static inline
 void lib_ring_buffer_record_disable(const struct lib_ring_buffer_config *config,
 				    struct lib_ring_buffer *buf)
@@ -15,7 +15,7 @@
 #include <wrapper/ringbuffer/config.h>
 #include <wrapper/ringbuffer/backend_types.h>
 #include <wrapper/ringbuffer/frontend_types.h>
-#include <lib/prio_heap/lttng_prio_heap.h>	/* For per-CPU read-side iterator */
+#include <lib/prio_heap/lttng_loser_tree.h>	/* For per-CPU read-side iterator */
 
 /* Buffer offset macros */
 
@@ -137,10 +137,16 @@ extern
 int lib_ring_buffer_reserve_slow(struct lib_ring_buffer_ctx *ctx,
 		void *client_ctx);
 
+extern
+void lib_ring_buffer_lazy_alloc_request(struct channel *chan, int cpu);
+
 extern
 void lib_ring_buffer_switch_slow(struct lib_ring_buffer *buf,
 				 enum switch_mode mode);
 
+extern
+void lib_ring_buffer_switch_pending(struct lib_ring_buffer *buf);
+
 extern
 void lib_ring_buffer_check_deliver_slow(const struct lib_ring_buffer_config *config,
 				   struct lib_ring_buffer *buf,
@@ -154,6 +160,29 @@ extern
 void lib_ring_buffer_switch_remote(struct lib_ring_buffer *buf);
 extern
 void lib_ring_buffer_switch_remote_empty(struct lib_ring_buffer *buf);
+extern
+void lib_ring_buffer_hp_flush(struct lib_ring_buffer *buf);
+
+/*
+ * Order all writes to buffer before the commit count update that will
+ * determine that the subbuffer is full.
+ */
+static inline
+void lib_ring_buffer_commit_barrier(const struct lib_ring_buffer_config *config,
+				    struct lib_ring_buffer *buf)
+{
+	/*
+	 * With RING_BUFFER_IPI_BARRIER, this compiler barrier is upgraded
+	 * into a smp_mb() by the IPI sent by get_subbuf(). Isolated cpus,
+	 * and the cpus of channels with writer barriers, are not sent IPIs,
+	 * so their writers need the write barrier.
+	 */
+	if (config->ipi == RING_BUFFER_IPI_BARRIER && likely(!buf->isolated)
+	    && likely(!buf->backend.chan->writer_barrier))
+		barrier();
+	else
+		smp_wmb();
+}
 
 /* Buffer write helpers */
 
@@ -183,6 +212,52 @@ void lib_ring_buffer_reserve_push_reader(struct lib_ring_buffer *buf,
 			return;
 	} while (unlikely(atomic_long_cmpxchg(&buf->consumed, consumed_old,
 					      consumed_new) != consumed_old));
+	/* The writer overwrites the sub-buffer the reader is behind on. */
+	v_inc(&chan->backend.config, &buf->reader_blocked);
+}
+
+/*
+ * Discard mode: position up to which writers can reuse the buffer space,
+ * held back by the secondary reader, if any, when it is behind the
+ * consumed position.
+ */
+static inline
+unsigned long lib_ring_buffer_reclaim_pos(struct lib_ring_buffer *buf)
+{
+	unsigned long consumed, secondary;
+
+	consumed = atomic_long_read(&buf->consumed);
+	/* Load consumed before secondary_readers, see open_read_secondary. */
+	smp_rmb();
+	if (likely(!atomic_long_read(&buf->secondary_readers)))
+		return consumed;
+	secondary = atomic_long_read(&buf->secondary_consumed);
+	if ((long) secondary - (long) consumed < 0)
+		return secondary;
+	return consumed;
+}
+
+/*
+ * Discard mode: whether a record which is not critical, ending at
+ * "offset_end", would use the critical reserve at the end of the last
+ * sub-buffer free for writing.
+ */
+static inline
+int lib_ring_buffer_critical_full(const struct lib_ring_buffer_config *config,
+				  struct lib_ring_buffer_ctx *ctx,
+				  unsigned long offset_end)
+{
+	struct channel *chan = ctx->chan;
+	unsigned long reserve;
+
+	if (config->mode != RING_BUFFER_DISCARD)
+		return 0;
+	reserve = READ_ONCE(chan->critical_reserve);
+	if (likely(!reserve) || ctx->critical)
+		return 0;
+	return offset_end - subbuf_trunc(lib_ring_buffer_reclaim_pos(ctx->buf),
+					 chan)
+		> chan->backend.buf_size - reserve;
 }
 
 static inline
@@ -13,9 +13,12 @@
 #define _LIB_RING_BUFFER_FRONTEND_TYPES_H
 
 #include <linux/kref.h>
+#include <linux/cpumask.h>
+#include <linux/irq_work.h>
+#include <linux/workqueue.h>
 #include <wrapper/ringbuffer/config.h>
 #include <wrapper/ringbuffer/backend_types.h>
-#include <lib/prio_heap/lttng_prio_heap.h>	/* For per-CPU read-side iterator */
+#include <lib/prio_heap/lttng_loser_tree.h>	/* For per-CPU read-side iterator */
 #include <lttng-cpuhotplug.h>
 
 /*
@@ -26,8 +29,8 @@ enum switch_mode { SWITCH_ACTIVE, SWITCH_FLUSH };
 
 /* channel-level read-side iterator */
 struct channel_iter {
-	/* Prio heap of buffers. Lowest timestamps at the top. */
-	struct lttng_ptr_heap heap;	/* Heap of struct lib_ring_buffer ptrs */
+	/* Buffers by cpu slot. Lowest timestamp wins. */
+	struct lttng_loser_tree tree;	/* Tree of struct lib_ring_buffer ptrs */
 	struct list_head empty_head;	/* Empty buffers linked-list head */
 	int read_open;			/* Opened for reading ? */
 	u64 last_qs;			/* Last quiescent state timestamp */
@@ -39,6 +42,8 @@ struct channel_iter {
 	unsigned long len_left;
 };
 
+struct lib_ring_buffer_crash_desc;
+
 /* channel: collection of per-cpu ring buffers. */
 struct channel {
 	atomic_t record_disabled;
@@ -48,11 +53,32 @@ struct channel {
 						 * bits used to represent the
 						 * subbuffer index.
 						 */
+	unsigned long critical_reserve;		/*
+						 * Discard mode: bytes at the end
+						 * of the buffer only critical
+						 * records may use, 0: none
+						 */
 
 	struct channel_backend backend;		/* Associated backend */
 
 	unsigned long switch_timer_interval;	/* Buffer flush (jiffies) */
 	unsigned long read_timer_interval;	/* Reader wakeup (jiffies) */
+	unsigned long read_timer_max_interval;	/* Adaptive if non-zero */
+	unsigned long live_latency;		/*
+						 * Delivery deadline of the
+						 * records (jiffies), 0: flush
+						 * every switch timer interval
+						 */
+	unsigned int critical_reserve_pct;	/* Of the sub-buffer size */
+	unsigned int blocking_timeout;		/*
+						 * Discard mode: usecs writers
+						 * wait for the reader, 0: none
+						 */
+	int writer_barrier;			/*
+						 * IPI barrier mode: writers
+						 * order their commits, readers
+						 * send no IPI
+						 */
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,10,0))
 	struct lttng_cpuhp_node cpuhp_prepare;
 	struct lttng_cpuhp_node cpuhp_online;
@@ -67,7 +93,14 @@ struct channel {
 	wait_queue_head_t read_wait;		/* reader wait queue */
 	wait_queue_head_t hp_wait;		/* CPU hotplug wait queue */
 	int finalized;				/* Has channel been finalized */
+	/* Lazy allocation (RING_BUFFER_CHANNEL_LAZY_ALLOC) */
+	cpumask_var_t lazy_alloc_pending;	/* Buffers requested by writers */
+	struct irq_work lazy_alloc_irq_work;	/* Leaves the tracing context */
+	struct work_struct lazy_alloc_work;	/* Allocates the buffers */
+	/* Crash descriptor (RING_BUFFER_OOPS_CONSISTENCY), see crash.h */
+	struct lib_ring_buffer_crash_desc *crash_desc;
 	struct channel_iter iter;		/* Channel read-side iterator */
+	atomic_t mmap_count;			/* Channel-wide mappings */
 	struct kref ref;			/* Reference count */
 };
 
@@ -111,6 +144,7 @@ struct lib_ring_buffer {
 					 * standard atomic access (shared)
 					 */
 	atomic_t record_disabled;
+	int switch_pending;		/* Switch requested from another cpu */
 	/* End of first 32 bytes cacheline */
 	union v_atomic last_tsc;	/*
 					 * Last timestamp written in the buffer.
@@ -130,20 +164,53 @@ struct lib_ring_buffer {
 	union v_atomic records_lost_big;	/* Events too big */
 	union v_atomic records_count;	/* Number of records written */
 	union v_atomic records_overrun;	/* Number of overwritten records */
+					/* Contention and slow path */
+	union v_atomic reserve_retries;	/* Lost write offset updates */
+	union v_atomic reserve_slow;	/* Slow path reservations */
+	union v_atomic subbuf_switches;	/* Sub-buffers closed by writers */
+	union v_atomic commit_overflows;	/* Next sub-buffer still committing */
+	union v_atomic reader_blocked;	/* Next sub-buffer not consumed */
+	atomic_long_t fill_hwm;		/* Max unconsumed bytes since last read */
+	unsigned long fill_threshold;	/* Poll priority fill level, 0: full */
 	wait_queue_head_t read_wait;	/* reader buffer-level wait queue */
 	wait_queue_head_t write_wait;	/* writer buffer-level wait queue (for metadata only) */
+	struct lib_ring_buffer_ctrl *ctrl;	/* mmap control area (RING_BUFFER_MMAP) */
 	int finalized;			/* buffer has been finalized */
 	struct timer_list switch_timer;	/* timer for periodical switch */
 	struct timer_list read_timer;	/* timer for read poll */
+	struct list_head timer_node;	/* Per-cpu timer base list */
+	unsigned long switch_timer_expires;	/* Per-cpu timer base (jiffies) */
+	unsigned long read_timer_expires;	/* Per-cpu timer base (jiffies) */
+	unsigned long read_timer_period;	/* Current period (jiffies) */
+	unsigned long read_timer_offset;	/* Write offset at last poll */
+	unsigned long live_pending_subbuf;	/* Sub-buffer holding data at last live check */
+	unsigned long live_idle_since;	/* Last live delivery (jiffies) */
+	int live_pending;		/*
+					 * live_pending_subbuf data not
+					 * delivered, switch timer only
+					 */
 	raw_spinlock_t raw_tick_nohz_spinlock;	/* nohz entry lock/trylock */
+	struct work_struct isolated_switch_work;	/* Idle isolated cpu */
+	int hp_flush_pending;		/* Cpu dead, switch left to the reader */
+	unsigned long isolated_switch_offset;	/* Offset after last switch */
 	struct lib_ring_buffer_iter iter;	/* read-side iterator */
 	unsigned long get_subbuf_consumed;	/* Read-side consumed */
+	unsigned long get_subbuf_run;	/* Sub-buffers held from get_subbuf_consumed, 0: one */
 	unsigned long prod_snapshot;	/* Producer count snapshot */
 	unsigned long cons_snapshot;	/* Consumer count snapshot */
+	atomic_long_t secondary_readers;	/* Secondary reader count (0 or 1) */
+	atomic_long_t secondary_consumed;	/*
+					 * Secondary reader position,
+					 * holding back writers with consumed
+					 */
+	unsigned long secondary_get_consumed;	/* Held by the secondary reader */
+	unsigned long secondary_sb_bindex;	/* Sub-buffer held by the secondary reader */
+	int secondary_get_subbuf;	/* Sub-buffer being held by secondary reader */
 	unsigned int get_subbuf:1,	/* Sub-buffer being held by reader */
 		switch_timer_enabled:1,	/* Protected by ring_buffer_nohz_lock */
 		read_timer_enabled:1,	/* Protected by ring_buffer_nohz_lock */
-		quiescent:1;
+		quiescent:1,
+		isolated:1;		/* nohz_full cpu, see channel_create() */
 };
 
 static inline
@@ -14,7 +14,13 @@
 #include <linux/slab.h>
 #include <linux/cpu.h>
 #include <linux/mm.h>
+#include <linux/nodemask.h>
 #include <linux/vmalloc.h>
+#include <linux/moduleparam.h>
+#include <linux/spinlock.h>
+#include <linux/log2.h>
+#include <linux/version.h>
+#include <linux/workqueue.h>
 
 #include <wrapper/mm.h>
 #include <wrapper/vmalloc.h>	/* for wrapper_vmalloc_sync_all() */
@@ -22,6 +28,224 @@
 #include <wrapper/ringbuffer/backend.h>
 #include <wrapper/ringbuffer/frontend.h>
 
+/*
+ * Reserve of pages for RING_BUFFER_STATIC buffers, allocated when the
+ * module is loaded. Loading it early (e.g. from the initramfs) sets the
+ * buffer memory aside before the system gets loaded or fragmented.
+ * RING_BUFFER_STATIC buffers only take pages from the reserve, so
+ * creating their channel never enters reclaim or compaction, and fails
+ * if the reserve is exhausted. Freed buffer pages go back to the
+ * reserve.
+ */
+static unsigned long static_reserve_mb;
+module_param_named(static_reserve_mb, static_reserve_mb, ulong, 0444);
+MODULE_PARM_DESC(static_reserve_mb, "Memory reserved at load time for static buffers, in MB, spread over the online nodes (default: 0)");
+
+/*
+ * Payloads of at least nocache_copy_threshold bytes are copied into the
+ * buffers with non-temporal stores where available, keeping large
+ * sequences and callstacks out of the cache of the traced code. The
+ * value is taken when a channel is created.
+ */
+static unsigned int nocache_copy_threshold;
+module_param_named(nocache_copy_threshold, nocache_copy_threshold, uint, 0644);
+MODULE_PARM_DESC(nocache_copy_threshold, "Payload size from which copies bypass the cache, in bytes (default: 0, disabled)");
+
+/*
+ * With high_order_alloc, the pages of each sub-buffer are allocated as
+ * a single physically contiguous block when the allocator can provide
+ * one without reclaim, falling back to page by page allocation. This
+ * makes the creation of large buffers faster, and lets the writers
+ * and readers of a sub-buffer go through the kernel linear mapping with
+ * fewer TLB entries.
+ */
+static int high_order_alloc = 1;
+module_param(high_order_alloc, int, 0644);
+MODULE_PARM_DESC(high_order_alloc, "Allocate sub-buffers as contiguous blocks when possible (0: disabled, 1: enabled)");
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6,8,0))
+#define RING_BUFFER_MAX_ALLOC_ORDER	MAX_PAGE_ORDER
+#elif (LINUX_VERSION_CODE >= KERNEL_VERSION(6,4,0))
+#define RING_BUFFER_MAX_ALLOC_ORDER	MAX_ORDER
+#else
+#define RING_BUFFER_MAX_ALLOC_ORDER	(MAX_ORDER - 1)
+#endif
+
+struct lib_ring_buffer_static_node {
+	struct list_head pages;		/* Linked through page->lru */
+	unsigned long nr_pages;
+};
+
+static DEFINE_SPINLOCK(static_reserve_lock);
+static struct lib_ring_buffer_static_node *static_reserve;
+static unsigned long static_reserve_nr_pages;	/* Total, in use or not */
+
+static
+struct page *lib_ring_buffer_static_page_get(int node)
+{
+	struct lib_ring_buffer_static_node *snode;
+	struct page *page = NULL;
+	int iter_node;
+
+	if (!static_reserve)
+		return NULL;
+	spin_lock(&static_reserve_lock);
+	snode = &static_reserve[node];
+	if (!snode->nr_pages) {
+		/* Fall back on the other nodes. */
+		for_each_online_node(iter_node) {
+			if (static_reserve[iter_node].nr_pages) {
+				snode = &static_reserve[iter_node];
+				break;
+			}
+		}
+	}
+	if (snode->nr_pages) {
+		page = list_first_entry(&snode->pages, struct page, lru);
+		list_del(&page->lru);
+		snode->nr_pages--;
+	}
+	spin_unlock(&static_reserve_lock);
+	/* Do not leak the content of a previous buffer. */
+	if (page)
+		clear_page(page_address(page));
+	return page;
+}
+
+static
+void lib_ring_buffer_static_page_put(struct page *page)
+{
+	struct lib_ring_buffer_static_node *snode;
+
+	snode = &static_reserve[page_to_nid(page)];
+	spin_lock(&static_reserve_lock);
+	list_add(&page->lru, &snode->pages);
+	snode->nr_pages++;
+	spin_unlock(&static_reserve_lock);
+}
+
+static
+struct page *lib_ring_buffer_backend_page_alloc(
+		const struct lib_ring_buffer_config *config, int node)
+{
+	if (config->backend == RING_BUFFER_STATIC)
+		return lib_ring_buffer_static_page_get(node);
+	return alloc_pages_node(node, GFP_KERNEL | __GFP_NOWARN | __GFP_ZERO, 0);
+}
+
+static
+void lib_ring_buffer_backend_page_free(
+		const struct lib_ring_buffer_config *config, struct page *page)
+{
+	if (config->backend == RING_BUFFER_STATIC && static_reserve)
+		lib_ring_buffer_static_page_put(page);
+	else
+		__free_page(page);
+}
+
+/*
+ * Order of the block of pages allocated for each sub-buffer of
+ * @num_pages_per_subbuf pages, 0 to allocate them page by page.
+ */
+static
+unsigned int lib_ring_buffer_backend_alloc_order(
+		const struct lib_ring_buffer_config *config,
+		unsigned long num_pages_per_subbuf)
+{
+	unsigned int order;
+
+	if (!READ_ONCE(high_order_alloc) || config->backend == RING_BUFFER_STATIC
+			|| num_pages_per_subbuf < 2)
+		return 0;
+	order = ilog2(num_pages_per_subbuf);
+	if (order > RING_BUFFER_MAX_ALLOC_ORDER)
+		return 0;
+	return order;
+}
+
+/*
+ * Allocate a block of 2^@order pages, split into order-0 pages so they
+ * are freed, mapped and moved into splice pipes one by one like pages
+ * allocated individually. Returns the first page, or NULL.
+ */
+static
+struct page *lib_ring_buffer_backend_block_alloc(int node, unsigned int order)
+{
+	struct page *page;
+
+	page = alloc_pages_node(node, GFP_KERNEL | __GFP_NOWARN
+			| __GFP_NORETRY | __GFP_ZERO, order);
+	if (!page)
+		return NULL;
+	split_page(page, order);
+	return page;
+}
+
+/*
+ * Number of pages of the static buffer reserve, 0 if there is none.
+ */
+unsigned long lib_ring_buffer_static_reserve_pages(void)
+{
+	return static_reserve_nr_pages;
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_static_reserve_pages);
+
+int lib_ring_buffer_static_reserve_init(void)
+{
+	unsigned long nr_pages, i;
+	int node;
+
+	if (!static_reserve_mb)
+		return 0;
+	static_reserve = kcalloc(nr_node_ids, sizeof(*static_reserve),
+			GFP_KERNEL);
+	if (!static_reserve)
+		return -ENOMEM;
+	for_each_node(node)
+		INIT_LIST_HEAD(&static_reserve[node].pages);
+	nr_pages = (static_reserve_mb << 20) >> PAGE_SHIFT;
+	node = first_online_node;
+	for (i = 0; i < nr_pages; i++) {
+		struct page *page;
+
+		page = alloc_pages_node(node, GFP_KERNEL | __GFP_THISNODE
+				| __GFP_NOWARN | __GFP_NORETRY, 0);
+		if (!page)
+			page = alloc_pages_node(node, GFP_KERNEL | __GFP_NOWARN, 0);
+		if (!page) {
+			lib_ring_buffer_static_reserve_exit();
+			return -ENOMEM;
+		}
+		list_add(&page->lru, &static_reserve[page_to_nid(page)].pages);
+		static_reserve[page_to_nid(page)].nr_pages++;
+		static_reserve_nr_pages++;
+		node = next_online_node(node);
+		if (node == MAX_NUMNODES)
+			node = first_online_node;
+	}
+	return 0;
+}
+
+/* Called when all buffers are freed. */
+void lib_ring_buffer_static_reserve_exit(void)
+{
+	struct page *page, *tmp;
+	int node;
+
+	if (!static_reserve)
+		return;
+	for_each_node(node) {
+		list_for_each_entry_safe(page, tmp,
+				&static_reserve[node].pages, lru) {
+			list_del(&page->lru);
+			__free_page(page);
+		}
+	}
+	kfree(static_reserve);
+	static_reserve = NULL;
+	static_reserve_nr_pages = 0;
+}
+
 /**
  * lib_ring_buffer_backend_allocate - allocate a channel buffer
  * @config: ring buffer instance configuration
@@ -42,6 +266,8 @@ int lib_ring_buffer_backend_allocate(const struct lib_ring_buffer_config *config
 	unsigned long num_subbuf_alloc;
 	struct page **pages;
 	unsigned long i;
+	unsigned int order;
+	int node;
 
 	num_pages = size >> PAGE_SHIFT;
 
@@ -52,7 +278,8 @@ int lib_ring_buffer_backend_allocate(const struct lib_ring_buffer_config *config
 	 * and returns if there should be enough free pages based on the
 	 * current estimate.
 	 */
-	if (!wrapper_check_enough_free_pages(num_pages))
+	if (config->backend != RING_BUFFER_STATIC
+			&& !wrapper_check_enough_free_pages(num_pages))
 		goto not_enough_pages;
 
 	/*
@@ -64,7 +291,7 @@ int lib_ring_buffer_backend_allocate(const struct lib_ring_buffer_config *config
 	wrapper_set_current_oom_origin();
 
 	num_pages_per_subbuf = num_pages >> get_count_order(num_subbuf);
-	subbuf_size = chanb->subbuf_size;
+	subbuf_size = size >> get_count_order(num_subbuf);
 	num_subbuf_alloc = num_subbuf;
 
 	if (extra_reader_sb) {
@@ -74,7 +301,7 @@ int lib_ring_buffer_backend_allocate(const struct lib_ring_buffer_config *config
 
 	pages = vmalloc_node(ALIGN(sizeof(*pages) * num_pages,
 				   1 << INTERNODE_CACHE_SHIFT),
-			cpu_to_node(max(bufb->cpu, 0)));
+			bufb->node);
 	if (unlikely(!pages))
 		goto pages_error;
 
@@ -82,15 +309,41 @@ int lib_ring_buffer_backend_allocate(const struct lib_ring_buffer_config *config
 					 * num_subbuf_alloc,
 				  1 << INTERNODE_CACHE_SHIFT),
 			GFP_KERNEL | __GFP_NOWARN,
-			cpu_to_node(max(bufb->cpu, 0)));
+			bufb->node);
 	if (unlikely(!bufb->array))
 		goto array_error;
 
-	for (i = 0; i < num_pages; i++) {
-		pages[i] = alloc_pages_node(cpu_to_node(max(bufb->cpu, 0)),
-				GFP_KERNEL | __GFP_NOWARN | __GFP_ZERO, 0);
+	/*
+	 * Blocks are only allocated at sub-buffer boundaries, and cover a
+	 * whole sub-buffer. Once a block allocation fails, the remaining
+	 * pages are allocated one by one. Interleaved buffers then go
+	 * round-robin per sub-buffer rather than per page.
+	 */
+	order = lib_ring_buffer_backend_alloc_order(config,
+			num_pages_per_subbuf);
+	node = bufb->node;
+	for (i = 0; i < num_pages;) {
+		if (chanb->numa_policy == RING_BUFFER_NUMA_INTERLEAVE) {
+			/* Round-robin, starting after the buffer node. */
+			node = next_online_node(node);
+			if (node == MAX_NUMNODES)
+				node = first_online_node;
+		}
+		if (order) {
+			struct page *block;
+
+			block = lib_ring_buffer_backend_block_alloc(node, order);
+			if (block) {
+				for (j = 0; j < num_pages_per_subbuf; j++)
+					pages[i++] = block + j;
+				continue;
+			}
+			order = 0;
+		}
+		pages[i] = lib_ring_buffer_backend_page_alloc(config, node);
 		if (unlikely(!pages[i]))
 			goto depopulate;
+		i++;
 	}
 	bufb->num_pages_per_subbuf = num_pages_per_subbuf;
 
@@ -103,7 +356,7 @@ int lib_ring_buffer_backend_allocate(const struct lib_ring_buffer_config *config
 				* num_pages_per_subbuf,
 				1 << INTERNODE_CACHE_SHIFT),
 				GFP_KERNEL | __GFP_NOWARN,
-				cpu_to_node(max(bufb->cpu, 0)));
+				bufb->node);
 		if (!bufb->array[i])
 			goto free_array;
 	}
@@ -114,7 +367,7 @@ int lib_ring_buffer_backend_allocate(const struct lib_ring_buffer_config *config
 				* num_subbuf,
 				1 << INTERNODE_CACHE_SHIFT),
 				GFP_KERNEL | __GFP_NOWARN,
-				cpu_to_node(max(bufb->cpu, 0)));
+				bufb->node);
 	if (unlikely(!bufb->buf_wsb))
 		goto free_array;
 
@@ -134,7 +387,7 @@ int lib_ring_buffer_backend_allocate(const struct lib_ring_buffer_config *config
 				* num_subbuf,
 				1 << INTERNODE_CACHE_SHIFT),
 			GFP_KERNEL | __GFP_NOWARN,
-			cpu_to_node(max(bufb->cpu, 0)));
+			bufb->node);
 	if (unlikely(!bufb->buf_cnt))
 		goto free_wsb;
 
@@ -152,6 +405,17 @@ int lib_ring_buffer_backend_allocate(const struct lib_ring_buffer_config *config
 		}
 	}
 
+	/* Map each sub-buffer contiguously */
+	if (config->backend == RING_BUFFER_VMAP) {
+		for (i = 0; i < num_subbuf_alloc; i++) {
+			bufb->array[i]->vaddr =
+				vmap(&pages[i * num_pages_per_subbuf],
+				     num_pages_per_subbuf, VM_MAP, PAGE_KERNEL);
+			if (unlikely(!bufb->array[i]->vaddr))
+				goto free_vmap;
+		}
+	}
+
 	/*
 	 * If kmalloc ever uses vmalloc underneath, make sure the buffer pages
 	 * will not fault.
@@ -161,6 +425,12 @@ int lib_ring_buffer_backend_allocate(const struct lib_ring_buffer_config *config
 	vfree(pages);
 	return 0;
 
+free_vmap:
+	for (i = 0; i < num_subbuf_alloc; i++) {
+		if (bufb->array[i]->vaddr)
+			vunmap(bufb->array[i]->vaddr);
+	}
+	lttng_kvfree(bufb->buf_cnt);
 free_wsb:
 	lttng_kvfree(bufb->buf_wsb);
 free_array:
@@ -169,7 +439,7 @@ free_array:
 depopulate:
 	/* Free all allocated pages */
 	for (i = 0; (i < num_pages && pages[i]); i++)
-		__free_page(pages[i]);
+		lib_ring_buffer_backend_page_free(config, pages[i]);
 	lttng_kvfree(bufb->array);
 array_error:
 	vfree(pages);
@@ -179,39 +449,301 @@ not_enough_pages:
 	return -ENOMEM;
 }
 
-int lib_ring_buffer_backend_create(struct lib_ring_buffer_backend *bufb,
-				   struct channel_backend *chanb, int cpu)
+/*
+ * The pool holds up to two sub-buffers worth of pages, which covers a
+ * sub-buffer in flight in the pipe while the next one is spliced.
+ */
+static
+struct lib_ring_buffer_page_pool *
+	lib_ring_buffer_page_pool_create(struct lib_ring_buffer_backend *bufb)
+{
+	struct lib_ring_buffer_page_pool *pool;
+	int node = bufb->node;
+
+	pool = kzalloc_node(sizeof(*pool), GFP_KERNEL, node);
+	if (!pool)
+		return NULL;
+	kref_init(&pool->ref);
+	spin_lock_init(&pool->lock);
+	INIT_LIST_HEAD(&pool->pages);
+	pool->max_pages = 2 * bufb->num_pages_per_subbuf;
+	pool->node = node;
+	return pool;
+}
+
+void lib_ring_buffer_page_pool_release(struct kref *kref)
+{
+	struct lib_ring_buffer_page_pool *pool =
+		container_of(kref, struct lib_ring_buffer_page_pool, ref);
+	struct page *page, *tmp;
+
+	list_for_each_entry_safe(page, tmp, &pool->pages, lru) {
+		list_del(&page->lru);
+		__free_page(page);
+	}
+	kfree(pool);
+}
+
+/*
+ * Get a replacement page. Recycled pages are not cleared: they only hold
+ * data previously produced in this buffer.
+ */
+struct page *lib_ring_buffer_page_pool_get(struct lib_ring_buffer_page_pool *pool)
+{
+	struct page *page = NULL;
+
+	spin_lock(&pool->lock);
+	if (!list_empty(&pool->pages)) {
+		page = list_first_entry(&pool->pages, struct page, lru);
+		list_del(&page->lru);
+		pool->nr_pages--;
+	}
+	spin_unlock(&pool->lock);
+	if (page)
+		return page;
+	return alloc_pages_node(pool->node, GFP_KERNEL | __GFP_ZERO, 0);
+}
+
+/*
+ * Put back a page released by a pipe. Only pages we hold the last
+ * reference to can be recycled: pages stolen by the splice target (e.g.
+ * moved into the page cache) are simply released.
+ */
+void lib_ring_buffer_page_pool_put(struct lib_ring_buffer_page_pool *pool,
+				   struct page *page)
+{
+	if (page_count(page) == 1) {
+		spin_lock(&pool->lock);
+		if (pool->nr_pages < pool->max_pages) {
+			list_add(&page->lru, &pool->pages);
+			pool->nr_pages++;
+			page = NULL;
+		}
+		spin_unlock(&pool->lock);
+	}
+	if (page)
+		__free_page(page);
+}
+
+/*
+ * Memory node of the buffer of "cpu" (-1 for the global buffer). It is
+ * computed when the buffer is created, which happens at cpu hotplug
+ * prepare for cpus brought online after channel creation.
+ */
+static
+int lib_ring_buffer_backend_node(struct channel_backend *chanb, int cpu)
+{
+	if (chanb->numa_policy == RING_BUFFER_NUMA_NODE)
+		return chanb->numa_node;
+	return cpu_to_node(max(cpu, 0));
+}
+
+static
+void lib_ring_buffer_backend_free_subbufs(struct lib_ring_buffer_backend *bufb,
+					  size_t num_subbuf);
+
+/*
+ * Sub-buffers and splice page pool of a buffer, for the given geometry.
+ */
+static
+int lib_ring_buffer_backend_alloc_subbufs(struct lib_ring_buffer_backend *bufb,
+					  size_t subbuf_size, size_t num_subbuf)
 {
+	struct channel_backend *chanb = &bufb->chan->backend;
 	const struct lib_ring_buffer_config *config = &chanb->config;
+	int ret;
 
+	ret = lib_ring_buffer_backend_allocate(config, bufb,
+					       subbuf_size * num_subbuf,
+					       num_subbuf,
+					       chanb->extra_reader_sb);
+	if (ret)
+		return ret;
+	if (config->output == RING_BUFFER_SPLICE) {
+		bufb->page_pool = lib_ring_buffer_page_pool_create(bufb);
+		if (!bufb->page_pool) {
+			lib_ring_buffer_backend_free_subbufs(bufb, num_subbuf);
+			return -ENOMEM;
+		}
+	}
+	return 0;
+}
+
+int lib_ring_buffer_backend_create(struct lib_ring_buffer_backend *bufb,
+				   struct channel_backend *chanb, int cpu)
+{
 	bufb->chan = container_of(chanb, struct channel, backend);
 	bufb->cpu = cpu;
+	bufb->node = lib_ring_buffer_backend_node(chanb, cpu);
 
-	return lib_ring_buffer_backend_allocate(config, bufb, chanb->buf_size,
-						chanb->num_subbuf,
-						chanb->extra_reader_sb);
+	return lib_ring_buffer_backend_alloc_subbufs(bufb, chanb->subbuf_size,
+						     chanb->num_subbuf);
 }
 
-void lib_ring_buffer_backend_free(struct lib_ring_buffer_backend *bufb)
+static
+void lib_ring_buffer_backend_free_subbufs(struct lib_ring_buffer_backend *bufb,
+					  size_t num_subbuf)
 {
 	struct channel_backend *chanb = &bufb->chan->backend;
+	const struct lib_ring_buffer_config *config = &chanb->config;
 	unsigned long i, j, num_subbuf_alloc;
 
-	num_subbuf_alloc = chanb->num_subbuf;
+	num_subbuf_alloc = num_subbuf;
 	if (chanb->extra_reader_sb)
 		num_subbuf_alloc++;
 
 	lttng_kvfree(bufb->buf_wsb);
 	lttng_kvfree(bufb->buf_cnt);
 	for (i = 0; i < num_subbuf_alloc; i++) {
+		if (bufb->array[i]->vaddr)
+			vunmap(bufb->array[i]->vaddr);
 		for (j = 0; j < bufb->num_pages_per_subbuf; j++)
-			__free_page(pfn_to_page(bufb->array[i]->p[j].pfn));
+			lib_ring_buffer_backend_page_free(config,
+				pfn_to_page(bufb->array[i]->p[j].pfn));
 		lttng_kvfree(bufb->array[i]);
 	}
 	lttng_kvfree(bufb->array);
+	if (bufb->page_pool) {
+		kref_put(&bufb->page_pool->ref,
+			 lib_ring_buffer_page_pool_release);
+		bufb->page_pool = NULL;
+	}
+}
+
+void lib_ring_buffer_backend_free(struct lib_ring_buffer_backend *bufb)
+{
+	lib_ring_buffer_backend_free_subbufs(bufb,
+			bufb->chan->backend.num_subbuf);
 	bufb->allocated = 0;
 }
 
+/**
+ * lib_ring_buffer_backend_node_pages - count the buffer pages of a node
+ * @bufb: buffer backend
+ * @node: memory node
+ * @nr_pages: receives the number of pages of the buffer
+ *
+ * Returns the number of pages of the buffer on @node, which can be less
+ * than the pages allocated on the node of the buffer when the node ran
+ * out of memory. Pages exchanged with the splice page pool meanwhile may
+ * be miscounted.
+ */
+unsigned long lib_ring_buffer_backend_node_pages(struct lib_ring_buffer_backend *bufb,
+						 int node, unsigned long *nr_pages)
+{
+	struct channel_backend *chanb = &bufb->chan->backend;
+	unsigned long i, j, num_subbuf_alloc, node_pages = 0;
+
+	*nr_pages = 0;
+	if (!bufb->allocated)
+		return 0;
+	num_subbuf_alloc = chanb->num_subbuf;
+	if (chanb->extra_reader_sb)
+		num_subbuf_alloc++;
+	for (i = 0; i < num_subbuf_alloc; i++) {
+		for (j = 0; j < bufb->num_pages_per_subbuf; j++) {
+			if (pfn_to_nid(READ_ONCE(bufb->array[i]->p[j].pfn)) == node)
+				node_pages++;
+		}
+	}
+	*nr_pages = num_subbuf_alloc * bufb->num_pages_per_subbuf;
+	return node_pages;
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_backend_node_pages);
+
+/**
+ * lib_ring_buffer_backend_mem_usage - memory held by a buffer backend
+ * @bufb: buffer backend
+ * @data_bytes: receives the size of the buffer pages
+ *
+ * Returns the size of the page arrays and sub-buffer tables of the
+ * buffer, as aligned at allocation. The splice page pool, shared with
+ * the reader, is not counted.
+ */
+size_t lib_ring_buffer_backend_mem_usage(struct lib_ring_buffer_backend *bufb,
+					 size_t *data_bytes)
+{
+	struct channel_backend *chanb = &bufb->chan->backend;
+	unsigned long num_subbuf_alloc;
+	size_t bytes;
+
+	*data_bytes = 0;
+	if (!bufb->allocated)
+		return 0;
+	num_subbuf_alloc = chanb->num_subbuf;
+	if (chanb->extra_reader_sb)
+		num_subbuf_alloc++;
+	*data_bytes = (size_t) num_subbuf_alloc * bufb->num_pages_per_subbuf
+			* PAGE_SIZE;
+	bytes = ALIGN(sizeof(*bufb->array) * num_subbuf_alloc,
+		      1 << INTERNODE_CACHE_SHIFT);
+	bytes += num_subbuf_alloc
+		* ALIGN(sizeof(struct lib_ring_buffer_backend_pages)
+			+ sizeof(struct lib_ring_buffer_backend_page)
+			  * bufb->num_pages_per_subbuf,
+			1 << INTERNODE_CACHE_SHIFT);
+	bytes += ALIGN(sizeof(*bufb->buf_wsb) * chanb->num_subbuf,
+		       1 << INTERNODE_CACHE_SHIFT);
+	bytes += ALIGN(sizeof(*bufb->buf_cnt) * chanb->num_subbuf,
+		       1 << INTERNODE_CACHE_SHIFT);
+	return bytes;
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_backend_mem_usage);
+
+/**
+ * lib_ring_buffer_backend_resize_alloc - allocate resized sub-buffers
+ * @new_bufb: backend receiving the new sub-buffers
+ * @bufb: backend being resized
+ * @subbuf_size: new sub-buffer size
+ * @num_subbuf: new number of sub-buffers
+ *
+ * The new sub-buffers are placed as those of @bufb. They are installed
+ * by lib_ring_buffer_backend_resize_swap(), or freed with
+ * lib_ring_buffer_backend_resize_free().
+ */
+int lib_ring_buffer_backend_resize_alloc(struct lib_ring_buffer_backend *new_bufb,
+					 const struct lib_ring_buffer_backend *bufb,
+					 size_t subbuf_size, size_t num_subbuf)
+{
+	memset(new_bufb, 0, sizeof(*new_bufb));
+	new_bufb->chan = bufb->chan;
+	new_bufb->cpu = bufb->cpu;
+	new_bufb->node = bufb->node;
+	return lib_ring_buffer_backend_alloc_subbufs(new_bufb, subbuf_size,
+						     num_subbuf);
+}
+
+void lib_ring_buffer_backend_resize_free(struct lib_ring_buffer_backend *new_bufb,
+					 size_t num_subbuf)
+{
+	lib_ring_buffer_backend_free_subbufs(new_bufb, num_subbuf);
+}
+
+/**
+ * lib_ring_buffer_backend_resize_swap - install resized sub-buffers
+ * @bufb: backend being resized
+ * @new_bufb: backend holding the new sub-buffers, receives the old ones
+ *
+ * Must be called with the buffer idle and empty, before the channel
+ * geometry is updated. The packet sequence numbers continue after the
+ * packets delivered from the old sub-buffers.
+ */
+void lib_ring_buffer_backend_resize_swap(struct lib_ring_buffer_backend *bufb,
+					 struct lib_ring_buffer_backend *new_bufb)
+{
+	struct channel_backend *chanb = &bufb->chan->backend;
+	unsigned long i;
+
+	for (i = 0; i < chanb->num_subbuf; i++)
+		bufb->seq_base += bufb->buf_cnt[i].seq_cnt;
+	swap(bufb->buf_wsb, new_bufb->buf_wsb);
+	swap(bufb->buf_rsb, new_bufb->buf_rsb);
+	swap(bufb->buf_cnt, new_bufb->buf_cnt);
+	swap(bufb->array, new_bufb->array);
+	swap(bufb->num_pages_per_subbuf, new_bufb->num_pages_per_subbuf);
+	swap(bufb->page_pool, new_bufb->page_pool);
+}
+
 void lib_ring_buffer_backend_reset(struct lib_ring_buffer_backend *bufb)
 {
 	struct channel_backend *chanb = &bufb->chan->backend;
@@ -273,12 +805,16 @@ int lttng_cpuhp_rb_backend_prepare(unsigned int cpu,
 {
 	struct channel_backend *chanb = container_of(node,
 			struct channel_backend, cpuhp_prepare);
+	struct channel *chan = container_of(chanb, struct channel, backend);
 	const struct lib_ring_buffer_config *config = &chanb->config;
 	struct lib_ring_buffer *buf;
 	int ret;
 
 	CHAN_WARN_ON(chanb, config->alloc == RING_BUFFER_ALLOC_GLOBAL);
 
+	/* Created on first write, or never. */
+	if (chanb->lazy_alloc || !lib_ring_buffer_channel_cpu_traced(chan, cpu))
+		return 0;
 	buf = per_cpu_ptr(chanb->buf, cpu);
 	ret = lib_ring_buffer_create(buf, chanb, cpu);
 	if (ret) {
@@ -311,6 +847,7 @@ int lib_ring_buffer_cpu_hp_callback(struct notifier_block *nb,
 	unsigned int cpu = (unsigned long)hcpu;
 	struct channel_backend *chanb = container_of(nb, struct channel_backend,
 						     cpu_hp_notifier);
+	struct channel *chan = container_of(chanb, struct channel, backend);
 	const struct lib_ring_buffer_config *config = &chanb->config;
 	struct lib_ring_buffer *buf;
 	int ret;
@@ -320,6 +857,10 @@ int lib_ring_buffer_cpu_hp_callback(struct notifier_block *nb,
 	switch (action) {
 	case CPU_UP_PREPARE:
 	case CPU_UP_PREPARE_FROZEN:
+		/* Created on first write, or never. */
+		if (chanb->lazy_alloc
+				|| !lib_ring_buffer_channel_cpu_traced(chan, cpu))
+			break;
 		buf = per_cpu_ptr(chanb->buf, cpu);
 		ret = lib_ring_buffer_create(buf, chanb, cpu);
 		if (ret) {
@@ -343,6 +884,120 @@ int lib_ring_buffer_cpu_hp_callback(struct notifier_block *nb,
 
 #endif /* #else #if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,10,0)) */
 
+/**
+ * channel_backend_check_geometry - validate a sub-buffer geometry
+ * @config: client ring buffer configuration
+ * @subbuf_size: size of sub-buffers (>= PAGE_SIZE, power of 2)
+ * @num_subbuf: number of sub-buffers (power of 2)
+ */
+int channel_backend_check_geometry(const struct lib_ring_buffer_config *config,
+				   size_t subbuf_size, size_t num_subbuf)
+{
+	/* Check that the subbuffer size is larger than a page. */
+	if (subbuf_size < PAGE_SIZE)
+		return -EINVAL;
+
+	/*
+	 * Make sure the number of subbuffers and subbuffer size are
+	 * power of 2 and nonzero.
+	 */
+	if (!subbuf_size || (subbuf_size & (subbuf_size - 1)))
+		return -EINVAL;
+	if (!num_subbuf || (num_subbuf & (num_subbuf - 1)))
+		return -EINVAL;
+	/*
+	 * Overwrite mode buffers require at least 2 subbuffers per
+	 * buffer.
+	 */
+	if (config->mode == RING_BUFFER_OVERWRITE && num_subbuf < 2)
+		return -EINVAL;
+
+	return subbuffer_id_check_index(config, num_subbuf);
+}
+
+void channel_backend_set_geometry(struct channel_backend *chanb,
+				  size_t subbuf_size, size_t num_subbuf)
+{
+	chanb->buf_size = num_subbuf * subbuf_size;
+	chanb->subbuf_size = subbuf_size;
+	chanb->buf_size_order = get_count_order(chanb->buf_size);
+	chanb->subbuf_size_order = get_count_order(subbuf_size);
+	chanb->num_subbuf_order = get_count_order(num_subbuf);
+	chanb->num_subbuf = num_subbuf;
+}
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,10,0))
+
+struct lib_ring_buffer_node_create {
+	struct work_struct work;
+	struct channel_backend *chanb;
+	int node;
+	int ret;
+};
+
+static
+void lib_ring_buffer_node_create_work(struct work_struct *work)
+{
+	struct lib_ring_buffer_node_create *nc = container_of(work,
+			struct lib_ring_buffer_node_create, work);
+	struct channel_backend *chanb = nc->chanb;
+	struct channel *chan = container_of(chanb, struct channel, backend);
+	int cpu, ret;
+
+	for_each_cpu_and(cpu, cpumask_of_node(nc->node), cpu_online_mask) {
+		if (!lib_ring_buffer_channel_cpu_traced(chan, cpu))
+			continue;
+		ret = lib_ring_buffer_create(per_cpu_ptr(chanb->buf, cpu),
+					     chanb, cpu);
+		if (ret) {
+			nc->ret = ret;
+			return;
+		}
+	}
+}
+
+/*
+ * Create the buffers of the online cpus of each node from a work item
+ * running on that node, so the nodes allocate and clear the pages of
+ * their buffers in parallel rather than one cpu doing it all. The cpu
+ * hotplug prepare callback then finds these buffers allocated. Buffers
+ * created before an error are freed by the caller.
+ */
+static
+int lib_ring_buffer_create_per_node(struct channel_backend *chanb)
+{
+	struct lib_ring_buffer_node_create *nc;
+	int node, cpu, ret = 0;
+
+	if (chanb->lazy_alloc || num_online_nodes() < 2)
+		return 0;
+	nc = kcalloc(nr_node_ids, sizeof(*nc), GFP_KERNEL);
+	if (!nc)
+		return -ENOMEM;
+	get_online_cpus();
+	for_each_online_node(node) {
+		cpu = cpumask_any_and(cpumask_of_node(node), cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			continue;	/* Memory-only node */
+		nc[node].chanb = chanb;
+		nc[node].node = node;
+		INIT_WORK(&nc[node].work, lib_ring_buffer_node_create_work);
+		queue_work_on(cpu, system_long_wq, &nc[node].work);
+	}
+	for_each_online_node(node) {
+		if (!nc[node].chanb)
+			continue;
+		flush_work(&nc[node].work);
+		if (nc[node].ret)
+			ret = nc[node].ret;
+	}
+	put_online_cpus();
+	kfree(nc);
+	return ret;
+}
+
+#endif /* #if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,10,0)) */
+
 /**
  * channel_backend_init - initialize a channel backend
  * @chanb: channel backend
@@ -352,6 +1007,10 @@ int lib_ring_buffer_cpu_hp_callback(struct notifier_block *nb,
  * @parent: dentry of parent directory, %NULL for root directory
  * @subbuf_size: size of sub-buffers (> PAGE_SIZE, power of 2)
  * @num_subbuf: number of sub-buffers (power of 2)
+ * @numa_policy: NUMA placement of the buffers memory
+ * @numa_node: memory node, for RING_BUFFER_NUMA_NODE policy
+ * @flags: RING_BUFFER_CHANNEL_* flags
+ * @cpu_mask: cpus with a buffer, %NULL for all (per-cpu channels only)
  *
  * Returns channel pointer if successful, %NULL otherwise.
  *
@@ -364,7 +1023,10 @@ int lib_ring_buffer_cpu_hp_callback(struct notifier_block *nb,
 int channel_backend_init(struct channel_backend *chanb,
 			 const char *name,
 			 const struct lib_ring_buffer_config *config,
-			 void *priv, size_t subbuf_size, size_t num_subbuf)
+			 void *priv, size_t subbuf_size, size_t num_subbuf,
+			 enum lib_ring_buffer_numa_policy numa_policy,
+			 int numa_node, unsigned int flags,
+			 const struct cpumask *cpu_mask)
 {
 	struct channel *chan = container_of(chanb, struct channel, backend);
 	unsigned int i;
@@ -373,39 +1035,41 @@ int channel_backend_init(struct channel_backend *chanb,
 	if (!name)
 		return -EPERM;
 
-	/* Check that the subbuffer size is larger than a page. */
-	if (subbuf_size < PAGE_SIZE)
-		return -EINVAL;
+	ret = channel_backend_check_geometry(config, subbuf_size, num_subbuf);
+	if (ret)
+		return ret;
 
-	/*
-	 * Make sure the number of subbuffers and subbuffer size are
-	 * power of 2 and nonzero.
-	 */
-	if (!subbuf_size || (subbuf_size & (subbuf_size - 1)))
+	if ((flags & (RING_BUFFER_CHANNEL_LAZY_ALLOC
+		      | RING_BUFFER_CHANNEL_HOUSEKEEPING))
+			&& config->alloc != RING_BUFFER_ALLOC_PER_CPU)
 		return -EINVAL;
-	if (!num_subbuf || (num_subbuf & (num_subbuf - 1)))
-		return -EINVAL;
-	/*
-	 * Overwrite mode buffers require at least 2 subbuffers per
-	 * buffer.
-	 */
-	if (config->mode == RING_BUFFER_OVERWRITE && num_subbuf < 2)
+	if (cpu_mask && (config->alloc != RING_BUFFER_ALLOC_PER_CPU
+			 || !cpumask_intersects(cpu_mask, cpu_possible_mask)))
 		return -EINVAL;
 
-	ret = subbuffer_id_check_index(config, num_subbuf);
-	if (ret)
-		return ret;
+	switch (numa_policy) {
+	case RING_BUFFER_NUMA_LOCAL:
+	case RING_BUFFER_NUMA_INTERLEAVE:
+		break;
+	case RING_BUFFER_NUMA_NODE:
+		if (numa_node < 0 || numa_node >= nr_node_ids
+				|| !node_online(numa_node))
+			return -EINVAL;
+		break;
+	default:
+		return -EINVAL;
+	}
+	chanb->numa_policy = numa_policy;
+	chanb->numa_node = numa_node;
 
 	chanb->priv = priv;
-	chanb->buf_size = num_subbuf * subbuf_size;
-	chanb->subbuf_size = subbuf_size;
-	chanb->buf_size_order = get_count_order(chanb->buf_size);
-	chanb->subbuf_size_order = get_count_order(subbuf_size);
-	chanb->num_subbuf_order = get_count_order(num_subbuf);
+	channel_backend_set_geometry(chanb, subbuf_size, num_subbuf);
 	chanb->extra_reader_sb =
 			(config->mode == RING_BUFFER_OVERWRITE) ? 1 : 0;
-	chanb->num_subbuf = num_subbuf;
+	chanb->lazy_alloc = !!(flags & RING_BUFFER_CHANNEL_LAZY_ALLOC);
+	chanb->housekeeping = !!(flags & RING_BUFFER_CHANNEL_HOUSEKEEPING);
 	strlcpy(chanb->name, name, NAME_MAX);
+	chanb->nocache_threshold = READ_ONCE(nocache_copy_threshold) ? : ULONG_MAX;
 	memcpy(&chanb->config, config, sizeof(chanb->config));
 
 	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU) {
@@ -413,6 +1077,13 @@ int channel_backend_init(struct channel_backend *chanb,
 			return -ENOMEM;
 	}
 
+	if (cpu_mask) {
+		if (!alloc_cpumask_var(&chanb->traced_cpumask, GFP_KERNEL))
+			goto free_cpumask;
+		cpumask_and(chanb->traced_cpumask, cpu_mask, cpu_possible_mask);
+		chanb->cpu_filter = 1;
+	}
+
 	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU) {
 		/* Allocating the buffer per-cpu structures */
 		chanb->buf = alloc_percpu(struct lib_ring_buffer);
@@ -420,6 +1091,9 @@ int channel_backend_init(struct channel_backend *chanb,
 			goto free_cpumask;
 
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,10,0))
+		ret = lib_ring_buffer_create_per_node(chanb);
+		if (ret)
+			goto free_bufs;
 		chanb->cpuhp_prepare.component = LTTNG_RING_BUFFER_BACKEND;
 		ret = cpuhp_state_add_instance(lttng_rb_hp_prepare,
 			&chanb->cpuhp_prepare.node);
@@ -447,6 +1121,10 @@ int channel_backend_init(struct channel_backend *chanb,
 
 			get_online_cpus();
 			for_each_online_cpu(i) {
+				if (chanb->lazy_alloc)
+					break;
+				if (!lib_ring_buffer_channel_cpu_traced(chan, i))
+					continue;
 				ret = lib_ring_buffer_create(per_cpu_ptr(chanb->buf, i),
 							 chanb, i);
 				if (ret)
@@ -455,6 +1133,10 @@ int channel_backend_init(struct channel_backend *chanb,
 			put_online_cpus();
 #else
 			for_each_possible_cpu(i) {
+				if (chanb->lazy_alloc)
+					break;
+				if (!lib_ring_buffer_channel_cpu_traced(chan, i))
+					continue;
 				ret = lib_ring_buffer_create(per_cpu_ptr(chanb->buf, i),
 							 chanb, i);
 				if (ret)
@@ -464,7 +1146,9 @@ int channel_backend_init(struct channel_backend *chanb,
 		}
 #endif /* #else #if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,10,0)) */
 	} else {
-		chanb->buf = kzalloc(sizeof(struct lib_ring_buffer), GFP_KERNEL);
+		chanb->buf = kzalloc_node(sizeof(struct lib_ring_buffer),
+				GFP_KERNEL,
+				lib_ring_buffer_backend_node(chanb, -1));
 		if (!chanb->buf)
 			goto free_cpumask;
 		ret = lib_ring_buffer_create(chanb->buf, chanb, -1);
@@ -501,8 +1185,10 @@ free_bufs:
 	} else
 		kfree(chanb->buf);
 free_cpumask:
-	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
+	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU) {
+		free_cpumask_var(chanb->traced_cpumask);
 		free_cpumask_var(chanb->cpumask);
+	}
 	return -ENOMEM;
 }
 
@@ -548,6 +1234,7 @@ void channel_backend_free(struct channel_backend *chanb)
 				continue;
 			lib_ring_buffer_free(buf);
 		}
+		free_cpumask_var(chanb->traced_cpumask);
 		free_cpumask_var(chanb->cpumask);
 		free_percpu(chanb->buf);
 	} else {
@@ -575,6 +1262,7 @@ void _lib_ring_buffer_write(struct lib_ring_buffer_backend *bufb, size_t offset,
 	size_t sbidx, index;
 	struct lib_ring_buffer_backend_pages *rpages;
 	unsigned long sb_bindex, id;
+	bool nocache = len - pagecpy >= chanb->nocache_threshold;
 
 	do {
 		len -= pagecpy;
@@ -595,11 +1283,18 @@ void _lib_ring_buffer_write(struct lib_ring_buffer_backend *bufb, size_t offset,
 		rpages = bufb->array[sb_bindex];
 		CHAN_WARN_ON(chanb, config->mode == RING_BUFFER_OVERWRITE
 			     && subbuffer_id_is_noref(config, id));
-		lib_ring_buffer_do_copy(config,
+		if (nocache)
+			lib_ring_buffer_do_copy_nocache(rpages->p[index].virt
+						+ (offset & ~PAGE_MASK),
+					src, pagecpy);
+		else
+			lib_ring_buffer_do_copy(config,
 					rpages->p[index].virt
 						+ (offset & ~PAGE_MASK),
 					src, pagecpy);
 	} while (unlikely(len != pagecpy));
+	if (nocache)
+		lib_ring_buffer_nocache_fence();
 }
 EXPORT_SYMBOL_GPL(_lib_ring_buffer_write);
 
@@ -751,6 +1446,7 @@ void _lib_ring_buffer_copy_from_user_inatomic(struct lib_ring_buffer_backend *bu
 	size_t sbidx, index;
 	struct lib_ring_buffer_backend_pages *rpages;
 	unsigned long sb_bindex, id;
+	bool nocache = len - pagecpy >= chanb->nocache_threshold;
 	int ret;
 
 	do {
@@ -772,7 +1468,13 @@ void _lib_ring_buffer_copy_from_user_inatomic(struct lib_ring_buffer_backend *bu
 		rpages = bufb->array[sb_bindex];
 		CHAN_WARN_ON(chanb, config->mode == RING_BUFFER_OVERWRITE
 				&& subbuffer_id_is_noref(config, id));
-		ret = lib_ring_buffer_do_copy_from_user_inatomic(rpages->p[index].virt
+		if (nocache)
+			ret = lib_ring_buffer_do_copy_from_user_inatomic_nocache(
+					rpages->p[index].virt
+						+ (offset & ~PAGE_MASK),
+					src, pagecpy) != 0;
+		else
+			ret = lib_ring_buffer_do_copy_from_user_inatomic(rpages->p[index].virt
 							+ (offset & ~PAGE_MASK),
 							src, pagecpy) != 0;
 		if (ret > 0) {
@@ -781,6 +1483,8 @@ void _lib_ring_buffer_copy_from_user_inatomic(struct lib_ring_buffer_backend *bu
 			break; /* stop copy */
 		}
 	} while (unlikely(len != pagecpy));
+	if (nocache)
+		lib_ring_buffer_nocache_fence();
 }
 EXPORT_SYMBOL_GPL(_lib_ring_buffer_copy_from_user_inatomic);
 
@@ -869,6 +1573,113 @@ void _lib_ring_buffer_strcpy_from_user_inatomic(struct lib_ring_buffer_backend *
 }
 EXPORT_SYMBOL_GPL(_lib_ring_buffer_strcpy_from_user_inatomic);
 
+/**
+ * _lib_ring_buffer_strscpy - write bounded string data to a ring_buffer buffer.
+ * @bufb : buffer backend
+ * @offset : offset within the buffer
+ * @src : source address
+ * @len : maximum length to write, including the terminating '\0'
+ *
+ * Returns the number of bytes copied, without the terminating '\0'.
+ */
+size_t _lib_ring_buffer_strscpy(struct lib_ring_buffer_backend *bufb,
+		size_t offset, const char *src, size_t len)
+{
+	struct channel_backend *chanb = &bufb->chan->backend;
+	const struct lib_ring_buffer_config *config = &chanb->config;
+	size_t sbidx, index, pagecpy, copied, count = 0;
+	struct lib_ring_buffer_backend_pages *rpages;
+	unsigned long sb_bindex, id;
+
+	CHAN_WARN_ON(chanb, !len);
+	len--;	/* Final '\0' */
+	while (count < len) {
+		sbidx = offset >> chanb->subbuf_size_order;
+		index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
+
+		/*
+		 * Underlying layer should never ask for writes across
+		 * subbuffers.
+		 */
+		CHAN_WARN_ON(chanb, offset >= chanb->buf_size);
+
+		pagecpy = min_t(size_t, len - count,
+				PAGE_SIZE - (offset & ~PAGE_MASK));
+		id = bufb->buf_wsb[sbidx].id;
+		sb_bindex = subbuffer_id_get_index(config, id);
+		rpages = bufb->array[sb_bindex];
+		CHAN_WARN_ON(chanb, config->mode == RING_BUFFER_OVERWRITE
+			     && subbuffer_id_is_noref(config, id));
+		copied = lib_ring_buffer_do_strcpy(config,
+				rpages->p[index].virt + (offset & ~PAGE_MASK),
+				src + count, pagecpy);
+		count += copied;
+		offset += copied;
+		if (copied < pagecpy)
+			break;
+	}
+	/* Ending '\0' */
+	_lib_ring_buffer_memset(bufb, offset, '\0', 1, 0);
+	return count;
+}
+EXPORT_SYMBOL_GPL(_lib_ring_buffer_strscpy);
+
+/**
+ * _lib_ring_buffer_strscpy_from_user_inatomic - write bounded userspace string data to a ring_buffer buffer.
+ * @bufb : buffer backend
+ * @offset : offset within the buffer
+ * @src : source address
+ * @len : maximum length to write, including the terminating '\0'
+ *
+ * Returns the number of bytes copied, without the terminating '\0'. The
+ * string is cut at the first fault.
+ *
+ * This function deals with userspace pointers, it should never be called
+ * directly without having the src pointer checked with access_ok()
+ * previously.
+ */
+size_t _lib_ring_buffer_strscpy_from_user_inatomic(struct lib_ring_buffer_backend *bufb,
+		size_t offset, const char __user *src, size_t len)
+{
+	struct channel_backend *chanb = &bufb->chan->backend;
+	const struct lib_ring_buffer_config *config = &chanb->config;
+	size_t sbidx, index, pagecpy, copied, count = 0;
+	struct lib_ring_buffer_backend_pages *rpages;
+	unsigned long sb_bindex, id;
+
+	CHAN_WARN_ON(chanb, !len);
+	len--;	/* Final '\0' */
+	while (count < len) {
+		sbidx = offset >> chanb->subbuf_size_order;
+		index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
+
+		/*
+		 * Underlying layer should never ask for writes across
+		 * subbuffers.
+		 */
+		CHAN_WARN_ON(chanb, offset >= chanb->buf_size);
+
+		pagecpy = min_t(size_t, len - count,
+				PAGE_SIZE - (offset & ~PAGE_MASK));
+		id = bufb->buf_wsb[sbidx].id;
+		sb_bindex = subbuffer_id_get_index(config, id);
+		rpages = bufb->array[sb_bindex];
+		CHAN_WARN_ON(chanb, config->mode == RING_BUFFER_OVERWRITE
+				&& subbuffer_id_is_noref(config, id));
+		copied = lib_ring_buffer_do_strcpy_from_user_inatomic(config,
+				rpages->p[index].virt + (offset & ~PAGE_MASK),
+				src + count, pagecpy);
+		count += copied;
+		offset += copied;
+		if (copied < pagecpy)
+			break;
+	}
+	/* Ending '\0' */
+	_lib_ring_buffer_memset(bufb, offset, '\0', 1, 0);
+	return count;
+}
+EXPORT_SYMBOL_GPL(_lib_ring_buffer_strscpy_from_user_inatomic);
+
 /**
  * lib_ring_buffer_read - read data from ring_buffer_buffer.
  * @bufb : buffer backend
@@ -893,6 +1704,16 @@ size_t lib_ring_buffer_read(struct lib_ring_buffer_backend *bufb, size_t offset,
 	index = (offset & (chanb->subbuf_size - 1)) >> PAGE_SHIFT;
 	if (unlikely(!len))
 		return 0;
+	if (config->backend == RING_BUFFER_VMAP) {
+		id = bufb->buf_rsb.id;
+		sb_bindex = subbuffer_id_get_index(config, id);
+		rpages = bufb->array[sb_bindex];
+		CHAN_WARN_ON(chanb, config->mode == RING_BUFFER_OVERWRITE
+			     && subbuffer_id_is_noref(config, id));
+		memcpy(dest, rpages->vaddr + (offset & (chanb->subbuf_size - 1)),
+		       len);
+		return orig_len;
+	}
 	for (;;) {
 		pagecpy = min_t(size_t, len, PAGE_SIZE - (offset & ~PAGE_MASK));
 		id = bufb->buf_rsb.id;
@@ -0,0 +1,151 @@
+/* SPDX-License-Identifier: (GPL-2.0 OR LGPL-2.1)
+ *
+ * ring_buffer_crash.c
+ *
+ * Ring buffer crash descriptors, see crash.h.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include <wrapper/ringbuffer/config.h>
+#include <wrapper/ringbuffer/backend.h>
+#include <wrapper/ringbuffer/frontend.h>
+#include <wrapper/ringbuffer/crash.h>
+#include <wrapper/vmcoreinfo.h>
+
+#define CRASH_ADDR(p)	((uint64_t) (unsigned long) (p))
+
+static DEFINE_MUTEX(crash_mutex);	/* Protects the descriptor list */
+
+static struct lib_ring_buffer_crash_root crash_root = {
+	.version = LIB_RING_BUFFER_CRASH_VERSION,
+	.layout_size = sizeof(struct lib_ring_buffer_crash_layout),
+	.layout = {
+		.buf_offset = offsetof(struct lib_ring_buffer, offset),
+		.buf_consumed = offsetof(struct lib_ring_buffer, consumed),
+		.buf_commit_hot = offsetof(struct lib_ring_buffer, commit_hot),
+		.buf_backend = offsetof(struct lib_ring_buffer, backend),
+		.cc_hot_size = sizeof(struct commit_counters_hot),
+		.cc_hot_seq = offsetof(struct commit_counters_hot, seq),
+		.backend_buf_wsb = offsetof(struct lib_ring_buffer_backend, buf_wsb),
+		.backend_buf_rsb = offsetof(struct lib_ring_buffer_backend, buf_rsb),
+		.backend_buf_cnt = offsetof(struct lib_ring_buffer_backend, buf_cnt),
+		.backend_array = offsetof(struct lib_ring_buffer_backend, array),
+		.backend_num_pages_per_subbuf =
+			offsetof(struct lib_ring_buffer_backend, num_pages_per_subbuf),
+		.wsb_size = sizeof(struct lib_ring_buffer_backend_subbuffer),
+		.wsb_id = offsetof(struct lib_ring_buffer_backend_subbuffer, id),
+		.cnt_size = sizeof(struct lib_ring_buffer_backend_counts),
+		.cnt_seq_cnt = offsetof(struct lib_ring_buffer_backend_counts, seq_cnt),
+		.pages_data_size =
+			offsetof(struct lib_ring_buffer_backend_pages, data_size),
+		.pages_p = offsetof(struct lib_ring_buffer_backend_pages, p),
+		.page_size = sizeof(struct lib_ring_buffer_backend_page),
+		.page_pfn = offsetof(struct lib_ring_buffer_backend_page, pfn),
+		.page_shift = PAGE_SHIFT,
+		.sb_id_index_mask = SB_ID_INDEX_MASK,
+	},
+};
+
+/*
+ * Describe the buffers of a channel. Called before the channel buffers
+ * can be written to.
+ */
+int lib_ring_buffer_crash_register(struct channel *chan)
+{
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+	struct lib_ring_buffer_crash_desc *desc;
+	unsigned int nr_bufs;
+	int cpu;
+
+	if (config->oops != RING_BUFFER_OOPS_CONSISTENCY)
+		return 0;
+	nr_bufs = config->alloc == RING_BUFFER_ALLOC_PER_CPU ? nr_cpu_ids : 1;
+	desc = kzalloc(sizeof(*desc) + nr_bufs * sizeof(desc->bufs[0]),
+			GFP_KERNEL);
+	if (!desc)
+		return -ENOMEM;
+	desc->magic = LIB_RING_BUFFER_CRASH_DESC_MAGIC;
+	desc->chan = CRASH_ADDR(chan);
+	desc->subbuf_size = chan->backend.subbuf_size;
+	desc->num_subbuf = chan->backend.num_subbuf;
+	desc->mode = config->mode == RING_BUFFER_OVERWRITE;
+	desc->nr_bufs = nr_bufs;
+	strlcpy(desc->name, chan->backend.name, sizeof(desc->name));
+	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU) {
+		for_each_possible_cpu(cpu)
+			desc->bufs[cpu] = CRASH_ADDR(per_cpu_ptr(chan->backend.buf,
+						cpu));
+	} else {
+		desc->bufs[0] = CRASH_ADDR(chan->backend.buf);
+	}
+
+	mutex_lock(&crash_mutex);
+	desc->next = crash_root.head;
+	/* Descriptor initialized before being linked. */
+	smp_wmb();
+	WRITE_ONCE(crash_root.head, CRASH_ADDR(desc));
+	mutex_unlock(&crash_mutex);
+	chan->crash_desc = desc;
+	return 0;
+}
+
+/*
+ * Called when the channel buffers are not written to anymore, before
+ * they are freed.
+ */
+void lib_ring_buffer_crash_unregister(struct channel *chan)
+{
+	struct lib_ring_buffer_crash_desc *desc = chan->crash_desc;
+	uint64_t *link;
+
+	if (!desc)
+		return;
+	mutex_lock(&crash_mutex);
+	for (link = &crash_root.head; *link;
+			link = &((struct lib_ring_buffer_crash_desc *)
+				(unsigned long) *link)->next) {
+		if (*link == CRASH_ADDR(desc)) {
+			WRITE_ONCE(*link, desc->next);
+			break;
+		}
+	}
+	mutex_unlock(&crash_mutex);
+	chan->crash_desc = NULL;
+	kfree(desc);
+}
+
+/* Called with the channel buffers stopped for resize. */
+void lib_ring_buffer_crash_resize(struct channel *chan)
+{
+	struct lib_ring_buffer_crash_desc *desc = chan->crash_desc;
+
+	if (!desc)
+		return;
+	WRITE_ONCE(desc->subbuf_size, chan->backend.subbuf_size);
+	WRITE_ONCE(desc->num_subbuf, chan->backend.num_subbuf);
+}
+
+int lib_ring_buffer_crash_init(void)
+{
+	char line[64];
+
+	crash_root.magic = LIB_RING_BUFFER_CRASH_ROOT_MAGIC;
+	snprintf(line, sizeof(line), "LTTNG_RING_BUFFER_CRASH=%llx\n",
+		(unsigned long long) CRASH_ADDR(&crash_root));
+	/* Kernels without vmcoreinfo only lose crash dump extraction. */
+	(void) wrapper_vmcoreinfo_append(line);
+	return 0;
+}
+
+void lib_ring_buffer_crash_exit(void)
+{
+	/* The vmcoreinfo line cannot be removed: invalidate the root. */
+	WRITE_ONCE(crash_root.magic, 0);
+}
@@ -40,6 +40,8 @@
 #include <linux/delay.h>
 #include <linux/module.h>
 #include <linux/percpu.h>
+#include <linux/rcupdate.h>
+#include <linux/tick.h>
 #include <asm/cacheflush.h>
 
 #include <wrapper/ringbuffer/config.h>
@@ -47,9 +49,12 @@
 #include <wrapper/ringbuffer/frontend.h>
 #include <wrapper/ringbuffer/iterator.h>
 #include <wrapper/ringbuffer/nohz.h>
+#include <wrapper/ringbuffer/vfs.h>
+#include <wrapper/ringbuffer/crash.h>
 #include <wrapper/atomic.h>
 #include <wrapper/kref.h>
 #include <wrapper/percpu-defs.h>
+#include <wrapper/poll.h>
 #include <wrapper/timer.h>
 #include <wrapper/vmalloc.h>
 
@@ -75,6 +80,26 @@ static ATOMIC_NOTIFIER_HEAD(tick_nohz_notifier);
 
 static DEFINE_PER_CPU(spinlock_t, ring_buffer_nohz_lock);
 
+/*
+ * The switch and read timers of the buffers pinned to a cpu are serviced
+ * by a single timer per cpu, whatever the number of channels. A buffer
+ * timer due within 1/2^RING_BUFFER_TIMER_SLACK_SHIFT of its period is
+ * serviced early along with the others, so the timers of the buffers
+ * sharing a period end up expiring together.
+ */
+#define RING_BUFFER_TIMER_SLACK_SHIFT	3
+
+struct lib_ring_buffer_timer_base {
+	spinlock_t lock;		/* Protects the fields below */
+	struct list_head buffers;	/* With switch or read timer enabled */
+	struct timer_list timer;
+	unsigned long expires;		/* Valid if armed */
+	int armed;
+	int cpu;
+};
+
+static DEFINE_PER_CPU(struct lib_ring_buffer_timer_base, ring_buffer_timer_base);
+
 DEFINE_PER_CPU(unsigned int, lib_ring_buffer_nesting);
 EXPORT_PER_CPU_SYMBOL(lib_ring_buffer_nesting);
 
@@ -126,6 +151,120 @@ int lib_ring_buffer_poll_deliver(const struct lib_ring_buffer_config *config,
 	return 1;
 }
 
+/*
+ * Same test as lib_ring_buffer_poll(), used for channel-level readiness.
+ */
+static
+int lib_ring_buffer_buf_ready(const struct lib_ring_buffer_config *config,
+			      struct lib_ring_buffer *buf,
+			      struct channel *chan)
+{
+	return subbuf_trunc(lib_ring_buffer_get_offset(config, buf), chan)
+		- subbuf_trunc(lib_ring_buffer_get_consumed(config, buf), chan)
+		!= 0;
+}
+
+/*
+ * Control area of RING_BUFFER_MMAP buffers, see lib/ringbuffer/vfs.h.
+ */
+static
+size_t lib_ring_buffer_ctrl_alloc_len(size_t num_subbuf)
+{
+	return PAGE_ALIGN(sizeof(struct lib_ring_buffer_ctrl)
+		+ num_subbuf * sizeof(struct lib_ring_buffer_ctrl_subbuf));
+}
+
+size_t lib_ring_buffer_ctrl_len(struct lib_ring_buffer *buf)
+{
+	if (!buf->ctrl)
+		return 0;
+	return lib_ring_buffer_ctrl_alloc_len(buf->ctrl->num_subbuf);
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_ctrl_len);
+
+/**
+ * lib_ring_buffer_mem_usage - memory held by a buffer
+ * @buf: buffer
+ * @data_bytes: receives the size of the buffer pages
+ *
+ * Returns the size of the bookkeeping of the buffer: its commit counters,
+ * control area and backend tables. Buffers which are not allocated hold
+ * none.
+ */
+size_t lib_ring_buffer_mem_usage(struct lib_ring_buffer *buf,
+				 size_t *data_bytes)
+{
+	struct channel_backend *chanb = &buf->backend.chan->backend;
+	size_t bytes;
+
+	bytes = lib_ring_buffer_backend_mem_usage(&buf->backend, data_bytes);
+	if (!bytes)
+		return 0;
+	bytes += ALIGN(sizeof(*buf->commit_hot) * chanb->num_subbuf,
+		       1 << INTERNODE_CACHE_SHIFT);
+	bytes += ALIGN(sizeof(*buf->commit_cold) * chanb->num_subbuf,
+		       1 << INTERNODE_CACHE_SHIFT);
+	return bytes + lib_ring_buffer_ctrl_len(buf);
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_mem_usage);
+
+static
+void lib_ring_buffer_ctrl_init(struct lib_ring_buffer_ctrl *ctrl,
+			       size_t subbuf_size, size_t num_subbuf)
+{
+	size_t i;
+
+	ctrl->version = LIB_RING_BUFFER_CTRL_VERSION;
+	ctrl->num_subbuf = num_subbuf;
+	ctrl->subbuf_size = subbuf_size;
+	ctrl->consumed = 0;
+	for (i = 0; i < num_subbuf; i++) {
+		ctrl->subbuf[i].packet_begin = -1ULL;
+		ctrl->subbuf[i].data_size = 0;
+		ctrl->subbuf[i].mmap_offset = 0;
+	}
+}
+
+static
+struct lib_ring_buffer_ctrl *lib_ring_buffer_ctrl_create(
+		const struct lib_ring_buffer_config *config,
+		size_t subbuf_size, size_t num_subbuf)
+{
+	struct lib_ring_buffer_ctrl *ctrl;
+
+	if (config->output != RING_BUFFER_MMAP)
+		return NULL;
+	ctrl = vmalloc_user(lib_ring_buffer_ctrl_alloc_len(num_subbuf));
+	if (!ctrl)
+		return ERR_PTR(-ENOMEM);
+	lib_ring_buffer_ctrl_init(ctrl, subbuf_size, num_subbuf);
+	return ctrl;
+}
+
+/*
+ * Publish the packet delivered in sub-buffer "idx". Called by the
+ * delivering writer, with exclusive access to the sub-buffer.
+ */
+static
+void lib_ring_buffer_ctrl_deliver(const struct lib_ring_buffer_config *config,
+				  struct lib_ring_buffer *buf,
+				  struct channel *chan,
+				  unsigned long offset, unsigned long idx)
+{
+	struct lib_ring_buffer_ctrl_subbuf *csb;
+	unsigned long sb_bindex;
+
+	if (!buf->ctrl)
+		return;
+	csb = &buf->ctrl->subbuf[idx];
+	sb_bindex = subbuffer_id_get_index(config, buf->backend.buf_wsb[idx].id);
+	WRITE_ONCE(csb->data_size,
+		   lib_ring_buffer_get_data_size(config, buf, idx));
+	WRITE_ONCE(csb->mmap_offset, buf->backend.array[sb_bindex]->mmap_offset);
+	smp_wmb();	/* Packet description before its position. */
+	WRITE_ONCE(csb->packet_begin, subbuf_trunc(offset, chan));
+}
+
 /*
  * Must be called under cpu hotplug protection.
  */
@@ -134,6 +273,8 @@ void lib_ring_buffer_free(struct lib_ring_buffer *buf)
 	struct channel *chan = buf->backend.chan;
 
 	lib_ring_buffer_print_errors(chan, buf, buf->backend.cpu);
+	vfree(buf->ctrl);
+	buf->ctrl = NULL;
 	lttng_kvfree(buf->commit_hot);
 	lttng_kvfree(buf->commit_cold);
 
@@ -167,6 +308,7 @@ void lib_ring_buffer_reset(struct lib_ring_buffer *buf)
 		v_set(config, &buf->commit_cold[i].cc_sb, 0);
 	}
 	atomic_long_set(&buf->consumed, 0);
+	atomic_long_set(&buf->secondary_consumed, 0);
 	atomic_set(&buf->record_disabled, 0);
 	v_set(config, &buf->last_tsc, 0);
 	lib_ring_buffer_backend_reset(&buf->backend);
@@ -176,7 +318,16 @@ void lib_ring_buffer_reset(struct lib_ring_buffer *buf)
 	v_set(config, &buf->records_lost_big, 0);
 	v_set(config, &buf->records_count, 0);
 	v_set(config, &buf->records_overrun, 0);
+	v_set(config, &buf->reserve_retries, 0);
+	v_set(config, &buf->reserve_slow, 0);
+	v_set(config, &buf->subbuf_switches, 0);
+	v_set(config, &buf->commit_overflows, 0);
+	v_set(config, &buf->reader_blocked, 0);
+	atomic_long_set(&buf->fill_hwm, 0);
 	buf->finalized = 0;
+	if (buf->ctrl)
+		lib_ring_buffer_ctrl_init(buf->ctrl, chan->backend.subbuf_size,
+					  chan->backend.num_subbuf);
 }
 EXPORT_SYMBOL_GPL(lib_ring_buffer_reset);
 
@@ -204,6 +355,119 @@ void channel_reset(struct channel *chan)
 }
 EXPORT_SYMBOL_GPL(channel_reset);
 
+/*
+ * Isolated cpus: on channels created with RING_BUFFER_CHANNEL_HOUSEKEEPING,
+ * the buffers of nohz_full cpus are never sent IPIs, and their timers run
+ * on housekeeping cpus. While writers may run, only the buffer cpu can
+ * update its offset and commit counts, so sub-buffer switches are either:
+ *
+ * - requested by the switch timer through switch_pending, and performed
+ *   by the next writer on the buffer cpu,
+ * - performed from another cpu once writers are kept out of the buffer by
+ *   record_disabled and a grace period has elapsed, since writers disable
+ *   preemption from reserve to commit. This is used for remote switches
+ *   (flush, quiescent), and by the switch timer when the cpu did not
+ *   record anything for a whole period.
+ *
+ * Events recorded on the isolated cpu during that grace period are lost.
+ */
+static
+bool lib_ring_buffer_cpu_isolated(struct channel *chan, int cpu)
+{
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,10,0))
+	return chan->backend.housekeeping && cpu >= 0
+		&& tick_nohz_full_cpu(cpu);
+#else
+	return false;
+#endif
+}
+
+/* Same as synchronize_trace(), which lives in the tracer module. */
+static
+void lib_ring_buffer_synchronize_writers(void)
+{
+	synchronize_sched();
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,4,0))
+#ifdef CONFIG_PREEMPT_RT_FULL
+	synchronize_rcu();
+#endif
+#else /* (LINUX_VERSION_CODE >= KERNEL_VERSION(3,4,0)) */
+#ifdef CONFIG_PREEMPT_RT
+	synchronize_rcu();
+#endif
+#endif /* (LINUX_VERSION_CODE >= KERNEL_VERSION(3,4,0)) */
+}
+
+/*
+ * Switch an isolated buffer whose writers are already held off by
+ * record_disabled.
+ */
+static
+void lib_ring_buffer_switch_isolated_quiescent(struct lib_ring_buffer *buf,
+					       enum switch_mode mode)
+{
+	struct channel *chan = buf->backend.chan;
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+
+	raw_spin_lock(&buf->raw_tick_nohz_spinlock);
+	/* Not being resized. */
+	if (buf->backend.allocated) {
+		WRITE_ONCE(buf->switch_pending, 0);
+		lib_ring_buffer_switch_slow(buf, mode);
+		buf->isolated_switch_offset = v_read(config, &buf->offset);
+	}
+	raw_spin_unlock(&buf->raw_tick_nohz_spinlock);
+}
+
+/* Called from process context, on any cpu. */
+static
+void lib_ring_buffer_switch_isolated(struct lib_ring_buffer *buf,
+				     enum switch_mode mode)
+{
+	atomic_inc(&buf->record_disabled);
+	lib_ring_buffer_synchronize_writers();
+	lib_ring_buffer_switch_isolated_quiescent(buf, mode);
+	/* Switch before letting writers in. */
+	smp_mb();
+	atomic_dec(&buf->record_disabled);
+}
+
+static
+void lib_ring_buffer_isolated_switch_work(struct work_struct *work)
+{
+	struct lib_ring_buffer *buf = container_of(work, struct lib_ring_buffer,
+						   isolated_switch_work);
+
+	lib_ring_buffer_switch_isolated(buf, SWITCH_ACTIVE);
+}
+
+/* Called from the switch timer, on a housekeeping cpu. */
+static
+void lib_ring_buffer_switch_isolated_timer(struct lib_ring_buffer *buf)
+{
+	struct channel *chan = buf->backend.chan;
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+
+	if (!READ_ONCE(buf->switch_pending)) {
+		WRITE_ONCE(buf->switch_pending, 1);
+		return;
+	}
+	/* Nothing recorded for a period, with data left since last switch. */
+	if (v_read(config, &buf->offset) != buf->isolated_switch_offset)
+		schedule_work(&buf->isolated_switch_work);
+}
+
+/*
+ * Called by a writer on the buffer cpu, before reserving space, when the
+ * switch timer of an isolated cpu requested a switch.
+ */
+void lib_ring_buffer_switch_pending(struct lib_ring_buffer *buf)
+{
+	WRITE_ONCE(buf->switch_pending, 0);
+	lib_ring_buffer_switch_slow(buf, SWITCH_ACTIVE);
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_switch_pending);
+
 /*
  * Must be called under cpu hotplug protection.
  */
@@ -224,8 +488,12 @@ int lib_ring_buffer_create(struct lib_ring_buffer *buf,
 	/*
 	 * Paranoia: per cpu dynamic allocation is not officially documented as
 	 * zeroing the memory, so let's do it here too, just in case.
+	 * Lazily allocated buffers are already seen by writers, which are
+	 * kept out by record_disabled and account their lost events: they
+	 * are left as they are.
 	 */
-	memset(buf, 0, sizeof(*buf));
+	if (!chanb->lazy_alloc)
+		memset(buf, 0, sizeof(*buf));
 
 	ret = lib_ring_buffer_backend_create(&buf->backend, &chan->backend, cpu);
 	if (ret)
@@ -253,9 +521,25 @@ int lib_ring_buffer_create(struct lib_ring_buffer *buf,
 		goto free_commit;
 	}
 
+	buf->ctrl = lib_ring_buffer_ctrl_create(config,
+			chan->backend.subbuf_size, chan->backend.num_subbuf);
+	if (IS_ERR(buf->ctrl)) {
+		ret = PTR_ERR(buf->ctrl);
+		buf->ctrl = NULL;
+		goto free_commit_cold;
+	}
+
 	init_waitqueue_head(&buf->read_wait);
 	init_waitqueue_head(&buf->write_wait);
-	raw_spin_lock_init(&buf->raw_tick_nohz_spinlock);
+	INIT_LIST_HEAD(&buf->timer_node);
+	/* Lazily allocated buffers: initialized at channel creation. */
+	if (!chanb->lazy_alloc)
+		raw_spin_lock_init(&buf->raw_tick_nohz_spinlock);
+	if (lib_ring_buffer_cpu_isolated(chan, cpu)) {
+		INIT_WORK(&buf->isolated_switch_work,
+			  lib_ring_buffer_isolated_switch_work);
+		buf->isolated = 1;
+	}
 
 	/*
 	 * Write the subbuffer header for first subbuffer so we know the total
@@ -292,6 +576,9 @@ int lib_ring_buffer_create(struct lib_ring_buffer *buf,
 
 	/* Error handling */
 free_init:
+	vfree(buf->ctrl);
+	buf->ctrl = NULL;
+free_commit_cold:
 	lttng_kvfree(buf->commit_cold);
 free_commit:
 	lttng_kvfree(buf->commit_hot);
@@ -300,24 +587,226 @@ free_chanbuf:
 	return ret;
 }
 
-static void switch_buffer_timer(LTTNG_TIMER_FUNC_ARG_TYPE t)
+/*
+ * Switch timer period: half the live latency in live mode, so records
+ * are found pending at one check and delivered at the next one at the
+ * latest.
+ */
+static
+unsigned long switch_timer_period(struct channel *chan)
+{
+	unsigned long live_latency = READ_ONCE(chan->live_latency);
+
+	if (live_latency)
+		return max(live_latency >> 1, 1UL);
+	return chan->switch_timer_interval;
+}
+
+/*
+ * Live mode check, on the buffer cpu. The current sub-buffer is only
+ * flushed when it already held data at the previous check, i.e. when
+ * its oldest record is about to miss the deadline: sub-buffers filled
+ * by the writers in the meantime are delivered without help. Empty
+ * packets are only produced when the buffer did not deliver anything
+ * for a switch timer interval, so readers can still tell the stream is
+ * idle rather than late.
+ */
+static
+void lib_ring_buffer_live_timer(const struct lib_ring_buffer_config *config,
+				struct lib_ring_buffer *buf,
+				struct channel *chan)
+{
+	unsigned long offset = v_read(config, &buf->offset);
+
+	if (subbuf_offset(offset, chan)) {
+		if (buf->live_pending
+		    && buf->live_pending_subbuf == subbuf_trunc(offset, chan)) {
+			lib_ring_buffer_switch_slow(buf, SWITCH_ACTIVE);
+			buf->live_pending = 0;
+			buf->live_idle_since = jiffies;
+		} else {
+			buf->live_pending = 1;
+			buf->live_pending_subbuf = subbuf_trunc(offset, chan);
+		}
+	} else {
+		if (buf->live_pending)
+			buf->live_idle_since = jiffies;
+		buf->live_pending = 0;
+		if (time_after_eq(jiffies, buf->live_idle_since
+					+ chan->switch_timer_interval)) {
+			lib_ring_buffer_switch_slow(buf, SWITCH_FLUSH);
+			buf->live_idle_since = jiffies;
+		}
+	}
+	/* Do not wait for the read timer to tell the reader. */
+	if (lib_ring_buffer_poll_deliver(config, buf, chan)) {
+		wake_up_interruptible(&buf->read_wait);
+		wake_up_interruptible(&chan->read_wait);
+	}
+}
+
+static
+void lib_ring_buffer_switch_timer_expire(struct lib_ring_buffer *buf)
 {
-	struct lib_ring_buffer *buf = lttng_from_timer(buf, t, switch_timer);
 	struct channel *chan = buf->backend.chan;
 	const struct lib_ring_buffer_config *config = &chan->backend.config;
 
 	/*
 	 * Only flush buffers periodically if readers are active.
 	 */
-	if (atomic_long_read(&buf->active_readers))
-		lib_ring_buffer_switch_slow(buf, SWITCH_ACTIVE);
+	if (atomic_long_read(&buf->active_readers)) {
+		if (buf->isolated)
+			lib_ring_buffer_switch_isolated_timer(buf);
+		else if (READ_ONCE(chan->live_latency))
+			lib_ring_buffer_live_timer(config, buf, chan);
+		else
+			lib_ring_buffer_switch_slow(buf, SWITCH_ACTIVE);
+	}
+}
 
-	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
-		lttng_mod_timer_pinned(&buf->switch_timer,
-				 jiffies + chan->switch_timer_interval);
+/*
+ * Timer of the buffers not serviced by the per-cpu timer base: global
+ * and isolated cpu buffers.
+ */
+static void switch_buffer_timer(LTTNG_TIMER_FUNC_ARG_TYPE t)
+{
+	struct lib_ring_buffer *buf = lttng_from_timer(buf, t, switch_timer);
+	struct channel *chan = buf->backend.chan;
+
+	lib_ring_buffer_switch_timer_expire(buf);
+	mod_timer(&buf->switch_timer, jiffies + switch_timer_period(chan));
+}
+
+/*
+ * Per-cpu buffers of cpus which are not isolated have their timers
+ * serviced by the timer base of their cpu.
+ */
+static
+bool lib_ring_buffer_timer_base_used(const struct lib_ring_buffer_config *config,
+				     struct lib_ring_buffer *buf)
+{
+	return config->alloc == RING_BUFFER_ALLOC_PER_CPU && !buf->isolated;
+}
+
+/*
+ * Called with the timer base lock held. The timer is always queued on
+ * the base cpu: it may have been migrated away by cpu hotplug.
+ */
+static
+void lib_ring_buffer_timer_base_arm(struct lib_ring_buffer_timer_base *base,
+				    unsigned long expires)
+{
+	if (base->armed && !time_before(expires, base->expires))
+		return;
+	del_timer(&base->timer);
+	base->expires = expires;
+	base->timer.expires = expires;
+	add_timer_on(&base->timer, base->cpu);
+	base->armed = 1;
+}
+
+static
+bool lib_ring_buffer_timer_due(unsigned long expires, unsigned long now,
+			       unsigned long period)
+{
+	return !time_before(now + (period >> RING_BUFFER_TIMER_SLACK_SHIFT),
+			    expires);
+}
+
+static
+void lib_ring_buffer_read_timer_expire(struct lib_ring_buffer *buf);
+
+static void lib_ring_buffer_timer_base_expire(LTTNG_TIMER_FUNC_ARG_TYPE t)
+{
+	struct lib_ring_buffer_timer_base *base =
+		lttng_from_timer(base, t, timer);
+	struct lib_ring_buffer *buf;
+	unsigned long now, next = 0, flags;
+	bool local, first = true;
+
+	spin_lock_irqsave(&base->lock, flags);
+	base->armed = 0;
+	now = jiffies;
+	/* Migrated by cpu hotplug: re-arm on the base cpu. */
+	local = smp_processor_id() == base->cpu;
+	list_for_each_entry(buf, &base->buffers, timer_node) {
+		struct channel *chan = buf->backend.chan;
+
+		if (buf->switch_timer_enabled) {
+			if (local && lib_ring_buffer_timer_due(
+					buf->switch_timer_expires, now,
+					switch_timer_period(chan))) {
+				lib_ring_buffer_switch_timer_expire(buf);
+				buf->switch_timer_expires =
+					now + switch_timer_period(chan);
+			}
+			if (first || time_before(buf->switch_timer_expires, next))
+				next = buf->switch_timer_expires;
+			first = false;
+		}
+		if (buf->read_timer_enabled) {
+			if (local && lib_ring_buffer_timer_due(
+					buf->read_timer_expires, now,
+					buf->read_timer_period)) {
+				lib_ring_buffer_read_timer_expire(buf);
+				buf->read_timer_expires =
+					now + buf->read_timer_period;
+			}
+			if (first || time_before(buf->read_timer_expires, next))
+				next = buf->read_timer_expires;
+			first = false;
+		}
+	}
+	if (!first)
+		lib_ring_buffer_timer_base_arm(base, next);
+	spin_unlock_irqrestore(&base->lock, flags);
+}
+
+/*
+ * Enable the switch or read timer of a buffer on its cpu timer base,
+ * and plan the base timer for its first expiry.
+ */
+static
+void lib_ring_buffer_timer_base_add(struct lib_ring_buffer *buf, bool read)
+{
+	struct lib_ring_buffer_timer_base *base =
+		&per_cpu(ring_buffer_timer_base, buf->backend.cpu);
+	unsigned long flags, expires;
+
+	spin_lock_irqsave(&base->lock, flags);
+	if (read) {
+		expires = buf->read_timer_expires;
+		buf->read_timer_enabled = 1;
+	} else {
+		expires = buf->switch_timer_expires;
+		buf->switch_timer_enabled = 1;
+	}
+	if (list_empty(&buf->timer_node))
+		list_add(&buf->timer_node, &base->buffers);
+	lib_ring_buffer_timer_base_arm(base, expires);
+	spin_unlock_irqrestore(&base->lock, flags);
+}
+
+/*
+ * Disable the switch or read timer of a buffer on its cpu timer base.
+ * The timer base no longer runs the timer once this returns. The base
+ * timer itself is left armed: it does not re-arm once the base is empty.
+ */
+static
+void lib_ring_buffer_timer_base_del(struct lib_ring_buffer *buf, bool read)
+{
+	struct lib_ring_buffer_timer_base *base =
+		&per_cpu(ring_buffer_timer_base, buf->backend.cpu);
+	unsigned long flags;
+
+	spin_lock_irqsave(&base->lock, flags);
+	if (read)
+		buf->read_timer_enabled = 0;
 	else
-		mod_timer(&buf->switch_timer,
-			  jiffies + chan->switch_timer_interval);
+		buf->switch_timer_enabled = 0;
+	if (!buf->read_timer_enabled && !buf->switch_timer_enabled)
+		list_del_init(&buf->timer_node);
+	spin_unlock_irqrestore(&base->lock, flags);
 }
 
 /*
@@ -327,22 +816,28 @@ static void lib_ring_buffer_start_switch_timer(struct lib_ring_buffer *buf)
 {
 	struct channel *chan = buf->backend.chan;
 	const struct lib_ring_buffer_config *config = &chan->backend.config;
-	unsigned int flags = 0;
 
+	/* Lazily allocated buffer not created yet. */
+	if (!buf->backend.allocated)
+		return;
 	if (!chan->switch_timer_interval || buf->switch_timer_enabled)
 		return;
 
-	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
-		flags = LTTNG_TIMER_PINNED;
-
-	lttng_timer_setup(&buf->switch_timer, switch_buffer_timer, flags, buf);
-	buf->switch_timer.expires = jiffies + chan->switch_timer_interval;
-
-	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
-		add_timer_on(&buf->switch_timer, buf->backend.cpu);
-	else
-		add_timer(&buf->switch_timer);
+	buf->live_pending = 0;
+	buf->live_idle_since = jiffies;
+	if (lib_ring_buffer_timer_base_used(config, buf)) {
+		buf->switch_timer_expires = jiffies + switch_timer_period(chan);
+		lib_ring_buffer_timer_base_add(buf, false);
+		return;
+	}
 
+	/*
+	 * Timers of isolated cpus are not pinned: the timer subsystem
+	 * moves them to housekeeping cpus.
+	 */
+	lttng_timer_setup(&buf->switch_timer, switch_buffer_timer, 0, buf);
+	buf->switch_timer.expires = jiffies + switch_timer_period(chan);
+	add_timer(&buf->switch_timer);
 	buf->switch_timer_enabled = 1;
 }
 
@@ -352,20 +847,52 @@ static void lib_ring_buffer_start_switch_timer(struct lib_ring_buffer *buf)
 static void lib_ring_buffer_stop_switch_timer(struct lib_ring_buffer *buf)
 {
 	struct channel *chan = buf->backend.chan;
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
 
+	if (!buf->backend.allocated)
+		return;
 	if (!chan->switch_timer_interval || !buf->switch_timer_enabled)
 		return;
 
+	if (lib_ring_buffer_timer_base_used(config, buf)) {
+		lib_ring_buffer_timer_base_del(buf, false);
+		return;
+	}
 	del_timer_sync(&buf->switch_timer);
 	buf->switch_timer_enabled = 0;
 }
 
+/*
+ * Scale the read timer period with the sub-buffer production rate. Halve
+ * it when half of the buffer or more was produced since the last poll, so
+ * readers get a chance to catch up before the buffer is full. Double it
+ * when not even a sub-buffer was produced.
+ */
+static
+void lib_ring_buffer_adapt_read_timer(const struct lib_ring_buffer_config *config,
+				      struct lib_ring_buffer *buf,
+				      struct channel *chan)
+{
+	unsigned long offset, produced;
+
+	offset = v_read(config, &buf->offset);
+	produced = (offset - buf->read_timer_offset)
+			>> chan->backend.subbuf_size_order;
+	buf->read_timer_offset = offset;
+	if (produced >= max(chan->backend.num_subbuf >> 1, 1UL))
+		buf->read_timer_period = max(buf->read_timer_period >> 1,
+				max(chan->read_timer_interval, 1UL));
+	else if (!produced)
+		buf->read_timer_period = min(buf->read_timer_period << 1,
+				chan->read_timer_max_interval);
+}
+
 /*
  * Polling timer to check the channels for data.
  */
-static void read_buffer_timer(LTTNG_TIMER_FUNC_ARG_TYPE t)
+static
+void lib_ring_buffer_read_timer_expire(struct lib_ring_buffer *buf)
 {
-	struct lib_ring_buffer *buf = lttng_from_timer(buf, t, read_timer);
 	struct channel *chan = buf->backend.chan;
 	const struct lib_ring_buffer_config *config = &chan->backend.config;
 
@@ -376,13 +903,16 @@ static void read_buffer_timer(LTTNG_TIMER_FUNC_ARG_TYPE t)
 		wake_up_interruptible(&buf->read_wait);
 		wake_up_interruptible(&chan->read_wait);
 	}
+	if (chan->read_timer_max_interval)
+		lib_ring_buffer_adapt_read_timer(config, buf, chan);
+}
 
-	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
-		lttng_mod_timer_pinned(&buf->read_timer,
-				 jiffies + chan->read_timer_interval);
-	else
-		mod_timer(&buf->read_timer,
-			  jiffies + chan->read_timer_interval);
+static void read_buffer_timer(LTTNG_TIMER_FUNC_ARG_TYPE t)
+{
+	struct lib_ring_buffer *buf = lttng_from_timer(buf, t, read_timer);
+
+	lib_ring_buffer_read_timer_expire(buf);
+	mod_timer(&buf->read_timer, jiffies + buf->read_timer_period);
 }
 
 /*
@@ -392,24 +922,26 @@ static void lib_ring_buffer_start_read_timer(struct lib_ring_buffer *buf)
 {
 	struct channel *chan = buf->backend.chan;
 	const struct lib_ring_buffer_config *config = &chan->backend.config;
-	unsigned int flags;
 
+	if (!buf->backend.allocated)
+		return;
 	if (config->wakeup != RING_BUFFER_WAKEUP_BY_TIMER
 	    || !chan->read_timer_interval
 	    || buf->read_timer_enabled)
 		return;
 
-	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
-		flags = LTTNG_TIMER_PINNED;
-
-	lttng_timer_setup(&buf->read_timer, read_buffer_timer, flags, buf);
-	buf->read_timer.expires = jiffies + chan->read_timer_interval;
-
-	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
-		add_timer_on(&buf->read_timer, buf->backend.cpu);
-	else
-		add_timer(&buf->read_timer);
+	buf->read_timer_period = chan->read_timer_interval;
+	buf->read_timer_offset = v_read(config, &buf->offset);
+	if (lib_ring_buffer_timer_base_used(config, buf)) {
+		buf->read_timer_expires = jiffies + buf->read_timer_period;
+		lib_ring_buffer_timer_base_add(buf, true);
+		return;
+	}
 
+	/* The read timer only reads the buffer counters. */
+	lttng_timer_setup(&buf->read_timer, read_buffer_timer, 0, buf);
+	buf->read_timer.expires = jiffies + buf->read_timer_period;
+	add_timer(&buf->read_timer);
 	buf->read_timer_enabled = 1;
 }
 
@@ -421,12 +953,17 @@ static void lib_ring_buffer_stop_read_timer(struct lib_ring_buffer *buf)
 	struct channel *chan = buf->backend.chan;
 	const struct lib_ring_buffer_config *config = &chan->backend.config;
 
+	if (!buf->backend.allocated)
+		return;
 	if (config->wakeup != RING_BUFFER_WAKEUP_BY_TIMER
 	    || !chan->read_timer_interval
 	    || !buf->read_timer_enabled)
 		return;
 
-	del_timer_sync(&buf->read_timer);
+	if (lib_ring_buffer_timer_base_used(config, buf))
+		lib_ring_buffer_timer_base_del(buf, true);
+	else
+		del_timer_sync(&buf->read_timer);
 	/*
 	 * do one more check to catch data that has been written in the last
 	 * timer period.
@@ -438,26 +975,105 @@ static void lib_ring_buffer_stop_read_timer(struct lib_ring_buffer *buf)
 	buf->read_timer_enabled = 0;
 }
 
-#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,10,0))
+/*
+ * Runs on the buffer cpu, so its writers see the buffer initialized
+ * once they are let in.
+ */
+static
+void lib_ring_buffer_lazy_enable(void *info)
+{
+	struct lib_ring_buffer *buf = info;
 
-enum cpuhp_state lttng_rb_hp_prepare;
-enum cpuhp_state lttng_rb_hp_online;
+	atomic_dec(&buf->record_disabled);
+}
 
-void lttng_rb_set_hp_prepare(enum cpuhp_state val)
+static
+void lib_ring_buffer_lazy_alloc_work(struct work_struct *work)
 {
-	lttng_rb_hp_prepare = val;
+	struct channel *chan = container_of(work, struct channel,
+					    lazy_alloc_work);
+	int cpu, ret;
+
+	get_online_cpus();
+	for_each_cpu(cpu, chan->lazy_alloc_pending) {
+		struct lib_ring_buffer *buf = per_cpu_ptr(chan->backend.buf,
+							  cpu);
+
+		if (buf->backend.allocated)
+			continue;
+		ret = lib_ring_buffer_create(buf, &chan->backend, cpu);
+		if (ret) {
+			/* The request stays pending: not retried. */
+			printk(KERN_WARNING "LTTng: lazy allocation of channel %s buffer for cpu %d failed (%d)\n",
+				chan->backend.name, cpu, ret);
+			continue;
+		}
+		if (cpu_online(cpu)) {
+			spin_lock(&per_cpu(ring_buffer_nohz_lock, cpu));
+			lib_ring_buffer_start_switch_timer(buf);
+			lib_ring_buffer_start_read_timer(buf);
+			spin_unlock(&per_cpu(ring_buffer_nohz_lock, cpu));
+			WARN_ON(smp_call_function_single(cpu,
+					lib_ring_buffer_lazy_enable, buf, 1));
+		} else {
+			lib_ring_buffer_lazy_enable(buf);
+		}
+		/* New stream available, as after cpu hotplug. */
+		wake_up_interruptible(&chan->hp_wait);
+	}
+	put_online_cpus();
 }
-EXPORT_SYMBOL_GPL(lttng_rb_set_hp_prepare);
 
-void lttng_rb_set_hp_online(enum cpuhp_state val)
+static
+void lib_ring_buffer_lazy_alloc_irq_work(struct irq_work *entry)
 {
-	lttng_rb_hp_online = val;
+	struct channel *chan = container_of(entry, struct channel,
+					    lazy_alloc_irq_work);
+
+	schedule_work(&chan->lazy_alloc_work);
 }
-EXPORT_SYMBOL_GPL(lttng_rb_set_hp_online);
 
-int lttng_cpuhp_rb_frontend_dead(unsigned int cpu,
-		struct lttng_cpuhp_node *node)
-{
+/*
+ * Called by a writer finding its per-cpu buffer not allocated, from any
+ * tracing context, including NMI and scheduler code. The allocation is
+ * requested once, from irq_work, and the event is accounted as lost.
+ */
+void lib_ring_buffer_lazy_alloc_request(struct channel *chan, int cpu)
+{
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+	struct lib_ring_buffer *buf;
+
+	if (!chan->backend.lazy_alloc
+			|| !lib_ring_buffer_channel_cpu_traced(chan, cpu))
+		return;
+	buf = per_cpu_ptr(chan->backend.buf, cpu);
+	v_inc(config, &buf->records_lost_full);
+	if (cpumask_test_and_set_cpu(cpu, chan->lazy_alloc_pending))
+		return;
+	irq_work_queue(&chan->lazy_alloc_irq_work);
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_lazy_alloc_request);
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,10,0))
+
+enum cpuhp_state lttng_rb_hp_prepare;
+enum cpuhp_state lttng_rb_hp_online;
+
+void lttng_rb_set_hp_prepare(enum cpuhp_state val)
+{
+	lttng_rb_hp_prepare = val;
+}
+EXPORT_SYMBOL_GPL(lttng_rb_set_hp_prepare);
+
+void lttng_rb_set_hp_online(enum cpuhp_state val)
+{
+	lttng_rb_hp_online = val;
+}
+EXPORT_SYMBOL_GPL(lttng_rb_set_hp_online);
+
+int lttng_cpuhp_rb_frontend_dead(unsigned int cpu,
+		struct lttng_cpuhp_node *node)
+{
 	struct channel *chan = container_of(node, struct channel,
 					    cpuhp_prepare);
 	struct lib_ring_buffer *buf = per_cpu_ptr(chan->backend.buf, cpu);
@@ -465,13 +1081,18 @@ int lttng_cpuhp_rb_frontend_dead(unsigned int cpu,
 
 	CHAN_WARN_ON(chan, config->alloc == RING_BUFFER_ALLOC_GLOBAL);
 
+	if (!buf->backend.allocated)
+		return 0;
 	/*
-	 * Performing a buffer switch on a remote CPU. Performed by
-	 * the CPU responsible for doing the hotunplug after the target
-	 * CPU stopped running completely. Ensures that all data
-	 * from that remote CPU is flushed.
+	 * The buffer stays allocated and readable. The switch making the
+	 * data of the dead cpu readable is left to the reader, see
+	 * lib_ring_buffer_hp_flush(), rather than performed in the
+	 * hotplug path. It is not needed anymore if the cpu comes back
+	 * online first, its writers then carrying on in the current
+	 * sub-buffer.
 	 */
-	lib_ring_buffer_switch_slow(buf, SWITCH_ACTIVE);
+	WRITE_ONCE(buf->hp_flush_pending, 1);
+	wake_up_interruptible(&buf->read_wait);
 	return 0;
 }
 EXPORT_SYMBOL_GPL(lttng_cpuhp_rb_frontend_dead);
@@ -486,6 +1107,7 @@ int lttng_cpuhp_rb_frontend_online(unsigned int cpu,
 
 	CHAN_WARN_ON(chan, config->alloc == RING_BUFFER_ALLOC_GLOBAL);
 
+	WRITE_ONCE(buf->hp_flush_pending, 0);
 	wake_up_interruptible(&chan->hp_wait);
 	lib_ring_buffer_start_switch_timer(buf);
 	lib_ring_buffer_start_read_timer(buf);
@@ -561,7 +1183,8 @@ int lib_ring_buffer_cpu_hp_callback(struct notifier_block *nb,
 		 * CPU stopped running completely. Ensures that all data
 		 * from that remote CPU is flushed.
 		 */
-		lib_ring_buffer_switch_slow(buf, SWITCH_ACTIVE);
+		if (buf->backend.allocated)
+			lib_ring_buffer_switch_slow(buf, SWITCH_ACTIVE);
 		return NOTIFY_OK;
 
 	default:
@@ -607,6 +1230,11 @@ static int notrace ring_buffer_tick_nohz_callback(struct notifier_block *nb,
 	switch (val) {
 	case TICK_NOHZ_FLUSH:
 		raw_spin_lock(&buf->raw_tick_nohz_spinlock);
+		/* Not created yet, or being resized. */
+		if (!buf->backend.allocated) {
+			raw_spin_unlock(&buf->raw_tick_nohz_spinlock);
+			break;
+		}
 		if (config->wakeup == RING_BUFFER_WAKEUP_BY_TIMER
 		    && chan->read_timer_interval
 		    && atomic_long_read(&buf->active_readers)
@@ -784,8 +1412,10 @@ static void channel_free(struct channel *chan)
 	if (chan->backend.release_priv_ops) {
 		chan->backend.release_priv_ops(chan->backend.priv_ops);
 	}
+	lib_ring_buffer_crash_unregister(chan);
 	channel_iterator_free(chan);
 	channel_backend_free(&chan->backend);
+	free_cpumask_var(chan->lazy_alloc_pending);
 	kfree(chan);
 }
 
@@ -803,6 +1433,12 @@ static void channel_free(struct channel *chan)
  *                         padding to let readers get those sub-buffers.
  *                         Used for live streaming.
  * @read_timer_interval: Time interval (in us) to wake up pending readers.
+ * @read_timer_max_interval: Upper bound (in us) of the adaptive read timer
+ *                           period, 0 for a fixed period.
+ * @numa_policy: NUMA placement of the buffers memory.
+ * @numa_node: Memory node, used by the RING_BUFFER_NUMA_NODE policy.
+ * @flags: RING_BUFFER_CHANNEL_* flags.
+ * @cpu_mask: Cpus with a buffer, NULL for all. Per-cpu channels only.
  *
  * Holds cpu hotplug.
  * Returns NULL on failure.
@@ -811,31 +1447,72 @@ struct channel *channel_create(const struct lib_ring_buffer_config *config,
 		   const char *name, void *priv, void *buf_addr,
 		   size_t subbuf_size,
 		   size_t num_subbuf, unsigned int switch_timer_interval,
-		   unsigned int read_timer_interval)
+		   unsigned int read_timer_interval,
+		   unsigned int read_timer_max_interval,
+		   enum lib_ring_buffer_numa_policy numa_policy,
+		   int numa_node, unsigned int flags,
+		   const struct cpumask *cpu_mask)
 {
 	int ret;
 	struct channel *chan;
 
 	if (lib_ring_buffer_check_config(config, switch_timer_interval,
-					 read_timer_interval))
+					 read_timer_interval,
+					 read_timer_max_interval))
 		return NULL;
 
 	chan = kzalloc(sizeof(struct channel), GFP_KERNEL);
 	if (!chan)
 		return NULL;
 
+	if (flags & RING_BUFFER_CHANNEL_LAZY_ALLOC) {
+		if (!zalloc_cpumask_var(&chan->lazy_alloc_pending, GFP_KERNEL))
+			goto error;
+		init_irq_work(&chan->lazy_alloc_irq_work,
+			      lib_ring_buffer_lazy_alloc_irq_work);
+		INIT_WORK(&chan->lazy_alloc_work,
+			  lib_ring_buffer_lazy_alloc_work);
+	}
+
 	ret = channel_backend_init(&chan->backend, name, config, priv,
-				   subbuf_size, num_subbuf);
+				   subbuf_size, num_subbuf, numa_policy,
+				   numa_node, flags, cpu_mask);
 	if (ret)
 		goto error;
 
+	if (chan->backend.lazy_alloc || chan->backend.cpu_filter) {
+		int cpu;
+
+		/*
+		 * Writers are kept out of the buffers until they are created,
+		 * see lib_ring_buffer_lazy_alloc_request(). Buffers of cpus
+		 * out of the channel cpu mask are never created.
+		 */
+		for_each_possible_cpu(cpu) {
+			struct lib_ring_buffer *buf =
+				per_cpu_ptr(chan->backend.buf, cpu);
+
+			if (!chan->backend.lazy_alloc
+					&& lib_ring_buffer_channel_cpu_traced(chan, cpu))
+				continue;
+			atomic_set(&buf->record_disabled, 1);
+			raw_spin_lock_init(&buf->raw_tick_nohz_spinlock);
+		}
+	}
+
 	ret = channel_iterator_init(chan);
 	if (ret)
 		goto error_free_backend;
 
+	ret = lib_ring_buffer_crash_register(chan);
+	if (ret)
+		goto error_free_iterator;
+
 	chan->commit_count_mask = (~0UL >> chan->backend.num_subbuf_order);
 	chan->switch_timer_interval = usecs_to_jiffies(switch_timer_interval);
 	chan->read_timer_interval = usecs_to_jiffies(read_timer_interval);
+	chan->read_timer_max_interval =
+		usecs_to_jiffies(read_timer_max_interval);
 	kref_init(&chan->ref);
 	init_waitqueue_head(&chan->read_wait);
 	init_waitqueue_head(&chan->hp_wait);
@@ -916,9 +1593,13 @@ cpuhp_online_error:
 	WARN_ON(ret);
 cpuhp_prepare_error:
 #endif /* #if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,10,0)) */
+	lib_ring_buffer_crash_unregister(chan);
+error_free_iterator:
+	channel_iterator_free(chan);
 error_free_backend:
 	channel_backend_free(&chan->backend);
 error:
+	free_cpumask_var(chan->lazy_alloc_pending);
 	kfree(chan);
 	return NULL;
 }
@@ -948,6 +1629,11 @@ void *channel_destroy(struct channel *chan)
 	const struct lib_ring_buffer_config *config = &chan->backend.config;
 	void *priv;
 
+	if (chan->backend.lazy_alloc) {
+		/* Writers are gone: no new allocation request. */
+		irq_work_sync(&chan->lazy_alloc_irq_work);
+		cancel_work_sync(&chan->lazy_alloc_work);
+	}
 	channel_unregister_notifiers(chan);
 
 	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU) {
@@ -959,6 +1645,9 @@ void *channel_destroy(struct channel *chan)
 			struct lib_ring_buffer *buf = per_cpu_ptr(chan->backend.buf,
 							      cpu);
 
+			/* Switch timers are stopped: no new request. */
+			if (buf->isolated)
+				cancel_work_sync(&buf->isolated_switch_work);
 			if (config->cb.buffer_finalize)
 				config->cb.buffer_finalize(buf,
 							   chan->backend.priv,
@@ -970,7 +1659,7 @@ void *channel_destroy(struct channel *chan)
 			 */
 			smp_wmb();
 			WRITE_ONCE(buf->finalized, 1);
-			wake_up_interruptible(&buf->read_wait);
+			lttng_wake_up_hangup(&buf->read_wait);
 		}
 	} else {
 		struct lib_ring_buffer *buf = chan->backend.buf;
@@ -984,17 +1673,258 @@ void *channel_destroy(struct channel *chan)
 		 */
 		smp_wmb();
 		WRITE_ONCE(buf->finalized, 1);
-		wake_up_interruptible(&buf->read_wait);
+		lttng_wake_up_hangup(&buf->read_wait);
 	}
 	WRITE_ONCE(chan->finalized, 1);
-	wake_up_interruptible(&chan->hp_wait);
-	wake_up_interruptible(&chan->read_wait);
+	/* Wake all exclusive waiters, see wrapper/poll.h. */
+	lttng_wake_up_hangup(&chan->hp_wait);
+	lttng_wake_up_hangup(&chan->read_wait);
 	priv = chan->backend.priv;
 	kref_put(&chan->ref, channel_release);
 	return priv;
 }
 EXPORT_SYMBOL_GPL(channel_destroy);
 
+struct lib_ring_buffer_resize {
+	struct lib_ring_buffer *buf;
+	struct lib_ring_buffer_backend backend;	/* New, then old sub-buffers */
+	struct commit_counters_hot *commit_hot;
+	struct commit_counters_cold *commit_cold;
+	struct lib_ring_buffer_ctrl *ctrl;
+};
+
+/*
+ * Nothing left to read: all packets have been consumed, or the buffer
+ * only holds the empty packet started when it was created.
+ */
+static
+bool lib_ring_buffer_resize_drained(struct lib_ring_buffer *buf,
+				    struct channel *chan)
+{
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+	unsigned long offset = v_read(config, &buf->offset);
+	unsigned long consumed = atomic_long_read(&buf->consumed);
+
+	if (offset == consumed)
+		return true;
+	return !consumed && !buf->backend.buf_cnt[0].seq_cnt
+		&& offset == config->cb.subbuffer_header_size();
+}
+
+static
+int lib_ring_buffer_resize_alloc(struct lib_ring_buffer_resize *resize,
+				 size_t subbuf_size, size_t num_subbuf)
+{
+	struct lib_ring_buffer *buf = resize->buf;
+	int node = cpu_to_node(max(buf->backend.cpu, 0));
+	int ret;
+
+	ret = lib_ring_buffer_backend_resize_alloc(&resize->backend,
+			&buf->backend, subbuf_size, num_subbuf);
+	if (ret)
+		return ret;
+	resize->commit_hot =
+		lttng_kvzalloc_node(ALIGN(sizeof(*resize->commit_hot)
+				   * num_subbuf,
+				   1 << INTERNODE_CACHE_SHIFT),
+			GFP_KERNEL | __GFP_NOWARN, node);
+	if (!resize->commit_hot) {
+		ret = -ENOMEM;
+		goto free_backend;
+	}
+	resize->commit_cold =
+		lttng_kvzalloc_node(ALIGN(sizeof(*resize->commit_cold)
+				   * num_subbuf,
+				   1 << INTERNODE_CACHE_SHIFT),
+			GFP_KERNEL | __GFP_NOWARN, node);
+	if (!resize->commit_cold) {
+		ret = -ENOMEM;
+		goto free_commit;
+	}
+	resize->ctrl = lib_ring_buffer_ctrl_create(&buf->backend.chan->backend.config,
+			subbuf_size, num_subbuf);
+	if (IS_ERR(resize->ctrl)) {
+		ret = PTR_ERR(resize->ctrl);
+		resize->ctrl = NULL;
+		goto free_commit_cold;
+	}
+	return 0;
+
+free_commit_cold:
+	lttng_kvfree(resize->commit_cold);
+free_commit:
+	lttng_kvfree(resize->commit_hot);
+free_backend:
+	lib_ring_buffer_backend_resize_free(&resize->backend, num_subbuf);
+	return ret;
+}
+
+static
+void lib_ring_buffer_resize_free(struct lib_ring_buffer_resize *resize,
+				 size_t num_subbuf)
+{
+	vfree(resize->ctrl);
+	lttng_kvfree(resize->commit_cold);
+	lttng_kvfree(resize->commit_hot);
+	lib_ring_buffer_backend_resize_free(&resize->backend, num_subbuf);
+}
+
+/*
+ * Stop the buffer timers, and keep the nohz callbacks away from the
+ * buffer: they test "allocated" with their lock held.
+ */
+static
+void lib_ring_buffer_resize_stop(struct lib_ring_buffer *buf)
+{
+	const struct lib_ring_buffer_config *config = &buf->backend.chan->backend.config;
+	int cpu = buf->backend.cpu;
+
+	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
+		spin_lock(&per_cpu(ring_buffer_nohz_lock, cpu));
+	lib_ring_buffer_stop_switch_timer(buf);
+	lib_ring_buffer_stop_read_timer(buf);
+	raw_spin_lock(&buf->raw_tick_nohz_spinlock);
+	buf->backend.allocated = 0;
+	raw_spin_unlock(&buf->raw_tick_nohz_spinlock);
+	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
+		spin_unlock(&per_cpu(ring_buffer_nohz_lock, cpu));
+}
+
+static
+void lib_ring_buffer_resize_start(struct lib_ring_buffer *buf)
+{
+	const struct lib_ring_buffer_config *config = &buf->backend.chan->backend.config;
+	int cpu = buf->backend.cpu;
+
+	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
+		spin_lock(&per_cpu(ring_buffer_nohz_lock, cpu));
+	smp_wmb();
+	buf->backend.allocated = 1;
+	if (config->alloc != RING_BUFFER_ALLOC_PER_CPU || cpu_online(cpu)) {
+		lib_ring_buffer_start_read_timer(buf);
+		lib_ring_buffer_start_switch_timer(buf);
+	}
+	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
+		spin_unlock(&per_cpu(ring_buffer_nohz_lock, cpu));
+}
+
+/* Install the new sub-buffers, and start over at their beginning. */
+static
+void lib_ring_buffer_resize_swap(struct lib_ring_buffer_resize *resize)
+{
+	struct lib_ring_buffer *buf = resize->buf;
+	const struct lib_ring_buffer_config *config = &buf->backend.chan->backend.config;
+
+	lib_ring_buffer_backend_resize_swap(&buf->backend, &resize->backend);
+	swap(buf->commit_hot, resize->commit_hot);
+	swap(buf->commit_cold, resize->commit_cold);
+	swap(buf->ctrl, resize->ctrl);
+	v_set(config, &buf->offset, 0);
+	atomic_long_set(&buf->consumed, 0);
+	v_set(config, &buf->last_tsc, 0);
+	buf->get_subbuf_consumed = 0;
+	buf->prod_snapshot = 0;
+	buf->cons_snapshot = 0;
+}
+
+/**
+ * channel_resize - Change the sub-buffer size and count of a channel.
+ * @chan: channel to resize
+ * @subbuf_size: new sub-buffer size
+ * @num_subbuf: new number of sub-buffers
+ *
+ * Writers must be stopped, and the readers must have consumed all the
+ * data and released their buffers, which can be opened again once the
+ * channel is resized: -EBUSY is returned otherwise. Nothing is changed
+ * on failure.
+ *
+ * New sub-buffers are allocated for all buffers before the old ones are
+ * freed. Buffers of a RING_BUFFER_CHANNEL_LAZY_ALLOC channel which are
+ * not created yet will be created with the new geometry.
+ *
+ * Holds cpu hotplug.
+ */
+int channel_resize(struct channel *chan, size_t subbuf_size,
+		   size_t num_subbuf)
+{
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+	size_t free_num_subbuf = num_subbuf;
+	struct lib_ring_buffer_resize *resize;
+	int cpu, i, nr = 0, nr_open = 0, nr_alloc = 0, ret;
+
+	ret = channel_backend_check_geometry(config, subbuf_size, num_subbuf);
+	if (ret)
+		return ret;
+	if (subbuf_size == chan->backend.subbuf_size
+			&& num_subbuf == chan->backend.num_subbuf)
+		return 0;
+	/* Channel-wide mappings are laid out for the current geometry. */
+	if (atomic_read(&chan->mmap_count))
+		return -EBUSY;
+	resize = kcalloc(config->alloc == RING_BUFFER_ALLOC_PER_CPU ?
+			 nr_cpu_ids : 1, sizeof(*resize), GFP_KERNEL);
+	if (!resize)
+		return -ENOMEM;
+	if (chan->backend.lazy_alloc)
+		flush_work(&chan->lazy_alloc_work);
+
+	get_online_cpus();
+	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU) {
+		for_each_channel_cpu(cpu, chan)
+			resize[nr++].buf = per_cpu_ptr(chan->backend.buf, cpu);
+	} else {
+		resize[nr++].buf = chan->backend.buf;
+	}
+	/* Holding the read side keeps readers away from the buffers. */
+	for (nr_open = 0; nr_open < nr; nr_open++) {
+		ret = lib_ring_buffer_open_read(resize[nr_open].buf);
+		if (ret)
+			goto release;
+	}
+	for (i = 0; i < nr; i++) {
+		if (atomic_long_read(&resize[i].buf->secondary_readers)
+		    || !lib_ring_buffer_resize_drained(resize[i].buf, chan)) {
+			ret = -EBUSY;
+			goto release;
+		}
+	}
+	for (nr_alloc = 0; nr_alloc < nr; nr_alloc++) {
+		ret = lib_ring_buffer_resize_alloc(&resize[nr_alloc],
+						   subbuf_size, num_subbuf);
+		if (ret)
+			goto free;
+	}
+
+	for (i = 0; i < nr; i++)
+		lib_ring_buffer_resize_stop(resize[i].buf);
+	for (i = 0; i < nr; i++)
+		lib_ring_buffer_resize_swap(&resize[i]);
+	free_num_subbuf = chan->backend.num_subbuf;
+	channel_backend_set_geometry(&chan->backend, subbuf_size, num_subbuf);
+	chan->commit_count_mask = (~0UL >> chan->backend.num_subbuf_order);
+	WRITE_ONCE(chan->critical_reserve,
+		   subbuf_size * chan->critical_reserve_pct / 100);
+	lib_ring_buffer_crash_resize(chan);
+	for (i = 0; i < nr; i++)
+		lib_ring_buffer_resize_start(resize[i].buf);
+	ret = 0;
+
+free:
+	/* Old sub-buffers on success. */
+	for (i = 0; i < nr_alloc; i++)
+		lib_ring_buffer_resize_free(&resize[i], free_num_subbuf);
+release:
+	for (i = 0; i < nr_open; i++)
+		lib_ring_buffer_release_read(resize[i].buf);
+	put_online_cpus();
+	kfree(resize);
+	/* Streams can be opened again. */
+	if (!ret)
+		wake_up_interruptible(&chan->hp_wait);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(channel_resize);
+
 struct lib_ring_buffer *channel_get_ring_buffer(
 					const struct lib_ring_buffer_config *config,
 					struct channel *chan, int cpu)
@@ -1006,6 +1936,43 @@ struct lib_ring_buffer *channel_get_ring_buffer(
 }
 EXPORT_SYMBOL_GPL(channel_get_ring_buffer);
 
+/**
+ * channel_get_ready_cpus - Get the cpus of the buffers with data to read.
+ * @chan: channel
+ * @ready: cpumask to fill
+ *
+ * A buffer is ready when a stream poll would report it readable: it
+ * holds at least one sub-buffer which is not the one being written.
+ * Global buffers are reported as cpu 0. Returns the number of ready
+ * buffers. Readers waiting for this are woken up through
+ * chan->read_wait.
+ */
+int channel_get_ready_cpus(struct channel *chan, struct cpumask *ready)
+{
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+	struct lib_ring_buffer *buf;
+	int cpu, nr = 0;
+
+	cpumask_clear(ready);
+	if (config->alloc == RING_BUFFER_ALLOC_GLOBAL) {
+		if (lib_ring_buffer_buf_ready(config, chan->backend.buf, chan)) {
+			cpumask_set_cpu(0, ready);
+			nr++;
+		}
+		return nr;
+	}
+	for_each_channel_cpu(cpu, chan) {
+		buf = per_cpu_ptr(chan->backend.buf, cpu);
+		if (!buf->backend.allocated
+		    || !lib_ring_buffer_buf_ready(config, buf, chan))
+			continue;
+		cpumask_set_cpu(cpu, ready);
+		nr++;
+	}
+	return nr;
+}
+EXPORT_SYMBOL_GPL(channel_get_ready_cpus);
+
 int lib_ring_buffer_open_read(struct lib_ring_buffer *buf)
 {
 	struct channel *chan = buf->backend.chan;
@@ -1032,6 +1999,55 @@ void lib_ring_buffer_release_read(struct lib_ring_buffer *buf)
 }
 EXPORT_SYMBOL_GPL(lib_ring_buffer_release_read);
 
+/*
+ * The secondary reader of a discard mode buffer reads the sub-buffers in
+ * place, without exchanging them with the writers, from its own position.
+ * Writers do not reclaim space past the position of either reader, so a
+ * sub-buffer is only reused once both readers released it. The secondary
+ * reader starts at the position of the primary reader.
+ */
+int lib_ring_buffer_open_read_secondary(struct lib_ring_buffer *buf)
+{
+	struct channel *chan = buf->backend.chan;
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+
+	if (config->mode != RING_BUFFER_DISCARD)
+		return -EINVAL;
+	if (!atomic_long_add_unless(&buf->secondary_readers, 1, 1))
+		return -EBUSY;
+	if (!lttng_kref_get(&chan->ref)) {
+		atomic_long_dec(&buf->secondary_readers);
+		return -EOVERFLOW;
+	}
+	/*
+	 * Order the secondary_readers increment before the consumed load.
+	 * Writers load consumed before secondary_readers: those not seeing
+	 * the secondary reader use a consumed position at most equal to
+	 * the one loaded here. See lib_ring_buffer_reclaim_pos().
+	 */
+	smp_mb();
+	atomic_long_set(&buf->secondary_consumed,
+			subbuf_trunc(atomic_long_read(&buf->consumed), chan));
+	buf->secondary_get_subbuf = 0;
+	smp_mb();
+	return 0;
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_open_read_secondary);
+
+void lib_ring_buffer_release_read_secondary(struct lib_ring_buffer *buf)
+{
+	struct channel *chan = buf->backend.chan;
+
+	CHAN_WARN_ON(chan, atomic_long_read(&buf->secondary_readers) != 1);
+	buf->secondary_get_subbuf = 0;
+	lttng_smp_mb__before_atomic();
+	atomic_long_dec(&buf->secondary_readers);
+	/* Wake-up the metadata producer */
+	wake_up_interruptible(&buf->write_wait);
+	kref_put(&chan->ref, channel_release);
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_release_read_secondary);
+
 /*
  * Promote compiler barrier to a smp_mb().
  * For the specific ring buffer case, this IPI call should be removed if the
@@ -1162,19 +2178,22 @@ void lib_ring_buffer_move_consumer(struct lib_ring_buffer *buf,
 	while ((long) consumed - (long) consumed_new < 0)
 		consumed = atomic_long_cmpxchg(&buf->consumed, consumed,
 					       consumed_new);
+	if (buf->ctrl)
+		WRITE_ONCE(buf->ctrl->consumed, atomic_long_read(&buf->consumed));
 	/* Wake-up the metadata producer */
 	wake_up_interruptible(&buf->write_wait);
 }
 EXPORT_SYMBOL_GPL(lib_ring_buffer_move_consumer);
 
 #if ARCH_IMPLEMENTS_FLUSH_DCACHE_PAGE
-static void lib_ring_buffer_flush_read_subbuf_dcache(
+static void lib_ring_buffer_flush_subbuf_dcache(
 		const struct lib_ring_buffer_config *config,
 		struct channel *chan,
-		struct lib_ring_buffer *buf)
+		struct lib_ring_buffer *buf,
+		unsigned long sb_bindex)
 {
 	struct lib_ring_buffer_backend_pages *pages;
-	unsigned long sb_bindex, id, i, nr_pages;
+	unsigned long i, nr_pages;
 
 	if (config->output != RING_BUFFER_MMAP)
 		return;
@@ -1188,8 +2207,6 @@ static void lib_ring_buffer_flush_read_subbuf_dcache(
 	 * extra TLB entries. Therefore, simply flush the dcache for the
 	 * entire sub-buffer before reading it.
 	 */
-	id = buf->backend.buf_rsb.id;
-	sb_bindex = subbuffer_id_get_index(config, id);
 	pages = buf->backend.array[sb_bindex];
 	nr_pages = buf->backend.num_pages_per_subbuf;
 	for (i = 0; i < nr_pages; i++) {
@@ -1200,53 +2217,24 @@ static void lib_ring_buffer_flush_read_subbuf_dcache(
 	}
 }
 #else
-static void lib_ring_buffer_flush_read_subbuf_dcache(
+static void lib_ring_buffer_flush_subbuf_dcache(
 		const struct lib_ring_buffer_config *config,
 		struct channel *chan,
-		struct lib_ring_buffer *buf)
+		struct lib_ring_buffer *buf,
+		unsigned long sb_bindex)
 {
 }
 #endif
 
-/**
- * lib_ring_buffer_get_subbuf - get exclusive access to subbuffer for reading
- * @buf: ring buffer
- * @consumed: consumed count indicating the position where to read
- *
- * Returns -ENODATA if buffer is finalized, -EAGAIN if there is currently no
- * data to read at consumed position, or 0 if the get operation succeeds.
- * Busy-loop trying to get data if the tick_nohz sequence lock is held.
+/*
+ * Order the commit count load of a reader before its loads of the buffer
+ * data and of the write offset, pairing with the writer-side barriers.
  */
-int lib_ring_buffer_get_subbuf(struct lib_ring_buffer *buf,
-			       unsigned long consumed)
+static
+void lib_ring_buffer_read_barrier(const struct lib_ring_buffer_config *config,
+				  struct lib_ring_buffer *buf)
 {
-	struct channel *chan = buf->backend.chan;
-	const struct lib_ring_buffer_config *config = &chan->backend.config;
-	unsigned long consumed_cur, consumed_idx, commit_count, write_offset;
-	int ret;
-	int finalized;
-
-	if (buf->get_subbuf) {
-		/*
-		 * Reader is trying to get a subbuffer twice.
-		 */
-		CHAN_WARN_ON(chan, 1);
-		return -EBUSY;
-	}
-retry:
-	finalized = READ_ONCE(buf->finalized);
 	/*
-	 * Read finalized before counters.
-	 */
-	smp_rmb();
-	consumed_cur = atomic_long_read(&buf->consumed);
-	consumed_idx = subbuf_index(consumed, chan);
-	commit_count = v_read(config, &buf->commit_cold[consumed_idx].cc_sb);
-	/*
-	 * Make sure we read the commit count before reading the buffer
-	 * data and the write offset. Correct consumed offset ordering
-	 * wrt commit count is insured by the use of cmpxchg to update
-	 * the consumed offset.
 	 * smp_call_function_single can fail if the remote CPU is offline,
 	 * this is OK because then there is no wmb to execute there.
 	 * If our thread is executing on the same CPU as the on the buffers
@@ -1278,8 +2266,13 @@ retry:
 	 * read and write vs write. They do not ensure core synchronization. We
 	 * really have to ensure total order between the 3 barriers running on
 	 * the 2 CPUs.
+	 *
+	 * Isolated cpus, and all cpus of channels with writer barriers, are
+	 * spared the IPI: their writers issue the write barrier themselves,
+	 * see lib_ring_buffer_commit_barrier().
 	 */
-	if (config->ipi == RING_BUFFER_IPI_BARRIER) {
+	if (config->ipi == RING_BUFFER_IPI_BARRIER && !buf->isolated
+	    && !chan->writer_barrier) {
 		if (config->sync == RING_BUFFER_SYNC_PER_CPU
 		    && config->alloc == RING_BUFFER_ALLOC_PER_CPU) {
 			if (raw_smp_processor_id() != buf->backend.cpu) {
@@ -1304,19 +2297,271 @@ retry:
 		 */
 		smp_rmb();
 	}
+}
+
+/**
+ * lib_ring_buffer_get_subbuf - get exclusive access to subbuffer for reading
+ * @buf: ring buffer
+ * @consumed: consumed count indicating the position where to read
+ *
+ * Returns -ENODATA if buffer is finalized, -EAGAIN if there is currently no
+ * data to read at consumed position, or 0 if the get operation succeeds.
+ * Busy-loop trying to get data if the tick_nohz sequence lock is held.
+ */
+int lib_ring_buffer_get_subbuf(struct lib_ring_buffer *buf,
+			       unsigned long consumed)
+{
+	struct channel *chan = buf->backend.chan;
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+	unsigned long consumed_cur, consumed_idx, commit_count, write_offset;
+	int ret;
+	int finalized;
+
+	if (buf->get_subbuf) {
+		/*
+		 * Reader is trying to get a subbuffer twice.
+		 */
+		CHAN_WARN_ON(chan, 1);
+		return -EBUSY;
+	}
+retry:
+	finalized = READ_ONCE(buf->finalized);
+	/*
+	 * Read finalized before counters.
+	 */
+	smp_rmb();
+	consumed_cur = atomic_long_read(&buf->consumed);
+	consumed_idx = subbuf_index(consumed, chan);
+	commit_count = v_read(config, &buf->commit_cold[consumed_idx].cc_sb);
+	/*
+	 * Make sure we read the commit count before reading the buffer
+	 * data and the write offset. Correct consumed offset ordering
+	 * wrt commit count is insured by the use of cmpxchg to update
+	 * the consumed offset.
+	 */
+	lib_ring_buffer_read_barrier(config, buf);
+
+	write_offset = v_read(config, &buf->offset);
+
+	/*
+	 * Check that the buffer we are getting is after or at consumed_cur
+	 * position.
+	 */
+	if ((long) subbuf_trunc(consumed, chan)
+	    - (long) subbuf_trunc(consumed_cur, chan) < 0)
+		goto nodata;
+
+	/*
+	 * Check that the subbuffer we are trying to consume has been
+	 * already fully committed.
+	 */
+	if (((commit_count - chan->backend.subbuf_size)
+	     & chan->commit_count_mask)
+	    - (buf_trunc(consumed, chan)
+	       >> chan->backend.num_subbuf_order)
+	    != 0)
+		goto nodata;
+
+	/*
+	 * Check that we are not about to read the same subbuffer in
+	 * which the writer head is.
+	 */
+	if (subbuf_trunc(write_offset, chan) - subbuf_trunc(consumed, chan)
+	    == 0)
+		goto nodata;
+
+	/*
+	 * Failure to get the subbuffer causes a busy-loop retry without going
+	 * to a wait queue. These are caused by short-lived race windows where
+	 * the writer is getting access to a subbuffer we were trying to get
+	 * access to. Also checks that the "consumed" buffer count we are
+	 * looking for matches the one contained in the subbuffer id.
+	 */
+	ret = update_read_sb_index(config, &buf->backend, &chan->backend,
+				   consumed_idx, buf_trunc_val(consumed, chan));
+	if (ret)
+		goto retry;
+	subbuffer_id_clear_noref(config, &buf->backend.buf_rsb.id);
+
+	buf->get_subbuf_consumed = consumed;
+	buf->get_subbuf = 1;
+
+	lib_ring_buffer_flush_subbuf_dcache(config, chan, buf,
+			subbuffer_id_get_index(config, buf->backend.buf_rsb.id));
+
+	return 0;
+
+nodata:
+	/*
+	 * The memory barriers __wait_event()/wake_up_interruptible() take care
+	 * of "raw_spin_is_locked" memory ordering.
+	 */
+	if (finalized)
+		return -ENODATA;
+	else if (raw_spin_is_locked(&buf->raw_tick_nohz_spinlock))
+		goto retry;
+	else
+		return -EAGAIN;
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_get_subbuf);
+
+/**
+ * lib_ring_buffer_put_subbuf - release exclusive subbuffer access
+ * @buf: ring buffer
+ */
+void lib_ring_buffer_put_subbuf(struct lib_ring_buffer *buf)
+{
+	struct lib_ring_buffer_backend *bufb = &buf->backend;
+	struct channel *chan = bufb->chan;
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+	unsigned long read_sb_bindex, consumed_idx, consumed;
+
+	CHAN_WARN_ON(chan, atomic_long_read(&buf->active_readers) != 1);
+
+	if (!buf->get_subbuf) {
+		/*
+		 * Reader puts a subbuffer it did not get.
+		 */
+		CHAN_WARN_ON(chan, 1);
+		return;
+	}
+	consumed = buf->get_subbuf_consumed;
+	buf->get_subbuf = 0;
+	buf->get_subbuf_run = 0;
+
+	/*
+	 * Clear the records_unread counter. (overruns counter)
+	 * Can still be non-zero if a file reader simply grabbed the data
+	 * without using iterators.
+	 * Can be below zero if an iterator is used on a snapshot more than
+	 * once.
+	 */
+	read_sb_bindex = subbuffer_id_get_index(config, bufb->buf_rsb.id);
+	v_add(config, v_read(config,
+			     &bufb->array[read_sb_bindex]->records_unread),
+	      &bufb->records_read);
+	v_set(config, &bufb->array[read_sb_bindex]->records_unread, 0);
+	CHAN_WARN_ON(chan, config->mode == RING_BUFFER_OVERWRITE
+		     && subbuffer_id_is_noref(config, bufb->buf_rsb.id));
+	subbuffer_id_set_noref(config, &bufb->buf_rsb.id);
 
+	/*
+	 * Exchange the reader subbuffer with the one we put in its place in the
+	 * writer subbuffer table. Expect the original consumed count. If
+	 * update_read_sb_index fails, this is because the writer updated the
+	 * subbuffer concurrently. We should therefore keep the subbuffer we
+	 * currently have: it has become invalid to try reading this sub-buffer
+	 * consumed count value anyway.
+	 */
+	consumed_idx = subbuf_index(consumed, chan);
+	update_read_sb_index(config, &buf->backend, &chan->backend,
+			     consumed_idx, buf_trunc_val(consumed, chan));
+	/*
+	 * update_read_sb_index return value ignored. Don't exchange sub-buffer
+	 * if the writer concurrently updated it.
+	 */
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_put_subbuf);
+
+/**
+ * lib_ring_buffer_get_subbuf_run - get read access to consecutive subbuffers
+ * @buf: ring buffer
+ * @consumed: consumed count indicating the position where to read
+ * @nr: in: maximum number of subbuffers, out: number of subbuffers held
+ *
+ * Discard mode only. Gets the subbuffer at @consumed as
+ * lib_ring_buffer_get_subbuf(), followed by the fully committed
+ * subbuffers after it, up to @nr. Subbuffers are not exchanged with the
+ * writers in discard mode, and writers do not go past the consumed
+ * position, so the whole run is protected until released with
+ * lib_ring_buffer_put_subbuf(). Returns as lib_ring_buffer_get_subbuf().
+ */
+int lib_ring_buffer_get_subbuf_run(struct lib_ring_buffer *buf,
+				   unsigned long consumed, unsigned long *nr)
+{
+	struct channel *chan = buf->backend.chan;
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+	unsigned long i, max_nr, write_offset;
+	int ret;
+
+	if (config->mode != RING_BUFFER_DISCARD || !*nr)
+		return -EINVAL;
+	ret = lib_ring_buffer_get_subbuf(buf, consumed);
+	if (ret)
+		return ret;
+	max_nr = min(*nr, chan->backend.num_subbuf);
 	write_offset = v_read(config, &buf->offset);
+	for (i = 1; i < max_nr; i++) {
+		unsigned long pos = consumed + (i << chan->backend.subbuf_size_order);
+		unsigned long commit_count;
+
+		commit_count = v_read(config,
+				&buf->commit_cold[subbuf_index(pos, chan)].cc_sb);
+		if (((commit_count - chan->backend.subbuf_size)
+		     & chan->commit_count_mask)
+		    - (buf_trunc(pos, chan) >> chan->backend.num_subbuf_order)
+		    != 0)
+			break;
+		if (subbuf_trunc(write_offset, chan) - subbuf_trunc(pos, chan)
+		    == 0)
+			break;
+	}
+	*nr = i;
+	if (i == 1)
+		return 0;
+	/* Order the commit count loads before the data loads of the run. */
+	lib_ring_buffer_read_barrier(config, buf);
+	for (i = 1; i < *nr; i++) {
+		unsigned long pos = consumed + (i << chan->backend.subbuf_size_order);
+
+		lib_ring_buffer_flush_subbuf_dcache(config, chan, buf,
+			subbuffer_id_get_index(config,
+				buf->backend.buf_wsb[subbuf_index(pos, chan)].id));
+	}
+	buf->get_subbuf_run = *nr;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_get_subbuf_run);
+
+/**
+ * lib_ring_buffer_get_next_subbuf_secondary - get the next sub-buffer for the
+ * secondary reader
+ * @buf: ring buffer
+ *
+ * Returns -ENODATA if buffer is finalized, -EAGAIN if there is currently no
+ * data to read at the secondary reader position, or 0 if the get operation
+ * succeeds. The sub-buffer is read in place until
+ * lib_ring_buffer_put_next_subbuf_secondary().
+ */
+int lib_ring_buffer_get_next_subbuf_secondary(struct lib_ring_buffer *buf)
+{
+	struct channel *chan = buf->backend.chan;
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+	unsigned long consumed, consumed_idx, commit_count, write_offset;
+	int finalized;
 
+	CHAN_WARN_ON(chan, atomic_long_read(&buf->secondary_readers) != 1);
+	if (buf->secondary_get_subbuf) {
+		/*
+		 * Reader is trying to get a subbuffer twice.
+		 */
+		CHAN_WARN_ON(chan, 1);
+		return -EBUSY;
+	}
+retry:
+	finalized = READ_ONCE(buf->finalized);
 	/*
-	 * Check that the buffer we are getting is after or at consumed_cur
-	 * position.
+	 * Read finalized before counters.
 	 */
-	if ((long) subbuf_trunc(consumed, chan)
-	    - (long) subbuf_trunc(consumed_cur, chan) < 0)
-		goto nodata;
+	smp_rmb();
+	consumed = atomic_long_read(&buf->secondary_consumed);
+	consumed_idx = subbuf_index(consumed, chan);
+	commit_count = v_read(config, &buf->commit_cold[consumed_idx].cc_sb);
+	lib_ring_buffer_read_barrier(config, buf);
+	write_offset = v_read(config, &buf->offset);
 
 	/*
-	 * Check that the subbuffer we are trying to consume has been
+	 * Check that the subbuffer we are trying to read has been
 	 * already fully committed.
 	 */
 	if (((commit_count - chan->backend.subbuf_size)
@@ -1334,31 +2579,18 @@ retry:
 	    == 0)
 		goto nodata;
 
-	/*
-	 * Failure to get the subbuffer causes a busy-loop retry without going
-	 * to a wait queue. These are caused by short-lived race windows where
-	 * the writer is getting access to a subbuffer we were trying to get
-	 * access to. Also checks that the "consumed" buffer count we are
-	 * looking for matches the one contained in the subbuffer id.
-	 */
-	ret = update_read_sb_index(config, &buf->backend, &chan->backend,
-				   consumed_idx, buf_trunc_val(consumed, chan));
-	if (ret)
-		goto retry;
-	subbuffer_id_clear_noref(config, &buf->backend.buf_rsb.id);
-
-	buf->get_subbuf_consumed = consumed;
-	buf->get_subbuf = 1;
+	/* Discard mode: the writer sub-buffers are never exchanged. */
+	buf->secondary_sb_bindex = subbuffer_id_get_index(config,
+			buf->backend.buf_wsb[consumed_idx].id);
+	buf->secondary_get_consumed = consumed;
+	buf->secondary_get_subbuf = 1;
 
-	lib_ring_buffer_flush_read_subbuf_dcache(config, chan, buf);
+	lib_ring_buffer_flush_subbuf_dcache(config, chan, buf,
+					    buf->secondary_sb_bindex);
 
 	return 0;
 
 nodata:
-	/*
-	 * The memory barriers __wait_event()/wake_up_interruptible() take care
-	 * of "raw_spin_is_locked" memory ordering.
-	 */
 	if (finalized)
 		return -ENODATA;
 	else if (raw_spin_is_locked(&buf->raw_tick_nohz_spinlock))
@@ -1366,64 +2598,35 @@ nodata:
 	else
 		return -EAGAIN;
 }
-EXPORT_SYMBOL_GPL(lib_ring_buffer_get_subbuf);
+EXPORT_SYMBOL_GPL(lib_ring_buffer_get_next_subbuf_secondary);
 
 /**
- * lib_ring_buffer_put_subbuf - release exclusive subbuffer access
+ * lib_ring_buffer_put_next_subbuf_secondary - release the sub-buffer of the
+ * secondary reader, letting writers reclaim it once the primary reader
+ * consumed it too.
  * @buf: ring buffer
  */
-void lib_ring_buffer_put_subbuf(struct lib_ring_buffer *buf)
+void lib_ring_buffer_put_next_subbuf_secondary(struct lib_ring_buffer *buf)
 {
-	struct lib_ring_buffer_backend *bufb = &buf->backend;
-	struct channel *chan = bufb->chan;
-	const struct lib_ring_buffer_config *config = &chan->backend.config;
-	unsigned long read_sb_bindex, consumed_idx, consumed;
-
-	CHAN_WARN_ON(chan, atomic_long_read(&buf->active_readers) != 1);
+	struct channel *chan = buf->backend.chan;
 
-	if (!buf->get_subbuf) {
+	CHAN_WARN_ON(chan, atomic_long_read(&buf->secondary_readers) != 1);
+	if (!buf->secondary_get_subbuf) {
 		/*
 		 * Reader puts a subbuffer it did not get.
 		 */
 		CHAN_WARN_ON(chan, 1);
 		return;
 	}
-	consumed = buf->get_subbuf_consumed;
-	buf->get_subbuf = 0;
-
-	/*
-	 * Clear the records_unread counter. (overruns counter)
-	 * Can still be non-zero if a file reader simply grabbed the data
-	 * without using iterators.
-	 * Can be below zero if an iterator is used on a snapshot more than
-	 * once.
-	 */
-	read_sb_bindex = subbuffer_id_get_index(config, bufb->buf_rsb.id);
-	v_add(config, v_read(config,
-			     &bufb->array[read_sb_bindex]->records_unread),
-	      &bufb->records_read);
-	v_set(config, &bufb->array[read_sb_bindex]->records_unread, 0);
-	CHAN_WARN_ON(chan, config->mode == RING_BUFFER_OVERWRITE
-		     && subbuffer_id_is_noref(config, bufb->buf_rsb.id));
-	subbuffer_id_set_noref(config, &bufb->buf_rsb.id);
-
-	/*
-	 * Exchange the reader subbuffer with the one we put in its place in the
-	 * writer subbuffer table. Expect the original consumed count. If
-	 * update_read_sb_index fails, this is because the writer updated the
-	 * subbuffer concurrently. We should therefore keep the subbuffer we
-	 * currently have: it has become invalid to try reading this sub-buffer
-	 * consumed count value anyway.
-	 */
-	consumed_idx = subbuf_index(consumed, chan);
-	update_read_sb_index(config, &buf->backend, &chan->backend,
-			     consumed_idx, buf_trunc_val(consumed, chan));
-	/*
-	 * update_read_sb_index return value ignored. Don't exchange sub-buffer
-	 * if the writer concurrently updated it.
-	 */
+	buf->secondary_get_subbuf = 0;
+	/* Order the reads of the sub-buffer before its release. */
+	smp_mb();
+	atomic_long_set(&buf->secondary_consumed,
+			subbuf_align(buf->secondary_get_consumed, chan));
+	/* Wake-up the metadata producer */
+	wake_up_interruptible(&buf->write_wait);
 }
-EXPORT_SYMBOL_GPL(lib_ring_buffer_put_subbuf);
+EXPORT_SYMBOL_GPL(lib_ring_buffer_put_next_subbuf_secondary);
 
 /*
  * cons_offset is an iterator on all subbuffer offsets between the reader
@@ -1540,19 +2743,8 @@ void lib_ring_buffer_switch_old_start(struct lib_ring_buffer *buf,
 
 	config->cb.buffer_begin(buf, tsc, oldidx);
 
-	/*
-	 * Order all writes to buffer before the commit count update that will
-	 * determine that the subbuffer is full.
-	 */
-	if (config->ipi == RING_BUFFER_IPI_BARRIER) {
-		/*
-		 * Must write slot data before incrementing commit count.  This
-		 * compiler barrier is upgraded into a smp_mb() by the IPI sent
-		 * by get_subbuf().
-		 */
-		barrier();
-	} else
-		smp_wmb();
+	/* Must write slot data before incrementing commit count. */
+	lib_ring_buffer_commit_barrier(config, buf);
 	cc_hot = &buf->commit_hot[oldidx];
 	v_add(config, config->cb.subbuffer_header_size(), &cc_hot->cc);
 	commit_count = v_read(config, &cc_hot->cc);
@@ -1583,23 +2775,13 @@ void lib_ring_buffer_switch_old_end(struct lib_ring_buffer *buf,
 	unsigned long commit_count, padding_size, data_size;
 	struct commit_counters_hot *cc_hot;
 
+	v_inc(config, &buf->subbuf_switches);
 	data_size = subbuf_offset(offsets->old - 1, chan) + 1;
 	padding_size = chan->backend.subbuf_size - data_size;
 	subbuffer_set_data_size(config, &buf->backend, oldidx, data_size);
 
-	/*
-	 * Order all writes to buffer before the commit count update that will
-	 * determine that the subbuffer is full.
-	 */
-	if (config->ipi == RING_BUFFER_IPI_BARRIER) {
-		/*
-		 * Must write slot data before incrementing commit count.  This
-		 * compiler barrier is upgraded into a smp_mb() by the IPI sent
-		 * by get_subbuf().
-		 */
-		barrier();
-	} else
-		smp_wmb();
+	/* Must write slot data before incrementing commit count. */
+	lib_ring_buffer_commit_barrier(config, buf);
 	cc_hot = &buf->commit_hot[oldidx];
 	v_add(config, padding_size, &cc_hot->cc);
 	commit_count = v_read(config, &cc_hot->cc);
@@ -1630,19 +2812,8 @@ void lib_ring_buffer_switch_new_start(struct lib_ring_buffer *buf,
 
 	config->cb.buffer_begin(buf, tsc, beginidx);
 
-	/*
-	 * Order all writes to buffer before the commit count update that will
-	 * determine that the subbuffer is full.
-	 */
-	if (config->ipi == RING_BUFFER_IPI_BARRIER) {
-		/*
-		 * Must write slot data before incrementing commit count.  This
-		 * compiler barrier is upgraded into a smp_mb() by the IPI sent
-		 * by get_subbuf().
-		 */
-		barrier();
-	} else
-		smp_wmb();
+	/* Must write slot data before incrementing commit count. */
+	lib_ring_buffer_commit_barrier(config, buf);
 	cc_hot = &buf->commit_hot[beginidx];
 	v_add(config, config->cb.subbuffer_header_size(), &cc_hot->cc);
 	commit_count = v_read(config, &cc_hot->cc);
@@ -1672,6 +2843,7 @@ void lib_ring_buffer_switch_new_end(struct lib_ring_buffer *buf,
 	unsigned long endidx, data_size;
 
 	endidx = subbuf_index(offsets->end - 1, chan);
+	v_inc(config, &buf->subbuf_switches);
 	data_size = subbuf_offset(offsets->end - 1, chan) + 1;
 	subbuffer_set_data_size(config, &buf->backend, endidx, data_size);
 }
@@ -1743,13 +2915,14 @@ int lib_ring_buffer_try_switch_slow(enum switch_mode mode,
 			/* Next subbuffer not being written to. */
 			if (unlikely(config->mode != RING_BUFFER_OVERWRITE &&
 				subbuf_trunc(offsets->begin, chan)
-				 - subbuf_trunc((unsigned long)
-				     atomic_long_read(&buf->consumed), chan)
+				 - subbuf_trunc(lib_ring_buffer_reclaim_pos(buf),
+						chan)
 				>= chan->backend.buf_size)) {
 				/*
 				 * We do not overwrite non consumed buffers
 				 * and we are full : don't switch.
 				 */
+				v_inc(config, &buf->reader_blocked);
 				return -1;
 			} else {
 				/*
@@ -1767,6 +2940,7 @@ int lib_ring_buffer_try_switch_slow(enum switch_mode mode,
 			 * either a writer OOPS or too many nested writes over a
 			 * reserve/commit pair.
 			 */
+			v_inc(config, &buf->commit_overflows);
 			return -1;
 		}
 
@@ -1802,12 +2976,15 @@ void lib_ring_buffer_switch_slow(struct lib_ring_buffer *buf, enum switch_mode m
 	/*
 	 * Perform retryable operations.
 	 */
-	do {
+	for (;;) {
 		if (lib_ring_buffer_try_switch_slow(mode, buf, chan, &offsets,
 						    &tsc))
 			return;	/* Switch not needed */
-	} while (v_cmpxchg(config, &buf->offset, offsets.old, offsets.end)
-		 != offsets.old);
+		if (v_cmpxchg(config, &buf->offset, offsets.old, offsets.end)
+		    == offsets.old)
+			break;
+		v_inc(config, &buf->reserve_retries);
+	}
 
 	/*
 	 * Atomically update last_tsc. This update races against concurrent
@@ -1869,6 +3046,12 @@ static void _lib_ring_buffer_switch_remote(struct lib_ring_buffer *buf,
 		return;
 	}
 
+	/* Isolated cpus are not sent IPIs. */
+	if (buf->isolated) {
+		lib_ring_buffer_switch_isolated(buf, mode);
+		return;
+	}
+
 	/*
 	 * Disabling preemption ensures two things: first, that the
 	 * target cpu is not taken concurrently offline while we are within
@@ -1889,6 +3072,190 @@ static void _lib_ring_buffer_switch_remote(struct lib_ring_buffer *buf,
 	preempt_enable();
 }
 
+/*
+ * Sequence number of the packet being written, i.e. the first packet
+ * following a switch. Same as computed by the client at buffer begin.
+ */
+static
+uint64_t lib_ring_buffer_current_seq_num(struct lib_ring_buffer *buf)
+{
+	struct channel *chan = buf->backend.chan;
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+	unsigned long idx = subbuf_index(v_read(config, &buf->offset), chan);
+
+	return buf->backend.seq_base
+		+ chan->backend.num_subbuf * buf->backend.buf_cnt[idx].seq_cnt
+		+ idx;
+}
+
+struct channel_flush_param {
+	struct channel *chan;
+	enum switch_mode mode;
+	uint64_t *seq_num;
+};
+
+/* Called from IPI, on each cpu of the flush mask. */
+static void remote_flush(void *info)
+{
+	struct channel_flush_param *param = info;
+	struct channel *chan = param->chan;
+	int cpu = smp_processor_id();
+	struct lib_ring_buffer *buf = per_cpu_ptr(chan->backend.buf, cpu);
+
+	lib_ring_buffer_switch_slow(buf, param->mode);
+	if (param->seq_num)
+		param->seq_num[cpu] = lib_ring_buffer_current_seq_num(buf);
+}
+
+/**
+ * channel_flush - Switch the sub-buffer of all the channel buffers.
+ * @chan: channel
+ * @empty: also switch buffers whose current sub-buffer is empty
+ * @seq_num: array of nr_cpu_ids entries, or NULL
+ *
+ * Per-cpu buffers are switched by a single IPI broadcast to their online
+ * cpus, rather than one synchronous IPI per buffer. Isolated cpus are not
+ * sent IPIs: their buffers are switched from here, after a single grace
+ * period for all of them. Buffers of offline cpus are switched from here
+ * as well.
+ *
+ * The sequence number of the first packet following the switch of each
+ * buffer is stored in @seq_num, indexed by cpu (0 for global buffers).
+ * Entries of cpus without buffer are left untouched.
+ */
+int channel_flush(struct channel *chan, int empty, uint64_t *seq_num)
+{
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+	struct channel_flush_param param;
+	struct lib_ring_buffer *buf;
+	cpumask_var_t ipi_mask, isolated_mask;
+	int cpu, ret = 0;
+
+	param.chan = chan;
+	param.mode = empty ? SWITCH_FLUSH : SWITCH_ACTIVE;
+	param.seq_num = seq_num;
+	if (config->alloc == RING_BUFFER_ALLOC_GLOBAL) {
+		buf = chan->backend.buf;
+		_lib_ring_buffer_switch_remote(buf, param.mode);
+		if (seq_num)
+			seq_num[0] = lib_ring_buffer_current_seq_num(buf);
+		return 0;
+	}
+	if (!zalloc_cpumask_var(&ipi_mask, GFP_KERNEL))
+		return -ENOMEM;
+	if (!zalloc_cpumask_var(&isolated_mask, GFP_KERNEL)) {
+		ret = -ENOMEM;
+		goto free_ipi_mask;
+	}
+
+	get_online_cpus();
+	for_each_channel_cpu(cpu, chan) {
+		buf = per_cpu_ptr(chan->backend.buf, cpu);
+		if (!buf->backend.allocated)
+			continue;
+		if (buf->isolated) {
+			atomic_inc(&buf->record_disabled);
+			cpumask_set_cpu(cpu, isolated_mask);
+		} else if (config->sync == RING_BUFFER_SYNC_GLOBAL
+			   || !cpu_online(cpu)) {
+			/* See _lib_ring_buffer_switch_remote(). */
+			preempt_disable();
+			lib_ring_buffer_switch_slow(buf, param.mode);
+			preempt_enable();
+			if (seq_num)
+				seq_num[cpu] = lib_ring_buffer_current_seq_num(buf);
+		} else {
+			cpumask_set_cpu(cpu, ipi_mask);
+		}
+	}
+	on_each_cpu_mask(ipi_mask, remote_flush, &param, 1);
+	if (!cpumask_empty(isolated_mask)) {
+		lib_ring_buffer_synchronize_writers();
+		for_each_cpu(cpu, isolated_mask) {
+			buf = per_cpu_ptr(chan->backend.buf, cpu);
+			lib_ring_buffer_switch_isolated_quiescent(buf,
+								  param.mode);
+			if (seq_num)
+				seq_num[cpu] = lib_ring_buffer_current_seq_num(buf);
+		}
+		/* Switch before letting writers in. */
+		smp_mb();
+		for_each_cpu(cpu, isolated_mask)
+			atomic_dec(&per_cpu_ptr(chan->backend.buf,
+						cpu)->record_disabled);
+	}
+	put_online_cpus();
+
+	free_cpumask_var(isolated_mask);
+free_ipi_mask:
+	free_cpumask_var(ipi_mask);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(channel_flush);
+
+/*
+ * Move the consumed position to the sub-buffer being written, dropping
+ * the unread data. Discard mode buffers whose reader holds a sub-buffer
+ * are left as is: writers could overwrite it.
+ */
+static
+int lib_ring_buffer_clear_reader(struct lib_ring_buffer *buf)
+{
+	struct channel *chan = buf->backend.chan;
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+	unsigned long consumed_old, consumed_new;
+
+	if (config->mode == RING_BUFFER_DISCARD && READ_ONCE(buf->get_subbuf))
+		return -EBUSY;
+	do {
+		consumed_old = atomic_long_read(&buf->consumed);
+		consumed_new = subbuf_trunc(v_read(config, &buf->offset), chan);
+		if ((long) consumed_old - (long) consumed_new >= 0)
+			return 0;
+	} while (atomic_long_cmpxchg(&buf->consumed, consumed_old,
+				     consumed_new) != consumed_old);
+	if (buf->ctrl)
+		WRITE_ONCE(buf->ctrl->consumed, atomic_long_read(&buf->consumed));
+	/* Wake-up the metadata producer */
+	wake_up_interruptible(&buf->write_wait);
+	return 0;
+}
+
+/**
+ * lib_ring_buffer_clear_channel - Drop the unread data of a channel.
+ * @chan: channel
+ *
+ * The current sub-buffer of each buffer is switched, then its consumed
+ * position is moved to the new one. Buffer pages are kept, and writers
+ * may run concurrently. Packet sequence numbers are not reset: the
+ * dropped packets show up as a gap to the reader. In discard mode, a
+ * buffer whose reader holds a sub-buffer is not cleared, and -EBUSY is
+ * returned once all the other buffers are.
+ */
+int lib_ring_buffer_clear_channel(struct channel *chan)
+{
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+	struct lib_ring_buffer *buf;
+	int cpu, ret, busy = 0;
+
+	ret = channel_flush(chan, 0, NULL);
+	if (ret)
+		return ret;
+	if (config->alloc == RING_BUFFER_ALLOC_GLOBAL)
+		return lib_ring_buffer_clear_reader(chan->backend.buf);
+	get_online_cpus();
+	for_each_channel_cpu(cpu, chan) {
+		buf = per_cpu_ptr(chan->backend.buf, cpu);
+		if (!buf->backend.allocated)
+			continue;
+		if (lib_ring_buffer_clear_reader(buf))
+			busy = 1;
+	}
+	put_online_cpus();
+	return busy ? -EBUSY : 0;
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_clear_channel);
+
 /* Switch sub-buffer if current sub-buffer is non-empty. */
 void lib_ring_buffer_switch_remote(struct lib_ring_buffer *buf)
 {
@@ -1896,6 +3263,19 @@ void lib_ring_buffer_switch_remote(struct lib_ring_buffer *buf)
 }
 EXPORT_SYMBOL_GPL(lib_ring_buffer_switch_remote);
 
+/*
+ * Switch the current sub-buffer of a buffer whose cpu went offline, as
+ * deferred by the hotplug dead callback. Called from the reader.
+ */
+void lib_ring_buffer_hp_flush(struct lib_ring_buffer *buf)
+{
+	if (likely(!READ_ONCE(buf->hp_flush_pending)))
+		return;
+	if (xchg(&buf->hp_flush_pending, 0))
+		lib_ring_buffer_switch_remote(buf);
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_hp_flush);
+
 /* Switch sub-buffer even if current sub-buffer is empty. */
 void lib_ring_buffer_switch_remote_empty(struct lib_ring_buffer *buf)
 {
@@ -1983,6 +3363,7 @@ retry:
 			 * commit counter we read might not match buf->offset
 			 * due to concurrent update. We therefore need to retry.
 			 */
+			v_inc(config, &buf->reserve_retries);
 			goto retry;
 		}
 		reserve_commit_diff =
@@ -1993,14 +3374,15 @@ retry:
 			/* Next subbuffer not being written to. */
 			if (unlikely(config->mode != RING_BUFFER_OVERWRITE &&
 				subbuf_trunc(offsets->begin, chan)
-				 - subbuf_trunc((unsigned long)
-				     atomic_long_read(&buf->consumed), chan)
+				 - subbuf_trunc(lib_ring_buffer_reclaim_pos(buf),
+						chan)
 				>= chan->backend.buf_size)) {
 				/*
 				 * We do not overwrite non consumed buffers
-				 * and we are full : record is lost.
+				 * and we are full : record is lost, counted
+				 * by lib_ring_buffer_reserve_slow().
 				 */
-				v_inc(config, &buf->records_lost_full);
+				v_inc(config, &buf->reader_blocked);
 				return -ENOBUFS;
 			} else {
 				/*
@@ -2019,6 +3401,7 @@ retry:
 			 * too many nested writes over a reserve/commit pair.
 			 */
 			v_inc(config, &buf->records_lost_wrap);
+			v_inc(config, &buf->commit_overflows);
 			return -EIO;
 		}
 		offsets->size =
@@ -2052,6 +3435,14 @@ retry:
 	}
 	offsets->end = offsets->begin + offsets->size;
 
+	if (unlikely(lib_ring_buffer_critical_full(config, ctx, offsets->end))) {
+		/*
+		 * The record would use the space left to critical
+		 * records : record is lost.
+		 */
+		return -ENOBUFS;
+	}
+
 	if (unlikely(subbuf_offset(offsets->end, chan) == 0)) {
 		/*
 		 * The offset_end will fall at the very beginning of the next
@@ -2062,6 +3453,161 @@ retry:
 	return 0;
 }
 
+/*
+ * Raise the fill high-water mark of a buffer to the distance between
+ * the start of a new sub-buffer and the consumed position. Called when
+ * a writer starts a sub-buffer.
+ */
+static
+void lib_ring_buffer_update_fill_hwm(struct lib_ring_buffer *buf,
+				     struct channel *chan,
+				     unsigned long begin)
+{
+	unsigned long fill, hwm;
+
+	fill = subbuf_trunc(begin, chan)
+		- subbuf_trunc((unsigned long) atomic_long_read(&buf->consumed),
+			       chan)
+		+ chan->backend.subbuf_size;
+	fill = min(fill, chan->backend.buf_size);
+	hwm = atomic_long_read(&buf->fill_hwm);
+	while (fill > hwm) {
+		unsigned long old = atomic_long_cmpxchg(&buf->fill_hwm, hwm,
+							fill);
+
+		if (old == hwm)
+			break;
+		hwm = old;
+	}
+}
+
+/**
+ * lib_ring_buffer_get_fill_hwm - Get and reset the fill high-water mark.
+ * @buf: ring buffer.
+ *
+ * Returns the largest number of bytes of the buffer written and not
+ * consumed, in sub-buffer units, since the previous call.
+ */
+unsigned long lib_ring_buffer_get_fill_hwm(struct lib_ring_buffer *buf)
+{
+	return atomic_long_xchg(&buf->fill_hwm, 0);
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_get_fill_hwm);
+
+/**
+ * lib_ring_buffer_set_fill_threshold - Set the poll priority fill level.
+ * @buf: ring buffer.
+ * @threshold: fill level in bytes, 0 for a full buffer.
+ *
+ * Poll reports POLLPRI once the data written and not consumed reaches
+ * @threshold, letting the reader react before records are lost.
+ */
+int lib_ring_buffer_set_fill_threshold(struct lib_ring_buffer *buf,
+				       unsigned long threshold)
+{
+	struct channel *chan = buf->backend.chan;
+
+	if (threshold > chan->backend.buf_size)
+		return -EINVAL;
+	WRITE_ONCE(buf->fill_threshold, threshold);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_set_fill_threshold);
+
+/**
+ * channel_set_critical_reserve - Keep space for critical records.
+ * @chan: channel.
+ * @pct: reserved part of the last free sub-buffer, in percent, 0 for none.
+ *
+ * In discard mode, records not flagged critical in their context are
+ * dropped rather than written into the last @pct percent of the last
+ * sub-buffer free for writing, so critical records are still recorded
+ * while the reader lags behind. The reserve follows channel_resize().
+ */
+int channel_set_critical_reserve(struct channel *chan, unsigned int pct)
+{
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+
+	if (config->mode != RING_BUFFER_DISCARD)
+		return -EINVAL;
+	if (pct > 100)
+		return -EINVAL;
+	chan->critical_reserve_pct = pct;
+	WRITE_ONCE(chan->critical_reserve,
+		   chan->backend.subbuf_size * pct / 100);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(channel_set_critical_reserve);
+
+/**
+ * channel_set_writer_barrier - Order commits on the writer side.
+ * @chan: channel.
+ * @enable: 1 for writer barriers, 0 for reader IPIs.
+ *
+ * With RING_BUFFER_IPI_BARRIER, writers only order their commits with
+ * a compiler barrier, upgraded by an IPI sent by the reader for each
+ * snapshot. With writer barriers, writers issue a write barrier on each
+ * commit instead, so that consumers reading often do not interrupt the
+ * traced cpus. Writers must be stopped, and all of their records
+ * committed, e.g. after a grace period.
+ */
+int channel_set_writer_barrier(struct channel *chan, int enable)
+{
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+
+	/* Writers always order their commits otherwise. */
+	if (config->ipi != RING_BUFFER_IPI_BARRIER)
+		return 0;
+	WRITE_ONCE(chan->writer_barrier, !!enable);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(channel_set_writer_barrier);
+
+/**
+ * channel_set_blocking_timeout - Wait for the reader rather than discard.
+ * @chan: channel.
+ * @timeout_us: longest wait of a reservation, in usecs, 0 to discard.
+ *
+ * In discard mode, writers running in task context wait for the reader
+ * to consume a sub-buffer for up to @timeout_us when the buffer is full,
+ * before dropping the record. Writers cannot sleep within the tracing
+ * fast path, so they spin with preemption disabled: the timeout is
+ * bounded by RING_BUFFER_MAX_BLOCKING_TIMEOUT. Writers in interrupt
+ * context keep dropping records.
+ */
+int channel_set_blocking_timeout(struct channel *chan, unsigned int timeout_us)
+{
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+
+	if (config->mode != RING_BUFFER_DISCARD)
+		return -EINVAL;
+	if (timeout_us > RING_BUFFER_MAX_BLOCKING_TIMEOUT)
+		return -EINVAL;
+	WRITE_ONCE(chan->blocking_timeout, timeout_us);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(channel_set_blocking_timeout);
+
+/**
+ * channel_set_live_latency - Deliver records within a deadline.
+ * @chan: channel.
+ * @latency_us: delivery deadline of the records, in usecs, 0 to flush
+ *              every switch timer interval.
+ *
+ * The switch timer then runs every half deadline, and only flushes the
+ * buffers holding records which would otherwise miss it. The switch
+ * timer interval becomes the longest time an idle buffer goes without
+ * delivering a packet. Takes effect at the next switch timer expiry.
+ */
+int channel_set_live_latency(struct channel *chan, unsigned int latency_us)
+{
+	if (!chan->switch_timer_interval)
+		return -EINVAL;
+	WRITE_ONCE(chan->live_latency, usecs_to_jiffies(latency_us));
+	return 0;
+}
+EXPORT_SYMBOL_GPL(channel_set_live_latency);
+
 static struct lib_ring_buffer *get_current_buf(struct channel *chan, int cpu)
 {
 	const struct lib_ring_buffer_config *config = &chan->backend.config;
@@ -2081,6 +3627,35 @@ void lib_ring_buffer_lost_event_too_big(struct channel *chan)
 }
 EXPORT_SYMBOL_GPL(lib_ring_buffer_lost_event_too_big);
 
+/*
+ * Wait until the reader frees the sub-buffer following the write
+ * position, for at most the channel blocking timeout over the whole
+ * reservation, tracked in usecs by "waited". Returns whether the
+ * reservation should be retried.
+ */
+static
+bool lib_ring_buffer_wait_reader(struct lib_ring_buffer *buf,
+				 struct channel *chan, unsigned int *waited)
+{
+	unsigned int timeout = READ_ONCE(chan->blocking_timeout);
+
+	if (likely(!timeout) || in_interrupt())
+		return false;
+	while (*waited < timeout) {
+		if (READ_ONCE(buf->finalized)
+		    || atomic_read(&chan->record_disabled)
+		    || atomic_read(&buf->record_disabled))
+			return false;
+		if (subbuf_align(v_read(&chan->backend.config, &buf->offset), chan)
+		    - subbuf_trunc(lib_ring_buffer_reclaim_pos(buf), chan)
+		    < chan->backend.buf_size)
+			return true;
+		udelay(1);
+		(*waited)++;
+	}
+	return false;
+}
+
 /**
  * lib_ring_buffer_reserve_slow - Atomic slot reservation in a buffer.
  * @ctx: ring buffer context.
@@ -2096,19 +3671,30 @@ int lib_ring_buffer_reserve_slow(struct lib_ring_buffer_ctx *ctx,
 	const struct lib_ring_buffer_config *config = &chan->backend.config;
 	struct lib_ring_buffer *buf;
 	struct switch_offsets offsets;
+	unsigned int waited = 0;
 	int ret;
 
 	ctx->buf = buf = get_current_buf(chan, ctx->cpu);
 	offsets.size = 0;
+	v_inc(config, &buf->reserve_slow);
 
-	do {
+	for (;;) {
 		ret = lib_ring_buffer_try_reserve_slow(buf, chan, &offsets,
 						       ctx, client_ctx);
+		if (unlikely(ret == -ENOBUFS)) {
+			if (config->mode == RING_BUFFER_DISCARD
+			    && lib_ring_buffer_wait_reader(buf, chan, &waited))
+				continue;
+			v_inc(config, &buf->records_lost_full);
+			return ret;
+		}
 		if (unlikely(ret))
 			return ret;
-	} while (unlikely(v_cmpxchg(config, &buf->offset, offsets.old,
-				    offsets.end)
-			  != offsets.old));
+		if (likely(v_cmpxchg(config, &buf->offset, offsets.old,
+				     offsets.end) == offsets.old))
+			break;
+		v_inc(config, &buf->reserve_retries);
+	}
 
 	/*
 	 * Atomically update last_tsc. This update races against concurrent
@@ -2141,8 +3727,10 @@ int lib_ring_buffer_reserve_slow(struct lib_ring_buffer_ctx *ctx,
 	/*
 	 * Populate new subbuffer.
 	 */
-	if (unlikely(offsets.switch_new_start))
+	if (unlikely(offsets.switch_new_start)) {
 		lib_ring_buffer_switch_new_start(buf, chan, &offsets, ctx->tsc);
+		lib_ring_buffer_update_fill_hwm(buf, chan, offsets.begin);
+	}
 
 	if (unlikely(offsets.switch_new_end))
 		lib_ring_buffer_switch_new_end(buf, chan, &offsets, ctx->tsc);
@@ -2262,6 +3850,7 @@ void lib_ring_buffer_check_deliver_slow(const struct lib_ring_buffer_config *con
 		 */
 		lib_ring_buffer_set_noref_offset(config, &buf->backend, idx,
 						 buf_trunc_val(offset, chan));
+		lib_ring_buffer_ctrl_deliver(config, buf, chan, offset, idx);
 
 		/*
 		 * Order set_noref and record counter updates before the
@@ -2297,17 +3886,37 @@ EXPORT_SYMBOL_GPL(lib_ring_buffer_check_deliver_slow);
 
 int __init init_lib_ring_buffer_frontend(void)
 {
-	int cpu;
+	int cpu, ret;
+
+	for_each_possible_cpu(cpu) {
+		struct lib_ring_buffer_timer_base *base =
+			&per_cpu(ring_buffer_timer_base, cpu);
 
-	for_each_possible_cpu(cpu)
 		spin_lock_init(&per_cpu(ring_buffer_nohz_lock, cpu));
-	return 0;
+		spin_lock_init(&base->lock);
+		INIT_LIST_HEAD(&base->buffers);
+		lttng_timer_setup(&base->timer,
+				  lib_ring_buffer_timer_base_expire,
+				  LTTNG_TIMER_PINNED, base);
+		base->cpu = cpu;
+	}
+	ret = lib_ring_buffer_static_reserve_init();
+	if (ret)
+		return ret;
+	return lib_ring_buffer_crash_init();
 }
 
 module_init(init_lib_ring_buffer_frontend);
 
 void __exit exit_lib_ring_buffer_frontend(void)
 {
+	int cpu;
+
+	/* All channels are destroyed: the timer bases are empty. */
+	for_each_possible_cpu(cpu)
+		del_timer_sync(&per_cpu(ring_buffer_timer_base, cpu).timer);
+	lib_ring_buffer_crash_exit();
+	lib_ring_buffer_static_reserve_exit();
 }
 
 module_exit(exit_lib_ring_buffer_frontend);
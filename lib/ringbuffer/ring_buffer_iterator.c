@@ -3,8 +3,9 @@
  * ring_buffer_iterator.c
  *
  * Ring buffer and channel iterators. Get each event of a channel in order. Uses
- * a prio heap for per-cpu buffers, giving a O(log(NR_CPUS)) algorithmic
- * complexity for the "get next event" operation.
+ * a tree of losers for per-cpu buffers, giving a O(log(NR_CPUS)) algorithmic
+ * complexity for the "get next event" operation, and O(1) while consecutive
+ * events come from the same buffer.
  *
  * Copyright (C) 2010-2012 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
  */
@@ -13,6 +14,7 @@
 #include <wrapper/file.h>
 #include <linux/jiffies.h>
 #include <linux/delay.h>
+#include <linux/gfp.h>
 #include <linux/module.h>
 
 /*
@@ -104,21 +106,13 @@ restart:
 }
 EXPORT_SYMBOL_GPL(lib_ring_buffer_get_next_record);
 
-static int buf_is_higher(void *a, void *b)
-{
-	struct lib_ring_buffer *bufa = a;
-	struct lib_ring_buffer *bufb = b;
-
-	/* Consider lowest timestamps to be at the top of the heap */
-	return (bufa->iter.timestamp < bufb->iter.timestamp);
-}
-
 static
 void lib_ring_buffer_get_empty_buf_records(const struct lib_ring_buffer_config *config,
 					   struct channel *chan)
 {
-	struct lttng_ptr_heap *heap = &chan->iter.heap;
+	struct lttng_loser_tree *tree = &chan->iter.tree;
 	struct lib_ring_buffer *buf, *tmp;
+	bool inserted = false;
 	ssize_t len;
 
 	list_for_each_entry_safe(buf, tmp, &chan->iter.empty_head,
@@ -147,14 +141,19 @@ void lib_ring_buffer_get_empty_buf_records(const struct lib_ring_buffer_config *
 			break;
 		default:
 			/*
-			 * Insert buffer into the heap, remove from empty buffer
+			 * Insert buffer into the tree, remove from empty buffer
 			 * list.
 			 */
 			CHAN_WARN_ON(chan, len < 0);
 			list_del(&buf->iter.empty_node);
-			CHAN_WARN_ON(chan, lttng_heap_insert(heap, buf));
+			lttng_loser_tree_set(tree, buf->backend.cpu, buf,
+					     buf->iter.timestamp);
+			inserted = true;
 		}
 	}
+	/* Play the matches once for all the inserted buffers. */
+	if (inserted)
+		lttng_loser_tree_build(tree);
 }
 
 static
@@ -174,7 +173,7 @@ void lib_ring_buffer_wait_for_qs(const struct lib_ring_buffer_config *config,
 	/*
 	 * We need to consider previously empty buffers.
 	 * Do a get next buf record on each of them. Add them to
-	 * the heap if they have data. If at least one of them
+	 * the tree if they have data. If at least one of them
 	 * don't have data, we need to wait for
 	 * switch_timer_interval + MAX_SYSTEM_LATENCY (so we are sure the
 	 * buffers have been switched either by the timer or idle entry) and
@@ -224,7 +223,7 @@ ssize_t channel_get_next_record(struct channel *chan,
 {
 	const struct lib_ring_buffer_config *config = &chan->backend.config;
 	struct lib_ring_buffer *buf;
-	struct lttng_ptr_heap *heap;
+	struct lttng_loser_tree *tree;
 	ssize_t len;
 
 	if (config->alloc == RING_BUFFER_ALLOC_GLOBAL) {
@@ -232,12 +231,12 @@ ssize_t channel_get_next_record(struct channel *chan,
 		return lib_ring_buffer_get_next_record(chan, *ret_buf);
 	}
 
-	heap = &chan->iter.heap;
+	tree = &chan->iter.tree;
 
 	/*
-	 * get next record for topmost buffer.
+	 * get next record for the buffer with the lowest timestamp.
 	 */
-	buf = lttng_heap_maximum(heap);
+	buf = lttng_loser_tree_winner(tree);
 	if (buf) {
 		len = lib_ring_buffer_get_next_record(chan, buf);
 		/*
@@ -248,43 +247,43 @@ ssize_t channel_get_next_record(struct channel *chan,
 		case -EAGAIN:
 			buf->iter.timestamp = 0;
 			list_add(&buf->iter.empty_node, &chan->iter.empty_head);
-			/* Remove topmost buffer from the heap */
-			CHAN_WARN_ON(chan, lttng_heap_remove(heap) != buf);
+			/* Remove winning buffer from the tree */
+			CHAN_WARN_ON(chan, lttng_loser_tree_remove_winner(tree) != buf);
 			break;
 		case -ENODATA:
 			/*
-			 * Buffer is finalized. Remove buffer from heap and
+			 * Buffer is finalized. Remove buffer from tree and
 			 * don't add to list of empty buffer, because it has no
 			 * more data to provide, ever.
 			 */
-			CHAN_WARN_ON(chan, lttng_heap_remove(heap) != buf);
+			CHAN_WARN_ON(chan, lttng_loser_tree_remove_winner(tree) != buf);
 			break;
 		case -EBUSY:
 			CHAN_WARN_ON(chan, 1);
 			break;
 		default:
 			/*
-			 * Reinsert buffer into the heap. Note that heap can be
-			 * partially empty, so we need to use
-			 * lttng_heap_replace_max().
+			 * Update the buffer timestamp in the tree. The matches
+			 * are only replayed once the timestamp goes past the
+			 * lowest timestamp of the other buffers.
 			 */
 			CHAN_WARN_ON(chan, len < 0);
-			CHAN_WARN_ON(chan, lttng_heap_replace_max(heap, buf) != buf);
+			lttng_loser_tree_update_winner(tree, buf->iter.timestamp);
 			break;
 		}
 	}
 
-	buf = lttng_heap_maximum(heap);
+	buf = lttng_loser_tree_winner(tree);
 	if (!buf || buf->iter.timestamp > chan->iter.last_qs) {
 		/*
 		 * Deal with buffers previously showing no data.
-		 * Add buffers containing data to the heap, update
+		 * Add buffers containing data to the tree, update
 		 * last_qs.
 		 */
 		lib_ring_buffer_wait_for_qs(config, chan);
 	}
 
-	*ret_buf = buf = lttng_heap_maximum(heap);
+	*ret_buf = buf = lttng_loser_tree_winner(tree);
 	if (buf) {
 		/*
 		 * If this warning triggers, you probably need to check your
@@ -308,7 +307,7 @@ ssize_t channel_get_next_record(struct channel *chan,
 		chan->iter.last_cpu = buf->backend.cpu;
 		return buf->iter.payload_len;
 	} else {
-		/* Heap is empty */
+		/* Tree is empty */
 		if (list_empty(&chan->iter.empty_head))
 			return -ENODATA;	/* All buffers finalized */
 		else
@@ -320,7 +319,8 @@ EXPORT_SYMBOL_GPL(channel_get_next_record);
 static
 void lib_ring_buffer_iterator_init(struct channel *chan, struct lib_ring_buffer *buf)
 {
-	if (buf->iter.allocated)
+	/* Buffers lazily allocated later on are not iterated. */
+	if (buf->iter.allocated || !buf->backend.allocated)
 		return;
 
 	buf->iter.allocated = 1;
@@ -394,9 +394,8 @@ int channel_iterator_init(struct channel *chan)
 		int ret;
 
 		INIT_LIST_HEAD(&chan->iter.empty_head);
-		ret = lttng_heap_init(&chan->iter.heap,
-				num_possible_cpus(),
-				GFP_KERNEL, buf_is_higher);
+		ret = lttng_loser_tree_init(&chan->iter.tree, nr_cpu_ids,
+				GFP_KERNEL);
 		if (ret)
 			return ret;
 
@@ -468,7 +467,7 @@ void channel_iterator_free(struct channel *chan)
 	const struct lib_ring_buffer_config *config = &chan->backend.config;
 
 	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
-		lttng_heap_free(&chan->iter.heap);
+		lttng_loser_tree_free(&chan->iter.tree);
 }
 
 int lib_ring_buffer_iterator_open(struct lib_ring_buffer *buf)
@@ -555,9 +554,13 @@ void lib_ring_buffer_iterator_reset(struct lib_ring_buffer *buf)
 	if (buf->iter.state != ITER_GET_SUBBUF)
 		lib_ring_buffer_put_next_subbuf(buf);
 	buf->iter.state = ITER_GET_SUBBUF;
-	/* Remove from heap (if present). */
-	if (lttng_heap_cherrypick(&chan->iter.heap, buf))
+	/* Remove from tree (if present). */
+	if (lttng_loser_tree_get(&chan->iter.tree, buf->backend.cpu)) {
+		lttng_loser_tree_set(&chan->iter.tree, buf->backend.cpu,
+				     NULL, 0);
+		lttng_loser_tree_build(&chan->iter.tree);
 		list_add(&buf->iter.empty_node, &chan->iter.empty_head);
+	}
 	buf->iter.timestamp = 0;
 	buf->iter.header_len = 0;
 	buf->iter.payload_len = 0;
@@ -573,9 +576,11 @@ void channel_iterator_reset(struct channel *chan)
 	struct lib_ring_buffer *buf;
 	int cpu;
 
-	/* Empty heap, put into empty_head */
-	while ((buf = lttng_heap_remove(&chan->iter.heap)) != NULL)
-		list_add(&buf->iter.empty_node, &chan->iter.empty_head);
+	/* Empty tree, put into empty_head */
+	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU) {
+		while ((buf = lttng_loser_tree_remove_winner(&chan->iter.tree)))
+			list_add(&buf->iter.empty_node, &chan->iter.empty_head);
+	}
 
 	for_each_channel_cpu(cpu, chan) {
 		buf = channel_get_ring_buffer(config, chan, cpu);
@@ -588,8 +593,27 @@ void channel_iterator_reset(struct channel *chan)
 	chan->iter.len_left = 0;
 }
 
+/*
+ * Copy the staged record payloads to userspace, ending at read_count.
+ */
+static
+int stage_flush(char __user *user_buf, size_t read_count,
+		const char *stage, size_t *staged)
+{
+	if (*staged && __copy_to_user(&user_buf[read_count - *staged],
+				      stage, *staged))
+		return -EFAULT;
+	*staged = 0;
+	return 0;
+}
+
 /*
  * Ring buffer payload extraction read() implementation.
+ *
+ * Record payloads are separated by their headers in the buffer. They are
+ * gathered into a staging page while their sub-buffer is held, and
+ * copied to userspace a page at a time rather than record by record.
+ * Payloads larger than the staging page are copied directly.
  */
 static
 ssize_t channel_ring_buffer_file_read(struct file *filp,
@@ -601,12 +625,16 @@ ssize_t channel_ring_buffer_file_read(struct file *filp,
 				      int fusionmerge)
 {
 	const struct lib_ring_buffer_config *config = &chan->backend.config;
-	size_t read_count = 0, read_offset;
+	size_t read_count = 0, read_offset, staged = 0;
+	char *stage;
 	ssize_t len;
 
 	might_sleep();
 	if (!access_ok(VERIFY_WRITE, user_buf, count))
 		return -EFAULT;
+	stage = (char *) __get_free_page(GFP_KERNEL);
+	if (!stage)
+		return -ENOMEM;
 
 	/* Finish copy of previous record */
 	if (*ppos != 0) {
@@ -615,7 +643,7 @@ ssize_t channel_ring_buffer_file_read(struct file *filp,
 			read_offset = *ppos;
 			if (config->alloc == RING_BUFFER_ALLOC_PER_CPU
 			    && fusionmerge)
-				buf = lttng_heap_maximum(&chan->iter.heap);
+				buf = lttng_loser_tree_winner(&chan->iter.tree);
 			CHAN_WARN_ON(chan, !buf);
 			goto skip_get_next;
 		}
@@ -685,23 +713,42 @@ skip_get_next:
 			chan->iter.len_left = len - copy_len;
 			*ppos = read_offset + copy_len;
 		}
-		if (__lib_ring_buffer_copy_to_user(&buf->backend, read_offset,
-					       &user_buf[read_count],
-					       copy_len)) {
-			/*
-			 * Leave the len_left and ppos values at their current
-			 * state, as we currently have a valid event to read.
-			 */
-			return -EFAULT;
+		if (copy_len > PAGE_SIZE - staged) {
+			if (stage_flush(user_buf, read_count, stage, &staged))
+				goto fault;
+		}
+		if (copy_len <= PAGE_SIZE) {
+			lib_ring_buffer_read(&buf->backend, read_offset,
+					     stage + staged, copy_len);
+			staged += copy_len;
+		} else if (__lib_ring_buffer_copy_to_user(&buf->backend,
+					read_offset, &user_buf[read_count],
+					copy_len)) {
+			goto fault;
 		}
 		read_count += copy_len;
 	};
+	if (stage_flush(user_buf, read_count, stage, &staged))
+		goto fault;
+	free_page((unsigned long) stage);
 	return read_count;
 
 nodata:
 	*ppos = 0;
 	chan->iter.len_left = 0;
+	if (stage_flush(user_buf, read_count, stage, &staged))
+		goto fault;
+	free_page((unsigned long) stage);
 	return read_count;
+
+fault:
+	/*
+	 * Leave the len_left and ppos values at their current state, as we
+	 * currently have a valid event to read. The staged payloads of the
+	 * previous records are lost.
+	 */
+	free_page((unsigned long) stage);
+	return -EFAULT;
 }
 
 /**
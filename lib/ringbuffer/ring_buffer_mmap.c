@@ -12,45 +12,106 @@
 
 #include <linux/module.h>
 #include <linux/mm.h>
+#include <linux/vmalloc.h>
 
 #include <wrapper/ringbuffer/backend.h>
 #include <wrapper/ringbuffer/frontend.h>
 #include <wrapper/ringbuffer/vfs.h>
 
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,10,0))
+static unsigned long lib_ring_buffer_fault_address(struct vm_fault *vmf)
+{
+	return vmf->address;
+}
+#else /* #if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,10,0)) */
+static unsigned long lib_ring_buffer_fault_address(struct vm_fault *vmf)
+{
+	return (unsigned long) vmf->virtual_address;
+}
+#endif /* #else #if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,10,0)) */
+
 /*
- * fault() vm_op implementation for ring buffer file mapping.
+ * Map all the pages of the reader sub-buffer, so that a consumer reading
+ * it takes a single fault rather than one per page. Pages already mapped
+ * by a previous use of the sub-buffer are skipped.
  */
-static int lib_ring_buffer_fault_compat(struct vm_area_struct *vma, struct vm_fault *vmf)
+static int lib_ring_buffer_fault_subbuf(struct vm_area_struct *vma,
+		struct vm_fault *vmf, struct lib_ring_buffer *buf,
+		struct lib_ring_buffer_backend_pages *rpages,
+		unsigned long offset)
+{
+	unsigned long addr, j;
+	int ret;
+
+	addr = (lib_ring_buffer_fault_address(vmf) & PAGE_MASK)
+		- (offset - rpages->mmap_offset);
+	for (j = 0; j < buf->backend.num_pages_per_subbuf; j++, addr += PAGE_SIZE) {
+		if (!rpages->p[j].pfn)
+			return VM_FAULT_SIGBUS;
+		ret = vm_insert_page(vma, addr, pfn_to_page(rpages->p[j].pfn));
+		switch (ret) {
+		case 0:
+		case -EBUSY:	/* Already mapped */
+		case -EFAULT:	/* Outside of the vma */
+			break;
+		case -ENOMEM:
+			return VM_FAULT_OOM;
+		default:
+			return VM_FAULT_SIGBUS;
+		}
+	}
+	return VM_FAULT_NOPAGE;
+}
+
+/*
+ * Fault on the page at @offset of the mapping of @buf. @in_place allows
+ * any sub-buffer of a discard mode buffer to be mapped.
+ */
+static int lib_ring_buffer_fault_buf(struct vm_area_struct *vma,
+		struct vm_fault *vmf, struct lib_ring_buffer *buf,
+		unsigned long offset, bool in_place)
 {
-	struct lib_ring_buffer *buf = vma->vm_private_data;
 	struct channel *chan = buf->backend.chan;
 	const struct lib_ring_buffer_config *config = &chan->backend.config;
-	pgoff_t pgoff = vmf->pgoff;
-	unsigned long *pfnp;
-	void **virt;
-	unsigned long offset, sb_bindex;
+	unsigned long sb_bindex;
 
+	/*
+	 * In discard mode, sub-buffers are not exchanged with the writers:
+	 * ready packets can be read in place.
+	 */
+	if (config->mode == RING_BUFFER_DISCARD && in_place) {
+		if (offset >= chan->backend.buf_size)
+			return VM_FAULT_SIGBUS;
+		sb_bindex = offset >> chan->backend.subbuf_size_order;
+		return lib_ring_buffer_fault_subbuf(vma, vmf, buf,
+				buf->backend.array[sb_bindex], offset);
+	}
 	/*
 	 * Verify that faults are only done on the range of pages owned by the
 	 * reader.
 	 */
-	offset = pgoff << PAGE_SHIFT;
 	sb_bindex = subbuffer_id_get_index(config, buf->backend.buf_rsb.id);
 	if (!(offset >= buf->backend.array[sb_bindex]->mmap_offset
 	      && offset < buf->backend.array[sb_bindex]->mmap_offset +
 			  buf->backend.chan->backend.subbuf_size))
 		return VM_FAULT_SIGBUS;
+	return lib_ring_buffer_fault_subbuf(vma, vmf, buf,
+			buf->backend.array[sb_bindex], offset);
+}
+
+/*
+ * fault() vm_op implementation for ring buffer file mapping.
+ */
+static int lib_ring_buffer_fault_compat(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+	struct lib_ring_buffer *buf = vma->vm_private_data;
+
 	/*
-	 * ring_buffer_read_get_pfn() gets the page frame number for the
-	 * current reader's pages.
+	 * Ready packets are read in place through the control area, and by
+	 * the secondary reader.
 	 */
-	pfnp = lib_ring_buffer_read_get_pfn(&buf->backend, offset, &virt);
-	if (!*pfnp)
-		return VM_FAULT_SIGBUS;
-	get_page(pfn_to_page(*pfnp));
-	vmf->page = pfn_to_page(*pfnp);
-
-	return 0;
+	return lib_ring_buffer_fault_buf(vma, vmf, buf, vmf->pgoff << PAGE_SHIFT,
+			buf->ctrl || atomic_long_read(&buf->secondary_readers));
 }
 
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,11,0))
@@ -73,6 +134,18 @@ static const struct vm_operations_struct lib_ring_buffer_mmap_ops = {
 	.fault = lib_ring_buffer_fault,
 };
 
+/*
+ * Length of the mapping of each buffer of @chan, without its control area.
+ */
+static unsigned long lib_ring_buffer_mmap_buf_len(struct channel *chan)
+{
+	unsigned long mmap_buf_len = chan->backend.buf_size;
+
+	if (chan->backend.extra_reader_sb)
+		mmap_buf_len += chan->backend.subbuf_size;
+	return mmap_buf_len;
+}
+
 /**
  *	lib_ring_buffer_mmap_buf: - mmap channel buffer to process address space
  *	@buf: ring buffer to map
@@ -93,15 +166,24 @@ static int lib_ring_buffer_mmap_buf(struct lib_ring_buffer *buf,
 	if (config->output != RING_BUFFER_MMAP)
 		return -EINVAL;
 
-	mmap_buf_len = chan->backend.buf_size;
-	if (chan->backend.extra_reader_sb)
-		mmap_buf_len += chan->backend.subbuf_size;
+	mmap_buf_len = lib_ring_buffer_mmap_buf_len(chan);
+
+	/* The control area follows the sub-buffers, see vfs.h. */
+	if (buf->ctrl && vma->vm_pgoff == (mmap_buf_len >> PAGE_SHIFT)) {
+		if (length > lib_ring_buffer_ctrl_len(buf))
+			return -EINVAL;
+		if (vma->vm_flags & VM_WRITE)
+			return -EPERM;
+		vma->vm_flags &= ~VM_MAYWRITE;
+		return remap_vmalloc_range(vma, buf->ctrl, 0);
+	}
 
 	if (length != mmap_buf_len)
 		return -EINVAL;
 
 	vma->vm_ops = &lib_ring_buffer_mmap_ops;
-	vma->vm_flags |= VM_DONTEXPAND;
+	/* VM_MIXEDMAP: pages are inserted with vm_insert_page() on fault. */
+	vma->vm_flags |= VM_DONTEXPAND | VM_MIXEDMAP;
 	vma->vm_private_data = buf;
 
 	return 0;
@@ -127,3 +209,149 @@ int vfs_lib_ring_buffer_mmap(struct file *filp, struct vm_area_struct *vma)
 	return lib_ring_buffer_mmap(filp, vma, buf);
 }
 EXPORT_SYMBOL_GPL(vfs_lib_ring_buffer_mmap);
+
+/*
+ * Channel-wide mappings lay out the buffers of all the cpus one after the
+ * other, the buffer of each cpu being mapped as its stream file, without
+ * the control area. Sub-buffers of discard mode buffers can all be
+ * mapped; in overwrite mode, only the reader sub-buffer of each buffer
+ * can. Reading still follows the get/put protocol of each stream.
+ */
+static struct lib_ring_buffer *lib_ring_buffer_channel_mmap_buf(
+		struct channel *chan, unsigned long index)
+{
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+	struct lib_ring_buffer *buf;
+
+	if (config->alloc == RING_BUFFER_ALLOC_GLOBAL) {
+		if (index)
+			return NULL;
+		buf = chan->backend.buf;
+	} else {
+		if (index >= nr_cpu_ids || !cpu_possible(index))
+			return NULL;
+		buf = per_cpu_ptr(chan->backend.buf, index);
+	}
+	if (!buf->backend.allocated)
+		return NULL;
+	return buf;
+}
+
+static int lib_ring_buffer_channel_fault_compat(struct vm_area_struct *vma,
+		struct vm_fault *vmf)
+{
+	struct channel *chan = vma->vm_private_data;
+	unsigned long mmap_buf_len = lib_ring_buffer_mmap_buf_len(chan);
+	unsigned long offset = vmf->pgoff << PAGE_SHIFT;
+	unsigned long index = offset / mmap_buf_len;
+	struct lib_ring_buffer *buf;
+
+	buf = lib_ring_buffer_channel_mmap_buf(chan, index);
+	if (!buf)
+		return VM_FAULT_SIGBUS;
+	return lib_ring_buffer_fault_buf(vma, vmf, buf,
+			offset - index * mmap_buf_len, true);
+}
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,11,0))
+static int lib_ring_buffer_channel_fault(struct vm_fault *vmf)
+{
+	struct vm_area_struct *vma = vmf->vma;
+	return lib_ring_buffer_channel_fault_compat(vma, vmf);
+}
+#else /* #if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,11,0)) */
+static int lib_ring_buffer_channel_fault(struct vm_area_struct *vma,
+		struct vm_fault *vmf)
+{
+	return lib_ring_buffer_channel_fault_compat(vma, vmf);
+}
+#endif /* #else #if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,11,0)) */
+
+/* Channel-wide mappings keep the channel from being resized. */
+static void lib_ring_buffer_channel_vm_open(struct vm_area_struct *vma)
+{
+	struct channel *chan = vma->vm_private_data;
+
+	atomic_inc(&chan->mmap_count);
+}
+
+static void lib_ring_buffer_channel_vm_close(struct vm_area_struct *vma)
+{
+	struct channel *chan = vma->vm_private_data;
+
+	atomic_dec(&chan->mmap_count);
+}
+
+static const struct vm_operations_struct lib_ring_buffer_channel_mmap_ops = {
+	.open = lib_ring_buffer_channel_vm_open,
+	.close = lib_ring_buffer_channel_vm_close,
+	.fault = lib_ring_buffer_channel_fault,
+};
+
+/**
+ *	lib_ring_buffer_channel_mmap_len - length of each buffer mapping
+ *	@chan: the channel
+ *
+ *	The buffer of cpu N starts at N times this length in the
+ *	channel-wide mappings.
+ */
+unsigned long lib_ring_buffer_channel_mmap_len(struct channel *chan)
+{
+	return lib_ring_buffer_mmap_buf_len(chan);
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_channel_mmap_len);
+
+/**
+ *	lib_ring_buffer_channel_mmap_offset - offset of a cpu buffer mapping
+ *	@chan: the channel
+ *	@cpu: the cpu of the buffer
+ *	@offset: receives the offset of the buffer in channel-wide mappings
+ *
+ *	Returns -ENODATA if the buffer of @cpu is not allocated.
+ */
+int lib_ring_buffer_channel_mmap_offset(struct channel *chan, int cpu,
+		unsigned long *offset)
+{
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+	unsigned long index = config->alloc == RING_BUFFER_ALLOC_GLOBAL ? 0 : cpu;
+
+	if (!lib_ring_buffer_channel_mmap_buf(chan, index))
+		return -ENODATA;
+	*offset = index * lib_ring_buffer_mmap_buf_len(chan);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_channel_mmap_offset);
+
+/**
+ *	lib_ring_buffer_channel_mmap - map the buffers of all cpus
+ *	@chan: the channel
+ *	@vma: vm_area_struct describing memory to be mapped
+ *
+ *	Returns 0 if ok, negative on error
+ *
+ *	Caller should already have grabbed mmap_sem.
+ */
+int lib_ring_buffer_channel_mmap(struct channel *chan,
+		struct vm_area_struct *vma)
+{
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+	unsigned long length = vma->vm_end - vma->vm_start;
+	unsigned long nr_pages, nr_buf;
+
+	if (config->output != RING_BUFFER_MMAP)
+		return -EINVAL;
+	nr_buf = config->alloc == RING_BUFFER_ALLOC_GLOBAL ? 1 : nr_cpu_ids;
+	nr_pages = nr_buf * (lib_ring_buffer_mmap_buf_len(chan) >> PAGE_SHIFT);
+	if (vma->vm_pgoff > nr_pages
+	    || (length >> PAGE_SHIFT) > nr_pages - vma->vm_pgoff)
+		return -EINVAL;
+
+	vma->vm_ops = &lib_ring_buffer_channel_mmap_ops;
+	/* VM_MIXEDMAP: pages are inserted with vm_insert_page() on fault. */
+	vma->vm_flags |= VM_DONTEXPAND | VM_MIXEDMAP;
+	vma->vm_private_data = chan;
+	lib_ring_buffer_channel_vm_open(vma);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_channel_mmap);
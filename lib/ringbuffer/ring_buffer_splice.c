@@ -34,12 +34,31 @@ EXPORT_SYMBOL_GPL(vfs_lib_ring_buffer_no_llseek);
 
 /*
  * Release pages from the buffer so splice pipe_to_file can move them.
- * Called after the pipe has been populated with buffer pages.
+ * Called after the pipe has been populated with buffer pages. The page is
+ * given back to the page pool of its buffer, referenced by the private
+ * field.
  */
 static void lib_ring_buffer_pipe_buf_release(struct pipe_inode_info *pipe,
 					     struct pipe_buffer *pbuf)
 {
-	__free_page(pbuf->page);
+	struct lib_ring_buffer_page_pool *pool =
+		(struct lib_ring_buffer_page_pool *) pbuf->private;
+
+	lib_ring_buffer_page_pool_put(pool, pbuf->page);
+	kref_put(&pool->ref, lib_ring_buffer_page_pool_release);
+}
+
+/*
+ * Duplicated pipe buffers (e.g. tee) also hold a reference on the pool.
+ */
+static void lib_ring_buffer_pipe_buf_get(struct pipe_inode_info *pipe,
+					 struct pipe_buffer *pbuf)
+{
+	struct lib_ring_buffer_page_pool *pool =
+		(struct lib_ring_buffer_page_pool *) pbuf->private;
+
+	generic_pipe_buf_get(pipe, pbuf);
+	kref_get(&pool->ref);
 }
 
 static const struct pipe_buf_operations ring_buffer_pipe_buf_ops = {
@@ -51,7 +70,7 @@ static const struct pipe_buf_operations ring_buffer_pipe_buf_ops = {
 	.confirm = generic_pipe_buf_confirm,
 	.release = lib_ring_buffer_pipe_buf_release,
 	.steal = generic_pipe_buf_steal,
-	.get = generic_pipe_buf_get,
+	.get = lib_ring_buffer_pipe_buf_get,
 };
 
 /*
@@ -60,7 +79,46 @@ static const struct pipe_buf_operations ring_buffer_pipe_buf_ops = {
 static void lib_ring_buffer_page_release(struct splice_pipe_desc *spd,
 					 unsigned int i)
 {
-	__free_page(spd->pages[i]);
+	struct lib_ring_buffer_page_pool *pool =
+		(struct lib_ring_buffer_page_pool *) spd->partial[i].private;
+
+	lib_ring_buffer_page_pool_put(pool, spd->pages[i]);
+	kref_put(&pool->ref, lib_ring_buffer_page_pool_release);
+}
+
+/*
+ * Add the buffer page at *pfnp to the pipe descriptor. We have to
+ * replace the page we are moving into the splice pipe. Pages of
+ * contiguously mapped sub-buffers stay in place: their content is copied
+ * into the pool page, which goes into the pipe instead. Returns false
+ * when the page pool is empty.
+ */
+static bool subbuf_splice_page(struct lib_ring_buffer *buf,
+			       struct splice_pipe_desc *spd,
+			       unsigned long *pfnp, void **virt,
+			       unsigned int poff, unsigned int len)
+{
+	const struct lib_ring_buffer_config *config =
+		&buf->backend.chan->backend.config;
+	struct page *new_page;
+
+	new_page = lib_ring_buffer_page_pool_get(buf->backend.page_pool);
+	if (!new_page)
+		return false;
+	if (config->backend == RING_BUFFER_VMAP) {
+		memcpy(page_address(new_page), *virt, PAGE_SIZE);
+		spd->pages[spd->nr_pages] = new_page;
+	} else {
+		spd->pages[spd->nr_pages] = pfn_to_page(*pfnp);
+		*pfnp = page_to_pfn(new_page);
+		*virt = page_address(new_page);
+	}
+	spd->partial[spd->nr_pages].offset = poff;
+	spd->partial[spd->nr_pages].len = len;
+	spd->partial[spd->nr_pages].private =
+		(unsigned long) buf->backend.page_pool;
+	kref_get(&buf->backend.page_pool->ref);
+	return true;
 }
 
 /*
@@ -115,8 +173,7 @@ static int subbuf_splice_actor(struct file *in,
 
 	for (; spd.nr_pages < nr_pages; spd.nr_pages++) {
 		unsigned int this_len;
-		unsigned long *pfnp, new_pfn;
-		struct page *new_page;
+		unsigned long *pfnp;
 		void **virt;
 
 		if (!len)
@@ -124,23 +181,10 @@ static int subbuf_splice_actor(struct file *in,
 		printk_dbg(KERN_DEBUG "SPLICE actor loop len %zu roffset %ld\n",
 			   len, roffset);
 
-		/*
-		 * We have to replace the page we are moving into the splice
-		 * pipe.
-		 */
-		new_page = alloc_pages_node(cpu_to_node(max(buf->backend.cpu,
-							    0)),
-					    GFP_KERNEL | __GFP_ZERO, 0);
-		if (!new_page)
-			break;
-		new_pfn = page_to_pfn(new_page);
 		this_len = PAGE_SIZE - poff;
 		pfnp = lib_ring_buffer_read_get_pfn(&buf->backend, roffset, &virt);
-		spd.pages[spd.nr_pages] = pfn_to_page(*pfnp);
-		*pfnp = new_pfn;
-		*virt = page_address(new_page);
-		spd.partial[spd.nr_pages].offset = poff;
-		spd.partial[spd.nr_pages].len = this_len;
+		if (!subbuf_splice_page(buf, &spd, pfnp, virt, poff, this_len))
+			break;
 
 		poff = 0;
 		roffset += PAGE_SIZE;
@@ -153,6 +197,87 @@ static int subbuf_splice_actor(struct file *in,
 	return wrapper_splice_to_pipe(pipe, &spd);
 }
 
+/*
+ * Size of a sub-buffer of the run held by the reader, padded to a page
+ * multiple as for a single sub-buffer.
+ */
+static unsigned long subbuf_run_padded_size(struct lib_ring_buffer *buf,
+					    unsigned long i,
+					    unsigned long *sb_bindex)
+{
+	struct channel *chan = buf->backend.chan;
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+	unsigned long pos;
+
+	pos = buf->get_subbuf_consumed + (i << chan->backend.subbuf_size_order);
+	*sb_bindex = subbuffer_id_get_index(config,
+			buf->backend.buf_wsb[subbuf_index(pos, chan)].id);
+	return PAGE_ALIGN(buf->backend.array[*sb_bindex]->data_size);
+}
+
+unsigned long lib_ring_buffer_get_run_padded_size(struct lib_ring_buffer *buf)
+{
+	unsigned long i, sb_bindex, size = 0;
+
+	for (i = 0; i < buf->get_subbuf_run; i++)
+		size += subbuf_run_padded_size(buf, i, &sb_bindex);
+	return size;
+}
+EXPORT_SYMBOL_GPL(lib_ring_buffer_get_run_padded_size);
+
+/*
+ *	subbuf_run_splice_actor - splice the run of subbuffers held by the
+ *	reader, each padded to a page multiple, from *ppos in the run
+ */
+static int subbuf_run_splice_actor(struct file *in,
+				   loff_t *ppos,
+				   struct pipe_inode_info *pipe,
+				   size_t len,
+				   unsigned int flags,
+				   struct lib_ring_buffer *buf)
+{
+	struct page *pages[PIPE_DEF_BUFFERS];
+	struct partial_page partial[PIPE_DEF_BUFFERS];
+	struct splice_pipe_desc spd = {
+		.pages = pages,
+		.nr_pages = 0,
+		.partial = partial,
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(4,12,0))
+		.flags = flags,
+#endif
+		.ops = &ring_buffer_pipe_buf_ops,
+		.spd_release = lib_ring_buffer_page_release,
+	};
+	unsigned long i, sb_bindex, start = 0, padded = 0, index;
+	struct lib_ring_buffer_backend_pages *rpages;
+
+	/* Find the sub-buffer holding *ppos. */
+	for (i = 0; i < buf->get_subbuf_run; i++) {
+		padded = subbuf_run_padded_size(buf, i, &sb_bindex);
+		if (*ppos < start + padded)
+			break;
+		start += padded;
+	}
+	if (i == buf->get_subbuf_run)
+		return 0;
+	rpages = buf->backend.array[sb_bindex];
+	/* Splice within this sub-buffer, the next call continues the run. */
+	len = min_t(size_t, len, start + padded - *ppos);
+	for (index = (*ppos - start) >> PAGE_SHIFT;
+	     spd.nr_pages < PIPE_DEF_BUFFERS && len;
+	     spd.nr_pages++, index++) {
+		if (!subbuf_splice_page(buf, &spd, &rpages->p[index].pfn,
+					&rpages->p[index].virt, 0, PAGE_SIZE))
+			break;
+		len -= PAGE_SIZE;
+	}
+
+	if (!spd.nr_pages)
+		return 0;
+
+	return wrapper_splice_to_pipe(pipe, &spd);
+}
+
 ssize_t lib_ring_buffer_splice_read(struct file *in, loff_t *ppos,
 				    struct pipe_inode_info *pipe, size_t len,
 				    unsigned int flags,
@@ -183,8 +308,17 @@ ssize_t lib_ring_buffer_splice_read(struct file *in, loff_t *ppos,
 
 	printk_dbg(KERN_DEBUG "SPLICE read len %zu pos %zd\n", len,
 		   (ssize_t)*ppos);
-	while (len && !spliced) {
-		ret = subbuf_splice_actor(in, ppos, pipe, len, flags, buf);
+	/*
+	 * A run of sub-buffers is spliced in one call, as long as the pipe
+	 * has room.
+	 */
+	while (len && (!spliced || buf->get_subbuf_run)) {
+		if (buf->get_subbuf_run)
+			ret = subbuf_run_splice_actor(in, ppos, pipe, len,
+						      flags, buf);
+		else
+			ret = subbuf_splice_actor(in, ppos, pipe, len, flags,
+						  buf);
 		printk_dbg(KERN_DEBUG "SPLICE read loop ret %d\n", ret);
 		if (ret < 0)
 			break;
@@ -108,6 +108,7 @@ unsigned int lib_ring_buffer_poll(struct file *filp, poll_table *wait,
 	if (filp->f_mode & FMODE_READ) {
 		poll_wait_set_exclusive(wait);
 		poll_wait(filp, &buf->read_wait, wait);
+		lib_ring_buffer_hp_flush(buf);
 
 		finalized = lib_ring_buffer_is_finalized(config, buf);
 		disabled = lib_ring_buffer_channel_is_disabled(chan);
@@ -138,11 +139,15 @@ retry:
 					return 0;
 			}
 		} else {
+			unsigned long threshold = READ_ONCE(buf->fill_threshold);
+
+			if (!threshold)
+				threshold = chan->backend.buf_size;
 			if (subbuf_trunc(lib_ring_buffer_get_offset(config, buf),
 					 chan)
 			  - subbuf_trunc(lib_ring_buffer_get_consumed(config, buf),
 					 chan)
-			  >= chan->backend.buf_size)
+			  >= threshold)
 				return POLLPRI | POLLRDBAND;
 			else
 				return POLLIN | POLLRDNORM;
@@ -178,6 +183,7 @@ long lib_ring_buffer_ioctl(struct file *filp, unsigned int cmd,
 
 	switch (cmd) {
 	case RING_BUFFER_SNAPSHOT:
+		lib_ring_buffer_hp_flush(buf);
 		return lib_ring_buffer_snapshot(buf, &buf->cons_snapshot,
 					    &buf->prod_snapshot);
 	case RING_BUFFER_SNAPSHOT_SAMPLE_POSITIONS:
@@ -227,6 +233,9 @@ long lib_ring_buffer_ioctl(struct file *filp, unsigned int cmd,
 	{
 		unsigned long size;
 
+		if (buf->get_subbuf_run)
+			return put_ulong(lib_ring_buffer_get_run_padded_size(buf),
+					 arg);
 		size = lib_ring_buffer_get_read_data_size(config, buf);
 		size = PAGE_ALIGN(size);
 		return put_ulong(size, arg);
@@ -263,6 +272,55 @@ long lib_ring_buffer_ioctl(struct file *filp, unsigned int cmd,
 	case RING_BUFFER_FLUSH_EMPTY:
 		lib_ring_buffer_switch_remote_empty(buf);
 		return 0;
+	case RING_BUFFER_GET_CTRL_LEN:
+		if (!buf->ctrl)
+			return -EINVAL;
+		return put_ulong(lib_ring_buffer_ctrl_len(buf), arg);
+	case RING_BUFFER_PUT_CONSUMED:
+	{
+		unsigned long uconsume;
+		long ret;
+
+		ret = get_user(uconsume, (unsigned long __user *) arg);
+		if (ret)
+			return ret; /* will return -EFAULT */
+		return lib_ring_buffer_put_consumed(buf, uconsume);
+	}
+	case RING_BUFFER_GET_FILL_HWM:
+		return put_ulong(lib_ring_buffer_get_fill_hwm(buf), arg);
+	case RING_BUFFER_SET_FILL_THRESHOLD:
+	{
+		unsigned long threshold;
+		long ret;
+
+		ret = get_user(threshold, (unsigned long __user *) arg);
+		if (ret)
+			return ret; /* will return -EFAULT */
+		return lib_ring_buffer_set_fill_threshold(buf, threshold);
+	}
+	case RING_BUFFER_GET_NEXT_SUBBUF_RUN:
+	{
+		unsigned long nr;
+		long ret;
+
+		if (config->output != RING_BUFFER_SPLICE)
+			return -EINVAL;
+		ret = get_user(nr, (unsigned long __user *) arg);
+		if (ret)
+			return ret; /* will return -EFAULT */
+		ret = lib_ring_buffer_get_next_subbuf_run(buf, &nr);
+		if (ret)
+			return ret;
+		/* Set file position to zero at each successful "get" */
+		filp->f_pos = 0;
+		ret = put_ulong(nr, arg);
+		if (ret)
+			lib_ring_buffer_put_subbuf(buf);
+		return ret;
+	}
+	case RING_BUFFER_PUT_NEXT_SUBBUF_RUN:
+		lib_ring_buffer_put_next_subbuf_run(buf);
+		return 0;
 	default:
 		return -ENOIOCTLCMD;
 	}
@@ -292,6 +350,19 @@ EXPORT_SYMBOL_GPL(lib_ring_buffer_ioctl);
  *      RING_BUFFER_GET_MMAP_READ_OFFSET
  *              returns the offset of the subbuffer belonging to the reader.
  *              Should only be used for mmap clients.
+ *	RING_BUFFER_GET_CTRL_LEN
+ *		returns the length of the control area, mapped after the
+ *		sub-buffers. Should only be used for mmap clients.
+ *	RING_BUFFER_PUT_CONSUMED
+ *		Release a sub-buffer read in place, in discard mode.
+ *	RING_BUFFER_GET_FILL_HWM
+ *		returns and resets the fill high-water mark, in bytes.
+ *	RING_BUFFER_SET_FILL_THRESHOLD
+ *		Set the fill level at which poll reports POLLPRI.
+ *	RING_BUFFER_GET_NEXT_SUBBUF_RUN
+ *		Get the run of ready sub-buffers to splice in one call.
+ *	RING_BUFFER_PUT_NEXT_SUBBUF_RUN
+ *		Release the run of sub-buffers.
  */
 static
 long vfs_lib_ring_buffer_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
@@ -313,6 +384,7 @@ long lib_ring_buffer_compat_ioctl(struct file *filp, unsigned int cmd,
 
 	switch (cmd) {
 	case RING_BUFFER_COMPAT_SNAPSHOT:
+		lib_ring_buffer_hp_flush(buf);
 		return lib_ring_buffer_snapshot(buf, &buf->cons_snapshot,
 						&buf->prod_snapshot);
 	case RING_BUFFER_COMPAT_SNAPSHOT_SAMPLE_POSITIONS:
@@ -372,8 +444,11 @@ long lib_ring_buffer_compat_ioctl(struct file *filp, unsigned int cmd,
 	{
 		unsigned long size;
 
-		size = lib_ring_buffer_get_read_data_size(config, buf);
-		size = PAGE_ALIGN(size);
+		if (buf->get_subbuf_run)
+			size = lib_ring_buffer_get_run_padded_size(buf);
+		else
+			size = PAGE_ALIGN(lib_ring_buffer_get_read_data_size(config,
+									     buf));
 		if (size > UINT_MAX)
 			return -EFBIG;
 		return compat_put_ulong(size, arg);
@@ -414,6 +489,61 @@ long lib_ring_buffer_compat_ioctl(struct file *filp, unsigned int cmd,
 	case RING_BUFFER_COMPAT_FLUSH_EMPTY:
 		lib_ring_buffer_switch_remote_empty(buf);
 		return 0;
+	case RING_BUFFER_COMPAT_GET_CTRL_LEN:
+		if (!buf->ctrl)
+			return -EINVAL;
+		return compat_put_ulong(lib_ring_buffer_ctrl_len(buf), arg);
+	case RING_BUFFER_COMPAT_PUT_CONSUMED:
+	{
+		__u32 uconsume;
+		unsigned long consume;
+		long ret;
+
+		ret = get_user(uconsume, (__u32 __user *) arg);
+		if (ret)
+			return ret; /* will return -EFAULT */
+		consume = atomic_long_read(&buf->consumed);
+		consume &= ~0xFFFFFFFFL;
+		consume |= uconsume;
+		return lib_ring_buffer_put_consumed(buf, consume);
+	}
+	case RING_BUFFER_COMPAT_GET_FILL_HWM:
+		return compat_put_ulong(lib_ring_buffer_get_fill_hwm(buf), arg);
+	case RING_BUFFER_COMPAT_SET_FILL_THRESHOLD:
+	{
+		__u32 threshold;
+		long ret;
+
+		ret = get_user(threshold, (__u32 __user *) arg);
+		if (ret)
+			return ret; /* will return -EFAULT */
+		return lib_ring_buffer_set_fill_threshold(buf, threshold);
+	}
+	case RING_BUFFER_COMPAT_GET_NEXT_SUBBUF_RUN:
+	{
+		__u32 unr;
+		unsigned long nr;
+		long ret;
+
+		if (config->output != RING_BUFFER_SPLICE)
+			return -EINVAL;
+		ret = get_user(unr, (__u32 __user *) arg);
+		if (ret)
+			return ret; /* will return -EFAULT */
+		nr = unr;
+		ret = lib_ring_buffer_get_next_subbuf_run(buf, &nr);
+		if (ret)
+			return ret;
+		/* Set file position to zero at each successful "get" */
+		filp->f_pos = 0;
+		ret = compat_put_ulong(nr, arg);
+		if (ret)
+			lib_ring_buffer_put_subbuf(buf);
+		return ret;
+	}
+	case RING_BUFFER_COMPAT_PUT_NEXT_SUBBUF_RUN:
+		lib_ring_buffer_put_next_subbuf_run(buf);
+		return 0;
 	default:
 		return -ENOIOCTLCMD;
 	}
@@ -430,6 +560,180 @@ long vfs_lib_ring_buffer_compat_ioctl(struct file *filp, unsigned int cmd,
 }
 #endif
 
+/*
+ * Secondary reader file operations. The secondary reader reads the
+ * sub-buffers in place through mmap, with RING_BUFFER_GET_NEXT_SUBBUF,
+ * RING_BUFFER_PUT_NEXT_SUBBUF and the sub-buffer size and mmap offset
+ * ioctls. The other ioctls belong to the primary reader.
+ */
+static
+int vfs_lib_ring_buffer_secondary_release(struct inode *inode,
+		struct file *file)
+{
+	struct lib_ring_buffer *buf = file->private_data;
+
+	lib_ring_buffer_release_read_secondary(buf);
+	return 0;
+}
+
+static
+unsigned int vfs_lib_ring_buffer_secondary_poll(struct file *filp,
+		poll_table *wait)
+{
+	struct lib_ring_buffer *buf = filp->private_data;
+	struct channel *chan = buf->backend.chan;
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+	int finalized;
+
+	if (!(filp->f_mode & FMODE_READ))
+		return 0;
+	/*
+	 * Not an exclusive wait: wake-ups of the primary reader must not
+	 * be taken by the secondary reader.
+	 */
+	poll_wait(filp, &buf->read_wait, wait);
+	finalized = lib_ring_buffer_is_finalized(config, buf);
+	if (lib_ring_buffer_channel_is_disabled(chan))
+		return POLLERR;
+	/*
+	 * lib_ring_buffer_is_finalized() contains a smp_rmb() ordering
+	 * finalized load before offsets loads.
+	 */
+	if (subbuf_trunc(lib_ring_buffer_get_offset(config, buf), chan)
+	    - subbuf_trunc(atomic_long_read(&buf->secondary_consumed), chan)
+	    == 0)
+		return finalized ? POLLHUP : 0;
+	return POLLIN | POLLRDNORM;
+}
+
+static
+long lib_ring_buffer_secondary_ioctl(struct file *filp, unsigned int cmd,
+		unsigned long arg, struct lib_ring_buffer *buf)
+{
+	struct channel *chan = buf->backend.chan;
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+
+	if (lib_ring_buffer_channel_is_disabled(chan))
+		return -EIO;
+
+	switch (cmd) {
+	case RING_BUFFER_GET_NEXT_SUBBUF:
+		return lib_ring_buffer_get_next_subbuf_secondary(buf);
+	case RING_BUFFER_PUT_NEXT_SUBBUF:
+		lib_ring_buffer_put_next_subbuf_secondary(buf);
+		return 0;
+	case RING_BUFFER_GET_SUBBUF_SIZE:
+	case RING_BUFFER_GET_PADDED_SUBBUF_SIZE:
+	{
+		unsigned long size;
+
+		if (!buf->secondary_get_subbuf)
+			return -EINVAL;
+		size = lib_ring_buffer_get_secondary_read_data_size(config, buf);
+		if (cmd == RING_BUFFER_GET_PADDED_SUBBUF_SIZE)
+			size = PAGE_ALIGN(size);
+		return put_ulong(size, arg);
+	}
+	case RING_BUFFER_GET_MAX_SUBBUF_SIZE:
+		return put_ulong(chan->backend.subbuf_size, arg);
+	case RING_BUFFER_GET_MMAP_LEN:
+		if (config->output != RING_BUFFER_MMAP)
+			return -EINVAL;
+		if (chan->backend.buf_size > INT_MAX)
+			return -EFBIG;
+		return put_ulong(chan->backend.buf_size, arg);
+	case RING_BUFFER_GET_MMAP_READ_OFFSET:
+		if (config->output != RING_BUFFER_MMAP
+		    || !buf->secondary_get_subbuf)
+			return -EINVAL;
+		return put_ulong(buf->backend.array[buf->secondary_sb_bindex]->mmap_offset,
+				 arg);
+	default:
+		return -ENOIOCTLCMD;
+	}
+}
+
+static
+long vfs_lib_ring_buffer_secondary_ioctl(struct file *filp, unsigned int cmd,
+		unsigned long arg)
+{
+	struct lib_ring_buffer *buf = filp->private_data;
+
+	return lib_ring_buffer_secondary_ioctl(filp, cmd, arg, buf);
+}
+
+#ifdef CONFIG_COMPAT
+static
+long vfs_lib_ring_buffer_secondary_compat_ioctl(struct file *filp,
+		unsigned int cmd, unsigned long arg)
+{
+	struct lib_ring_buffer *buf = filp->private_data;
+	struct channel *chan = buf->backend.chan;
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+
+	switch (cmd) {
+	case RING_BUFFER_COMPAT_GET_NEXT_SUBBUF:
+	case RING_BUFFER_COMPAT_PUT_NEXT_SUBBUF:
+		return lib_ring_buffer_secondary_ioctl(filp, cmd, arg, buf);
+	case RING_BUFFER_COMPAT_GET_SUBBUF_SIZE:
+	case RING_BUFFER_COMPAT_GET_PADDED_SUBBUF_SIZE:
+	{
+		unsigned long size;
+
+		if (lib_ring_buffer_channel_is_disabled(chan))
+			return -EIO;
+		if (!buf->secondary_get_subbuf)
+			return -EINVAL;
+		size = lib_ring_buffer_get_secondary_read_data_size(config, buf);
+		if (cmd == RING_BUFFER_COMPAT_GET_PADDED_SUBBUF_SIZE)
+			size = PAGE_ALIGN(size);
+		if (size > UINT_MAX)
+			return -EFBIG;
+		return compat_put_ulong(size, arg);
+	}
+	case RING_BUFFER_COMPAT_GET_MAX_SUBBUF_SIZE:
+		if (chan->backend.subbuf_size > UINT_MAX)
+			return -EFBIG;
+		return compat_put_ulong(chan->backend.subbuf_size, arg);
+	case RING_BUFFER_COMPAT_GET_MMAP_LEN:
+		if (config->output != RING_BUFFER_MMAP)
+			return -EINVAL;
+		if (chan->backend.buf_size > UINT_MAX)
+			return -EFBIG;
+		return compat_put_ulong(chan->backend.buf_size, arg);
+	case RING_BUFFER_COMPAT_GET_MMAP_READ_OFFSET:
+	{
+		unsigned long read_offset;
+
+		if (lib_ring_buffer_channel_is_disabled(chan))
+			return -EIO;
+		if (config->output != RING_BUFFER_MMAP
+		    || !buf->secondary_get_subbuf)
+			return -EINVAL;
+		read_offset = buf->backend.array[buf->secondary_sb_bindex]->mmap_offset;
+		if (read_offset > UINT_MAX)
+			return -EINVAL;
+		return compat_put_ulong(read_offset, arg);
+	}
+	default:
+		return -ENOIOCTLCMD;
+	}
+}
+#endif
+
+const struct file_operations lib_ring_buffer_secondary_file_operations = {
+	.owner = THIS_MODULE,
+	.release = vfs_lib_ring_buffer_secondary_release,
+	.poll = vfs_lib_ring_buffer_secondary_poll,
+	.mmap = vfs_lib_ring_buffer_mmap,
+	.unlocked_ioctl = vfs_lib_ring_buffer_secondary_ioctl,
+	.llseek = vfs_lib_ring_buffer_no_llseek,
+#ifdef CONFIG_COMPAT
+	.compat_ioctl = vfs_lib_ring_buffer_secondary_compat_ioctl,
+#endif
+};
+EXPORT_SYMBOL_GPL(lib_ring_buffer_secondary_file_operations);
+
 const struct file_operations lib_ring_buffer_file_operations = {
 	.owner = THIS_MODULE,
 	.open = vfs_lib_ring_buffer_open,
@@ -16,12 +16,15 @@
 /* VFS API */
 
 extern const struct file_operations lib_ring_buffer_file_operations;
+/* Secondary reader of a discard mode buffer, see lib_ring_buffer_open_read_secondary() */
+extern const struct file_operations lib_ring_buffer_secondary_file_operations;
 
 /*
  * Internal file operations.
  */
 
 struct lib_ring_buffer;
+struct channel;
 
 int lib_ring_buffer_open(struct inode *inode, struct file *file,
 		struct lib_ring_buffer *buf);
@@ -34,6 +37,11 @@ ssize_t lib_ring_buffer_splice_read(struct file *in, loff_t *ppos,
 		unsigned int flags, struct lib_ring_buffer *buf);
 int lib_ring_buffer_mmap(struct file *filp, struct vm_area_struct *vma,
 		struct lib_ring_buffer *buf);
+int lib_ring_buffer_channel_mmap(struct channel *chan,
+		struct vm_area_struct *vma);
+unsigned long lib_ring_buffer_channel_mmap_len(struct channel *chan);
+int lib_ring_buffer_channel_mmap_offset(struct channel *chan, int cpu,
+		unsigned long *offset);
 
 /* Ring Buffer ioctl() and ioctl numbers */
 long lib_ring_buffer_ioctl(struct file *filp, unsigned int cmd,
@@ -52,6 +60,44 @@ ssize_t vfs_lib_ring_buffer_splice_read(struct file *in, loff_t *ppos,
 		struct pipe_inode_info *pipe, size_t len,
 		unsigned int flags);
 
+/*
+ * Layout of the read-only control area of a RING_BUFFER_MMAP buffer,
+ * mapped from the stream file at the offset returned by
+ * RING_BUFFER_GET_MMAP_LEN, over the length returned by
+ * RING_BUFFER_GET_CTRL_LEN. It lets a consumer find the ready
+ * sub-buffers without system calls:
+ *
+ * - subbuf[i] describes the last packet delivered in sub-buffer i:
+ *   the packet at position "pos" is ready when
+ *   subbuf[(pos / subbuf_size) % num_subbuf].packet_begin == pos.
+ *   data_size and mmap_offset are valid for that packet if read after
+ *   packet_begin, with a read barrier in between. packet_begin is -1
+ *   until the first delivery,
+ * - consumed is the position moved by the reader.
+ *
+ * Positions are those of RING_BUFFER_GET_SUBBUF, zero-extended.
+ *
+ * In discard mode, a ready packet is not overwritten until it is
+ * consumed, so it can be read in place from the mapping at mmap_offset,
+ * and handed back with RING_BUFFER_PUT_CONSUMED. In overwrite mode, the
+ * packet must be taken with RING_BUFFER_GET_SUBBUF before reading it.
+ */
+#define LIB_RING_BUFFER_CTRL_VERSION	1
+
+struct lib_ring_buffer_ctrl_subbuf {
+	uint64_t packet_begin;	/* Position of the last packet delivered */
+	uint64_t data_size;	/* Packet size, with padding */
+	uint64_t mmap_offset;	/* Offset of the packet in the mapping */
+} __attribute__((packed));
+
+struct lib_ring_buffer_ctrl {
+	uint32_t version;	/* LIB_RING_BUFFER_CTRL_VERSION */
+	uint32_t num_subbuf;	/* Number of entries in subbuf[] */
+	uint64_t subbuf_size;
+	uint64_t consumed;
+	struct lib_ring_buffer_ctrl_subbuf subbuf[];
+} __attribute__((packed));
+
 /*
  * Use RING_BUFFER_GET_NEXT_SUBBUF / RING_BUFFER_PUT_NEXT_SUBBUF to read and
  * consume sub-buffers sequentially.
@@ -112,6 +158,32 @@ ssize_t vfs_lib_ring_buffer_splice_read(struct file *in, loff_t *ppos,
  * so it can be read again.
  */
 #define RING_BUFFER_METADATA_CACHE_DUMP		_IO(0xF6, 0x10)
+/* returns the length of the control area to mmap. */
+#define RING_BUFFER_GET_CTRL_LEN		_IOR(0xF6, 0x11, unsigned long)
+/*
+ * Discard mode only: move the consumer past the ready packet at the
+ * specified position, read in place through the control area.
+ */
+#define RING_BUFFER_PUT_CONSUMED		_IOW(0xF6, 0x12, unsigned long)
+/*
+ * returns the largest fill level of the buffer since the previous call,
+ * in bytes, and resets it.
+ */
+#define RING_BUFFER_GET_FILL_HWM		_IOR(0xF6, 0x13, unsigned long)
+/* poll reports POLLPRI at this fill level in bytes, 0 meaning full. */
+#define RING_BUFFER_SET_FILL_THRESHOLD		_IOW(0xF6, 0x14, unsigned long)
+/*
+ * Discard mode, splice output: get the run of consecutive ready
+ * sub-buffers following the consumer, at most the number passed, which
+ * is updated to the number of sub-buffers held. The run is spliced in
+ * one call, each sub-buffer padded to a page multiple, its padded length
+ * being returned by RING_BUFFER_GET_PADDED_SUBBUF_SIZE. The packet
+ * boundaries are those of LTTNG_RING_BUFFER_GET_PACKET_DESC_BATCH issued
+ * before the get.
+ */
+#define RING_BUFFER_GET_NEXT_SUBBUF_RUN		_IOWR(0xF6, 0x15, unsigned long)
+/* Release the run of sub-buffers, move consumer past it. */
+#define RING_BUFFER_PUT_NEXT_SUBBUF_RUN		_IO(0xF6, 0x16)
 
 #ifdef CONFIG_COMPAT
 /* Get a snapshot of the current ring buffer producer and consumer positions */
@@ -156,6 +228,22 @@ ssize_t vfs_lib_ring_buffer_splice_read(struct file *in, loff_t *ppos,
 /* Flush the current sub-buffer, even if empty. */
 #define RING_BUFFER_COMPAT_FLUSH_EMPTY			\
 	RING_BUFFER_FLUSH_EMPTY
+/* returns the length of the control area to mmap. */
+#define RING_BUFFER_COMPAT_GET_CTRL_LEN		_IOR(0xF6, 0x11, compat_ulong_t)
+/*
+ * Discard mode only: move the consumer past the ready packet at the
+ * specified position, read in place through the control area.
+ */
+#define RING_BUFFER_COMPAT_PUT_CONSUMED		_IOW(0xF6, 0x12, compat_ulong_t)
+/*
+ * returns the largest fill level of the buffer since the previous call,
+ * in bytes, and resets it.
+ */
+#define RING_BUFFER_COMPAT_GET_FILL_HWM		_IOR(0xF6, 0x13, compat_ulong_t)
+/* poll reports POLLPRI at this fill level in bytes, 0 meaning full. */
+#define RING_BUFFER_COMPAT_SET_FILL_THRESHOLD	_IOW(0xF6, 0x14, compat_ulong_t)
+#define RING_BUFFER_COMPAT_GET_NEXT_SUBBUF_RUN	_IOWR(0xF6, 0x15, compat_ulong_t)
+#define RING_BUFFER_COMPAT_PUT_NEXT_SUBBUF_RUN	RING_BUFFER_PUT_NEXT_SUBBUF_RUN
 #endif /* CONFIG_COMPAT */
 
 #endif /* _LIB_RING_BUFFER_VFS_H */
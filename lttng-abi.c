@@ -30,6 +30,8 @@
 #include <linux/uaccess.h>
 #include <linux/slab.h>
 #include <linux/err.h>
+#include <linux/string.h>
+#include <linux/cpumask.h>
 #include <wrapper/vmalloc.h>	/* for wrapper_vmalloc_sync_all() */
 #include <wrapper/ringbuffer/vfs.h>
 #include <wrapper/ringbuffer/backend.h>
@@ -59,6 +61,8 @@ static const struct file_operations lttng_event_fops;
 static struct file_operations lttng_stream_ring_buffer_file_operations;
 
 static int put_u64(uint64_t val, unsigned long arg);
+static int lttng_abi_create_event(struct file *channel_file,
+		struct lttng_kernel_event *event_param);
 
 /*
  * Teardown management: opened file descriptors keep a refcount on the module,
@@ -131,6 +135,76 @@ fd_error:
 	return ret;
 }
 
+static
+int lttng_abi_clock(void)
+{
+	struct file *clock_file;
+	int file_fd, ret;
+
+	file_fd = lttng_get_unused_fd();
+	if (file_fd < 0) {
+		ret = file_fd;
+		goto fd_error;
+	}
+
+	clock_file = anon_inode_getfile("[lttng_clock]",
+					&lttng_clock_page_fops,
+					NULL, O_RDONLY);
+	if (IS_ERR(clock_file)) {
+		ret = PTR_ERR(clock_file);
+		goto file_error;
+	}
+	ret = lttng_clock_page_fops.open(NULL, clock_file);
+	if (ret < 0)
+		goto open_error;
+	fd_install(file_fd, clock_file);
+	return file_fd;
+
+open_error:
+	fput(clock_file);
+file_error:
+	put_unused_fd(file_fd);
+fd_error:
+	return ret;
+}
+
+static
+long lttng_abi_event_list(struct lttng_kernel_event_list __user *ulist)
+{
+	struct lttng_kernel_event_list list;
+	struct lttng_event_list_writer writer;
+	int ret;
+
+	if (copy_from_user(&list, ulist, sizeof(list)))
+		return -EFAULT;
+	if (list.flags & ~LTTNG_KERNEL_EVENT_LIST_FIELDS)
+		return -EINVAL;
+	memset(&writer, 0, sizeof(writer));
+	writer.ubuf = (char __user *) (unsigned long) list.buf;
+	writer.avail = list.len;
+	writer.flags = list.flags;
+	switch (list.instrumentation) {
+	case LTTNG_KERNEL_TRACEPOINT:
+		ret = lttng_probes_list_binary(&writer);
+		break;
+	case LTTNG_KERNEL_SYSCALL:
+		ret = lttng_syscalls_list_binary(&writer);
+		break;
+	default:
+		ret = -EINVAL;
+		break;
+	}
+	kfree(writer.entry.data);
+	if (ret)
+		return ret;
+	list.version = LTTNG_KERNEL_EVENT_LIST_VERSION;
+	list.nr_entries = writer.nr_entries;
+	list.len = writer.len;
+	if (copy_to_user(ulist, &list, sizeof(list)))
+		return -EFAULT;
+	return 0;
+}
+
 #ifndef CONFIG_HAVE_SYSCALL_TRACEPOINTS
 static inline
 int lttng_abi_syscall_list(void)
@@ -219,12 +293,52 @@ long lttng_abi_add_context(struct file *file,
 				context_param->u.perf_counter.config,
 				context_param->u.perf_counter.name,
 				ctx);
+	case LTTNG_KERNEL_CONTEXT_PERF_COUNTER_DELTA:
+		context_param->u.perf_counter.name[LTTNG_KERNEL_SYM_NAME_LEN - 1] = '\0';
+		return lttng_add_perf_counter_delta_to_ctx(context_param->u.perf_counter.type,
+				context_param->u.perf_counter.config,
+				context_param->u.perf_counter.name,
+				ctx);
+	case LTTNG_KERNEL_CONTEXT_PERF_COUNTER_GROUP:
+	case LTTNG_KERNEL_CONTEXT_PERF_COUNTER_GROUP_DELTA:
+	{
+		struct lttng_kernel_perf_counter_group_ctx *group =
+			&context_param->u.perf_counter_group;
+		struct lttng_kernel_perf_counter_group_member
+			members[LTTNG_KERNEL_PERF_COUNTER_GROUP_MAX];
+
+		if (!group->nr_members
+				|| group->nr_members > LTTNG_KERNEL_PERF_COUNTER_GROUP_MAX)
+			return -EINVAL;
+		if (copy_from_user(members,
+				(void __user *) (unsigned long) group->members,
+				group->nr_members * sizeof(*members)))
+			return -EFAULT;
+		group->name[LTTNG_KERNEL_SYM_NAME_LEN - 1] = '\0';
+		return lttng_add_perf_counter_group_to_ctx(members,
+				group->nr_members, group->name, ctx,
+				context_param->ctx == LTTNG_KERNEL_CONTEXT_PERF_COUNTER_GROUP_DELTA);
+	}
 	case LTTNG_KERNEL_CONTEXT_PROCNAME:
 		return lttng_add_procname_to_ctx(ctx);
 	case LTTNG_KERNEL_CONTEXT_HOSTNAME:
 		return lttng_add_hostname_to_ctx(ctx);
+	case LTTNG_KERNEL_CONTEXT_PROCNAME_INTERNED:
+		return lttng_add_procname_interned_to_ctx(ctx);
+	case LTTNG_KERNEL_CONTEXT_HOSTNAME_INTERNED:
+		return lttng_add_hostname_interned_to_ctx(ctx);
 	case LTTNG_KERNEL_CONTEXT_CPU_ID:
+	{
+		struct lttng_channel *channel = file->private_data;
+
+		/*
+		 * Per-cpu streams already carry the cpu_id in their packet
+		 * context: recording it in each event is redundant.
+		 */
+		if (channel->channel_type == PER_CPU_CHANNEL)
+			return 0;
 		return lttng_add_cpu_id_to_ctx(ctx);
+	}
 	case LTTNG_KERNEL_CONTEXT_INTERRUPTIBLE:
 		return lttng_add_interruptible_to_ctx(ctx);
 	case LTTNG_KERNEL_CONTEXT_NEED_RESCHEDULE:
@@ -235,7 +349,17 @@ long lttng_abi_add_context(struct file *file,
 		return lttng_add_migratable_to_ctx(ctx);
 	case LTTNG_KERNEL_CONTEXT_CALLSTACK_KERNEL:
 	case LTTNG_KERNEL_CONTEXT_CALLSTACK_USER:
-		return lttng_add_callstack_to_ctx(ctx, context_param->ctx);
+	case LTTNG_KERNEL_CONTEXT_CALLSTACK_KERNEL_ID:
+	case LTTNG_KERNEL_CONTEXT_CALLSTACK_USER_ID:
+		return lttng_add_callstack_to_ctx(ctx, context_param->ctx,
+				context_param->u.callstack.max_depth,
+				context_param->u.callstack.max_walk_time);
+	case LTTNG_KERNEL_CONTEXT_USER_TRUNCATED:
+		return lttng_add_user_truncated_to_ctx(ctx);
+	case LTTNG_KERNEL_CONTEXT_RATELIMIT_SUPPRESSED:
+		return lttng_add_ratelimit_suppressed_to_ctx(ctx);
+	case LTTNG_KERNEL_CONTEXT_TASK_STATE_FLAGS:
+		return lttng_add_task_state_flags_to_ctx(ctx);
 	default:
 		return -EINVAL;
 	}
@@ -255,10 +379,17 @@ long lttng_abi_add_context(struct file *file,
  *		Returns the LTTng kernel tracer version
  *	LTTNG_KERNEL_TRACEPOINT_LIST
  *		Returns a file descriptor listing available tracepoints
+ *	LTTNG_KERNEL_EVENT_LIST
+ *		Copies a binary listing of the tracepoint or system call
+ *		events, with their field types
  *	LTTNG_KERNEL_WAIT_QUIESCENT
- *		Returns after all previously running probes have completed
+ *		Returns after all previously running probes have completed,
+ *		and the destroyed sessions are freed
  *	LTTNG_KERNEL_TRACER_ABI_VERSION
  *		Returns the LTTng kernel tracer ABI version
+ *	LTTNG_KERNEL_CLOCK
+ *		Returns a file descriptor which can be mapped read-only
+ *		to read the trace clock from user-space
  *
  * The returned session will be deleted when its file descriptor is closed.
  */
@@ -314,9 +445,15 @@ long lttng_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		return lttng_abi_tracepoint_list();
 	case LTTNG_KERNEL_SYSCALL_LIST:
 		return lttng_abi_syscall_list();
+	case LTTNG_KERNEL_EVENT_LIST:
+		return lttng_abi_event_list(
+			(struct lttng_kernel_event_list __user *) arg);
+	case LTTNG_KERNEL_CLOCK:
+		return lttng_abi_clock();
 	case LTTNG_KERNEL_OLD_WAIT_QUIESCENT:
 	case LTTNG_KERNEL_WAIT_QUIESCENT:
 		synchronize_trace();
+		lttng_session_teardown_wait();
 		return 0;
 	case LTTNG_KERNEL_OLD_CALIBRATE:
 	{
@@ -348,6 +485,22 @@ long lttng_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			return -EFAULT;
 		return ret;
 	}
+	case LTTNG_KERNEL_CALIBRATE_OVERHEAD:
+	{
+		struct lttng_kernel_calibrate_overhead __user *ucalibrate =
+			(struct lttng_kernel_calibrate_overhead __user *) arg;
+		struct lttng_kernel_calibrate_overhead calibrate;
+		int ret;
+
+		if (copy_from_user(&calibrate, ucalibrate, sizeof(calibrate)))
+			return -EFAULT;
+		ret = lttng_calibrate_overhead(&calibrate);
+		if (ret)
+			return ret;
+		if (copy_to_user(ucalibrate, &calibrate, sizeof(calibrate)))
+			return -EFAULT;
+		return 0;
+	}
 	default:
 		return -ENOIOCTLCMD;
 	}
@@ -361,6 +514,35 @@ static const struct file_operations lttng_fops = {
 #endif
 };
 
+/*
+ * Copy a cpu mask bitmap of "len" bytes from user-space, keeping the
+ * possible cpus.
+ */
+static
+int lttng_abi_copy_cpu_mask(struct cpumask *mask, uint64_t user_mask,
+			    uint32_t len)
+{
+	uint8_t *bytes;
+	unsigned int cpu;
+
+	if (!len || len > LTTNG_KERNEL_CPU_MASK_MAX_LEN)
+		return -EINVAL;
+	bytes = memdup_user((void __user *) (unsigned long) user_mask, len);
+	if (IS_ERR(bytes))
+		return PTR_ERR(bytes);
+	cpumask_clear(mask);
+	for_each_possible_cpu(cpu) {
+		if (cpu / 8 >= len)
+			break;
+		if (bytes[cpu / 8] & (1U << (cpu % 8)))
+			cpumask_set_cpu(cpu, mask);
+	}
+	kfree(bytes);
+	if (cpumask_empty(mask))
+		return -EINVAL;
+	return 0;
+}
+
 static
 int lttng_abi_create_channel(struct file *session_file,
 			     struct lttng_kernel_channel *chan_param,
@@ -371,9 +553,31 @@ int lttng_abi_create_channel(struct file *session_file,
 	const char *transport_name;
 	struct lttng_channel *chan;
 	struct file *chan_file;
+	cpumask_var_t cpu_mask;
 	int chan_fd;
 	int ret = 0;
 
+	if (chan_param->flags & ~(LTTNG_KERNEL_CHANNEL_FLAG_LAZY_ALLOC
+				| LTTNG_KERNEL_CHANNEL_FLAG_CPU_MASK
+				| LTTNG_KERNEL_CHANNEL_FLAG_HOUSEKEEPING
+				| LTTNG_KERNEL_CHANNEL_FLAG_PACKED
+				| LTTNG_KERNEL_CHANNEL_FLAG_COARSE_CLOCK))
+		return -EINVAL;
+#if (BITS_PER_LONG != 64)
+	/* Reading jiffies_64 takes a seqlock on 32-bit architectures. */
+	if (chan_param->flags & LTTNG_KERNEL_CHANNEL_FLAG_COARSE_CLOCK)
+		return -EINVAL;
+#endif
+	if (chan_param->flags && channel_type != PER_CPU_CHANNEL)
+		return -EINVAL;
+	if (!zalloc_cpumask_var(&cpu_mask, GFP_KERNEL))
+		return -ENOMEM;
+	if (chan_param->flags & LTTNG_KERNEL_CHANNEL_FLAG_CPU_MASK) {
+		ret = lttng_abi_copy_cpu_mask(cpu_mask, chan_param->cpu_mask,
+					      chan_param->cpu_mask_len);
+		if (ret)
+			goto cpu_mask_error;
+	}
 	chan_fd = lttng_get_unused_fd();
 	if (chan_fd < 0) {
 		ret = chan_fd;
@@ -397,7 +601,12 @@ int lttng_abi_create_channel(struct file *session_file,
 	}
 	switch (channel_type) {
 	case PER_CPU_CHANNEL:
-		if (chan_param->output == LTTNG_KERNEL_SPLICE) {
+		if (chan_param->output == LTTNG_KERNEL_SPLICE
+				&& lib_ring_buffer_static_reserve_pages()) {
+			/* Buffers taken from the reserve set aside at load. */
+			transport_name = chan_param->overwrite ?
+				"relay-overwrite-static" : "relay-discard-static";
+		} else if (chan_param->output == LTTNG_KERNEL_SPLICE) {
 			transport_name = chan_param->overwrite ?
 				"relay-overwrite" : "relay-discard";
 		} else if (chan_param->output == LTTNG_KERNEL_MMAP) {
@@ -432,6 +641,12 @@ int lttng_abi_create_channel(struct file *session_file,
 				  chan_param->num_subbuf,
 				  chan_param->switch_timer_interval,
 				  chan_param->read_timer_interval,
+				  chan_param->read_timer_max_interval,
+				  chan_param->numa_policy,
+				  chan_param->numa_node,
+				  chan_param->flags,
+				  (chan_param->flags & LTTNG_KERNEL_CHANNEL_FLAG_CPU_MASK) ?
+					cpu_mask : NULL,
 				  channel_type);
 	if (!chan) {
 		ret = -EINVAL;
@@ -440,6 +655,7 @@ int lttng_abi_create_channel(struct file *session_file,
 	chan->file = chan_file;
 	chan_file->private_data = chan;
 	fd_install(chan_fd, chan_file);
+	free_cpumask_var(cpu_mask);
 
 	return chan_fd;
 
@@ -450,6 +666,262 @@ refcount_error:
 file_error:
 	put_unused_fd(chan_fd);
 fd_error:
+cpu_mask_error:
+	free_cpumask_var(cpu_mask);
+	return ret;
+}
+
+/*
+ * Create a channel recording into the buffers of another channel of the
+ * session, which owns the streams.
+ */
+static
+int lttng_abi_create_shared_channel(struct file *session_file,
+		struct lttng_kernel_channel_shared *shared_param)
+{
+	struct lttng_session *session = session_file->private_data;
+	struct lttng_channel *owner, *chan;
+	struct file *owner_file, *chan_file;
+	int chan_fd;
+	int ret = 0;
+
+	owner_file = fget(shared_param->channel_fd);
+	if (!owner_file)
+		return -EBADF;
+	if (owner_file->f_op != &lttng_channel_fops) {
+		ret = -EINVAL;
+		goto owner_error;
+	}
+	owner = owner_file->private_data;
+	if (owner->session != session) {
+		ret = -EINVAL;
+		goto owner_error;
+	}
+	chan_fd = lttng_get_unused_fd();
+	if (chan_fd < 0) {
+		ret = chan_fd;
+		goto owner_error;
+	}
+	chan_file = anon_inode_getfile("[lttng_channel]",
+				       &lttng_channel_fops,
+				       NULL, O_RDWR);
+	if (IS_ERR(chan_file)) {
+		ret = PTR_ERR(chan_file);
+		goto file_error;
+	}
+	if (atomic_long_add_unless(&session_file->f_count,
+		1, INT_MAX) == INT_MAX) {
+		ret = -EOVERFLOW;
+		goto refcount_error;
+	}
+	chan = lttng_channel_create_shared(owner);
+	if (!chan) {
+		ret = -EINVAL;
+		goto chan_error;
+	}
+	chan->file = chan_file;
+	chan_file->private_data = chan;
+	fd_install(chan_fd, chan_file);
+	fput(owner_file);
+	return chan_fd;
+
+chan_error:
+	atomic_long_dec(&session_file->f_count);
+refcount_error:
+	fput(chan_file);
+file_error:
+	put_unused_fd(chan_fd);
+owner_error:
+	fput(owner_file);
+	return ret;
+}
+
+static
+int lttng_abi_session_config_check(
+		const struct lttng_kernel_session_config_entry *entries,
+		uint32_t i)
+{
+	const struct lttng_kernel_session_config_entry *entry = &entries[i];
+	uint32_t target_type;
+
+	if (entry->type == LTTNG_KERNEL_SESSION_CONFIG_CHANNEL)
+		return 0;
+	/* Targets are earlier entries of the batch. */
+	if (entry->target >= i)
+		return -EINVAL;
+	target_type = entries[entry->target].type;
+	switch (entry->type) {
+	case LTTNG_KERNEL_SESSION_CONFIG_EVENT:
+	case LTTNG_KERNEL_SESSION_CONFIG_CONTEXT:
+		if (target_type != LTTNG_KERNEL_SESSION_CONFIG_CHANNEL)
+			return -EINVAL;
+		return 0;
+	case LTTNG_KERNEL_SESSION_CONFIG_FILTER:
+		if (target_type != LTTNG_KERNEL_SESSION_CONFIG_EVENT)
+			return -EINVAL;
+		return 0;
+	case LTTNG_KERNEL_SESSION_CONFIG_ENABLE:
+		if (target_type != LTTNG_KERNEL_SESSION_CONFIG_CHANNEL
+				&& target_type != LTTNG_KERNEL_SESSION_CONFIG_EVENT)
+			return -EINVAL;
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+/*
+ * Apply entry "i" of a checked batch. "files" holds the file of each
+ * channel and event entry already applied.
+ */
+static
+int lttng_abi_session_config_apply(struct file *session_file,
+		struct lttng_kernel_session_config_entry *entries,
+		struct file **files, uint32_t i)
+{
+	struct lttng_kernel_session_config_entry *entry = &entries[i];
+	void __user *param = (void __user *) (unsigned long) entry->param;
+	struct file *target = NULL;
+	enum lttng_event_type *evtype;
+	int fd;
+
+	if (entry->type != LTTNG_KERNEL_SESSION_CONFIG_CHANNEL)
+		target = files[entry->target];
+
+	switch (entry->type) {
+	case LTTNG_KERNEL_SESSION_CONFIG_CHANNEL:
+	{
+		struct lttng_kernel_channel chan_param;
+
+		if (copy_from_user(&chan_param, param, sizeof(chan_param)))
+			return -EFAULT;
+		fd = lttng_abi_create_channel(session_file, &chan_param,
+				PER_CPU_CHANNEL);
+		break;
+	}
+	case LTTNG_KERNEL_SESSION_CONFIG_EVENT:
+	{
+		struct lttng_kernel_event event_param;
+
+		if (copy_from_user(&event_param, param, sizeof(event_param)))
+			return -EFAULT;
+		fd = lttng_abi_create_event(target, &event_param);
+		break;
+	}
+	case LTTNG_KERNEL_SESSION_CONFIG_CONTEXT:
+	{
+		struct lttng_kernel_context context_param;
+		struct lttng_channel *channel = target->private_data;
+
+		if (copy_from_user(&context_param, param,
+				sizeof(context_param)))
+			return -EFAULT;
+		return lttng_abi_add_context(target, &context_param,
+				&channel->ctx, channel->session);
+	}
+	case LTTNG_KERNEL_SESSION_CONFIG_FILTER:
+		evtype = target->private_data;
+		if (*evtype != LTTNG_TYPE_ENABLER)
+			return -EINVAL;
+		return lttng_enabler_attach_bytecode(target->private_data,
+				param);
+	case LTTNG_KERNEL_SESSION_CONFIG_ENABLE:
+		if (entries[entry->target].type
+				== LTTNG_KERNEL_SESSION_CONFIG_CHANNEL)
+			return lttng_channel_enable(target->private_data);
+		evtype = target->private_data;
+		if (*evtype == LTTNG_TYPE_ENABLER)
+			return lttng_enabler_enable(target->private_data);
+		return lttng_event_enable(target->private_data);
+	default:
+		return -EINVAL;
+	}
+	if (fd < 0)
+		return fd;
+	entry->fd = fd;
+	/* Keep the file while the batch refers to it. */
+	files[i] = fget(fd);
+	if (!files[i])
+		return -EBADF;
+	return 0;
+}
+
+/*
+ * Apply a batch of channel, event, context, filter and enable entries
+ * to a session in one call. All the entries are checked before the
+ * first one is applied, and the enabler syncs are deferred to the end
+ * of the batch, so an active session is synced once. Channels and
+ * events are invariant once created: on error, the entries applied
+ * before the failed one are kept, and their file descriptors returned.
+ */
+static
+long lttng_abi_session_configure(struct file *session_file,
+		struct lttng_kernel_session_config __user *uconfig)
+{
+	struct lttng_session *session = session_file->private_data;
+	struct lttng_kernel_session_config config;
+	struct lttng_kernel_session_config_entry *entries;
+	void __user *uentries;
+	struct file **files;
+	uint32_t i, error_index = 0;
+	size_t len;
+	long ret = 0;
+
+	if (copy_from_user(&config, uconfig, sizeof(config)))
+		return -EFAULT;
+	if (!config.nr_entries
+			|| config.nr_entries > LTTNG_KERNEL_SESSION_CONFIG_MAX_ENTRIES)
+		return -EINVAL;
+	uentries = (void __user *) (unsigned long) config.entries;
+	len = config.nr_entries * sizeof(*entries);
+	entries = lttng_kvmalloc(len, GFP_KERNEL);
+	if (!entries)
+		return -ENOMEM;
+	files = lttng_kvzalloc(config.nr_entries * sizeof(*files), GFP_KERNEL);
+	if (!files) {
+		ret = -ENOMEM;
+		goto files_error;
+	}
+	if (copy_from_user(entries, uentries, len)) {
+		ret = -EFAULT;
+		goto end;
+	}
+	for (i = 0; i < config.nr_entries; i++) {
+		ret = lttng_abi_session_config_check(entries, i);
+		if (ret) {
+			error_index = i;
+			goto error;
+		}
+		entries[i].fd = -1;
+	}
+
+	lttng_session_config_begin(session);
+	for (i = 0; i < config.nr_entries; i++) {
+		ret = lttng_abi_session_config_apply(session_file, entries,
+				files, i);
+		if (ret) {
+			error_index = i;
+			break;
+		}
+	}
+	lttng_session_config_end(session);
+
+	for (i = 0; i < config.nr_entries; i++) {
+		if (files[i])
+			fput(files[i]);
+	}
+	/* Return the file descriptors created, even on error. */
+	if (copy_to_user(uentries, entries, len) && !ret)
+		ret = -EFAULT;
+	if (!ret)
+		goto end;
+error:
+	if (put_user(error_index, &uconfig->error_index))
+		ret = -EFAULT;
+end:
+	lttng_kvfree(files);
+files_error:
+	lttng_kvfree(entries);
 	return ret;
 }
 
@@ -473,6 +945,31 @@ fd_error:
  *		Add PID to session tracker
  *	LTTNG_KERNEL_SESSION_UNTRACK_PID
  *		Remove PID from session tracker
+ *	LTTNG_KERNEL_SESSION_TRACK_ID
+ *		Add cgroup, namespace, UID or GID to session tracker
+ *	LTTNG_KERNEL_SESSION_UNTRACK_ID
+ *		Remove cgroup, namespace, UID or GID from session tracker
+ *	LTTNG_KERNEL_SESSION_STATEDUMP_MODE
+ *		Select full or incremental session statedump
+ *	LTTNG_KERNEL_SESSION_STATEDUMP_MASK
+ *		Select the categories of the session statedump
+ *	LTTNG_KERNEL_SESSION_CLEAR
+ *		Drop the unread data of the session streams
+ *	LTTNG_KERNEL_SESSION_CONFIGURE
+ *		Apply a batch of channel, event, context, filter and
+ *		enable descriptors
+ *	LTTNG_KERNEL_SESSION_METADATA_FORMAT
+ *		Select TSDL or binary event payload declarations
+ *	LTTNG_KERNEL_SESSION_LAZY_METADATA
+ *		Emit the metadata of events on their first record
+ *	LTTNG_KERNEL_SHARED_CHANNEL
+ *		Returns a LTTng channel file descriptor recording into
+ *		the buffers of another channel
+ *	LTTNG_KERNEL_SESSION_PAUSE
+ *		Stop recording into an active session, without
+ *		stopping it
+ *	LTTNG_KERNEL_SESSION_RESUME
+ *		Resume recording into a paused session
  *
  * The returned channel will be deleted when its file descriptor is closed.
  */
@@ -496,7 +993,11 @@ long lttng_session_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		chan_param.num_subbuf = old_chan_param.num_subbuf;
 		chan_param.switch_timer_interval = old_chan_param.switch_timer_interval;
 		chan_param.read_timer_interval = old_chan_param.read_timer_interval;
+		chan_param.read_timer_max_interval = 0;
 		chan_param.output = old_chan_param.output;
+		chan_param.numa_policy = LTTNG_KERNEL_NUMA_LOCAL;
+		chan_param.numa_node = -1;
+		chan_param.flags = 0;
 
 		return lttng_abi_create_channel(file, &chan_param,
 				PER_CPU_CHANNEL);
@@ -536,7 +1037,11 @@ long lttng_session_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		chan_param.num_subbuf = old_chan_param.num_subbuf;
 		chan_param.switch_timer_interval = old_chan_param.switch_timer_interval;
 		chan_param.read_timer_interval = old_chan_param.read_timer_interval;
+		chan_param.read_timer_max_interval = 0;
 		chan_param.output = old_chan_param.output;
+		chan_param.numa_policy = LTTNG_KERNEL_NUMA_LOCAL;
+		chan_param.numa_node = -1;
+		chan_param.flags = 0;
 
 		return lttng_abi_create_channel(file, &chan_param,
 				METADATA_CHANNEL);
@@ -562,6 +1067,72 @@ long lttng_session_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		return lttng_session_metadata_regenerate(session);
 	case LTTNG_KERNEL_SESSION_STATEDUMP:
 		return lttng_session_statedump(session);
+	case LTTNG_KERNEL_SESSION_STATEDUMP_MODE:
+		return lttng_session_set_statedump_mode(session,
+				(enum lttng_kernel_statedump_mode) arg);
+	case LTTNG_KERNEL_SESSION_STATEDUMP_MASK:
+		return lttng_session_set_statedump_mask(session,
+				(uint32_t) arg);
+	case LTTNG_KERNEL_SESSION_METADATA_FORMAT:
+		return lttng_session_set_metadata_format(session,
+				(enum lttng_kernel_metadata_format) arg);
+	case LTTNG_KERNEL_SESSION_LAZY_METADATA:
+		return lttng_session_set_lazy_metadata(session, (int) arg);
+	case LTTNG_KERNEL_SHARED_CHANNEL:
+	{
+		struct lttng_kernel_channel_shared shared_param;
+
+		if (copy_from_user(&shared_param,
+				(struct lttng_kernel_channel_shared __user *) arg,
+				sizeof(shared_param)))
+			return -EFAULT;
+		return lttng_abi_create_shared_channel(file, &shared_param);
+	}
+	case LTTNG_KERNEL_SESSION_PAUSE:
+		return lttng_session_pause(session, (uint32_t) arg);
+	case LTTNG_KERNEL_SESSION_RESUME:
+		return lttng_session_resume(session);
+	case LTTNG_KERNEL_SESSION_CLEAR:
+		return lttng_session_clear(session);
+	case LTTNG_KERNEL_SESSION_CONFIGURE:
+		return lttng_abi_session_configure(file,
+				(struct lttng_kernel_session_config __user *) arg);
+	case LTTNG_KERNEL_SESSION_TRACK_ID:
+	case LTTNG_KERNEL_SESSION_UNTRACK_ID:
+	{
+		struct lttng_kernel_tracker_id tracker_param;
+		enum lttng_tracker_type type;
+
+		if (copy_from_user(&tracker_param,
+				(struct lttng_kernel_tracker_id __user *) arg,
+				sizeof(tracker_param)))
+			return -EFAULT;
+		switch (tracker_param.type) {
+		case LTTNG_KERNEL_TRACKER_CGROUP:
+			type = LTTNG_TRACKER_CGROUP;
+			break;
+		case LTTNG_KERNEL_TRACKER_PID_NS:
+			type = LTTNG_TRACKER_PID_NS;
+			break;
+		case LTTNG_KERNEL_TRACKER_NET_NS:
+			type = LTTNG_TRACKER_NET_NS;
+			break;
+		case LTTNG_KERNEL_TRACKER_UID:
+			type = LTTNG_TRACKER_UID;
+			break;
+		case LTTNG_KERNEL_TRACKER_GID:
+			type = LTTNG_TRACKER_GID;
+			break;
+		default:
+			return -EINVAL;
+		}
+		if (cmd == LTTNG_KERNEL_SESSION_TRACK_ID)
+			return lttng_session_track_id(session, type,
+					tracker_param.id);
+		else
+			return lttng_session_untrack_id(session, type,
+					tracker_param.id);
+	}
 	default:
 		return -ENOIOCTLCMD;
 	}
@@ -734,6 +1305,12 @@ long lttng_metadata_ring_buffer_ioctl(struct file *filp,
 
 		return lttng_metadata_cache_dump(stream);
 	}
+	case LTTNG_KERNEL_METADATA_CACHE_MAP:
+	{
+		struct lttng_metadata_stream *stream = filp->private_data;
+
+		return lttng_metadata_cache_map_create(stream->metadata_cache);
+	}
 	default:
 		break;
 	}
@@ -817,6 +1394,12 @@ long lttng_metadata_ring_buffer_compat_ioctl(struct file *filp,
 
 		return lttng_metadata_cache_dump(stream);
 	}
+	case LTTNG_KERNEL_METADATA_CACHE_MAP:
+	{
+		struct lttng_metadata_stream *stream = filp->private_data;
+
+		return lttng_metadata_cache_map_create(stream->metadata_cache);
+	}
 	default:
 		break;
 	}
@@ -975,6 +1558,26 @@ fd_error:
 	return ret;
 }
 
+/* Open the pool stream of a memory node. */
+static
+int lttng_abi_open_pool_stream(struct file *channel_file, int node)
+{
+	struct lttng_channel *channel = channel_file->private_data;
+	struct lib_ring_buffer *buf;
+	int ret;
+
+	if (node < 0 || node >= nr_node_ids)
+		return -EINVAL;
+	buf = lttng_channel_pool_read_open(channel, node);
+	if (!buf)
+		return -ENOENT;
+	ret = lttng_abi_create_stream_fd(channel_file, buf,
+			&lttng_stream_ring_buffer_file_operations);
+	if (ret < 0)
+		lib_ring_buffer_release_read(buf);
+	return ret;
+}
+
 static
 int lttng_abi_open_metadata_stream(struct file *channel_file)
 {
@@ -1056,6 +1659,12 @@ int lttng_abi_create_event(struct file *channel_file,
 	case LTTNG_KERNEL_FUNCTION:
 		event_param->u.ftrace.symbol_name[LTTNG_KERNEL_SYM_NAME_LEN - 1] = '\0';
 		break;
+	case LTTNG_KERNEL_FENTRY:
+		event_param->u.fentry.symbol_name[LTTNG_KERNEL_SYM_NAME_LEN - 1] = '\0';
+		break;
+	case LTTNG_KERNEL_FGRAPH:
+		event_param->u.fgraph.symbol_name[LTTNG_KERNEL_SYM_NAME_LEN - 1] = '\0';
+		break;
 	default:
 		break;
 	}
@@ -1081,6 +1690,8 @@ int lttng_abi_create_event(struct file *channel_file,
 			|| event_param->instrumentation == LTTNG_KERNEL_SYSCALL) {
 		struct lttng_enabler *enabler;
 
+		if (event_param->instrumentation == LTTNG_KERNEL_TRACEPOINT)
+			lttng_probes_load_matching(event_param->name);
 		if (strutils_is_star_glob_pattern(event_param->name)) {
 			/*
 			 * If the event name is a star globbing pattern,
@@ -1124,25 +1735,257 @@ fd_error:
 	return ret;
 }
 
-/**
- *	lttng_channel_ioctl - lttng syscall through ioctl
- *
- *	@file: the file
- *	@cmd: the command
- *	@arg: command arg
- *
- *	This ioctl implements lttng commands:
- *      LTTNG_KERNEL_STREAM
- *              Returns an event stream file descriptor or failure.
- *              (typically, one event stream records events from one CPU)
- *	LTTNG_KERNEL_EVENT
- *		Returns an event file descriptor or failure.
- *	LTTNG_KERNEL_CONTEXT
- *		Prepend a context field to each event in the channel
- *	LTTNG_KERNEL_ENABLE
- *		Enable recording for events in this channel (weak enable)
- *	LTTNG_KERNEL_DISABLE
- *		Disable recording for events in this channel (strong disable)
+/*
+ * The channel readiness file is readable when any stream of the channel
+ * has data to read. read() returns the bitmap of the ready cpus, over
+ * DIV_ROUND_UP(nr_cpu_ids, 8) bytes: bit (N % 8) of byte (N / 8) is
+ * set for cpu N. Only the streams opened for reading wake it up.
+ */
+static
+unsigned int lttng_channel_ready_poll(struct file *file, poll_table *wait)
+{
+	struct file *channel_file = file->private_data;
+	struct lttng_channel *channel = channel_file->private_data;
+	cpumask_var_t ready;
+	unsigned int mask = 0;
+
+	poll_wait(file, channel->ops->get_read_wait_queue(channel->chan), wait);
+	if (channel->ops->is_disabled(channel->chan))
+		return POLLERR;
+	if (!zalloc_cpumask_var(&ready, GFP_KERNEL))
+		return POLLERR;
+	if (channel->ops->get_ready_cpus(channel->chan, ready))
+		mask = POLLIN | POLLRDNORM;
+	else if (channel->ops->is_finalized(channel->chan))
+		mask = POLLHUP;
+	free_cpumask_var(ready);
+	return mask;
+}
+
+static
+ssize_t lttng_channel_ready_read(struct file *file, char __user *user_buf,
+		size_t count, loff_t *ppos)
+{
+	struct file *channel_file = file->private_data;
+	struct lttng_channel *channel = channel_file->private_data;
+	size_t len = DIV_ROUND_UP(nr_cpu_ids, 8);
+	cpumask_var_t ready;
+	uint8_t *bitmap;
+	ssize_t ret;
+	int cpu;
+
+	if (count < len)
+		return -EINVAL;
+	bitmap = kzalloc(len, GFP_KERNEL);
+	if (!bitmap)
+		return -ENOMEM;
+	if (!zalloc_cpumask_var(&ready, GFP_KERNEL)) {
+		ret = -ENOMEM;
+		goto end_bitmap;
+	}
+	channel->ops->get_ready_cpus(channel->chan, ready);
+	for_each_cpu(cpu, ready)
+		bitmap[cpu / 8] |= 1U << (cpu % 8);
+	if (copy_to_user(user_buf, bitmap, len))
+		ret = -EFAULT;
+	else
+		ret = len;
+	free_cpumask_var(ready);
+end_bitmap:
+	kfree(bitmap);
+	return ret;
+}
+
+static
+int lttng_channel_ready_release(struct inode *inode, struct file *file)
+{
+	struct file *channel_file = file->private_data;
+
+	if (channel_file)
+		fput(channel_file);
+	return 0;
+}
+
+static const struct file_operations lttng_channel_ready_fops = {
+	.owner = THIS_MODULE,
+	.release = lttng_channel_ready_release,
+	.poll = lttng_channel_ready_poll,
+	.read = lttng_channel_ready_read,
+};
+
+static
+int lttng_abi_open_channel_ready(struct file *channel_file)
+{
+	struct lttng_channel *channel = channel_file->private_data;
+	struct file *ready_file;
+	int ready_fd, ret;
+
+	if (!channel->ops->get_ready_cpus)
+		return -ENOSYS;
+	ready_fd = lttng_get_unused_fd();
+	if (ready_fd < 0) {
+		ret = ready_fd;
+		goto fd_error;
+	}
+	ready_file = anon_inode_getfile("[lttng_channel_ready]",
+					&lttng_channel_ready_fops,
+					NULL, O_RDONLY);
+	if (IS_ERR(ready_file)) {
+		ret = PTR_ERR(ready_file);
+		goto file_error;
+	}
+	/* The readiness file holds a reference on the channel */
+	if (atomic_long_add_unless(&channel_file->f_count,
+		1, INT_MAX) == INT_MAX) {
+		ret = -EOVERFLOW;
+		goto refcount_error;
+	}
+	ready_file->private_data = channel_file;
+	fd_install(ready_fd, ready_file);
+	return ready_fd;
+
+refcount_error:
+	fput(ready_file);
+file_error:
+	put_unused_fd(ready_fd);
+fd_error:
+	return ret;
+}
+
+static
+long lttng_abi_channel_flush(struct lttng_channel *channel,
+		struct lttng_kernel_channel_flush __user *uparam)
+{
+	struct lttng_kernel_channel_flush param;
+	uint64_t *seq_num = NULL;
+	long ret;
+
+	if (copy_from_user(&param, uparam, sizeof(param)))
+		return -EFAULT;
+	if (param.flags & ~LTTNG_KERNEL_CHANNEL_FLUSH_EMPTY)
+		return -EINVAL;
+	if (param.seq_num) {
+		if (param.nr_seq_num < nr_cpu_ids)
+			return -EINVAL;
+		seq_num = kmalloc_array(nr_cpu_ids, sizeof(*seq_num),
+				GFP_KERNEL);
+		if (!seq_num)
+			return -ENOMEM;
+		memset(seq_num, 0xFF, nr_cpu_ids * sizeof(*seq_num));
+	}
+	ret = lttng_channel_flush(channel,
+			param.flags & LTTNG_KERNEL_CHANNEL_FLUSH_EMPTY, seq_num);
+	if (ret || !seq_num)
+		goto end;
+	if (copy_to_user((uint64_t __user *) (unsigned long) param.seq_num,
+			seq_num, nr_cpu_ids * sizeof(*seq_num))
+			|| put_user((uint32_t) nr_cpu_ids, &uparam->nr_seq_num))
+		ret = -EFAULT;
+end:
+	kfree(seq_num);
+	return ret;
+}
+
+static
+long lttng_abi_channel_mmap_layout(struct lttng_channel *channel,
+		struct lttng_kernel_channel_mmap_layout __user *uparam)
+{
+	struct lttng_kernel_channel_mmap_layout param;
+	struct channel *chan = channel->chan;
+	uint64_t *offsets = NULL;
+	unsigned long offset;
+	long ret = 0;
+	int cpu;
+
+	if (chan->backend.config.output != RING_BUFFER_MMAP)
+		return -EINVAL;
+	if (copy_from_user(&param, uparam, sizeof(param)))
+		return -EFAULT;
+	param.stream_len = lib_ring_buffer_channel_mmap_len(chan);
+	if (put_user(param.stream_len, &uparam->stream_len))
+		return -EFAULT;
+	if (!param.offsets)
+		return 0;
+	if (param.nr_offsets < nr_cpu_ids)
+		return -EINVAL;
+	offsets = kmalloc_array(nr_cpu_ids, sizeof(*offsets), GFP_KERNEL);
+	if (!offsets)
+		return -ENOMEM;
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++) {
+		if (lib_ring_buffer_channel_mmap_offset(chan, cpu, &offset))
+			offsets[cpu] = -1ULL;
+		else
+			offsets[cpu] = offset;
+	}
+	if (copy_to_user((uint64_t __user *) (unsigned long) param.offsets,
+			offsets, nr_cpu_ids * sizeof(*offsets))
+			|| put_user((uint32_t) nr_cpu_ids, &uparam->nr_offsets))
+		ret = -EFAULT;
+	kfree(offsets);
+	return ret;
+}
+
+/**
+ *	lttng_channel_ioctl - lttng syscall through ioctl
+ *
+ *	@file: the file
+ *	@cmd: the command
+ *	@arg: command arg
+ *
+ *	This ioctl implements lttng commands:
+ *      LTTNG_KERNEL_STREAM
+ *              Returns an event stream file descriptor or failure.
+ *              (typically, one event stream records events from one CPU)
+ *	LTTNG_KERNEL_EVENT
+ *		Returns an event file descriptor or failure.
+ *	LTTNG_KERNEL_CONTEXT
+ *		Prepend a context field to each event in the channel
+ *	LTTNG_KERNEL_ENABLE
+ *		Enable recording for events in this channel (weak enable)
+ *	LTTNG_KERNEL_DISABLE
+ *		Disable recording for events in this channel (strong disable)
+ *	LTTNG_KERNEL_CHANNEL_HOT_EVENT
+ *		Reserve a compact header event id for an event name
+ *	LTTNG_KERNEL_CHANNEL_EVENT_HEADER
+ *		Select the event header layout (compact, large or delta)
+ *	LTTNG_KERNEL_CHANNEL_RESIZE
+ *		Change the sub-buffer size and count of a stopped channel
+ *	LTTNG_KERNEL_CHANNEL_READY_FD
+ *		Returns a file descriptor readable when any stream of the
+ *		channel has data, reporting the ready cpus on read
+ *	LTTNG_KERNEL_CHANNEL_FLUSH
+ *		Switches the current packet of all the channel streams,
+ *		returning the sequence number following each switch
+ *	LTTNG_KERNEL_CHANNEL_TRIGGER
+ *		Returns a trigger file descriptor, freezing another channel
+ *		when an event of this channel is recorded
+ *	LTTNG_KERNEL_CHANNEL_SNAPSHOT_AREA
+ *		Returns a file descriptor mapping the preallocated area
+ *		the streams copy their snapshots to
+ *	LTTNG_KERNEL_CHANNEL_CRITICAL
+ *		Keep part of the last free sub-buffer to critical events
+ *		(discard mode)
+ *	LTTNG_KERNEL_CHANNEL_BLOCKING
+ *		Wait for the consumer rather than discard events recorded
+ *		in task context (discard mode)
+ *	LTTNG_KERNEL_CHANNEL_LIVE
+ *		Flush streams only when their events would otherwise miss
+ *		a delivery deadline
+ *	LTTNG_KERNEL_CHANNEL_MMAP_LAYOUT
+ *		Returns the offsets of the stream buffers in the mapping
+ *		of the channel file descriptor
+ *	LTTNG_KERNEL_CHANNEL_READER_BARRIER
+ *		Select whether the consumer sends IPIs to the writer cpus
+ *		or the writers order their commits themselves
+ *	LTTNG_KERNEL_CHANNEL_POOL
+ *		Copy the packets of the per-cpu buffers into a pool
+ *		buffer per memory node
+ *	LTTNG_KERNEL_CHANNEL_POOL_STREAM
+ *		Returns a stream file descriptor for the pool buffer of
+ *		a memory node
+ *	LTTNG_KERNEL_CONTEXT_GUARD
+ *		Record a context only for the records passing a filter
+ *		bytecode
  *
  * Channel and event file descriptors also hold a reference on the session.
  */
@@ -1154,6 +1997,12 @@ long lttng_channel_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	switch (cmd) {
 	case LTTNG_KERNEL_OLD_STREAM:
 	case LTTNG_KERNEL_STREAM:
+		/* The streams are those of the owner channel. */
+		if (channel->shared)
+			return -EPERM;
+		/* The staging streams are read by the pool. */
+		if (channel->pool)
+			return -EPERM;
 		return lttng_abi_open_stream(file);
 	case LTTNG_KERNEL_OLD_EVENT:
 	{
@@ -1204,6 +2053,7 @@ long lttng_channel_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			memcpy(uevent_param->u.kretprobe.symbol_name,
 				old_uevent_param->u.kretprobe.symbol_name,
 				sizeof(uevent_param->u.kretprobe.symbol_name));
+			uevent_param->u.kretprobe.threshold = 0;
 			break;
 		case LTTNG_KERNEL_FUNCTION:
 			memcpy(uevent_param->u.ftrace.symbol_name,
@@ -1238,7 +2088,10 @@ old_event_end:
 		struct lttng_kernel_old_context *old_ucontext_param;
 		int ret;
 
-		ucontext_param = kmalloc(sizeof(struct lttng_kernel_context),
+		/* Records carry the contexts of the owner channel. */
+		if (channel->shared)
+			return -EPERM;
+		ucontext_param = kzalloc(sizeof(struct lttng_kernel_context),
 				GFP_KERNEL);
 		if (!ucontext_param) {
 			ret = -ENOMEM;
@@ -1286,6 +2139,8 @@ old_ctx_end:
 	{
 		struct lttng_kernel_context ucontext_param;
 
+		if (channel->shared)
+			return -EPERM;
 		if (copy_from_user(&ucontext_param,
 				(struct lttng_kernel_context __user *) arg,
 				sizeof(ucontext_param)))
@@ -1303,6 +2158,221 @@ old_ctx_end:
 	case LTTNG_KERNEL_SYSCALL_MASK:
 		return lttng_channel_syscall_mask(channel,
 			(struct lttng_kernel_syscall_mask __user *) arg);
+	case LTTNG_KERNEL_CHANNEL_PID_SYSCALL_MASK:
+		return lttng_channel_pid_syscall_mask(channel,
+			(struct lttng_kernel_pid_syscall_mask __user *) arg);
+	case LTTNG_KERNEL_CHANNEL_SAMPLING:
+	{
+		struct lttng_kernel_channel_sampling sampling_param;
+
+		if (copy_from_user(&sampling_param,
+				(struct lttng_kernel_channel_sampling __user *) arg,
+				sizeof(sampling_param)))
+			return -EFAULT;
+		return lttng_channel_set_sampling(channel,
+				sampling_param.period);
+	}
+	case LTTNG_KERNEL_AGGREGATION:
+	{
+		struct lttng_kernel_aggregation aggregation_param;
+
+		if (copy_from_user(&aggregation_param,
+				(struct lttng_kernel_aggregation __user *) arg,
+				sizeof(aggregation_param)))
+			return -EFAULT;
+		return lttng_channel_aggregation_create(channel,
+				&aggregation_param);
+	}
+	case LTTNG_KERNEL_CHANNEL_COMPRESSION:
+	{
+		struct lttng_kernel_channel_compression compression_param;
+
+		if (copy_from_user(&compression_param,
+				(struct lttng_kernel_channel_compression __user *) arg,
+				sizeof(compression_param)))
+			return -EFAULT;
+		return lttng_channel_set_compression(channel,
+				&compression_param);
+	}
+	case LTTNG_KERNEL_SYSCALL_LATENCY:
+	{
+		struct lttng_kernel_syscall_latency latency_param;
+
+		if (copy_from_user(&latency_param,
+				(struct lttng_kernel_syscall_latency __user *) arg,
+				sizeof(latency_param)))
+			return -EFAULT;
+		return lttng_channel_set_syscall_latency(channel,
+				&latency_param);
+	}
+	case LTTNG_KERNEL_SYSCALL_SUMMARY:
+	{
+		struct lttng_kernel_syscall_summary summary_param;
+
+		if (copy_from_user(&summary_param,
+				(struct lttng_kernel_syscall_summary __user *) arg,
+				sizeof(summary_param)))
+			return -EFAULT;
+		return lttng_channel_set_syscall_summary(channel,
+				&summary_param);
+	}
+	case LTTNG_KERNEL_CHANNEL_HOT_EVENT:
+	{
+		struct lttng_kernel_channel_hot_event hot_param;
+
+		if (copy_from_user(&hot_param,
+				(struct lttng_kernel_channel_hot_event __user *) arg,
+				sizeof(hot_param)))
+			return -EFAULT;
+		hot_param.name[LTTNG_KERNEL_SYM_NAME_LEN - 1] = '\0';
+		return lttng_channel_add_hot_event(channel, hot_param.name);
+	}
+	case LTTNG_KERNEL_CHANNEL_EVENT_HEADER:
+	{
+		struct lttng_kernel_channel_event_header header_param;
+
+		if (copy_from_user(&header_param,
+				(struct lttng_kernel_channel_event_header __user *) arg,
+				sizeof(header_param)))
+			return -EFAULT;
+		return lttng_channel_set_header_type(channel,
+				header_param.type);
+	}
+	case LTTNG_KERNEL_CHANNEL_RESIZE:
+	{
+		struct lttng_kernel_channel_resize resize_param;
+
+		if (copy_from_user(&resize_param,
+				(struct lttng_kernel_channel_resize __user *) arg,
+				sizeof(resize_param)))
+			return -EFAULT;
+		return lttng_channel_resize(channel, resize_param.subbuf_size,
+				resize_param.num_subbuf);
+	}
+	case LTTNG_KERNEL_CHANNEL_READY_FD:
+		return lttng_abi_open_channel_ready(file);
+	case LTTNG_KERNEL_CHANNEL_FLUSH:
+		return lttng_abi_channel_flush(channel,
+				(struct lttng_kernel_channel_flush __user *) arg);
+	case LTTNG_KERNEL_CHANNEL_TRIGGER:
+	{
+		struct lttng_kernel_channel_trigger trigger_param;
+		struct file *target_file;
+
+		if (copy_from_user(&trigger_param,
+				(struct lttng_kernel_channel_trigger __user *) arg,
+				sizeof(trigger_param)))
+			return -EFAULT;
+		target_file = fget(trigger_param.target_fd);
+		if (!target_file)
+			return -EBADF;
+		if (target_file->f_op != &lttng_channel_fops) {
+			fput(target_file);
+			return -EINVAL;
+		}
+		return lttng_channel_trigger_create(channel, target_file,
+				trigger_param.window);
+	}
+	case LTTNG_KERNEL_CHANNEL_SNAPSHOT_AREA:
+		return lttng_channel_snapshot_area_create(channel);
+	case LTTNG_KERNEL_CHANNEL_SNAPSHOT_RANGE:
+	{
+		struct lttng_kernel_channel_snapshot_range range_param;
+		cpumask_var_t cpus;
+		int ret;
+
+		if (copy_from_user(&range_param,
+				(struct lttng_kernel_channel_snapshot_range __user *) arg,
+				sizeof(range_param)))
+			return -EFAULT;
+		if (!range_param.cpu_mask_len)
+			return lttng_channel_set_snapshot_range(channel,
+					range_param.begin, NULL);
+		if (!zalloc_cpumask_var(&cpus, GFP_KERNEL))
+			return -ENOMEM;
+		ret = lttng_abi_copy_cpu_mask(cpus, range_param.cpu_mask,
+					      range_param.cpu_mask_len);
+		if (!ret)
+			ret = lttng_channel_set_snapshot_range(channel,
+					range_param.begin, cpus);
+		free_cpumask_var(cpus);
+		return ret;
+	}
+	case LTTNG_KERNEL_CHANNEL_MMAP_LAYOUT:
+		return lttng_abi_channel_mmap_layout(channel,
+				(struct lttng_kernel_channel_mmap_layout __user *) arg);
+	case LTTNG_KERNEL_CHANNEL_CRITICAL:
+	{
+		struct lttng_kernel_channel_critical critical_param;
+
+		if (copy_from_user(&critical_param,
+				(struct lttng_kernel_channel_critical __user *) arg,
+				sizeof(critical_param)))
+			return -EFAULT;
+		return lttng_channel_set_critical_reserve(channel,
+				critical_param.reserve_pct);
+	}
+	case LTTNG_KERNEL_CHANNEL_READER_BARRIER:
+	{
+		struct lttng_kernel_channel_reader_barrier barrier_param;
+
+		if (copy_from_user(&barrier_param,
+				(struct lttng_kernel_channel_reader_barrier __user *) arg,
+				sizeof(barrier_param)))
+			return -EFAULT;
+		return lttng_channel_set_reader_barrier(channel,
+				barrier_param.barrier);
+	}
+	case LTTNG_KERNEL_CHANNEL_POOL:
+	{
+		struct lttng_kernel_channel_pool pool_param;
+
+		if (copy_from_user(&pool_param,
+				(struct lttng_kernel_channel_pool __user *) arg,
+				sizeof(pool_param)))
+			return -EFAULT;
+		return lttng_channel_set_pool(channel, pool_param.num_subbuf);
+	}
+	case LTTNG_KERNEL_CHANNEL_POOL_STREAM:
+		return lttng_abi_open_pool_stream(file, (int) arg);
+	case LTTNG_KERNEL_CONTEXT_GUARD:
+		if (channel->shared)
+			return -EPERM;
+		return lttng_channel_context_guard(channel,
+			(struct lttng_kernel_context_guard __user *) arg);
+	case LTTNG_KERNEL_CHANNEL_BLOCKING:
+	{
+		struct lttng_kernel_channel_blocking blocking_param;
+
+		if (copy_from_user(&blocking_param,
+				(struct lttng_kernel_channel_blocking __user *) arg,
+				sizeof(blocking_param)))
+			return -EFAULT;
+		return lttng_channel_set_blocking_timeout(channel,
+				blocking_param.timeout_us);
+	}
+	case LTTNG_KERNEL_CHANNEL_LIVE:
+	{
+		struct lttng_kernel_channel_live live_param;
+
+		if (copy_from_user(&live_param,
+				(struct lttng_kernel_channel_live __user *) arg,
+				sizeof(live_param)))
+			return -EFAULT;
+		return lttng_channel_set_live_latency(channel,
+				live_param.latency_us);
+	}
+	case LTTNG_KERNEL_CHANNEL_USER_CAPTURE:
+	{
+		struct lttng_kernel_channel_user_capture capture_param;
+
+		if (copy_from_user(&capture_param,
+				(struct lttng_kernel_channel_user_capture __user *) arg,
+				sizeof(capture_param)))
+			return -EFAULT;
+		return lttng_channel_set_user_capture(channel,
+				capture_param.max_len);
+	}
 	default:
 		return -ENOIOCTLCMD;
 	}
@@ -1384,10 +2454,23 @@ int lttng_metadata_channel_release(struct inode *inode, struct file *file)
 	return 0;
 }
 
+/*
+ * Maps the buffers of all the channel streams, laid out as reported by
+ * LTTNG_KERNEL_CHANNEL_MMAP_LAYOUT.
+ */
+static
+int lttng_channel_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct lttng_channel *channel = file->private_data;
+
+	return lib_ring_buffer_channel_mmap(channel->chan, vma);
+}
+
 static const struct file_operations lttng_channel_fops = {
 	.owner = THIS_MODULE,
 	.release = lttng_channel_release,
 	.poll = lttng_channel_poll,
+	.mmap = lttng_channel_mmap,
 	.unlocked_ioctl = lttng_channel_ioctl,
 #ifdef CONFIG_COMPAT
 	.compat_ioctl = lttng_channel_ioctl,
@@ -1417,6 +2500,34 @@ static const struct file_operations lttng_metadata_fops = {
  *		Enable recording for this event (weak enable)
  *	LTTNG_KERNEL_DISABLE
  *		Disable recording for this event (strong disable)
+ *	LTTNG_KERNEL_ADD_CALLSITE
+ *		Instrument a callsite of this uprobe event
+ *	LTTNG_KERNEL_ADD_CALLSITES
+ *		Instrument a batch of callsites of this uprobe event
+ *	LTTNG_KERNEL_FILTER_STATS
+ *		Get the filter evaluation statistics of this event, or of
+ *		the events matched by this enabler
+ *	LTTNG_KERNEL_EVENT_CRITICAL
+ *		Let this event, or the events matched by this enabler, use
+ *		the critical reserve of the channel
+ *	LTTNG_KERNEL_EVENT_RATELIMIT
+ *		Rate limit this event, or the events matched by this
+ *		enabler, per value of a context
+ *	LTTNG_KERNEL_EVENT_COUNT_ONLY
+ *		Count the hits of this event, or of the events matched by
+ *		this enabler, instead of recording them
+ *	LTTNG_KERNEL_EVENT_HIT_COUNT
+ *		Get the hits counted for this event, or summed over the
+ *		events matched by this enabler
+ *	LTTNG_KERNEL_EVENT_GATE
+ *		Condition the events matched by this enabler on session
+ *		gates, or let them open and close session gates
+ *	LTTNG_KERNEL_EVENT_COALESCE
+ *		Coalesce the runs of identical records of this event, or
+ *		of the events matched by this enabler
+ *	LTTNG_KERNEL_EVENT_BREAKER
+ *		Disarm this event, or the events matched by this enabler,
+ *		for a cooldown when they exceed a budget
  */
 static
 long lttng_event_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
@@ -1484,7 +2595,188 @@ long lttng_event_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 				(struct lttng_kernel_event_callsite __user *) arg);
 		case LTTNG_TYPE_ENABLER:
 			return -EINVAL;
+		default:
+			WARN_ON_ONCE(1);
+			return -ENOSYS;
+		}
+	case LTTNG_KERNEL_ADD_CALLSITES:
+		switch (*evtype) {
+		case LTTNG_TYPE_EVENT:
+			event = file->private_data;
+			return lttng_event_add_callsites(event,
+				(struct lttng_kernel_event_callsites __user *) arg);
+		case LTTNG_TYPE_ENABLER:
+			return -EINVAL;
+		default:
+			WARN_ON_ONCE(1);
+			return -ENOSYS;
+		}
+	case LTTNG_KERNEL_FILTER_STATS:
+	{
+		struct lttng_kernel_filter_stats stats;
+		int ret;
+
+		switch (*evtype) {
+		case LTTNG_TYPE_EVENT:
+			event = file->private_data;
+			ret = lttng_event_filter_stats(event, &stats);
+			break;
+		case LTTNG_TYPE_ENABLER:
+			enabler = file->private_data;
+			ret = lttng_enabler_filter_stats(enabler, &stats);
+			break;
+		default:
+			WARN_ON_ONCE(1);
+			return -ENOSYS;
+		}
+		if (ret)
+			return ret;
+		if (copy_to_user((struct lttng_kernel_filter_stats __user *) arg,
+				&stats, sizeof(stats)))
+			return -EFAULT;
+		return 0;
+	}
+	case LTTNG_KERNEL_EVENT_CRITICAL:
+		switch (*evtype) {
+		case LTTNG_TYPE_EVENT:
+			event = file->private_data;
+			return lttng_event_set_critical(event, (int) arg);
+		case LTTNG_TYPE_ENABLER:
+			enabler = file->private_data;
+			return lttng_enabler_set_critical(enabler, (int) arg);
+		default:
+			WARN_ON_ONCE(1);
+			return -ENOSYS;
+		}
+	case LTTNG_KERNEL_EVENT_RATELIMIT:
+	{
+		struct lttng_kernel_event_ratelimit ratelimit_param;
+
+		if (copy_from_user(&ratelimit_param,
+				(struct lttng_kernel_event_ratelimit __user *) arg,
+				sizeof(ratelimit_param)))
+			return -EFAULT;
+		switch (*evtype) {
+		case LTTNG_TYPE_EVENT:
+			event = file->private_data;
+			return lttng_event_set_ratelimit(event, &ratelimit_param);
+		case LTTNG_TYPE_ENABLER:
+			enabler = file->private_data;
+			return lttng_enabler_set_ratelimit(enabler,
+					&ratelimit_param);
+		default:
+			WARN_ON_ONCE(1);
+			return -ENOSYS;
+		}
+	}
+	case LTTNG_KERNEL_EVENT_BREAKER:
+	{
+		struct lttng_kernel_event_breaker breaker_param;
+
+		if (copy_from_user(&breaker_param,
+				(struct lttng_kernel_event_breaker __user *) arg,
+				sizeof(breaker_param)))
+			return -EFAULT;
+		switch (*evtype) {
+		case LTTNG_TYPE_EVENT:
+			event = file->private_data;
+			return lttng_event_set_breaker(event, &breaker_param);
+		case LTTNG_TYPE_ENABLER:
+			enabler = file->private_data;
+			return lttng_enabler_set_breaker(enabler,
+					&breaker_param);
+		default:
+			WARN_ON_ONCE(1);
+			return -ENOSYS;
+		}
+	}
+	case LTTNG_KERNEL_EVENT_COUNT_ONLY:
+		switch (*evtype) {
+		case LTTNG_TYPE_EVENT:
+			event = file->private_data;
+			return lttng_event_set_count_only(event, (int) arg);
+		case LTTNG_TYPE_ENABLER:
+			enabler = file->private_data;
+			return lttng_enabler_set_count_only(enabler, (int) arg);
+		default:
+			WARN_ON_ONCE(1);
+			return -ENOSYS;
+		}
+	case LTTNG_KERNEL_EVENT_HIT_COUNT:
+	{
+		struct lttng_kernel_event_hit_count hit_count;
+		int ret;
+
+		switch (*evtype) {
+		case LTTNG_TYPE_EVENT:
+			event = file->private_data;
+			ret = lttng_event_hit_count(event, &hit_count);
+			break;
+		case LTTNG_TYPE_ENABLER:
+			enabler = file->private_data;
+			ret = lttng_enabler_hit_count(enabler, &hit_count);
+			break;
+		default:
+			WARN_ON_ONCE(1);
+			return -ENOSYS;
+		}
+		if (ret)
+			return ret;
+		if (copy_to_user((struct lttng_kernel_event_hit_count __user *) arg,
+				&hit_count, sizeof(hit_count)))
+			return -EFAULT;
+		return 0;
+	}
+	case LTTNG_KERNEL_EVENT_GATE:
+	{
+		struct lttng_kernel_event_gate gate_param;
+
+		if (copy_from_user(&gate_param,
+				(struct lttng_kernel_event_gate __user *) arg,
+				sizeof(gate_param)))
+			return -EFAULT;
+		switch (*evtype) {
+		case LTTNG_TYPE_EVENT:
+			return -EINVAL;
+		case LTTNG_TYPE_ENABLER:
+			enabler = file->private_data;
+			return lttng_enabler_set_gate(enabler, &gate_param);
+		default:
+			WARN_ON_ONCE(1);
+			return -ENOSYS;
+		}
+	}
+	case LTTNG_KERNEL_EVENT_COALESCE:
+		switch (*evtype) {
+		case LTTNG_TYPE_EVENT:
+			event = file->private_data;
+			return lttng_event_set_coalesce(event, (int) arg);
+		case LTTNG_TYPE_ENABLER:
+			enabler = file->private_data;
+			return lttng_enabler_set_coalesce(enabler, (int) arg);
+		default:
+			WARN_ON_ONCE(1);
+			return -ENOSYS;
+		}
+	case LTTNG_KERNEL_FILTER_BPF:
+	{
+		struct lttng_kernel_filter_bpf bpf_param;
+
+		if (copy_from_user(&bpf_param,
+				(struct lttng_kernel_filter_bpf __user *) arg,
+				sizeof(bpf_param)))
+			return -EFAULT;
+		switch (*evtype) {
+		case LTTNG_TYPE_EVENT:
+			return -EINVAL;
+		case LTTNG_TYPE_ENABLER:
+			enabler = file->private_data;
+			return lttng_enabler_attach_bpf(enabler, &bpf_param);
+		default:
+			WARN_ON_ONCE(1);
+			return -ENOSYS;
 		}
+	}
 	default:
 		return -ENOIOCTLCMD;
 	}
@@ -1534,6 +2826,249 @@ static int put_u64(uint64_t val, unsigned long arg)
 	return put_user(val, (uint64_t __user *) arg);
 }
 
+/*
+ * Fill the descriptor of the sub-buffer currently held by the reader.
+ */
+int lttng_stream_get_packet_desc(struct lib_ring_buffer *buf,
+		struct lttng_kernel_packet_desc *desc)
+{
+	struct channel *chan = buf->backend.chan;
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+	const struct lttng_channel_ops *ops = chan->backend.priv_ops;
+
+	if (ops->timestamp_begin(config, buf, &desc->timestamp_begin) < 0
+			|| ops->timestamp_end(config, buf, &desc->timestamp_end) < 0
+			|| ops->events_discarded(config, buf, &desc->events_discarded) < 0
+			|| ops->content_size(config, buf, &desc->content_size) < 0
+			|| ops->packet_size(config, buf, &desc->packet_size) < 0
+			|| ops->stream_id(config, buf, &desc->stream_id) < 0
+			|| ops->sequence_number(config, buf, &desc->seq_num) < 0
+			|| ops->instance_id(config, buf, &desc->instance_id) < 0)
+		return -ENOSYS;
+	return 0;
+}
+
+/*
+ * Sub-buffers of a channel frozen by a trigger with a window which end
+ * before the window are released without being read, as if they had
+ * been overwritten.
+ */
+static bool lttng_stream_subbuf_before_window(struct lib_ring_buffer *buf)
+{
+	struct channel *chan = buf->backend.chan;
+	const struct lttng_channel_ops *ops = chan->backend.priv_ops;
+	struct lttng_channel *lttng_chan = channel_get_private(chan);
+	uint64_t window_start = READ_ONCE(lttng_chan->window_start), ts;
+
+	if (likely(!window_start))
+		return false;
+	if (ops->timestamp_end(&chan->backend.config, buf, &ts) < 0)
+		return false;
+	return ts < window_start;
+}
+
+/*
+ * In lazy metadata mode, sub-buffers are not handed to readers while
+ * records of the session wait for the metadata of their event. Checked
+ * once the sub-buffer is held, after the records it holds.
+ */
+static bool lttng_stream_metadata_pending(struct lib_ring_buffer *buf)
+{
+	struct lttng_channel *lttng_chan = channel_get_private(buf->backend.chan);
+
+	smp_rmb();
+	return atomic_read(&lttng_chan->session->metadata_pending) != 0;
+}
+
+/*
+ * lib_ring_buffer_get_next_subbuf(), skipping sub-buffers before the
+ * window, with -EAGAIN while metadata is pending.
+ */
+static int lttng_stream_get_next_subbuf(struct lib_ring_buffer *buf)
+{
+	int ret;
+
+	for (;;) {
+		ret = lib_ring_buffer_get_next_subbuf(buf);
+		if (ret)
+			return ret;
+		if (unlikely(lttng_stream_metadata_pending(buf))) {
+			lib_ring_buffer_put_subbuf(buf);
+			return -EAGAIN;
+		}
+		if (!lttng_stream_subbuf_before_window(buf))
+			return 0;
+		lib_ring_buffer_put_next_subbuf(buf);
+	}
+}
+
+/*
+ * lib_ring_buffer_get_subbuf(), with -EAGAIN for sub-buffers before the
+ * window, and while metadata is pending.
+ */
+static int lttng_stream_get_subbuf(struct lib_ring_buffer *buf,
+		unsigned long consumed)
+{
+	int ret;
+
+	ret = lib_ring_buffer_get_subbuf(buf, consumed);
+	if (ret)
+		return ret;
+	if (unlikely(lttng_stream_metadata_pending(buf))
+			|| lttng_stream_subbuf_before_window(buf)) {
+		lib_ring_buffer_put_subbuf(buf);
+		return -EAGAIN;
+	}
+	return 0;
+}
+
+/*
+ * Get the next sub-buffer, as RING_BUFFER_GET_NEXT_SUBBUF, and return
+ * its descriptor. The sub-buffer is released with
+ * RING_BUFFER_PUT_NEXT_SUBBUF as usual.
+ */
+static long lttng_stream_get_next_subbuf_desc(struct file *filp,
+		unsigned long arg)
+{
+	struct lib_ring_buffer *buf = filp->private_data;
+	struct lttng_kernel_packet_desc desc;
+	int ret;
+
+	ret = lttng_stream_get_next_subbuf(buf);
+	if (ret)
+		return ret;
+	/* Set file position to zero at each successful "get" */
+	filp->f_pos = 0;
+	ret = lttng_stream_get_packet_desc(buf, &desc);
+	if (ret)
+		goto error;
+	if (copy_to_user((struct lttng_kernel_packet_desc __user *) arg,
+			&desc, sizeof(desc))) {
+		ret = -EFAULT;
+		goto error;
+	}
+	return 0;
+
+error:
+	lib_ring_buffer_put_next_subbuf(buf);
+	return ret;
+}
+
+/*
+ * Return the descriptors of the fully committed sub-buffers following
+ * the consumed position, in order, without moving the consumer. Each
+ * sub-buffer is only held while its header is read, as done for
+ * snapshots, so this cannot be called while the reader holds a
+ * sub-buffer. Returns -EAGAIN (or -ENODATA once finalized) if no
+ * sub-buffer is ready.
+ */
+static long lttng_stream_get_packet_desc_batch(struct file *filp,
+		unsigned long arg)
+{
+	struct lttng_kernel_packet_desc_batch __user *ubatch =
+		(struct lttng_kernel_packet_desc_batch __user *) arg;
+	struct lib_ring_buffer *buf = filp->private_data;
+	struct channel *chan = buf->backend.chan;
+	struct lttng_kernel_packet_desc __user *udesc;
+	struct lttng_kernel_packet_desc_batch batch;
+	unsigned long consumed;
+	uint32_t i;
+	int ret = 0;
+
+	if (copy_from_user(&batch, ubatch, sizeof(batch)))
+		return -EFAULT;
+	if (buf->get_subbuf)
+		return -EBUSY;
+	udesc = (struct lttng_kernel_packet_desc __user *)
+			(unsigned long) batch.addr;
+	batch.count = min_t(uint32_t, batch.count, chan->backend.num_subbuf);
+	consumed = atomic_long_read(&buf->consumed);
+	for (i = 0; i < batch.count; i++) {
+		struct lttng_kernel_packet_desc desc;
+
+		ret = lib_ring_buffer_get_subbuf(buf,
+				consumed + i * chan->backend.subbuf_size);
+		if (ret)
+			break;
+		ret = lttng_stream_get_packet_desc(buf, &desc);
+		lib_ring_buffer_put_subbuf(buf);
+		if (ret)
+			return ret;
+		if (copy_to_user(&udesc[i], &desc, sizeof(desc)))
+			return -EFAULT;
+	}
+	if (!i && ret)
+		return ret;
+	if (put_user(i, &ubatch->count))
+		return -EFAULT;
+	return 0;
+}
+
+/*
+ * Open a secondary reader on the buffer of a stream, as a new fd.
+ */
+static
+int lttng_stream_open_secondary(struct file *stream_file)
+{
+	struct lib_ring_buffer *buf = stream_file->private_data;
+	int ret;
+
+	ret = lib_ring_buffer_open_read_secondary(buf);
+	if (ret)
+		return ret;
+	ret = lttng_abi_create_stream_fd(stream_file, buf,
+			&lib_ring_buffer_secondary_file_operations);
+	if (ret < 0)
+		lib_ring_buffer_release_read_secondary(buf);
+	return ret;
+}
+
+/*
+ * Copy the contention counters of a stream to user-space.
+ */
+static
+long lttng_stream_contention_stats(struct lib_ring_buffer *buf,
+		struct lttng_kernel_ring_buffer_contention __user *ustats)
+{
+	const struct lib_ring_buffer_config *config =
+		&buf->backend.chan->backend.config;
+	struct lttng_kernel_ring_buffer_contention stats;
+
+	memset(&stats, 0, sizeof(stats));
+	stats.reserve_retries = lib_ring_buffer_get_reserve_retries(config, buf);
+	stats.reserve_slow = lib_ring_buffer_get_reserve_slow(config, buf);
+	stats.subbuf_switches = lib_ring_buffer_get_subbuf_switches(config, buf);
+	stats.commit_overflows = lib_ring_buffer_get_commit_overflows(config, buf);
+	stats.reader_blocked = lib_ring_buffer_get_reader_blocked(config, buf);
+	if (copy_to_user(ustats, &stats, sizeof(stats)))
+		return -EFAULT;
+	return 0;
+}
+
+static
+long lttng_stream_placement(struct lib_ring_buffer *buf,
+		struct lttng_kernel_ring_buffer_placement __user *uplacement)
+{
+	struct lib_ring_buffer_backend *bufb = &buf->backend;
+	struct lttng_kernel_ring_buffer_placement placement;
+	unsigned long nr_pages, node_pages;
+
+	memset(&placement, 0, sizeof(placement));
+	placement.cpu = bufb->cpu;
+	if (bufb->chan->backend.numa_policy == RING_BUFFER_NUMA_INTERLEAVE)
+		placement.node = -1;
+	else
+		placement.node = bufb->node;
+	node_pages = lib_ring_buffer_backend_node_pages(bufb, bufb->node,
+			&nr_pages);
+	placement.nr_pages = nr_pages;
+	if (placement.node >= 0)
+		placement.node_pages = node_pages;
+	if (copy_to_user(uplacement, &placement, sizeof(placement)))
+		return -EFAULT;
+	return 0;
+}
+
 static long lttng_stream_ring_buffer_ioctl(struct file *filp,
 		unsigned int cmd, unsigned long arg)
 {
@@ -1543,10 +3078,41 @@ static long lttng_stream_ring_buffer_ioctl(struct file *filp,
 	const struct lttng_channel_ops *ops = chan->backend.priv_ops;
 	int ret;
 
-	if (atomic_read(&chan->record_disabled))
+	if (lib_ring_buffer_channel_is_disabled(chan))
 		return -EIO;
+	/* The in-kernel writer is the reader of the stream. */
+	if (cmd != LTTNG_RING_BUFFER_WRITER_STOP && lttng_stream_writer_attached(buf))
+		return -EBUSY;
 
 	switch (cmd) {
+	case RING_BUFFER_SNAPSHOT:
+		ret = lib_ring_buffer_file_operations.unlocked_ioctl(filp,
+				cmd, arg);
+		if (ret)
+			return ret;
+		return lttng_stream_snapshot_range(buf, &buf->cons_snapshot,
+				buf->prod_snapshot);
+	case RING_BUFFER_GET_NEXT_SUBBUF:
+		ret = lttng_stream_get_next_subbuf(buf);
+		if (!ret) {
+			/* Set file position to zero at each successful "get" */
+			filp->f_pos = 0;
+		}
+		return ret;
+	case RING_BUFFER_GET_SUBBUF:
+	{
+		unsigned long uconsume;
+
+		ret = get_user(uconsume, (unsigned long __user *) arg);
+		if (ret)
+			return ret; /* will return -EFAULT */
+		ret = lttng_stream_get_subbuf(buf, uconsume);
+		if (!ret) {
+			/* Set file position to zero at each successful "get" */
+			filp->f_pos = 0;
+		}
+		return ret;
+	}
 	case LTTNG_RING_BUFFER_GET_TIMESTAMP_BEGIN:
 	{
 		uint64_t ts;
@@ -1628,6 +3194,61 @@ static long lttng_stream_ring_buffer_ioctl(struct file *filp,
 			goto error;
 		return put_u64(id, arg);
 	}
+	case LTTNG_RING_BUFFER_GET_COMPRESSED_SIZE:
+	{
+		uint64_t cs;
+
+		ret = lttng_compress_get_size(buf, &cs);
+		if (ret < 0)
+			return ret;
+		return put_u64(cs, arg);
+	}
+	case LTTNG_RING_BUFFER_GET_COMPRESSED_SUBBUF:
+	{
+		struct lttng_kernel_compressed_subbuf csb;
+
+		if (copy_from_user(&csb,
+				(struct lttng_kernel_compressed_subbuf __user *) arg,
+				sizeof(csb)))
+			return -EFAULT;
+		return lttng_compress_read(buf, &csb);
+	}
+	case LTTNG_RING_BUFFER_GET_NEXT_SUBBUF_DESC:
+		return lttng_stream_get_next_subbuf_desc(filp, arg);
+	case LTTNG_RING_BUFFER_GET_PACKET_DESC_BATCH:
+		return lttng_stream_get_packet_desc_batch(filp, arg);
+	case LTTNG_RING_BUFFER_WRITER_START:
+	{
+		struct lttng_kernel_stream_writer writer_param;
+
+		if (copy_from_user(&writer_param,
+				(struct lttng_kernel_stream_writer __user *) arg,
+				sizeof(writer_param)))
+			return -EFAULT;
+		return lttng_stream_writer_start(filp, &writer_param);
+	}
+	case LTTNG_RING_BUFFER_WRITER_STOP:
+		return lttng_stream_writer_stop(buf);
+	case LTTNG_RING_BUFFER_SNAPSHOT_COPY:
+	{
+		struct lttng_kernel_snapshot_copy copy;
+
+		ret = lttng_stream_snapshot_copy(buf, &copy);
+		if (ret)
+			return ret;
+		if (copy_to_user((struct lttng_kernel_snapshot_copy __user *) arg,
+				&copy, sizeof(copy)))
+			return -EFAULT;
+		return 0;
+	}
+	case LTTNG_RING_BUFFER_GET_CONTENTION_STATS:
+		return lttng_stream_contention_stats(buf,
+			(struct lttng_kernel_ring_buffer_contention __user *) arg);
+	case LTTNG_RING_BUFFER_OPEN_SECONDARY:
+		return lttng_stream_open_secondary(filp);
+	case LTTNG_RING_BUFFER_GET_PLACEMENT:
+		return lttng_stream_placement(buf,
+			(struct lttng_kernel_ring_buffer_placement __user *) arg);
 	default:
 		return lib_ring_buffer_file_operations.unlocked_ioctl(filp,
 				cmd, arg);
@@ -1647,10 +3268,45 @@ static long lttng_stream_ring_buffer_compat_ioctl(struct file *filp,
 	const struct lttng_channel_ops *ops = chan->backend.priv_ops;
 	int ret;
 
-	if (atomic_read(&chan->record_disabled))
+	if (lib_ring_buffer_channel_is_disabled(chan))
 		return -EIO;
+	/* The in-kernel writer is the reader of the stream. */
+	if (cmd != LTTNG_RING_BUFFER_COMPAT_WRITER_STOP && lttng_stream_writer_attached(buf))
+		return -EBUSY;
 
 	switch (cmd) {
+	case RING_BUFFER_COMPAT_SNAPSHOT:
+		ret = lib_ring_buffer_file_operations.compat_ioctl(filp,
+				cmd, arg);
+		if (ret)
+			return ret;
+		return lttng_stream_snapshot_range(buf, &buf->cons_snapshot,
+				buf->prod_snapshot);
+	case RING_BUFFER_COMPAT_GET_NEXT_SUBBUF:
+		ret = lttng_stream_get_next_subbuf(buf);
+		if (!ret) {
+			/* Set file position to zero at each successful "get" */
+			filp->f_pos = 0;
+		}
+		return ret;
+	case RING_BUFFER_COMPAT_GET_SUBBUF:
+	{
+		__u32 uconsume;
+		unsigned long consume;
+
+		ret = get_user(uconsume, (__u32 __user *) arg);
+		if (ret)
+			return ret; /* will return -EFAULT */
+		consume = buf->cons_snapshot;
+		consume &= ~0xFFFFFFFFL;
+		consume |= uconsume;
+		ret = lttng_stream_get_subbuf(buf, consume);
+		if (!ret) {
+			/* Set file position to zero at each successful "get" */
+			filp->f_pos = 0;
+		}
+		return ret;
+	}
 	case LTTNG_RING_BUFFER_COMPAT_GET_TIMESTAMP_BEGIN:
 	{
 		uint64_t ts;
@@ -1732,6 +3388,61 @@ static long lttng_stream_ring_buffer_compat_ioctl(struct file *filp,
 			goto error;
 		return put_u64(id, arg);
 	}
+	case LTTNG_RING_BUFFER_COMPAT_GET_COMPRESSED_SIZE:
+	{
+		uint64_t cs;
+
+		ret = lttng_compress_get_size(buf, &cs);
+		if (ret < 0)
+			return ret;
+		return put_u64(cs, arg);
+	}
+	case LTTNG_RING_BUFFER_COMPAT_GET_COMPRESSED_SUBBUF:
+	{
+		struct lttng_kernel_compressed_subbuf csb;
+
+		if (copy_from_user(&csb,
+				(struct lttng_kernel_compressed_subbuf __user *) arg,
+				sizeof(csb)))
+			return -EFAULT;
+		return lttng_compress_read(buf, &csb);
+	}
+	case LTTNG_RING_BUFFER_COMPAT_GET_NEXT_SUBBUF_DESC:
+		return lttng_stream_get_next_subbuf_desc(filp, arg);
+	case LTTNG_RING_BUFFER_COMPAT_GET_PACKET_DESC_BATCH:
+		return lttng_stream_get_packet_desc_batch(filp, arg);
+	case LTTNG_RING_BUFFER_COMPAT_WRITER_START:
+	{
+		struct lttng_kernel_stream_writer writer_param;
+
+		if (copy_from_user(&writer_param,
+				(struct lttng_kernel_stream_writer __user *) arg,
+				sizeof(writer_param)))
+			return -EFAULT;
+		return lttng_stream_writer_start(filp, &writer_param);
+	}
+	case LTTNG_RING_BUFFER_COMPAT_WRITER_STOP:
+		return lttng_stream_writer_stop(buf);
+	case LTTNG_RING_BUFFER_COMPAT_SNAPSHOT_COPY:
+	{
+		struct lttng_kernel_snapshot_copy copy;
+
+		ret = lttng_stream_snapshot_copy(buf, &copy);
+		if (ret)
+			return ret;
+		if (copy_to_user((struct lttng_kernel_snapshot_copy __user *) arg,
+				&copy, sizeof(copy)))
+			return -EFAULT;
+		return 0;
+	}
+	case LTTNG_RING_BUFFER_COMPAT_GET_CONTENTION_STATS:
+		return lttng_stream_contention_stats(buf,
+			(struct lttng_kernel_ring_buffer_contention __user *) arg);
+	case LTTNG_RING_BUFFER_COMPAT_OPEN_SECONDARY:
+		return lttng_stream_open_secondary(filp);
+	case LTTNG_RING_BUFFER_COMPAT_GET_PLACEMENT:
+		return lttng_stream_placement(buf,
+			(struct lttng_kernel_ring_buffer_placement __user *) arg);
 	default:
 		return lib_ring_buffer_file_operations.compat_ioctl(filp,
 				cmd, arg);
@@ -1742,13 +3453,22 @@ error:
 }
 #endif /* CONFIG_COMPAT */
 
+static int lttng_stream_ring_buffer_release(struct inode *inode,
+		struct file *file)
+{
+	struct lib_ring_buffer *buf = file->private_data;
+
+	(void) lttng_stream_writer_stop(buf);
+	return lib_ring_buffer_file_operations.release(inode, file);
+}
+
 static void lttng_stream_override_ring_buffer_fops(void)
 {
 	lttng_stream_ring_buffer_file_operations.owner = THIS_MODULE;
 	lttng_stream_ring_buffer_file_operations.open =
 		lib_ring_buffer_file_operations.open;
 	lttng_stream_ring_buffer_file_operations.release =
-		lib_ring_buffer_file_operations.release;
+		lttng_stream_ring_buffer_release;
 	lttng_stream_ring_buffer_file_operations.poll =
 		lib_ring_buffer_file_operations.poll;
 	lttng_stream_ring_buffer_file_operations.splice_read =
@@ -29,6 +29,10 @@ enum lttng_kernel_instrumentation {
 	LTTNG_KERNEL_NOOP	= 4,	/* not hooked */
 	LTTNG_KERNEL_SYSCALL	= 5,
 	LTTNG_KERNEL_UPROBE	= 6,
+	LTTNG_KERNEL_FENTRY	= 7,
+	LTTNG_KERNEL_FGRAPH	= 8,
+	LTTNG_KERNEL_SAMPLER	= 9,
+	LTTNG_KERNEL_HWTRACE_SYNC	= 10,
 };
 
 /*
@@ -39,10 +43,57 @@ enum lttng_kernel_output {
 	LTTNG_KERNEL_MMAP	= 1,
 };
 
+/*
+ * NUMA placement of per-cpu buffers memory.
+ */
+enum lttng_kernel_numa_policy {
+	LTTNG_KERNEL_NUMA_LOCAL		= 0,	/* node of each cpu */
+	LTTNG_KERNEL_NUMA_INTERLEAVE	= 1,	/* pages spread over nodes */
+	LTTNG_KERNEL_NUMA_NODE		= 2,	/* node "numa_node" */
+};
+
 /*
  * LTTng DebugFS ABI structures.
  */
-#define LTTNG_KERNEL_CHANNEL_PADDING	LTTNG_KERNEL_SYM_NAME_LEN + 32
+/*
+ * Channel flags.
+ *
+ * LTTNG_KERNEL_CHANNEL_FLAG_LAZY_ALLOC: each per-cpu buffer is only
+ * allocated when an event is first recorded on its cpu. The stream
+ * appears when the buffer is ready, as after cpu hotplug, and the
+ * events dropped meanwhile are accounted as lost in its first packet.
+ *
+ * LTTNG_KERNEL_CHANNEL_FLAG_CPU_MASK: buffers are only allocated, and
+ * events only recorded, on the cpus set in the "cpu_mask" bitmap. It
+ * points to "cpu_mask_len" bytes, cpu N being bit (N % 8) of byte N / 8.
+ * Bits of cpus which are not possible are ignored.
+ *
+ * LTTNG_KERNEL_CHANNEL_FLAG_HOUSEKEEPING: the buffers of nohz_full cpus
+ * are not sent IPIs, and their timers run on housekeeping cpus. Their
+ * sub-buffer switches are done by their own writers, or from another cpu
+ * while keeping writers out for a grace period, which loses the events
+ * recorded meanwhile.
+ *
+ * LTTNG_KERNEL_CHANNEL_FLAG_PACKED: event records are laid out without
+ * alignment padding, and the metadata describes their fields as byte
+ * aligned. It trades unaligned accesses on the reader side for smaller
+ * records. Packed channels always use the delta event header.
+ *
+ * LTTNG_KERNEL_CHANNEL_FLAG_COARSE_CLOCK: events are timestamped with the
+ * jiffies counter instead of the trace clock, which is cheaper to read,
+ * for channels which do not need fine-grained timestamps. The metadata
+ * maps the timestamps of the channel to a separate "coarse" clock, with
+ * a HZ frequency. Only available on 64-bit architectures.
+ */
+#define LTTNG_KERNEL_CHANNEL_FLAG_LAZY_ALLOC	(1U << 0)
+#define LTTNG_KERNEL_CHANNEL_FLAG_CPU_MASK	(1U << 1)
+#define LTTNG_KERNEL_CHANNEL_FLAG_HOUSEKEEPING	(1U << 2)
+#define LTTNG_KERNEL_CHANNEL_FLAG_PACKED	(1U << 3)
+#define LTTNG_KERNEL_CHANNEL_FLAG_COARSE_CLOCK	(1U << 4)
+
+#define LTTNG_KERNEL_CPU_MASK_MAX_LEN	1024	/* bytes */
+
+#define LTTNG_KERNEL_CHANNEL_PADDING	LTTNG_KERNEL_SYM_NAME_LEN + 4
 struct lttng_kernel_channel {
 	uint64_t subbuf_size;			/* in bytes */
 	uint64_t num_subbuf;
@@ -50,32 +101,143 @@ struct lttng_kernel_channel {
 	unsigned int read_timer_interval;	/* usecs */
 	enum lttng_kernel_output output;	/* splice, mmap */
 	int overwrite;				/* 1: overwrite, 0: discard */
+	uint32_t numa_policy;			/* enum lttng_kernel_numa_policy */
+	int32_t numa_node;
+	uint32_t flags;				/* LTTNG_KERNEL_CHANNEL_FLAG_* */
+	uint64_t cpu_mask;			/* user-space pointer */
+	uint32_t cpu_mask_len;			/* in bytes */
+	/*
+	 * Adaptive read timer: the wakeup period of each buffer is scaled
+	 * with its sub-buffer production rate, from read_timer_interval
+	 * up to this value. 0 keeps the period fixed.
+	 */
+	uint32_t read_timer_max_interval;	/* usecs */
 	char padding[LTTNG_KERNEL_CHANNEL_PADDING];
 } __attribute__((packed));
 
+/*
+ * A non-zero threshold only records the return event, for calls lasting
+ * at least "threshold" ns, along with their duration.
+ */
 struct lttng_kernel_kretprobe {
 	uint64_t addr;
 
 	uint64_t offset;
 	char symbol_name[LTTNG_KERNEL_SYM_NAME_LEN];
+	uint64_t threshold;
 } __attribute__((packed));
 
 /*
  * Either addr is used, or symbol_name and offset.
  */
+/*
+ * Kprobe argument fetch specification. Each argument is read from a
+ * register, at its byte offset in struct pt_regs, or from a kernel stack
+ * slot, then dereferenced "nr_derefs" times: each dereference adds its
+ * offset to the value and loads from the resulting address. The last
+ * dereference reads "size" bytes, up to
+ * LTTNG_KERNEL_KPROBE_FETCH_MAX_SIZE, recorded as a byte array unless
+ * the size is the one of an integer. Without dereference, the value is
+ * recorded as an integer of "size" bytes. Faulting reads record zeroes.
+ */
+#define LTTNG_KERNEL_KPROBE_FETCH_MAX_ARGS	16
+#define LTTNG_KERNEL_KPROBE_FETCH_MAX_DEREFS	4
+#define LTTNG_KERNEL_KPROBE_FETCH_MAX_SIZE	64
+#define LTTNG_KERNEL_KPROBE_FETCH_NAME_LEN	32
+
+enum lttng_kernel_kprobe_fetch_base {
+	LTTNG_KERNEL_KPROBE_FETCH_REG		= 0,
+	LTTNG_KERNEL_KPROBE_FETCH_STACK		= 1,
+};
+
+#define LTTNG_KERNEL_KPROBE_FETCH_SIGNED	(1U << 0)
+#define LTTNG_KERNEL_KPROBE_FETCH_HEX		(1U << 1)
+
+#define LTTNG_KERNEL_KPROBE_FETCH_ARG_PADDING	16
+struct lttng_kernel_kprobe_fetch_arg {
+	char name[LTTNG_KERNEL_KPROBE_FETCH_NAME_LEN];	/* Field name */
+	uint32_t base;		/* enum lttng_kernel_kprobe_fetch_base */
+	uint32_t index;		/* pt_regs offset or stack slot */
+	uint32_t nr_derefs;
+	int32_t deref_offset[LTTNG_KERNEL_KPROBE_FETCH_MAX_DEREFS];
+	uint32_t size;		/* In bytes */
+	uint32_t flags;		/* LTTNG_KERNEL_KPROBE_FETCH_* */
+	char padding[LTTNG_KERNEL_KPROBE_FETCH_ARG_PADDING];
+} __attribute__((packed));
+
+#define LTTNG_KERNEL_KPROBE_FETCH_PADDING	12
+struct lttng_kernel_kprobe_fetch {
+	uint32_t nr_args;
+	char padding[LTTNG_KERNEL_KPROBE_FETCH_PADDING];
+	struct lttng_kernel_kprobe_fetch_arg args[0];
+} __attribute__((packed));
+
+/*
+ * A symbol name holding star globs or a comma-separated list of symbols
+ * instruments all the matching functions at "offset", with a single
+ * event. "addr" must then be 0.
+ */
 struct lttng_kernel_kprobe {
 	uint64_t addr;
 
 	uint64_t offset;
 	char symbol_name[LTTNG_KERNEL_SYM_NAME_LEN];
+	/* User-space address of a struct lttng_kernel_kprobe_fetch, or 0. */
+	uint64_t fetch;
 } __attribute__((packed));
 
 struct lttng_kernel_function_tracer {
 	char symbol_name[LTTNG_KERNEL_SYM_NAME_LEN];
 } __attribute__((packed));
 
+/*
+ * Function entry probe. The symbol name is an ftrace filter: a glob
+ * instruments all the matching functions with the same event.
+ */
+struct lttng_kernel_fentry {
+	char symbol_name[LTTNG_KERNEL_SYM_NAME_LEN];
+} __attribute__((packed));
+
+/*
+ * Function graph probe: one record per function return, with the call
+ * duration. The symbol name is a comma-separated list of globs selecting
+ * the functions, all functions if empty. Calls nested deeper than
+ * max_depth (0: unlimited) or shorter than min_duration (in ns) are not
+ * recorded.
+ */
+struct lttng_kernel_fgraph {
+	char symbol_name[LTTNG_KERNEL_SYM_NAME_LEN];
+	uint32_t max_depth;
+	uint64_t min_duration;
+} __attribute__((packed));
+
+/*
+ * Hits of each uprobe callsite are sampled before being recorded: one
+ * hit in "sample_period" (0: all), and at most one hit every
+ * "sample_interval" ns (0: no minimum, at most 60 s) are recorded.
+ */
+#define LTTNG_KERNEL_UPROBE_SAMPLE_INTERVAL_MAX	(60 * 1000000000ULL)
 struct lttng_kernel_uprobe {
 	int fd;
+	uint32_t sample_period;
+	uint64_t sample_interval;
+} __attribute__((packed));
+
+/*
+ * Periodic cpu sampler: each online cpu records a sample of the
+ * interrupted context "frequency" times per second, at most 10000.
+ */
+struct lttng_kernel_sampler {
+	uint64_t frequency;
+} __attribute__((packed));
+
+/*
+ * Hardware trace correlation markers: each online cpu records its cycle
+ * counter, which timestamps Intel PT and CoreSight traces, with the perf
+ * and trace clocks, "frequency" times per second, at most 1000.
+ */
+struct lttng_kernel_hwtrace_sync {
+	uint64_t frequency;
 } __attribute__((packed));
 
 struct lttng_kernel_event_callsite_uprobe {
@@ -88,6 +250,95 @@ struct lttng_kernel_event_callsite {
 	} u;
 } __attribute__((packed));
 
+/*
+ * Batch of uprobe callsites, added with a single ioctl. "offsets" is a
+ * user-space pointer to "nr_callsites" uint64_t offsets in the file of
+ * the event. Offsets already instrumented by the event are skipped.
+ */
+#define LTTNG_KERNEL_CALLSITES_MAX	65536
+#define LTTNG_KERNEL_CALLSITES_PADDING	16
+struct lttng_kernel_event_callsites {
+	uint32_t nr_callsites;
+	uint32_t padding1;
+	uint64_t offsets;
+	char padding[LTTNG_KERNEL_CALLSITES_PADDING];
+} __attribute__((packed));
+
+/*
+ * Filter evaluation statistics of an event, or summed over the events
+ * matched by an enabler. Each run of a filter program is counted, the
+ * filters of an event being run as a single program once fused. The
+ * cost in cycles is summed over "samples" sampled runs.
+ */
+#define LTTNG_KERNEL_FILTER_STATS_PADDING	32
+struct lttng_kernel_filter_stats {
+	uint64_t evaluations;
+	uint64_t accepts;
+	uint64_t rejects;
+	uint64_t samples;
+	uint64_t cycles;
+	char padding[LTTNG_KERNEL_FILTER_STATS_PADDING];
+} __attribute__((packed));
+
+/*
+ * Rate limit of an event, or of the events matched by an enabler. On
+ * each cpu, each value of the "key" context may record "burst" records
+ * in a row, refilled at "rate" records per second. An empty key limits
+ * the event as a whole. A rate of 0 removes the limit.
+ */
+#define LTTNG_KERNEL_EVENT_RATELIMIT_PADDING	32
+struct lttng_kernel_event_ratelimit {
+	uint32_t rate;				/* Records per second */
+	uint32_t burst;				/* Records */
+	char key[LTTNG_KERNEL_SYM_NAME_LEN];	/* Context name, or "" */
+	char padding[LTTNG_KERNEL_EVENT_RATELIMIT_PADDING];
+} __attribute__((packed));
+
+/*
+ * Circuit breaker of an event, or of the events matched by an enabler.
+ * An event exceeding its budget on a cpu, of records or of probe cycles
+ * timed by the probe profile, is disarmed until the cooldown is over. A
+ * cooldown of 0 keeps it disarmed until its breaker is set again. Budgets
+ * of 0 remove the breaker.
+ */
+#define LTTNG_KERNEL_EVENT_BREAKER_PADDING	32
+struct lttng_kernel_event_breaker {
+	uint64_t max_rate;			/* Records per second, 0: unlimited */
+	uint64_t max_cycles;			/* Cycles per second, 0: unlimited */
+	uint32_t cooldown_ms;
+	char padding[LTTNG_KERNEL_EVENT_BREAKER_PADDING];
+} __attribute__((packed));
+
+/*
+ * Hits of an event, or summed over the events matched by an enabler,
+ * counted while in count-only mode.
+ */
+#define LTTNG_KERNEL_EVENT_HIT_COUNT_PADDING	32
+struct lttng_kernel_event_hit_count {
+	uint64_t count;
+	char padding[LTTNG_KERNEL_EVENT_HIT_COUNT_PADDING];
+} __attribute__((packed));
+
+enum lttng_kernel_gate_scope {
+	LTTNG_KERNEL_GATE_SCOPE_CPU		= 0,
+	LTTNG_KERNEL_GATE_SCOPE_TASK		= 1,
+};
+
+/*
+ * Gates of the events matched by an enabler, as bitmasks of the 32
+ * session gates of a scope. The events are recorded only while all the
+ * "cond" gates are open, and open the "open" gates and close the
+ * "close" gates each time they are hit. All masks 0 remove the gates.
+ */
+#define LTTNG_KERNEL_EVENT_GATE_PADDING		32
+struct lttng_kernel_event_gate {
+	uint32_t scope;		/* enum lttng_kernel_gate_scope */
+	uint32_t cond;
+	uint32_t open;
+	uint32_t close;
+	char padding[LTTNG_KERNEL_EVENT_GATE_PADDING];
+} __attribute__((packed));
+
 /*
  * For syscall tracing, name = "*" means "enable all".
  */
@@ -104,6 +355,10 @@ struct lttng_kernel_event {
 		struct lttng_kernel_kprobe kprobe;
 		struct lttng_kernel_function_tracer ftrace;
 		struct lttng_kernel_uprobe uprobe;
+		struct lttng_kernel_fentry fentry;
+		struct lttng_kernel_fgraph fgraph;
+		struct lttng_kernel_sampler sampler;
+		struct lttng_kernel_hwtrace_sync hwtrace_sync;
 		char padding[LTTNG_KERNEL_EVENT_PADDING2];
 	} u;
 } __attribute__((packed));
@@ -127,11 +382,522 @@ struct lttng_kernel_calibrate {
 	enum lttng_kernel_calibrate_type type;	/* type (input) */
 } __attribute__((packed));
 
+/*
+ * Overhead calibration: the operation is run "iterations" times on the
+ * calling cpu, and the total time and cycles spent are returned. NONE
+ * measures the calibration loop itself, to subtract from the others.
+ * TRACEPOINT fires the lttng_calibrate tracepoint: the cost of a disabled
+ * tracepoint, or of recording the event in the sessions which enabled
+ * it, along with their contexts and filters.
+ */
+enum lttng_kernel_calibrate_op {
+	LTTNG_KERNEL_CALIBRATE_OP_NONE		= 0,	/* Empty function call */
+	LTTNG_KERNEL_CALIBRATE_OP_CLOCK		= 1,	/* Trace clock read */
+	LTTNG_KERNEL_CALIBRATE_OP_TRACEPOINT	= 2,	/* lttng_calibrate */
+	LTTNG_KERNEL_CALIBRATE_OP_KPROBE	= 3,	/* Hit, empty handler */
+	LTTNG_KERNEL_CALIBRATE_OP_KRETPROBE	= 4,	/* Hit, empty handlers */
+	LTTNG_KERNEL_CALIBRATE_OP_CONTEXT	= 5,	/* Value of context "name" */
+};
+
+#define LTTNG_KERNEL_CALIBRATE_ITERATIONS_DEFAULT	100000
+#define LTTNG_KERNEL_CALIBRATE_ITERATIONS_MAX		10000000
+#define LTTNG_KERNEL_CALIBRATE_OVERHEAD_PADDING		32
+struct lttng_kernel_calibrate_overhead {
+	uint32_t op;			/* enum lttng_kernel_calibrate_op */
+	uint32_t iterations;		/* 0: default */
+	char name[LTTNG_KERNEL_SYM_NAME_LEN];	/* Context name */
+	uint64_t total_ns;		/* Output */
+	uint64_t total_cycles;		/* Output */
+	char padding[LTTNG_KERNEL_CALIBRATE_OVERHEAD_PADDING];
+} __attribute__((packed));
+
+#define LTTNG_KERNEL_CHANNEL_SAMPLING_PADDING	32
+struct lttng_kernel_channel_sampling {
+	uint32_t period;	/* record 1 event out of "period", per cpu */
+	char padding[LTTNG_KERNEL_CHANNEL_SAMPLING_PADDING];
+} __attribute__((packed));
+
+#define LTTNG_KERNEL_CHANNEL_CRITICAL_PADDING	32
+struct lttng_kernel_channel_critical {
+	uint32_t reserve_pct;	/* of the last free sub-buffer, 0: none */
+	char padding[LTTNG_KERNEL_CHANNEL_CRITICAL_PADDING];
+} __attribute__((packed));
+
+#define LTTNG_KERNEL_CHANNEL_BLOCKING_PADDING	32
+struct lttng_kernel_channel_blocking {
+	uint32_t timeout_us;	/* wait for the consumer, 0: discard */
+	char padding[LTTNG_KERNEL_CHANNEL_BLOCKING_PADDING];
+} __attribute__((packed));
+
+enum lttng_kernel_reader_barrier {
+	LTTNG_KERNEL_READER_BARRIER_IPI = 0,	/* IPI the writer cpus */
+	LTTNG_KERNEL_READER_BARRIER_WRITER = 1,	/* writers order commits */
+};
+
+#define LTTNG_KERNEL_CHANNEL_READER_BARRIER_PADDING	32
+struct lttng_kernel_channel_reader_barrier {
+	uint32_t barrier;	/* enum lttng_kernel_reader_barrier */
+	char padding[LTTNG_KERNEL_CHANNEL_READER_BARRIER_PADDING];
+} __attribute__((packed));
+
+/*
+ * The per-cpu buffers of the channel stage its packets, copied into a
+ * pool buffer per memory node, read with LTTNG_KERNEL_CHANNEL_POOL_STREAM.
+ */
+#define LTTNG_KERNEL_CHANNEL_POOL_PADDING	32
+struct lttng_kernel_channel_pool {
+	uint64_t num_subbuf;	/* sub-buffers of each pool buffer */
+	char padding[LTTNG_KERNEL_CHANNEL_POOL_PADDING];
+} __attribute__((packed));
+
+#define LTTNG_KERNEL_CHANNEL_LIVE_PADDING	32
+struct lttng_kernel_channel_live {
+	uint32_t latency_us;	/* delivery deadline, 0: periodic flush */
+	char padding[LTTNG_KERNEL_CHANNEL_LIVE_PADDING];
+} __attribute__((packed));
+
+#define LTTNG_KERNEL_CHANNEL_USER_CAPTURE_PADDING	32
+struct lttng_kernel_channel_user_capture {
+	uint32_t max_len;	/* bytes per user field, 0: unlimited */
+	char padding[LTTNG_KERNEL_CHANNEL_USER_CAPTURE_PADDING];
+} __attribute__((packed));
+
+#define LTTNG_KERNEL_AGGREGATION_PADDING	32
+struct lttng_kernel_aggregation {
+	uint32_t nr_entries;	/* per-cpu map entries, power of 2 */
+	int32_t value_field;	/* channel context index used as value, -1: none */
+	char padding[LTTNG_KERNEL_AGGREGATION_PADDING];
+} __attribute__((packed));
+
+#define LTTNG_KERNEL_AGGREGATION_MAX_KEYS	4
+#define LTTNG_KERNEL_AGGREGATION_KEY_LEN	16
+#define LTTNG_KERNEL_AGGREGATION_HIST_BUCKETS	32
+
+union lttng_kernel_aggregation_key {
+	int64_t s64;
+	char str[LTTNG_KERNEL_AGGREGATION_KEY_LEN];
+} __attribute__((packed));
+
+/*
+ * Entries read from an aggregation map file descriptor. Keys are the
+ * values of the channel contexts (integer or string), in order. Bucket
+ * 0 of the histogram counts values <= 0, bucket n counts values in
+ * [2^(n-1), 2^n).
+ */
+struct lttng_kernel_aggregation_entry {
+	uint32_t cpu;
+	uint32_t event_id;
+	union lttng_kernel_aggregation_key keys[LTTNG_KERNEL_AGGREGATION_MAX_KEYS];
+	uint64_t count;
+	uint64_t sum;
+	uint64_t hist[LTTNG_KERNEL_AGGREGATION_HIST_BUCKETS];
+} __attribute__((packed));
+
+enum lttng_kernel_tracker_type {
+	LTTNG_KERNEL_TRACKER_CGROUP		= 0,
+	LTTNG_KERNEL_TRACKER_PID_NS		= 1,
+	LTTNG_KERNEL_TRACKER_NET_NS		= 2,
+	LTTNG_KERNEL_TRACKER_UID		= 3,
+	LTTNG_KERNEL_TRACKER_GID		= 4,
+};
+
+#define LTTNG_KERNEL_TRACKER_ID_PADDING	32
+enum lttng_kernel_statedump_mode {
+	LTTNG_KERNEL_STATEDUMP_FULL		= 0,
+	LTTNG_KERNEL_STATEDUMP_INCREMENTAL	= 1,
+};
+
+/* Statedump categories, all but TRACKED_PIDS by default. */
+#define LTTNG_KERNEL_STATEDUMP_PROCESS		(1U << 0)
+#define LTTNG_KERNEL_STATEDUMP_FD		(1U << 1)
+#define LTTNG_KERNEL_STATEDUMP_INTERRUPT	(1U << 2)
+#define LTTNG_KERNEL_STATEDUMP_NETIF		(1U << 3)
+#define LTTNG_KERNEL_STATEDUMP_BLOCK_DEVICE	(1U << 4)
+#define LTTNG_KERNEL_STATEDUMP_CPU_TOPOLOGY	(1U << 5)
+/* Only dump the processes and fds of the pids tracked by the session. */
+#define LTTNG_KERNEL_STATEDUMP_TRACKED_PIDS	(1U << 6)
+#define LTTNG_KERNEL_STATEDUMP_DEFAULT		\
+	(LTTNG_KERNEL_STATEDUMP_PROCESS | LTTNG_KERNEL_STATEDUMP_FD	\
+	 | LTTNG_KERNEL_STATEDUMP_INTERRUPT | LTTNG_KERNEL_STATEDUMP_NETIF \
+	 | LTTNG_KERNEL_STATEDUMP_BLOCK_DEVICE				\
+	 | LTTNG_KERNEL_STATEDUMP_CPU_TOPOLOGY)
+#define LTTNG_KERNEL_STATEDUMP_ALL		\
+	(LTTNG_KERNEL_STATEDUMP_DEFAULT | LTTNG_KERNEL_STATEDUMP_TRACKED_PIDS)
+
+/*
+ * Each write to the lttng-logger file is one event, or one event per
+ * line, without its newline.
+ */
+enum lttng_kernel_logger_mode {
+	LTTNG_KERNEL_LOGGER_MODE_WRITE		= 0,
+	LTTNG_KERNEL_LOGGER_MODE_LINES		= 1,
+};
+
+/* Binary format: see lttng-metadata-binary.h. */
+enum lttng_kernel_metadata_format {
+	LTTNG_KERNEL_METADATA_FORMAT_TSDL	= 0,
+	LTTNG_KERNEL_METADATA_FORMAT_BINARY	= 1,
+};
+
+struct lttng_kernel_tracker_id {
+	uint32_t type;		/* enum lttng_kernel_tracker_type */
+	int64_t id;		/* cgroup id, namespace inode, uid or gid. -1: all */
+	char padding[LTTNG_KERNEL_TRACKER_ID_PADDING];
+} __attribute__((packed));
+
+/*
+ * Session configuration batch. Each entry applies one descriptor, pointed
+ * to by "param", to a target: the session for channels, or an earlier
+ * channel or event entry of the batch, designated by its index:
+ *
+ *   CHANNEL: struct lttng_kernel_channel, target unused.
+ *   EVENT:   struct lttng_kernel_event, target is a CHANNEL entry.
+ *   CONTEXT: struct lttng_kernel_context, target is a CHANNEL entry.
+ *   FILTER:  struct lttng_kernel_filter_bytecode, target is an EVENT
+ *            entry.
+ *   ENABLE:  no descriptor, target is a CHANNEL or EVENT entry.
+ *
+ * The "fd" of CHANNEL and EVENT entries is set to the file descriptor
+ * created for them. On error, "error_index" is set to the entry which
+ * failed.
+ */
+enum lttng_kernel_session_config_type {
+	LTTNG_KERNEL_SESSION_CONFIG_CHANNEL	= 0,
+	LTTNG_KERNEL_SESSION_CONFIG_EVENT	= 1,
+	LTTNG_KERNEL_SESSION_CONFIG_CONTEXT	= 2,
+	LTTNG_KERNEL_SESSION_CONFIG_FILTER	= 3,
+	LTTNG_KERNEL_SESSION_CONFIG_ENABLE	= 4,
+};
+
+#define LTTNG_KERNEL_SESSION_CONFIG_MAX_ENTRIES	65536
+#define LTTNG_KERNEL_SESSION_CONFIG_ENTRY_PADDING	16
+struct lttng_kernel_session_config_entry {
+	uint32_t type;		/* enum lttng_kernel_session_config_type */
+	uint32_t target;	/* Index of the target entry */
+	uint64_t param;		/* user pointer to the descriptor */
+	int32_t fd;		/* Output: created file descriptor, or -1 */
+	char padding[LTTNG_KERNEL_SESSION_CONFIG_ENTRY_PADDING];
+} __attribute__((packed));
+
+#define LTTNG_KERNEL_SESSION_CONFIG_PADDING	32
+struct lttng_kernel_session_config {
+	uint64_t entries;	/* user pointer to nr_entries entries */
+	uint32_t nr_entries;
+	uint32_t error_index;	/* Output: index of the failed entry */
+	char padding[LTTNG_KERNEL_SESSION_CONFIG_PADDING];
+} __attribute__((packed));
+
+/*
+ * State of a metadata cache mapping: the metadata is the first "size"
+ * bytes of the mapping, valid as long as "version" does not change.
+ */
+struct lttng_kernel_metadata_cache_state {
+	uint64_t version;
+	uint64_t size;
+} __attribute__((packed));
+
+enum lttng_kernel_compression_algo {
+	LTTNG_KERNEL_COMPRESSION_NONE		= 0,
+	LTTNG_KERNEL_COMPRESSION_LZ4		= 1,
+};
+
+#define LTTNG_KERNEL_CHANNEL_COMPRESSION_PADDING	32
+struct lttng_kernel_channel_compression {
+	uint32_t algo;		/* enum lttng_kernel_compression_algo */
+	char padding[LTTNG_KERNEL_CHANNEL_COMPRESSION_PADDING];
+} __attribute__((packed));
+
+#define LTTNG_KERNEL_SYSCALL_LATENCY_PADDING	32
+struct lttng_kernel_syscall_latency {
+	uint32_t enable;	/* 1: record entry and exit as one event */
+	uint64_t threshold;	/* minimum duration recorded, in ns */
+	char padding[LTTNG_KERNEL_SYSCALL_LATENCY_PADDING];
+} __attribute__((packed));
+
+#define LTTNG_KERNEL_SYSCALL_SUMMARY_PADDING	32
+struct lttng_kernel_syscall_summary {
+	uint32_t enable;	/* 1: record per-process counters only */
+	uint64_t period;	/* ns between summaries, 0: at stop only */
+	char padding[LTTNG_KERNEL_SYSCALL_SUMMARY_PADDING];
+} __attribute__((packed));
+
+/*
+ * Reserve a compact header event id for the named event. Hot events
+ * must be designated before any event is created in the channel.
+ */
+#define LTTNG_KERNEL_CHANNEL_HOT_EVENT_PADDING	32
+struct lttng_kernel_channel_hot_event {
+	char name[LTTNG_KERNEL_SYM_NAME_LEN];
+	char padding[LTTNG_KERNEL_CHANNEL_HOT_EVENT_PADDING];
+} __attribute__((packed));
+
+/* Values match lttng_channel header_type. */
+enum lttng_kernel_event_header_type {
+	LTTNG_KERNEL_EVENT_HEADER_AUTO		= 0,	/* compact or large */
+	LTTNG_KERNEL_EVENT_HEADER_COMPACT	= 1,
+	LTTNG_KERNEL_EVENT_HEADER_LARGE		= 2,
+	LTTNG_KERNEL_EVENT_HEADER_DELTA		= 3,	/* variable-width timestamp */
+};
+
+/*
+ * New sub-buffer geometry of a channel. The session must be stopped, and
+ * the channel streams fully consumed and closed. They can be opened
+ * again once the channel is resized: the channel file descriptor polls
+ * in, as after cpu hotplug. Sub-buffer sizes must be queried again.
+ * Channels with compression set up cannot be resized.
+ */
+#define LTTNG_KERNEL_CHANNEL_RESIZE_PADDING	32
+struct lttng_kernel_channel_resize {
+	uint64_t subbuf_size;	/* in bytes */
+	uint64_t num_subbuf;
+	char padding[LTTNG_KERNEL_CHANNEL_RESIZE_PADDING];
+} __attribute__((packed));
+
+/*
+ * Switch the current packet of all the channel streams at once. If
+ * seq_num is not 0, it is the address of an array of nr_seq_num
+ * uint64_t, which must be at least the number of possible cpus. Entry N
+ * receives the sequence number of the first packet following the switch
+ * of the stream with instance id N, or -1ULL if there is no such stream.
+ * nr_seq_num is updated with the number of entries used.
+ */
+#define LTTNG_KERNEL_CHANNEL_FLUSH_EMPTY	(1U << 0)
+
+#define LTTNG_KERNEL_CHANNEL_FLUSH_PADDING	32
+struct lttng_kernel_channel_flush {
+	uint32_t flags;		/* LTTNG_KERNEL_CHANNEL_FLUSH_* */
+	uint32_t nr_seq_num;
+	uint64_t seq_num;	/* user-space array address, 0 for none */
+	char padding[LTTNG_KERNEL_CHANNEL_FLUSH_PADDING];
+} __attribute__((packed));
+
+/*
+ * Freeze the channel of target_fd, of the same tracer, when an event of
+ * the channel the trigger is attached to is recorded. With a window, the
+ * readers of the frozen channel skip its sub-buffers ending more than
+ * window ns before the firing.
+ */
+#define LTTNG_KERNEL_CHANNEL_TRIGGER_PADDING	24
+struct lttng_kernel_channel_trigger {
+	int32_t target_fd;	/* Channel file descriptor */
+	uint64_t window;	/* ns before the firing, 0: whole buffer */
+	char padding[LTTNG_KERNEL_CHANNEL_TRIGGER_PADDING];
+} __attribute__((packed));
+
+/*
+ * Restrict the snapshots of the streams of a channel, taken with
+ * RING_BUFFER_SNAPSHOT or LTTNG_RING_BUFFER_SNAPSHOT_COPY, to the
+ * sub-buffers ending at or after "begin", in the clock units of the
+ * packet timestamps, and to the streams of the cpus set in "cpu_mask",
+ * laid out as for the channel cpu mask. The sub-buffers before "begin"
+ * are skipped without being read, and snapshots of the streams of the
+ * other cpus fail with -ENODATA. A zero "begin" or "cpu_mask_len"
+ * removes the corresponding bound.
+ */
+#define LTTNG_KERNEL_CHANNEL_SNAPSHOT_RANGE_PADDING	32
+struct lttng_kernel_channel_snapshot_range {
+	uint64_t begin;			/* 0: no lower bound */
+	uint64_t cpu_mask;		/* user-space pointer */
+	uint32_t cpu_mask_len;		/* in bytes, 0: all cpus */
+	char padding[LTTNG_KERNEL_CHANNEL_SNAPSHOT_RANGE_PADDING];
+} __attribute__((packed));
+
+/*
+ * Layout of the mapping of a channel file descriptor, which maps the
+ * buffers of all the channel streams one after the other, each one laid
+ * out as the mapping of its stream file descriptor, without the control
+ * area. stream_len receives the length of each stream buffer. If offsets
+ * is not 0, it is the address of an array of nr_offsets uint64_t, which
+ * must be at least the number of possible cpus. Entry N receives the
+ * mmap offset of the buffer of the stream with instance id N, or -1ULL
+ * if there is no such buffer (yet). nr_offsets is updated with the
+ * number of entries used. Only for channels with mmap output.
+ */
+#define LTTNG_KERNEL_CHANNEL_MMAP_LAYOUT_PADDING	32
+struct lttng_kernel_channel_mmap_layout {
+	uint64_t stream_len;	/* out */
+	uint64_t offsets;	/* user-space array address, 0 for none */
+	uint32_t nr_offsets;
+	char padding[LTTNG_KERNEL_CHANNEL_MMAP_LAYOUT_PADDING];
+} __attribute__((packed));
+
+/*
+ * Result of LTTNG_RING_BUFFER_SNAPSHOT_COPY: nr_subbuf sub-buffers, one
+ * every subbuf_size bytes from offset in the channel snapshot area.
+ */
+#define LTTNG_KERNEL_SNAPSHOT_COPY_PADDING	32
+struct lttng_kernel_snapshot_copy {
+	uint64_t offset;	/* mmap offset of the stream slot */
+	uint64_t subbuf_size;
+	uint32_t nr_subbuf;	/* copied, oldest first */
+	uint32_t nr_lost;	/* overwritten during the copy */
+	char padding[LTTNG_KERNEL_SNAPSHOT_COPY_PADDING];
+} __attribute__((packed));
+
+/*
+ * Result of LTTNG_RING_BUFFER_GET_CONTENTION_STATS: writer contention
+ * and slow path counters of a stream, since its last reset.
+ */
+#define LTTNG_KERNEL_RING_BUFFER_CONTENTION_PADDING	32
+struct lttng_kernel_ring_buffer_contention {
+	uint64_t reserve_retries;	/* lost write offset updates */
+	uint64_t reserve_slow;		/* slow path reservations */
+	uint64_t subbuf_switches;	/* sub-buffers closed by writers */
+	uint64_t commit_overflows;	/* next sub-buffer still being committed */
+	uint64_t reader_blocked;	/* next sub-buffer not consumed */
+	char padding[LTTNG_KERNEL_RING_BUFFER_CONTENTION_PADDING];
+} __attribute__((packed));
+
+/*
+ * Result of LTTNG_RING_BUFFER_GET_PLACEMENT: the cpu a stream records,
+ * and the memory node its pages were allocated on, so that consumers
+ * may read it from a thread of that node.
+ */
+#define LTTNG_KERNEL_RING_BUFFER_PLACEMENT_PADDING	32
+struct lttng_kernel_ring_buffer_placement {
+	int32_t cpu;		/* -1 for a global stream */
+	int32_t node;		/* -1 for pages interleaved over the nodes */
+	uint64_t nr_pages;	/* pages of the stream buffer */
+	uint64_t node_pages;	/* of which allocated on node */
+	char padding[LTTNG_KERNEL_RING_BUFFER_PLACEMENT_PADDING];
+} __attribute__((packed));
+
+#define LTTNG_KERNEL_CHANNEL_EVENT_HEADER_PADDING	32
+struct lttng_kernel_channel_event_header {
+	uint32_t type;		/* enum lttng_kernel_event_header_type */
+	char padding[LTTNG_KERNEL_CHANNEL_EVENT_HEADER_PADDING];
+} __attribute__((packed));
+
+#define LTTNG_KERNEL_CHANNEL_SHARED_PADDING	32
+struct lttng_kernel_channel_shared {
+	int32_t channel_fd;	/* channel owning the buffers */
+	char padding[LTTNG_KERNEL_CHANNEL_SHARED_PADDING];
+} __attribute__((packed));
+
+struct lttng_kernel_compressed_subbuf {
+	uint64_t addr;		/* user-space destination address */
+	uint64_t len;		/* destination size, in bytes */
+} __attribute__((packed));
+
+/*
+ * Packet header fields of a sub-buffer, as returned one by one by the
+ * LTTNG_RING_BUFFER_GET_* ioctls.
+ */
+struct lttng_kernel_packet_desc {
+	uint64_t timestamp_begin;
+	uint64_t timestamp_end;
+	uint64_t events_discarded;
+	uint64_t content_size;
+	uint64_t packet_size;
+	uint64_t stream_id;
+	uint64_t seq_num;
+	uint64_t instance_id;
+} __attribute__((packed));
+
+/* Record of the packet index written by the in-kernel stream writer. */
+struct lttng_kernel_packet_index {
+	uint64_t offset;	/* Packet offset in the destination file */
+	struct lttng_kernel_packet_desc desc;
+} __attribute__((packed));
+
+#define LTTNG_KERNEL_STREAM_WRITER_PADDING	32
+struct lttng_kernel_stream_writer {
+	int32_t fd;		/* Destination file or socket */
+	int32_t index_fd;	/* Packet index file, -1: none */
+	char padding[LTTNG_KERNEL_STREAM_WRITER_PADDING];
+} __attribute__((packed));
+
+struct lttng_kernel_packet_desc_batch {
+	uint64_t addr;		/* user-space array of struct lttng_kernel_packet_desc */
+	uint32_t count;		/* in: array length, out: descriptors filled */
+} __attribute__((packed));
+
+/*
+ * Layout of the read-only memory area mapped from the LTTNG_KERNEL_CLOCK
+ * file descriptor. Each cpu entry is updated periodically by the kernel
+ * with a (cycle counter, trace clock) pair sampled on that cpu, and
+ * the rate of the last update interval. The trace clock value for a
+ * counter value "now" read on that cpu is:
+ *
+ *   value + (((now - cycles) * mult) >> shift)
+ *
+ * The cycle counter is the architecture counter used by get_cycles()
+ * (TSC on x86, cntvct on arm64). Readers retry while "seq" is odd, or
+ * when it changed across the read. An entry with mult == 0 is not
+ * calibrated yet.
+ */
+#define LTTNG_KERNEL_CLOCK_PAGE_VERSION		1
+#define LTTNG_KERNEL_CLOCK_NAME_LEN		32
+#define LTTNG_KERNEL_CLOCK_PAGE_CPU_PADDING	40
+struct lttng_kernel_clock_page_cpu {
+	uint32_t seq;
+	uint32_t mult;
+	uint64_t cycles;
+	uint64_t value;
+	char padding[LTTNG_KERNEL_CLOCK_PAGE_CPU_PADDING];
+} __attribute__((packed));
+
+#define LTTNG_KERNEL_CLOCK_PAGE_PADDING		8
+struct lttng_kernel_clock_page {
+	uint32_t version;	/* LTTNG_KERNEL_CLOCK_PAGE_VERSION */
+	uint32_t nr_cpus;	/* Number of entries in cpu[] */
+	uint32_t shift;
+	uint32_t padding0;
+	uint64_t freq;		/* Trace clock frequency, in Hz */
+	char name[LTTNG_KERNEL_CLOCK_NAME_LEN];	/* Trace clock name */
+	char padding[LTTNG_KERNEL_CLOCK_PAGE_PADDING];
+	struct lttng_kernel_clock_page_cpu cpu[0];
+} __attribute__((packed));
+
 struct lttng_kernel_syscall_mask {
 	uint32_t len;	/* in bits */
 	char mask[];
 } __attribute__((packed));
 
+/*
+ * Syscall mask of a process, laid out as for LTTNG_KERNEL_SYSCALL_MASK.
+ * Syscalls beyond len are disabled for the process.
+ */
+struct lttng_kernel_pid_syscall_mask {
+	int32_t pid;	/* Process (thread group) id */
+	uint32_t len;	/* in bits, 0: remove the mask of pid */
+	char mask[];
+} __attribute__((packed));
+
+/*
+ * Binary listing of the tracepoint or system call events. The entries
+ * are copied to "buf", each starting on 8 bytes. When the list does not
+ * fit in "len" bytes, only the first entries are copied, and "len" is
+ * set to the size of the whole list.
+ */
+#define LTTNG_KERNEL_EVENT_LIST_VERSION		1
+/* Follow each entry name by the payload record of the event. */
+#define LTTNG_KERNEL_EVENT_LIST_FIELDS		(1U << 0)
+
+#define LTTNG_KERNEL_EVENT_LIST_PADDING		32
+struct lttng_kernel_event_list {
+	uint32_t version;		/* Out: LTTNG_KERNEL_EVENT_LIST_VERSION */
+	uint32_t flags;			/* LTTNG_KERNEL_EVENT_LIST_* */
+	uint32_t instrumentation;	/* LTTNG_KERNEL_TRACEPOINT or SYSCALL */
+	uint32_t nr_entries;		/* Out: number of entries copied */
+	uint64_t len;			/* Size of buf, out: size of the list */
+	uint64_t buf;			/* User-space address of the entries */
+	char padding[LTTNG_KERNEL_EVENT_LIST_PADDING];
+} __attribute__((packed));
+
+/*
+ * The null terminated name is followed, at "fields_offset" from the
+ * start of the entry, by the payload record of the event, as described
+ * in lttng-metadata-binary.h, from its marker byte.
+ */
+struct lttng_kernel_event_list_entry {
+	uint32_t len;			/* Size of the entry, padding included */
+	uint32_t index;			/* System call table index */
+	uint32_t bitness;		/* System call bitness */
+	uint32_t fields_offset;		/* 0 without LTTNG_KERNEL_EVENT_LIST_FIELDS */
+	char name[];
+} __attribute__((packed));
+
 enum lttng_kernel_context_type {
 	LTTNG_KERNEL_CONTEXT_PID		= 0,
 	LTTNG_KERNEL_CONTEXT_PERF_COUNTER	= 1,
@@ -151,6 +917,16 @@ enum lttng_kernel_context_type {
 	LTTNG_KERNEL_CONTEXT_MIGRATABLE		= 15,
 	LTTNG_KERNEL_CONTEXT_CALLSTACK_KERNEL	= 16,
 	LTTNG_KERNEL_CONTEXT_CALLSTACK_USER	= 17,
+	LTTNG_KERNEL_CONTEXT_CALLSTACK_KERNEL_ID	= 18,
+	LTTNG_KERNEL_CONTEXT_CALLSTACK_USER_ID	= 19,
+	LTTNG_KERNEL_CONTEXT_PERF_COUNTER_GROUP	= 20,
+	LTTNG_KERNEL_CONTEXT_PROCNAME_INTERNED	= 21,
+	LTTNG_KERNEL_CONTEXT_HOSTNAME_INTERNED	= 22,
+	LTTNG_KERNEL_CONTEXT_USER_TRUNCATED	= 23,
+	LTTNG_KERNEL_CONTEXT_RATELIMIT_SUPPRESSED	= 24,
+	LTTNG_KERNEL_CONTEXT_TASK_STATE_FLAGS	= 25,
+	LTTNG_KERNEL_CONTEXT_PERF_COUNTER_DELTA	= 26,
+	LTTNG_KERNEL_CONTEXT_PERF_COUNTER_GROUP_DELTA	= 27,
 };
 
 struct lttng_kernel_perf_counter_ctx {
@@ -159,6 +935,29 @@ struct lttng_kernel_perf_counter_ctx {
 	char name[LTTNG_KERNEL_SYM_NAME_LEN];
 } __attribute__((packed));
 
+#define LTTNG_KERNEL_PERF_COUNTER_GROUP_MAX	8
+struct lttng_kernel_perf_counter_group_member {
+	uint32_t type;
+	uint64_t config;
+} __attribute__((packed));
+
+struct lttng_kernel_perf_counter_group_ctx {
+	uint64_t members;	/* user pointer to nr_members members */
+	uint32_t nr_members;
+	char name[LTTNG_KERNEL_SYM_NAME_LEN];
+} __attribute__((packed));
+
+/*
+ * The stack walks of a callstack context on each cpu take at most
+ * "max_walk_time" ns per second: once the budget of a cpu is spent,
+ * the stacks are recorded as incomplete and empty, and the stack ids as
+ * unknown, until its next 100 ms window. The budget is at most 1 s.
+ */
+struct lttng_kernel_callstack_ctx {
+	uint32_t max_depth;	/* 0: default depth */
+	uint64_t max_walk_time;	/* ns per second per cpu, 0: unlimited */
+} __attribute__((packed));
+
 #define LTTNG_KERNEL_CONTEXT_PADDING1	16
 #define LTTNG_KERNEL_CONTEXT_PADDING2	LTTNG_KERNEL_SYM_NAME_LEN + 32
 struct lttng_kernel_context {
@@ -167,6 +966,8 @@ struct lttng_kernel_context {
 
 	union {
 		struct lttng_kernel_perf_counter_ctx perf_counter;
+		struct lttng_kernel_callstack_ctx callstack;
+		struct lttng_kernel_perf_counter_group_ctx perf_counter_group;
 		char padding[LTTNG_KERNEL_CONTEXT_PADDING2];
 	} u;
 } __attribute__((packed));
@@ -179,6 +980,32 @@ struct lttng_kernel_filter_bytecode {
 	char data[0];
 } __attribute__((packed));
 
+/*
+ * Guard of the channel context named "name": the context is recorded
+ * only when the guard bytecode, run after the event filters, records
+ * the event. Other records hold an empty choice in place of its value.
+ */
+#define LTTNG_KERNEL_CONTEXT_GUARD_PADDING	32
+struct lttng_kernel_context_guard {
+	char name[LTTNG_KERNEL_SYM_NAME_LEN];
+	char padding[LTTNG_KERNEL_CONTEXT_GUARD_PADDING];
+	struct lttng_kernel_filter_bytecode bytecode;	/* Must be last */
+} __attribute__((packed));
+
+/*
+ * BPF program filter: fd of a BPF_PROG_TYPE_RAW_TRACEPOINT program,
+ * loaded with bpf(2). The program context holds the beginning of the
+ * filter stack data of the event, and the event is recorded when the
+ * program returns nonzero. Filters are combined with the bytecode
+ * filters of the enabler, ordered by seqnum.
+ */
+#define LTTNG_KERNEL_FILTER_BPF_PADDING		32
+struct lttng_kernel_filter_bpf {
+	int32_t fd;
+	uint64_t seqnum;
+	char padding[LTTNG_KERNEL_FILTER_BPF_PADDING];
+} __attribute__((packed));
+
 /* LTTng file descriptor ioctl */
 #define LTTNG_KERNEL_SESSION			_IO(0xF6, 0x45)
 #define LTTNG_KERNEL_TRACER_VERSION		\
@@ -190,6 +1017,11 @@ struct lttng_kernel_filter_bytecode {
 #define LTTNG_KERNEL_SYSCALL_LIST		_IO(0xF6, 0x4A)
 #define LTTNG_KERNEL_TRACER_ABI_VERSION		\
 	_IOR(0xF6, 0x4B, struct lttng_kernel_tracer_abi_version)
+#define LTTNG_KERNEL_CLOCK			_IO(0xF6, 0x4C)
+#define LTTNG_KERNEL_EVENT_LIST			\
+	_IOWR(0xF6, 0x4D, struct lttng_kernel_event_list)
+#define LTTNG_KERNEL_CALIBRATE_OVERHEAD		\
+	_IOWR(0xF6, 0x4E, struct lttng_kernel_calibrate_overhead)
 
 /* Session FD ioctl */
 #define LTTNG_KERNEL_METADATA			\
@@ -211,6 +1043,30 @@ struct lttng_kernel_filter_bytecode {
 #define LTTNG_KERNEL_SESSION_METADATA_REGEN	_IO(0xF6, 0x59)
 /* 0x5A and 0x5B are reserved for a future ABI-breaking cleanup. */
 #define LTTNG_KERNEL_SESSION_STATEDUMP		_IO(0xF6, 0x5C)
+#define LTTNG_KERNEL_SESSION_TRACK_ID		\
+	_IOW(0xF6, 0x5D, struct lttng_kernel_tracker_id)
+#define LTTNG_KERNEL_SESSION_UNTRACK_ID		\
+	_IOW(0xF6, 0x5E, struct lttng_kernel_tracker_id)
+/* Argument is an enum lttng_kernel_statedump_mode. */
+#define LTTNG_KERNEL_SESSION_STATEDUMP_MODE	_IOW(0xF6, 0x5F, int32_t)
+/* 0x50 to 0x5F are used up: session ioctls continue at 0xA0. */
+#define LTTNG_KERNEL_SESSION_CLEAR		_IO(0xF6, 0xA0)
+#define LTTNG_KERNEL_SESSION_CONFIGURE		\
+	_IOWR(0xF6, 0xA1, struct lttng_kernel_session_config)
+/* Argument is an enum lttng_kernel_metadata_format. */
+#define LTTNG_KERNEL_SESSION_METADATA_FORMAT	_IOW(0xF6, 0xA2, int32_t)
+/* Argument is a mask of LTTNG_KERNEL_STATEDUMP_* categories. */
+#define LTTNG_KERNEL_SESSION_STATEDUMP_MASK	_IOW(0xF6, 0xA3, uint32_t)
+/* Argument is 1 to emit the metadata of events on their first record. */
+#define LTTNG_KERNEL_SESSION_LAZY_METADATA	_IOW(0xF6, 0xA4, int32_t)
+#define LTTNG_KERNEL_SHARED_CHANNEL		\
+	_IOW(0xF6, 0xA5, struct lttng_kernel_channel_shared)
+/* Argument is a mask of LTTNG_KERNEL_SESSION_PAUSE_* flags. */
+#define LTTNG_KERNEL_SESSION_PAUSE		_IOW(0xF6, 0xA6, uint32_t)
+#define LTTNG_KERNEL_SESSION_RESUME		_IO(0xF6, 0xA7)
+
+/* Close the current packets of the session streams at the pause. */
+#define LTTNG_KERNEL_SESSION_PAUSE_FLUSH	(1U << 0)
 
 /* Channel FD ioctl */
 #define LTTNG_KERNEL_STREAM			_IO(0xF6, 0x62)
@@ -218,6 +1074,55 @@ struct lttng_kernel_filter_bytecode {
 	_IOW(0xF6, 0x63, struct lttng_kernel_event)
 #define LTTNG_KERNEL_SYSCALL_MASK		\
 	_IOWR(0xF6, 0x64, struct lttng_kernel_syscall_mask)
+#define LTTNG_KERNEL_CHANNEL_SAMPLING		\
+	_IOW(0xF6, 0x65, struct lttng_kernel_channel_sampling)
+#define LTTNG_KERNEL_AGGREGATION		\
+	_IOW(0xF6, 0x66, struct lttng_kernel_aggregation)
+#define LTTNG_KERNEL_CHANNEL_COMPRESSION	\
+	_IOW(0xF6, 0x67, struct lttng_kernel_channel_compression)
+#define LTTNG_KERNEL_SYSCALL_LATENCY		\
+	_IOW(0xF6, 0x68, struct lttng_kernel_syscall_latency)
+#define LTTNG_KERNEL_CHANNEL_HOT_EVENT		\
+	_IOW(0xF6, 0x69, struct lttng_kernel_channel_hot_event)
+#define LTTNG_KERNEL_CHANNEL_EVENT_HEADER	\
+	_IOW(0xF6, 0x6A, struct lttng_kernel_channel_event_header)
+#define LTTNG_KERNEL_CHANNEL_RESIZE		\
+	_IOW(0xF6, 0x6B, struct lttng_kernel_channel_resize)
+#define LTTNG_KERNEL_CHANNEL_READY_FD		_IO(0xF6, 0x6C)
+#define LTTNG_KERNEL_CHANNEL_FLUSH		\
+	_IOWR(0xF6, 0x6D, struct lttng_kernel_channel_flush)
+#define LTTNG_KERNEL_CHANNEL_TRIGGER		\
+	_IOW(0xF6, 0x6E, struct lttng_kernel_channel_trigger)
+
+/* Channel ioctls continue at 0x72, 0x62 to 0x6F being used up. */
+#define LTTNG_KERNEL_CHANNEL_SNAPSHOT_AREA	_IO(0xF6, 0x72)
+#define LTTNG_KERNEL_CHANNEL_CRITICAL		\
+	_IOW(0xF6, 0x73, struct lttng_kernel_channel_critical)
+#define LTTNG_KERNEL_CHANNEL_BLOCKING		\
+	_IOW(0xF6, 0x74, struct lttng_kernel_channel_blocking)
+#define LTTNG_KERNEL_CHANNEL_LIVE		\
+	_IOW(0xF6, 0x75, struct lttng_kernel_channel_live)
+#define LTTNG_KERNEL_CHANNEL_PID_SYSCALL_MASK	\
+	_IOW(0xF6, 0x76, struct lttng_kernel_pid_syscall_mask)
+#define LTTNG_KERNEL_CHANNEL_USER_CAPTURE	\
+	_IOW(0xF6, 0x77, struct lttng_kernel_channel_user_capture)
+#define LTTNG_KERNEL_SYSCALL_SUMMARY		\
+	_IOW(0xF6, 0x78, struct lttng_kernel_syscall_summary)
+#define LTTNG_KERNEL_CHANNEL_SNAPSHOT_RANGE	\
+	_IOW(0xF6, 0x79, struct lttng_kernel_channel_snapshot_range)
+#define LTTNG_KERNEL_CHANNEL_MMAP_LAYOUT	\
+	_IOWR(0xF6, 0x7A, struct lttng_kernel_channel_mmap_layout)
+#define LTTNG_KERNEL_CHANNEL_READER_BARRIER	\
+	_IOW(0xF6, 0x7B, struct lttng_kernel_channel_reader_barrier)
+#define LTTNG_KERNEL_CHANNEL_POOL		\
+	_IOW(0xF6, 0x7C, struct lttng_kernel_channel_pool)
+/* Argument is a memory node id, returns a stream file descriptor. */
+#define LTTNG_KERNEL_CHANNEL_POOL_STREAM	_IOW(0xF6, 0x7D, int32_t)
+#define LTTNG_KERNEL_CONTEXT_GUARD		\
+	_IOW(0xF6, 0x7E, struct lttng_kernel_context_guard)
+
+/* Trigger FD ioctl */
+#define LTTNG_KERNEL_TRIGGER_REARM		_IO(0xF6, 0x6F)
 
 /* Event and Channel FD ioctl */
 #define LTTNG_KERNEL_CONTEXT			\
@@ -230,6 +1135,36 @@ struct lttng_kernel_filter_bytecode {
 /* Event FD ioctl */
 #define LTTNG_KERNEL_FILTER			_IO(0xF6, 0x90)
 #define LTTNG_KERNEL_ADD_CALLSITE		_IO(0xF6, 0x91)
+#define LTTNG_KERNEL_ADD_CALLSITES		\
+	_IOW(0xF6, 0x92, struct lttng_kernel_event_callsites)
+#define LTTNG_KERNEL_FILTER_STATS		\
+	_IOR(0xF6, 0x93, struct lttng_kernel_filter_stats)
+/* Argument is 1 to flag the events critical, 0 otherwise. */
+#define LTTNG_KERNEL_EVENT_CRITICAL		_IOW(0xF6, 0x94, int32_t)
+#define LTTNG_KERNEL_EVENT_RATELIMIT		\
+	_IOW(0xF6, 0x95, struct lttng_kernel_event_ratelimit)
+#define LTTNG_KERNEL_FILTER_BPF			\
+	_IOW(0xF6, 0x96, struct lttng_kernel_filter_bpf)
+/* Argument is 1 to count the hits of the events instead of recording them. */
+#define LTTNG_KERNEL_EVENT_COUNT_ONLY		_IOW(0xF6, 0x97, int32_t)
+#define LTTNG_KERNEL_EVENT_HIT_COUNT		\
+	_IOR(0xF6, 0x98, struct lttng_kernel_event_hit_count)
+#define LTTNG_KERNEL_EVENT_GATE			\
+	_IOW(0xF6, 0x99, struct lttng_kernel_event_gate)
+/* Argument is 1 to coalesce the repeated records of the events. */
+#define LTTNG_KERNEL_EVENT_COALESCE		_IOW(0xF6, 0x9A, int32_t)
+#define LTTNG_KERNEL_EVENT_BREAKER		\
+	_IOW(0xF6, 0x9B, struct lttng_kernel_event_breaker)
+
+/* lttng-logger FD ioctl */
+#define LTTNG_KERNEL_LOGGER_MODE		_IOW(0xF6, 0xB0, int32_t)
+
+/* Metadata stream FD ioctl */
+#define LTTNG_KERNEL_METADATA_CACHE_MAP		_IO(0xF6, 0x30)
+
+/* Metadata cache mapping FD ioctl */
+#define LTTNG_KERNEL_METADATA_CACHE_STATE	\
+	_IOR(0xF6, 0x31, struct lttng_kernel_metadata_cache_state)
 
 /* LTTng-specific ioctls for the lib ringbuffer */
 /* returns the timestamp begin of the current sub-buffer */
@@ -250,6 +1185,36 @@ struct lttng_kernel_filter_bytecode {
 #define LTTNG_RING_BUFFER_GET_SEQ_NUM		_IOR(0xF6, 0x27, uint64_t)
 /* returns the stream instance id */
 #define LTTNG_RING_BUFFER_INSTANCE_ID		_IOR(0xF6, 0x28, uint64_t)
+/* returns the compressed size of the current sub-buffer */
+#define LTTNG_RING_BUFFER_GET_COMPRESSED_SIZE	_IOR(0xF6, 0x29, uint64_t)
+/* copies the compressed current sub-buffer */
+#define LTTNG_RING_BUFFER_GET_COMPRESSED_SUBBUF	\
+	_IOW(0xF6, 0x2A, struct lttng_kernel_compressed_subbuf)
+/* gets the next sub-buffer and returns its packet descriptor */
+#define LTTNG_RING_BUFFER_GET_NEXT_SUBBUF_DESC	\
+	_IOR(0xF6, 0x2B, struct lttng_kernel_packet_desc)
+/* returns the packet descriptors of the ready sub-buffers, without getting them */
+#define LTTNG_RING_BUFFER_GET_PACKET_DESC_BATCH	\
+	_IOWR(0xF6, 0x2C, struct lttng_kernel_packet_desc_batch)
+/* splices the ready sub-buffers to a file from the kernel */
+#define LTTNG_RING_BUFFER_WRITER_START		\
+	_IOW(0xF6, 0x2D, struct lttng_kernel_stream_writer)
+/* detaches the in-kernel writer, returns the error which stopped it */
+#define LTTNG_RING_BUFFER_WRITER_STOP		_IO(0xF6, 0x2E)
+/* copies the completed sub-buffers to the channel snapshot area */
+#define LTTNG_RING_BUFFER_SNAPSHOT_COPY		\
+	_IOR(0xF6, 0x2F, struct lttng_kernel_snapshot_copy)
+/* returns the writer contention counters (0x30 and 0x31 are metadata ioctls) */
+#define LTTNG_RING_BUFFER_GET_CONTENTION_STATS	\
+	_IOR(0xF6, 0x32, struct lttng_kernel_ring_buffer_contention)
+/*
+ * returns a secondary reader fd on a discard mode stream, reading through
+ * mmap without consuming: writers reuse sub-buffers released by both readers
+ */
+#define LTTNG_RING_BUFFER_OPEN_SECONDARY	_IO(0xF6, 0x33)
+/* returns the cpu and memory node of the stream */
+#define LTTNG_RING_BUFFER_GET_PLACEMENT		\
+	_IOR(0xF6, 0x34, struct lttng_kernel_ring_buffer_placement)
 
 #ifdef CONFIG_COMPAT
 /* returns the timestamp begin of the current sub-buffer */
@@ -279,6 +1244,34 @@ struct lttng_kernel_filter_bytecode {
 /* returns the stream instance id */
 #define LTTNG_RING_BUFFER_COMPAT_INSTANCE_ID	\
 	LTTNG_RING_BUFFER_INSTANCE_ID
+/* returns the compressed size of the current sub-buffer */
+#define LTTNG_RING_BUFFER_COMPAT_GET_COMPRESSED_SIZE \
+	LTTNG_RING_BUFFER_GET_COMPRESSED_SIZE
+/* copies the compressed current sub-buffer */
+#define LTTNG_RING_BUFFER_COMPAT_GET_COMPRESSED_SUBBUF \
+	LTTNG_RING_BUFFER_GET_COMPRESSED_SUBBUF
+/* gets the next sub-buffer and returns its packet descriptor */
+#define LTTNG_RING_BUFFER_COMPAT_GET_NEXT_SUBBUF_DESC \
+	LTTNG_RING_BUFFER_GET_NEXT_SUBBUF_DESC
+/* returns the packet descriptors of the ready sub-buffers, without getting them */
+#define LTTNG_RING_BUFFER_COMPAT_GET_PACKET_DESC_BATCH \
+	LTTNG_RING_BUFFER_GET_PACKET_DESC_BATCH
+/* splices the ready sub-buffers to a file from the kernel */
+#define LTTNG_RING_BUFFER_COMPAT_WRITER_START	\
+	LTTNG_RING_BUFFER_WRITER_START
+/* detaches the in-kernel writer, returns the error which stopped it */
+#define LTTNG_RING_BUFFER_COMPAT_WRITER_STOP	\
+	LTTNG_RING_BUFFER_WRITER_STOP
+/* copies the completed sub-buffers to the channel snapshot area */
+#define LTTNG_RING_BUFFER_COMPAT_SNAPSHOT_COPY	\
+	LTTNG_RING_BUFFER_SNAPSHOT_COPY
+/* returns the writer contention counters */
+#define LTTNG_RING_BUFFER_COMPAT_GET_CONTENTION_STATS	\
+	LTTNG_RING_BUFFER_GET_CONTENTION_STATS
+#define LTTNG_RING_BUFFER_COMPAT_OPEN_SECONDARY	\
+	LTTNG_RING_BUFFER_OPEN_SECONDARY
+#define LTTNG_RING_BUFFER_COMPAT_GET_PLACEMENT	\
+	LTTNG_RING_BUFFER_GET_PLACEMENT
 #endif /* CONFIG_COMPAT */
 
 #endif /* _LTTNG_ABI_H */
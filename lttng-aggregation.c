@@ -0,0 +1,384 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-aggregation.c
+ *
+ * LTTng in-kernel aggregation maps.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/err.h>
+#include <linux/file.h>
+#include <linux/anon_inodes.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/uaccess.h>
+#include <asm/local.h>
+#include <asm/local64.h>
+
+#include <wrapper/vmalloc.h>
+#include <wrapper/file.h>
+#include <lttng-events.h>
+
+/*
+ * An aggregation map is attached to a channel, which then stops
+ * recording events into its ring buffer. Instead, each event updates a
+ * per-cpu map entry keyed by the event ID and the values of the channel
+ * contexts. One of the channel contexts can be selected as value, in
+ * which case its sum and log2 histogram are kept along with the count.
+ *
+ * Each cpu only updates its own map, with preemption disabled. Entries
+ * are claimed with a local cmpxchg, so updates from nested contexts
+ * (interrupts, NMIs) are safe. Events which cannot find an entry within
+ * LTTNG_AGGREGATION_MAX_PROBE slots are dropped.
+ */
+
+#define LTTNG_AGGREGATION_MAX_PROBE	8
+#define LTTNG_AGGREGATION_MAX_ENTRIES	65536
+
+struct lttng_aggregation_slot {
+	unsigned long hash;		/* 0: free slot */
+	int ready;			/* Key is published */
+	uint32_t event_id;
+	union lttng_kernel_aggregation_key keys[LTTNG_KERNEL_AGGREGATION_MAX_KEYS];
+	local_t count;
+	local64_t sum;
+	local_t hist[LTTNG_KERNEL_AGGREGATION_HIST_BUCKETS];
+};
+
+struct lttng_aggregation_map {
+	struct lttng_channel *chan;
+	unsigned int nr_entries;	/* Per-cpu, power of 2 */
+	int value_field;		/* -1: count only */
+	unsigned int nr_keys;
+	int key_fields[LTTNG_KERNEL_AGGREGATION_MAX_KEYS];
+	struct lttng_aggregation_slot **cpu_slots;
+};
+
+static
+bool lttng_aggregation_field_is_string(const struct lttng_event_field *field)
+{
+	switch (field->type.atype) {
+	case atype_array:
+		return field->type.u.array.elem_type.u.basic.integer.encoding
+			!= lttng_encode_none;
+	case atype_sequence:
+		return field->type.u.sequence.elem_type.u.basic.integer.encoding
+			!= lttng_encode_none;
+	case atype_string:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static
+bool lttng_aggregation_field_is_integer(const struct lttng_event_field *field)
+{
+	return field->type.atype == atype_integer
+		|| field->type.atype == atype_enum;
+}
+
+static
+void lttng_aggregation_get_key(struct lttng_ctx_field *ctx_field,
+		struct lttng_probe_ctx *probe_ctx,
+		union lttng_kernel_aggregation_key *key)
+{
+	union lttng_ctx_value v;
+
+	ctx_field->get_value(ctx_field, probe_ctx, &v);
+	if (lttng_aggregation_field_is_string(&ctx_field->event_field)) {
+		strncpy(key->str, v.str, LTTNG_KERNEL_AGGREGATION_KEY_LEN - 1);
+	} else {
+		key->s64 = v.s64;
+	}
+}
+
+static
+unsigned int lttng_aggregation_hist_bucket(int64_t value)
+{
+	unsigned int bucket;
+
+	if (value <= 0)
+		return 0;
+	bucket = ilog2((u64) value) + 1;
+	return min_t(unsigned int, bucket,
+		LTTNG_KERNEL_AGGREGATION_HIST_BUCKETS - 1);
+}
+
+/*
+ * Account one event in the map of the current cpu. Called from the
+ * client reserve path with preemption disabled.
+ */
+void lttng_aggregation_update(struct lttng_aggregation_map *map,
+		struct lttng_probe_ctx *probe_ctx,
+		uint32_t event_id, int cpu)
+{
+	union lttng_kernel_aggregation_key keys[LTTNG_KERNEL_AGGREGATION_MAX_KEYS];
+	struct lttng_ctx *ctx = map->chan->ctx;
+	struct lttng_aggregation_slot *slots, *slot;
+	unsigned long hash, old;
+	unsigned int i, idx;
+	int64_t value = 0;
+
+	memset(keys, 0, sizeof(keys));
+	for (i = 0; i < map->nr_keys; i++)
+		lttng_aggregation_get_key(&ctx->fields[map->key_fields[i]],
+				probe_ctx, &keys[i]);
+	if (map->value_field >= 0) {
+		struct lttng_ctx_field *ctx_field = &ctx->fields[map->value_field];
+		union lttng_ctx_value v;
+
+		ctx_field->get_value(ctx_field, probe_ctx, &v);
+		value = v.s64;
+	}
+
+	hash = jhash(keys, sizeof(keys), event_id) | 1UL;
+	slots = map->cpu_slots[cpu];
+	idx = hash & (map->nr_entries - 1);
+	for (i = 0; i < LTTNG_AGGREGATION_MAX_PROBE; i++) {
+		slot = &slots[idx];
+		old = READ_ONCE(slot->hash);
+		if (!old) {
+			old = cmpxchg_local(&slot->hash, 0, hash);
+			if (!old) {
+				slot->event_id = event_id;
+				memcpy(slot->keys, keys, sizeof(keys));
+				/* Publish key before marking the slot ready. */
+				smp_wmb();
+				WRITE_ONCE(slot->ready, 1);
+				goto update;
+			}
+		}
+		if (old == hash) {
+			/*
+			 * Slot is being filled by the context we
+			 * interrupted: drop the event.
+			 */
+			if (!READ_ONCE(slot->ready))
+				return;
+			if (slot->event_id == event_id
+					&& !memcmp(slot->keys, keys, sizeof(keys)))
+				goto update;
+		}
+		idx = (idx + 1) & (map->nr_entries - 1);
+	}
+	return;	/* Map full: drop the event. */
+
+update:
+	local_inc(&slot->count);
+	if (map->value_field >= 0) {
+		local64_add(value, &slot->sum);
+		local_inc(&slot->hist[lttng_aggregation_hist_bucket(value)]);
+	}
+}
+EXPORT_SYMBOL_GPL(lttng_aggregation_update);
+
+/*
+ * Read entries of all cpus. The file position is the index of the next
+ * slot to read, across all cpu maps. Only whole entries are returned.
+ */
+static
+ssize_t lttng_aggregation_read(struct file *file, char __user *user_buf,
+		size_t count, loff_t *ppos)
+{
+	struct lttng_channel *chan = file->private_data;
+	struct lttng_aggregation_map *map = chan->aggregation;
+	struct lttng_kernel_aggregation_entry entry;
+	loff_t pos = *ppos, end;
+	ssize_t copied = 0;
+	unsigned int i;
+
+	if (count < sizeof(entry))
+		return -EINVAL;
+	end = (loff_t) nr_cpu_ids * map->nr_entries;
+	for (; pos < end && count - copied >= sizeof(entry); pos++) {
+		unsigned int cpu = pos / map->nr_entries;
+		struct lttng_aggregation_slot *slot;
+
+		if (!cpu_possible(cpu)) {
+			pos = (loff_t) (cpu + 1) * map->nr_entries - 1;
+			continue;
+		}
+		slot = &map->cpu_slots[cpu][pos & (map->nr_entries - 1)];
+		if (!READ_ONCE(slot->ready))
+			continue;
+		/* Read key after ready flag. */
+		smp_rmb();
+		memset(&entry, 0, sizeof(entry));
+		entry.cpu = cpu;
+		entry.event_id = slot->event_id;
+		memcpy(entry.keys, slot->keys, sizeof(entry.keys));
+		entry.count = local_read(&slot->count);
+		entry.sum = local64_read(&slot->sum);
+		for (i = 0; i < LTTNG_KERNEL_AGGREGATION_HIST_BUCKETS; i++)
+			entry.hist[i] = local_read(&slot->hist[i]);
+		if (copy_to_user(user_buf + copied, &entry, sizeof(entry)))
+			return -EFAULT;
+		copied += sizeof(entry);
+	}
+	*ppos = pos;
+	return copied;
+}
+
+static
+int lttng_aggregation_release(struct inode *inode, struct file *file)
+{
+	struct lttng_channel *chan = file->private_data;
+
+	fput(chan->file);
+	return 0;
+}
+
+static const struct file_operations lttng_aggregation_fops = {
+	.owner = THIS_MODULE,
+	.read = lttng_aggregation_read,
+	.llseek = default_llseek,
+	.release = lttng_aggregation_release,
+};
+
+static
+void lttng_aggregation_map_free(struct lttng_aggregation_map *map)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		lttng_kvfree(map->cpu_slots[cpu]);
+	kfree(map->cpu_slots);
+	kfree(map);
+}
+
+static
+struct lttng_aggregation_map *lttng_aggregation_map_alloc(
+		struct lttng_channel *chan,
+		struct lttng_kernel_aggregation *param)
+{
+	struct lttng_aggregation_map *map;
+	struct lttng_ctx *ctx = chan->ctx;
+	int cpu, i;
+
+	map = kzalloc(sizeof(*map), GFP_KERNEL);
+	if (!map)
+		return NULL;
+	map->chan = chan;
+	map->nr_entries = param->nr_entries;
+	map->value_field = param->value_field;
+	for (i = 0; ctx && i < ctx->nr_fields; i++) {
+		struct lttng_ctx_field *field = &ctx->fields[i];
+
+		if (i == map->value_field || !field->get_value)
+			continue;
+		if (map->nr_keys == LTTNG_KERNEL_AGGREGATION_MAX_KEYS)
+			break;
+		if (!lttng_aggregation_field_is_integer(&field->event_field)
+				&& !lttng_aggregation_field_is_string(&field->event_field))
+			continue;
+		map->key_fields[map->nr_keys++] = i;
+	}
+	map->cpu_slots = kcalloc(nr_cpu_ids, sizeof(*map->cpu_slots),
+			GFP_KERNEL);
+	if (!map->cpu_slots)
+		goto error;
+	for_each_possible_cpu(cpu) {
+		map->cpu_slots[cpu] = lttng_kvzalloc_node(map->nr_entries
+				* sizeof(struct lttng_aggregation_slot),
+				GFP_KERNEL | __GFP_NOWARN, cpu_to_node(cpu));
+		if (!map->cpu_slots[cpu])
+			goto error;
+	}
+	return map;
+
+error:
+	if (map->cpu_slots)
+		lttng_aggregation_map_free(map);
+	else
+		kfree(map);
+	return NULL;
+}
+
+/*
+ * Attach an aggregation map to a channel, and return a file descriptor
+ * to read its content. Must be called before the session is started.
+ */
+int lttng_channel_aggregation_create(struct lttng_channel *chan,
+		struct lttng_kernel_aggregation *param)
+{
+	struct lttng_aggregation_map *map;
+	struct file *map_file;
+	int file_fd, ret;
+
+	if (chan->channel_type == METADATA_CHANNEL)
+		return -EPERM;
+	if (!param->nr_entries
+			|| param->nr_entries > LTTNG_AGGREGATION_MAX_ENTRIES
+			|| !is_power_of_2(param->nr_entries))
+		return -EINVAL;
+	if (param->value_field >= 0) {
+		struct lttng_ctx_field *field;
+
+		if (!chan->ctx || param->value_field >= chan->ctx->nr_fields)
+			return -EINVAL;
+		field = &chan->ctx->fields[param->value_field];
+		if (!field->get_value
+				|| !lttng_aggregation_field_is_integer(&field->event_field))
+			return -EINVAL;
+	}
+
+	lttng_lock_session(chan->session);
+	if (chan->session->been_active) {
+		ret = -EBUSY;
+		goto unlock;
+	}
+	if (chan->aggregation) {
+		ret = -EEXIST;
+		goto unlock;
+	}
+	map = lttng_aggregation_map_alloc(chan, param);
+	if (!map) {
+		ret = -ENOMEM;
+		goto unlock;
+	}
+	file_fd = lttng_get_unused_fd();
+	if (file_fd < 0) {
+		ret = file_fd;
+		goto fd_error;
+	}
+	/* The map file holds a reference on the channel file. */
+	if (!atomic_long_add_unless(&chan->file->f_count, 1, LONG_MAX)) {
+		ret = -EOVERFLOW;
+		goto refcount_error;
+	}
+	map_file = anon_inode_getfile("[lttng_aggregation]",
+			&lttng_aggregation_fops, chan, O_RDONLY);
+	if (IS_ERR(map_file)) {
+		ret = PTR_ERR(map_file);
+		goto file_error;
+	}
+	chan->aggregation = map;
+	fd_install(file_fd, map_file);
+	lttng_unlock_session(chan->session);
+	return file_fd;
+
+file_error:
+	atomic_long_dec(&chan->file->f_count);
+refcount_error:
+	put_unused_fd(file_fd);
+fd_error:
+	lttng_aggregation_map_free(map);
+unlock:
+	lttng_unlock_session(chan->session);
+	return ret;
+}
+
+/*
+ * Called at channel destruction, when no probe can use the map anymore.
+ */
+void lttng_channel_aggregation_destroy(struct lttng_channel *chan)
+{
+	if (!chan->aggregation)
+		return;
+	lttng_aggregation_map_free(chan->aggregation);
+	chan->aggregation = NULL;
+}
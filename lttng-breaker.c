@@ -0,0 +1,338 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-breaker.c
+ *
+ * LTTng per-event circuit breakers.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/bitops.h>
+#include <linux/jiffies.h>
+#include <linux/irq_work.h>
+#include <linux/workqueue.h>
+#include <linux/math64.h>
+
+#include <wrapper/vmalloc.h>
+#include <wrapper/trace-clock.h>
+#include <lttng-events.h>
+
+/*
+ * A circuit breaker accounts the records of its event reaching the ring
+ * buffer client on each cpu over windows of LTTNG_BREAKER_WINDOW_MS,
+ * along with the probe cycles of the event on the cpu, as timed by the
+ * probe profile when it is built and enabled. An event exceeding either
+ * budget in a window trips its breaker: its records are discarded from
+ * then on, and the session breaker work disarms it, as if it was
+ * disabled, and emits the lttng_breaker_trip event. Once the cooldown is
+ * over, the event is armed again, and lttng_breaker_reset is emitted.
+ * The cooldown lasts at least a window, so that the windows of the cpus
+ * are over when the event is armed again.
+ *
+ * Each cpu only updates its own window, with preemption disabled.
+ * Updates by nested contexts (interrupts, NMIs) may slightly misaccount
+ * it. The trip and reset events must be enabled in the session for the
+ * trips to be accounted for by the trace.
+ */
+
+/* Define the tracepoints, but do not build the probes */
+#define CREATE_TRACE_POINTS
+#define TRACE_INCLUDE_PATH instrumentation/events/lttng-module
+#define TRACE_INCLUDE_FILE lttng-breaker
+#define LTTNG_INSTRUMENTATION
+#include <instrumentation/events/lttng-module/lttng-breaker.h>
+
+DEFINE_TRACE(lttng_breaker_trip);
+DEFINE_TRACE(lttng_breaker_reset);
+
+#define LTTNG_BREAKER_WINDOW_MS		100
+
+enum lttng_breaker_state {
+	LTTNG_BREAKER_TRIPPED = 0,	/* Budget exceeded, records discarded */
+	LTTNG_BREAKER_DISARMED,		/* Event disarmed by the work */
+};
+
+struct lttng_breaker_cpu {
+	uint64_t window_start;		/* Trace clock */
+	uint64_t count;			/* Records in the window */
+	uint64_t cycles_start;		/* Profile cycles at window start */
+};
+
+struct lttng_breaker {
+	uint64_t window;		/* Trace clock units */
+	uint64_t max_count;		/* Records per window, 0: unlimited */
+	uint64_t max_cycles;		/* Cycles per window, 0: unlimited */
+	unsigned int cooldown_ms;	/* 0: until set again */
+	unsigned long state;		/* enum lttng_breaker_state bits */
+	/* Window which tripped the breaker. */
+	unsigned int trip_cpu;
+	uint64_t trip_count, trip_cycles;
+	uint64_t nr_trips;
+	unsigned long reset_jiffies;	/* End of the cooldown */
+	struct lttng_breaker_cpu __percpu *cpus;
+};
+
+/* Cycles of the probe phases of the event on @cpu, 0 if not profiled. */
+static
+uint64_t lttng_breaker_cycles(struct lttng_event *event, int cpu)
+{
+	struct lttng_probe_profile __percpu *profile =
+		lttng_event_profile(event);
+	struct lttng_probe_profile *p;
+	uint64_t cycles = 0;
+	int phase;
+
+	if (!profile)
+		return 0;
+	p = per_cpu_ptr(profile, cpu);
+	for (phase = 0; phase < LTTNG_PROBE_PROFILE_NR_PHASES; phase++)
+		cycles += READ_ONCE(p->phase[phase].cycles);
+	return cycles;
+}
+
+/*
+ * Account a record of the event in the window of the current cpu.
+ * Returns false if the record must not be recorded. Called from the
+ * client reserve path with preemption disabled.
+ */
+bool lttng_breaker_check(struct lttng_event *event, int cpu)
+{
+	struct lttng_breaker *br = event->breaker;
+	struct lttng_breaker_cpu *bc;
+	uint64_t max_count, max_cycles, now, cycles = 0;
+
+	if (test_bit(LTTNG_BREAKER_TRIPPED, &br->state))
+		return false;
+	max_count = READ_ONCE(br->max_count);
+	max_cycles = READ_ONCE(br->max_cycles);
+	bc = per_cpu_ptr(br->cpus, cpu);
+	now = trace_clock_read64();
+	if (max_cycles)
+		cycles = lttng_breaker_cycles(event, cpu);
+	if (now - bc->window_start >= br->window) {
+		bc->window_start = now;
+		bc->count = 0;
+		bc->cycles_start = cycles;
+	}
+	bc->count++;
+	if ((!max_count || bc->count <= max_count)
+			&& (!max_cycles || cycles - bc->cycles_start <= max_cycles))
+		return true;
+	if (!test_and_set_bit(LTTNG_BREAKER_TRIPPED, &br->state)) {
+		br->trip_cpu = cpu;
+		br->trip_count = bc->count;
+		br->trip_cycles = cycles - bc->cycles_start;
+		irq_work_queue(&event->chan->session->breaker_irq_work);
+	}
+	return false;
+}
+EXPORT_SYMBOL_GPL(lttng_breaker_check);
+
+bool lttng_breaker_enabled(struct lttng_breaker *br)
+{
+	return br && (br->max_count || br->max_cycles);
+}
+
+bool lttng_breaker_disarmed(struct lttng_breaker *br)
+{
+	return br && test_bit(LTTNG_BREAKER_DISARMED, &br->state);
+}
+
+static
+void lttng_session_breaker_irq_work(struct irq_work *entry)
+{
+	struct lttng_session *session =
+		container_of(entry, struct lttng_session, breaker_irq_work);
+
+	schedule_work(&session->breaker_work);
+}
+
+/*
+ * Disarm the tripped events of the session, and arm again those whose
+ * cooldown is over. The reset work is scheduled for the next cooldown
+ * end.
+ */
+static
+void lttng_session_breaker_update(struct lttng_session *session)
+{
+	struct lttng_event *event;
+	unsigned long now = jiffies, next = 0;
+	bool pending = false;
+
+	lttng_lock_session(session);
+	list_for_each_entry(event, &session->events, list) {
+		struct lttng_breaker *br = event->breaker;
+
+		if (!br)
+			continue;
+		if (!test_bit(LTTNG_BREAKER_DISARMED, &br->state)) {
+			if (!test_bit(LTTNG_BREAKER_TRIPPED, &br->state))
+				continue;
+			br->nr_trips++;
+			br->reset_jiffies = now + msecs_to_jiffies(
+				max_t(unsigned int, br->cooldown_ms,
+					LTTNG_BREAKER_WINDOW_MS));
+			set_bit(LTTNG_BREAKER_DISARMED, &br->state);
+			trace_lttng_breaker_trip(session, event->chan->id,
+				event->id, br->trip_cpu, br->trip_count,
+				br->trip_cycles, br->cooldown_ms);
+		} else if (br->cooldown_ms
+				&& time_after_eq(now, br->reset_jiffies)) {
+			clear_bit(LTTNG_BREAKER_DISARMED, &br->state);
+			clear_bit(LTTNG_BREAKER_TRIPPED, &br->state);
+			trace_lttng_breaker_reset(session, event->chan->id,
+				event->id, br->nr_trips);
+			continue;
+		}
+		if (!br->cooldown_ms)
+			continue;
+		if (!pending || time_before(br->reset_jiffies, next))
+			next = br->reset_jiffies;
+		pending = true;
+	}
+	lttng_session_update_armed(session);
+	if (pending) {
+		cancel_delayed_work(&session->breaker_reset_work);
+		schedule_delayed_work(&session->breaker_reset_work,
+			time_after(next, now) ? next - now : 0);
+	}
+	lttng_unlock_session(session);
+}
+
+static
+void lttng_session_breaker_work(struct work_struct *work)
+{
+	lttng_session_breaker_update(container_of(work, struct lttng_session,
+			breaker_work));
+}
+
+static
+void lttng_session_breaker_reset_work(struct work_struct *work)
+{
+	lttng_session_breaker_update(container_of(to_delayed_work(work),
+			struct lttng_session, breaker_reset_work));
+}
+
+void lttng_session_breaker_init(struct lttng_session *session)
+{
+	init_irq_work(&session->breaker_irq_work,
+			lttng_session_breaker_irq_work);
+	INIT_WORK(&session->breaker_work, lttng_session_breaker_work);
+	INIT_DELAYED_WORK(&session->breaker_reset_work,
+			lttng_session_breaker_reset_work);
+}
+
+/*
+ * Called at session teardown, once no probe can trip a breaker anymore,
+ * with the sessions mutex held.
+ */
+void lttng_session_breaker_teardown(struct lttng_session *session)
+{
+	irq_work_sync(&session->breaker_irq_work);
+	cancel_work_sync(&session->breaker_work);
+	cancel_delayed_work_sync(&session->breaker_reset_work);
+}
+
+int lttng_breaker_validate(const struct lttng_kernel_event_breaker *param)
+{
+	if (!param->max_cycles)
+		return 0;
+#ifdef LTTNG_PROBE_PROFILE
+	return 0;
+#else
+	/* Cycles are only timed by the probe profile. */
+	return -ENOSYS;
+#endif
+}
+
+static
+struct lttng_breaker *lttng_breaker_alloc(void)
+{
+	struct lttng_breaker *br;
+
+	br = kzalloc(sizeof(*br), GFP_KERNEL);
+	if (!br)
+		return NULL;
+	br->window = div_u64(trace_clock_freq() * LTTNG_BREAKER_WINDOW_MS,
+			MSEC_PER_SEC);
+	br->cpus = alloc_percpu(struct lttng_breaker_cpu);
+	if (!br->cpus) {
+		kfree(br);
+		return NULL;
+	}
+	/* Ensure the memory we just allocated don't trigger page faults */
+	wrapper_vmalloc_sync_all();
+	return br;
+}
+
+void lttng_breaker_destroy(struct lttng_breaker *br)
+{
+	if (!br)
+		return;
+	free_percpu(br->cpus);
+	kfree(br);
+}
+
+/* Budget per window of a budget per second, at least 1 if set. */
+static
+uint64_t lttng_breaker_budget(uint64_t per_sec)
+{
+	if (!per_sec)
+		return 0;
+	if (per_sec > div64_u64(U64_MAX, LTTNG_BREAKER_WINDOW_MS))
+		return U64_MAX;
+	return max_t(uint64_t, div_u64(per_sec * LTTNG_BREAKER_WINDOW_MS,
+			MSEC_PER_SEC), 1);
+}
+
+/*
+ * Arm the event again, whether its cooldown is over or not. Called with
+ * the session lock held, before the armed state of the event is updated.
+ */
+void lttng_breaker_reset(struct lttng_breaker *br)
+{
+	if (!br)
+		return;
+	clear_bit(LTTNG_BREAKER_DISARMED, &br->state);
+	clear_bit(LTTNG_BREAKER_TRIPPED, &br->state);
+}
+
+/*
+ * Set the circuit breaker of an event, allocating it on first use. A
+ * NULL @param or zero budgets remove the breaker. With @reset, or once
+ * removed, a tripped breaker is reset. Called with the session lock
+ * held, before the armed state of the event is updated.
+ */
+int lttng_breaker_set(struct lttng_breaker **brp,
+		const struct lttng_kernel_event_breaker *param, bool reset)
+{
+	struct lttng_breaker *br = *brp;
+	int ret;
+
+	if (!param || !(param->max_rate | param->max_cycles)) {
+		if (br) {
+			WRITE_ONCE(br->max_count, 0);
+			WRITE_ONCE(br->max_cycles, 0);
+			lttng_breaker_reset(br);
+		}
+		return 0;
+	}
+	ret = lttng_breaker_validate(param);
+	if (ret)
+		return ret;
+	if (!br) {
+		br = lttng_breaker_alloc();
+		if (!br)
+			return -ENOMEM;
+		*brp = br;
+	}
+	WRITE_ONCE(br->max_count, lttng_breaker_budget(param->max_rate));
+	WRITE_ONCE(br->max_cycles, lttng_breaker_budget(param->max_cycles));
+	br->cooldown_ms = param->cooldown_ms;
+	if (reset)
+		lttng_breaker_reset(br);
+	return 0;
+}
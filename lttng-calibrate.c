@@ -7,8 +7,20 @@
  * Copyright (C) 2010-2012 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
  */
 
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/kprobes.h>
+#include <linux/preempt.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#include <asm/timex.h>
+
 #include <lttng-abi.h>
 #include <lttng-events.h>
+#include <wrapper/trace-clock.h>
+
+/* Iterations run with preemption disabled, between two reschedules. */
+#define LTTNG_CALIBRATE_BATCH	1000
 
 noinline
 void lttng_calibrate_kretprobe(void)
@@ -27,3 +39,168 @@ int lttng_calibrate(struct lttng_kernel_calibrate *calibrate)
 	}
 	return 0;
 }
+
+/* Target of the NONE, KPROBE and KRETPROBE overhead operations. */
+static noinline
+void lttng_calibrate_target(void)
+{
+	asm volatile ("");
+}
+
+struct lttng_calibrate_op {
+	enum lttng_kernel_calibrate_op op;
+	struct lttng_ctx_field *field;	/* CONTEXT */
+	struct lttng_probe_ctx probe_ctx;
+};
+
+static
+void lttng_calibrate_op_run(struct lttng_calibrate_op *op, unsigned int i)
+{
+	union lttng_ctx_value v;
+
+	switch (op->op) {
+	case LTTNG_KERNEL_CALIBRATE_OP_CLOCK:
+		(void) trace_clock_read64();
+		break;
+	case LTTNG_KERNEL_CALIBRATE_OP_TRACEPOINT:
+		lttng_calibrate_tracepoint(i);
+		break;
+	case LTTNG_KERNEL_CALIBRATE_OP_CONTEXT:
+		op->field->get_value(op->field, &op->probe_ctx, &v);
+		break;
+	default:
+		lttng_calibrate_target();
+		break;
+	}
+}
+
+static
+void lttng_calibrate_measure(struct lttng_calibrate_op *op,
+		struct lttng_kernel_calibrate_overhead *calibrate)
+{
+	unsigned int i = 0, batch;
+	uint64_t total_ns = 0, total_cycles = 0;
+
+	while (i < calibrate->iterations) {
+		cycles_t start_cycles;
+		ktime_t start;
+
+		batch = min_t(unsigned int, calibrate->iterations - i,
+			LTTNG_CALIBRATE_BATCH);
+		preempt_disable();
+		start = ktime_get();
+		start_cycles = get_cycles();
+		for (; batch; batch--, i++)
+			lttng_calibrate_op_run(op, i);
+		total_cycles += get_cycles() - start_cycles;
+		total_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+		preempt_enable();
+		cond_resched();
+	}
+	calibrate->total_ns = total_ns;
+	calibrate->total_cycles = total_cycles;
+}
+
+#ifdef CONFIG_KPROBES
+static
+int lttng_calibrate_kprobe_pre(struct kprobe *p, struct pt_regs *regs)
+{
+	return 0;
+}
+#endif
+
+#ifdef CONFIG_KRETPROBES
+static
+int lttng_calibrate_kretprobe_handler(struct kretprobe_instance *krpi,
+		struct pt_regs *regs)
+{
+	return 0;
+}
+#endif
+
+static
+int lttng_calibrate_probe(struct lttng_calibrate_op *op,
+		struct lttng_kernel_calibrate_overhead *calibrate)
+{
+	switch (op->op) {
+#ifdef CONFIG_KPROBES
+	case LTTNG_KERNEL_CALIBRATE_OP_KPROBE:
+	{
+		struct kprobe kp;
+		int ret;
+
+		memset(&kp, 0, sizeof(kp));
+		kp.addr = (kprobe_opcode_t *) lttng_calibrate_target;
+		kp.pre_handler = lttng_calibrate_kprobe_pre;
+		ret = register_kprobe(&kp);
+		if (ret)
+			return ret;
+		lttng_calibrate_measure(op, calibrate);
+		unregister_kprobe(&kp);
+		return 0;
+	}
+#endif
+#ifdef CONFIG_KRETPROBES
+	case LTTNG_KERNEL_CALIBRATE_OP_KRETPROBE:
+	{
+		struct kretprobe krp;
+		int ret;
+
+		memset(&krp, 0, sizeof(krp));
+		krp.kp.addr = (kprobe_opcode_t *) lttng_calibrate_target;
+		krp.entry_handler = lttng_calibrate_kretprobe_handler;
+		krp.handler = lttng_calibrate_kretprobe_handler;
+		ret = register_kretprobe(&krp);
+		if (ret)
+			return ret;
+		lttng_calibrate_measure(op, calibrate);
+		unregister_kretprobe(&krp);
+		return 0;
+	}
+#endif
+	default:
+		return -ENOSYS;
+	}
+}
+
+/*
+ * Measure the cost of @calibrate->iterations runs of an instrumentation
+ * operation on the calling cpu. Times include the calibration loop,
+ * measured alone by the NONE operation.
+ */
+int lttng_calibrate_overhead(struct lttng_kernel_calibrate_overhead *calibrate)
+{
+	struct lttng_calibrate_op op;
+	int idx;
+
+	memset(&op, 0, sizeof(op));
+	op.op = calibrate->op;
+	if (!calibrate->iterations)
+		calibrate->iterations = LTTNG_KERNEL_CALIBRATE_ITERATIONS_DEFAULT;
+	if (calibrate->iterations > LTTNG_KERNEL_CALIBRATE_ITERATIONS_MAX)
+		return -EINVAL;
+	calibrate->name[LTTNG_KERNEL_SYM_NAME_LEN - 1] = '\0';
+
+	switch (calibrate->op) {
+	case LTTNG_KERNEL_CALIBRATE_OP_NONE:
+	case LTTNG_KERNEL_CALIBRATE_OP_CLOCK:
+	case LTTNG_KERNEL_CALIBRATE_OP_TRACEPOINT:
+		break;
+	case LTTNG_KERNEL_CALIBRATE_OP_KPROBE:
+	case LTTNG_KERNEL_CALIBRATE_OP_KRETPROBE:
+		return lttng_calibrate_probe(&op, calibrate);
+	case LTTNG_KERNEL_CALIBRATE_OP_CONTEXT:
+		/* Static contexts only need the current task. */
+		idx = lttng_get_context_index(lttng_static_ctx, calibrate->name);
+		if (idx < 0)
+			return -ENOENT;
+		op.field = &lttng_static_ctx->fields[idx];
+		if (!op.field->get_value)
+			return -EINVAL;
+		break;
+	default:
+		return -EINVAL;
+	}
+	lttng_calibrate_measure(&op, calibrate);
+	return 0;
+}
@@ -0,0 +1,179 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-clock-page.c
+ *
+ * LTTng trace clock shared with user-space through a read-only mapping.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/smp.h>
+#include <linux/string.h>
+#include <linux/timex.h>
+#include <linux/math64.h>
+
+#include <wrapper/trace-clock.h>
+#include <lttng-abi.h>
+#include <lttng-events.h>
+
+/*
+ * A single clock page is shared by all LTTNG_KERNEL_CLOCK file
+ * descriptors. It is allocated on first open, and freed when the last
+ * file is released (a mapping holds a reference on its file). While it
+ * exists, each cpu entry is refreshed every LTTNG_CLOCK_PAGE_INTERVAL
+ * from an IPI on that cpu, so each entry only has a single writer.
+ *
+ * The trace clock plugin cannot change while the page exists, because
+ * lttng-tracer holds a clock reference for its whole lifetime.
+ */
+
+#define LTTNG_CLOCK_PAGE_INTERVAL	(HZ / 10)
+#define LTTNG_CLOCK_PAGE_SHIFT		24
+
+static DEFINE_MUTEX(clock_page_mutex);
+static struct lttng_kernel_clock_page *clock_page;
+static size_t clock_page_len;
+static int clock_page_refcount;
+
+static void lttng_clock_page_update_work(struct work_struct *work);
+static DECLARE_DELAYED_WORK(clock_page_work, lttng_clock_page_update_work);
+
+/* Called from IPI, with interrupts off. */
+static
+void lttng_clock_page_update_cpu(void *info)
+{
+	struct lttng_kernel_clock_page *page = info;
+	struct lttng_kernel_clock_page_cpu *entry;
+	uint64_t cycles, value, delta_cycles, delta_value, mult;
+	uint32_t seq;
+
+	entry = &page->cpu[smp_processor_id()];
+	cycles = (uint64_t) get_cycles();
+	value = trace_clock_read64();
+	mult = entry->mult;
+	delta_cycles = cycles - entry->cycles;
+	delta_value = value - entry->value;
+	if (entry->cycles && delta_cycles
+			&& delta_value <= (U64_MAX >> LTTNG_CLOCK_PAGE_SHIFT)) {
+		mult = div64_u64(delta_value << LTTNG_CLOCK_PAGE_SHIFT,
+				delta_cycles);
+		/* Keep the previous rate if it does not fit. */
+		if (mult > U32_MAX)
+			mult = entry->mult;
+	}
+
+	seq = entry->seq;
+	WRITE_ONCE(entry->seq, seq + 1);
+	smp_wmb();	/* Odd seq before content. */
+	entry->cycles = cycles;
+	entry->value = value;
+	entry->mult = (uint32_t) mult;
+	smp_wmb();	/* Content before even seq. */
+	WRITE_ONCE(entry->seq, seq + 2);
+}
+
+static
+void lttng_clock_page_update_work(struct work_struct *work)
+{
+	on_each_cpu(lttng_clock_page_update_cpu, clock_page, 1);
+	schedule_delayed_work(&clock_page_work, LTTNG_CLOCK_PAGE_INTERVAL);
+}
+
+/* Called with clock_page_mutex held. */
+static
+int lttng_clock_page_create(void)
+{
+	struct lttng_kernel_clock_page *page;
+	size_t len;
+
+	/* Architecture without cycle counter. */
+	if (!get_cycles())
+		return -ENOSYS;
+	len = PAGE_ALIGN(sizeof(*page)
+		+ nr_cpu_ids * sizeof(struct lttng_kernel_clock_page_cpu));
+	page = vmalloc_user(len);
+	if (!page)
+		return -ENOMEM;
+	page->version = LTTNG_KERNEL_CLOCK_PAGE_VERSION;
+	page->nr_cpus = nr_cpu_ids;
+	page->shift = LTTNG_CLOCK_PAGE_SHIFT;
+	page->freq = trace_clock_freq();
+	strncpy(page->name, trace_clock_name(),
+		LTTNG_KERNEL_CLOCK_NAME_LEN - 1);
+	clock_page = page;
+	clock_page_len = len;
+	/* First sample now, rates are known at the next update. */
+	on_each_cpu(lttng_clock_page_update_cpu, page, 1);
+	schedule_delayed_work(&clock_page_work, LTTNG_CLOCK_PAGE_INTERVAL);
+	return 0;
+}
+
+/* Called with clock_page_mutex held. */
+static
+void lttng_clock_page_destroy(void)
+{
+	cancel_delayed_work_sync(&clock_page_work);
+	vfree(clock_page);
+	clock_page = NULL;
+	clock_page_len = 0;
+}
+
+static
+int lttng_clock_page_open(struct inode *inode, struct file *file)
+{
+	int ret = 0;
+
+	mutex_lock(&clock_page_mutex);
+	if (!clock_page_refcount) {
+		ret = lttng_clock_page_create();
+		if (ret)
+			goto end;
+	}
+	clock_page_refcount++;
+end:
+	mutex_unlock(&clock_page_mutex);
+	return ret;
+}
+
+static
+int lttng_clock_page_release(struct inode *inode, struct file *file)
+{
+	mutex_lock(&clock_page_mutex);
+	if (!--clock_page_refcount)
+		lttng_clock_page_destroy();
+	mutex_unlock(&clock_page_mutex);
+	return 0;
+}
+
+static
+int lttng_clock_page_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	unsigned long len = vma->vm_end - vma->vm_start;
+	int ret;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	mutex_lock(&clock_page_mutex);
+	if (vma->vm_pgoff || len > clock_page_len) {
+		ret = -EINVAL;
+		goto end;
+	}
+	vma->vm_flags &= ~VM_MAYWRITE;
+	ret = remap_vmalloc_range(vma, clock_page, 0);
+end:
+	mutex_unlock(&clock_page_mutex);
+	return ret;
+}
+
+const struct file_operations lttng_clock_page_fops = {
+	.owner = THIS_MODULE,
+	.open = lttng_clock_page_open,
+	.release = lttng_clock_page_release,
+	.mmap = lttng_clock_page_mmap,
+};
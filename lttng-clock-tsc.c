@@ -0,0 +1,205 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-clock-tsc.c
+ *
+ * LTTng trace clock plugin reading the CPU cycle counter directly.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/ktime.h>
+#include <linux/delay.h>
+#include <linux/irqflags.h>
+#include <linux/math64.h>
+#include <linux/version.h>
+
+#include <lttng-tracer.h>
+#include <lttng-clock.h>
+#include <lttng-kernel-version.h>
+
+/*
+ * Loading this module replaces the mainline monotonic clock with the
+ * cycle counter as LTTng trace clock: the TSC on x86 (only when it is
+ * constant, non-stop and considered stable by the kernel), and the
+ * virtual counter (cntvct) on arm64. Reading the counter takes no lock,
+ * so it is safe to call from NMI context.
+ *
+ * The counter frequency is calibrated against the kernel monotonic
+ * clock at load time. The offset from Epoch is measured by the generic
+ * metadata code at session start, using that frequency.
+ *
+ * As for any clock plugin, this module must be loaded before the
+ * first session is created.
+ */
+
+#if defined(CONFIG_X86)
+
+#include <asm/tsc.h>
+#include <asm/cpufeature.h>
+
+static inline u64 trace_clock_tsc_read_counter(void)
+{
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,3,0))
+	return rdtsc();
+#else
+	return native_read_tsc();
+#endif
+}
+
+static int trace_clock_tsc_check(void)
+{
+	if (!boot_cpu_has(X86_FEATURE_TSC)
+			|| !boot_cpu_has(X86_FEATURE_CONSTANT_TSC)
+			|| !boot_cpu_has(X86_FEATURE_NONSTOP_TSC)) {
+		printk(KERN_WARNING "LTTng: TSC is not invariant, cannot be used as trace clock.\n");
+		return -ENODEV;
+	}
+	if (check_tsc_unstable()) {
+		printk(KERN_WARNING "LTTng: TSC is marked unstable, cannot be used as trace clock.\n");
+		return -ENODEV;
+	}
+	return 0;
+}
+
+/* Kernel-calibrated frequency, used as sanity check. */
+static u64 trace_clock_tsc_kernel_freq(void)
+{
+	return (u64) tsc_khz * 1000ULL;
+}
+
+#elif defined(CONFIG_ARM64)
+
+#include <asm/arch_timer.h>
+#include <clocksource/arm_arch_timer.h>
+
+static inline u64 trace_clock_tsc_read_counter(void)
+{
+	/* Takes care of the counter errata workarounds. */
+	return arch_timer_read_counter();
+}
+
+static int trace_clock_tsc_check(void)
+{
+	if (!arch_timer_get_rate()) {
+		printk(KERN_WARNING "LTTng: architected timer is not available, cannot be used as trace clock.\n");
+		return -ENODEV;
+	}
+	return 0;
+}
+
+static u64 trace_clock_tsc_kernel_freq(void)
+{
+	return (u64) arch_timer_get_rate();
+}
+
+#else
+#error "LTTng cycle counter trace clock is only supported on x86 and arm64."
+#endif
+
+#define TSC_CALIBRATE_MS	100
+/* Maximum divergence from the kernel frequency, in parts per million. */
+#define TSC_CALIBRATE_MAX_PPM	1000
+
+static u64 trace_clock_tsc_frequency;
+
+/*
+ * Sample the counter and the monotonic clock back to back, with
+ * interrupts disabled to keep both reads close.
+ */
+static void trace_clock_tsc_sample(u64 *cycles, u64 *ns)
+{
+	unsigned long flags;
+
+	local_irq_save(flags);
+	*cycles = trace_clock_tsc_read_counter();
+	*ns = ktime_to_ns(ktime_get());
+	local_irq_restore(flags);
+}
+
+static int trace_clock_tsc_calibrate(void)
+{
+	u64 cycles[2], ns[2], freq, kfreq, diff;
+
+	trace_clock_tsc_sample(&cycles[0], &ns[0]);
+	msleep(TSC_CALIBRATE_MS);
+	trace_clock_tsc_sample(&cycles[1], &ns[1]);
+	if (ns[1] <= ns[0] || cycles[1] <= cycles[0])
+		return -EINVAL;
+	/* Way too long, e.g. suspended: the product below could overflow. */
+	if (ns[1] - ns[0] > NSEC_PER_SEC)
+		return -EAGAIN;
+	freq = div64_u64((cycles[1] - cycles[0]) * NSEC_PER_SEC,
+			ns[1] - ns[0]);
+	kfreq = trace_clock_tsc_kernel_freq();
+	if (kfreq) {
+		diff = freq > kfreq ? freq - kfreq : kfreq - freq;
+		if (div64_u64(diff * 1000000ULL, kfreq) > TSC_CALIBRATE_MAX_PPM) {
+			printk(KERN_WARNING "LTTng: calibrated cycle counter frequency (%llu Hz) diverges from kernel frequency (%llu Hz).\n",
+				(unsigned long long) freq,
+				(unsigned long long) kfreq);
+			return -EINVAL;
+		}
+	}
+	trace_clock_tsc_frequency = freq;
+	return 0;
+}
+
+static u64 trace_clock_tsc_read64(void)
+{
+	return trace_clock_tsc_read_counter();
+}
+
+static u64 trace_clock_tsc_freq(void)
+{
+	return trace_clock_tsc_frequency;
+}
+
+static const char *trace_clock_tsc_name(void)
+{
+	return "tsc";
+}
+
+static const char *trace_clock_tsc_description(void)
+{
+	return "CPU cycle counter";
+}
+
+/* A NULL uuid callback selects the boot id, like the monotonic clock. */
+static
+struct lttng_trace_clock ltc = {
+	.read64 = trace_clock_tsc_read64,
+	.freq = trace_clock_tsc_freq,
+	.name = trace_clock_tsc_name,
+	.description = trace_clock_tsc_description,
+};
+
+static __init
+int lttng_clock_tsc_init(void)
+{
+	int ret;
+
+	ret = trace_clock_tsc_check();
+	if (ret)
+		return ret;
+	ret = trace_clock_tsc_calibrate();
+	if (ret)
+		return ret;
+	return lttng_clock_register_plugin(&ltc, THIS_MODULE);
+}
+module_init(lttng_clock_tsc_init);
+
+static __exit
+void lttng_clock_tsc_exit(void)
+{
+	lttng_clock_unregister_plugin(&ltc, THIS_MODULE);
+}
+module_exit(lttng_clock_tsc_exit);
+
+MODULE_LICENSE("GPL and additional rights");
+MODULE_AUTHOR("agent <agent@local>");
+MODULE_DESCRIPTION("LTTng cycle counter trace clock");
+MODULE_VERSION(__stringify(LTTNG_MODULES_MAJOR_VERSION) "."
+	__stringify(LTTNG_MODULES_MINOR_VERSION) "."
+	__stringify(LTTNG_MODULES_PATCHLEVEL_VERSION)
+	LTTNG_MODULES_EXTRAVERSION);
@@ -0,0 +1,79 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-coalesce.c
+ *
+ * LTTng coalescing of repeated records.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/cpu.h>
+#include <linux/workqueue.h>
+
+#include <lttng-events.h>
+
+/*
+ * The ring buffer client keeps the first record of a run of identical
+ * records of an event in coalesce mode, and discards the following
+ * ones, which are counted in the run of the cpu. The run ends with the
+ * next record of another event, with a record which differs from the
+ * kept one, or which does not immediately follow it in the buffer (e.g.
+ * the first record of a packet), and when the session is stopped. The
+ * lttng_coalesce_repeats event is then emitted with the number of
+ * repeats: it must be enabled in the session for the repeats to be
+ * accounted for by the trace.
+ */
+
+/* Define the tracepoints, but do not build the probes */
+#define CREATE_TRACE_POINTS
+#define TRACE_INCLUDE_PATH instrumentation/events/lttng-module
+#define TRACE_INCLUDE_FILE lttng-coalesce
+#define LTTNG_INSTRUMENTATION
+#include <instrumentation/events/lttng-module/lttng-coalesce.h>
+
+DEFINE_TRACE(lttng_coalesce_repeats);
+
+/* Called by the ring buffer client, from the outermost record of the cpu. */
+void lttng_coalesce_record(struct lttng_channel *chan, uint32_t id,
+		u64 count, u64 last_tsc)
+{
+	trace_lttng_coalesce_repeats(chan->session, chan->id, id, count,
+		last_tsc);
+}
+EXPORT_SYMBOL_GPL(lttng_coalesce_record);
+
+static
+long lttng_channel_coalesce_flush_cpu(void *arg)
+{
+	struct lttng_channel *chan = arg;
+
+	chan->ops->event_coalesce_flush(chan->chan);
+	return 0;
+}
+
+/*
+ * Record the pending repeats of the online cpus. Called with the
+ * session lock held, while the session is still active. Runs on each
+ * cpu from a work item, so that the flush is the outermost record.
+ */
+void lttng_channel_coalesce_flush(struct lttng_channel *chan)
+{
+	struct lttng_event *event;
+	int cpu;
+
+	/* Runs are kept per owner of the buffers. */
+	if (!chan->ops->event_coalesce_flush || chan->shared)
+		return;
+	list_for_each_entry(event, &chan->session->events, list) {
+		if (lttng_channel_owner(event->chan) == chan && event->coalesce)
+			goto flush;
+	}
+	return;
+
+flush:
+	get_online_cpus();
+	for_each_online_cpu(cpu)
+		work_on_cpu(cpu, lttng_channel_coalesce_flush_cpu, chan);
+	put_online_cpus();
+}
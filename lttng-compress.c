@@ -0,0 +1,271 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-compress.c
+ *
+ * LTTng sub-buffer compression.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/uaccess.h>
+#include <linux/lz4.h>
+
+#include <wrapper/vmalloc.h>
+#include <wrapper/ringbuffer/backend.h>
+#include <wrapper/ringbuffer/frontend.h>
+#include <lttng-events.h>
+
+/*
+ * Sub-buffers are compressed on the consumer side, in process context,
+ * the first time the consumer asks for the compressed size of the
+ * sub-buffer it holds (between get_subbuf and put_subbuf). Compressing
+ * at delivery instead would put the compression cost on the tracing
+ * fast path, which can run in NMI context.
+ *
+ * The consumer then copies the compressed data out instead of
+ * splicing or mapping the sub-buffer.
+ */
+
+#if IS_ENABLED(CONFIG_LZ4_COMPRESS)
+
+struct lttng_compress_buf {
+	struct mutex lock;		/* Serializes consumers of this buffer */
+	bool valid;			/* Cached output matches "consumed" */
+	unsigned long consumed;		/* Sub-buffer of the cached output */
+	size_t out_len;			/* Compressed size */
+	size_t out_alloc_len;
+	void *in;			/* Linearized sub-buffer */
+	void *out;			/* Compressed sub-buffer */
+	void *wrkmem;
+};
+
+static
+size_t lttng_compress_bound(size_t len)
+{
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,11,0))
+	return LZ4_compressBound(len);
+#else
+	return lz4_compressbound(len);
+#endif
+}
+
+static
+int lttng_compress_lz4(struct lttng_compress_buf *cbuf, size_t in_len)
+{
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,11,0))
+	int ret;
+
+	ret = LZ4_compress_default(cbuf->in, cbuf->out, in_len,
+			cbuf->out_alloc_len, cbuf->wrkmem);
+	if (ret <= 0)
+		return -EIO;
+	cbuf->out_len = ret;
+	return 0;
+#else
+	size_t out_len = cbuf->out_alloc_len;
+
+	if (lz4_compress(cbuf->in, in_len, cbuf->out, &out_len, cbuf->wrkmem))
+		return -EIO;
+	cbuf->out_len = out_len;
+	return 0;
+#endif
+}
+
+static
+void lttng_compress_buf_free(struct lttng_compress_buf *cbuf)
+{
+	if (!cbuf)
+		return;
+	lttng_kvfree(cbuf->in);
+	lttng_kvfree(cbuf->out);
+	lttng_kvfree(cbuf->wrkmem);
+	kfree(cbuf);
+}
+
+static
+struct lttng_compress_buf *lttng_compress_buf_alloc(size_t subbuf_size, int node)
+{
+	struct lttng_compress_buf *cbuf;
+
+	cbuf = kzalloc_node(sizeof(*cbuf), GFP_KERNEL, node);
+	if (!cbuf)
+		return NULL;
+	mutex_init(&cbuf->lock);
+	cbuf->out_alloc_len = lttng_compress_bound(subbuf_size);
+	cbuf->in = lttng_kvmalloc_node(subbuf_size, GFP_KERNEL, node);
+	cbuf->out = lttng_kvmalloc_node(cbuf->out_alloc_len, GFP_KERNEL, node);
+	cbuf->wrkmem = lttng_kvmalloc_node(LZ4_MEM_COMPRESS, GFP_KERNEL, node);
+	if (!cbuf->in || !cbuf->out || !cbuf->wrkmem) {
+		lttng_compress_buf_free(cbuf);
+		return NULL;
+	}
+	return cbuf;
+}
+
+void lttng_channel_compression_destroy(struct lttng_channel *chan)
+{
+	int cpu;
+
+	if (!chan->compress)
+		return;
+	for_each_possible_cpu(cpu)
+		lttng_compress_buf_free(chan->compress[cpu]);
+	kfree(chan->compress);
+	chan->compress = NULL;
+}
+
+int lttng_channel_set_compression(struct lttng_channel *chan,
+		struct lttng_kernel_channel_compression *param)
+{
+	size_t subbuf_size = chan->chan->backend.subbuf_size;
+	int cpu, ret = 0;
+
+	if (chan->channel_type == METADATA_CHANNEL)
+		return -EPERM;
+	switch (param->algo) {
+	case LTTNG_KERNEL_COMPRESSION_NONE:
+	case LTTNG_KERNEL_COMPRESSION_LZ4:
+		break;
+	default:
+		return -EINVAL;
+	}
+	lttng_lock_session(chan->session);
+	if (chan->session->been_active) {
+		ret = -EBUSY;
+		goto unlock;
+	}
+	if (param->algo == LTTNG_KERNEL_COMPRESSION_NONE) {
+		lttng_channel_compression_destroy(chan);
+		goto unlock;
+	}
+	if (chan->compress)
+		goto unlock;
+	chan->compress = kcalloc(nr_cpu_ids, sizeof(*chan->compress),
+			GFP_KERNEL);
+	if (!chan->compress) {
+		ret = -ENOMEM;
+		goto unlock;
+	}
+	for_each_possible_cpu(cpu) {
+		chan->compress[cpu] = lttng_compress_buf_alloc(subbuf_size,
+				cpu_to_node(cpu));
+		if (!chan->compress[cpu]) {
+			lttng_channel_compression_destroy(chan);
+			ret = -ENOMEM;
+			goto unlock;
+		}
+	}
+unlock:
+	lttng_unlock_session(chan->session);
+	return ret;
+}
+
+/*
+ * Compress the sub-buffer currently held by the consumer, unless it
+ * has already been compressed. Called with cbuf->lock held.
+ */
+static
+int lttng_compress_subbuf(struct lib_ring_buffer *buf,
+		struct lttng_compress_buf *cbuf)
+{
+	struct channel *chan = buf->backend.chan;
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+	unsigned long consumed = buf->get_subbuf_consumed;
+	size_t in_len;
+	int ret;
+
+	/* A sub-buffer must be held with get_subbuf. */
+	if (!buf->get_subbuf)
+		return -EINVAL;
+	if (cbuf->valid && cbuf->consumed == consumed)
+		return 0;
+	cbuf->valid = false;
+	in_len = lib_ring_buffer_get_read_data_size(config, buf);
+	if (lib_ring_buffer_read(&buf->backend, 0, cbuf->in, in_len) != in_len)
+		return -EIO;
+	ret = lttng_compress_lz4(cbuf, in_len);
+	if (ret)
+		return ret;
+	cbuf->consumed = consumed;
+	cbuf->valid = true;
+	return 0;
+}
+
+static
+struct lttng_compress_buf *lttng_compress_get_buf(struct lib_ring_buffer *buf)
+{
+	struct lttng_channel *lttng_chan = channel_get_private(buf->backend.chan);
+
+	if (!lttng_chan->compress || buf->backend.cpu < 0)
+		return NULL;
+	return lttng_chan->compress[buf->backend.cpu];
+}
+
+int lttng_compress_get_size(struct lib_ring_buffer *buf, uint64_t *size)
+{
+	struct lttng_compress_buf *cbuf = lttng_compress_get_buf(buf);
+	int ret;
+
+	if (!cbuf)
+		return -ENOSYS;
+	mutex_lock(&cbuf->lock);
+	ret = lttng_compress_subbuf(buf, cbuf);
+	if (!ret)
+		*size = cbuf->out_len;
+	mutex_unlock(&cbuf->lock);
+	return ret;
+}
+
+int lttng_compress_read(struct lib_ring_buffer *buf,
+		struct lttng_kernel_compressed_subbuf *param)
+{
+	struct lttng_compress_buf *cbuf = lttng_compress_get_buf(buf);
+	int ret;
+
+	if (!cbuf)
+		return -ENOSYS;
+	mutex_lock(&cbuf->lock);
+	ret = lttng_compress_subbuf(buf, cbuf);
+	if (ret)
+		goto end;
+	if (param->len < cbuf->out_len) {
+		ret = -ENOSPC;
+		goto end;
+	}
+	if (copy_to_user((void __user *) (unsigned long) param->addr,
+			cbuf->out, cbuf->out_len))
+		ret = -EFAULT;
+end:
+	mutex_unlock(&cbuf->lock);
+	return ret;
+}
+
+#else /* IS_ENABLED(CONFIG_LZ4_COMPRESS) */
+
+void lttng_channel_compression_destroy(struct lttng_channel *chan)
+{
+}
+
+int lttng_channel_set_compression(struct lttng_channel *chan,
+		struct lttng_kernel_channel_compression *param)
+{
+	if (param->algo == LTTNG_KERNEL_COMPRESSION_NONE)
+		return 0;
+	return -ENOSYS;
+}
+
+int lttng_compress_get_size(struct lib_ring_buffer *buf, uint64_t *size)
+{
+	return -ENOSYS;
+}
+
+int lttng_compress_read(struct lib_ring_buffer *buf,
+		struct lttng_kernel_compressed_subbuf *param)
+{
+	return -ENOSYS;
+}
+
+#endif /* IS_ENABLED(CONFIG_LZ4_COMPRESS) */
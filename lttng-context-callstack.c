@@ -23,18 +23,39 @@
  * The allocation is done at the initialization to avoid memory
  * allocation overhead while tracing, using a shallow stack.
  *
- * The kernel callstack is recovered using save_stack_trace(), and the
- * userspace callstack uses save_stack_trace_user(). They rely on frame
- * pointers. These are usually available for the kernel, but the
- * compiler option -fomit-frame-pointer frequently used in popular Linux
- * distributions may cause the userspace callstack to be unreliable, and
- * is a known limitation of this approach. If frame pointers are not
- * available, it produces no error, but the callstack will be empty. We
- * still provide the feature, because it works well for runtime
- * environments having frame pointers. In the future, unwind support
- * and/or last branch record may provide a solution to this problem.
+ * The kernel callstack is recovered using save_stack_trace(), which
+ * uses the unwinder the kernel is built with: on x86, kernels built with
+ * CONFIG_UNWINDER_ORC are unwound with ORC and do not need frame
+ * pointers. The userspace callstack uses save_stack_trace_user(), which
+ * relies on frame pointers. The compiler option -fomit-frame-pointer
+ * frequently used in popular Linux distributions may cause the
+ * userspace callstack to be unreliable, and is a known limitation of
+ * this approach. If frame pointers are not available, it produces no
+ * error, but the callstack will be empty. We still provide the feature,
+ * because it works well for runtime environments having frame pointers.
+ *
+ * The maximum depth can be lowered per context, which bounds both the
+ * capture cost and the record size. The time spent walking the stacks
+ * can also be bounded per context on each cpu, over windows of
+ * LTTNG_CS_WINDOW_MS: the stacks of the events following a spent
+ * budget are not walked, and are recorded as empty and incomplete (a
+ * lone ULONG_MAX delimiter), or as LTTNG_CS_ID_NONE. Mostly useful for
+ * user stacks, whose walk may fault.
  *
  * The symbol name resolution is left to the trace reader.
+ *
+ * The callstack_kernel_id and callstack_user_id variants record a
+ * 32-bit stack id instead of the stack. Each context field has its own
+ * table of stacks, filled locklessly from the probe: a slot is claimed
+ * with cmpxchg, its entries are copied to a preallocated arena, and the
+ * slot is published. Concurrent insertions of the same stack may give
+ * it two ids, which is harmless. The first time a stack is seen, the
+ * lttng_callstack_id event is emitted with the stack, from the
+ * reservation of the event being recorded: the nested record makes the
+ * outer reservation retry, which then finds the stack in the table.
+ * The lttng_callstack_id event must be enabled in the session for the
+ * ids to be resolved. When the table is full, LTTNG_CS_ID_NONE is
+ * recorded.
  */
 
 #include <linux/module.h>
@@ -43,14 +64,54 @@
 #include <linux/utsname.h>
 #include <linux/stacktrace.h>
 #include <linux/spinlock.h>
+#include <linux/jhash.h>
+#include <linux/math64.h>
 #include "lttng-events.h"
 #include "wrapper/ringbuffer/backend.h"
 #include "wrapper/ringbuffer/frontend.h"
+#include "wrapper/trace-clock.h"
 #include "wrapper/vmalloc.h"
 #include "lttng-tracer.h"
 
+/* Define the tracepoints, but do not build the probes */
+#define CREATE_TRACE_POINTS
+#define TRACE_INCLUDE_PATH instrumentation/events/lttng-module
+#define TRACE_INCLUDE_FILE lttng-callstack
+#define LTTNG_INSTRUMENTATION
+#include <instrumentation/events/lttng-module/lttng-callstack.h>
+
+DEFINE_TRACE(lttng_callstack_id);
+
 #define MAX_ENTRIES 128
 
+#define LTTNG_CS_WINDOW_MS	100
+
+#define LTTNG_CS_TABLE_BITS	12
+#define LTTNG_CS_TABLE_SIZE	(1U << LTTNG_CS_TABLE_BITS)
+#define LTTNG_CS_TABLE_PROBES	16
+/* Room for LTTNG_CS_TABLE_SIZE stacks of 32 entries. */
+#define LTTNG_CS_ARENA_ENTRIES	(LTTNG_CS_TABLE_SIZE * 32)
+#define LTTNG_CS_ID_NONE	((uint32_t) -1)
+
+enum lttng_cs_slot_state {
+	LTTNG_CS_SLOT_FREE = 0,
+	LTTNG_CS_SLOT_BUSY,		/* Being filled, or arena full */
+	LTTNG_CS_SLOT_READY,
+};
+
+struct lttng_cs_slot {
+	u32 state;			/* enum lttng_cs_slot_state */
+	u32 hash;
+	u32 nr_entries;
+	u32 offset;			/* In arena */
+};
+
+struct lttng_cs_table {
+	atomic_t arena_used;
+	struct lttng_cs_slot slots[LTTNG_CS_TABLE_SIZE];
+	unsigned long arena[LTTNG_CS_ARENA_ENTRIES];
+};
+
 enum lttng_cs_ctx_modes {
 	CALLSTACK_KERNEL = 0,
 	CALLSTACK_USER = 1,
@@ -59,20 +120,28 @@ enum lttng_cs_ctx_modes {
 
 struct lttng_cs_dispatch {
 	struct stack_trace stack_trace;
+	uint32_t id;			/* With a stack table */
+	bool skipped;			/* Walk budget spent */
 	unsigned long entries[MAX_ENTRIES];
 };
 
 struct lttng_cs {
 	struct lttng_cs_dispatch dispatch[RING_BUFFER_MAX_NESTING];
+	u64 window_start;		/* Trace clock */
+	u64 walk_time;			/* Spent in the window */
 };
 
 struct field_data {
 	struct lttng_cs __percpu *cs_percpu;
 	enum lttng_cs_ctx_modes mode;
+	struct lttng_cs_table *table;	/* NULL: record the stacks */
+	u64 window;			/* Trace clock units */
+	u64 max_walk_time;		/* Per window, 0: unlimited */
 };
 
 struct lttng_cs_type {
 	const char *name;
+	const char *id_name;
 	const char *save_func_name;
 	void (*save_func)(struct stack_trace *trace);
 };
@@ -80,11 +149,13 @@ struct lttng_cs_type {
 static struct lttng_cs_type cs_types[] = {
 	{
 		.name		= "callstack_kernel",
+		.id_name	= "callstack_kernel_id",
 		.save_func_name	= "save_stack_trace",
 		.save_func	= NULL,
 	},
 	{
 		.name		= "callstack_user",
+		.id_name	= "callstack_user_id",
 		.save_func_name	= "save_stack_trace_user",
 		.save_func	= NULL,
 	},
@@ -109,6 +180,8 @@ int init_type(enum lttng_cs_ctx_modes mode)
 
 /* Keep track of nesting inside userspace callstack context code */
 DEFINE_PER_CPU(int, callstack_user_nesting);
+/* Keep track of lttng_callstack_id events being emitted */
+static DEFINE_PER_CPU(int, callstack_id_nesting);
 
 static
 struct stack_trace *stack_trace_context(struct lttng_ctx_field *field,
@@ -143,29 +216,34 @@ struct stack_trace *stack_trace_context(struct lttng_ctx_field *field,
 }
 
 /*
- * In order to reserve the correct size, the callstack is computed. The
- * resulting callstack is saved to be accessed in the record step.
+ * Walk the stack into "trace", within the walk budget of the cpu. The
+ * final ULONG_MAX delimiter is removed. Return false if the stack has
+ * not been walked.
  */
 static
-size_t lttng_callstack_get_size(size_t offset, struct lttng_ctx_field *field,
-				struct lib_ring_buffer_ctx *ctx,
-				struct lttng_channel *chan)
+bool lttng_cs_walk(struct lttng_ctx_field *field,
+		struct lib_ring_buffer_ctx *ctx, struct stack_trace *trace)
 {
-	struct stack_trace *trace;
 	struct field_data *fdata = field->priv;
-	size_t orig_offset = offset;
-
-	/* do not write data if no space is available */
-	trace = stack_trace_context(field, ctx);
-	if (unlikely(!trace)) {
-		offset += lib_ring_buffer_align(offset, lttng_alignof(unsigned int));
-		offset += sizeof(unsigned int);
-		offset += lib_ring_buffer_align(offset, lttng_alignof(unsigned long));
-		return offset - orig_offset;
-	}
+	struct lttng_cs_dispatch *dispatch = container_of(trace,
+			struct lttng_cs_dispatch, stack_trace);
+	struct lttng_cs *cs = NULL;
+	u64 start = 0;
 
 	/* reset stack trace, no need to clear memory */
 	trace->nr_entries = 0;
+	dispatch->skipped = false;
+	if (fdata->max_walk_time) {
+		cs = per_cpu_ptr(fdata->cs_percpu, ctx->cpu);
+		start = trace_clock_read64();
+		if (start - cs->window_start >= fdata->window) {
+			cs->window_start = start;
+			cs->walk_time = 0;
+		} else if (cs->walk_time >= fdata->max_walk_time) {
+			dispatch->skipped = true;
+			return false;
+		}
+	}
 
 	if (fdata->mode == CALLSTACK_USER)
 		++per_cpu(callstack_user_nesting, ctx->cpu);
@@ -176,6 +254,10 @@ size_t lttng_callstack_get_size(size_t offset, struct lttng_ctx_field *field,
 	if (fdata->mode == CALLSTACK_USER)
 		per_cpu(callstack_user_nesting, ctx->cpu)--;
 
+	/* The walks of nested records are also accounted here. */
+	if (cs)
+		cs->walk_time += trace_clock_read64() - start;
+
 	/*
 	 * Remove final ULONG_MAX delimiter. If we cannot find it, add
 	 * our own marker to show that the stack is incomplete. This is
@@ -185,12 +267,173 @@ size_t lttng_callstack_get_size(size_t offset, struct lttng_ctx_field *field,
 			&& trace->entries[trace->nr_entries - 1] == ULONG_MAX) {
 		trace->nr_entries--;
 	}
-	offset += lib_ring_buffer_align(offset, lttng_alignof(unsigned int));
+	return true;
+}
+
+/* Whether our own ULONG_MAX delimiter ends the recorded stack. */
+static
+bool lttng_cs_incomplete(struct stack_trace *trace)
+{
+	return trace->nr_entries == trace->max_entries
+		|| container_of(trace, struct lttng_cs_dispatch,
+			stack_trace)->skipped;
+}
+
+static
+bool lttng_cs_slot_match(struct lttng_cs_table *table,
+		struct lttng_cs_slot *slot, u32 hash,
+		struct stack_trace *trace)
+{
+	return slot->hash == hash && slot->nr_entries == trace->nr_entries
+		&& !memcmp(&table->arena[slot->offset], trace->entries,
+			sizeof(unsigned long) * trace->nr_entries);
+}
+
+/*
+ * Return the id of the stack, inserting it if "insert" is set. "*new"
+ * is set if the stack has been inserted.
+ */
+static
+uint32_t lttng_cs_table_get_id(struct lttng_cs_table *table,
+		struct stack_trace *trace, bool insert, bool *new)
+{
+	u32 hash, offset;
+	int i;
+
+	*new = false;
+	hash = jhash(trace->entries,
+		sizeof(unsigned long) * trace->nr_entries, 0);
+	for (i = 0; i < LTTNG_CS_TABLE_PROBES; i++) {
+		uint32_t id = (hash + i) & (LTTNG_CS_TABLE_SIZE - 1);
+		struct lttng_cs_slot *slot = &table->slots[id];
+		u32 state = smp_load_acquire(&slot->state);
+
+		if (state == LTTNG_CS_SLOT_READY) {
+			if (lttng_cs_slot_match(table, slot, hash, trace))
+				return id;
+			continue;
+		}
+		if (state != LTTNG_CS_SLOT_FREE)
+			continue;
+		if (!insert)
+			return LTTNG_CS_ID_NONE;
+		if (cmpxchg(&slot->state, LTTNG_CS_SLOT_FREE,
+				LTTNG_CS_SLOT_BUSY) != LTTNG_CS_SLOT_FREE)
+			continue;
+		/* Bounded: at most one failure per slot. */
+		offset = atomic_add_return(trace->nr_entries,
+				&table->arena_used) - trace->nr_entries;
+		if (offset + trace->nr_entries > LTTNG_CS_ARENA_ENTRIES)
+			return LTTNG_CS_ID_NONE;	/* Slot left busy. */
+		slot->hash = hash;
+		slot->nr_entries = trace->nr_entries;
+		slot->offset = offset;
+		memcpy(&table->arena[offset], trace->entries,
+			sizeof(unsigned long) * trace->nr_entries);
+		smp_store_release(&slot->state, LTTNG_CS_SLOT_READY);
+		*new = true;
+		return id;
+	}
+	return LTTNG_CS_ID_NONE;
+}
+
+/*
+ * Look up the stack id, and emit the stack the first time it is seen.
+ * Events recorded while emitting it only look up their own stack.
+ */
+static
+void lttng_callstack_set_id(struct lttng_ctx_field *field,
+		struct lib_ring_buffer_ctx *ctx,
+		struct lttng_channel *chan,
+		struct lttng_cs_dispatch *dispatch)
+{
+	struct field_data *fdata = field->priv;
+	struct stack_trace *trace = &dispatch->stack_trace;
+	int *nesting = per_cpu_ptr(&callstack_id_nesting, ctx->cpu);
+	bool new;
+
+	dispatch->id = lttng_cs_table_get_id(fdata->table, trace,
+			!*nesting, &new);
+	if (!new)
+		return;
+	(*nesting)++;
+	trace_lttng_callstack_id(chan->session, chan->id,
+		cs_types[fdata->mode].id_name, dispatch->id,
+		trace->entries, trace->nr_entries);
+	(*nesting)--;
+}
+
+static
+size_t lttng_callstack_id_get_size(size_t offset, struct lttng_ctx_field *field,
+				struct lib_ring_buffer_ctx *ctx,
+				struct lttng_channel *chan)
+{
+	struct stack_trace *trace;
+	size_t orig_offset = offset;
+
+	trace = stack_trace_context(field, ctx);
+	if (likely(trace)) {
+		struct lttng_cs_dispatch *dispatch = container_of(trace,
+				struct lttng_cs_dispatch, stack_trace);
+
+		if (lttng_cs_walk(field, ctx, trace))
+			lttng_callstack_set_id(field, ctx, chan, dispatch);
+		else
+			dispatch->id = LTTNG_CS_ID_NONE;
+	}
+	offset += lib_ring_buffer_record_align(ctx->packed, offset,
+			lttng_alignof(uint32_t));
+	offset += sizeof(uint32_t);
+	return offset - orig_offset;
+}
+
+static
+void lttng_callstack_id_record(struct lttng_ctx_field *field,
+			struct lib_ring_buffer_ctx *ctx,
+			struct lttng_channel *chan)
+{
+	struct stack_trace *trace = stack_trace_context(field, ctx);
+	uint32_t id = LTTNG_CS_ID_NONE;
+
+	if (likely(trace))
+		id = container_of(trace, struct lttng_cs_dispatch,
+				stack_trace)->id;
+	lib_ring_buffer_align_ctx(ctx, lttng_alignof(id));
+	chan->ops->event_write(ctx, &id, sizeof(id));
+}
+
+/*
+ * In order to reserve the correct size, the callstack is computed. The
+ * resulting callstack is saved to be accessed in the record step.
+ */
+static
+size_t lttng_callstack_get_size(size_t offset, struct lttng_ctx_field *field,
+				struct lib_ring_buffer_ctx *ctx,
+				struct lttng_channel *chan)
+{
+	struct stack_trace *trace;
+	size_t orig_offset = offset;
+
+	/* do not write data if no space is available */
+	trace = stack_trace_context(field, ctx);
+	if (unlikely(!trace)) {
+		offset += lib_ring_buffer_record_align(ctx->packed, offset,
+			lttng_alignof(unsigned int));
+		offset += sizeof(unsigned int);
+		offset += lib_ring_buffer_record_align(ctx->packed, offset,
+			lttng_alignof(unsigned long));
+		return offset - orig_offset;
+	}
+
+	lttng_cs_walk(field, ctx, trace);
+	offset += lib_ring_buffer_record_align(ctx->packed, offset,
+			lttng_alignof(unsigned int));
 	offset += sizeof(unsigned int);
-	offset += lib_ring_buffer_align(offset, lttng_alignof(unsigned long));
+	offset += lib_ring_buffer_record_align(ctx->packed, offset,
+			lttng_alignof(unsigned long));
 	offset += sizeof(unsigned long) * trace->nr_entries;
 	/* Add our own ULONG_MAX delimiter to show incomplete stack. */
-	if (trace->nr_entries == trace->max_entries)
+	if (lttng_cs_incomplete(trace))
 		offset += sizeof(unsigned long);
 	return offset - orig_offset;
 }
@@ -212,14 +455,14 @@ void lttng_callstack_record(struct lttng_ctx_field *field,
 	}
 	lib_ring_buffer_align_ctx(ctx, lttng_alignof(unsigned int));
 	nr_seq_entries = trace->nr_entries;
-	if (trace->nr_entries == trace->max_entries)
+	if (lttng_cs_incomplete(trace))
 		nr_seq_entries++;
 	chan->ops->event_write(ctx, &nr_seq_entries, sizeof(unsigned int));
 	lib_ring_buffer_align_ctx(ctx, lttng_alignof(unsigned long));
 	chan->ops->event_write(ctx, trace->entries,
 			sizeof(unsigned long) * trace->nr_entries);
 	/* Add our own ULONG_MAX delimiter to show incomplete stack. */
-	if (trace->nr_entries == trace->max_entries) {
+	if (lttng_cs_incomplete(trace)) {
 		unsigned long delim = ULONG_MAX;
 
 		chan->ops->event_write(ctx, &delim, sizeof(unsigned long));
@@ -232,11 +475,13 @@ void field_data_free(struct field_data *fdata)
 	if (!fdata)
 		return;
 	free_percpu(fdata->cs_percpu);
+	lttng_kvfree(fdata->table);
 	kfree(fdata);
 }
 
 static
-struct field_data __percpu *field_data_create(enum lttng_cs_ctx_modes mode)
+struct field_data __percpu *field_data_create(enum lttng_cs_ctx_modes mode,
+		unsigned int max_entries, u64 max_walk_time, bool stack_id)
 {
 	int cpu, i;
 	struct lttng_cs __percpu *cs_set;
@@ -250,6 +495,11 @@ struct field_data __percpu *field_data_create(enum lttng_cs_ctx_modes mode)
 		goto error_alloc;
 
 	fdata->cs_percpu = cs_set;
+	if (stack_id) {
+		fdata->table = lttng_kvzalloc(sizeof(*fdata->table), GFP_KERNEL);
+		if (!fdata->table)
+			goto error_alloc;
+	}
 	for_each_possible_cpu(cpu) {
 		struct lttng_cs *cs;
 
@@ -259,10 +509,20 @@ struct field_data __percpu *field_data_create(enum lttng_cs_ctx_modes mode)
 
 			dispatch = &cs->dispatch[i];
 			dispatch->stack_trace.entries = dispatch->entries;
-			dispatch->stack_trace.max_entries = MAX_ENTRIES;
+			dispatch->stack_trace.max_entries = max_entries;
 		}
 	}
 	fdata->mode = mode;
+	if (max_walk_time) {
+		u64 window_ns = div_u64(max_walk_time * LTTNG_CS_WINDOW_MS,
+				MSEC_PER_SEC);
+
+		/* Budget of a window, in trace clock units, at least 1. */
+		fdata->window = div_u64(trace_clock_freq() * LTTNG_CS_WINDOW_MS,
+				MSEC_PER_SEC);
+		fdata->max_walk_time = max_t(u64, div_u64(window_ns
+				* trace_clock_freq(), NSEC_PER_SEC), 1);
+	}
 	return fdata;
 
 error_alloc:
@@ -280,13 +540,19 @@ void lttng_callstack_destroy(struct lttng_ctx_field *field)
 
 static
 int __lttng_add_callstack_generic(struct lttng_ctx **ctx,
-		enum lttng_cs_ctx_modes mode)
+		enum lttng_cs_ctx_modes mode, uint32_t max_depth,
+		uint64_t max_walk_time, bool stack_id)
 {
-	const char *ctx_name = cs_types[mode].name;
+	const char *ctx_name = stack_id ? cs_types[mode].id_name :
+			cs_types[mode].name;
 	struct lttng_ctx_field *field;
 	struct field_data *fdata;
 	int ret;
 
+	if (!max_depth)
+		max_depth = MAX_ENTRIES;
+	if (max_depth > MAX_ENTRIES || max_walk_time > NSEC_PER_SEC)
+		return -EINVAL;
 	ret = init_type(mode);
 	if (ret)
 		return ret;
@@ -297,13 +563,25 @@ int __lttng_add_callstack_generic(struct lttng_ctx **ctx,
 		ret = -EEXIST;
 		goto error_find;
 	}
-	fdata = field_data_create(mode);
+	fdata = field_data_create(mode, max_depth, max_walk_time, stack_id);
 	if (!fdata) {
 		ret = -ENOMEM;
 		goto error_create;
 	}
 
 	field->event_field.name = ctx_name;
+	if (stack_id) {
+		field->event_field.type.atype = atype_integer;
+		field->event_field.type.u.basic.integer.size = sizeof(uint32_t) * CHAR_BIT;
+		field->event_field.type.u.basic.integer.alignment = lttng_alignof(uint32_t) * CHAR_BIT;
+		field->event_field.type.u.basic.integer.signedness = lttng_is_signed_type(uint32_t);
+		field->event_field.type.u.basic.integer.reverse_byte_order = 0;
+		field->event_field.type.u.basic.integer.base = 10;
+		field->event_field.type.u.basic.integer.encoding = lttng_encode_none;
+		field->get_size_arg = lttng_callstack_id_get_size;
+		field->record = lttng_callstack_id_record;
+		goto end_type;
+	}
 	field->event_field.type.atype = atype_sequence;
 	field->event_field.type.u.sequence.elem_type.atype = atype_integer;
 	field->event_field.type.u.sequence.elem_type.u.basic.integer.size = sizeof(unsigned long) * CHAR_BIT;
@@ -323,8 +601,10 @@ int __lttng_add_callstack_generic(struct lttng_ctx **ctx,
 
 	field->get_size_arg = lttng_callstack_get_size;
 	field->record = lttng_callstack_record;
+end_type:
 	field->priv = fdata;
 	field->destroy = lttng_callstack_destroy;
+	lttng_context_update(*ctx);
 	wrapper_vmalloc_sync_all();
 	return 0;
 
@@ -340,23 +620,37 @@ error_find:
  *
  *	@ctx: the lttng_ctx pointer to initialize
  *	@type: the context type
+ *	@max_depth: maximum number of frames, 0 for the default (128)
+ *	@max_walk_time: stack walk ns per second on each cpu, 0: unlimited
  *
  *	Supported callstack type supported:
  *	LTTNG_KERNEL_CONTEXT_CALLSTACK_KERNEL
  *		Records the callstack of the kernel
  *	LTTNG_KERNEL_CONTEXT_CALLSTACK_USER
  *		Records the callstack of the userspace program (from the kernel)
+ *	LTTNG_KERNEL_CONTEXT_CALLSTACK_KERNEL_ID
+ *	LTTNG_KERNEL_CONTEXT_CALLSTACK_USER_ID
+ *		Records the id of the stack, see lttng_callstack_id
  *
  * Return 0 for success, or error code.
  */
-int lttng_add_callstack_to_ctx(struct lttng_ctx **ctx, int type)
+int lttng_add_callstack_to_ctx(struct lttng_ctx **ctx, int type,
+		uint32_t max_depth, uint64_t max_walk_time)
 {
 	switch (type) {
 	case LTTNG_KERNEL_CONTEXT_CALLSTACK_KERNEL:
-		return __lttng_add_callstack_generic(ctx, CALLSTACK_KERNEL);
+		return __lttng_add_callstack_generic(ctx, CALLSTACK_KERNEL,
+				max_depth, max_walk_time, false);
+	case LTTNG_KERNEL_CONTEXT_CALLSTACK_KERNEL_ID:
+		return __lttng_add_callstack_generic(ctx, CALLSTACK_KERNEL,
+				max_depth, max_walk_time, true);
 #ifdef CONFIG_X86
 	case LTTNG_KERNEL_CONTEXT_CALLSTACK_USER:
-		return __lttng_add_callstack_generic(ctx, CALLSTACK_USER);
+		return __lttng_add_callstack_generic(ctx, CALLSTACK_USER,
+				max_depth, max_walk_time, false);
+	case LTTNG_KERNEL_CONTEXT_CALLSTACK_USER_ID:
+		return __lttng_add_callstack_generic(ctx, CALLSTACK_USER,
+				max_depth, max_walk_time, true);
 #endif
 	default:
 		return -EINVAL;
@@ -0,0 +1,236 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-context-guard.c
+ *
+ * LTTng channel context guards.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <lttng-events.h>
+#include <wrapper/ringbuffer/frontend_types.h>
+#include <wrapper/vmalloc.h>
+#include <lttng-tracer.h>
+
+/*
+ * A guarded context is recorded as:
+ *
+ *   struct {
+ *     enum : uint8_t { _none, _value } tag;
+ *     variant <tag> { struct { } none; <context type> value; } v;
+ *   }
+ *
+ * The guard runs when the context sizes are computed, once per
+ * reservation, after the event filters: its result is kept in the probe
+ * context for the record callback. Guards reading the event payload see
+ * the filter stack data prepared by the tracepoint probes; other
+ * instrumentation records their contexts as none.
+ */
+enum lttng_ctx_guard_tag {
+	LTTNG_CTX_GUARD_NONE = 0,
+	LTTNG_CTX_GUARD_VALUE = 1,
+};
+
+static const struct lttng_enum_entry ctx_guard_tag_entries[] = {
+	{ .start = { .value = LTTNG_CTX_GUARD_NONE },
+	  .end = { .value = LTTNG_CTX_GUARD_NONE }, .string = "_none" },
+	{ .start = { .value = LTTNG_CTX_GUARD_VALUE },
+	  .end = { .value = LTTNG_CTX_GUARD_VALUE }, .string = "_value" },
+};
+
+static const struct lttng_enum_desc ctx_guard_tag_desc = {
+	.name = "context_guard_tag",
+	.entries = ctx_guard_tag_entries,
+	.nr_entries = ARRAY_SIZE(ctx_guard_tag_entries),
+};
+
+static
+bool lttng_ctx_guard_run(const struct lttng_ctx_guard *guard,
+		struct lttng_probe_ctx *lttng_probe_ctx)
+{
+	struct lttng_event *event = lttng_probe_ctx->event;
+	struct lttng_bytecode_runtime *bc_runtime;
+
+	if (!event)
+		return false;
+	lttng_list_for_each_entry_rcu(bc_runtime,
+			&event->ctx_guard_runtime_head, node) {
+		if (bc_runtime->bc != guard->bc)
+			continue;
+		if (!bc_runtime->context_only
+				&& !lttng_probe_ctx->filter_stack_data)
+			return false;
+		return lttng_bytecode_runtime_filter(bc_runtime,
+				lttng_probe_ctx,
+				lttng_probe_ctx->filter_stack_data)
+			& LTTNG_FILTER_RECORD_FLAG;
+	}
+	/* Not linked to this event. */
+	return false;
+}
+
+size_t lttng_ctx_guard_get_size(size_t offset, struct lttng_ctx_field *field,
+		struct lib_ring_buffer_ctx *ctx, struct lttng_channel *chan)
+{
+	struct lttng_probe_ctx *lttng_probe_ctx = ctx->priv;
+	uint32_t bit = 1U << field->guard->index;
+	size_t orig_offset = offset;
+
+	offset += sizeof(uint8_t);
+	if (!lttng_ctx_guard_run(field->guard, lttng_probe_ctx)) {
+		lttng_probe_ctx->ctx_guard_pass &= ~bit;
+		return offset - orig_offset;
+	}
+	lttng_probe_ctx->ctx_guard_pass |= bit;
+	if (field->get_size)
+		offset += field->get_size(ctx->packed ? 0 : offset);
+	if (field->get_size_arg)
+		offset += field->get_size_arg(offset, field, ctx, chan);
+	return offset - orig_offset;
+}
+EXPORT_SYMBOL_GPL(lttng_ctx_guard_get_size);
+
+void lttng_ctx_guard_record(struct lttng_ctx_field *field,
+		struct lib_ring_buffer_ctx *ctx, struct lttng_channel *chan)
+{
+	struct lttng_probe_ctx *lttng_probe_ctx = ctx->priv;
+	uint8_t tag = LTTNG_CTX_GUARD_NONE;
+
+	if (lttng_probe_ctx->ctx_guard_pass & (1U << field->guard->index))
+		tag = LTTNG_CTX_GUARD_VALUE;
+	chan->ops->event_write(ctx, &tag, sizeof(tag));
+	if (tag == LTTNG_CTX_GUARD_VALUE)
+		field->record(field, ctx, chan);
+}
+EXPORT_SYMBOL_GPL(lttng_ctx_guard_record);
+
+static
+void lttng_ctx_guard_init_type(struct lttng_ctx_guard *guard,
+		const struct lttng_event_field *event_field)
+{
+	guard->choices[0].name = "none";
+	guard->choices[0].type.atype = atype_struct;
+	guard->choices[0].type.u._struct.nr_fields = 0;
+	guard->choices[1].name = "value";
+	guard->choices[1].type = event_field->type;
+
+	guard->fields[0].name = "tag";
+	guard->fields[0].type.atype = atype_enum;
+	guard->fields[0].type.u.basic.enumeration.desc = &ctx_guard_tag_desc;
+	guard->fields[0].type.u.basic.enumeration.container_type.size =
+		sizeof(uint8_t) * CHAR_BIT;
+	guard->fields[0].type.u.basic.enumeration.container_type.alignment =
+		lttng_alignof(uint8_t) * CHAR_BIT;
+	guard->fields[0].type.u.basic.enumeration.container_type.signedness =
+		lttng_is_signed_type(uint8_t);
+	guard->fields[0].type.u.basic.enumeration.container_type.base = 10;
+	guard->fields[0].type.u.basic.enumeration.container_type.encoding =
+		lttng_encode_none;
+	guard->fields[1].name = "v";
+	guard->fields[1].type.atype = atype_variant;
+	guard->fields[1].type.u.variant.tag_name = "tag";
+	guard->fields[1].type.u.variant.choices = guard->choices;
+	guard->fields[1].type.u.variant.nr_choices = ARRAY_SIZE(guard->choices);
+
+	guard->field.name = event_field->name;
+	guard->field.type.atype = atype_struct;
+	guard->field.type.u._struct.nr_fields = ARRAY_SIZE(guard->fields);
+	guard->field.type.u._struct.fields = guard->fields;
+}
+
+/*
+ * Guard a context of the channel with a filter bytecode. The bytecode is
+ * linked to the events of the channel when the enablers are synced.
+ * Contexts are only guarded before the session is first started.
+ */
+int lttng_channel_context_guard(struct lttng_channel *chan,
+		struct lttng_kernel_context_guard __user *uguard)
+{
+	char name[LTTNG_KERNEL_SYM_NAME_LEN];
+	struct lttng_filter_bytecode_node *bytecode_node;
+	struct lttng_ctx_guard *guard;
+	struct lttng_ctx_field *field;
+	unsigned int i, nr_guards = 0;
+	uint32_t bytecode_len;
+	int idx, ret;
+
+	if (copy_from_user(name, uguard->name, sizeof(name)))
+		return -EFAULT;
+	name[sizeof(name) - 1] = '\0';
+	ret = get_user(bytecode_len, &uguard->bytecode.len);
+	if (ret)
+		return ret;
+	if (bytecode_len > LTTNG_KERNEL_FILTER_BYTECODE_MAX_LEN)
+		return -EINVAL;
+	bytecode_node = kzalloc(sizeof(*bytecode_node) + bytecode_len,
+			GFP_KERNEL);
+	if (!bytecode_node)
+		return -ENOMEM;
+	if (copy_from_user(&bytecode_node->bc, &uguard->bytecode,
+			sizeof(bytecode_node->bc) + bytecode_len)) {
+		ret = -EFAULT;
+		goto error_free_bytecode;
+	}
+	/* Enforce length based on allocated size */
+	bytecode_node->bc.len = bytecode_len;
+	if (bytecode_node->bc.reloc_offset > bytecode_len) {
+		ret = -EINVAL;
+		goto error_free_bytecode;
+	}
+	guard = kzalloc(sizeof(*guard), GFP_KERNEL);
+	if (!guard) {
+		ret = -ENOMEM;
+		goto error_free_bytecode;
+	}
+	guard->bc = bytecode_node;
+
+	lttng_lock_sessions();
+	if (chan->session->been_active) {
+		ret = -EPERM;
+		goto error_unlock;
+	}
+	idx = lttng_get_context_index(chan->ctx, name);
+	if (idx < 0) {
+		ret = -ENOENT;
+		goto error_unlock;
+	}
+	field = &chan->ctx->fields[idx];
+	if (field->guard) {
+		ret = -EEXIST;
+		goto error_unlock;
+	}
+	for (i = 0; i < chan->ctx->nr_fields; i++) {
+		if (chan->ctx->fields[i].guard)
+			nr_guards++;
+	}
+	if (nr_guards >= LTTNG_CTX_GUARD_MAX) {
+		ret = -ENOSPC;
+		goto error_unlock;
+	}
+	guard->index = nr_guards;
+	lttng_ctx_guard_init_type(guard, &field->event_field);
+	field->guard = guard;
+	lttng_context_update(chan->ctx);
+	lttng_unlock_sessions();
+	wrapper_vmalloc_sync_all();
+	return 0;
+
+error_unlock:
+	lttng_unlock_sessions();
+	kfree(guard);
+error_free_bytecode:
+	kfree(bytecode_node);
+	return ret;
+}
+
+/* Called when the context is destroyed, after its events are freed. */
+void lttng_ctx_guard_destroy(struct lttng_ctx_guard *guard)
+{
+	if (!guard)
+		return;
+	kfree(guard->bc);
+	kfree(guard);
+}
@@ -105,3 +105,26 @@ int lttng_add_hostname_to_ctx(struct lttng_ctx **ctx)
 	return 0;
 }
 EXPORT_SYMBOL_GPL(lttng_add_hostname_to_ctx);
+
+static
+size_t hostname_get_string(char *dest)
+{
+	struct nsproxy *nsproxy;
+	char *hostname;
+	size_t len;
+
+	nsproxy = current->nsproxy;
+	if (!nsproxy)
+		return 0;
+	hostname = nsproxy->uts_ns->name.nodename;
+	len = strnlen(hostname, __NEW_UTS_LEN);
+	memcpy(dest, hostname, len);
+	return len;
+}
+
+int lttng_add_hostname_interned_to_ctx(struct lttng_ctx **ctx)
+{
+	return lttng_add_interned_string_to_ctx(ctx, "hostname",
+			hostname_get_string);
+}
+EXPORT_SYMBOL_GPL(lttng_add_hostname_interned_to_ctx);
@@ -0,0 +1,224 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-context-intern.c
+ *
+ * LTTng interned string contexts.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/jhash.h>
+#include <lttng-events.h>
+#include <wrapper/ringbuffer/backend.h>
+#include <wrapper/ringbuffer/frontend.h>
+#include <wrapper/vmalloc.h>
+#include <lttng-tracer.h>
+
+/*
+ * An interned string context is recorded as:
+ *
+ *   struct {
+ *     uint8_t slot;
+ *     uint8_t __string_length;
+ *     char string[__string_length];
+ *   }
+ *
+ * - slot LTTNG_INTERN_NO_SLOT: the string is not interned,
+ * - length > 0: the string is recorded, and defines the slot,
+ * - length 0: the string is the last one defined for the slot, earlier
+ *   in the same packet.
+ *
+ * Each per-cpu stream has its own table, and definitions are only
+ * reused within the packet they have been recorded in, so each packet
+ * can be decoded on its own. The record size is computed before the
+ * space is reserved: an event referencing a slot may still end up at
+ * the beginning of the next packet if its reservation switches packet,
+ * in which case the definition is at the end of the previous packet.
+ *
+ * The table is only used by events recorded at the outermost ring
+ * buffer nesting level on per-cpu channels. Nested events could
+ * otherwise see a definition made by an event recorded earlier in the
+ * stream, but not committed yet. Other events record their string.
+ */
+
+#define LTTNG_INTERN_NR_SLOTS	64
+#define LTTNG_INTERN_NO_SLOT	0xFF
+
+struct lttng_intern_entry {
+	unsigned long packet;		/* Packet of the definition */
+	uint8_t len;			/* 0: unused */
+	char str[LTTNG_INTERN_STRING_MAX_LEN];
+};
+
+/* Decision taken when computing the size, used when recording. */
+struct lttng_intern_pending {
+	uint8_t slot;
+	uint8_t len;
+	bool ref;
+	char str[LTTNG_INTERN_STRING_MAX_LEN];
+};
+
+struct lttng_intern_table {
+	struct lttng_intern_entry slots[LTTNG_INTERN_NR_SLOTS];
+	struct lttng_intern_pending pending[RING_BUFFER_MAX_NESTING];
+};
+
+struct lttng_intern_field {
+	size_t (*get_string)(char *dest);
+	struct lttng_intern_table __percpu *table;
+};
+
+static struct lttng_event_field intern_fields[] = {
+	{
+		.name = "slot",
+		.type = __type_integer(uint8_t, 0, 0, 0, __BYTE_ORDER, 10, none),
+	},
+	{
+		.name = "string",
+		.type = {
+			.atype = atype_sequence,
+			.u.sequence.length_type = __type_integer(uint8_t,
+					0, 0, 0, __BYTE_ORDER, 10, none),
+			.u.sequence.elem_type = __type_integer(char,
+					0, 0, 0, __BYTE_ORDER, 10, UTF8),
+		},
+	},
+};
+
+static
+unsigned long intern_current_packet(struct lttng_channel *chan, int cpu)
+{
+	struct channel *rb_chan = chan->chan;
+	const struct lib_ring_buffer_config *config = &rb_chan->backend.config;
+	struct lib_ring_buffer *buf = per_cpu_ptr(rb_chan->backend.buf, cpu);
+
+	return subbuf_trunc(v_read(config, &buf->offset), rb_chan);
+}
+
+static
+size_t intern_get_size_arg(size_t offset, struct lttng_ctx_field *field,
+		struct lib_ring_buffer_ctx *ctx,
+		struct lttng_channel *chan)
+{
+	struct lttng_intern_field *ifield = field->priv;
+	const struct lib_ring_buffer_config *config = &chan->chan->backend.config;
+	struct lttng_intern_table *table;
+	struct lttng_intern_pending *pending;
+	struct lttng_intern_entry *entry;
+	int nesting;
+
+	/* Max nesting is checked in lib_ring_buffer_get_cpu(). */
+	nesting = per_cpu(lib_ring_buffer_nesting, ctx->cpu) - 1;
+	table = per_cpu_ptr(ifield->table, ctx->cpu);
+	pending = &table->pending[nesting];
+	pending->len = ifield->get_string(pending->str);
+	pending->slot = LTTNG_INTERN_NO_SLOT;
+	pending->ref = false;
+	if (nesting || config->alloc != RING_BUFFER_ALLOC_PER_CPU
+			|| !pending->len)
+		goto end;
+	pending->slot = jhash(pending->str, pending->len, 0)
+			& (LTTNG_INTERN_NR_SLOTS - 1);
+	entry = &table->slots[pending->slot];
+	if (entry->len == pending->len
+			&& entry->packet == intern_current_packet(chan, ctx->cpu)
+			&& !memcmp(entry->str, pending->str, pending->len))
+		pending->ref = true;
+end:
+	return 2 * sizeof(uint8_t) + (pending->ref ? 0 : pending->len);
+}
+
+static
+void intern_record(struct lttng_ctx_field *field,
+		struct lib_ring_buffer_ctx *ctx,
+		struct lttng_channel *chan)
+{
+	struct lttng_intern_field *ifield = field->priv;
+	struct lttng_intern_table *table;
+	struct lttng_intern_pending *pending;
+	struct lttng_intern_entry *entry;
+	uint8_t len;
+	int nesting;
+
+	nesting = per_cpu(lib_ring_buffer_nesting, ctx->cpu) - 1;
+	table = per_cpu_ptr(ifield->table, ctx->cpu);
+	pending = &table->pending[nesting];
+	len = pending->ref ? 0 : pending->len;
+	chan->ops->event_write(ctx, &pending->slot, sizeof(pending->slot));
+	chan->ops->event_write(ctx, &len, sizeof(len));
+	if (!len)
+		return;
+	chan->ops->event_write(ctx, pending->str, len);
+	if (pending->slot == LTTNG_INTERN_NO_SLOT)
+		return;
+	entry = &table->slots[pending->slot];
+	entry->packet = subbuf_trunc(ctx->buf_offset, chan->chan);
+	entry->len = len;
+	memcpy(entry->str, pending->str, len);
+}
+
+static
+void intern_destroy(struct lttng_ctx_field *field)
+{
+	struct lttng_intern_field *ifield = field->priv;
+
+	free_percpu(ifield->table);
+	kfree(ifield);
+}
+
+/**
+ *	lttng_add_interned_string_to_ctx - add an interned string context
+ *	@ctx: the lttng_ctx pointer to initialize
+ *	@name: the context field name
+ *	@get_string: copies the current string without null terminator,
+ *		and returns its length (at most LTTNG_INTERN_STRING_MAX_LEN)
+ */
+int lttng_add_interned_string_to_ctx(struct lttng_ctx **ctx, const char *name,
+		size_t (*get_string)(char *dest))
+{
+	struct lttng_ctx_field *field;
+	struct lttng_intern_field *ifield;
+	int ret;
+
+	ifield = kzalloc(sizeof(*ifield), GFP_KERNEL);
+	if (!ifield)
+		return -ENOMEM;
+	ifield->get_string = get_string;
+	ifield->table = alloc_percpu(struct lttng_intern_table);
+	if (!ifield->table) {
+		ret = -ENOMEM;
+		goto error_table;
+	}
+	field = lttng_append_context(ctx);
+	if (!field) {
+		ret = -ENOMEM;
+		goto error_append;
+	}
+	if (lttng_find_context(*ctx, name)) {
+		ret = -EEXIST;
+		goto error_find;
+	}
+	field->event_field.name = name;
+	field->event_field.type.atype = atype_struct;
+	field->event_field.type.u._struct.nr_fields = ARRAY_SIZE(intern_fields);
+	field->event_field.type.u._struct.fields = intern_fields;
+	field->get_size_arg = intern_get_size_arg;
+	field->record = intern_record;
+	field->priv = ifield;
+	field->destroy = intern_destroy;
+	lttng_context_update(*ctx);
+	wrapper_vmalloc_sync_all();
+	return 0;
+
+error_find:
+	lttng_remove_context_field(ctx, field);
+error_append:
+	free_percpu(ifield->table);
+error_table:
+	kfree(ifield);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(lttng_add_interned_string_to_ctx);
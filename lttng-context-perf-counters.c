@@ -13,11 +13,103 @@
 #include <linux/list.h>
 #include <linux/string.h>
 #include <linux/cpu.h>
+#include <linux/moduleparam.h>
 #include <lttng-events.h>
 #include <wrapper/ringbuffer/frontend_types.h>
+#include <wrapper/ringbuffer/backend.h>
+#include <wrapper/ringbuffer/frontend.h>
 #include <wrapper/vmalloc.h>
 #include <wrapper/perf.h>
 #include <lttng-tracer.h>
+#include <lttng-kernel-version.h>
+
+#if defined(CONFIG_X86) && (LINUX_VERSION_CODE >= KERNEL_VERSION(4,1,0))
+
+#include <asm/msr.h>
+#include <asm/perf_event.h>
+
+/*
+ * Fast path for core PMU counters on x86: read the hardware counter of
+ * the local cpu with rdpmc and add the delta since the last perf update
+ * to the count accumulated by perf, as self-monitoring user-space
+ * readers do. This avoids the pmu->read() indirect call, which also
+ * writes back the count. Counters which are not active on the local
+ * cpu, or not from the core PMU, take the perf read.
+ *
+ * The perf overflow handler runs in NMI context: the sequence retry
+ * below covers an update interrupting the read, but a probe hit from
+ * NMI in the middle of an update may see the new prev_count with the
+ * old count, and undercount once by the last delta.
+ */
+
+static int perf_counter_rdpmc_enable = 1;
+module_param_named(perf_counter_rdpmc, perf_counter_rdpmc_enable, int, 0644);
+MODULE_PARM_DESC(perf_counter_rdpmc, "Read local core PMU counters with rdpmc (0: disabled, 1: enabled)");
+
+static unsigned int perf_counter_width_gp, perf_counter_width_fixed;
+static int perf_counter_nr_fixed;
+
+static
+void perf_counter_rdpmc_init(void)
+{
+	struct x86_pmu_capability cap;
+
+	memset(&cap, 0, sizeof(cap));
+	perf_get_x86_pmu_capability(&cap);
+	perf_counter_width_gp = cap.bit_width_gp;
+	perf_counter_width_fixed = cap.bit_width_fixed;
+	perf_counter_nr_fixed = cap.num_counters_fixed;
+}
+
+/* Called with preemption disabled. */
+static
+bool perf_counter_read_rdpmc(struct perf_event *event, uint64_t *value)
+{
+	struct hw_perf_event *hwc = &event->hw;
+	u64 prev, count, raw;
+	unsigned int width, shift, rdpmc_idx;
+	int idx;
+
+	if (!READ_ONCE(perf_counter_rdpmc_enable))
+		return false;
+	if (event->pmu->type != PERF_TYPE_RAW
+			|| READ_ONCE(event->state) != PERF_EVENT_STATE_ACTIVE
+			|| READ_ONCE(event->oncpu) != smp_processor_id()
+			|| (READ_ONCE(hwc->state) & PERF_HES_STOPPED))
+		return false;
+	idx = READ_ONCE(hwc->idx);
+	if (idx < 0 || idx >= INTEL_PMC_IDX_FIXED + perf_counter_nr_fixed)
+		return false;
+	width = idx >= INTEL_PMC_IDX_FIXED ? perf_counter_width_fixed :
+		perf_counter_width_gp;
+	if (!width || width > 64)
+		return false;
+	shift = 64 - width;
+	rdpmc_idx = READ_ONCE(hwc->event_base_rdpmc);
+	do {
+		prev = local64_read(&hwc->prev_count);
+		count = local64_read(&event->count);
+		rdpmcl(rdpmc_idx, raw);
+		barrier();
+	} while (local64_read(&hwc->prev_count) != prev);
+	*value = count + (((raw << shift) - (prev << shift)) >> shift);
+	return true;
+}
+
+#else
+
+static
+void perf_counter_rdpmc_init(void)
+{
+}
+
+static
+bool perf_counter_read_rdpmc(struct perf_event *event, uint64_t *value)
+{
+	return false;
+}
+
+#endif
 
 static
 size_t perf_counter_get_size(size_t offset)
@@ -30,22 +122,11 @@ size_t perf_counter_get_size(size_t offset)
 }
 
 static
-void perf_counter_record(struct lttng_ctx_field *field,
-			 struct lib_ring_buffer_ctx *ctx,
-			 struct lttng_channel *chan)
+uint64_t perf_counter_read(struct perf_event *event)
 {
-	struct perf_event *event;
 	uint64_t value;
 
-	event = field->u.perf_counter->e[ctx->cpu];
-	if (likely(event)) {
-		if (unlikely(event->state == PERF_EVENT_STATE_ERROR)) {
-			value = 0;
-		} else {
-			event->pmu->read(event);
-			value = local64_read(&event->count);
-		}
-	} else {
+	if (unlikely(!event)) {
 		/*
 		 * Perf chooses not to be clever and not to support enabling a
 		 * perf counter before the cpu is brought up. Therefore, we need
@@ -53,12 +134,320 @@ void perf_counter_record(struct lttng_ctx_field *field,
 		 * before the counter is setup. Write an arbitrary 0 in this
 		 * case.
 		 */
-		value = 0;
+		return 0;
 	}
+	if (unlikely(event->state == PERF_EVENT_STATE_ERROR))
+		return 0;
+	if (perf_counter_read_rdpmc(event, &value))
+		return value;
+	event->pmu->read(event);
+	return local64_read(&event->count);
+}
+
+static
+void perf_counter_record(struct lttng_ctx_field *field,
+			 struct lib_ring_buffer_ctx *ctx,
+			 struct lttng_channel *chan)
+{
+	uint64_t value;
+
+	value = perf_counter_read(field->u.perf_counter->e[ctx->cpu]);
 	lib_ring_buffer_align_ctx(ctx, lttng_alignof(value));
 	chan->ops->event_write(ctx, &value, sizeof(value));
 }
 
+static
+size_t perf_counter_group_get_size(size_t offset, struct lttng_ctx_field *field,
+		struct lib_ring_buffer_ctx *ctx,
+		struct lttng_channel *chan)
+{
+	size_t size = 0;
+
+	size += lib_ring_buffer_align(offset, lttng_alignof(uint64_t));
+	size += sizeof(uint64_t) * field->u.perf_counter->nr_counters;
+	return size;
+}
+
+/*
+ * All the counters of the group are read back to back, and written as
+ * a single array.
+ */
+static
+void perf_counter_group_record(struct lttng_ctx_field *field,
+			 struct lib_ring_buffer_ctx *ctx,
+			 struct lttng_channel *chan)
+{
+	struct lttng_perf_counter_field *perf_field = field->u.perf_counter;
+	unsigned int nr_counters = perf_field->nr_counters;
+	struct perf_event **events = &perf_field->e[ctx->cpu * nr_counters];
+	uint64_t values[LTTNG_KERNEL_PERF_COUNTER_GROUP_MAX];
+	unsigned int i;
+
+	for (i = 0; i < nr_counters; i++)
+		values[i] = perf_counter_read(events[i]);
+	lib_ring_buffer_align_ctx(ctx, lttng_alignof(uint64_t));
+	chan->ops->event_write(ctx, values, nr_counters * sizeof(uint64_t));
+}
+
+/*
+ * Delta counters are recorded, for each counter, as:
+ *
+ *   struct {
+ *     enum : uint8_t { _d0, _d8, _d16, _d32, _base, _full } w;
+ *     variant <w> { ... } v;
+ *   }
+ *
+ * - d0 to d32: 0 to 32-bit delta from the reference value,
+ * - base: 64-bit value, which becomes the reference value,
+ * - full: 64-bit value, leaving the reference value unchanged.
+ *
+ * The reference value is the value of the last base or delta record of
+ * the counter in the packet: the first record of the counter in each
+ * packet is a base, so each packet can be decoded on its own. The
+ * record size is computed before the space is reserved: a delta record
+ * may still end up at the beginning of the next packet if its
+ * reservation switches packet, in which case its reference is at the
+ * end of the previous packet.
+ *
+ * Only records at the outermost ring buffer nesting level on per-cpu
+ * channels are delta encoded: the counters are read when computing the
+ * record size, and nested records could otherwise be recorded between
+ * a delta record and its reference. Other records are full.
+ */
+enum lttng_perf_delta_width {
+	LTTNG_PERF_DELTA_0 = 0,
+	LTTNG_PERF_DELTA_8 = 1,
+	LTTNG_PERF_DELTA_16 = 2,
+	LTTNG_PERF_DELTA_32 = 3,
+	LTTNG_PERF_DELTA_BASE = 4,
+	LTTNG_PERF_DELTA_FULL = 5,
+};
+
+struct lttng_perf_counter_delta {
+	unsigned long packet;		/* Packet of the reference values */
+	uint64_t ref[LTTNG_KERNEL_PERF_COUNTER_GROUP_MAX];
+	/* Decision taken when computing the size, used when recording. */
+	unsigned long pending_packet;
+	uint64_t pending[LTTNG_KERNEL_PERF_COUNTER_GROUP_MAX];
+};
+
+static const struct lttng_enum_entry perf_delta_width_entries[] = {
+	{ .start = { .value = LTTNG_PERF_DELTA_0 },
+	  .end = { .value = LTTNG_PERF_DELTA_0 }, .string = "_d0" },
+	{ .start = { .value = LTTNG_PERF_DELTA_8 },
+	  .end = { .value = LTTNG_PERF_DELTA_8 }, .string = "_d8" },
+	{ .start = { .value = LTTNG_PERF_DELTA_16 },
+	  .end = { .value = LTTNG_PERF_DELTA_16 }, .string = "_d16" },
+	{ .start = { .value = LTTNG_PERF_DELTA_32 },
+	  .end = { .value = LTTNG_PERF_DELTA_32 }, .string = "_d32" },
+	{ .start = { .value = LTTNG_PERF_DELTA_BASE },
+	  .end = { .value = LTTNG_PERF_DELTA_BASE }, .string = "_base" },
+	{ .start = { .value = LTTNG_PERF_DELTA_FULL },
+	  .end = { .value = LTTNG_PERF_DELTA_FULL }, .string = "_full" },
+};
+
+static const struct lttng_enum_desc perf_delta_width_desc = {
+	.name = "perf_counter_delta_width",
+	.entries = perf_delta_width_entries,
+	.nr_entries = ARRAY_SIZE(perf_delta_width_entries),
+};
+
+/* Byte-aligned: the delta records are written unaligned. */
+static struct lttng_event_field perf_delta_choices[] = {
+	{
+		.name = "d0",
+		.type = {
+			.atype = atype_struct,
+			.u._struct.nr_fields = 0,
+		},
+	},
+	{
+		.name = "d8",
+		.type = __type_integer(uint8_t, 0, 8, 0, __BYTE_ORDER, 10, none),
+	},
+	{
+		.name = "d16",
+		.type = __type_integer(uint16_t, 0, 8, 0, __BYTE_ORDER, 10, none),
+	},
+	{
+		.name = "d32",
+		.type = __type_integer(uint32_t, 0, 8, 0, __BYTE_ORDER, 10, none),
+	},
+	{
+		.name = "base",
+		.type = __type_integer(uint64_t, 0, 8, 0, __BYTE_ORDER, 10, none),
+	},
+	{
+		.name = "full",
+		.type = __type_integer(uint64_t, 0, 8, 0, __BYTE_ORDER, 10, none),
+	},
+};
+
+static struct lttng_event_field perf_delta_fields[] = {
+	{
+		.name = "w",
+		.type = {
+			.atype = atype_enum,
+			.u.basic.enumeration.desc = &perf_delta_width_desc,
+			.u.basic.enumeration.container_type = {
+				.size = 8,
+				.alignment = 8,
+				.signedness = 0,
+				.base = 10,
+				.encoding = lttng_encode_none,
+			},
+		},
+	},
+	{
+		.name = "v",
+		.type = {
+			.atype = atype_variant,
+			.u.variant.tag_name = "w",
+			.u.variant.choices = perf_delta_choices,
+			.u.variant.nr_choices = ARRAY_SIZE(perf_delta_choices),
+		},
+	},
+};
+
+static struct lttng_type perf_delta_type = {
+	.atype = atype_struct,
+	.u._struct.nr_fields = ARRAY_SIZE(perf_delta_fields),
+	.u._struct.fields = perf_delta_fields,
+};
+
+static
+bool perf_counter_delta_outermost(struct lttng_channel *chan,
+		struct lib_ring_buffer_ctx *ctx)
+{
+	return chan->chan->backend.config.alloc == RING_BUFFER_ALLOC_PER_CPU
+		&& per_cpu(lib_ring_buffer_nesting, ctx->cpu) == 1;
+}
+
+static
+unsigned long perf_counter_delta_packet(struct lttng_channel *chan, int cpu)
+{
+	struct channel *rb_chan = chan->chan;
+	const struct lib_ring_buffer_config *config = &rb_chan->backend.config;
+	struct lib_ring_buffer *buf = per_cpu_ptr(rb_chan->backend.buf, cpu);
+
+	return subbuf_trunc(v_read(config, &buf->offset), rb_chan);
+}
+
+static
+enum lttng_perf_delta_width perf_counter_delta_width(
+		const struct lttng_perf_counter_delta *delta, unsigned int i)
+{
+	uint64_t d;
+
+	if (delta->pending_packet != delta->packet || delta->pending[i] < delta->ref[i])
+		return LTTNG_PERF_DELTA_BASE;
+	d = delta->pending[i] - delta->ref[i];
+	if (!d)
+		return LTTNG_PERF_DELTA_0;
+	if (!(d >> 8))
+		return LTTNG_PERF_DELTA_8;
+	if (!(d >> 16))
+		return LTTNG_PERF_DELTA_16;
+	if (!(d >> 32))
+		return LTTNG_PERF_DELTA_32;
+	return LTTNG_PERF_DELTA_BASE;
+}
+
+/* 0, 1, 2, 4 or 8 bytes. */
+static
+size_t perf_counter_delta_size(enum lttng_perf_delta_width width)
+{
+	if (width >= LTTNG_PERF_DELTA_BASE)
+		return sizeof(uint64_t);
+	return (1U << width) >> 1;
+}
+
+static
+size_t perf_counter_delta_get_size(size_t offset, struct lttng_ctx_field *field,
+		struct lib_ring_buffer_ctx *ctx,
+		struct lttng_channel *chan)
+{
+	struct lttng_perf_counter_field *perf_field = field->u.perf_counter;
+	unsigned int nr_counters = perf_field->nr_counters;
+	struct perf_event **events = &perf_field->e[ctx->cpu * nr_counters];
+	struct lttng_perf_counter_delta *delta;
+	size_t size = 0;
+	unsigned int i;
+
+	if (!perf_counter_delta_outermost(chan, ctx))
+		return nr_counters * (sizeof(uint8_t) + sizeof(uint64_t));
+	delta = per_cpu_ptr(perf_field->delta, ctx->cpu);
+	delta->pending_packet = perf_counter_delta_packet(chan, ctx->cpu);
+	for (i = 0; i < nr_counters; i++) {
+		delta->pending[i] = perf_counter_read(events[i]);
+		size += sizeof(uint8_t) + perf_counter_delta_size(
+			perf_counter_delta_width(delta, i));
+	}
+	return size;
+}
+
+static
+void perf_counter_delta_record(struct lttng_ctx_field *field,
+		struct lib_ring_buffer_ctx *ctx,
+		struct lttng_channel *chan)
+{
+	struct lttng_perf_counter_field *perf_field = field->u.perf_counter;
+	unsigned int nr_counters = perf_field->nr_counters;
+	struct perf_event **events = &perf_field->e[ctx->cpu * nr_counters];
+	struct lttng_perf_counter_delta *delta;
+	unsigned int i;
+
+	if (!perf_counter_delta_outermost(chan, ctx)) {
+		uint8_t width = LTTNG_PERF_DELTA_FULL;
+
+		for (i = 0; i < nr_counters; i++) {
+			uint64_t value = perf_counter_read(events[i]);
+
+			chan->ops->event_write(ctx, &width, sizeof(width));
+			chan->ops->event_write(ctx, &value, sizeof(value));
+		}
+		return;
+	}
+	delta = per_cpu_ptr(perf_field->delta, ctx->cpu);
+	for (i = 0; i < nr_counters; i++) {
+		uint8_t width = perf_counter_delta_width(delta, i);
+		uint64_t d = delta->pending[i] - delta->ref[i];
+
+		chan->ops->event_write(ctx, &width, sizeof(width));
+		switch (width) {
+		case LTTNG_PERF_DELTA_0:
+			break;
+		case LTTNG_PERF_DELTA_8:
+		{
+			uint8_t v = (uint8_t) d;
+
+			chan->ops->event_write(ctx, &v, sizeof(v));
+			break;
+		}
+		case LTTNG_PERF_DELTA_16:
+		{
+			uint16_t v = (uint16_t) d;
+
+			chan->ops->event_write(ctx, &v, sizeof(v));
+			break;
+		}
+		case LTTNG_PERF_DELTA_32:
+		{
+			uint32_t v = (uint32_t) d;
+
+			chan->ops->event_write(ctx, &v, sizeof(v));
+			break;
+		}
+		default:
+			chan->ops->event_write(ctx, &delta->pending[i],
+				sizeof(uint64_t));
+			break;
+		}
+		delta->ref[i] = delta->pending[i];
+	}
+	delta->packet = subbuf_trunc(ctx->buf_offset, chan->chan);
+}
+
 #if defined(CONFIG_PERF_EVENTS) && (LINUX_VERSION_CODE >= KERNEL_VERSION(3,0,99))
 static
 void overflow_callback(struct perf_event *event,
@@ -75,6 +464,59 @@ void overflow_callback(struct perf_event *event, int nmi,
 }
 #endif
 
+static
+void perf_counters_release_cpu(struct lttng_perf_counter_field *perf_field,
+		int cpu)
+{
+	struct perf_event **events = &perf_field->e[cpu * perf_field->nr_counters];
+	struct perf_event *pevent;
+	unsigned int i;
+
+	for (i = 0; i < perf_field->nr_counters; i++) {
+		pevent = events[i];
+		if (!pevent)
+			continue;
+		events[i] = NULL;
+		barrier();	/* NULLify event before perf counter teardown */
+		perf_event_release_kernel(pevent);
+	}
+}
+
+/*
+ * Create the counters of a field on a cpu. On error, the counters
+ * already created on that cpu are released.
+ */
+static
+int perf_counters_create_cpu(struct lttng_perf_counter_field *perf_field,
+		int cpu)
+{
+	struct perf_event **events = &perf_field->e[cpu * perf_field->nr_counters];
+	struct perf_event *pevent;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < perf_field->nr_counters; i++) {
+		pevent = wrapper_perf_event_create_kernel_counter(&perf_field->attr[i],
+				cpu, NULL, overflow_callback);
+		if (!pevent || IS_ERR(pevent)) {
+			ret = -EINVAL;
+			goto error;
+		}
+		if (pevent->state == PERF_EVENT_STATE_ERROR) {
+			perf_event_release_kernel(pevent);
+			ret = -EBUSY;
+			goto error;
+		}
+		barrier();	/* Create perf counter before setting event */
+		events[i] = pevent;
+	}
+	return 0;
+
+error:
+	perf_counters_release_cpu(perf_field, cpu);
+	return ret;
+}
+
 static
 void lttng_destroy_perf_counter_field(struct lttng_ctx_field *field)
 {
@@ -97,7 +539,7 @@ void lttng_destroy_perf_counter_field(struct lttng_ctx_field *field)
 
 		get_online_cpus();
 		for_each_online_cpu(cpu)
-			perf_event_release_kernel(events[cpu]);
+			perf_counters_release_cpu(field->u.perf_counter, cpu);
 		put_online_cpus();
 #ifdef CONFIG_HOTPLUG_CPU
 		unregister_cpu_notifier(&field->u.perf_counter->nb);
@@ -106,6 +548,7 @@ void lttng_destroy_perf_counter_field(struct lttng_ctx_field *field)
 #endif /* #else #if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,10,0)) */
 	kfree(field->event_field.name);
 	kfree(field->u.perf_counter->attr);
+	free_percpu(field->u.perf_counter->delta);
 	lttng_kvfree(events);
 	kfree(field->u.perf_counter);
 }
@@ -118,21 +561,8 @@ int lttng_cpuhp_perf_counter_online(unsigned int cpu,
 	struct lttng_perf_counter_field *perf_field =
 		container_of(node, struct lttng_perf_counter_field,
 				cpuhp_online);
-	struct perf_event **events = perf_field->e;
-	struct perf_event_attr *attr = perf_field->attr;
-	struct perf_event *pevent;
 
-	pevent = wrapper_perf_event_create_kernel_counter(attr,
-			cpu, NULL, overflow_callback);
-	if (!pevent || IS_ERR(pevent))
-		return -EINVAL;
-	if (pevent->state == PERF_EVENT_STATE_ERROR) {
-		perf_event_release_kernel(pevent);
-		return -EINVAL;
-	}
-	barrier();	/* Create perf counter before setting event */
-	events[cpu] = pevent;
-	return 0;
+	return perf_counters_create_cpu(perf_field, cpu);
 }
 
 int lttng_cpuhp_perf_counter_dead(unsigned int cpu,
@@ -141,13 +571,8 @@ int lttng_cpuhp_perf_counter_dead(unsigned int cpu,
 	struct lttng_perf_counter_field *perf_field =
 		container_of(node, struct lttng_perf_counter_field,
 				cpuhp_prepare);
-	struct perf_event **events = perf_field->e;
-	struct perf_event *pevent;
 
-	pevent = events[cpu];
-	events[cpu] = NULL;
-	barrier();	/* NULLify event before perf counter teardown */
-	perf_event_release_kernel(pevent);
+	perf_counters_release_cpu(perf_field, cpu);
 	return 0;
 }
 
@@ -174,9 +599,6 @@ int lttng_perf_counter_cpu_hp_callback(struct notifier_block *nb,
 	unsigned int cpu = (unsigned long) hcpu;
 	struct lttng_perf_counter_field *perf_field =
 		container_of(nb, struct lttng_perf_counter_field, nb);
-	struct perf_event **events = perf_field->e;
-	struct perf_event_attr *attr = perf_field->attr;
-	struct perf_event *pevent;
 
 	if (!perf_field->hp_enable)
 		return NOTIFY_OK;
@@ -184,25 +606,14 @@ int lttng_perf_counter_cpu_hp_callback(struct notifier_block *nb,
 	switch (action) {
 	case CPU_ONLINE:
 	case CPU_ONLINE_FROZEN:
-		pevent = wrapper_perf_event_create_kernel_counter(attr,
-				cpu, NULL, overflow_callback);
-		if (!pevent || IS_ERR(pevent))
-			return NOTIFY_BAD;
-		if (pevent->state == PERF_EVENT_STATE_ERROR) {
-			perf_event_release_kernel(pevent);
+		if (perf_counters_create_cpu(perf_field, cpu))
 			return NOTIFY_BAD;
-		}
-		barrier();	/* Create perf counter before setting event */
-		events[cpu] = pevent;
 		break;
 	case CPU_UP_CANCELED:
 	case CPU_UP_CANCELED_FROZEN:
 	case CPU_DEAD:
 	case CPU_DEAD_FROZEN:
-		pevent = events[cpu];
-		events[cpu] = NULL;
-		barrier();	/* NULLify event before perf counter teardown */
-		perf_event_release_kernel(pevent);
+		perf_counters_release_cpu(perf_field, cpu);
 		break;
 	}
 	return NOTIFY_OK;
@@ -212,41 +623,66 @@ int lttng_perf_counter_cpu_hp_callback(struct notifier_block *nb,
 
 #endif /* #else #if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,10,0)) */
 
-int lttng_add_perf_counter_to_ctx(uint32_t type,
-				  uint64_t config,
-				  const char *name,
-				  struct lttng_ctx **ctx)
+/*
+ * A group field records all its counters as a single array. Its
+ * counters are pinned, so they are all scheduled on each cpu for as
+ * long as the field exists.
+ */
+static
+int __lttng_add_perf_counters_to_ctx(
+		const struct lttng_kernel_perf_counter_group_member *members,
+		unsigned int nr_counters, const char *name,
+		struct lttng_ctx **ctx, bool group, bool delta)
 {
 	struct lttng_ctx_field *field;
 	struct lttng_perf_counter_field *perf_field;
 	struct perf_event **events;
 	struct perf_event_attr *attr;
+	unsigned int i;
 	int ret;
 	char *name_alloc;
 
-	events = lttng_kvzalloc(num_possible_cpus() * sizeof(*events), GFP_KERNEL);
+	events = lttng_kvzalloc(num_possible_cpus() * nr_counters * sizeof(*events),
+			GFP_KERNEL);
 	if (!events)
 		return -ENOMEM;
 
-	attr = kzalloc(sizeof(struct perf_event_attr), GFP_KERNEL);
+	attr = kcalloc(nr_counters, sizeof(struct perf_event_attr), GFP_KERNEL);
 	if (!attr) {
 		ret = -ENOMEM;
 		goto error_attr;
 	}
 
-	attr->type = type;
-	attr->config = config;
-	attr->size = sizeof(struct perf_event_attr);
-	attr->pinned = 1;
-	attr->disabled = 0;
+	for (i = 0; i < nr_counters; i++) {
+		attr[i].type = members[i].type;
+		attr[i].config = members[i].config;
+		attr[i].size = sizeof(struct perf_event_attr);
+		attr[i].pinned = 1;
+		attr[i].disabled = 0;
+	}
 
 	perf_field = kzalloc(sizeof(struct lttng_perf_counter_field), GFP_KERNEL);
 	if (!perf_field) {
 		ret = -ENOMEM;
 		goto error_alloc_perf_field;
 	}
+	perf_field->nr_counters = nr_counters;
 	perf_field->e = events;
 	perf_field->attr = attr;
+	perf_counter_rdpmc_init();
+
+	if (delta) {
+		int cpu;
+
+		perf_field->delta = alloc_percpu(struct lttng_perf_counter_delta);
+		if (!perf_field->delta) {
+			ret = -ENOMEM;
+			goto delta_alloc_error;
+		}
+		/* No reference in any packet. */
+		for_each_possible_cpu(cpu)
+			per_cpu_ptr(perf_field->delta, cpu)->packet = ULONG_MAX;
+	}
 
 	name_alloc = kstrdup(name, GFP_KERNEL);
 	if (!name_alloc) {
@@ -290,16 +726,9 @@ int lttng_add_perf_counter_to_ctx(uint32_t type,
 #endif
 		get_online_cpus();
 		for_each_online_cpu(cpu) {
-			events[cpu] = wrapper_perf_event_create_kernel_counter(attr,
-						cpu, NULL, overflow_callback);
-			if (!events[cpu] || IS_ERR(events[cpu])) {
-				ret = -EINVAL;
+			ret = perf_counters_create_cpu(perf_field, cpu);
+			if (ret)
 				goto counter_error;
-			}
-			if (events[cpu]->state == PERF_EVENT_STATE_ERROR) {
-				ret = -EBUSY;
-				goto counter_busy;
-			}
 		}
 		put_online_cpus();
 		perf_field->hp_enable = 1;
@@ -309,15 +738,39 @@ int lttng_add_perf_counter_to_ctx(uint32_t type,
 	field->destroy = lttng_destroy_perf_counter_field;
 
 	field->event_field.name = name_alloc;
-	field->event_field.type.atype = atype_integer;
-	field->event_field.type.u.basic.integer.size = sizeof(uint64_t) * CHAR_BIT;
-	field->event_field.type.u.basic.integer.alignment = lttng_alignof(uint64_t) * CHAR_BIT;
-	field->event_field.type.u.basic.integer.signedness = lttng_is_signed_type(uint64_t);
-	field->event_field.type.u.basic.integer.reverse_byte_order = 0;
-	field->event_field.type.u.basic.integer.base = 10;
-	field->event_field.type.u.basic.integer.encoding = lttng_encode_none;
-	field->get_size = perf_counter_get_size;
-	field->record = perf_counter_record;
+	if (delta && group) {
+		field->event_field.type.atype = atype_array_compound;
+		field->event_field.type.u.array_compound.elem_type = &perf_delta_type;
+		field->event_field.type.u.array_compound.length = nr_counters;
+		field->get_size_arg = perf_counter_delta_get_size;
+		field->record = perf_counter_delta_record;
+	} else if (delta) {
+		field->event_field.type = perf_delta_type;
+		field->get_size_arg = perf_counter_delta_get_size;
+		field->record = perf_counter_delta_record;
+	} else if (group) {
+		field->event_field.type.atype = atype_array;
+		field->event_field.type.u.array.elem_type.atype = atype_integer;
+		field->event_field.type.u.array.elem_type.u.basic.integer.size = sizeof(uint64_t) * CHAR_BIT;
+		field->event_field.type.u.array.elem_type.u.basic.integer.alignment = lttng_alignof(uint64_t) * CHAR_BIT;
+		field->event_field.type.u.array.elem_type.u.basic.integer.signedness = lttng_is_signed_type(uint64_t);
+		field->event_field.type.u.array.elem_type.u.basic.integer.reverse_byte_order = 0;
+		field->event_field.type.u.array.elem_type.u.basic.integer.base = 10;
+		field->event_field.type.u.array.elem_type.u.basic.integer.encoding = lttng_encode_none;
+		field->event_field.type.u.array.length = nr_counters;
+		field->get_size_arg = perf_counter_group_get_size;
+		field->record = perf_counter_group_record;
+	} else {
+		field->event_field.type.atype = atype_integer;
+		field->event_field.type.u.basic.integer.size = sizeof(uint64_t) * CHAR_BIT;
+		field->event_field.type.u.basic.integer.alignment = lttng_alignof(uint64_t) * CHAR_BIT;
+		field->event_field.type.u.basic.integer.signedness = lttng_is_signed_type(uint64_t);
+		field->event_field.type.u.basic.integer.reverse_byte_order = 0;
+		field->event_field.type.u.basic.integer.base = 10;
+		field->event_field.type.u.basic.integer.encoding = lttng_encode_none;
+		field->get_size = perf_counter_get_size;
+		field->record = perf_counter_record;
+	}
 	field->u.perf_counter = perf_field;
 	lttng_context_update(*ctx);
 
@@ -335,15 +788,12 @@ cpuhp_online_error:
 	}
 cpuhp_prepare_error:
 #else	/* #if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,10,0)) */
-counter_busy:
 counter_error:
 	{
 		int cpu;
 
-		for_each_online_cpu(cpu) {
-			if (events[cpu] && !IS_ERR(events[cpu]))
-				perf_event_release_kernel(events[cpu]);
-		}
+		for_each_online_cpu(cpu)
+			perf_counters_release_cpu(perf_field, cpu);
 		put_online_cpus();
 #ifdef CONFIG_HOTPLUG_CPU
 		unregister_cpu_notifier(&perf_field->nb);
@@ -355,6 +805,8 @@ find_error:
 append_context_error:
 	kfree(name_alloc);
 name_alloc_error:
+	free_percpu(perf_field->delta);
+delta_alloc_error:
 	kfree(perf_field);
 error_alloc_perf_field:
 	kfree(attr);
@@ -362,3 +814,46 @@ error_attr:
 	lttng_kvfree(events);
 	return ret;
 }
+
+int lttng_add_perf_counter_to_ctx(uint32_t type,
+				  uint64_t config,
+				  const char *name,
+				  struct lttng_ctx **ctx)
+{
+	struct lttng_kernel_perf_counter_group_member member = {
+		.type = type,
+		.config = config,
+	};
+
+	return __lttng_add_perf_counters_to_ctx(&member, 1, name, ctx, false,
+			false);
+}
+EXPORT_SYMBOL_GPL(lttng_add_perf_counter_to_ctx);
+
+/* Record the counter as deltas from its previous value in the packet. */
+int lttng_add_perf_counter_delta_to_ctx(uint32_t type,
+				  uint64_t config,
+				  const char *name,
+				  struct lttng_ctx **ctx)
+{
+	struct lttng_kernel_perf_counter_group_member member = {
+		.type = type,
+		.config = config,
+	};
+
+	return __lttng_add_perf_counters_to_ctx(&member, 1, name, ctx, false,
+			true);
+}
+EXPORT_SYMBOL_GPL(lttng_add_perf_counter_delta_to_ctx);
+
+int lttng_add_perf_counter_group_to_ctx(
+		const struct lttng_kernel_perf_counter_group_member *members,
+		unsigned int nr_members,
+		const char *name,
+		struct lttng_ctx **ctx, bool delta)
+{
+	if (!nr_members || nr_members > LTTNG_KERNEL_PERF_COUNTER_GROUP_MAX)
+		return -EINVAL;
+	return __lttng_add_perf_counters_to_ctx(members, nr_members, name,
+			ctx, true, delta);
+}
@@ -31,6 +31,7 @@ void ppid_record(struct lttng_ctx_field *field,
 		 struct lib_ring_buffer_ctx *ctx,
 		 struct lttng_channel *chan)
 {
+	const struct lttng_task_ctx_cache *cache = lttng_task_ctx_cache_current();
 	pid_t ppid;
 
 	/*
@@ -40,9 +41,13 @@ void ppid_record(struct lttng_ctx_field *field,
 	 * it synchronizes both for RCU and RCU sched, and rely on
 	 * rcu_read_lock_sched_notrace.
 	 */
-	rcu_read_lock();
-	ppid = task_tgid_nr(current->real_parent);
-	rcu_read_unlock();
+	if (cache) {
+		ppid = cache->ppid;
+	} else {
+		rcu_read_lock();
+		ppid = task_tgid_nr(current->real_parent);
+		rcu_read_unlock();
+	}
 	lib_ring_buffer_align_ctx(ctx, lttng_alignof(ppid));
 	chan->ops->event_write(ctx, &ppid, sizeof(ppid));
 }
@@ -52,6 +57,7 @@ void ppid_get_value(struct lttng_ctx_field *field,
 		struct lttng_probe_ctx *lttng_probe_ctx,
 		union lttng_ctx_value *value)
 {
+	const struct lttng_task_ctx_cache *cache = lttng_task_ctx_cache_current();
 	pid_t ppid;
 
 	/*
@@ -61,9 +67,13 @@ void ppid_get_value(struct lttng_ctx_field *field,
 	 * it synchronizes both for RCU and RCU sched, and rely on
 	 * rcu_read_lock_sched_notrace.
 	 */
-	rcu_read_lock();
-	ppid = task_tgid_nr(current->real_parent);
-	rcu_read_unlock();
+	if (cache) {
+		ppid = cache->ppid;
+	} else {
+		rcu_read_lock();
+		ppid = task_tgid_nr(current->real_parent);
+		rcu_read_unlock();
+	}
 	value->s64 = ppid;
 }
 
@@ -90,6 +100,8 @@ int lttng_add_ppid_to_ctx(struct lttng_ctx **ctx)
 	field->record = ppid_record;
 	field->get_value = ppid_get_value;
 	lttng_context_update(*ctx);
+	if (!lttng_task_ctx_cache_get())
+		field->destroy = lttng_task_ctx_cache_destroy_field;
 	wrapper_vmalloc_sync_all();
 	return 0;
 }
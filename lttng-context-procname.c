@@ -10,6 +10,7 @@
 #include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/sched.h>
+#include <linux/string.h>
 #include <lttng-events.h>
 #include <wrapper/ringbuffer/frontend_types.h>
 #include <wrapper/vmalloc.h>
@@ -76,3 +77,19 @@ int lttng_add_procname_to_ctx(struct lttng_ctx **ctx)
 	return 0;
 }
 EXPORT_SYMBOL_GPL(lttng_add_procname_to_ctx);
+
+static
+size_t procname_get_string(char *dest)
+{
+	size_t len = strnlen(current->comm, sizeof(current->comm));
+
+	memcpy(dest, current->comm, len);
+	return len;
+}
+
+int lttng_add_procname_interned_to_ctx(struct lttng_ctx **ctx)
+{
+	return lttng_add_interned_string_to_ctx(ctx, "procname",
+			procname_get_string);
+}
+EXPORT_SYMBOL_GPL(lttng_add_procname_interned_to_ctx);
@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-context-ratelimit-suppressed.c
+ *
+ * LTTng rate limit suppressed records context.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <lttng-events.h>
+#include <wrapper/ringbuffer/frontend_types.h>
+#include <wrapper/vmalloc.h>
+#include <lttng-tracer.h>
+
+/*
+ * Number of records of the same rate limit key suppressed on this cpu
+ * since the previous record of this key, 0 for events which are not rate
+ * limited.
+ */
+
+static
+size_t ratelimit_suppressed_get_size(size_t offset)
+{
+	size_t size = 0;
+
+	size += lib_ring_buffer_align(offset, lttng_alignof(uint32_t));
+	size += sizeof(uint32_t);
+	return size;
+}
+
+static
+void ratelimit_suppressed_record(struct lttng_ctx_field *field,
+		struct lib_ring_buffer_ctx *ctx,
+		struct lttng_channel *chan)
+{
+	struct lttng_probe_ctx *lttng_probe_ctx = ctx->priv;
+	uint32_t ratelimit_suppressed = lttng_probe_ctx->ratelimit_suppressed;
+
+	lib_ring_buffer_align_ctx(ctx, lttng_alignof(ratelimit_suppressed));
+	chan->ops->event_write(ctx, &ratelimit_suppressed, sizeof(ratelimit_suppressed));
+}
+
+int lttng_add_ratelimit_suppressed_to_ctx(struct lttng_ctx **ctx)
+{
+	struct lttng_ctx_field *field;
+
+	field = lttng_append_context(ctx);
+	if (!field)
+		return -ENOMEM;
+	if (lttng_find_context(*ctx, "ratelimit_suppressed")) {
+		lttng_remove_context_field(ctx, field);
+		return -EEXIST;
+	}
+	field->event_field.name = "ratelimit_suppressed";
+	field->event_field.type.atype = atype_integer;
+	field->event_field.type.u.basic.integer.size = sizeof(uint32_t) * CHAR_BIT;
+	field->event_field.type.u.basic.integer.alignment = lttng_alignof(uint32_t) * CHAR_BIT;
+	field->event_field.type.u.basic.integer.signedness = lttng_is_signed_type(uint32_t);
+	field->event_field.type.u.basic.integer.reverse_byte_order = 0;
+	field->event_field.type.u.basic.integer.base = 10;
+	field->event_field.type.u.basic.integer.encoding = lttng_encode_none;
+	field->get_size = ratelimit_suppressed_get_size;
+	field->record = ratelimit_suppressed_record;
+	lttng_context_update(*ctx);
+	wrapper_vmalloc_sync_all();
+	return 0;
+}
+EXPORT_SYMBOL_GPL(lttng_add_ratelimit_suppressed_to_ctx);
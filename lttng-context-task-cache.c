@@ -0,0 +1,148 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-context-task-cache.c
+ *
+ * LTTng per-cpu cache of the current task context values.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/pid_namespace.h>
+#include <linux/rcupdate.h>
+
+#include <wrapper/tracepoint.h>
+#include <lttng-kernel-version.h>
+#include <lttng-events.h>
+
+/*
+ * When enabled, the vpid, vtid, ppid and vppid contexts read the values
+ * computed by a sched_switch probe when the task is scheduled in,
+ * rather than chasing the namespace and parent pointers on each event.
+ *
+ * The values are those of the last schedule-in: the parent of a task
+ * reparented while it runs is only seen after its next schedule. This
+ * is why the cache is disabled by default.
+ *
+ * The entry of a cpu is only written by the scheduler on that cpu, with
+ * interrupts off. The task pointer is cleared during the update, so a
+ * reader in NMI context falls back on the direct computation, as does
+ * any reader running between the probe and the actual switch.
+ */
+
+static int task_ctx_cache_enable;
+module_param_named(task_context_cache, task_ctx_cache_enable, int, 0644);
+MODULE_PARM_DESC(task_context_cache, "Cache vpid, vtid, ppid and vppid contexts at schedule-in (0: disabled, 1: enabled)");
+
+static DEFINE_PER_CPU(struct lttng_task_ctx_cache, task_ctx_cache);
+static DEFINE_MUTEX(task_ctx_cache_mutex);
+static int task_ctx_cache_refcount;
+static int task_ctx_cache_active;
+
+static
+void lttng_task_ctx_cache_fill(struct lttng_task_ctx_cache *cache,
+		struct task_struct *next)
+{
+	struct pid_namespace *ns;
+	struct task_struct *parent;
+
+	WRITE_ONCE(cache->task, NULL);
+	barrier();
+	/*
+	 * Same values as computed from "next" itself once it runs: current
+	 * is still the previous task here.
+	 */
+	ns = task_active_pid_ns(next);
+	parent = rcu_dereference_sched(next->real_parent);
+	cache->ppid = task_tgid_nr(parent);
+	if (!next->nsproxy || !ns) {
+		cache->vpid = 0;
+		cache->vtid = 0;
+		cache->vppid = 0;
+	} else {
+		cache->vpid = task_tgid_nr_ns(next, ns);
+		cache->vtid = task_pid_nr_ns(next, ns);
+		cache->vppid = task_tgid_nr_ns(parent, ns);
+	}
+	barrier();
+	WRITE_ONCE(cache->task, next);
+}
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,4,0))
+static
+void lttng_task_ctx_cache_sched_switch(void *data, bool preempt,
+		struct task_struct *prev, struct task_struct *next)
+#else
+static
+void lttng_task_ctx_cache_sched_switch(void *data,
+		struct task_struct *prev, struct task_struct *next)
+#endif
+{
+	lttng_task_ctx_cache_fill(this_cpu_ptr(&task_ctx_cache), next);
+}
+
+/*
+ * Return the cache entry of the current task, or NULL if the caller
+ * must compute the values itself. Called with preemption disabled.
+ */
+const struct lttng_task_ctx_cache *lttng_task_ctx_cache_current(void)
+{
+	struct lttng_task_ctx_cache *cache;
+
+	if (!READ_ONCE(task_ctx_cache_active))
+		return NULL;
+	cache = this_cpu_ptr(&task_ctx_cache);
+	if (READ_ONCE(cache->task) != current)
+		return NULL;
+	barrier();
+	return cache;
+}
+
+/*
+ * Take a reference on the cache for a context field. Returns 0 if the
+ * cache is used, in which case lttng_task_ctx_cache_put() must be called
+ * when the field is destroyed.
+ */
+int lttng_task_ctx_cache_get(void)
+{
+	int cpu, ret = 0;
+
+	if (!READ_ONCE(task_ctx_cache_enable))
+		return -ENOSYS;
+	mutex_lock(&task_ctx_cache_mutex);
+	if (task_ctx_cache_refcount++)
+		goto end;
+	/* Entries left over from a previous registration. */
+	for_each_possible_cpu(cpu)
+		WRITE_ONCE(per_cpu_ptr(&task_ctx_cache, cpu)->task, NULL);
+	ret = lttng_wrapper_tracepoint_probe_register("sched_switch",
+			(void *) lttng_task_ctx_cache_sched_switch, NULL);
+	if (ret) {
+		task_ctx_cache_refcount--;
+		goto end;
+	}
+	WRITE_ONCE(task_ctx_cache_active, 1);
+end:
+	mutex_unlock(&task_ctx_cache_mutex);
+	return ret;
+}
+
+void lttng_task_ctx_cache_put(void)
+{
+	mutex_lock(&task_ctx_cache_mutex);
+	if (!--task_ctx_cache_refcount) {
+		WRITE_ONCE(task_ctx_cache_active, 0);
+		WARN_ON_ONCE(lttng_wrapper_tracepoint_probe_unregister("sched_switch",
+				(void *) lttng_task_ctx_cache_sched_switch, NULL));
+	}
+	mutex_unlock(&task_ctx_cache_mutex);
+}
+
+void lttng_task_ctx_cache_destroy_field(struct lttng_ctx_field *field)
+{
+	lttng_task_ctx_cache_put();
+}
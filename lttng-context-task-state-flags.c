@@ -0,0 +1,150 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-context-task-state-flags.c
+ *
+ * LTTng task state flags context.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/irqflags.h>
+#include <lttng-events.h>
+#include <wrapper/ringbuffer/frontend_types.h>
+#include <wrapper/vmalloc.h>
+#include <lttng-tracer.h>
+
+/*
+ * The interruptible, need_reschedule, preemptible and migratable
+ * contexts packed as one-bit fields of a single byte, computed by a
+ * single callback. The preemptible and migratable bits are only present
+ * on kernels providing the corresponding contexts. The bit fields are
+ * laid out in the native byte order, starting from the least
+ * significant bit on little-endian architectures, and from the most
+ * significant one on big-endian architectures.
+ */
+
+/* Nesting of preempt disabling within LTTng, as for preemptible. */
+#define LTTNG_PREEMPT_DISABLE_NESTING	2
+
+enum lttng_task_state_flag {
+	LTTNG_TASK_STATE_INTERRUPTIBLE,
+	LTTNG_TASK_STATE_NEED_RESCHEDULE,
+#if defined(CONFIG_PREEMPT_RT_FULL) || defined(CONFIG_PREEMPT)
+	LTTNG_TASK_STATE_PREEMPTIBLE,
+#endif
+#ifdef CONFIG_PREEMPT_RT_FULL
+	LTTNG_TASK_STATE_MIGRATABLE,
+#endif
+	NR_LTTNG_TASK_STATE_FLAGS,
+};
+
+#define __type_task_state_bits(_size, _alignment)	\
+	__type_integer(uint8_t, _size, _alignment, 0, __BYTE_ORDER, 10, none)
+
+static struct lttng_event_field task_state_fields[] = {
+	[LTTNG_TASK_STATE_INTERRUPTIBLE] = {
+		.name = "interruptible",
+		/* The first bit starts on a byte. */
+		.type = __type_task_state_bits(1, CHAR_BIT),
+	},
+	[LTTNG_TASK_STATE_NEED_RESCHEDULE] = {
+		.name = "need_reschedule",
+		.type = __type_task_state_bits(1, 1),
+	},
+#if defined(CONFIG_PREEMPT_RT_FULL) || defined(CONFIG_PREEMPT)
+	[LTTNG_TASK_STATE_PREEMPTIBLE] = {
+		.name = "preemptible",
+		.type = __type_task_state_bits(1, 1),
+	},
+#endif
+#ifdef CONFIG_PREEMPT_RT_FULL
+	[LTTNG_TASK_STATE_MIGRATABLE] = {
+		.name = "migratable",
+		.type = __type_task_state_bits(1, 1),
+	},
+#endif
+	[NR_LTTNG_TASK_STATE_FLAGS] = {
+		.name = "padding",
+		.type = __type_task_state_bits(CHAR_BIT - NR_LTTNG_TASK_STATE_FLAGS, 1),
+	},
+};
+
+static inline
+uint8_t task_state_bit(enum lttng_task_state_flag flag, bool set)
+{
+	if (!set)
+		return 0;
+#if __BYTE_ORDER == __BIG_ENDIAN
+	return 1U << (CHAR_BIT - 1 - flag);
+#else
+	return 1U << flag;
+#endif
+}
+
+static
+uint8_t task_state_flags(struct lttng_probe_ctx *lttng_probe_ctx)
+{
+	uint8_t flags = 0;
+
+	/* Unknown (-1) interruptible state recorded as 0. */
+	flags |= task_state_bit(LTTNG_TASK_STATE_INTERRUPTIBLE,
+			(int8_t) lttng_probe_ctx->interruptible > 0);
+	flags |= task_state_bit(LTTNG_TASK_STATE_NEED_RESCHEDULE,
+			test_tsk_need_resched(current));
+#if defined(CONFIG_PREEMPT_RT_FULL) || defined(CONFIG_PREEMPT)
+	flags |= task_state_bit(LTTNG_TASK_STATE_PREEMPTIBLE,
+			preempt_count() == LTTNG_PREEMPT_DISABLE_NESTING);
+#endif
+#ifdef CONFIG_PREEMPT_RT_FULL
+	flags |= task_state_bit(LTTNG_TASK_STATE_MIGRATABLE,
+			!current->migrate_disable);
+#endif
+	return flags;
+}
+
+static
+size_t task_state_flags_get_size(size_t offset)
+{
+	size_t size = 0;
+
+	size += lib_ring_buffer_align(offset, lttng_alignof(uint8_t));
+	size += sizeof(uint8_t);
+	return size;
+}
+
+static
+void task_state_flags_record(struct lttng_ctx_field *field,
+		struct lib_ring_buffer_ctx *ctx,
+		struct lttng_channel *chan)
+{
+	uint8_t flags = task_state_flags(ctx->priv);
+
+	lib_ring_buffer_align_ctx(ctx, lttng_alignof(flags));
+	chan->ops->event_write(ctx, &flags, sizeof(flags));
+}
+
+int lttng_add_task_state_flags_to_ctx(struct lttng_ctx **ctx)
+{
+	struct lttng_ctx_field *field;
+
+	field = lttng_append_context(ctx);
+	if (!field)
+		return -ENOMEM;
+	if (lttng_find_context(*ctx, "task_state_flags")) {
+		lttng_remove_context_field(ctx, field);
+		return -EEXIST;
+	}
+	field->event_field.name = "task_state_flags";
+	field->event_field.type.atype = atype_struct;
+	field->event_field.type.u._struct.nr_fields = ARRAY_SIZE(task_state_fields);
+	field->event_field.type.u._struct.fields = task_state_fields;
+	field->get_size = task_state_flags_get_size;
+	field->record = task_state_flags_record;
+	lttng_context_update(*ctx);
+	wrapper_vmalloc_sync_all();
+	return 0;
+}
+EXPORT_SYMBOL_GPL(lttng_add_task_state_flags_to_ctx);
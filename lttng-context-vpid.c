@@ -30,12 +30,15 @@ void vpid_record(struct lttng_ctx_field *field,
 		 struct lib_ring_buffer_ctx *ctx,
 		 struct lttng_channel *chan)
 {
+	const struct lttng_task_ctx_cache *cache = lttng_task_ctx_cache_current();
 	pid_t vpid;
 
 	/*
 	 * nsproxy can be NULL when scheduled out of exit.
 	 */
-	if (!current->nsproxy)
+	if (cache)
+		vpid = cache->vpid;
+	else if (!current->nsproxy)
 		vpid = 0;
 	else
 		vpid = task_tgid_vnr(current);
@@ -48,12 +51,15 @@ void vpid_get_value(struct lttng_ctx_field *field,
 		struct lttng_probe_ctx *lttng_probe_ctx,
 		union lttng_ctx_value *value)
 {
+	const struct lttng_task_ctx_cache *cache = lttng_task_ctx_cache_current();
 	pid_t vpid;
 
 	/*
 	 * nsproxy can be NULL when scheduled out of exit.
 	 */
-	if (!current->nsproxy)
+	if (cache)
+		vpid = cache->vpid;
+	else if (!current->nsproxy)
 		vpid = 0;
 	else
 		vpid = task_tgid_vnr(current);
@@ -83,6 +89,8 @@ int lttng_add_vpid_to_ctx(struct lttng_ctx **ctx)
 	field->record = vpid_record;
 	field->get_value = vpid_get_value;
 	lttng_context_update(*ctx);
+	if (!lttng_task_ctx_cache_get())
+		field->destroy = lttng_task_ctx_cache_destroy_field;
 	wrapper_vmalloc_sync_all();
 	return 0;
 }
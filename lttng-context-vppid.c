@@ -31,6 +31,7 @@ void vppid_record(struct lttng_ctx_field *field,
 		  struct lib_ring_buffer_ctx *ctx,
 		  struct lttng_channel *chan)
 {
+	const struct lttng_task_ctx_cache *cache = lttng_task_ctx_cache_current();
 	struct task_struct *parent;
 	pid_t vppid;
 
@@ -47,13 +48,17 @@ void vppid_record(struct lttng_ctx_field *field,
 	 * rcu_read_lock_sched_notrace.
 	 */
 
-	rcu_read_lock();
-	parent = rcu_dereference(current->real_parent);
-	if (!current->nsproxy)
-		vppid = 0;
-	else
-		vppid = task_tgid_vnr(parent);
-	rcu_read_unlock();
+	if (cache) {
+		vppid = cache->vppid;
+	} else {
+		rcu_read_lock();
+		parent = rcu_dereference(current->real_parent);
+		if (!current->nsproxy)
+			vppid = 0;
+		else
+			vppid = task_tgid_vnr(parent);
+		rcu_read_unlock();
+	}
 	lib_ring_buffer_align_ctx(ctx, lttng_alignof(vppid));
 	chan->ops->event_write(ctx, &vppid, sizeof(vppid));
 }
@@ -63,6 +68,7 @@ void vppid_get_value(struct lttng_ctx_field *field,
 		struct lttng_probe_ctx *lttng_probe_ctx,
 		union lttng_ctx_value *value)
 {
+	const struct lttng_task_ctx_cache *cache = lttng_task_ctx_cache_current();
 	struct task_struct *parent;
 	pid_t vppid;
 
@@ -79,13 +85,17 @@ void vppid_get_value(struct lttng_ctx_field *field,
 	 * rcu_read_lock_sched_notrace.
 	 */
 
-	rcu_read_lock();
-	parent = rcu_dereference(current->real_parent);
-	if (!current->nsproxy)
-		vppid = 0;
-	else
-		vppid = task_tgid_vnr(parent);
-	rcu_read_unlock();
+	if (cache) {
+		vppid = cache->vppid;
+	} else {
+		rcu_read_lock();
+		parent = rcu_dereference(current->real_parent);
+		if (!current->nsproxy)
+			vppid = 0;
+		else
+			vppid = task_tgid_vnr(parent);
+		rcu_read_unlock();
+	}
 	value->s64 = vppid;
 }
 
@@ -112,6 +122,8 @@ int lttng_add_vppid_to_ctx(struct lttng_ctx **ctx)
 	field->record = vppid_record;
 	field->get_value = vppid_get_value;
 	lttng_context_update(*ctx);
+	if (!lttng_task_ctx_cache_get())
+		field->destroy = lttng_task_ctx_cache_destroy_field;
 	wrapper_vmalloc_sync_all();
 	return 0;
 }
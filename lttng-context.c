@@ -92,10 +92,45 @@ struct lttng_ctx_field *lttng_append_context(struct lttng_ctx **ctx_p)
 	}
 	field = &ctx->fields[ctx->nr_fields];
 	ctx->nr_fields++;
+	/* Until the next lttng_context_update(). */
+	ctx->fixed_size = 0;
+	ctx->packed_fixed_size = 0;
 	return field;
 }
 EXPORT_SYMBOL_GPL(lttng_append_context);
 
+/*
+ * Contexts made only of fixed-size fields have the same layout in every
+ * record, starting on largest_align: compute their size once, instead
+ * of at each reservation. The get_size() callbacks only pad before
+ * their field, so packed records size them at offset 0.
+ */
+static
+size_t lttng_context_fixed_size(struct lttng_ctx *ctx, int packed)
+{
+	size_t offset = 0;
+	int i;
+
+	for (i = 0; i < ctx->nr_fields; i++) {
+		struct lttng_ctx_field *field = &ctx->fields[i];
+
+		if (field->guard)
+			return 0;
+		switch (field->event_field.type.atype) {
+		case atype_integer:
+		case atype_array:
+		case atype_array_bitfield:
+			break;
+		default:
+			return 0;
+		}
+		if (field->get_size_arg || !field->get_size)
+			return 0;
+		offset += field->get_size(packed ? 0 : offset);
+	}
+	return offset;
+}
+
 /*
  * lttng_context_update() should be called at least once between context
  * modification and trace start.
@@ -109,7 +144,11 @@ void lttng_context_update(struct lttng_ctx *ctx)
 		struct lttng_type *type;
 		size_t field_align = 8;
 
-		type = &ctx->fields[i].event_field.type;
+		/* Guarded contexts begin with their tag. */
+		if (ctx->fields[i].guard)
+			type = &ctx->fields[i].guard->field.type;
+		else
+			type = &ctx->fields[i].event_field.type;
 		switch (type->atype) {
 		case atype_integer:
 			field_align = type->u.basic.integer.alignment;
@@ -208,6 +247,8 @@ void lttng_context_update(struct lttng_ctx *ctx)
 		largest_align = max_t(size_t, largest_align, field_align);
 	}
 	ctx->largest_align = largest_align >> 3;	/* bits to bytes */
+	ctx->fixed_size = lttng_context_fixed_size(ctx, 0);
+	ctx->packed_fixed_size = lttng_context_fixed_size(ctx, 1);
 }
 
 /*
@@ -222,6 +263,7 @@ void lttng_remove_context_field(struct lttng_ctx **ctx_p,
 	ctx->nr_fields--;
 	WARN_ON_ONCE(&ctx->fields[ctx->nr_fields] != field);
 	memset(&ctx->fields[ctx->nr_fields], 0, sizeof(struct lttng_ctx_field));
+	lttng_context_update(ctx);
 }
 EXPORT_SYMBOL_GPL(lttng_remove_context_field);
 
@@ -234,6 +276,7 @@ void lttng_destroy_context(struct lttng_ctx *ctx)
 	for (i = 0; i < ctx->nr_fields; i++) {
 		if (ctx->fields[i].destroy)
 			ctx->fields[i].destroy(&ctx->fields[i]);
+		lttng_ctx_guard_destroy(ctx->fields[i].guard);
 	}
 	lttng_kvfree(ctx->fields);
 	kfree(ctx);
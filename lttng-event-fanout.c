@@ -0,0 +1,298 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-event-fanout.c
+ *
+ * LTTng tracepoint event fan-out to several sessions and channels.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+
+#include <wrapper/tracepoint.h>
+#include <wrapper/ringbuffer/backend.h>
+#include <lttng-events.h>
+#include <lttng-tracer.h>
+#include <lttng-tp-mempool.h>
+
+/*
+ * Built with CONFIG_LTTNG_EVENT_FANOUT, all the events of a tracepoint
+ * are registered as a single probe, the fan-out probe of the event
+ * class, with a fan-out group as probe data. The probe serializes the
+ * payload once into a scratch buffer of the tracepoint memory pool, and
+ * copies it into the reservation of each event recording it. The
+ * filters, contexts and record headers are still evaluated per event.
+ *
+ * The payload of the scratch buffer starts aligned on its largest
+ * alignment, like the payload of a record, so its layout is the same
+ * in all channels. Packed channels, which do not align the payload,
+ * keep the per-event serialization.
+ *
+ * Groups are created and updated with the sessions mutex held. An empty
+ * group is unregistered, and freed by lttng_event_fanout_free_released()
+ * once the probes which may still use it have completed.
+ */
+
+static LIST_HEAD(fanout_groups);		/* Registered groups */
+static LIST_HEAD(fanout_released);		/* Empty, unregistered groups */
+
+/*
+ * Return a scratch buffer from the tracepoint memory pool, or NULL if
+ * the payload does not fit, or if no slot is free for the current
+ * nesting level. Called with preemption disabled, from the probe.
+ */
+void *lttng_event_fanout_scratch_get(size_t len)
+{
+	return lttng_tp_mempool_alloc_raw(len);
+}
+EXPORT_SYMBOL_GPL(lttng_event_fanout_scratch_get);
+
+void lttng_event_fanout_scratch_put(void *scratch)
+{
+	lttng_tp_mempool_free(scratch);
+}
+EXPORT_SYMBOL_GPL(lttng_event_fanout_scratch_put);
+
+/*
+ * Scratch buffer writers, with the semantic of the ring buffer client
+ * operations. The context private data is the scratch buffer, and the
+ * context offset is relative to it.
+ */
+static
+void lttng_fanout_write(struct lib_ring_buffer_ctx *ctx, const void *src,
+		size_t len)
+{
+	lib_ring_buffer_do_copy(NULL, (char *) ctx->priv + ctx->buf_offset,
+			src, len);
+	ctx->buf_offset += len;
+}
+
+static
+void lttng_fanout_write_from_user(struct lib_ring_buffer_ctx *ctx,
+		const void *src, size_t len)
+{
+	char *dest = (char *) ctx->priv + ctx->buf_offset;
+
+	if (lib_ring_buffer_copy_from_user_check_nofault(dest,
+			(const void __user *) src, len))
+		memset(dest, 0, len);
+	ctx->buf_offset += len;
+}
+
+static
+void lttng_fanout_memset(struct lib_ring_buffer_ctx *ctx, int c, size_t len)
+{
+	lib_ring_buffer_do_memset((char *) ctx->priv + ctx->buf_offset, c, len);
+	ctx->buf_offset += len;
+}
+
+static
+void lttng_fanout_strcpy(struct lib_ring_buffer_ctx *ctx, const char *src,
+		size_t len)
+{
+	char *dest = (char *) ctx->priv + ctx->buf_offset;
+	size_t count;
+
+	if (unlikely(!len))
+		return;
+	count = lib_ring_buffer_do_strcpy(NULL, dest, src, len - 1);
+	/* Padding */
+	if (unlikely(count < len - 1))
+		lib_ring_buffer_do_memset(dest + count, '#', len - 1 - count);
+	/* Ending '\0' */
+	dest[len - 1] = '\0';
+	ctx->buf_offset += len;
+}
+
+static
+void lttng_fanout_strcpy_from_user(struct lib_ring_buffer_ctx *ctx,
+		const char __user *src, size_t len)
+{
+	char *dest = (char *) ctx->priv + ctx->buf_offset;
+	mm_segment_t old_fs = get_fs();
+	size_t count = 0;
+
+	if (unlikely(!len))
+		return;
+	set_fs(KERNEL_DS);
+	pagefault_disable();
+	if (likely(access_ok(VERIFY_READ, src, len)))
+		count = lib_ring_buffer_do_strcpy_from_user_inatomic(NULL,
+				dest, src, len - 1);
+	pagefault_enable();
+	set_fs(old_fs);
+	/* Padding */
+	if (unlikely(count < len - 1))
+		lib_ring_buffer_do_memset(dest + count, '#', len - 1 - count);
+	/* Ending '\0' */
+	dest[len - 1] = '\0';
+	ctx->buf_offset += len;
+}
+
+static
+size_t lttng_fanout_strscpy(struct lib_ring_buffer_ctx *ctx, const char *src,
+		size_t len)
+{
+	char *dest = (char *) ctx->priv + ctx->buf_offset;
+	size_t count;
+
+	if (unlikely(!len))
+		return 0;
+	count = lib_ring_buffer_do_strcpy(NULL, dest, src, len - 1);
+	/* Ending '\0' */
+	dest[count] = '\0';
+	ctx->buf_offset += count + 1;
+	return count + 1;
+}
+
+static
+size_t lttng_fanout_strscpy_from_user(struct lib_ring_buffer_ctx *ctx,
+		const char __user *src, size_t len)
+{
+	char *dest = (char *) ctx->priv + ctx->buf_offset;
+	mm_segment_t old_fs = get_fs();
+	size_t count = 0;
+
+	if (unlikely(!len))
+		return 0;
+	set_fs(KERNEL_DS);
+	pagefault_disable();
+	if (likely(access_ok(VERIFY_READ, src, len)))
+		count = lib_ring_buffer_do_strcpy_from_user_inatomic(NULL,
+				dest, src, len - 1);
+	pagefault_enable();
+	set_fs(old_fs);
+	/* Ending '\0' */
+	dest[count] = '\0';
+	ctx->buf_offset += count + 1;
+	return count + 1;
+}
+
+/*
+ * The payload is copied into each record with its exact size: the slack
+ * field always ends it with no unused space.
+ */
+static
+void lttng_fanout_shrink(struct lib_ring_buffer_ctx *ctx)
+{
+	uint16_t slack = 0;
+
+	lib_ring_buffer_align_ctx(ctx, lttng_alignof(slack));
+	lttng_fanout_write(ctx, &slack, sizeof(slack));
+}
+
+static const struct lttng_channel_ops fanout_scratch_ops = {
+	.event_write = lttng_fanout_write,
+	.event_write_from_user = lttng_fanout_write_from_user,
+	.event_memset = lttng_fanout_memset,
+	.event_strcpy = lttng_fanout_strcpy,
+	.event_strcpy_from_user = lttng_fanout_strcpy_from_user,
+	.event_strscpy = lttng_fanout_strscpy,
+	.event_strscpy_from_user = lttng_fanout_strscpy_from_user,
+	.event_shrink = lttng_fanout_shrink,
+};
+
+const struct lttng_event_fanout_chan lttng_event_fanout_chan = {
+	.ops = &fanout_scratch_ops,
+};
+EXPORT_SYMBOL_GPL(lttng_event_fanout_chan);
+
+static
+struct lttng_event_fanout *lttng_event_fanout_find(struct list_head *head,
+		const struct lttng_event_desc *desc)
+{
+	struct lttng_event_fanout *fanout;
+
+	list_for_each_entry(fanout, head, node) {
+		if (fanout->desc == desc)
+			return fanout;
+	}
+	return NULL;
+}
+
+/*
+ * Add a tracepoint event to the fan-out group of its tracepoint,
+ * registering the group probe for the first event. A released group
+ * of the tracepoint is registered again rather than replaced: a probe
+ * still iterating on a re-added event then ends on the same list head.
+ * Must be called with sessions_mutex held.
+ */
+int lttng_event_fanout_register(struct lttng_event *event)
+{
+	const struct lttng_event_desc *desc = event->desc;
+	struct lttng_event_fanout *fanout;
+	int ret;
+
+	fanout = lttng_event_fanout_find(&fanout_groups, desc);
+	if (fanout)
+		goto add;
+	fanout = lttng_event_fanout_find(&fanout_released, desc);
+	if (!fanout) {
+		fanout = kzalloc(sizeof(*fanout), GFP_KERNEL);
+		if (!fanout)
+			return -ENOMEM;
+		fanout->desc = desc;
+		INIT_LIST_HEAD(&fanout->events);
+		list_add(&fanout->node, &fanout_released);
+	}
+	ret = lttng_wrapper_tracepoint_probe_register(desc->kname,
+			desc->fanout_callback, fanout);
+	if (ret)
+		return ret;
+	list_move(&fanout->node, &fanout_groups);
+add:
+	list_add_tail_rcu(&event->fanout_node, &fanout->events);
+	event->fanout = fanout;
+	return 0;
+}
+
+/*
+ * Remove a tracepoint event from its fan-out group, unregistering the
+ * group probe with the last event. The probe may still iterate on the
+ * event until the next synchronize_trace().
+ * Must be called with sessions_mutex held.
+ */
+int lttng_event_fanout_unregister(struct lttng_event *event)
+{
+	struct lttng_event_fanout *fanout = event->fanout;
+	int ret;
+
+	if (!list_is_singular(&fanout->events)) {
+		list_del_rcu(&event->fanout_node);
+		event->fanout = NULL;
+		return 0;
+	}
+	ret = lttng_wrapper_tracepoint_probe_unregister(fanout->desc->kname,
+			fanout->desc->fanout_callback, fanout);
+	if (ret)
+		return ret;
+	list_del_rcu(&event->fanout_node);
+	event->fanout = NULL;
+	list_move(&fanout->node, &fanout_released);
+	return 0;
+}
+
+/*
+ * Free the groups unregistered before the last synchronize_trace().
+ * Must be called with sessions_mutex held.
+ */
+void lttng_event_fanout_free_released(void)
+{
+	struct lttng_event_fanout *fanout, *tmp;
+
+	list_for_each_entry_safe(fanout, tmp, &fanout_released, node) {
+		list_del(&fanout->node);
+		kfree(fanout);
+	}
+}
+
+/* Called once all sessions are destroyed. */
+void lttng_event_fanout_exit(void)
+{
+	WARN_ON_ONCE(!list_empty(&fanout_groups));
+	lttng_event_fanout_free_released();
+}
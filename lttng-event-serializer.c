@@ -0,0 +1,301 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-event-serializer.c
+ *
+ * LTTng table-driven event serializer.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/percpu.h>
+#include <linux/string.h>
+
+#include <wrapper/ringbuffer/frontend_types.h>
+#include <lttng-events.h>
+#include <lttng-tracer.h>
+
+/*
+ * Built with CONFIG_LTTNG_TABLE_SERIALIZER, the probes of cold events
+ * (those which are not hot events of their channel) only snapshot their
+ * field sources into a structure, and this function walks the event
+ * field descriptors to size and write the record. The offset of each
+ * field source within the structure is precomputed by the probe, one
+ * per field descriptor. The code of a single function then serializes
+ * most events, instead of the per-event code expanded in each probe.
+ *
+ * Sources are, per field type:
+ * - integers and enumerations: the value, of the field type,
+ * - arrays: a pointer to the elements,
+ * - sequences: a struct lttng_event_table_seq,
+ * - strings: a pointer to the string, or NULL.
+ *
+ * Fields fetched from user-space, bounded strings, compound types and
+ * custom fields are not handled: classes using them keep the expanded
+ * code. The string lengths are kept on the dynamic length stack between
+ * the sizing and the writing of the record, as the expanded code does.
+ */
+
+#define LTTNG_NULL_STRING	"(null)"
+
+static inline
+size_t lttng_table_integer_align(const struct lttng_integer_type *type)
+{
+	return type->alignment / CHAR_BIT;
+}
+
+static inline
+size_t lttng_table_integer_size(const struct lttng_integer_type *type)
+{
+	return type->size / CHAR_BIT;
+}
+
+/* Write a sequence length with the size of its descriptor length type. */
+static
+void lttng_table_write_length(struct lttng_channel *chan,
+		struct lib_ring_buffer_ctx *ctx,
+		const struct lttng_integer_type *type, size_t len)
+{
+	union {
+		uint8_t v8;
+		uint16_t v16;
+		uint32_t v32;
+		uint64_t v64;
+	} u;
+
+	switch (type->size) {
+	case 8:
+		u.v8 = len;
+		break;
+	case 16:
+		u.v16 = len;
+		break;
+	case 32:
+		u.v32 = len;
+		break;
+	case 64:
+		u.v64 = len;
+		break;
+	default:
+		WARN_ON_ONCE(1);
+		return;
+	}
+	lib_ring_buffer_align_ctx(ctx, lttng_table_integer_align(type));
+	chan->ops->event_write(ctx, &u, type->size / CHAR_BIT);
+}
+
+/*
+ * Returns the payload size, and its largest alignment in "align", or -1
+ * if the string lengths do not fit the dynamic length stack.
+ */
+static
+ssize_t lttng_table_get_size(const struct lttng_event_desc *desc,
+		const size_t *offsets, const char *src, int packed,
+		size_t *align)
+{
+	struct lttng_dynamic_len_stack *stack =
+		this_cpu_ptr(&lttng_dynamic_len_stack);
+	size_t len = 0, largest_align = 1;
+	unsigned int i;
+
+	for (i = 0; i < desc->nr_fields; i++) {
+		const struct lttng_event_field *field = &desc->fields[i];
+		const struct lttng_type *type = &field->type;
+		const char *field_src = src + offsets[i];
+		const struct lttng_integer_type *elem;
+		size_t field_align = 1;
+
+		if (field->nowrite)
+			continue;
+		switch (type->atype) {
+		case atype_integer:
+			field_align = lttng_table_integer_align(&type->u.basic.integer);
+			len += lib_ring_buffer_record_align(packed, len, field_align);
+			len += lttng_table_integer_size(&type->u.basic.integer);
+			break;
+		case atype_enum:
+			elem = &type->u.basic.enumeration.container_type;
+			field_align = lttng_table_integer_align(elem);
+			len += lib_ring_buffer_record_align(packed, len, field_align);
+			len += lttng_table_integer_size(elem);
+			break;
+		case atype_array:
+			elem = &type->u.array.elem_type.u.basic.integer;
+			field_align = lttng_table_integer_align(elem);
+			len += lib_ring_buffer_record_align(packed, len, field_align);
+			len += lttng_table_integer_size(elem) * type->u.array.length;
+			break;
+		case atype_array_bitfield:
+			/* Length in bits. */
+			field_align = type->u.array.elem_alignment;
+			len += lib_ring_buffer_record_align(packed, len, field_align);
+			len += type->u.array.length / CHAR_BIT;
+			break;
+		case atype_sequence:
+		case atype_sequence_bitfield:
+		{
+			const struct lttng_event_table_seq *seq =
+				(const struct lttng_event_table_seq *) field_src;
+			const struct lttng_integer_type *length_type =
+				&type->u.sequence.length_type.u.basic.integer;
+
+			field_align = lttng_table_integer_align(length_type);
+			len += lib_ring_buffer_record_align(packed, len, field_align);
+			len += lttng_table_integer_size(length_type);
+			if (type->atype == atype_sequence) {
+				elem = &type->u.sequence.elem_type.u.basic.integer;
+				largest_align = max_t(size_t, largest_align,
+						lttng_table_integer_align(elem));
+				len += lib_ring_buffer_record_align(packed, len,
+						lttng_table_integer_align(elem));
+				len += lttng_table_integer_size(elem) * seq->len;
+			} else {
+				/* Length in bytes. */
+				largest_align = max_t(size_t, largest_align,
+						type->u.sequence.elem_alignment);
+				len += lib_ring_buffer_record_align(packed, len,
+						type->u.sequence.elem_alignment);
+				len += seq->len;
+			}
+			break;
+		}
+		case atype_string:
+		{
+			const char *str = *(const char * const *) field_src;
+
+			if (unlikely(++stack->offset >= LTTNG_DYNAMIC_LEN_STACK_SIZE))
+				return -1;
+			barrier();	/* reserve before use. */
+			len += stack->stack[stack->offset - 1] =
+				strlen(str ? str : LTTNG_NULL_STRING) + 1;
+			break;
+		}
+		default:
+			WARN_ON_ONCE(1);
+			return -1;
+		}
+		largest_align = max_t(size_t, largest_align, field_align);
+	}
+	*align = largest_align;
+	return len;
+}
+
+static
+void lttng_table_write(struct lttng_channel *chan,
+		struct lib_ring_buffer_ctx *ctx,
+		const struct lttng_event_desc *desc,
+		const size_t *offsets, const char *src, size_t len_idx)
+{
+	struct lttng_dynamic_len_stack *stack =
+		this_cpu_ptr(&lttng_dynamic_len_stack);
+	unsigned int i;
+
+	for (i = 0; i < desc->nr_fields; i++) {
+		const struct lttng_event_field *field = &desc->fields[i];
+		const struct lttng_type *type = &field->type;
+		const char *field_src = src + offsets[i];
+		const struct lttng_integer_type *elem;
+
+		if (field->nowrite)
+			continue;
+		switch (type->atype) {
+		case atype_integer:
+			elem = &type->u.basic.integer;
+			lib_ring_buffer_align_ctx(ctx, lttng_table_integer_align(elem));
+			chan->ops->event_write(ctx, field_src,
+					lttng_table_integer_size(elem));
+			break;
+		case atype_enum:
+			elem = &type->u.basic.enumeration.container_type;
+			lib_ring_buffer_align_ctx(ctx, lttng_table_integer_align(elem));
+			chan->ops->event_write(ctx, field_src,
+					lttng_table_integer_size(elem));
+			break;
+		case atype_array:
+			elem = &type->u.array.elem_type.u.basic.integer;
+			lib_ring_buffer_align_ctx(ctx, lttng_table_integer_align(elem));
+			chan->ops->event_write(ctx, *(const void * const *) field_src,
+					lttng_table_integer_size(elem) * type->u.array.length);
+			break;
+		case atype_array_bitfield:
+			lib_ring_buffer_align_ctx(ctx, type->u.array.elem_alignment);
+			chan->ops->event_write(ctx, *(const void * const *) field_src,
+					type->u.array.length / CHAR_BIT);
+			break;
+		case atype_sequence:
+		{
+			const struct lttng_event_table_seq *seq =
+				(const struct lttng_event_table_seq *) field_src;
+
+			lttng_table_write_length(chan, ctx,
+				&type->u.sequence.length_type.u.basic.integer,
+				seq->len);
+			elem = &type->u.sequence.elem_type.u.basic.integer;
+			lib_ring_buffer_align_ctx(ctx, lttng_table_integer_align(elem));
+			chan->ops->event_write(ctx, seq->ptr,
+					lttng_table_integer_size(elem) * seq->len);
+			break;
+		}
+		case atype_sequence_bitfield:
+		{
+			const struct lttng_event_table_seq *seq =
+				(const struct lttng_event_table_seq *) field_src;
+
+			/* Length in bits. */
+			lttng_table_write_length(chan, ctx,
+				&type->u.sequence.length_type.u.basic.integer,
+				seq->len * CHAR_BIT);
+			lib_ring_buffer_align_ctx(ctx, type->u.sequence.elem_alignment);
+			chan->ops->event_write(ctx, seq->ptr, seq->len);
+			break;
+		}
+		case atype_string:
+		{
+			const char *str = *(const char * const *) field_src;
+
+			chan->ops->event_strcpy(ctx, str ? str : LTTNG_NULL_STRING,
+					stack->stack[len_idx++]);
+			break;
+		}
+		default:
+			WARN_ON_ONCE(1);
+			return;
+		}
+	}
+}
+
+/*
+ * Record the event of "probe_ctx" from the field sources in "src", at
+ * offsets[i] for field i of the event descriptor. Called from the probe
+ * after the filter, like the expanded code which it replaces.
+ */
+void lttng_event_table_serialize(struct lttng_probe_ctx *probe_ctx,
+		const size_t *offsets, const void *src)
+{
+	struct lttng_event *event = probe_ctx->event;
+	struct lttng_channel *chan = event->chan;
+	struct lttng_dynamic_len_stack *stack =
+		this_cpu_ptr(&lttng_dynamic_len_stack);
+	size_t orig_len_offset = stack->offset;
+	struct lib_ring_buffer_ctx ctx;
+	ssize_t event_len;
+	size_t event_align;
+
+	event_len = lttng_table_get_size(event->desc, offsets, src,
+			chan->packed, &event_align);
+	if (unlikely(event_len < 0)) {
+		lib_ring_buffer_lost_event_too_big(chan->chan);
+		goto end;
+	}
+	lib_ring_buffer_ctx_init(&ctx, chan->chan, probe_ctx, event_len,
+			event_align, -1);
+	if (chan->ops->event_reserve(&ctx, event->id) < 0)
+		goto end;
+	lttng_table_write(chan, &ctx, event->desc, offsets, src,
+			orig_len_offset);
+	chan->ops->event_commit(&ctx);
+end:
+	barrier();	/* use before un-reserve. */
+	stack->offset = orig_len_offset;
+}
+EXPORT_SYMBOL_GPL(lttng_event_table_serialize);
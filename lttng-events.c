@@ -28,12 +28,14 @@
 #include <linux/uaccess.h>
 #include <linux/vmalloc.h>
 #include <linux/uuid.h>
+#include <linux/workqueue.h>
 
 #include <wrapper/vmalloc.h>	/* for wrapper_vmalloc_sync_all() */
 #include <wrapper/random.h>
 #include <wrapper/tracepoint.h>
 #include <wrapper/list.h>
 #include <wrapper/types.h>
+#include <wrapper/poll.h>
 #include <lttng-kernel-version.h>
 #include <lttng-events.h>
 #include <lttng-tracer.h>
@@ -43,21 +45,51 @@
 #include <wrapper/ringbuffer/backend.h>
 #include <wrapper/ringbuffer/frontend.h>
 
-#define METADATA_CACHE_DEFAULT_SIZE 4096
-
 static LIST_HEAD(sessions);
+static LIST_HEAD(sessions_teardown);	/* Destroyed, awaiting teardown */
 static LIST_HEAD(lttng_transport_list);
+
+/*
+ * Metadata fields of tracepoint and system call events, shared by all
+ * sessions. The TSDL of an event payload only depends on its descriptor
+ * and on the channel layout, so it is generated once and copied into
+ * the metadata cache of each session recording the event. Protected by
+ * metadata_fragment_mutex, nested in the session locks.
+ */
+#define LTTNG_METADATA_FRAGMENT_HT_BITS		8
+#define LTTNG_METADATA_FRAGMENT_HT_SIZE		(1U << LTTNG_METADATA_FRAGMENT_HT_BITS)
+struct lttng_metadata_fragment {
+	struct hlist_node hlist;
+	const struct lttng_event_desc *desc;
+	int packed;			/* Channel layout */
+	int binary;			/* Metadata format */
+	struct lttng_metadata_buf buf;
+};
+static struct hlist_head metadata_fragment_ht[LTTNG_METADATA_FRAGMENT_HT_SIZE];
+static DEFINE_MUTEX(metadata_fragment_mutex);
 /*
- * Protect the sessions and metadata caches.
+ * Protect the session list, the transport list and the probe registry,
+ * along with the session state they are walked with: the event and
+ * enabler lists, and the session, channel and enabler enable states.
+ * Each session has its own lock, nested in sessions_mutex, protecting
+ * its state: operations on the state of a single session, which do not
+ * look up probes or register instrumentation, only take the session
+ * lock, so that those of distinct sessions do not serialize. The state
+ * walked with sessions_mutex alone is only changed with both held.
  */
 static DEFINE_MUTEX(sessions_mutex);
 static struct kmem_cache *event_cache;
 
 static void lttng_session_lazy_sync_enablers(struct lttng_session *session);
 static void lttng_session_sync_enablers(struct lttng_session *session);
+static void lttng_enabler_lazy_sync(struct lttng_enabler *enabler);
 static void lttng_enabler_destroy(struct lttng_enabler *enabler);
 
 static void _lttng_event_destroy(struct lttng_event *event);
+static void lttng_session_teardown_work(struct work_struct *work);
+static void lttng_session_metadata_irq_work(struct irq_work *entry);
+static void lttng_session_metadata_work(struct work_struct *work);
+static DECLARE_WORK(session_teardown_work, lttng_session_teardown_work);
 static void _lttng_channel_destroy(struct lttng_channel *chan);
 static int _lttng_event_unregister(struct lttng_event *event);
 static
@@ -65,13 +97,17 @@ int _lttng_event_metadata_statedump(struct lttng_session *session,
 				  struct lttng_channel *chan,
 				  struct lttng_event *event);
 static
+int _lttng_event_fields_shared_statedump(struct lttng_session *session,
+					 struct lttng_channel *chan,
+					 struct lttng_event *event);
+static
 int _lttng_session_metadata_statedump(struct lttng_session *session);
 static
 void _lttng_metadata_channel_hangup(struct lttng_metadata_stream *stream);
 static
 int _lttng_field_statedump(struct lttng_session *session,
 		const struct lttng_event_field *field,
-		size_t nesting);
+		size_t nesting, int packed);
 
 void synchronize_trace(void)
 {
@@ -87,16 +123,95 @@ void synchronize_trace(void)
 #endif /* (LINUX_VERSION_CODE >= KERNEL_VERSION(3,4,0)) */
 }
 
+static
+void lttng_event_update_armed(struct lttng_event *event)
+{
+	struct lttng_channel *chan = event->chan;
+	struct lttng_session *session = chan->session;
+	unsigned long armed = 0;
+
+	if (session->active && chan->enabled && event->enabled
+			&& !lttng_breaker_disarmed(event->breaker))
+		armed |= LTTNG_EVENT_ARMED;
+	if (session->pid_tracker)
+		armed |= LTTNG_EVENT_ARMED_PID_TRACKER;
+	if (session->id_tracker_mask)
+		armed |= LTTNG_EVENT_ARMED_ID_TRACKERS;
+	if (chan->trigger)
+		armed |= LTTNG_EVENT_ARMED_TRIGGER;
+	if (event->id >= chan->nr_hot_events)
+		armed |= LTTNG_EVENT_ARMED_COLD;
+	if (event->critical)
+		armed |= LTTNG_EVENT_ARMED_CRITICAL;
+	if (lttng_ratelimit_enabled(event->ratelimit))
+		armed |= LTTNG_EVENT_ARMED_RATELIMIT;
+	if (lttng_breaker_enabled(event->breaker))
+		armed |= LTTNG_EVENT_ARMED_BREAKER;
+	if (event->count_only && event->hit_count)
+		armed |= LTTNG_EVENT_ARMED_COUNT;
+	if (session->gates && event->gate.cond)
+		armed |= LTTNG_EVENT_ARMED_GATE;
+	if (session->gates && (event->gate.open | event->gate.close))
+		armed |= LTTNG_EVENT_ARMED_GATE_ACTION;
+	if (event->coalesce)
+		armed |= LTTNG_EVENT_ARMED_COALESCE;
+	if (session->lazy_metadata && !event->metadata_dumped)
+		armed |= LTTNG_EVENT_ARMED_LAZY_METADATA;
+	if (event->ctx_guard_payload)
+		armed |= LTTNG_EVENT_ARMED_CTX_GUARD;
+	if (session->pausable)
+		armed |= LTTNG_EVENT_ARMED_PAUSE;
+	WRITE_ONCE(event->armed, armed);
+}
+
+/*
+ * Must be called with the session lock held, after any change to the
+ * state summarized by lttng_event armed.
+ */
+void lttng_session_update_armed(struct lttng_session *session)
+{
+	struct lttng_event *event;
+
+	list_for_each_entry(event, &session->events, list)
+		lttng_event_update_armed(event);
+}
+EXPORT_SYMBOL_GPL(lttng_session_update_armed);
+
 void lttng_lock_sessions(void)
 {
 	mutex_lock(&sessions_mutex);
 }
 
+int lttng_trylock_sessions(void)
+{
+	return mutex_trylock(&sessions_mutex);
+}
+
 void lttng_unlock_sessions(void)
 {
 	mutex_unlock(&sessions_mutex);
 }
 
+void lttng_lock_session(struct lttng_session *session)
+{
+	mutex_lock(&session->lock);
+}
+EXPORT_SYMBOL_GPL(lttng_lock_session);
+
+void lttng_unlock_session(struct lttng_session *session)
+{
+	mutex_unlock(&session->lock);
+}
+EXPORT_SYMBOL_GPL(lttng_unlock_session);
+
+/*
+ * Called with sessions lock held.
+ */
+struct list_head *lttng_get_sessions_list_head(void)
+{
+	return &sessions;
+}
+
 /*
  * Called with sessions lock held.
  */
@@ -121,20 +236,23 @@ struct lttng_session *lttng_session_create(void)
 	session = lttng_kvzalloc(sizeof(struct lttng_session), GFP_KERNEL);
 	if (!session)
 		goto err;
+	mutex_init(&session->lock);
 	INIT_LIST_HEAD(&session->chan);
 	INIT_LIST_HEAD(&session->events);
 	uuid_le_gen(&session->uuid);
+	session->statedump_mask = LTTNG_KERNEL_STATEDUMP_DEFAULT;
+	init_irq_work(&session->metadata_irq_work,
+			lttng_session_metadata_irq_work);
+	INIT_WORK(&session->metadata_work, lttng_session_metadata_work);
+	lttng_session_breaker_init(session);
 
 	metadata_cache = kzalloc(sizeof(struct lttng_metadata_cache),
 			GFP_KERNEL);
 	if (!metadata_cache)
 		goto err_free_session;
-	metadata_cache->data = vzalloc(METADATA_CACHE_DEFAULT_SIZE);
-	if (!metadata_cache->data)
-		goto err_free_cache;
-	metadata_cache->cache_alloc = METADATA_CACHE_DEFAULT_SIZE;
 	kref_init(&metadata_cache->refcount);
 	mutex_init(&metadata_cache->lock);
+	init_waitqueue_head(&metadata_cache->map_wait);
 	session->metadata_cache = metadata_cache;
 	INIT_LIST_HEAD(&metadata_cache->metadata_stream);
 	memcpy(&metadata_cache->uuid, &session->uuid,
@@ -146,42 +264,42 @@ struct lttng_session *lttng_session_create(void)
 	mutex_unlock(&sessions_mutex);
 	return session;
 
-err_free_cache:
-	kfree(metadata_cache);
 err_free_session:
 	lttng_kvfree(session);
 err:
 	mutex_unlock(&sessions_mutex);
 	return NULL;
 }
+EXPORT_SYMBOL_GPL(lttng_session_create);
 
 void metadata_cache_destroy(struct kref *kref)
 {
 	struct lttng_metadata_cache *cache =
 		container_of(kref, struct lttng_metadata_cache, refcount);
-	vfree(cache->data);
+	unsigned int i;
+
+	for (i = 0; i < cache->nr_chunks; i++)
+		free_page((unsigned long) cache->chunks[i]);
+	kfree(cache->chunks);
 	kfree(cache);
 }
 
-void lttng_session_destroy(struct lttng_session *session)
+/*
+ * Free a session once no probe can use its events anymore.
+ * Called with sessions mutex held.
+ */
+static
+void _lttng_session_teardown(struct lttng_session *session)
 {
 	struct lttng_channel *chan, *tmpchan;
 	struct lttng_event *event, *tmpevent;
 	struct lttng_metadata_stream *metadata_stream;
 	struct lttng_enabler *enabler, *tmpenabler;
-	int ret;
+	int i;
 
-	mutex_lock(&sessions_mutex);
-	WRITE_ONCE(session->active, 0);
-	list_for_each_entry(chan, &session->chan, list) {
-		ret = lttng_syscalls_unregister(chan);
-		WARN_ON(ret);
-	}
-	list_for_each_entry(event, &session->events, list) {
-		ret = _lttng_event_unregister(event);
-		WARN_ON(ret);
-	}
-	synchronize_trace();	/* Wait for in-flight events to complete */
+	irq_work_sync(&session->metadata_irq_work);
+	cancel_work_sync(&session->metadata_work);
+	lttng_session_breaker_teardown(session);
 	list_for_each_entry_safe(enabler, tmpenabler,
 			&session->enablers_head, node)
 		lttng_enabler_destroy(enabler);
@@ -195,28 +313,247 @@ void lttng_session_destroy(struct lttng_session *session)
 		_lttng_metadata_channel_hangup(metadata_stream);
 	if (session->pid_tracker)
 		lttng_pid_tracker_destroy(session->pid_tracker);
+	for (i = 0; i < NR_LTTNG_TRACKER_TYPES; i++) {
+		if (session->id_trackers[i])
+			lttng_id_tracker_destroy(session->id_trackers[i]);
+	}
+	lttng_statedump_shadow_destroy(session);
+	lttng_session_gates_destroy(session);
 	kref_put(&session->metadata_cache->refcount, metadata_cache_destroy);
 	list_del(&session->list);
+}
+
+/*
+ * Tear down all the sessions destroyed since the last run, after a
+ * single grace period. The sessions mutex is held across the grace
+ * period, like for the other unregistrations, so that fan-out groups
+ * released meanwhile by other sessions are not freed early.
+ */
+static
+void lttng_session_teardown_work(struct work_struct *work)
+{
+	struct lttng_session *session, *tmpsession;
+	LIST_HEAD(teardown);
+
+	mutex_lock(&sessions_mutex);
+	list_splice_init(&sessions_teardown, &teardown);
+	if (list_empty(&teardown))
+		goto end;
+	synchronize_trace();	/* Wait for in-flight events to complete */
+#ifdef LTTNG_EVENT_FANOUT
+	lttng_event_fanout_free_released();
+#endif
+	list_for_each_entry_safe(session, tmpsession, &teardown, list) {
+		_lttng_session_teardown(session);
+		lttng_kvfree(session);
+	}
+end:
 	mutex_unlock(&sessions_mutex);
-	lttng_kvfree(session);
 }
 
-int lttng_session_statedump(struct lttng_session *session)
+/*
+ * Wait for the teardown of the sessions destroyed so far, and for the
+ * release of their probe module references.
+ */
+void lttng_session_teardown_wait(void)
+{
+	flush_work(&session_teardown_work);
+}
+EXPORT_SYMBOL_GPL(lttng_session_teardown_wait);
+
+/*
+ * Stop a session and unregister all its probes. The session is then
+ * freed asynchronously after a grace period, so releasing the session
+ * file does not wait for it, and sessions destroyed together share the
+ * same grace period.
+ */
+void lttng_session_destroy(struct lttng_session *session)
 {
+	struct lttng_channel *chan;
+	struct lttng_event *event;
 	int ret;
 
 	mutex_lock(&sessions_mutex);
-	ret = lttng_statedump_start(session);
+	lttng_lock_session(session);
+	WRITE_ONCE(session->active, 0);
+	lttng_session_update_armed(session);
+	list_for_each_entry(chan, &session->chan, list) {
+		ret = lttng_syscalls_unregister(chan);
+		WARN_ON(ret);
+	}
+	lttng_wrapper_tracepoint_batch_begin();
+	list_for_each_entry(event, &session->events, list) {
+		ret = _lttng_event_unregister(event);
+		WARN_ON(ret);
+	}
+	lttng_wrapper_tracepoint_batch_end();
+	list_move_tail(&session->list, &sessions_teardown);
+	lttng_unlock_session(session);
 	mutex_unlock(&sessions_mutex);
+	schedule_work(&session_teardown_work);
+}
+EXPORT_SYMBOL_GPL(lttng_session_destroy);
+
+int lttng_session_statedump(struct lttng_session *session)
+{
+	int ret;
+
+	lttng_lock_session(session);
+	ret = lttng_statedump_start(session);
+	lttng_unlock_session(session);
+	return ret;
+}
+
+/*
+ * In incremental mode, statedumps after the first one replay the file
+ * descriptors of processes which did not change since the previous
+ * statedump from a shadow kept by lttng-statedump, instead of walking
+ * their file descriptor table.
+ */
+int lttng_session_set_statedump_mode(struct lttng_session *session,
+		enum lttng_kernel_statedump_mode mode)
+{
+	int ret = 0;
+
+	lttng_lock_session(session);
+	switch (mode) {
+	case LTTNG_KERNEL_STATEDUMP_FULL:
+		session->statedump_incremental = 0;
+		lttng_statedump_shadow_destroy(session);
+		break;
+	case LTTNG_KERNEL_STATEDUMP_INCREMENTAL:
+		session->statedump_incremental = 1;
+		break;
+	default:
+		ret = -EINVAL;
+	}
+	lttng_unlock_session(session);
+	return ret;
+}
+
+/*
+ * Restrict the statedumps of the session to some categories, and
+ * optionally to the processes of its pid tracker.
+ */
+int lttng_session_set_statedump_mask(struct lttng_session *session,
+		uint32_t mask)
+{
+	if (mask & ~LTTNG_KERNEL_STATEDUMP_ALL)
+		return -EINVAL;
+	lttng_lock_session(session);
+	session->statedump_mask = mask;
+	lttng_unlock_session(session);
+	return 0;
+}
+
+/*
+ * The payload declarations of the events are emitted as TSDL text, or
+ * as the compact records described in lttng-metadata-binary.h. The
+ * format is chosen before the session is first enabled, and stays the
+ * same for the whole trace.
+ */
+int lttng_session_set_metadata_format(struct lttng_session *session,
+		enum lttng_kernel_metadata_format format)
+{
+	int ret = 0;
+
+	lttng_lock_session(session);
+	if (session->been_active) {
+		ret = -EBUSY;
+		goto end;
+	}
+	switch (format) {
+	case LTTNG_KERNEL_METADATA_FORMAT_TSDL:
+		session->metadata_binary = 0;
+		break;
+	case LTTNG_KERNEL_METADATA_FORMAT_BINARY:
+		session->metadata_binary = 1;
+		break;
+	default:
+		ret = -EINVAL;
+	}
+end:
+	lttng_unlock_session(session);
+	return ret;
+}
+
+/*
+ * In lazy metadata mode, the metadata of an event is emitted after its
+ * first record, from a work item, rather than when the session is
+ * started or the event created. Sub-buffers are not handed to readers
+ * while records wait for their metadata, so that the metadata stream
+ * describes the records read. The mode is chosen before the session is
+ * first enabled.
+ */
+int lttng_session_set_lazy_metadata(struct lttng_session *session,
+		int lazy)
+{
+	int ret = 0;
+
+	lttng_lock_session(session);
+	if (session->been_active) {
+		ret = -EBUSY;
+		goto end;
+	}
+	session->lazy_metadata = !!lazy;
+	lttng_session_update_armed(session);
+end:
+	lttng_unlock_session(session);
 	return ret;
 }
 
+/* Called from the probe, on the first record of the event. */
+void lttng_event_metadata_queue(struct lttng_event *event)
+{
+	struct lttng_session *session = event->chan->session;
+
+	atomic_inc(&session->metadata_pending);
+	set_bit(LTTNG_EVENT_METADATA_QUEUED, &event->metadata_lazy);
+	irq_work_queue(&session->metadata_irq_work);
+}
+EXPORT_SYMBOL_GPL(lttng_event_metadata_queue);
+
+static
+void lttng_session_metadata_irq_work(struct irq_work *entry)
+{
+	struct lttng_session *session =
+		container_of(entry, struct lttng_session, metadata_irq_work);
+
+	schedule_work(&session->metadata_work);
+}
+
+static
+void lttng_session_metadata_work(struct work_struct *work)
+{
+	struct lttng_session *session =
+		container_of(work, struct lttng_session, metadata_work);
+	struct lttng_event *event;
+	int ret;
+
+	lttng_lock_session(session);
+	list_for_each_entry(event, &session->events, list) {
+		if (!test_and_clear_bit(LTTNG_EVENT_METADATA_QUEUED,
+				&event->metadata_lazy))
+			continue;
+		/* Emitted when the session is next started if stopped. */
+		ret = _lttng_event_metadata_statedump(session, event->chan,
+				event);
+		WARN_ON_ONCE(ret);
+		/* Readers hold on the sub-buffers until the metadata lands. */
+		smp_mb__before_atomic();
+		atomic_dec(&session->metadata_pending);
+	}
+	lttng_session_update_armed(session);
+	lttng_unlock_session(session);
+}
+
 int lttng_session_enable(struct lttng_session *session)
 {
 	int ret = 0;
 	struct lttng_channel *chan;
 
 	mutex_lock(&sessions_mutex);
+	lttng_lock_session(session);
 	if (session->active) {
 		ret = -EBUSY;
 		goto end;
@@ -235,7 +572,16 @@ int lttng_session_enable(struct lttng_session *session)
 	list_for_each_entry(chan, &session->chan, list) {
 		if (chan->header_type)
 			continue;		/* don't change it if session stop/restart */
-		if (chan->free_event_id < 31)
+		if (chan->packed) {
+			chan->header_type = 3;	/* delta, byte aligned */
+			continue;
+		}
+		/*
+		 * With hot events, keep the compact header even when other
+		 * events need the extended one.
+		 */
+		if (chan->free_event_id < LTTNG_NR_HOT_EVENTS
+				|| chan->nr_hot_events)
 			chan->header_type = 1;	/* compact */
 		else
 			chan->header_type = 2;	/* large */
@@ -247,20 +593,28 @@ int lttng_session_enable(struct lttng_session *session)
 			lib_ring_buffer_clear_quiescent_channel(chan->chan);
 	}
 
+	lttng_session_gates_reset(session);
+
 	WRITE_ONCE(session->active, 1);
 	WRITE_ONCE(session->been_active, 1);
+	lttng_session_update_armed(session);
 	ret = _lttng_session_metadata_statedump(session);
 	if (ret) {
 		WRITE_ONCE(session->active, 0);
+		lttng_session_update_armed(session);
 		goto end;
 	}
 	ret = lttng_statedump_start(session);
-	if (ret)
+	if (ret) {
 		WRITE_ONCE(session->active, 0);
+		lttng_session_update_armed(session);
+	}
 end:
+	lttng_unlock_session(session);
 	mutex_unlock(&sessions_mutex);
 	return ret;
 }
+EXPORT_SYMBOL_GPL(lttng_session_enable);
 
 int lttng_session_disable(struct lttng_session *session)
 {
@@ -268,11 +622,24 @@ int lttng_session_disable(struct lttng_session *session)
 	struct lttng_channel *chan;
 
 	mutex_lock(&sessions_mutex);
+	lttng_lock_session(session);
 	if (!session->active) {
 		ret = -EBUSY;
 		goto end;
 	}
+	/*
+	 * Record the syscall summaries and the pending repeats of
+	 * coalesced records while the session is still active.
+	 */
+	list_for_each_entry(chan, &session->chan, list) {
+		if (chan->channel_type != METADATA_CHANNEL) {
+			lttng_syscall_summary_flush(chan);
+			lttng_channel_coalesce_flush(chan);
+		}
+	}
 	WRITE_ONCE(session->active, 0);
+	WRITE_ONCE(session->paused, 0);
+	lttng_session_update_armed(session);
 
 	/* Set transient enabler state to "disabled" */
 	session->tstate = 0;
@@ -283,10 +650,122 @@ int lttng_session_disable(struct lttng_session *session)
 		if (chan->channel_type != METADATA_CHANNEL)
 			lib_ring_buffer_set_quiescent_channel(chan->chan);
 	}
+	/* Move the packets flushed above to the pools. */
+	list_for_each_entry(chan, &session->chan, list)
+		lttng_channel_pool_flush(chan);
 end:
+	lttng_unlock_session(session);
 	mutex_unlock(&sessions_mutex);
 	return ret;
 }
+EXPORT_SYMBOL_GPL(lttng_session_disable);
+
+/*
+ * Drop the data recorded so far in the session streams, keeping their
+ * buffers. Tracing may be active. The metadata is kept.
+ */
+int lttng_session_clear(struct lttng_session *session)
+{
+	struct lttng_channel *chan;
+	int ret = 0, busy = 0;
+
+	lttng_lock_session(session);
+	list_for_each_entry(chan, &session->chan, list) {
+		/* Shared channels are cleared with their owner. */
+		if (chan->channel_type == METADATA_CHANNEL || chan->shared)
+			continue;
+		ret = lib_ring_buffer_clear_channel(chan->chan);
+		if (ret == -EBUSY) {
+			busy = 1;
+			ret = 0;
+		} else if (ret) {
+			goto end;
+		}
+	}
+	if (busy)
+		ret = -EBUSY;
+end:
+	lttng_unlock_session(session);
+	return ret;
+}
+
+static
+void lttng_channel_switch_remote(struct lttng_channel *chan)
+{
+	struct channel *rb_chan = chan->chan;
+	const struct lib_ring_buffer_config *config = &rb_chan->backend.config;
+	int cpu;
+
+	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU) {
+		get_online_cpus();
+		for_each_channel_cpu(cpu, rb_chan)
+			lib_ring_buffer_switch_remote(
+				channel_get_ring_buffer(config, rb_chan, cpu));
+		put_online_cpus();
+	} else {
+		lib_ring_buffer_switch_remote(
+			channel_get_ring_buffer(config, rb_chan, 0));
+	}
+}
+
+/*
+ * Pause the recording of an active session, without stopping it: the
+ * enablers are not synced, and neither the metadata nor the statedump
+ * are written on resume. The first pause arms the events of the session
+ * with the pause check, later pauses and resumes only flip the session
+ * gate. There is no grace period: records being written by the probes
+ * may land after the pause. With LTTNG_KERNEL_SESSION_PAUSE_FLUSH, the
+ * current packets of the streams are closed, so that the data recorded
+ * before the pause can be consumed.
+ */
+int lttng_session_pause(struct lttng_session *session, uint32_t flags)
+{
+	struct lttng_channel *chan;
+	int ret = 0;
+
+	if (flags & ~LTTNG_KERNEL_SESSION_PAUSE_FLUSH)
+		return -EINVAL;
+	lttng_lock_session(session);
+	if (!session->active) {
+		ret = -EBUSY;
+		goto end;
+	}
+	if (session->paused) {
+		ret = -EEXIST;
+		goto end;
+	}
+	if (!session->pausable) {
+		session->pausable = 1;
+		lttng_session_update_armed(session);
+	}
+	WRITE_ONCE(session->paused, 1);
+	if (!(flags & LTTNG_KERNEL_SESSION_PAUSE_FLUSH))
+		goto end;
+	list_for_each_entry(chan, &session->chan, list) {
+		/* Shared channels are flushed with their owner. */
+		if (chan->channel_type == METADATA_CHANNEL || chan->shared)
+			continue;
+		lttng_channel_switch_remote(chan);
+	}
+end:
+	lttng_unlock_session(session);
+	return ret;
+}
+
+int lttng_session_resume(struct lttng_session *session)
+{
+	int ret = 0;
+
+	lttng_lock_session(session);
+	if (!session->paused) {
+		ret = -EEXIST;
+		goto end;
+	}
+	WRITE_ONCE(session->paused, 0);
+end:
+	lttng_unlock_session(session);
+	return ret;
+}
 
 int lttng_session_metadata_regenerate(struct lttng_session *session)
 {
@@ -296,20 +775,21 @@ int lttng_session_metadata_regenerate(struct lttng_session *session)
 	struct lttng_metadata_cache *cache = session->metadata_cache;
 	struct lttng_metadata_stream *stream;
 
-	mutex_lock(&sessions_mutex);
+	lttng_lock_session(session);
 	if (!session->active) {
 		ret = -EBUSY;
 		goto end;
 	}
 
 	mutex_lock(&cache->lock);
-	memset(cache->data, 0, cache->cache_alloc);
+	/* Chunks are kept to be rewritten. */
 	cache->metadata_written = 0;
 	cache->version++;
 	list_for_each_entry(stream, &session->metadata_cache->metadata_stream, list) {
 		stream->metadata_out = 0;
 		stream->metadata_in = 0;
 	}
+	wake_up_interruptible(&cache->map_wait);
 	mutex_unlock(&cache->lock);
 
 	session->metadata_dumped = 0;
@@ -324,7 +804,7 @@ int lttng_session_metadata_regenerate(struct lttng_session *session)
 	ret = _lttng_session_metadata_statedump(session);
 
 end:
-	mutex_unlock(&sessions_mutex);
+	lttng_unlock_session(session);
 	return ret;
 }
 
@@ -333,6 +813,7 @@ int lttng_channel_enable(struct lttng_channel *channel)
 	int ret = 0;
 
 	mutex_lock(&sessions_mutex);
+	lttng_lock_session(channel->session);
 	if (channel->channel_type == METADATA_CHANNEL) {
 		ret = -EPERM;
 		goto end;
@@ -343,10 +824,12 @@ int lttng_channel_enable(struct lttng_channel *channel)
 	}
 	/* Set transient enabler state to "enabled" */
 	channel->tstate = 1;
-	lttng_session_sync_enablers(channel->session);
+	lttng_session_lazy_sync_enablers(channel->session);
 	/* Set atomically the state to "enabled" */
 	WRITE_ONCE(channel->enabled, 1);
+	lttng_session_update_armed(channel->session);
 end:
+	lttng_unlock_session(channel->session);
 	mutex_unlock(&sessions_mutex);
 	return ret;
 }
@@ -356,6 +839,7 @@ int lttng_channel_disable(struct lttng_channel *channel)
 	int ret = 0;
 
 	mutex_lock(&sessions_mutex);
+	lttng_lock_session(channel->session);
 	if (channel->channel_type == METADATA_CHANNEL) {
 		ret = -EPERM;
 		goto end;
@@ -366,25 +850,314 @@ int lttng_channel_disable(struct lttng_channel *channel)
 	}
 	/* Set atomically the state to "disabled" */
 	WRITE_ONCE(channel->enabled, 0);
+	lttng_session_update_armed(channel->session);
 	/* Set transient enabler state to "enabled" */
 	channel->tstate = 0;
-	lttng_session_sync_enablers(channel->session);
+	lttng_session_lazy_sync_enablers(channel->session);
 end:
+	lttng_unlock_session(channel->session);
 	mutex_unlock(&sessions_mutex);
 	return ret;
 }
 
-int lttng_event_enable(struct lttng_event *event)
+/*
+ * Record one event out of "period" on each cpu. The sampling period
+ * can be changed while tracing; it is exported in the packet context
+ * along with the number of events sampled out.
+ */
+int lttng_channel_set_sampling(struct lttng_channel *channel,
+		uint32_t period)
+{
+	if (channel->channel_type == METADATA_CHANNEL)
+		return -EPERM;
+	if (!period)
+		return -EINVAL;
+	WRITE_ONCE(channel->sampling_period, period);
+	return 0;
+}
+
+/*
+ * Designate an event as hot: the event created with this name gets
+ * the next reserved ID, which fits in the compact event header. Other
+ * events get IDs above the reserved ones. This must be done before any
+ * event is created in the channel, since IDs are fixed in the metadata.
+ */
+int lttng_channel_add_hot_event(struct lttng_channel *channel,
+		const char *name)
 {
+	unsigned int i;
 	int ret = 0;
 
-	mutex_lock(&sessions_mutex);
-	if (event->chan->channel_type == METADATA_CHANNEL) {
-		ret = -EPERM;
-		goto end;
-	}
-	if (event->enabled) {
-		ret = -EEXIST;
+	if (channel->channel_type == METADATA_CHANNEL || channel->shared)
+		return -EPERM;
+	if (!*name)
+		return -EINVAL;
+	lttng_lock_session(channel->session);
+	if (channel->session->been_active
+			|| channel->free_event_id != channel->nr_hot_events) {
+		ret = -EBUSY;
+		goto end;
+	}
+	for (i = 0; i < channel->nr_hot_events; i++) {
+		if (!strncmp(channel->hot_events[i], name,
+				LTTNG_KERNEL_SYM_NAME_LEN - 1)) {
+			ret = -EEXIST;
+			goto end;
+		}
+	}
+	if (channel->nr_hot_events == LTTNG_NR_HOT_EVENTS) {
+		ret = -ENOSPC;
+		goto end;
+	}
+	if (!channel->hot_events) {
+		channel->hot_events = kcalloc(LTTNG_NR_HOT_EVENTS,
+				sizeof(*channel->hot_events), GFP_KERNEL);
+		if (!channel->hot_events) {
+			ret = -ENOMEM;
+			goto end;
+		}
+	}
+	strncpy(channel->hot_events[channel->nr_hot_events], name,
+		LTTNG_KERNEL_SYM_NAME_LEN - 1);
+	channel->nr_hot_events++;
+	channel->free_event_id++;	/* Reserved for this event. */
+end:
+	lttng_unlock_session(channel->session);
+	return ret;
+}
+
+/*
+ * Switch the current packet of all the channel streams. seq_num has
+ * nr_cpu_ids entries. Serialized with resize, which replaces the buffers.
+ */
+int lttng_channel_flush(struct lttng_channel *channel, int empty,
+		uint64_t *seq_num)
+{
+	int ret;
+
+	if (channel->channel_type == METADATA_CHANNEL)
+		return -EPERM;
+	if (!channel->ops->channel_flush)
+		return -ENOSYS;
+	lttng_lock_session(channel->session);
+	ret = channel->ops->channel_flush(channel->chan, empty, seq_num);
+	lttng_unlock_session(channel->session);
+	return ret;
+}
+
+/*
+ * Select the event header layout instead of deriving it from the number
+ * of events at session start.
+ */
+int lttng_channel_set_header_type(struct lttng_channel *channel,
+		uint32_t type)
+{
+	int ret = 0;
+
+	if (channel->channel_type == METADATA_CHANNEL || channel->shared)
+		return -EPERM;
+	switch (type) {
+	case LTTNG_KERNEL_EVENT_HEADER_AUTO:
+	case LTTNG_KERNEL_EVENT_HEADER_DELTA:
+		break;
+	case LTTNG_KERNEL_EVENT_HEADER_COMPACT:
+	case LTTNG_KERNEL_EVENT_HEADER_LARGE:
+		/* Their fields are aligned, which packed records are not. */
+		if (channel->packed)
+			return -EINVAL;
+		break;
+	default:
+		return -EINVAL;
+	}
+	lttng_lock_session(channel->session);
+	if (channel->session->been_active) {
+		ret = -EBUSY;
+		goto end;
+	}
+	channel->header_type = type;
+end:
+	lttng_unlock_session(channel->session);
+	return ret;
+}
+
+/*
+ * Change the sub-buffer geometry of a channel of a stopped session. The
+ * ring buffer checks that its streams have been consumed and closed.
+ * Compressed channels keep their geometry: the compression buffers are
+ * sized for the sub-buffers they were set up with.
+ */
+int lttng_channel_resize(struct lttng_channel *channel,
+		uint64_t subbuf_size, uint64_t num_subbuf)
+{
+	int ret;
+
+	if (channel->channel_type == METADATA_CHANNEL || channel->shared)
+		return -EPERM;
+	if (!channel->ops->channel_resize)
+		return -ENOSYS;
+	if ((size_t) subbuf_size != subbuf_size
+			|| (size_t) num_subbuf != num_subbuf)
+		return -EINVAL;
+	lttng_lock_session(channel->session);
+	if (channel->session->active || channel->compress) {
+		ret = -EBUSY;
+		goto end;
+	}
+	/* Wait for events recorded before the session was stopped. */
+	synchronize_trace();
+	ret = channel->ops->channel_resize(channel->chan, subbuf_size,
+			num_subbuf);
+end:
+	lttng_unlock_session(channel->session);
+	return ret;
+}
+
+/*
+ * Discard mode: keep the last "reserve_pct" percent of the last free
+ * sub-buffer of each stream to the events flagged critical, dropping
+ * the other events first when the consumer lags behind.
+ */
+int lttng_channel_set_critical_reserve(struct lttng_channel *channel,
+		uint32_t reserve_pct)
+{
+	int ret;
+
+	if (channel->channel_type == METADATA_CHANNEL || channel->shared)
+		return -EPERM;
+	if (!channel->ops->channel_set_critical_reserve)
+		return -ENOSYS;
+	lttng_lock_session(channel->session);
+	ret = channel->ops->channel_set_critical_reserve(channel->chan,
+			reserve_pct);
+	lttng_unlock_session(channel->session);
+	return ret;
+}
+
+/*
+ * Discard mode: events recorded in task context, such as system calls,
+ * wait up to "timeout_us" for the consumer when their stream is full,
+ * rather than being discarded. Events recorded in interrupt context are
+ * still discarded.
+ */
+int lttng_channel_set_blocking_timeout(struct lttng_channel *channel,
+		uint32_t timeout_us)
+{
+	int ret;
+
+	if (channel->channel_type == METADATA_CHANNEL || channel->shared)
+		return -EPERM;
+	if (!channel->ops->channel_set_blocking_timeout)
+		return -ENOSYS;
+	lttng_lock_session(channel->session);
+	ret = channel->ops->channel_set_blocking_timeout(channel->chan,
+			timeout_us);
+	lttng_unlock_session(channel->session);
+	return ret;
+}
+
+/*
+ * Select how the consumer of a channel of a stopped session orders its
+ * reads with the commits of the writers: by sending an IPI to the cpus
+ * of the streams it snapshots, or by having the writers issue a write
+ * barrier on each commit, so that frequent readers do not interrupt the
+ * traced cpus.
+ */
+int lttng_channel_set_reader_barrier(struct lttng_channel *channel,
+		enum lttng_kernel_reader_barrier barrier)
+{
+	int ret;
+
+	if (channel->channel_type == METADATA_CHANNEL || channel->shared)
+		return -EPERM;
+	if (!channel->ops->channel_set_writer_barrier)
+		return -ENOSYS;
+	switch (barrier) {
+	case LTTNG_KERNEL_READER_BARRIER_IPI:
+	case LTTNG_KERNEL_READER_BARRIER_WRITER:
+		break;
+	default:
+		return -EINVAL;
+	}
+	lttng_lock_session(channel->session);
+	if (channel->session->active) {
+		ret = -EBUSY;
+		goto end;
+	}
+	/* Wait for events recorded before the session was stopped. */
+	synchronize_trace();
+	ret = channel->ops->channel_set_writer_barrier(channel->chan,
+			barrier == LTTNG_KERNEL_READER_BARRIER_WRITER);
+end:
+	lttng_unlock_session(channel->session);
+	return ret;
+}
+
+/*
+ * Live mode: have the switch timer flush a stream only when it holds
+ * events older than "latency_us", rather than every switch timer
+ * interval. Idle streams still get an empty packet every switch timer
+ * interval.
+ */
+int lttng_channel_set_live_latency(struct lttng_channel *channel,
+		uint32_t latency_us)
+{
+	int ret;
+
+	if (channel->channel_type == METADATA_CHANNEL || channel->shared)
+		return -EPERM;
+	if (!channel->ops->channel_set_live_latency)
+		return -ENOSYS;
+	lttng_lock_session(channel->session);
+	ret = channel->ops->channel_set_live_latency(channel->chan,
+			latency_us);
+	lttng_unlock_session(channel->session);
+	return ret;
+}
+
+/*
+ * Limit the bytes recorded by each user-space string and sequence field,
+ * "max_len" 0 meaning unlimited. Longer fields are truncated, which the
+ * user_truncated context records. Takes effect on the next events.
+ */
+int lttng_channel_set_user_capture(struct lttng_channel *channel,
+		uint32_t max_len)
+{
+	if (channel->channel_type == METADATA_CHANNEL)
+		return -EPERM;
+	WRITE_ONCE(channel->user_capture_max, max_len);
+	return 0;
+}
+
+/*
+ * Reserved ID of a hot event, or the next free ID. The events of shared
+ * channels take the next free ID of the channel owning the buffers.
+ */
+static
+uint32_t lttng_channel_event_id(struct lttng_channel *chan, const char *name)
+{
+	unsigned int i;
+
+	if (chan->shared)
+		return chan->shared->free_event_id++;
+	for (i = 0; i < chan->nr_hot_events; i++) {
+		if (!strncmp(chan->hot_events[i], name,
+				LTTNG_KERNEL_SYM_NAME_LEN - 1))
+			return i;
+	}
+	return chan->free_event_id++;
+}
+
+int lttng_event_enable(struct lttng_event *event)
+{
+	int ret = 0;
+
+	lttng_lock_session(event->chan->session);
+	if (event->chan->channel_type == METADATA_CHANNEL) {
+		ret = -EPERM;
+		goto end;
+	}
+	if (event->enabled) {
+		ret = -EEXIST;
 		goto end;
 	}
 	switch (event->instrumentation) {
@@ -394,6 +1167,10 @@ int lttng_event_enable(struct lttng_event *event)
 		break;
 	case LTTNG_KERNEL_KPROBE:
 	case LTTNG_KERNEL_FUNCTION:
+	case LTTNG_KERNEL_FENTRY:
+	case LTTNG_KERNEL_FGRAPH:
+	case LTTNG_KERNEL_SAMPLER:
+	case LTTNG_KERNEL_HWTRACE_SYNC:
 	case LTTNG_KERNEL_UPROBE:
 	case LTTNG_KERNEL_NOOP:
 		WRITE_ONCE(event->enabled, 1);
@@ -405,8 +1182,10 @@ int lttng_event_enable(struct lttng_event *event)
 		WARN_ON_ONCE(1);
 		ret = -EINVAL;
 	}
+	if (!ret)
+		lttng_session_update_armed(event->chan->session);
 end:
-	mutex_unlock(&sessions_mutex);
+	lttng_unlock_session(event->chan->session);
 	return ret;
 }
 
@@ -414,7 +1193,7 @@ int lttng_event_disable(struct lttng_event *event)
 {
 	int ret = 0;
 
-	mutex_lock(&sessions_mutex);
+	lttng_lock_session(event->chan->session);
 	if (event->chan->channel_type == METADATA_CHANNEL) {
 		ret = -EPERM;
 		goto end;
@@ -430,6 +1209,10 @@ int lttng_event_disable(struct lttng_event *event)
 		break;
 	case LTTNG_KERNEL_KPROBE:
 	case LTTNG_KERNEL_FUNCTION:
+	case LTTNG_KERNEL_FENTRY:
+	case LTTNG_KERNEL_FGRAPH:
+	case LTTNG_KERNEL_SAMPLER:
+	case LTTNG_KERNEL_HWTRACE_SYNC:
 	case LTTNG_KERNEL_UPROBE:
 	case LTTNG_KERNEL_NOOP:
 		WRITE_ONCE(event->enabled, 0);
@@ -441,11 +1224,202 @@ int lttng_event_disable(struct lttng_event *event)
 		WARN_ON_ONCE(1);
 		ret = -EINVAL;
 	}
+	if (!ret)
+		lttng_session_update_armed(event->chan->session);
 end:
-	mutex_unlock(&sessions_mutex);
+	lttng_unlock_session(event->chan->session);
+	return ret;
+}
+
+/*
+ * Critical events may use the critical reserve of their channel. The
+ * events of enablers are flagged through their enablers instead.
+ */
+int lttng_event_set_critical(struct lttng_event *event, int critical)
+{
+	int ret = 0;
+
+	lttng_lock_session(event->chan->session);
+	if (event->chan->channel_type == METADATA_CHANNEL) {
+		ret = -EPERM;
+		goto end;
+	}
+	switch (event->instrumentation) {
+	case LTTNG_KERNEL_TRACEPOINT:
+	case LTTNG_KERNEL_SYSCALL:
+		ret = -EINVAL;
+		goto end;
+	default:
+		break;
+	}
+	event->critical = !!critical;
+	lttng_session_update_armed(event->chan->session);
+end:
+	lttng_unlock_session(event->chan->session);
+	return ret;
+}
+
+/*
+ * Rate limit an event per value of a context. The events of enablers are
+ * rate limited through their enablers instead.
+ */
+int lttng_event_set_ratelimit(struct lttng_event *event,
+		const struct lttng_kernel_event_ratelimit *param)
+{
+	int ret;
+
+	lttng_lock_session(event->chan->session);
+	if (event->chan->channel_type == METADATA_CHANNEL) {
+		ret = -EPERM;
+		goto end;
+	}
+	switch (event->instrumentation) {
+	case LTTNG_KERNEL_TRACEPOINT:
+	case LTTNG_KERNEL_SYSCALL:
+		ret = -EINVAL;
+		goto end;
+	default:
+		break;
+	}
+	ret = lttng_ratelimit_set(&event->ratelimit, param);
+	if (!ret)
+		lttng_session_update_armed(event->chan->session);
+end:
+	lttng_unlock_session(event->chan->session);
 	return ret;
 }
 
+int lttng_event_set_breaker(struct lttng_event *event,
+		const struct lttng_kernel_event_breaker *param)
+{
+	int ret;
+
+	lttng_lock_session(event->chan->session);
+	if (event->chan->channel_type == METADATA_CHANNEL) {
+		ret = -EPERM;
+		goto end;
+	}
+	switch (event->instrumentation) {
+	case LTTNG_KERNEL_TRACEPOINT:
+	case LTTNG_KERNEL_SYSCALL:
+		ret = -EINVAL;
+		goto end;
+	default:
+		break;
+	}
+	ret = lttng_breaker_set(&event->breaker, param, true);
+	if (!ret)
+		lttng_session_update_armed(event->chan->session);
+end:
+	lttng_unlock_session(event->chan->session);
+	return ret;
+}
+
+/*
+ * The hit counters are allocated when an event first enters count-only
+ * mode, and kept until its destruction, so that the probes may update
+ * them without synchronizing with the mode changes.
+ */
+static
+int lttng_event_alloc_hit_count(struct lttng_event *event)
+{
+	if (event->hit_count)
+		return 0;
+	event->hit_count = alloc_percpu(u64);
+	if (!event->hit_count)
+		return -ENOMEM;
+	/* Ensure the memory we just allocated don't trigger page faults */
+	wrapper_vmalloc_sync_all();
+	return 0;
+}
+
+/*
+ * Events in count-only mode count their hits accepted by the trackers
+ * and filters instead of recording them. The events of enablers are
+ * set through their enablers instead.
+ */
+int lttng_event_set_count_only(struct lttng_event *event, int count_only)
+{
+	int ret = 0;
+
+	lttng_lock_session(event->chan->session);
+	if (event->chan->channel_type == METADATA_CHANNEL) {
+		ret = -EPERM;
+		goto end;
+	}
+	switch (event->instrumentation) {
+	case LTTNG_KERNEL_TRACEPOINT:
+	case LTTNG_KERNEL_SYSCALL:
+		ret = -EINVAL;
+		goto end;
+	default:
+		break;
+	}
+	if (count_only) {
+		ret = lttng_event_alloc_hit_count(event);
+		if (ret)
+			goto end;
+	}
+	event->count_only = !!count_only;
+	lttng_session_update_armed(event->chan->session);
+end:
+	lttng_unlock_session(event->chan->session);
+	return ret;
+}
+
+/*
+ * Events in coalesce mode keep a single record of a run of identical
+ * records on a cpu buffer, followed by an lttng_coalesce_repeats
+ * record with the number of repeats discarded. The events of enablers
+ * are set through their enablers instead.
+ */
+int lttng_event_set_coalesce(struct lttng_event *event, int coalesce)
+{
+	int ret = 0;
+
+	lttng_lock_session(event->chan->session);
+	if (event->chan->channel_type == METADATA_CHANNEL) {
+		ret = -EPERM;
+		goto end;
+	}
+	switch (event->instrumentation) {
+	case LTTNG_KERNEL_TRACEPOINT:
+	case LTTNG_KERNEL_SYSCALL:
+		ret = -EINVAL;
+		goto end;
+	default:
+		break;
+	}
+	event->coalesce = !!coalesce;
+	lttng_session_update_armed(event->chan->session);
+end:
+	lttng_unlock_session(event->chan->session);
+	return ret;
+}
+
+static
+u64 lttng_event_sum_hit_count(struct lttng_event *event)
+{
+	u64 sum = 0;
+	int cpu;
+
+	if (!event->hit_count)
+		return 0;
+	for_each_possible_cpu(cpu)
+		sum += *per_cpu_ptr(event->hit_count, cpu);
+	return sum;
+}
+
+int lttng_event_hit_count(struct lttng_event *event,
+		struct lttng_kernel_event_hit_count *hit_count)
+{
+	memset(hit_count, 0, sizeof(*hit_count));
+	lttng_lock_session(event->chan->session);
+	hit_count->count = lttng_event_sum_hit_count(event);
+	lttng_unlock_session(event->chan->session);
+	return 0;
+}
+
 static struct lttng_transport *lttng_transport_find(const char *name)
 {
 	struct lttng_transport *transport;
@@ -457,18 +1431,73 @@ static struct lttng_transport *lttng_transport_find(const char *name)
 	return NULL;
 }
 
+/*
+ * Have the per-cpu buffers of a channel only stage its packets, copied
+ * as they complete into pool buffers shared by the cpus of each memory
+ * node, with "num_subbuf" sub-buffers each, from which the consumer
+ * reads them. Must be set before the session is started and before the
+ * streams of the channel are opened.
+ */
+int lttng_channel_set_pool(struct lttng_channel *channel,
+		uint64_t num_subbuf)
+{
+	const struct lib_ring_buffer_config *config;
+	struct lttng_transport *transport;
+	int ret;
+
+	if (channel->channel_type == METADATA_CHANNEL || channel->shared)
+		return -EPERM;
+	if (!num_subbuf || num_subbuf > UINT_MAX)
+		return -EINVAL;
+	config = &channel->chan->backend.config;
+	mutex_lock(&sessions_mutex);
+	lttng_lock_session(channel->session);
+	if (channel->session->been_active) {
+		ret = -EBUSY;
+		goto end;
+	}
+	if (channel->pool) {
+		ret = -EEXIST;
+		goto end;
+	}
+	transport = lttng_transport_find(config->output == RING_BUFFER_MMAP ?
+			"relay-pool-mmap" : "relay-pool");
+	if (!transport) {
+		printk(KERN_WARNING "LTTng pool transport not found\n");
+		ret = -ENOENT;
+		goto end;
+	}
+	if (!try_module_get(transport->owner)) {
+		ret = -ENOENT;
+		goto end;
+	}
+	ret = lttng_channel_pool_create(channel, transport, num_subbuf);
+	if (ret)
+		module_put(transport->owner);
+end:
+	lttng_unlock_session(channel->session);
+	mutex_unlock(&sessions_mutex);
+	return ret;
+}
+
 struct lttng_channel *lttng_channel_create(struct lttng_session *session,
 				       const char *transport_name,
 				       void *buf_addr,
 				       size_t subbuf_size, size_t num_subbuf,
 				       unsigned int switch_timer_interval,
 				       unsigned int read_timer_interval,
+				       unsigned int read_timer_max_interval,
+				       enum lttng_kernel_numa_policy numa_policy,
+				       int numa_node,
+				       uint32_t flags,
+				       const struct cpumask *cpu_mask,
 				       enum channel_type channel_type)
 {
 	struct lttng_channel *chan;
 	struct lttng_transport *transport = NULL;
 
 	mutex_lock(&sessions_mutex);
+	lttng_lock_session(session);
 	if (session->been_active && channel_type != METADATA_CHANNEL)
 		goto active;	/* Refuse to add channel to active session */
 	transport = lttng_transport_find(transport_name);
@@ -484,9 +1513,20 @@ struct lttng_channel *lttng_channel_create(struct lttng_session *session,
 	chan = kzalloc(sizeof(struct lttng_channel), GFP_KERNEL);
 	if (!chan)
 		goto nomem;
+	chan->sampling = alloc_percpu(struct lttng_channel_sampling);
+	if (!chan->sampling)
+		goto sampling_error;
+	chan->lost = alloc_percpu(struct lttng_channel_lost);
+	if (!chan->lost)
+		goto lost_error;
+	chan->coalesce = alloc_percpu(struct lttng_channel_coalesce);
+	if (!chan->coalesce)
+		goto coalesce_error;
 	chan->session = session;
 	chan->id = session->free_chan_id++;
 	chan->ops = &transport->ops;
+	chan->packed = !!(flags & LTTNG_KERNEL_CHANNEL_FLAG_PACKED);
+	chan->coarse_clock = !!(flags & LTTNG_KERNEL_CHANNEL_FLAG_COARSE_CLOCK);
 	/*
 	 * Note: the channel creation op already writes into the packet
 	 * headers. Therefore the "chan" information used as input
@@ -494,7 +1534,9 @@ struct lttng_channel *lttng_channel_create(struct lttng_session *session,
 	 */
 	chan->chan = transport->ops.channel_create(transport_name,
 			chan, buf_addr, subbuf_size, num_subbuf,
-			switch_timer_interval, read_timer_interval);
+			switch_timer_interval, read_timer_interval,
+			read_timer_max_interval,
+			numa_policy, numa_node, flags, cpu_mask);
 	if (!chan->chan)
 		goto create_error;
 	chan->tstate = 1;
@@ -502,19 +1544,74 @@ struct lttng_channel *lttng_channel_create(struct lttng_session *session,
 	chan->transport = transport;
 	chan->channel_type = channel_type;
 	list_add(&chan->list, &session->chan);
+	lttng_unlock_session(session);
 	mutex_unlock(&sessions_mutex);
 	return chan;
 
 create_error:
+	free_percpu(chan->coalesce);
+coalesce_error:
+	free_percpu(chan->lost);
+lost_error:
+	free_percpu(chan->sampling);
+sampling_error:
 	kfree(chan);
 nomem:
 	if (transport)
 		module_put(transport->owner);
 notransport:
 active:
+	lttng_unlock_session(session);
 	mutex_unlock(&sessions_mutex);
 	return NULL;
 }
+EXPORT_SYMBOL_GPL(lttng_channel_create);
+
+/*
+ * Create a channel recording into the per-cpu buffers of another
+ * channel of the session, rather than into buffers of its own, so that
+ * low-rate channels do not each take a set of mostly empty buffers.
+ * The shared channel has its own events, enablers and enable state. Its
+ * events get IDs from the owning channel and are declared in the
+ * metadata as events of its stream, their records being told apart by
+ * event ID. The buffer settings and contexts are those of the owning
+ * channel, and the shared channel has no streams of its own.
+ */
+struct lttng_channel *lttng_channel_create_shared(struct lttng_channel *owner)
+{
+	struct lttng_session *session = owner->session;
+	struct lttng_channel *chan = NULL;
+
+	mutex_lock(&sessions_mutex);
+	lttng_lock_session(session);
+	if (session->been_active)
+		goto end;	/* Refuse to add channel to active session */
+	if (owner->channel_type != PER_CPU_CHANNEL || owner->shared)
+		goto end;
+	if (!try_module_get(owner->transport->owner))
+		goto end;
+	chan = kzalloc(sizeof(struct lttng_channel), GFP_KERNEL);
+	if (!chan) {
+		module_put(owner->transport->owner);
+		goto end;
+	}
+	chan->session = session;
+	chan->id = session->free_chan_id++;
+	chan->ops = owner->ops;
+	chan->chan = owner->chan;
+	chan->shared = owner;
+	chan->packed = owner->packed;
+	chan->coarse_clock = owner->coarse_clock;
+	chan->tstate = 1;
+	chan->enabled = 1;
+	chan->transport = owner->transport;
+	chan->channel_type = PER_CPU_CHANNEL;
+	list_add(&chan->list, &session->chan);
+end:
+	lttng_unlock_session(session);
+	mutex_unlock(&sessions_mutex);
+	return chan;
+}
 
 /*
  * Only used internally at session destruction for per-cpu channels, and
@@ -524,20 +1621,35 @@ active:
 static
 void _lttng_channel_destroy(struct lttng_channel *chan)
 {
-	chan->ops->channel_destroy(chan->chan);
+	/* The pool is the reader of the staging buffers. */
+	lttng_channel_pool_destroy(chan);
+	if (!chan->shared)
+		chan->ops->channel_destroy(chan->chan);
 	module_put(chan->transport->owner);
 	list_del(&chan->list);
+	lttng_channel_aggregation_destroy(chan);
+	lttng_channel_compression_destroy(chan);
+	lttng_channel_snapshot_area_destroy(chan);
+	lttng_syscalls_destroy(chan);
 	lttng_destroy_context(chan->ctx);
+	free_percpu(chan->coalesce);
+	free_percpu(chan->lost);
+	free_percpu(chan->sampling);
+	kfree(chan->hot_events);
 	kfree(chan);
 }
 
 void lttng_metadata_channel_destroy(struct lttng_channel *chan)
 {
+	struct lttng_session *session = chan->session;
+
 	BUG_ON(chan->channel_type != METADATA_CHANNEL);
 
-	/* Protect the metadata cache with the sessions_mutex. */
+	/* Protect the session channel list and the metadata cache. */
 	mutex_lock(&sessions_mutex);
+	lttng_lock_session(session);
 	_lttng_channel_destroy(chan);
+	lttng_unlock_session(session);
 	mutex_unlock(&sessions_mutex);
 }
 EXPORT_SYMBOL_GPL(lttng_metadata_channel_destroy);
@@ -546,12 +1658,12 @@ static
 void _lttng_metadata_channel_hangup(struct lttng_metadata_stream *stream)
 {
 	stream->finalized = 1;
-	wake_up_interruptible(&stream->read_wait);
+	lttng_wake_up_hangup(&stream->read_wait);
 }
 
 /*
  * Supports event creation while tracing session is active.
- * Needs to be called with sessions mutex held.
+ * Needs to be called with sessions mutex and session lock held.
  */
 struct lttng_event *_lttng_event_create(struct lttng_channel *chan,
 				struct lttng_kernel_event *event_param,
@@ -567,7 +1679,7 @@ struct lttng_event *_lttng_event_create(struct lttng_channel *chan,
 	uint32_t hash;
 	int ret;
 
-	if (chan->free_event_id == -1U) {
+	if (lttng_channel_owner(chan)->free_event_id == -1U) {
 		ret = -EMFILE;
 		goto full;
 	}
@@ -580,6 +1692,10 @@ struct lttng_event *_lttng_event_create(struct lttng_channel *chan,
 	case LTTNG_KERNEL_UPROBE:
 	case LTTNG_KERNEL_KRETPROBE:
 	case LTTNG_KERNEL_FUNCTION:
+	case LTTNG_KERNEL_FENTRY:
+	case LTTNG_KERNEL_FGRAPH:
+	case LTTNG_KERNEL_SAMPLER:
+	case LTTNG_KERNEL_HWTRACE_SYNC:
 	case LTTNG_KERNEL_NOOP:
 	case LTTNG_KERNEL_SYSCALL:
 		event_name = event_param->name;
@@ -609,10 +1725,11 @@ struct lttng_event *_lttng_event_create(struct lttng_channel *chan,
 	}
 	event->chan = chan;
 	event->filter = filter;
-	event->id = chan->free_event_id++;
+	event->id = lttng_channel_event_id(chan, event_name);
 	event->instrumentation = itype;
 	event->evtype = LTTNG_TYPE_EVENT;
 	INIT_LIST_HEAD(&event->bytecode_runtime_head);
+	INIT_LIST_HEAD(&event->ctx_guard_runtime_head);
 	INIT_LIST_HEAD(&event->enablers_ref_head);
 
 	switch (itype) {
@@ -644,6 +1761,7 @@ struct lttng_event *_lttng_event_create(struct lttng_channel *chan,
 				event_param->u.kprobe.symbol_name,
 				event_param->u.kprobe.offset,
 				event_param->u.kprobe.addr,
+				event_param->u.kprobe.fetch,
 				event);
 		if (ret) {
 			ret = -EINVAL;
@@ -671,7 +1789,7 @@ struct lttng_event *_lttng_event_create(struct lttng_channel *chan,
 		}
 		event_return->chan = chan;
 		event_return->filter = filter;
-		event_return->id = chan->free_event_id++;
+		event_return->id = lttng_channel_owner(chan)->free_event_id++;
 		event_return->enabled = 0;
 		event_return->registered = 1;
 		event_return->instrumentation = itype;
@@ -683,6 +1801,7 @@ struct lttng_event *_lttng_event_create(struct lttng_channel *chan,
 				event_param->u.kretprobe.symbol_name,
 				event_param->u.kretprobe.offset,
 				event_param->u.kretprobe.addr,
+				event_param->u.kretprobe.threshold,
 				event, event_return);
 		if (ret) {
 			kmem_cache_free(event_cache, event_return);
@@ -705,8 +1824,91 @@ struct lttng_event *_lttng_event_create(struct lttng_channel *chan,
 		}
 		list_add(&event_return->list, &chan->session->events);
 		break;
-	}
-	case LTTNG_KERNEL_FUNCTION:
+	}
+	case LTTNG_KERNEL_FUNCTION:
+		/*
+		 * Needs to be explicitly enabled after creation, since
+		 * we may want to apply filters.
+		 */
+		event->enabled = 0;
+		event->registered = 1;
+		/*
+		 * Populate lttng_event structure before event
+		 * registration.
+		 */
+		smp_wmb();
+		ret = lttng_ftrace_register(event_name,
+				event_param->u.ftrace.symbol_name,
+				event);
+		if (ret) {
+			goto register_error;
+		}
+		ret = try_module_get(event->desc->owner);
+		WARN_ON_ONCE(!ret);
+		break;
+	case LTTNG_KERNEL_FENTRY:
+		/*
+		 * Needs to be explicitly enabled after creation, since
+		 * we may want to apply filters.
+		 */
+		event->enabled = 0;
+		event->registered = 1;
+		/*
+		 * Populate lttng_event structure before event
+		 * registration.
+		 */
+		smp_wmb();
+		ret = lttng_fentry_register(event_name,
+				event_param->u.fentry.symbol_name,
+				event);
+		if (ret)
+			goto register_error;
+		ret = try_module_get(event->desc->owner);
+		WARN_ON_ONCE(!ret);
+		break;
+	case LTTNG_KERNEL_FGRAPH:
+		/*
+		 * Needs to be explicitly enabled after creation, since
+		 * we may want to apply filters.
+		 */
+		event->enabled = 0;
+		event->registered = 1;
+		/*
+		 * Populate lttng_event structure before event
+		 * registration.
+		 */
+		smp_wmb();
+		ret = lttng_fgraph_register(event_name,
+				event_param->u.fgraph.symbol_name,
+				event_param->u.fgraph.max_depth,
+				event_param->u.fgraph.min_duration,
+				event);
+		if (ret)
+			goto register_error;
+		ret = try_module_get(event->desc->owner);
+		WARN_ON_ONCE(!ret);
+		break;
+	case LTTNG_KERNEL_SAMPLER:
+		/*
+		 * Needs to be explicitly enabled after creation, since
+		 * we may want to apply filters.
+		 */
+		event->enabled = 0;
+		event->registered = 1;
+		/*
+		 * Populate lttng_event structure before event
+		 * registration.
+		 */
+		smp_wmb();
+		ret = lttng_sampler_register(event_name,
+				event_param->u.sampler.frequency,
+				event);
+		if (ret)
+			goto register_error;
+		ret = try_module_get(event->desc->owner);
+		WARN_ON_ONCE(!ret);
+		break;
+	case LTTNG_KERNEL_HWTRACE_SYNC:
 		/*
 		 * Needs to be explicitly enabled after creation, since
 		 * we may want to apply filters.
@@ -718,12 +1920,11 @@ struct lttng_event *_lttng_event_create(struct lttng_channel *chan,
 		 * registration.
 		 */
 		smp_wmb();
-		ret = lttng_ftrace_register(event_name,
-				event_param->u.ftrace.symbol_name,
+		ret = lttng_hwtrace_sync_register(event_name,
+				event_param->u.hwtrace_sync.frequency,
 				event);
-		if (ret) {
+		if (ret)
 			goto register_error;
-		}
 		ret = try_module_get(event->desc->owner);
 		WARN_ON_ONCE(!ret);
 		break;
@@ -757,6 +1958,8 @@ struct lttng_event *_lttng_event_create(struct lttng_channel *chan,
 
 		ret = lttng_uprobes_register(event_param->name,
 				event_param->u.uprobe.fd,
+				event_param->u.uprobe.sample_period,
+				event_param->u.uprobe.sample_interval,
 				event);
 		if (ret)
 			goto register_error;
@@ -775,6 +1978,8 @@ struct lttng_event *_lttng_event_create(struct lttng_channel *chan,
 	}
 	hlist_add_head(&event->hlist, head);
 	list_add(&event->list, &chan->session->events);
+	lttng_probe_profile_event_add(event);
+	lttng_event_update_armed(event);
 	return event;
 
 statedump_error:
@@ -797,8 +2002,10 @@ struct lttng_event *lttng_event_create(struct lttng_channel *chan,
 	struct lttng_event *event;
 
 	mutex_lock(&sessions_mutex);
+	lttng_lock_session(chan->session);
 	event = _lttng_event_create(chan, event_param, filter, event_desc,
 				itype);
+	lttng_unlock_session(chan->session);
 	mutex_unlock(&sessions_mutex);
 	return event;
 }
@@ -816,9 +2023,13 @@ void register_event(struct lttng_event *event)
 	desc = event->desc;
 	switch (event->instrumentation) {
 	case LTTNG_KERNEL_TRACEPOINT:
+#ifdef LTTNG_EVENT_FANOUT
+		ret = lttng_event_fanout_register(event);
+#else
 		ret = lttng_wrapper_tracepoint_probe_register(desc->kname,
 						  desc->probe_callback,
 						  event);
+#endif
 		break;
 	case LTTNG_KERNEL_SYSCALL:
 		ret = lttng_syscall_filter_enable(event->chan,
@@ -828,6 +2039,10 @@ void register_event(struct lttng_event *event)
 	case LTTNG_KERNEL_UPROBE:
 	case LTTNG_KERNEL_KRETPROBE:
 	case LTTNG_KERNEL_FUNCTION:
+	case LTTNG_KERNEL_FENTRY:
+	case LTTNG_KERNEL_FGRAPH:
+	case LTTNG_KERNEL_SAMPLER:
+	case LTTNG_KERNEL_HWTRACE_SYNC:
 	case LTTNG_KERNEL_NOOP:
 		ret = 0;
 		break;
@@ -852,9 +2067,13 @@ int _lttng_event_unregister(struct lttng_event *event)
 	desc = event->desc;
 	switch (event->instrumentation) {
 	case LTTNG_KERNEL_TRACEPOINT:
+#ifdef LTTNG_EVENT_FANOUT
+		ret = lttng_event_fanout_unregister(event);
+#else
 		ret = lttng_wrapper_tracepoint_probe_unregister(event->desc->kname,
 						  event->desc->probe_callback,
 						  event);
+#endif
 		break;
 	case LTTNG_KERNEL_KPROBE:
 		lttng_kprobes_unregister(event);
@@ -868,6 +2087,22 @@ int _lttng_event_unregister(struct lttng_event *event)
 		lttng_ftrace_unregister(event);
 		ret = 0;
 		break;
+	case LTTNG_KERNEL_FENTRY:
+		lttng_fentry_unregister(event);
+		ret = 0;
+		break;
+	case LTTNG_KERNEL_FGRAPH:
+		lttng_fgraph_unregister(event);
+		ret = 0;
+		break;
+	case LTTNG_KERNEL_SAMPLER:
+		lttng_sampler_unregister(event);
+		ret = 0;
+		break;
+	case LTTNG_KERNEL_HWTRACE_SYNC:
+		lttng_hwtrace_sync_unregister(event);
+		ret = 0;
+		break;
 	case LTTNG_KERNEL_SYSCALL:
 		ret = lttng_syscall_filter_disable(event->chan,
 			desc->name);
@@ -909,6 +2144,22 @@ void _lttng_event_destroy(struct lttng_event *event)
 		module_put(event->desc->owner);
 		lttng_ftrace_destroy_private(event);
 		break;
+	case LTTNG_KERNEL_FENTRY:
+		module_put(event->desc->owner);
+		lttng_fentry_destroy_private(event);
+		break;
+	case LTTNG_KERNEL_FGRAPH:
+		module_put(event->desc->owner);
+		lttng_fgraph_destroy_private(event);
+		break;
+	case LTTNG_KERNEL_SAMPLER:
+		module_put(event->desc->owner);
+		lttng_sampler_destroy_private(event);
+		break;
+	case LTTNG_KERNEL_HWTRACE_SYNC:
+		module_put(event->desc->owner);
+		lttng_hwtrace_sync_destroy_private(event);
+		break;
 	case LTTNG_KERNEL_NOOP:
 	case LTTNG_KERNEL_SYSCALL:
 		break;
@@ -920,7 +2171,12 @@ void _lttng_event_destroy(struct lttng_event *event)
 		WARN_ON_ONCE(1);
 	}
 	list_del(&event->list);
+	lttng_ratelimit_destroy(event->ratelimit);
+	lttng_breaker_destroy(event->breaker);
+	free_percpu(event->hit_count);
+	lttng_probe_profile_event_remove(event);
 	lttng_destroy_context(event->ctx);
+	lttng_free_event_filter_runtime(event);
 	kmem_cache_free(event_cache, event);
 }
 
@@ -930,7 +2186,7 @@ int lttng_session_track_pid(struct lttng_session *session, int pid)
 
 	if (pid < -1)
 		return -EINVAL;
-	mutex_lock(&sessions_mutex);
+	lttng_lock_session(session);
 	if (pid == -1) {
 		/* track all pids: destroy tracker. */
 		if (session->pid_tracker) {
@@ -958,7 +2214,8 @@ int lttng_session_track_pid(struct lttng_session *session, int pid)
 		}
 	}
 unlock:
-	mutex_unlock(&sessions_mutex);
+	lttng_session_update_armed(session);
+	lttng_unlock_session(session);
 	return ret;
 }
 
@@ -968,7 +2225,7 @@ int lttng_session_untrack_pid(struct lttng_session *session, int pid)
 
 	if (pid < -1)
 		return -EINVAL;
-	mutex_lock(&sessions_mutex);
+	lttng_lock_session(session);
 	if (pid == -1) {
 		/* untrack all pids: replace by empty tracker. */
 		struct lttng_pid_tracker *old_lpf = session->pid_tracker;
@@ -992,7 +2249,95 @@ int lttng_session_untrack_pid(struct lttng_session *session, int pid)
 		ret = lttng_pid_tracker_del(session->pid_tracker, pid);
 	}
 unlock:
-	mutex_unlock(&sessions_mutex);
+	lttng_session_update_armed(session);
+	lttng_unlock_session(session);
+	return ret;
+}
+
+/*
+ * Id trackers follow the PID tracker semantic: tracking id -1 tracks
+ * all ids (removes the tracker), untracking id -1 tracks none.
+ */
+int lttng_session_track_id(struct lttng_session *session,
+		enum lttng_tracker_type type, int64_t id)
+{
+	struct lttng_id_tracker *lit;
+	int ret;
+
+	if (type >= NR_LTTNG_TRACKER_TYPES || id < -1)
+		return -EINVAL;
+	lttng_lock_session(session);
+	lit = session->id_trackers[type];
+	if (id == -1) {
+		/* track all ids: destroy tracker. */
+		if (lit) {
+			WRITE_ONCE(session->id_tracker_mask,
+				session->id_tracker_mask & ~(1UL << type));
+			rcu_assign_pointer(session->id_trackers[type], NULL);
+			synchronize_trace();
+			lttng_id_tracker_destroy(lit);
+		}
+		ret = 0;
+	} else {
+		if (!lit) {
+			lit = lttng_id_tracker_create();
+			if (!lit) {
+				ret = -ENOMEM;
+				goto unlock;
+			}
+			ret = lttng_id_tracker_add(lit, id);
+			if (ret) {
+				lttng_id_tracker_destroy(lit);
+				goto unlock;
+			}
+			rcu_assign_pointer(session->id_trackers[type], lit);
+			WRITE_ONCE(session->id_tracker_mask,
+				session->id_tracker_mask | (1UL << type));
+		} else {
+			ret = lttng_id_tracker_add(lit, id);
+		}
+	}
+unlock:
+	lttng_session_update_armed(session);
+	lttng_unlock_session(session);
+	return ret;
+}
+
+int lttng_session_untrack_id(struct lttng_session *session,
+		enum lttng_tracker_type type, int64_t id)
+{
+	int ret;
+
+	if (type >= NR_LTTNG_TRACKER_TYPES || id < -1)
+		return -EINVAL;
+	lttng_lock_session(session);
+	if (id == -1) {
+		/* untrack all ids: replace by empty tracker. */
+		struct lttng_id_tracker *old_lit = session->id_trackers[type];
+		struct lttng_id_tracker *lit;
+
+		lit = lttng_id_tracker_create();
+		if (!lit) {
+			ret = -ENOMEM;
+			goto unlock;
+		}
+		rcu_assign_pointer(session->id_trackers[type], lit);
+		WRITE_ONCE(session->id_tracker_mask,
+			session->id_tracker_mask | (1UL << type));
+		synchronize_trace();
+		if (old_lit)
+			lttng_id_tracker_destroy(old_lit);
+		ret = 0;
+	} else {
+		if (!session->id_trackers[type]) {
+			ret = -ENOENT;
+			goto unlock;
+		}
+		ret = lttng_id_tracker_del(session->id_trackers[type], id);
+	}
+unlock:
+	lttng_session_update_armed(session);
+	lttng_unlock_session(session);
 	return ret;
 }
 
@@ -1004,7 +2349,7 @@ void *pid_list_start(struct seq_file *m, loff_t *pos)
 	struct lttng_pid_hash_node *e;
 	int iter = 0, i;
 
-	mutex_lock(&sessions_mutex);
+	lttng_lock_session(session);
 	lpf = session->pid_tracker;
 	if (lpf) {
 		for (i = 0; i < LTTNG_PID_TABLE_SIZE; i++) {
@@ -1026,7 +2371,7 @@ void *pid_list_start(struct seq_file *m, loff_t *pos)
 	return NULL;
 }
 
-/* Called with sessions_mutex held. */
+/* Called with the session lock held. */
 static
 void *pid_list_next(struct seq_file *m, void *p, loff_t *ppos)
 {
@@ -1060,7 +2405,9 @@ void *pid_list_next(struct seq_file *m, void *p, loff_t *ppos)
 static
 void pid_list_stop(struct seq_file *m, void *p)
 {
-	mutex_unlock(&sessions_mutex);
+	struct lttng_session *session = m->private;
+
+	lttng_unlock_session(session);
 }
 
 static
@@ -1180,7 +2527,6 @@ int lttng_match_enabler_name(const char *desc_name,
 	return 1;
 }
 
-static
 int lttng_desc_match_enabler(const struct lttng_event_desc *desc,
 		struct lttng_enabler *enabler)
 {
@@ -1310,14 +2656,14 @@ void lttng_create_syscall_if_missing(struct lttng_enabler *enabler)
 {
 	int ret;
 
-	ret = lttng_syscalls_register(enabler->chan, NULL);
+	ret = lttng_syscalls_register(enabler->chan, enabler);
 	WARN_ON_ONCE(ret);
 }
 
 /*
  * Create struct lttng_event if it is missing and present in the list of
  * tracepoint probes.
- * Should be called with sessions mutex held.
+ * Should be called with sessions mutex and session lock held.
  */
 static
 void lttng_create_event_if_missing(struct lttng_enabler *enabler)
@@ -1335,103 +2681,397 @@ void lttng_create_event_if_missing(struct lttng_enabler *enabler)
 	}
 }
 
-/*
- * Create events associated with an enabler (if not already present),
- * and add backward reference from the event to the enabler.
- * Should be called with sessions mutex held.
- */
-static
-int lttng_enabler_ref_events(struct lttng_enabler *enabler)
+/*
+ * Add backward reference from the event to the enabler, if missing.
+ * Should be called with sessions mutex and session lock held.
+ */
+static
+int lttng_enabler_ref_event(struct lttng_enabler *enabler,
+		struct lttng_event *event)
+{
+	struct lttng_enabler_ref *enabler_ref;
+
+	enabler_ref = lttng_event_enabler_ref(event, enabler);
+	if (!enabler_ref) {
+		/*
+		 * If no backward ref, create it.
+		 * Add backward ref from event to enabler.
+		 */
+		enabler_ref = kzalloc(sizeof(*enabler_ref), GFP_KERNEL);
+		if (!enabler_ref)
+			return -ENOMEM;
+		enabler_ref->ref = enabler;
+		list_add(&enabler_ref->node,
+			&event->enablers_ref_head);
+		/* Add forward ref from enabler to event. */
+		enabler_ref->event = event;
+		list_add(&enabler_ref->enabler_node,
+			&enabler->events_ref_head);
+	}
+
+	/*
+	 * Link filter bytecodes if not linked yet.
+	 */
+	lttng_enabler_event_link_bytecode(event, enabler);
+	lttng_filter_event_link_ctx_guards(event);
+
+	/* TODO: merge event context. */
+	return 0;
+}
+
+/*
+ * Create the tracepoint events of the descriptors matching a tracepoint
+ * enabler within "descs", if not already present, and reference them.
+ * The descriptors are those of the probe index which begin with the
+ * enabler name, or with the literal prefix of its star-glob pattern, so
+ * the work is bounded by the candidate matches instead of walking all
+ * probes and all session events.
+ * Should be called with sessions mutex and session lock held.
+ */
+static
+int lttng_enabler_ref_tracepoints(struct lttng_enabler *enabler,
+		const struct lttng_event_desc * const *descs, size_t nr)
+{
+	struct lttng_session *session = enabler->chan->session;
+	size_t i;
+	int ret;
+
+	for (i = 0; i < nr; i++) {
+		const struct lttng_event_desc *desc = descs[i];
+		struct lttng_event *event, *iter;
+		struct hlist_head *head;
+		uint32_t hash;
+
+		if (!lttng_desc_match_enabler(desc, enabler))
+			continue;
+		event = NULL;
+		hash = jhash(desc->name, strlen(desc->name), 0);
+		head = &session->events_ht.table[hash & (LTTNG_EVENT_HT_SIZE - 1)];
+		lttng_hlist_for_each_entry(iter, head, hlist) {
+			if (iter->desc == desc && iter->chan == enabler->chan) {
+				event = iter;
+				break;
+			}
+		}
+		if (!event) {
+			event = _lttng_event_create(enabler->chan,
+					NULL, NULL, desc,
+					LTTNG_KERNEL_TRACEPOINT);
+			if (IS_ERR(event)) {
+				printk(KERN_INFO "Unable to create event %s\n",
+					desc->name);
+				continue;
+			}
+		}
+		ret = lttng_enabler_ref_event(enabler, event);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/*
+ * Create events associated with an enabler (if not already present),
+ * and add backward reference from the event to the enabler.
+ * Should be called with sessions mutex and session lock held.
+ */
+static
+int lttng_enabler_ref_events(struct lttng_enabler *enabler)
+{
+	struct lttng_session *session = enabler->chan->session;
+	struct lttng_event *event;
+	int ret;
+
+	if (enabler->event_param.instrumentation == LTTNG_KERNEL_TRACEPOINT) {
+		const char *name = enabler->event_param.name;
+		const struct lttng_event_desc * const *descs;
+		size_t nr, len;
+
+		/* Exact name, or literal prefix of the star-glob pattern. */
+		if (enabler->type == LTTNG_ENABLER_NAME)
+			len = strlen(name) + 1;
+		else
+			len = strcspn(name, "*\\");
+		if (!lttng_probes_match_prefix(name, len, &descs, &nr))
+			return lttng_enabler_ref_tracepoints(enabler, descs, nr);
+		/* Without probe index, walk all probes and events. */
+	}
+
+	/* First ensure that probe events are created for this enabler. */
+	lttng_create_event_if_missing(enabler);
+
+	/* For each event matching enabler in session event list. */
+	list_for_each_entry(event, &session->events, list) {
+		if (!lttng_event_match_enabler(event, enabler))
+			continue;
+		ret = lttng_enabler_ref_event(enabler, event);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/*
+ * Called at module load: connect the probe on all enablers matching
+ * this event.
+ * Called with sessions lock held.
+ */
+int lttng_fix_pending_events(void)
+{
+	struct lttng_session *session;
+
+	list_for_each_entry(session, &sessions, list) {
+		lttng_lock_session(session);
+		lttng_session_lazy_sync_enablers(session);
+		lttng_unlock_session(session);
+	}
+	return 0;
+}
+
+/*
+ * Called when events are created for the enablers of this session
+ * outside of the enabler sync, e.g. on the first hit of a system call.
+ * Called with sessions lock and session lock held.
+ */
+void lttng_session_fix_pending_events(struct lttng_session *session)
+{
+	lttng_session_lazy_sync_enablers(session);
+}
+
+struct lttng_enabler *lttng_enabler_create(enum lttng_enabler_type type,
+		struct lttng_kernel_event *event_param,
+		struct lttng_channel *chan)
+{
+	struct lttng_enabler *enabler;
+
+	enabler = kzalloc(sizeof(*enabler), GFP_KERNEL);
+	if (!enabler)
+		return NULL;
+	enabler->type = type;
+	INIT_LIST_HEAD(&enabler->filter_bytecode_head);
+	INIT_LIST_HEAD(&enabler->events_ref_head);
+	memcpy(&enabler->event_param, event_param,
+		sizeof(enabler->event_param));
+	enabler->chan = chan;
+	/* ctx left NULL */
+	enabler->enabled = 0;
+	enabler->evtype = LTTNG_TYPE_ENABLER;
+	mutex_lock(&sessions_mutex);
+	lttng_lock_session(chan->session);
+	list_add(&enabler->node, &enabler->chan->session->enablers_head);
+	lttng_enabler_lazy_sync(enabler);
+	lttng_unlock_session(chan->session);
+	mutex_unlock(&sessions_mutex);
+	return enabler;
+}
+EXPORT_SYMBOL_GPL(lttng_enabler_create);
+
+int lttng_enabler_enable(struct lttng_enabler *enabler)
+{
+	mutex_lock(&sessions_mutex);
+	lttng_lock_session(enabler->chan->session);
+	enabler->enabled = 1;
+	lttng_enabler_lazy_sync(enabler);
+	lttng_unlock_session(enabler->chan->session);
+	mutex_unlock(&sessions_mutex);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(lttng_enabler_enable);
+
+int lttng_enabler_disable(struct lttng_enabler *enabler)
+{
+	mutex_lock(&sessions_mutex);
+	lttng_lock_session(enabler->chan->session);
+	enabler->enabled = 0;
+	lttng_enabler_lazy_sync(enabler);
+	lttng_unlock_session(enabler->chan->session);
+	mutex_unlock(&sessions_mutex);
+	return 0;
+}
+
+int lttng_enabler_set_critical(struct lttng_enabler *enabler, int critical)
+{
+	mutex_lock(&sessions_mutex);
+	lttng_lock_session(enabler->chan->session);
+	enabler->critical = !!critical;
+	lttng_enabler_lazy_sync(enabler);
+	lttng_unlock_session(enabler->chan->session);
+	mutex_unlock(&sessions_mutex);
+	return 0;
+}
+
+int lttng_enabler_set_ratelimit(struct lttng_enabler *enabler,
+		const struct lttng_kernel_event_ratelimit *param)
+{
+	int ret, key_index;
+
+	ret = lttng_ratelimit_validate(param, &key_index);
+	if (ret)
+		return ret;
+	mutex_lock(&sessions_mutex);
+	lttng_lock_session(enabler->chan->session);
+	if (enabler->chan->channel_type == METADATA_CHANNEL) {
+		ret = -EPERM;
+		goto end;
+	}
+	enabler->ratelimit = *param;
+	lttng_enabler_lazy_sync(enabler);
+end:
+	lttng_unlock_session(enabler->chan->session);
+	mutex_unlock(&sessions_mutex);
+	return ret;
+}
+
+int lttng_enabler_set_breaker(struct lttng_enabler *enabler,
+		const struct lttng_kernel_event_breaker *param)
+{
+	struct lttng_enabler_ref *enabler_ref;
+	int ret;
+
+	ret = lttng_breaker_validate(param);
+	if (ret)
+		return ret;
+	mutex_lock(&sessions_mutex);
+	lttng_lock_session(enabler->chan->session);
+	if (enabler->chan->channel_type == METADATA_CHANNEL) {
+		ret = -EPERM;
+		goto end;
+	}
+	enabler->breaker = *param;
+	/* Setting a breaker again arms the events it disarmed. */
+	list_for_each_entry(enabler_ref, &enabler->events_ref_head,
+			enabler_node)
+		lttng_breaker_reset(enabler_ref->event->breaker);
+	lttng_enabler_lazy_sync(enabler);
+end:
+	lttng_unlock_session(enabler->chan->session);
+	mutex_unlock(&sessions_mutex);
+	return ret;
+}
+
+/*
+ * The session gates are allocated when first used by one of its
+ * enablers, and kept until its teardown.
+ */
+int lttng_enabler_set_gate(struct lttng_enabler *enabler,
+		const struct lttng_kernel_event_gate *param)
+{
+	int ret;
+
+	ret = lttng_gate_validate(param);
+	if (ret)
+		return ret;
+	mutex_lock(&sessions_mutex);
+	lttng_lock_session(enabler->chan->session);
+	if (enabler->chan->channel_type == METADATA_CHANNEL) {
+		ret = -EPERM;
+		goto end;
+	}
+	if (param->cond | param->open | param->close) {
+		ret = lttng_session_gates_create(enabler->chan->session);
+		if (ret)
+			goto end;
+	}
+	enabler->gate = *param;
+	lttng_enabler_lazy_sync(enabler);
+end:
+	lttng_unlock_session(enabler->chan->session);
+	mutex_unlock(&sessions_mutex);
+	return ret;
+}
+
+int lttng_enabler_set_count_only(struct lttng_enabler *enabler, int count_only)
 {
-	struct lttng_session *session = enabler->chan->session;
-	struct lttng_event *event;
-
-	/* First ensure that probe events are created for this enabler. */
-	lttng_create_event_if_missing(enabler);
-
-	/* For each event matching enabler in session event list. */
-	list_for_each_entry(event, &session->events, list) {
-		struct lttng_enabler_ref *enabler_ref;
+	int ret = 0;
 
-		if (!lttng_event_match_enabler(event, enabler))
-			continue;
-		enabler_ref = lttng_event_enabler_ref(event, enabler);
-		if (!enabler_ref) {
-			/*
-			 * If no backward ref, create it.
-			 * Add backward ref from event to enabler.
-			 */
-			enabler_ref = kzalloc(sizeof(*enabler_ref), GFP_KERNEL);
-			if (!enabler_ref)
-				return -ENOMEM;
-			enabler_ref->ref = enabler;
-			list_add(&enabler_ref->node,
-				&event->enablers_ref_head);
-		}
+	mutex_lock(&sessions_mutex);
+	lttng_lock_session(enabler->chan->session);
+	if (enabler->chan->channel_type == METADATA_CHANNEL) {
+		ret = -EPERM;
+		goto end;
+	}
+	enabler->count_only = !!count_only;
+	lttng_enabler_lazy_sync(enabler);
+end:
+	lttng_unlock_session(enabler->chan->session);
+	mutex_unlock(&sessions_mutex);
+	return ret;
+}
 
-		/*
-		 * Link filter bytecodes if not linked yet.
-		 */
-		lttng_enabler_event_link_bytecode(event, enabler);
+int lttng_enabler_set_coalesce(struct lttng_enabler *enabler, int coalesce)
+{
+	int ret = 0;
 
-		/* TODO: merge event context. */
+	mutex_lock(&sessions_mutex);
+	lttng_lock_session(enabler->chan->session);
+	if (enabler->chan->channel_type == METADATA_CHANNEL) {
+		ret = -EPERM;
+		goto end;
 	}
-	return 0;
+	enabler->coalesce = !!coalesce;
+	lttng_enabler_lazy_sync(enabler);
+end:
+	lttng_unlock_session(enabler->chan->session);
+	mutex_unlock(&sessions_mutex);
+	return ret;
 }
 
 /*
- * Called at module load: connect the probe on all enablers matching
- * this event.
- * Called with sessions lock held.
+ * Hit counts summed over the events matched by an enabler.
  */
-int lttng_fix_pending_events(void)
+int lttng_enabler_hit_count(struct lttng_enabler *enabler,
+		struct lttng_kernel_event_hit_count *hit_count)
 {
-	struct lttng_session *session;
+	struct lttng_enabler_ref *enabler_ref;
 
-	list_for_each_entry(session, &sessions, list)
-		lttng_session_lazy_sync_enablers(session);
+	memset(hit_count, 0, sizeof(*hit_count));
+	lttng_lock_session(enabler->chan->session);
+	list_for_each_entry(enabler_ref, &enabler->events_ref_head,
+			enabler_node)
+		hit_count->count += lttng_event_sum_hit_count(enabler_ref->event);
+	lttng_unlock_session(enabler->chan->session);
 	return 0;
 }
 
-struct lttng_enabler *lttng_enabler_create(enum lttng_enabler_type type,
-		struct lttng_kernel_event *event_param,
-		struct lttng_channel *chan)
+static
+void lttng_filter_stats_to_abi(struct lttng_kernel_filter_stats *stats,
+		const struct lttng_filter_stats *sum)
 {
-	struct lttng_enabler *enabler;
-
-	enabler = kzalloc(sizeof(*enabler), GFP_KERNEL);
-	if (!enabler)
-		return NULL;
-	enabler->type = type;
-	INIT_LIST_HEAD(&enabler->filter_bytecode_head);
-	memcpy(&enabler->event_param, event_param,
-		sizeof(enabler->event_param));
-	enabler->chan = chan;
-	/* ctx left NULL */
-	enabler->enabled = 0;
-	enabler->evtype = LTTNG_TYPE_ENABLER;
-	mutex_lock(&sessions_mutex);
-	list_add(&enabler->node, &enabler->chan->session->enablers_head);
-	lttng_session_lazy_sync_enablers(enabler->chan->session);
-	mutex_unlock(&sessions_mutex);
-	return enabler;
+	memset(stats, 0, sizeof(*stats));
+	stats->evaluations = sum->evaluations;
+	stats->accepts = sum->accepts;
+	stats->rejects = sum->evaluations - sum->accepts;
+	stats->samples = sum->samples;
+	stats->cycles = sum->cycles;
 }
 
-int lttng_enabler_enable(struct lttng_enabler *enabler)
+int lttng_event_filter_stats(struct lttng_event *event,
+		struct lttng_kernel_filter_stats *stats)
 {
-	mutex_lock(&sessions_mutex);
-	enabler->enabled = 1;
-	lttng_session_lazy_sync_enablers(enabler->chan->session);
-	mutex_unlock(&sessions_mutex);
+	struct lttng_filter_stats sum = { 0 };
+
+	lttng_lock_session(event->chan->session);
+	lttng_filter_event_stats(event, &sum);
+	lttng_unlock_session(event->chan->session);
+	lttng_filter_stats_to_abi(stats, &sum);
 	return 0;
 }
 
-int lttng_enabler_disable(struct lttng_enabler *enabler)
+/*
+ * Filter statistics summed over the events matched by an enabler.
+ */
+int lttng_enabler_filter_stats(struct lttng_enabler *enabler,
+		struct lttng_kernel_filter_stats *stats)
 {
-	mutex_lock(&sessions_mutex);
-	enabler->enabled = 0;
-	lttng_session_lazy_sync_enablers(enabler->chan->session);
-	mutex_unlock(&sessions_mutex);
+	struct lttng_filter_stats sum = { 0 };
+	struct lttng_enabler_ref *enabler_ref;
+
+	lttng_lock_session(enabler->chan->session);
+	list_for_each_entry(enabler_ref, &enabler->events_ref_head,
+			enabler_node)
+		lttng_filter_event_stats(enabler_ref->event, &sum);
+	lttng_unlock_session(enabler->chan->session);
+	lttng_filter_stats_to_abi(stats, &sum);
 	return 0;
 }
 
@@ -1456,8 +3096,12 @@ int lttng_enabler_attach_bytecode(struct lttng_enabler *enabler,
 	bytecode_node->enabler = enabler;
 	/* Enforce length based on allocated size */
 	bytecode_node->bc.len = bytecode_len;
+	mutex_lock(&sessions_mutex);
+	lttng_lock_session(enabler->chan->session);
 	list_add_tail(&bytecode_node->node, &enabler->filter_bytecode_head);
-	lttng_session_lazy_sync_enablers(enabler->chan->session);
+	lttng_enabler_lazy_sync(enabler);
+	lttng_unlock_session(enabler->chan->session);
+	mutex_unlock(&sessions_mutex);
 	return 0;
 
 error_free:
@@ -1465,6 +3109,32 @@ error_free:
 	return ret;
 }
 
+int lttng_enabler_attach_bpf(struct lttng_enabler *enabler,
+		struct lttng_kernel_filter_bpf *bpf_param)
+{
+	struct lttng_filter_bytecode_node *bytecode_node;
+	struct bpf_prog *prog;
+
+	prog = lttng_filter_bpf_get(bpf_param->fd);
+	if (IS_ERR(prog))
+		return PTR_ERR(prog);
+	bytecode_node = kzalloc(sizeof(*bytecode_node), GFP_KERNEL);
+	if (!bytecode_node) {
+		lttng_filter_bpf_put(prog);
+		return -ENOMEM;
+	}
+	bytecode_node->enabler = enabler;
+	bytecode_node->bpf_prog = prog;
+	bytecode_node->bc.seqnum = bpf_param->seqnum;
+	mutex_lock(&sessions_mutex);
+	lttng_lock_session(enabler->chan->session);
+	list_add_tail(&bytecode_node->node, &enabler->filter_bytecode_head);
+	lttng_enabler_lazy_sync(enabler);
+	lttng_unlock_session(enabler->chan->session);
+	mutex_unlock(&sessions_mutex);
+	return 0;
+}
+
 int lttng_event_add_callsite(struct lttng_event *event,
 		struct lttng_kernel_event_callsite __user *callsite)
 {
@@ -1477,6 +3147,17 @@ int lttng_event_add_callsite(struct lttng_event *event,
 	}
 }
 
+int lttng_event_add_callsites(struct lttng_event *event,
+		struct lttng_kernel_event_callsites __user *callsites)
+{
+	switch (event->instrumentation) {
+	case LTTNG_KERNEL_UPROBE:
+		return lttng_uprobes_add_callsites(event, callsites);
+	default:
+		return -EINVAL;
+	}
+}
+
 int lttng_enabler_attach_context(struct lttng_enabler *enabler,
 		struct lttng_kernel_context *context_param)
 {
@@ -1487,10 +3168,19 @@ static
 void lttng_enabler_destroy(struct lttng_enabler *enabler)
 {
 	struct lttng_filter_bytecode_node *filter_node, *tmp_filter_node;
+	struct lttng_enabler_ref *enabler_ref, *tmp_enabler_ref;
+
+	/* Destroy references from and to the events */
+	list_for_each_entry_safe(enabler_ref, tmp_enabler_ref,
+			&enabler->events_ref_head, enabler_node) {
+		list_del(&enabler_ref->node);
+		kfree(enabler_ref);
+	}
 
 	/* Destroy filter bytecode */
 	list_for_each_entry_safe(filter_node, tmp_filter_node,
 			&enabler->filter_bytecode_head, node) {
+		lttng_filter_bpf_put(filter_node->bpf_prog);
 		kfree(filter_node);
 	}
 
@@ -1502,79 +3192,182 @@ void lttng_enabler_destroy(struct lttng_enabler *enabler)
 }
 
 /*
- * lttng_session_sync_enablers should be called just before starting a
- * session.
- * Should be called with sessions mutex held.
+ * Sync the enabled state, tracepoint registration and filters of an
+ * event with its enablers.
+ * Should be called with sessions mutex and session lock held.
  */
 static
-void lttng_session_sync_enablers(struct lttng_session *session)
+void lttng_event_sync_enablers(struct lttng_event *event)
 {
-	struct lttng_enabler *enabler;
-	struct lttng_event *event;
+	struct lttng_session *session = event->chan->session;
+	struct lttng_enabler_ref *enabler_ref;
+	struct lttng_bytecode_runtime *runtime;
+	const struct lttng_kernel_event_ratelimit *ratelimit = NULL;
+	const struct lttng_kernel_event_breaker *breaker = NULL;
+	const struct lttng_kernel_event_gate *gate = NULL;
+	int enabled = 0, has_enablers_without_bytecode = 0, critical = 0;
+	int count_only = 0, coalesce = 0;
 
-	list_for_each_entry(enabler, &session->enablers_head, node)
-		lttng_enabler_ref_events(enabler);
-	/*
-	 * For each event, if at least one of its enablers is enabled,
-	 * and its channel and session transient states are enabled, we
-	 * enable the event, else we disable it.
-	 */
-	list_for_each_entry(event, &session->events, list) {
-		struct lttng_enabler_ref *enabler_ref;
-		struct lttng_bytecode_runtime *runtime;
-		int enabled = 0, has_enablers_without_bytecode = 0;
-
-		switch (event->instrumentation) {
-		case LTTNG_KERNEL_TRACEPOINT:
-		case LTTNG_KERNEL_SYSCALL:
-			/* Enable events */
-			list_for_each_entry(enabler_ref,
-					&event->enablers_ref_head, node) {
-				if (enabler_ref->ref->enabled) {
-					enabled = 1;
-					break;
-				}
+	switch (event->instrumentation) {
+	case LTTNG_KERNEL_TRACEPOINT:
+	case LTTNG_KERNEL_SYSCALL:
+		/* Enable events */
+		list_for_each_entry(enabler_ref,
+				&event->enablers_ref_head, node) {
+			if (enabler_ref->ref->enabled) {
+				enabled = 1;
+				break;
 			}
-			break;
-		default:
-			/* Not handled with lazy sync. */
-			continue;
 		}
-		/*
-		 * Enabled state is based on union of enablers, with
-		 * intesection of session and channel transient enable
-		 * states.
-		 */
-		enabled = enabled && session->tstate && event->chan->tstate;
+		/* Critical if any of its enabled enablers is. */
+		list_for_each_entry(enabler_ref,
+				&event->enablers_ref_head, node) {
+			if (enabler_ref->ref->enabled
+					&& enabler_ref->ref->critical) {
+				critical = 1;
+				break;
+			}
+		}
+		/* Coalesced if any of its enabled enablers is. */
+		list_for_each_entry(enabler_ref,
+				&event->enablers_ref_head, node) {
+			if (enabler_ref->ref->enabled
+					&& enabler_ref->ref->coalesce) {
+				coalesce = 1;
+				break;
+			}
+		}
+		/* Rate limited by the first of its enabled enablers which is. */
+		list_for_each_entry(enabler_ref,
+				&event->enablers_ref_head, node) {
+			if (enabler_ref->ref->enabled
+					&& enabler_ref->ref->ratelimit.rate) {
+				ratelimit = &enabler_ref->ref->ratelimit;
+				break;
+			}
+		}
+		/* Circuit breaker of the first of its enabled enablers with one. */
+		list_for_each_entry(enabler_ref,
+				&event->enablers_ref_head, node) {
+			const struct lttng_kernel_event_breaker *b =
+				&enabler_ref->ref->breaker;
 
-		WRITE_ONCE(event->enabled, enabled);
+			if (enabler_ref->ref->enabled
+					&& (b->max_rate | b->max_cycles)) {
+				breaker = b;
+				break;
+			}
+		}
 		/*
-		 * Sync tracepoint registration with event enabled
-		 * state.
+		 * Count-only if all of its enabled enablers are: recording
+		 * the event for one of them takes precedence.
 		 */
-		if (enabled) {
-			register_event(event);
-		} else {
-			_lttng_event_unregister(event);
+		list_for_each_entry(enabler_ref,
+				&event->enablers_ref_head, node) {
+			if (!enabler_ref->ref->enabled)
+				continue;
+			if (!enabler_ref->ref->count_only) {
+				count_only = 0;
+				break;
+			}
+			count_only = 1;
 		}
-
-		/* Check if has enablers without bytecode enabled */
+		/* Gated by the first of its enabled enablers which is. */
 		list_for_each_entry(enabler_ref,
 				&event->enablers_ref_head, node) {
+			const struct lttng_kernel_event_gate *g =
+				&enabler_ref->ref->gate;
+
 			if (enabler_ref->ref->enabled
-					&& list_empty(&enabler_ref->ref->filter_bytecode_head)) {
-				has_enablers_without_bytecode = 1;
+					&& (g->cond | g->open | g->close)) {
+				gate = g;
 				break;
 			}
 		}
-		event->has_enablers_without_bytecode =
-			has_enablers_without_bytecode;
+		break;
+	default:
+		/* Not handled with lazy sync. */
+		return;
+	}
+	/*
+	 * Enabled state is based on union of enablers, with
+	 * intesection of session and channel transient enable
+	 * states.
+	 */
+	enabled = enabled && session->tstate && event->chan->tstate;
+
+	WRITE_ONCE(event->enabled, enabled);
+	event->critical = critical;
+	event->coalesce = coalesce;
+	/* The event is not rate limited if its buckets cannot be allocated. */
+	(void) lttng_ratelimit_set(&event->ratelimit, ratelimit);
+	/* Nor has it a breaker if it cannot be allocated. */
+	(void) lttng_breaker_set(&event->breaker, breaker, false);
+	/* The event keeps recording if its counters cannot be allocated. */
+	event->count_only = count_only
+		&& !lttng_event_alloc_hit_count(event);
+	if (gate) {
+		event->gate.scope = gate->scope;
+		event->gate.cond = gate->cond;
+		event->gate.open = gate->open;
+		event->gate.close = gate->close;
+	} else {
+		memset(&event->gate, 0, sizeof(event->gate));
+	}
+	/*
+	 * Sync tracepoint registration with event enabled
+	 * state.
+	 */
+	if (enabled) {
+		register_event(event);
+	} else {
+		_lttng_event_unregister(event);
+	}
 
-		/* Enable filters */
-		list_for_each_entry(runtime,
-				&event->bytecode_runtime_head, node)
-			lttng_filter_sync_state(runtime);
+	/* Check if has enablers without bytecode enabled */
+	list_for_each_entry(enabler_ref,
+			&event->enablers_ref_head, node) {
+		if (enabler_ref->ref->enabled
+				&& list_empty(&enabler_ref->ref->filter_bytecode_head)) {
+			has_enablers_without_bytecode = 1;
+			break;
+		}
 	}
+	event->has_enablers_without_bytecode =
+		has_enablers_without_bytecode;
+
+	/* Enable filters */
+	list_for_each_entry(runtime,
+			&event->bytecode_runtime_head, node)
+		lttng_filter_sync_state(runtime);
+	lttng_filter_event_fuse_bytecode(event);
+}
+
+/*
+ * lttng_session_sync_enablers should be called just before starting a
+ * session.
+ * Should be called with sessions mutex and session lock held.
+ */
+static
+void lttng_session_sync_enablers(struct lttng_session *session)
+{
+	struct lttng_enabler *enabler;
+	struct lttng_event *event;
+
+	list_for_each_entry(enabler, &session->enablers_head, node)
+		lttng_enabler_ref_events(enabler);
+	/*
+	 * For each event, if at least one of its enablers is enabled,
+	 * and its channel and session transient states are enabled, we
+	 * enable the event, else we disable it. The tracepoint probe
+	 * changes are applied at once when the batch ends.
+	 */
+	lttng_wrapper_tracepoint_batch_begin();
+	list_for_each_entry(event, &session->events, list)
+		lttng_event_sync_enablers(event);
+	lttng_wrapper_tracepoint_batch_end();
+	lttng_filter_link_cache_flush();
+	lttng_session_update_armed(session);
 }
 
 /*
@@ -1582,17 +3375,148 @@ void lttng_session_sync_enablers(struct lttng_session *session)
  * be. It is required after each modification applied to an active
  * session, and right before session "start".
  * "lazy" sync means we only sync if required.
- * Should be called with sessions mutex held.
+ * Should be called with sessions mutex and session lock held.
  */
 static
 void lttng_session_lazy_sync_enablers(struct lttng_session *session)
 {
-	/* We can skip if session is not active */
-	if (!session->active)
+	/* We can skip if session is not active, or within a batch */
+	if (!session->active || session->sync_deferred)
 		return;
 	lttng_session_sync_enablers(session);
 }
 
+/*
+ * Defer the enabler syncs of the session configuration changes which
+ * follow, until lttng_session_config_end() applies them all at once.
+ */
+void lttng_session_config_begin(struct lttng_session *session)
+{
+	lttng_lock_session(session);
+	session->sync_deferred = 1;
+	lttng_unlock_session(session);
+}
+
+void lttng_session_config_end(struct lttng_session *session)
+{
+	mutex_lock(&sessions_mutex);
+	lttng_lock_session(session);
+	session->sync_deferred = 0;
+	lttng_session_lazy_sync_enablers(session);
+	lttng_unlock_session(session);
+	mutex_unlock(&sessions_mutex);
+}
+
+/*
+ * Apply a modified enabler to an active session. The state of the other
+ * enablers is already applied, so only the events this enabler matches
+ * need to be synced, found through its references once the events it
+ * matches are created. The cost of an enabler change is then bounded by
+ * the number of events it matches rather than by the session size.
+ * Should be called with sessions mutex and session lock held.
+ */
+static
+void lttng_enabler_lazy_sync(struct lttng_enabler *enabler)
+{
+	struct lttng_session *session = enabler->chan->session;
+	struct lttng_enabler_ref *enabler_ref;
+
+	/* We can skip if session is not active, or within a batch */
+	if (!session->active || session->sync_deferred)
+		return;
+	lttng_enabler_ref_events(enabler);
+	list_for_each_entry(enabler_ref, &enabler->events_ref_head,
+			enabler_node) {
+		lttng_event_sync_enablers(enabler_ref->event);
+		lttng_event_update_armed(enabler_ref->event);
+	}
+	lttng_filter_link_cache_flush();
+}
+
+/*
+ * Make room for "len" more bytes in the metadata cache.
+ * Called with the metadata cache lock held.
+ */
+static
+int metadata_cache_reserve(struct lttng_metadata_cache *cache, size_t len)
+{
+	size_t needed = DIV_ROUND_UP((size_t) cache->metadata_written + len,
+			LTTNG_METADATA_CACHE_CHUNK_SIZE);
+
+	if (needed > cache->chunks_alloc) {
+		unsigned int chunks_alloc;
+		char **chunks;
+
+		chunks_alloc = max_t(unsigned int, needed,
+				cache->chunks_alloc << 1);
+		chunks = krealloc(cache->chunks,
+				chunks_alloc * sizeof(*chunks), GFP_KERNEL);
+		if (!chunks)
+			return -ENOMEM;
+		cache->chunks = chunks;
+		cache->chunks_alloc = chunks_alloc;
+	}
+	while (cache->nr_chunks < needed) {
+		char *chunk;
+
+		/* Whole pages, so that the cache can be mapped. */
+		chunk = (char *) __get_free_page(GFP_KERNEL);
+		if (!chunk)
+			return -ENOMEM;
+		cache->chunks[cache->nr_chunks++] = chunk;
+	}
+	return 0;
+}
+
+/*
+ * Append to the metadata cache, across chunks. Room must be reserved.
+ * Called with the metadata cache lock held.
+ */
+static
+void metadata_cache_write(struct lttng_metadata_cache *cache,
+		const char *src, size_t len)
+{
+	while (len) {
+		size_t offset = cache->metadata_written
+				% LTTNG_METADATA_CACHE_CHUNK_SIZE;
+		size_t copy_len = min_t(size_t, len,
+				LTTNG_METADATA_CACHE_CHUNK_SIZE - offset);
+
+		memcpy(cache->chunks[cache->metadata_written
+					/ LTTNG_METADATA_CACHE_CHUNK_SIZE] + offset,
+			src, copy_len);
+		cache->metadata_written += copy_len;
+		src += copy_len;
+		len -= copy_len;
+	}
+}
+
+/*
+ * Write "len" bytes of the metadata cache from the stream position into
+ * a reserved metadata record, one chunk segment at a time.
+ * Called with the metadata cache lock held.
+ */
+static
+void metadata_cache_output(struct lttng_metadata_stream *stream,
+		struct lib_ring_buffer_ctx *ctx, size_t len)
+{
+	struct lttng_metadata_cache *cache = stream->metadata_cache;
+	unsigned int pos = stream->metadata_in;
+
+	while (len) {
+		size_t offset = pos % LTTNG_METADATA_CACHE_CHUNK_SIZE;
+		size_t write_len = min_t(size_t, len,
+				LTTNG_METADATA_CACHE_CHUNK_SIZE - offset);
+
+		stream->transport->ops.event_write(ctx,
+			cache->chunks[pos / LTTNG_METADATA_CACHE_CHUNK_SIZE]
+				+ offset,
+			write_len);
+		pos += write_len;
+		len -= write_len;
+	}
+}
+
 /*
  * Serialize at most one packet worth of metadata into a metadata
  * channel.
@@ -1601,7 +3525,7 @@ void lttng_session_lazy_sync_enablers(struct lttng_session *session)
  * allows us to do racy operations such as looking for remaining space left in
  * packet and write, since mutual exclusion protects us from concurrent writes.
  * Mutual exclusion on the metadata cache allow us to read the cache content
- * without racing against reallocation of the cache by updates.
+ * without racing against its regeneration.
  * Returns the number of bytes written in the channel, 0 if no data
  * was written and a negative value on error.
  */
@@ -1617,9 +3541,6 @@ int lttng_metadata_output_channel(struct lttng_metadata_stream *stream,
 	 * put_next. The metadata cache lock protects reading the metadata
 	 * cache. It can indeed be read concurrently by "get_next_subbuf" and
 	 * "flush" operations on the buffer invoked by different processes.
-	 * Moreover, since the metadata cache memory can be reallocated, we
-	 * need to have exclusive access against updates even though we only
-	 * read it.
 	 */
 	mutex_lock(&stream->metadata_cache->lock);
 	WARN_ON(stream->metadata_in < stream->metadata_out);
@@ -1647,79 +3568,138 @@ int lttng_metadata_output_channel(struct lttng_metadata_stream *stream,
 		printk(KERN_WARNING "LTTng: Metadata event reservation failed\n");
 		goto end;
 	}
-	stream->transport->ops.event_write(&ctx,
-			stream->metadata_cache->data + stream->metadata_in,
-			reserve_len);
-	stream->transport->ops.event_commit(&ctx);
-	stream->metadata_in += reserve_len;
-	ret = reserve_len;
+	metadata_cache_output(stream, &ctx, reserve_len);
+	stream->transport->ops.event_commit(&ctx);
+	stream->metadata_in += reserve_len;
+	ret = reserve_len;
+
+end:
+	mutex_unlock(&stream->metadata_cache->lock);
+	return ret;
+}
+
+/*
+ * Append to a metadata fragment being generated.
+ * Must be called with metadata_fragment_mutex held.
+ */
+static
+int lttng_metadata_fragment_vprintf(struct lttng_metadata_fragment *fragment,
+		const char *fmt, va_list ap)
+{
+	struct lttng_metadata_buf *buf = &fragment->buf;
+	va_list aq;
+	int len;
+
+	va_copy(aq, ap);
+	len = vsnprintf(NULL, 0, fmt, aq);
+	va_end(aq);
+	if (buf->len + len + 1 > buf->alloc) {
+		size_t alloc;
+		char *data;
+
+		alloc = max_t(size_t, buf->len + len + 1, buf->alloc << 1);
+		data = krealloc(buf->data, alloc, GFP_KERNEL);
+		if (!data)
+			return -ENOMEM;
+		buf->data = data;
+		buf->alloc = alloc;
+	}
+	vsnprintf(buf->data + buf->len, len + 1, fmt, ap);
+	buf->len += len;
+	return 0;
+}
+
+/*
+ * Copy metadata already formatted into the metadata cache.
+ * Must be called with the session lock held.
+ */
+static
+int lttng_metadata_write(struct lttng_session *session, const char *str,
+		size_t len)
+{
+	struct lttng_metadata_cache *cache = session->metadata_cache;
+	struct lttng_metadata_stream *stream;
+	int ret;
 
+	mutex_lock(&cache->lock);
+	ret = metadata_cache_reserve(cache, len);
+	if (ret)
+		goto end;
+	metadata_cache_write(cache, str, len);
+	list_for_each_entry(stream, &cache->metadata_stream, list)
+		wake_up_interruptible(&stream->read_wait);
+	wake_up_interruptible(&cache->map_wait);
 end:
-	mutex_unlock(&stream->metadata_cache->lock);
+	mutex_unlock(&cache->lock);
 	return ret;
 }
 
 /*
  * Write the metadata to the metadata cache.
- * Must be called with sessions_mutex held.
+ * Must be called with the session lock held.
  * The metadata cache lock protects us from concurrent read access from
  * thread outputting metadata content to ring buffer.
+ * The fragment is formatted in place at the end of the last chunk, and
+ * only formatted separately when it spans chunks.
  */
 int lttng_metadata_printf(struct lttng_session *session,
 			  const char *fmt, ...)
 {
+	struct lttng_metadata_cache *cache = session->metadata_cache;
+	struct lttng_metadata_stream *stream;
+	size_t offset, avail;
 	char *str;
-	size_t len;
+	int len, ret;
 	va_list ap;
-	struct lttng_metadata_stream *stream;
 
 	WARN_ON_ONCE(!READ_ONCE(session->active));
 
+	if (session->metadata_capture) {
+		va_start(ap, fmt);
+		ret = lttng_metadata_fragment_vprintf(session->metadata_capture,
+				fmt, ap);
+		va_end(ap);
+		return ret;
+	}
+
+	mutex_lock(&cache->lock);
+	ret = metadata_cache_reserve(cache, 1);
+	if (ret)
+		goto end;
+	offset = cache->metadata_written % LTTNG_METADATA_CACHE_CHUNK_SIZE;
+	avail = LTTNG_METADATA_CACHE_CHUNK_SIZE - offset;
 	va_start(ap, fmt);
-	str = kvasprintf(GFP_KERNEL, fmt, ap);
+	len = vsnprintf(cache->chunks[cache->metadata_written
+				/ LTTNG_METADATA_CACHE_CHUNK_SIZE] + offset,
+			avail, fmt, ap);
 	va_end(ap);
-	if (!str)
-		return -ENOMEM;
-
-	len = strlen(str);
-	mutex_lock(&session->metadata_cache->lock);
-	if (session->metadata_cache->metadata_written + len >
-			session->metadata_cache->cache_alloc) {
-		char *tmp_cache_realloc;
-		unsigned int tmp_cache_alloc_size;
-
-		tmp_cache_alloc_size = max_t(unsigned int,
-				session->metadata_cache->cache_alloc + len,
-				session->metadata_cache->cache_alloc << 1);
-		tmp_cache_realloc = vzalloc(tmp_cache_alloc_size);
-		if (!tmp_cache_realloc)
-			goto err;
-		if (session->metadata_cache->data) {
-			memcpy(tmp_cache_realloc,
-				session->metadata_cache->data,
-				session->metadata_cache->cache_alloc);
-			vfree(session->metadata_cache->data);
-		}
+	/* The terminating null character must fit as well. */
+	if (len < avail) {
+		cache->metadata_written += len;
+		goto wakeup;
+	}
 
-		session->metadata_cache->cache_alloc = tmp_cache_alloc_size;
-		session->metadata_cache->data = tmp_cache_realloc;
+	va_start(ap, fmt);
+	str = kvasprintf(GFP_KERNEL, fmt, ap);
+	va_end(ap);
+	if (!str) {
+		ret = -ENOMEM;
+		goto end;
 	}
-	memcpy(session->metadata_cache->data +
-			session->metadata_cache->metadata_written,
-			str, len);
-	session->metadata_cache->metadata_written += len;
-	mutex_unlock(&session->metadata_cache->lock);
+	ret = metadata_cache_reserve(cache, len);
+	if (!ret)
+		metadata_cache_write(cache, str, len);
 	kfree(str);
+	if (ret)
+		goto end;
 
-	list_for_each_entry(stream, &session->metadata_cache->metadata_stream, list)
+wakeup:
+	list_for_each_entry(stream, &cache->metadata_stream, list)
 		wake_up_interruptible(&stream->read_wait);
-
-	return 0;
-
-err:
-	mutex_unlock(&session->metadata_cache->lock);
-	kfree(str);
-	return -ENOMEM;
+	wake_up_interruptible(&cache->map_wait);
+end:
+	mutex_unlock(&cache->lock);
+	return ret;
 }
 
 static
@@ -1739,12 +3719,23 @@ int print_tabs(struct lttng_session *session, size_t nesting)
 }
 
 /*
- * Must be called with sessions_mutex held.
+ * Fields of packed records are only byte aligned. Alignments are in bits.
+ */
+static
+unsigned int lttng_metadata_field_align(int packed, unsigned int alignment)
+{
+	if (packed)
+		return min_t(unsigned int, alignment, CHAR_BIT);
+	return alignment;
+}
+
+/*
+ * Must be called with the session lock held.
  */
 static
 int _lttng_struct_type_statedump(struct lttng_session *session,
 		const struct lttng_type *type,
-		size_t nesting)
+		size_t nesting, int packed)
 {
 	int ret;
 	uint32_t i, nr_fields;
@@ -1761,7 +3752,7 @@ int _lttng_struct_type_statedump(struct lttng_session *session,
 		const struct lttng_event_field *iter_field;
 
 		iter_field = &type->u._struct.fields[i];
-		ret = _lttng_field_statedump(session, iter_field, nesting + 1);
+		ret = _lttng_field_statedump(session, iter_field, nesting + 1, packed);
 		if (ret)
 			return ret;
 	}
@@ -1774,17 +3765,17 @@ int _lttng_struct_type_statedump(struct lttng_session *session,
 }
 
 /*
- * Must be called with sessions_mutex held.
+ * Must be called with the session lock held.
  */
 static
 int _lttng_struct_statedump(struct lttng_session *session,
 		const struct lttng_event_field *field,
-		size_t nesting)
+		size_t nesting, int packed)
 {
 	int ret;
 
 	ret = _lttng_struct_type_statedump(session,
-			&field->type, nesting);
+			&field->type, nesting, packed);
 	if (ret)
 		return ret;
 	ret = lttng_metadata_printf(session,
@@ -1794,12 +3785,12 @@ int _lttng_struct_statedump(struct lttng_session *session,
 }
 
 /*
- * Must be called with sessions_mutex held.
+ * Must be called with the session lock held.
  */
 static
 int _lttng_variant_type_statedump(struct lttng_session *session,
 		const struct lttng_type *type,
-		size_t nesting)
+		size_t nesting, int packed)
 {
 	int ret;
 	uint32_t i, nr_choices;
@@ -1817,7 +3808,7 @@ int _lttng_variant_type_statedump(struct lttng_session *session,
 		const struct lttng_event_field *iter_field;
 
 		iter_field = &type->u.variant.choices[i];
-		ret = _lttng_field_statedump(session, iter_field, nesting + 1);
+		ret = _lttng_field_statedump(session, iter_field, nesting + 1, packed);
 		if (ret)
 			return ret;
 	}
@@ -1830,17 +3821,17 @@ int _lttng_variant_type_statedump(struct lttng_session *session,
 }
 
 /*
- * Must be called with sessions_mutex held.
+ * Must be called with the session lock held.
  */
 static
 int _lttng_variant_statedump(struct lttng_session *session,
 		const struct lttng_event_field *field,
-		size_t nesting)
+		size_t nesting, int packed)
 {
 	int ret;
 
 	ret = _lttng_variant_type_statedump(session,
-			&field->type, nesting);
+			&field->type, nesting, packed);
 	if (ret)
 		return ret;
 	ret = lttng_metadata_printf(session,
@@ -1850,12 +3841,12 @@ int _lttng_variant_statedump(struct lttng_session *session,
 }
 
 /*
- * Must be called with sessions_mutex held.
+ * Must be called with the session lock held.
  */
 static
 int _lttng_array_compound_statedump(struct lttng_session *session,
 		const struct lttng_event_field *field,
-		size_t nesting)
+		size_t nesting, int packed)
 {
 	int ret;
 	const struct lttng_type *elem_type;
@@ -1864,12 +3855,12 @@ int _lttng_array_compound_statedump(struct lttng_session *session,
 	elem_type = field->type.u.array_compound.elem_type;
 	switch (elem_type->atype) {
 	case atype_struct:
-		ret = _lttng_struct_type_statedump(session, elem_type, nesting);
+		ret = _lttng_struct_type_statedump(session, elem_type, nesting, packed);
 		if (ret)
 			return ret;
 		break;
 	case atype_variant:
-		ret = _lttng_variant_type_statedump(session, elem_type, nesting);
+		ret = _lttng_variant_type_statedump(session, elem_type, nesting, packed);
 		if (ret)
 			return ret;
 		break;
@@ -1884,12 +3875,12 @@ int _lttng_array_compound_statedump(struct lttng_session *session,
 }
 
 /*
- * Must be called with sessions_mutex held.
+ * Must be called with the session lock held.
  */
 static
 int _lttng_sequence_compound_statedump(struct lttng_session *session,
 		const struct lttng_event_field *field,
-		size_t nesting)
+		size_t nesting, int packed)
 {
 	int ret;
 	const char *length_name;
@@ -1901,12 +3892,12 @@ int _lttng_sequence_compound_statedump(struct lttng_session *session,
 	elem_type = field->type.u.sequence_compound.elem_type;
 	switch (elem_type->atype) {
 	case atype_struct:
-		ret = _lttng_struct_type_statedump(session, elem_type, nesting);
+		ret = _lttng_struct_type_statedump(session, elem_type, nesting, packed);
 		if (ret)
 			return ret;
 		break;
 	case atype_variant:
-		ret = _lttng_variant_type_statedump(session, elem_type, nesting);
+		ret = _lttng_variant_type_statedump(session, elem_type, nesting, packed);
 		if (ret)
 			return ret;
 		break;
@@ -1921,12 +3912,12 @@ int _lttng_sequence_compound_statedump(struct lttng_session *session,
 }
 
 /*
- * Must be called with sessions_mutex held.
+ * Must be called with the session lock held.
  */
 static
 int _lttng_enum_statedump(struct lttng_session *session,
 		const struct lttng_event_field *field,
-		size_t nesting)
+		size_t nesting, int packed)
 {
 	const struct lttng_enum_desc *enum_desc;
 	const struct lttng_integer_type *container_type;
@@ -1943,7 +3934,8 @@ int _lttng_enum_statedump(struct lttng_session *session,
 	ret = lttng_metadata_printf(session,
 		"enum : integer { size = %u; align = %u; signed = %u; encoding = %s; base = %u;%s } {\n",
 		container_type->size,
-		container_type->alignment,
+		lttng_metadata_field_align(packed,
+				container_type->alignment),
 		container_type->signedness,
 		(container_type->encoding == lttng_encode_none)
 			? "none"
@@ -2044,12 +4036,12 @@ end:
 }
 
 /*
- * Must be called with sessions_mutex held.
+ * Must be called with the session lock held.
  */
 static
 int _lttng_field_statedump(struct lttng_session *session,
 		const struct lttng_event_field *field,
-		size_t nesting)
+		size_t nesting, int packed)
 {
 	int ret = 0;
 
@@ -2061,7 +4053,8 @@ int _lttng_field_statedump(struct lttng_session *session,
 		ret = lttng_metadata_printf(session,
 			"integer { size = %u; align = %u; signed = %u; encoding = %s; base = %u;%s } _%s;\n",
 			field->type.u.basic.integer.size,
-			field->type.u.basic.integer.alignment,
+			lttng_metadata_field_align(packed,
+				field->type.u.basic.integer.alignment),
 			field->type.u.basic.integer.signedness,
 			(field->type.u.basic.integer.encoding == lttng_encode_none)
 				? "none"
@@ -2077,7 +4070,7 @@ int _lttng_field_statedump(struct lttng_session *session,
 			field->name);
 		break;
 	case atype_enum:
-		ret = _lttng_enum_statedump(session, field, nesting);
+		ret = _lttng_enum_statedump(session, field, nesting, packed);
 		break;
 	case atype_array:
 	case atype_array_bitfield:
@@ -2085,7 +4078,7 @@ int _lttng_field_statedump(struct lttng_session *session,
 		const struct lttng_basic_type *elem_type;
 
 		elem_type = &field->type.u.array.elem_type;
-		if (field->type.u.array.elem_alignment) {
+		if (field->type.u.array.elem_alignment && !packed) {
 			ret = print_tabs(session, nesting);
 			if (ret)
 				return ret;
@@ -2102,7 +4095,8 @@ int _lttng_field_statedump(struct lttng_session *session,
 		ret = lttng_metadata_printf(session,
 			"integer { size = %u; align = %u; signed = %u; encoding = %s; base = %u;%s } _%s[%u];\n",
 			elem_type->u.basic.integer.size,
-			elem_type->u.basic.integer.alignment,
+			lttng_metadata_field_align(packed,
+				elem_type->u.basic.integer.alignment),
 			elem_type->u.basic.integer.signedness,
 			(elem_type->u.basic.integer.encoding == lttng_encode_none)
 				? "none"
@@ -2132,7 +4126,8 @@ int _lttng_field_statedump(struct lttng_session *session,
 		ret = lttng_metadata_printf(session,
 			"integer { size = %u; align = %u; signed = %u; encoding = %s; base = %u;%s } __%s_length;\n",
 			length_type->u.basic.integer.size,
-			(unsigned int) length_type->u.basic.integer.alignment,
+			lttng_metadata_field_align(packed,
+				length_type->u.basic.integer.alignment),
 			length_type->u.basic.integer.signedness,
 			(length_type->u.basic.integer.encoding == lttng_encode_none)
 				? "none"
@@ -2149,7 +4144,7 @@ int _lttng_field_statedump(struct lttng_session *session,
 		if (ret)
 			return ret;
 
-		if (field->type.u.sequence.elem_alignment) {
+		if (field->type.u.sequence.elem_alignment && !packed) {
 			ret = print_tabs(session, nesting);
 			if (ret)
 				return ret;
@@ -2166,7 +4161,8 @@ int _lttng_field_statedump(struct lttng_session *session,
 		ret = lttng_metadata_printf(session,
 			"integer { size = %u; align = %u; signed = %u; encoding = %s; base = %u;%s } _%s[ __%s_length ];\n",
 			elem_type->u.basic.integer.size,
-			(unsigned int) elem_type->u.basic.integer.alignment,
+			lttng_metadata_field_align(packed,
+				elem_type->u.basic.integer.alignment),
 			elem_type->u.basic.integer.signedness,
 			(elem_type->u.basic.integer.encoding == lttng_encode_none)
 				? "none"
@@ -2196,16 +4192,16 @@ int _lttng_field_statedump(struct lttng_session *session,
 			field->name);
 		break;
 	case atype_struct:
-		ret = _lttng_struct_statedump(session, field, nesting);
+		ret = _lttng_struct_statedump(session, field, nesting, packed);
 		break;
 	case atype_array_compound:
-		ret = _lttng_array_compound_statedump(session, field, nesting);
+		ret = _lttng_array_compound_statedump(session, field, nesting, packed);
 		break;
 	case atype_sequence_compound:
-		ret = _lttng_sequence_compound_statedump(session, field, nesting);
+		ret = _lttng_sequence_compound_statedump(session, field, nesting, packed);
 		break;
 	case atype_variant:
-		ret = _lttng_variant_statedump(session, field, nesting);
+		ret = _lttng_variant_statedump(session, field, nesting, packed);
 		break;
 
 	default:
@@ -2217,7 +4213,7 @@ int _lttng_field_statedump(struct lttng_session *session,
 
 static
 int _lttng_context_metadata_statedump(struct lttng_session *session,
-				    struct lttng_ctx *ctx)
+				    struct lttng_ctx *ctx, int packed)
 {
 	int ret = 0;
 	int i;
@@ -2227,7 +4223,9 @@ int _lttng_context_metadata_statedump(struct lttng_session *session,
 	for (i = 0; i < ctx->nr_fields; i++) {
 		const struct lttng_ctx_field *field = &ctx->fields[i];
 
-		ret = _lttng_field_statedump(session, &field->event_field, 2);
+		ret = _lttng_field_statedump(session, field->guard ?
+				&field->guard->field : &field->event_field, 2,
+				packed);
 		if (ret)
 			return ret;
 	}
@@ -2245,7 +4243,8 @@ int _lttng_fields_metadata_statedump(struct lttng_session *session,
 	for (i = 0; i < desc->nr_fields; i++) {
 		const struct lttng_event_field *field = &desc->fields[i];
 
-		ret = _lttng_field_statedump(session, field, 2);
+		ret = _lttng_field_statedump(session, field, 2,
+				event->chan->packed);
 		if (ret)
 			return ret;
 	}
@@ -2253,7 +4252,7 @@ int _lttng_fields_metadata_statedump(struct lttng_session *session,
 }
 
 /*
- * Must be called with sessions_mutex held.
+ * Must be called with the session lock held.
  */
 static
 int _lttng_event_metadata_statedump(struct lttng_session *session,
@@ -2266,6 +4265,10 @@ int _lttng_event_metadata_statedump(struct lttng_session *session,
 		return 0;
 	if (chan->channel_type == METADATA_CHANNEL)
 		return 0;
+	/* Emitted by the metadata work after the first record. */
+	if (session->lazy_metadata
+			&& !test_bit(LTTNG_EVENT_METADATA_HIT, &event->metadata_lazy))
+		return 0;
 
 	ret = lttng_metadata_printf(session,
 		"event {\n"
@@ -2274,7 +4277,7 @@ int _lttng_event_metadata_statedump(struct lttng_session *session,
 		"	stream_id = %u;\n",
 		event->desc->name,
 		event->id,
-		event->chan->id);
+		lttng_channel_owner(event->chan)->id);
 	if (ret)
 		goto end;
 
@@ -2284,7 +4287,8 @@ int _lttng_event_metadata_statedump(struct lttng_session *session,
 		if (ret)
 			goto end;
 	}
-	ret = _lttng_context_metadata_statedump(session, event->ctx);
+	ret = _lttng_context_metadata_statedump(session, event->ctx,
+			chan->packed);
 	if (ret)
 		goto end;
 	if (event->ctx) {
@@ -2294,6 +4298,61 @@ int _lttng_event_metadata_statedump(struct lttng_session *session,
 			goto end;
 	}
 
+	ret = _lttng_event_fields_shared_statedump(session, chan, event);
+	if (ret)
+		goto end;
+
+	event->metadata_dumped = 1;
+end:
+	return ret;
+}
+
+/*
+ * Binary record of the payload declaration, appended to the fragment
+ * being generated, or written directly for unshared descriptors.
+ * Must be called with the session lock held.
+ */
+static
+int _lttng_event_fields_binary_statedump(struct lttng_session *session,
+					 struct lttng_channel *chan,
+					 struct lttng_event *event)
+{
+	struct lttng_metadata_buf buf = { 0 };
+	int ret;
+
+	if (session->metadata_capture)
+		return lttng_metadata_binary_encode_event(
+				&session->metadata_capture->buf,
+				event->desc, chan->packed);
+	ret = lttng_metadata_binary_encode_event(&buf, event->desc,
+			chan->packed);
+	if (!ret)
+		ret = lttng_metadata_write(session, buf.data, buf.len);
+	kfree(buf.data);
+	return ret;
+}
+
+/*
+ * Payload part of the event metadata, the same in all sessions for a
+ * given descriptor, channel layout and metadata format.
+ * Must be called with the session lock held.
+ */
+static
+int _lttng_event_fields_statedump(struct lttng_session *session,
+				  struct lttng_channel *chan,
+				  struct lttng_event *event)
+{
+	int ret;
+
+	if (session->metadata_binary) {
+		ret = _lttng_event_fields_binary_statedump(session, chan,
+				event);
+		if (ret)
+			goto end;
+		ret = lttng_metadata_printf(session, "};\n\n");
+		goto end;
+	}
+
 	ret = lttng_metadata_printf(session,
 		"	fields := struct {\n"
 		);
@@ -2304,6 +4363,19 @@ int _lttng_event_metadata_statedump(struct lttng_session *session,
 	if (ret)
 		goto end;
 
+	/*
+	 * Single-pass events end with the unused part of their
+	 * reservation, when it could not be given back.
+	 */
+	if (event->desc->single_pass) {
+		ret = lttng_metadata_printf(session,
+			"		integer { size = 16; align = %u; signed = 0; encoding = none; base = 10; } __lttng_slack_length;\n"
+			"		integer { size = 8; align = 8; signed = 0; encoding = none; base = 10; } _lttng_slack[ __lttng_slack_length ];\n",
+			lttng_metadata_field_align(chan->packed, 16));
+		if (ret)
+			goto end;
+	}
+
 	/*
 	 * LTTng space reservation can only reserve multiples of the
 	 * byte size.
@@ -2311,17 +4383,112 @@ int _lttng_event_metadata_statedump(struct lttng_session *session,
 	ret = lttng_metadata_printf(session,
 		"	};\n"
 		"};\n\n");
-	if (ret)
-		goto end;
+end:
+	return ret;
+}
 
-	event->metadata_dumped = 1;
+/*
+ * Emit the payload metadata of an event from the shared fragments,
+ * generating the fragment on first use. Descriptors of probes created
+ * for a single event (kprobes, uprobes, ...) are not shared: they are
+ * freed with their event.
+ * Must be called with the session lock held.
+ */
+static
+int _lttng_event_fields_shared_statedump(struct lttng_session *session,
+					 struct lttng_channel *chan,
+					 struct lttng_event *event)
+{
+	const struct lttng_event_desc *desc = event->desc;
+	struct lttng_metadata_fragment *fragment;
+	struct hlist_head *head;
+	int ret;
+
+	switch (event->instrumentation) {
+	case LTTNG_KERNEL_TRACEPOINT:
+	case LTTNG_KERNEL_SYSCALL:
+		break;
+	default:
+		return _lttng_event_fields_statedump(session, chan, event);
+	}
+	head = &metadata_fragment_ht[jhash(&desc, sizeof(desc), 0)
+			& (LTTNG_METADATA_FRAGMENT_HT_SIZE - 1)];
+	mutex_lock(&metadata_fragment_mutex);
+	lttng_hlist_for_each_entry(fragment, head, hlist) {
+		if (fragment->desc == desc && fragment->packed == chan->packed
+				&& fragment->binary == session->metadata_binary)
+			goto write;
+	}
+	fragment = kzalloc(sizeof(*fragment), GFP_KERNEL);
+	if (!fragment) {
+		ret = -ENOMEM;
+		goto end;
+	}
+	fragment->desc = desc;
+	fragment->packed = chan->packed;
+	fragment->binary = session->metadata_binary;
+	session->metadata_capture = fragment;
+	ret = _lttng_event_fields_statedump(session, chan, event);
+	session->metadata_capture = NULL;
+	if (ret) {
+		kfree(fragment->buf.data);
+		kfree(fragment);
+		goto end;
+	}
+	hlist_add_head(&fragment->hlist, head);
+write:
+	ret = lttng_metadata_write(session, fragment->buf.data,
+			fragment->buf.len);
 end:
+	mutex_unlock(&metadata_fragment_mutex);
 	return ret;
+}
+
+/*
+ * Free the shared metadata fragments of the events of a probe provider
+ * being unregistered, or all of them if "probe_desc" is NULL.
+ */
+void lttng_metadata_fragments_purge(const struct lttng_probe_desc *probe_desc)
+{
+	struct lttng_metadata_fragment *fragment;
+	struct hlist_node *tmp;
+	unsigned int i, j;
+
+	mutex_lock(&metadata_fragment_mutex);
+	for (i = 0; i < LTTNG_METADATA_FRAGMENT_HT_SIZE; i++) {
+		lttng_hlist_for_each_entry_safe(fragment, tmp,
+				&metadata_fragment_ht[i], hlist) {
+			if (probe_desc) {
+				for (j = 0; j < probe_desc->nr_events; j++) {
+					if (probe_desc->event_desc[j] == fragment->desc)
+						break;
+				}
+				if (j == probe_desc->nr_events)
+					continue;
+			}
+			hlist_del(&fragment->hlist);
+			kfree(fragment->buf.data);
+			kfree(fragment);
+		}
+	}
+	mutex_unlock(&metadata_fragment_mutex);
+}
 
+static
+const char *lttng_event_header_name(int header_type)
+{
+	switch (header_type) {
+	case 1:
+		return "struct event_header_compact";
+	case 3:
+		return "struct event_header_delta";
+	default:
+		return "struct event_header_large";
+	}
 }
 
 /*
- * Must be called with sessions_mutex held.
+ * Must be called with the session lock held.
  */
 static
 int _lttng_channel_metadata_statedump(struct lttng_session *session,
@@ -2335,15 +4502,22 @@ int _lttng_channel_metadata_statedump(struct lttng_session *session,
 	if (chan->channel_type == METADATA_CHANNEL)
 		return 0;
 
+	/* Its events are declared in the stream of the owning channel. */
+	if (chan->shared) {
+		chan->metadata_dumped = 1;
+		return 0;
+	}
+
 	WARN_ON_ONCE(!chan->header_type);
 	ret = lttng_metadata_printf(session,
 		"stream {\n"
 		"	id = %u;\n"
-		"	event.header := %s;\n"
-		"	packet.context := struct packet_context;\n",
+		"	event.header := %s%s;\n"
+		"	packet.context := struct packet_context%s;\n",
 		chan->id,
-		chan->header_type == 1 ? "struct event_header_compact" :
-			"struct event_header_large");
+		lttng_event_header_name(chan->header_type),
+		chan->coarse_clock ? "_coarse" : "",
+		chan->coarse_clock ? "_coarse" : "");
 	if (ret)
 		goto end;
 
@@ -2353,7 +4527,8 @@ int _lttng_channel_metadata_statedump(struct lttng_session *session,
 		if (ret)
 			goto end;
 	}
-	ret = _lttng_context_metadata_statedump(session, chan->ctx);
+	ret = _lttng_context_metadata_statedump(session, chan->ctx,
+			chan->packed);
 	if (ret)
 		goto end;
 	if (chan->ctx) {
@@ -2372,21 +4547,33 @@ end:
 }
 
 /*
- * Must be called with sessions_mutex held.
+ * Declare the packet context of the streams timestamped by the trace
+ * clock, or by the coarse clock.
+ *
+ * Must be called with the session lock held.
  */
 static
-int _lttng_stream_packet_context_declare(struct lttng_session *session)
+int _lttng_stream_packet_context_declare(struct lttng_session *session,
+		bool coarse)
 {
+	const char *clock = coarse ? "coarse" : "monotonic";
+
 	return lttng_metadata_printf(session,
-		"struct packet_context {\n"
-		"	uint64_clock_monotonic_t timestamp_begin;\n"
-		"	uint64_clock_monotonic_t timestamp_end;\n"
+		"struct packet_context%s {\n"
+		"	uint64_clock_%s_t timestamp_begin;\n"
+		"	uint64_clock_%s_t timestamp_end;\n"
 		"	uint64_t content_size;\n"
 		"	uint64_t packet_size;\n"
 		"	uint64_t packet_seq_num;\n"
 		"	unsigned long events_discarded;\n"
 		"	uint32_t cpu_id;\n"
-		"};\n\n"
+		"	uint32_t sampling_period;\n"
+		"	unsigned long events_sampled_out;\n"
+		"	uint32_t events_discarded_id[%u];\n"
+		"	unsigned long events_discarded_count[%u];\n"
+		"};\n\n",
+		coarse ? "_coarse" : "", clock, clock,
+		LTTNG_LOST_SUMMARY_SLOTS, LTTNG_LOST_SUMMARY_SLOTS
 		);
 }
 
@@ -2399,40 +4586,94 @@ int _lttng_stream_packet_context_declare(struct lttng_session *session)
  * id: range: 0 - 65534.
  * id 65535 is reserved to indicate an extended header.
  *
- * Must be called with sessions_mutex held.
+ * Delta header:
+ * id: as for the compact header.
+ * tsw: number of low-order timestamp bits stored (0, 8, 16, 32 or 64),
+ * enough to cover the delta from the previous record. The byte-aligned
+ * integers are declared inline, the uintN_t aliases being aligned on
+ * their natural alignment on some architectures.
+ *
+ * The headers of the streams timestamped by the coarse clock have a
+ * "_coarse" suffix.
+ *
+ * Must be called with the session lock held.
  */
 static
-int _lttng_event_header_declare(struct lttng_session *session)
+int _lttng_event_header_declare(struct lttng_session *session, bool coarse)
 {
-	return lttng_metadata_printf(session,
-	"struct event_header_compact {\n"
+	const char *suffix = coarse ? "_coarse" : "";
+	const char *clock = coarse ? "coarse" : "monotonic";
+	const char *clock_name = coarse ? trace_clock_name_coarse()
+			: trace_clock_name();
+	int ret;
+
+	ret = lttng_metadata_printf(session,
+	"struct event_header_compact%s {\n"
 	"	enum : uint5_t { compact = 0 ... 30, extended = 31 } id;\n"
 	"	variant <id> {\n"
 	"		struct {\n"
-	"			uint27_clock_monotonic_t timestamp;\n"
+	"			uint27_clock_%s_t timestamp;\n"
 	"		} compact;\n"
 	"		struct {\n"
 	"			uint32_t id;\n"
-	"			uint64_clock_monotonic_t timestamp;\n"
+	"			uint64_clock_%s_t timestamp;\n"
 	"		} extended;\n"
 	"	} v;\n"
 	"} align(%u);\n"
 	"\n"
-	"struct event_header_large {\n"
+	"struct event_header_large%s {\n"
 	"	enum : uint16_t { compact = 0 ... 65534, extended = 65535 } id;\n"
 	"	variant <id> {\n"
 	"		struct {\n"
-	"			uint32_clock_monotonic_t timestamp;\n"
+	"			uint32_clock_%s_t timestamp;\n"
 	"		} compact;\n"
 	"		struct {\n"
 	"			uint32_t id;\n"
-	"			uint64_clock_monotonic_t timestamp;\n"
+	"			uint64_clock_%s_t timestamp;\n"
 	"		} extended;\n"
 	"	} v;\n"
 	"} align(%u);\n\n",
+	suffix, clock, clock,
 	lttng_alignof(uint32_t) * CHAR_BIT,
+	suffix, clock, clock,
 	lttng_alignof(uint16_t) * CHAR_BIT
 	);
+	if (ret)
+		return ret;
+	return lttng_metadata_printf(session,
+	"struct event_header_delta%s {\n"
+	"	enum : uint5_t { compact = 0 ... 30, extended = 31 } id;\n"
+	"	enum : uint3_t { ts0 = 0, ts8 = 1, ts16 = 2, ts32 = 3, ts64 = 4 } tsw;\n"
+	"	variant <id> {\n"
+	"		struct {\n"
+	"		} compact;\n"
+	"		struct {\n"
+	"			integer { size = 32; align = 8; signed = false; } id;\n"
+	"		} extended;\n"
+	"	} v;\n"
+	"	variant <tsw> {\n"
+	"		struct {\n"
+	"		} ts0;\n"
+	"		struct {\n"
+	"			integer { size = 8; align = 8; signed = false; map = clock.%s.value; } timestamp;\n"
+	"		} ts8;\n"
+	"		struct {\n"
+	"			integer { size = 16; align = 8; signed = false; map = clock.%s.value; } timestamp;\n"
+	"		} ts16;\n"
+	"		struct {\n"
+	"			integer { size = 32; align = 8; signed = false; map = clock.%s.value; } timestamp;\n"
+	"		} ts32;\n"
+	"		struct {\n"
+	"			integer { size = 64; align = 8; signed = false; map = clock.%s.value; } timestamp;\n"
+	"		} ts64;\n"
+	"	} t;\n"
+	"} align(8);\n\n",
+	suffix,
+	clock_name,
+	clock_name,
+	clock_name,
+	clock_name
+	);
 }
 
  /*
@@ -2444,19 +4685,18 @@ int _lttng_event_header_declare(struct lttng_session *session)
  * system sets the REALTIME clock to 0 after boot.
  */
 static
-int64_t measure_clock_offset(void)
+int64_t __measure_clock_offset(u64 (*read64)(void), uint64_t tcf)
 {
 	uint64_t monotonic_avg, monotonic[2], realtime;
-	uint64_t tcf = trace_clock_freq();
 	int64_t offset;
 	struct timespec rts = { 0, 0 };
 	unsigned long flags;
 
 	/* Disable interrupts to increase correlation precision. */
 	local_irq_save(flags);
-	monotonic[0] = trace_clock_read64();
+	monotonic[0] = read64();
 	getnstimeofday(&rts);
-	monotonic[1] = trace_clock_read64();
+	monotonic[1] = read64();
 	local_irq_restore(flags);
 
 	monotonic_avg = (monotonic[0] + monotonic[1]) >> 1;
@@ -2473,9 +4713,106 @@ int64_t measure_clock_offset(void)
 	return offset;
 }
 
+static
+u64 measure_clock_read64(void)
+{
+	return trace_clock_read64();
+}
+
+static
+int64_t measure_clock_offset(void)
+{
+	return __measure_clock_offset(measure_clock_read64, trace_clock_freq());
+}
+
+static
+int64_t measure_coarse_clock_offset(void)
+{
+	return __measure_clock_offset(trace_clock_read64_coarse,
+			trace_clock_freq_coarse());
+}
+
+/*
+ * Declare the integer types mapped to a clock, named after the clock
+ * family ("monotonic" for the trace clock, or "coarse").
+ *
+ * Must be called with the session lock held.
+ */
+static
+int _lttng_clock_types_declare(struct lttng_session *session,
+		const char *clock, const char *clock_name)
+{
+	return lttng_metadata_printf(session,
+		"typealias integer {\n"
+		"	size = 27; align = 1; signed = false;\n"
+		"	map = clock.%s.value;\n"
+		"} := uint27_clock_%s_t;\n"
+		"\n"
+		"typealias integer {\n"
+		"	size = 32; align = %u; signed = false;\n"
+		"	map = clock.%s.value;\n"
+		"} := uint32_clock_%s_t;\n"
+		"\n"
+		"typealias integer {\n"
+		"	size = 64; align = %u; signed = false;\n"
+		"	map = clock.%s.value;\n"
+		"} := uint64_clock_%s_t;\n\n",
+		clock_name, clock,
+		lttng_alignof(uint32_t) * CHAR_BIT,
+		clock_name, clock,
+		lttng_alignof(uint64_t) * CHAR_BIT,
+		clock_name, clock
+		);
+}
+
+/*
+ * Must be called with the session lock held.
+ */
+static
+int _lttng_coarse_clock_declare(struct lttng_session *session)
+{
+	int ret;
+
+	ret = lttng_metadata_printf(session,
+		"clock {\n"
+		"	name = \"%s\";\n"
+		"	description = \"%s\";\n"
+		"	freq = %llu; /* Frequency, in Hz */\n"
+		"	/* clock value offset from Epoch is: offset * (1/freq) */\n"
+		"	offset = %lld;\n"
+		"};\n\n",
+		trace_clock_name_coarse(),
+		trace_clock_description_coarse(),
+		(unsigned long long) trace_clock_freq_coarse(),
+		(long long) measure_coarse_clock_offset()
+		);
+	if (ret)
+		return ret;
+	ret = _lttng_clock_types_declare(session, "coarse",
+			trace_clock_name_coarse());
+	if (ret)
+		return ret;
+	ret = _lttng_stream_packet_context_declare(session, true);
+	if (ret)
+		return ret;
+	return _lttng_event_header_declare(session, true);
+}
+
+static
+bool lttng_session_has_coarse_channel(struct lttng_session *session)
+{
+	struct lttng_channel *chan;
+
+	list_for_each_entry(chan, &session->chan, list) {
+		if (chan->coarse_clock)
+			return true;
+	}
+	return false;
+}
+
 /*
  * Output metadata into this session's metadata buffers.
- * Must be called with sessions_mutex held.
+ * Must be called with the session lock held.
  */
 static
 int _lttng_session_metadata_statedump(struct lttng_session *session)
@@ -2548,6 +4885,7 @@ int _lttng_session_metadata_statedump(struct lttng_session *session)
 		"	tracer_major = %d;\n"
 		"	tracer_minor = %d;\n"
 		"	tracer_patchlevel = %d;\n"
+		"%s"
 		"};\n\n",
 		current->nsproxy->uts_ns->name.nodename,
 		utsname()->sysname,
@@ -2555,7 +4893,8 @@ int _lttng_session_metadata_statedump(struct lttng_session *session)
 		utsname()->version,
 		LTTNG_MODULES_MAJOR_VERSION,
 		LTTNG_MODULES_MINOR_VERSION,
-		LTTNG_MODULES_PATCHLEVEL_VERSION
+		LTTNG_MODULES_PATCHLEVEL_VERSION,
+		session->metadata_binary ? "	metadata_format = \"binary\";\n" : ""
 		);
 	if (ret)
 		goto end;
@@ -2590,38 +4929,26 @@ int _lttng_session_metadata_statedump(struct lttng_session *session)
 	if (ret)
 		goto end;
 
-	ret = lttng_metadata_printf(session,
-		"typealias integer {\n"
-		"	size = 27; align = 1; signed = false;\n"
-		"	map = clock.%s.value;\n"
-		"} := uint27_clock_monotonic_t;\n"
-		"\n"
-		"typealias integer {\n"
-		"	size = 32; align = %u; signed = false;\n"
-		"	map = clock.%s.value;\n"
-		"} := uint32_clock_monotonic_t;\n"
-		"\n"
-		"typealias integer {\n"
-		"	size = 64; align = %u; signed = false;\n"
-		"	map = clock.%s.value;\n"
-		"} := uint64_clock_monotonic_t;\n\n",
-		trace_clock_name(),
-		lttng_alignof(uint32_t) * CHAR_BIT,
-		trace_clock_name(),
-		lttng_alignof(uint64_t) * CHAR_BIT,
-		trace_clock_name()
-		);
+	ret = _lttng_clock_types_declare(session, "monotonic",
+			trace_clock_name());
 	if (ret)
 		goto end;
 
-	ret = _lttng_stream_packet_context_declare(session);
+	ret = _lttng_stream_packet_context_declare(session, false);
 	if (ret)
 		goto end;
 
-	ret = _lttng_event_header_declare(session);
+	ret = _lttng_event_header_declare(session, false);
 	if (ret)
 		goto end;
 
+	/* Channels cannot be added once the session has been active. */
+	if (lttng_session_has_coarse_channel(session)) {
+		ret = _lttng_coarse_clock_declare(session);
+		if (ret)
+			goto end;
+	}
+
 skip_session:
 	list_for_each_entry(chan, &session->chan, list) {
 		ret = _lttng_channel_metadata_statedump(session, chan);
@@ -2827,6 +5154,10 @@ static int __init lttng_events_init(void)
 	ret = lttng_tracepoint_init();
 	if (ret)
 		goto error_tp;
+	BUILD_BUG_ON(offsetof(struct lttng_event, has_enablers_without_bytecode)
+			+ sizeof(int) > LTTNG_HOT_FIELDS_MAX_SIZE);
+	BUILD_BUG_ON(offsetof(struct lttng_channel, aggregation)
+			+ sizeof(void *) > LTTNG_HOT_FIELDS_MAX_SIZE);
 	event_cache = KMEM_CACHE(lttng_event, 0);
 	if (!event_cache) {
 		ret = -ENOMEM;
@@ -2841,6 +5172,12 @@ static int __init lttng_events_init(void)
 	ret = lttng_init_cpu_hotplug();
 	if (ret)
 		goto error_hotplug;
+	ret = lttng_probe_profile_init();
+	if (ret)
+		goto error_profile;
+	ret = lttng_memory_stats_init();
+	if (ret)
+		goto error_memory_stats;
 	printk(KERN_NOTICE "LTTng: Loaded modules v%s.%s.%s%s (%s)%s%s\n",
 		__stringify(LTTNG_MODULES_MAJOR_VERSION),
 		__stringify(LTTNG_MODULES_MINOR_VERSION),
@@ -2859,6 +5196,10 @@ static int __init lttng_events_init(void)
 #endif
 	return 0;
 
+error_memory_stats:
+	lttng_probe_profile_exit();
+error_profile:
+	lttng_exit_cpu_hotplug();
 error_hotplug:
 	lttng_logger_exit();
 error_logger:
@@ -2894,12 +5235,20 @@ static void __exit lttng_events_exit(void)
 {
 	struct lttng_session *session, *tmpsession;
 
+	lttng_memory_stats_exit();
+	lttng_probe_profile_exit();
 	lttng_exit_cpu_hotplug();
 	lttng_logger_exit();
 	lttng_abi_exit();
 	list_for_each_entry_safe(session, tmpsession, &sessions, list)
 		lttng_session_destroy(session);
+	lttng_session_teardown_wait();
+	lttng_metadata_fragments_purge(NULL);
 	kmem_cache_destroy(event_cache);
+#ifdef LTTNG_EVENT_FANOUT
+	lttng_event_fanout_exit();
+#endif
+	lttng_probes_exit();
 	lttng_tracepoint_exit();
 	lttng_context_exit();
 	printk(KERN_NOTICE "LTTng: Unloaded modules v%s.%s.%s%s (%s)%s%s\n",
@@ -12,14 +12,24 @@
 
 #include <linux/version.h>
 #include <linux/list.h>
+#include <linux/err.h>
+#include <linux/cache.h>
 #include <linux/kprobes.h>
 #include <linux/kref.h>
+#include <linux/percpu.h>
+#include <linux/cpumask.h>
+#include <linux/timex.h>
+#include <linux/irq_work.h>
+#include <linux/workqueue.h>
+#include <asm/local.h>
 #include <lttng-cpuhotplug.h>
 #include <linux/uuid.h>
 #include <wrapper/uprobes.h>
+#include <wrapper/rcu.h>
 #include <lttng-tracer.h>
 #include <lttng-abi.h>
 #include <lttng-abi-old.h>
+#include <lttng-probe-profile.h>
 
 #define lttng_is_signed_type(type)	(((type)(-1)) < 0)
 
@@ -29,7 +39,10 @@ struct lttng_metadata_cache;
 struct lib_ring_buffer_ctx;
 struct perf_event;
 struct perf_event_attr;
+struct lttng_perf_counter_delta;
+struct lttng_ctx_guard;
 struct lib_ring_buffer_config;
+struct bpf_prog;
 
 /* Type description */
 
@@ -182,13 +195,20 @@ struct lttng_perf_counter_field {
 	struct notifier_block nb;
 	int hp_enable;
 #endif
-	struct perf_event_attr *attr;
-	struct perf_event **e;	/* per-cpu array */
+	unsigned int nr_counters;
+	struct lttng_perf_counter_delta __percpu *delta;	/* NULL: full values */
+	struct perf_event_attr *attr;	/* nr_counters entries */
+	struct perf_event **e;	/* per-cpu array of nr_counters entries */
 };
 
 struct lttng_probe_ctx {
 	struct lttng_event *event;
 	uint8_t interruptible;
+	uint8_t user_truncated;		/* A user field was truncated */
+	uint8_t sampled;		/* Channel sampling done by the probe */
+	uint32_t ratelimit_suppressed;	/* Records suppressed before this one */
+	uint32_t ctx_guard_pass;	/* Context guards passed, by index */
+	const char *filter_stack_data;	/* NULL: payload not prepared */
 };
 
 struct lttng_ctx_field {
@@ -207,6 +227,7 @@ struct lttng_ctx_field {
 		struct lttng_perf_counter_field *perf_counter;
 	} u;
 	void (*destroy)(struct lttng_ctx_field *field);
+	struct lttng_ctx_guard *guard;	/* NULL: recorded in every record */
 	/*
 	 * Private data to keep state between get_size and record.
 	 * User must perform its own synchronization to protect against
@@ -220,16 +241,24 @@ struct lttng_ctx {
 	unsigned int nr_fields;
 	unsigned int allocated_fields;
 	size_t largest_align;	/* in bytes */
+	size_t fixed_size;	/* in bytes, 0: per-record size */
+	size_t packed_fixed_size;	/* fixed_size in packed records */
 };
 
 struct lttng_event_desc {
 	const char *name;		/* lttng-modules name */
 	const char *kname;		/* Linux kernel name (tracepoints) */
 	void *probe_callback;
+	void *fanout_callback;		/* CONFIG_LTTNG_EVENT_FANOUT probe */
 	const struct lttng_event_ctx *ctx;	/* context */
 	const struct lttng_event_field *fields;	/* event payload */
 	unsigned int nr_fields;
 	struct module *owner;
+	/*
+	 * Reserved for an upper bound of its size and shrunk at commit,
+	 * the payload ending with a "_lttng_slack" sequence field.
+	 */
+	unsigned int single_pass:1;
 };
 
 struct lttng_probe_desc {
@@ -251,6 +280,7 @@ enum lttng_event_type {
 struct lttng_filter_bytecode_node {
 	struct list_head node;
 	struct lttng_enabler *enabler;
+	struct bpf_prog *bpf_prog;	/* BPF filter, NULL for bytecode */
 	/*
 	 * struct lttng_kernel_filter_bytecode has var. sized array, must be
 	 * last field.
@@ -258,6 +288,22 @@ struct lttng_filter_bytecode_node {
 	struct lttng_kernel_filter_bytecode bc;
 };
 
+/*
+ * Guard of a channel context: its bytecode, linked to each event of the
+ * channel, is run at reservation, and the context is only recorded if
+ * it records the event. The metadata describes the guarded field as an
+ * enum-tagged variant of an empty struct and of the context type.
+ */
+#define LTTNG_CTX_GUARD_MAX		32
+
+struct lttng_ctx_guard {
+	unsigned int index;		/* Bit in ctx_guard_pass */
+	struct lttng_filter_bytecode_node *bc;
+	struct lttng_event_field field;	/* Guarded field, for the metadata */
+	struct lttng_event_field fields[2];	/* Tag and variant */
+	struct lttng_event_field choices[2];	/* None and context value */
+};
+
 /*
  * Filter return value masks.
  */
@@ -267,14 +313,26 @@ enum lttng_filter_ret {
 	/* Other bits are kept for future use. */
 };
 
+/* One filter run out of LTTNG_FILTER_STATS_SAMPLE_PERIOD is timed. */
+#define LTTNG_FILTER_STATS_SAMPLE_PERIOD	64
+
+struct lttng_filter_stats {
+	uint64_t evaluations;
+	uint64_t accepts;
+	uint64_t samples;
+	uint64_t cycles;	/* Sum over sampled runs */
+};
+
 struct lttng_bytecode_runtime {
 	/* Associated bytecode */
 	struct lttng_filter_bytecode_node *bc;
 	uint64_t (*filter)(void *filter_data, struct lttng_probe_ctx *lttng_probe_ctx,
 			const char *filter_stack_data);
 	int link_failed;
+	int context_only;	/* filter does not read the event payload */
 	struct list_head node;	/* list of bytecode runtime in event */
 	struct lttng_event *event;
+	struct lttng_filter_stats __percpu *stats;	/* or NULL */
 };
 
 /*
@@ -283,32 +341,111 @@ struct lttng_bytecode_runtime {
 struct lttng_enabler_ref {
 	struct list_head node;			/* enabler ref list */
 	struct lttng_enabler *ref;		/* backward ref */
+	struct list_head enabler_node;		/* per-enabler list of refs */
+	struct lttng_event *event;		/* forward ref */
 };
 
+struct lttng_uprobe_site;
+struct lttng_ratelimit;
+struct lttng_breaker;
+struct lttng_gates;
+
 struct lttng_uprobe_handler {
 	struct lttng_event *event;
 	loff_t offset;
-	struct uprobe_consumer up_consumer;
-	struct list_head node;
+	struct lttng_uprobe_site *site;	/* Shared uprobe consumer */
+	struct list_head site_node;	/* Per-site handler list, RCU */
+	struct list_head node;		/* Per-event handler list */
+	atomic_t sample_count;		/* Hits since last period sample */
+	atomic64_t sample_next;		/* Trace clock of next interval sample */
 };
 
 /*
  * lttng_event structure is referred to by the tracing fast path. It must be
  * kept small.
  */
+/*
+ * Bits of lttng_event armed, recomputed with the session lock held
+ * whenever the session, channel or event enable state, or the session
+ * trackers, change. The probe fast path only loads this word from the
+ * event to know whether it should record, and whether the trackers
+ * need to be evaluated.
+ */
+#define LTTNG_EVENT_ARMED		(1UL << 0)	/* Session, channel and event enabled */
+#define LTTNG_EVENT_ARMED_PID_TRACKER	(1UL << 1)	/* Session has a PID tracker */
+#define LTTNG_EVENT_ARMED_ID_TRACKERS	(1UL << 2)	/* Session has id trackers */
+#define LTTNG_EVENT_ARMED_TRIGGER	(1UL << 3)	/* Channel has a trigger */
+#define LTTNG_EVENT_ARMED_COLD		(1UL << 4)	/* Not a hot event of its channel */
+#define LTTNG_EVENT_ARMED_CRITICAL	(1UL << 5)	/* May use the channel critical reserve */
+#define LTTNG_EVENT_ARMED_RATELIMIT	(1UL << 6)	/* Has a rate limit */
+#define LTTNG_EVENT_ARMED_COUNT		(1UL << 7)	/* Counts its hits instead of recording */
+#define LTTNG_EVENT_ARMED_GATE		(1UL << 8)	/* Conditioned on session gates */
+#define LTTNG_EVENT_ARMED_GATE_ACTION	(1UL << 9)	/* Opens or closes session gates */
+#define LTTNG_EVENT_ARMED_COALESCE	(1UL << 10)	/* Coalesces its repeated records */
+#define LTTNG_EVENT_ARMED_LAZY_METADATA	(1UL << 11)	/* Metadata emitted on first record */
+#define LTTNG_EVENT_ARMED_CTX_GUARD	(1UL << 12)	/* Context guards read the payload */
+#define LTTNG_EVENT_ARMED_BREAKER	(1UL << 13)	/* Has a circuit breaker */
+#define LTTNG_EVENT_ARMED_PAUSE		(1UL << 14)	/* Session may be paused */
+
+/* Bits of lttng_event metadata_lazy. */
+#define LTTNG_EVENT_METADATA_HIT	0	/* Recorded in lazy metadata mode */
+#define LTTNG_EVENT_METADATA_QUEUED	1	/* Metadata awaited by a record */
+
+/*
+ * The fields read by the probe fast path are grouped at the beginning
+ * of lttng_event and lttng_channel, within LTTNG_HOT_FIELDS_MAX_SIZE
+ * bytes, so that the fast path layout does not depend on the
+ * instrumentation type. Fields written at runtime by the control path
+ * (enable state, lists) start on a separate cache line.
+ */
+#define LTTNG_HOT_FIELDS_MAX_SIZE	64
+
 struct lttng_event {
+	/* Hot fields, read by the probe fast path. */
 	enum lttng_event_type evtype;	/* First field. */
 	unsigned int id;
+	unsigned long armed;		/* LTTNG_EVENT_ARMED* bits */
 	struct lttng_channel *chan;
-	int enabled;
+	struct lttng_ctx *ctx;
+	/* list of struct lttng_bytecode_runtime, sorted by seqnum */
+	struct list_head bytecode_runtime_head;
+	/* Union of the enabled runtimes as a single program, RCU, or NULL */
+	struct lttng_bytecode_runtime *fused_filter;
+	int has_enablers_without_bytecode;
+
+	/* Cold fields. */
+	int enabled ____cacheline_aligned_in_smp;
+	int critical;			/* Flagged critical, or by an enabler */
+	struct lttng_ratelimit *ratelimit;	/* or NULL */
+	struct lttng_breaker *breaker;	/* or NULL */
+	int count_only;			/* Set directly, or by its enablers */
+	int coalesce;			/* Set directly, or by its enablers */
+	/* Hits counted while in count-only mode, or NULL if never in it */
+	u64 __percpu *hit_count;
+	struct {
+		enum lttng_kernel_gate_scope scope;
+		u32 cond, open, close;	/* Session gates bitmasks */
+	} gate;				/* Set by its enablers */
 	const struct lttng_event_desc *desc;
 	void *filter;
-	struct lttng_ctx *ctx;
+	/* Statistics of the fused filters replaced since event creation */
+	struct lttng_filter_stats fused_filter_stats;
+	/* list of struct lttng_bytecode_runtime of the context guards */
+	struct list_head ctx_guard_runtime_head;
+	int ctx_guard_payload;		/* A context guard reads the payload */
+#ifdef LTTNG_PROBE_PROFILE
+	struct lttng_probe_profile __percpu *profile;	/* or NULL */
+	struct list_head profile_node;	/* Profiled events list */
+#endif
 	enum lttng_kernel_instrumentation instrumentation;
 	union {
 		struct {
 			struct kprobe kp;
 			char *symbol_name;
+			/* Probes of a symbol list, or NULL */
+			struct lttng_kprobe_bulk *bulk;
+			/* Argument fetch program, or NULL */
+			struct lttng_kprobe_fetch *fetch;
 		} kprobe;
 		struct {
 			struct lttng_krp *lttng_krp;
@@ -317,23 +454,54 @@ struct lttng_event {
 		struct {
 			char *symbol_name;
 		} ftrace;
+		struct {
+			struct lttng_fentry *lttng_fentry;
+			char *symbol_name;
+		} fentry;
+		struct {
+			struct lttng_fgraph *lttng_fgraph;
+		} fgraph;
+		struct {
+			struct lttng_sampler *lttng_sampler;
+		} sampler;
+		struct {
+			struct lttng_hwtrace_sync *lttng_hwtrace_sync;
+		} hwtrace_sync;
 		struct {
 			struct inode *inode;
 			struct list_head head;
+			unsigned int sample_period;	/* 0, 1: all hits */
+			uint64_t sample_interval;	/* Trace clock units */
 		} uprobe;
 	} u;
 	struct list_head list;		/* Event list in session */
 	unsigned int metadata_dumped:1;
+	unsigned long metadata_lazy;	/* LTTNG_EVENT_METADATA_* bits */
 
 	/* Backward references: list of lttng_enabler_ref (ref to enablers) */
 	struct list_head enablers_ref_head;
 	struct hlist_node hlist;	/* session ht of events */
 	int registered;			/* has reg'd tracepoint probe */
-	/* list of struct lttng_bytecode_runtime, sorted by seqnum */
-	struct list_head bytecode_runtime_head;
-	int has_enablers_without_bytecode;
+	struct lttng_event_fanout *fanout;	/* fan-out group, or NULL */
+	struct list_head fanout_node;	/* fan-out group list of events, RCU */
+} ____cacheline_aligned_in_smp;
+
+/*
+ * Fan-out group of the events of a tracepoint, registered as data of the
+ * fan-out probe in their place with CONFIG_LTTNG_EVENT_FANOUT.
+ */
+struct lttng_event_fanout {
+	const struct lttng_event_desc *desc;
+	struct list_head events;	/* list of struct lttng_event, RCU */
+	struct list_head node;		/* fan-out groups list */
 };
 
+#ifdef LTTNG_PROBE_PROFILE
+#define lttng_event_profile(event)	((event)->profile)
+#else
+#define lttng_event_profile(event)	((struct lttng_probe_profile __percpu *) NULL)
+#endif
+
 enum lttng_enabler_type {
 	LTTNG_ENABLER_STAR_GLOB,
 	LTTNG_ENABLER_NAME,
@@ -351,11 +519,23 @@ struct lttng_enabler {
 	struct list_head node;	/* per-session list of enablers */
 	/* head list of struct lttng_ust_filter_bytecode_node */
 	struct list_head filter_bytecode_head;
+	/* head list of struct lttng_enabler_ref, of the events enabled */
+	struct list_head events_ref_head;
 
 	struct lttng_kernel_event event_param;
 	struct lttng_channel *chan;
 	struct lttng_ctx *ctx;
-	unsigned int enabled:1;
+	unsigned int enabled:1,
+		critical:1,		/* Flags its events critical */
+		count_only:1,		/* Counts the hits of its events */
+		coalesce:1,		/* Coalesces repeated records of its events */
+		syscall_lazy:1;		/* Syscall events created on first hit */
+	/* Rate limit of its events, if rate is not 0 */
+	struct lttng_kernel_event_ratelimit ratelimit;
+	/* Circuit breaker of its events, if a budget is not 0 */
+	struct lttng_kernel_event_breaker breaker;
+	/* Session gates of its events, if any mask is not 0 */
+	struct lttng_kernel_event_gate gate;
 };
 
 struct lttng_channel_ops {
@@ -364,8 +544,27 @@ struct lttng_channel_ops {
 				void *buf_addr,
 				size_t subbuf_size, size_t num_subbuf,
 				unsigned int switch_timer_interval,
-				unsigned int read_timer_interval);
+				unsigned int read_timer_interval,
+				unsigned int read_timer_max_interval,
+				enum lttng_kernel_numa_policy numa_policy,
+				int numa_node, uint32_t flags,
+				const struct cpumask *cpu_mask);
 	void (*channel_destroy)(struct channel *chan);
+	int (*channel_resize)(struct channel *chan, size_t subbuf_size,
+			size_t num_subbuf);
+	/* Optional: NULL for channels which do not support it. */
+	int (*channel_set_critical_reserve)(struct channel *chan,
+			unsigned int pct);
+	int (*channel_set_blocking_timeout)(struct channel *chan,
+			unsigned int timeout_us);
+	int (*channel_set_live_latency)(struct channel *chan,
+			unsigned int latency_us);
+	int (*channel_set_writer_barrier)(struct channel *chan, int enable);
+	/* Optional: NULL for channels which do not support it. */
+	void (*event_coalesce_flush)(struct channel *chan);
+	/* Optional: NULL for channels which do not support it. */
+	int (*channel_flush)(struct channel *chan, int empty,
+			uint64_t *seq_num);
 	struct lib_ring_buffer *(*buffer_read_open)(struct channel *chan);
 	int (*buffer_has_read_closed_stream)(struct channel *chan);
 	void (*buffer_read_close)(struct lib_ring_buffer *buf);
@@ -382,6 +581,17 @@ struct lttng_channel_ops {
 			     size_t len);
 	void (*event_strcpy_from_user)(struct lib_ring_buffer_ctx *ctx,
 				       const char __user *src, size_t len);
+	/*
+	 * Single-pass serialization: bounded string copies return the
+	 * size written, and event_shrink ends the payload with its slack
+	 * field before commit. NULL for the metadata channel, which
+	 * has no events.
+	 */
+	size_t (*event_strscpy)(struct lib_ring_buffer_ctx *ctx,
+				const char *src, size_t len);
+	size_t (*event_strscpy_from_user)(struct lib_ring_buffer_ctx *ctx,
+					  const char __user *src, size_t len);
+	void (*event_shrink)(struct lib_ring_buffer_ctx *ctx);
 	/*
 	 * packet_avail_size returns the available size in the current
 	 * packet. Note that the size returned is only a hint, since it
@@ -390,6 +600,12 @@ struct lttng_channel_ops {
 	size_t (*packet_avail_size)(struct channel *chan);
 	wait_queue_head_t *(*get_writer_buf_wait_queue)(struct channel *chan, int cpu);
 	wait_queue_head_t *(*get_hp_wait_queue)(struct channel *chan);
+	/*
+	 * Channel-level readiness of the streams. Optional: NULL for
+	 * channels which do not support it.
+	 */
+	wait_queue_head_t *(*get_read_wait_queue)(struct channel *chan);
+	int (*get_ready_cpus)(struct channel *chan, struct cpumask *ready);
 	int (*is_finalized)(struct channel *chan);
 	int (*is_disabled)(struct channel *chan);
 	int (*timestamp_begin) (const struct lib_ring_buffer_config *config,
@@ -429,6 +645,11 @@ struct lttng_transport {
 };
 
 struct lttng_syscall_filter;
+struct lttng_syscall_dispatch;
+struct lttng_syscall_latency;
+struct lttng_syscall_pid_masks;
+struct lttng_syscall_summary;
+struct lttng_syscall_lazy;
 
 #define LTTNG_EVENT_HT_BITS		12
 #define LTTNG_EVENT_HT_SIZE		(1U << LTTNG_EVENT_HT_BITS)
@@ -437,18 +658,88 @@ struct lttng_event_ht {
 	struct hlist_head table[LTTNG_EVENT_HT_SIZE];
 };
 
+/*
+ * Per-cpu state of channel event sampling.
+ */
+struct lttng_channel_sampling {
+	local_t count;			/* Events seen since last recorded */
+	local_t skipped;		/* Events sampled out since trace start */
+};
+
+/*
+ * Per-cpu split of the records lost by a channel between the first
+ * LTTNG_LOST_SUMMARY_SLOTS event IDs losing records on the cpu, written
+ * in the packet context. Not reset, like events_discarded.
+ */
+#define LTTNG_LOST_SUMMARY_SLOTS	4
+
+struct lttng_channel_lost {
+	unsigned int id[LTTNG_LOST_SUMMARY_SLOTS];	/* Event ID + 1, 0: free */
+	local_t count[LTTNG_LOST_SUMMARY_SLOTS];	/* Records lost */
+};
+
+/*
+ * Per-cpu run of repeated records of an event in coalesce mode: the
+ * record kept in the buffer, and the repeats discarded after it, see
+ * the ring buffer client. Only used by the outermost record of the cpu.
+ */
+struct lttng_channel_coalesce {
+	struct lib_ring_buffer *buf;	/* Buffer of the kept record, NULL: none */
+	unsigned long end;		/* Offset following the kept record */
+	unsigned long begin;		/* Contexts of the record being written */
+	size_t len;			/* Length of its contexts and payload */
+	u32 hash;			/* Hash of its contexts and payload */
+	uint32_t id;			/* Event ID of the kept record */
+	u64 count;			/* Repeats discarded since */
+	u64 last_tsc;			/* Timestamp of the last repeat */
+};
+
+struct lttng_aggregation_map;
+struct lttng_channel_trigger;
+struct lttng_snapshot_area;
+struct lttng_statedump_shadow;
+struct lttng_metadata_fragment;
+struct lttng_fentry;
+struct lttng_fgraph;
+struct lttng_sampler;
+struct lttng_hwtrace_sync;
+struct lttng_kprobe_bulk;
+struct lttng_kprobe_fetch;
+struct lttng_compress_buf;
+struct lttng_pool;
+
+/*
+ * Event IDs below 31 fit in the compact event header, 31 being the
+ * escape to the extended header.
+ */
+#define LTTNG_NR_HOT_EVENTS	31
+
 struct lttng_channel {
-	unsigned int id;
+	/* Hot fields, read by the probe and ring buffer client fast paths. */
 	struct channel *chan;		/* Channel buffers */
-	int enabled;
+	struct lttng_channel_ops *ops;
 	struct lttng_ctx *ctx;
-	/* Event ID management */
 	struct lttng_session *session;
-	struct file *file;		/* File associated to channel */
-	unsigned int free_event_id;	/* Next event ID to allocate */
-	struct list_head list;		/* Channel list */
-	struct lttng_channel_ops *ops;
-	struct lttng_transport *transport;
+	unsigned int id;
+	int header_type;		/* 0: unset, 1: compact, 2: large, 3: delta */
+	int packed;			/* Records without alignment padding */
+	int coarse_clock;		/* Timestamps from the coarse clock */
+	size_t user_capture_max;	/* Bytes per user field, 0: unlimited */
+	unsigned int sampling_period;	/* 0 or 1: record all events */
+	struct lttng_channel_sampling __percpu *sampling;
+	struct lttng_aggregation_map *aggregation;	/* NULL: record events */
+
+	/* Syscall tracing fast path. */
+	struct lttng_syscall_dispatch *sc_dispatch ____cacheline_aligned_in_smp;
+	struct lttng_syscall_dispatch *compat_sc_dispatch;
+	struct lttng_syscall_dispatch *sc_exit_dispatch;
+	struct lttng_syscall_dispatch *compat_sc_exit_dispatch;
+	struct lttng_syscall_filter *sc_filter;
+	struct lttng_syscall_latency *sc_latency;	/* NULL: entry and exit records */
+	struct lttng_syscall_pid_masks *sc_pid_masks;	/* NULL: no per-process mask */
+	struct lttng_syscall_summary *sc_summary;	/* NULL: syscalls recorded */
+	struct lttng_syscall_lazy *sc_lazy;	/* NULL: no star-glob enabler */
+	struct list_head sc_node;	/* Syscall probes channel list, RCU */
 	struct lttng_event **sc_table;	/* for syscall tracing */
 	struct lttng_event **compat_sc_table;
 	struct lttng_event **sc_exit_table;	/* for syscall exit tracing */
@@ -457,15 +748,43 @@ struct lttng_channel {
 	struct lttng_event *sc_compat_unknown;
 	struct lttng_event *sc_exit_unknown;
 	struct lttng_event *compat_sc_exit_unknown;
-	struct lttng_syscall_filter *sc_filter;
-	int header_type;		/* 0: unset, 1: compact, 2: large */
+
+	/* Cold fields. */
+	int enabled ____cacheline_aligned_in_smp;
+	/* Event ID management */
+	struct file *file;		/* File associated to channel */
+	unsigned int free_event_id;	/* Next event ID to allocate */
+	/* Names owning event IDs [0, nr_hot_events), see LTTNG_NR_HOT_EVENTS */
+	char (*hot_events)[LTTNG_KERNEL_SYM_NAME_LEN];
+	unsigned int nr_hot_events;
+	struct list_head list;		/* Channel list */
+	struct lttng_transport *transport;
 	enum channel_type channel_type;
+	struct lttng_compress_buf **compress;	/* Per-cpu, NULL: no compression */
+	struct lttng_channel_trigger *trigger;	/* NULL: no trigger */
+	/* Trace clock, sub-buffers ending before it are not read, 0: none */
+	uint64_t window_start;
+	struct lttng_snapshot_area *snapshot_area;	/* NULL: none */
+	/* Snapshot range: trace clock lower bound, 0: none */
+	uint64_t snapshot_begin;
+	struct cpumask *snapshot_cpus;	/* NULL: all cpus */
+	struct lttng_channel_lost __percpu *lost;
+	struct lttng_channel_coalesce __percpu *coalesce;
+	/* Channel owning the buffers of this shared channel, or NULL */
+	struct lttng_channel *shared;
+	struct lttng_pool *pool;	/* NULL: streams read by the consumer */
 	unsigned int metadata_dumped:1,
-		sys_enter_registered:1,
-		sys_exit_registered:1,
+		sc_listed:1,		/* On the syscall probes channel list */
 		syscall_all:1,
 		tstate:1;		/* Transient enable state */
-};
+} ____cacheline_aligned_in_smp;
+
+/* Channel owning the buffers a channel records into. */
+static inline
+struct lttng_channel *lttng_channel_owner(struct lttng_channel *chan)
+{
+	return chan->shared ? chan->shared : chan;
+}
 
 struct lttng_metadata_stream {
 	void *priv;			/* Ring buffer private data */
@@ -488,6 +807,29 @@ struct lttng_dynamic_len_stack {
 
 DECLARE_PER_CPU(struct lttng_dynamic_len_stack, lttng_dynamic_len_stack);
 
+/* Sequence field source of lttng_event_table_serialize(). */
+struct lttng_event_table_seq {
+	const void *ptr;
+	size_t len;			/* elements, bytes for bitfields */
+};
+
+void lttng_event_table_serialize(struct lttng_probe_ctx *probe_ctx,
+		const size_t *offsets, const void *src);
+
+/* Channel of the fan-out probes, writing into the scratch buffer. */
+struct lttng_event_fanout_chan {
+	const struct lttng_channel_ops *ops;
+};
+
+extern const struct lttng_event_fanout_chan lttng_event_fanout_chan;
+
+void *lttng_event_fanout_scratch_get(size_t len);
+void lttng_event_fanout_scratch_put(void *scratch);
+int lttng_event_fanout_register(struct lttng_event *event);
+int lttng_event_fanout_unregister(struct lttng_event *event);
+void lttng_event_fanout_free_released(void);
+void lttng_event_fanout_exit(void);
+
 /*
  * struct lttng_pid_tracker declared in header due to deferencing of *v
  * in RCU_INITIALIZER(v).
@@ -495,8 +837,18 @@ DECLARE_PER_CPU(struct lttng_dynamic_len_stack, lttng_dynamic_len_stack);
 #define LTTNG_PID_HASH_BITS	6
 #define LTTNG_PID_TABLE_SIZE	(1 << LTTNG_PID_HASH_BITS)
 
+/*
+ * Bitmap of tracked PIDs used for lookups, resized on demand. The hash
+ * table is kept for duplicate detection and for listing tracked PIDs.
+ */
+struct lttng_pid_bitmap {
+	unsigned int nr_bits;
+	unsigned long bits[];
+};
+
 struct lttng_pid_tracker {
 	struct hlist_head pid_hash[LTTNG_PID_TABLE_SIZE];
+	struct lttng_pid_bitmap *bitmap;
 };
 
 struct lttng_pid_hash_node {
@@ -504,9 +856,32 @@ struct lttng_pid_hash_node {
 	int pid;
 };
 
+enum lttng_tracker_type {
+	LTTNG_TRACKER_CGROUP = 0,
+	LTTNG_TRACKER_PID_NS,
+	LTTNG_TRACKER_NET_NS,
+	LTTNG_TRACKER_UID,
+	LTTNG_TRACKER_GID,
+	NR_LTTNG_TRACKER_TYPES,
+};
+
+#define LTTNG_ID_HASH_BITS	6
+#define LTTNG_ID_TABLE_SIZE	(1 << LTTNG_ID_HASH_BITS)
+
+struct lttng_id_tracker {
+	struct hlist_head id_hash[LTTNG_ID_TABLE_SIZE];
+};
+
+struct lttng_id_hash_node {
+	struct hlist_node hlist;
+	uint64_t id;
+};
+
 struct lttng_session {
+	struct mutex lock;		/* Session state, in sessions_mutex */
 	int active;			/* Is trace session active ? */
 	int been_active;		/* Has trace session been active ? */
+	int paused;			/* Is active trace session paused ? */
 	struct file *file;		/* File associated to session */
 	struct list_head chan;		/* Channel list head */
 	struct list_head events;	/* Event list head */
@@ -515,29 +890,92 @@ struct lttng_session {
 	uuid_le uuid;			/* Trace session unique ID */
 	struct lttng_metadata_cache *metadata_cache;
 	struct lttng_pid_tracker *pid_tracker;
+	struct lttng_id_tracker *id_trackers[NR_LTTNG_TRACKER_TYPES];
+	unsigned long id_tracker_mask;	/* Bit set for each id tracker */
+	/* Incremental statedump state, owned by lttng-statedump. */
+	struct lttng_statedump_shadow *statedump_shadow;
+	struct lttng_gates *gates;	/* Allocated on first use, RCU */
+	unsigned int statedump_mask;	/* LTTNG_KERNEL_STATEDUMP_* */
 	unsigned int metadata_dumped:1,
-		tstate:1;		/* Transient enable state */
+		tstate:1,		/* Transient enable state */
+		statedump_incremental:1,
+		sync_deferred:1,	/* Enabler sync deferred by a batch */
+		metadata_binary:1,	/* Binary payload declarations */
+		lazy_metadata:1,	/* Event metadata on first record */
+		pausable:1;		/* Has been paused */
+	/* Events recorded in lazy metadata mode awaiting their metadata */
+	atomic_t metadata_pending;
+	struct irq_work metadata_irq_work;	/* Leaves the tracing context */
+	struct work_struct metadata_work;	/* Emits the lazy metadata */
+	struct irq_work breaker_irq_work;	/* Leaves the tracing context */
+	struct work_struct breaker_work;	/* Disarms the tripped events */
+	struct delayed_work breaker_reset_work;	/* Rearms them after cooldown */
+	/* Shared metadata fragment being generated, or NULL */
+	struct lttng_metadata_fragment *metadata_capture;
 	/* List of enablers */
 	struct list_head enablers_head;
 	/* Hash table of events */
 	struct lttng_event_ht events_ht;
 };
 
+/*
+ * The metadata cache is made of fixed-size chunks, so that it grows
+ * without moving the metadata already written.
+ */
+#define LTTNG_METADATA_CACHE_CHUNK_SIZE	PAGE_SIZE
+
 struct lttng_metadata_cache {
-	char *data;			/* Metadata cache */
-	unsigned int cache_alloc;	/* Metadata allocated size (bytes) */
+	char **chunks;			/* Metadata cache chunks */
+	unsigned int nr_chunks;		/* Number of chunks allocated */
+	unsigned int chunks_alloc;	/* Size of the chunks array */
 	unsigned int metadata_written;	/* Number of bytes written in metadata cache */
 	struct kref refcount;		/* Metadata cache usage */
 	struct list_head metadata_stream;	/* Metadata stream list */
 	uuid_le uuid;			/* Trace session unique ID (copy) */
 	struct mutex lock;		/* Produce/consume lock */
 	uint64_t version;		/* Current version of the metadata */
+	wait_queue_head_t map_wait;	/* Cache mappings: appends and regen */
+};
+
+/* Metadata being generated outside of a metadata cache. */
+struct lttng_metadata_buf {
+	char *data;
+	size_t len, alloc;
+};
+
+int lttng_metadata_buf_append(struct lttng_metadata_buf *buf,
+		const void *src, size_t len);
+int lttng_metadata_binary_encode_event(struct lttng_metadata_buf *buf,
+		const struct lttng_event_desc *desc, int packed);
+
+/* Binary event listing being copied to user-space. */
+struct lttng_event_list_writer {
+	char __user *ubuf;
+	uint64_t avail;			/* Size of the user-space buffer */
+	uint64_t len;			/* Size of the list */
+	uint32_t nr_entries;		/* Entries copied */
+	uint32_t flags;			/* LTTNG_KERNEL_EVENT_LIST_* */
+	int full;			/* An entry did not fit */
+	struct lttng_metadata_buf entry;
 };
 
+int lttng_event_list_append(struct lttng_event_list_writer *writer,
+		const struct lttng_event_desc *desc, const char *name,
+		uint32_t index, uint32_t bitness);
+int lttng_probes_list_binary(struct lttng_event_list_writer *writer);
+
 void lttng_lock_sessions(void);
+int lttng_trylock_sessions(void);
 void lttng_unlock_sessions(void);
+void lttng_lock_session(struct lttng_session *session);
+void lttng_unlock_session(struct lttng_session *session);
 
+struct list_head *lttng_get_sessions_list_head(void);
 struct list_head *lttng_get_probe_list_head(void);
+void lttng_metadata_fragments_purge(const struct lttng_probe_desc *probe_desc);
+int lttng_probes_match_prefix(const char *prefix, size_t len,
+		const struct lttng_event_desc * const **descs, size_t *nr);
+void lttng_probes_load_matching(const char *name);
 
 struct lttng_enabler *lttng_enabler_create(enum lttng_enabler_type type,
 		struct lttng_kernel_event *event_param,
@@ -545,16 +983,47 @@ struct lttng_enabler *lttng_enabler_create(enum lttng_enabler_type type,
 
 int lttng_enabler_enable(struct lttng_enabler *enabler);
 int lttng_enabler_disable(struct lttng_enabler *enabler);
+int lttng_enabler_set_critical(struct lttng_enabler *enabler, int critical);
+int lttng_enabler_set_ratelimit(struct lttng_enabler *enabler,
+		const struct lttng_kernel_event_ratelimit *param);
+int lttng_enabler_set_breaker(struct lttng_enabler *enabler,
+		const struct lttng_kernel_event_breaker *param);
+int lttng_enabler_set_count_only(struct lttng_enabler *enabler, int count_only);
+int lttng_enabler_set_coalesce(struct lttng_enabler *enabler, int coalesce);
+int lttng_enabler_set_gate(struct lttng_enabler *enabler,
+		const struct lttng_kernel_event_gate *param);
+int lttng_enabler_hit_count(struct lttng_enabler *enabler,
+		struct lttng_kernel_event_hit_count *hit_count);
 int lttng_fix_pending_events(void);
+void lttng_session_fix_pending_events(struct lttng_session *session);
+int lttng_desc_match_enabler(const struct lttng_event_desc *desc,
+		struct lttng_enabler *enabler);
 int lttng_session_active(void);
 
 struct lttng_session *lttng_session_create(void);
 int lttng_session_enable(struct lttng_session *session);
 int lttng_session_disable(struct lttng_session *session);
 void lttng_session_destroy(struct lttng_session *session);
+void lttng_session_teardown_wait(void);
 int lttng_session_metadata_regenerate(struct lttng_session *session);
+int lttng_session_clear(struct lttng_session *session);
+int lttng_session_pause(struct lttng_session *session, uint32_t flags);
+int lttng_session_resume(struct lttng_session *session);
+void lttng_session_config_begin(struct lttng_session *session);
+void lttng_session_config_end(struct lttng_session *session);
 int lttng_session_statedump(struct lttng_session *session);
+void lttng_session_update_armed(struct lttng_session *session);
+int lttng_session_set_statedump_mode(struct lttng_session *session,
+		enum lttng_kernel_statedump_mode mode);
+int lttng_session_set_statedump_mask(struct lttng_session *session,
+		uint32_t mask);
+int lttng_session_set_metadata_format(struct lttng_session *session,
+		enum lttng_kernel_metadata_format format);
+int lttng_session_set_lazy_metadata(struct lttng_session *session,
+		int lazy);
+void lttng_event_metadata_queue(struct lttng_event *event);
 void metadata_cache_destroy(struct kref *kref);
+int lttng_metadata_cache_map_create(struct lttng_metadata_cache *cache);
 
 struct lttng_channel *lttng_channel_create(struct lttng_session *session,
 				       const char *transport_name,
@@ -562,7 +1031,13 @@ struct lttng_channel *lttng_channel_create(struct lttng_session *session,
 				       size_t subbuf_size, size_t num_subbuf,
 				       unsigned int switch_timer_interval,
 				       unsigned int read_timer_interval,
+				       unsigned int read_timer_max_interval,
+				       enum lttng_kernel_numa_policy numa_policy,
+				       int numa_node,
+				       uint32_t flags,
+				       const struct cpumask *cpu_mask,
 				       enum channel_type channel_type);
+struct lttng_channel *lttng_channel_create_shared(struct lttng_channel *owner);
 struct lttng_channel *lttng_global_channel_create(struct lttng_session *session,
 				       int overwrite, void *buf_addr,
 				       size_t subbuf_size, size_t num_subbuf,
@@ -587,8 +1062,98 @@ struct lttng_event *lttng_event_compat_old_create(struct lttng_channel *chan,
 
 int lttng_channel_enable(struct lttng_channel *channel);
 int lttng_channel_disable(struct lttng_channel *channel);
+int lttng_channel_set_sampling(struct lttng_channel *channel,
+		uint32_t period);
+int lttng_channel_add_hot_event(struct lttng_channel *channel,
+		const char *name);
+int lttng_channel_resize(struct lttng_channel *channel,
+		uint64_t subbuf_size, uint64_t num_subbuf);
+int lttng_channel_set_critical_reserve(struct lttng_channel *channel,
+		uint32_t reserve_pct);
+int lttng_channel_set_blocking_timeout(struct lttng_channel *channel,
+		uint32_t timeout_us);
+int lttng_channel_set_live_latency(struct lttng_channel *channel,
+		uint32_t latency_us);
+int lttng_channel_set_reader_barrier(struct lttng_channel *channel,
+		enum lttng_kernel_reader_barrier barrier);
+int lttng_channel_set_user_capture(struct lttng_channel *channel,
+		uint32_t max_len);
+int lttng_channel_flush(struct lttng_channel *channel, int empty,
+		uint64_t *seq_num);
+int lttng_channel_set_header_type(struct lttng_channel *channel,
+		uint32_t type);
+int lttng_channel_set_pool(struct lttng_channel *channel,
+		uint64_t num_subbuf);
+
+int lttng_channel_aggregation_create(struct lttng_channel *chan,
+		struct lttng_kernel_aggregation *param);
+void lttng_channel_aggregation_destroy(struct lttng_channel *chan);
+int lttng_channel_trigger_create(struct lttng_channel *chan,
+		struct file *target_file, uint64_t window);
+void lttng_channel_trigger_fire(struct lttng_channel *chan);
+int lttng_channel_snapshot_area_create(struct lttng_channel *chan);
+void lttng_channel_snapshot_area_destroy(struct lttng_channel *chan);
+int lttng_stream_snapshot_copy(struct lib_ring_buffer *buf,
+		struct lttng_kernel_snapshot_copy *copy);
+int lttng_channel_set_snapshot_range(struct lttng_channel *chan,
+		uint64_t begin, const struct cpumask *cpus);
+int lttng_stream_snapshot_range(struct lib_ring_buffer *buf,
+		unsigned long *consumed, unsigned long produced);
+int lttng_channel_pool_create(struct lttng_channel *chan,
+		struct lttng_transport *transport, uint64_t num_subbuf);
+void lttng_channel_pool_flush(struct lttng_channel *chan);
+struct lib_ring_buffer *lttng_channel_pool_read_open(struct lttng_channel *chan,
+		int node);
+void lttng_channel_pool_destroy(struct lttng_channel *chan);
+size_t lttng_channel_pool_mem_usage(struct lttng_channel *chan,
+		size_t *data_bytes);
+void lttng_aggregation_update(struct lttng_aggregation_map *map,
+		struct lttng_probe_ctx *probe_ctx,
+		uint32_t event_id, int cpu);
+
+int lttng_channel_set_compression(struct lttng_channel *chan,
+		struct lttng_kernel_channel_compression *param);
+void lttng_channel_compression_destroy(struct lttng_channel *chan);
+int lttng_compress_get_size(struct lib_ring_buffer *buf, uint64_t *size);
+int lttng_compress_read(struct lib_ring_buffer *buf,
+		struct lttng_kernel_compressed_subbuf *param);
+int lttng_stream_get_packet_desc(struct lib_ring_buffer *buf,
+		struct lttng_kernel_packet_desc *desc);
+int lttng_stream_writer_start(struct file *stream_file,
+		struct lttng_kernel_stream_writer *param);
+int lttng_stream_writer_stop(struct lib_ring_buffer *buf);
+bool lttng_stream_writer_attached(struct lib_ring_buffer *buf);
 int lttng_event_enable(struct lttng_event *event);
 int lttng_event_disable(struct lttng_event *event);
+int lttng_event_set_critical(struct lttng_event *event, int critical);
+int lttng_event_set_ratelimit(struct lttng_event *event,
+		const struct lttng_kernel_event_ratelimit *param);
+int lttng_event_set_breaker(struct lttng_event *event,
+		const struct lttng_kernel_event_breaker *param);
+int lttng_event_set_count_only(struct lttng_event *event, int count_only);
+int lttng_event_set_coalesce(struct lttng_event *event, int coalesce);
+int lttng_event_hit_count(struct lttng_event *event,
+		struct lttng_kernel_event_hit_count *hit_count);
+
+int lttng_ratelimit_validate(const struct lttng_kernel_event_ratelimit *param,
+		int *key_index);
+int lttng_ratelimit_set(struct lttng_ratelimit **rlp,
+		const struct lttng_kernel_event_ratelimit *param);
+void lttng_ratelimit_destroy(struct lttng_ratelimit *rl);
+bool lttng_ratelimit_enabled(struct lttng_ratelimit *rl);
+bool lttng_ratelimit_check(struct lttng_ratelimit *rl,
+		struct lttng_probe_ctx *probe_ctx, int cpu);
+
+int lttng_breaker_validate(const struct lttng_kernel_event_breaker *param);
+int lttng_breaker_set(struct lttng_breaker **brp,
+		const struct lttng_kernel_event_breaker *param, bool reset);
+void lttng_breaker_reset(struct lttng_breaker *br);
+void lttng_breaker_destroy(struct lttng_breaker *br);
+bool lttng_breaker_enabled(struct lttng_breaker *br);
+bool lttng_breaker_disarmed(struct lttng_breaker *br);
+bool lttng_breaker_check(struct lttng_event *event, int cpu);
+void lttng_session_breaker_init(struct lttng_session *session);
+void lttng_session_breaker_teardown(struct lttng_session *session);
 
 void lttng_transport_register(struct lttng_transport *transport);
 void lttng_transport_unregister(struct lttng_transport *transport);
@@ -619,22 +1184,55 @@ int lttng_pid_tracker_del(struct lttng_pid_tracker *lpf, int pid);
 int lttng_session_track_pid(struct lttng_session *session, int pid);
 int lttng_session_untrack_pid(struct lttng_session *session, int pid);
 
+struct lttng_id_tracker *lttng_id_tracker_create(void);
+void lttng_id_tracker_destroy(struct lttng_id_tracker *lit);
+int lttng_id_tracker_add(struct lttng_id_tracker *lit, uint64_t id);
+int lttng_id_tracker_del(struct lttng_id_tracker *lit, uint64_t id);
+bool lttng_id_trackers_match(struct lttng_session *session);
+
+bool lttng_gates_match(struct lttng_event *event);
+void lttng_gates_act(struct lttng_event *event);
+int lttng_gate_validate(const struct lttng_kernel_event_gate *param);
+int lttng_session_gates_create(struct lttng_session *session);
+void lttng_session_gates_reset(struct lttng_session *session);
+void lttng_session_gates_destroy(struct lttng_session *session);
+
+void lttng_coalesce_record(struct lttng_channel *chan, uint32_t id,
+		u64 count, u64 last_tsc);
+void lttng_channel_coalesce_flush(struct lttng_channel *chan);
+
+int lttng_session_track_id(struct lttng_session *session,
+		enum lttng_tracker_type type, int64_t id);
+int lttng_session_untrack_id(struct lttng_session *session,
+		enum lttng_tracker_type type, int64_t id);
+
 int lttng_session_list_tracker_pids(struct lttng_session *session);
 
 void lttng_clock_ref(void);
 void lttng_clock_unref(void);
 
 #if defined(CONFIG_HAVE_SYSCALL_TRACEPOINTS)
-int lttng_syscalls_register(struct lttng_channel *chan, void *filter);
+int lttng_syscalls_register(struct lttng_channel *chan,
+		struct lttng_enabler *enabler);
 int lttng_syscalls_unregister(struct lttng_channel *chan);
+void lttng_syscalls_destroy(struct lttng_channel *chan);
 int lttng_syscall_filter_enable(struct lttng_channel *chan,
 		const char *name);
 int lttng_syscall_filter_disable(struct lttng_channel *chan,
 		const char *name);
 long lttng_channel_syscall_mask(struct lttng_channel *channel,
 		struct lttng_kernel_syscall_mask __user *usyscall_mask);
+int lttng_channel_set_syscall_latency(struct lttng_channel *chan,
+		struct lttng_kernel_syscall_latency *param);
+long lttng_channel_pid_syscall_mask(struct lttng_channel *chan,
+		struct lttng_kernel_pid_syscall_mask __user *umask);
+int lttng_channel_set_syscall_summary(struct lttng_channel *chan,
+		struct lttng_kernel_syscall_summary *param);
+void lttng_syscall_summary_flush(struct lttng_channel *chan);
+int lttng_syscalls_list_binary(struct lttng_event_list_writer *writer);
 #else
-static inline int lttng_syscalls_register(struct lttng_channel *chan, void *filter)
+static inline int lttng_syscalls_register(struct lttng_channel *chan,
+		struct lttng_enabler *enabler)
 {
 	return -ENOSYS;
 }
@@ -644,6 +1242,10 @@ static inline int lttng_syscalls_unregister(struct lttng_channel *chan)
 	return 0;
 }
 
+static inline void lttng_syscalls_destroy(struct lttng_channel *chan)
+{
+}
+
 static inline int lttng_syscall_filter_enable(struct lttng_channel *chan,
 		const char *name)
 {
@@ -661,13 +1263,71 @@ static inline long lttng_channel_syscall_mask(struct lttng_channel *channel,
 {
 	return -ENOSYS;
 }
+
+static inline int lttng_channel_set_syscall_latency(struct lttng_channel *chan,
+		struct lttng_kernel_syscall_latency *param)
+{
+	return -ENOSYS;
+}
+
+static inline long lttng_channel_pid_syscall_mask(struct lttng_channel *chan,
+		struct lttng_kernel_pid_syscall_mask __user *umask)
+{
+	return -ENOSYS;
+}
+
+static inline int lttng_channel_set_syscall_summary(struct lttng_channel *chan,
+		struct lttng_kernel_syscall_summary *param)
+{
+	return -ENOSYS;
+}
+
+static inline void lttng_syscall_summary_flush(struct lttng_channel *chan)
+{
+}
+
+static inline int lttng_syscalls_list_binary(struct lttng_event_list_writer *writer)
+{
+	return -ENOSYS;
+}
 #endif
 
 void lttng_filter_sync_state(struct lttng_bytecode_runtime *runtime);
+void lttng_filter_event_fuse_bytecode(struct lttng_event *event);
+void lttng_filter_link_cache_flush(void);
+void lttng_filter_event_stats(struct lttng_event *event,
+		struct lttng_filter_stats *sum);
+void lttng_free_event_filter_runtime(struct lttng_event *event);
+int lttng_event_filter_stats(struct lttng_event *event,
+		struct lttng_kernel_filter_stats *stats);
+int lttng_enabler_filter_stats(struct lttng_enabler *enabler,
+		struct lttng_kernel_filter_stats *stats);
 int lttng_enabler_attach_bytecode(struct lttng_enabler *enabler,
 		struct lttng_kernel_filter_bytecode __user *bytecode);
+int lttng_enabler_attach_bpf(struct lttng_enabler *enabler,
+		struct lttng_kernel_filter_bpf *bpf_param);
 void lttng_enabler_event_link_bytecode(struct lttng_event *event,
 		struct lttng_enabler *enabler);
+int lttng_filter_event_link_standalone(struct lttng_event *event,
+		struct lttng_filter_bytecode_node *filter_bytecode);
+void lttng_filter_event_link_ctx_guards(struct lttng_event *event);
+size_t lttng_filter_event_mem_usage(struct lttng_event *event);
+
+#ifdef CONFIG_BPF_SYSCALL
+struct bpf_prog *lttng_filter_bpf_get(int fd);
+void lttng_filter_bpf_put(struct bpf_prog *prog);
+#else
+static inline
+struct bpf_prog *lttng_filter_bpf_get(int fd)
+{
+	return ERR_PTR(-ENOSYS);
+}
+
+static inline
+void lttng_filter_bpf_put(struct bpf_prog *prog)
+{
+}
+#endif /* CONFIG_BPF_SYSCALL */
 
 int lttng_probes_init(void);
 
@@ -682,6 +1342,13 @@ int lttng_get_context_index(struct lttng_ctx *ctx, const char *name);
 void lttng_remove_context_field(struct lttng_ctx **ctx,
 				struct lttng_ctx_field *field);
 void lttng_destroy_context(struct lttng_ctx *ctx);
+int lttng_channel_context_guard(struct lttng_channel *chan,
+		struct lttng_kernel_context_guard __user *uguard);
+void lttng_ctx_guard_destroy(struct lttng_ctx_guard *guard);
+size_t lttng_ctx_guard_get_size(size_t offset, struct lttng_ctx_field *field,
+		struct lib_ring_buffer_ctx *ctx, struct lttng_channel *chan);
+void lttng_ctx_guard_record(struct lttng_ctx_field *field,
+		struct lib_ring_buffer_ctx *ctx, struct lttng_channel *chan);
 int lttng_add_pid_to_ctx(struct lttng_ctx **ctx);
 int lttng_add_cpu_id_to_ctx(struct lttng_ctx **ctx);
 int lttng_add_procname_to_ctx(struct lttng_ctx **ctx);
@@ -693,8 +1360,17 @@ int lttng_add_vtid_to_ctx(struct lttng_ctx **ctx);
 int lttng_add_ppid_to_ctx(struct lttng_ctx **ctx);
 int lttng_add_vppid_to_ctx(struct lttng_ctx **ctx);
 int lttng_add_hostname_to_ctx(struct lttng_ctx **ctx);
+int lttng_add_procname_interned_to_ctx(struct lttng_ctx **ctx);
+int lttng_add_hostname_interned_to_ctx(struct lttng_ctx **ctx);
+/* Max string length of an interned string context, without terminator. */
+#define LTTNG_INTERN_STRING_MAX_LEN	64
+int lttng_add_interned_string_to_ctx(struct lttng_ctx **ctx, const char *name,
+		size_t (*get_string)(char *dest));
 int lttng_add_interruptible_to_ctx(struct lttng_ctx **ctx);
+int lttng_add_user_truncated_to_ctx(struct lttng_ctx **ctx);
+int lttng_add_ratelimit_suppressed_to_ctx(struct lttng_ctx **ctx);
 int lttng_add_need_reschedule_to_ctx(struct lttng_ctx **ctx);
+int lttng_add_task_state_flags_to_ctx(struct lttng_ctx **ctx);
 #if defined(CONFIG_PREEMPT_RT_FULL) || defined(CONFIG_PREEMPT)
 int lttng_add_preemptible_to_ctx(struct lttng_ctx **ctx);
 #else
@@ -714,13 +1390,34 @@ int lttng_add_migratable_to_ctx(struct lttng_ctx **ctx)
 }
 #endif
 
-int lttng_add_callstack_to_ctx(struct lttng_ctx **ctx, int type);
+int lttng_add_callstack_to_ctx(struct lttng_ctx **ctx, int type,
+		uint32_t max_depth, uint64_t max_walk_time);
+
+/* Current task values, see lttng-context-task-cache.c */
+struct lttng_task_ctx_cache {
+	struct task_struct *task;	/* NULL during update */
+	pid_t vpid, vtid, ppid, vppid;
+};
+
+const struct lttng_task_ctx_cache *lttng_task_ctx_cache_current(void);
+int lttng_task_ctx_cache_get(void);
+void lttng_task_ctx_cache_put(void);
+void lttng_task_ctx_cache_destroy_field(struct lttng_ctx_field *field);
 
 #if defined(CONFIG_PERF_EVENTS)
 int lttng_add_perf_counter_to_ctx(uint32_t type,
 				  uint64_t config,
 				  const char *name,
 				  struct lttng_ctx **ctx);
+int lttng_add_perf_counter_delta_to_ctx(uint32_t type,
+				  uint64_t config,
+				  const char *name,
+				  struct lttng_ctx **ctx);
+int lttng_add_perf_counter_group_to_ctx(
+		const struct lttng_kernel_perf_counter_group_member *members,
+		unsigned int nr_members,
+		const char *name,
+		struct lttng_ctx **ctx, bool delta);
 int lttng_cpuhp_perf_counter_online(unsigned int cpu,
 		struct lttng_cpuhp_node *node);
 int lttng_cpuhp_perf_counter_dead(unsigned int cpu,
@@ -735,6 +1432,23 @@ int lttng_add_perf_counter_to_ctx(uint32_t type,
 	return -ENOSYS;
 }
 static inline
+int lttng_add_perf_counter_delta_to_ctx(uint32_t type,
+				  uint64_t config,
+				  const char *name,
+				  struct lttng_ctx **ctx)
+{
+	return -ENOSYS;
+}
+static inline
+int lttng_add_perf_counter_group_to_ctx(
+		const struct lttng_kernel_perf_counter_group_member *members,
+		unsigned int nr_members,
+		const char *name,
+		struct lttng_ctx **ctx, bool delta)
+{
+	return -ENOSYS;
+}
+static inline
 int lttng_cpuhp_perf_counter_online(unsigned int cpu,
 		struct lttng_cpuhp_node *node)
 {
@@ -751,13 +1465,39 @@ int lttng_cpuhp_perf_counter_dead(unsigned int cpu,
 int lttng_logger_init(void);
 void lttng_logger_exit(void);
 
+int lttng_memory_stats_init(void);
+void lttng_memory_stats_exit(void);
+
+/* Phases of a statedump, timed by lttng-statedump. */
+enum lttng_statedump_phase {
+	LTTNG_STATEDUMP_PHASE_PROCESS,
+	LTTNG_STATEDUMP_PHASE_FD,
+	LTTNG_STATEDUMP_PHASE_INTERRUPT,
+	LTTNG_STATEDUMP_PHASE_NETIF,
+	LTTNG_STATEDUMP_PHASE_BLOCK_DEVICE,
+	LTTNG_STATEDUMP_PHASE_CPU_TOPOLOGY,
+	NR_LTTNG_STATEDUMP_PHASES,
+};
+
+/*
+ * Durations of the last statedump, in ns. Process and file descriptor
+ * phases run on all cpus concurrently: theirs is the sum over cpus.
+ */
+struct lttng_statedump_stats {
+	u64 total_ns;
+	u64 phase_ns[NR_LTTNG_STATEDUMP_PHASES];
+};
+
 extern int lttng_statedump_start(struct lttng_session *session);
+extern void lttng_statedump_shadow_destroy(struct lttng_session *session);
+extern void lttng_statedump_get_stats(struct lttng_statedump_stats *stats);
 
 #ifdef CONFIG_KPROBES
 int lttng_kprobes_register(const char *name,
 		const char *symbol_name,
 		uint64_t offset,
 		uint64_t addr,
+		uint64_t fetch,
 		struct lttng_event *event);
 void lttng_kprobes_unregister(struct lttng_event *event);
 void lttng_kprobes_destroy_private(struct lttng_event *event);
@@ -767,6 +1507,7 @@ int lttng_kprobes_register(const char *name,
 		const char *symbol_name,
 		uint64_t offset,
 		uint64_t addr,
+		uint64_t fetch,
 		struct lttng_event *event)
 {
 	return -ENOSYS;
@@ -785,18 +1526,24 @@ void lttng_kprobes_destroy_private(struct lttng_event *event)
 
 int lttng_event_add_callsite(struct lttng_event *event,
 	struct lttng_kernel_event_callsite *callsite);
+int lttng_event_add_callsites(struct lttng_event *event,
+	struct lttng_kernel_event_callsites __user *callsites);
 
 #ifdef CONFIG_UPROBES
 int lttng_uprobes_register(const char *name,
-	int fd, struct lttng_event *event);
+	int fd, uint32_t sample_period, uint64_t sample_interval,
+	struct lttng_event *event);
 int lttng_uprobes_add_callsite(struct lttng_event *event,
 	struct lttng_kernel_event_callsite *callsite);
+int lttng_uprobes_add_callsites(struct lttng_event *event,
+	struct lttng_kernel_event_callsites __user *callsites);
 void lttng_uprobes_unregister(struct lttng_event *event);
 void lttng_uprobes_destroy_private(struct lttng_event *event);
 #else
 static inline
 int lttng_uprobes_register(const char *name,
-	int fd, struct lttng_event *event)
+	int fd, uint32_t sample_period, uint64_t sample_interval,
+	struct lttng_event *event)
 {
 	return -ENOSYS;
 }
@@ -808,6 +1555,13 @@ int lttng_uprobes_add_callsite(struct lttng_event *event,
 	return -ENOSYS;
 }
 
+static inline
+int lttng_uprobes_add_callsites(struct lttng_event *event,
+	struct lttng_kernel_event_callsites __user *callsites)
+{
+	return -ENOSYS;
+}
+
 static inline
 void lttng_uprobes_unregister(struct lttng_event *event)
 {
@@ -824,6 +1578,7 @@ int lttng_kretprobes_register(const char *name,
 		const char *symbol_name,
 		uint64_t offset,
 		uint64_t addr,
+		uint64_t threshold,
 		struct lttng_event *event_entry,
 		struct lttng_event *event_exit);
 void lttng_kretprobes_unregister(struct lttng_event *event);
@@ -836,6 +1591,7 @@ int lttng_kretprobes_register(const char *name,
 		const char *symbol_name,
 		uint64_t offset,
 		uint64_t addr,
+		uint64_t threshold,
 		struct lttng_event *event_entry,
 		struct lttng_event *event_exit)
 {
@@ -886,11 +1642,240 @@ void lttng_ftrace_destroy_private(struct lttng_event *event)
 }
 #endif
 
+#ifdef CONFIG_DYNAMIC_FTRACE
+int lttng_fentry_register(const char *name,
+			  const char *symbol_name,
+			  struct lttng_event *event);
+void lttng_fentry_unregister(struct lttng_event *event);
+void lttng_fentry_destroy_private(struct lttng_event *event);
+#else
+static inline
+int lttng_fentry_register(const char *name,
+			  const char *symbol_name,
+			  struct lttng_event *event)
+{
+	return -ENOSYS;
+}
+
+static inline
+void lttng_fentry_unregister(struct lttng_event *event)
+{
+}
+
+static inline
+void lttng_fentry_destroy_private(struct lttng_event *event)
+{
+}
+#endif
+
+#ifdef CONFIG_FUNCTION_GRAPH_TRACER
+int lttng_fgraph_register(const char *name,
+			  const char *symbol_name,
+			  uint32_t max_depth,
+			  uint64_t min_duration,
+			  struct lttng_event *event);
+void lttng_fgraph_unregister(struct lttng_event *event);
+void lttng_fgraph_destroy_private(struct lttng_event *event);
+#else
+static inline
+int lttng_fgraph_register(const char *name,
+			  const char *symbol_name,
+			  uint32_t max_depth,
+			  uint64_t min_duration,
+			  struct lttng_event *event)
+{
+	return -ENOSYS;
+}
+
+static inline
+void lttng_fgraph_unregister(struct lttng_event *event)
+{
+}
+
+static inline
+void lttng_fgraph_destroy_private(struct lttng_event *event)
+{
+}
+#endif
+
+int lttng_sampler_register(const char *name,
+			   uint64_t frequency,
+			   struct lttng_event *event);
+void lttng_sampler_unregister(struct lttng_event *event);
+void lttng_sampler_destroy_private(struct lttng_event *event);
+
+int lttng_hwtrace_sync_register(const char *name,
+			   uint64_t frequency,
+			   struct lttng_event *event);
+void lttng_hwtrace_sync_unregister(struct lttng_event *event);
+void lttng_hwtrace_sync_destroy_private(struct lttng_event *event);
+
 int lttng_calibrate(struct lttng_kernel_calibrate *calibrate);
+int lttng_calibrate_overhead(struct lttng_kernel_calibrate_overhead *calibrate);
+void lttng_calibrate_tracepoint(unsigned int iteration);
 
 extern const struct file_operations lttng_tracepoint_list_fops;
+extern const struct file_operations lttng_clock_page_fops;
 extern const struct file_operations lttng_syscall_list_fops;
 
+/*
+ * Run a filter program, counting its runs and results, and timing one
+ * run out of LTTNG_FILTER_STATS_SAMPLE_PERIOD. Counters are per cpu,
+ * updated with operations safe against nested interrupts.
+ */
+static inline
+uint64_t lttng_bytecode_runtime_filter(struct lttng_bytecode_runtime *bc_runtime,
+		struct lttng_probe_ctx *lttng_probe_ctx,
+		const char *filter_stack_data)
+{
+	struct lttng_filter_stats __percpu *stats = bc_runtime->stats;
+	uint64_t ret;
+	cycles_t start;
+
+	if (unlikely(!stats))
+		return bc_runtime->filter(bc_runtime, lttng_probe_ctx,
+				filter_stack_data);
+	if (likely(this_cpu_inc_return(stats->evaluations)
+			% LTTNG_FILTER_STATS_SAMPLE_PERIOD)) {
+		ret = bc_runtime->filter(bc_runtime, lttng_probe_ctx,
+				filter_stack_data);
+	} else {
+		start = get_cycles();
+		ret = bc_runtime->filter(bc_runtime, lttng_probe_ctx,
+				filter_stack_data);
+		this_cpu_add(stats->cycles, get_cycles() - start);
+		this_cpu_inc(stats->samples);
+	}
+	if (ret & LTTNG_FILTER_RECORD_FLAG)
+		this_cpu_inc(stats->accepts);
+	return ret;
+}
+
+/*
+ * Run the filters of an event which only read contexts, before the
+ * filter stack data is prepared from the event payload. Return 1 if one
+ * of them records the event, 0 if all the filters of the event discard
+ * it, or -1 if filters reading the payload remain to be run by
+ * lttng_event_filter_payload(). Called within an RCU read-side critical
+ * section.
+ */
+static inline
+int lttng_event_filter_context(struct lttng_event *event,
+		struct lttng_probe_ctx *lttng_probe_ctx)
+{
+	struct lttng_bytecode_runtime *bc_runtime;
+	int remaining = 0;
+
+	bc_runtime = lttng_rcu_dereference(event->fused_filter);
+	if (bc_runtime) {
+		if (!bc_runtime->context_only)
+			return -1;
+		return !!(lttng_bytecode_runtime_filter(bc_runtime,
+				lttng_probe_ctx, NULL) & LTTNG_FILTER_RECORD_FLAG);
+	}
+	lttng_list_for_each_entry_rcu(bc_runtime, &event->bytecode_runtime_head, node) {
+		if (!bc_runtime->context_only) {
+			remaining = 1;
+			continue;
+		}
+		if (unlikely(lttng_bytecode_runtime_filter(bc_runtime,
+				lttng_probe_ctx, NULL) & LTTNG_FILTER_RECORD_FLAG))
+			return 1;
+	}
+	return remaining ? -1 : 0;
+}
+
+/*
+ * Run the filters of an event reading its payload, once the filter
+ * stack data is prepared. Return 1 if one of them records the event.
+ */
+static inline
+int lttng_event_filter_payload(struct lttng_event *event,
+		struct lttng_probe_ctx *lttng_probe_ctx,
+		const char *filter_stack_data)
+{
+	struct lttng_bytecode_runtime *bc_runtime;
+
+	bc_runtime = lttng_rcu_dereference(event->fused_filter);
+	if (bc_runtime)
+		return !!(lttng_bytecode_runtime_filter(bc_runtime,
+				lttng_probe_ctx, filter_stack_data)
+				& LTTNG_FILTER_RECORD_FLAG);
+	lttng_list_for_each_entry_rcu(bc_runtime, &event->bytecode_runtime_head, node) {
+		if (bc_runtime->context_only)
+			continue;
+		if (unlikely(lttng_bytecode_runtime_filter(bc_runtime,
+				lttng_probe_ctx, filter_stack_data)
+				& LTTNG_FILTER_RECORD_FLAG))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Called by the probes once the trackers and filters accept a hit.
+ * Return true if the event is in count-only mode, its hit then being
+ * counted instead of recorded.
+ */
+static inline
+bool lttng_event_count_hit(struct lttng_event *event, unsigned long armed)
+{
+	if (likely(!(armed & LTTNG_EVENT_ARMED_COUNT)))
+		return false;
+	this_cpu_inc(*event->hit_count);
+	return true;
+}
+
+/*
+ * Return whether the current event must be recorded, given the channel
+ * sampling period. Called with preemption disabled, by the tracepoint
+ * probes before their filters, and by the ring buffer client for the
+ * other instrumentation.
+ */
+static inline
+bool lttng_channel_sample(struct lttng_channel *chan, int cpu)
+{
+	unsigned int period = READ_ONCE(chan->sampling_period);
+	struct lttng_channel_sampling *sampling;
+
+	if (likely(period <= 1))
+		return true;
+	sampling = per_cpu_ptr(chan->sampling, cpu);
+	if (local_inc_return(&sampling->count) < period) {
+		local_inc(&sampling->skipped);
+		return false;
+	}
+	local_sub(period, &sampling->count);
+	return true;
+}
+
+/*
+ * Called by the probes and the ring buffer client before a hit is
+ * accepted. Return true if the session of the event is paused.
+ */
+static inline
+bool lttng_session_paused(struct lttng_session *session, unsigned long armed)
+{
+	return unlikely(armed & LTTNG_EVENT_ARMED_PAUSE)
+		&& READ_ONCE(session->paused);
+}
+
+/*
+ * Called by the ring buffer client for each record reserved. In lazy
+ * metadata mode, the first record of an event queues the emission of
+ * its metadata.
+ */
+static inline
+void lttng_event_metadata_hit(struct lttng_event *event, unsigned long armed)
+{
+	if (likely(!(armed & LTTNG_EVENT_ARMED_LAZY_METADATA)))
+		return;
+	if (!test_bit(LTTNG_EVENT_METADATA_HIT, &event->metadata_lazy)
+			&& !test_and_set_bit(LTTNG_EVENT_METADATA_HIT,
+				&event->metadata_lazy))
+		lttng_event_metadata_queue(event);
+}
+
 #define TRACEPOINT_HAS_DATA_ARG
 
 #endif /* _LTTNG_EVENTS_H */
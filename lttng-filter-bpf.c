@@ -0,0 +1,104 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * lttng-filter-bpf.c
+ *
+ * LTTng modules filters running BPF programs.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/bpf.h>
+#include <linux/filter.h>
+#include <linux/rcupdate.h>
+#include <linux/string.h>
+#include <linux/version.h>
+
+#include <lttng-filter.h>
+
+/*
+ * A BPF filter is a BPF_PROG_TYPE_RAW_TRACEPOINT program, loaded and
+ * checked by the kernel verifier, and JIT-compiled when the kernel is
+ * configured to. Its context is the array of u64 arguments of raw
+ * tracepoint programs, which holds the beginning of the filter stack
+ * data of the event, zero-padded: the fields laid out as for the
+ * filter bytecode, beyond the first LTTNG_FILTER_BPF_CTX_LEN bytes,
+ * cannot be read by the program.
+ *
+ * Strings, arrays and sequences are passed by address, to be read with
+ * the probe read helpers: they can be user-space addresses for the
+ * fields of user-space data.
+ */
+
+#define LTTNG_FILTER_BPF_CTX_LEN	(MAX_BPF_FUNC_ARGS * sizeof(u64))
+
+struct bpf_prog *lttng_filter_bpf_get(int fd)
+{
+	return bpf_prog_get_type(fd, BPF_PROG_TYPE_RAW_TRACEPOINT);
+}
+
+void lttng_filter_bpf_put(struct bpf_prog *prog)
+{
+	if (prog)
+		bpf_prog_put(prog);
+}
+
+uint64_t lttng_filter_bpf_run(void *filter_data,
+		struct lttng_probe_ctx *lttng_probe_ctx,
+		const char *filter_stack_data)
+{
+	struct bytecode_runtime *runtime = filter_data;
+	struct bpf_prog *prog = runtime->p.bc->bpf_prog;
+	u64 ctx[MAX_BPF_FUNC_ARGS] = { 0 };
+	unsigned int ret;
+
+	memcpy(ctx, filter_stack_data, runtime->bpf_ctx_len);
+	rcu_read_lock();
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5,15,0))
+	ret = bpf_prog_run(prog, ctx);
+#else
+	ret = BPF_PROG_RUN(prog, ctx);
+#endif
+	rcu_read_unlock();
+	return ret ? LTTNG_FILTER_RECORD_FLAG : LTTNG_FILTER_DISCARD;
+}
+
+/*
+ * Compute the length of the filter stack data of the event passed to
+ * the program. Fails for events with fields the filter stack data
+ * cannot hold.
+ */
+int lttng_filter_bpf_link(struct lttng_event *event,
+		struct bytecode_runtime *runtime)
+{
+	const struct lttng_event_desc *desc = event->desc;
+	size_t len = 0;
+	unsigned int i;
+
+	if (!desc)
+		return -EINVAL;
+	for (i = 0; i < desc->nr_fields; i++) {
+		switch (desc->fields[i].type.atype) {
+		case atype_integer:
+		case atype_enum:
+			len += sizeof(int64_t);
+			break;
+		case atype_array:
+		case atype_sequence:
+		case atype_array_bitfield:
+		case atype_sequence_bitfield:
+			len += sizeof(unsigned long);
+			len += sizeof(void *);
+			break;
+		case atype_string:
+			len += sizeof(void *);
+			break;
+		default:
+			return -EINVAL;
+		}
+	}
+	runtime->bpf_ctx_len = min_t(size_t, len, LTTNG_FILTER_BPF_CTX_LEN);
+	runtime->p.context_only = 0;
+	runtime->p.filter = lttng_filter_bpf_run;
+	return 0;
+}
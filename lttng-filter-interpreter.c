@@ -114,6 +114,73 @@ int stack_star_glob_match(struct estack *stack, int top, const char *cmp_type)
 	return result;
 }
 
+static
+int string_matcher_match(const struct filter_string_matcher *matcher,
+		const char *str, size_t len)
+{
+	const char *chars = filter_string_matcher_chars(matcher);
+	const struct filter_string_segment *first, *last;
+	size_t pos, end;
+	unsigned int i;
+
+	first = &matcher->segments[0];
+	if (matcher->nr_segments == 1)
+		return len == first->len
+			&& !memcmp(str, chars + first->offset, len);
+	last = &matcher->segments[matcher->nr_segments - 1];
+	if (len < first->len + last->len)
+		return 0;
+	if (memcmp(str, chars + first->offset, first->len)
+			|| memcmp(str + len - last->len, chars + last->offset,
+				last->len))
+		return 0;
+	/* Match the middle segments at their leftmost position. */
+	pos = first->len;
+	end = len - last->len;
+	for (i = 1; i < matcher->nr_segments - 1; i++) {
+		const struct filter_string_segment *segment =
+			&matcher->segments[i];
+
+		for (;;) {
+			if (end - pos < segment->len)
+				return 0;
+			if (!memcmp(str + pos, chars + segment->offset,
+					segment->len))
+				break;
+			pos++;
+		}
+		pos += segment->len;
+	}
+	return 1;
+}
+
+/*
+ * Match a kernel string against the compiled literal it is compared
+ * with. Return 1 on match, 0 on mismatch, or -1 if the comparison
+ * needs to interpret the literal.
+ */
+static
+int stack_string_match(struct estack *stack, int top)
+{
+	struct estack_entry *pattern_reg, *candidate_reg;
+
+	if (estack_ax(stack, top)->u.s.literal_type != ESTACK_STRING_LITERAL_TYPE_NONE) {
+		pattern_reg = estack_ax(stack, top);
+		candidate_reg = estack_bx(stack, top);
+	} else {
+		pattern_reg = estack_bx(stack, top);
+		candidate_reg = estack_ax(stack, top);
+	}
+	if (pattern_reg->u.s.literal_type == ESTACK_STRING_LITERAL_TYPE_NONE
+			|| !pattern_reg->u.s.matcher
+			|| candidate_reg->u.s.literal_type != ESTACK_STRING_LITERAL_TYPE_NONE
+			|| candidate_reg->u.s.user)
+		return -1;
+	return string_matcher_match(pattern_reg->u.s.matcher,
+		candidate_reg->u.s.str,
+		strnlen(candidate_reg->u.s.str, candidate_reg->u.s.seq_len));
+}
+
 static
 int stack_strcmp(struct estack *stack, int top, const char *cmp_type)
 {
@@ -601,6 +668,36 @@ end:
 	return ret;
 }
 
+/* Binary search within the sorted set values. */
+static
+int set_match(const struct set_op *insn, int64_t v)
+{
+	unsigned int lo = 0, hi = insn->nr_values;
+
+	while (lo < hi) {
+		unsigned int mid = lo + ((hi - lo) >> 1);
+		int64_t mid_v = insn->values[mid];
+
+		if (mid_v == v)
+			return 1;
+		if (mid_v < v)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return 0;
+}
+
+static
+int set_bitmap_match(const struct filter_set_bitmap *bitmap, int64_t v)
+{
+	uint64_t bit = (uint64_t) v - (uint64_t) bitmap->base;
+
+	if (bit >= bitmap->nr_bits)
+		return 0;
+	return !!(bitmap->bits[bit >> 3] & (1U << (bit & 7)));
+}
+
 /*
  * Return 0 (discard), or raise the 0x1 flag (log event).
  * Currently, other flags are kept for future extensions and have no
@@ -756,6 +853,13 @@ uint64_t lttng_filter_interpret_bytecode(void *filter_data,
 		[ FILTER_OP_UNARY_BIT_NOT ] = &&LABEL_FILTER_OP_UNARY_BIT_NOT,
 
 		[ FILTER_OP_RETURN_S64 ] = &&LABEL_FILTER_OP_RETURN_S64,
+
+		/* set and range */
+		[ FILTER_OP_IN_SET_S64 ] = &&LABEL_FILTER_OP_IN_SET_S64,
+		[ FILTER_OP_IN_SET_BITMAP_S64 ] = &&LABEL_FILTER_OP_IN_SET_BITMAP_S64,
+		[ FILTER_OP_IN_RANGE_S64 ] = &&LABEL_FILTER_OP_IN_RANGE_S64,
+
+		[ FILTER_OP_LOAD_STRING_MATCHER ] = &&LABEL_FILTER_OP_LOAD_STRING_MATCHER,
 	};
 #endif /* #ifndef INTERPRETER_USE_SWITCH */
 
@@ -805,7 +909,9 @@ uint64_t lttng_filter_interpret_bytecode(void *filter_data,
 		{
 			int res;
 
-			res = (stack_strcmp(stack, top, "==") == 0);
+			res = stack_string_match(stack, top);
+			if (res < 0)
+				res = (stack_strcmp(stack, top, "==") == 0);
 			estack_pop(stack, top, ax, bx);
 			estack_ax_v = res;
 			next_pc += sizeof(struct binary_op);
@@ -815,7 +921,11 @@ uint64_t lttng_filter_interpret_bytecode(void *filter_data,
 		{
 			int res;
 
-			res = (stack_strcmp(stack, top, "!=") != 0);
+			res = stack_string_match(stack, top);
+			if (res < 0)
+				res = (stack_strcmp(stack, top, "!=") != 0);
+			else
+				res = !res;
 			estack_pop(stack, top, ax, bx);
 			estack_ax_v = res;
 			next_pc += sizeof(struct binary_op);
@@ -866,7 +976,9 @@ uint64_t lttng_filter_interpret_bytecode(void *filter_data,
 		{
 			int res;
 
-			res = (stack_star_glob_match(stack, top, "==") == 0);
+			res = stack_string_match(stack, top);
+			if (res < 0)
+				res = (stack_star_glob_match(stack, top, "==") == 0);
 			estack_pop(stack, top, ax, bx);
 			estack_ax_v = res;
 			next_pc += sizeof(struct binary_op);
@@ -876,7 +988,11 @@ uint64_t lttng_filter_interpret_bytecode(void *filter_data,
 		{
 			int res;
 
-			res = (stack_star_glob_match(stack, top, "!=") != 0);
+			res = stack_string_match(stack, top);
+			if (res < 0)
+				res = (stack_star_glob_match(stack, top, "!=") != 0);
+			else
+				res = !res;
 			estack_pop(stack, top, ax, bx);
 			estack_ax_v = res;
 			next_pc += sizeof(struct binary_op);
@@ -1055,6 +1171,35 @@ uint64_t lttng_filter_interpret_bytecode(void *filter_data,
 			next_pc += sizeof(struct unary_op);
 			PO;
 		}
+
+		/* set and range */
+		OP(FILTER_OP_IN_SET_S64):
+		{
+			struct set_op *insn = (struct set_op *) pc;
+
+			estack_ax_v = set_match(insn, estack_ax_v);
+			next_pc += filter_set_op_len(insn);
+			PO;
+		}
+		OP(FILTER_OP_IN_SET_BITMAP_S64):
+		{
+			struct set_op *insn = (struct set_op *) pc;
+
+			estack_ax_v = set_bitmap_match((struct filter_set_bitmap *)
+					&bytecode->data[insn->data_offset],
+					estack_ax_v);
+			next_pc += filter_set_op_len(insn);
+			PO;
+		}
+		OP(FILTER_OP_IN_RANGE_S64):
+		{
+			struct range_op *insn = (struct range_op *) pc;
+
+			estack_ax_v = estack_ax_v >= insn->lo
+				&& estack_ax_v <= insn->hi;
+			next_pc += sizeof(struct range_op);
+			PO;
+		}
 		OP(FILTER_OP_UNARY_MINUS_S64):
 		{
 			estack_ax_v = -estack_ax_v;
@@ -1200,6 +1345,7 @@ uint64_t lttng_filter_interpret_bytecode(void *filter_data,
 			estack_ax(stack, top)->u.s.literal_type =
 				ESTACK_STRING_LITERAL_TYPE_PLAIN;
 			estack_ax(stack, top)->u.s.user = 0;
+			estack_ax(stack, top)->u.s.matcher = NULL;
 			next_pc += sizeof(struct load_op) + strlen(insn->data) + 1;
 			PO;
 		}
@@ -1215,10 +1361,35 @@ uint64_t lttng_filter_interpret_bytecode(void *filter_data,
 			estack_ax(stack, top)->u.s.literal_type =
 				ESTACK_STRING_LITERAL_TYPE_STAR_GLOB;
 			estack_ax(stack, top)->u.s.user = 0;
+			estack_ax(stack, top)->u.s.matcher = NULL;
 			next_pc += sizeof(struct load_op) + strlen(insn->data) + 1;
 			PO;
 		}
 
+		OP(FILTER_OP_LOAD_STRING_MATCHER):
+		{
+			struct load_op *insn = (struct load_op *) pc;
+			struct load_string_matcher *ref =
+				(struct load_string_matcher *) insn->data;
+			const struct filter_string_matcher *matcher =
+				(const struct filter_string_matcher *)
+					&bytecode->data[ref->data_offset];
+
+			estack_push(stack, top, ax, bx);
+			estack_ax(stack, top)->u.s.str =
+				filter_string_matcher_chars(matcher)
+					+ matcher->literal;
+			dbg_printk("load compiled string %s\n",
+				estack_ax(stack, top)->u.s.str);
+			estack_ax(stack, top)->u.s.seq_len = LTTNG_SIZE_MAX;
+			estack_ax(stack, top)->u.s.literal_type =
+				matcher->literal_type;
+			estack_ax(stack, top)->u.s.user = 0;
+			estack_ax(stack, top)->u.s.matcher = matcher;
+			next_pc += sizeof(struct load_op) + ref->len;
+			PO;
+		}
+
 		OP(FILTER_OP_LOAD_S64):
 		{
 			struct load_op *insn = (struct load_op *) pc;
@@ -1580,3 +1751,150 @@ end:
 #undef OP
 #undef PO
 #undef END_OP
+
+/*
+ * Execute the register IR lowered from the bytecode. Same return values
+ * as lttng_filter_interpret_bytecode().
+ */
+uint64_t lttng_filter_interpret_regs(void *filter_data,
+		struct lttng_probe_ctx *lttng_probe_ctx,
+		const char *filter_stack_data)
+{
+	struct bytecode_runtime *bytecode = filter_data;
+	const struct filter_reg_insn *code = bytecode->reg_code, *insn;
+	int64_t r[FILTER_REG_FILE_LEN];
+	unsigned int pc = 0;
+
+	for (;;) {
+		insn = &code[pc++];
+		switch (insn->op) {
+		case FILTER_REG_OP_RETURN:
+			/* LTTNG_FILTER_DISCARD or LTTNG_FILTER_RECORD_FLAG */
+			return !!r[insn->a];
+		case FILTER_REG_OP_LOAD_IMM:
+			r[insn->dst] = insn->imm;
+			break;
+
+		case FILTER_REG_OP_LOAD_S8:
+			r[insn->dst] = *(const int8_t *) &filter_stack_data[insn->imm];
+			break;
+		case FILTER_REG_OP_LOAD_S16:
+			r[insn->dst] = *(const int16_t *) &filter_stack_data[insn->imm];
+			break;
+		case FILTER_REG_OP_LOAD_S32:
+			r[insn->dst] = *(const int32_t *) &filter_stack_data[insn->imm];
+			break;
+		case FILTER_REG_OP_LOAD_S64:
+			r[insn->dst] = *(const int64_t *) &filter_stack_data[insn->imm];
+			break;
+		case FILTER_REG_OP_LOAD_U8:
+			r[insn->dst] = *(const uint8_t *) &filter_stack_data[insn->imm];
+			break;
+		case FILTER_REG_OP_LOAD_U16:
+			r[insn->dst] = *(const uint16_t *) &filter_stack_data[insn->imm];
+			break;
+		case FILTER_REG_OP_LOAD_U32:
+			r[insn->dst] = *(const uint32_t *) &filter_stack_data[insn->imm];
+			break;
+		case FILTER_REG_OP_LOAD_U64:
+			r[insn->dst] = *(const uint64_t *) &filter_stack_data[insn->imm];
+			break;
+		case FILTER_REG_OP_LOAD_CONTEXT:
+		{
+			struct lttng_ctx_field *ctx_field;
+			union lttng_ctx_value v;
+
+			ctx_field = &lttng_static_ctx->fields[insn->imm];
+			ctx_field->get_value(ctx_field, lttng_probe_ctx, &v);
+			r[insn->dst] = v.s64;
+			break;
+		}
+
+		case FILTER_REG_OP_EQ:
+			r[insn->dst] = r[insn->a] == r[insn->b];
+			break;
+		case FILTER_REG_OP_NE:
+			r[insn->dst] = r[insn->a] != r[insn->b];
+			break;
+		case FILTER_REG_OP_GT:
+			r[insn->dst] = r[insn->a] > r[insn->b];
+			break;
+		case FILTER_REG_OP_LT:
+			r[insn->dst] = r[insn->a] < r[insn->b];
+			break;
+		case FILTER_REG_OP_GE:
+			r[insn->dst] = r[insn->a] >= r[insn->b];
+			break;
+		case FILTER_REG_OP_LE:
+			r[insn->dst] = r[insn->a] <= r[insn->b];
+			break;
+		case FILTER_REG_OP_RSHIFT:
+			/* Catch undefined behavior. */
+			if (unlikely(r[insn->b] < 0 || r[insn->b] >= 64))
+				return 0;
+			r[insn->dst] = ((uint64_t) r[insn->a] >> (uint32_t) r[insn->b]);
+			break;
+		case FILTER_REG_OP_LSHIFT:
+			/* Catch undefined behavior. */
+			if (unlikely(r[insn->b] < 0 || r[insn->b] >= 64))
+				return 0;
+			r[insn->dst] = ((uint64_t) r[insn->a] << (uint32_t) r[insn->b]);
+			break;
+		case FILTER_REG_OP_AND:
+			r[insn->dst] = ((uint64_t) r[insn->a] & (uint64_t) r[insn->b]);
+			break;
+		case FILTER_REG_OP_OR:
+			r[insn->dst] = ((uint64_t) r[insn->a] | (uint64_t) r[insn->b]);
+			break;
+		case FILTER_REG_OP_XOR:
+			r[insn->dst] = ((uint64_t) r[insn->a] ^ (uint64_t) r[insn->b]);
+			break;
+
+		case FILTER_REG_OP_EQ_IMM:
+			r[insn->dst] = r[insn->a] == insn->imm;
+			break;
+		case FILTER_REG_OP_NE_IMM:
+			r[insn->dst] = r[insn->a] != insn->imm;
+			break;
+		case FILTER_REG_OP_GT_IMM:
+			r[insn->dst] = r[insn->a] > insn->imm;
+			break;
+		case FILTER_REG_OP_LT_IMM:
+			r[insn->dst] = r[insn->a] < insn->imm;
+			break;
+		case FILTER_REG_OP_GE_IMM:
+			r[insn->dst] = r[insn->a] >= insn->imm;
+			break;
+		case FILTER_REG_OP_LE_IMM:
+			r[insn->dst] = r[insn->a] <= insn->imm;
+			break;
+
+		case FILTER_REG_OP_BIT_NOT:
+			r[insn->dst] = ~(uint64_t) r[insn->a];
+			break;
+		case FILTER_REG_OP_NEG:
+			r[insn->dst] = -r[insn->a];
+			break;
+		case FILTER_REG_OP_NOT:
+			r[insn->dst] = !r[insn->a];
+			break;
+
+		case FILTER_REG_OP_JZ:
+			/* If r[a] is 0, skip and evaluate to 0 */
+			if (unlikely(r[insn->a] == 0))
+				pc = insn->imm;
+			break;
+		case FILTER_REG_OP_JNZ_SET:
+			/* If r[a] is nonzero, skip and evaluate to 1 */
+			if (unlikely(r[insn->a] != 0)) {
+				r[insn->a] = 1;
+				pc = insn->imm;
+			}
+			break;
+
+		default:
+			WARN_ON_ONCE(1);
+			return 0;
+		}
+	}
+}
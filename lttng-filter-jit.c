@@ -0,0 +1,562 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * lttng-filter-jit.c
+ *
+ * LTTng modules filter bytecode JIT compiler (x86-64).
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <wrapper/kallsyms.h>
+
+#include <lttng-filter.h>
+
+/*
+ * Translate specialized filter bytecode into native x86-64 code. Only
+ * the integer subset of the instruction set is handled: comparisons and
+ * bitwise operations on s64, logical operators, immediate loads, and
+ * integer loads from the event payload and from the static context.
+ * Bytecode using any other instruction (strings, globbing patterns,
+ * doubles, nested types) keeps using the interpreter.
+ *
+ * The interpreter register stack is mapped onto the native stack: AX
+ * is kept in %rax, and every push spills the previous AX with a native
+ * push. Validation guarantees that the stack depth matches on both
+ * sides of a logical operator jump target, so the stack layout is
+ * static, and the epilogue reloads %rsp from the frame pointer to
+ * discard whatever is left on error.
+ *
+ * Register usage:
+ *   %rax: AX
+ *   %rcx: BX (popped from the native stack by binary operators)
+ *   %rbx: struct lttng_probe_ctx pointer (callee-saved)
+ *   %r12: filter stack data pointer (callee-saved)
+ *
+ * All jumps are encoded with 32-bit displacements so instruction sizes
+ * do not depend on their location: a first pass computes the size of
+ * the generated code and the native offset of each bytecode
+ * instruction, and a second pass emits the code.
+ */
+
+static int filter_jit_enable = 1;
+module_param_named(filter_jit, filter_jit_enable, int, 0644);
+MODULE_PARM_DESC(filter_jit, "Compile filter bytecode to native code (0: disabled, 1: enabled)");
+
+static void *(*module_alloc_sym)(unsigned long size);
+static void (*module_memfree_sym)(void *module_region);
+static int (*set_memory_ro_sym)(unsigned long addr, int numpages);
+static int (*set_memory_rw_sym)(unsigned long addr, int numpages);
+static int (*set_memory_x_sym)(unsigned long addr, int numpages);
+static int (*set_memory_nx_sym)(unsigned long addr, int numpages);
+
+struct filter_jit_ctx {
+	struct bytecode_runtime *runtime;
+	u8 *image;		/* NULL during the sizing pass. */
+	unsigned int len;	/* Current native offset. */
+	unsigned int *addrs;	/* Bytecode offset to native offset. */
+	unsigned int err_off;	/* Native offset of the discard path. */
+	unsigned int exit_off;	/* Native offset of the epilogue. */
+	int error;
+};
+
+/* x86-64 condition codes, second byte of the Jcc rel32/SETcc opcodes. */
+#define X86_CC_E	0x4
+#define X86_CC_NE	0x5
+#define X86_CC_A	0x7
+#define X86_CC_L	0xc
+#define X86_CC_GE	0xd
+#define X86_CC_LE	0xe
+#define X86_CC_G	0xf
+
+/*
+ * Called with the sessions mutex held, which serializes the lazy
+ * symbol lookup.
+ */
+static
+int filter_jit_lookup_symbols(void)
+{
+	if (module_alloc_sym)
+		return 0;
+	module_memfree_sym = (void *) kallsyms_lookup_funcptr("module_memfree");
+	set_memory_ro_sym = (void *) kallsyms_lookup_funcptr("set_memory_ro");
+	set_memory_rw_sym = (void *) kallsyms_lookup_funcptr("set_memory_rw");
+	set_memory_x_sym = (void *) kallsyms_lookup_funcptr("set_memory_x");
+	set_memory_nx_sym = (void *) kallsyms_lookup_funcptr("set_memory_nx");
+	if (!module_memfree_sym || !set_memory_ro_sym || !set_memory_rw_sym
+			|| !set_memory_x_sym || !set_memory_nx_sym) {
+		printk_once(KERN_WARNING "LTTng: filter JIT symbol lookup failed, using interpreter.\n");
+		return -ENOSYS;
+	}
+	/* Set last: non-NULL module_alloc_sym means lookup is complete. */
+	module_alloc_sym = (void *) kallsyms_lookup_funcptr("module_alloc");
+	if (!module_alloc_sym) {
+		printk_once(KERN_WARNING "LTTng: filter JIT symbol lookup failed, using interpreter.\n");
+		return -ENOSYS;
+	}
+	return 0;
+}
+
+/*
+ * Called from generated code to fetch an integer context value.
+ */
+static
+int64_t filter_jit_get_context_s64(struct lttng_probe_ctx *lttng_probe_ctx,
+		uint32_t idx)
+{
+	struct lttng_ctx_field *ctx_field;
+	union lttng_ctx_value v;
+
+	ctx_field = &lttng_static_ctx->fields[idx];
+	ctx_field->get_value(ctx_field, lttng_probe_ctx, &v);
+	return v.s64;
+}
+
+static
+void emit_bytes(struct filter_jit_ctx *ctx, const u8 *bytes, unsigned int len)
+{
+	if (ctx->image)
+		memcpy(ctx->image + ctx->len, bytes, len);
+	ctx->len += len;
+}
+
+#define EMIT(ctx, ...)							\
+	do {								\
+		const u8 __bytes[] = { __VA_ARGS__ };			\
+									\
+		emit_bytes(ctx, __bytes, sizeof(__bytes));		\
+	} while (0)
+
+static
+void emit_u32(struct filter_jit_ctx *ctx, u32 v)
+{
+	emit_bytes(ctx, (const u8 *) &v, sizeof(v));
+}
+
+static
+void emit_u64(struct filter_jit_ctx *ctx, u64 v)
+{
+	emit_bytes(ctx, (const u8 *) &v, sizeof(v));
+}
+
+/* Displacement relative to the end of the 4-byte immediate. */
+static
+void emit_rel32(struct filter_jit_ctx *ctx, unsigned int target)
+{
+	emit_u32(ctx, (u32) (target - (ctx->len + sizeof(u32))));
+}
+
+static
+void emit_jmp(struct filter_jit_ctx *ctx, unsigned int target)
+{
+	EMIT(ctx, 0xe9);		/* jmp rel32 */
+	emit_rel32(ctx, target);
+}
+
+static
+void emit_jcc(struct filter_jit_ctx *ctx, u8 cc, unsigned int target)
+{
+	EMIT(ctx, 0x0f, 0x80 | cc);	/* jcc rel32 */
+	emit_rel32(ctx, target);
+}
+
+static
+void emit_call(struct filter_jit_ctx *ctx, void *func)
+{
+	EMIT(ctx, 0xe8);		/* call rel32 */
+	if (ctx->image) {
+		long rel = (long) func
+			- (long) (ctx->image + ctx->len + sizeof(u32));
+
+		if (rel != (s32) rel)
+			ctx->error = -ERANGE;
+		emit_u32(ctx, (u32) rel);
+	} else {
+		emit_u32(ctx, 0);
+	}
+}
+
+/* %rax = (%rax != 0) */
+static
+void emit_normalize_ax(struct filter_jit_ctx *ctx)
+{
+	EMIT(ctx, 0x48, 0x85, 0xc0);	/* test %rax,%rax */
+	EMIT(ctx, 0x0f, 0x95, 0xc0);	/* setne %al */
+	EMIT(ctx, 0x0f, 0xb6, 0xc0);	/* movzbl %al,%eax */
+}
+
+/* %rax = (BX <cc> AX), pop BX. */
+static
+void emit_cmp_s64(struct filter_jit_ctx *ctx, u8 cc)
+{
+	EMIT(ctx, 0x59);		/* pop %rcx */
+	EMIT(ctx, 0x48, 0x39, 0xc1);	/* cmp %rax,%rcx */
+	EMIT(ctx, 0x0f, 0x90 | cc, 0xc0);	/* setcc %al */
+	EMIT(ctx, 0x0f, 0xb6, 0xc0);	/* movzbl %al,%eax */
+}
+
+static
+void emit_load_stack_data(struct filter_jit_ctx *ctx, u32 offset)
+{
+	EMIT(ctx, 0x50);		/* push %rax */
+	EMIT(ctx, 0x49, 0x8b, 0x84, 0x24);	/* mov disp32(%r12),%rax */
+	emit_u32(ctx, offset);
+}
+
+static
+void emit_load_context(struct filter_jit_ctx *ctx, u32 idx)
+{
+	EMIT(ctx, 0x50);		/* push %rax */
+	EMIT(ctx, 0x48, 0x89, 0xdf);	/* mov %rbx,%rdi */
+	EMIT(ctx, 0xbe);		/* mov $imm32,%esi */
+	emit_u32(ctx, idx);
+	emit_call(ctx, filter_jit_get_context_s64);
+}
+
+/*
+ * Match a "get root; get index u16; load field s64/u64" sequence
+ * produced by the specializer for integer payload and context fields.
+ * Return the index data on success, NULL otherwise.
+ */
+static
+const struct filter_get_index_data *match_root_index_load(
+		struct filter_jit_ctx *ctx, void *pc, void *end_pc)
+{
+	struct bytecode_runtime *runtime = ctx->runtime;
+	struct load_op *index_insn, *load_insn;
+	const struct filter_get_index_data *gid;
+	uint16_t index;
+
+	index_insn = pc + sizeof(struct load_op);
+	load_insn = (void *) index_insn + sizeof(struct load_op)
+			+ sizeof(struct get_index_u16);
+	if ((void *) load_insn + sizeof(struct load_op) > end_pc)
+		return NULL;
+	if (index_insn->op != FILTER_OP_GET_INDEX_U16)
+		return NULL;
+	if (load_insn->op != FILTER_OP_LOAD_FIELD_S64
+			&& load_insn->op != FILTER_OP_LOAD_FIELD_U64)
+		return NULL;
+	index = ((struct get_index_u16 *) index_insn->data)->index;
+	if (index + sizeof(*gid) > runtime->data_len)
+		return NULL;
+	gid = (const struct filter_get_index_data *) &runtime->data[index];
+	if (gid->elem.type != OBJECT_TYPE_S64
+			&& gid->elem.type != OBJECT_TYPE_U64)
+		return NULL;
+	if (gid->elem.rev_bo)
+		return NULL;
+	return gid;
+}
+
+/*
+ * The sizing pass records the native offset of each instruction it
+ * emits, all of which follow the prologue. In the emission pass, a zero
+ * offset means the skip target does not start an emitted instruction,
+ * e.g. it lands inside a fused sequence: leave it to the interpreter.
+ */
+static
+bool skip_target_valid(struct filter_jit_ctx *ctx, uint16_t skip_offset)
+{
+	if (skip_offset > ctx->runtime->len)
+		return false;
+	return !ctx->image || ctx->addrs[skip_offset];
+}
+
+#define ROOT_INDEX_LOAD_LEN	(2 * sizeof(struct load_op)		\
+		+ sizeof(struct get_index_u16) + sizeof(struct load_op))
+
+static
+int filter_jit_emit(struct filter_jit_ctx *ctx)
+{
+	struct bytecode_runtime *runtime = ctx->runtime;
+	void *pc, *next_pc, *start_pc, *end_pc;
+
+	/* Prologue */
+	EMIT(ctx, 0x55);		/* push %rbp */
+	EMIT(ctx, 0x48, 0x89, 0xe5);	/* mov %rsp,%rbp */
+	EMIT(ctx, 0x53);		/* push %rbx */
+	EMIT(ctx, 0x41, 0x54);		/* push %r12 */
+	EMIT(ctx, 0x48, 0x89, 0xf3);	/* mov %rsi,%rbx */
+	EMIT(ctx, 0x49, 0x89, 0xd4);	/* mov %rdx,%r12 */
+	EMIT(ctx, 0x31, 0xc0);		/* xor %eax,%eax */
+
+	start_pc = &runtime->code[0];
+	end_pc = start_pc + runtime->len;
+	for (pc = next_pc = start_pc; pc < end_pc; pc = next_pc) {
+		ctx->addrs[pc - start_pc] = ctx->len;
+
+		switch (*(filter_opcode_t *) pc) {
+		case FILTER_OP_RETURN:
+		case FILTER_OP_RETURN_S64:
+			/* LTTNG_FILTER_DISCARD or LTTNG_FILTER_RECORD_FLAG */
+			emit_normalize_ax(ctx);
+			emit_jmp(ctx, ctx->exit_off);
+			next_pc += sizeof(struct return_op);
+			break;
+
+		case FILTER_OP_EQ_S64:
+			emit_cmp_s64(ctx, X86_CC_E);
+			next_pc += sizeof(struct binary_op);
+			break;
+		case FILTER_OP_NE_S64:
+			emit_cmp_s64(ctx, X86_CC_NE);
+			next_pc += sizeof(struct binary_op);
+			break;
+		case FILTER_OP_GT_S64:
+			emit_cmp_s64(ctx, X86_CC_G);
+			next_pc += sizeof(struct binary_op);
+			break;
+		case FILTER_OP_LT_S64:
+			emit_cmp_s64(ctx, X86_CC_L);
+			next_pc += sizeof(struct binary_op);
+			break;
+		case FILTER_OP_GE_S64:
+			emit_cmp_s64(ctx, X86_CC_GE);
+			next_pc += sizeof(struct binary_op);
+			break;
+		case FILTER_OP_LE_S64:
+			emit_cmp_s64(ctx, X86_CC_LE);
+			next_pc += sizeof(struct binary_op);
+			break;
+
+		case FILTER_OP_BIT_RSHIFT:
+		case FILTER_OP_BIT_LSHIFT:
+			/* Catch undefined behavior: discard the event. */
+			EMIT(ctx, 0x48, 0x83, 0xf8, 0x3f);	/* cmp $63,%rax */
+			emit_jcc(ctx, X86_CC_A, ctx->err_off);
+			EMIT(ctx, 0x59);		/* pop %rcx */
+			EMIT(ctx, 0x48, 0x91);		/* xchg %rax,%rcx */
+			if (*(filter_opcode_t *) pc == FILTER_OP_BIT_RSHIFT)
+				EMIT(ctx, 0x48, 0xd3, 0xe8);	/* shr %cl,%rax */
+			else
+				EMIT(ctx, 0x48, 0xd3, 0xe0);	/* shl %cl,%rax */
+			next_pc += sizeof(struct binary_op);
+			break;
+		case FILTER_OP_BIT_AND:
+			EMIT(ctx, 0x59);		/* pop %rcx */
+			EMIT(ctx, 0x48, 0x21, 0xc8);	/* and %rcx,%rax */
+			next_pc += sizeof(struct binary_op);
+			break;
+		case FILTER_OP_BIT_OR:
+			EMIT(ctx, 0x59);		/* pop %rcx */
+			EMIT(ctx, 0x48, 0x09, 0xc8);	/* or %rcx,%rax */
+			next_pc += sizeof(struct binary_op);
+			break;
+		case FILTER_OP_BIT_XOR:
+			EMIT(ctx, 0x59);		/* pop %rcx */
+			EMIT(ctx, 0x48, 0x31, 0xc8);	/* xor %rcx,%rax */
+			next_pc += sizeof(struct binary_op);
+			break;
+
+		case FILTER_OP_UNARY_BIT_NOT:
+			EMIT(ctx, 0x48, 0xf7, 0xd0);	/* not %rax */
+			next_pc += sizeof(struct unary_op);
+			break;
+		case FILTER_OP_UNARY_PLUS_S64:
+			next_pc += sizeof(struct unary_op);
+			break;
+		case FILTER_OP_UNARY_MINUS_S64:
+			EMIT(ctx, 0x48, 0xf7, 0xd8);	/* neg %rax */
+			next_pc += sizeof(struct unary_op);
+			break;
+		case FILTER_OP_UNARY_NOT_S64:
+			EMIT(ctx, 0x48, 0x85, 0xc0);	/* test %rax,%rax */
+			EMIT(ctx, 0x0f, 0x94, 0xc0);	/* sete %al */
+			EMIT(ctx, 0x0f, 0xb6, 0xc0);	/* movzbl %al,%eax */
+			next_pc += sizeof(struct unary_op);
+			break;
+
+		case FILTER_OP_AND:
+		{
+			struct logical_op *insn = (struct logical_op *) pc;
+
+			if (!skip_target_valid(ctx, insn->skip_offset))
+				return -EINVAL;
+			/* If AX is 0, skip and evaluate to 0 */
+			EMIT(ctx, 0x48, 0x85, 0xc0);	/* test %rax,%rax */
+			emit_jcc(ctx, X86_CC_E, ctx->addrs[insn->skip_offset]);
+			/* Pop 1 when jump not taken */
+			EMIT(ctx, 0x58);		/* pop %rax */
+			next_pc += sizeof(struct logical_op);
+			break;
+		}
+		case FILTER_OP_OR:
+		{
+			struct logical_op *insn = (struct logical_op *) pc;
+
+			if (!skip_target_valid(ctx, insn->skip_offset))
+				return -EINVAL;
+			/* If AX is nonzero, skip and evaluate to 1 */
+			EMIT(ctx, 0x48, 0x85, 0xc0);	/* test %rax,%rax */
+			EMIT(ctx, 0x74, 0x0a);		/* je over mov and jmp */
+			EMIT(ctx, 0xb8, 0x01, 0x00, 0x00, 0x00);	/* mov $1,%eax */
+			emit_jmp(ctx, ctx->addrs[insn->skip_offset]);
+			/* Pop 1 when jump not taken */
+			EMIT(ctx, 0x58);		/* pop %rax */
+			next_pc += sizeof(struct logical_op);
+			break;
+		}
+
+		case FILTER_OP_LOAD_S64:
+		{
+			struct load_op *insn = (struct load_op *) pc;
+
+			EMIT(ctx, 0x50);		/* push %rax */
+			EMIT(ctx, 0x48, 0xb8);		/* movabs $imm64,%rax */
+			emit_u64(ctx, ((struct literal_numeric *) insn->data)->v);
+			next_pc += sizeof(struct load_op)
+					+ sizeof(struct literal_numeric);
+			break;
+		}
+
+		case FILTER_OP_LOAD_FIELD_REF_S64:
+		{
+			struct load_op *insn = (struct load_op *) pc;
+			struct field_ref *ref = (struct field_ref *) insn->data;
+
+			emit_load_stack_data(ctx, ref->offset);
+			next_pc += sizeof(struct load_op) + sizeof(struct field_ref);
+			break;
+		}
+
+		case FILTER_OP_GET_CONTEXT_REF_S64:
+		{
+			struct load_op *insn = (struct load_op *) pc;
+			struct field_ref *ref = (struct field_ref *) insn->data;
+
+			emit_load_context(ctx, ref->offset);
+			next_pc += sizeof(struct load_op) + sizeof(struct field_ref);
+			break;
+		}
+
+		case FILTER_OP_GET_PAYLOAD_ROOT:
+		{
+			const struct filter_get_index_data *gid;
+
+			gid = match_root_index_load(ctx, pc, end_pc);
+			if (!gid || gid->offset > INT_MAX)
+				goto unsupported;
+			emit_load_stack_data(ctx, (u32) gid->offset);
+			next_pc += ROOT_INDEX_LOAD_LEN;
+			break;
+		}
+
+		case FILTER_OP_GET_CONTEXT_ROOT:
+		{
+			const struct filter_get_index_data *gid;
+
+			gid = match_root_index_load(ctx, pc, end_pc);
+			if (!gid)
+				goto unsupported;
+			emit_load_context(ctx, (u32) gid->ctx_index);
+			next_pc += ROOT_INDEX_LOAD_LEN;
+			break;
+		}
+
+		case FILTER_OP_CAST_NOP:
+			next_pc += sizeof(struct cast_op);
+			break;
+
+		default:
+			goto unsupported;
+		}
+	}
+	ctx->addrs[runtime->len] = ctx->len;
+
+	/* Reaching the end of bytecode without return discards the event. */
+	ctx->err_off = ctx->len;
+	EMIT(ctx, 0x31, 0xc0);		/* xor %eax,%eax */
+
+	/* Epilogue */
+	ctx->exit_off = ctx->len;
+	EMIT(ctx, 0x48, 0x8d, 0x65, 0xf0);	/* lea -16(%rbp),%rsp */
+	EMIT(ctx, 0x41, 0x5c);		/* pop %r12 */
+	EMIT(ctx, 0x5b);		/* pop %rbx */
+	EMIT(ctx, 0x5d);		/* pop %rbp */
+	EMIT(ctx, 0xc3);		/* ret */
+	return ctx->error;
+
+unsupported:
+	dbg_printk("JIT: unsupported bytecode op %s (%u), using interpreter\n",
+		lttng_filter_print_op((unsigned int) *(filter_opcode_t *) pc),
+		(unsigned int) *(filter_opcode_t *) pc);
+	return -EINVAL;
+}
+
+/*
+ * Compile a validated and specialized bytecode runtime. On success, the
+ * native code is installed in runtime->jit_image. On failure, the
+ * runtime is left untouched and the interpreter should be used.
+ */
+int lttng_filter_jit_compile(struct bytecode_runtime *runtime)
+{
+	struct filter_jit_ctx ctx;
+	unsigned int nr_pages;
+	void *image;
+	int ret;
+
+	if (!filter_jit_enable)
+		return -ENOSYS;
+	ret = filter_jit_lookup_symbols();
+	if (ret)
+		return ret;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.runtime = runtime;
+	ctx.addrs = kcalloc(runtime->len + 1, sizeof(*ctx.addrs), GFP_KERNEL);
+	if (!ctx.addrs)
+		return -ENOMEM;
+
+	/* Sizing pass. */
+	ret = filter_jit_emit(&ctx);
+	if (ret)
+		goto end;
+
+	nr_pages = DIV_ROUND_UP(ctx.len, PAGE_SIZE);
+	image = module_alloc_sym(nr_pages * PAGE_SIZE);
+	if (!image) {
+		ret = -ENOMEM;
+		goto end;
+	}
+	/* Fill with int3 padding. */
+	memset(image, 0xcc, nr_pages * PAGE_SIZE);
+
+	/* Emission pass, using offsets computed by the sizing pass. */
+	ctx.image = image;
+	ctx.len = 0;
+	ret = filter_jit_emit(&ctx);
+	if (ret) {
+		module_memfree_sym(image);
+		goto end;
+	}
+	set_memory_ro_sym((unsigned long) image, nr_pages);
+	set_memory_x_sym((unsigned long) image, nr_pages);
+
+	runtime->jit_image = image;
+	runtime->jit_nr_pages = nr_pages;
+	dbg_printk("JIT: compiled %u bytes of bytecode into %u bytes\n",
+		(unsigned int) runtime->len, ctx.len);
+end:
+	kfree(ctx.addrs);
+	return ret;
+}
+
+/*
+ * Free native code. The caller must ensure no tracing probe can still
+ * be executing it.
+ */
+void lttng_filter_jit_free(struct bytecode_runtime *runtime)
+{
+	unsigned long addr = (unsigned long) runtime->jit_image;
+
+	if (!runtime->jit_image)
+		return;
+	set_memory_nx_sym(addr, runtime->jit_nr_pages);
+	set_memory_rw_sym(addr, runtime->jit_nr_pages);
+	module_memfree_sym(runtime->jit_image);
+	runtime->jit_image = NULL;
+	runtime->jit_nr_pages = 0;
+}
@@ -0,0 +1,145 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * lttng-filter-memo.c
+ *
+ * LTTng modules filter per-task result cache.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/hash.h>
+#include <linux/atomic.h>
+
+#include <lttng-filter.h>
+
+/*
+ * Filters which only read the procname, pid, tid, vpid and vtid
+ * contexts evaluate to the same result for a task as long as its name
+ * and pid are unchanged, which only happens on exec or comm change.
+ * Their result is cached in a small per-cpu table, keyed by the task,
+ * its pid and name, and a filter identifier which is never reused.
+ * Keeping the name and pid in the key, rather than invalidating the
+ * entries from the exec and comm change tracepoints, is immune to the
+ * rename tracepoint firing before the new name is stored, and to
+ * renames done through /proc while the task runs on another cpu.
+ *
+ * Entries are only accessed on the local cpu, with preemption disabled,
+ * but an interrupt or NMI may nest over an access. Updates make the cpu
+ * sequence count odd: lookups nested over an update miss, updates
+ * nested over an update are dropped, and a lookup interrupted by an
+ * update sees the count change and misses.
+ */
+
+#define LTTNG_FILTER_MEMO_BITS	6
+
+struct lttng_filter_memo_entry {
+	struct task_struct *task;
+	uint64_t memo_id;
+	uint64_t comm[TASK_COMM_LEN / sizeof(uint64_t)];
+	pid_t pid;
+	uint64_t result;
+};
+
+struct lttng_filter_memo_cpu {
+	unsigned int seq;
+	struct lttng_filter_memo_entry entries[1U << LTTNG_FILTER_MEMO_BITS];
+};
+
+static int filter_memo_enable = 1;
+module_param_named(filter_memo, filter_memo_enable, int, 0644);
+MODULE_PARM_DESC(filter_memo, "Cache per-task results of filters only reading task contexts (0: disabled, 1: enabled)");
+
+static DEFINE_PER_CPU(struct lttng_filter_memo_cpu, filter_memo);
+static atomic64_t filter_memo_ids = ATOMIC64_INIT(0);
+
+/* Return a new filter identifier, never 0. */
+uint64_t lttng_filter_memo_new_id(void)
+{
+	return atomic64_inc_return(&filter_memo_ids);
+}
+
+/*
+ * Whether a context name is one of the contexts fixed for a task until
+ * exec or comm change.
+ */
+bool lttng_filter_memo_context(const char *name)
+{
+	static const char * const names[] = {
+		"procname", "pid", "tid", "vpid", "vtid",
+	};
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(names); i++) {
+		if (!strcmp(name, names[i]))
+			return true;
+	}
+	return false;
+}
+
+static
+bool memo_entry_match(const struct lttng_filter_memo_entry *entry,
+		struct task_struct *task, uint64_t memo_id,
+		const uint64_t *comm)
+{
+	return entry->task == task && entry->memo_id == memo_id
+		&& entry->pid == task->pid
+		&& entry->comm[0] == comm[0] && entry->comm[1] == comm[1];
+}
+
+/*
+ * Filter callback of runtimes with a memo_id, wrapping the callback
+ * selected for the bytecode.
+ */
+uint64_t lttng_filter_memo(void *filter_data,
+		struct lttng_probe_ctx *lttng_probe_ctx,
+		const char *filter_stack_data)
+{
+	struct bytecode_runtime *runtime = filter_data;
+	struct task_struct *task = current;
+	struct lttng_filter_memo_cpu *memo;
+	struct lttng_filter_memo_entry *entry;
+	uint64_t comm[ARRAY_SIZE(entry->comm)], result;
+	unsigned int seq;
+
+	BUILD_BUG_ON(sizeof(comm) != TASK_COMM_LEN);
+	if (!READ_ONCE(filter_memo_enable))
+		return runtime->memo_filter(filter_data, lttng_probe_ctx,
+				filter_stack_data);
+	memcpy(comm, task->comm, sizeof(comm));
+	memo = this_cpu_ptr(&filter_memo);
+	entry = &memo->entries[hash_64((unsigned long) task ^ runtime->memo_id,
+			LTTNG_FILTER_MEMO_BITS)];
+
+	seq = READ_ONCE(memo->seq);
+	if (likely(!(seq & 1))) {
+		barrier();
+		if (memo_entry_match(entry, task, runtime->memo_id, comm)) {
+			result = entry->result;
+			barrier();
+			if (likely(READ_ONCE(memo->seq) == seq))
+				return result;
+		}
+	}
+
+	result = runtime->memo_filter(filter_data, lttng_probe_ctx,
+			filter_stack_data);
+
+	seq = READ_ONCE(memo->seq);
+	if (seq & 1)
+		return result;	/* Nested over an update. */
+	WRITE_ONCE(memo->seq, seq + 1);
+	barrier();
+	entry->task = task;
+	entry->memo_id = runtime->memo_id;
+	entry->comm[0] = comm[0];
+	entry->comm[1] = comm[1];
+	entry->pid = task->pid;
+	entry->result = result;
+	barrier();
+	WRITE_ONCE(memo->seq, seq + 2);
+	return result;
+}
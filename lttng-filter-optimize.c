@@ -0,0 +1,705 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * lttng-filter-optimize.c
+ *
+ * LTTng modules filter bytecode optimizer.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <wrapper/vmalloc.h>
+
+#include <lttng-filter.h>
+
+/*
+ * Rewrite validated bytecode before specialization:
+ *
+ * - Operators applied to s64 immediates are folded into an immediate,
+ *   e.g. "1 == 1" becomes "1".
+ * - Logical operators with an immediate first operand are removed, along
+ *   with the second operand when it can never be evaluated: "0 && x"
+ *   becomes "0", "1 && x" becomes "x".
+ * - A logical operator applied twice to the same comparison, e.g.
+ *   "a == 1 && a == 1", keeps a single comparison.
+ * - Set and range membership tests of immediates are folded as well.
+ * - Instructions following the first return are removed.
+ *
+ * The pass simulates the stack linearly, and does not track values
+ * across jump targets. Instructions are only ever removed, or replaced
+ * by an immediate load no larger than the instructions it replaces, so
+ * the bytecode never grows. Jump offsets are relocated to the new
+ * layout. The rewritten bytecode is validated again, and the original
+ * bytecode is kept if validation fails.
+ */
+
+static int filter_optimize_enable = 1;
+module_param_named(filter_optimize, filter_optimize_enable, int, 0644);
+MODULE_PARM_DESC(filter_optimize, "Optimize filter bytecode (0: disabled, 1: enabled)");
+
+struct filter_opt_insn {
+	uint16_t offset;		/* In the original bytecode */
+	uint16_t len;
+	uint16_t new_offset;
+	uint16_t target;		/* Logical ops: target insn index */
+	unsigned int join_start;	/* Jump targets: expression start */
+	int64_t fold;			/* Value of the folded immediate */
+	unsigned int deleted:1;
+	unsigned int folded:1;		/* Replaced by a load of "fold" */
+	unsigned int is_target:1;
+};
+
+struct filter_opt_entry {
+	unsigned int start;		/* First insn of the expression */
+	unsigned int producer;		/* Constants: insn loading the value */
+	int64_t v;
+	unsigned int is_const:1;
+	unsigned int boolean:1;		/* Value is 0 or 1 */
+};
+
+struct filter_opt_ctx {
+	struct bytecode_runtime *runtime;
+	struct filter_opt_insn *insns;
+	unsigned int nr_insns;
+	unsigned int end;		/* Insn index of the end of bytecode */
+	struct filter_opt_entry stack[FILTER_STACK_LEN];
+	int depth;
+	int changed;
+};
+
+static
+size_t opt_insn_len(struct bytecode_runtime *runtime, char *pc)
+{
+	struct load_op *insn = (struct load_op *) pc;
+
+	switch (*(filter_opcode_t *) pc) {
+	case FILTER_OP_RETURN:
+	case FILTER_OP_RETURN_S64:
+		return sizeof(struct return_op);
+	case FILTER_OP_MUL ... FILTER_OP_BIT_XOR:
+	case FILTER_OP_EQ ... FILTER_OP_LE_S64_DOUBLE:
+	case FILTER_OP_EQ_STAR_GLOB_STRING:
+	case FILTER_OP_NE_STAR_GLOB_STRING:
+		return sizeof(struct binary_op);
+	case FILTER_OP_UNARY_PLUS ... FILTER_OP_UNARY_NOT_DOUBLE:
+	case FILTER_OP_UNARY_BIT_NOT:
+		return sizeof(struct unary_op);
+	case FILTER_OP_AND:
+	case FILTER_OP_OR:
+		return sizeof(struct logical_op);
+	case FILTER_OP_LOAD_FIELD_REF ... FILTER_OP_LOAD_FIELD_REF_DOUBLE:
+	case FILTER_OP_GET_CONTEXT_REF ... FILTER_OP_LOAD_FIELD_REF_USER_SEQUENCE:
+		return sizeof(struct load_op) + sizeof(struct field_ref);
+	case FILTER_OP_LOAD_STRING:
+	case FILTER_OP_LOAD_STAR_GLOB_STRING:
+	{
+		size_t maxlen = runtime->len - (pc - runtime->code)
+				- sizeof(struct load_op);
+
+		return sizeof(struct load_op) + strnlen(insn->data, maxlen) + 1;
+	}
+	case FILTER_OP_LOAD_S64:
+		return sizeof(struct load_op) + sizeof(struct literal_numeric);
+	case FILTER_OP_LOAD_DOUBLE:
+		return sizeof(struct load_op) + sizeof(struct literal_double);
+	case FILTER_OP_CAST_TO_S64 ... FILTER_OP_CAST_NOP:
+		return sizeof(struct cast_op);
+	case FILTER_OP_GET_CONTEXT_ROOT ... FILTER_OP_GET_PAYLOAD_ROOT:
+	case FILTER_OP_LOAD_FIELD ... FILTER_OP_LOAD_FIELD_DOUBLE:
+		return sizeof(struct load_op);
+	case FILTER_OP_GET_SYMBOL:
+	case FILTER_OP_GET_SYMBOL_FIELD:
+		return sizeof(struct load_op) + sizeof(struct get_symbol);
+	case FILTER_OP_GET_INDEX_U16:
+		return sizeof(struct load_op) + sizeof(struct get_index_u16);
+	case FILTER_OP_GET_INDEX_U64:
+		return sizeof(struct load_op) + sizeof(struct get_index_u64);
+	case FILTER_OP_IN_SET_S64:
+		return filter_set_op_len((struct set_op *) pc);
+	case FILTER_OP_IN_RANGE_S64:
+		return sizeof(struct range_op);
+	default:
+		return 0;
+	}
+}
+
+static
+filter_opcode_t opt_op(struct filter_opt_ctx *ctx, unsigned int i)
+{
+	return *(filter_opcode_t *) &ctx->runtime->code[ctx->insns[i].offset];
+}
+
+/* Return the index of the insn at a bytecode offset, or -1. */
+static
+int opt_find(struct filter_opt_ctx *ctx, unsigned int offset)
+{
+	unsigned int lo = 0, hi = ctx->nr_insns;
+
+	if (offset == ctx->runtime->len)
+		return ctx->end;
+	while (lo < hi) {
+		unsigned int mid = lo + ((hi - lo) >> 1);
+
+		if (ctx->insns[mid].offset == offset)
+			return mid;
+		if (ctx->insns[mid].offset < offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return -1;
+}
+
+static
+int opt_decode(struct filter_opt_ctx *ctx)
+{
+	struct bytecode_runtime *runtime = ctx->runtime;
+	unsigned int offset = 0, i;
+	size_t len;
+
+	while (offset < runtime->len) {
+		struct filter_opt_insn *insn = &ctx->insns[ctx->nr_insns++];
+
+		len = opt_insn_len(runtime, &runtime->code[offset]);
+		if (!len || offset + len > runtime->len)
+			return -EINVAL;
+		insn->offset = offset;
+		insn->len = len;
+		offset += len;
+	}
+	/* Sentinel insn for the end of bytecode. */
+	ctx->end = ctx->nr_insns;
+	ctx->insns[ctx->end].offset = runtime->len;
+	for (i = 0; i < ctx->nr_insns; i++) {
+		struct logical_op *op;
+		int target;
+
+		if (opt_op(ctx, i) != FILTER_OP_AND
+				&& opt_op(ctx, i) != FILTER_OP_OR)
+			continue;
+		op = (struct logical_op *) &runtime->code[ctx->insns[i].offset];
+		target = opt_find(ctx, op->skip_offset);
+		if (target <= (int) i)
+			return -EINVAL;
+		ctx->insns[i].target = target;
+		ctx->insns[target].is_target = 1;
+		ctx->insns[target].join_start = UINT_MAX;
+	}
+	return 0;
+}
+
+/* Whether a jump targets an insn of [from, to). */
+static
+bool opt_range_has_target(struct filter_opt_ctx *ctx, unsigned int from,
+		unsigned int to)
+{
+	unsigned int i;
+
+	for (i = from; i < to; i++) {
+		if (ctx->insns[i].is_target)
+			return true;
+	}
+	return false;
+}
+
+/* Whether [from, to) holds a logical operator still in the code. */
+static
+bool opt_range_has_jump(struct filter_opt_ctx *ctx, unsigned int from,
+		unsigned int to)
+{
+	unsigned int i;
+
+	for (i = from; i < to; i++) {
+		if (ctx->insns[i].deleted)
+			continue;
+		if (opt_op(ctx, i) == FILTER_OP_AND
+				|| opt_op(ctx, i) == FILTER_OP_OR)
+			return true;
+	}
+	return false;
+}
+
+/* Whether a jump from before "from" targets an insn of (from, to). */
+static
+bool opt_range_entered(struct filter_opt_ctx *ctx, unsigned int from,
+		unsigned int to)
+{
+	unsigned int i;
+
+	for (i = 0; i < from; i++) {
+		struct filter_opt_insn *insn = &ctx->insns[i];
+
+		if (insn->deleted || (opt_op(ctx, i) != FILTER_OP_AND
+				&& opt_op(ctx, i) != FILTER_OP_OR))
+			continue;
+		if (insn->target > from && insn->target < to)
+			return true;
+	}
+	return false;
+}
+
+static
+void opt_delete(struct filter_opt_ctx *ctx, unsigned int from,
+		unsigned int to)
+{
+	unsigned int i;
+
+	for (i = from; i < to; i++)
+		ctx->insns[i].deleted = 1;
+	ctx->changed = 1;
+}
+
+static
+void opt_fold(struct filter_opt_ctx *ctx, unsigned int start, unsigned int i,
+		int64_t v, struct filter_opt_entry *result)
+{
+	opt_delete(ctx, start, i);
+	ctx->insns[i].folded = 1;
+	ctx->insns[i].fold = v;
+	result->start = start;
+	result->producer = i;
+	result->v = v;
+	result->is_const = 1;
+	result->boolean = v == 0 || v == 1;
+}
+
+static
+bool opt_is_compare(filter_opcode_t op)
+{
+	switch (op) {
+	case FILTER_OP_EQ ... FILTER_OP_LE_S64_DOUBLE:
+	case FILTER_OP_EQ_STAR_GLOB_STRING:
+	case FILTER_OP_NE_STAR_GLOB_STRING:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Compute the value of an operator applied to immediates. Return false
+ * if it cannot be folded: arithmetic operators are rejected at runtime,
+ * and out of range shifts discard the event.
+ */
+static
+bool opt_eval_binary(filter_opcode_t op, int64_t bx, int64_t ax, int64_t *v)
+{
+	switch (op) {
+	case FILTER_OP_EQ:
+	case FILTER_OP_EQ_S64:
+		*v = bx == ax;
+		return true;
+	case FILTER_OP_NE:
+	case FILTER_OP_NE_S64:
+		*v = bx != ax;
+		return true;
+	case FILTER_OP_GT:
+	case FILTER_OP_GT_S64:
+		*v = bx > ax;
+		return true;
+	case FILTER_OP_LT:
+	case FILTER_OP_LT_S64:
+		*v = bx < ax;
+		return true;
+	case FILTER_OP_GE:
+	case FILTER_OP_GE_S64:
+		*v = bx >= ax;
+		return true;
+	case FILTER_OP_LE:
+	case FILTER_OP_LE_S64:
+		*v = bx <= ax;
+		return true;
+	case FILTER_OP_BIT_RSHIFT:
+		if (ax < 0 || ax >= 64)
+			return false;
+		*v = (uint64_t) bx >> (uint32_t) ax;
+		return true;
+	case FILTER_OP_BIT_LSHIFT:
+		if (ax < 0 || ax >= 64)
+			return false;
+		*v = (uint64_t) bx << (uint32_t) ax;
+		return true;
+	case FILTER_OP_BIT_AND:
+		*v = (uint64_t) bx & (uint64_t) ax;
+		return true;
+	case FILTER_OP_BIT_OR:
+		*v = (uint64_t) bx | (uint64_t) ax;
+		return true;
+	case FILTER_OP_BIT_XOR:
+		*v = (uint64_t) bx ^ (uint64_t) ax;
+		return true;
+	default:
+		return false;
+	}
+}
+
+static
+bool opt_eval_unary(filter_opcode_t op, int64_t ax, int64_t *v)
+{
+	switch (op) {
+	case FILTER_OP_UNARY_PLUS:
+	case FILTER_OP_UNARY_PLUS_S64:
+		*v = ax;
+		return true;
+	case FILTER_OP_UNARY_MINUS:
+	case FILTER_OP_UNARY_MINUS_S64:
+		*v = -ax;
+		return true;
+	case FILTER_OP_UNARY_NOT:
+	case FILTER_OP_UNARY_NOT_S64:
+		*v = !ax;
+		return true;
+	case FILTER_OP_UNARY_BIT_NOT:
+		*v = ~(uint64_t) ax;
+		return true;
+	default:
+		return false;
+	}
+}
+
+static
+int64_t opt_eval_membership(char *pc, int64_t ax)
+{
+	if (*(filter_opcode_t *) pc == FILTER_OP_IN_RANGE_S64) {
+		struct range_op *insn = (struct range_op *) pc;
+
+		return ax >= insn->lo && ax <= insn->hi;
+	} else {
+		struct set_op *insn = (struct set_op *) pc;
+		unsigned int i;
+
+		for (i = 0; i < insn->nr_values; i++) {
+			if (insn->values[i] == ax)
+				return 1;
+		}
+		return 0;
+	}
+}
+
+static
+struct filter_opt_entry *opt_push(struct filter_opt_ctx *ctx, unsigned int i)
+{
+	struct filter_opt_entry *entry;
+
+	if (ctx->depth >= FILTER_STACK_LEN)
+		return NULL;
+	entry = &ctx->stack[ctx->depth++];
+	memset(entry, 0, sizeof(*entry));
+	entry->start = i;
+	return entry;
+}
+
+/*
+ * Simplify a logical operator. Return the index of the next insn to
+ * simulate.
+ */
+static
+unsigned int opt_logical(struct filter_opt_ctx *ctx, unsigned int i)
+{
+	struct filter_opt_insn *insn = &ctx->insns[i];
+	struct filter_opt_entry *ax = &ctx->stack[ctx->depth - 1];
+	bool is_and = opt_op(ctx, i) == FILTER_OP_AND;
+	unsigned int target = insn->target;
+	unsigned int start = ax->start;
+
+	ctx->insns[target].join_start = min(ctx->insns[target].join_start,
+			start);
+	if (ax->is_const && !opt_range_has_target(ctx, start + 1, i)) {
+		if (is_and == !ax->v) {
+			/* Always jumps: the second operand is dead. */
+			if (!opt_range_entered(ctx, i, target)) {
+				/* "x || y" evaluates to 1 for nonzero x. */
+				if (!is_and && ax->v != 1) {
+					ctx->insns[ax->producer].folded = 1;
+					ctx->insns[ax->producer].fold = 1;
+				}
+				opt_delete(ctx, i, target);
+				return target;
+			}
+		} else {
+			/* Never jumps: the first operand is dead. */
+			opt_delete(ctx, start, i + 1);
+			ctx->depth--;
+			return i + 1;
+		}
+	}
+	/*
+	 * Same comparison on both sides: "x && x" and "x || x"
+	 * evaluate to x when x is 0 or 1.
+	 */
+	if (ax->boolean && target > i + 1
+			&& !opt_range_has_target(ctx, start + 1, i + 1)
+			&& !opt_range_has_target(ctx, i + 2, target)
+			&& !opt_range_has_jump(ctx, start, i)
+			&& !opt_range_has_jump(ctx, i + 1, target)
+			&& !opt_range_entered(ctx, i, target)) {
+		struct bytecode_runtime *runtime = ctx->runtime;
+		unsigned int first = start, second = i + 1;
+		bool same = true;
+
+		while (first < i || second < target) {
+			struct filter_opt_insn *a, *b;
+
+			while (first < i && ctx->insns[first].deleted)
+				first++;
+			while (second < target && ctx->insns[second].deleted)
+				second++;
+			if (first == i || second == target) {
+				same = first == i && second == target;
+				break;
+			}
+			a = &ctx->insns[first++];
+			b = &ctx->insns[second++];
+			if (a->folded || b->folded) {
+				same = a->folded && b->folded
+					&& a->fold == b->fold;
+			} else {
+				same = a->len == b->len
+					&& !memcmp(&runtime->code[a->offset],
+						&runtime->code[b->offset],
+						a->len);
+			}
+			if (!same)
+				break;
+		}
+		if (same) {
+			opt_delete(ctx, i, target);
+			return target;
+		}
+	}
+	/* Pop 1 when jump not taken */
+	ctx->depth--;
+	return i + 1;
+}
+
+static
+int opt_simulate(struct filter_opt_ctx *ctx)
+{
+	unsigned int i = 0;
+
+	while (i < ctx->nr_insns) {
+		struct filter_opt_insn *insn = &ctx->insns[i];
+		filter_opcode_t op = opt_op(ctx, i);
+		struct filter_opt_entry *ax, *bx;
+		int64_t v;
+
+		if (insn->is_target && ctx->depth > 0) {
+			/* Values are not tracked across jumps. */
+			ax = &ctx->stack[ctx->depth - 1];
+			ax->is_const = 0;
+			ax->boolean = 0;
+			ax->start = min(ax->start, insn->join_start);
+		}
+		switch (op) {
+		case FILTER_OP_RETURN:
+		case FILTER_OP_RETURN_S64:
+			if (i + 1 < ctx->nr_insns)
+				opt_delete(ctx, i + 1, ctx->nr_insns);
+			return 0;
+
+		case FILTER_OP_MUL ... FILTER_OP_BIT_XOR:
+		case FILTER_OP_EQ ... FILTER_OP_LE_S64_DOUBLE:
+		case FILTER_OP_EQ_STAR_GLOB_STRING:
+		case FILTER_OP_NE_STAR_GLOB_STRING:
+			if (ctx->depth < 2)
+				return -EINVAL;
+			ax = &ctx->stack[ctx->depth - 1];
+			bx = &ctx->stack[ctx->depth - 2];
+			ctx->depth--;
+			if (ax->is_const && bx->is_const
+					&& !opt_range_has_target(ctx,
+						bx->start + 1, i)
+					&& opt_eval_binary(op, bx->v, ax->v, &v)) {
+				opt_fold(ctx, bx->start, i, v, bx);
+				break;
+			}
+			bx->is_const = 0;
+			bx->boolean = opt_is_compare(op);
+			break;
+
+		case FILTER_OP_UNARY_PLUS ... FILTER_OP_UNARY_NOT_DOUBLE:
+		case FILTER_OP_UNARY_BIT_NOT:
+			if (ctx->depth < 1)
+				return -EINVAL;
+			ax = &ctx->stack[ctx->depth - 1];
+			if (ax->is_const
+					&& !opt_range_has_target(ctx,
+						ax->start + 1, i)
+					&& opt_eval_unary(op, ax->v, &v)) {
+				opt_fold(ctx, ax->start, i, v, ax);
+				break;
+			}
+			ax->is_const = 0;
+			ax->boolean = op == FILTER_OP_UNARY_NOT
+				|| op == FILTER_OP_UNARY_NOT_S64
+				|| op == FILTER_OP_UNARY_NOT_DOUBLE;
+			break;
+
+		case FILTER_OP_IN_SET_S64:
+		case FILTER_OP_IN_RANGE_S64:
+			if (ctx->depth < 1)
+				return -EINVAL;
+			ax = &ctx->stack[ctx->depth - 1];
+			if (ax->is_const
+					&& !opt_range_has_target(ctx,
+						ax->start + 1, i)) {
+				v = opt_eval_membership(
+					&ctx->runtime->code[insn->offset],
+					ax->v);
+				opt_fold(ctx, ax->start, i, v, ax);
+				break;
+			}
+			ax->is_const = 0;
+			ax->boolean = 1;
+			break;
+
+		case FILTER_OP_AND:
+		case FILTER_OP_OR:
+			if (ctx->depth < 1)
+				return -EINVAL;
+			i = opt_logical(ctx, i);
+			continue;
+
+		case FILTER_OP_LOAD_S64:
+		{
+			struct load_op *load = (struct load_op *)
+				&ctx->runtime->code[insn->offset];
+
+			ax = opt_push(ctx, i);
+			if (!ax)
+				return -EINVAL;
+			ax->producer = i;
+			ax->v = ((struct literal_numeric *) load->data)->v;
+			ax->is_const = 1;
+			ax->boolean = ax->v == 0 || ax->v == 1;
+			break;
+		}
+
+		case FILTER_OP_LOAD_FIELD_REF ... FILTER_OP_LOAD_STRING:
+		case FILTER_OP_LOAD_DOUBLE:
+		case FILTER_OP_GET_CONTEXT_REF ... FILTER_OP_LOAD_STAR_GLOB_STRING:
+		case FILTER_OP_GET_CONTEXT_ROOT ... FILTER_OP_GET_PAYLOAD_ROOT:
+			if (!opt_push(ctx, i))
+				return -EINVAL;
+			break;
+
+		case FILTER_OP_CAST_TO_S64:
+		case FILTER_OP_CAST_NOP:
+			/* Casts of s64 immediates keep their value. */
+			if (ctx->depth < 1)
+				return -EINVAL;
+			break;
+
+		case FILTER_OP_CAST_DOUBLE_TO_S64:
+		case FILTER_OP_GET_SYMBOL ... FILTER_OP_LOAD_FIELD_DOUBLE:
+			/* Pop 1, push 1 */
+			if (ctx->depth < 1)
+				return -EINVAL;
+			ax = &ctx->stack[ctx->depth - 1];
+			ax->is_const = 0;
+			ax->boolean = 0;
+			break;
+
+		default:
+			return -EINVAL;
+		}
+		i++;
+	}
+	return 0;
+}
+
+/* Emit the rewritten bytecode into "code", and relocate the jumps. */
+static
+size_t opt_emit(struct filter_opt_ctx *ctx, char *code)
+{
+	struct bytecode_runtime *runtime = ctx->runtime;
+	size_t len = 0;
+	int i;
+
+	for (i = 0; i < ctx->nr_insns; i++) {
+		struct filter_opt_insn *insn = &ctx->insns[i];
+
+		insn->new_offset = len;
+		if (insn->deleted)
+			continue;
+		if (insn->folded) {
+			struct load_op *load = (struct load_op *) &code[len];
+
+			load->op = FILTER_OP_LOAD_S64;
+			((struct literal_numeric *) load->data)->v = insn->fold;
+			len += sizeof(struct load_op)
+				+ sizeof(struct literal_numeric);
+		} else {
+			memcpy(&code[len], &runtime->code[insn->offset],
+				insn->len);
+			len += insn->len;
+		}
+	}
+	ctx->insns[ctx->end].new_offset = len;
+	/* Deleted insns are relocated to the next insn kept. */
+	for (i = ctx->nr_insns - 1; i >= 0; i--) {
+		if (ctx->insns[i].deleted)
+			ctx->insns[i].new_offset = ctx->insns[i + 1].new_offset;
+	}
+	for (i = 0; i < ctx->nr_insns; i++) {
+		struct filter_opt_insn *insn = &ctx->insns[i];
+		struct logical_op *op;
+
+		if (insn->deleted || insn->folded)
+			continue;
+		op = (struct logical_op *) &code[insn->new_offset];
+		if (op->op != FILTER_OP_AND && op->op != FILTER_OP_OR)
+			continue;
+		op->skip_offset = ctx->insns[insn->target].new_offset;
+	}
+	return len;
+}
+
+/*
+ * Optimize validated bytecode in place. Return 1 if the bytecode was
+ * rewritten, 0 if it was left untouched.
+ */
+int lttng_filter_optimize_bytecode(struct bytecode_runtime *runtime)
+{
+	struct filter_opt_ctx ctx;
+	char *code = NULL, *orig = NULL;
+	uint16_t orig_len = runtime->len;
+	size_t len;
+	int ret = 0;
+
+	if (!filter_optimize_enable || !runtime->len)
+		return 0;
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.runtime = runtime;
+	/* Each insn is at least one byte long, plus the end sentinel. */
+	ctx.insns = lttng_kvzalloc((runtime->len + 1) * sizeof(*ctx.insns),
+			GFP_KERNEL);
+	code = kmalloc(runtime->len, GFP_KERNEL);
+	orig = kmalloc(runtime->len, GFP_KERNEL);
+	if (!ctx.insns || !code || !orig)
+		goto end;
+	if (opt_decode(&ctx) || opt_simulate(&ctx) || !ctx.changed)
+		goto end;
+	len = opt_emit(&ctx, code);
+	if (WARN_ON_ONCE(len > runtime->len) || !len)
+		goto end;
+
+	memcpy(orig, runtime->code, orig_len);
+	memcpy(runtime->code, code, len);
+	runtime->len = len;
+	if (lttng_filter_validate_bytecode(runtime)) {
+		dbg_printk("Optimized bytecode failed validation, using original bytecode\n");
+		memcpy(runtime->code, orig, orig_len);
+		runtime->len = orig_len;
+		goto end;
+	}
+	dbg_printk("Optimized %u bytes of bytecode into %u bytes\n",
+		(unsigned int) orig_len, (unsigned int) len);
+	ret = 1;
+end:
+	kfree(orig);
+	kfree(code);
+	lttng_kvfree(ctx.insns);
+	return ret;
+}
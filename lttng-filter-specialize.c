@@ -7,6 +7,7 @@
  * Copyright (C) 2010-2016 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
  */
 
+#include <linux/module.h>
 #include <linux/slab.h>
 #include <lttng-filter.h>
 #include "lib/align.h"
@@ -54,6 +55,110 @@ static ssize_t bytecode_push_data(struct bytecode_runtime *runtime,
 	return offset;
 }
 
+/*
+ * Test sets of close values against a bitmap stored in the runtime
+ * data. Sets spanning a wider range, or which do not fit in the runtime
+ * data, keep the binary search.
+ */
+static void specialize_set(struct bytecode_runtime *runtime,
+		struct set_op *insn)
+{
+	struct filter_set_bitmap *bitmap;
+	uint64_t span, bit;
+	ssize_t offset;
+	unsigned int i;
+
+	span = (uint64_t) insn->values[insn->nr_values - 1]
+		- (uint64_t) insn->values[0];
+	if (span >= FILTER_SET_BITMAP_MAX_BITS)
+		return;
+	offset = bytecode_reserve_data(runtime, __alignof__(*bitmap),
+			sizeof(*bitmap) + DIV_ROUND_UP(span + 1, CHAR_BIT));
+	if (offset < 0)
+		return;
+	/* Reserved data is zeroed. */
+	bitmap = (struct filter_set_bitmap *) &runtime->data[offset];
+	bitmap->base = insn->values[0];
+	bitmap->nr_bits = span + 1;
+	for (i = 0; i < insn->nr_values; i++) {
+		bit = (uint64_t) insn->values[i] - (uint64_t) bitmap->base;
+		bitmap->bits[bit >> 3] |= 1U << (bit & 7);
+	}
+	insn->data_offset = offset;
+	insn->op = FILTER_OP_IN_SET_BITMAP_S64;
+}
+
+/*
+ * Compile a string literal into a matcher stored in the runtime data,
+ * so comparing it with a string does not interpret the literal again
+ * for each event. In a plain literal, anything matches past the first
+ * unescaped star. Literals too short to hold the matcher reference, or
+ * holding escape sequences the interpreter does not handle the same
+ * way, are left as is.
+ */
+static void specialize_load_string(struct bytecode_runtime *runtime,
+		struct load_op *insn,
+		enum estack_string_literal_type literal_type)
+{
+	const char *literal = insn->data;
+	struct load_string_matcher *ref;
+	struct filter_string_matcher *matcher;
+	struct filter_string_segment *segment;
+	size_t len = strlen(literal), nr_segments = 1, i, pos = 0;
+	ssize_t offset;
+	char *chars;
+
+	if (len + 1 < sizeof(*ref))
+		return;
+	for (i = 0; i < len; i++) {
+		if (literal[i] == '\\') {
+			if (i + 1 == len)
+				return;
+			if (literal_type == ESTACK_STRING_LITERAL_TYPE_PLAIN
+					&& literal[i + 1] != '\\'
+					&& literal[i + 1] != '*')
+				return;
+			i++;
+		} else if (literal[i] == '*') {
+			nr_segments++;
+			if (literal_type == ESTACK_STRING_LITERAL_TYPE_PLAIN)
+				break;
+		}
+	}
+	offset = bytecode_reserve_data(runtime, __alignof__(*matcher),
+			sizeof(*matcher) + nr_segments * sizeof(*segment)
+			+ 2 * len + 1);
+	if (offset < 0)
+		return;
+	matcher = (struct filter_string_matcher *) &runtime->data[offset];
+	matcher->literal_type = literal_type;
+	matcher->nr_segments = nr_segments;
+	chars = filter_string_matcher_chars(matcher);
+	segment = &matcher->segments[0];
+	for (i = 0; i < len; i++) {
+		if (literal[i] == '\\') {
+			chars[pos++] = literal[++i];
+		} else if (literal[i] == '*') {
+			segment->len = pos - segment->offset;
+			segment++;
+			segment->offset = pos;
+			if (literal_type == ESTACK_STRING_LITERAL_TYPE_PLAIN)
+				break;
+		} else {
+			chars[pos++] = literal[i];
+		}
+	}
+	segment->len = pos - segment->offset;
+	matcher->literal = pos;
+	memcpy(&chars[pos], literal, len + 1);
+
+	/* The literal is overwritten by the matcher reference. */
+	ref = (struct load_string_matcher *) insn->data;
+	ref->len = len + 1;
+	ref->data_offset = offset;
+	insn->op = FILTER_OP_LOAD_STRING_MATCHER;
+}
+
 static int specialize_load_field(struct vstack_entry *stack_top,
 		struct load_op *insn)
 {
@@ -876,6 +981,34 @@ int lttng_filter_specialize_bytecode(struct lttng_event *event,
 			break;
 		}
 
+		/* set and range */
+		case FILTER_OP_IN_SET_S64:
+		{
+			struct set_op *insn = (struct set_op *) pc;
+
+			specialize_set(bytecode, insn);
+			/* Pop 1, push 1 */
+			vstack_ax(stack)->type = REG_S64;
+			next_pc += filter_set_op_len(insn);
+			break;
+		}
+
+		case FILTER_OP_IN_SET_BITMAP_S64:
+		{
+			/* Pop 1, push 1 */
+			vstack_ax(stack)->type = REG_S64;
+			next_pc += filter_set_op_len((struct set_op *) pc);
+			break;
+		}
+
+		case FILTER_OP_IN_RANGE_S64:
+		{
+			/* Pop 1, push 1 */
+			vstack_ax(stack)->type = REG_S64;
+			next_pc += sizeof(struct range_op);
+			break;
+		}
+
 		case FILTER_OP_UNARY_PLUS_S64:
 		case FILTER_OP_UNARY_MINUS_S64:
 		case FILTER_OP_UNARY_NOT_S64:
@@ -957,26 +1090,32 @@ int lttng_filter_specialize_bytecode(struct lttng_event *event,
 		case FILTER_OP_LOAD_STRING:
 		{
 			struct load_op *insn = (struct load_op *) pc;
+			size_t len = strlen(insn->data) + 1;
 
 			if (vstack_push(stack)) {
 				ret = -EINVAL;
 				goto end;
 			}
 			vstack_ax(stack)->type = REG_STRING;
-			next_pc += sizeof(struct load_op) + strlen(insn->data) + 1;
+			specialize_load_string(bytecode, insn,
+				ESTACK_STRING_LITERAL_TYPE_PLAIN);
+			next_pc += sizeof(struct load_op) + len;
 			break;
 		}
 
 		case FILTER_OP_LOAD_STAR_GLOB_STRING:
 		{
 			struct load_op *insn = (struct load_op *) pc;
+			size_t len = strlen(insn->data) + 1;
 
 			if (vstack_push(stack)) {
 				ret = -EINVAL;
 				goto end;
 			}
 			vstack_ax(stack)->type = REG_STAR_GLOB_STRING;
-			next_pc += sizeof(struct load_op) + strlen(insn->data) + 1;
+			specialize_load_string(bytecode, insn,
+				ESTACK_STRING_LITERAL_TYPE_STAR_GLOB);
+			next_pc += sizeof(struct load_op) + len;
 			break;
 		}
 
@@ -1203,3 +1342,478 @@ int lttng_filter_specialize_bytecode(struct lttng_event *event,
 end:
 	return ret;
 }
+
+static int filter_regs_enable = 1;
+module_param_named(filter_regs, filter_regs_enable, int, 0644);
+MODULE_PARM_DESC(filter_regs, "Lower filter bytecode to the register-based interpreter (0: disabled, 1: enabled)");
+
+struct filter_lower_ctx {
+	struct bytecode_runtime *runtime;
+	struct filter_reg_insn *insns;
+	unsigned int nr_insns;
+	unsigned int *map;		/* Bytecode offset to IR index */
+	unsigned long *targets;		/* Bitmap of jump target offsets */
+	int depth;			/* Number of registers in use */
+};
+
+/*
+ * Length of an instruction of the subset handled by the register IR, or
+ * 0 if the instruction is not handled.
+ */
+static
+size_t lower_insn_len(void *pc)
+{
+	switch (*(filter_opcode_t *) pc) {
+	case FILTER_OP_RETURN:
+	case FILTER_OP_RETURN_S64:
+		return sizeof(struct return_op);
+	case FILTER_OP_EQ_S64:
+	case FILTER_OP_NE_S64:
+	case FILTER_OP_GT_S64:
+	case FILTER_OP_LT_S64:
+	case FILTER_OP_GE_S64:
+	case FILTER_OP_LE_S64:
+	case FILTER_OP_BIT_RSHIFT:
+	case FILTER_OP_BIT_LSHIFT:
+	case FILTER_OP_BIT_AND:
+	case FILTER_OP_BIT_OR:
+	case FILTER_OP_BIT_XOR:
+		return sizeof(struct binary_op);
+	case FILTER_OP_UNARY_BIT_NOT:
+	case FILTER_OP_UNARY_PLUS_S64:
+	case FILTER_OP_UNARY_MINUS_S64:
+	case FILTER_OP_UNARY_NOT_S64:
+		return sizeof(struct unary_op);
+	case FILTER_OP_AND:
+	case FILTER_OP_OR:
+		return sizeof(struct logical_op);
+	case FILTER_OP_LOAD_S64:
+		return sizeof(struct load_op) + sizeof(struct literal_numeric);
+	case FILTER_OP_LOAD_FIELD_REF_S64:
+	case FILTER_OP_GET_CONTEXT_REF_S64:
+		return sizeof(struct load_op) + sizeof(struct field_ref);
+	case FILTER_OP_GET_PAYLOAD_ROOT:
+	case FILTER_OP_GET_CONTEXT_ROOT:
+	case FILTER_OP_LOAD_FIELD_S8:
+	case FILTER_OP_LOAD_FIELD_S16:
+	case FILTER_OP_LOAD_FIELD_S32:
+	case FILTER_OP_LOAD_FIELD_S64:
+	case FILTER_OP_LOAD_FIELD_U8:
+	case FILTER_OP_LOAD_FIELD_U16:
+	case FILTER_OP_LOAD_FIELD_U32:
+	case FILTER_OP_LOAD_FIELD_U64:
+		return sizeof(struct load_op);
+	case FILTER_OP_GET_INDEX_U16:
+		return sizeof(struct load_op) + sizeof(struct get_index_u16);
+	case FILTER_OP_CAST_NOP:
+		return sizeof(struct cast_op);
+	default:
+		return 0;
+	}
+}
+
+static
+struct filter_reg_insn *lower_emit(struct filter_lower_ctx *ctx,
+		enum filter_reg_op op)
+{
+	struct filter_reg_insn *insn = &ctx->insns[ctx->nr_insns++];
+
+	insn->op = op;
+	return insn;
+}
+
+/* Allocate the register of a pushed value. */
+static
+int lower_push(struct filter_lower_ctx *ctx)
+{
+	if (ctx->depth >= FILTER_REG_FILE_LEN)
+		return -EINVAL;
+	return ctx->depth++;
+}
+
+static
+int lower_binary(struct filter_lower_ctx *ctx, enum filter_reg_op op)
+{
+	struct filter_reg_insn *insn;
+
+	if (ctx->depth < 2)
+		return -EINVAL;
+	insn = lower_emit(ctx, op);
+	insn->a = insn->dst = ctx->depth - 2;
+	insn->b = ctx->depth - 1;
+	ctx->depth--;
+	return 0;
+}
+
+static
+int lower_unary(struct filter_lower_ctx *ctx, enum filter_reg_op op)
+{
+	struct filter_reg_insn *insn;
+
+	if (ctx->depth < 1)
+		return -EINVAL;
+	insn = lower_emit(ctx, op);
+	insn->a = insn->dst = ctx->depth - 1;
+	return 0;
+}
+
+static
+enum filter_reg_op lower_binary_op(filter_opcode_t op)
+{
+	switch (op) {
+	case FILTER_OP_EQ_S64:
+		return FILTER_REG_OP_EQ;
+	case FILTER_OP_NE_S64:
+		return FILTER_REG_OP_NE;
+	case FILTER_OP_GT_S64:
+		return FILTER_REG_OP_GT;
+	case FILTER_OP_LT_S64:
+		return FILTER_REG_OP_LT;
+	case FILTER_OP_GE_S64:
+		return FILTER_REG_OP_GE;
+	case FILTER_OP_LE_S64:
+		return FILTER_REG_OP_LE;
+	case FILTER_OP_BIT_RSHIFT:
+		return FILTER_REG_OP_RSHIFT;
+	case FILTER_OP_BIT_LSHIFT:
+		return FILTER_REG_OP_LSHIFT;
+	case FILTER_OP_BIT_AND:
+		return FILTER_REG_OP_AND;
+	case FILTER_OP_BIT_OR:
+		return FILTER_REG_OP_OR;
+	case FILTER_OP_BIT_XOR:
+	default:
+		return FILTER_REG_OP_XOR;
+	}
+}
+
+/*
+ * Lower "load s64 immediate; compare s64" into a comparison against an
+ * immediate, unless the comparison is a jump target. Return the length
+ * of bytecode consumed, 0 if the sequence does not match.
+ */
+static
+size_t lower_compare_imm(struct filter_lower_ctx *ctx, void *pc, void *end_pc)
+{
+	struct bytecode_runtime *runtime = ctx->runtime;
+	struct load_op *insn = (struct load_op *) pc;
+	size_t len = sizeof(struct load_op) + sizeof(struct literal_numeric);
+	struct filter_reg_insn *reg_insn;
+	enum filter_reg_op op;
+
+	if (pc + len + sizeof(struct binary_op) > end_pc || ctx->depth < 1)
+		return 0;
+	if (test_bit(pc + len - (void *) runtime->code, ctx->targets))
+		return 0;
+	switch (*(filter_opcode_t *) (pc + len)) {
+	case FILTER_OP_EQ_S64:
+		op = FILTER_REG_OP_EQ_IMM;
+		break;
+	case FILTER_OP_NE_S64:
+		op = FILTER_REG_OP_NE_IMM;
+		break;
+	case FILTER_OP_GT_S64:
+		op = FILTER_REG_OP_GT_IMM;
+		break;
+	case FILTER_OP_LT_S64:
+		op = FILTER_REG_OP_LT_IMM;
+		break;
+	case FILTER_OP_GE_S64:
+		op = FILTER_REG_OP_GE_IMM;
+		break;
+	case FILTER_OP_LE_S64:
+		op = FILTER_REG_OP_LE_IMM;
+		break;
+	default:
+		return 0;
+	}
+	reg_insn = lower_emit(ctx, op);
+	reg_insn->a = reg_insn->dst = ctx->depth - 1;
+	reg_insn->imm = ((struct literal_numeric *) insn->data)->v;
+	return len + sizeof(struct binary_op);
+}
+
+/*
+ * Lower a "get root; get index u16; load field" sequence produced by the
+ * specializer for integer payload and context fields into a single load.
+ * Return the length of bytecode consumed, 0 if the sequence does not
+ * match.
+ */
+static
+size_t lower_root_index_load(struct filter_lower_ctx *ctx, void *pc,
+		void *end_pc)
+{
+	struct bytecode_runtime *runtime = ctx->runtime;
+	const size_t index_len = sizeof(struct load_op)
+			+ sizeof(struct get_index_u16);
+	struct load_op *index_insn = pc + sizeof(struct load_op);
+	struct load_op *load_insn = (void *) index_insn + index_len;
+	const struct filter_get_index_data *gid;
+	struct filter_reg_insn *reg_insn;
+	enum filter_reg_op op;
+	uint16_t index;
+	int reg;
+
+	if ((void *) load_insn + sizeof(struct load_op) > end_pc)
+		return 0;
+	if (index_insn->op != FILTER_OP_GET_INDEX_U16)
+		return 0;
+	if (test_bit((void *) index_insn - (void *) runtime->code, ctx->targets)
+			|| test_bit((void *) load_insn - (void *) runtime->code,
+				ctx->targets))
+		return 0;
+	index = ((struct get_index_u16 *) index_insn->data)->index;
+	if (index + sizeof(*gid) > runtime->data_len)
+		return 0;
+	gid = (const struct filter_get_index_data *) &runtime->data[index];
+	if (gid->elem.rev_bo)
+		return 0;
+	switch (load_insn->op) {
+	case FILTER_OP_LOAD_FIELD_S8:
+		op = FILTER_REG_OP_LOAD_S8;
+		break;
+	case FILTER_OP_LOAD_FIELD_S16:
+		op = FILTER_REG_OP_LOAD_S16;
+		break;
+	case FILTER_OP_LOAD_FIELD_S32:
+		op = FILTER_REG_OP_LOAD_S32;
+		break;
+	case FILTER_OP_LOAD_FIELD_S64:
+		op = FILTER_REG_OP_LOAD_S64;
+		break;
+	case FILTER_OP_LOAD_FIELD_U8:
+		op = FILTER_REG_OP_LOAD_U8;
+		break;
+	case FILTER_OP_LOAD_FIELD_U16:
+		op = FILTER_REG_OP_LOAD_U16;
+		break;
+	case FILTER_OP_LOAD_FIELD_U32:
+		op = FILTER_REG_OP_LOAD_U32;
+		break;
+	case FILTER_OP_LOAD_FIELD_U64:
+		op = FILTER_REG_OP_LOAD_U64;
+		break;
+	default:
+		return 0;
+	}
+	if (*(filter_opcode_t *) pc == FILTER_OP_GET_CONTEXT_ROOT) {
+		/* Integer context values are fetched as 64-bit values. */
+		if (op != FILTER_REG_OP_LOAD_S64 && op != FILTER_REG_OP_LOAD_U64)
+			return 0;
+		op = FILTER_REG_OP_LOAD_CONTEXT;
+	}
+	reg = lower_push(ctx);
+	if (reg < 0)
+		return 0;
+	reg_insn = lower_emit(ctx, op);
+	reg_insn->dst = reg;
+	reg_insn->imm = op == FILTER_REG_OP_LOAD_CONTEXT ?
+		gid->ctx_index : gid->offset;
+	return sizeof(struct load_op) + index_len + sizeof(struct load_op);
+}
+
+static
+int lower_bytecode(struct filter_lower_ctx *ctx)
+{
+	struct bytecode_runtime *runtime = ctx->runtime;
+	void *pc, *next_pc, *start_pc, *end_pc;
+	struct filter_reg_insn *reg_insn;
+	unsigned int i;
+	size_t len;
+	int reg;
+
+	start_pc = &runtime->code[0];
+	end_pc = start_pc + runtime->len;
+
+	/* Find the jump targets first, so fused sequences never span one. */
+	for (pc = start_pc; pc < end_pc; pc += len) {
+		len = lower_insn_len(pc);
+		if (!len) {
+			dbg_printk("Register IR: unsupported bytecode op %s (%u), using interpreter\n",
+				lttng_filter_print_op((unsigned int) *(filter_opcode_t *) pc),
+				(unsigned int) *(filter_opcode_t *) pc);
+			return -EINVAL;
+		}
+		switch (*(filter_opcode_t *) pc) {
+		case FILTER_OP_AND:
+		case FILTER_OP_OR:
+		{
+			struct logical_op *insn = (struct logical_op *) pc;
+
+			if (insn->skip_offset > runtime->len)
+				return -EINVAL;
+			__set_bit(insn->skip_offset, ctx->targets);
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	for (pc = next_pc = start_pc; pc < end_pc; pc = next_pc) {
+		ctx->map[pc - start_pc] = ctx->nr_insns;
+		next_pc += lower_insn_len(pc);
+
+		switch (*(filter_opcode_t *) pc) {
+		case FILTER_OP_RETURN:
+		case FILTER_OP_RETURN_S64:
+			if (ctx->depth < 1)
+				return -EINVAL;
+			reg_insn = lower_emit(ctx, FILTER_REG_OP_RETURN);
+			reg_insn->a = ctx->depth - 1;
+			break;
+
+		case FILTER_OP_EQ_S64:
+		case FILTER_OP_NE_S64:
+		case FILTER_OP_GT_S64:
+		case FILTER_OP_LT_S64:
+		case FILTER_OP_GE_S64:
+		case FILTER_OP_LE_S64:
+		case FILTER_OP_BIT_RSHIFT:
+		case FILTER_OP_BIT_LSHIFT:
+		case FILTER_OP_BIT_AND:
+		case FILTER_OP_BIT_OR:
+		case FILTER_OP_BIT_XOR:
+			if (lower_binary(ctx,
+					lower_binary_op(*(filter_opcode_t *) pc)))
+				return -EINVAL;
+			break;
+
+		case FILTER_OP_UNARY_BIT_NOT:
+			if (lower_unary(ctx, FILTER_REG_OP_BIT_NOT))
+				return -EINVAL;
+			break;
+		case FILTER_OP_UNARY_MINUS_S64:
+			if (lower_unary(ctx, FILTER_REG_OP_NEG))
+				return -EINVAL;
+			break;
+		case FILTER_OP_UNARY_NOT_S64:
+			if (lower_unary(ctx, FILTER_REG_OP_NOT))
+				return -EINVAL;
+			break;
+		case FILTER_OP_UNARY_PLUS_S64:
+		case FILTER_OP_CAST_NOP:
+			break;
+
+		case FILTER_OP_AND:
+		case FILTER_OP_OR:
+		{
+			struct logical_op *insn = (struct logical_op *) pc;
+
+			if (ctx->depth < 1)
+				return -EINVAL;
+			/* The jump target is patched once all offsets are known. */
+			reg_insn = lower_emit(ctx,
+				insn->op == FILTER_OP_AND ?
+					FILTER_REG_OP_JZ : FILTER_REG_OP_JNZ_SET);
+			reg_insn->a = ctx->depth - 1;
+			reg_insn->imm = insn->skip_offset;
+			/* Pop 1 when jump not taken */
+			ctx->depth--;
+			break;
+		}
+
+		case FILTER_OP_LOAD_S64:
+		{
+			struct load_op *insn = (struct load_op *) pc;
+
+			len = lower_compare_imm(ctx, pc, end_pc);
+			if (len) {
+				next_pc = pc + len;
+				break;
+			}
+			reg = lower_push(ctx);
+			if (reg < 0)
+				return -EINVAL;
+			reg_insn = lower_emit(ctx, FILTER_REG_OP_LOAD_IMM);
+			reg_insn->dst = reg;
+			reg_insn->imm = ((struct literal_numeric *) insn->data)->v;
+			break;
+		}
+
+		case FILTER_OP_LOAD_FIELD_REF_S64:
+		case FILTER_OP_GET_CONTEXT_REF_S64:
+		{
+			struct load_op *insn = (struct load_op *) pc;
+			struct field_ref *ref = (struct field_ref *) insn->data;
+
+			reg = lower_push(ctx);
+			if (reg < 0)
+				return -EINVAL;
+			reg_insn = lower_emit(ctx,
+				insn->op == FILTER_OP_LOAD_FIELD_REF_S64 ?
+					FILTER_REG_OP_LOAD_S64 :
+					FILTER_REG_OP_LOAD_CONTEXT);
+			reg_insn->dst = reg;
+			reg_insn->imm = ref->offset;
+			break;
+		}
+
+		case FILTER_OP_GET_PAYLOAD_ROOT:
+		case FILTER_OP_GET_CONTEXT_ROOT:
+			len = lower_root_index_load(ctx, pc, end_pc);
+			if (!len)
+				return -EINVAL;
+			next_pc = pc + len;
+			break;
+
+		default:
+			/* Index and field loads outside of a root sequence. */
+			return -EINVAL;
+		}
+	}
+	/* Reaching the end of bytecode without return discards the event. */
+	ctx->map[runtime->len] = ctx->nr_insns;
+	reg_insn = lower_emit(ctx, FILTER_REG_OP_LOAD_IMM);
+	reg_insn->dst = 0;
+	reg_insn->imm = 0;
+	reg_insn = lower_emit(ctx, FILTER_REG_OP_RETURN);
+	reg_insn->a = 0;
+
+	for (i = 0; i < ctx->nr_insns; i++) {
+		reg_insn = &ctx->insns[i];
+		if (reg_insn->op != FILTER_REG_OP_JZ
+				&& reg_insn->op != FILTER_REG_OP_JNZ_SET)
+			continue;
+		reg_insn->imm = ctx->map[reg_insn->imm];
+	}
+	return 0;
+}
+
+/*
+ * Lower a validated and specialized bytecode runtime into the register
+ * IR. On success, the IR is installed in runtime->reg_code. On failure,
+ * the runtime is left untouched and the stack interpreter should be
+ * used.
+ */
+int lttng_filter_lower_bytecode(struct bytecode_runtime *runtime)
+{
+	struct filter_lower_ctx ctx;
+	int ret;
+
+	if (!filter_regs_enable)
+		return -ENOSYS;
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.runtime = runtime;
+	/* Each bytecode instruction lowers to at most one IR instruction. */
+	ctx.insns = kcalloc(runtime->len + 2, sizeof(*ctx.insns), GFP_KERNEL);
+	ctx.map = kcalloc(runtime->len + 1, sizeof(*ctx.map), GFP_KERNEL);
+	ctx.targets = kcalloc(BITS_TO_LONGS(runtime->len + 1),
+			sizeof(unsigned long), GFP_KERNEL);
+	if (!ctx.insns || !ctx.map || !ctx.targets) {
+		ret = -ENOMEM;
+		goto end;
+	}
+	ret = lower_bytecode(&ctx);
+	if (ret)
+		goto end;
+	runtime->reg_code = ctx.insns;
+	ctx.insns = NULL;
+	dbg_printk("Register IR: lowered %u bytes of bytecode into %u instructions\n",
+		(unsigned int) runtime->len, ctx.nr_insns);
+end:
+	kfree(ctx.targets);
+	kfree(ctx.map);
+	kfree(ctx.insns);
+	return ret;
+}
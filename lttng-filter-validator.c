@@ -265,6 +265,22 @@ int validate_get_symbol(struct bytecode_runtime *bytecode,
 	return 0;
 }
 
+static
+int validate_set(const struct set_op *insn)
+{
+	unsigned int i;
+
+	if (!insn->nr_values || insn->data_offset)
+		return -EINVAL;
+	for (i = 1; i < insn->nr_values; i++) {
+		if (insn->values[i - 1] >= insn->values[i]) {
+			printk(KERN_WARNING "Set values are not sorted\n");
+			return -EINVAL;
+		}
+	}
+	return 0;
+}
+
 /*
  * Validate bytecode range overflow within the validation pass.
  * Called for each instruction encountered.
@@ -383,6 +399,49 @@ int bytecode_validate_overflow(struct bytecode_runtime *bytecode,
 		break;
 	}
 
+	/* set and range */
+	case FILTER_OP_IN_SET_S64:
+	{
+		struct set_op *insn = (struct set_op *) pc;
+
+		if (unlikely(pc + sizeof(struct set_op)
+				> start_pc + bytecode->len)) {
+			ret = -ERANGE;
+			break;
+		}
+		if (unlikely(pc + filter_set_op_len(insn)
+				> start_pc + bytecode->len)) {
+			ret = -ERANGE;
+			break;
+		}
+		ret = validate_set(insn);
+		break;
+	}
+
+	case FILTER_OP_IN_SET_BITMAP_S64:
+		printk(KERN_WARNING "Unexpected set bitmap\n");
+		ret = -EINVAL;
+		break;
+
+	case FILTER_OP_LOAD_STRING_MATCHER:
+		printk(KERN_WARNING "Unexpected string matcher\n");
+		ret = -EINVAL;
+		break;
+
+	case FILTER_OP_IN_RANGE_S64:
+	{
+		struct range_op *insn = (struct range_op *) pc;
+
+		if (unlikely(pc + sizeof(struct range_op)
+				> start_pc + bytecode->len)) {
+			ret = -ERANGE;
+			break;
+		}
+		if (insn->lo > insn->hi)
+			ret = -EINVAL;
+		break;
+	}
+
 	/* logical */
 	case FILTER_OP_AND:
 	case FILTER_OP_OR:
@@ -799,6 +858,35 @@ int validate_instruction_context(struct bytecode_runtime *bytecode,
 		break;
 	}
 
+	case FILTER_OP_IN_SET_S64:
+	case FILTER_OP_IN_SET_BITMAP_S64:
+	case FILTER_OP_IN_RANGE_S64:
+	{
+		if (!vstack_ax(stack)) {
+			printk(KERN_WARNING "Empty stack\n");
+			ret = -EINVAL;
+			goto end;
+		}
+		switch (vstack_ax(stack)->type) {
+		default:
+			printk(KERN_WARNING "unknown register type\n");
+			ret = -EINVAL;
+			goto end;
+
+		case REG_STRING:
+		case REG_STAR_GLOB_STRING:
+		case REG_DOUBLE:
+			printk(KERN_WARNING "Set and range ops can only be applied to numeric registers\n");
+			ret = -EINVAL;
+			goto end;
+		case REG_S64:
+			break;
+		case REG_TYPE_UNKNOWN:
+			break;
+		}
+		break;
+	}
+
 	case FILTER_OP_UNARY_PLUS_S64:
 	case FILTER_OP_UNARY_MINUS_S64:
 	case FILTER_OP_UNARY_NOT_S64:
@@ -1385,6 +1473,37 @@ int exec_insn(struct bytecode_runtime *bytecode,
 		break;
 	}
 
+	/* set and range */
+	case FILTER_OP_IN_SET_S64:
+	case FILTER_OP_IN_SET_BITMAP_S64:
+	case FILTER_OP_IN_RANGE_S64:
+	{
+		/* Pop 1, push 1 */
+		if (!vstack_ax(stack)) {
+			printk(KERN_WARNING "Empty stack\n");
+			ret = -EINVAL;
+			goto end;
+		}
+		switch (vstack_ax(stack)->type) {
+		case REG_S64:
+		case REG_TYPE_UNKNOWN:
+			break;
+		case REG_DOUBLE:
+		default:
+			printk(KERN_WARNING "Unexpected register type %d for operation\n",
+				(int) vstack_ax(stack)->type);
+			ret = -EINVAL;
+			goto end;
+		}
+
+		vstack_ax(stack)->type = REG_S64;
+		if (*(filter_opcode_t *) pc == FILTER_OP_IN_RANGE_S64)
+			next_pc += sizeof(struct range_op);
+		else
+			next_pc += filter_set_op_len((struct set_op *) pc);
+		break;
+	}
+
 	/* logical */
 	case FILTER_OP_AND:
 	case FILTER_OP_OR:
@@ -1691,12 +1810,39 @@ end:
 /*
  * Never called concurrently (hash seed is shared).
  */
+/*
+ * Whether an instruction reads the event payload, as opposed to the
+ * contexts or immediate values.
+ */
+static
+bool insn_reads_payload(char *pc)
+{
+	switch (*(filter_opcode_t *) pc) {
+	case FILTER_OP_LOAD_FIELD_REF:
+	case FILTER_OP_LOAD_FIELD_REF_STRING:
+	case FILTER_OP_LOAD_FIELD_REF_SEQUENCE:
+	case FILTER_OP_LOAD_FIELD_REF_S64:
+	case FILTER_OP_LOAD_FIELD_REF_DOUBLE:
+	case FILTER_OP_LOAD_FIELD_REF_USER_STRING:
+	case FILTER_OP_LOAD_FIELD_REF_USER_SEQUENCE:
+	case FILTER_OP_GET_PAYLOAD_ROOT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Validate the bytecode, and classify it as reading only contexts when
+ * no reachable instruction reads the event payload.
+ */
 int lttng_filter_validate_bytecode(struct bytecode_runtime *bytecode)
 {
 	struct mp_table *mp_table;
 	char *pc, *next_pc, *start_pc;
 	int ret = -EINVAL;
 	struct vstack stack;
+	bool reads_payload = false;
 
 	vstack_init(&stack);
 
@@ -1727,6 +1873,8 @@ int lttng_filter_validate_bytecode(struct bytecode_runtime *bytecode)
 					&stack, start_pc, pc);
 		if (ret)
 			goto end;
+		if (insn_reads_payload(pc))
+			reads_payload = true;
 		ret = exec_insn(bytecode, mp_table, &stack, &next_pc, pc);
 		if (ret <= 0)
 			goto end;
@@ -1739,5 +1887,7 @@ end:
 		}
 	}
 	kfree(mp_table);
+	if (!ret)
+		bytecode->p.context_only = !reads_payload;
 	return ret;
 }
@@ -7,9 +7,13 @@
  * Copyright (C) 2010-2016 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
  */
 
+#include <linux/module.h>
 #include <linux/list.h>
 #include <linux/slab.h>
+#include <linux/rcupdate.h>
+#include <linux/jhash.h>
 
+#include <wrapper/list.h>
 #include <lttng-filter.h>
 
 static const char *opnames[] = {
@@ -156,6 +160,13 @@ static const char *opnames[] = {
 	[ FILTER_OP_UNARY_BIT_NOT ] = "UNARY_BIT_NOT",
 
 	[ FILTER_OP_RETURN_S64 ] = "RETURN_S64",
+
+	/* set and range */
+	[ FILTER_OP_IN_SET_S64 ] = "IN_SET_S64",
+	[ FILTER_OP_IN_SET_BITMAP_S64 ] = "IN_SET_BITMAP_S64",
+	[ FILTER_OP_IN_RANGE_S64 ] = "IN_RANGE_S64",
+
+	[ FILTER_OP_LOAD_STRING_MATCHER ] = "LOAD_STRING_MATCHER",
 };
 
 const char *lttng_filter_print_op(enum filter_op op)
@@ -375,18 +386,301 @@ int apply_reloc(struct lttng_event *event,
 
 static
 int bytecode_is_linked(struct lttng_filter_bytecode_node *filter_bytecode,
-		struct lttng_event *event)
+		struct list_head *runtime_head)
 {
 	struct lttng_bytecode_runtime *bc_runtime;
 
-	list_for_each_entry(bc_runtime,
-			&event->bytecode_runtime_head, node) {
+	list_for_each_entry(bc_runtime, runtime_head, node) {
 		if (bc_runtime->bc == filter_bytecode)
 			return 1;
 	}
 	return 0;
 }
 
+/*
+ * Use native code when the bytecode could be compiled, else the register
+ * IR when it could be lowered, else fall back on the stack interpreter.
+ */
+static
+void bytecode_runtime_set_filter(struct bytecode_runtime *runtime)
+{
+	if (runtime->p.bc && runtime->p.bc->bpf_prog) {
+		runtime->p.filter = lttng_filter_bpf_run;
+		return;
+	}
+	if (runtime->jit_image)
+		runtime->p.filter = runtime->jit_image;
+	else if (runtime->reg_code)
+		runtime->p.filter = lttng_filter_interpret_regs;
+	else
+		runtime->p.filter = lttng_filter_interpret_bytecode;
+	if (runtime->memo_id) {
+		runtime->memo_filter = runtime->p.filter;
+		runtime->p.filter = lttng_filter_memo;
+	}
+}
+
+static
+ssize_t bytecode_insn_len(char *pc);
+
+/*
+ * Link cache. Glob enablers attach the same bytecode to many events,
+ * and relocation often yields the same code for all of them. Within an
+ * enabler sync pass, validation and optimization results are kept by
+ * relocated code and symbol table, and the specialization result is
+ * kept along with the event fields it was made for. Events sharing the
+ * same fields, such as those of a single event class, copy it instead
+ * of specializing the bytecode again. Protected by the sessions mutex,
+ * and flushed at the end of each sync pass so cached event fields can
+ * not outlive their probe module.
+ */
+#define FILTER_LINK_CACHE_SIZE	64
+
+struct filter_link_cache_entry {
+	struct hlist_node hlist;
+	u32 hash;
+	int ret;			/* Validation result. */
+	int context_only;
+	bool memo;
+	uint16_t len;			/* Validated and optimized code. */
+	char *code;
+	/* Specialization for these event fields, or NULL. */
+	const struct lttng_event_field *fields;
+	unsigned int nr_fields;
+	char *spec_code;
+	char *data;
+	size_t data_len;
+	size_t key_len;
+	char key[];			/* Relocated code and symbol table. */
+};
+
+static struct hlist_head filter_link_cache[FILTER_LINK_CACHE_SIZE];
+
+static
+size_t filter_link_cache_key(struct bytecode_runtime *runtime, u32 *hash)
+{
+	struct lttng_kernel_filter_bytecode *bc = &runtime->p.bc->bc;
+
+	*hash = jhash(runtime->code, runtime->len, 0);
+	*hash = jhash(bc->data + bc->reloc_offset, bc->len - bc->reloc_offset,
+			*hash);
+	return runtime->len + bc->len - bc->reloc_offset;
+}
+
+static
+bool filter_link_cache_match(struct filter_link_cache_entry *entry,
+		struct bytecode_runtime *runtime, size_t key_len)
+{
+	struct lttng_kernel_filter_bytecode *bc = &runtime->p.bc->bc;
+
+	return entry->key_len == key_len
+		&& !memcmp(entry->key, runtime->code, runtime->len)
+		&& !memcmp(entry->key + runtime->len,
+			bc->data + bc->reloc_offset,
+			bc->len - bc->reloc_offset);
+}
+
+/*
+ * Look up the relocated bytecode of a runtime. Return the cache entry,
+ * or NULL if not found, in which case *hash and *key_len are set for
+ * filter_link_cache_add().
+ */
+static
+struct filter_link_cache_entry *filter_link_cache_lookup(
+		struct bytecode_runtime *runtime, u32 *hash, size_t *key_len)
+{
+	struct filter_link_cache_entry *entry;
+	struct hlist_head *head;
+
+	*key_len = filter_link_cache_key(runtime, hash);
+	head = &filter_link_cache[*hash & (FILTER_LINK_CACHE_SIZE - 1)];
+	lttng_hlist_for_each_entry(entry, head, hlist) {
+		if (entry->hash == *hash
+				&& filter_link_cache_match(entry, runtime, *key_len))
+			return entry;
+	}
+	return NULL;
+}
+
+/*
+ * Add a cache entry for a runtime, with its key taken from the
+ * relocated code saved by the caller in "code". Caching is best effort:
+ * return NULL on allocation failure.
+ */
+static
+struct filter_link_cache_entry *filter_link_cache_add(
+		struct bytecode_runtime *runtime, const char *code,
+		u32 hash, size_t key_len, int ret)
+{
+	struct lttng_kernel_filter_bytecode *bc = &runtime->p.bc->bc;
+	size_t code_len = key_len - (bc->len - bc->reloc_offset);
+	struct filter_link_cache_entry *entry;
+
+	entry = kzalloc(sizeof(*entry) + key_len, GFP_KERNEL);
+	if (!entry)
+		return NULL;
+	if (!ret) {
+		entry->code = kmemdup(runtime->code, runtime->len, GFP_KERNEL);
+		if (!entry->code) {
+			kfree(entry);
+			return NULL;
+		}
+	}
+	entry->hash = hash;
+	entry->ret = ret;
+	entry->context_only = runtime->p.context_only;
+	entry->memo = !!runtime->memo_id;
+	entry->len = runtime->len;
+	entry->key_len = key_len;
+	memcpy(entry->key, code, code_len);
+	memcpy(entry->key + code_len, bc->data + bc->reloc_offset,
+			bc->len - bc->reloc_offset);
+	hlist_add_head(&entry->hlist,
+		&filter_link_cache[hash & (FILTER_LINK_CACHE_SIZE - 1)]);
+	return entry;
+}
+
+/*
+ * Keep the specialization of a runtime for the fields of its event, if
+ * none is cached yet.
+ */
+static
+void filter_link_cache_add_spec(struct filter_link_cache_entry *entry,
+		struct bytecode_runtime *runtime)
+{
+	const struct lttng_event_desc *desc = runtime->p.event->desc;
+
+	if (entry->spec_code)
+		return;
+	entry->spec_code = kmemdup(runtime->code, runtime->len, GFP_KERNEL);
+	if (!entry->spec_code)
+		return;
+	if (runtime->data_len) {
+		entry->data = kmemdup(runtime->data, runtime->data_len,
+				GFP_KERNEL);
+		if (!entry->data) {
+			kfree(entry->spec_code);
+			entry->spec_code = NULL;
+			return;
+		}
+	}
+	entry->data_len = runtime->data_len;
+	entry->fields = desc->fields;
+	entry->nr_fields = desc->nr_fields;
+}
+
+/*
+ * Copy the cached specialization into a runtime if it was made for the
+ * fields of its event. Return 0 on success, 1 if the bytecode must be
+ * specialized, or a negative error value.
+ */
+static
+int filter_link_cache_get_spec(struct filter_link_cache_entry *entry,
+		struct bytecode_runtime *runtime)
+{
+	const struct lttng_event_desc *desc = runtime->p.event->desc;
+
+	if (!entry->spec_code || entry->fields != desc->fields
+			|| entry->nr_fields != desc->nr_fields)
+		return 1;
+	if (entry->data_len) {
+		runtime->data = kmemdup(entry->data, entry->data_len,
+				GFP_KERNEL);
+		if (!runtime->data)
+			return -ENOMEM;
+	}
+	runtime->data_len = entry->data_len;
+	runtime->data_alloc_len = entry->data_len;
+	memcpy(runtime->code, entry->spec_code, entry->len);
+	return 0;
+}
+
+/*
+ * Drop the link cache. Called with the sessions mutex held at the end
+ * of each enabler sync pass.
+ */
+void lttng_filter_link_cache_flush(void)
+{
+	struct filter_link_cache_entry *entry;
+	struct hlist_node *tmp;
+	unsigned int i;
+
+	for (i = 0; i < FILTER_LINK_CACHE_SIZE; i++) {
+		lttng_hlist_for_each_entry_safe(entry, tmp,
+				&filter_link_cache[i], hlist) {
+			hlist_del(&entry->hlist);
+			kfree(entry->code);
+			kfree(entry->spec_code);
+			kfree(entry->data);
+			kfree(entry);
+		}
+	}
+}
+
+
+/*
+ * Filters are memoized per task when they read no payload field and
+ * only contexts which stay the same for a task until exec or comm
+ * change. Called on validated bytecode, before specialization.
+ */
+static
+void bytecode_classify_memo(struct bytecode_runtime *runtime)
+{
+	char *pc = runtime->code, *end = runtime->code + runtime->len;
+	const char *name;
+
+	if (!runtime->p.context_only)
+		return;
+	while (pc < end) {
+		ssize_t len;
+
+		switch (*(filter_opcode_t *) pc) {
+		case FILTER_OP_RETURN:
+		case FILTER_OP_RETURN_S64:
+			runtime->memo_id = lttng_filter_memo_new_id();
+			return;
+		case FILTER_OP_GET_CONTEXT_REF:
+		case FILTER_OP_GET_CONTEXT_REF_STRING:
+		case FILTER_OP_GET_CONTEXT_REF_S64:
+		case FILTER_OP_GET_CONTEXT_REF_DOUBLE:
+		{
+			struct load_op *insn = (struct load_op *) pc;
+			struct field_ref *ref = (struct field_ref *) insn->data;
+
+			name = lttng_static_ctx->fields[ref->offset].event_field.name;
+			if (!lttng_filter_memo_context(name))
+				return;
+			break;
+		}
+		case FILTER_OP_GET_CONTEXT_ROOT:
+		{
+			struct load_op *insn;
+			struct get_symbol *sym;
+
+			/* The context is selected by the following symbol. */
+			pc += sizeof(struct load_op);
+			insn = (struct load_op *) pc;
+			if (pc >= end || insn->op != FILTER_OP_GET_SYMBOL)
+				return;
+			sym = (struct get_symbol *) insn->data;
+			name = runtime->p.bc->bc.data
+				+ runtime->p.bc->bc.reloc_offset + sym->offset;
+			if (!lttng_filter_memo_context(name))
+				return;
+			break;
+		}
+		case FILTER_OP_GET_APP_CONTEXT_ROOT:
+			return;
+		default:
+			break;
+		}
+		len = bytecode_insn_len(pc);
+		if (len < 0)
+			return;
+		pc += len;
+	}
+}
+
 /*
  * Take a bytecode with reloc table and link it to an event to create a
  * bytecode runtime.
@@ -398,12 +692,14 @@ int _lttng_filter_event_link_bytecode(struct lttng_event *event,
 {
 	int ret, offset, next_offset;
 	struct bytecode_runtime *runtime = NULL;
-	size_t runtime_alloc_len;
+	struct filter_link_cache_entry *entry;
+	size_t runtime_alloc_len, key_len;
+	u32 hash;
 
 	if (!filter_bytecode)
 		return 0;
 	/* Bytecode already linked */
-	if (bytecode_is_linked(filter_bytecode, event))
+	if (bytecode_is_linked(filter_bytecode, &event->bytecode_runtime_head))
 		return 0;
 
 	dbg_printk("Linking...\n");
@@ -417,6 +713,12 @@ int _lttng_filter_event_link_bytecode(struct lttng_event *event,
 	}
 	runtime->p.bc = filter_bytecode;
 	runtime->p.event = event;
+	if (filter_bytecode->bpf_prog) {
+		ret = lttng_filter_bpf_link(event, runtime);
+		if (ret)
+			goto link_error;
+		goto linked;
+	}
 	runtime->len = filter_bytecode->bc.reloc_offset;
 	/* copy original bytecode */
 	memcpy(runtime->code, filter_bytecode->bc.data, runtime->len);
@@ -438,17 +740,56 @@ int _lttng_filter_event_link_bytecode(struct lttng_event *event,
 		}
 		next_offset = offset + sizeof(uint16_t) + strlen(name) + 1;
 	}
-	/* Validate bytecode */
-	ret = lttng_filter_validate_bytecode(runtime);
-	if (ret) {
-		goto link_error;
+	entry = filter_link_cache_lookup(runtime, &hash, &key_len);
+	if (entry) {
+		/* Same bytecode already validated in this sync pass. */
+		ret = entry->ret;
+		if (ret)
+			goto link_error;
+		memcpy(runtime->code, entry->code, entry->len);
+		runtime->len = entry->len;
+		runtime->p.context_only = entry->context_only;
+		if (entry->memo)
+			runtime->memo_id = lttng_filter_memo_new_id();
+		ret = filter_link_cache_get_spec(entry, runtime);
+		if (ret < 0)
+			goto link_error;
+		if (!ret)
+			goto specialized;
+	} else {
+		char *code = kmemdup(runtime->code, runtime->len, GFP_KERNEL);
+
+		/* Validate bytecode */
+		ret = lttng_filter_validate_bytecode(runtime);
+		if (!ret) {
+			/* Optimize bytecode, validated again when rewritten */
+			lttng_filter_optimize_bytecode(runtime);
+			bytecode_classify_memo(runtime);
+		}
+		if (code)
+			entry = filter_link_cache_add(runtime, code, hash,
+					key_len, ret);
+		kfree(code);
+		if (ret) {
+			goto link_error;
+		}
 	}
 	/* Specialize bytecode */
 	ret = lttng_filter_specialize_bytecode(event, runtime);
 	if (ret) {
 		goto link_error;
 	}
-	runtime->p.filter = lttng_filter_interpret_bytecode;
+	if (entry)
+		filter_link_cache_add_spec(entry, runtime);
+specialized:
+	/* JIT failure is not fatal: the interpreter is used instead. */
+	if (lttng_filter_jit_compile(runtime)
+			&& lttng_filter_lower_bytecode(runtime))
+		dbg_printk("Bytecode not compiled, using interpreter.\n");
+	bytecode_runtime_set_filter(runtime);
+linked:
+	/* Statistics are best effort. */
+	runtime->p.stats = alloc_percpu(struct lttng_filter_stats);
 	runtime->p.link_failed = 0;
 	list_add_rcu(&runtime->p.node, insert_loc);
 	dbg_printk("Linking successful.\n");
@@ -470,7 +811,477 @@ void lttng_filter_sync_state(struct lttng_bytecode_runtime *runtime)
 	if (!bc->enabler->enabled || runtime->link_failed)
 		runtime->filter = lttng_filter_false;
 	else
-		runtime->filter = lttng_filter_interpret_bytecode;
+		bytecode_runtime_set_filter(container_of(runtime,
+				struct bytecode_runtime, p));
+}
+
+/*
+ * Length of a specialized instruction, or a negative error value.
+ */
+static
+ssize_t bytecode_insn_len(char *pc)
+{
+	switch (*(filter_opcode_t *) pc) {
+	case FILTER_OP_RETURN:
+	case FILTER_OP_RETURN_S64:
+		return sizeof(struct return_op);
+
+	/* binary */
+	case FILTER_OP_MUL:
+	case FILTER_OP_DIV:
+	case FILTER_OP_MOD:
+	case FILTER_OP_PLUS:
+	case FILTER_OP_MINUS:
+	case FILTER_OP_BIT_RSHIFT:
+	case FILTER_OP_BIT_LSHIFT:
+	case FILTER_OP_BIT_AND:
+	case FILTER_OP_BIT_OR:
+	case FILTER_OP_BIT_XOR:
+	case FILTER_OP_EQ:
+	case FILTER_OP_NE:
+	case FILTER_OP_GT:
+	case FILTER_OP_LT:
+	case FILTER_OP_GE:
+	case FILTER_OP_LE:
+	case FILTER_OP_EQ_STRING:
+	case FILTER_OP_NE_STRING:
+	case FILTER_OP_GT_STRING:
+	case FILTER_OP_LT_STRING:
+	case FILTER_OP_GE_STRING:
+	case FILTER_OP_LE_STRING:
+	case FILTER_OP_EQ_STAR_GLOB_STRING:
+	case FILTER_OP_NE_STAR_GLOB_STRING:
+	case FILTER_OP_EQ_S64:
+	case FILTER_OP_NE_S64:
+	case FILTER_OP_GT_S64:
+	case FILTER_OP_LT_S64:
+	case FILTER_OP_GE_S64:
+	case FILTER_OP_LE_S64:
+	case FILTER_OP_EQ_DOUBLE:
+	case FILTER_OP_NE_DOUBLE:
+	case FILTER_OP_GT_DOUBLE:
+	case FILTER_OP_LT_DOUBLE:
+	case FILTER_OP_GE_DOUBLE:
+	case FILTER_OP_LE_DOUBLE:
+	case FILTER_OP_EQ_DOUBLE_S64:
+	case FILTER_OP_NE_DOUBLE_S64:
+	case FILTER_OP_GT_DOUBLE_S64:
+	case FILTER_OP_LT_DOUBLE_S64:
+	case FILTER_OP_GE_DOUBLE_S64:
+	case FILTER_OP_LE_DOUBLE_S64:
+	case FILTER_OP_EQ_S64_DOUBLE:
+	case FILTER_OP_NE_S64_DOUBLE:
+	case FILTER_OP_GT_S64_DOUBLE:
+	case FILTER_OP_LT_S64_DOUBLE:
+	case FILTER_OP_GE_S64_DOUBLE:
+	case FILTER_OP_LE_S64_DOUBLE:
+		return sizeof(struct binary_op);
+
+	/* unary */
+	case FILTER_OP_UNARY_PLUS:
+	case FILTER_OP_UNARY_MINUS:
+	case FILTER_OP_UNARY_NOT:
+	case FILTER_OP_UNARY_PLUS_S64:
+	case FILTER_OP_UNARY_MINUS_S64:
+	case FILTER_OP_UNARY_NOT_S64:
+	case FILTER_OP_UNARY_PLUS_DOUBLE:
+	case FILTER_OP_UNARY_MINUS_DOUBLE:
+	case FILTER_OP_UNARY_NOT_DOUBLE:
+	case FILTER_OP_UNARY_BIT_NOT:
+		return sizeof(struct unary_op);
+
+	/* logical */
+	case FILTER_OP_AND:
+	case FILTER_OP_OR:
+		return sizeof(struct logical_op);
+
+	/* load field and context ref */
+	case FILTER_OP_LOAD_FIELD_REF:
+	case FILTER_OP_LOAD_FIELD_REF_STRING:
+	case FILTER_OP_LOAD_FIELD_REF_SEQUENCE:
+	case FILTER_OP_LOAD_FIELD_REF_S64:
+	case FILTER_OP_LOAD_FIELD_REF_DOUBLE:
+	case FILTER_OP_LOAD_FIELD_REF_USER_STRING:
+	case FILTER_OP_LOAD_FIELD_REF_USER_SEQUENCE:
+	case FILTER_OP_GET_CONTEXT_REF:
+	case FILTER_OP_GET_CONTEXT_REF_STRING:
+	case FILTER_OP_GET_CONTEXT_REF_S64:
+	case FILTER_OP_GET_CONTEXT_REF_DOUBLE:
+		return sizeof(struct load_op) + sizeof(struct field_ref);
+
+	/* load from immediate operand */
+	case FILTER_OP_LOAD_STRING:
+	case FILTER_OP_LOAD_STAR_GLOB_STRING:
+	{
+		struct load_op *insn = (struct load_op *) pc;
+
+		return sizeof(struct load_op) + strlen(insn->data) + 1;
+	}
+	case FILTER_OP_LOAD_STRING_MATCHER:
+	{
+		struct load_op *insn = (struct load_op *) pc;
+		struct load_string_matcher *ref =
+			(struct load_string_matcher *) insn->data;
+
+		return sizeof(struct load_op) + ref->len;
+	}
+	case FILTER_OP_LOAD_S64:
+		return sizeof(struct load_op) + sizeof(struct literal_numeric);
+	case FILTER_OP_LOAD_DOUBLE:
+		return sizeof(struct load_op) + sizeof(struct literal_double);
+
+	/* cast */
+	case FILTER_OP_CAST_TO_S64:
+	case FILTER_OP_CAST_DOUBLE_TO_S64:
+	case FILTER_OP_CAST_NOP:
+		return sizeof(struct cast_op);
+
+	/* Instructions for recursive traversal through composed types. */
+	case FILTER_OP_GET_CONTEXT_ROOT:
+	case FILTER_OP_GET_APP_CONTEXT_ROOT:
+	case FILTER_OP_GET_PAYLOAD_ROOT:
+	case FILTER_OP_LOAD_FIELD:
+	case FILTER_OP_LOAD_FIELD_S8:
+	case FILTER_OP_LOAD_FIELD_S16:
+	case FILTER_OP_LOAD_FIELD_S32:
+	case FILTER_OP_LOAD_FIELD_S64:
+	case FILTER_OP_LOAD_FIELD_U8:
+	case FILTER_OP_LOAD_FIELD_U16:
+	case FILTER_OP_LOAD_FIELD_U32:
+	case FILTER_OP_LOAD_FIELD_U64:
+	case FILTER_OP_LOAD_FIELD_STRING:
+	case FILTER_OP_LOAD_FIELD_SEQUENCE:
+	case FILTER_OP_LOAD_FIELD_DOUBLE:
+		return sizeof(struct load_op);
+	case FILTER_OP_GET_SYMBOL:
+	case FILTER_OP_GET_SYMBOL_FIELD:
+		return sizeof(struct load_op) + sizeof(struct get_symbol);
+	case FILTER_OP_GET_INDEX_U16:
+		return sizeof(struct load_op) + sizeof(struct get_index_u16);
+	case FILTER_OP_GET_INDEX_U64:
+		return sizeof(struct load_op) + sizeof(struct get_index_u64);
+
+	/* set and range */
+	case FILTER_OP_IN_SET_S64:
+	case FILTER_OP_IN_SET_BITMAP_S64:
+		return filter_set_op_len((struct set_op *) pc);
+	case FILTER_OP_IN_RANGE_S64:
+		return sizeof(struct range_op);
+
+	case FILTER_OP_UNKNOWN:
+	default:
+		return -EINVAL;
+	}
+}
+
+/*
+ * Return the offset of the return instruction ending the reachable
+ * code of a validated bytecode. The validator stops at the first return
+ * instruction and only allows forward jumps, so nothing past it can be
+ * executed.
+ */
+static
+int bytecode_find_return(struct bytecode_runtime *runtime)
+{
+	char *start_pc = &runtime->code[0], *pc;
+	ssize_t len;
+
+	for (pc = start_pc; pc - start_pc < runtime->len; pc += len) {
+		switch (*(filter_opcode_t *) pc) {
+		case FILTER_OP_RETURN:
+		case FILTER_OP_RETURN_S64:
+			return pc - start_pc;
+		}
+		len = bytecode_insn_len(pc);
+		if (len < 0)
+			return len;
+	}
+	return -EINVAL;
+}
+
+/*
+ * Copy the reachable code of a bytecode at offset "code_base" of the
+ * fused runtime, relocating jump targets and data indexes.
+ */
+static
+int bytecode_fuse_append(struct bytecode_runtime *fused,
+		struct bytecode_runtime *runtime,
+		size_t code_base, size_t code_len, size_t data_base)
+{
+	char *start_pc = &fused->code[code_base], *pc;
+	ssize_t len;
+
+	memcpy(start_pc, runtime->code, code_len);
+	if (runtime->data_len)
+		memcpy(&fused->data[data_base], runtime->data,
+			runtime->data_len);
+	for (pc = start_pc; pc - start_pc < code_len; pc += len) {
+		len = bytecode_insn_len(pc);
+		if (len < 0)
+			return len;
+		switch (*(filter_opcode_t *) pc) {
+		case FILTER_OP_AND:
+		case FILTER_OP_OR:
+		{
+			struct logical_op *insn = (struct logical_op *) pc;
+
+			insn->skip_offset += code_base;
+			break;
+		}
+		case FILTER_OP_GET_INDEX_U16:
+		{
+			struct load_op *insn = (struct load_op *) pc;
+			struct get_index_u16 *index = (struct get_index_u16 *) insn->data;
+
+			if (index->index + data_base > USHRT_MAX)
+				return -E2BIG;
+			index->index += data_base;
+			break;
+		}
+		case FILTER_OP_GET_INDEX_U64:
+		{
+			struct load_op *insn = (struct load_op *) pc;
+			struct get_index_u64 *index = (struct get_index_u64 *) insn->data;
+
+			index->index += data_base;
+			break;
+		}
+		case FILTER_OP_IN_SET_BITMAP_S64:
+		{
+			struct set_op *insn = (struct set_op *) pc;
+
+			if (insn->data_offset + data_base > USHRT_MAX)
+				return -E2BIG;
+			insn->data_offset += data_base;
+			break;
+		}
+		case FILTER_OP_LOAD_STRING_MATCHER:
+		{
+			struct load_op *insn = (struct load_op *) pc;
+			struct load_string_matcher *ref =
+				(struct load_string_matcher *) insn->data;
+
+			if (ref->data_offset + data_base > USHRT_MAX)
+				return -E2BIG;
+			ref->data_offset += data_base;
+			break;
+		}
+		}
+	}
+	return 0;
+}
+
+static
+void bytecode_fused_runtime_free(struct bytecode_fused_runtime *fused)
+{
+	free_percpu(fused->runtime.p.stats);
+	lttng_filter_jit_free(&fused->runtime);
+	kfree(fused->runtime.reg_code);
+	kfree(fused->runtime.data);
+	kfree(fused->runtimes);
+	kfree(fused);
+}
+
+/*
+ * Build a single program evaluating the union of the "nr_runtimes"
+ * active filters of an event:
+ *
+ *   <filter 1 code> OR <filter 2 code> OR ... <filter N code> RETURN
+ *
+ * where each OR jumps to the final RETURN as soon as a filter accepts
+ * the event. The return instruction of each filter is replaced by the
+ * OR, so jumps targeting it within a filter remain valid. Filters keep
+ * their seqnum order. Return NULL if the filters cannot be fused.
+ */
+static
+struct bytecode_fused_runtime *bytecode_fuse(struct lttng_event *event,
+		unsigned int nr_runtimes)
+{
+	struct bytecode_fused_runtime *fused;
+	struct lttng_bytecode_runtime *runtime;
+	size_t code_len = 0, data_len = 0, code_base = 0, data_base = 0;
+	unsigned int i = 0;
+	struct logical_op *or_insn;
+	struct return_op *ret_insn;
+	bool memo;
+	int ret;
+
+	list_for_each_entry(runtime, &event->bytecode_runtime_head, node) {
+		struct bytecode_runtime *bc;
+
+		if (runtime->filter == lttng_filter_false)
+			continue;
+		bc = container_of(runtime, struct bytecode_runtime, p);
+		ret = bytecode_find_return(bc);
+		if (ret < 0)
+			return NULL;
+		code_len += ret + sizeof(struct logical_op);
+		data_len = ALIGN(data_len, __alignof__(struct filter_get_index_data));
+		data_len += bc->data_len;
+	}
+	/* The last OR is replaced by the final RETURN. */
+	code_len += sizeof(struct return_op) - sizeof(struct logical_op);
+	if (code_len > USHRT_MAX || data_len > FILTER_MAX_DATA_LEN)
+		return NULL;
+
+	fused = kzalloc(sizeof(*fused) + code_len, GFP_KERNEL);
+	if (!fused)
+		return NULL;
+	fused->runtimes = kcalloc(nr_runtimes, sizeof(*fused->runtimes),
+			GFP_KERNEL);
+	if (!fused->runtimes)
+		goto error;
+	if (data_len) {
+		fused->runtime.data = kzalloc(data_len, GFP_KERNEL);
+		if (!fused->runtime.data)
+			goto error;
+	}
+	fused->nr_runtimes = nr_runtimes;
+	fused->runtime.data_len = data_len;
+	fused->runtime.data_alloc_len = data_len;
+	fused->runtime.len = code_len;
+	fused->runtime.p.event = event;
+	/* The union of filters reading only contexts reads only contexts. */
+	fused->runtime.p.context_only = 1;
+	memo = true;
+
+	list_for_each_entry(runtime, &event->bytecode_runtime_head, node) {
+		struct bytecode_runtime *bc;
+		size_t len;
+
+		if (runtime->filter == lttng_filter_false)
+			continue;
+		bc = container_of(runtime, struct bytecode_runtime, p);
+		len = bytecode_find_return(bc);
+		data_base = ALIGN(data_base, __alignof__(struct filter_get_index_data));
+		ret = bytecode_fuse_append(&fused->runtime, bc, code_base, len,
+				data_base);
+		if (ret)
+			goto error;
+		fused->runtimes[i++] = runtime;
+		fused->runtime.p.context_only &= runtime->context_only;
+		memo &= !!bc->memo_id;
+		code_base += len;
+		data_base += bc->data_len;
+		if (i == nr_runtimes)
+			break;
+		or_insn = (struct logical_op *) &fused->runtime.code[code_base];
+		or_insn->op = FILTER_OP_OR;
+		or_insn->skip_offset = code_len - sizeof(struct return_op);
+		code_base += sizeof(struct logical_op);
+	}
+	ret_insn = (struct return_op *) &fused->runtime.code[code_base];
+	ret_insn->op = FILTER_OP_RETURN;
+
+	if (memo)
+		fused->runtime.memo_id = lttng_filter_memo_new_id();
+	if (lttng_filter_jit_compile(&fused->runtime)
+			&& lttng_filter_lower_bytecode(&fused->runtime))
+		dbg_printk("Fused bytecode not compiled, using interpreter.\n");
+	bytecode_runtime_set_filter(&fused->runtime);
+	fused->runtime.p.stats = alloc_percpu(struct lttng_filter_stats);
+	return fused;
+
+error:
+	bytecode_fused_runtime_free(fused);
+	return NULL;
+}
+
+static
+bool bytecode_fused_runtime_match(struct bytecode_fused_runtime *fused,
+		struct lttng_event *event, unsigned int nr_runtimes)
+{
+	struct lttng_bytecode_runtime *runtime;
+	unsigned int i = 0;
+
+	if (fused->nr_runtimes != nr_runtimes)
+		return false;
+	list_for_each_entry(runtime, &event->bytecode_runtime_head, node) {
+		if (runtime->filter == lttng_filter_false)
+			continue;
+		if (fused->runtimes[i++] != runtime)
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Publish a single program evaluating the union of all active filters
+ * of an event, so the probe does not have to call each filter in turn.
+ * Must be called after lttng_filter_sync_state() on each runtime of the
+ * event, with the sessions mutex held.
+ */
+static
+void runtime_stats_add(struct lttng_filter_stats *sum,
+		struct lttng_bytecode_runtime *runtime)
+{
+	int cpu;
+
+	if (!runtime->stats)
+		return;
+	for_each_possible_cpu(cpu) {
+		struct lttng_filter_stats *stats =
+			per_cpu_ptr(runtime->stats, cpu);
+
+		sum->evaluations += READ_ONCE(stats->evaluations);
+		sum->accepts += READ_ONCE(stats->accepts);
+		sum->samples += READ_ONCE(stats->samples);
+		sum->cycles += READ_ONCE(stats->cycles);
+	}
+}
+
+/*
+ * Add the filter statistics of an event to "sum". Called with the
+ * sessions mutex held.
+ */
+void lttng_filter_event_stats(struct lttng_event *event,
+		struct lttng_filter_stats *sum)
+{
+	struct lttng_bytecode_runtime *runtime;
+
+	sum->evaluations += event->fused_filter_stats.evaluations;
+	sum->accepts += event->fused_filter_stats.accepts;
+	sum->samples += event->fused_filter_stats.samples;
+	sum->cycles += event->fused_filter_stats.cycles;
+	if (event->fused_filter)
+		runtime_stats_add(sum, event->fused_filter);
+	list_for_each_entry(runtime, &event->bytecode_runtime_head, node)
+		runtime_stats_add(sum, runtime);
+}
+
+void lttng_filter_event_fuse_bytecode(struct lttng_event *event)
+{
+	struct lttng_bytecode_runtime *runtime;
+	struct bytecode_fused_runtime *old_fused = NULL, *fused = NULL;
+	unsigned int nr_runtimes = 0;
+
+	list_for_each_entry(runtime, &event->bytecode_runtime_head, node) {
+		if (runtime->filter == lttng_filter_false)
+			continue;
+		/* BPF programs cannot be fused with bytecode. */
+		if (runtime->bc->bpf_prog) {
+			nr_runtimes = 0;
+			break;
+		}
+		nr_runtimes++;
+	}
+	if (event->fused_filter) {
+		old_fused = container_of(event->fused_filter,
+				struct bytecode_fused_runtime, runtime.p);
+		if (bytecode_fused_runtime_match(old_fused, event, nr_runtimes))
+			return;
+	} else if (nr_runtimes < 2) {
+		return;
+	}
+	if (nr_runtimes >= 2)
+		fused = bytecode_fuse(event, nr_runtimes);
+	rcu_assign_pointer(event->fused_filter,
+			fused ? &fused->runtime.p : NULL);
+	if (old_fused) {
+		synchronize_trace();	/* Wait for in-flight filters */
+		runtime_stats_add(&event->fused_filter_stats, &old_fused->runtime.p);
+		bytecode_fused_runtime_free(old_fused);
+	}
 }
 
 /*
@@ -525,6 +1336,56 @@ void lttng_enabler_event_link_bytecode(struct lttng_event *event,
 	}
 }
 
+/*
+ * Link a bytecode to an event which belongs to no session, such as the
+ * events of the filter benchmark, so it goes through the same
+ * validation, specialization and compilation as session events. The
+ * runtime is freed by lttng_free_event_filter_runtime(). Returns the
+ * link error, in which case the runtime discards all records.
+ */
+int lttng_filter_event_link_standalone(struct lttng_event *event,
+		struct lttng_filter_bytecode_node *filter_bytecode)
+{
+	int ret;
+
+	lttng_lock_sessions();
+	ret = _lttng_filter_event_link_bytecode(event, filter_bytecode,
+			event->bytecode_runtime_head.prev);
+	lttng_filter_link_cache_flush();
+	lttng_unlock_sessions();
+	return ret;
+}
+EXPORT_SYMBOL_GPL(lttng_filter_event_link_standalone);
+
+/*
+ * Link the guards of the channel contexts to an event, once each. A
+ * guard which fails to link never records its context for the event.
+ * Should be called with sessions mutex and session lock held.
+ */
+void lttng_filter_event_link_ctx_guards(struct lttng_event *event)
+{
+	struct lttng_ctx *ctx = event->chan->ctx;
+	struct lttng_bytecode_runtime *runtime;
+	unsigned int i;
+
+	if (!ctx)
+		return;
+	for (i = 0; i < ctx->nr_fields; i++) {
+		struct lttng_ctx_guard *guard = ctx->fields[i].guard;
+
+		if (!guard || bytecode_is_linked(guard->bc,
+				&event->ctx_guard_runtime_head))
+			continue;
+		if (_lttng_filter_event_link_bytecode(event, guard->bc,
+				event->ctx_guard_runtime_head.prev))
+			dbg_printk("[lttng filter] warning: cannot link context guard bytecode\n");
+	}
+	list_for_each_entry(runtime, &event->ctx_guard_runtime_head, node) {
+		if (!runtime->link_failed && !runtime->context_only)
+			event->ctx_guard_payload = 1;
+	}
+}
+
 /*
  * We own the filter_bytecode if we return success.
  */
@@ -541,17 +1402,70 @@ void lttng_free_enabler_filter_bytecode(struct lttng_enabler *enabler)
 
 	list_for_each_entry_safe(filter_bytecode, tmp,
 			&enabler->filter_bytecode_head, node) {
+		lttng_filter_bpf_put(filter_bytecode->bpf_prog);
 		kfree(filter_bytecode);
 	}
 }
 
-void lttng_free_event_filter_runtime(struct lttng_event *event)
+static
+void lttng_free_filter_runtime_list(struct list_head *runtime_head)
 {
 	struct bytecode_runtime *runtime, *tmp;
 
-	list_for_each_entry_safe(runtime, tmp,
-			&event->bytecode_runtime_head, p.node) {
+	list_for_each_entry_safe(runtime, tmp, runtime_head, p.node) {
+		free_percpu(runtime->p.stats);
+		lttng_filter_jit_free(runtime);
+		kfree(runtime->reg_code);
 		kfree(runtime->data);
 		kfree(runtime);
 	}
 }
+
+void lttng_free_event_filter_runtime(struct lttng_event *event)
+{
+
+	if (event->fused_filter) {
+		bytecode_fused_runtime_free(container_of(event->fused_filter,
+				struct bytecode_fused_runtime, runtime.p));
+		event->fused_filter = NULL;
+	}
+	lttng_free_filter_runtime_list(&event->bytecode_runtime_head);
+	lttng_free_filter_runtime_list(&event->ctx_guard_runtime_head);
+}
+EXPORT_SYMBOL_GPL(lttng_free_event_filter_runtime);
+
+static
+size_t lttng_filter_runtime_mem_usage(const struct bytecode_runtime *runtime)
+{
+	size_t bytes;
+
+	bytes = ksize(runtime) + ksize(runtime->reg_code) + ksize(runtime->data);
+	bytes += (size_t) runtime->jit_nr_pages << PAGE_SHIFT;
+	if (runtime->p.stats)
+		bytes += num_possible_cpus() * sizeof(struct lttng_filter_stats);
+	return bytes;
+}
+
+/*
+ * Memory held by the filter and context guard runtimes of an event, in
+ * bytes. Called with the sessions mutex held.
+ */
+size_t lttng_filter_event_mem_usage(struct lttng_event *event)
+{
+	struct bytecode_runtime *runtime;
+	size_t bytes = 0;
+
+	if (event->fused_filter) {
+		struct bytecode_fused_runtime *fused = container_of(
+			event->fused_filter, struct bytecode_fused_runtime,
+			runtime.p);
+
+		bytes += lttng_filter_runtime_mem_usage(&fused->runtime);
+		bytes += ksize(fused->runtimes);
+	}
+	list_for_each_entry(runtime, &event->bytecode_runtime_head, p.node)
+		bytes += lttng_filter_runtime_mem_usage(runtime);
+	list_for_each_entry(runtime, &event->ctx_guard_runtime_head, p.node)
+		bytes += lttng_filter_runtime_mem_usage(runtime);
+	return bytes;
+}
@@ -41,10 +41,84 @@ struct bytecode_runtime {
 	size_t data_len;
 	size_t data_alloc_len;
 	char *data;
+	void *jit_image;		/* Native code, NULL if interpreted. */
+	unsigned int jit_nr_pages;
+	struct filter_reg_insn *reg_code;	/* Register IR, or NULL. */
+	/* Nonzero if the results are cached per task, see lttng-filter-memo.c */
+	uint64_t memo_id;
+	uint64_t (*memo_filter)(void *filter_data,
+			struct lttng_probe_ctx *lttng_probe_ctx,
+			const char *filter_stack_data);
+	size_t bpf_ctx_len;		/* Stack data bytes passed to BPF */
 	uint16_t len;
 	char code[0];
 };
 
+/*
+ * Union of the active filters of an event, evaluated as one program.
+ * "runtimes" lists the event runtimes it was built from, in order.
+ */
+struct bytecode_fused_runtime {
+	unsigned int nr_runtimes;
+	struct lttng_bytecode_runtime **runtimes;
+	struct bytecode_runtime runtime;	/* Must be last (code[]). */
+};
+
+/*
+ * Register-based internal representation, lowered from specialized
+ * bytecode. Each stack slot of the bytecode is assigned a register of a
+ * fixed register file, so instructions name their operands rather than
+ * pushing and popping them. Payload and context loads, and comparisons
+ * against an immediate, are single instructions.
+ */
+#define FILTER_REG_FILE_LEN	(FILTER_STACK_LEN - FILTER_STACK_EMPTY - 1)
+
+enum filter_reg_op {
+	FILTER_REG_OP_RETURN,		/* return !!r[a] */
+	FILTER_REG_OP_LOAD_IMM,		/* r[dst] = imm */
+	/* r[dst] = *(type *) (filter_stack_data + imm) */
+	FILTER_REG_OP_LOAD_S8,
+	FILTER_REG_OP_LOAD_S16,
+	FILTER_REG_OP_LOAD_S32,
+	FILTER_REG_OP_LOAD_S64,
+	FILTER_REG_OP_LOAD_U8,
+	FILTER_REG_OP_LOAD_U16,
+	FILTER_REG_OP_LOAD_U32,
+	FILTER_REG_OP_LOAD_U64,
+	FILTER_REG_OP_LOAD_CONTEXT,	/* r[dst] = static context field imm */
+	/* r[dst] = r[a] <op> r[b] */
+	FILTER_REG_OP_EQ,
+	FILTER_REG_OP_NE,
+	FILTER_REG_OP_GT,
+	FILTER_REG_OP_LT,
+	FILTER_REG_OP_GE,
+	FILTER_REG_OP_LE,
+	FILTER_REG_OP_RSHIFT,
+	FILTER_REG_OP_LSHIFT,
+	FILTER_REG_OP_AND,
+	FILTER_REG_OP_OR,
+	FILTER_REG_OP_XOR,
+	/* r[dst] = r[a] <op> imm */
+	FILTER_REG_OP_EQ_IMM,
+	FILTER_REG_OP_NE_IMM,
+	FILTER_REG_OP_GT_IMM,
+	FILTER_REG_OP_LT_IMM,
+	FILTER_REG_OP_GE_IMM,
+	FILTER_REG_OP_LE_IMM,
+	/* r[dst] = <op> r[a] */
+	FILTER_REG_OP_BIT_NOT,
+	FILTER_REG_OP_NEG,
+	FILTER_REG_OP_NOT,
+	FILTER_REG_OP_JZ,		/* if (!r[a]) goto insn imm */
+	FILTER_REG_OP_JNZ_SET,		/* if (r[a]) { r[a] = 1; goto insn imm } */
+};
+
+struct filter_reg_insn {
+	uint8_t op;			/* enum filter_reg_op */
+	uint8_t dst, a, b;
+	int64_t imm;
+};
+
 enum entry_type {
 	REG_S64,
 	REG_DOUBLE,
@@ -83,6 +157,24 @@ enum object_type {
 	OBJECT_TYPE_DYNAMIC,
 };
 
+/*
+ * Sets whose values span less than FILTER_SET_BITMAP_MAX_BITS are
+ * tested against a bitmap, bit i standing for value base + i.
+ */
+#define FILTER_SET_BITMAP_MAX_BITS	4096
+
+struct filter_set_bitmap {
+	int64_t base;
+	uint32_t nr_bits;
+	uint8_t bits[];
+};
+
+static inline
+size_t filter_set_op_len(const struct set_op *insn)
+{
+	return sizeof(struct set_op) + insn->nr_values * sizeof(int64_t);
+}
+
 struct filter_get_index_data {
 	uint64_t offset;	/* in bytes */
 	size_t ctx_index;
@@ -163,6 +255,32 @@ enum estack_string_literal_type {
 	ESTACK_STRING_LITERAL_TYPE_STAR_GLOB,
 };
 
+/*
+ * Compiled string literal. The literal is split on its unescaped stars
+ * into segments of unescaped characters: the first segment anchored at
+ * the start of the candidate, the last one at its end, and the others
+ * matched in order in between. A literal without star is a single
+ * segment, matched exactly. The segment characters, followed by the
+ * original literal, are stored after the segments.
+ */
+struct filter_string_segment {
+	uint16_t offset;	/* In the matcher characters */
+	uint16_t len;
+};
+
+struct filter_string_matcher {
+	enum estack_string_literal_type literal_type;
+	uint16_t nr_segments;
+	uint16_t literal;	/* Offset of the literal in the characters */
+	struct filter_string_segment segments[];
+};
+
+static inline
+char *filter_string_matcher_chars(const struct filter_string_matcher *matcher)
+{
+	return (char *) &matcher->segments[matcher->nr_segments];
+}
+
 struct load_ptr {
 	enum load_type type;
 	enum object_type object_type;
@@ -191,6 +309,8 @@ struct estack_entry {
 			size_t seq_len;
 			enum estack_string_literal_type literal_type;
 			int user;		/* is string from userspace ? */
+			/* Compiled literal, only set for literals. */
+			const struct filter_string_matcher *matcher;
 		} s;
 		struct load_ptr ptr;
 	} u;
@@ -235,14 +355,64 @@ struct estack {
 const char *lttng_filter_print_op(enum filter_op op);
 
 int lttng_filter_validate_bytecode(struct bytecode_runtime *bytecode);
+int lttng_filter_optimize_bytecode(struct bytecode_runtime *bytecode);
 int lttng_filter_specialize_bytecode(struct lttng_event *event,
 		struct bytecode_runtime *bytecode);
 
 uint64_t lttng_filter_false(void *filter_data,
 		struct lttng_probe_ctx *lttng_probe_ctx,
 		const char *filter_stack_data);
+uint64_t lttng_filter_memo(void *filter_data,
+		struct lttng_probe_ctx *lttng_probe_ctx,
+		const char *filter_stack_data);
+uint64_t lttng_filter_memo_new_id(void);
+bool lttng_filter_memo_context(const char *name);
 uint64_t lttng_filter_interpret_bytecode(void *filter_data,
 		struct lttng_probe_ctx *lttng_probe_ctx,
 		const char *filter_stack_data);
 
+int lttng_filter_lower_bytecode(struct bytecode_runtime *runtime);
+uint64_t lttng_filter_interpret_regs(void *filter_data,
+		struct lttng_probe_ctx *lttng_probe_ctx,
+		const char *filter_stack_data);
+
+#ifdef CONFIG_X86_64
+int lttng_filter_jit_compile(struct bytecode_runtime *runtime);
+void lttng_filter_jit_free(struct bytecode_runtime *runtime);
+#else
+static inline
+int lttng_filter_jit_compile(struct bytecode_runtime *runtime)
+{
+	return -ENOSYS;
+}
+
+static inline
+void lttng_filter_jit_free(struct bytecode_runtime *runtime)
+{
+}
+#endif
+
+#ifdef CONFIG_BPF_SYSCALL
+int lttng_filter_bpf_link(struct lttng_event *event,
+		struct bytecode_runtime *runtime);
+uint64_t lttng_filter_bpf_run(void *filter_data,
+		struct lttng_probe_ctx *lttng_probe_ctx,
+		const char *filter_stack_data);
+#else
+static inline
+int lttng_filter_bpf_link(struct lttng_event *event,
+		struct bytecode_runtime *runtime)
+{
+	return -ENOSYS;
+}
+
+static inline
+uint64_t lttng_filter_bpf_run(void *filter_data,
+		struct lttng_probe_ctx *lttng_probe_ctx,
+		const char *filter_stack_data)
+{
+	return LTTNG_FILTER_DISCARD;
+}
+#endif
+
 #endif /* _LTTNG_FILTER_H */
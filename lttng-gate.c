@@ -0,0 +1,231 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-gate.c
+ *
+ * LTTng session gates, arming events between occurrences of other events.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/hash.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/atomic.h>
+
+#include <wrapper/vmalloc.h>
+#include <lttng-events.h>
+
+/*
+ * A session has 32 gates of each scope, each either open or closed on
+ * each cpu, or for each task. The events of an enabler may be
+ * conditioned on some gates of a scope, being recorded only while all of
+ * them are open, and may open or close gates of that scope each time
+ * they are hit, once accepted by their filters. All gates are closed
+ * when the session is started.
+ *
+ * For example, the entry of a system call opening a task gate and its
+ * exit closing it records the block events conditioned on that gate
+ * only while a task runs that system call. Events acting on gates can
+ * be in count-only mode, so that they are not recorded themselves.
+ *
+ * Cpu gates are a word per cpu, updated with a local cmpxchg. Task
+ * gates are kept in a per-session table indexed by thread id, each slot
+ * holding the thread id and its gates in a single 64-bit word updated
+ * with cmpxchg. Colliding threads make the table lossy: a thread opening
+ * a gate takes over the slot of its colliding thread, whose gates are
+ * then closed, and a thread reusing the id of a dead thread inherits its
+ * gates. Task gates are those of the current task, including in
+ * interrupt context.
+ */
+
+#define LTTNG_GATE_TASK_SLOTS_ORDER	12
+#define LTTNG_GATE_TASK_NR_SLOTS	(1U << LTTNG_GATE_TASK_SLOTS_ORDER)
+
+struct lttng_gates {
+	unsigned long __percpu *cpu;	/* Open cpu gates */
+	atomic64_t *task;		/* Thread id << 32 | open task gates */
+};
+
+static
+atomic64_t *lttng_gates_task_slot(struct lttng_gates *gates, u32 tid)
+{
+	return &gates->task[hash_32(tid, LTTNG_GATE_TASK_SLOTS_ORDER)];
+}
+
+static
+u32 lttng_gates_task_get(struct lttng_gates *gates)
+{
+	u32 tid = current->pid;
+	u64 v = atomic64_read(lttng_gates_task_slot(gates, tid));
+
+	if ((u32) (v >> 32) != tid)
+		return 0;
+	return (u32) v;
+}
+
+/*
+ * Return true if the gates the event is conditioned on are all open.
+ * Called by the probes of events with LTTNG_EVENT_ARMED_GATE.
+ */
+bool lttng_gates_match(struct lttng_event *event)
+{
+	struct lttng_gates *gates;
+	u32 cond = event->gate.cond;
+	u32 open;
+
+	gates = lttng_rcu_dereference(event->chan->session->gates);
+	if (!gates)
+		return true;
+	switch (event->gate.scope) {
+	case LTTNG_KERNEL_GATE_SCOPE_CPU:
+		open = (u32) READ_ONCE(*this_cpu_ptr(gates->cpu));
+		break;
+	case LTTNG_KERNEL_GATE_SCOPE_TASK:
+		open = lttng_gates_task_get(gates);
+		break;
+	default:
+		return true;
+	}
+	return (open & cond) == cond;
+}
+EXPORT_SYMBOL_GPL(lttng_gates_match);
+
+static
+void lttng_gates_cpu_act(struct lttng_gates *gates, u32 set, u32 clear)
+{
+	unsigned long *p = this_cpu_ptr(gates->cpu);
+	unsigned long old, new;
+
+	do {
+		old = READ_ONCE(*p);
+		new = (old | set) & ~(unsigned long) clear;
+		if (new == old)
+			return;
+	} while (cmpxchg_local(p, old, new) != old);
+}
+
+static
+void lttng_gates_task_act(struct lttng_gates *gates, u32 set, u32 clear)
+{
+	u32 tid = current->pid;
+	atomic64_t *slot = lttng_gates_task_slot(gates, tid);
+	u64 old, new, prev;
+	u32 open;
+
+	old = atomic64_read(slot);
+	for (;;) {
+		open = (u32) (old >> 32) == tid ? (u32) old : 0;
+		open = (open | set) & ~clear;
+		/* Do not take over a colliding thread to close gates. */
+		if ((u32) (old >> 32) != tid && !open)
+			return;
+		new = ((u64) tid << 32) | open;
+		if (new == old)
+			return;
+		prev = atomic64_cmpxchg(slot, old, new);
+		if (prev == old)
+			return;
+		old = prev;
+	}
+}
+
+/*
+ * Open and close the gates acted on by the event. Called by the probes
+ * of events with LTTNG_EVENT_ARMED_GATE_ACTION, once accepted by their
+ * filters. Closing takes precedence.
+ */
+void lttng_gates_act(struct lttng_event *event)
+{
+	struct lttng_gates *gates;
+
+	gates = lttng_rcu_dereference(event->chan->session->gates);
+	if (!gates)
+		return;
+	switch (event->gate.scope) {
+	case LTTNG_KERNEL_GATE_SCOPE_CPU:
+		lttng_gates_cpu_act(gates, event->gate.open, event->gate.close);
+		break;
+	case LTTNG_KERNEL_GATE_SCOPE_TASK:
+		lttng_gates_task_act(gates, event->gate.open, event->gate.close);
+		break;
+	default:
+		break;
+	}
+}
+EXPORT_SYMBOL_GPL(lttng_gates_act);
+
+int lttng_gate_validate(const struct lttng_kernel_event_gate *param)
+{
+	switch (param->scope) {
+	case LTTNG_KERNEL_GATE_SCOPE_CPU:
+	case LTTNG_KERNEL_GATE_SCOPE_TASK:
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+/*
+ * Allocate the gates of a session, on first use. Called with the
+ * session lock held.
+ */
+int lttng_session_gates_create(struct lttng_session *session)
+{
+	struct lttng_gates *gates;
+
+	if (session->gates)
+		return 0;
+	gates = kzalloc(sizeof(*gates), GFP_KERNEL);
+	if (!gates)
+		return -ENOMEM;
+	gates->cpu = alloc_percpu(unsigned long);
+	if (!gates->cpu)
+		goto error_cpu;
+	gates->task = lttng_kvzalloc(LTTNG_GATE_TASK_NR_SLOTS
+			* sizeof(*gates->task), GFP_KERNEL);
+	if (!gates->task)
+		goto error_task;
+	/* Ensure the memory we just allocated don't trigger page faults */
+	wrapper_vmalloc_sync_all();
+	rcu_assign_pointer(session->gates, gates);
+	return 0;
+
+error_task:
+	free_percpu(gates->cpu);
+error_cpu:
+	kfree(gates);
+	return -ENOMEM;
+}
+
+/*
+ * Close all the gates of a session. Called with the session lock
+ * held, while the session is inactive.
+ */
+void lttng_session_gates_reset(struct lttng_session *session)
+{
+	struct lttng_gates *gates = session->gates;
+	unsigned int i;
+	int cpu;
+
+	if (!gates)
+		return;
+	for_each_possible_cpu(cpu)
+		WRITE_ONCE(*per_cpu_ptr(gates->cpu, cpu), 0);
+	for (i = 0; i < LTTNG_GATE_TASK_NR_SLOTS; i++)
+		atomic64_set(&gates->task[i], 0);
+}
+
+/* Called once no probe can use the session anymore. */
+void lttng_session_gates_destroy(struct lttng_session *session)
+{
+	struct lttng_gates *gates = session->gates;
+
+	if (!gates)
+		return;
+	lttng_kvfree(gates->task);
+	free_percpu(gates->cpu);
+	kfree(gates);
+	session->gates = NULL;
+}
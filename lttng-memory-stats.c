@@ -0,0 +1,199 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-memory-stats.c
+ *
+ * LTTng tracer memory statistics.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#include <wrapper/ringbuffer/frontend.h>
+#include <lttng-events.h>
+#include <lttng-tp-mempool.h>
+
+/*
+ * The "lttng-memory" debugfs file shows the memory held by each session
+ * and its channels, along with their event, enabler and record counters,
+ * followed by the totals of the tracer. Sizes are in bytes: "data" is
+ * the buffer pages, "table" the bookkeeping of the buffers, and the
+ * sizes of the slab objects are as reported by ksize(). The counters of
+ * the buffers are sampled without stopping the tracer.
+ */
+
+struct lttng_memory_stats {
+	size_t data_bytes;
+	size_t table_bytes;
+	size_t object_bytes;
+};
+
+struct lttng_memory_stats_channel {
+	unsigned int nr_buffers;
+	size_t data_bytes, table_bytes;
+	unsigned long records, overrun, lost_full, lost_wrap, lost_big,
+		reserve_slow;
+};
+
+static struct dentry *memory_stats_dentry;
+
+static
+void lttng_memory_stats_buffer(const struct lib_ring_buffer_config *config,
+		struct lib_ring_buffer *buf, struct lttng_memory_stats_channel *s)
+{
+	size_t data_bytes;
+
+	s->table_bytes += lib_ring_buffer_mem_usage(buf, &data_bytes);
+	if (!data_bytes)
+		return;
+	s->nr_buffers++;
+	s->data_bytes += data_bytes;
+	s->records += lib_ring_buffer_get_records_count(config, buf);
+	s->overrun += lib_ring_buffer_get_records_overrun(config, buf);
+	s->lost_full += lib_ring_buffer_get_records_lost_full(config, buf);
+	s->lost_wrap += lib_ring_buffer_get_records_lost_wrap(config, buf);
+	s->lost_big += lib_ring_buffer_get_records_lost_big(config, buf);
+	s->reserve_slow += lib_ring_buffer_get_reserve_slow(config, buf);
+}
+
+static
+void lttng_memory_stats_channel(struct seq_file *m,
+		struct lttng_channel *chan, struct lttng_memory_stats *total)
+{
+	struct channel *rb_chan = chan->chan;
+	const struct lib_ring_buffer_config *config;
+	struct lttng_memory_stats_channel s;
+	size_t pool_data_bytes, pool_bytes;
+	int cpu;
+
+	seq_printf(m, "  channel %u %s", chan->id,
+		chan->channel_type == METADATA_CHANNEL ? "metadata" :
+		(rb_chan ? rb_chan->backend.name : ""));
+	/* The buffers of a shared channel are those of its owner. */
+	if (!rb_chan || chan->shared) {
+		seq_puts(m, chan->shared ? " shared\n" : "\n");
+		return;
+	}
+	config = &rb_chan->backend.config;
+	memset(&s, 0, sizeof(s));
+	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU) {
+		for_each_channel_cpu(cpu, rb_chan)
+			lttng_memory_stats_buffer(config,
+				channel_get_ring_buffer(config, rb_chan, cpu),
+				&s);
+	} else {
+		lttng_memory_stats_buffer(config,
+			channel_get_ring_buffer(config, rb_chan, 0), &s);
+	}
+	pool_bytes = lttng_channel_pool_mem_usage(chan, &pool_data_bytes);
+	seq_printf(m, " buffers %u data %zu table %zu pool_data %zu pool_table %zu\n",
+		s.nr_buffers, s.data_bytes, s.table_bytes, pool_data_bytes,
+		pool_bytes);
+	seq_printf(m, "    records %lu overrun %lu lost_full %lu lost_wrap %lu lost_big %lu reserve_slow %lu\n",
+		s.records, s.overrun, s.lost_full, s.lost_wrap, s.lost_big,
+		s.reserve_slow);
+	total->data_bytes += s.data_bytes + pool_data_bytes;
+	total->table_bytes += s.table_bytes + pool_bytes;
+}
+
+static
+void lttng_memory_stats_session(struct seq_file *m,
+		struct lttng_session *session, struct lttng_memory_stats *total)
+{
+	struct lttng_metadata_cache *cache = session->metadata_cache;
+	struct lttng_channel *chan;
+	struct lttng_event *event;
+	struct lttng_enabler *enabler;
+	unsigned int nr_events = 0, nr_enablers = 0, nr_chunks, chunks_alloc;
+	size_t event_bytes = 0, filter_bytes = 0, enabler_bytes = 0,
+		metadata_bytes;
+
+	list_for_each_entry(event, &session->events, list) {
+		nr_events++;
+		event_bytes += sizeof(*event);
+		filter_bytes += lttng_filter_event_mem_usage(event);
+	}
+	list_for_each_entry(enabler, &session->enablers_head, node) {
+		struct lttng_filter_bytecode_node *bytecode;
+
+		nr_enablers++;
+		enabler_bytes += ksize(enabler);
+		list_for_each_entry(bytecode, &enabler->filter_bytecode_head,
+				node)
+			enabler_bytes += ksize(bytecode);
+	}
+	/* The chunks array is reallocated by metadata writers. */
+	mutex_lock(&cache->lock);
+	nr_chunks = cache->nr_chunks;
+	chunks_alloc = cache->chunks_alloc;
+	mutex_unlock(&cache->lock);
+	metadata_bytes = (size_t) nr_chunks * LTTNG_METADATA_CACHE_CHUNK_SIZE
+		+ (size_t) chunks_alloc * sizeof(*cache->chunks);
+
+	seq_printf(m, "session %pUl active %d\n", &session->uuid,
+		session->active);
+	seq_printf(m, "  events %u event %zu filter %zu enablers %u enabler %zu metadata_cache %zu\n",
+		nr_events, event_bytes, filter_bytes, nr_enablers,
+		enabler_bytes, metadata_bytes);
+	list_for_each_entry(chan, &session->chan, list)
+		lttng_memory_stats_channel(m, chan, total);
+	total->object_bytes += event_bytes + filter_bytes + enabler_bytes
+		+ metadata_bytes;
+}
+
+static
+int lttng_memory_stats_show(struct seq_file *m, void *p)
+{
+	struct lttng_memory_stats total;
+	struct lttng_session *session;
+	unsigned int nr_sessions = 0;
+	size_t mempool_bytes = lttng_tp_mempool_mem_usage();
+
+	memset(&total, 0, sizeof(total));
+	lttng_lock_sessions();
+	list_for_each_entry(session, lttng_get_sessions_list_head(), list) {
+		nr_sessions++;
+		/* Channel resizes replace the buffers under the session lock. */
+		lttng_lock_session(session);
+		lttng_memory_stats_session(m, session, &total);
+		lttng_unlock_session(session);
+	}
+	lttng_unlock_sessions();
+	seq_printf(m, "total sessions %u data %zu table %zu objects %zu tp_mempool %zu\n",
+		nr_sessions, total.data_bytes, total.table_bytes,
+		total.object_bytes, mempool_bytes);
+	return 0;
+}
+
+static
+int lttng_memory_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, lttng_memory_stats_show, NULL);
+}
+
+static const struct file_operations lttng_memory_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = lttng_memory_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+int lttng_memory_stats_init(void)
+{
+	/* Statistics are optional. */
+	memory_stats_dentry = debugfs_create_file("lttng-memory", 0444, NULL,
+			NULL, &lttng_memory_stats_fops);
+	if (IS_ERR(memory_stats_dentry))
+		memory_stats_dentry = NULL;
+	return 0;
+}
+
+void lttng_memory_stats_exit(void)
+{
+	debugfs_remove(memory_stats_dentry);
+	memory_stats_dentry = NULL;
+}
@@ -0,0 +1,351 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-metadata-binary.c
+ *
+ * LTTng compact binary encoding of the event payload declarations.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+
+#include <lttng-events.h>
+#include <lttng-metadata-binary.h>
+
+/*
+ * The record is generated from the same event field descriptions as the
+ * TSDL declarations by _lttng_field_statedump(), and describes the same
+ * layout. See lttng-metadata-binary.h for the format.
+ */
+
+int lttng_metadata_buf_append(struct lttng_metadata_buf *buf,
+		const void *src, size_t len)
+{
+	if (buf->len + len > buf->alloc) {
+		size_t alloc;
+		char *data;
+
+		alloc = max_t(size_t, buf->len + len, buf->alloc << 1);
+		data = krealloc(buf->data, alloc, GFP_KERNEL);
+		if (!data)
+			return -ENOMEM;
+		buf->data = data;
+		buf->alloc = alloc;
+	}
+	memcpy(buf->data + buf->len, src, len);
+	buf->len += len;
+	return 0;
+}
+
+static
+int binary_u8(struct lttng_metadata_buf *buf, uint8_t v)
+{
+	return lttng_metadata_buf_append(buf, &v, sizeof(v));
+}
+
+static
+int binary_u32(struct lttng_metadata_buf *buf, uint32_t v)
+{
+	return lttng_metadata_buf_append(buf, &v, sizeof(v));
+}
+
+static
+int binary_u64(struct lttng_metadata_buf *buf, uint64_t v)
+{
+	return lttng_metadata_buf_append(buf, &v, sizeof(v));
+}
+
+static
+int binary_string(struct lttng_metadata_buf *buf, const char *s)
+{
+	return lttng_metadata_buf_append(buf, s, strlen(s) + 1);
+}
+
+/* Fields of packed records are only byte aligned. Alignments are in bits. */
+static
+int binary_integer(struct lttng_metadata_buf *buf,
+		const struct lttng_integer_type *type, int packed)
+{
+	struct lttng_metadata_binary_integer integer;
+
+	integer.size = type->size;
+	integer.alignment = packed ? min_t(unsigned int, type->alignment,
+			CHAR_BIT) : type->alignment;
+	integer.flags = 0;
+	if (type->signedness)
+		integer.flags |= LTTNG_METADATA_BINARY_INT_SIGNED;
+	if (type->reverse_byte_order)
+		integer.flags |= LTTNG_METADATA_BINARY_INT_REVERSE_BO;
+	integer.base = type->base;
+	integer.encoding = type->encoding;
+	return lttng_metadata_buf_append(buf, &integer, sizeof(integer));
+}
+
+static
+int binary_enum(struct lttng_metadata_buf *buf,
+		const struct lttng_type *type, int packed)
+{
+	const struct lttng_enum_desc *enum_desc = type->u.basic.enumeration.desc;
+	unsigned int i;
+	int ret;
+
+	ret = binary_string(buf, enum_desc->name);
+	if (ret)
+		return ret;
+	ret = binary_integer(buf, &type->u.basic.enumeration.container_type,
+			packed);
+	if (ret)
+		return ret;
+	ret = binary_u32(buf, enum_desc->nr_entries);
+	if (ret)
+		return ret;
+	for (i = 0; i < enum_desc->nr_entries; i++) {
+		const struct lttng_enum_entry *entry = &enum_desc->entries[i];
+		uint8_t flags = 0;
+
+		if (entry->start.signedness)
+			flags |= LTTNG_METADATA_BINARY_ENUM_START_SIGNED;
+		if (entry->end.signedness)
+			flags |= LTTNG_METADATA_BINARY_ENUM_END_SIGNED;
+		if (entry->options.is_auto)
+			flags |= LTTNG_METADATA_BINARY_ENUM_AUTO;
+		ret = binary_u64(buf, entry->start.value);
+		if (ret)
+			return ret;
+		ret = binary_u64(buf, entry->end.value);
+		if (ret)
+			return ret;
+		ret = binary_u8(buf, flags);
+		if (ret)
+			return ret;
+		ret = binary_string(buf, entry->string);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static
+int binary_fields(struct lttng_metadata_buf *buf,
+		const struct lttng_event_field *fields, unsigned int nr_fields,
+		int packed, unsigned int depth);
+
+static
+int binary_type(struct lttng_metadata_buf *buf, const struct lttng_type *type,
+		int packed, unsigned int depth)
+{
+	int ret;
+
+	if (depth > LTTNG_METADATA_BINARY_MAX_DEPTH)
+		return -EINVAL;
+	switch (type->atype) {
+	case atype_integer:
+		ret = binary_u8(buf, LTTNG_METADATA_BINARY_TYPE_INTEGER);
+		if (ret)
+			return ret;
+		return binary_integer(buf, &type->u.basic.integer, packed);
+	case atype_enum:
+		ret = binary_u8(buf, LTTNG_METADATA_BINARY_TYPE_ENUM);
+		if (ret)
+			return ret;
+		return binary_enum(buf, type, packed);
+	case atype_array:
+	case atype_array_bitfield:
+		ret = binary_u8(buf, LTTNG_METADATA_BINARY_TYPE_ARRAY);
+		if (ret)
+			return ret;
+		ret = binary_u32(buf, packed ? 0 :
+				type->u.array.elem_alignment * CHAR_BIT);
+		if (ret)
+			return ret;
+		ret = binary_u32(buf, type->u.array.length);
+		if (ret)
+			return ret;
+		ret = binary_u8(buf, LTTNG_METADATA_BINARY_TYPE_INTEGER);
+		if (ret)
+			return ret;
+		return binary_integer(buf,
+				&type->u.array.elem_type.u.basic.integer, packed);
+	case atype_sequence:
+	case atype_sequence_bitfield:
+		ret = binary_u8(buf, LTTNG_METADATA_BINARY_TYPE_SEQUENCE);
+		if (ret)
+			return ret;
+		ret = binary_integer(buf,
+				&type->u.sequence.length_type.u.basic.integer,
+				packed);
+		if (ret)
+			return ret;
+		ret = binary_u32(buf, packed ? 0 :
+				type->u.sequence.elem_alignment * CHAR_BIT);
+		if (ret)
+			return ret;
+		ret = binary_u8(buf, LTTNG_METADATA_BINARY_TYPE_INTEGER);
+		if (ret)
+			return ret;
+		return binary_integer(buf,
+				&type->u.sequence.elem_type.u.basic.integer, packed);
+	case atype_string:
+		ret = binary_u8(buf, LTTNG_METADATA_BINARY_TYPE_STRING);
+		if (ret)
+			return ret;
+		return binary_u8(buf, type->u.basic.string.encoding);
+	case atype_struct:
+		ret = binary_u8(buf, LTTNG_METADATA_BINARY_TYPE_STRUCT);
+		if (ret)
+			return ret;
+		ret = binary_u32(buf, type->u._struct.nr_fields);
+		if (ret)
+			return ret;
+		return binary_fields(buf, type->u._struct.fields,
+				type->u._struct.nr_fields, packed, depth + 1);
+	case atype_array_compound:
+		ret = binary_u8(buf, LTTNG_METADATA_BINARY_TYPE_ARRAY_COMPOUND);
+		if (ret)
+			return ret;
+		ret = binary_u32(buf, type->u.array_compound.length);
+		if (ret)
+			return ret;
+		return binary_type(buf, type->u.array_compound.elem_type,
+				packed, depth + 1);
+	case atype_sequence_compound:
+		ret = binary_u8(buf,
+				LTTNG_METADATA_BINARY_TYPE_SEQUENCE_COMPOUND);
+		if (ret)
+			return ret;
+		ret = binary_string(buf, type->u.sequence_compound.length_name);
+		if (ret)
+			return ret;
+		return binary_type(buf, type->u.sequence_compound.elem_type,
+				packed, depth + 1);
+	case atype_variant:
+		ret = binary_u8(buf, LTTNG_METADATA_BINARY_TYPE_VARIANT);
+		if (ret)
+			return ret;
+		ret = binary_string(buf, type->u.variant.tag_name);
+		if (ret)
+			return ret;
+		ret = binary_u32(buf, type->u.variant.nr_choices);
+		if (ret)
+			return ret;
+		return binary_fields(buf, type->u.variant.choices,
+				type->u.variant.nr_choices, packed, depth + 1);
+	default:
+		WARN_ON_ONCE(1);
+		return -EINVAL;
+	}
+}
+
+static
+int binary_fields(struct lttng_metadata_buf *buf,
+		const struct lttng_event_field *fields, unsigned int nr_fields,
+		int packed, unsigned int depth)
+{
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < nr_fields; i++) {
+		ret = binary_string(buf, fields[i].name);
+		if (ret)
+			return ret;
+		ret = binary_type(buf, &fields[i].type, packed, depth);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/*
+ * Append the marker and the binary record of the payload declaration of
+ * an event to "buf", for a channel of the given layout. On error, "buf"
+ * is left as it was.
+ */
+int lttng_metadata_binary_encode_event(struct lttng_metadata_buf *buf,
+		const struct lttng_event_desc *desc, int packed)
+{
+	size_t start = buf->len, len_offset;
+	uint32_t record_len;
+	int ret;
+
+	ret = binary_u8(buf, LTTNG_METADATA_BINARY_MARKER);
+	if (ret)
+		goto error;
+	len_offset = buf->len;
+	ret = binary_u32(buf, 0);
+	if (ret)
+		goto error;
+	ret = binary_u8(buf, LTTNG_METADATA_BINARY_VERSION);
+	if (ret)
+		goto error;
+	ret = binary_u8(buf, (desc->single_pass ?
+				LTTNG_METADATA_BINARY_FLAG_SLACK : 0)
+			| (packed ? LTTNG_METADATA_BINARY_FLAG_PACKED : 0));
+	if (ret)
+		goto error;
+	ret = lttng_metadata_buf_append(buf, "\0\0", sizeof(uint16_t));
+	if (ret)
+		goto error;
+	ret = binary_u32(buf, desc->nr_fields);
+	if (ret)
+		goto error;
+	ret = binary_fields(buf, desc->fields, desc->nr_fields, packed, 0);
+	if (ret)
+		goto error;
+	record_len = buf->len - len_offset - sizeof(record_len);
+	memcpy(buf->data + len_offset, &record_len, sizeof(record_len));
+	return 0;
+
+error:
+	buf->len = start;
+	return ret;
+}
+
+/*
+ * Copy an entry of a binary event listing to user-space, or only count
+ * its size once an entry did not fit.
+ */
+int lttng_event_list_append(struct lttng_event_list_writer *writer,
+		const struct lttng_event_desc *desc, const char *name,
+		uint32_t index, uint32_t bitness)
+{
+	static const char zero[8];
+	struct lttng_kernel_event_list_entry entry;
+	struct lttng_metadata_buf *buf = &writer->entry;
+	int ret;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.index = index;
+	entry.bitness = bitness;
+	buf->len = 0;
+	ret = lttng_metadata_buf_append(buf, &entry, sizeof(entry));
+	if (ret)
+		return ret;
+	ret = lttng_metadata_buf_append(buf, name, strlen(name) + 1);
+	if (ret)
+		return ret;
+	if (writer->flags & LTTNG_KERNEL_EVENT_LIST_FIELDS) {
+		entry.fields_offset = buf->len;
+		ret = lttng_metadata_binary_encode_event(buf, desc, 0);
+		if (ret)
+			return ret;
+	}
+	ret = lttng_metadata_buf_append(buf, zero,
+			ALIGN(buf->len, sizeof(zero)) - buf->len);
+	if (ret)
+		return ret;
+	entry.len = buf->len;
+	memcpy(buf->data, &entry, sizeof(entry));
+	if (!writer->full && writer->len + buf->len <= writer->avail) {
+		if (copy_to_user(writer->ubuf + writer->len, buf->data,
+				buf->len))
+			return -EFAULT;
+		writer->nr_entries++;
+	} else {
+		writer->full = 1;
+	}
+	writer->len += buf->len;
+	return 0;
+}
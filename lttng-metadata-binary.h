@@ -0,0 +1,380 @@
+#ifndef _LTTNG_METADATA_BINARY_H
+#define _LTTNG_METADATA_BINARY_H
+
+/*
+ * lttng-metadata-binary.h
+ *
+ * LTTng compact binary encoding of the event payload declarations, and
+ * its decoder. This header is shared with user-space viewers and
+ * converters.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ */
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/string.h>
+#else
+#include <stdint.h>
+#include <string.h>
+#endif
+
+/*
+ * With LTTNG_KERNEL_METADATA_FORMAT_BINARY, the metadata stays TSDL
+ * text, except for the payload of each event: the "fields := struct
+ * { ... };" declaration of the event block is replaced by a binary
+ * record. A record starts with a null byte, which cannot appear in
+ * TSDL, followed by a 32-bit length and the record itself, of that
+ * length. The environment of the trace holds
+ * 'metadata_format = "binary";'.
+ *
+ * All integers are in the byte order of the trace. Strings are null
+ * terminated. Alignments are in bits, and already adjusted for the
+ * channel layout: a packed channel record has byte-aligned integers and
+ * no element alignment. A record is:
+ *
+ *   uint8_t  version             LTTNG_METADATA_BINARY_VERSION
+ *   uint8_t  flags               LTTNG_METADATA_BINARY_FLAG_*
+ *   uint16_t reserved
+ *   uint32_t nr_fields
+ *   field    fields[nr_fields]
+ *
+ * where a field is its name followed by its type, and a type is a
+ * uint8_t LTTNG_METADATA_BINARY_TYPE_* followed by:
+ *
+ *   INTEGER            integer
+ *   ENUM               string name, integer container,
+ *                      uint32_t nr_entries, entry entries[nr_entries]
+ *   ARRAY              uint32_t elem_alignment, uint32_t length,
+ *                      type elem
+ *   SEQUENCE           integer length_type, uint32_t elem_alignment,
+ *                      type elem
+ *   STRING             uint8_t encoding
+ *   STRUCT             uint32_t nr_fields, field fields[nr_fields]
+ *   ARRAY_COMPOUND     uint32_t length, type elem
+ *   SEQUENCE_COMPOUND  string length_name, type elem
+ *   VARIANT            string tag_name, uint32_t nr_choices,
+ *                      field choices[nr_choices]
+ *
+ *   integer            uint8_t size, uint8_t alignment,
+ *                      uint8_t flags (LTTNG_METADATA_BINARY_INT_*),
+ *                      uint8_t base, uint8_t encoding
+ *   entry              uint64_t start, uint64_t end,
+ *                      uint8_t flags (LTTNG_METADATA_BINARY_ENUM_*),
+ *                      string label
+ *
+ * Encodings are 0: none, 1: UTF8, 2: ASCII. A sequence of basic
+ * elements is preceded in the record by its length integer, named after
+ * the field as in the TSDL declaration.
+ */
+
+#define LTTNG_METADATA_BINARY_MARKER		0
+#define LTTNG_METADATA_BINARY_VERSION		1
+#define LTTNG_METADATA_BINARY_MAX_DEPTH		16
+
+/*
+ * The payload ends with the "_lttng_slack" sequence of bytes, after its
+ * 16-bit unsigned length, aligned on 16 bits unless the record is
+ * packed.
+ */
+#define LTTNG_METADATA_BINARY_FLAG_SLACK	(1U << 0)
+/* Record of a packed channel. */
+#define LTTNG_METADATA_BINARY_FLAG_PACKED	(1U << 1)
+
+#define LTTNG_METADATA_BINARY_INT_SIGNED	(1U << 0)
+#define LTTNG_METADATA_BINARY_INT_REVERSE_BO	(1U << 1)
+
+#define LTTNG_METADATA_BINARY_ENUM_START_SIGNED	(1U << 0)
+#define LTTNG_METADATA_BINARY_ENUM_END_SIGNED	(1U << 1)
+#define LTTNG_METADATA_BINARY_ENUM_AUTO		(1U << 2)
+
+enum lttng_metadata_binary_type {
+	LTTNG_METADATA_BINARY_TYPE_INTEGER		= 0,
+	LTTNG_METADATA_BINARY_TYPE_ENUM			= 1,
+	LTTNG_METADATA_BINARY_TYPE_ARRAY		= 2,
+	LTTNG_METADATA_BINARY_TYPE_SEQUENCE		= 3,
+	LTTNG_METADATA_BINARY_TYPE_STRING		= 4,
+	LTTNG_METADATA_BINARY_TYPE_STRUCT		= 5,
+	LTTNG_METADATA_BINARY_TYPE_ARRAY_COMPOUND	= 6,
+	LTTNG_METADATA_BINARY_TYPE_SEQUENCE_COMPOUND	= 7,
+	LTTNG_METADATA_BINARY_TYPE_VARIANT		= 8,
+};
+
+struct lttng_metadata_binary_integer {
+	uint8_t size;
+	uint8_t alignment;
+	uint8_t flags;
+	uint8_t base;
+	uint8_t encoding;
+};
+
+/*
+ * Decoder. The visitor callbacks are called in declaration order; a
+ * non-zero return value stops the decoding and is returned. Compound
+ * types call type_begin() then the callbacks of their elements, and
+ * type_end(). "name" is NULL for the element type of arrays and
+ * sequences.
+ */
+struct lttng_metadata_binary_visitor {
+	int (*integer)(void *priv, const char *name,
+			const struct lttng_metadata_binary_integer *integer);
+	int (*string)(void *priv, const char *name, uint8_t encoding);
+	int (*enum_begin)(void *priv, const char *field_name,
+			const char *enum_name,
+			const struct lttng_metadata_binary_integer *container);
+	int (*enum_entry)(void *priv, uint64_t start, uint64_t end,
+			uint8_t flags, const char *label);
+	int (*array_begin)(void *priv, const char *name,
+			uint32_t elem_alignment, uint32_t length);
+	int (*sequence_begin)(void *priv, const char *name,
+			const struct lttng_metadata_binary_integer *length_type,
+			uint32_t elem_alignment);
+	int (*struct_begin)(void *priv, const char *name, uint32_t nr_fields);
+	int (*array_compound_begin)(void *priv, const char *name,
+			uint32_t length);
+	int (*sequence_compound_begin)(void *priv, const char *name,
+			const char *length_name);
+	int (*variant_begin)(void *priv, const char *name,
+			const char *tag_name, uint32_t nr_choices);
+	/* End of an enum, array, sequence, struct or variant. */
+	int (*type_end)(void *priv, uint8_t type);
+};
+
+struct lttng_metadata_binary_reader {
+	const uint8_t *p, *end;
+};
+
+static inline
+int lttng_metadata_binary_read(struct lttng_metadata_binary_reader *r,
+		void *dest, size_t len)
+{
+	if ((size_t) (r->end - r->p) < len)
+		return -1;
+	memcpy(dest, r->p, len);
+	r->p += len;
+	return 0;
+}
+
+static inline
+const char *lttng_metadata_binary_read_string(
+		struct lttng_metadata_binary_reader *r)
+{
+	const char *s = (const char *) r->p;
+	size_t len;
+
+	len = strnlen(s, r->end - r->p);
+	if (len == (size_t) (r->end - r->p))
+		return NULL;
+	r->p += len + 1;
+	return s;
+}
+
+static inline
+int lttng_metadata_binary_read_integer(struct lttng_metadata_binary_reader *r,
+		struct lttng_metadata_binary_integer *integer)
+{
+	return lttng_metadata_binary_read(r, integer, sizeof(*integer));
+}
+
+#define LTTNG_MB_CALL(visitor, cb, ...)				\
+	((visitor)->cb ? (visitor)->cb(__VA_ARGS__) : 0)
+
+static inline
+int lttng_metadata_binary_decode_fields(struct lttng_metadata_binary_reader *r,
+		uint32_t nr_fields,
+		const struct lttng_metadata_binary_visitor *visitor,
+		void *priv, unsigned int depth);
+
+static inline
+int lttng_metadata_binary_decode_type(struct lttng_metadata_binary_reader *r,
+		const char *name,
+		const struct lttng_metadata_binary_visitor *visitor,
+		void *priv, unsigned int depth)
+{
+	struct lttng_metadata_binary_integer integer;
+	uint32_t u32, len;
+	uint8_t type, u8;
+	const char *s;
+	int ret;
+
+	if (depth > LTTNG_METADATA_BINARY_MAX_DEPTH)
+		return -1;
+	if (lttng_metadata_binary_read(r, &type, sizeof(type)))
+		return -1;
+	switch (type) {
+	case LTTNG_METADATA_BINARY_TYPE_INTEGER:
+		if (lttng_metadata_binary_read_integer(r, &integer))
+			return -1;
+		return LTTNG_MB_CALL(visitor, integer, priv, name, &integer);
+	case LTTNG_METADATA_BINARY_TYPE_STRING:
+		if (lttng_metadata_binary_read(r, &u8, sizeof(u8)))
+			return -1;
+		return LTTNG_MB_CALL(visitor, string, priv, name, u8);
+	case LTTNG_METADATA_BINARY_TYPE_ENUM:
+	{
+		uint64_t start, end;
+		uint32_t i;
+
+		s = lttng_metadata_binary_read_string(r);
+		if (!s || lttng_metadata_binary_read_integer(r, &integer)
+				|| lttng_metadata_binary_read(r, &u32, sizeof(u32)))
+			return -1;
+		ret = LTTNG_MB_CALL(visitor, enum_begin, priv, name, s, &integer);
+		if (ret)
+			return ret;
+		for (i = 0; i < u32; i++) {
+			if (lttng_metadata_binary_read(r, &start, sizeof(start))
+					|| lttng_metadata_binary_read(r, &end, sizeof(end))
+					|| lttng_metadata_binary_read(r, &u8, sizeof(u8)))
+				return -1;
+			s = lttng_metadata_binary_read_string(r);
+			if (!s)
+				return -1;
+			ret = LTTNG_MB_CALL(visitor, enum_entry, priv, start, end,
+					u8, s);
+			if (ret)
+				return ret;
+		}
+		break;
+	}
+	case LTTNG_METADATA_BINARY_TYPE_ARRAY:
+		if (lttng_metadata_binary_read(r, &u32, sizeof(u32))
+				|| lttng_metadata_binary_read(r, &len, sizeof(len)))
+			return -1;
+		ret = LTTNG_MB_CALL(visitor, array_begin, priv, name, u32, len);
+		if (ret)
+			return ret;
+		ret = lttng_metadata_binary_decode_type(r, NULL, visitor, priv,
+				depth + 1);
+		if (ret)
+			return ret;
+		break;
+	case LTTNG_METADATA_BINARY_TYPE_SEQUENCE:
+		if (lttng_metadata_binary_read_integer(r, &integer)
+				|| lttng_metadata_binary_read(r, &u32, sizeof(u32)))
+			return -1;
+		ret = LTTNG_MB_CALL(visitor, sequence_begin, priv, name,
+				&integer, u32);
+		if (ret)
+			return ret;
+		ret = lttng_metadata_binary_decode_type(r, NULL, visitor, priv,
+				depth + 1);
+		if (ret)
+			return ret;
+		break;
+	case LTTNG_METADATA_BINARY_TYPE_STRUCT:
+		if (lttng_metadata_binary_read(r, &u32, sizeof(u32)))
+			return -1;
+		ret = LTTNG_MB_CALL(visitor, struct_begin, priv, name, u32);
+		if (ret)
+			return ret;
+		ret = lttng_metadata_binary_decode_fields(r, u32, visitor, priv,
+				depth + 1);
+		if (ret)
+			return ret;
+		break;
+	case LTTNG_METADATA_BINARY_TYPE_ARRAY_COMPOUND:
+		if (lttng_metadata_binary_read(r, &u32, sizeof(u32)))
+			return -1;
+		ret = LTTNG_MB_CALL(visitor, array_compound_begin, priv, name,
+				u32);
+		if (ret)
+			return ret;
+		ret = lttng_metadata_binary_decode_type(r, NULL, visitor, priv,
+				depth + 1);
+		if (ret)
+			return ret;
+		break;
+	case LTTNG_METADATA_BINARY_TYPE_SEQUENCE_COMPOUND:
+		s = lttng_metadata_binary_read_string(r);
+		if (!s)
+			return -1;
+		ret = LTTNG_MB_CALL(visitor, sequence_compound_begin, priv,
+				name, s);
+		if (ret)
+			return ret;
+		ret = lttng_metadata_binary_decode_type(r, NULL, visitor, priv,
+				depth + 1);
+		if (ret)
+			return ret;
+		break;
+	case LTTNG_METADATA_BINARY_TYPE_VARIANT:
+		s = lttng_metadata_binary_read_string(r);
+		if (!s || lttng_metadata_binary_read(r, &u32, sizeof(u32)))
+			return -1;
+		ret = LTTNG_MB_CALL(visitor, variant_begin, priv, name, s, u32);
+		if (ret)
+			return ret;
+		ret = lttng_metadata_binary_decode_fields(r, u32, visitor, priv,
+				depth + 1);
+		if (ret)
+			return ret;
+		break;
+	default:
+		return -1;
+	}
+	return LTTNG_MB_CALL(visitor, type_end, priv, type);
+}
+
+static inline
+int lttng_metadata_binary_decode_fields(struct lttng_metadata_binary_reader *r,
+		uint32_t nr_fields,
+		const struct lttng_metadata_binary_visitor *visitor,
+		void *priv, unsigned int depth)
+{
+	uint32_t i;
+	int ret;
+
+	for (i = 0; i < nr_fields; i++) {
+		const char *name = lttng_metadata_binary_read_string(r);
+
+		if (!name)
+			return -1;
+		ret = lttng_metadata_binary_decode_type(r, name, visitor, priv,
+				depth);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/*
+ * Decode the record at "p", which points after the marker byte, within
+ * "len" bytes of metadata. Returns the number of bytes consumed, the
+ * payload flags in "flags", or a negative value on error.
+ */
+static inline
+long lttng_metadata_binary_decode(const void *p, size_t len, uint8_t *flags,
+		const struct lttng_metadata_binary_visitor *visitor, void *priv)
+{
+	struct lttng_metadata_binary_reader r = {
+		.p = (const uint8_t *) p,
+		.end = (const uint8_t *) p + len,
+	};
+	uint32_t record_len, nr_fields;
+	uint16_t reserved;
+	uint8_t version;
+	int ret;
+
+	if (lttng_metadata_binary_read(&r, &record_len, sizeof(record_len))
+			|| (size_t) (r.end - r.p) < record_len)
+		return -1;
+	r.end = r.p + record_len;
+	if (lttng_metadata_binary_read(&r, &version, sizeof(version))
+			|| version != LTTNG_METADATA_BINARY_VERSION
+			|| lttng_metadata_binary_read(&r, flags, sizeof(*flags))
+			|| lttng_metadata_binary_read(&r, &reserved, sizeof(reserved))
+			|| lttng_metadata_binary_read(&r, &nr_fields, sizeof(nr_fields)))
+		return -1;
+	ret = lttng_metadata_binary_decode_fields(&r, nr_fields, visitor, priv,
+			0);
+	if (ret)
+		return ret;
+	return sizeof(record_len) + record_len;
+}
+
+#undef LTTNG_MB_CALL
+
+#endif /* _LTTNG_METADATA_BINARY_H */
@@ -0,0 +1,193 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-metadata-map.c
+ *
+ * LTTng read-only mapping of a session metadata cache.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/file.h>
+#include <linux/poll.h>
+#include <linux/anon_inodes.h>
+#include <linux/uaccess.h>
+
+#include <wrapper/file.h>
+#include <lttng-abi.h>
+#include <lttng-events.h>
+#include <lttng-kernel-version.h>
+
+/*
+ * The metadata cache is made of pages which are never moved nor freed
+ * before the cache itself, so consumers can read the metadata in place
+ * rather than through the metadata stream ring buffer. The cache is
+ * mapped at offset 0, and pages are faulted in as the cache grows: a
+ * consumer can map a large range once and read up to the size returned
+ * by LTTNG_KERNEL_METADATA_CACHE_STATE. The file is readable when the
+ * cache changed since the last state returned.
+ *
+ * A metadata regeneration rewrites the cache in place and increments
+ * its version: a consumer re-reads the state after copying a range and
+ * starts over from offset 0 when the version changed.
+ */
+
+struct lttng_metadata_map {
+	struct lttng_metadata_cache *cache;
+	/* Last state returned, protected by the cache lock. */
+	uint64_t version;
+	uint64_t size;
+};
+
+static
+int lttng_metadata_map_fault_compat(struct vm_area_struct *vma,
+		struct vm_fault *vmf)
+{
+	struct lttng_metadata_map *map = vma->vm_private_data;
+	struct lttng_metadata_cache *cache = map->cache;
+	int ret = VM_FAULT_SIGBUS;
+
+	mutex_lock(&cache->lock);
+	if (vmf->pgoff < cache->nr_chunks) {
+		vmf->page = virt_to_page(cache->chunks[vmf->pgoff]);
+		get_page(vmf->page);
+		ret = 0;
+	}
+	mutex_unlock(&cache->lock);
+	return ret;
+}
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,11,0))
+static int lttng_metadata_map_fault(struct vm_fault *vmf)
+{
+	return lttng_metadata_map_fault_compat(vmf->vma, vmf);
+}
+#else /* #if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,11,0)) */
+static int lttng_metadata_map_fault(struct vm_area_struct *vma,
+		struct vm_fault *vmf)
+{
+	return lttng_metadata_map_fault_compat(vma, vmf);
+}
+#endif /* #else #if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,11,0)) */
+
+static const struct vm_operations_struct lttng_metadata_map_vm_ops = {
+	.fault = lttng_metadata_map_fault,
+};
+
+static
+int lttng_metadata_map_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	if (vma->vm_pgoff)
+		return -EINVAL;
+	vma->vm_flags &= ~VM_MAYWRITE;
+	vma->vm_flags |= VM_DONTEXPAND;
+	vma->vm_ops = &lttng_metadata_map_vm_ops;
+	vma->vm_private_data = file->private_data;
+	return 0;
+}
+
+static
+unsigned int lttng_metadata_map_poll(struct file *file, poll_table *wait)
+{
+	struct lttng_metadata_map *map = file->private_data;
+	struct lttng_metadata_cache *cache = map->cache;
+	unsigned int mask = 0;
+
+	poll_wait(file, &cache->map_wait, wait);
+	mutex_lock(&cache->lock);
+	if (cache->version != map->version
+			|| cache->metadata_written != map->size)
+		mask |= POLLIN | POLLRDNORM;
+	mutex_unlock(&cache->lock);
+	return mask;
+}
+
+static
+long lttng_metadata_map_ioctl(struct file *file, unsigned int cmd,
+		unsigned long arg)
+{
+	struct lttng_metadata_map *map = file->private_data;
+	struct lttng_metadata_cache *cache = map->cache;
+	struct lttng_kernel_metadata_cache_state state;
+
+	switch (cmd) {
+	case LTTNG_KERNEL_METADATA_CACHE_STATE:
+		mutex_lock(&cache->lock);
+		map->version = cache->version;
+		map->size = cache->metadata_written;
+		state.version = map->version;
+		state.size = map->size;
+		mutex_unlock(&cache->lock);
+		if (copy_to_user((struct lttng_kernel_metadata_cache_state __user *) arg,
+				&state, sizeof(state)))
+			return -EFAULT;
+		return 0;
+	default:
+		return -ENOIOCTLCMD;
+	}
+}
+
+static
+int lttng_metadata_map_release(struct inode *inode, struct file *file)
+{
+	struct lttng_metadata_map *map = file->private_data;
+
+	kref_put(&map->cache->refcount, metadata_cache_destroy);
+	kfree(map);
+	return 0;
+}
+
+static const struct file_operations lttng_metadata_map_fops = {
+	.owner = THIS_MODULE,
+	.mmap = lttng_metadata_map_mmap,
+	.poll = lttng_metadata_map_poll,
+	.unlocked_ioctl = lttng_metadata_map_ioctl,
+#ifdef CONFIG_COMPAT
+	.compat_ioctl = lttng_metadata_map_ioctl,
+#endif
+	.release = lttng_metadata_map_release,
+};
+
+/*
+ * Return a file descriptor mapping the metadata cache. The mapping holds
+ * a reference on the cache, which survives its session.
+ */
+int lttng_metadata_cache_map_create(struct lttng_metadata_cache *cache)
+{
+	struct lttng_metadata_map *map;
+	struct file *map_file;
+	int file_fd, ret;
+
+	map = kzalloc(sizeof(*map), GFP_KERNEL);
+	if (!map)
+		return -ENOMEM;
+	map->cache = cache;
+	/* Nothing returned yet: readable as soon as there is metadata. */
+	mutex_lock(&cache->lock);
+	map->version = cache->version;
+	mutex_unlock(&cache->lock);
+	file_fd = lttng_get_unused_fd();
+	if (file_fd < 0) {
+		ret = file_fd;
+		goto fd_error;
+	}
+	map_file = anon_inode_getfile("[lttng_metadata_map]",
+			&lttng_metadata_map_fops, map, O_RDONLY);
+	if (IS_ERR(map_file)) {
+		ret = PTR_ERR(map_file);
+		goto file_error;
+	}
+	kref_get(&cache->refcount);
+	fd_install(file_fd, map_file);
+	return file_fd;
+
+file_error:
+	put_unused_fd(file_fd);
+fd_error:
+	kfree(map);
+	return ret;
+}
@@ -0,0 +1,307 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-pool.c
+ *
+ * LTTng pool buffers, shared by the per-cpu buffers of a memory node.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <linux/nodemask.h>
+#include <linux/topology.h>
+
+#include <wrapper/ringbuffer/backend.h>
+#include <wrapper/ringbuffer/frontend.h>
+#include <lttng-kernel-version.h>
+#include <lttng-events.h>
+
+/*
+ * The per-cpu buffers of a channel with a pool only stage its packets:
+ * the pool takes the reader role of each of them, and copies each packet
+ * as it is delivered into the pool buffer of the memory node of the cpu,
+ * a global buffer with sub-buffers of the same size, which the consumer
+ * reads instead. The per-cpu buffers can then be a few sub-buffers each,
+ * sized for the latency of the copy, and the pool buffers for the rate
+ * of the whole node, rather than each cpu buffer for the bursts of its
+ * cpu.
+ *
+ * Each sub-buffer of a pool buffer holds a single packet, unchanged: the
+ * packet descriptors of a pool stream, including the cpu the packet was
+ * recorded on, are those of its current packet. Packets of the cpus of a
+ * node are interleaved in the pool stream, in the order they complete.
+ *
+ * The copy is done by a work item queued on the unbound workqueue when
+ * the read timer of the staging buffer wakes its reader up. While the
+ * pool buffer is full, packets are left in the staging buffer, whose
+ * read timer retries the copy, and the staging buffer discards the
+ * events once full itself.
+ */
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,13,0))
+typedef struct wait_queue_entry lttng_wait_queue_entry_t;
+#else
+typedef wait_queue_t lttng_wait_queue_entry_t;
+#endif
+
+struct lttng_pool_node {
+	struct channel *chan;		/* NULL: no cpu of the node */
+	struct mutex lock;		/* One packet per sub-buffer */
+};
+
+struct lttng_pool_cpu {
+	struct lib_ring_buffer *buf;	/* Staging buffer, NULL: none */
+	struct lttng_pool *pool;
+	struct lttng_pool_node *node;
+	lttng_wait_queue_entry_t wait;
+	struct work_struct work;
+};
+
+struct lttng_pool {
+	struct lttng_transport *transport;
+	struct lttng_pool_node *nodes;	/* By node id */
+	struct lttng_pool_cpu *cpus;	/* By cpu id */
+};
+
+/*
+ * Copy the packet held from the staging buffer of a cpu into the pool
+ * buffer of its node. Fails with -ENOBUFS if the pool buffer is full.
+ */
+static
+int lttng_pool_copy(struct lttng_pool_cpu *pc)
+{
+	const struct lttng_channel_ops *ops = &pc->pool->transport->ops;
+	struct lib_ring_buffer *buf = pc->buf;
+	const struct lib_ring_buffer_config *config =
+		&buf->backend.chan->backend.config;
+	struct lib_ring_buffer_ctx ctx;
+	size_t len, pos, chunk;
+	int ret;
+
+	len = lib_ring_buffer_get_read_data_size(config, buf);
+	lib_ring_buffer_ctx_init(&ctx, pc->node->chan, NULL, PAGE_ALIGN(len),
+			sizeof(char), -1);
+	mutex_lock(&pc->node->lock);
+	ret = ops->event_reserve(&ctx, 0);
+	if (ret)
+		goto end;
+	for (pos = 0; pos < len; pos += chunk) {
+		chunk = min_t(size_t, len - pos,
+				PAGE_SIZE - offset_in_page(pos));
+		ops->event_write(&ctx,
+			lib_ring_buffer_read_offset_address(&buf->backend, pos),
+			chunk);
+	}
+	/* Padded to a page multiple, as the packet size. */
+	ops->event_memset(&ctx, 0, PAGE_ALIGN(len) - len);
+	ops->event_commit(&ctx);
+end:
+	mutex_unlock(&pc->node->lock);
+	return ret;
+}
+
+static
+void lttng_pool_work(struct work_struct *work)
+{
+	struct lttng_pool_cpu *pc =
+		container_of(work, struct lttng_pool_cpu, work);
+
+	while (!lib_ring_buffer_get_next_subbuf(pc->buf)) {
+		if (lttng_pool_copy(pc)) {
+			/* Left in the staging buffer for the next wakeup. */
+			lib_ring_buffer_put_subbuf(pc->buf);
+			break;
+		}
+		lib_ring_buffer_put_next_subbuf(pc->buf);
+	}
+}
+
+static
+int lttng_pool_wake(lttng_wait_queue_entry_t *wait, unsigned int mode,
+		int sync, void *key)
+{
+	struct lttng_pool_cpu *pc =
+		container_of(wait, struct lttng_pool_cpu, wait);
+
+	queue_work(system_unbound_wq, &pc->work);
+	return 0;
+}
+
+/* Cpus of offline nodes use the pool of the first online node. */
+static
+int lttng_pool_cpu_node(int cpu)
+{
+	int node = cpu_to_node(cpu);
+
+	if (node < 0 || !node_online(node))
+		node = first_online_node;
+	return node;
+}
+
+static
+void lttng_pool_free(struct lttng_pool *pool)
+{
+	int cpu, node;
+
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++) {
+		struct lttng_pool_cpu *pc = &pool->cpus[cpu];
+
+		if (!pc->buf)
+			continue;
+		remove_wait_queue(&pc->buf->read_wait, &pc->wait);
+		cancel_work_sync(&pc->work);
+		lib_ring_buffer_release_read(pc->buf);
+	}
+	for (node = 0; node < nr_node_ids; node++) {
+		if (pool->nodes[node].chan)
+			pool->transport->ops.channel_destroy(pool->nodes[node].chan);
+	}
+	kfree(pool->cpus);
+	kfree(pool->nodes);
+	kfree(pool);
+}
+
+/*
+ * Create the pool of a per-cpu channel, with "num_subbuf" sub-buffers
+ * per node, taking the reader role of each of its buffers. Called with
+ * the sessions mutex and the session lock held, before the session is
+ * started.
+ */
+int lttng_channel_pool_create(struct lttng_channel *chan,
+		struct lttng_transport *transport, uint64_t num_subbuf)
+{
+	struct channel *rb_chan = chan->chan;
+	const struct lib_ring_buffer_config *config = &rb_chan->backend.config;
+	struct lttng_pool *pool;
+	int cpu, ret;
+
+	/* The copy is driven by the read timer of the staging buffers. */
+	if (config->alloc != RING_BUFFER_ALLOC_PER_CPU
+			|| !rb_chan->read_timer_interval)
+		return -EINVAL;
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return -ENOMEM;
+	pool->transport = transport;
+	pool->nodes = kcalloc(nr_node_ids, sizeof(*pool->nodes), GFP_KERNEL);
+	pool->cpus = kcalloc(nr_cpu_ids, sizeof(*pool->cpus), GFP_KERNEL);
+	if (!pool->nodes || !pool->cpus) {
+		ret = -ENOMEM;
+		goto error;
+	}
+	for_each_channel_cpu(cpu, rb_chan) {
+		struct lttng_pool_cpu *pc = &pool->cpus[cpu];
+		int node = lttng_pool_cpu_node(cpu);
+		struct lttng_pool_node *pn = &pool->nodes[node];
+		struct lib_ring_buffer *buf;
+
+		if (!pn->chan) {
+			mutex_init(&pn->lock);
+			pn->chan = transport->ops.channel_create("[lttng_pool]",
+					chan, NULL, rb_chan->backend.subbuf_size,
+					num_subbuf, 0,
+					jiffies_to_usecs(rb_chan->read_timer_interval),
+					0, LTTNG_KERNEL_NUMA_NODE, node, 0, NULL);
+			if (!pn->chan) {
+				ret = -EINVAL;
+				goto error;
+			}
+		}
+		buf = channel_get_ring_buffer(config, rb_chan, cpu);
+		/* The consumer already opened the stream. */
+		if (lib_ring_buffer_open_read(buf)) {
+			ret = -EBUSY;
+			goto error;
+		}
+		pc->buf = buf;
+		pc->pool = pool;
+		pc->node = pn;
+		INIT_WORK(&pc->work, lttng_pool_work);
+		init_waitqueue_func_entry(&pc->wait, lttng_pool_wake);
+		add_wait_queue(&buf->read_wait, &pc->wait);
+	}
+	chan->pool = pool;
+	return 0;
+
+error:
+	lttng_pool_free(pool);
+	return ret;
+}
+
+/*
+ * Copy the packets flushed when the session is stopped, so that the
+ * consumer finds them in the pool. Called with the session lock held.
+ */
+void lttng_channel_pool_flush(struct lttng_channel *chan)
+{
+	struct lttng_pool *pool = chan->pool;
+	int cpu;
+
+	if (!pool)
+		return;
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++) {
+		if (pool->cpus[cpu].buf)
+			queue_work(system_unbound_wq, &pool->cpus[cpu].work);
+	}
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++) {
+		if (pool->cpus[cpu].buf)
+			flush_work(&pool->cpus[cpu].work);
+	}
+}
+
+/* Open the pool stream of a node for reading. */
+struct lib_ring_buffer *lttng_channel_pool_read_open(struct lttng_channel *chan,
+		int node)
+{
+	struct lttng_pool *pool = chan->pool;
+
+	if (!pool || !pool->nodes[node].chan)
+		return NULL;
+	return pool->transport->ops.buffer_read_open(pool->nodes[node].chan);
+}
+
+/* Called at channel destruction, before the staging buffers are freed. */
+void lttng_channel_pool_destroy(struct lttng_channel *chan)
+{
+	struct lttng_pool *pool = chan->pool;
+	struct module *owner;
+
+	if (!pool)
+		return;
+	owner = pool->transport->owner;
+	lttng_pool_free(pool);
+	chan->pool = NULL;
+	module_put(owner);
+}
+
+/*
+ * Memory held by the pool buffers of a channel, as for its own buffers.
+ * Called with the sessions mutex held.
+ */
+size_t lttng_channel_pool_mem_usage(struct lttng_channel *chan,
+		size_t *data_bytes)
+{
+	struct lttng_pool *pool = chan->pool;
+	size_t bytes = 0;
+	int node;
+
+	*data_bytes = 0;
+	if (!pool)
+		return 0;
+	for (node = 0; node < nr_node_ids; node++) {
+		struct channel *rb_chan = pool->nodes[node].chan;
+		size_t node_data_bytes;
+
+		if (!rb_chan)
+			continue;
+		bytes += lib_ring_buffer_mem_usage(channel_get_ring_buffer(
+					&rb_chan->backend.config, rb_chan, 0),
+				&node_data_bytes);
+		*data_bytes += node_data_bytes;
+	}
+	return bytes;
+}
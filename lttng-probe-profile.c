@@ -0,0 +1,149 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-probe-profile.c
+ *
+ * LTTng per-event probe overhead profiling.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/list.h>
+#include <linux/slab.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#include <lttng-events.h>
+#include <lttng-probe-profile.h>
+
+/*
+ * Events get a per-cpu profile at creation, which probes update while
+ * lttng_probe_profile_enable is set. The profiles of the existing
+ * events are shown in the "lttng-probe-profile" debugfs file, one line
+ * per phase with the number of timed runs, their total cycles, and the
+ * histogram of their log2 duration in cycles.
+ */
+
+int lttng_probe_profile_enable;
+EXPORT_SYMBOL_GPL(lttng_probe_profile_enable);
+module_param_named(probe_profile, lttng_probe_profile_enable, int, 0644);
+MODULE_PARM_DESC(probe_profile, "Time the probe phases of each event (0: disabled, 1: enabled)");
+
+static const char *phase_name[LTTNG_PROBE_PROFILE_NR_PHASES] = {
+	[LTTNG_PROBE_PROFILE_FILTER] = "filter",
+	[LTTNG_PROBE_PROFILE_RESERVE] = "reserve",
+	[LTTNG_PROBE_PROFILE_CONTEXT] = "context",
+	[LTTNG_PROBE_PROFILE_SERIALIZE] = "serialize",
+	[LTTNG_PROBE_PROFILE_COMMIT] = "commit",
+};
+
+static DEFINE_MUTEX(profile_mutex);
+static LIST_HEAD(profile_events);
+static struct dentry *profile_dentry;
+
+/*
+ * Called once the event is created. Profiling is best effort: the event
+ * is not profiled if its profile cannot be allocated.
+ */
+void lttng_probe_profile_event_add(struct lttng_event *event)
+{
+	event->profile = alloc_percpu(struct lttng_probe_profile);
+	if (!event->profile)
+		return;
+	mutex_lock(&profile_mutex);
+	list_add_tail(&event->profile_node, &profile_events);
+	mutex_unlock(&profile_mutex);
+}
+
+/*
+ * Called on event destruction, once its probes cannot run anymore.
+ */
+void lttng_probe_profile_event_remove(struct lttng_event *event)
+{
+	if (!event->profile)
+		return;
+	mutex_lock(&profile_mutex);
+	list_del(&event->profile_node);
+	mutex_unlock(&profile_mutex);
+	free_percpu(event->profile);
+	event->profile = NULL;
+}
+
+static
+void lttng_probe_profile_show_event(struct seq_file *m,
+		struct lttng_event *event)
+{
+	int phase, i, cpu;
+
+	seq_printf(m, "event %s channel %u id %u\n",
+		event->desc ? event->desc->name : "", event->chan->id,
+		event->id);
+	for (phase = 0; phase < LTTNG_PROBE_PROFILE_NR_PHASES; phase++) {
+		struct lttng_probe_profile_hist sum;
+		uint64_t count = 0;
+
+		memset(&sum, 0, sizeof(sum));
+		for_each_possible_cpu(cpu) {
+			struct lttng_probe_profile_hist *hist =
+				&per_cpu_ptr(event->profile, cpu)->phase[phase];
+
+			sum.cycles += READ_ONCE(hist->cycles);
+			for (i = 0; i < LTTNG_PROBE_PROFILE_NR_BUCKETS; i++)
+				sum.buckets[i] += READ_ONCE(hist->buckets[i]);
+		}
+		for (i = 0; i < LTTNG_PROBE_PROFILE_NR_BUCKETS; i++)
+			count += sum.buckets[i];
+		if (!count)
+			continue;
+		seq_printf(m, "  %-10s %12llu %16llu", phase_name[phase],
+			(unsigned long long) count,
+			(unsigned long long) sum.cycles);
+		for (i = 0; i < LTTNG_PROBE_PROFILE_NR_BUCKETS; i++)
+			seq_printf(m, " %llu", (unsigned long long) sum.buckets[i]);
+		seq_putc(m, '\n');
+	}
+}
+
+static
+int lttng_probe_profile_show(struct seq_file *m, void *p)
+{
+	struct lttng_event *event;
+
+	mutex_lock(&profile_mutex);
+	list_for_each_entry(event, &profile_events, profile_node)
+		lttng_probe_profile_show_event(m, event);
+	mutex_unlock(&profile_mutex);
+	return 0;
+}
+
+static
+int lttng_probe_profile_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, lttng_probe_profile_show, NULL);
+}
+
+static const struct file_operations lttng_probe_profile_fops = {
+	.owner = THIS_MODULE,
+	.open = lttng_probe_profile_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+int lttng_probe_profile_init(void)
+{
+	/* The profiles are still updated without debugfs. */
+	profile_dentry = debugfs_create_file("lttng-probe-profile", 0444,
+			NULL, NULL, &lttng_probe_profile_fops);
+	if (IS_ERR(profile_dentry))
+		profile_dentry = NULL;
+	return 0;
+}
+
+void lttng_probe_profile_exit(void)
+{
+	debugfs_remove(profile_dentry);
+	profile_dentry = NULL;
+}
@@ -0,0 +1,125 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-probe-profile.h
+ *
+ * LTTng per-event probe overhead profiling.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#ifndef _LTTNG_PROBE_PROFILE_H
+#define _LTTNG_PROBE_PROFILE_H
+
+#include <linux/percpu.h>
+#include <linux/timex.h>
+#include <linux/bitops.h>
+
+struct lttng_event;
+
+/*
+ * Phases of a probe, timed in cycles. The reserve phase includes the
+ * context record phase, timed by the ring buffer client within the
+ * event header write.
+ */
+enum lttng_probe_profile_phase {
+	LTTNG_PROBE_PROFILE_FILTER = 0,
+	LTTNG_PROBE_PROFILE_RESERVE,
+	LTTNG_PROBE_PROFILE_CONTEXT,
+	LTTNG_PROBE_PROFILE_SERIALIZE,
+	LTTNG_PROBE_PROFILE_COMMIT,
+	LTTNG_PROBE_PROFILE_NR_PHASES,
+};
+
+/* Histogram bucket i counts durations of [2^(i-1), 2^i) cycles. */
+#define LTTNG_PROBE_PROFILE_NR_BUCKETS	24
+
+struct lttng_probe_profile_hist {
+	uint64_t cycles;
+	uint64_t buckets[LTTNG_PROBE_PROFILE_NR_BUCKETS];
+};
+
+/* Per-cpu profile of an event. */
+struct lttng_probe_profile {
+	struct lttng_probe_profile_hist phase[LTTNG_PROBE_PROFILE_NR_PHASES];
+};
+
+#ifdef LTTNG_PROBE_PROFILE
+
+extern int lttng_probe_profile_enable;
+
+int lttng_probe_profile_init(void);
+void lttng_probe_profile_exit(void);
+void lttng_probe_profile_event_add(struct lttng_event *event);
+void lttng_probe_profile_event_remove(struct lttng_event *event);
+
+static inline
+cycles_t lttng_probe_profile_begin(struct lttng_probe_profile __percpu *profile)
+{
+	if (likely(!READ_ONCE(lttng_probe_profile_enable) || !profile))
+		return 0;
+	return get_cycles();
+}
+
+/*
+ * Account the time elapsed since "start" to a phase, and return the
+ * start of the next phase. A zero start means the probe is not being
+ * profiled. Counters are updated with operations safe against nested
+ * interrupts.
+ */
+static inline
+cycles_t lttng_probe_profile_phase(struct lttng_probe_profile __percpu *profile,
+		enum lttng_probe_profile_phase phase, cycles_t start)
+{
+	cycles_t now, delta;
+	unsigned int bucket;
+
+	if (likely(!start))
+		return 0;
+	now = get_cycles();
+	delta = now - start;
+	bucket = min_t(unsigned int, fls64(delta),
+			LTTNG_PROBE_PROFILE_NR_BUCKETS - 1);
+	this_cpu_add(profile->phase[phase].cycles, delta);
+	this_cpu_inc(profile->phase[phase].buckets[bucket]);
+	return now ? now : 1;
+}
+
+#else /* LTTNG_PROBE_PROFILE */
+
+static inline
+int lttng_probe_profile_init(void)
+{
+	return 0;
+}
+
+static inline
+void lttng_probe_profile_exit(void)
+{
+}
+
+static inline
+void lttng_probe_profile_event_add(struct lttng_event *event)
+{
+}
+
+static inline
+void lttng_probe_profile_event_remove(struct lttng_event *event)
+{
+}
+
+static inline
+cycles_t lttng_probe_profile_begin(struct lttng_probe_profile __percpu *profile)
+{
+	return 0;
+}
+
+static inline
+cycles_t lttng_probe_profile_phase(struct lttng_probe_profile __percpu *profile,
+		enum lttng_probe_profile_phase phase, cycles_t start)
+{
+	return 0;
+}
+
+#endif /* LTTNG_PROBE_PROFILE */
+
+#endif /* _LTTNG_PROBE_PROFILE_H */
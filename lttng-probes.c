@@ -11,7 +11,10 @@
 #include <linux/list.h>
 #include <linux/mutex.h>
 #include <linux/seq_file.h>
+#include <linux/sort.h>
+#include <linux/kmod.h>
 
+#include <wrapper/vmalloc.h>
 #include <lttng-events.h>
 
 /*
@@ -31,6 +34,85 @@ static LIST_HEAD(lazy_probe_init);
  */
 static int lazy_nesting;
 
+/*
+ * Event descriptors of the registered probes, sorted by name, so that
+ * enablers find the events they match with a lookup of their name or of
+ * the prefix before their first star. Rebuilt on the first lookup after
+ * the probe list changes. Protected by the sessions lock.
+ */
+static const struct lttng_event_desc **desc_index;
+static size_t desc_index_len;
+static int desc_index_dirty = 1;
+
+/*
+ * Catalog of the probe providers of the probes/ directory, which are
+ * loaded on demand rather than all at startup: the provider module is
+ * requested when an enabler which may match its events is created. All
+ * event names of a provider begin with the provider name and '_', so
+ * the catalog only needs the provider names. A provider which fails to
+ * load, not being built for this kernel, is not requested again. Protected
+ * by probe_catalog_mutex, which must not be nested in the sessions lock:
+ * the module init registers the provider with the sessions lock held.
+ */
+struct lttng_probe_catalog_entry {
+	const char *provider;
+	const char *module;
+	int requested;
+};
+
+#define LTTNG_PROBE_CATALOG_ENTRY(_provider, _module)	\
+	{ .provider = #_provider, .module = "lttng-probe-" #_module }
+
+static struct lttng_probe_catalog_entry probe_catalog[] = {
+	LTTNG_PROBE_CATALOG_ENTRY(9p, 9p),
+	LTTNG_PROBE_CATALOG_ENTRY(asoc, asoc),
+	LTTNG_PROBE_CATALOG_ENTRY(block, block),
+	LTTNG_PROBE_CATALOG_ENTRY(btrfs, btrfs),
+	LTTNG_PROBE_CATALOG_ENTRY(compaction, compaction),
+	LTTNG_PROBE_CATALOG_ENTRY(ext3, ext3),
+	LTTNG_PROBE_CATALOG_ENTRY(ext4, ext4),
+	LTTNG_PROBE_CATALOG_ENTRY(gpio, gpio),
+	LTTNG_PROBE_CATALOG_ENTRY(i2c, i2c),
+	LTTNG_PROBE_CATALOG_ENTRY(irq, irq),
+	LTTNG_PROBE_CATALOG_ENTRY(jbd, jbd),
+	LTTNG_PROBE_CATALOG_ENTRY(jbd2, jbd2),
+	LTTNG_PROBE_CATALOG_ENTRY(kmem, kmem),
+	LTTNG_PROBE_CATALOG_ENTRY(kvm, kvm),
+	LTTNG_PROBE_CATALOG_ENTRY(kvm_x86, kvm-x86),
+	LTTNG_PROBE_CATALOG_ENTRY(kvm_mmu, kvm-x86-mmu),
+	LTTNG_PROBE_CATALOG_ENTRY(lock, lock),
+	LTTNG_PROBE_CATALOG_ENTRY(lttng_callstack, callstack),
+	LTTNG_PROBE_CATALOG_ENTRY(lttng_coalesce, coalesce),
+	LTTNG_PROBE_CATALOG_ENTRY(lttng_statedump, statedump),
+	LTTNG_PROBE_CATALOG_ENTRY(mm_vmscan, vmscan),
+	LTTNG_PROBE_CATALOG_ENTRY(module, module),
+	LTTNG_PROBE_CATALOG_ENTRY(napi, napi),
+	LTTNG_PROBE_CATALOG_ENTRY(net, net),
+	LTTNG_PROBE_CATALOG_ENTRY(power, power),
+	LTTNG_PROBE_CATALOG_ENTRY(preemptirq, preemptirq),
+	LTTNG_PROBE_CATALOG_ENTRY(printk, printk),
+	LTTNG_PROBE_CATALOG_ENTRY(random, random),
+	LTTNG_PROBE_CATALOG_ENTRY(rcu, rcu),
+	LTTNG_PROBE_CATALOG_ENTRY(regmap, regmap),
+	LTTNG_PROBE_CATALOG_ENTRY(regulator, regulator),
+	LTTNG_PROBE_CATALOG_ENTRY(rpc, sunrpc),
+	LTTNG_PROBE_CATALOG_ENTRY(rpm, rpm),
+	LTTNG_PROBE_CATALOG_ENTRY(sched, sched),
+	LTTNG_PROBE_CATALOG_ENTRY(scsi, scsi),
+	LTTNG_PROBE_CATALOG_ENTRY(signal, signal),
+	LTTNG_PROBE_CATALOG_ENTRY(skb, skb),
+	LTTNG_PROBE_CATALOG_ENTRY(sock, sock),
+	LTTNG_PROBE_CATALOG_ENTRY(timer, timer),
+	LTTNG_PROBE_CATALOG_ENTRY(udp, udp),
+	LTTNG_PROBE_CATALOG_ENTRY(v4l2, v4l2),
+	LTTNG_PROBE_CATALOG_ENTRY(workqueue, workqueue),
+	LTTNG_PROBE_CATALOG_ENTRY(writeback, writeback),
+	LTTNG_PROBE_CATALOG_ENTRY(x86_exceptions, x86-exceptions),
+	LTTNG_PROBE_CATALOG_ENTRY(x86_irq_vectors, x86-irq-vectors),
+};
+
+static DEFINE_MUTEX(probe_catalog_mutex);
+
 DEFINE_PER_CPU(struct lttng_dynamic_len_stack, lttng_dynamic_len_stack);
 
 EXPORT_PER_CPU_SYMBOL_GPL(lttng_dynamic_len_stack);
@@ -102,6 +184,7 @@ void lttng_lazy_probe_register(struct lttng_probe_desc *desc)
 	/* We should be added at the head of the list */
 	list_add(&desc->head, probe_list);
 desc_added:
+	desc_index_dirty = 1;
 	pr_debug("LTTng: just registered probe %s containing %u events\n",
 		desc->provider, desc->nr_events);
 }
@@ -184,25 +267,167 @@ EXPORT_SYMBOL_GPL(lttng_probe_register);
 void lttng_probe_unregister(struct lttng_probe_desc *desc)
 {
 	lttng_lock_sessions();
-	if (!desc->lazy)
+	if (!desc->lazy) {
 		list_del(&desc->head);
-	else
+		desc_index_dirty = 1;
+	} else {
 		list_del(&desc->lazy_init_head);
+	}
+	/* Its descriptors go away with the probe module. */
+	lttng_metadata_fragments_purge(desc);
 	pr_debug("LTTng: just unregistered probe %s\n", desc->provider);
 	lttng_unlock_sessions();
 }
 EXPORT_SYMBOL_GPL(lttng_probe_unregister);
 
 /*
- * TODO: this is O(nr_probes * nb_events), could be faster.
+ * Whether events of "provider" may match the first "len" bytes of
+ * "name", which are the whole event name or the prefix of a star
+ * globbing pattern.
+ */
+static
+int probe_catalog_match(const char *provider, const char *name, size_t len)
+{
+	size_t provider_len = strlen(provider);
+
+	if (strncmp(name, provider, min(len, provider_len)))
+		return 0;
+	return len <= provider_len || name[provider_len] == '_';
+}
+
+/*
+ * Load the providers of the catalog which may have events matching the
+ * event name or star globbing pattern of a new enabler, and which are
+ * not registered yet.
+ * Must be called without the sessions lock held.
+ */
+void lttng_probes_load_matching(const char *name)
+{
+	size_t len = strcspn(name, "*");
+	const struct lttng_probe_desc *registered;
+	unsigned int i;
+
+	mutex_lock(&probe_catalog_mutex);
+	for (i = 0; i < ARRAY_SIZE(probe_catalog); i++) {
+		struct lttng_probe_catalog_entry *entry = &probe_catalog[i];
+
+		if (entry->requested
+				|| !probe_catalog_match(entry->provider, name, len))
+			continue;
+		lttng_lock_sessions();
+		registered = find_provider(entry->provider);
+		lttng_unlock_sessions();
+		if (registered)
+			continue;
+		request_module("%s", entry->module);
+		lttng_lock_sessions();
+		registered = find_provider(entry->provider);
+		lttng_unlock_sessions();
+		if (!registered) {
+			entry->requested = 1;
+			pr_debug("LTTng: probe provider %s is not available\n",
+				entry->provider);
+		}
+	}
+	mutex_unlock(&probe_catalog_mutex);
+}
+
+static
+int desc_name_cmp(const void *a, const void *b)
+{
+	const struct lttng_event_desc * const *desc_a = a;
+	const struct lttng_event_desc * const *desc_b = b;
+
+	return strcmp((*desc_a)->name, (*desc_b)->name);
+}
+
+/*
+ * Called with sessions lock held.
+ */
+static
+int lttng_probes_index_rebuild(void)
+{
+	struct lttng_probe_desc *probe_desc;
+	size_t nr_events = 0, pos = 0;
+	int i;
+
+	lttng_kvfree(desc_index);
+	desc_index = NULL;
+	desc_index_len = 0;
+	list_for_each_entry(probe_desc, &_probe_list, head)
+		nr_events += probe_desc->nr_events;
+	if (nr_events) {
+		desc_index = lttng_kvmalloc(nr_events * sizeof(*desc_index),
+				GFP_KERNEL);
+		if (!desc_index)
+			return -ENOMEM;
+		list_for_each_entry(probe_desc, &_probe_list, head) {
+			for (i = 0; i < probe_desc->nr_events; i++)
+				desc_index[pos++] = probe_desc->event_desc[i];
+		}
+		sort(desc_index, nr_events, sizeof(*desc_index),
+			desc_name_cmp, NULL);
+	}
+	desc_index_len = nr_events;
+	desc_index_dirty = 0;
+	return 0;
+}
+
+/*
+ * Return in "descs" and "nr" the registered event descriptors whose name
+ * begins with the "len" first bytes of "prefix". Passing the terminating
+ * '\0' in "len" looks up an exact name. Returns -ENOMEM if the index
+ * cannot be built, in which case the caller walks the probe list.
+ * Called with sessions lock held.
+ */
+int lttng_probes_match_prefix(const char *prefix, size_t len,
+		const struct lttng_event_desc * const **descs, size_t *nr)
+{
+	size_t low, high, first;
+
+	/* Process the lazily registered probes first. */
+	lttng_get_probe_list_head();
+	if (desc_index_dirty && lttng_probes_index_rebuild())
+		return -ENOMEM;
+	/* Names are sorted, so the names with this prefix are contiguous. */
+	low = 0;
+	high = desc_index_len;
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+
+		if (strncmp(desc_index[mid]->name, prefix, len) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	first = low;
+	high = desc_index_len;
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+
+		if (strncmp(desc_index[mid]->name, prefix, len) <= 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	*descs = desc_index + first;
+	*nr = low - first;
+	return 0;
+}
+
+/*
  * Called with sessions lock held.
  */
 static
 const struct lttng_event_desc *find_event(const char *name)
 {
+	const struct lttng_event_desc * const *descs;
 	struct lttng_probe_desc *probe_desc;
+	size_t nr;
 	int i;
 
+	if (!lttng_probes_match_prefix(name, strlen(name) + 1, &descs, &nr))
+		return nr ? descs[0] : NULL;
 	list_for_each_entry(probe_desc, &_probe_list, head) {
 		for (i = 0; i < probe_desc->nr_events; i++) {
 			if (!strcmp(probe_desc->event_desc[i]->name, name))
@@ -238,6 +463,33 @@ void lttng_event_put(const struct lttng_event_desc *event)
 }
 EXPORT_SYMBOL_GPL(lttng_event_put);
 
+/*
+ * Binary counterpart of the tracepoint list file.
+ */
+int lttng_probes_list_binary(struct lttng_event_list_writer *writer)
+{
+	struct lttng_probe_desc *probe_desc;
+	struct list_head *probe_list;
+	int ret = 0, i;
+
+	lttng_lock_sessions();
+	probe_list = lttng_get_probe_list_head();
+	list_for_each_entry(probe_desc, probe_list, head) {
+		for (i = 0; i < probe_desc->nr_events; i++) {
+			const struct lttng_event_desc *desc =
+				probe_desc->event_desc[i];
+
+			ret = lttng_event_list_append(writer, desc, desc->name,
+					0, 0);
+			if (ret)
+				goto end;
+		}
+	}
+end:
+	lttng_unlock_sessions();
+	return ret;
+}
+
 static
 void *tp_list_start(struct seq_file *m, loff_t *pos)
 {
@@ -322,3 +574,11 @@ int lttng_probes_init(void)
 		per_cpu_ptr(&lttng_dynamic_len_stack, cpu)->offset = 0;
 	return 0;
 }
+
+void lttng_probes_exit(void)
+{
+	lttng_kvfree(desc_index);
+	desc_index = NULL;
+	desc_index_len = 0;
+	desc_index_dirty = 1;
+}
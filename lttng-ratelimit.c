@@ -0,0 +1,272 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-ratelimit.c
+ *
+ * LTTng per-key event rate limiting.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/jhash.h>
+#include <linux/math64.h>
+#include <linux/string.h>
+
+#include <wrapper/vmalloc.h>
+#include <wrapper/trace-clock.h>
+#include <lttng-events.h>
+
+/*
+ * A rate limited event keeps one token bucket per value of its key
+ * context on each cpu. Buckets hold up to "burst" records, and are
+ * refilled at "rate" records per second. Records finding an empty
+ * bucket are not recorded, and counted as suppressed in their bucket:
+ * the next record of this key reports this count in its
+ * ratelimit_suppressed context.
+ *
+ * Each cpu only updates its own buckets, with preemption disabled.
+ * Buckets are claimed with a local cmpxchg. A key finding no bucket
+ * within LTTNG_RATELIMIT_MAX_PROBE slots recycles the first one, losing
+ * its suppressed count. Updates of a bucket by nested contexts
+ * (interrupts, NMIs) may slightly misaccount its credit.
+ */
+
+#define LTTNG_RATELIMIT_NR_SLOTS	256	/* Per-cpu, power of 2 */
+#define LTTNG_RATELIMIT_MAX_PROBE	4
+
+struct lttng_ratelimit_slot {
+	unsigned long hash;		/* 0: free slot */
+	uint64_t last;			/* Trace clock of the last refill */
+	uint64_t credit;		/* Trace clock units */
+	uint32_t suppressed;
+};
+
+struct lttng_ratelimit {
+	uint64_t cost;			/* Credit per record, 0: unlimited */
+	uint64_t max_credit;		/* Credit of "burst" records */
+	int key_index;			/* In lttng_static_ctx, -1: no key */
+	struct lttng_ratelimit_slot **cpu_slots;
+};
+
+static
+bool lttng_ratelimit_field_is_string(const struct lttng_event_field *field)
+{
+	switch (field->type.atype) {
+	case atype_array:
+		return field->type.u.array.elem_type.u.basic.integer.encoding
+			!= lttng_encode_none;
+	case atype_sequence:
+		return field->type.u.sequence.elem_type.u.basic.integer.encoding
+			!= lttng_encode_none;
+	case atype_string:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static
+unsigned long lttng_ratelimit_hash(int key_index,
+		struct lttng_probe_ctx *probe_ctx)
+{
+	struct lttng_ctx_field *field;
+	union lttng_ctx_value v;
+
+	if (key_index < 0)
+		return 1UL;
+	field = &lttng_static_ctx->fields[key_index];
+	field->get_value(field, probe_ctx, &v);
+	if (lttng_ratelimit_field_is_string(&field->event_field))
+		return jhash(v.str, strlen(v.str), 0) | 1UL;
+	return jhash_2words((u32) v.s64, (u32) ((u64) v.s64 >> 32), 0) | 1UL;
+}
+
+static
+struct lttng_ratelimit_slot *lttng_ratelimit_lookup(
+		struct lttng_ratelimit_slot *slots, unsigned long hash,
+		uint64_t now, uint64_t max_credit)
+{
+	struct lttng_ratelimit_slot *slot;
+	unsigned long old;
+	unsigned int i, idx;
+
+	idx = hash & (LTTNG_RATELIMIT_NR_SLOTS - 1);
+	for (i = 0; i < LTTNG_RATELIMIT_MAX_PROBE; i++) {
+		slot = &slots[(idx + i) & (LTTNG_RATELIMIT_NR_SLOTS - 1)];
+		old = READ_ONCE(slot->hash);
+		if (old == hash)
+			return slot;
+		if (!old && cmpxchg_local(&slot->hash, 0, hash) == 0)
+			goto init;
+	}
+	/* Recycle the first bucket probed. */
+	slot = &slots[idx];
+	WRITE_ONCE(slot->hash, hash);
+init:
+	slot->last = now;
+	slot->credit = max_credit;
+	slot->suppressed = 0;
+	return slot;
+}
+
+/*
+ * Take the credit of a record of the event from the bucket of its key on
+ * the current cpu. Returns false if the record must not be recorded.
+ * Called from the client reserve path with preemption disabled.
+ */
+bool lttng_ratelimit_check(struct lttng_ratelimit *rl,
+		struct lttng_probe_ctx *probe_ctx, int cpu)
+{
+	struct lttng_ratelimit_slot *slot;
+	uint64_t cost, max_credit, now, delta, credit;
+
+	cost = READ_ONCE(rl->cost);
+	if (!cost)
+		return true;
+	max_credit = READ_ONCE(rl->max_credit);
+	now = trace_clock_read64();
+	slot = lttng_ratelimit_lookup(rl->cpu_slots[cpu],
+			lttng_ratelimit_hash(READ_ONCE(rl->key_index), probe_ctx),
+			now, max_credit);
+	credit = min(slot->credit, max_credit);
+	delta = now - slot->last;
+	if ((int64_t) delta > 0) {
+		if (delta >= max_credit - credit)
+			credit = max_credit;
+		else
+			credit += delta;
+		slot->last = now;
+	}
+	if (credit < cost) {
+		slot->credit = credit;
+		slot->suppressed++;
+		return false;
+	}
+	slot->credit = credit - cost;
+	probe_ctx->ratelimit_suppressed = slot->suppressed;
+	slot->suppressed = 0;
+	return true;
+}
+EXPORT_SYMBOL_GPL(lttng_ratelimit_check);
+
+bool lttng_ratelimit_enabled(struct lttng_ratelimit *rl)
+{
+	return rl && rl->cost;
+}
+
+static
+struct lttng_ratelimit *lttng_ratelimit_alloc(void)
+{
+	struct lttng_ratelimit *rl;
+	int cpu;
+
+	rl = kzalloc(sizeof(*rl), GFP_KERNEL);
+	if (!rl)
+		return NULL;
+	rl->key_index = -1;
+	rl->cpu_slots = kcalloc(nr_cpu_ids, sizeof(*rl->cpu_slots),
+			GFP_KERNEL);
+	if (!rl->cpu_slots)
+		goto error;
+	for_each_possible_cpu(cpu) {
+		rl->cpu_slots[cpu] = lttng_kvzalloc_node(LTTNG_RATELIMIT_NR_SLOTS
+				* sizeof(struct lttng_ratelimit_slot),
+				GFP_KERNEL | __GFP_NOWARN, cpu_to_node(cpu));
+		if (!rl->cpu_slots[cpu])
+			goto error;
+	}
+	/* Ensure the memory we just allocated don't trigger page faults */
+	wrapper_vmalloc_sync_all();
+	return rl;
+
+error:
+	lttng_ratelimit_destroy(rl);
+	return NULL;
+}
+
+void lttng_ratelimit_destroy(struct lttng_ratelimit *rl)
+{
+	int cpu;
+
+	if (!rl)
+		return;
+	if (rl->cpu_slots) {
+		for_each_possible_cpu(cpu)
+			lttng_kvfree(rl->cpu_slots[cpu]);
+		kfree(rl->cpu_slots);
+	}
+	kfree(rl);
+}
+
+/*
+ * Check a rate limit, returning the index of its key within
+ * lttng_static_ctx in @key_index, -1 when it has no key.
+ */
+int lttng_ratelimit_validate(const struct lttng_kernel_event_ratelimit *param,
+		int *key_index)
+{
+	const struct lttng_ctx_field *field;
+	int idx;
+
+	*key_index = -1;
+	if (!param->rate)
+		return 0;
+	if (!param->burst)
+		return -EINVAL;
+	if (strnlen(param->key, LTTNG_KERNEL_SYM_NAME_LEN)
+			== LTTNG_KERNEL_SYM_NAME_LEN)
+		return -EINVAL;
+	if (!param->key[0])
+		return 0;
+	idx = lttng_get_context_index(lttng_static_ctx, param->key);
+	if (idx < 0)
+		return -ENOENT;
+	field = &lttng_static_ctx->fields[idx];
+	if (!field->get_value)
+		return -EINVAL;
+	switch (field->event_field.type.atype) {
+	case atype_integer:
+	case atype_enum:
+		break;
+	default:
+		if (!lttng_ratelimit_field_is_string(&field->event_field))
+			return -EINVAL;
+	}
+	*key_index = idx;
+	return 0;
+}
+
+/*
+ * Set the rate limit of an event, allocating its buckets on first use. A
+ * NULL or zero rate @param removes the limit. Called with sessions mutex
+ * held. Buckets of the previous limit are kept, and refill with the new
+ * rate.
+ */
+int lttng_ratelimit_set(struct lttng_ratelimit **rlp,
+		const struct lttng_kernel_event_ratelimit *param)
+{
+	struct lttng_ratelimit *rl = *rlp;
+	uint64_t cost;
+	int ret, key_index;
+
+	if (!param || !param->rate) {
+		if (rl)
+			WRITE_ONCE(rl->cost, 0);
+		return 0;
+	}
+	ret = lttng_ratelimit_validate(param, &key_index);
+	if (ret)
+		return ret;
+	if (!rl) {
+		rl = lttng_ratelimit_alloc();
+		if (!rl)
+			return -ENOMEM;
+		*rlp = rl;
+	}
+	cost = max_t(uint64_t, div64_u64(trace_clock_freq(), param->rate), 1);
+	WRITE_ONCE(rl->key_index, key_index);
+	WRITE_ONCE(rl->max_credit, cost * param->burst);
+	WRITE_ONCE(rl->cost, cost);
+	return 0;
+}
@@ -13,4 +13,8 @@
 #define RING_BUFFER_MODE_TEMPLATE		RING_BUFFER_DISCARD
 #define RING_BUFFER_MODE_TEMPLATE_STRING	"discard-mmap"
 #define RING_BUFFER_OUTPUT_TEMPLATE		RING_BUFFER_MMAP
+/* Contiguous sub-buffers use vmalloc space, scarce on 32-bit. */
+#ifdef CONFIG_64BIT
+#define RING_BUFFER_BACKEND_TEMPLATE		RING_BUFFER_VMAP
+#endif
 #include "lttng-ring-buffer-client.h"
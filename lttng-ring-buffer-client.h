@@ -9,6 +9,7 @@
 
 #include <linux/module.h>
 #include <linux/types.h>
+#include <linux/jhash.h>
 #include <lib/bitfield.h>
 #include <wrapper/vmalloc.h>	/* for wrapper_vmalloc_sync_all() */
 #include <wrapper/trace-clock.h>
@@ -16,8 +17,26 @@
 #include <lttng-tracer.h>
 #include <wrapper/ringbuffer/frontend_types.h>
 
+#ifndef RING_BUFFER_BACKEND_TEMPLATE
+#define RING_BUFFER_BACKEND_TEMPLATE	RING_BUFFER_PAGE
+#endif
+
 #define LTTNG_COMPACT_EVENT_BITS	5
 #define LTTNG_COMPACT_TSC_BITS		27
+#define LTTNG_DELTA_TSC_WIDTH_BITS	3
+
+/*
+ * Timestamp width of the delta event header. The timestamp field holds
+ * the low bits of the clock, which is enough for the reader to rebuild
+ * it as long as the delta from the previous record fits.
+ */
+enum lttng_delta_tsc_width {
+	LTTNG_DELTA_TSC_0 = 0,	/* Same timestamp as the previous record */
+	LTTNG_DELTA_TSC_8 = 1,
+	LTTNG_DELTA_TSC_16 = 2,
+	LTTNG_DELTA_TSC_32 = 3,
+	LTTNG_DELTA_TSC_64 = 4,
+};
 
 static struct lttng_transport lttng_relay_transport;
 
@@ -59,6 +78,20 @@ struct packet_header {
 						 * (may overflow)
 						 */
 		uint32_t cpu_id;		/* CPU id associated with stream */
+		uint32_t sampling_period;	/* Sampling period at subbuffer end */
+		unsigned long events_sampled_out;	/*
+						 * Events sampled out since the
+						 * beginning of the trace.
+						 * (may overflow)
+						 */
+		uint32_t events_discarded_id[LTTNG_LOST_SUMMARY_SLOTS];
+						/* -1U: unused slot */
+		unsigned long events_discarded_count[LTTNG_LOST_SUMMARY_SLOTS];
+						/*
+						 * Events of events_discarded_id
+						 * lost since the beginning of
+						 * the trace. (may overflow)
+						 */
 		uint8_t header_end;		/* End of header */
 	} ctx;
 };
@@ -70,18 +103,23 @@ struct lttng_client_ctx {
 
 static inline notrace u64 lib_ring_buffer_clock_read(struct channel *chan)
 {
+	struct lttng_channel *lttng_chan = channel_get_private(chan);
+
+	if (unlikely(lttng_chan->coarse_clock))
+		return trace_clock_read64_coarse();
 	return trace_clock_read64();
 }
 
 static inline
 size_t ctx_get_aligned_size(size_t offset, struct lttng_ctx *ctx,
-		size_t ctx_len)
+		size_t ctx_len, int packed)
 {
 	size_t orig_offset = offset;
 
 	if (likely(!ctx))
 		return 0;
-	offset += lib_ring_buffer_align(offset, ctx->largest_align);
+	offset += lib_ring_buffer_record_align(packed, offset,
+			ctx->largest_align);
 	offset += ctx_len;
 	return offset - orig_offset;
 }
@@ -97,9 +135,26 @@ void ctx_get_struct_size(struct lttng_ctx *ctx, size_t *ctx_len,
 		*ctx_len = 0;
 		return;
 	}
+	/* Computed by lttng_context_update(). */
+	if (likely(ctx->fixed_size)) {
+		*ctx_len = bufctx->packed ? ctx->packed_fixed_size
+				: ctx->fixed_size;
+		return;
+	}
+	/*
+	 * get_size() only pads before its field: sized at offset 0, it
+	 * is the size of the field in packed records. get_size_arg()
+	 * pads according to bufctx->packed.
+	 */
 	for (i = 0; i < ctx->nr_fields; i++) {
+		if (unlikely(ctx->fields[i].guard)) {
+			offset += lttng_ctx_guard_get_size(offset,
+					&ctx->fields[i], bufctx, chan);
+			continue;
+		}
 		if (ctx->fields[i].get_size)
-			offset += ctx->fields[i].get_size(offset);
+			offset += ctx->fields[i].get_size(bufctx->packed ?
+					0 : offset);
 		if (ctx->fields[i].get_size_arg)
 			offset += ctx->fields[i].get_size_arg(offset,
 					&ctx->fields[i], bufctx, chan);
@@ -117,8 +172,53 @@ void ctx_record(struct lib_ring_buffer_ctx *bufctx,
 	if (likely(!ctx))
 		return;
 	lib_ring_buffer_align_ctx(bufctx, ctx->largest_align);
-	for (i = 0; i < ctx->nr_fields; i++)
-		ctx->fields[i].record(&ctx->fields[i], bufctx, chan);
+	for (i = 0; i < ctx->nr_fields; i++) {
+		if (unlikely(ctx->fields[i].guard))
+			lttng_ctx_guard_record(&ctx->fields[i], bufctx, chan);
+		else
+			ctx->fields[i].record(&ctx->fields[i], bufctx, chan);
+	}
+}
+
+/*
+ * Pick the timestamp width from the delta with buf->last_tsc. last_tsc
+ * is the timestamp of a record physically preceding this one, which is
+ * never more recent than the record right before it, so the delta is
+ * an upper bound. On 32-bit architectures, last_tsc only holds the high
+ * bits, so only the overflow check done by the ring buffer can be used.
+ */
+static inline
+enum lttng_delta_tsc_width lttng_delta_tsc_width(
+		const struct lib_ring_buffer_config *config,
+		struct lib_ring_buffer_ctx *ctx)
+{
+#if (BITS_PER_LONG == 64)
+	u64 delta;
+#endif
+
+	if (ctx->rflags & RING_BUFFER_RFLAG_FULL_TSC)
+		return LTTNG_DELTA_TSC_64;
+#if (BITS_PER_LONG == 64)
+	delta = ctx->tsc - v_read(config, &ctx->buf->last_tsc);
+	if (!delta)
+		return LTTNG_DELTA_TSC_0;
+	if (!(delta >> 8))
+		return LTTNG_DELTA_TSC_8;
+	if (!(delta >> 16))
+		return LTTNG_DELTA_TSC_16;
+	if (!(delta >> 32))
+		return LTTNG_DELTA_TSC_32;
+	return LTTNG_DELTA_TSC_64;
+#else
+	return LTTNG_DELTA_TSC_32;
+#endif
+}
+
+/* 0, 1, 2, 4 or 8 bytes. */
+static inline
+size_t lttng_delta_tsc_size(enum lttng_delta_tsc_width width)
+{
+	return (1U << width) >> 1;
 }
 
 /*
@@ -178,14 +278,30 @@ size_t record_header_size(const struct lib_ring_buffer_config *config,
 			offset += sizeof(uint64_t);	/* timestamp */
 		}
 		break;
+	case 3:	/* delta */
+	{
+		enum lttng_delta_tsc_width width;
+
+		/* Byte-aligned: the header is written unaligned. */
+		padding = 0;
+		width = lttng_delta_tsc_width(config, ctx);
+		/* Kept for lttng_write_event_header(), across retries. */
+		ctx->rflags &= ~LTTNG_RFLAG_DELTA_TSC_MASK;
+		ctx->rflags |= width << LTTNG_RFLAG_DELTA_TSC_SHIFT;
+		offset += sizeof(uint8_t);	/* id and timestamp width */
+		if (ctx->rflags & LTTNG_RFLAG_EXTENDED)
+			offset += sizeof(uint32_t);	/* id */
+		offset += lttng_delta_tsc_size(width);
+		break;
+	}
 	default:
 		padding = 0;
 		WARN_ON_ONCE(1);
 	}
 	offset += ctx_get_aligned_size(offset, lttng_chan->ctx,
-			client_ctx->packet_context_len);
+			client_ctx->packet_context_len, ctx->packed);
 	offset += ctx_get_aligned_size(offset, event->ctx,
-			client_ctx->event_context_len);
+			client_ctx->event_context_len, ctx->packed);
 
 	*pre_header_padding = padding;
 	return offset - orig_offset;
@@ -198,6 +314,85 @@ void lttng_write_event_header_slow(const struct lib_ring_buffer_config *config,
 				 struct lib_ring_buffer_ctx *ctx,
 				 uint32_t event_id);
 
+/*
+ * Delta header: 5-bit id and 3-bit timestamp width in the first byte,
+ * then the 32-bit id if extended, then the low bits of the timestamp.
+ * 1 to 13 bytes, with no alignment.
+ */
+static __inline__
+void lttng_write_event_header_delta(const struct lib_ring_buffer_config *config,
+			    struct lib_ring_buffer_ctx *ctx,
+			    uint32_t event_id)
+{
+	enum lttng_delta_tsc_width width = (ctx->rflags
+		& LTTNG_RFLAG_DELTA_TSC_MASK) >> LTTNG_RFLAG_DELTA_TSC_SHIFT;
+	uint8_t id_width = 0;
+
+	bt_bitfield_write(&id_width, uint8_t,
+			0,
+			LTTNG_COMPACT_EVENT_BITS,
+			(ctx->rflags & LTTNG_RFLAG_EXTENDED) ? 31 : event_id);
+	bt_bitfield_write(&id_width, uint8_t,
+			LTTNG_COMPACT_EVENT_BITS,
+			LTTNG_DELTA_TSC_WIDTH_BITS,
+			width);
+	lib_ring_buffer_write(config, ctx, &id_width, sizeof(id_width));
+	if (ctx->rflags & LTTNG_RFLAG_EXTENDED)
+		lib_ring_buffer_write(config, ctx, &event_id, sizeof(event_id));
+	switch (width) {
+	case LTTNG_DELTA_TSC_0:
+		break;
+	case LTTNG_DELTA_TSC_8:
+	{
+		uint8_t timestamp = (uint8_t) ctx->tsc;
+
+		lib_ring_buffer_write(config, ctx, &timestamp, sizeof(timestamp));
+		break;
+	}
+	case LTTNG_DELTA_TSC_16:
+	{
+		uint16_t timestamp = (uint16_t) ctx->tsc;
+
+		lib_ring_buffer_write(config, ctx, &timestamp, sizeof(timestamp));
+		break;
+	}
+	case LTTNG_DELTA_TSC_32:
+	{
+		uint32_t timestamp = (uint32_t) ctx->tsc;
+
+		lib_ring_buffer_write(config, ctx, &timestamp, sizeof(timestamp));
+		break;
+	}
+	case LTTNG_DELTA_TSC_64:
+	{
+		uint64_t timestamp = ctx->tsc;
+
+		lib_ring_buffer_write(config, ctx, &timestamp, sizeof(timestamp));
+		break;
+	}
+	}
+}
+
+/*
+ * Records of events in coalesce mode are compared from their contexts,
+ * the header holding the timestamp. Runs are only tracked by the
+ * outermost record of the cpu: nested records break them.
+ */
+static __inline__
+bool lttng_coalesce_outermost(int cpu)
+{
+	return per_cpu(lib_ring_buffer_nesting, cpu) == 1;
+}
+
+static __inline__
+void lttng_coalesce_mark(struct lttng_channel *lttng_chan,
+		struct lib_ring_buffer_ctx *ctx)
+{
+	if (lttng_coalesce_outermost(ctx->cpu))
+		per_cpu_ptr(lttng_chan->coalesce, ctx->cpu)->begin =
+			ctx->buf_offset;
+}
+
 /*
  * lttng_write_event_header
  *
@@ -215,6 +410,7 @@ void lttng_write_event_header(const struct lib_ring_buffer_config *config,
 	struct lttng_channel *lttng_chan = channel_get_private(ctx->chan);
 	struct lttng_probe_ctx *lttng_probe_ctx = ctx->priv;
 	struct lttng_event *event = lttng_probe_ctx->event;
+	cycles_t profile_ts;
 
 	if (unlikely(ctx->rflags))
 		goto slow_path;
@@ -245,12 +441,20 @@ void lttng_write_event_header(const struct lib_ring_buffer_config *config,
 		lib_ring_buffer_write(config, ctx, &timestamp, sizeof(timestamp));
 		break;
 	}
+	case 3:	/* delta */
+		lttng_write_event_header_delta(config, ctx, event_id);
+		break;
 	default:
 		WARN_ON_ONCE(1);
 	}
 
+	if (unlikely(READ_ONCE(event->armed) & LTTNG_EVENT_ARMED_COALESCE))
+		lttng_coalesce_mark(lttng_chan, ctx);
+	profile_ts = lttng_probe_profile_begin(lttng_event_profile(event));
 	ctx_record(ctx, lttng_chan, lttng_chan->ctx);
 	ctx_record(ctx, lttng_chan, event->ctx);
+	lttng_probe_profile_phase(lttng_event_profile(event),
+			LTTNG_PROBE_PROFILE_CONTEXT, profile_ts);
 	lib_ring_buffer_align_ctx(ctx, ctx->largest_align);
 
 	return;
@@ -267,6 +471,7 @@ void lttng_write_event_header_slow(const struct lib_ring_buffer_config *config,
 	struct lttng_channel *lttng_chan = channel_get_private(ctx->chan);
 	struct lttng_probe_ctx *lttng_probe_ctx = ctx->priv;
 	struct lttng_event *event = lttng_probe_ctx->event;
+	cycles_t profile_ts;
 
 	switch (lttng_chan->header_type) {
 	case 1:	/* compact */
@@ -319,11 +524,19 @@ void lttng_write_event_header_slow(const struct lib_ring_buffer_config *config,
 		}
 		break;
 	}
+	case 3:	/* delta */
+		lttng_write_event_header_delta(config, ctx, event_id);
+		break;
 	default:
 		WARN_ON_ONCE(1);
 	}
+	if (unlikely(READ_ONCE(event->armed) & LTTNG_EVENT_ARMED_COALESCE))
+		lttng_coalesce_mark(lttng_chan, ctx);
+	profile_ts = lttng_probe_profile_begin(lttng_event_profile(event));
 	ctx_record(ctx, lttng_chan, lttng_chan->ctx);
 	ctx_record(ctx, lttng_chan, event->ctx);
+	lttng_probe_profile_phase(lttng_event_profile(event),
+			LTTNG_PROBE_PROFILE_CONTEXT, profile_ts);
 	lib_ring_buffer_align_ctx(ctx, ctx->largest_align);
 }
 
@@ -367,6 +580,7 @@ static void client_buffer_begin(struct lib_ring_buffer *buf, u64 tsc,
 				subbuf_idx * chan->backend.subbuf_size);
 	struct lttng_channel *lttng_chan = channel_get_private(chan);
 	struct lttng_session *session = lttng_chan->session;
+	unsigned int i;
 
 	header->magic = CTF_MAGIC_NUMBER;
 	memcpy(header->uuid, session->uuid.b, sizeof(session->uuid));
@@ -376,11 +590,18 @@ static void client_buffer_begin(struct lib_ring_buffer *buf, u64 tsc,
 	header->ctx.timestamp_end = 0;
 	header->ctx.content_size = ~0ULL; /* for debugging */
 	header->ctx.packet_size = ~0ULL;
-	header->ctx.packet_seq_num = chan->backend.num_subbuf * \
+	header->ctx.packet_seq_num = buf->backend.seq_base + \
+				     chan->backend.num_subbuf * \
 				     buf->backend.buf_cnt[subbuf_idx].seq_cnt + \
 				     subbuf_idx;
 	header->ctx.events_discarded = 0;
 	header->ctx.cpu_id = buf->backend.cpu;
+	header->ctx.sampling_period = 0;
+	header->ctx.events_sampled_out = 0;
+	for (i = 0; i < LTTNG_LOST_SUMMARY_SLOTS; i++) {
+		header->ctx.events_discarded_id[i] = -1U;
+		header->ctx.events_discarded_count[i] = 0;
+	}
 }
 
 /*
@@ -395,7 +616,11 @@ static void client_buffer_end(struct lib_ring_buffer *buf, u64 tsc,
 		(struct packet_header *)
 			lib_ring_buffer_offset_address(&buf->backend,
 				subbuf_idx * chan->backend.subbuf_size);
+	struct lttng_channel *lttng_chan = channel_get_private(chan);
+	struct lttng_channel_lost *lost =
+		per_cpu_ptr(lttng_chan->lost, buf->backend.cpu);
 	unsigned long records_lost = 0;
+	unsigned int i;
 
 	header->ctx.timestamp_end = tsc;
 	header->ctx.content_size =
@@ -406,6 +631,15 @@ static void client_buffer_end(struct lib_ring_buffer *buf, u64 tsc,
 	records_lost += lib_ring_buffer_get_records_lost_wrap(&client_config, buf);
 	records_lost += lib_ring_buffer_get_records_lost_big(&client_config, buf);
 	header->ctx.events_discarded = records_lost;
+	header->ctx.sampling_period = max(READ_ONCE(lttng_chan->sampling_period), 1U);
+	header->ctx.events_sampled_out =
+		local_read(&per_cpu_ptr(lttng_chan->sampling,
+					buf->backend.cpu)->skipped);
+	for (i = 0; i < LTTNG_LOST_SUMMARY_SLOTS; i++) {
+		header->ctx.events_discarded_id[i] = READ_ONCE(lost->id[i]) - 1;
+		header->ctx.events_discarded_count[i] =
+			local_read(&lost->count[i]);
+	}
 }
 
 static int client_buffer_create(struct lib_ring_buffer *buf, void *priv,
@@ -529,7 +763,7 @@ static const struct lib_ring_buffer_config client_config = {
 	.alloc = RING_BUFFER_ALLOC_PER_CPU,
 	.sync = RING_BUFFER_SYNC_PER_CPU,
 	.mode = RING_BUFFER_MODE_TEMPLATE,
-	.backend = RING_BUFFER_PAGE,
+	.backend = RING_BUFFER_BACKEND_TEMPLATE,
 	.output = RING_BUFFER_OUTPUT_TEMPLATE,
 	.oops = RING_BUFFER_OOPS_CONSISTENCY,
 	.ipi = RING_BUFFER_IPI_BARRIER,
@@ -553,13 +787,38 @@ struct channel *_channel_create(const char *name,
 				struct lttng_channel *lttng_chan, void *buf_addr,
 				size_t subbuf_size, size_t num_subbuf,
 				unsigned int switch_timer_interval,
-				unsigned int read_timer_interval)
+				unsigned int read_timer_interval,
+				unsigned int read_timer_max_interval,
+				enum lttng_kernel_numa_policy numa_policy,
+				int numa_node, uint32_t flags,
+				const struct cpumask *cpu_mask)
 {
+	enum lib_ring_buffer_numa_policy rb_numa_policy;
+	unsigned int rb_flags = 0;
 	struct channel *chan;
 
+	switch (numa_policy) {
+	case LTTNG_KERNEL_NUMA_LOCAL:
+		rb_numa_policy = RING_BUFFER_NUMA_LOCAL;
+		break;
+	case LTTNG_KERNEL_NUMA_INTERLEAVE:
+		rb_numa_policy = RING_BUFFER_NUMA_INTERLEAVE;
+		break;
+	case LTTNG_KERNEL_NUMA_NODE:
+		rb_numa_policy = RING_BUFFER_NUMA_NODE;
+		break;
+	default:
+		return NULL;
+	}
+	if (flags & LTTNG_KERNEL_CHANNEL_FLAG_LAZY_ALLOC)
+		rb_flags |= RING_BUFFER_CHANNEL_LAZY_ALLOC;
+	if (flags & LTTNG_KERNEL_CHANNEL_FLAG_HOUSEKEEPING)
+		rb_flags |= RING_BUFFER_CHANNEL_HOUSEKEEPING;
 	chan = channel_create(&client_config, name, lttng_chan, buf_addr,
 			      subbuf_size, num_subbuf, switch_timer_interval,
-			      read_timer_interval);
+			      read_timer_interval, read_timer_max_interval,
+			      rb_numa_policy, numa_node,
+			      rb_flags, cpu_mask);
 	if (chan) {
 		/*
 		 * Ensure this module is not unloaded before we finish
@@ -613,6 +872,76 @@ void lttng_buffer_read_close(struct lib_ring_buffer *buf)
 	lib_ring_buffer_release_read(buf);
 }
 
+/*
+ * Account a record lost by a failed reservation to its event ID. IDs
+ * are given the free slots of the cpu in loss order, and never
+ * released: the records lost by events beyond the last slot are only
+ * counted in events_discarded.
+ */
+static
+void lttng_event_lost(struct lttng_channel *lttng_chan, int cpu,
+		uint32_t event_id)
+{
+	struct lttng_channel_lost *lost = per_cpu_ptr(lttng_chan->lost, cpu);
+	unsigned int i, id;
+
+	for (i = 0; i < LTTNG_LOST_SUMMARY_SLOTS; i++) {
+		id = READ_ONCE(lost->id[i]);
+		if (!id) {
+			/* Claim the slot, racing with nested writers. */
+			id = cmpxchg(&lost->id[i], 0, event_id + 1);
+			if (!id)
+				id = event_id + 1;
+		}
+		if (id == event_id + 1) {
+			local_inc(&lost->count[i]);
+			return;
+		}
+	}
+}
+
+/*
+ * End the run of repeated records of the cpu, emitting the number of
+ * repeats discarded, if any.
+ */
+static
+void lttng_coalesce_end(struct lttng_channel *lttng_chan,
+		struct lttng_channel_coalesce *run)
+{
+	uint32_t id = run->id;
+	u64 count = run->count, last_tsc = run->last_tsc;
+
+	run->buf = NULL;
+	run->count = 0;
+	if (count)
+		lttng_coalesce_record(lttng_chan, id, count, last_tsc);
+}
+
+/* Hash the contexts and payload of a record, before its commit. */
+static
+u32 lttng_coalesce_hash(struct lib_ring_buffer_ctx *ctx,
+		unsigned long offset, size_t len)
+{
+	struct channel_backend *chanb = &ctx->chan->backend;
+	struct lib_ring_buffer_backend_pages *backend_pages;
+	size_t chunk, pagecpy;
+	const void *src;
+	u32 hash = 0;
+
+	backend_pages = lib_ring_buffer_get_backend_pages_from_ctx(
+			&client_config, ctx);
+	offset &= chanb->buf_size - 1;
+	while (len) {
+		chunk = min_t(size_t, len, PAGE_SIZE - (offset & ~PAGE_MASK));
+		src = lib_ring_buffer_backend_dest(&client_config, chanb,
+				backend_pages, offset, chunk, &pagecpy);
+		hash = jhash(src, chunk, hash);
+		offset += chunk;
+		len -= chunk;
+	}
+	return hash;
+}
+
 static
 int lttng_event_reserve(struct lib_ring_buffer_ctx *ctx,
 		      uint32_t event_id)
@@ -621,6 +950,8 @@ int lttng_event_reserve(struct lib_ring_buffer_ctx *ctx,
 	struct lttng_probe_ctx *lttng_probe_ctx = ctx->priv;
 	struct lttng_event *event = lttng_probe_ctx->event;
 	struct lttng_client_ctx client_ctx;
+	struct lttng_channel_coalesce *run;
+	unsigned long armed;
 	int ret, cpu;
 
 	cpu = lib_ring_buffer_get_cpu(&client_config);
@@ -628,12 +959,65 @@ int lttng_event_reserve(struct lib_ring_buffer_ctx *ctx,
 		return -EPERM;
 	ctx->cpu = cpu;
 
+	if (unlikely(!lib_ring_buffer_channel_cpu_traced(ctx->chan, cpu))) {
+		ret = -EAGAIN;
+		goto put;
+	}
+	if (!lttng_probe_ctx->sampled
+			&& unlikely(!lttng_channel_sample(lttng_chan, cpu))) {
+		ret = -EAGAIN;
+		goto put;
+	}
+	armed = READ_ONCE(event->armed);
+	if (lttng_session_paused(event->chan->session, armed)) {
+		ret = -EAGAIN;
+		goto put;
+	}
+	/* Tracepoint probes count their hits before serializing. */
+	if (unlikely(lttng_event_count_hit(event, armed))) {
+		ret = -EAGAIN;
+		goto put;
+	}
+	if (unlikely(armed & LTTNG_EVENT_ARMED_BREAKER)
+			&& !lttng_breaker_check(event, cpu)) {
+		ret = -EAGAIN;
+		goto put;
+	}
+	if (unlikely(armed & LTTNG_EVENT_ARMED_RATELIMIT)
+			&& !lttng_ratelimit_check(event->ratelimit,
+				lttng_probe_ctx, cpu)) {
+		ret = -EAGAIN;
+		goto put;
+	}
+	if (unlikely(armed & LTTNG_EVENT_ARMED_TRIGGER))
+		lttng_channel_trigger_fire(lttng_chan);
+	if (unlikely(armed & LTTNG_EVENT_ARMED_CRITICAL))
+		ctx->critical = 1;
+	if (unlikely(lttng_chan->aggregation)) {
+		/* Aggregation channels do not record events. */
+		lttng_aggregation_update(lttng_chan->aggregation,
+				lttng_probe_ctx, event_id, cpu);
+		ret = -EAGAIN;
+		goto put;
+	}
+	if (lttng_chan->packed) {
+		/* Payload sized by the probe without padding. */
+		ctx->packed = 1;
+		ctx->largest_align = 1;
+	}
+	/* Another event ends the run of repeats, before its record. */
+	run = per_cpu_ptr(lttng_chan->coalesce, cpu);
+	if (unlikely(run->count) && run->id != event->id
+			&& lttng_coalesce_outermost(cpu))
+		lttng_coalesce_end(lttng_chan, run);
+
 	/* Compute internal size of context structures. */
 	ctx_get_struct_size(lttng_chan->ctx, &client_ctx.packet_context_len, lttng_chan, ctx);
 	ctx_get_struct_size(event->ctx, &client_ctx.event_context_len, lttng_chan, ctx);
 
 	switch (lttng_chan->header_type) {
 	case 1:	/* compact */
+	case 3:	/* delta */
 		if (event_id > 30)
 			ctx->rflags |= LTTNG_RFLAG_EXTENDED;
 		break;
@@ -646,8 +1030,12 @@ int lttng_event_reserve(struct lib_ring_buffer_ctx *ctx,
 	}
 
 	ret = lib_ring_buffer_reserve(&client_config, ctx, &client_ctx);
-	if (unlikely(ret))
+	if (unlikely(ret)) {
+		if (ret != -EAGAIN)
+			lttng_event_lost(lttng_chan, cpu, event_id);
 		goto put;
+	}
+	lttng_event_metadata_hit(event, armed);
 	lib_ring_buffer_backend_get_pages(&client_config, ctx,
 			&ctx->backend_pages);
 	lttng_write_event_header(&client_config, ctx, event_id);
@@ -657,10 +1045,79 @@ put:
 	return ret;
 }
 
+/*
+ * Commit a record of an event in coalesce mode. A repeat of the record
+ * kept by the run of the cpu, immediately following it in the same
+ * packet, is discarded and counted instead. Records are compared by
+ * event ID, and by length and hash of their contexts and payload.
+ */
 static
-void lttng_event_commit(struct lib_ring_buffer_ctx *ctx)
+void lttng_event_commit_coalesce(struct lib_ring_buffer_ctx *ctx)
 {
+	struct lttng_channel *lttng_chan = channel_get_private(ctx->chan);
+	struct lttng_probe_ctx *lttng_probe_ctx = ctx->priv;
+	uint32_t id = lttng_probe_ctx->event->id;
+	struct lttng_channel_coalesce *run;
+	size_t len;
+	u32 hash;
+
+	run = per_cpu_ptr(lttng_chan->coalesce, ctx->cpu);
+	len = ctx->buf_offset - run->begin;
+	/* Not marked if the mode was set after the header was written. */
+	if (!lttng_coalesce_outermost(ctx->cpu)
+			|| len > ctx->buf_offset - ctx->pre_offset) {
+		lib_ring_buffer_commit(&client_config, ctx);
+		return;
+	}
+	hash = lttng_coalesce_hash(ctx, run->begin, len);
+	if (run->buf == ctx->buf && run->end == ctx->pre_offset
+			&& subbuf_offset(ctx->pre_offset, ctx->chan)
+			&& run->id == id && run->len == len && run->hash == hash
+			&& !lib_ring_buffer_try_discard_reserve(&client_config, ctx)) {
+		run->count++;
+		run->last_tsc = ctx->tsc;
+		return;
+	}
 	lib_ring_buffer_commit(&client_config, ctx);
+	if (run->count) {
+		/* Followed by the repeats record, it cannot start a run. */
+		lttng_coalesce_end(lttng_chan, run);
+		return;
+	}
+	run->buf = ctx->buf;
+	run->end = ctx->pre_offset + ctx->slot_size;
+	run->len = len;
+	run->hash = hash;
+	run->id = id;
+}
+
+static
+void lttng_event_commit(struct lib_ring_buffer_ctx *ctx)
+{
+	struct lttng_probe_ctx *lttng_probe_ctx = ctx->priv;
+
+	if (unlikely(READ_ONCE(lttng_probe_ctx->event->armed)
+			& LTTNG_EVENT_ARMED_COALESCE))
+		lttng_event_commit_coalesce(ctx);
+	else
+		lib_ring_buffer_commit(&client_config, ctx);
+	lib_ring_buffer_put_cpu(&client_config);
+}
+
+/*
+ * Record the pending repeats of the current cpu, from a work item
+ * running on that cpu.
+ */
+static
+void lttng_event_coalesce_flush(struct channel *chan)
+{
+	struct lttng_channel *lttng_chan = channel_get_private(chan);
+	int cpu;
+
+	cpu = lib_ring_buffer_get_cpu(&client_config);
+	if (cpu < 0)
+		return;
+	lttng_coalesce_end(lttng_chan, per_cpu_ptr(lttng_chan->coalesce, cpu));
 	lib_ring_buffer_put_cpu(&client_config);
 }
 
@@ -700,6 +1157,44 @@ void lttng_event_strcpy_from_user(struct lib_ring_buffer_ctx *ctx,
 			len, '#');
 }
 
+static
+size_t lttng_event_strscpy(struct lib_ring_buffer_ctx *ctx, const char *src,
+		size_t len)
+{
+	return lib_ring_buffer_strscpy(&client_config, ctx, src, len);
+}
+
+static
+size_t lttng_event_strscpy_from_user(struct lib_ring_buffer_ctx *ctx,
+		const char __user *src, size_t len)
+{
+	return lib_ring_buffer_strscpy_from_user_inatomic(&client_config, ctx,
+			src, len);
+}
+
+/*
+ * End a single-pass payload with its slack field, giving back the
+ * reserved space left unused. If a nested record was reserved after this
+ * one meanwhile, the space cannot be given back: it is filled by the
+ * slack field instead, so the record keeps its reserved size.
+ */
+static
+void lttng_event_shrink(struct lib_ring_buffer_ctx *ctx)
+{
+	unsigned long reserved_end = ctx->pre_offset + ctx->slot_size;
+	uint16_t slack = 0;
+
+	lib_ring_buffer_align_ctx(ctx, lttng_alignof(slack));
+	if (likely(!lib_ring_buffer_try_shrink_reserve(&client_config, ctx,
+			ctx->buf_offset + sizeof(slack)))) {
+		lib_ring_buffer_write(&client_config, ctx, &slack, sizeof(slack));
+		return;
+	}
+	slack = reserved_end - ctx->buf_offset - sizeof(slack);
+	lib_ring_buffer_write(&client_config, ctx, &slack, sizeof(slack));
+	lib_ring_buffer_memset(&client_config, ctx, 0, slack);
+}
+
 static
 wait_queue_head_t *lttng_get_writer_buf_wait_queue(struct channel *chan, int cpu)
 {
@@ -714,6 +1209,12 @@ wait_queue_head_t *lttng_get_hp_wait_queue(struct channel *chan)
 	return &chan->hp_wait;
 }
 
+static
+wait_queue_head_t *lttng_get_read_wait_queue(struct channel *chan)
+{
+	return &chan->read_wait;
+}
+
 static
 int lttng_is_finalized(struct channel *chan)
 {
@@ -732,6 +1233,13 @@ static struct lttng_transport lttng_relay_transport = {
 	.ops = {
 		.channel_create = _channel_create,
 		.channel_destroy = lttng_channel_destroy,
+		.channel_resize = channel_resize,
+		.channel_set_critical_reserve = channel_set_critical_reserve,
+		.channel_set_blocking_timeout = channel_set_blocking_timeout,
+		.channel_set_live_latency = channel_set_live_latency,
+		.channel_set_writer_barrier = channel_set_writer_barrier,
+		.event_coalesce_flush = lttng_event_coalesce_flush,
+		.channel_flush = channel_flush,
 		.buffer_read_open = lttng_buffer_read_open,
 		.buffer_has_read_closed_stream =
 			lttng_buffer_has_read_closed_stream,
@@ -743,9 +1251,14 @@ static struct lttng_transport lttng_relay_transport = {
 		.event_memset = lttng_event_memset,
 		.event_strcpy = lttng_event_strcpy,
 		.event_strcpy_from_user = lttng_event_strcpy_from_user,
+		.event_strscpy = lttng_event_strscpy,
+		.event_strscpy_from_user = lttng_event_strscpy_from_user,
+		.event_shrink = lttng_event_shrink,
 		.packet_avail_size = NULL,	/* Would be racy anyway */
 		.get_writer_buf_wait_queue = lttng_get_writer_buf_wait_queue,
 		.get_hp_wait_queue = lttng_get_hp_wait_queue,
+		.get_read_wait_queue = lttng_get_read_wait_queue,
+		.get_ready_cpus = channel_get_ready_cpus,
 		.is_finalized = lttng_is_finalized,
 		.is_disabled = lttng_is_disabled,
 		.timestamp_begin = client_timestamp_begin,
@@ -240,14 +240,20 @@ struct channel *_channel_create(const char *name,
 				struct lttng_channel *lttng_chan, void *buf_addr,
 				size_t subbuf_size, size_t num_subbuf,
 				unsigned int switch_timer_interval,
-				unsigned int read_timer_interval)
+				unsigned int read_timer_interval,
+				unsigned int read_timer_max_interval,
+				enum lttng_kernel_numa_policy numa_policy,
+				int numa_node, uint32_t flags,
+				const struct cpumask *cpu_mask)
 {
 	struct channel *chan;
 
+	/* Single global buffer: keep the default placement. */
 	chan = channel_create(&client_config, name,
 			      lttng_chan->session->metadata_cache, buf_addr,
 			      subbuf_size, num_subbuf, switch_timer_interval,
-			      read_timer_interval);
+			      read_timer_interval, 0, RING_BUFFER_NUMA_LOCAL, -1, 0,
+			      NULL);
 	if (chan) {
 		/*
 		 * Ensure this module is not unloaded before we finish
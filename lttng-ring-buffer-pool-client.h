@@ -0,0 +1,380 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-ring-buffer-pool-client.h
+ *
+ * LTTng lib ring buffer pool client template.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/types.h>
+#include <wrapper/vmalloc.h>	/* for wrapper_vmalloc_sync_all() */
+#include <lttng-events.h>
+#include <lttng-tracer.h>
+
+/*
+ * The pool buffers of a channel hold whole packets copied from its
+ * per-cpu staging buffers, one packet per sub-buffer, as a single record
+ * without header. The pool client writes no packet header of its own:
+ * the packet descriptors of the pool streams are read from the header
+ * of the copied packet by the client of the staging channel, which is
+ * the private data of the pool channel.
+ */
+
+static struct lttng_transport lttng_relay_transport;
+
+static const struct lib_ring_buffer_config client_config;
+
+static inline
+u64 lib_ring_buffer_clock_read(struct channel *chan)
+{
+	return 0;
+}
+
+static inline
+size_t record_header_size(const struct lib_ring_buffer_config *config,
+				 struct channel *chan, size_t offset,
+				 size_t *pre_header_padding,
+				 struct lib_ring_buffer_ctx *ctx,
+				 void *client_ctx)
+{
+	return 0;
+}
+
+#include <wrapper/ringbuffer/api.h>
+
+static u64 client_ring_buffer_clock_read(struct channel *chan)
+{
+	return 0;
+}
+
+static
+size_t client_record_header_size(const struct lib_ring_buffer_config *config,
+				 struct channel *chan, size_t offset,
+				 size_t *pre_header_padding,
+				 struct lib_ring_buffer_ctx *ctx,
+				 void *client_ctx)
+{
+	return 0;
+}
+
+/* The copied packets carry their own header. */
+static size_t client_packet_header_size(void)
+{
+	return 0;
+}
+
+static void client_buffer_begin(struct lib_ring_buffer *buf, u64 tsc,
+				unsigned int subbuf_idx)
+{
+}
+
+static void client_buffer_end(struct lib_ring_buffer *buf, u64 tsc,
+			      unsigned int subbuf_idx, unsigned long data_size)
+{
+}
+
+static int client_buffer_create(struct lib_ring_buffer *buf, void *priv,
+				int cpu, const char *name)
+{
+	return 0;
+}
+
+static void client_buffer_finalize(struct lib_ring_buffer *buf, void *priv, int cpu)
+{
+}
+
+/* Client of the staging channel, which describes the copied packets. */
+static
+const struct lttng_channel_ops *client_staging_ops(struct lib_ring_buffer *buf,
+		const struct lib_ring_buffer_config **config)
+{
+	struct lttng_channel *lttng_chan = channel_get_private(buf->backend.chan);
+
+	*config = &lttng_chan->chan->backend.config;
+	return lttng_chan->ops;
+}
+
+static int client_timestamp_begin(const struct lib_ring_buffer_config *config,
+		struct lib_ring_buffer *buf, uint64_t *timestamp_begin)
+{
+	const struct lttng_channel_ops *ops = client_staging_ops(buf, &config);
+
+	return ops->timestamp_begin(config, buf, timestamp_begin);
+}
+
+static int client_timestamp_end(const struct lib_ring_buffer_config *config,
+			struct lib_ring_buffer *buf,
+			uint64_t *timestamp_end)
+{
+	const struct lttng_channel_ops *ops = client_staging_ops(buf, &config);
+
+	return ops->timestamp_end(config, buf, timestamp_end);
+}
+
+static int client_events_discarded(const struct lib_ring_buffer_config *config,
+			struct lib_ring_buffer *buf,
+			uint64_t *events_discarded)
+{
+	const struct lttng_channel_ops *ops = client_staging_ops(buf, &config);
+
+	return ops->events_discarded(config, buf, events_discarded);
+}
+
+static int client_current_timestamp(const struct lib_ring_buffer_config *config,
+		struct lib_ring_buffer *buf,
+		uint64_t *ts)
+{
+	const struct lttng_channel_ops *ops = client_staging_ops(buf, &config);
+
+	return ops->current_timestamp(config, buf, ts);
+}
+
+static int client_content_size(const struct lib_ring_buffer_config *config,
+			struct lib_ring_buffer *buf,
+			uint64_t *content_size)
+{
+	const struct lttng_channel_ops *ops = client_staging_ops(buf, &config);
+
+	return ops->content_size(config, buf, content_size);
+}
+
+static int client_packet_size(const struct lib_ring_buffer_config *config,
+			struct lib_ring_buffer *buf,
+			uint64_t *packet_size)
+{
+	const struct lttng_channel_ops *ops = client_staging_ops(buf, &config);
+
+	return ops->packet_size(config, buf, packet_size);
+}
+
+static int client_stream_id(const struct lib_ring_buffer_config *config,
+			struct lib_ring_buffer *buf,
+			uint64_t *stream_id)
+{
+	const struct lttng_channel_ops *ops = client_staging_ops(buf, &config);
+
+	return ops->stream_id(config, buf, stream_id);
+}
+
+static int client_sequence_number(const struct lib_ring_buffer_config *config,
+			struct lib_ring_buffer *buf,
+			uint64_t *seq)
+{
+	const struct lttng_channel_ops *ops = client_staging_ops(buf, &config);
+
+	return ops->sequence_number(config, buf, seq);
+}
+
+/* The cpu of the staging buffer the packet was recorded in. */
+static
+int client_instance_id(const struct lib_ring_buffer_config *config,
+		struct lib_ring_buffer *buf,
+		uint64_t *id)
+{
+	const struct lttng_channel_ops *ops = client_staging_ops(buf, &config);
+
+	return ops->instance_id(config, buf, id);
+}
+
+static const struct lib_ring_buffer_config client_config = {
+	.cb.ring_buffer_clock_read = client_ring_buffer_clock_read,
+	.cb.record_header_size = client_record_header_size,
+	.cb.subbuffer_header_size = client_packet_header_size,
+	.cb.buffer_begin = client_buffer_begin,
+	.cb.buffer_end = client_buffer_end,
+	.cb.buffer_create = client_buffer_create,
+	.cb.buffer_finalize = client_buffer_finalize,
+
+	.tsc_bits = 0,
+	.alloc = RING_BUFFER_ALLOC_GLOBAL,
+	.sync = RING_BUFFER_SYNC_GLOBAL,
+	.mode = RING_BUFFER_MODE_TEMPLATE,
+	.backend = RING_BUFFER_PAGE,
+	.output = RING_BUFFER_OUTPUT_TEMPLATE,
+	.oops = RING_BUFFER_OOPS_CONSISTENCY,
+	.ipi = RING_BUFFER_IPI_BARRIER,
+	.wakeup = RING_BUFFER_WAKEUP_BY_TIMER,
+};
+
+static
+void release_priv_ops(void *priv_ops)
+{
+	module_put(THIS_MODULE);
+}
+
+static
+void lttng_channel_destroy(struct channel *chan)
+{
+	channel_destroy(chan);
+}
+
+/* The pool buffer of a memory node, placed on that node. */
+static
+struct channel *_channel_create(const char *name,
+				struct lttng_channel *lttng_chan, void *buf_addr,
+				size_t subbuf_size, size_t num_subbuf,
+				unsigned int switch_timer_interval,
+				unsigned int read_timer_interval,
+				unsigned int read_timer_max_interval,
+				enum lttng_kernel_numa_policy numa_policy,
+				int numa_node, uint32_t flags,
+				const struct cpumask *cpu_mask)
+{
+	struct channel *chan;
+
+	if (numa_policy != LTTNG_KERNEL_NUMA_NODE)
+		return NULL;
+	chan = channel_create(&client_config, name, lttng_chan, buf_addr,
+			      subbuf_size, num_subbuf, 0,
+			      read_timer_interval, 0, RING_BUFFER_NUMA_NODE,
+			      numa_node, 0, NULL);
+	if (chan) {
+		/*
+		 * Ensure this module is not unloaded before we finish
+		 * using lttng_relay_transport.ops.
+		 */
+		if (!try_module_get(THIS_MODULE)) {
+			printk(KERN_WARNING "LTT : Can't lock transport module.\n");
+			goto error;
+		}
+		chan->backend.priv_ops = &lttng_relay_transport.ops;
+		chan->backend.release_priv_ops = release_priv_ops;
+	}
+	return chan;
+
+error:
+	lttng_channel_destroy(chan);
+	return NULL;
+}
+
+static
+struct lib_ring_buffer *lttng_buffer_read_open(struct channel *chan)
+{
+	struct lib_ring_buffer *buf;
+
+	buf = channel_get_ring_buffer(&client_config, chan, 0);
+	if (!lib_ring_buffer_open_read(buf))
+		return buf;
+	return NULL;
+}
+
+static
+int lttng_buffer_has_read_closed_stream(struct channel *chan)
+{
+	struct lib_ring_buffer *buf;
+
+	buf = channel_get_ring_buffer(&client_config, chan, 0);
+	return !atomic_long_read(&buf->active_readers);
+}
+
+static
+void lttng_buffer_read_close(struct lib_ring_buffer *buf)
+{
+	lib_ring_buffer_release_read(buf);
+}
+
+static
+int lttng_event_reserve(struct lib_ring_buffer_ctx *ctx, uint32_t event_id)
+{
+	int ret;
+
+	ret = lib_ring_buffer_reserve(&client_config, ctx, NULL);
+	if (ret)
+		return ret;
+	lib_ring_buffer_backend_get_pages(&client_config, ctx,
+			&ctx->backend_pages);
+	return 0;
+}
+
+/* Commit the copied packet, and end its sub-buffer with it. */
+static
+void lttng_event_commit(struct lib_ring_buffer_ctx *ctx)
+{
+	lib_ring_buffer_commit(&client_config, ctx);
+	lib_ring_buffer_switch_slow(ctx->buf, SWITCH_ACTIVE);
+}
+
+static
+void lttng_event_write(struct lib_ring_buffer_ctx *ctx, const void *src,
+		     size_t len)
+{
+	lib_ring_buffer_write(&client_config, ctx, src, len);
+}
+
+static
+void lttng_event_memset(struct lib_ring_buffer_ctx *ctx,
+		int c, size_t len)
+{
+	lib_ring_buffer_memset(&client_config, ctx, c, len);
+}
+
+static
+int lttng_is_finalized(struct channel *chan)
+{
+	return lib_ring_buffer_channel_is_finalized(chan);
+}
+
+static
+int lttng_is_disabled(struct channel *chan)
+{
+	return lib_ring_buffer_channel_is_disabled(chan);
+}
+
+static struct lttng_transport lttng_relay_transport = {
+	.name = "relay-" RING_BUFFER_MODE_TEMPLATE_STRING,
+	.owner = THIS_MODULE,
+	.ops = {
+		.channel_create = _channel_create,
+		.channel_destroy = lttng_channel_destroy,
+		.buffer_read_open = lttng_buffer_read_open,
+		.buffer_has_read_closed_stream =
+			lttng_buffer_has_read_closed_stream,
+		.buffer_read_close = lttng_buffer_read_close,
+		.event_reserve = lttng_event_reserve,
+		.event_commit = lttng_event_commit,
+		.event_memset = lttng_event_memset,
+		.event_write = lttng_event_write,
+		.is_finalized = lttng_is_finalized,
+		.is_disabled = lttng_is_disabled,
+		.timestamp_begin = client_timestamp_begin,
+		.timestamp_end = client_timestamp_end,
+		.events_discarded = client_events_discarded,
+		.content_size = client_content_size,
+		.packet_size = client_packet_size,
+		.stream_id = client_stream_id,
+		.current_timestamp = client_current_timestamp,
+		.sequence_number = client_sequence_number,
+		.instance_id = client_instance_id,
+	},
+};
+
+static int __init lttng_ring_buffer_client_init(void)
+{
+	/*
+	 * This vmalloc sync all also takes care of the lib ring buffer
+	 * vmalloc'd module pages when it is built as a module into LTTng.
+	 */
+	wrapper_vmalloc_sync_all();
+	lttng_transport_register(&lttng_relay_transport);
+	return 0;
+}
+
+module_init(lttng_ring_buffer_client_init);
+
+static void __exit lttng_ring_buffer_client_exit(void)
+{
+	lttng_transport_unregister(&lttng_relay_transport);
+}
+
+module_exit(lttng_ring_buffer_client_exit);
+
+MODULE_LICENSE("GPL and additional rights");
+MODULE_AUTHOR("agent <agent@local>");
+MODULE_DESCRIPTION("LTTng ring buffer " RING_BUFFER_MODE_TEMPLATE_STRING
+		   " client");
+MODULE_VERSION(__stringify(LTTNG_MODULES_MAJOR_VERSION) "."
+	__stringify(LTTNG_MODULES_MINOR_VERSION) "."
+	__stringify(LTTNG_MODULES_PATCHLEVEL_VERSION)
+	LTTNG_MODULES_EXTRAVERSION);
@@ -0,0 +1,335 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-snapshot-area.c
+ *
+ * LTTng preallocated snapshot copy-out area of a channel.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/file.h>
+#include <linux/anon_inodes.h>
+
+#include <wrapper/ringbuffer/backend.h>
+#include <wrapper/ringbuffer/frontend.h>
+#include <wrapper/file.h>
+#include <lttng-abi.h>
+#include <lttng-events.h>
+
+/*
+ * A snapshot area holds one slot per stream, large enough for all the
+ * sub-buffers of the stream. LTTNG_RING_BUFFER_SNAPSHOT_COPY, issued by
+ * the reader of a stream, takes a snapshot of the stream and copies its
+ * completed sub-buffers into the stream slot, oldest first, one every
+ * subbuf_size bytes. In overwrite mode, each sub-buffer is first swapped
+ * with the reader sub-buffer, so writers cannot overwrite it while it is
+ * copied. The whole snapshot is taken at memory copy speed, after which
+ * the consumer drains the slot through a read-only mapping of the area
+ * file descriptor, while writers keep recording.
+ *
+ * The slot of a stream is mapped at offset instance_id * slot_len. The
+ * area is allocated up front for all possible cpus, and is freed with
+ * the channel, on which the area file holds a reference.
+ *
+ * Snapshots, copied or read in place, can be restricted to a range of
+ * time and to a set of cpus, so that their cost follows the amount of
+ * data requested rather than the channel size.
+ */
+
+struct lttng_snapshot_area {
+	size_t slot_len;		/* Page aligned */
+	unsigned int nr_slots;
+	void **slots;			/* By instance id, vmalloc_user */
+};
+
+static
+void lttng_snapshot_area_free(struct lttng_snapshot_area *area)
+{
+	unsigned int i;
+
+	for (i = 0; i < area->nr_slots; i++)
+		vfree(area->slots[i]);
+	kfree(area->slots);
+	kfree(area);
+}
+
+static
+struct lttng_snapshot_area *lttng_snapshot_area_alloc(struct lttng_channel *chan)
+{
+	struct channel *rb_chan = chan->chan;
+	const struct lib_ring_buffer_config *config = &rb_chan->backend.config;
+	struct lttng_snapshot_area *area;
+	unsigned int i;
+
+	area = kzalloc(sizeof(*area), GFP_KERNEL);
+	if (!area)
+		return NULL;
+	area->slot_len = PAGE_ALIGN(rb_chan->backend.num_subbuf
+			* rb_chan->backend.subbuf_size);
+	area->nr_slots = config->alloc == RING_BUFFER_ALLOC_GLOBAL ?
+			1 : nr_cpu_ids;
+	area->slots = kcalloc(area->nr_slots, sizeof(*area->slots),
+			GFP_KERNEL);
+	if (!area->slots)
+		goto error;
+	for (i = 0; i < area->nr_slots; i++) {
+		if (config->alloc == RING_BUFFER_ALLOC_PER_CPU
+				&& !cpu_possible(i))
+			continue;
+		area->slots[i] = vmalloc_user(area->slot_len);
+		if (!area->slots[i])
+			goto error;
+	}
+	return area;
+
+error:
+	lttng_snapshot_area_free(area);
+	return NULL;
+}
+
+/*
+ * Set the snapshot range of a channel. The cpu mask is allocated the
+ * first time it is set, and then updated in place: readers see either
+ * cpu set for each cpu.
+ */
+int lttng_channel_set_snapshot_range(struct lttng_channel *chan,
+		uint64_t begin, const struct cpumask *cpus)
+{
+	struct cpumask *snapshot_cpus;
+	int ret = 0;
+
+	if (chan->channel_type == METADATA_CHANNEL)
+		return -EPERM;
+
+	lttng_lock_session(chan->session);
+	snapshot_cpus = chan->snapshot_cpus;
+	if (cpus && !snapshot_cpus) {
+		snapshot_cpus = kzalloc(cpumask_size(), GFP_KERNEL);
+		if (!snapshot_cpus) {
+			ret = -ENOMEM;
+			goto unlock;
+		}
+		cpumask_copy(snapshot_cpus, cpus);
+		/* Mask initialized before being seen by the stream readers. */
+		smp_wmb();
+		WRITE_ONCE(chan->snapshot_cpus, snapshot_cpus);
+	} else if (cpus) {
+		cpumask_copy(snapshot_cpus, cpus);
+	} else if (snapshot_cpus) {
+		cpumask_setall(snapshot_cpus);
+	}
+	WRITE_ONCE(chan->snapshot_begin, begin);
+unlock:
+	lttng_unlock_session(chan->session);
+	return ret;
+}
+
+/*
+ * Apply the snapshot range of the channel to the snapshot of a stream,
+ * from "*consumed" to "produced". Fails with -ENODATA for the streams of
+ * the cpus outside of the range, and moves "*consumed" to the first
+ * sub-buffer ending at or after the beginning of the range. Sub-buffers
+ * being in time order, it is found by bisection, reading the header of
+ * about log2(num_subbuf) sub-buffers, the ones overwritten meanwhile
+ * being the oldest. Called by the stream reader, not holding a
+ * sub-buffer.
+ */
+int lttng_stream_snapshot_range(struct lib_ring_buffer *buf,
+		unsigned long *consumed, unsigned long produced)
+{
+	struct channel *chan = buf->backend.chan;
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+	const struct lttng_channel_ops *ops = chan->backend.priv_ops;
+	struct lttng_channel *lttng_chan = channel_get_private(chan);
+	const struct cpumask *cpus = READ_ONCE(lttng_chan->snapshot_cpus);
+	uint64_t begin = READ_ONCE(lttng_chan->snapshot_begin);
+	unsigned int order = chan->backend.subbuf_size_order;
+	unsigned long lo, hi;
+
+	if (cpus && config->alloc == RING_BUFFER_ALLOC_PER_CPU
+			&& !cpumask_test_cpu(buf->backend.cpu, cpus))
+		return -ENODATA;
+	if (!begin)
+		return 0;
+	lo = 0;
+	hi = (produced - *consumed) >> order;
+	while (lo < hi) {
+		unsigned long mid = lo + ((hi - lo) >> 1);
+		bool before = true;
+		uint64_t ts;
+
+		if (!lib_ring_buffer_get_subbuf(buf, *consumed + (mid << order))) {
+			before = ops->timestamp_end(config, buf, &ts) >= 0
+				&& ts < begin;
+			lib_ring_buffer_put_subbuf(buf);
+		}
+		if (before)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*consumed += lo << order;
+	return 0;
+}
+
+/*
+ * Copy the completed sub-buffers of a stream into its slot. Called by
+ * the stream reader.
+ */
+int lttng_stream_snapshot_copy(struct lib_ring_buffer *buf,
+		struct lttng_kernel_snapshot_copy *copy)
+{
+	struct channel *chan = buf->backend.chan;
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+	struct lttng_channel *lttng_chan = channel_get_private(chan);
+	struct lttng_snapshot_area *area = READ_ONCE(lttng_chan->snapshot_area);
+	unsigned long consumed, produced, pos;
+	unsigned int slot;
+	char *dest;
+	int ret;
+
+	if (!area)
+		return -ENOENT;
+	if (buf->get_subbuf)
+		return -EBUSY;
+	/* The channel was resized after the area was created. */
+	if (chan->backend.num_subbuf * chan->backend.subbuf_size
+			> area->slot_len)
+		return -ENOSPC;
+	slot = config->alloc == RING_BUFFER_ALLOC_GLOBAL ? 0 : buf->backend.cpu;
+	dest = area->slots[slot];
+	memset(copy, 0, sizeof(*copy));
+	copy->offset = (uint64_t) slot * area->slot_len;
+	copy->subbuf_size = chan->backend.subbuf_size;
+
+	ret = lib_ring_buffer_snapshot(buf, &consumed, &produced);
+	if (ret)
+		return ret;
+	ret = lttng_stream_snapshot_range(buf, &consumed, produced);
+	if (ret)
+		return ret;
+	for (pos = consumed; (long) (produced - pos) > 0
+			&& copy->nr_subbuf < chan->backend.num_subbuf;
+			pos += chan->backend.subbuf_size) {
+		ret = lib_ring_buffer_get_subbuf(buf, pos);
+		if (ret) {
+			/* Overwritten since the snapshot. */
+			copy->nr_lost++;
+			continue;
+		}
+		lib_ring_buffer_read(&buf->backend, 0,
+				dest + copy->nr_subbuf * chan->backend.subbuf_size,
+				lib_ring_buffer_get_read_data_size(config, buf));
+		lib_ring_buffer_put_subbuf(buf);
+		copy->nr_subbuf++;
+	}
+	return 0;
+}
+
+static
+int lttng_snapshot_area_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct lttng_channel *chan = file->private_data;
+	struct lttng_snapshot_area *area = chan->snapshot_area;
+	unsigned long len = vma->vm_end - vma->vm_start;
+	unsigned long slot_pages = area->slot_len >> PAGE_SHIFT;
+	unsigned long slot;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	slot = vma->vm_pgoff / slot_pages;
+	if (vma->vm_pgoff % slot_pages || slot >= area->nr_slots
+			|| !area->slots[slot] || len > area->slot_len)
+		return -EINVAL;
+	vma->vm_flags &= ~VM_MAYWRITE;
+	return remap_vmalloc_range(vma, area->slots[slot], 0);
+}
+
+static
+int lttng_snapshot_area_release(struct inode *inode, struct file *file)
+{
+	struct lttng_channel *chan = file->private_data;
+
+	fput(chan->file);
+	return 0;
+}
+
+static const struct file_operations lttng_snapshot_area_fops = {
+	.owner = THIS_MODULE,
+	.mmap = lttng_snapshot_area_mmap,
+	.release = lttng_snapshot_area_release,
+};
+
+/*
+ * Allocate the snapshot area of a channel, and return a file descriptor
+ * to map it.
+ */
+int lttng_channel_snapshot_area_create(struct lttng_channel *chan)
+{
+	struct lttng_snapshot_area *area;
+	struct file *area_file;
+	int file_fd, ret;
+
+	if (chan->channel_type == METADATA_CHANNEL)
+		return -EPERM;
+
+	lttng_lock_session(chan->session);
+	if (chan->snapshot_area) {
+		ret = -EEXIST;
+		goto unlock;
+	}
+	area = lttng_snapshot_area_alloc(chan);
+	if (!area) {
+		ret = -ENOMEM;
+		goto unlock;
+	}
+	file_fd = lttng_get_unused_fd();
+	if (file_fd < 0) {
+		ret = file_fd;
+		goto fd_error;
+	}
+	/* The area file holds a reference on the channel file. */
+	if (!atomic_long_add_unless(&chan->file->f_count, 1, LONG_MAX)) {
+		ret = -EOVERFLOW;
+		goto refcount_error;
+	}
+	area_file = anon_inode_getfile("[lttng_snapshot_area]",
+			&lttng_snapshot_area_fops, chan, O_RDONLY);
+	if (IS_ERR(area_file)) {
+		ret = PTR_ERR(area_file);
+		goto file_error;
+	}
+	/* Area initialized before being seen by the stream readers. */
+	smp_wmb();
+	WRITE_ONCE(chan->snapshot_area, area);
+	fd_install(file_fd, area_file);
+	lttng_unlock_session(chan->session);
+	return file_fd;
+
+file_error:
+	atomic_long_dec(&chan->file->f_count);
+refcount_error:
+	put_unused_fd(file_fd);
+fd_error:
+	lttng_snapshot_area_free(area);
+unlock:
+	lttng_unlock_session(chan->session);
+	return ret;
+}
+
+/*
+ * Called at channel destruction, when no stream can be read anymore.
+ */
+void lttng_channel_snapshot_area_destroy(struct lttng_channel *chan)
+{
+	kfree(chan->snapshot_cpus);
+	chan->snapshot_cpus = NULL;
+	if (!chan->snapshot_area)
+		return;
+	lttng_snapshot_area_free(chan->snapshot_area);
+	chan->snapshot_area = NULL;
+}
@@ -31,8 +31,17 @@
 #include <linux/fdtable.h>
 #include <linux/swap.h>
 #include <linux/wait.h>
+#include <linux/workqueue.h>
 #include <linux/mutex.h>
 #include <linux/device.h>
+#include <linux/hash.h>
+#include <linux/binfmts.h>
+#include <linux/spinlock.h>
+#include <linux/path.h>
+#include <linux/dcache.h>
+#include <linux/ktime.h>
+#include <linux/moduleparam.h>
+#include <asm/syscall.h>
 
 #include <lttng-events.h>
 #include <lttng-tracer.h>
@@ -43,6 +52,8 @@
 #include <wrapper/genhd.h>
 #include <wrapper/file.h>
 #include <wrapper/time.h>
+#include <wrapper/vmalloc.h>
+#include <wrapper/list.h>
 
 #ifdef CONFIG_LTTNG_HAS_LIST_IRQ
 #include <linux/irq.h>
@@ -61,24 +72,70 @@ DEFINE_TRACE(lttng_statedump_interrupt);
 DEFINE_TRACE(lttng_statedump_file_descriptor);
 DEFINE_TRACE(lttng_statedump_start);
 DEFINE_TRACE(lttng_statedump_process_state);
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,8,0))
+DEFINE_TRACE(lttng_statedump_pid_ns);
+#endif
 DEFINE_TRACE(lttng_statedump_network_interface);
 #ifdef LTTNG_HAVE_STATEDUMP_CPU_TOPOLOGY
 DEFINE_TRACE(lttng_statedump_cpu_topology);
 #endif
 
+struct lttng_shadow_scratch;
+struct lttng_path_cache;
+
 struct lttng_fd_ctx {
 	char *page;
 	struct lttng_session *session;
 	struct task_struct *p;
 	struct files_struct *files;
+	struct lttng_shadow_scratch *scratch;
+	struct lttng_path_cache *paths;
+};
+
+/*
+ * Process states and file descriptors are dumped by one work item per
+ * online CPU. Each work item handles the processes of one shard, so
+ * that the events are written into the local buffer of each CPU rather
+ * than flooding the buffer of the CPU running the statedump. All
+ * threads of a process belong to the same shard, which keeps their
+ * process state and file descriptor events ordered. Running a work
+ * item on each CPU also guarantees that each CPU has been in a state
+ * where it was in syscall mode (i.e. not in a trap, an IRQ or a soft
+ * IRQ).
+ */
+struct lttng_statedump_cpu_work {
+	struct delayed_work work;
+	unsigned int shard;
 };
 
 /*
  * Protected by the trace lock.
  */
-static struct delayed_work cpu_work[NR_CPUS];
+static struct lttng_statedump_cpu_work cpu_work[NR_CPUS];
 static DECLARE_WAIT_QUEUE_HEAD(statedump_wq);
 static atomic_t kernel_threads_to_run;
+static struct lttng_session *statedump_session;
+static unsigned int statedump_nr_shards;
+static int statedump_error;
+static atomic64_t statedump_work_ns[2];	/* Process and fd phases */
+static struct lttng_statedump_stats statedump_stats;
+
+/*
+ * The process walks of the statedump leave their RCU read-side critical
+ * section every statedump_chunk_us to let other tasks run. The walk
+ * resumes after the last process dumped, which is pinned meanwhile. If
+ * that process was released, the walk resumes after the processes
+ * started before it: the task list is ordered by creation, and the
+ * processes created since the statedump started are traced by their
+ * fork.
+ */
+static unsigned int statedump_chunk_us = 1000;
+module_param(statedump_chunk_us, uint, 0644);
+MODULE_PARM_DESC(statedump_chunk_us, "Longest run of the statedump process walks without rescheduling, in usecs (0: no limit)");
+
+struct lttng_statedump_cursor {
+	s64 chunk_end;			/* ktime, in ns */
+};
 
 enum lttng_thread_type {
 	LTTNG_USER_THREAD = 0,
@@ -204,11 +261,686 @@ int lttng_enumerate_network_ip_interface(struct lttng_session *session)
 }
 #endif /* CONFIG_INET */
 
+/*
+ * Whether a process belongs to the shard and, if the session restricts
+ * its statedump to them, to the processes of its pid tracker. The
+ * tracker cannot change during the statedump: both are protected by
+ * the session lock.
+ */
+static
+bool lttng_statedump_selected(struct lttng_session *session,
+		struct task_struct *p, unsigned int shard)
+{
+	struct lttng_pid_tracker *lpf = session->pid_tracker;
+
+	if (task_tgid_nr(p) % statedump_nr_shards != shard)
+		return false;
+	if (!(session->statedump_mask & LTTNG_KERNEL_STATEDUMP_TRACKED_PIDS)
+	    || !lpf)
+		return true;
+	return lttng_pid_tracker_lookup(lpf, task_tgid_nr(p));
+}
+
+/*
+ * Incremental statedump.
+ *
+ * Sessions in incremental mode keep a shadow of the file descriptors
+ * dumped for each process. A process is considered unchanged since it
+ * was dumped when it did not fork, exec, or issue a system call which
+ * can change its file descriptor table afterwards. Those are tracked
+ * by probes on sched_process_fork, sched_process_exec and sys_exit,
+ * which store a generation number into a table indexed by tgid hash.
+ * Hash collisions only cause extra walks. The file descriptors of
+ * unchanged processes are replayed from the shadow, others are walked
+ * and their shadow updated. Process states are always dumped from the
+ * task list, since scheduling state changes continuously and is cheap
+ * to dump.
+ *
+ * Processes sharing a file descriptor table without being threads of
+ * the same process (clone with CLONE_FILES but not CLONE_THREAD) are
+ * only tracked through the process issuing the system call.
+ *
+ * Shadows are protected by the trace lock, except for their hash
+ * table, which is filled concurrently by the per-CPU work items.
+ */
+
+#define LTTNG_SHADOW_HASH_BITS		12
+#define LTTNG_SHADOW_HASH_SIZE		(1U << LTTNG_SHADOW_HASH_BITS)
+#define LTTNG_FD_DIRTY_BITS		14
+#define LTTNG_SHADOW_SCRATCH_LEN	(1UL << 20)
+
+struct lttng_shadow_fd {
+	int fd;
+	unsigned int flags;
+	fmode_t fmode;
+	unsigned int name_len;		/* Including final \0 */
+	char name[];
+};
+
+struct lttng_shadow_proc {
+	struct hlist_node hlist;
+	pid_t tgid;
+	u64 gen;			/* Statedump generation of the walk */
+	unsigned long dump_seq;		/* Last statedump seeing the process */
+	size_t len;			/* Length of data */
+	char data[];			/* struct lttng_shadow_fd records */
+};
+
+struct lttng_statedump_shadow {
+	spinlock_t lock;		/* Protects proc_hash */
+	u64 gen;			/* Generation of the current statedump */
+	unsigned long dump_seq;
+	struct hlist_head proc_hash[LTTNG_SHADOW_HASH_SIZE];
+};
+
+struct lttng_shadow_scratch {
+	char *buf;
+	size_t len;
+	bool overflow;
+};
+
+static atomic64_t fd_gen;
+static u64 fd_dirty_gen[1U << LTTNG_FD_DIRTY_BITS];
+static int shadow_refcount;
+
+static
+void lttng_fd_mark_dirty(pid_t tgid)
+{
+	/* Order the fd table update before reading the generation. */
+	smp_mb();
+	WRITE_ONCE(fd_dirty_gen[hash_32(tgid, LTTNG_FD_DIRTY_BITS)],
+		atomic64_read(&fd_gen));
+}
+
+static
+bool lttng_fd_is_dirty(pid_t tgid, u64 gen)
+{
+	return READ_ONCE(fd_dirty_gen[hash_32(tgid, LTTNG_FD_DIRTY_BITS)]) >= gen;
+}
+
+static
+void lttng_shadow_fork_probe(void *data, struct task_struct *parent,
+		struct task_struct *child)
+{
+	lttng_fd_mark_dirty(child->tgid);
+}
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,4,0))
+static
+void lttng_shadow_exec_probe(void *data, struct task_struct *p,
+		pid_t old_pid, struct linux_binprm *bprm)
+{
+	lttng_fd_mark_dirty(p->tgid);
+}
+#endif
+
+#ifdef CONFIG_HAVE_SYSCALL_TRACEPOINTS
+static
+bool lttng_syscall_changes_fds(long nr)
+{
+	switch (nr) {
+#ifdef __NR_open
+	case __NR_open:
+#endif
+#ifdef __NR_creat
+	case __NR_creat:
+#endif
+#ifdef __NR_openat
+	case __NR_openat:
+#endif
+#ifdef __NR_openat2
+	case __NR_openat2:
+#endif
+#ifdef __NR_open_by_handle_at
+	case __NR_open_by_handle_at:
+#endif
+#ifdef __NR_close
+	case __NR_close:
+#endif
+#ifdef __NR_close_range
+	case __NR_close_range:
+#endif
+#ifdef __NR_dup
+	case __NR_dup:
+#endif
+#ifdef __NR_dup2
+	case __NR_dup2:
+#endif
+#ifdef __NR_dup3
+	case __NR_dup3:
+#endif
+#ifdef __NR_fcntl
+	case __NR_fcntl:
+#endif
+#ifdef __NR_fcntl64
+	case __NR_fcntl64:
+#endif
+#ifdef __NR_socketcall
+	case __NR_socketcall:
+#endif
+#ifdef __NR_socket
+	case __NR_socket:
+#endif
+#ifdef __NR_socketpair
+	case __NR_socketpair:
+#endif
+#ifdef __NR_accept
+	case __NR_accept:
+#endif
+#ifdef __NR_accept4
+	case __NR_accept4:
+#endif
+#ifdef __NR_recvmsg
+	case __NR_recvmsg:	/* SCM_RIGHTS */
+#endif
+#ifdef __NR_recvmmsg
+	case __NR_recvmmsg:
+#endif
+#ifdef __NR_pipe
+	case __NR_pipe:
+#endif
+#ifdef __NR_pipe2
+	case __NR_pipe2:
+#endif
+#ifdef __NR_eventfd
+	case __NR_eventfd:
+#endif
+#ifdef __NR_eventfd2
+	case __NR_eventfd2:
+#endif
+#ifdef __NR_epoll_create
+	case __NR_epoll_create:
+#endif
+#ifdef __NR_epoll_create1
+	case __NR_epoll_create1:
+#endif
+#ifdef __NR_signalfd
+	case __NR_signalfd:
+#endif
+#ifdef __NR_signalfd4
+	case __NR_signalfd4:
+#endif
+#ifdef __NR_timerfd_create
+	case __NR_timerfd_create:
+#endif
+#ifdef __NR_inotify_init
+	case __NR_inotify_init:
+#endif
+#ifdef __NR_inotify_init1
+	case __NR_inotify_init1:
+#endif
+#ifdef __NR_fanotify_init
+	case __NR_fanotify_init:
+#endif
+#ifdef __NR_memfd_create
+	case __NR_memfd_create:
+#endif
+#ifdef __NR_perf_event_open
+	case __NR_perf_event_open:
+#endif
+#ifdef __NR_userfaultfd
+	case __NR_userfaultfd:
+#endif
+#ifdef __NR_bpf
+	case __NR_bpf:
+#endif
+#ifdef __NR_mq_open
+	case __NR_mq_open:
+#endif
+#ifdef __NR_pidfd_open
+	case __NR_pidfd_open:
+#endif
+#ifdef __NR_pidfd_getfd
+	case __NR_pidfd_getfd:
+#endif
+#ifdef __NR_io_uring_setup
+	case __NR_io_uring_setup:
+#endif
+#ifdef __NR_io_uring_enter
+	case __NR_io_uring_enter:
+#endif
+#ifdef __NR_fsopen
+	case __NR_fsopen:
+#endif
+#ifdef __NR_fspick
+	case __NR_fspick:
+#endif
+#ifdef __NR_fsmount
+	case __NR_fsmount:
+#endif
+#ifdef __NR_open_tree
+	case __NR_open_tree:
+#endif
+#ifdef __NR_unshare
+	case __NR_unshare:	/* CLONE_FILES */
+#endif
+		return true;
+	default:
+		return false;
+	}
+}
+
+#ifndef CONFIG_COMPAT
+# ifndef is_compat_task
+#  define is_compat_task()	(0)
+# endif
+#endif
+
+/* in_compat_syscall appears in kernel 4.6. */
+#ifndef in_compat_syscall
+ #define in_compat_syscall()	is_compat_task()
+#endif
+
+static
+void lttng_shadow_sys_exit_probe(void *data, struct pt_regs *regs, long ret)
+{
+	/* Compat system call numbers differ: consider them all. */
+	if (in_compat_syscall()
+			|| lttng_syscall_changes_fds(syscall_get_nr(current, regs)))
+		lttng_fd_mark_dirty(current->tgid);
+}
+
+static
+int lttng_shadow_register_sys_exit(void)
+{
+	return lttng_wrapper_tracepoint_probe_register("sys_exit",
+			(void *) lttng_shadow_sys_exit_probe, NULL);
+}
+
+static
+void lttng_shadow_unregister_sys_exit(void)
+{
+	WARN_ON_ONCE(lttng_wrapper_tracepoint_probe_unregister("sys_exit",
+			(void *) lttng_shadow_sys_exit_probe, NULL));
+}
+#else
+static
+int lttng_shadow_register_sys_exit(void)
+{
+	/* Cannot see file descriptor table changes. */
+	return -ENOSYS;
+}
+
+static
+void lttng_shadow_unregister_sys_exit(void)
+{
+}
+#endif /* CONFIG_HAVE_SYSCALL_TRACEPOINTS */
+
+static
+int lttng_shadow_probes_register(void)
+{
+	int ret;
+
+	ret = lttng_shadow_register_sys_exit();
+	if (ret)
+		goto sys_exit_error;
+	ret = lttng_wrapper_tracepoint_probe_register("sched_process_fork",
+			(void *) lttng_shadow_fork_probe, NULL);
+	if (ret)
+		goto fork_error;
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,4,0))
+	ret = lttng_wrapper_tracepoint_probe_register("sched_process_exec",
+			(void *) lttng_shadow_exec_probe, NULL);
+	if (ret)
+		goto exec_error;
+#endif
+	return 0;
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,4,0))
+exec_error:
+	WARN_ON_ONCE(lttng_wrapper_tracepoint_probe_unregister("sched_process_fork",
+			(void *) lttng_shadow_fork_probe, NULL));
+#endif
+fork_error:
+	lttng_shadow_unregister_sys_exit();
+sys_exit_error:
+	return ret;
+}
+
+static
+void lttng_shadow_probes_unregister(void)
+{
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,4,0))
+	WARN_ON_ONCE(lttng_wrapper_tracepoint_probe_unregister("sched_process_exec",
+			(void *) lttng_shadow_exec_probe, NULL));
+#endif
+	WARN_ON_ONCE(lttng_wrapper_tracepoint_probe_unregister("sched_process_fork",
+			(void *) lttng_shadow_fork_probe, NULL));
+	lttng_shadow_unregister_sys_exit();
+}
+
+/*
+ * Called with the trace lock held. A newly created shadow is empty: the
+ * first incremental statedump walks all processes.
+ */
+static
+int lttng_statedump_shadow_create(struct lttng_session *session)
+{
+	struct lttng_statedump_shadow *shadow;
+	int ret;
+
+	shadow = lttng_kvzalloc(sizeof(*shadow), GFP_KERNEL);
+	if (!shadow)
+		return -ENOMEM;
+	spin_lock_init(&shadow->lock);
+	if (!shadow_refcount++) {
+		ret = lttng_shadow_probes_register();
+		if (ret) {
+			shadow_refcount--;
+			lttng_kvfree(shadow);
+			return ret;
+		}
+	}
+	session->statedump_shadow = shadow;
+	return 0;
+}
+
+/*
+ * Called with the trace lock held.
+ */
+void lttng_statedump_shadow_destroy(struct lttng_session *session)
+{
+	struct lttng_statedump_shadow *shadow = session->statedump_shadow;
+	unsigned int i;
+
+	if (!shadow)
+		return;
+	session->statedump_shadow = NULL;
+	if (!--shadow_refcount) {
+		lttng_shadow_probes_unregister();
+		/* Wait for in-flight probes before a new shadow is created. */
+		tracepoint_synchronize_unregister();
+	}
+	for (i = 0; i < LTTNG_SHADOW_HASH_SIZE; i++) {
+		struct lttng_shadow_proc *e;
+		struct hlist_node *tmp;
+
+		lttng_hlist_for_each_entry_safe(e, tmp, &shadow->proc_hash[i],
+				hlist) {
+			hlist_del(&e->hlist);
+			kfree(e);
+		}
+	}
+	lttng_kvfree(shadow);
+}
+EXPORT_SYMBOL_GPL(lttng_statedump_shadow_destroy);
+
+static
+struct lttng_shadow_proc *lttng_shadow_lookup(struct lttng_statedump_shadow *shadow,
+		pid_t tgid)
+{
+	struct hlist_head *head;
+	struct lttng_shadow_proc *e;
+
+	head = &shadow->proc_hash[hash_32(tgid, LTTNG_SHADOW_HASH_BITS)];
+	spin_lock(&shadow->lock);
+	lttng_hlist_for_each_entry(e, head, hlist) {
+		if (e->tgid == tgid)
+			goto end;
+	}
+	e = NULL;
+end:
+	spin_unlock(&shadow->lock);
+	return e;
+}
+
+/*
+ * Replace the shadow of a process by the records collected in the
+ * scratch buffer. Called within RCU read-side critical section, and
+ * each process is only handled by the work item of its shard.
+ */
+static
+void lttng_shadow_update(struct lttng_statedump_shadow *shadow,
+		struct lttng_shadow_proc *old, pid_t tgid,
+		struct lttng_shadow_scratch *scratch)
+{
+	struct lttng_shadow_proc *e = NULL;
+
+	if (!scratch->overflow) {
+		e = kmalloc(sizeof(*e) + scratch->len,
+			GFP_ATOMIC | __GFP_NOWARN);
+		if (e) {
+			e->tgid = tgid;
+			e->gen = shadow->gen;
+			e->dump_seq = shadow->dump_seq;
+			e->len = scratch->len;
+			memcpy(e->data, scratch->buf, scratch->len);
+		}
+	}
+	spin_lock(&shadow->lock);
+	if (old)
+		hlist_del(&old->hlist);
+	/* Without shadow, the process is walked again next time. */
+	if (e)
+		hlist_add_head(&e->hlist,
+			&shadow->proc_hash[hash_32(tgid, LTTNG_SHADOW_HASH_BITS)]);
+	spin_unlock(&shadow->lock);
+	kfree(old);
+}
+
+static
+void lttng_shadow_record_fd(struct lttng_shadow_scratch *scratch,
+		int fd, const char *name, unsigned int flags, fmode_t fmode)
+{
+	struct lttng_shadow_fd *rec;
+	size_t name_len = strlen(name) + 1, len;
+
+	if (!scratch || scratch->overflow)
+		return;
+	len = ALIGN(sizeof(*rec) + name_len, __alignof__(*rec));
+	if (scratch->len + len > LTTNG_SHADOW_SCRATCH_LEN) {
+		scratch->overflow = true;
+		return;
+	}
+	rec = (struct lttng_shadow_fd *) (scratch->buf + scratch->len);
+	rec->fd = fd;
+	rec->flags = flags;
+	rec->fmode = fmode;
+	rec->name_len = name_len;
+	memcpy(rec->name, name, name_len);
+	scratch->len += len;
+}
+
+static
+void lttng_shadow_replay(struct lttng_session *session,
+		struct task_struct *p, struct lttng_shadow_proc *e)
+{
+	size_t offset = 0;
+
+	while (offset < e->len) {
+		struct lttng_shadow_fd *rec =
+			(struct lttng_shadow_fd *) (e->data + offset);
+
+		trace_lttng_statedump_file_descriptor(session, p, rec->fd,
+			rec->name, rec->flags, rec->fmode);
+		offset += ALIGN(sizeof(*rec) + rec->name_len,
+				__alignof__(*rec));
+	}
+}
+
+/*
+ * Drop the shadow of processes which were not seen by the last
+ * statedump. Called with the trace lock held, after all work items
+ * completed.
+ */
+static
+void lttng_shadow_sweep(struct lttng_statedump_shadow *shadow)
+{
+	unsigned int i;
+
+	for (i = 0; i < LTTNG_SHADOW_HASH_SIZE; i++) {
+		struct lttng_shadow_proc *e;
+		struct hlist_node *tmp;
+
+		lttng_hlist_for_each_entry_safe(e, tmp, &shadow->proc_hash[i],
+				hlist) {
+			if (e->dump_seq == shadow->dump_seq)
+				continue;
+			hlist_del(&e->hlist);
+			kfree(e);
+		}
+	}
+}
+
+/*
+ * Many processes have the same files open: each work item keeps the
+ * names it resolved with d_path(), keyed by path, for the duration of
+ * its walk of the file descriptors. Cached paths hold a reference, so
+ * their dentry and mount cannot be reused for another file meanwhile.
+ * Pseudo files named by d_dname (sockets, pipes, anonymous inodes) have
+ * names which are unique and cheap to build: they are not cached.
+ */
+#define LTTNG_PATH_CACHE_BITS		10
+#define LTTNG_PATH_CACHE_SIZE		(1U << LTTNG_PATH_CACHE_BITS)
+#define LTTNG_PATH_CACHE_MAX_ENTRIES	4096
+
+struct lttng_path_cache_entry {
+	struct hlist_node hlist;
+	struct path path;
+	char name[];
+};
+
+struct lttng_path_cache {
+	unsigned int nr_entries;
+	struct hlist_head hash[LTTNG_PATH_CACHE_SIZE];
+};
+
+static
+struct lttng_path_cache *lttng_path_cache_create(void)
+{
+	struct lttng_path_cache *cache;
+	unsigned int i;
+
+	cache = lttng_kvmalloc(sizeof(*cache), GFP_KERNEL);
+	if (!cache)
+		return NULL;
+	cache->nr_entries = 0;
+	for (i = 0; i < LTTNG_PATH_CACHE_SIZE; i++)
+		INIT_HLIST_HEAD(&cache->hash[i]);
+	return cache;
+}
+
+/*
+ * Called outside of RCU read-side critical section: releasing a path
+ * may sleep.
+ */
+static
+void lttng_path_cache_destroy(struct lttng_path_cache *cache)
+{
+	unsigned int i;
+
+	if (!cache)
+		return;
+	for (i = 0; i < LTTNG_PATH_CACHE_SIZE; i++) {
+		struct lttng_path_cache_entry *e;
+		struct hlist_node *tmp;
+
+		lttng_hlist_for_each_entry_safe(e, tmp, &cache->hash[i],
+				hlist) {
+			path_put(&e->path);
+			kfree(e);
+		}
+	}
+	lttng_kvfree(cache);
+}
+
+/*
+ * Return the name of a path, from the cache or resolved into page.
+ * Called within RCU read-side critical section, with the file table
+ * lock held.
+ */
+static
+const char *lttng_path_cache_lookup(struct lttng_path_cache *cache,
+		const struct path *path, char *page)
+{
+	const struct dentry *dentry = path->dentry;
+	struct lttng_path_cache_entry *e;
+	struct hlist_head *head;
+	const char *s;
+	size_t len;
+
+	if (!cache || (dentry->d_op && dentry->d_op->d_dname))
+		return d_path(path, page, PAGE_SIZE);
+	head = &cache->hash[hash_long((unsigned long) path->dentry
+			^ (unsigned long) path->mnt, LTTNG_PATH_CACHE_BITS)];
+	lttng_hlist_for_each_entry(e, head, hlist) {
+		if (e->path.dentry == path->dentry && e->path.mnt == path->mnt)
+			return e->name;
+	}
+	s = d_path(path, page, PAGE_SIZE);
+	if (IS_ERR(s) || cache->nr_entries >= LTTNG_PATH_CACHE_MAX_ENTRIES)
+		return s;
+	len = strlen(s) + 1;
+	e = kmalloc(sizeof(*e) + len, GFP_ATOMIC | __GFP_NOWARN);
+	if (!e)
+		return s;
+	e->path = *path;
+	path_get(&e->path);
+	memcpy(e->name, s, len);
+	hlist_add_head(&e->hlist, head);
+	cache->nr_entries++;
+	return e->name;
+}
+
+static
+u64 lttng_task_start_time(struct task_struct *p)
+{
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,17,0))
+	return p->start_time;
+#else
+	return timespec_to_ns(&p->start_time);
+#endif
+}
+
+static
+void lttng_statedump_cursor_init(struct lttng_statedump_cursor *cursor)
+{
+	cursor->chunk_end = ktime_to_ns(ktime_get())
+		+ (s64) READ_ONCE(statedump_chunk_us) * NSEC_PER_USEC;
+}
+
+/*
+ * Called within RCU read-side critical section, by for_each_process()
+ * walks, once done with process g. Reschedules if the chunk budget
+ * elapsed, and returns the process to continue the walk from.
+ */
+static
+struct task_struct *lttng_statedump_cursor_yield(
+		struct lttng_statedump_cursor *cursor, struct task_struct *g)
+{
+	struct task_struct *p, *prev = &init_task;
+	u64 start_time;
+
+	if (!READ_ONCE(statedump_chunk_us)
+	    || ktime_to_ns(ktime_get()) < cursor->chunk_end)
+		return g;
+	get_task_struct(g);
+	rcu_read_unlock();
+	cond_resched();
+	rcu_read_lock();
+	lttng_statedump_cursor_init(cursor);
+	/* Still on the task list: freed after a grace period only. */
+	if (pid_alive(g)) {
+		put_task_struct(g);
+		return g;
+	}
+	start_time = lttng_task_start_time(g);
+	put_task_struct(g);
+	for_each_process(p) {
+		if (lttng_task_start_time(p) > start_time)
+			break;
+		prev = p;
+	}
+	return prev;
+}
+
 static
 int lttng_dump_one_fd(const void *p, struct file *file, unsigned int fd)
 {
 	const struct lttng_fd_ctx *ctx = p;
-	const char *s = d_path(&file->f_path, ctx->page, PAGE_SIZE);
+	const char *s = lttng_path_cache_lookup(ctx->paths, &file->f_path,
+			ctx->page);
 	unsigned int flags = file->f_flags;
 	struct fdtable *fdt;
 
@@ -236,20 +968,31 @@ int lttng_dump_one_fd(const void *p, struct file *file, unsigned int fd)
 		spin_lock(&dentry->d_lock);
 		trace_lttng_statedump_file_descriptor(ctx->session, ctx->p, fd,
 			dentry->d_name.name, flags, file->f_mode);
+		lttng_shadow_record_fd(ctx->scratch, fd, dentry->d_name.name,
+			flags, file->f_mode);
 		spin_unlock(&dentry->d_lock);
 		goto end;
 	}
 	trace_lttng_statedump_file_descriptor(ctx->session, ctx->p, fd, s,
 		flags, file->f_mode);
+	lttng_shadow_record_fd(ctx->scratch, fd, s, flags, file->f_mode);
 end:
 	return 0;
 }
 
 static
 void lttng_enumerate_task_fd(struct lttng_session *session,
-		struct task_struct *p, char *tmp)
+		struct task_struct *p, char *tmp,
+		struct lttng_shadow_scratch *scratch,
+		struct lttng_path_cache *paths)
 {
-	struct lttng_fd_ctx ctx = { .page = tmp, .session = session, .p = p };
+	struct lttng_fd_ctx ctx = {
+		.page = tmp,
+		.session = session,
+		.p = p,
+		.scratch = scratch,
+		.paths = paths,
+	};
 	struct files_struct *files;
 
 	task_lock(p);
@@ -263,20 +1006,66 @@ end:
 }
 
 static
-int lttng_enumerate_file_descriptors(struct lttng_session *session)
+void lttng_enumerate_task_fd_incremental(struct lttng_session *session,
+		struct task_struct *p, char *tmp,
+		struct lttng_shadow_scratch *scratch,
+		struct lttng_path_cache *paths)
+{
+	struct lttng_statedump_shadow *shadow = session->statedump_shadow;
+	struct lttng_shadow_proc *e;
+
+	e = lttng_shadow_lookup(shadow, p->tgid);
+	if (e && !lttng_fd_is_dirty(p->tgid, e->gen)) {
+		lttng_shadow_replay(session, p, e);
+		e->dump_seq = shadow->dump_seq;
+		return;
+	}
+	scratch->len = 0;
+	scratch->overflow = false;
+	lttng_enumerate_task_fd(session, p, tmp, scratch, paths);
+	lttng_shadow_update(shadow, e, p->tgid, scratch);
+}
+
+static
+int lttng_enumerate_file_descriptors(struct lttng_session *session,
+		unsigned int shard)
 {
+	struct lttng_shadow_scratch scratch = { 0 };
+	struct lttng_statedump_cursor cursor;
+	struct lttng_path_cache *paths;
 	struct task_struct *p;
 	char *tmp;
 
 	tmp = (char *) __get_free_page(GFP_KERNEL);
 	if (!tmp)
 		return -ENOMEM;
+	if (session->statedump_shadow) {
+		scratch.buf = lttng_kvmalloc(LTTNG_SHADOW_SCRATCH_LEN,
+				GFP_KERNEL);
+		if (!scratch.buf) {
+			free_page((unsigned long) tmp);
+			return -ENOMEM;
+		}
+	}
+	/* Without cache, each path is resolved. */
+	paths = lttng_path_cache_create();
 
 	/* Enumerate active file descriptors */
+	lttng_statedump_cursor_init(&cursor);
 	rcu_read_lock();
-	for_each_process(p)
-		lttng_enumerate_task_fd(session, p, tmp);
+	for_each_process(p) {
+		if (!lttng_statedump_selected(session, p, shard))
+			continue;
+		if (scratch.buf)
+			lttng_enumerate_task_fd_incremental(session, p, tmp,
+					&scratch, paths);
+		else
+			lttng_enumerate_task_fd(session, p, tmp, NULL, paths);
+		p = lttng_statedump_cursor_yield(&cursor, p);
+	}
 	rcu_read_unlock();
+	lttng_path_cache_destroy(paths);
+	lttng_kvfree(scratch.buf);
 	free_page((unsigned long) tmp);
 	return 0;
 }
@@ -387,6 +1176,111 @@ int lttng_list_interrupts(struct lttng_session *session)
 }
 #endif
 
+/*
+ * Each pid namespace is described once per statedump, by an event
+ * giving its level and parent. A process state event is emitted for
+ * each pid namespace level of each thread by default. With
+ * statedump_ns_dedup, only the event of the active pid namespace of the
+ * thread is emitted: its vtid, vpid and vppid in the ancestor
+ * namespaces are not dumped, and its ns_inum references the namespace
+ * hierarchy. The namespaces dumped are tracked by inode number, shared
+ * by the work items of all shards.
+ */
+static int statedump_ns_dedup;
+module_param(statedump_ns_dedup, int, 0644);
+MODULE_PARM_DESC(statedump_ns_dedup, "Dump thread states in their active pid namespace only (0: disabled, 1: enabled)");
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,8,0))
+
+#define LTTNG_NS_SET_BITS	8
+#define LTTNG_NS_SET_SIZE	(1U << LTTNG_NS_SET_BITS)
+
+struct lttng_ns_set_entry {
+	struct hlist_node hlist;
+	unsigned int inum;
+};
+
+static DEFINE_SPINLOCK(statedump_ns_lock);
+/* Protected by statedump_ns_lock, emptied at the end of each statedump. */
+static struct hlist_head statedump_ns_set[LTTNG_NS_SET_SIZE];
+
+/*
+ * Returns whether the namespace was not dumped yet. Namespaces which
+ * cannot be tracked for lack of memory are dumped again.
+ */
+static
+bool lttng_statedump_ns_first(unsigned int inum)
+{
+	struct hlist_head *head = &statedump_ns_set[hash_32(inum,
+			LTTNG_NS_SET_BITS)];
+	struct lttng_ns_set_entry *e;
+
+	spin_lock(&statedump_ns_lock);
+	lttng_hlist_for_each_entry(e, head, hlist) {
+		if (e->inum == inum) {
+			spin_unlock(&statedump_ns_lock);
+			return false;
+		}
+	}
+	e = kmalloc(sizeof(*e), GFP_ATOMIC | __GFP_NOWARN);
+	if (e) {
+		e->inum = inum;
+		hlist_add_head(&e->hlist, head);
+	}
+	spin_unlock(&statedump_ns_lock);
+	return true;
+}
+
+/*
+ * Called with the trace lock held, after all work items completed.
+ */
+static
+void lttng_statedump_ns_clear(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < LTTNG_NS_SET_SIZE; i++) {
+		struct lttng_ns_set_entry *e;
+		struct hlist_node *tmp;
+
+		lttng_hlist_for_each_entry_safe(e, tmp, &statedump_ns_set[i],
+				hlist) {
+			hlist_del(&e->hlist);
+			kfree(e);
+		}
+	}
+}
+
+/*
+ * Describe a pid namespace and its ancestors, stopping at the first one
+ * already described.
+ */
+static
+void lttng_statedump_pid_ns(struct lttng_session *session,
+		struct pid_namespace *pid_ns)
+{
+	for (; pid_ns; pid_ns = pid_ns->parent) {
+		if (!lttng_statedump_ns_first(pid_ns->lttng_proc_inum))
+			break;
+		trace_lttng_statedump_pid_ns(session, pid_ns);
+	}
+}
+
+#else /* #if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,8,0)) */
+
+static
+void lttng_statedump_ns_clear(void)
+{
+}
+
+static
+void lttng_statedump_pid_ns(struct lttng_session *session,
+		struct pid_namespace *pid_ns)
+{
+}
+
+#endif /* #else #if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,8,0)) */
+
 /*
  * Called with task lock held.
  */
@@ -401,20 +1295,28 @@ void lttng_statedump_process_ns(struct lttng_session *session,
 	struct pid_namespace *pid_ns;
 
 	pid_ns = task_active_pid_ns(p);
+	lttng_statedump_pid_ns(session, pid_ns);
 	do {
 		trace_lttng_statedump_process_state(session,
 			p, type, mode, submode, status, pid_ns);
+		if (READ_ONCE(statedump_ns_dedup))
+			break;
 		pid_ns = pid_ns->parent;
 	} while (pid_ns);
 }
 
 static
-int lttng_enumerate_process_states(struct lttng_session *session)
+int lttng_enumerate_process_states(struct lttng_session *session,
+		unsigned int shard)
 {
+	struct lttng_statedump_cursor cursor;
 	struct task_struct *g, *p;
 
+	lttng_statedump_cursor_init(&cursor);
 	rcu_read_lock();
 	for_each_process(g) {
+		if (!lttng_statedump_selected(session, g, shard))
+			continue;
 		p = g;
 		do {
 			enum lttng_execution_mode mode =
@@ -461,6 +1363,7 @@ int lttng_enumerate_process_states(struct lttng_session *session)
 				p, type, mode, submode, status);
 			task_unlock(p);
 		} while_each_thread(g, p);
+		g = lttng_statedump_cursor_yield(&cursor, g);
 	}
 	rcu_read_unlock();
 
@@ -470,75 +1373,158 @@ int lttng_enumerate_process_states(struct lttng_session *session)
 static
 void lttng_statedump_work_func(struct work_struct *work)
 {
+	struct lttng_statedump_cpu_work *cw =
+		container_of(to_delayed_work(work),
+			struct lttng_statedump_cpu_work, work);
+	unsigned int mask = statedump_session->statedump_mask;
+	u64 start;
+	int ret = 0;
+
+	if (mask & LTTNG_KERNEL_STATEDUMP_PROCESS) {
+		start = ktime_get_ns();
+		ret = lttng_enumerate_process_states(statedump_session,
+				cw->shard);
+		atomic64_add(ktime_get_ns() - start,
+			&statedump_work_ns[LTTNG_STATEDUMP_PHASE_PROCESS]);
+	}
+	if (!ret && (mask & LTTNG_KERNEL_STATEDUMP_FD)) {
+		start = ktime_get_ns();
+		ret = lttng_enumerate_file_descriptors(statedump_session,
+				cw->shard);
+		atomic64_add(ktime_get_ns() - start,
+			&statedump_work_ns[LTTNG_STATEDUMP_PHASE_FD]);
+	}
+	if (ret)
+		cmpxchg(&statedump_error, 0, ret);
 	if (atomic_dec_and_test(&kernel_threads_to_run))
 		/* If we are the last thread, wake up do_lttng_statedump */
 		wake_up(&statedump_wq);
 }
 
+/* Add the time spent since *start to a phase, and restart from now. */
+static
+void lttng_statedump_phase_end(enum lttng_statedump_phase phase, u64 *start)
+{
+	u64 now = ktime_get_ns();
+
+	statedump_stats.phase_ns[phase] += now - *start;
+	*start = now;
+}
+
 static
 int do_lttng_statedump(struct lttng_session *session)
 {
+	unsigned int shard = 0;
+	u64 begin, start;
 	int cpu, ret;
 
+	memset(&statedump_stats, 0, sizeof(statedump_stats));
+	atomic64_set(&statedump_work_ns[LTTNG_STATEDUMP_PHASE_PROCESS], 0);
+	atomic64_set(&statedump_work_ns[LTTNG_STATEDUMP_PHASE_FD], 0);
+	begin = ktime_get_ns();
 	trace_lttng_statedump_start(session);
-	ret = lttng_enumerate_process_states(session);
-	if (ret)
-		return ret;
-	ret = lttng_enumerate_file_descriptors(session);
-	if (ret)
-		return ret;
+
+	if (session->statedump_incremental && !session->statedump_shadow) {
+		ret = lttng_statedump_shadow_create(session);
+		if (ret)
+			printk(KERN_WARNING "LTTng: incremental statedump unavailable (%d), using full statedump\n",
+				ret);
+	}
+	if (session->statedump_shadow) {
+		session->statedump_shadow->gen = atomic64_inc_return(&fd_gen);
+		session->statedump_shadow->dump_seq++;
+	}
+
+	/*
+	 * Fire off a work queue on each CPU, which dumps the process
+	 * states and file descriptors of its shard, while we dump the
+	 * global state from this thread.
+	 */
+	get_online_cpus();
+	statedump_session = session;
+	statedump_nr_shards = num_online_cpus();
+	statedump_error = 0;
+	atomic_set(&kernel_threads_to_run, statedump_nr_shards);
+	for_each_online_cpu(cpu) {
+		cpu_work[cpu].shard = shard++;
+		INIT_DELAYED_WORK(&cpu_work[cpu].work, lttng_statedump_work_func);
+		queue_delayed_work_on(cpu, system_long_wq,
+				&cpu_work[cpu].work, 0);
+	}
+
 	/*
 	 * FIXME
 	 * ret = lttng_enumerate_vm_maps(session);
 	 * if (ret)
 	 * 	return ret;
 	 */
-	ret = lttng_list_interrupts(session);
-	if (ret)
-		return ret;
-	ret = lttng_enumerate_network_ip_interface(session);
-	if (ret)
-		return ret;
-	ret = lttng_enumerate_block_devices(session);
+	start = ktime_get_ns();
+	if (session->statedump_mask & LTTNG_KERNEL_STATEDUMP_INTERRUPT) {
+		ret = lttng_list_interrupts(session);
+		if (ret)
+			goto wait;
+		lttng_statedump_phase_end(LTTNG_STATEDUMP_PHASE_INTERRUPT,
+				&start);
+	}
+	if (session->statedump_mask & LTTNG_KERNEL_STATEDUMP_NETIF) {
+		ret = lttng_enumerate_network_ip_interface(session);
+		if (ret)
+			goto wait;
+		lttng_statedump_phase_end(LTTNG_STATEDUMP_PHASE_NETIF, &start);
+	}
+	ret = 0;
+	if (session->statedump_mask & LTTNG_KERNEL_STATEDUMP_BLOCK_DEVICE) {
+		ret = lttng_enumerate_block_devices(session);
+		lttng_statedump_phase_end(LTTNG_STATEDUMP_PHASE_BLOCK_DEVICE,
+				&start);
+	}
 	switch (ret) {
 	case 0:
 		break;
 	case -ENOSYS:
 		printk(KERN_WARNING "LTTng: block device enumeration is not supported by kernel\n");
+		ret = 0;
 		break;
 	default:
-		return ret;
+		goto wait;
+	}
+	if (session->statedump_mask & LTTNG_KERNEL_STATEDUMP_CPU_TOPOLOGY) {
+		ret = lttng_enumerate_cpu_topology(session);
+		lttng_statedump_phase_end(LTTNG_STATEDUMP_PHASE_CPU_TOPOLOGY,
+				&start);
 	}
-	ret = lttng_enumerate_cpu_topology(session);
-	if (ret)
-		return ret;
 
 	/* TODO lttng_dump_idt_table(session); */
 	/* TODO lttng_dump_softirq_vec(session); */
 	/* TODO lttng_list_modules(session); */
 	/* TODO lttng_dump_swap_files(session); */
 
-	/*
-	 * Fire off a work queue on each CPU. Their sole purpose in life
-	 * is to guarantee that each CPU has been in a state where is was in
-	 * syscall mode (i.e. not in a trap, an IRQ or a soft IRQ).
-	 */
-	get_online_cpus();
-	atomic_set(&kernel_threads_to_run, num_online_cpus());
-	for_each_online_cpu(cpu) {
-		INIT_DELAYED_WORK(&cpu_work[cpu], lttng_statedump_work_func);
-		schedule_delayed_work_on(cpu, &cpu_work[cpu], 0);
-	}
+wait:
 	/* Wait for all threads to run */
 	__wait_event(statedump_wq, (atomic_read(&kernel_threads_to_run) == 0));
 	put_online_cpus();
+	statedump_session = NULL;
+	lttng_statedump_ns_clear();
+	statedump_stats.phase_ns[LTTNG_STATEDUMP_PHASE_PROCESS] =
+		atomic64_read(&statedump_work_ns[LTTNG_STATEDUMP_PHASE_PROCESS]);
+	statedump_stats.phase_ns[LTTNG_STATEDUMP_PHASE_FD] =
+		atomic64_read(&statedump_work_ns[LTTNG_STATEDUMP_PHASE_FD]);
+	statedump_stats.total_ns = ktime_get_ns() - begin;
+	if (ret)
+		return ret;
+	if (statedump_error)
+		return statedump_error;
+	/* Shadows are only refreshed by file descriptor walks. */
+	if (session->statedump_shadow
+	    && (session->statedump_mask & LTTNG_KERNEL_STATEDUMP_FD))
+		lttng_shadow_sweep(session->statedump_shadow);
 	/* Our work is done */
 	trace_lttng_statedump_end(session);
 	return 0;
 }
 
 /*
- * Called with session mutex held.
+ * Called with the session lock held.
  */
 int lttng_statedump_start(struct lttng_session *session)
 {
@@ -546,6 +1532,16 @@ int lttng_statedump_start(struct lttng_session *session)
 }
 EXPORT_SYMBOL_GPL(lttng_statedump_start);
 
+/*
+ * Get the phase durations of the last statedump. The caller must not
+ * run concurrently with statedumps.
+ */
+void lttng_statedump_get_stats(struct lttng_statedump_stats *stats)
+{
+	*stats = statedump_stats;
+}
+EXPORT_SYMBOL_GPL(lttng_statedump_get_stats);
+
 static
 int __init lttng_statedump_init(void)
 {
@@ -0,0 +1,301 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-stream-writer.c
+ *
+ * LTTng in-kernel stream writer, splicing sub-buffers to a file or socket.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/splice.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <linux/hashtable.h>
+
+#include <wrapper/ringbuffer/backend.h>
+#include <wrapper/ringbuffer/frontend.h>
+#include <lttng-kernel-version.h>
+#include <lttng-abi.h>
+#include <lttng-events.h>
+
+/*
+ * A writer takes the reader role of a stream: each time the stream read
+ * wait queue is woken up, a work item gets the ready sub-buffers and
+ * splices them, padded to a page multiple as done by the consumer
+ * daemon, to the destination file. The optional index file receives one
+ * struct lttng_kernel_packet_index per packet.
+ *
+ * The work is queued on the unbound workqueue, which runs it on the
+ * NUMA node of the cpu which woke the stream up, i.e. the node of the
+ * buffer for per-cpu channels woken up by their read timer.
+ *
+ * Both files are written from the position they have when the writer is
+ * started, without updating it. The writer stops on the first error,
+ * which is returned when it is detached. It lives as long as the stream
+ * file: it is detached when the stream is released at the latest.
+ */
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,13,0))
+typedef struct wait_queue_entry lttng_wait_queue_entry_t;
+#else
+typedef wait_queue_t lttng_wait_queue_entry_t;
+#endif
+
+struct lttng_stream_writer {
+	struct hlist_node node;		/* stream_writer_ht, by buffer */
+	struct lib_ring_buffer *buf;
+	struct file *stream_file;	/* Not referenced: owns the writer */
+	struct file *out;
+	struct file *index;		/* NULL: no packet index */
+	loff_t out_pos;
+	loff_t index_pos;
+	lttng_wait_queue_entry_t wait;
+	struct work_struct work;
+	int error;			/* First error, stops the writer */
+};
+
+#define STREAM_WRITER_HT_BITS	6
+
+static DEFINE_MUTEX(stream_writer_mutex);
+static DEFINE_HASHTABLE(stream_writer_ht, STREAM_WRITER_HT_BITS);
+static atomic_t stream_writer_count = ATOMIC_INIT(0);
+
+/* Called with stream_writer_mutex held. */
+static
+struct lttng_stream_writer *lttng_stream_writer_lookup(struct lib_ring_buffer *buf)
+{
+	struct lttng_stream_writer *writer;
+
+	hash_for_each_possible(stream_writer_ht, writer, node,
+			(unsigned long) buf) {
+		if (writer->buf == buf)
+			return writer;
+	}
+	return NULL;
+}
+
+static
+ssize_t lttng_stream_writer_write(struct file *file, const void *data,
+		size_t len, loff_t *pos)
+{
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,14,0))
+	return kernel_write(file, data, len, pos);
+#else
+	ssize_t ret;
+
+	ret = kernel_write(file, data, len, *pos);
+	if (ret > 0)
+		*pos += ret;
+	return ret;
+#endif
+}
+
+/* Splice the sub-buffer held by the writer. */
+static
+int lttng_stream_writer_splice(struct lttng_stream_writer *writer,
+		size_t len)
+{
+	loff_t pos = 0;
+
+	while (len) {
+		long ret;
+
+		ret = do_splice_direct(writer->stream_file, &pos, writer->out,
+				&writer->out_pos, len, 0);
+		if (ret < 0)
+			return ret;
+		if (!ret)
+			return -EIO;
+		len -= ret;
+	}
+	return 0;
+}
+
+static
+int lttng_stream_writer_index(struct lttng_stream_writer *writer,
+		uint64_t offset)
+{
+	struct lttng_kernel_packet_index index;
+	ssize_t ret;
+
+	index.offset = offset;
+	ret = lttng_stream_get_packet_desc(writer->buf, &index.desc);
+	if (ret)
+		return ret;
+	ret = lttng_stream_writer_write(writer->index, &index, sizeof(index),
+			&writer->index_pos);
+	if (ret < 0)
+		return ret;
+	if (ret != sizeof(index))
+		return -EIO;
+	return 0;
+}
+
+static
+int lttng_stream_writer_packet(struct lttng_stream_writer *writer)
+{
+	struct lib_ring_buffer *buf = writer->buf;
+	const struct lib_ring_buffer_config *config = &buf->backend.chan->backend.config;
+	uint64_t offset = writer->out_pos;
+	int ret;
+
+	ret = lib_ring_buffer_get_next_subbuf(buf);
+	if (ret)
+		return ret;
+	/* Index first: the descriptor is read from the held sub-buffer. */
+	if (writer->index) {
+		ret = lttng_stream_writer_index(writer, offset);
+		if (ret)
+			goto put;
+	}
+	ret = lttng_stream_writer_splice(writer,
+			PAGE_ALIGN(lib_ring_buffer_get_read_data_size(config, buf)));
+put:
+	lib_ring_buffer_put_next_subbuf(buf);
+	return ret;
+}
+
+static
+void lttng_stream_writer_work(struct work_struct *work)
+{
+	struct lttng_stream_writer *writer =
+		container_of(work, struct lttng_stream_writer, work);
+	int ret;
+
+	if (writer->error)
+		return;
+	for (;;) {
+		ret = lttng_stream_writer_packet(writer);
+		if (!ret)
+			continue;
+		/*
+		 * -EAGAIN: nothing ready, -ENODATA: finalized and drained,
+		 * both wait for the next wakeup, which only comes for
+		 * new data or at finalization.
+		 */
+		if (ret != -EAGAIN && ret != -ENODATA)
+			writer->error = ret;
+		break;
+	}
+}
+
+static
+int lttng_stream_writer_wake(lttng_wait_queue_entry_t *wait, unsigned int mode,
+		int sync, void *key)
+{
+	struct lttng_stream_writer *writer =
+		container_of(wait, struct lttng_stream_writer, wait);
+
+	queue_work(system_unbound_wq, &writer->work);
+	return 0;
+}
+
+/*
+ * Attach a writer to the stream file, which must not be read by
+ * user-space while the writer is attached.
+ */
+int lttng_stream_writer_start(struct file *stream_file,
+		struct lttng_kernel_stream_writer *param)
+{
+	struct lib_ring_buffer *buf = stream_file->private_data;
+	struct lttng_stream_writer *writer;
+	int ret;
+
+	writer = kzalloc(sizeof(*writer), GFP_KERNEL);
+	if (!writer)
+		return -ENOMEM;
+	writer->buf = buf;
+	writer->stream_file = stream_file;
+	INIT_WORK(&writer->work, lttng_stream_writer_work);
+	init_waitqueue_func_entry(&writer->wait, lttng_stream_writer_wake);
+	writer->out = fget(param->fd);
+	if (!writer->out) {
+		ret = -EBADF;
+		goto error;
+	}
+	if (!(writer->out->f_mode & FMODE_WRITE)) {
+		ret = -EBADF;
+		goto error;
+	}
+	writer->out_pos = writer->out->f_pos;
+	if (param->index_fd >= 0) {
+		writer->index = fget(param->index_fd);
+		if (!writer->index) {
+			ret = -EBADF;
+			goto error;
+		}
+		if (!(writer->index->f_mode & FMODE_WRITE)) {
+			ret = -EBADF;
+			goto error;
+		}
+		writer->index_pos = writer->index->f_pos;
+	}
+
+	mutex_lock(&stream_writer_mutex);
+	if (lttng_stream_writer_lookup(buf) || buf->get_subbuf) {
+		mutex_unlock(&stream_writer_mutex);
+		ret = -EBUSY;
+		goto error;
+	}
+	hash_add(stream_writer_ht, &writer->node, (unsigned long) buf);
+	atomic_inc(&stream_writer_count);
+	add_wait_queue(&buf->read_wait, &writer->wait);
+	mutex_unlock(&stream_writer_mutex);
+	/* Data ready before the writer was attached. */
+	queue_work(system_unbound_wq, &writer->work);
+	return 0;
+
+error:
+	if (writer->index)
+		fput(writer->index);
+	if (writer->out)
+		fput(writer->out);
+	kfree(writer);
+	return ret;
+}
+
+/*
+ * Detach the writer of a stream. Returns the error which stopped it,
+ * 0 if none, or -ENOENT if the stream has no writer.
+ */
+int lttng_stream_writer_stop(struct lib_ring_buffer *buf)
+{
+	struct lttng_stream_writer *writer;
+	int ret;
+
+	mutex_lock(&stream_writer_mutex);
+	writer = lttng_stream_writer_lookup(buf);
+	if (!writer) {
+		mutex_unlock(&stream_writer_mutex);
+		return -ENOENT;
+	}
+	hash_del(&writer->node);
+	remove_wait_queue(&buf->read_wait, &writer->wait);
+	mutex_unlock(&stream_writer_mutex);
+	cancel_work_sync(&writer->work);
+	atomic_dec(&stream_writer_count);
+	ret = writer->error;
+	if (writer->index)
+		fput(writer->index);
+	fput(writer->out);
+	kfree(writer);
+	return ret;
+}
+
+/* Whether user-space reads of the stream must be refused. */
+bool lttng_stream_writer_attached(struct lib_ring_buffer *buf)
+{
+	bool attached;
+
+	if (!atomic_read(&stream_writer_count))
+		return false;
+	mutex_lock(&stream_writer_mutex);
+	attached = lttng_stream_writer_lookup(buf) != NULL;
+	mutex_unlock(&stream_writer_mutex);
+	return attached;
+}
@@ -3,6 +3,7 @@
  * Copyright (C) 2017 Philippe Proulx <pproulx@efficios.com>
  */
 
+#include <linux/module.h>
 #include <linux/types.h>
 
 #include <lttng-string-utils.h>
@@ -105,6 +106,7 @@ bool strutils_star_glob_match(const char *pattern, size_t pattern_len,
 		&pattern_with_len, string_get_char_at_cb,
 		&candidate_with_len);
 }
+EXPORT_SYMBOL_GPL(strutils_star_glob_match);
 
 bool strutils_star_glob_match_char_cb(
 		strutils_get_char_at_cb pattern_get_char_at_cb,
@@ -18,6 +18,11 @@
 #include <linux/stringify.h>
 #include <linux/file.h>
 #include <linux/anon_inodes.h>
+#include <linux/hash.h>
+#include <linux/sched.h>
+#include <linux/math64.h>
+#include <linux/cpu.h>
+#include <linux/workqueue.h>
 #include <asm/ptrace.h>
 #include <asm/syscall.h>
 
@@ -25,6 +30,9 @@
 #include <wrapper/tracepoint.h>
 #include <wrapper/file.h>
 #include <wrapper/rcu.h>
+#include <wrapper/list.h>
+#include <wrapper/vmalloc.h>
+#include <wrapper/trace-clock.h>
 #include <lttng-events.h>
 
 #ifndef CONFIG_COMPAT
@@ -270,22 +278,91 @@ struct user_msghdr;
 
 struct trace_syscall_entry {
 	void *func;
+	void *thunk;			/* Unpacks arguments, calls func */
 	const struct lttng_event_desc *desc;
 	const struct lttng_event_field *fields;
 	unsigned int nrargs;
 };
 
+/*
+ * Per-channel dispatch entry, indexed by system call number. func is
+ * the thunk recording event (or the unknown system call event), or
+ * NULL when the system call is filtered out. The events never change
+ * once the sys_enter/sys_exit probes are registered, only func is
+ * updated when the filter changes.
+ */
+struct lttng_syscall_dispatch {
+	void *func;
+	struct lttng_event *event;
+};
+
 #define CREATE_SYSCALL_TABLE
 
+/*
+ * Thunks fetching exactly the number of arguments of each system call
+ * from pt_regs, and calling its probe directly.
+ */
+#define SC_THUNK_ARGS_TYPES_0
+#define SC_THUNK_ARGS_TYPES_1	, unsigned long
+#define SC_THUNK_ARGS_TYPES_2	SC_THUNK_ARGS_TYPES_1, unsigned long
+#define SC_THUNK_ARGS_TYPES_3	SC_THUNK_ARGS_TYPES_2, unsigned long
+#define SC_THUNK_ARGS_TYPES_4	SC_THUNK_ARGS_TYPES_3, unsigned long
+#define SC_THUNK_ARGS_TYPES_5	SC_THUNK_ARGS_TYPES_4, unsigned long
+#define SC_THUNK_ARGS_TYPES_6	SC_THUNK_ARGS_TYPES_5, unsigned long
+
+#define SC_THUNK_ARGS_0(_args)
+#define SC_THUNK_ARGS_1(_args)	, _args[0]
+#define SC_THUNK_ARGS_2(_args)	SC_THUNK_ARGS_1(_args), _args[1]
+#define SC_THUNK_ARGS_3(_args)	SC_THUNK_ARGS_2(_args), _args[2]
+#define SC_THUNK_ARGS_4(_args)	SC_THUNK_ARGS_3(_args), _args[3]
+#define SC_THUNK_ARGS_5(_args)	SC_THUNK_ARGS_4(_args), _args[4]
+#define SC_THUNK_ARGS_6(_args)	SC_THUNK_ARGS_5(_args), _args[5]
+
+#define SC_ENTRY_THUNK(_probe, _thunk, _nrargs)				\
+static void _thunk(struct lttng_event *event, struct pt_regs *regs,	\
+		long id)						\
+{									\
+	void (*fptr)(void *__data SC_THUNK_ARGS_TYPES_##_nrargs) =	\
+		(void *) _probe;					\
+	unsigned long args[(_nrargs) + 1];				\
+									\
+	if (_nrargs)							\
+		syscall_get_arguments(current, regs, 0, _nrargs, args);	\
+	fptr(event SC_THUNK_ARGS_##_nrargs(args));			\
+}
+
+#define SC_EXIT_THUNK(_probe, _thunk, _nrargs)				\
+static void _thunk(struct lttng_event *event, struct pt_regs *regs,	\
+		long id, long ret)					\
+{									\
+	void (*fptr)(void *__data, long ret				\
+		SC_THUNK_ARGS_TYPES_##_nrargs) = (void *) _probe;	\
+	unsigned long args[(_nrargs) + 1];				\
+									\
+	if (_nrargs)							\
+		syscall_get_arguments(current, regs, 0, _nrargs, args);	\
+	fptr(event, ret SC_THUNK_ARGS_##_nrargs(args));			\
+}
+
 #define SC_ENTER
 
 #undef sc_exit
 #define sc_exit(...)
 
+#undef TRACE_SYSCALL_TABLE
+#define TRACE_SYSCALL_TABLE(_template, _name, _nr, _nrargs)	\
+	SC_ENTRY_THUNK(__event_probe__syscall_entry_##_template, \
+		__syscall_entry_thunk_##_name, _nrargs)
+
+/* Syscall enter thunks */
+#include <instrumentation/syscalls/headers/syscalls_integers.h>
+#include <instrumentation/syscalls/headers/syscalls_pointers.h>
+
 #undef TRACE_SYSCALL_TABLE
 #define TRACE_SYSCALL_TABLE(_template, _name, _nr, _nrargs)	\
 	[ _nr ] = {						\
 		.func = __event_probe__syscall_entry_##_template, \
+		.thunk = __syscall_entry_thunk_##_name,		\
 		.nrargs = (_nrargs),				\
 		.fields = __event_fields___syscall_entry_##_template, \
 		.desc = &__event_desc___syscall_entry_##_name,	\
@@ -297,10 +374,20 @@ static const struct trace_syscall_entry sc_table[] = {
 #include <instrumentation/syscalls/headers/syscalls_pointers.h>
 };
 
+#undef TRACE_SYSCALL_TABLE
+#define TRACE_SYSCALL_TABLE(_template, _name, _nr, _nrargs)	\
+	SC_ENTRY_THUNK(__event_probe__compat_syscall_entry_##_template, \
+		__compat_syscall_entry_thunk_##_name, _nrargs)
+
+/* Compat syscall enter thunks */
+#include <instrumentation/syscalls/headers/compat_syscalls_integers.h>
+#include <instrumentation/syscalls/headers/compat_syscalls_pointers.h>
+
 #undef TRACE_SYSCALL_TABLE
 #define TRACE_SYSCALL_TABLE(_template, _name, _nr, _nrargs)	\
 	[ _nr ] = {						\
 		.func = __event_probe__compat_syscall_entry_##_template, \
+		.thunk = __compat_syscall_entry_thunk_##_name,	\
 		.nrargs = (_nrargs),				\
 		.fields = __event_fields___compat_syscall_entry_##_template, \
 		.desc = &__event_desc___compat_syscall_entry_##_name, \
@@ -319,10 +406,20 @@ const struct trace_syscall_entry compat_sc_table[] = {
 #undef sc_exit
 #define sc_exit(...)		__VA_ARGS__
 
+#undef TRACE_SYSCALL_TABLE
+#define TRACE_SYSCALL_TABLE(_template, _name, _nr, _nrargs)	\
+	SC_EXIT_THUNK(__event_probe__syscall_exit_##_template,	\
+		__syscall_exit_thunk_##_name, _nrargs)
+
+/* Syscall exit thunks */
+#include <instrumentation/syscalls/headers/syscalls_integers.h>
+#include <instrumentation/syscalls/headers/syscalls_pointers.h>
+
 #undef TRACE_SYSCALL_TABLE
 #define TRACE_SYSCALL_TABLE(_template, _name, _nr, _nrargs)	\
 	[ _nr ] = {						\
 		.func = __event_probe__syscall_exit_##_template, \
+		.thunk = __syscall_exit_thunk_##_name,		\
 		.nrargs = (_nrargs),				\
 		.fields = __event_fields___syscall_exit_##_template, \
 		.desc = &__event_desc___syscall_exit_##_name, \
@@ -334,10 +431,20 @@ static const struct trace_syscall_entry sc_exit_table[] = {
 #include <instrumentation/syscalls/headers/syscalls_pointers.h>
 };
 
+#undef TRACE_SYSCALL_TABLE
+#define TRACE_SYSCALL_TABLE(_template, _name, _nr, _nrargs)	\
+	SC_EXIT_THUNK(__event_probe__compat_syscall_exit_##_template, \
+		__compat_syscall_exit_thunk_##_name, _nrargs)
+
+/* Compat syscall exit thunks */
+#include <instrumentation/syscalls/headers/compat_syscalls_integers.h>
+#include <instrumentation/syscalls/headers/compat_syscalls_pointers.h>
+
 #undef TRACE_SYSCALL_TABLE
 #define TRACE_SYSCALL_TABLE(_template, _name, _nr, _nrargs)	\
 	[ _nr ] = {						\
 		.func = __event_probe__compat_syscall_exit_##_template, \
+		.thunk = __compat_syscall_exit_thunk_##_name,	\
 		.nrargs = (_nrargs),				\
 		.fields = __event_fields___compat_syscall_exit_##_template, \
 		.desc = &__event_desc___compat_syscall_exit_##_name, \
@@ -358,8 +465,37 @@ struct lttng_syscall_filter {
 	DECLARE_BITMAP(sc_compat, NR_compat_syscalls);
 };
 
+/*
+ * All the channels tracing system calls share a single probe on each of
+ * the sys_enter and sys_exit tracepoints, which runs the dispatch of the
+ * channels on syscall_chans. The number of channels dispatching each
+ * system call lets the probes return right away for the system calls
+ * no channel traces. Updated with the sessions lock held.
+ */
+static LIST_HEAD(syscall_chans);	/* RCU */
+static unsigned int sc_nr_chans[ARRAY_SIZE(sc_table)];
+static unsigned int sc_exit_nr_chans[ARRAY_SIZE(sc_exit_table)];
+static unsigned int compat_sc_nr_chans[ARRAY_SIZE(compat_sc_table)];
+static unsigned int compat_sc_exit_nr_chans[ARRAY_SIZE(compat_sc_exit_table)];
+
+/*
+ * Star-glob syscall enablers do not create the events of all the system
+ * calls they match: the first hit of each system call without event
+ * queues the creation of its events, if it matches a syscall enabler of
+ * the channel, and is recorded as an unknown system call meanwhile.
+ */
+struct lttng_syscall_lazy {
+	struct lttng_channel *chan;
+	int enabled;			/* Cleared at session destruction */
+	struct delayed_work work;
+	DECLARE_BITMAP(sc_hit, NR_syscalls);
+	DECLARE_BITMAP(sc_exit_hit, NR_syscalls);
+	DECLARE_BITMAP(compat_sc_hit, NR_compat_syscalls);
+	DECLARE_BITMAP(compat_sc_exit_hit, NR_compat_syscalls);
+};
+
 static void syscall_entry_unknown(struct lttng_event *event,
-	struct pt_regs *regs, unsigned int id)
+	struct pt_regs *regs, long id)
 {
 	unsigned long args[UNKNOWN_SYSCALL_NRARGS];
 
@@ -370,379 +506,1099 @@ static void syscall_entry_unknown(struct lttng_event *event,
 		__event_probe__syscall_entry_unknown(event, id, args);
 }
 
-void syscall_entry_probe(void *__data, struct pt_regs *regs, long id)
+static void syscall_exit_unknown(struct lttng_event *event,
+	struct pt_regs *regs, long id, long ret)
 {
-	struct lttng_channel *chan = __data;
-	struct lttng_event *event, *unknown_event;
-	const struct trace_syscall_entry *table, *entry;
-	size_t table_len;
+	unsigned long args[UNKNOWN_SYSCALL_NRARGS];
 
-	if (unlikely(in_compat_syscall())) {
-		struct lttng_syscall_filter *filter;
-
-		filter = lttng_rcu_dereference(chan->sc_filter);
-		if (filter) {
-			if (id < 0 || id >= NR_compat_syscalls
-				|| !test_bit(id, filter->sc_compat)) {
-				/* System call filtered out. */
-				return;
-			}
-		}
-		table = compat_sc_table;
-		table_len = ARRAY_SIZE(compat_sc_table);
-		unknown_event = chan->sc_compat_unknown;
-	} else {
-		struct lttng_syscall_filter *filter;
-
-		filter = lttng_rcu_dereference(chan->sc_filter);
-		if (filter) {
-			if (id < 0 || id >= NR_syscalls
-				|| !test_bit(id, filter->sc)) {
-				/* System call filtered out. */
-				return;
-			}
+	syscall_get_arguments(current, regs, 0, UNKNOWN_SYSCALL_NRARGS, args);
+	if (unlikely(in_compat_syscall()))
+		__event_probe__compat_syscall_exit_unknown(event, id, ret,
+			args);
+	else
+		__event_probe__syscall_exit_unknown(event, id, ret, args);
+}
+
+static void syscall_entry_lazy(struct lttng_event *event,
+	struct pt_regs *regs, long id)
+{
+	struct lttng_syscall_lazy *lazy = event->chan->sc_lazy;
+
+	if (!test_and_set_bit(id, unlikely(in_compat_syscall()) ?
+			lazy->compat_sc_hit : lazy->sc_hit))
+		schedule_delayed_work(&lazy->work, 0);
+	syscall_entry_unknown(event, regs, id);
+}
+
+static void syscall_exit_lazy(struct lttng_event *event,
+	struct pt_regs *regs, long id, long ret)
+{
+	struct lttng_syscall_lazy *lazy = event->chan->sc_lazy;
+
+	if (!test_and_set_bit(id, unlikely(in_compat_syscall()) ?
+			lazy->compat_sc_exit_hit : lazy->sc_exit_hit))
+		schedule_delayed_work(&lazy->work, 0);
+	syscall_exit_unknown(event, regs, id, ret);
+}
+
+/*
+ * System call numbers beyond the dispatch tables are not covered by the
+ * dispatch entries: test the filter for them.
+ */
+static
+bool syscall_unknown_enabled(struct lttng_channel *chan, long id, bool compat)
+{
+	struct lttng_syscall_filter *filter;
+
+	filter = lttng_rcu_dereference(chan->sc_filter);
+	if (!filter)
+		return true;
+	if (id < 0)
+		return false;
+	if (compat)
+		return id < NR_compat_syscalls && test_bit(id, filter->sc_compat);
+	return id < NR_syscalls && test_bit(id, filter->sc);
+}
+
+/*
+ * Per-process syscall masks, restricting the syscalls of the channel
+ * recorded for the processes they are attached to. Processes without a
+ * mask record all the syscalls enabled in the channel.
+ *
+ * Lookups are performed from the syscall probes, within the RCU sched
+ * read-side critical section of the tracepoint call site. Updates are
+ * serialized by the session lock.
+ */
+#define LTTNG_SYSCALL_PID_MASK_HT_BITS	6
+#define LTTNG_SYSCALL_PID_MASK_HT_SIZE	(1U << LTTNG_SYSCALL_PID_MASK_HT_BITS)
+
+/* Keep masks for syscall numbers well beyond the current tables. */
+#define LTTNG_SYSCALL_PID_MASK_MAX_LEN	(1U << 16)
+
+struct lttng_syscall_pid_mask {
+	struct hlist_node hlist;
+	int pid;
+	DECLARE_BITMAP(sc, NR_syscalls);
+	DECLARE_BITMAP(sc_compat, NR_compat_syscalls);
+};
+
+struct lttng_syscall_pid_masks {
+	struct hlist_head hash[LTTNG_SYSCALL_PID_MASK_HT_SIZE];
+};
+
+static
+struct hlist_head *syscall_pid_mask_head(struct lttng_syscall_pid_masks *masks,
+		int pid)
+{
+	return &masks->hash[hash_32(pid, LTTNG_SYSCALL_PID_MASK_HT_BITS)];
+}
+
+/*
+ * Return false if the current process has a mask which does not allow
+ * syscall @id. A single hash lookup on the thread group id, done only
+ * when masks are set on the channel.
+ */
+static
+bool syscall_pid_enabled(struct lttng_channel *chan, long id, bool compat)
+{
+	struct lttng_syscall_pid_masks *masks;
+	struct lttng_syscall_pid_mask *e;
+	int pid;
+
+	masks = lttng_rcu_dereference(chan->sc_pid_masks);
+	if (likely(!masks))
+		return true;
+	pid = task_tgid_nr(current);
+	lttng_hlist_for_each_entry(e, syscall_pid_mask_head(masks, pid), hlist) {
+		if (e->pid != pid)
+			continue;
+		if (id < 0)
+			return false;
+		if (compat)
+			return id < NR_compat_syscalls
+				&& test_bit(id, e->sc_compat);
+		return id < NR_syscalls && test_bit(id, e->sc);
+	}
+	return true;
+}
+
+static
+void syscall_pid_masks_free(struct lttng_syscall_pid_masks *masks)
+{
+	struct lttng_syscall_pid_mask *e;
+	struct hlist_node *tmp;
+	unsigned int i;
+
+	if (!masks)
+		return;
+	for (i = 0; i < LTTNG_SYSCALL_PID_MASK_HT_SIZE; i++) {
+		lttng_hlist_for_each_entry_safe(e, tmp, &masks->hash[i], hlist) {
+			hlist_del(&e->hlist);
+			kfree(e);
 		}
-		table = sc_table;
-		table_len = ARRAY_SIZE(sc_table);
-		unknown_event = chan->sc_unknown;
 	}
-	if (unlikely(id < 0 || id >= table_len)) {
-		syscall_entry_unknown(unknown_event, regs, id);
+	kfree(masks);
+}
+
+/*
+ * Latency mode: system call entries are kept in a slot of a per-channel
+ * table indexed by thread id, and recorded along with the exit, as one
+ * syscall_exit_latency event. Colliding threads make the table lossy:
+ * when the exit does not find its entry, it is recorded as a regular
+ * exit event.
+ *
+ * Each slot is protected by a sequence count, odd while the slot is
+ * being updated. Taking an even sequence count with cmpxchg makes
+ * updates exclusive: an update colliding with a concurrent one is
+ * dropped.
+ */
+#define SYSCALL_LATENCY_SLOTS_ORDER	12
+#define SYSCALL_LATENCY_NR_SLOTS	(1U << SYSCALL_LATENCY_SLOTS_ORDER)
+
+struct lttng_syscall_latency_slot {
+	unsigned long seq;
+	pid_t tid;		/* 0: free slot */
+	int id;
+	uint64_t timestamp;	/* entry time */
+	unsigned long args[UNKNOWN_SYSCALL_NRARGS];
+};
+
+struct lttng_syscall_latency {
+	int enabled;
+	uint64_t threshold;	/* minimum duration, in trace clock units */
+	struct lttng_event *event;
+	struct lttng_event *compat_event;
+	struct lttng_syscall_latency_slot slots[SYSCALL_LATENCY_NR_SLOTS];
+};
+
+static
+struct lttng_syscall_latency_slot *syscall_latency_slot(
+		struct lttng_syscall_latency *latency)
+{
+	return &latency->slots[hash_32(current->pid,
+			SYSCALL_LATENCY_SLOTS_ORDER)];
+}
+
+static
+void syscall_latency_entry(struct lttng_syscall_latency *latency,
+		struct lttng_event *event, struct pt_regs *regs, long id)
+{
+	struct lttng_syscall_latency_slot *slot;
+	unsigned long seq;
+
+	/* Only keep entries which would have been recorded. */
+	if (!(READ_ONCE(event->armed) & LTTNG_EVENT_ARMED))
 		return;
+	slot = syscall_latency_slot(latency);
+	seq = READ_ONCE(slot->seq);
+	if ((seq & 1) || cmpxchg(&slot->seq, seq, seq + 1) != seq)
+		return;
+	slot->tid = current->pid;
+	slot->id = id;
+	syscall_get_arguments(current, regs, 0, UNKNOWN_SYSCALL_NRARGS,
+		slot->args);
+	slot->timestamp = trace_clock_read64();
+	smp_wmb();	/* Content before even seq. */
+	WRITE_ONCE(slot->seq, seq + 2);
+}
+
+/*
+ * Return false if the entry of the system call is not found, in which
+ * case the exit has not been recorded.
+ */
+static
+bool syscall_latency_exit(struct lttng_syscall_latency *latency,
+		bool compat, long id, long ret)
+{
+	struct lttng_syscall_latency_slot *slot;
+	unsigned long args[UNKNOWN_SYSCALL_NRARGS];
+	unsigned long seq;
+	uint64_t timestamp, duration;
+	pid_t tid;
+	int slot_id;
+
+	slot = syscall_latency_slot(latency);
+	seq = READ_ONCE(slot->seq);
+	if (seq & 1)
+		return false;
+	smp_rmb();	/* Even seq before content. */
+	tid = slot->tid;
+	slot_id = slot->id;
+	timestamp = slot->timestamp;
+	memcpy(args, slot->args, sizeof(args));
+	smp_rmb();	/* Content before seq validation. */
+	if (READ_ONCE(slot->seq) != seq || tid != current->pid || slot_id != id)
+		return false;
+	/* Free the slot, unless it has been reused meanwhile. */
+	if (cmpxchg(&slot->seq, seq, seq + 1) == seq) {
+		slot->tid = 0;
+		smp_wmb();	/* Content before even seq. */
+		WRITE_ONCE(slot->seq, seq + 2);
 	}
-	if (unlikely(in_compat_syscall()))
-		event = chan->compat_sc_table[id];
+	duration = trace_clock_read64() - timestamp;
+	if (duration < latency->threshold)
+		return true;
+	if (unlikely(compat))
+		__event_probe__compat_syscall_exit_latency(latency->compat_event,
+			id, ret, duration, args);
 	else
-		event = chan->sc_table[id];
-	if (unlikely(!event)) {
-		syscall_entry_unknown(unknown_event, regs, id);
+		__event_probe__syscall_exit_latency(latency->event, id, ret,
+			duration, args);
+	return true;
+}
+
+/*
+ * Summary mode: rather than being recorded, system calls update per-cpu
+ * counters keyed by process and system call, holding their count, error
+ * count, and total and maximum duration. The counters are recorded as
+ * syscall_summary events by the first exit of each period, and by
+ * lttng_syscall_summary_flush() when the session is stopped.
+ *
+ * Entry times are kept in a lossy per-channel table indexed by thread
+ * id, protected by sequence counts as for the latency mode. System calls
+ * whose entry is not found at exit are not counted.
+ *
+ * The per-cpu counters are only updated from the syscall probes, with
+ * preemption disabled, and flushed from a work item running on their
+ * cpu with preemption disabled, so they need no further protection.
+ * System calls which cannot find a counter within
+ * SYSCALL_SUMMARY_MAX_PROBE entries are not counted.
+ */
+#define SYSCALL_SUMMARY_SLOTS_ORDER	12
+#define SYSCALL_SUMMARY_NR_SLOTS	(1U << SYSCALL_SUMMARY_SLOTS_ORDER)
+#define SYSCALL_SUMMARY_ENTRIES_ORDER	10
+#define SYSCALL_SUMMARY_NR_ENTRIES	(1U << SYSCALL_SUMMARY_ENTRIES_ORDER)
+#define SYSCALL_SUMMARY_MAX_PROBE	8
+
+struct lttng_syscall_summary_slot {
+	unsigned long seq;
+	pid_t tid;		/* 0: free slot */
+	int id;
+	uint64_t timestamp;	/* entry time */
+};
+
+struct lttng_syscall_summary_entry {
+	pid_t pid;		/* 0: free entry */
+	int id;
+	bool compat;
+	uint64_t end;		/* end of the current period */
+	uint64_t count;
+	uint64_t errors;
+	uint64_t total;
+	uint64_t max;
+};
+
+struct lttng_syscall_summary_cpu {
+	struct work_struct flush_work;
+	struct lttng_syscall_summary *summary;
+	struct lttng_syscall_summary_entry entries[SYSCALL_SUMMARY_NR_ENTRIES];
+};
+
+struct lttng_syscall_summary {
+	int enabled;
+	uint64_t period;	/* in trace clock units, 0: at stop only */
+	struct lttng_event *event;
+	struct lttng_event *compat_event;
+	struct lttng_syscall_summary_cpu **cpus;
+	struct lttng_syscall_summary_slot slots[SYSCALL_SUMMARY_NR_SLOTS];
+};
+
+static
+struct lttng_syscall_summary_slot *syscall_summary_slot(
+		struct lttng_syscall_summary *summary)
+{
+	return &summary->slots[hash_32(current->pid,
+			SYSCALL_SUMMARY_SLOTS_ORDER)];
+}
+
+static
+void syscall_summary_entry(struct lttng_syscall_summary *summary,
+		struct lttng_event *event, long id)
+{
+	struct lttng_syscall_summary_slot *slot;
+	unsigned long seq;
+
+	/* Only count system calls which would have been recorded. */
+	if (!(READ_ONCE(event->armed) & LTTNG_EVENT_ARMED))
 		return;
+	slot = syscall_summary_slot(summary);
+	seq = READ_ONCE(slot->seq);
+	if ((seq & 1) || cmpxchg(&slot->seq, seq, seq + 1) != seq)
+		return;
+	slot->tid = current->pid;
+	slot->id = id;
+	slot->timestamp = trace_clock_read64();
+	smp_wmb();	/* Content before even seq. */
+	WRITE_ONCE(slot->seq, seq + 2);
+}
+
+static
+void syscall_summary_record(struct lttng_syscall_summary *summary,
+		const struct lttng_syscall_summary_entry *entry)
+{
+	if (unlikely(entry->compat))
+		__event_probe__compat_syscall_summary(summary->compat_event,
+			entry->pid, entry->id, entry->count, entry->errors,
+			entry->total, entry->max);
+	else
+		__event_probe__syscall_summary(summary->event,
+			entry->pid, entry->id, entry->count, entry->errors,
+			entry->total, entry->max);
+}
+
+static
+struct lttng_syscall_summary_entry *syscall_summary_lookup(
+		struct lttng_syscall_summary_cpu *cpu, pid_t pid, int id,
+		bool compat)
+{
+	uint32_t hash = hash_32((uint32_t) pid ^ ((uint32_t) id << 16)
+			^ compat, SYSCALL_SUMMARY_ENTRIES_ORDER);
+	unsigned int i;
+
+	for (i = 0; i < SYSCALL_SUMMARY_MAX_PROBE; i++) {
+		struct lttng_syscall_summary_entry *entry =
+			&cpu->entries[(hash + i) & (SYSCALL_SUMMARY_NR_ENTRIES - 1)];
+
+		if (!entry->pid) {
+			entry->pid = pid;
+			entry->id = id;
+			entry->compat = compat;
+			return entry;
+		}
+		if (entry->pid == pid && entry->id == id
+				&& entry->compat == compat)
+			return entry;
 	}
-	entry = &table[id];
-	WARN_ON_ONCE(!entry);
+	return NULL;
+}
 
-	switch (entry->nrargs) {
-	case 0:
-	{
-		void (*fptr)(void *__data) = entry->func;
+static
+void syscall_summary_exit(struct lttng_syscall_summary *summary,
+		bool compat, long id, long ret)
+{
+	struct lttng_syscall_summary_entry *entry;
+	struct lttng_syscall_summary_slot *slot;
+	uint64_t timestamp, now, duration;
+	unsigned long seq;
+	pid_t tid;
+	int slot_id;
+
+	slot = syscall_summary_slot(summary);
+	seq = READ_ONCE(slot->seq);
+	if (seq & 1)
+		return;
+	smp_rmb();	/* Even seq before content. */
+	tid = slot->tid;
+	slot_id = slot->id;
+	timestamp = slot->timestamp;
+	smp_rmb();	/* Content before seq validation. */
+	if (READ_ONCE(slot->seq) != seq || tid != current->pid || slot_id != id)
+		return;
+	/* Free the slot, unless it has been reused meanwhile. */
+	if (cmpxchg(&slot->seq, seq, seq + 1) == seq) {
+		slot->tid = 0;
+		smp_wmb();	/* Content before even seq. */
+		WRITE_ONCE(slot->seq, seq + 2);
+	}
+	now = trace_clock_read64();
+	duration = now - timestamp;
 
-		fptr(event);
-		break;
+	entry = syscall_summary_lookup(summary->cpus[smp_processor_id()],
+			task_tgid_nr(current), id, compat);
+	if (!entry)
+		return;
+	if (summary->period && now >= entry->end) {
+		if (entry->count)
+			syscall_summary_record(summary, entry);
+		entry->count = 0;
+		entry->errors = 0;
+		entry->total = 0;
+		entry->max = 0;
+		entry->end = now + summary->period;
 	}
-	case 1:
-	{
-		void (*fptr)(void *__data, unsigned long arg0) = entry->func;
-		unsigned long args[1];
+	entry->count++;
+	if (IS_ERR_VALUE(ret))
+		entry->errors++;
+	entry->total += duration;
+	entry->max = max(entry->max, duration);
+}
 
-		syscall_get_arguments(current, regs, 0, entry->nrargs, args);
-		fptr(event, args[0]);
-		break;
+static
+void syscall_summary_flush_cpu(struct work_struct *work)
+{
+	struct lttng_syscall_summary_cpu *cpu =
+		container_of(work, struct lttng_syscall_summary_cpu, flush_work);
+	unsigned int i;
+
+	preempt_disable();
+	for (i = 0; i < SYSCALL_SUMMARY_NR_ENTRIES; i++) {
+		if (cpu->entries[i].count)
+			syscall_summary_record(cpu->summary, &cpu->entries[i]);
 	}
-	case 2:
-	{
-		void (*fptr)(void *__data,
-			unsigned long arg0,
-			unsigned long arg1) = entry->func;
-		unsigned long args[2];
+	memset(cpu->entries, 0, sizeof(cpu->entries));
+	preempt_enable();
+}
 
-		syscall_get_arguments(current, regs, 0, entry->nrargs, args);
-		fptr(event, args[0], args[1]);
-		break;
+/*
+ * Record the counters of the online cpus, and reset them. Called with
+ * sessions lock held, while the session is still active.
+ */
+void lttng_syscall_summary_flush(struct lttng_channel *chan)
+{
+	struct lttng_syscall_summary *summary = chan->sc_summary;
+	int cpu;
+
+	if (!summary || !summary->enabled)
+		return;
+	get_online_cpus();
+	for_each_online_cpu(cpu)
+		schedule_work_on(cpu, &summary->cpus[cpu]->flush_work);
+	for_each_online_cpu(cpu)
+		flush_work(&summary->cpus[cpu]->flush_work);
+	put_online_cpus();
+}
+
+static
+void syscall_summary_free(struct lttng_syscall_summary *summary)
+{
+	int cpu;
+
+	if (!summary)
+		return;
+	if (summary->cpus) {
+		for_each_possible_cpu(cpu)
+			lttng_kvfree(summary->cpus[cpu]);
+		kfree(summary->cpus);
 	}
-	case 3:
-	{
-		void (*fptr)(void *__data,
-			unsigned long arg0,
-			unsigned long arg1,
-			unsigned long arg2) = entry->func;
-		unsigned long args[3];
+	lttng_kvfree(summary);
+}
 
-		syscall_get_arguments(current, regs, 0, entry->nrargs, args);
-		fptr(event, args[0], args[1], args[2]);
-		break;
+static
+struct lttng_syscall_summary *syscall_summary_alloc(void)
+{
+	struct lttng_syscall_summary *summary;
+	int cpu;
+
+	summary = lttng_kvzalloc(sizeof(*summary), GFP_KERNEL);
+	if (!summary)
+		return NULL;
+	summary->cpus = kcalloc(nr_cpu_ids, sizeof(*summary->cpus),
+			GFP_KERNEL);
+	if (!summary->cpus)
+		goto error;
+	for_each_possible_cpu(cpu) {
+		struct lttng_syscall_summary_cpu *summary_cpu;
+
+		summary_cpu = lttng_kvzalloc_node(sizeof(*summary_cpu),
+				GFP_KERNEL, cpu_to_node(cpu));
+		if (!summary_cpu)
+			goto error;
+		INIT_WORK(&summary_cpu->flush_work, syscall_summary_flush_cpu);
+		summary_cpu->summary = summary;
+		summary->cpus[cpu] = summary_cpu;
 	}
-	case 4:
-	{
-		void (*fptr)(void *__data,
-			unsigned long arg0,
-			unsigned long arg1,
-			unsigned long arg2,
-			unsigned long arg3) = entry->func;
-		unsigned long args[4];
-
-		syscall_get_arguments(current, regs, 0, entry->nrargs, args);
-		fptr(event, args[0], args[1], args[2], args[3]);
-		break;
+	return summary;
+
+error:
+	syscall_summary_free(summary);
+	return NULL;
+}
+
+void syscall_entry_probe(void *__data, struct pt_regs *regs, long id)
+{
+	struct lttng_channel *chan = __data;
+	const struct lttng_syscall_dispatch *dispatch;
+	void (*fptr)(struct lttng_event *event, struct pt_regs *regs, long id);
+	struct lttng_syscall_summary *summary;
+	struct lttng_syscall_latency *latency;
+	bool compat = in_compat_syscall();
+	size_t dispatch_len;
+
+	if (unlikely(compat)) {
+		dispatch = chan->compat_sc_dispatch;
+		dispatch_len = ARRAY_SIZE(compat_sc_table);
+	} else {
+		dispatch = chan->sc_dispatch;
+		dispatch_len = ARRAY_SIZE(sc_table);
 	}
-	case 5:
-	{
-		void (*fptr)(void *__data,
-			unsigned long arg0,
-			unsigned long arg1,
-			unsigned long arg2,
-			unsigned long arg3,
-			unsigned long arg4) = entry->func;
-		unsigned long args[5];
-
-		syscall_get_arguments(current, regs, 0, entry->nrargs, args);
-		fptr(event, args[0], args[1], args[2], args[3], args[4]);
-		break;
+	if (unlikely(!syscall_pid_enabled(chan, id, compat)))
+		return;
+	if (unlikely(id < 0 || id >= dispatch_len)) {
+		if (syscall_unknown_enabled(chan, id, compat))
+			syscall_entry_unknown(compat ? chan->sc_compat_unknown
+					: chan->sc_unknown, regs, id);
+		return;
 	}
-	case 6:
-	{
-		void (*fptr)(void *__data,
-			unsigned long arg0,
-			unsigned long arg1,
-			unsigned long arg2,
-			unsigned long arg3,
-			unsigned long arg4,
-			unsigned long arg5) = entry->func;
-		unsigned long args[6];
-
-		syscall_get_arguments(current, regs, 0, entry->nrargs, args);
-		fptr(event, args[0], args[1], args[2],
-			args[3], args[4], args[5]);
-		break;
+	dispatch = &dispatch[id];
+	fptr = READ_ONCE(dispatch->func);
+	if (!fptr) {
+		/* System call filtered out. */
+		return;
 	}
-	default:
-		break;
+	summary = chan->sc_summary;
+	if (unlikely(summary && summary->enabled)) {
+		syscall_summary_entry(summary, dispatch->event, id);
+		return;
+	}
+	latency = chan->sc_latency;
+	if (unlikely(latency && latency->enabled)) {
+		syscall_latency_entry(latency, dispatch->event, regs, id);
+		return;
 	}
+	fptr(dispatch->event, regs, id);
 }
 
-static void syscall_exit_unknown(struct lttng_event *event,
-	struct pt_regs *regs, int id, long ret)
+void syscall_exit_probe(void *__data, struct pt_regs *regs, long ret)
 {
-	unsigned long args[UNKNOWN_SYSCALL_NRARGS];
+	struct lttng_channel *chan = __data;
+	const struct lttng_syscall_dispatch *dispatch;
+	void (*fptr)(struct lttng_event *event, struct pt_regs *regs, long id,
+		long ret);
+	struct lttng_syscall_summary *summary;
+	struct lttng_syscall_latency *latency;
+	bool compat = in_compat_syscall();
+	size_t dispatch_len;
+	long id;
 
-	syscall_get_arguments(current, regs, 0, UNKNOWN_SYSCALL_NRARGS, args);
-	if (unlikely(in_compat_syscall()))
-		__event_probe__compat_syscall_exit_unknown(event, id, ret,
-			args);
-	else
-		__event_probe__syscall_exit_unknown(event, id, ret, args);
+	id = syscall_get_nr(current, regs);
+	if (unlikely(compat)) {
+		dispatch = chan->compat_sc_exit_dispatch;
+		dispatch_len = ARRAY_SIZE(compat_sc_exit_table);
+	} else {
+		dispatch = chan->sc_exit_dispatch;
+		dispatch_len = ARRAY_SIZE(sc_exit_table);
+	}
+	if (unlikely(!syscall_pid_enabled(chan, id, compat)))
+		return;
+	if (unlikely(id < 0 || id >= dispatch_len)) {
+		if (syscall_unknown_enabled(chan, id, compat))
+			syscall_exit_unknown(compat ? chan->compat_sc_exit_unknown
+					: chan->sc_exit_unknown, regs, id, ret);
+		return;
+	}
+	dispatch = &dispatch[id];
+	fptr = READ_ONCE(dispatch->func);
+	if (!fptr) {
+		/* System call filtered out. */
+		return;
+	}
+	summary = chan->sc_summary;
+	if (unlikely(summary && summary->enabled)) {
+		syscall_summary_exit(summary, compat, id, ret);
+		return;
+	}
+	latency = chan->sc_latency;
+	if (unlikely(latency && latency->enabled)
+			&& syscall_latency_exit(latency, compat, id, ret))
+		return;
+	fptr(dispatch->event, regs, id, ret);
 }
 
-void syscall_exit_probe(void *__data, struct pt_regs *regs, long ret)
+static
+void syscall_entry_fanout_probe(void *__data, struct pt_regs *regs, long id)
 {
-	struct lttng_channel *chan = __data;
-	struct lttng_event *event, *unknown_event;
-	const struct trace_syscall_entry *table, *entry;
-	size_t table_len;
+	struct lttng_channel *chan;
+	const unsigned int *nr_chans = sc_nr_chans;
+	size_t len = ARRAY_SIZE(sc_table);
+
+	if (unlikely(in_compat_syscall())) {
+		nr_chans = compat_sc_nr_chans;
+		len = ARRAY_SIZE(compat_sc_table);
+	}
+	/* System call numbers beyond the tables are checked per channel. */
+	if (likely(id >= 0 && id < len) && !READ_ONCE(nr_chans[id]))
+		return;
+	lttng_list_for_each_entry_rcu(chan, &syscall_chans, sc_node)
+		syscall_entry_probe(chan, regs, id);
+}
+
+static
+void syscall_exit_fanout_probe(void *__data, struct pt_regs *regs, long ret)
+{
+	struct lttng_channel *chan;
+	const unsigned int *nr_chans = sc_exit_nr_chans;
+	size_t len = ARRAY_SIZE(sc_exit_table);
 	long id;
 
 	id = syscall_get_nr(current, regs);
 	if (unlikely(in_compat_syscall())) {
-		struct lttng_syscall_filter *filter;
-
-		filter = lttng_rcu_dereference(chan->sc_filter);
-		if (filter) {
-			if (id < 0 || id >= NR_compat_syscalls
-				|| !test_bit(id, filter->sc_compat)) {
-				/* System call filtered out. */
-				return;
-			}
-		}
-		table = compat_sc_exit_table;
-		table_len = ARRAY_SIZE(compat_sc_exit_table);
-		unknown_event = chan->compat_sc_exit_unknown;
-	} else {
-		struct lttng_syscall_filter *filter;
-
-		filter = lttng_rcu_dereference(chan->sc_filter);
-		if (filter) {
-			if (id < 0 || id >= NR_syscalls
-				|| !test_bit(id, filter->sc)) {
-				/* System call filtered out. */
-				return;
-			}
-		}
-		table = sc_exit_table;
-		table_len = ARRAY_SIZE(sc_exit_table);
-		unknown_event = chan->sc_exit_unknown;
+		nr_chans = compat_sc_exit_nr_chans;
+		len = ARRAY_SIZE(compat_sc_exit_table);
 	}
-	if (unlikely(id < 0 || id >= table_len)) {
-		syscall_exit_unknown(unknown_event, regs, id, ret);
+	if (likely(id >= 0 && id < len) && !READ_ONCE(nr_chans[id]))
 		return;
+	lttng_list_for_each_entry_rcu(chan, &syscall_chans, sc_node)
+		syscall_exit_probe(chan, regs, ret);
+}
+
+static
+void fill_dispatch(struct lttng_syscall_dispatch *dispatch,
+	const struct trace_syscall_entry *table, size_t table_len,
+	struct lttng_event **chan_table, struct lttng_event *unknown_event,
+	void *unknown_func, void *lazy_func, const unsigned long *lazy_hit,
+	const unsigned long *filter, size_t filter_len,
+	unsigned int *nr_chans)
+{
+	unsigned int i;
+
+	for (i = 0; i < table_len; i++) {
+		struct lttng_event *event = unknown_event;
+		void *func = unknown_func;
+
+		if (table[i].desc && chan_table[i]) {
+			event = chan_table[i];
+			func = table[i].thunk;
+		} else if (table[i].desc) {
+			/* Events created on first hit, or no event. */
+			func = lazy_hit && !test_bit(i, lazy_hit) ?
+				lazy_func : NULL;
+		}
+		/* System calls without events yet are not filtered. */
+		if (func != lazy_func && filter
+				&& (i >= filter_len || !test_bit(i, filter)))
+			func = NULL;
+		/* Count the listed channels dispatching the system call. */
+		if (nr_chans && !dispatch[i].func != !func) {
+			if (func)
+				WRITE_ONCE(nr_chans[i], nr_chans[i] + 1);
+			else
+				WRITE_ONCE(nr_chans[i], nr_chans[i] - 1);
+		}
+		dispatch[i].event = event;
+		WRITE_ONCE(dispatch[i].func, func);
 	}
-	if (unlikely(in_compat_syscall()))
-		event = chan->compat_sc_exit_table[id];
-	else
-		event = chan->sc_exit_table[id];
-	if (unlikely(!event)) {
-		syscall_exit_unknown(unknown_event, regs, id, ret);
+}
+
+/*
+ * Reflect the event tables and the filter into the dispatch tables.
+ * Should be called with sessions lock held.
+ */
+static
+void update_dispatch(struct lttng_channel *chan)
+{
+	struct lttng_syscall_filter *filter = chan->sc_filter;
+	struct lttng_syscall_lazy *lazy = chan->sc_lazy;
+
+	if (!chan->sc_dispatch)
 		return;
+	fill_dispatch(chan->sc_dispatch, sc_table, ARRAY_SIZE(sc_table),
+		chan->sc_table, chan->sc_unknown, syscall_entry_unknown,
+		syscall_entry_lazy, lazy ? lazy->sc_hit : NULL,
+		filter ? filter->sc : NULL, NR_syscalls,
+		chan->sc_listed ? sc_nr_chans : NULL);
+	fill_dispatch(chan->sc_exit_dispatch, sc_exit_table,
+		ARRAY_SIZE(sc_exit_table), chan->sc_exit_table,
+		chan->sc_exit_unknown, syscall_exit_unknown,
+		syscall_exit_lazy, lazy ? lazy->sc_exit_hit : NULL,
+		filter ? filter->sc : NULL, NR_syscalls,
+		chan->sc_listed ? sc_exit_nr_chans : NULL);
+#ifdef CONFIG_COMPAT
+	fill_dispatch(chan->compat_sc_dispatch, compat_sc_table,
+		ARRAY_SIZE(compat_sc_table), chan->compat_sc_table,
+		chan->sc_compat_unknown, syscall_entry_unknown,
+		syscall_entry_lazy, lazy ? lazy->compat_sc_hit : NULL,
+		filter ? filter->sc_compat : NULL, NR_compat_syscalls,
+		chan->sc_listed ? compat_sc_nr_chans : NULL);
+	fill_dispatch(chan->compat_sc_exit_dispatch, compat_sc_exit_table,
+		ARRAY_SIZE(compat_sc_exit_table), chan->compat_sc_exit_table,
+		chan->compat_sc_exit_unknown, syscall_exit_unknown,
+		syscall_exit_lazy, lazy ? lazy->compat_sc_exit_hit : NULL,
+		filter ? filter->sc_compat : NULL, NR_compat_syscalls,
+		chan->sc_listed ? compat_sc_exit_nr_chans : NULL);
+#endif
+}
+
+static
+void account_dispatch(const struct lttng_syscall_dispatch *dispatch,
+	size_t len, unsigned int *nr_chans, bool add)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++) {
+		if (!dispatch[i].func)
+			continue;
+		if (add)
+			WRITE_ONCE(nr_chans[i], nr_chans[i] + 1);
+		else
+			WRITE_ONCE(nr_chans[i], nr_chans[i] - 1);
 	}
-	entry = &table[id];
-	WARN_ON_ONCE(!entry);
+}
 
-	switch (entry->nrargs) {
-	case 0:
-	{
-		void (*fptr)(void *__data, long ret) = entry->func;
+/*
+ * Add the channel to, or remove it from, the channels the shared probes
+ * dispatch system calls to. The probes are registered with the first
+ * channel, and unregistered with the last one. A removed channel can
+ * still be used by the probes until the next synchronize_trace().
+ * Should be called with sessions lock held.
+ */
+static
+int syscall_chans_add(struct lttng_channel *chan)
+{
+	int ret;
 
-		fptr(event, ret);
-		break;
+	if (list_empty(&syscall_chans)) {
+		ret = lttng_wrapper_tracepoint_probe_register("sys_enter",
+				(void *) syscall_entry_fanout_probe, NULL);
+		if (ret)
+			return ret;
+		/*
+		 * We change the name of sys_exit tracepoint due to
+		 * namespace conflict with sys_exit syscall entry.
+		 */
+		ret = lttng_wrapper_tracepoint_probe_register("sys_exit",
+				(void *) syscall_exit_fanout_probe, NULL);
+		if (ret) {
+			WARN_ON_ONCE(lttng_wrapper_tracepoint_probe_unregister("sys_enter",
+				(void *) syscall_entry_fanout_probe, NULL));
+			return ret;
+		}
 	}
-	case 1:
-	{
-		void (*fptr)(void *__data,
-			long ret,
-			unsigned long arg0) = entry->func;
-		unsigned long args[1];
+	account_dispatch(chan->sc_dispatch, ARRAY_SIZE(sc_table),
+		sc_nr_chans, true);
+	account_dispatch(chan->sc_exit_dispatch, ARRAY_SIZE(sc_exit_table),
+		sc_exit_nr_chans, true);
+#ifdef CONFIG_COMPAT
+	account_dispatch(chan->compat_sc_dispatch, ARRAY_SIZE(compat_sc_table),
+		compat_sc_nr_chans, true);
+	account_dispatch(chan->compat_sc_exit_dispatch,
+		ARRAY_SIZE(compat_sc_exit_table), compat_sc_exit_nr_chans, true);
+#endif
+	list_add_tail_rcu(&chan->sc_node, &syscall_chans);
+	chan->sc_listed = 1;
+	return 0;
+}
+
+static
+int syscall_chans_remove(struct lttng_channel *chan)
+{
+	int ret;
+
+	list_del_rcu(&chan->sc_node);
+	chan->sc_listed = 0;
+	account_dispatch(chan->sc_dispatch, ARRAY_SIZE(sc_table),
+		sc_nr_chans, false);
+	account_dispatch(chan->sc_exit_dispatch, ARRAY_SIZE(sc_exit_table),
+		sc_exit_nr_chans, false);
+#ifdef CONFIG_COMPAT
+	account_dispatch(chan->compat_sc_dispatch, ARRAY_SIZE(compat_sc_table),
+		compat_sc_nr_chans, false);
+	account_dispatch(chan->compat_sc_exit_dispatch,
+		ARRAY_SIZE(compat_sc_exit_table), compat_sc_exit_nr_chans, false);
+#endif
+	if (!list_empty(&syscall_chans))
+		return 0;
+	ret = lttng_wrapper_tracepoint_probe_unregister("sys_exit",
+			(void *) syscall_exit_fanout_probe, NULL);
+	WARN_ON_ONCE(ret);
+	ret = lttng_wrapper_tracepoint_probe_unregister("sys_enter",
+			(void *) syscall_entry_fanout_probe, NULL);
+	WARN_ON_ONCE(ret);
+	return 0;
+}
 
-		syscall_get_arguments(current, regs, 0, entry->nrargs, args);
-		fptr(event, ret, args[0]);
-		break;
-	}
-	case 2:
-	{
-		void (*fptr)(void *__data,
-			long ret,
-			unsigned long arg0,
-			unsigned long arg1) = entry->func;
-		unsigned long args[2];
+/*
+ * Create the event of system call "i" of "table".
+ * noinline to diminish caller stack size.
+ * Should be called with sessions lock held.
+ */
+static noinline
+int create_syscall_event(const struct trace_syscall_entry *table,
+	unsigned int i, struct lttng_event **chan_table,
+	struct lttng_channel *chan, enum sc_type type)
+{
+	const struct lttng_event_desc *desc = table[i].desc;
+	struct lttng_kernel_event ev;
 
-		syscall_get_arguments(current, regs, 0, entry->nrargs, args);
-		fptr(event, ret, args[0], args[1]);
-		break;
-	}
-	case 3:
-	{
-		void (*fptr)(void *__data,
-			long ret,
-			unsigned long arg0,
-			unsigned long arg1,
-			unsigned long arg2) = entry->func;
-		unsigned long args[3];
-
-		syscall_get_arguments(current, regs, 0, entry->nrargs, args);
-		fptr(event, ret, args[0], args[1], args[2]);
+	memset(&ev, 0, sizeof(ev));
+	switch (type) {
+	case SC_TYPE_ENTRY:
+		strncpy(ev.name, SYSCALL_ENTRY_STR,
+			LTTNG_KERNEL_SYM_NAME_LEN);
 		break;
-	}
-	case 4:
-	{
-		void (*fptr)(void *__data,
-			long ret,
-			unsigned long arg0,
-			unsigned long arg1,
-			unsigned long arg2,
-			unsigned long arg3) = entry->func;
-		unsigned long args[4];
-
-		syscall_get_arguments(current, regs, 0, entry->nrargs, args);
-		fptr(event, ret, args[0], args[1], args[2], args[3]);
+	case SC_TYPE_EXIT:
+		strncpy(ev.name, SYSCALL_EXIT_STR,
+			LTTNG_KERNEL_SYM_NAME_LEN);
 		break;
-	}
-	case 5:
-	{
-		void (*fptr)(void *__data,
-			long ret,
-			unsigned long arg0,
-			unsigned long arg1,
-			unsigned long arg2,
-			unsigned long arg3,
-			unsigned long arg4) = entry->func;
-		unsigned long args[5];
-
-		syscall_get_arguments(current, regs, 0, entry->nrargs, args);
-		fptr(event, ret, args[0], args[1], args[2], args[3], args[4]);
+	case SC_TYPE_COMPAT_ENTRY:
+		strncpy(ev.name, COMPAT_SYSCALL_ENTRY_STR,
+			LTTNG_KERNEL_SYM_NAME_LEN);
 		break;
-	}
-	case 6:
-	{
-		void (*fptr)(void *__data,
-			long ret,
-			unsigned long arg0,
-			unsigned long arg1,
-			unsigned long arg2,
-			unsigned long arg3,
-			unsigned long arg4,
-			unsigned long arg5) = entry->func;
-		unsigned long args[6];
-
-		syscall_get_arguments(current, regs, 0, entry->nrargs, args);
-		fptr(event, ret, args[0], args[1], args[2],
-			args[3], args[4], args[5]);
+	case SC_TYPE_COMPAT_EXIT:
+		strncpy(ev.name, COMPAT_SYSCALL_EXIT_STR,
+			LTTNG_KERNEL_SYM_NAME_LEN);
 		break;
-	}
 	default:
+		BUG_ON(1);
 		break;
 	}
+	strncat(ev.name, desc->name,
+		LTTNG_KERNEL_SYM_NAME_LEN - strlen(ev.name) - 1);
+	ev.name[LTTNG_KERNEL_SYM_NAME_LEN - 1] = '\0';
+	ev.instrumentation = LTTNG_KERNEL_SYSCALL;
+	chan_table[i] = _lttng_event_create(chan, &ev, NULL,
+					desc, ev.instrumentation);
+	WARN_ON_ONCE(!chan_table[i]);
+	if (IS_ERR(chan_table[i])) {
+		int ret = PTR_ERR(chan_table[i]);
+
+		chan_table[i] = NULL;
+		return ret;
+	}
+	return 0;
 }
 
 /*
- * noinline to diminish caller stack size.
+ * Create the events of the system calls matching the enabler.
  * Should be called with sessions lock held.
  */
 static
 int fill_table(const struct trace_syscall_entry *table, size_t table_len,
 	struct lttng_event **chan_table, struct lttng_channel *chan,
-	void *filter, enum sc_type type)
+	struct lttng_enabler *enabler, enum sc_type type)
 {
-	const struct lttng_event_desc *desc;
 	unsigned int i;
+	int ret;
 
-	/* Allocate events for each syscall, insert into table */
+	/* Allocate events for each matching syscall, insert into table */
 	for (i = 0; i < table_len; i++) {
-		struct lttng_kernel_event ev;
-		desc = table[i].desc;
-
-		if (!desc) {
+		if (!table[i].desc) {
 			/* Unknown syscall */
 			continue;
 		}
 		/*
-		 * Skip those already populated by previous failed
-		 * register for this channel.
+		 * Skip those already populated by previous register for
+		 * this channel.
 		 */
 		if (chan_table[i])
 			continue;
-		memset(&ev, 0, sizeof(ev));
-		switch (type) {
-		case SC_TYPE_ENTRY:
-			strncpy(ev.name, SYSCALL_ENTRY_STR,
-				LTTNG_KERNEL_SYM_NAME_LEN);
-			break;
-		case SC_TYPE_EXIT:
-			strncpy(ev.name, SYSCALL_EXIT_STR,
-				LTTNG_KERNEL_SYM_NAME_LEN);
-			break;
-		case SC_TYPE_COMPAT_ENTRY:
-			strncpy(ev.name, COMPAT_SYSCALL_ENTRY_STR,
-				LTTNG_KERNEL_SYM_NAME_LEN);
-			break;
-		case SC_TYPE_COMPAT_EXIT:
-			strncpy(ev.name, COMPAT_SYSCALL_EXIT_STR,
-				LTTNG_KERNEL_SYM_NAME_LEN);
-			break;
-		default:
-			BUG_ON(1);
-			break;
-		}
-		strncat(ev.name, desc->name,
-			LTTNG_KERNEL_SYM_NAME_LEN - strlen(ev.name) - 1);
-		ev.name[LTTNG_KERNEL_SYM_NAME_LEN - 1] = '\0';
-		ev.instrumentation = LTTNG_KERNEL_SYSCALL;
-		chan_table[i] = _lttng_event_create(chan, &ev, filter,
-						desc, ev.instrumentation);
-		WARN_ON_ONCE(!chan_table[i]);
-		if (IS_ERR(chan_table[i])) {
+		if (lttng_desc_match_enabler(table[i].desc, enabler) <= 0)
+			continue;
+		ret = create_syscall_event(table, i, chan_table, chan, type);
+		if (ret) {
 			/*
 			 * If something goes wrong in event registration
 			 * after the first one, we have no choice but to
 			 * leave the previous events in there, until
 			 * deleted by session teardown.
 			 */
-			return PTR_ERR(chan_table[i]);
+			return ret;
 		}
 	}
 	return 0;
 }
 
+/*
+ * Whether a system call event descriptor matches a syscall enabler of
+ * the channel.
+ */
+static
+bool syscall_desc_match_chan(const struct lttng_event_desc *desc,
+	struct lttng_channel *chan)
+{
+	struct lttng_enabler *enabler;
+
+	list_for_each_entry(enabler, &chan->session->enablers_head, node) {
+		if (enabler->chan == chan
+		    && enabler->event_param.instrumentation == LTTNG_KERNEL_SYSCALL
+		    && lttng_desc_match_enabler(desc, enabler) > 0)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Create the missing events of the system calls hit at least once.
+ * Should be called with sessions lock held.
+ */
+static
+int fill_table_hit(const struct trace_syscall_entry *table, size_t table_len,
+	struct lttng_event **chan_table, struct lttng_channel *chan,
+	const unsigned long *hit, enum sc_type type)
+{
+	unsigned int i;
+	int ret;
+
+	for_each_set_bit(i, hit, table_len) {
+		if (!table[i].desc || chan_table[i])
+			continue;
+		if (!syscall_desc_match_chan(table[i].desc, chan))
+			continue;
+		ret = create_syscall_event(table, i, chan_table, chan, type);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static
+void syscall_lazy_work(struct work_struct *work)
+{
+	struct lttng_syscall_lazy *lazy = container_of(work,
+			struct lttng_syscall_lazy, work.work);
+	struct lttng_channel *chan = lazy->chan;
+	int ret;
+
+	/*
+	 * Session destruction cancels this work with the sessions lock
+	 * held: retry later rather than wait for it.
+	 */
+	if (!lttng_trylock_sessions()) {
+		schedule_delayed_work(&lazy->work, 1);
+		return;
+	}
+	lttng_lock_session(chan->session);
+	if (!lazy->enabled)
+		goto unlock;
+	ret = fill_table_hit(sc_table, ARRAY_SIZE(sc_table),
+			chan->sc_table, chan, lazy->sc_hit, SC_TYPE_ENTRY);
+	if (ret)
+		goto sync;
+	ret = fill_table_hit(sc_exit_table, ARRAY_SIZE(sc_exit_table),
+			chan->sc_exit_table, chan, lazy->sc_exit_hit,
+			SC_TYPE_EXIT);
+	if (ret)
+		goto sync;
+#ifdef CONFIG_COMPAT
+	ret = fill_table_hit(compat_sc_table, ARRAY_SIZE(compat_sc_table),
+			chan->compat_sc_table, chan, lazy->compat_sc_hit,
+			SC_TYPE_COMPAT_ENTRY);
+	if (ret)
+		goto sync;
+	ret = fill_table_hit(compat_sc_exit_table,
+			ARRAY_SIZE(compat_sc_exit_table),
+			chan->compat_sc_exit_table, chan,
+			lazy->compat_sc_exit_hit, SC_TYPE_COMPAT_EXIT);
+#endif
+sync:
+	WARN_ON_ONCE(ret);
+	/* Reference and enable the new events, then dispatch to them. */
+	lttng_session_fix_pending_events(chan->session);
+	update_dispatch(chan);
+unlock:
+	lttng_unlock_session(chan->session);
+	lttng_unlock_sessions();
+}
+
+/*
+ * Defer the creation of the events of a star-glob enabler to the first
+ * hit of each system call. The system calls already hit are checked
+ * again against the new enabler.
+ * Should be called with sessions lock held.
+ */
+static
+int syscall_lazy_enable(struct lttng_channel *chan,
+	struct lttng_enabler *enabler)
+{
+	struct lttng_syscall_lazy *lazy = chan->sc_lazy;
+
+	if (!lazy) {
+		lazy = kzalloc(sizeof(*lazy), GFP_KERNEL);
+		if (!lazy)
+			return -ENOMEM;
+		lazy->chan = chan;
+		lazy->enabled = 1;
+		INIT_DELAYED_WORK(&lazy->work, syscall_lazy_work);
+		chan->sc_lazy = lazy;
+	}
+	if (enabler->syscall_lazy)
+		return 0;
+	enabler->syscall_lazy = 1;
+	bitmap_zero(lazy->sc_hit, NR_syscalls);
+	bitmap_zero(lazy->sc_exit_hit, NR_syscalls);
+	bitmap_zero(lazy->compat_sc_hit, NR_compat_syscalls);
+	bitmap_zero(lazy->compat_sc_exit_hit, NR_compat_syscalls);
+	return 0;
+}
+
+/*
+ * Should be called with sessions lock held.
+ */
+static
+int create_latency_events(struct lttng_channel *chan)
+{
+	struct lttng_syscall_latency *latency = chan->sc_latency;
+	struct lttng_kernel_event ev;
+
+	if (!latency->event) {
+		const struct lttng_event_desc *desc =
+			&__event_desc___syscall_exit_latency;
+		struct lttng_event *event;
+
+		memset(&ev, 0, sizeof(ev));
+		strncpy(ev.name, desc->name, LTTNG_KERNEL_SYM_NAME_LEN);
+		ev.name[LTTNG_KERNEL_SYM_NAME_LEN - 1] = '\0';
+		ev.instrumentation = LTTNG_KERNEL_SYSCALL;
+		event = _lttng_event_create(chan, &ev, NULL, desc,
+					ev.instrumentation);
+		if (IS_ERR(event))
+			return PTR_ERR(event);
+		latency->event = event;
+	}
+	if (!latency->compat_event) {
+		const struct lttng_event_desc *desc =
+			&__event_desc___compat_syscall_exit_latency;
+		struct lttng_event *event;
+
+		memset(&ev, 0, sizeof(ev));
+		strncpy(ev.name, desc->name, LTTNG_KERNEL_SYM_NAME_LEN);
+		ev.name[LTTNG_KERNEL_SYM_NAME_LEN - 1] = '\0';
+		ev.instrumentation = LTTNG_KERNEL_SYSCALL;
+		event = _lttng_event_create(chan, &ev, NULL, desc,
+					ev.instrumentation);
+		if (IS_ERR(event))
+			return PTR_ERR(event);
+		latency->compat_event = event;
+	}
+	return 0;
+}
+
+/*
+ * Should be called with sessions lock held.
+ */
+static
+int create_summary_events(struct lttng_channel *chan)
+{
+	struct lttng_syscall_summary *summary = chan->sc_summary;
+	struct lttng_kernel_event ev;
+
+	if (!summary->event) {
+		const struct lttng_event_desc *desc =
+			&__event_desc___syscall_summary;
+		struct lttng_event *event;
+
+		memset(&ev, 0, sizeof(ev));
+		strncpy(ev.name, desc->name, LTTNG_KERNEL_SYM_NAME_LEN);
+		ev.name[LTTNG_KERNEL_SYM_NAME_LEN - 1] = '\0';
+		ev.instrumentation = LTTNG_KERNEL_SYSCALL;
+		event = _lttng_event_create(chan, &ev, NULL, desc,
+					ev.instrumentation);
+		if (IS_ERR(event))
+			return PTR_ERR(event);
+		summary->event = event;
+	}
+	if (!summary->compat_event) {
+		const struct lttng_event_desc *desc =
+			&__event_desc___compat_syscall_summary;
+		struct lttng_event *event;
+
+		memset(&ev, 0, sizeof(ev));
+		strncpy(ev.name, desc->name, LTTNG_KERNEL_SYM_NAME_LEN);
+		ev.name[LTTNG_KERNEL_SYM_NAME_LEN - 1] = '\0';
+		ev.instrumentation = LTTNG_KERNEL_SYSCALL;
+		event = _lttng_event_create(chan, &ev, NULL, desc,
+					ev.instrumentation);
+		if (IS_ERR(event))
+			return PTR_ERR(event);
+		summary->compat_event = event;
+	}
+	return 0;
+}
+
 /*
  * Should be called with sessions lock held.
  */
-int lttng_syscalls_register(struct lttng_channel *chan, void *filter)
+int lttng_syscalls_register(struct lttng_channel *chan,
+		struct lttng_enabler *enabler)
 {
 	struct lttng_kernel_event ev;
 	int ret;
@@ -763,7 +1619,18 @@ int lttng_syscalls_register(struct lttng_channel *chan, void *filter)
 		if (!chan->sc_exit_table)
 			return -ENOMEM;
 	}
-
+	if (!chan->sc_dispatch) {
+		chan->sc_dispatch = kzalloc(sizeof(struct lttng_syscall_dispatch)
+					* ARRAY_SIZE(sc_table), GFP_KERNEL);
+		if (!chan->sc_dispatch)
+			return -ENOMEM;
+	}
+	if (!chan->sc_exit_dispatch) {
+		chan->sc_exit_dispatch = kzalloc(sizeof(struct lttng_syscall_dispatch)
+					* ARRAY_SIZE(sc_exit_table), GFP_KERNEL);
+		if (!chan->sc_exit_dispatch)
+			return -ENOMEM;
+	}
 
 #ifdef CONFIG_COMPAT
 	if (!chan->compat_sc_table) {
@@ -781,6 +1648,18 @@ int lttng_syscalls_register(struct lttng_channel *chan, void *filter)
 		if (!chan->compat_sc_exit_table)
 			return -ENOMEM;
 	}
+	if (!chan->compat_sc_dispatch) {
+		chan->compat_sc_dispatch = kzalloc(sizeof(struct lttng_syscall_dispatch)
+					* ARRAY_SIZE(compat_sc_table), GFP_KERNEL);
+		if (!chan->compat_sc_dispatch)
+			return -ENOMEM;
+	}
+	if (!chan->compat_sc_exit_dispatch) {
+		chan->compat_sc_exit_dispatch = kzalloc(sizeof(struct lttng_syscall_dispatch)
+					* ARRAY_SIZE(compat_sc_exit_table), GFP_KERNEL);
+		if (!chan->compat_sc_exit_dispatch)
+			return -ENOMEM;
+	}
 #endif
 	if (!chan->sc_unknown) {
 		const struct lttng_event_desc *desc =
@@ -849,83 +1728,213 @@ int lttng_syscalls_register(struct lttng_channel *chan, void *filter)
 		}
 	}
 
+	if (chan->sc_latency) {
+		ret = create_latency_events(chan);
+		if (ret)
+			return ret;
+	}
+
+	if (chan->sc_summary) {
+		ret = create_summary_events(chan);
+		if (ret)
+			return ret;
+	}
+
+	/*
+	 * The latency and summary modes account system calls through
+	 * their events, which are then all created upfront.
+	 */
+	if (enabler->type == LTTNG_ENABLER_STAR_GLOB
+			&& !chan->sc_latency && !chan->sc_summary) {
+		ret = syscall_lazy_enable(chan, enabler);
+		if (ret)
+			return ret;
+		goto dispatch;
+	}
 	ret = fill_table(sc_table, ARRAY_SIZE(sc_table),
-			chan->sc_table, chan, filter, SC_TYPE_ENTRY);
+			chan->sc_table, chan, enabler, SC_TYPE_ENTRY);
 	if (ret)
 		return ret;
 	ret = fill_table(sc_exit_table, ARRAY_SIZE(sc_exit_table),
-			chan->sc_exit_table, chan, filter, SC_TYPE_EXIT);
+			chan->sc_exit_table, chan, enabler, SC_TYPE_EXIT);
 	if (ret)
 		return ret;
 
 #ifdef CONFIG_COMPAT
 	ret = fill_table(compat_sc_table, ARRAY_SIZE(compat_sc_table),
-			chan->compat_sc_table, chan, filter,
+			chan->compat_sc_table, chan, enabler,
 			SC_TYPE_COMPAT_ENTRY);
 	if (ret)
 		return ret;
 	ret = fill_table(compat_sc_exit_table, ARRAY_SIZE(compat_sc_exit_table),
-			chan->compat_sc_exit_table, chan, filter,
+			chan->compat_sc_exit_table, chan, enabler,
 			SC_TYPE_COMPAT_EXIT);
 	if (ret)
 		return ret;
 #endif
-	if (!chan->sys_enter_registered) {
-		ret = lttng_wrapper_tracepoint_probe_register("sys_enter",
-				(void *) syscall_entry_probe, chan);
-		if (ret)
-			return ret;
-		chan->sys_enter_registered = 1;
-	}
-	/*
-	 * We change the name of sys_exit tracepoint due to namespace
-	 * conflict with sys_exit syscall entry.
-	 */
-	if (!chan->sys_exit_registered) {
-		ret = lttng_wrapper_tracepoint_probe_register("sys_exit",
-				(void *) syscall_exit_probe, chan);
-		if (ret) {
-			WARN_ON_ONCE(lttng_wrapper_tracepoint_probe_unregister("sys_enter",
-				(void *) syscall_entry_probe, chan));
-			return ret;
-		}
-		chan->sys_exit_registered = 1;
-	}
+dispatch:
+	/* Publish the dispatch tables before the probes can use them. */
+	update_dispatch(chan);
+	if (!chan->sc_listed)
+		ret = syscall_chans_add(chan);
 	return ret;
 }
 
 /*
- * Only called at session destruction.
+ * Only called at session destruction. The probes can still run on the
+ * channel until the next synchronize_trace(): its tables are freed at
+ * channel destruction.
  */
 int lttng_syscalls_unregister(struct lttng_channel *chan)
 {
 	int ret;
 
-	if (!chan->sc_table)
-		return 0;
-	if (chan->sys_enter_registered) {
-		ret = lttng_wrapper_tracepoint_probe_unregister("sys_exit",
-				(void *) syscall_exit_probe, chan);
+	if (chan->sc_listed) {
+		ret = syscall_chans_remove(chan);
 		if (ret)
 			return ret;
-		chan->sys_enter_registered = 0;
 	}
-	if (chan->sys_exit_registered) {
-		ret = lttng_wrapper_tracepoint_probe_unregister("sys_enter",
-				(void *) syscall_entry_probe, chan);
-		if (ret)
-			return ret;
-		chan->sys_exit_registered = 0;
+	if (chan->sc_lazy)
+		chan->sc_lazy->enabled = 0;
+	return 0;
+}
+
+/*
+ * Called at channel destruction, after the probes completed.
+ */
+void lttng_syscalls_destroy(struct lttng_channel *chan)
+{
+	struct lttng_syscall_lazy *lazy = chan->sc_lazy;
+
+	if (lazy) {
+		/* The work does not wait for the sessions lock. */
+		cancel_delayed_work_sync(&lazy->work);
+		kfree(lazy);
+		chan->sc_lazy = NULL;
 	}
 	/* lttng_event destroy will be performed by lttng_session_destroy() */
 	kfree(chan->sc_table);
 	kfree(chan->sc_exit_table);
+	kfree(chan->sc_dispatch);
+	kfree(chan->sc_exit_dispatch);
 #ifdef CONFIG_COMPAT
 	kfree(chan->compat_sc_table);
 	kfree(chan->compat_sc_exit_table);
+	kfree(chan->compat_sc_dispatch);
+	kfree(chan->compat_sc_exit_dispatch);
 #endif
 	kfree(chan->sc_filter);
-	return 0;
+	lttng_kvfree(chan->sc_latency);
+	syscall_summary_free(chan->sc_summary);
+	syscall_pid_masks_free(chan->sc_pid_masks);
+}
+
+/*
+ * The latency mode can only be changed before the session is first
+ * started, so the probes never see the state change.
+ */
+int lttng_channel_set_syscall_latency(struct lttng_channel *chan,
+		struct lttng_kernel_syscall_latency *param)
+{
+	struct lttng_syscall_latency *latency;
+	uint64_t freq = trace_clock_freq(), threshold = param->threshold;
+	int ret = 0;
+
+	if (chan->channel_type == METADATA_CHANNEL)
+		return -EPERM;
+	/* Convert to trace clock units. */
+	if (threshold && freq != NSEC_PER_SEC) {
+		if (threshold > div64_u64(U64_MAX, freq))
+			return -EINVAL;
+		threshold = div64_u64(threshold * freq, NSEC_PER_SEC);
+	}
+	lttng_lock_sessions();
+	lttng_lock_session(chan->session);
+	if (chan->session->been_active) {
+		ret = -EBUSY;
+		goto unlock;
+	}
+	if (!param->enable) {
+		if (chan->sc_latency)
+			chan->sc_latency->enabled = 0;
+		goto unlock;
+	}
+	if (!chan->sc_latency) {
+		latency = lttng_kvzalloc(sizeof(*latency), GFP_KERNEL);
+		if (!latency) {
+			ret = -ENOMEM;
+			goto unlock;
+		}
+		chan->sc_latency = latency;
+	}
+	latency = chan->sc_latency;
+	/* Syscall events already created: add the latency events now. */
+	if (chan->sc_table) {
+		ret = create_latency_events(chan);
+		if (ret)
+			goto unlock;
+	}
+	latency->threshold = threshold;
+	latency->enabled = 1;
+unlock:
+	lttng_unlock_session(chan->session);
+	lttng_unlock_sessions();
+	return ret;
+}
+
+/*
+ * As the latency mode, the summary mode can only be changed before the
+ * session is first started.
+ */
+int lttng_channel_set_syscall_summary(struct lttng_channel *chan,
+		struct lttng_kernel_syscall_summary *param)
+{
+	struct lttng_syscall_summary *summary;
+	uint64_t freq = trace_clock_freq(), period = param->period;
+	int ret = 0;
+
+	if (chan->channel_type == METADATA_CHANNEL)
+		return -EPERM;
+	/* Convert to trace clock units. */
+	if (period && freq != NSEC_PER_SEC) {
+		if (period > div64_u64(U64_MAX, freq))
+			return -EINVAL;
+		period = div64_u64(period * freq, NSEC_PER_SEC);
+	}
+	lttng_lock_sessions();
+	lttng_lock_session(chan->session);
+	if (chan->session->been_active) {
+		ret = -EBUSY;
+		goto unlock;
+	}
+	if (!param->enable) {
+		if (chan->sc_summary)
+			chan->sc_summary->enabled = 0;
+		goto unlock;
+	}
+	if (!chan->sc_summary) {
+		summary = syscall_summary_alloc();
+		if (!summary) {
+			ret = -ENOMEM;
+			goto unlock;
+		}
+		chan->sc_summary = summary;
+		/* Ensure the memory we just allocated don't trigger page faults */
+		wrapper_vmalloc_sync_all();
+	}
+	summary = chan->sc_summary;
+	/* Syscall events already created: add the summary events now. */
+	if (chan->sc_table) {
+		ret = create_summary_events(chan);
+		if (ret)
+			goto unlock;
+	}
+	summary->period = period;
+	summary->enabled = 1;
+unlock:
+	lttng_unlock_session(chan->session);
+	lttng_unlock_sessions();
+	return ret;
 }
 
 static
@@ -997,6 +2006,7 @@ int lttng_syscall_filter_enable(struct lttng_channel *chan,
 			kfree(filter);
 		}
 		chan->syscall_all = 1;
+		update_dispatch(chan);
 		return 0;
 	}
 
@@ -1036,6 +2046,7 @@ int lttng_syscall_filter_enable(struct lttng_channel *chan,
 	}
 	if (!chan->sc_filter)
 		rcu_assign_pointer(chan->sc_filter, filter);
+	update_dispatch(chan);
 	return 0;
 
 error:
@@ -1104,6 +2115,7 @@ apply_filter:
 	if (!chan->sc_filter)
 		rcu_assign_pointer(chan->sc_filter, filter);
 	chan->syscall_all = 0;
+	update_dispatch(chan);
 	return 0;
 
 error:
@@ -1223,6 +2235,39 @@ const struct file_operations lttng_syscall_list_fops = {
 	.release = seq_release,
 };
 
+/*
+ * Binary counterpart of the system call list file.
+ */
+int lttng_syscalls_list_binary(struct lttng_event_list_writer *writer)
+{
+	const struct trace_syscall_entry *table, *entry;
+	unsigned int bitness;
+	unsigned long index;
+	const char *name;
+	loff_t pos;
+	int ret;
+
+	for (pos = 0; (entry = syscall_list_get_entry(&pos)); pos++) {
+		ret = get_sc_table(entry, &table, &bitness);
+		if (ret)
+			return ret;
+		if (!entry->desc)
+			continue;
+		if (table == sc_table) {
+			index = entry - table;
+			name = &entry->desc->name[strlen(SYSCALL_ENTRY_STR)];
+		} else {
+			index = (entry - table) + ARRAY_SIZE(sc_table);
+			name = &entry->desc->name[strlen(COMPAT_SYSCALL_ENTRY_STR)];
+		}
+		ret = lttng_event_list_append(writer, entry->desc, name,
+				index, bitness);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
 long lttng_channel_syscall_mask(struct lttng_channel *channel,
 		struct lttng_kernel_syscall_mask __user *usyscall_mask)
 {
@@ -1278,6 +2323,104 @@ long lttng_channel_syscall_mask(struct lttng_channel *channel,
 	return ret;
 }
 
+/*
+ * Set, replace or remove (len 0) the syscall mask of a process. The
+ * mask is laid out as for lttng_channel_syscall_mask(): native syscalls
+ * first, followed by compat syscalls.
+ */
+long lttng_channel_pid_syscall_mask(struct lttng_channel *chan,
+		struct lttng_kernel_pid_syscall_mask __user *umask)
+{
+	struct lttng_syscall_pid_masks *masks;
+	struct lttng_syscall_pid_mask *e = NULL, *old = NULL, *iter;
+	struct hlist_head *head;
+	uint32_t len, sc_tables_len;
+	char *tmp_mask = NULL;
+	int32_t pid;
+	int bit;
+	long ret;
+
+	if (chan->channel_type == METADATA_CHANNEL)
+		return -EPERM;
+	if (get_user(pid, &umask->pid) || get_user(len, &umask->len))
+		return -EFAULT;
+	if (pid < 0 || len > LTTNG_SYSCALL_PID_MASK_MAX_LEN)
+		return -EINVAL;
+	if (len) {
+		tmp_mask = kzalloc(ALIGN(len, 8) >> 3, GFP_KERNEL);
+		e = kzalloc(sizeof(*e), GFP_KERNEL);
+		if (!tmp_mask || !e) {
+			ret = -ENOMEM;
+			goto end;
+		}
+		if (copy_from_user(tmp_mask, umask->mask, ALIGN(len, 8) >> 3)) {
+			ret = -EFAULT;
+			goto end;
+		}
+		e->pid = pid;
+		sc_tables_len = min_t(uint32_t, len, get_sc_tables_len());
+		for (bit = 0; bit < sc_tables_len; bit++) {
+			char state;
+
+			bt_bitfield_read_be(tmp_mask, char, bit, 1, &state);
+			if (!state)
+				continue;
+			if (bit < ARRAY_SIZE(sc_table)) {
+				if (bit < NR_syscalls)
+					set_bit(bit, e->sc);
+			} else if (bit - ARRAY_SIZE(sc_table) < NR_compat_syscalls) {
+				set_bit(bit - ARRAY_SIZE(sc_table), e->sc_compat);
+			}
+		}
+	}
+
+	lttng_lock_session(chan->session);
+	masks = chan->sc_pid_masks;
+	if (!masks) {
+		if (!len) {
+			ret = -ENOENT;
+			goto unlock;
+		}
+		masks = kzalloc(sizeof(*masks), GFP_KERNEL);
+		if (!masks) {
+			ret = -ENOMEM;
+			goto unlock;
+		}
+		rcu_assign_pointer(chan->sc_pid_masks, masks);
+	}
+	head = syscall_pid_mask_head(masks, pid);
+	lttng_hlist_for_each_entry(iter, head, hlist) {
+		if (iter->pid == pid) {
+			old = iter;
+			break;
+		}
+	}
+	if (e) {
+		if (old)
+			hlist_replace_rcu(&old->hlist, &e->hlist);
+		else
+			hlist_add_head_rcu(&e->hlist, head);
+		e = NULL;
+	} else if (old) {
+		hlist_del_rcu(&old->hlist);
+	} else {
+		ret = -ENOENT;
+		goto unlock;
+	}
+	ret = 0;
+	if (old) {
+		/* Wait for the probes still using the previous mask. */
+		synchronize_trace();
+		kfree(old);
+	}
+unlock:
+	lttng_unlock_session(chan->session);
+end:
+	kfree(e);
+	kfree(tmp_mask);
+	return ret;
+}
+
 int lttng_abi_syscall_list(void)
 {
 	struct file *syscall_list_file;
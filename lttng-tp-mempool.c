@@ -7,25 +7,132 @@
 
 #include <linux/slab.h>
 #include <linux/percpu.h>
+#include <linux/hardirq.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <lttng-tp-mempool.h>
 
-struct lttng_tp_buf_entry {
-	int cpu; /* To make sure we return the entry to the right pool. */
-	char buf[LTTNG_TP_MEMPOOL_BUF_SIZE];
-	struct list_head list;
+enum lttng_tp_mempool_level {
+	LTTNG_TP_MEMPOOL_LEVEL_THREAD = 0,
+	LTTNG_TP_MEMPOOL_LEVEL_SOFTIRQ = 1,
+	LTTNG_TP_MEMPOOL_LEVEL_IRQ = 2,
+	LTTNG_TP_MEMPOOL_LEVEL_NMI = 3,
+};
+
+static const char *level_name[LTTNG_TP_MEMPOOL_NR_LEVELS] = {
+	[LTTNG_TP_MEMPOOL_LEVEL_THREAD] = "thread",
+	[LTTNG_TP_MEMPOOL_LEVEL_SOFTIRQ] = "softirq",
+	[LTTNG_TP_MEMPOOL_LEVEL_IRQ] = "irq",
+	[LTTNG_TP_MEMPOOL_LEVEL_NMI] = "nmi",
+};
+
+static const size_t class_size[LTTNG_TP_MEMPOOL_NR_CLASSES] = {
+	256, 4096, LTTNG_TP_MEMPOOL_BUF_SIZE,
 };
 
 /*
- * No exclusive access strategy for now, this memory pool is currently only
- * used from a non-preemptible context, and the interrupt tracepoint probes do
- * not use this facility.
+ * Slots per cpu of each size class, for each nesting level. Interrupt
+ * and NMI probes seldom need large buffers.
  */
+static const unsigned int class_slots[LTTNG_TP_MEMPOOL_NR_LEVELS][LTTNG_TP_MEMPOOL_NR_CLASSES] = {
+	[LTTNG_TP_MEMPOOL_LEVEL_THREAD] = { 8, 4, 1 },
+	[LTTNG_TP_MEMPOOL_LEVEL_SOFTIRQ] = { 4, 2, 1 },
+	[LTTNG_TP_MEMPOOL_LEVEL_IRQ] = { 4, 2, 0 },
+	[LTTNG_TP_MEMPOOL_LEVEL_NMI] = { 2, 1, 0 },
+};
+
+/*
+ * Slots of a size class, for one nesting level of a cpu, allocated as a
+ * single block. No exclusive access strategy: each nesting level has its
+ * own slots, and a level cannot be re-entered on a cpu while the probe
+ * is non-preemptible.
+ */
+struct lttng_tp_buf_class {
+	char *base;				/* Slots memory, or NULL */
+	unsigned long free_mask;		/* Free slots */
+	/* Statistics. */
+	unsigned long nr_alloc;			/* Successful allocations */
+	unsigned long nr_fail;			/* Allocations without a slot */
+	unsigned int in_use, max_in_use;
+};
+
 struct per_cpu_buf {
-	struct list_head free_list; /* Free struct lttng_tp_buf_entry. */
+	struct lttng_tp_buf_class class[LTTNG_TP_MEMPOOL_NR_LEVELS][LTTNG_TP_MEMPOOL_NR_CLASSES];
 };
 
 static struct per_cpu_buf __percpu *pool; /* Per-cpu buffer. */
+static struct dentry *stats_dentry;
+
+static
+enum lttng_tp_mempool_level lttng_tp_mempool_level(void)
+{
+	if (in_nmi())
+		return LTTNG_TP_MEMPOOL_LEVEL_NMI;
+	if (in_irq())
+		return LTTNG_TP_MEMPOOL_LEVEL_IRQ;
+	if (in_softirq())
+		return LTTNG_TP_MEMPOOL_LEVEL_SOFTIRQ;
+	return LTTNG_TP_MEMPOOL_LEVEL_THREAD;
+}
+
+static
+int lttng_tp_mempool_stats_show(struct seq_file *m, void *p)
+{
+	int level, i, cpu;
+
+	seq_printf(m, "%-8s %8s %6s %12s %12s %8s\n",
+		"level", "size", "slots", "alloc", "fail", "max");
+	for (level = 0; level < LTTNG_TP_MEMPOOL_NR_LEVELS; level++) {
+		for (i = 0; i < LTTNG_TP_MEMPOOL_NR_CLASSES; i++) {
+			unsigned long nr_alloc = 0, nr_fail = 0;
+			unsigned int max_in_use = 0;
+
+			for_each_possible_cpu(cpu) {
+				struct lttng_tp_buf_class *c =
+					&per_cpu_ptr(pool, cpu)->class[level][i];
+
+				nr_alloc += READ_ONCE(c->nr_alloc);
+				nr_fail += READ_ONCE(c->nr_fail);
+				max_in_use = max(max_in_use,
+						READ_ONCE(c->max_in_use));
+			}
+			seq_printf(m, "%-8s %8zu %6u %12lu %12lu %8u\n",
+				level_name[level], class_size[i],
+				class_slots[level][i], nr_alloc, nr_fail,
+				max_in_use);
+		}
+	}
+	return 0;
+}
+
+size_t lttng_tp_mempool_mem_usage(void)
+{
+	size_t bytes = 0;
+	int level, i;
+
+	if (!pool)
+		return 0;
+	for (level = 0; level < LTTNG_TP_MEMPOOL_NR_LEVELS; level++) {
+		for (i = 0; i < LTTNG_TP_MEMPOOL_NR_CLASSES; i++)
+			bytes += class_slots[level][i] * class_size[i];
+	}
+	return (bytes + sizeof(struct per_cpu_buf)) * num_possible_cpus();
+}
+
+static
+int lttng_tp_mempool_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, lttng_tp_mempool_stats_show, NULL);
+}
+
+static const struct file_operations lttng_tp_mempool_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = lttng_tp_mempool_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
 
 int lttng_tp_mempool_init(void)
 {
@@ -46,28 +153,34 @@ int lttng_tp_mempool_init(void)
 
 	for_each_possible_cpu(cpu) {
 		struct per_cpu_buf *cpu_buf = per_cpu_ptr(pool, cpu);
+		int level, i;
 
-		INIT_LIST_HEAD(&cpu_buf->free_list);
-	}
+		for (level = 0; level < LTTNG_TP_MEMPOOL_NR_LEVELS; level++) {
+			for (i = 0; i < LTTNG_TP_MEMPOOL_NR_CLASSES; i++) {
+				struct lttng_tp_buf_class *c =
+					&cpu_buf->class[level][i];
+				unsigned int nr_slots = class_slots[level][i];
 
-	for_each_possible_cpu(cpu) {
-		int i;
-		struct per_cpu_buf *cpu_buf = per_cpu_ptr(pool, cpu);
-
-		for (i = 0; i < LTTNG_TP_MEMPOOL_NR_BUF_PER_CPU; i++) {
-			struct lttng_tp_buf_entry *entry;
-
-			entry = kzalloc_node(sizeof(struct lttng_tp_buf_entry),
-					GFP_KERNEL, cpu_to_node(cpu));
-			if (!entry) {
-				ret = -ENOMEM;
-				goto error_free_pool;
+				BUILD_BUG_ON(LTTNG_TP_MEMPOOL_MAX_SLOTS > BITS_PER_LONG);
+				if (!nr_slots)
+					continue;
+				c->base = kzalloc_node(nr_slots * class_size[i],
+						GFP_KERNEL, cpu_to_node(cpu));
+				if (!c->base) {
+					ret = -ENOMEM;
+					goto error_free_pool;
+				}
+				c->free_mask = (1UL << nr_slots) - 1;
 			}
-			entry->cpu = cpu;
-			list_add_tail(&entry->list, &cpu_buf->free_list);
 		}
 	}
 
+	/* Statistics are optional. */
+	stats_dentry = debugfs_create_file("lttng-tp-mempool", 0444, NULL,
+			NULL, &lttng_tp_mempool_stats_fops);
+	if (IS_ERR(stats_dentry))
+		stats_dentry = NULL;
+
 	ret = 0;
 	goto end;
 
@@ -85,74 +198,122 @@ void lttng_tp_mempool_destroy(void)
 		return;
 	}
 
+	debugfs_remove(stats_dentry);
+	stats_dentry = NULL;
 	for_each_possible_cpu(cpu) {
 		struct per_cpu_buf *cpu_buf = per_cpu_ptr(pool, cpu);
-		struct lttng_tp_buf_entry *entry, *tmp;
-		int i = 0;
+		int level, i;
 
-		list_for_each_entry_safe(entry, tmp, &cpu_buf->free_list, list) {
-			list_del(&entry->list);
-			kfree(entry);
-			i++;
-		}
-		if (i < LTTNG_TP_MEMPOOL_NR_BUF_PER_CPU) {
-			printk(KERN_WARNING "Leak detected in tp-mempool\n");
+		for (level = 0; level < LTTNG_TP_MEMPOOL_NR_LEVELS; level++) {
+			for (i = 0; i < LTTNG_TP_MEMPOOL_NR_CLASSES; i++) {
+				struct lttng_tp_buf_class *c =
+					&cpu_buf->class[level][i];
+
+				if (c->in_use) {
+					printk(KERN_WARNING "Leak detected in tp-mempool\n");
+				}
+				kfree(c->base);
+			}
 		}
 	}
 	free_percpu(pool);
 	pool = NULL;
 }
 
-void *lttng_tp_mempool_alloc(size_t size)
+void *lttng_tp_mempool_alloc_raw(size_t size)
 {
-	void *ret;
-	struct lttng_tp_buf_entry *entry;
-	struct per_cpu_buf *cpu_buf;
-	int cpu = smp_processor_id();
+	struct per_cpu_buf *cpu_buf = this_cpu_ptr(pool);
+	struct lttng_tp_buf_class *classes =
+		cpu_buf->class[lttng_tp_mempool_level()];
+	int i, first;
 
-	if (size > LTTNG_TP_MEMPOOL_BUF_SIZE) {
-		ret = NULL;
-		goto end;
+	for (first = 0; first < LTTNG_TP_MEMPOOL_NR_CLASSES; first++) {
+		if (size <= class_size[first])
+			break;
 	}
+	if (first == LTTNG_TP_MEMPOOL_NR_CLASSES)
+		return NULL;
 
-	cpu_buf = per_cpu_ptr(pool, cpu);
-	if (list_empty(&cpu_buf->free_list)) {
-		ret = NULL;
-		goto end;
+	/* Fall back on the larger classes when all slots are in use. */
+	for (i = first; i < LTTNG_TP_MEMPOOL_NR_CLASSES; i++) {
+		struct lttng_tp_buf_class *c = &classes[i];
+		unsigned int slot;
+
+		if (!c->free_mask)
+			continue;
+		slot = __ffs(c->free_mask);
+		c->free_mask &= ~(1UL << slot);
+		barrier();	/* reserve before use. */
+		c->nr_alloc++;
+		if (++c->in_use > c->max_in_use)
+			c->max_in_use = c->in_use;
+		return c->base + slot * class_size[i];
 	}
+	classes[first].nr_fail++;
+	return NULL;
+}
+
+void *lttng_tp_mempool_alloc(size_t size)
+{
+	void *ret;
 
-	entry = list_first_entry(&cpu_buf->free_list, struct lttng_tp_buf_entry, list);
-	/* Remove the entry from the free list. */
-	list_del(&entry->list);
+	ret = lttng_tp_mempool_alloc_raw(size);
+	if (ret)
+		memset(ret, 0, size);
+	return ret;
+}
 
-	memset(entry->buf, 0, LTTNG_TP_MEMPOOL_BUF_SIZE);
+/*
+ * Return the size class holding "ptr" on "cpu", and its slot in "slot",
+ * or NULL.
+ */
+static
+struct lttng_tp_buf_class *lttng_tp_mempool_find(int cpu, const char *ptr,
+		unsigned int *slot)
+{
+	struct per_cpu_buf *cpu_buf = per_cpu_ptr(pool, cpu);
+	int level, i;
 
-	ret = (void *) entry->buf;
+	for (level = 0; level < LTTNG_TP_MEMPOOL_NR_LEVELS; level++) {
+		for (i = 0; i < LTTNG_TP_MEMPOOL_NR_CLASSES; i++) {
+			struct lttng_tp_buf_class *c = &cpu_buf->class[level][i];
 
-end:
-	return ret;
+			if (ptr >= c->base && ptr < c->base
+					+ class_slots[level][i] * class_size[i]) {
+				*slot = (ptr - c->base) / class_size[i];
+				return c;
+			}
+		}
+	}
+	return NULL;
 }
 
 void lttng_tp_mempool_free(void *ptr)
 {
-	struct lttng_tp_buf_entry *entry;
-	struct per_cpu_buf *cpu_buf;
+	struct lttng_tp_buf_class *c;
+	unsigned int slot;
+	int cpu;
 
 	if (!ptr) {
 		goto end;
 	}
 
-	entry = container_of(ptr, struct lttng_tp_buf_entry, buf);
-	if (!entry) {
-		goto end;
+	/* Buffers are normally released on the cpu which allocated them. */
+	c = lttng_tp_mempool_find(smp_processor_id(), ptr, &slot);
+	if (unlikely(!c)) {
+		for_each_possible_cpu(cpu) {
+			c = lttng_tp_mempool_find(cpu, ptr, &slot);
+			if (c)
+				break;
+		}
 	}
-
-	cpu_buf = per_cpu_ptr(pool, entry->cpu);
-	if (!cpu_buf) {
+	if (WARN_ON_ONCE(!c)) {
 		goto end;
 	}
-	/* Add it to the free list. */
-	list_add_tail(&entry->list, &cpu_buf->free_list);
+	c->in_use--;
+	barrier();	/* use before un-reserve. */
+	/* Add it to the free slots. */
+	c->free_mask |= 1UL << slot;
 
 end:
 	return;
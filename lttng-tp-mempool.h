@@ -10,13 +10,21 @@
 
 #include <linux/percpu.h>
 
-#define LTTNG_TP_MEMPOOL_NR_BUF_PER_CPU 4
-#define LTTNG_TP_MEMPOOL_BUF_SIZE 4096
+/*
+ * The pool is a per-cpu arena of buffers of LTTNG_TP_MEMPOOL_NR_CLASSES
+ * size classes, the largest being LTTNG_TP_MEMPOOL_BUF_SIZE bytes. Each
+ * context nesting level (thread, softirq, irq and NMI) has its own slots
+ * in each class, so that a probe interrupting another one does not use
+ * its buffers.
+ */
+#define LTTNG_TP_MEMPOOL_NR_LEVELS	4
+#define LTTNG_TP_MEMPOOL_NR_CLASSES	3
+#define LTTNG_TP_MEMPOOL_MAX_SLOTS	8
+#define LTTNG_TP_MEMPOOL_BUF_SIZE	16384
 
 /*
- * Initialize the pool, only performed once. The pool is a set of
- * LTTNG_TP_MEMPOOL_NR_BUF_PER_CPU buffers of size LTTNG_TP_MEMPOOL_BUF_SIZE
- * per-cpu.
+ * Initialize the pool, only performed once, and its allocation
+ * statistics file in debugfs.
  *
  * Returns 0 on success, a negative value on error.
  */
@@ -28,23 +36,33 @@ int lttng_tp_mempool_init(void);
 void lttng_tp_mempool_destroy(void);
 
 /*
- * Ask for a buffer on the current cpu.
+ * Ask for a buffer on the current cpu, from the smallest size class
+ * holding "size" bytes with a free slot for the current nesting level.
  *
- * The pool is per-cpu, but there is no exclusive access guarantee on the
- * per-cpu free-list, the caller needs to ensure it cannot get preempted or
- * interrupted while performing the allocation.
+ * The pool is per-cpu and per nesting level, but there is no exclusive
+ * access guarantee within a level: the caller needs to ensure it cannot
+ * get preempted or migrated while the buffer is allocated.
  *
- * The maximum size that can be allocated is LTTNG_TP_MEMPOOL_BUF_SIZE, and the
- * maximum number of buffers allocated simultaneously on the same CPU is
- * LTTNG_TP_MEMPOOL_NR_BUF_PER_CPU.
+ * The maximum size that can be allocated is LTTNG_TP_MEMPOOL_BUF_SIZE.
  *
- * Return a pointer to a buffer on success, NULL on error.
+ * Return a pointer to a zeroed buffer on success, NULL on error.
  */
 void *lttng_tp_mempool_alloc(size_t size);
 
 /*
- * Release the memory reserved. Same concurrency limitations as the allocation.
+ * Same as lttng_tp_mempool_alloc(), without zeroing the buffer.
+ */
+void *lttng_tp_mempool_alloc_raw(size_t size);
+
+/*
+ * Release the memory reserved, from the nesting level which allocated
+ * it. Same concurrency limitations as the allocation.
  */
 void lttng_tp_mempool_free(void *ptr);
 
+/*
+ * Memory held by the pool on all cpus, in bytes.
+ */
+size_t lttng_tp_mempool_mem_usage(void);
+
 #endif /* LTTNG_TP_MEMPOOL_H */
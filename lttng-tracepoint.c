@@ -32,6 +32,18 @@ DEFINE_MUTEX(lttng_tracepoint_mutex);
 static
 struct hlist_head tracepoint_table[TRACEPOINT_TABLE_SIZE];
 
+/*
+ * Within a batch (see lttng_tracepoint_batch_begin()), the probes
+ * registered and unregistered on tracepoints present in the kernel are
+ * only marked pending, and the tracepoint entry queued on the batch
+ * list. Pairs of registration and unregistration of the same probe
+ * cancel out.
+ */
+static
+unsigned int lttng_tracepoint_batch_nesting;
+static
+LIST_HEAD(lttng_tracepoint_batch_list);
+
 /*
  * The tracepoint entry is the node contained within the hash table. It
  * is a mapping from the "string" key to the struct tracepoint pointer.
@@ -41,57 +53,67 @@ struct tracepoint_entry {
 	struct tracepoint *tp;
 	int refcount;
 	struct list_head probes;
+	struct list_head batch_node;	/* on lttng_tracepoint_batch_list */
 	char name[0];
 };
 
+enum lttng_tp_probe_pending {
+	LTTNG_TP_PROBE_SYNCED = 0,
+	LTTNG_TP_PROBE_ADD,		/* not registered on e->tp yet */
+	LTTNG_TP_PROBE_REMOVE,		/* still registered on e->tp */
+};
+
 struct lttng_tp_probe {
 	struct tracepoint_func tp_func;
 	struct list_head list;
+	enum lttng_tp_probe_pending pending;
 };
 
 static
-int add_probe(struct tracepoint_entry *e, void *probe, void *data)
+struct lttng_tp_probe *find_probe(struct tracepoint_entry *e,
+		void *probe, void *data)
 {
 	struct lttng_tp_probe *p;
-	int found = 0;
 
 	list_for_each_entry(p, &e->probes, list) {
-		if (p->tp_func.func == probe && p->tp_func.data == data) {
-			found = 1;
-			break;
-		}
+		if (p->tp_func.func == probe && p->tp_func.data == data)
+			return p;
 	}
-	if (found)
-		return -EEXIST;
+	return NULL;
+}
+
+static
+struct lttng_tp_probe *add_probe(struct tracepoint_entry *e,
+		void *probe, void *data)
+{
+	struct lttng_tp_probe *p;
+
+	if (find_probe(e, probe, data))
+		return ERR_PTR(-EEXIST);
 	p = kmalloc(sizeof(struct lttng_tp_probe), GFP_KERNEL);
 	if (!p)
-		return -ENOMEM;
+		return ERR_PTR(-ENOMEM);
 	p->tp_func.func = probe;
 	p->tp_func.data = data;
+	p->pending = LTTNG_TP_PROBE_SYNCED;
 	list_add(&p->list, &e->probes);
-	return 0;
+	return p;
 }
 
 static
-int remove_probe(struct tracepoint_entry *e, void *probe, void *data)
+void remove_probe(struct lttng_tp_probe *p)
 {
-	struct lttng_tp_probe *p;
-	int found = 0;
+	list_del(&p->list);
+	kfree(p);
+}
 
-	list_for_each_entry(p, &e->probes, list) {
-		if (p->tp_func.func == probe && p->tp_func.data == data) {
-			found = 1;
-			break;
-		}
-	}
-	if (found) {
-		list_del(&p->list);
-		kfree(p);
-		return 0;
-	} else {
-		WARN_ON(1);
-		return -ENOENT;
-	}
+static
+void batch_probe(struct tracepoint_entry *e, struct lttng_tp_probe *p,
+		enum lttng_tp_probe_pending pending)
+{
+	p->pending = pending;
+	if (list_empty(&e->batch_node))
+		list_add_tail(&e->batch_node, &lttng_tracepoint_batch_list);
 }
 
 /*
@@ -145,6 +167,7 @@ struct tracepoint_entry *add_tracepoint(const char *name)
 	e->tp = NULL;
 	e->refcount = 0;
 	INIT_LIST_HEAD(&e->probes);
+	INIT_LIST_HEAD(&e->batch_node);
 	hlist_add_head(&e->hlist, head);
 	return e;
 }
@@ -163,6 +186,7 @@ void remove_tracepoint(struct tracepoint_entry *e)
 int lttng_tracepoint_probe_register(const char *name, void *probe, void *data)
 {
 	struct tracepoint_entry *e;
+	struct lttng_tp_probe *p;
 	int ret = 0;
 
 	mutex_lock(&lttng_tracepoint_mutex);
@@ -174,12 +198,25 @@ int lttng_tracepoint_probe_register(const char *name, void *probe, void *data)
 			goto end;
 		}
 	}
+	p = find_probe(e, probe, data);
+	if (p && p->pending == LTTNG_TP_PROBE_REMOVE) {
+		/* Unregistered within the batch: keep it registered. */
+		p->pending = LTTNG_TP_PROBE_SYNCED;
+		e->refcount++;
+		goto end;
+	}
 	/* add (probe, data) to entry */
-	ret = add_probe(e, probe, data);
-	if (ret)
+	p = add_probe(e, probe, data);
+	if (IS_ERR(p)) {
+		ret = PTR_ERR(p);
 		goto end;
+	}
 	e->refcount++;
 	if (e->tp) {
+		if (lttng_tracepoint_batch_nesting) {
+			batch_probe(e, p, LTTNG_TP_PROBE_ADD);
+			goto end;
+		}
 		ret = tracepoint_probe_register(e->tp, probe, data);
 		WARN_ON_ONCE(ret);
 		ret = 0;
@@ -188,10 +225,12 @@ end:
 	mutex_unlock(&lttng_tracepoint_mutex);
 	return ret;
 }
+EXPORT_SYMBOL_GPL(lttng_tracepoint_probe_register);
 
 int lttng_tracepoint_probe_unregister(const char *name, void *probe, void *data)
 {
 	struct tracepoint_entry *e;
+	struct lttng_tp_probe *p;
 	int ret = 0;
 
 	mutex_lock(&lttng_tracepoint_mutex);
@@ -201,20 +240,91 @@ int lttng_tracepoint_probe_unregister(const char *name, void *probe, void *data)
 		goto end;
 	}
 	/* remove (probe, data) from entry */
-	ret = remove_probe(e, probe, data);
-	if (ret)
+	p = find_probe(e, probe, data);
+	if (!p || p->pending == LTTNG_TP_PROBE_REMOVE) {
+		WARN_ON(1);
+		ret = -ENOENT;
 		goto end;
-	if (e->tp) {
+	}
+	if (e->tp && p->pending == LTTNG_TP_PROBE_SYNCED) {
+		if (lttng_tracepoint_batch_nesting) {
+			batch_probe(e, p, LTTNG_TP_PROBE_REMOVE);
+			goto put;
+		}
 		ret = tracepoint_probe_unregister(e->tp, probe, data);
 		WARN_ON_ONCE(ret);
 		ret = 0;
 	}
+	remove_probe(p);
+put:
 	if (!--e->refcount)
 		remove_tracepoint(e);
 end:
 	mutex_unlock(&lttng_tracepoint_mutex);
 	return ret;
 }
+EXPORT_SYMBOL_GPL(lttng_tracepoint_probe_unregister);
+
+/*
+ * Apply the pending probes of a tracepoint. New probes are registered
+ * before the removed ones are unregistered, so that replacing the
+ * probes of a tracepoint does not disable it in between.
+ */
+static
+void lttng_tracepoint_batch_apply(struct tracepoint_entry *e)
+{
+	struct lttng_tp_probe *p, *tmp;
+	int ret;
+
+	list_for_each_entry(p, &e->probes, list) {
+		if (p->pending != LTTNG_TP_PROBE_ADD)
+			continue;
+		ret = tracepoint_probe_register(e->tp,
+				p->tp_func.func, p->tp_func.data);
+		WARN_ON_ONCE(ret);
+		p->pending = LTTNG_TP_PROBE_SYNCED;
+	}
+	list_for_each_entry_safe(p, tmp, &e->probes, list) {
+		if (p->pending != LTTNG_TP_PROBE_REMOVE)
+			continue;
+		ret = tracepoint_probe_unregister(e->tp,
+				p->tp_func.func, p->tp_func.data);
+		WARN_ON_ONCE(ret);
+		remove_probe(p);
+	}
+	list_del_init(&e->batch_node);
+}
+
+/*
+ * Defer the registrations and unregistrations of probes on the kernel
+ * tracepoints until the matching lttng_tracepoint_batch_end(), which
+ * applies them with the tracepoint table locked once, grouped by
+ * tracepoint. Batches can nest.
+ */
+void lttng_tracepoint_batch_begin(void)
+{
+	mutex_lock(&lttng_tracepoint_mutex);
+	lttng_tracepoint_batch_nesting++;
+	mutex_unlock(&lttng_tracepoint_mutex);
+}
+EXPORT_SYMBOL_GPL(lttng_tracepoint_batch_begin);
+
+void lttng_tracepoint_batch_end(void)
+{
+	struct tracepoint_entry *e, *tmp;
+
+	mutex_lock(&lttng_tracepoint_mutex);
+	if (WARN_ON_ONCE(!lttng_tracepoint_batch_nesting))
+		goto end;
+	if (--lttng_tracepoint_batch_nesting)
+		goto end;
+	list_for_each_entry_safe(e, tmp, &lttng_tracepoint_batch_list,
+			batch_node)
+		lttng_tracepoint_batch_apply(e);
+end:
+	mutex_unlock(&lttng_tracepoint_mutex);
+}
+EXPORT_SYMBOL_GPL(lttng_tracepoint_batch_end);
 
 #ifdef CONFIG_MODULES
 
@@ -268,20 +378,27 @@ int lttng_tracepoint_going(struct tp_module *tp_mod)
 	for (i = 0; i < tp_mod->mod->num_tracepoints; i++) {
 		struct tracepoint *tp;
 		struct tracepoint_entry *e;
-		struct lttng_tp_probe *p;
+		struct lttng_tp_probe *p, *tmp;
 
 		tp = lttng_tracepoint_ptr_deref(&tp_mod->mod->tracepoints_ptrs[i]);
 		e = get_tracepoint(tp->name);
 		if (!e || !e->tp)
 			continue;
-		/* unregister each (probe, data) */
-		list_for_each_entry(p, &e->probes, list) {
+		/* unregister each (probe, data), dropping the pending ones */
+		list_for_each_entry_safe(p, tmp, &e->probes, list) {
 			int ret;
 
-			ret = tracepoint_probe_unregister(e->tp,
-					p->tp_func.func, p->tp_func.data);
-			WARN_ON_ONCE(ret);
+			if (p->pending != LTTNG_TP_PROBE_ADD) {
+				ret = tracepoint_probe_unregister(e->tp,
+						p->tp_func.func, p->tp_func.data);
+				WARN_ON_ONCE(ret);
+			}
+			if (p->pending == LTTNG_TP_PROBE_REMOVE)
+				remove_probe(p);
+			else
+				p->pending = LTTNG_TP_PROBE_SYNCED;
 		}
+		list_del_init(&e->batch_node);
 		e->tp = NULL;
 		if (!--e->refcount)
 			remove_tracepoint(e);
@@ -64,6 +64,9 @@
 #define LTTNG_METADATA_TIMEOUT_MSEC	10000
 
 #define LTTNG_RFLAG_EXTENDED		RING_BUFFER_RFLAG_END
-#define LTTNG_RFLAG_END			(LTTNG_RFLAG_EXTENDED << 1)
+/* Timestamp width of the delta event header, 3 bits. */
+#define LTTNG_RFLAG_DELTA_TSC_SHIFT	2
+#define LTTNG_RFLAG_DELTA_TSC_MASK	(7U << LTTNG_RFLAG_DELTA_TSC_SHIFT)
+#define LTTNG_RFLAG_END			(1U << 5)
 
 #endif /* _LTTNG_TRACER_H */
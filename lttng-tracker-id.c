@@ -0,0 +1,193 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-tracker-id.c
+ *
+ * LTTng cgroup, namespace, UID and GID tracking.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/err.h>
+#include <linux/hash.h>
+#include <linux/rcupdate.h>
+#include <linux/cred.h>
+#include <linux/nsproxy.h>
+#include <linux/pid_namespace.h>
+#include <linux/cgroup.h>
+#include <net/net_namespace.h>
+
+#include <wrapper/tracepoint.h>
+#include <wrapper/rcu.h>
+#include <wrapper/list.h>
+#include <lttng-kernel-version.h>
+#include <lttng-events.h>
+
+/*
+ * Same concurrency rules as the PID tracker: concurrent updates are
+ * serialized by the session lock, and lookups are performed within
+ * RCU read-side critical sections (RCU sched) at the tracepoint call
+ * site. Tracked sets are expected to be small (a few cgroups or
+ * namespaces per session), hence the fixed-size hash table.
+ */
+
+static
+bool lttng_id_tracker_get_current(enum lttng_tracker_type type, uint64_t *id)
+{
+	switch (type) {
+	case LTTNG_TRACKER_CGROUP:
+#if defined(CONFIG_CGROUPS) && \
+	(LINUX_VERSION_CODE >= KERNEL_VERSION(4,18,0))
+		rcu_read_lock();
+		*id = cgroup_id(task_dfl_cgroup(current));
+		rcu_read_unlock();
+		return true;
+#else
+		return false;
+#endif
+	case LTTNG_TRACKER_PID_NS:
+	{
+		struct pid_namespace *pid_ns = task_active_pid_ns(current);
+
+		if (!pid_ns)
+			return false;
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,19,0))
+		*id = pid_ns->ns.inum;
+#else
+		*id = pid_ns->proc_inum;
+#endif
+		return true;
+	}
+	case LTTNG_TRACKER_NET_NS:
+	{
+		struct nsproxy *nsproxy = current->nsproxy;
+
+		/* nsproxy is NULL for exiting tasks. */
+		if (!nsproxy)
+			return false;
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,19,0))
+		*id = nsproxy->net_ns->ns.inum;
+#else
+		*id = nsproxy->net_ns->proc_inum;
+#endif
+		return true;
+	}
+	case LTTNG_TRACKER_UID:
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,5,0))
+		*id = __kuid_val(current_uid());
+#else
+		*id = current_uid();
+#endif
+		return true;
+	case LTTNG_TRACKER_GID:
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,5,0))
+		*id = __kgid_val(current_gid());
+#else
+		*id = current_gid();
+#endif
+		return true;
+	default:
+		return false;
+	}
+}
+
+static
+bool lttng_id_tracker_lookup(struct lttng_id_tracker *lit, uint64_t id)
+{
+	struct hlist_head *head;
+	struct lttng_id_hash_node *e;
+
+	head = &lit->id_hash[hash_64(id, LTTNG_ID_HASH_BITS)];
+	lttng_hlist_for_each_entry_rcu(e, head, hlist) {
+		if (id == e->id)
+			return true;	/* Found */
+	}
+	return false;
+}
+
+/*
+ * Return whether the current task matches all the id trackers of the
+ * session. Called from the probe prologue when at least one id tracker
+ * is set.
+ */
+bool lttng_id_trackers_match(struct lttng_session *session)
+{
+	unsigned long mask = READ_ONCE(session->id_tracker_mask);
+	int type;
+
+	for (type = 0; type < NR_LTTNG_TRACKER_TYPES; type++) {
+		struct lttng_id_tracker *lit;
+		uint64_t id;
+
+		if (!(mask & (1UL << type)))
+			continue;
+		lit = lttng_rcu_dereference(session->id_trackers[type]);
+		if (!lit)
+			continue;
+		if (!lttng_id_tracker_get_current(type, &id))
+			return false;
+		if (!lttng_id_tracker_lookup(lit, id))
+			return false;
+	}
+	return true;
+}
+EXPORT_SYMBOL_GPL(lttng_id_trackers_match);
+
+int lttng_id_tracker_add(struct lttng_id_tracker *lit, uint64_t id)
+{
+	struct hlist_head *head;
+	struct lttng_id_hash_node *e;
+
+	head = &lit->id_hash[hash_64(id, LTTNG_ID_HASH_BITS)];
+	lttng_hlist_for_each_entry(e, head, hlist) {
+		if (id == e->id)
+			return -EEXIST;
+	}
+	e = kmalloc(sizeof(struct lttng_id_hash_node), GFP_KERNEL);
+	if (!e)
+		return -ENOMEM;
+	e->id = id;
+	hlist_add_head_rcu(&e->hlist, head);
+	return 0;
+}
+
+int lttng_id_tracker_del(struct lttng_id_tracker *lit, uint64_t id)
+{
+	struct hlist_head *head;
+	struct lttng_id_hash_node *e;
+
+	head = &lit->id_hash[hash_64(id, LTTNG_ID_HASH_BITS)];
+	lttng_hlist_for_each_entry(e, head, hlist) {
+		if (id == e->id) {
+			hlist_del_rcu(&e->hlist);
+			/* See pid_tracker_del_node_rcu(). */
+			synchronize_trace();
+			kfree(e);
+			return 0;
+		}
+	}
+	return -ENOENT;	/* Not found */
+}
+
+struct lttng_id_tracker *lttng_id_tracker_create(void)
+{
+	return kzalloc(sizeof(struct lttng_id_tracker), GFP_KERNEL);
+}
+
+void lttng_id_tracker_destroy(struct lttng_id_tracker *lit)
+{
+	int i;
+
+	for (i = 0; i < LTTNG_ID_TABLE_SIZE; i++) {
+		struct hlist_head *head = &lit->id_hash[i];
+		struct lttng_id_hash_node *e;
+		struct hlist_node *tmp;
+
+		lttng_hlist_for_each_entry_safe(e, tmp, head, hlist) {
+			hlist_del(&e->hlist);
+			kfree(e);
+		}
+	}
+	kfree(lit);
+}
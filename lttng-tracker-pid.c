@@ -13,11 +13,14 @@
 #include <linux/seq_file.h>
 #include <linux/stringify.h>
 #include <linux/hash.h>
+#include <linux/bitmap.h>
+#include <linux/log2.h>
 #include <linux/rcupdate.h>
 
 #include <wrapper/tracepoint.h>
 #include <wrapper/rcu.h>
 #include <wrapper/list.h>
+#include <wrapper/vmalloc.h>
 #include <lttng-events.h>
 
 /*
@@ -27,7 +30,7 @@
  *
  * Concurrent updates of the PID hash table are forbidden: the caller
  * must ensure mutual exclusion. This is currently done by holding the
- * sessions_mutex across calls to create, destroy, add, and del
+ * session lock across calls to create, destroy, add, and del
  * functions of this API.
  */
 int lttng_pid_tracker_get_node_pid(const struct lttng_pid_hash_node *node)
@@ -39,21 +42,66 @@ int lttng_pid_tracker_get_node_pid(const struct lttng_pid_hash_node *node)
  * Lookup performed from RCU read-side critical section (RCU sched),
  * protected by preemption off at the tracepoint call site.
  * Return 1 if found, 0 if not found.
+ *
+ * The lookup is a single bit test, independently of the number of
+ * tracked PIDs.
  */
 bool lttng_pid_tracker_lookup(struct lttng_pid_tracker *lpf, int pid)
 {
-	struct hlist_head *head;
-	struct lttng_pid_hash_node *e;
-	uint32_t hash = hash_32(pid, 32);
+	struct lttng_pid_bitmap *bitmap;
 
-	head = &lpf->pid_hash[hash & (LTTNG_PID_TABLE_SIZE - 1)];
-	lttng_hlist_for_each_entry_rcu(e, head, hlist) {
-		if (pid == e->pid)
-			return 1;	/* Found */
+	bitmap = lttng_rcu_dereference(lpf->bitmap);
+	if (unlikely(!bitmap || pid < 0 || pid >= bitmap->nr_bits))
+		return 0;
+	return test_bit(pid, bitmap->bits);
+}
+EXPORT_SYMBOL_GPL(lttng_pid_tracker_lookup);
+
+#define LTTNG_PID_BITMAP_MIN_BITS	32768
+
+static
+struct lttng_pid_bitmap *pid_bitmap_alloc(unsigned int nr_bits)
+{
+	struct lttng_pid_bitmap *bitmap;
+
+	bitmap = lttng_kvzalloc(sizeof(struct lttng_pid_bitmap)
+			+ BITS_TO_LONGS(nr_bits) * sizeof(unsigned long),
+			GFP_KERNEL);
+	if (!bitmap)
+		return NULL;
+	bitmap->nr_bits = nr_bits;
+	return bitmap;
+}
+
+/*
+ * Grow the bitmap so it can hold "pid". The new bitmap is published
+ * after copying the old one, and the old one is freed once no lookup
+ * can still use it.
+ */
+static
+int pid_bitmap_reserve(struct lttng_pid_tracker *lpf, int pid)
+{
+	struct lttng_pid_bitmap *old = lpf->bitmap, *new;
+	unsigned int nr_bits;
+
+	if (pid < 0)
+		return -EINVAL;
+	if (old && pid < old->nr_bits)
+		return 0;
+	nr_bits = max_t(unsigned int, roundup_pow_of_two(pid + 1),
+			LTTNG_PID_BITMAP_MIN_BITS);
+	new = pid_bitmap_alloc(nr_bits);
+	if (!new)
+		return -ENOMEM;
+	if (old)
+		bitmap_copy(new->bits, old->bits, old->nr_bits);
+	rcu_assign_pointer(lpf->bitmap, new);
+	if (old) {
+		synchronize_trace();
+		lttng_kvfree(old);
 	}
 	return 0;
 }
-EXPORT_SYMBOL_GPL(lttng_pid_tracker_lookup);
 
 /*
  * Tracker add and del operations support concurrent RCU lookups.
@@ -63,23 +111,30 @@ int lttng_pid_tracker_add(struct lttng_pid_tracker *lpf, int pid)
 	struct hlist_head *head;
 	struct lttng_pid_hash_node *e;
 	uint32_t hash = hash_32(pid, 32);
+	int ret;
 
 	head = &lpf->pid_hash[hash & (LTTNG_PID_TABLE_SIZE - 1)];
 	lttng_hlist_for_each_entry(e, head, hlist) {
 		if (pid == e->pid)
 			return -EEXIST;
 	}
+	ret = pid_bitmap_reserve(lpf, pid);
+	if (ret)
+		return ret;
 	e = kmalloc(sizeof(struct lttng_pid_hash_node), GFP_KERNEL);
 	if (!e)
 		return -ENOMEM;
 	e->pid = pid;
 	hlist_add_head_rcu(&e->hlist, head);
+	set_bit(pid, lpf->bitmap->bits);
 	return 0;
 }
 
 static
-void pid_tracker_del_node_rcu(struct lttng_pid_hash_node *e)
+void pid_tracker_del_node_rcu(struct lttng_pid_tracker *lpf,
+		struct lttng_pid_hash_node *e)
 {
+	clear_bit(e->pid, lpf->bitmap->bits);
 	hlist_del_rcu(&e->hlist);
 	/*
 	 * We choose to use a heavyweight synchronize on removal here,
@@ -117,7 +172,7 @@ int lttng_pid_tracker_del(struct lttng_pid_tracker *lpf, int pid)
 	 */
 	lttng_hlist_for_each_entry(e, head, hlist) {
 		if (pid == e->pid) {
-			pid_tracker_del_node_rcu(e);
+			pid_tracker_del_node_rcu(lpf, e);
 			return 0;
 		}
 	}
@@ -141,5 +196,6 @@ void lttng_pid_tracker_destroy(struct lttng_pid_tracker *lpf)
 		lttng_hlist_for_each_entry_safe(e, tmp, head, hlist)
 			pid_tracker_del_node(e);
 	}
+	lttng_kvfree(lpf->bitmap);
 	kfree(lpf);
 }
@@ -0,0 +1,312 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-trigger.c
+ *
+ * LTTng flight recorder triggers, freezing a channel on a matching event.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/file.h>
+#include <linux/anon_inodes.h>
+#include <linux/irq_work.h>
+#include <linux/workqueue.h>
+#include <linux/wait.h>
+#include <linux/uaccess.h>
+#include <linux/math64.h>
+
+#include <wrapper/ringbuffer/backend.h>
+#include <wrapper/ringbuffer/frontend.h>
+#include <wrapper/ringbuffer/frontend_api.h>
+#include <wrapper/atomic.h>
+#include <wrapper/poll.h>
+#include <wrapper/file.h>
+#include <wrapper/trace-clock.h>
+#include <lttng-abi.h>
+#include <lttng-events.h>
+
+/*
+ * A trigger is attached to a trigger channel, and targets another
+ * channel, typically in overwrite mode. The events enabled on the
+ * trigger channel, along with their filters, select the trigger
+ * conditions: the first of them reaching the trigger channel client
+ * freezes the target channel, so its buffers stop being overwritten
+ * while its streams remain readable, and can be snapshot by the
+ * consumer at its own pace. The current packet of each target stream is then switched
+ * from a work item, making the data up to the trigger readable, and the
+ * trigger file descriptor becomes readable.
+ *
+ * With a window, the target channel only keeps the records preceding the
+ * firing by less than the window: it is sized as a staging ring for the
+ * window, overwritten until the trigger fires, after which its readers
+ * skip the sub-buffers ending before the window.
+ *
+ * The trigger file holds a reference on both channel files. The trigger
+ * fires once, until re-armed from its file descriptor, which lets the
+ * target channel record again. Closing the trigger file re-arms it too.
+ */
+
+enum lttng_trigger_state {
+	LTTNG_TRIGGER_ARMED = 0,
+	LTTNG_TRIGGER_FIRED,
+};
+
+struct lttng_channel_trigger {
+	struct lttng_channel *chan;	/* Trigger channel */
+	struct file *target_file;	/* Channel frozen by the trigger */
+	atomic_t state;			/* enum lttng_trigger_state */
+	int frozen;			/* Target streams switched */
+	uint64_t window;		/* Trace clock units, 0: no window */
+	uint64_t fired_tsc;		/* Trace clock at the last firing */
+	uint64_t count;			/* Times fired */
+	struct mutex lock;		/* Serializes re-arming */
+	struct irq_work irq_work;	/* Leaves the tracing context */
+	struct work_struct work;
+	wait_queue_head_t wait;
+};
+
+/* Convert @ns nanoseconds to trace clock units, saturating. */
+static
+uint64_t lttng_trigger_clock(uint64_t ns)
+{
+	uint64_t freq = trace_clock_freq();
+
+	if (freq == NSEC_PER_SEC)
+		return ns;
+	if (ns > div64_u64(U64_MAX, freq))
+		return U64_MAX;
+	return div64_u64(ns * freq, NSEC_PER_SEC);
+}
+
+static
+struct lttng_channel *lttng_trigger_target(struct lttng_channel_trigger *trigger)
+{
+	return trigger->target_file->private_data;
+}
+
+static
+void lttng_trigger_work(struct work_struct *work)
+{
+	struct lttng_channel_trigger *trigger =
+		container_of(work, struct lttng_channel_trigger, work);
+	struct lttng_channel *target = lttng_trigger_target(trigger);
+
+	/* The target channel stays frozen even if this fails. */
+	WARN_ON_ONCE(target->ops->channel_flush(target->chan, 0, NULL));
+	if (trigger->window && trigger->fired_tsc > trigger->window)
+		WRITE_ONCE(target->window_start,
+			trigger->fired_tsc - trigger->window);
+	trigger->count++;
+	WRITE_ONCE(trigger->frozen, 1);
+	wake_up_interruptible(&trigger->wait);
+}
+
+static
+void lttng_trigger_irq_work(struct irq_work *entry)
+{
+	struct lttng_channel_trigger *trigger =
+		container_of(entry, struct lttng_channel_trigger, irq_work);
+
+	schedule_work(&trigger->work);
+}
+
+/*
+ * Called from the ring buffer client for events of a channel with a
+ * trigger, in any tracing context.
+ */
+void lttng_channel_trigger_fire(struct lttng_channel *chan)
+{
+	struct lttng_channel_trigger *trigger = READ_ONCE(chan->trigger);
+	struct channel *target;
+
+	if (!trigger || atomic_cmpxchg(&trigger->state, LTTNG_TRIGGER_ARMED,
+			LTTNG_TRIGGER_FIRED) != LTTNG_TRIGGER_ARMED)
+		return;
+	trigger->fired_tsc = trace_clock_read64();
+	target = lttng_trigger_target(trigger)->chan;
+	channel_record_freeze(&target->backend.config, target);
+	irq_work_queue(&trigger->irq_work);
+}
+EXPORT_SYMBOL_GPL(lttng_channel_trigger_fire);
+
+/* Wait for a firing in progress, and let the target record again. */
+static
+void lttng_trigger_rearm(struct lttng_channel_trigger *trigger)
+{
+	struct channel *target = lttng_trigger_target(trigger)->chan;
+
+	mutex_lock(&trigger->lock);
+	irq_work_sync(&trigger->irq_work);
+	flush_work(&trigger->work);
+	if (atomic_read(&trigger->state) != LTTNG_TRIGGER_FIRED)
+		goto end;
+	WRITE_ONCE(trigger->frozen, 0);
+	WRITE_ONCE(lttng_trigger_target(trigger)->window_start, 0);
+	channel_record_thaw(&target->backend.config, target);
+	/* Target recording enabled before next firing. */
+	lttng_smp_mb__before_atomic();
+	atomic_set(&trigger->state, LTTNG_TRIGGER_ARMED);
+end:
+	mutex_unlock(&trigger->lock);
+}
+
+static
+unsigned int lttng_trigger_poll(struct file *file, poll_table *wait)
+{
+	struct lttng_channel_trigger *trigger = file->private_data;
+
+	poll_wait(file, &trigger->wait, wait);
+	if (READ_ONCE(trigger->frozen))
+		return POLLIN | POLLRDNORM;
+	return 0;
+}
+
+/* Returns the number of times the trigger fired, as an uint64_t. */
+static
+ssize_t lttng_trigger_read(struct file *file, char __user *user_buf,
+		size_t count, loff_t *ppos)
+{
+	struct lttng_channel_trigger *trigger = file->private_data;
+	uint64_t fired;
+
+	if (count < sizeof(fired))
+		return -EINVAL;
+	fired = READ_ONCE(trigger->count);
+	if (copy_to_user(user_buf, &fired, sizeof(fired)))
+		return -EFAULT;
+	return sizeof(fired);
+}
+
+/*
+ * This ioctl implements lttng commands:
+ *	LTTNG_KERNEL_TRIGGER_REARM
+ *		Let the target channel record again, and re-arm the trigger
+ */
+static
+long lttng_trigger_ioctl(struct file *file, unsigned int cmd,
+		unsigned long arg)
+{
+	struct lttng_channel_trigger *trigger = file->private_data;
+
+	switch (cmd) {
+	case LTTNG_KERNEL_TRIGGER_REARM:
+		lttng_trigger_rearm(trigger);
+		return 0;
+	default:
+		return -ENOIOCTLCMD;
+	}
+}
+
+static
+int lttng_trigger_release(struct inode *inode, struct file *file)
+{
+	struct lttng_channel_trigger *trigger = file->private_data;
+	struct lttng_channel *chan = trigger->chan;
+
+	lttng_lock_session(chan->session);
+	WRITE_ONCE(chan->trigger, NULL);
+	lttng_session_update_armed(chan->session);
+	lttng_unlock_session(chan->session);
+	/* Wait for clients which could still fire. */
+	synchronize_trace();
+	lttng_trigger_rearm(trigger);
+	fput(trigger->target_file);
+	fput(chan->file);
+	kfree(trigger);
+	return 0;
+}
+
+static const struct file_operations lttng_trigger_fops = {
+	.owner = THIS_MODULE,
+	.release = lttng_trigger_release,
+	.poll = lttng_trigger_poll,
+	.read = lttng_trigger_read,
+	.unlocked_ioctl = lttng_trigger_ioctl,
+#ifdef CONFIG_COMPAT
+	.compat_ioctl = lttng_trigger_ioctl,
+#endif
+};
+
+/*
+ * Attach a trigger freezing the channel of target_file to chan, keeping
+ * the window ns preceding the firing, and return its file descriptor.
+ * Takes ownership of the target_file reference.
+ */
+int lttng_channel_trigger_create(struct lttng_channel *chan,
+		struct file *target_file, uint64_t window)
+{
+	struct lttng_channel *target = target_file->private_data;
+	struct lttng_channel_trigger *trigger;
+	struct file *trigger_file;
+	int trigger_fd, ret;
+
+	if (chan->channel_type == METADATA_CHANNEL
+			|| target->channel_type == METADATA_CHANNEL) {
+		ret = -EPERM;
+		goto error;
+	}
+	if (target == chan) {
+		ret = -EINVAL;
+		goto error;
+	}
+	if (!target->ops->channel_flush) {
+		ret = -ENOSYS;
+		goto error;
+	}
+	trigger = kzalloc(sizeof(*trigger), GFP_KERNEL);
+	if (!trigger) {
+		ret = -ENOMEM;
+		goto error;
+	}
+	trigger->chan = chan;
+	trigger->target_file = target_file;
+	trigger->window = lttng_trigger_clock(window);
+	atomic_set(&trigger->state, LTTNG_TRIGGER_ARMED);
+	mutex_init(&trigger->lock);
+	init_irq_work(&trigger->irq_work, lttng_trigger_irq_work);
+	INIT_WORK(&trigger->work, lttng_trigger_work);
+	init_waitqueue_head(&trigger->wait);
+
+	lttng_lock_session(chan->session);
+	if (chan->trigger) {
+		ret = -EEXIST;
+		goto unlock;
+	}
+	trigger_fd = lttng_get_unused_fd();
+	if (trigger_fd < 0) {
+		ret = trigger_fd;
+		goto unlock;
+	}
+	/* The trigger file holds a reference on the channel file. */
+	if (!atomic_long_add_unless(&chan->file->f_count, 1, LONG_MAX)) {
+		ret = -EOVERFLOW;
+		goto refcount_error;
+	}
+	trigger_file = anon_inode_getfile("[lttng_trigger]",
+			&lttng_trigger_fops, trigger, O_RDONLY);
+	if (IS_ERR(trigger_file)) {
+		ret = PTR_ERR(trigger_file);
+		goto file_error;
+	}
+	/* Trigger initialized before being seen by the clients. */
+	smp_wmb();
+	WRITE_ONCE(chan->trigger, trigger);
+	lttng_session_update_armed(chan->session);
+	fd_install(trigger_fd, trigger_file);
+	lttng_unlock_session(chan->session);
+	return trigger_fd;
+
+file_error:
+	atomic_long_dec(&chan->file->f_count);
+refcount_error:
+	put_unused_fd(trigger_fd);
+unlock:
+	lttng_unlock_session(chan->session);
+	kfree(trigger);
+error:
+	fput(target_file);
+	return ret;
+}
@@ -0,0 +1,225 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * probes/lttng-duration.h
+ *
+ * LTTng duration statistics kept by probes for their summary events.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#ifndef _LTTNG_PROBES_DURATION_H
+#define _LTTNG_PROBES_DURATION_H
+
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/percpu.h>
+#include <linux/module.h>
+#include <lttng-abi.h>
+#include <wrapper/trace-clock.h>
+#include <wrapper/tracepoint.h>
+#include <wrapper/vmalloc.h>
+#include <wrapper/percpu-defs.h>
+
+/*
+ * Count, total and maximum of durations, in trace clock units, and their
+ * log2 histogram: bucket 0 counts null durations, bucket n durations in
+ * [2^(n-1), 2^n), as for aggregation maps.
+ */
+struct lttng_duration_stats {
+	uint64_t count;
+	uint64_t total;
+	uint64_t max;
+	uint32_t hist[LTTNG_KERNEL_AGGREGATION_HIST_BUCKETS];
+};
+
+/*
+ * Statistics over consecutive periods. A period is ended by the first
+ * duration added after its end, which starts the next one.
+ */
+struct lttng_duration_period {
+	uint64_t end;				/* 0: no period started */
+	struct lttng_duration_stats cur;
+	struct lttng_duration_stats last;	/* Previous period */
+};
+
+/* Convert @ns nanoseconds to trace clock units, saturating. */
+static inline
+uint64_t lttng_duration_clock(uint64_t ns)
+{
+	uint64_t freq = trace_clock_freq();
+
+	if (freq == NSEC_PER_SEC)
+		return ns;
+	if (ns > div64_u64(U64_MAX, freq))
+		return U64_MAX;
+	return div64_u64(ns * freq, NSEC_PER_SEC);
+}
+
+static inline
+void lttng_duration_stats_add(struct lttng_duration_stats *stats,
+		uint64_t duration)
+{
+	unsigned int bucket = 0;
+
+	if (duration)
+		bucket = min_t(unsigned int, ilog2(duration) + 1,
+			LTTNG_KERNEL_AGGREGATION_HIST_BUCKETS - 1);
+	stats->count++;
+	stats->total += duration;
+	stats->max = max(stats->max, duration);
+	stats->hist[bucket]++;
+}
+
+/*
+ * Add a duration ending at @now to the periods of @len trace clock units,
+ * 0 meaning no period. Returns true if this ended a period, whose
+ * statistics are then in @period->last until the next period ends.
+ */
+static inline
+bool lttng_duration_period_add(struct lttng_duration_period *period,
+		uint64_t len, uint64_t now, uint64_t duration)
+{
+	bool ended = false;
+
+	if (len && now >= period->end) {
+		if (period->end) {
+			period->last = period->cur;
+			ended = true;
+		}
+		memset(&period->cur, 0, sizeof(period->cur));
+		period->end = now + len;
+	}
+	lttng_duration_stats_add(&period->cur, duration);
+	return ended;
+}
+
+/*
+ * Hooks measuring durations for the event probes of their tracepoints.
+ *
+ * The hooks are registered at module load, before any event probe, and
+ * unregistered after the event probes at module unload: the probes of a
+ * tracepoint are called in their registration order, so the probes of
+ * each session see the state left by the hooks for the same tracepoint
+ * call. The probe modules keep this state per cpu, and each documents
+ * why the state of a cpu is not overwritten by a nested call before
+ * its event probes read it.
+ */
+struct lttng_duration_hook {
+	const char *name;	/* Tracepoint */
+	void *probe;
+};
+
+/*
+ * Unregister the first @nr hooks, in reverse order, and wait for the
+ * hooks still running, so that their state can be freed.
+ */
+static inline
+void lttng_duration_hooks_unregister(const struct lttng_duration_hook *hooks,
+		unsigned int nr)
+{
+	while (nr--)
+		WARN_ON_ONCE(lttng_wrapper_tracepoint_probe_unregister(
+				hooks[nr].name, hooks[nr].probe, NULL));
+	tracepoint_synchronize_unregister();
+}
+
+/* Register @nr hooks, once their state is allocated. */
+static inline
+int lttng_duration_hooks_register(const struct lttng_duration_hook *hooks,
+		unsigned int nr)
+{
+	unsigned int i;
+	int ret;
+
+	/* The state is allocated before the hooks use it. */
+	wrapper_vmalloc_sync_all();
+	for (i = 0; i < nr; i++) {
+		ret = lttng_wrapper_tracepoint_probe_register(hooks[i].name,
+				hooks[i].probe, NULL);
+		if (ret) {
+			lttng_duration_hooks_unregister(hooks, i);
+			return ret;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Per-cpu state of the hooks: a per-cpu pointer to the zeroed state of
+ * each possible cpu, allocated on its node. The states themselves are
+ * not in the per-cpu area, whose allocations are limited to
+ * PCPU_MIN_UNIT_SIZE, since most of them hold tables of slots.
+ */
+static inline
+void lttng_duration_cpus_free(void * __percpu *cpus)
+{
+	int cpu;
+
+	if (!cpus)
+		return;
+	for_each_possible_cpu(cpu)
+		lttng_kvfree(*per_cpu_ptr(cpus, cpu));
+	free_percpu(cpus);
+}
+
+static inline
+void * __percpu *lttng_duration_cpus_alloc(size_t size)
+{
+	void * __percpu *cpus;
+	int cpu;
+
+	cpus = alloc_percpu(void *);
+	if (!cpus)
+		return NULL;
+	for_each_possible_cpu(cpu) {
+		*per_cpu_ptr(cpus, cpu) = lttng_kvzalloc_node(size,
+				GFP_KERNEL, cpu_to_node(cpu));
+		if (!*per_cpu_ptr(cpus, cpu)) {
+			lttng_duration_cpus_free(cpus);
+			return NULL;
+		}
+	}
+	return cpus;
+}
+
+/* State of @cpu, and of the current cpu, within a hook or event probe. */
+#define lttng_duration_cpu(cpus, cpu)	(*per_cpu_ptr(cpus, cpu))
+#define lttng_duration_this_cpu(cpus)	(*lttng_this_cpu_ptr(cpus))
+
+/*
+ * Define the init and exit of the probe module of @_system, which
+ * defines TP_MODULE_NOAUTOLOAD: when @_enabled, @_register registers
+ * the hooks before the event probes, and @_unregister unregisters them
+ * after the event probes.
+ */
+#define LTTNG_DURATION_PROBE_MODULE(_system, _enabled, _register, _unregister) \
+static									\
+int __init lttng_probe_##_system##_init(void)				\
+{									\
+	int ret;							\
+									\
+	if (_enabled) {							\
+		ret = _register();					\
+		if (ret)						\
+			return ret;					\
+	}								\
+	ret = __lttng_events_init__##_system();				\
+	if (ret && (_enabled))						\
+		_unregister();						\
+	return ret;							\
+}									\
+module_init(lttng_probe_##_system##_init);				\
+									\
+static									\
+void __exit lttng_probe_##_system##_exit(void)				\
+{									\
+	__lttng_events_exit__##_system();				\
+	if (_enabled)							\
+		_unregister();						\
+}									\
+module_exit(lttng_probe_##_system##_exit)
+
+#endif /* _LTTNG_PROBES_DURATION_H */
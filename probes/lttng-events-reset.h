@@ -74,6 +74,9 @@
 #undef _ctf_string
 #define _ctf_string(_item, _src, _user, _nowrite)
 
+#undef _ctf_string_bounded
+#define _ctf_string_bounded(_item, _src, _max_len, _user, _nowrite)
+
 #undef _ctf_enum
 #define _ctf_enum(_name, _type, _item, _src, _nowrite)
 
@@ -135,6 +138,9 @@
 #undef ctf_string
 #define ctf_string(_item, _src)
 
+#undef ctf_string_bounded
+#define ctf_string_bounded(_item, _src, _max_len)
+
 #undef ctf_enum
 #define ctf_enum(_name, _type, _item, _src)
 
@@ -242,6 +248,9 @@
 #undef ctf_user_string
 #define ctf_user_string(_item, _user_src)
 
+#undef ctf_user_string_bounded
+#define ctf_user_string_bounded(_item, _user_src, _max_len)
+
 #undef ctf_user_enum
 #define ctf_user_enum(_name, _type, _item, _src)
 
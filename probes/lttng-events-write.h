@@ -92,6 +92,15 @@
 #define ctf_string(_item, _src)					\
 	_ctf_string(_item, _src, 0, 0)
 
+/*
+ * Bounded strings are copied in a single pass, truncated to _max_len
+ * bytes including the terminating '\0'. Events using them are reserved
+ * for their upper bound, and shrunk at commit.
+ */
+#undef ctf_string_bounded
+#define ctf_string_bounded(_item, _src, _max_len)		\
+	_ctf_string_bounded(_item, _src, _max_len, 0, 0)
+
 #undef ctf_enum
 #define ctf_enum(_name, _type, _item, _src)			\
 	_ctf_enum(_name, _type, _item, _src, 0, 0)
@@ -176,6 +185,10 @@
 #define ctf_user_string(_item, _src)					\
 	_ctf_string(_item, _src, 1, 0)
 
+#undef ctf_user_string_bounded
+#define ctf_user_string_bounded(_item, _src, _max_len)			\
+	_ctf_string_bounded(_item, _src, _max_len, 1, 0)
+
 #undef ctf_user_enum
 #define ctf_user_enum(_name, _type, _item, _src)			\
 	_ctf_enum(_name, _type, _item, _src, 1, 0)
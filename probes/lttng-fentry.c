@@ -0,0 +1,230 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * probes/lttng-fentry.c
+ *
+ * LTTng function entry probes, using the ftrace function hooks.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+/*
+ * Each event registers its own ftrace_ops, filtered on the functions
+ * matching its symbol name, which may be an ftrace filter glob. Only the
+ * selected functions call the handler, from their mcount/fentry call
+ * site, without the breakpoint trap of a kprobe: instrumenting many
+ * functions with a single event is cheap.
+ *
+ * Unregistering the ftrace_ops waits for the handlers in progress, so
+ * the module can be unloaded.
+ */
+
+#include <linux/module.h>
+#include <linux/ftrace.h>
+#include <linux/slab.h>
+#include <lttng-events.h>
+#include <wrapper/ringbuffer/frontend_types.h>
+#include <wrapper/vmalloc.h>
+#include <lttng-tracer.h>
+#include <lttng-kernel-version.h>
+
+struct lttng_fentry {
+	struct ftrace_ops ops;
+	struct lttng_event *event;
+};
+
+static
+void lttng_fentry_record(struct lttng_event *event, unsigned long ip,
+		unsigned long parent_ip)
+{
+	struct lttng_probe_ctx lttng_probe_ctx = {
+		.event = event,
+		.interruptible = !irqs_disabled(),
+	};
+	struct lttng_channel *chan = event->chan;
+	struct lib_ring_buffer_ctx ctx;
+	struct {
+		unsigned long ip;
+		unsigned long parent_ip;
+	} payload;
+	int ret;
+
+	if (unlikely(!(READ_ONCE(event->armed) & LTTNG_EVENT_ARMED)))
+		return;
+
+	lib_ring_buffer_ctx_init(&ctx, chan->chan, &lttng_probe_ctx,
+				 sizeof(payload), lttng_alignof(payload), -1);
+	ret = chan->ops->event_reserve(&ctx, event->id);
+	if (ret < 0)
+		return;
+	payload.ip = ip;
+	payload.parent_ip = parent_ip;
+	lib_ring_buffer_align_ctx(&ctx, lttng_alignof(payload));
+	chan->ops->event_write(&ctx, &payload, sizeof(payload));
+	chan->ops->event_commit(&ctx);
+}
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5,11,0))
+static
+void lttng_fentry_handler(unsigned long ip, unsigned long parent_ip,
+		struct ftrace_ops *op, struct ftrace_regs *fregs)
+{
+	struct lttng_fentry *fentry = container_of(op, struct lttng_fentry, ops);
+	int bit;
+
+	bit = ftrace_test_recursion_trylock(ip, parent_ip);
+	if (bit < 0)
+		return;
+	lttng_fentry_record(fentry->event, ip, parent_ip);
+	ftrace_test_recursion_unlock(bit);
+}
+
+/* The handler protects itself against recursion. */
+#define LTTNG_FENTRY_OPS_FLAGS	FTRACE_OPS_FL_RECURSION
+#else /* #if (LINUX_VERSION_CODE >= KERNEL_VERSION(5,11,0)) */
+static
+void lttng_fentry_handler(unsigned long ip, unsigned long parent_ip,
+		struct ftrace_ops *op, struct pt_regs *regs)
+{
+	struct lttng_fentry *fentry = container_of(op, struct lttng_fentry, ops);
+
+	lttng_fentry_record(fentry->event, ip, parent_ip);
+}
+
+/* Ftrace protects the handler against recursion. */
+#define LTTNG_FENTRY_OPS_FLAGS	0
+#endif /* #else #if (LINUX_VERSION_CODE >= KERNEL_VERSION(5,11,0)) */
+
+/*
+ * Create event description
+ */
+static
+int lttng_create_fentry_event(const char *name, struct lttng_event *event)
+{
+	struct lttng_event_field *fields;
+	struct lttng_event_desc *desc;
+	int ret;
+
+	desc = kzalloc(sizeof(*event->desc), GFP_KERNEL);
+	if (!desc)
+		return -ENOMEM;
+	desc->name = kstrdup(name, GFP_KERNEL);
+	if (!desc->name) {
+		ret = -ENOMEM;
+		goto error_str;
+	}
+	desc->nr_fields = 2;
+	desc->fields = fields =
+		kzalloc(2 * sizeof(struct lttng_event_field), GFP_KERNEL);
+	if (!desc->fields) {
+		ret = -ENOMEM;
+		goto error_fields;
+	}
+	fields[0].name = "ip";
+	fields[0].type.atype = atype_integer;
+	fields[0].type.u.basic.integer.size = sizeof(unsigned long) * CHAR_BIT;
+	fields[0].type.u.basic.integer.alignment = lttng_alignof(unsigned long) * CHAR_BIT;
+	fields[0].type.u.basic.integer.signedness = lttng_is_signed_type(unsigned long);
+	fields[0].type.u.basic.integer.reverse_byte_order = 0;
+	fields[0].type.u.basic.integer.base = 16;
+	fields[0].type.u.basic.integer.encoding = lttng_encode_none;
+
+	fields[1].name = "parent_ip";
+	fields[1].type.atype = atype_integer;
+	fields[1].type.u.basic.integer.size = sizeof(unsigned long) * CHAR_BIT;
+	fields[1].type.u.basic.integer.alignment = lttng_alignof(unsigned long) * CHAR_BIT;
+	fields[1].type.u.basic.integer.signedness = lttng_is_signed_type(unsigned long);
+	fields[1].type.u.basic.integer.reverse_byte_order = 0;
+	fields[1].type.u.basic.integer.base = 16;
+	fields[1].type.u.basic.integer.encoding = lttng_encode_none;
+
+	desc->owner = THIS_MODULE;
+	event->desc = desc;
+
+	return 0;
+
+error_fields:
+	kfree(desc->name);
+error_str:
+	kfree(desc);
+	return ret;
+}
+
+int lttng_fentry_register(const char *name,
+			  const char *symbol_name,
+			  struct lttng_event *event)
+{
+	struct lttng_fentry *fentry;
+	int ret;
+
+	ret = lttng_create_fentry_event(name, event);
+	if (ret)
+		goto error;
+
+	fentry = kzalloc(sizeof(*fentry), GFP_KERNEL);
+	if (!fentry) {
+		ret = -ENOMEM;
+		goto fentry_error;
+	}
+	fentry->event = event;
+	fentry->ops.func = lttng_fentry_handler;
+	fentry->ops.flags = LTTNG_FENTRY_OPS_FLAGS;
+	event->u.fentry.lttng_fentry = fentry;
+	event->u.fentry.symbol_name = kstrdup(symbol_name, GFP_KERNEL);
+	if (!event->u.fentry.symbol_name) {
+		ret = -ENOMEM;
+		goto name_error;
+	}
+	/* Select the functions, before the hooks are enabled. */
+	ret = ftrace_set_filter(&fentry->ops,
+			(unsigned char *) event->u.fentry.symbol_name,
+			strlen(event->u.fentry.symbol_name), 1);
+	if (ret)
+		goto filter_error;
+
+	/* Ensure the memory we just allocated don't trigger page faults */
+	wrapper_vmalloc_sync_all();
+
+	ret = register_ftrace_function(&fentry->ops);
+	if (ret)
+		goto register_error;
+	return 0;
+
+register_error:
+filter_error:
+	ftrace_free_filter(&fentry->ops);
+	kfree(event->u.fentry.symbol_name);
+name_error:
+	kfree(fentry);
+fentry_error:
+	kfree(event->desc->fields);
+	kfree(event->desc->name);
+	kfree(event->desc);
+error:
+	return ret;
+}
+EXPORT_SYMBOL_GPL(lttng_fentry_register);
+
+void lttng_fentry_unregister(struct lttng_event *event)
+{
+	unregister_ftrace_function(&event->u.fentry.lttng_fentry->ops);
+}
+EXPORT_SYMBOL_GPL(lttng_fentry_unregister);
+
+void lttng_fentry_destroy_private(struct lttng_event *event)
+{
+	ftrace_free_filter(&event->u.fentry.lttng_fentry->ops);
+	kfree(event->u.fentry.lttng_fentry);
+	kfree(event->u.fentry.symbol_name);
+	kfree(event->desc->fields);
+	kfree(event->desc->name);
+	kfree(event->desc);
+}
+EXPORT_SYMBOL_GPL(lttng_fentry_destroy_private);
+
+MODULE_LICENSE("GPL and additional rights");
+MODULE_AUTHOR("agent <agent@local>");
+MODULE_DESCRIPTION("LTTng function entry probes");
+MODULE_VERSION(__stringify(LTTNG_MODULES_MAJOR_VERSION) "."
+	__stringify(LTTNG_MODULES_MINOR_VERSION) "."
+	__stringify(LTTNG_MODULES_PATCHLEVEL_VERSION)
+	LTTNG_MODULES_EXTRAVERSION);
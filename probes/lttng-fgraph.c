@@ -0,0 +1,456 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * probes/lttng-fgraph.c
+ *
+ * LTTng function graph probes, using the ftrace function graph hooks.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+/*
+ * Each event records one record per function return, holding the
+ * function address, the call duration and the call depth, rather than an
+ * entry and an exit record. Calls deeper than the event maximum depth are
+ * not hooked, and calls shorter than its minimum duration are dropped at
+ * return, so slow paths can be traced without recording every call.
+ *
+ * The kernel supports a single set of function graph hooks: all the
+ * events share them, and they are registered while at least one event
+ * exists. The entry hook only requests the return hook of a call when an
+ * armed event selects it. The events are walked under RCU-sched by the
+ * hooks.
+ *
+ * The functions of an event are resolved when it is created: functions of
+ * modules loaded later are not selected. The call depth counts the hooked
+ * calls only.
+ */
+
+#include <linux/module.h>
+#include <linux/ftrace.h>
+#include <linux/kallsyms.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <lttng-events.h>
+#include <lttng-string-utils.h>
+#include <wrapper/fgraph.h>
+#include <wrapper/rcu.h>
+#include <wrapper/ringbuffer/frontend_types.h>
+#include <wrapper/vmalloc.h>
+#include <lttng-tracer.h>
+#include <lttng-kernel-version.h>
+
+#define LTTNG_FGRAPH_MAX_FUNCS	65536
+
+struct lttng_fgraph {
+	struct list_head node;		/* fgraph_events list, RCU */
+	struct lttng_event *event;
+	unsigned long *funcs;		/* Sorted addresses, NULL for all */
+	unsigned int nr_funcs;
+	unsigned int max_depth;		/* 0: unlimited */
+	uint64_t min_duration;		/* ns */
+};
+
+static LIST_HEAD(fgraph_events);
+static DEFINE_MUTEX(fgraph_mutex);
+
+static notrace
+int lttng_fgraph_match(const struct lttng_fgraph *fgraph, unsigned long func,
+		int depth)
+{
+	unsigned int lo = 0, hi = fgraph->nr_funcs;
+
+	if (unlikely(!(READ_ONCE(fgraph->event->armed) & LTTNG_EVENT_ARMED)))
+		return 0;
+	if (fgraph->max_depth && depth >= fgraph->max_depth)
+		return 0;
+	if (!fgraph->funcs)
+		return 1;
+	while (lo < hi) {
+		unsigned int mid = lo + ((hi - lo) >> 1);
+
+		if (fgraph->funcs[mid] == func)
+			return 1;
+		if (fgraph->funcs[mid] < func)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return 0;
+}
+
+static notrace
+void lttng_fgraph_record(struct lttng_event *event,
+		const struct ftrace_graph_ret *trace, uint64_t duration)
+{
+	struct lttng_probe_ctx lttng_probe_ctx = {
+		.event = event,
+		.interruptible = !irqs_disabled(),
+	};
+	struct lttng_channel *chan = event->chan;
+	struct lib_ring_buffer_ctx ctx;
+	unsigned long ip = trace->func;
+	uint32_t depth = trace->depth;
+	size_t len = sizeof(ip);
+	int ret;
+
+	len += lib_ring_buffer_record_align(chan->packed, len,
+			lttng_alignof(duration));
+	len += sizeof(duration);
+	len += lib_ring_buffer_record_align(chan->packed, len,
+			lttng_alignof(depth));
+	len += sizeof(depth);
+	lib_ring_buffer_ctx_init(&ctx, chan->chan, &lttng_probe_ctx, len,
+				 max(lttng_alignof(ip), lttng_alignof(duration)),
+				 -1);
+	ret = chan->ops->event_reserve(&ctx, event->id);
+	if (ret < 0)
+		return;
+	lib_ring_buffer_align_ctx(&ctx, lttng_alignof(ip));
+	chan->ops->event_write(&ctx, &ip, sizeof(ip));
+	lib_ring_buffer_align_ctx(&ctx, lttng_alignof(duration));
+	chan->ops->event_write(&ctx, &duration, sizeof(duration));
+	lib_ring_buffer_align_ctx(&ctx, lttng_alignof(depth));
+	chan->ops->event_write(&ctx, &depth, sizeof(depth));
+	chan->ops->event_commit(&ctx);
+}
+
+static notrace
+int lttng_fgraph_entry(struct ftrace_graph_ent *trace)
+{
+	struct lttng_fgraph *fgraph;
+	int ret = 0;
+
+	rcu_read_lock_sched_notrace();
+	lttng_list_for_each_entry_rcu(fgraph, &fgraph_events, node) {
+		if (lttng_fgraph_match(fgraph, trace->func, trace->depth)) {
+			ret = 1;
+			break;
+		}
+	}
+	rcu_read_unlock_sched_notrace();
+	return ret;
+}
+
+static notrace
+void lttng_fgraph_return(struct ftrace_graph_ret *trace)
+{
+	uint64_t duration = trace->rettime - trace->calltime;
+	struct lttng_fgraph *fgraph;
+
+	rcu_read_lock_sched_notrace();
+	lttng_list_for_each_entry_rcu(fgraph, &fgraph_events, node) {
+		if (duration < fgraph->min_duration
+				|| !lttng_fgraph_match(fgraph, trace->func,
+						trace->depth))
+			continue;
+		lttng_fgraph_record(fgraph->event, trace, duration);
+	}
+	rcu_read_unlock_sched_notrace();
+}
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6,9,0))
+static notrace
+int lttng_fgraph_entry_handler(struct ftrace_graph_ent *trace,
+		struct fgraph_ops *gops)
+{
+	return lttng_fgraph_entry(trace);
+}
+
+static notrace
+void lttng_fgraph_return_handler(struct ftrace_graph_ret *trace,
+		struct fgraph_ops *gops)
+{
+	lttng_fgraph_return(trace);
+}
+#else /* #if (LINUX_VERSION_CODE >= KERNEL_VERSION(6,9,0)) */
+static notrace
+int lttng_fgraph_entry_handler(struct ftrace_graph_ent *trace)
+{
+	return lttng_fgraph_entry(trace);
+}
+
+static notrace
+void lttng_fgraph_return_handler(struct ftrace_graph_ret *trace)
+{
+	lttng_fgraph_return(trace);
+}
+#endif /* #else #if (LINUX_VERSION_CODE >= KERNEL_VERSION(6,9,0)) */
+
+#ifdef LTTNG_FGRAPH_OPS
+static struct fgraph_ops lttng_fgraph_ops = {
+	.entryfunc = lttng_fgraph_entry_handler,
+	.retfunc = lttng_fgraph_return_handler,
+};
+
+static
+int lttng_fgraph_hooks_register(void)
+{
+	return wrapper_register_ftrace_graph(&lttng_fgraph_ops);
+}
+
+static
+void lttng_fgraph_hooks_unregister(void)
+{
+	wrapper_unregister_ftrace_graph(&lttng_fgraph_ops);
+}
+#else /* #ifdef LTTNG_FGRAPH_OPS */
+static
+int lttng_fgraph_hooks_register(void)
+{
+	return wrapper_register_ftrace_graph(lttng_fgraph_return_handler,
+			lttng_fgraph_entry_handler);
+}
+
+static
+void lttng_fgraph_hooks_unregister(void)
+{
+	wrapper_unregister_ftrace_graph();
+}
+#endif /* #else #ifdef LTTNG_FGRAPH_OPS */
+
+#ifdef CONFIG_KALLSYMS
+struct lttng_fgraph_func_match {
+	const char *symbols;		/* Comma-separated globs */
+	unsigned long *addrs;
+	unsigned int nr_addrs;
+	int ret;
+};
+
+static
+int lttng_fgraph_match_symbol(void *data, const char *name,
+		struct module *mod, unsigned long addr)
+{
+	struct lttng_fgraph_func_match *match = data;
+	const char *pattern = match->symbols, *end;
+
+	for (;; pattern = end + 1) {
+		end = strchrnul(pattern, ',');
+		if (end != pattern && strutils_star_glob_match(pattern,
+				end - pattern, name, strlen(name)))
+			break;
+		if (!*end)
+			return 0;
+	}
+	if (match->nr_addrs == LTTNG_FGRAPH_MAX_FUNCS) {
+		match->ret = -E2BIG;
+		return 1;
+	}
+	match->addrs[match->nr_addrs++] = addr;
+	return 0;
+}
+
+static
+int lttng_fgraph_addr_cmp(const void *a, const void *b)
+{
+	unsigned long addr_a = *(const unsigned long *) a;
+	unsigned long addr_b = *(const unsigned long *) b;
+
+	if (addr_a < addr_b)
+		return -1;
+	return addr_a > addr_b;
+}
+
+/*
+ * Resolve the functions matching a list of globs into a sorted array of
+ * unique addresses.
+ */
+static
+int lttng_fgraph_resolve(struct lttng_fgraph *fgraph, const char *symbols)
+{
+	struct lttng_fgraph_func_match match = {
+		.symbols = symbols,
+	};
+	unsigned int i, nr_funcs = 0;
+	int ret;
+
+	match.addrs = lttng_kvmalloc(LTTNG_FGRAPH_MAX_FUNCS
+			* sizeof(*match.addrs), GFP_KERNEL);
+	if (!match.addrs)
+		return -ENOMEM;
+	/* The walk of the module symbols requires the module mutex. */
+	mutex_lock(&module_mutex);
+	kallsyms_on_each_symbol(lttng_fgraph_match_symbol, &match);
+	mutex_unlock(&module_mutex);
+	ret = match.ret;
+	if (ret)
+		goto end;
+	/* Aliases of a function share its address. */
+	sort(match.addrs, match.nr_addrs, sizeof(*match.addrs),
+		lttng_fgraph_addr_cmp, NULL);
+	for (i = 0; i < match.nr_addrs; i++) {
+		if (!nr_funcs || match.addrs[i] != match.addrs[nr_funcs - 1])
+			match.addrs[nr_funcs++] = match.addrs[i];
+	}
+	if (!nr_funcs) {
+		ret = -ENOENT;
+		goto end;
+	}
+	fgraph->funcs = lttng_kvmalloc(nr_funcs * sizeof(*fgraph->funcs),
+			GFP_KERNEL);
+	if (!fgraph->funcs) {
+		ret = -ENOMEM;
+		goto end;
+	}
+	memcpy(fgraph->funcs, match.addrs, nr_funcs * sizeof(*fgraph->funcs));
+	fgraph->nr_funcs = nr_funcs;
+end:
+	lttng_kvfree(match.addrs);
+	return ret;
+}
+#else /* #ifdef CONFIG_KALLSYMS */
+static
+int lttng_fgraph_resolve(struct lttng_fgraph *fgraph, const char *symbols)
+{
+	return -ENOSYS;
+}
+#endif /* #else #ifdef CONFIG_KALLSYMS */
+
+/*
+ * Create event description
+ */
+static
+int lttng_create_fgraph_event(const char *name, struct lttng_event *event)
+{
+	struct lttng_event_field *fields;
+	struct lttng_event_desc *desc;
+	int ret;
+
+	desc = kzalloc(sizeof(*event->desc), GFP_KERNEL);
+	if (!desc)
+		return -ENOMEM;
+	desc->name = kstrdup(name, GFP_KERNEL);
+	if (!desc->name) {
+		ret = -ENOMEM;
+		goto error_str;
+	}
+	desc->nr_fields = 3;
+	desc->fields = fields =
+		kzalloc(3 * sizeof(struct lttng_event_field), GFP_KERNEL);
+	if (!desc->fields) {
+		ret = -ENOMEM;
+		goto error_fields;
+	}
+	fields[0].name = "ip";
+	fields[0].type.atype = atype_integer;
+	fields[0].type.u.basic.integer.size = sizeof(unsigned long) * CHAR_BIT;
+	fields[0].type.u.basic.integer.alignment = lttng_alignof(unsigned long) * CHAR_BIT;
+	fields[0].type.u.basic.integer.signedness = lttng_is_signed_type(unsigned long);
+	fields[0].type.u.basic.integer.reverse_byte_order = 0;
+	fields[0].type.u.basic.integer.base = 16;
+	fields[0].type.u.basic.integer.encoding = lttng_encode_none;
+
+	fields[1].name = "duration";
+	fields[1].type.atype = atype_integer;
+	fields[1].type.u.basic.integer.size = sizeof(uint64_t) * CHAR_BIT;
+	fields[1].type.u.basic.integer.alignment = lttng_alignof(uint64_t) * CHAR_BIT;
+	fields[1].type.u.basic.integer.signedness = lttng_is_signed_type(uint64_t);
+	fields[1].type.u.basic.integer.reverse_byte_order = 0;
+	fields[1].type.u.basic.integer.base = 10;
+	fields[1].type.u.basic.integer.encoding = lttng_encode_none;
+
+	fields[2].name = "depth";
+	fields[2].type.atype = atype_integer;
+	fields[2].type.u.basic.integer.size = sizeof(uint32_t) * CHAR_BIT;
+	fields[2].type.u.basic.integer.alignment = lttng_alignof(uint32_t) * CHAR_BIT;
+	fields[2].type.u.basic.integer.signedness = lttng_is_signed_type(uint32_t);
+	fields[2].type.u.basic.integer.reverse_byte_order = 0;
+	fields[2].type.u.basic.integer.base = 10;
+	fields[2].type.u.basic.integer.encoding = lttng_encode_none;
+
+	desc->owner = THIS_MODULE;
+	event->desc = desc;
+
+	return 0;
+
+error_fields:
+	kfree(desc->name);
+error_str:
+	kfree(desc);
+	return ret;
+}
+
+int lttng_fgraph_register(const char *name,
+			  const char *symbol_name,
+			  uint32_t max_depth,
+			  uint64_t min_duration,
+			  struct lttng_event *event)
+{
+	struct lttng_fgraph *fgraph;
+	int ret;
+
+	ret = lttng_create_fgraph_event(name, event);
+	if (ret)
+		goto error;
+
+	fgraph = kzalloc(sizeof(*fgraph), GFP_KERNEL);
+	if (!fgraph) {
+		ret = -ENOMEM;
+		goto fgraph_error;
+	}
+	fgraph->event = event;
+	fgraph->max_depth = max_depth;
+	fgraph->min_duration = min_duration;
+	if (symbol_name[0] != '\0') {
+		ret = lttng_fgraph_resolve(fgraph, symbol_name);
+		if (ret)
+			goto resolve_error;
+	}
+	event->u.fgraph.lttng_fgraph = fgraph;
+
+	/* Ensure the memory we just allocated don't trigger page faults */
+	wrapper_vmalloc_sync_all();
+
+	mutex_lock(&fgraph_mutex);
+	if (list_empty(&fgraph_events)) {
+		ret = lttng_fgraph_hooks_register();
+		if (ret) {
+			mutex_unlock(&fgraph_mutex);
+			goto register_error;
+		}
+	}
+	list_add_tail_rcu(&fgraph->node, &fgraph_events);
+	mutex_unlock(&fgraph_mutex);
+	return 0;
+
+register_error:
+	lttng_kvfree(fgraph->funcs);
+resolve_error:
+	kfree(fgraph);
+fgraph_error:
+	kfree(event->desc->fields);
+	kfree(event->desc->name);
+	kfree(event->desc);
+error:
+	return ret;
+}
+EXPORT_SYMBOL_GPL(lttng_fgraph_register);
+
+void lttng_fgraph_unregister(struct lttng_event *event)
+{
+	mutex_lock(&fgraph_mutex);
+	list_del_rcu(&event->u.fgraph.lttng_fgraph->node);
+	if (list_empty(&fgraph_events))
+		lttng_fgraph_hooks_unregister();
+	mutex_unlock(&fgraph_mutex);
+	/* Wait for the hooks walking the event list. */
+	synchronize_sched();
+}
+EXPORT_SYMBOL_GPL(lttng_fgraph_unregister);
+
+void lttng_fgraph_destroy_private(struct lttng_event *event)
+{
+	lttng_kvfree(event->u.fgraph.lttng_fgraph->funcs);
+	kfree(event->u.fgraph.lttng_fgraph);
+	kfree(event->desc->fields);
+	kfree(event->desc->name);
+	kfree(event->desc);
+}
+EXPORT_SYMBOL_GPL(lttng_fgraph_destroy_private);
+
+MODULE_LICENSE("GPL and additional rights");
+MODULE_AUTHOR("agent <agent@local>");
+MODULE_DESCRIPTION("LTTng function graph probes");
+MODULE_VERSION(__stringify(LTTNG_MODULES_MAJOR_VERSION) "."
+	__stringify(LTTNG_MODULES_MINOR_VERSION) "."
+	__stringify(LTTNG_MODULES_PATCHLEVEL_VERSION)
+	LTTNG_MODULES_EXTRAVERSION);
@@ -45,11 +45,7 @@ void lttng_ftrace_handler(unsigned long ip, unsigned long parent_ip,
 	} payload;
 	int ret;
 
-	if (unlikely(!READ_ONCE(chan->session->active)))
-		return;
-	if (unlikely(!READ_ONCE(chan->enabled)))
-		return;
-	if (unlikely(!READ_ONCE(event->enabled)))
+	if (unlikely(!(READ_ONCE(event->armed) & LTTNG_EVENT_ARMED)))
 		return;
 
 	lib_ring_buffer_ctx_init(&ctx, chan->chan, &lttng_probe_ctx,
@@ -81,11 +77,7 @@ void lttng_ftrace_handler(unsigned long ip, unsigned long parent_ip, void **data
 	} payload;
 	int ret;
 
-	if (unlikely(!READ_ONCE(chan->session->active)))
-		return;
-	if (unlikely(!READ_ONCE(chan->enabled)))
-		return;
-	if (unlikely(!READ_ONCE(event->enabled)))
+	if (unlikely(!(READ_ONCE(event->armed) & LTTNG_EVENT_ARMED)))
 		return;
 
 	lib_ring_buffer_ctx_init(&ctx, chan->chan, &lttng_probe_ctx,
@@ -0,0 +1,269 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * probes/lttng-hwtrace-sync.c
+ *
+ * LTTng hardware trace correlation markers, using per-cpu hrtimers.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+/*
+ * Each event arms one pinned hrtimer per online cpu, expiring at the
+ * configured frequency. Each expiry records a marker holding the cpu
+ * cycle counter, which timestamps the hardware instruction traces (TSC
+ * packets of Intel PT on x86, the generic timer of CoreSight on arm64),
+ * along with the perf clock and the LTTng trace clock, read back to back
+ * with interrupts off. Hardware trace decoders map their timestamps to
+ * the trace clock by interpolating between the markers of each cpu.
+ *
+ * The hardware traces themselves are configured and collected through
+ * the perf interface (e.g. "perf record -e intel_pt//"): their AUX
+ * buffers are only allocated through the perf mmap interface, so they
+ * cannot be exposed as LTTng streams.
+ *
+ * As for the cpu sampler, the timers run while the event is registered,
+ * markers being recorded only while it is armed, and cpus brought online
+ * after the registration are not covered.
+ */
+
+#include <linux/module.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/cpu.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/version.h>
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,11,0))
+#include <linux/sched/clock.h>
+#endif
+#include <linux/slab.h>
+#include <linux/timex.h>
+#include <lttng-events.h>
+#include <wrapper/ringbuffer/frontend_types.h>
+#include <wrapper/trace-clock.h>
+#include <wrapper/vmalloc.h>
+#include <lttng-tracer.h>
+#include <lttng-kernel-version.h>
+
+/* At most one marker every 1ms on each cpu. */
+#define LTTNG_HWTRACE_SYNC_MAX_FREQUENCY	1000
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5,4,0))
+/* Expire in hard interrupt context, even on PREEMPT_RT. */
+#define LTTNG_HWTRACE_SYNC_HRTIMER_MODE	HRTIMER_MODE_REL_PINNED_HARD
+#else
+#define LTTNG_HWTRACE_SYNC_HRTIMER_MODE	HRTIMER_MODE_REL_PINNED
+#endif
+
+struct lttng_hwtrace_sync_cpu {
+	struct hrtimer timer;
+	struct lttng_hwtrace_sync *sync;
+	int cpu;
+};
+
+struct lttng_hwtrace_sync {
+	struct lttng_event *event;
+	ktime_t period;
+	struct lttng_hwtrace_sync_cpu __percpu *cpus;
+};
+
+static
+void lttng_hwtrace_sync_record(struct lttng_event *event)
+{
+	struct lttng_probe_ctx lttng_probe_ctx = {
+		.event = event,
+		.interruptible = 0,
+	};
+	struct lttng_channel *chan = event->chan;
+	struct lib_ring_buffer_ctx ctx;
+	struct {
+		uint64_t hw_counter;
+		uint64_t perf_clock;
+		uint64_t trace_clock;
+	} payload;
+	int ret;
+
+	if (unlikely(!(READ_ONCE(event->armed) & LTTNG_EVENT_ARMED)))
+		return;
+
+	payload.trace_clock = trace_clock_read64();
+	payload.hw_counter = (uint64_t) get_cycles();
+	payload.perf_clock = local_clock();
+	lib_ring_buffer_ctx_init(&ctx, chan->chan, &lttng_probe_ctx,
+				 sizeof(payload), lttng_alignof(payload), -1);
+	ret = chan->ops->event_reserve(&ctx, event->id);
+	if (ret < 0)
+		return;
+	lib_ring_buffer_align_ctx(&ctx, lttng_alignof(payload));
+	chan->ops->event_write(&ctx, &payload, sizeof(payload));
+	chan->ops->event_commit(&ctx);
+}
+
+static
+enum hrtimer_restart lttng_hwtrace_sync_timer(struct hrtimer *timer)
+{
+	struct lttng_hwtrace_sync_cpu *sync_cpu =
+		container_of(timer, struct lttng_hwtrace_sync_cpu, timer);
+	struct lttng_hwtrace_sync *sync = sync_cpu->sync;
+
+	/* Migrated from an offline cpu: its cpu is not covered anymore. */
+	if (sync_cpu->cpu != smp_processor_id())
+		return HRTIMER_NORESTART;
+	lttng_hwtrace_sync_record(sync->event);
+	hrtimer_forward_now(timer, sync->period);
+	return HRTIMER_RESTART;
+}
+
+/* Called on each cpu, since the timers are pinned. */
+static
+void lttng_hwtrace_sync_start_cpu(void *info)
+{
+	struct lttng_hwtrace_sync *sync = info;
+	struct lttng_hwtrace_sync_cpu *sync_cpu = this_cpu_ptr(sync->cpus);
+
+	hrtimer_start(&sync_cpu->timer, sync->period,
+		LTTNG_HWTRACE_SYNC_HRTIMER_MODE);
+}
+
+static
+void lttng_hwtrace_sync_init_field(struct lttng_event_field *field,
+		const char *name)
+{
+	field->name = name;
+	field->type.atype = atype_integer;
+	field->type.u.basic.integer.size = sizeof(uint64_t) * CHAR_BIT;
+	field->type.u.basic.integer.alignment = lttng_alignof(uint64_t) * CHAR_BIT;
+	field->type.u.basic.integer.signedness = lttng_is_signed_type(uint64_t);
+	field->type.u.basic.integer.reverse_byte_order = 0;
+	field->type.u.basic.integer.base = 10;
+	field->type.u.basic.integer.encoding = lttng_encode_none;
+}
+
+/*
+ * Create event description
+ */
+static
+int lttng_create_hwtrace_sync_event(const char *name, struct lttng_event *event)
+{
+	struct lttng_event_field *fields;
+	struct lttng_event_desc *desc;
+	int ret;
+
+	desc = kzalloc(sizeof(*event->desc), GFP_KERNEL);
+	if (!desc)
+		return -ENOMEM;
+	desc->name = kstrdup(name, GFP_KERNEL);
+	if (!desc->name) {
+		ret = -ENOMEM;
+		goto error_str;
+	}
+	desc->nr_fields = 3;
+	desc->fields = fields =
+		kzalloc(3 * sizeof(struct lttng_event_field), GFP_KERNEL);
+	if (!desc->fields) {
+		ret = -ENOMEM;
+		goto error_fields;
+	}
+	lttng_hwtrace_sync_init_field(&fields[0], "hw_counter");
+	lttng_hwtrace_sync_init_field(&fields[1], "perf_clock");
+	lttng_hwtrace_sync_init_field(&fields[2], "trace_clock");
+
+	desc->owner = THIS_MODULE;
+	event->desc = desc;
+
+	return 0;
+
+error_fields:
+	kfree(desc->name);
+error_str:
+	kfree(desc);
+	return ret;
+}
+
+int lttng_hwtrace_sync_register(const char *name,
+			   uint64_t frequency,
+			   struct lttng_event *event)
+{
+	struct lttng_hwtrace_sync *sync;
+	int ret, cpu;
+
+	if (!frequency || frequency > LTTNG_HWTRACE_SYNC_MAX_FREQUENCY)
+		return -EINVAL;
+	ret = lttng_create_hwtrace_sync_event(name, event);
+	if (ret)
+		goto error;
+
+	sync = kzalloc(sizeof(*sync), GFP_KERNEL);
+	if (!sync) {
+		ret = -ENOMEM;
+		goto sync_error;
+	}
+	sync->cpus = alloc_percpu(struct lttng_hwtrace_sync_cpu);
+	if (!sync->cpus) {
+		ret = -ENOMEM;
+		goto percpu_error;
+	}
+	sync->event = event;
+	sync->period = ns_to_ktime(div64_u64(NSEC_PER_SEC, frequency));
+	for_each_possible_cpu(cpu) {
+		struct lttng_hwtrace_sync_cpu *sync_cpu =
+			per_cpu_ptr(sync->cpus, cpu);
+
+		hrtimer_init(&sync_cpu->timer, CLOCK_MONOTONIC,
+			LTTNG_HWTRACE_SYNC_HRTIMER_MODE);
+		sync_cpu->timer.function = lttng_hwtrace_sync_timer;
+		sync_cpu->sync = sync;
+		sync_cpu->cpu = cpu;
+	}
+	event->u.hwtrace_sync.lttng_hwtrace_sync = sync;
+
+	/* Ensure the memory we just allocated don't trigger page faults */
+	wrapper_vmalloc_sync_all();
+
+	get_online_cpus();
+	on_each_cpu(lttng_hwtrace_sync_start_cpu, sync, 1);
+	put_online_cpus();
+	return 0;
+
+percpu_error:
+	kfree(sync);
+sync_error:
+	kfree(event->desc->fields);
+	kfree(event->desc->name);
+	kfree(event->desc);
+error:
+	return ret;
+}
+EXPORT_SYMBOL_GPL(lttng_hwtrace_sync_register);
+
+void lttng_hwtrace_sync_unregister(struct lttng_event *event)
+{
+	struct lttng_hwtrace_sync *sync = event->u.hwtrace_sync.lttng_hwtrace_sync;
+	int cpu;
+
+	/* Waits for the callbacks in progress. */
+	for_each_possible_cpu(cpu)
+		hrtimer_cancel(&per_cpu_ptr(sync->cpus, cpu)->timer);
+}
+EXPORT_SYMBOL_GPL(lttng_hwtrace_sync_unregister);
+
+void lttng_hwtrace_sync_destroy_private(struct lttng_event *event)
+{
+	struct lttng_hwtrace_sync *sync = event->u.hwtrace_sync.lttng_hwtrace_sync;
+
+	free_percpu(sync->cpus);
+	kfree(sync);
+	kfree(event->desc->fields);
+	kfree(event->desc->name);
+	kfree(event->desc);
+}
+EXPORT_SYMBOL_GPL(lttng_hwtrace_sync_destroy_private);
+
+MODULE_LICENSE("GPL and additional rights");
+MODULE_AUTHOR("agent <agent@local>");
+MODULE_DESCRIPTION("LTTng hardware trace correlation markers");
+MODULE_VERSION(__stringify(LTTNG_MODULES_MAJOR_VERSION) "."
+	__stringify(LTTNG_MODULES_MINOR_VERSION) "."
+	__stringify(LTTNG_MODULES_PATCHLEVEL_VERSION)
+	LTTNG_MODULES_EXTRAVERSION);
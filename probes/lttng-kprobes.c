@@ -9,66 +9,385 @@
 
 #include <linux/module.h>
 #include <linux/kprobes.h>
+#include <linux/kallsyms.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/uaccess.h>
 #include <lttng-events.h>
+#include <lttng-string-utils.h>
 #include <wrapper/ringbuffer/frontend_types.h>
 #include <wrapper/vmalloc.h>
 #include <wrapper/irqflags.h>
 #include <lttng-tracer.h>
+#include <lttng-kernel-version.h>
+
+/*
+ * A symbol name holding star globs or a comma-separated list of symbols
+ * instruments all the matching functions with a single event. The
+ * addresses are resolved with a single walk of the kernel symbols, and
+ * the kprobes are registered and unregistered as one batch, with a
+ * single grace period. Functions which cannot be probed are skipped.
+ */
+#define LTTNG_KPROBE_BULK_MAX	65536
+
+struct lttng_kprobe_bulk_probe {
+	struct kprobe kp;
+	struct lttng_event *event;
+};
+
+struct lttng_kprobe_bulk {
+	struct lttng_kprobe_bulk_probe *probes;
+	struct kprobe **kps;		/* Registered kprobes */
+	unsigned int nr_kps;
+};
+
+/*
+ * Argument fetch program. Each argument loads a register or a stack
+ * slot, follows its dereferences, and stores its value or the memory it
+ * points to into the payload.
+ */
+enum lttng_kprobe_fetch_op {
+	LTTNG_KPROBE_FETCH_OP_REG,	/* value = register at offset */
+	LTTNG_KPROBE_FETCH_OP_STACK,	/* value = stack slot "offset" */
+	LTTNG_KPROBE_FETCH_OP_DEREF,	/* value = *(value + offset) */
+	LTTNG_KPROBE_FETCH_OP_STORE_VALUE,	/* Record "size" bytes of value */
+	LTTNG_KPROBE_FETCH_OP_STORE_MEM,	/* Record "size" bytes at value + offset */
+};
+
+struct lttng_kprobe_fetch_insn {
+	uint8_t op;			/* enum lttng_kprobe_fetch_op */
+	uint8_t size;			/* Stores: size in bytes */
+	uint8_t align;			/* Stores: alignment in bytes */
+	long offset;
+};
+
+struct lttng_kprobe_fetch {
+	size_t payload_len[2];		/* Unpacked and packed channels */
+	size_t payload_align;
+	unsigned int nr_insns;
+	struct lttng_kprobe_fetch_insn insns[];
+};
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5,8,0))
+static inline
+long lttng_probe_kernel_read(void *dst, const void *src, size_t size)
+{
+	return copy_from_kernel_nofault(dst, src, size);
+}
+#else
+static inline
+long lttng_probe_kernel_read(void *dst, const void *src, size_t size)
+{
+	return probe_kernel_read(dst, src, size);
+}
+#endif
 
 static
-int lttng_kprobes_handler_pre(struct kprobe *p, struct pt_regs *regs)
+int lttng_kprobes_record(struct lttng_event *event, struct kprobe *p,
+		struct pt_regs *regs)
 {
-	struct lttng_event *event =
-		container_of(p, struct lttng_event, u.kprobe.kp);
 	struct lttng_probe_ctx lttng_probe_ctx = {
 		.event = event,
 		.interruptible = !lttng_regs_irqs_disabled(regs),
 	};
+	const struct lttng_kprobe_fetch *fetch = event->u.kprobe.fetch;
 	struct lttng_channel *chan = event->chan;
 	struct lib_ring_buffer_ctx ctx;
 	int ret;
 	unsigned long data = (unsigned long) p->addr;
+	size_t len = sizeof(data), align = lttng_alignof(data);
 
-	if (unlikely(!READ_ONCE(chan->session->active)))
-		return 0;
-	if (unlikely(!READ_ONCE(chan->enabled)))
-		return 0;
-	if (unlikely(!READ_ONCE(event->enabled)))
+	if (unlikely(!(READ_ONCE(event->armed) & LTTNG_EVENT_ARMED)))
 		return 0;
 
-	lib_ring_buffer_ctx_init(&ctx, chan->chan, &lttng_probe_ctx, sizeof(data),
-				 lttng_alignof(data), -1);
+	if (fetch) {
+		len = fetch->payload_len[!!chan->packed];
+		align = fetch->payload_align;
+	}
+	lib_ring_buffer_ctx_init(&ctx, chan->chan, &lttng_probe_ctx, len,
+				 align, -1);
 	ret = chan->ops->event_reserve(&ctx, event->id);
 	if (ret < 0)
 		return 0;
 	lib_ring_buffer_align_ctx(&ctx, lttng_alignof(data));
 	chan->ops->event_write(&ctx, &data, sizeof(data));
+	if (fetch)
+		lttng_kprobe_fetch_run(fetch, regs, chan, &ctx);
 	chan->ops->event_commit(&ctx);
 	return 0;
 }
 
+static
+int lttng_kprobes_handler_pre(struct kprobe *p, struct pt_regs *regs)
+{
+	return lttng_kprobes_record(
+		container_of(p, struct lttng_event, u.kprobe.kp), p, regs);
+}
+
+static
+int lttng_kprobes_bulk_handler_pre(struct kprobe *p, struct pt_regs *regs)
+{
+	struct lttng_kprobe_bulk_probe *probe =
+		container_of(p, struct lttng_kprobe_bulk_probe, kp);
+
+	return lttng_kprobes_record(probe->event, p, regs);
+}
+
+#ifdef CONFIG_HAVE_REGS_AND_STACK_ACCESS_API
+/*
+ * Compile an argument fetch specification into a fetch program, and
+ * append the fields of the arguments to the event description.
+ */
+static
+int lttng_kprobe_fetch_compile(const struct lttng_kernel_kprobe_fetch_arg *args,
+		uint32_t nr_args, struct lttng_event_field *fields,
+		struct lttng_kprobe_fetch **fetchp)
+{
+	struct lttng_kprobe_fetch *fetch;
+	size_t len[2] = { sizeof(unsigned long), sizeof(unsigned long) };
+	size_t largest_align = lttng_alignof(unsigned long);
+	unsigned int i, j, nr_insns = 0;
+	int ret;
+
+	for (i = 0; i < nr_args; i++)
+		nr_insns += args[i].nr_derefs + 2;
+	fetch = kzalloc(sizeof(*fetch) + nr_insns * sizeof(fetch->insns[0]),
+			GFP_KERNEL);
+	if (!fetch)
+		return -ENOMEM;
+	for (i = 0; i < nr_args; i++) {
+		const struct lttng_kernel_kprobe_fetch_arg *arg = &args[i];
+		struct lttng_event_field *field = &fields[i];
+		struct lttng_kprobe_fetch_insn *insn;
+		struct lttng_integer_type *integer;
+		int is_integer;
+		size_t align;
+
+		is_integer = arg->size == 1 || arg->size == 2
+			|| arg->size == 4 || arg->size == 8;
+		ret = -EINVAL;
+		if (!arg->size || arg->size > LTTNG_KERNEL_KPROBE_FETCH_MAX_SIZE
+				|| arg->nr_derefs > LTTNG_KERNEL_KPROBE_FETCH_MAX_DEREFS
+				|| (!arg->nr_derefs && (!is_integer
+					|| arg->size > sizeof(unsigned long))))
+			goto error;
+		insn = &fetch->insns[fetch->nr_insns++];
+		switch (arg->base) {
+		case LTTNG_KERNEL_KPROBE_FETCH_REG:
+			if (arg->index % sizeof(unsigned long)
+					|| arg->index >= sizeof(struct pt_regs))
+				goto error;
+			insn->op = LTTNG_KPROBE_FETCH_OP_REG;
+			break;
+		case LTTNG_KERNEL_KPROBE_FETCH_STACK:
+			insn->op = LTTNG_KPROBE_FETCH_OP_STACK;
+			break;
+		default:
+			goto error;
+		}
+		insn->offset = arg->index;
+		for (j = 0; j + 1 < arg->nr_derefs; j++) {
+			insn = &fetch->insns[fetch->nr_insns++];
+			insn->op = LTTNG_KPROBE_FETCH_OP_DEREF;
+			insn->offset = arg->deref_offset[j];
+		}
+		align = is_integer ? arg->size : 1;
+		insn = &fetch->insns[fetch->nr_insns++];
+		insn->size = arg->size;
+		insn->align = align;
+		if (arg->nr_derefs) {
+			insn->op = LTTNG_KPROBE_FETCH_OP_STORE_MEM;
+			insn->offset = arg->deref_offset[arg->nr_derefs - 1];
+		} else {
+			insn->op = LTTNG_KPROBE_FETCH_OP_STORE_VALUE;
+		}
+		len[0] += lib_ring_buffer_record_align(0, len[0], align);
+		len[0] += arg->size;
+		len[1] += arg->size;
+		largest_align = max(largest_align, align);
+
+		field->name = kstrndup(arg->name,
+				LTTNG_KERNEL_KPROBE_FETCH_NAME_LEN - 1, GFP_KERNEL);
+		if (!field->name) {
+			ret = -ENOMEM;
+			goto error;
+		}
+		if (is_integer) {
+			field->type.atype = atype_integer;
+			integer = &field->type.u.basic.integer;
+		} else {
+			field->type.atype = atype_array;
+			field->type.u.array.elem_type.atype = atype_integer;
+			field->type.u.array.length = arg->size;
+			integer = &field->type.u.array.elem_type.u.basic.integer;
+		}
+		integer->size = (is_integer ? arg->size : 1) * CHAR_BIT;
+		integer->alignment = align * CHAR_BIT;
+		integer->signedness = is_integer
+			&& (arg->flags & LTTNG_KERNEL_KPROBE_FETCH_SIGNED);
+		integer->reverse_byte_order = 0;
+		integer->base = (!is_integer
+			|| (arg->flags & LTTNG_KERNEL_KPROBE_FETCH_HEX)) ? 16 : 10;
+		integer->encoding = lttng_encode_none;
+	}
+	fetch->payload_len[0] = len[0];
+	fetch->payload_len[1] = len[1];
+	fetch->payload_align = largest_align;
+	*fetchp = fetch;
+	return 0;
+
+error:
+	kfree(fetch);
+	return ret;
+}
+
+static
+unsigned long lttng_kprobe_fetch_load(struct pt_regs *regs,
+		const struct lttng_kprobe_fetch_insn *insn, unsigned long value)
+{
+	switch (insn->op) {
+	case LTTNG_KPROBE_FETCH_OP_REG:
+		return regs_get_register(regs, insn->offset);
+	case LTTNG_KPROBE_FETCH_OP_STACK:
+		return regs_get_kernel_stack_nth(regs, insn->offset);
+	case LTTNG_KPROBE_FETCH_OP_DEREF:
+		if (lttng_probe_kernel_read(&value,
+				(void *) (value + insn->offset), sizeof(value)))
+			return 0;
+		return value;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Run the fetch program, writing the arguments after the ip.
+ */
+static
+void lttng_kprobe_fetch_run(const struct lttng_kprobe_fetch *fetch,
+		struct pt_regs *regs, struct lttng_channel *chan,
+		struct lib_ring_buffer_ctx *ctx)
+{
+	char buf[LTTNG_KERNEL_KPROBE_FETCH_MAX_SIZE];
+	unsigned long value = 0;
+	unsigned int i;
+
+	for (i = 0; i < fetch->nr_insns; i++) {
+		const struct lttng_kprobe_fetch_insn *insn = &fetch->insns[i];
+
+		switch (insn->op) {
+		case LTTNG_KPROBE_FETCH_OP_STORE_VALUE:
+		{
+			union {
+				uint8_t u8;
+				uint16_t u16;
+				uint32_t u32;
+				uint64_t u64;
+			} v;
+
+			switch (insn->size) {
+			case 1:
+				v.u8 = value;
+				break;
+			case 2:
+				v.u16 = value;
+				break;
+			case 4:
+				v.u32 = value;
+				break;
+			default:
+				v.u64 = value;
+				break;
+			}
+			lib_ring_buffer_align_ctx(ctx, insn->align);
+			chan->ops->event_write(ctx, &v, insn->size);
+			break;
+		}
+		case LTTNG_KPROBE_FETCH_OP_STORE_MEM:
+			if (lttng_probe_kernel_read(buf,
+					(void *) (value + insn->offset),
+					insn->size))
+				memset(buf, 0, insn->size);
+			lib_ring_buffer_align_ctx(ctx, insn->align);
+			chan->ops->event_write(ctx, buf, insn->size);
+			break;
+		default:
+			value = lttng_kprobe_fetch_load(regs, insn, value);
+			break;
+		}
+	}
+}
+#else /* #ifdef CONFIG_HAVE_REGS_AND_STACK_ACCESS_API */
+static
+int lttng_kprobe_fetch_compile(const struct lttng_kernel_kprobe_fetch_arg *args,
+		uint32_t nr_args, struct lttng_event_field *fields,
+		struct lttng_kprobe_fetch **fetchp)
+{
+	return -ENOSYS;
+}
+
+static
+void lttng_kprobe_fetch_run(const struct lttng_kprobe_fetch *fetch,
+		struct pt_regs *regs, struct lttng_channel *chan,
+		struct lib_ring_buffer_ctx *ctx)
+{
+}
+#endif /* #else #ifdef CONFIG_HAVE_REGS_AND_STACK_ACCESS_API */
+
+static
+void lttng_destroy_kprobe_event(struct lttng_event *event)
+{
+	unsigned int i;
+
+	/* The first field, "ip", is not allocated. */
+	for (i = 1; i < event->desc->nr_fields; i++)
+		kfree(event->desc->fields[i].name);
+	kfree(event->u.kprobe.fetch);
+	kfree(event->desc->fields);
+	kfree(event->desc->name);
+	kfree(event->desc);
+}
+
 /*
  * Create event description
  */
 static
-int lttng_create_kprobe_event(const char *name, struct lttng_event *event)
+int lttng_create_kprobe_event(const char *name, uint64_t ufetch,
+		struct lttng_event *event)
 {
+	struct lttng_kernel_kprobe_fetch_arg *args = NULL;
 	struct lttng_event_field *field;
 	struct lttng_event_desc *desc;
+	uint32_t nr_args = 0;
 	int ret;
 
+	if (ufetch) {
+		struct lttng_kernel_kprobe_fetch __user *uspec =
+			(struct lttng_kernel_kprobe_fetch __user *)
+				(unsigned long) ufetch;
+
+		if (get_user(nr_args, &uspec->nr_args))
+			return -EFAULT;
+		if (nr_args > LTTNG_KERNEL_KPROBE_FETCH_MAX_ARGS)
+			return -EINVAL;
+		args = memdup_user(uspec->args, nr_args * sizeof(*args));
+		if (IS_ERR(args))
+			return PTR_ERR(args);
+	}
+	event->u.kprobe.fetch = NULL;
 	desc = kzalloc(sizeof(*event->desc), GFP_KERNEL);
-	if (!desc)
-		return -ENOMEM;
+	if (!desc) {
+		ret = -ENOMEM;
+		goto error_desc;
+	}
 	desc->name = kstrdup(name, GFP_KERNEL);
 	if (!desc->name) {
 		ret = -ENOMEM;
 		goto error_str;
 	}
-	desc->nr_fields = 1;
 	desc->fields = field =
-		kzalloc(1 * sizeof(struct lttng_event_field), GFP_KERNEL);
+		kzalloc((1 + nr_args) * sizeof(struct lttng_event_field),
+			GFP_KERNEL);
 	if (!field) {
 		ret = -ENOMEM;
 		goto error_field;
@@ -81,33 +400,205 @@ int lttng_create_kprobe_event(const char *name, struct lttng_event *event)
 	field->type.u.basic.integer.reverse_byte_order = 0;
 	field->type.u.basic.integer.base = 16;
 	field->type.u.basic.integer.encoding = lttng_encode_none;
+	desc->nr_fields = 1 + nr_args;
 	desc->owner = THIS_MODULE;
 	event->desc = desc;
-
+	if (nr_args) {
+		ret = lttng_kprobe_fetch_compile(args, nr_args, field + 1,
+				&event->u.kprobe.fetch);
+		if (ret) {
+			lttng_destroy_kprobe_event(event);
+			goto error_desc;
+		}
+	}
+	kfree(args);
 	return 0;
 
 error_field:
 	kfree(desc->name);
 error_str:
 	kfree(desc);
+error_desc:
+	kfree(args);
 	return ret;
 }
 
+#ifdef CONFIG_KALLSYMS
+struct lttng_kprobe_bulk_match {
+	const char *symbols;		/* Comma-separated globs */
+	unsigned long *addrs;
+	unsigned int nr_addrs;
+	int ret;
+};
+
+static
+int lttng_kprobe_bulk_match_symbol(void *data, const char *name,
+		struct module *mod, unsigned long addr)
+{
+	struct lttng_kprobe_bulk_match *match = data;
+	const char *pattern = match->symbols, *end;
+
+	for (;; pattern = end + 1) {
+		end = strchrnul(pattern, ',');
+		if (end != pattern && strutils_star_glob_match(pattern,
+				end - pattern, name, strlen(name)))
+			break;
+		if (!*end)
+			return 0;
+	}
+	if (match->nr_addrs == LTTNG_KPROBE_BULK_MAX) {
+		match->ret = -E2BIG;
+		return 1;
+	}
+	match->addrs[match->nr_addrs++] = addr;
+	return 0;
+}
+
+static
+int lttng_kprobe_addr_cmp(const void *a, const void *b)
+{
+	unsigned long addr_a = *(const unsigned long *) a;
+	unsigned long addr_b = *(const unsigned long *) b;
+
+	if (addr_a < addr_b)
+		return -1;
+	return addr_a > addr_b;
+}
+
+static
+int lttng_kprobes_bulk_register(const char *symbols, uint64_t offset,
+		struct lttng_event *event)
+{
+	struct lttng_kprobe_bulk_match match = {
+		.symbols = symbols,
+	};
+	struct lttng_kprobe_bulk *bulk;
+	unsigned int i, nr_probes = 0;
+	int ret;
+
+	match.addrs = lttng_kvmalloc(LTTNG_KPROBE_BULK_MAX
+			* sizeof(*match.addrs), GFP_KERNEL);
+	if (!match.addrs)
+		return -ENOMEM;
+	/* The walk of the module symbols requires the module mutex. */
+	mutex_lock(&module_mutex);
+	kallsyms_on_each_symbol(lttng_kprobe_bulk_match_symbol, &match);
+	mutex_unlock(&module_mutex);
+	ret = match.ret;
+	if (ret)
+		goto match_error;
+	/* Aliases of a function share its address. */
+	sort(match.addrs, match.nr_addrs, sizeof(*match.addrs),
+		lttng_kprobe_addr_cmp, NULL);
+	for (i = 0; i < match.nr_addrs; i++) {
+		if (!nr_probes || match.addrs[i] != match.addrs[nr_probes - 1])
+			match.addrs[nr_probes++] = match.addrs[i];
+	}
+	if (!nr_probes) {
+		ret = -ENOENT;
+		goto match_error;
+	}
+
+	bulk = kzalloc(sizeof(*bulk), GFP_KERNEL);
+	if (!bulk) {
+		ret = -ENOMEM;
+		goto match_error;
+	}
+	bulk->probes = lttng_kvzalloc(nr_probes * sizeof(*bulk->probes),
+			GFP_KERNEL);
+	bulk->kps = lttng_kvmalloc(nr_probes * sizeof(*bulk->kps),
+			GFP_KERNEL);
+	if (!bulk->probes || !bulk->kps) {
+		ret = -ENOMEM;
+		goto alloc_error;
+	}
+	for (i = 0; i < nr_probes; i++) {
+		struct lttng_kprobe_bulk_probe *probe = &bulk->probes[i];
+
+		probe->event = event;
+		probe->kp.pre_handler = lttng_kprobes_bulk_handler_pre;
+		probe->kp.addr = (kprobe_opcode_t *) match.addrs[i];
+		probe->kp.offset = offset;
+		bulk->kps[i] = &probe->kp;
+	}
+	event->u.kprobe.bulk = bulk;
+
+	/* Ensure the memory we just allocated don't trigger page faults. */
+	wrapper_vmalloc_sync_all();
+
+	ret = register_kprobes(bulk->kps, nr_probes);
+	if (!ret) {
+		bulk->nr_kps = nr_probes;
+		goto end;
+	}
+	/*
+	 * The batch is rolled back when one of the kprobes is refused,
+	 * e.g. for a blacklisted function: register the others one by
+	 * one.
+	 */
+	for (i = 0; i < nr_probes; i++) {
+		struct kprobe *kp = &bulk->probes[i].kp;
+
+		memset(kp, 0, sizeof(*kp));
+		kp->pre_handler = lttng_kprobes_bulk_handler_pre;
+		kp->addr = (kprobe_opcode_t *) match.addrs[i];
+		kp->offset = offset;
+		if (!register_kprobe(kp))
+			bulk->kps[bulk->nr_kps++] = kp;
+	}
+	if (!bulk->nr_kps)
+		goto alloc_error;
+end:
+	lttng_kvfree(match.addrs);
+	return 0;
+
+alloc_error:
+	event->u.kprobe.bulk = NULL;
+	lttng_kvfree(bulk->kps);
+	lttng_kvfree(bulk->probes);
+	kfree(bulk);
+match_error:
+	lttng_kvfree(match.addrs);
+	return ret;
+}
+#else /* #ifdef CONFIG_KALLSYMS */
+static
+int lttng_kprobes_bulk_register(const char *symbols, uint64_t offset,
+		struct lttng_event *event)
+{
+	return -ENOSYS;
+}
+#endif /* #else #ifdef CONFIG_KALLSYMS */
+
 int lttng_kprobes_register(const char *name,
 			   const char *symbol_name,
 			   uint64_t offset,
 			   uint64_t addr,
+			   uint64_t fetch,
 			   struct lttng_event *event)
 {
 	int ret;
 
+	if (strpbrk(symbol_name, "*,")) {
+		if (addr)
+			return -EINVAL;
+		ret = lttng_create_kprobe_event(name, fetch, event);
+		if (ret)
+			return ret;
+		ret = lttng_kprobes_bulk_register(symbol_name, offset, event);
+		if (ret)
+			lttng_destroy_kprobe_event(event);
+		return ret;
+	}
+
 	/* Kprobes expects a NULL symbol name if unused */
 	if (symbol_name[0] == '\0')
 		symbol_name = NULL;
 
-	ret = lttng_create_kprobe_event(name, event);
+	ret = lttng_create_kprobe_event(name, fetch, event);
 	if (ret)
 		goto error;
+	event->u.kprobe.bulk = NULL;
 	memset(&event->u.kprobe.kp, 0, sizeof(event->u.kprobe.kp));
 	event->u.kprobe.kp.pre_handler = lttng_kprobes_handler_pre;
 	if (symbol_name) {
@@ -141,9 +632,7 @@ int lttng_kprobes_register(const char *name,
 register_error:
 	kfree(event->u.kprobe.symbol_name);
 name_error:
-	kfree(event->desc->fields);
-	kfree(event->desc->name);
-	kfree(event->desc);
+	lttng_destroy_kprobe_event(event);
 error:
 	return ret;
 }
@@ -151,16 +640,26 @@ EXPORT_SYMBOL_GPL(lttng_kprobes_register);
 
 void lttng_kprobes_unregister(struct lttng_event *event)
 {
-	unregister_kprobe(&event->u.kprobe.kp);
+	struct lttng_kprobe_bulk *bulk = event->u.kprobe.bulk;
+
+	if (bulk)
+		unregister_kprobes(bulk->kps, bulk->nr_kps);
+	else
+		unregister_kprobe(&event->u.kprobe.kp);
 }
 EXPORT_SYMBOL_GPL(lttng_kprobes_unregister);
 
 void lttng_kprobes_destroy_private(struct lttng_event *event)
 {
+	struct lttng_kprobe_bulk *bulk = event->u.kprobe.bulk;
+
+	if (bulk) {
+		lttng_kvfree(bulk->kps);
+		lttng_kvfree(bulk->probes);
+		kfree(bulk);
+	}
 	kfree(event->u.kprobe.symbol_name);
-	kfree(event->desc->fields);
-	kfree(event->desc->name);
-	kfree(event->desc);
+	lttng_destroy_kprobe_event(event);
 }
 EXPORT_SYMBOL_GPL(lttng_kprobes_destroy_private);
 
@@ -11,10 +11,12 @@
 #include <linux/kprobes.h>
 #include <linux/slab.h>
 #include <linux/kref.h>
+#include <linux/math64.h>
 #include <lttng-events.h>
 #include <wrapper/ringbuffer/frontend_types.h>
 #include <wrapper/vmalloc.h>
 #include <wrapper/irqflags.h>
+#include <wrapper/trace-clock.h>
 #include <lttng-tracer.h>
 
 enum lttng_kretprobe_type {
@@ -22,9 +24,15 @@ enum lttng_kretprobe_type {
 	EVENT_RETURN = 1,
 };
 
+/*
+ * With a latency threshold, the entry handler only saves the entry time
+ * in the kretprobe instance data, and the return handler records the
+ * return event, with the call duration, when it reaches the threshold.
+ */
 struct lttng_krp {
 	struct kretprobe krp;
 	struct lttng_event *event[2];	/* ENTRY and RETURN */
+	uint64_t threshold;		/* trace clock units, 0: no latency mode */
 	struct kref kref_register;
 	struct kref kref_alloc;
 };
@@ -49,24 +57,42 @@ int _lttng_kretprobes_handler(struct kretprobe_instance *krpi,
 		unsigned long ip;
 		unsigned long parent_ip;
 	} payload;
+	size_t payload_len = sizeof(payload), align = lttng_alignof(payload);
+	uint64_t duration = 0;
 
-	if (unlikely(!READ_ONCE(chan->session->active)))
-		return 0;
-	if (unlikely(!READ_ONCE(chan->enabled)))
-		return 0;
-	if (unlikely(!READ_ONCE(event->enabled)))
+	if (lttng_krp->threshold) {
+		uint64_t *entry_time = (uint64_t *) krpi->data;
+
+		if (type == EVENT_ENTRY) {
+			*entry_time = trace_clock_read64();
+			return 0;
+		}
+		duration = trace_clock_read64() - *entry_time;
+		if (duration < lttng_krp->threshold)
+			return 0;
+		payload_len += lib_ring_buffer_record_align(chan->packed,
+				payload_len, lttng_alignof(duration));
+		payload_len += sizeof(duration);
+		align = max_t(size_t, align, lttng_alignof(duration));
+	}
+
+	if (unlikely(!(READ_ONCE(event->armed) & LTTNG_EVENT_ARMED)))
 		return 0;
 
 	payload.ip = (unsigned long) krpi->rp->kp.addr;
 	payload.parent_ip = (unsigned long) krpi->ret_addr;
 
-	lib_ring_buffer_ctx_init(&ctx, chan->chan, &lttng_probe_ctx, sizeof(payload),
-				 lttng_alignof(payload), -1);
+	lib_ring_buffer_ctx_init(&ctx, chan->chan, &lttng_probe_ctx, payload_len,
+				 align, -1);
 	ret = chan->ops->event_reserve(&ctx, event->id);
 	if (ret < 0)
 		return 0;
-	lib_ring_buffer_align_ctx(&ctx, lttng_alignof(payload));
+	lib_ring_buffer_align_ctx(&ctx, align);
 	chan->ops->event_write(&ctx, &payload, sizeof(payload));
+	if (lttng_krp->threshold) {
+		lib_ring_buffer_align_ctx(&ctx, lttng_alignof(duration));
+		chan->ops->event_write(&ctx, &duration, sizeof(duration));
+	}
 	chan->ops->event_commit(&ctx);
 	return 0;
 }
@@ -90,7 +116,7 @@ int lttng_kretprobes_handler_return(struct kretprobe_instance *krpi,
  */
 static
 int lttng_create_kprobe_event(const char *name, struct lttng_event *event,
-			      enum lttng_kretprobe_type type)
+			      enum lttng_kretprobe_type type, bool latency)
 {
 	struct lttng_event_field *fields;
 	struct lttng_event_desc *desc;
@@ -120,9 +146,10 @@ int lttng_create_kprobe_event(const char *name, struct lttng_event *event,
 	strcpy(alloc_name, name);
 	strcat(alloc_name, suffix);
 	desc->name = alloc_name;
-	desc->nr_fields = 2;
+	desc->nr_fields = latency ? 3 : 2;
 	desc->fields = fields =
-		kzalloc(2 * sizeof(struct lttng_event_field), GFP_KERNEL);
+		kzalloc(desc->nr_fields * sizeof(struct lttng_event_field),
+			GFP_KERNEL);
 	if (!desc->fields) {
 		ret = -ENOMEM;
 		goto error_fields;
@@ -145,6 +172,17 @@ int lttng_create_kprobe_event(const char *name, struct lttng_event *event,
 	fields[1].type.u.basic.integer.base = 16;
 	fields[1].type.u.basic.integer.encoding = lttng_encode_none;
 
+	if (latency) {
+		fields[2].name = "duration";
+		fields[2].type.atype = atype_integer;
+		fields[2].type.u.basic.integer.size = sizeof(uint64_t) * CHAR_BIT;
+		fields[2].type.u.basic.integer.alignment = lttng_alignof(uint64_t) * CHAR_BIT;
+		fields[2].type.u.basic.integer.signedness = lttng_is_signed_type(uint64_t);
+		fields[2].type.u.basic.integer.reverse_byte_order = 0;
+		fields[2].type.u.basic.integer.base = 10;
+		fields[2].type.u.basic.integer.encoding = lttng_encode_none;
+	}
+
 	desc->owner = THIS_MODULE;
 	event->desc = desc;
 
@@ -161,20 +199,32 @@ int lttng_kretprobes_register(const char *name,
 			   const char *symbol_name,
 			   uint64_t offset,
 			   uint64_t addr,
+			   uint64_t threshold,
 			   struct lttng_event *event_entry,
 			   struct lttng_event *event_return)
 {
 	int ret;
 	struct lttng_krp *lttng_krp;
+	uint64_t freq = trace_clock_freq();
 
 	/* Kprobes expects a NULL symbol name if unused */
 	if (symbol_name[0] == '\0')
 		symbol_name = NULL;
 
-	ret = lttng_create_kprobe_event(name, event_entry, EVENT_ENTRY);
+	/* Convert the threshold from ns to trace clock units. */
+	if (threshold && freq != NSEC_PER_SEC) {
+		if (threshold > div64_u64(U64_MAX, freq))
+			return -EINVAL;
+		threshold = max_t(uint64_t, div64_u64(threshold * freq,
+					NSEC_PER_SEC), 1);
+	}
+
+	ret = lttng_create_kprobe_event(name, event_entry, EVENT_ENTRY,
+			false);
 	if (ret)
 		goto error;
-	ret = lttng_create_kprobe_event(name, event_return, EVENT_RETURN);
+	ret = lttng_create_kprobe_event(name, event_return, EVENT_RETURN,
+			threshold != 0);
 	if (ret)
 		goto event_return_error;
 	lttng_krp = kzalloc(sizeof(*lttng_krp), GFP_KERNEL);
@@ -182,6 +232,9 @@ int lttng_kretprobes_register(const char *name,
 		goto krp_error;
 	lttng_krp->krp.entry_handler = lttng_kretprobes_handler_entry;
 	lttng_krp->krp.handler = lttng_kretprobes_handler_return;
+	lttng_krp->threshold = threshold;
+	if (threshold)
+		lttng_krp->krp.data_size = sizeof(uint64_t);
 	if (symbol_name) {
 		char *alloc_symbol;
 
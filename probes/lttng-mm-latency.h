@@ -0,0 +1,272 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * probes/lttng-mm-latency.h
+ *
+ * LTTng memory reclaim and compaction latencies measured by probes for
+ * their latency and summary events.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#ifndef _LTTNG_PROBES_MM_LATENCY_H
+#define _LTTNG_PROBES_MM_LATENCY_H
+
+#include <linux/types.h>
+#include <linux/sched.h>
+#include <linux/hash.h>
+#include <linux/slab.h>
+#include <linux/rcupdate.h>
+#include <linux/cgroup.h>
+#include <linux/version.h>
+#include <wrapper/trace-clock.h>
+#include <wrapper/vmalloc.h>
+#include <probes/lttng-duration.h>
+
+/*
+ * A stall starts and ends in the same task, which may sleep and migrate
+ * meanwhile: its start is kept in a slot of a global table indexed by
+ * thread, as for work callback durations. Colliding threads make the
+ * table lossy: a stall whose start is not found is not measured.
+ *
+ * The durations are accounted in statistics per cpu, either all in a
+ * single slot, or per cgroup of the stalled task, in which case a stall
+ * whose cgroup does not find a slot within LTTNG_MM_LATENCY_MAX_PROBE
+ * slots of its cpu is not accounted.
+ *
+ * The end hook leaves the stall which just ended in the state of its
+ * cpu, for the event probes of the same tracepoint call. Stalls only
+ * end in task context, so this state is not overwritten meanwhile.
+ */
+#define LTTNG_MM_START_SLOTS_ORDER	10
+#define LTTNG_MM_START_NR_SLOTS		(1U << LTTNG_MM_START_SLOTS_ORDER)
+
+#define LTTNG_MM_LATENCY_SLOTS_ORDER	6
+#define LTTNG_MM_LATENCY_NR_SLOTS	(1U << LTTNG_MM_LATENCY_SLOTS_ORDER)
+#define LTTNG_MM_LATENCY_MAX_PROBE	8
+
+struct lttng_mm_start {
+	int order;		/* -1: unknown */
+	gfp_t gfp_flags;
+	uint64_t timestamp;	/* 0: no stall started */
+};
+
+struct lttng_mm_start_slot {
+	unsigned long seq;
+	pid_t tid;
+	struct lttng_mm_start start;
+};
+
+struct lttng_mm_latency_slot {
+	bool used;
+	uint64_t cgroup_id;
+	struct lttng_duration_period period;
+};
+
+struct lttng_mm_latency_cpu {
+	/* Last stall end, measured is false if it was not measured. */
+	bool measured;
+	struct lttng_mm_start start;
+	uint64_t duration;
+	uint64_t cgroup_id;
+	const struct lttng_duration_stats *summary;
+	struct lttng_mm_latency_slot slots[LTTNG_MM_LATENCY_NR_SLOTS];
+};
+
+struct lttng_mm_latency {
+	uint64_t period;	/* In trace clock units, 0: no summary */
+	uint64_t threshold;	/* In trace clock units */
+	bool per_cgroup;
+	struct lttng_mm_start_slot *start_slots;
+	void * __percpu *cpus;
+};
+
+/* The default cgroup of the current task, 0 if not available. */
+static inline
+uint64_t lttng_mm_latency_cgroup_id(void)
+{
+#if defined(CONFIG_CGROUPS) && \
+	(LINUX_VERSION_CODE >= KERNEL_VERSION(4,18,0))
+	uint64_t id;
+
+	rcu_read_lock();
+	id = cgroup_id(task_dfl_cgroup(current));
+	rcu_read_unlock();
+	return id;
+#else
+	return 0;
+#endif
+}
+
+static inline
+struct lttng_mm_start_slot *lttng_mm_start_slot(struct lttng_mm_latency *lat)
+{
+	return &lat->start_slots[hash_32(current->pid,
+			LTTNG_MM_START_SLOTS_ORDER)];
+}
+
+/* Keep the start of a stall of the current task, replacing any other. */
+static inline
+void lttng_mm_start_set(struct lttng_mm_latency *lat,
+		const struct lttng_mm_start *start)
+{
+	struct lttng_mm_start_slot *slot;
+	unsigned long seq;
+
+	slot = lttng_mm_start_slot(lat);
+	seq = READ_ONCE(slot->seq);
+	if ((seq & 1) || cmpxchg(&slot->seq, seq, seq + 1) != seq)
+		return;
+	slot->tid = current->pid;
+	slot->start = *start;
+	smp_wmb();	/* Content before even seq. */
+	WRITE_ONCE(slot->seq, seq + 2);
+}
+
+/* Return false if no start is kept for the current task. */
+static inline
+bool lttng_mm_start_get(struct lttng_mm_latency *lat,
+		struct lttng_mm_start *start)
+{
+	struct lttng_mm_start_slot *slot;
+	unsigned long seq;
+	pid_t tid;
+
+	slot = lttng_mm_start_slot(lat);
+	seq = READ_ONCE(slot->seq);
+	if (seq & 1)
+		return false;
+	smp_rmb();	/* Even seq before content. */
+	tid = slot->tid;
+	*start = slot->start;
+	smp_rmb();	/* Content before seq validation. */
+	return READ_ONCE(slot->seq) == seq && tid == current->pid;
+}
+
+static inline
+struct lttng_mm_latency_slot *lttng_mm_latency_slot(
+		struct lttng_mm_latency_cpu *cpu, uint64_t cgroup_id)
+{
+	struct lttng_mm_latency_slot *slot;
+	unsigned int i, h;
+
+	h = hash_64(cgroup_id, LTTNG_MM_LATENCY_SLOTS_ORDER);
+	for (i = 0; i < LTTNG_MM_LATENCY_MAX_PROBE; i++) {
+		slot = &cpu->slots[(h + i) & (LTTNG_MM_LATENCY_NR_SLOTS - 1)];
+		if (slot->used && slot->cgroup_id == cgroup_id)
+			return slot;
+		if (!slot->used) {
+			slot->used = true;
+			slot->cgroup_id = cgroup_id;
+			return slot;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * End the stall of the current task, if its start is kept, and account
+ * its duration in the statistics of the cpu. Its order and gfp flags
+ * are kept for the next stall of the task.
+ */
+static inline
+void lttng_mm_latency_end(struct lttng_mm_latency *lat)
+{
+	struct lttng_mm_latency_cpu *cpu;
+	struct lttng_mm_latency_slot *slot;
+	uint64_t now;
+
+	cpu = lttng_duration_this_cpu(lat->cpus);
+	cpu->measured = false;
+	cpu->summary = NULL;
+	if (!lttng_mm_start_get(lat, &cpu->start) || !cpu->start.timestamp)
+		return;
+	now = trace_clock_read64();
+	cpu->measured = true;
+	cpu->duration = now - cpu->start.timestamp;
+	cpu->start.timestamp = 0;
+	lttng_mm_start_set(lat, &cpu->start);
+	cpu->cgroup_id = lat->per_cgroup ? lttng_mm_latency_cgroup_id() : 0;
+	slot = lttng_mm_latency_slot(cpu, cpu->cgroup_id);
+	if (slot && lttng_duration_period_add(&slot->period, lat->period,
+			now, cpu->duration))
+		cpu->summary = &slot->period.last;
+}
+
+/* The stall which just ended on this cpu, NULL if it was not measured. */
+static inline
+const struct lttng_mm_latency_cpu *lttng_mm_latency_cpu(
+		struct lttng_mm_latency *lat)
+{
+	const struct lttng_mm_latency_cpu *cpu;
+
+	if (!lat->cpus)
+		return NULL;
+	cpu = lttng_duration_this_cpu(lat->cpus);
+	return cpu->measured ? cpu : NULL;
+}
+
+/* Return false unless the stall which just ended lasted the threshold. */
+static inline
+bool lttng_mm_latency_get(struct lttng_mm_latency *lat,
+		const struct lttng_mm_start **start, uint64_t *duration)
+{
+	const struct lttng_mm_latency_cpu *cpu = lttng_mm_latency_cpu(lat);
+
+	if (!cpu || cpu->duration < lat->threshold)
+		return false;
+	*start = &cpu->start;
+	*duration = cpu->duration;
+	return true;
+}
+
+/*
+ * Return the statistics of the period ended by the stall which just
+ * ended, or NULL if it did not end a period.
+ */
+static inline
+const struct lttng_duration_stats *lttng_mm_latency_summary(
+		struct lttng_mm_latency *lat, uint64_t *cgroup_id)
+{
+	const struct lttng_mm_latency_cpu *cpu = lttng_mm_latency_cpu(lat);
+
+	if (!cpu || !cpu->summary)
+		return NULL;
+	*cgroup_id = cpu->cgroup_id;
+	return cpu->summary;
+}
+
+static inline
+void lttng_mm_latency_free(struct lttng_mm_latency *lat)
+{
+	lttng_duration_cpus_free(lat->cpus);
+	lat->cpus = NULL;
+	lttng_kvfree(lat->start_slots);
+	lat->start_slots = NULL;
+}
+
+/*
+ * Allocate the state of the hooks, with periods and thresholds in
+ * milliseconds and microseconds. Called before the hooks are registered.
+ */
+static inline
+int lttng_mm_latency_alloc(struct lttng_mm_latency *lat,
+		unsigned int period_ms, unsigned int threshold_us,
+		bool per_cgroup)
+{
+	lat->period = lttng_duration_clock(
+		(uint64_t) period_ms * NSEC_PER_MSEC);
+	lat->threshold = lttng_duration_clock(
+		(uint64_t) threshold_us * NSEC_PER_USEC);
+	lat->per_cgroup = per_cgroup;
+	lat->start_slots = lttng_kvzalloc(LTTNG_MM_START_NR_SLOTS
+			* sizeof(*lat->start_slots), GFP_KERNEL);
+	lat->cpus = lttng_duration_cpus_alloc(
+			sizeof(struct lttng_mm_latency_cpu));
+	if (!lat->start_slots || !lat->cpus) {
+		lttng_mm_latency_free(lat);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+#endif /* _LTTNG_PROBES_MM_LATENCY_H */
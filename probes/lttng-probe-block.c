@@ -8,7 +8,9 @@
  */
 
 #include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <linux/blktrace_api.h>
+#include <linux/hash.h>
 #include <lttng-tracer.h>
 #include <lttng-kernel-version.h>
 
@@ -19,6 +21,7 @@
 #include <trace/events/block.h>
 
 #include <wrapper/tracepoint.h>
+#include <wrapper/trace-clock.h>
 
 /*
  * Create LTTng tracepoint probes.
@@ -27,8 +30,115 @@
 #define CREATE_TRACE_POINTS
 #define TRACE_INCLUDE_PATH instrumentation/events/lttng-module
 
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,12,0))
+/*
+ * Latency mode: the issue time of each request is kept in a slot of a
+ * global table indexed by request address, since requests may complete
+ * on another cpu, and read back by the block_rq_latency event when the
+ * request completes. Colliding requests make the table lossy: when the
+ * completion does not find its request, the event is dropped.
+ *
+ * Slots are not freed on completion, so that the event of each session
+ * reads the same issue time, and partial completions all report the
+ * time elapsed since the issue. A request is issued again before being
+ * completed again, which refreshes its slot.
+ *
+ * Each slot is protected by a sequence count, odd while the slot is
+ * being updated, as for system call latencies.
+ */
+#define TP_MODULE_NOAUTOLOAD
+
+#define BLOCK_LATENCY_SLOTS_ORDER	10
+#define BLOCK_LATENCY_NR_SLOTS		(1U << BLOCK_LATENCY_SLOTS_ORDER)
+
+struct lttng_block_latency_slot {
+	unsigned long seq;
+	struct request *rq;
+	uint64_t timestamp;	/* issue time */
+};
+
+static int block_latency;
+module_param(block_latency, int, 0444);
+MODULE_PARM_DESC(block_latency, "Record block_rq_latency events, pairing request issues with their completion (0: disabled, 1: enabled)");
+
+static struct lttng_block_latency_slot block_latency_slots[BLOCK_LATENCY_NR_SLOTS];
+
+static
+void lttng_block_latency_issue(void *data, struct request_queue *q,
+		struct request *rq)
+{
+	struct lttng_block_latency_slot *slot;
+	unsigned long seq;
+
+	slot = &block_latency_slots[hash_ptr(rq, BLOCK_LATENCY_SLOTS_ORDER)];
+	seq = READ_ONCE(slot->seq);
+	if ((seq & 1) || cmpxchg(&slot->seq, seq, seq + 1) != seq)
+		return;
+	slot->rq = rq;
+	slot->timestamp = trace_clock_read64();
+	smp_wmb();	/* Content before even seq. */
+	WRITE_ONCE(slot->seq, seq + 2);
+}
+
+/*
+ * Return the time elapsed since the issue of the request, or 0 if its
+ * issue is not found.
+ */
+static
+uint64_t lttng_block_rq_latency(struct request *rq)
+{
+	struct lttng_block_latency_slot *slot;
+	struct request *slot_rq;
+	uint64_t timestamp;
+	unsigned long seq;
+
+	slot = &block_latency_slots[hash_ptr(rq, BLOCK_LATENCY_SLOTS_ORDER)];
+	seq = READ_ONCE(slot->seq);
+	if (seq & 1)
+		return 0;
+	smp_rmb();	/* Even seq before content. */
+	slot_rq = slot->rq;
+	timestamp = slot->timestamp;
+	smp_rmb();	/* Content before seq validation. */
+	if (READ_ONCE(slot->seq) != seq || slot_rq != rq)
+		return 0;
+	return max_t(uint64_t, trace_clock_read64() - timestamp, 1);
+}
+#endif
+
 #include <instrumentation/events/lttng-module/block.h>
 
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,12,0))
+static
+int __init lttng_probe_block_init(void)
+{
+	int ret;
+
+	ret = __lttng_events_init__block();
+	if (ret || !block_latency)
+		return ret;
+	ret = lttng_wrapper_tracepoint_probe_register("block_rq_issue",
+			(void *) lttng_block_latency_issue, NULL);
+	if (ret)
+		__lttng_events_exit__block();
+	return ret;
+}
+module_init(lttng_probe_block_init);
+
+static
+void __exit lttng_probe_block_exit(void)
+{
+	if (block_latency) {
+		WARN_ON_ONCE(lttng_wrapper_tracepoint_probe_unregister("block_rq_issue",
+				(void *) lttng_block_latency_issue, NULL));
+		/* Wait for the probe before the table is freed. */
+		tracepoint_synchronize_unregister();
+	}
+	__lttng_events_exit__block();
+}
+module_exit(lttng_probe_block_exit);
+#endif
+
 MODULE_LICENSE("GPL and additional rights");
 MODULE_AUTHOR("Mathieu Desnoyers <mathieu.desnoyers@efficios.com>");
 MODULE_DESCRIPTION("LTTng block probes");
@@ -9,6 +9,8 @@
  */
 
 #include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/version.h>
 #include <lttng-tracer.h>
 
 /*
@@ -17,15 +19,183 @@
  */
 #include <trace/events/compaction.h>
 
+#include <wrapper/tracepoint.h>
+#include <probes/lttng-mm-latency.h>
+
 /*
  * Create LTTng tracepoint probes.
  */
 #define LTTNG_PACKAGE_BUILD
 #define CREATE_TRACE_POINTS
 #define TRACE_INCLUDE_PATH instrumentation/events/lttng-module
+#define TP_MODULE_NOAUTOLOAD
+
+/*
+ * Latency mode: hooks on mm_compaction_begin and mm_compaction_end
+ * measure the duration of each compaction of a zone. Those lasting at
+ * least compaction_latency_threshold_us are recorded as
+ * mm_compaction_latency events, with the order and gfp flags of the
+ * direct compaction of the task, known from
+ * mm_compaction_try_to_compact_pages, or an order of -1 for the
+ * compactions of kcompactd. The statistics of the durations are kept
+ * per cpu, and per cgroup with compaction_latency_per_cgroup=1, over
+ * periods of compaction_latency_period_ms, and recorded as one
+ * mm_compaction_summary event at the first end of a compaction
+ * following the end of the period.
+ */
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,0,0))
+#define LTTNG_COMPACTION_LATENCY
+#endif
+
+static int compaction_latency;
+module_param(compaction_latency, int, 0444);
+MODULE_PARM_DESC(compaction_latency, "Measure zone compaction durations for the compaction latency and summary events (0: disabled, 1: enabled)");
+
+static unsigned int compaction_latency_period_ms = 1000;
+module_param(compaction_latency_period_ms, uint, 0444);
+MODULE_PARM_DESC(compaction_latency_period_ms, "Period of the compaction summary events, in milliseconds (0: no summary)");
+
+static unsigned int compaction_latency_threshold_us;
+module_param(compaction_latency_threshold_us, uint, 0444);
+MODULE_PARM_DESC(compaction_latency_threshold_us, "Minimum duration of the zone compactions recorded individually, in microseconds (0: all)");
+
+static int compaction_latency_per_cgroup;
+module_param(compaction_latency_per_cgroup, int, 0444);
+MODULE_PARM_DESC(compaction_latency_per_cgroup, "Keep the compaction summaries per cgroup of the compacting task (0: per cpu only, 1: per cgroup)");
+
+#ifdef LTTNG_COMPACTION_LATENCY
+
+static struct lttng_mm_latency compaction_lat;
+
+/* Kept for the compactions of the zones, started by mm_compaction_begin. */
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,8,0))
+static
+void lttng_compaction_latency_direct(void *data, int order, gfp_t gfp_mask,
+		int prio)
+#else
+static
+void lttng_compaction_latency_direct(void *data, int order, gfp_t gfp_mask,
+		enum migrate_mode mode)
+#endif
+{
+	struct lttng_mm_start start = {
+		.order = order,
+		.gfp_flags = gfp_mask,
+	};
+
+	lttng_mm_start_set(&compaction_lat, &start);
+}
+
+static
+void lttng_compaction_latency_begin(void *data, unsigned long zone_start,
+		unsigned long migrate_pfn, unsigned long free_pfn,
+		unsigned long zone_end, bool sync)
+{
+	struct lttng_mm_start start;
+
+	if (!lttng_mm_start_get(&compaction_lat, &start)) {
+		start.order = -1;
+		start.gfp_flags = 0;
+	}
+	start.timestamp = trace_clock_read64();
+	lttng_mm_start_set(&compaction_lat, &start);
+}
+
+static
+void lttng_compaction_latency_end(void *data, unsigned long zone_start,
+		unsigned long migrate_pfn, unsigned long free_pfn,
+		unsigned long zone_end, bool sync, int status)
+{
+	lttng_mm_latency_end(&compaction_lat);
+}
+
+/*
+ * Return false unless the compaction which just ended lasted at least
+ * the threshold, in which case its order, gfp flags and duration are
+ * returned.
+ */
+static
+bool lttng_compaction_latency(int *order, gfp_t *gfp_flags,
+		uint64_t *duration)
+{
+	const struct lttng_mm_start *start;
+
+	if (!lttng_mm_latency_get(&compaction_lat, &start, duration))
+		return false;
+	*order = start->order;
+	*gfp_flags = start->gfp_flags;
+	return true;
+}
+
+/*
+ * Return the statistics of the period ended by the compaction which
+ * just ended, or NULL if it did not end a period.
+ */
+static
+const struct lttng_duration_stats *lttng_compaction_summary(
+		uint64_t *cgroup_id)
+{
+	return lttng_mm_latency_summary(&compaction_lat, cgroup_id);
+}
+
+#endif /* LTTNG_COMPACTION_LATENCY */
 
 #include <instrumentation/events/lttng-module/compaction.h>
 
+#ifdef LTTNG_COMPACTION_LATENCY
+
+static const struct lttng_duration_hook compaction_latency_hooks[] = {
+	{ "mm_compaction_try_to_compact_pages",
+		(void *) lttng_compaction_latency_direct },
+	{ "mm_compaction_begin", (void *) lttng_compaction_latency_begin },
+	{ "mm_compaction_end", (void *) lttng_compaction_latency_end },
+};
+
+static
+int lttng_compaction_latency_register(void)
+{
+	int ret;
+
+	ret = lttng_mm_latency_alloc(&compaction_lat,
+			compaction_latency_period_ms,
+			compaction_latency_threshold_us,
+			compaction_latency_per_cgroup);
+	if (ret)
+		return ret;
+	ret = lttng_duration_hooks_register(compaction_latency_hooks,
+			ARRAY_SIZE(compaction_latency_hooks));
+	if (ret)
+		lttng_mm_latency_free(&compaction_lat);
+	return ret;
+}
+
+static
+void lttng_compaction_latency_unregister(void)
+{
+	lttng_duration_hooks_unregister(compaction_latency_hooks,
+			ARRAY_SIZE(compaction_latency_hooks));
+	lttng_mm_latency_free(&compaction_lat);
+}
+
+#else /* LTTNG_COMPACTION_LATENCY */
+
+static
+int lttng_compaction_latency_register(void)
+{
+	return -ENOSYS;
+}
+
+static
+void lttng_compaction_latency_unregister(void)
+{
+}
+
+#endif /* LTTNG_COMPACTION_LATENCY */
+
+LTTNG_DURATION_PROBE_MODULE(compaction, compaction_latency,
+		lttng_compaction_latency_register,
+		lttng_compaction_latency_unregister);
+
 MODULE_LICENSE("GPL and additional rights");
 MODULE_AUTHOR("Andrew Gabbasov <andrew_gabbasov@mentor.com>");
 MODULE_DESCRIPTION("LTTng compaction probes");
@@ -8,7 +8,10 @@
  */
 
 #include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <linux/interrupt.h>
+#include <linux/hash.h>
+#include <linux/slab.h>
 #include <lttng-tracer.h>
 
 /*
@@ -18,6 +21,8 @@
 #include <trace/events/irq.h>
 
 #include <wrapper/tracepoint.h>
+#include <wrapper/trace-clock.h>
+#include <probes/lttng-duration.h>
 
 /*
  * Create LTTng tracepoint probes.
@@ -25,9 +30,259 @@
 #define LTTNG_PACKAGE_BUILD
 #define CREATE_TRACE_POINTS
 #define TRACE_INCLUDE_PATH instrumentation/events/lttng-module
+#define TP_MODULE_NOAUTOLOAD
+
+/*
+ * Duration mode: hooks on the handler entry and exit tracepoints
+ * measure the duration of each hard irq and softirq handler. The count,
+ * total and maximum duration, and the log2 histogram of the durations,
+ * in trace clock units, are kept per cpu and per irq or vector over
+ * periods of irq_duration_period_ms, and recorded as one
+ * irq_handler_summary or softirq_summary event at the first exit
+ * following the end of the period on this cpu. Handlers lasting at least
+ * irq_duration_threshold_us are also recorded individually as
+ * irq_handler_duration or softirq_duration events.
+ *
+ * The state of a cpu is only updated by its own handlers: hard irq
+ * handlers run with interrupts off, and softirq handlers are only
+ * interrupted by hard irq handlers, which use their own state. Hard
+ * irqs which do not find a slot within IRQ_DURATION_MAX_PROBE slots are
+ * not measured.
+ */
+#define IRQ_DURATION_SLOTS_ORDER	6
+#define IRQ_DURATION_NR_SLOTS		(1U << IRQ_DURATION_SLOTS_ORDER)
+#define IRQ_DURATION_MAX_PROBE		8
+
+struct lttng_irq_duration_slot {
+	int irq;			/* -1: free slot */
+	int summary;			/* Last exit ended a period */
+	struct lttng_duration_period period;
+};
+
+struct lttng_irq_duration_state {
+	uint64_t entry;			/* 0: no handler running */
+	uint64_t duration;		/* Of the last handler */
+	struct lttng_irq_duration_slot *slot;	/* Of the last handler */
+};
+
+struct lttng_irq_duration_cpu {
+	struct lttng_irq_duration_state hardirq;
+	struct lttng_irq_duration_state softirq;
+	struct lttng_irq_duration_slot hardirqs[IRQ_DURATION_NR_SLOTS];
+	struct lttng_irq_duration_slot softirqs[NR_SOFTIRQS];
+};
+
+static int irq_duration;
+module_param(irq_duration, int, 0444);
+MODULE_PARM_DESC(irq_duration, "Measure irq and softirq handler durations for the summary and duration events (0: disabled, 1: enabled)");
+
+static unsigned int irq_duration_period_ms = 1000;
+module_param(irq_duration_period_ms, uint, 0444);
+MODULE_PARM_DESC(irq_duration_period_ms, "Period of the irq and softirq summary events, in milliseconds (0: no summary)");
+
+static unsigned int irq_duration_threshold_us;
+module_param(irq_duration_threshold_us, uint, 0444);
+MODULE_PARM_DESC(irq_duration_threshold_us, "Minimum duration of the irq and softirq handlers recorded individually, in microseconds (0: none)");
+
+/* In trace clock units. */
+static uint64_t irq_duration_period, irq_duration_threshold;
+
+static void * __percpu *irq_duration_cpus;
+
+static
+struct lttng_irq_duration_slot *lttng_irq_duration_hardirq_slot(
+		struct lttng_irq_duration_cpu *cpu, int irq)
+{
+	struct lttng_irq_duration_slot *slot;
+	unsigned int i, h = hash_32(irq, IRQ_DURATION_SLOTS_ORDER);
+
+	for (i = 0; i < IRQ_DURATION_MAX_PROBE; i++) {
+		slot = &cpu->hardirqs[(h + i) & (IRQ_DURATION_NR_SLOTS - 1)];
+		if (slot->irq == irq)
+			return slot;
+		if (slot->irq < 0) {
+			slot->irq = irq;
+			return slot;
+		}
+	}
+	return NULL;
+}
+
+static
+void lttng_irq_duration_exit(struct lttng_irq_duration_state *state,
+		struct lttng_irq_duration_slot *slot)
+{
+	uint64_t now, duration;
+
+	state->slot = NULL;
+	if (!state->entry || !slot)
+		return;
+	now = trace_clock_read64();
+	duration = now - state->entry;
+	state->entry = 0;
+	slot->summary = lttng_duration_period_add(&slot->period,
+			irq_duration_period, now, duration);
+	state->duration = duration;
+	state->slot = slot;
+}
+
+static
+void lttng_irq_duration_handler_entry(void *data, int irq,
+		struct irqaction *action)
+{
+	struct lttng_irq_duration_cpu *cpu =
+		lttng_duration_this_cpu(irq_duration_cpus);
+
+	cpu->hardirq.entry = trace_clock_read64();
+}
+
+static
+void lttng_irq_duration_handler_exit(void *data, int irq,
+		struct irqaction *action, int ret)
+{
+	struct lttng_irq_duration_cpu *cpu =
+		lttng_duration_this_cpu(irq_duration_cpus);
+
+	lttng_irq_duration_exit(&cpu->hardirq,
+		lttng_irq_duration_hardirq_slot(cpu, irq));
+}
+
+static
+void lttng_irq_duration_softirq_entry(void *data, unsigned int vec_nr)
+{
+	struct lttng_irq_duration_cpu *cpu =
+		lttng_duration_this_cpu(irq_duration_cpus);
+
+	cpu->softirq.entry = trace_clock_read64();
+}
+
+static
+void lttng_irq_duration_softirq_exit(void *data, unsigned int vec_nr)
+{
+	struct lttng_irq_duration_cpu *cpu =
+		lttng_duration_this_cpu(irq_duration_cpus);
+
+	lttng_irq_duration_exit(&cpu->softirq,
+		vec_nr < NR_SOFTIRQS ? &cpu->softirqs[vec_nr] : NULL);
+}
+
+/*
+ * Return the statistics of the period ended by the handler which just
+ * returned on this cpu, or NULL if it did not end a period.
+ */
+static
+const struct lttng_duration_stats *lttng_irq_duration_summary(
+		const struct lttng_irq_duration_state *state)
+{
+	if (!state->slot || !state->slot->summary)
+		return NULL;
+	return &state->slot->period.last;
+}
+
+/*
+ * Return the duration of the handler which just returned on this cpu,
+ * or 0 if it is below the threshold.
+ */
+static
+uint64_t lttng_irq_duration_above(const struct lttng_irq_duration_state *state)
+{
+	if (!irq_duration_threshold || !state->slot
+			|| state->duration < irq_duration_threshold)
+		return 0;
+	return max_t(uint64_t, state->duration, 1);
+}
+
+static
+const struct lttng_duration_stats *lttng_irq_handler_summary(void)
+{
+	struct lttng_irq_duration_cpu *cpu;
+
+	if (!irq_duration_cpus)
+		return NULL;
+	cpu = lttng_duration_this_cpu(irq_duration_cpus);
+	return lttng_irq_duration_summary(&cpu->hardirq);
+}
+
+static
+const struct lttng_duration_stats *lttng_softirq_summary(void)
+{
+	struct lttng_irq_duration_cpu *cpu;
+
+	if (!irq_duration_cpus)
+		return NULL;
+	cpu = lttng_duration_this_cpu(irq_duration_cpus);
+	return lttng_irq_duration_summary(&cpu->softirq);
+}
+
+static
+uint64_t lttng_irq_handler_duration(void)
+{
+	struct lttng_irq_duration_cpu *cpu;
+
+	if (!irq_duration_cpus)
+		return 0;
+	cpu = lttng_duration_this_cpu(irq_duration_cpus);
+	return lttng_irq_duration_above(&cpu->hardirq);
+}
+
+static
+uint64_t lttng_softirq_duration(void)
+{
+	struct lttng_irq_duration_cpu *cpu;
+
+	if (!irq_duration_cpus)
+		return 0;
+	cpu = lttng_duration_this_cpu(irq_duration_cpus);
+	return lttng_irq_duration_above(&cpu->softirq);
+}
 
 #include <instrumentation/events/lttng-module/irq.h>
 
+static const struct lttng_duration_hook irq_duration_hooks[] = {
+	{ "irq_handler_entry", (void *) lttng_irq_duration_handler_entry },
+	{ "irq_handler_exit", (void *) lttng_irq_duration_handler_exit },
+	{ "softirq_entry", (void *) lttng_irq_duration_softirq_entry },
+	{ "softirq_exit", (void *) lttng_irq_duration_softirq_exit },
+};
+
+static
+int lttng_irq_duration_register(void)
+{
+	struct lttng_irq_duration_cpu *state;
+	int cpu, i, ret;
+
+	irq_duration_period = lttng_duration_clock(
+		(uint64_t) irq_duration_period_ms * NSEC_PER_MSEC);
+	irq_duration_threshold = lttng_duration_clock(
+		(uint64_t) irq_duration_threshold_us * NSEC_PER_USEC);
+	irq_duration_cpus = lttng_duration_cpus_alloc(sizeof(*state));
+	if (!irq_duration_cpus)
+		return -ENOMEM;
+	for_each_possible_cpu(cpu) {
+		state = lttng_duration_cpu(irq_duration_cpus, cpu);
+		for (i = 0; i < IRQ_DURATION_NR_SLOTS; i++)
+			state->hardirqs[i].irq = -1;
+		for (i = 0; i < NR_SOFTIRQS; i++)
+			state->softirqs[i].irq = i;
+	}
+	ret = lttng_duration_hooks_register(irq_duration_hooks,
+			ARRAY_SIZE(irq_duration_hooks));
+	if (ret)
+		lttng_duration_cpus_free(irq_duration_cpus);
+	return ret;
+}
+
+static
+void lttng_irq_duration_unregister(void)
+{
+	lttng_duration_hooks_unregister(irq_duration_hooks,
+			ARRAY_SIZE(irq_duration_hooks));
+	lttng_duration_cpus_free(irq_duration_cpus);
+}
+
+LTTNG_DURATION_PROBE_MODULE(irq, irq_duration,
+		lttng_irq_duration_register, lttng_irq_duration_unregister);
+
 MODULE_LICENSE("GPL and additional rights");
 MODULE_AUTHOR("Mathieu Desnoyers <mathieu.desnoyers@efficios.com>");
 MODULE_DESCRIPTION("LTTng irq probes");
@@ -14,7 +14,12 @@
  */
 #include <wrapper/page_alloc.h>
 #include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <linux/mm.h>
+#include <linux/hash.h>
+#include <linux/slab.h>
+#include <linux/jiffies.h>
+#include <linux/hardirq.h>
 #include <lttng-tracer.h>
 
 /*
@@ -24,6 +29,7 @@
 #include <trace/events/kmem.h>
 
 #include <wrapper/tracepoint.h>
+#include <wrapper/vmalloc.h>
 
 /*
  * Create LTTng tracepoint probes.
@@ -31,9 +37,248 @@
 #define LTTNG_PACKAGE_BUILD
 #define CREATE_TRACE_POINTS
 #define TRACE_INCLUDE_PATH instrumentation/events/lttng-module
+#define TP_MODULE_NOAUTOLOAD
+
+/*
+ * Aggregation mode: hooks on the slab allocation and free tracepoints
+ * count, per cpu and per call site and allocation flags, the
+ * allocations and frees and the bytes requested and allocated, over
+ * periods of kmem_aggregation_period_ms. The counters of each period
+ * are recorded as one kmem_*_summary event at the first allocation or
+ * free of this call site following the end of the period on this cpu,
+ * through the summary event mapped on the tracepoint of this
+ * allocation or free. Frees have no allocation flags: they are counted
+ * per free call site, with null flags.
+ *
+ * Call sites which do not find a slot within KMEM_AGGREGATION_MAX_PROBE
+ * slots of the counters of their cpu are not counted, nor are
+ * allocations in NMI context. Periods are measured in jiffies, to keep
+ * the trace clock off the allocation fast path.
+ *
+ * The state left by the hooks for the event probes of an allocation is
+ * kept per cpu and per context level, since allocations nest within
+ * interrupt handlers.
+ */
+#define KMEM_AGGREGATION_SLOTS_ORDER	9
+#define KMEM_AGGREGATION_NR_SLOTS	(1U << KMEM_AGGREGATION_SLOTS_ORDER)
+#define KMEM_AGGREGATION_MAX_PROBE	8
+
+/* Task, softirq and hard irq contexts. */
+#define KMEM_AGGREGATION_NR_LEVELS	3
+
+struct lttng_kmem_site_stats {
+	uint64_t allocs;
+	uint64_t frees;
+	uint64_t bytes_req;
+	uint64_t bytes_alloc;
+};
+
+struct lttng_kmem_site_slot {
+	unsigned long call_site;	/* 0: free slot */
+	gfp_t gfp_flags;
+	int started;			/* A period is started */
+	unsigned long period_end;	/* In jiffies */
+	struct lttng_kmem_site_stats cur;
+	struct lttng_kmem_site_stats last;	/* Previous period */
+};
+
+struct lttng_kmem_aggregation_state {
+	/* Summary ended by the last allocation or free, or NULL. */
+	const struct lttng_kmem_site_stats *summary;
+	gfp_t gfp_flags;
+};
+
+struct lttng_kmem_aggregation_cpu {
+	struct lttng_kmem_aggregation_state levels[KMEM_AGGREGATION_NR_LEVELS];
+	struct lttng_kmem_site_slot slots[KMEM_AGGREGATION_NR_SLOTS];
+};
+
+static int kmem_aggregation;
+module_param(kmem_aggregation, int, 0444);
+MODULE_PARM_DESC(kmem_aggregation, "Count slab allocations and frees per call site for the kmem summary events (0: disabled, 1: enabled)");
+
+static unsigned int kmem_aggregation_period_ms = 1000;
+module_param(kmem_aggregation_period_ms, uint, 0444);
+MODULE_PARM_DESC(kmem_aggregation_period_ms, "Period of the kmem summary events, in milliseconds");
+
+static unsigned long kmem_aggregation_period;	/* In jiffies */
+
+static void * __percpu *kmem_aggregation_cpus;
+
+/* Context level of the caller, -1 in NMI context. */
+static
+int lttng_kmem_aggregation_level(void)
+{
+	if (in_nmi())
+		return -1;
+	if (in_irq())
+		return 2;
+	if (in_serving_softirq())
+		return 1;
+	return 0;
+}
+
+static
+struct lttng_kmem_site_slot *lttng_kmem_site_slot(
+		struct lttng_kmem_aggregation_cpu *cpu,
+		unsigned long call_site, gfp_t gfp_flags)
+{
+	struct lttng_kmem_site_slot *slot;
+	unsigned int i, h;
+
+	h = hash_long(call_site ^ (__force unsigned long) gfp_flags,
+			KMEM_AGGREGATION_SLOTS_ORDER);
+	for (i = 0; i < KMEM_AGGREGATION_MAX_PROBE; i++) {
+		slot = &cpu->slots[(h + i) & (KMEM_AGGREGATION_NR_SLOTS - 1)];
+		if (slot->call_site == call_site && slot->gfp_flags == gfp_flags)
+			return slot;
+		if (!slot->call_site) {
+			slot->call_site = call_site;
+			slot->gfp_flags = gfp_flags;
+			return slot;
+		}
+	}
+	return NULL;
+}
+
+static
+void lttng_kmem_aggregation_account(unsigned long call_site,
+		gfp_t gfp_flags, size_t bytes_req, size_t bytes_alloc,
+		bool free)
+{
+	struct lttng_kmem_aggregation_cpu *cpu;
+	struct lttng_kmem_aggregation_state *state;
+	struct lttng_kmem_site_slot *slot;
+	unsigned long flags, now = jiffies;
+	int level;
+
+	level = lttng_kmem_aggregation_level();
+	if (level < 0)
+		return;
+	cpu = lttng_duration_this_cpu(kmem_aggregation_cpus);
+	state = &cpu->levels[level];
+	state->summary = NULL;
+	/* Allocations of interrupt handlers update the same counters. */
+	local_irq_save(flags);
+	slot = lttng_kmem_site_slot(cpu, call_site, gfp_flags);
+	if (!slot)
+		goto end;
+	if (!slot->started || time_after_eq(now, slot->period_end)) {
+		if (slot->started) {
+			slot->last = slot->cur;
+			state->summary = &slot->last;
+			state->gfp_flags = gfp_flags;
+		}
+		memset(&slot->cur, 0, sizeof(slot->cur));
+		slot->period_end = now + kmem_aggregation_period;
+		slot->started = 1;
+	}
+	if (free) {
+		slot->cur.frees++;
+	} else {
+		slot->cur.allocs++;
+		slot->cur.bytes_req += bytes_req;
+		slot->cur.bytes_alloc += bytes_alloc;
+	}
+end:
+	local_irq_restore(flags);
+}
+
+static
+void lttng_kmem_aggregation_alloc(void *data, unsigned long call_site,
+		const void *ptr, size_t bytes_req, size_t bytes_alloc,
+		gfp_t gfp_flags)
+{
+	if (ptr)
+		lttng_kmem_aggregation_account(call_site, gfp_flags,
+			bytes_req, bytes_alloc, false);
+}
+
+static
+void lttng_kmem_aggregation_alloc_node(void *data, unsigned long call_site,
+		const void *ptr, size_t bytes_req, size_t bytes_alloc,
+		gfp_t gfp_flags, int node)
+{
+	if (ptr)
+		lttng_kmem_aggregation_account(call_site, gfp_flags,
+			bytes_req, bytes_alloc, false);
+}
+
+static
+void lttng_kmem_aggregation_free(void *data, unsigned long call_site,
+		const void *ptr)
+{
+	/* kfree(NULL) is not a free. */
+	if (ptr)
+		lttng_kmem_aggregation_account(call_site, 0, 0, 0, true);
+}
+
+/*
+ * Return the counters of the period ended by the allocation or free
+ * being traced, or NULL if it did not end a period.
+ */
+static
+const struct lttng_kmem_site_stats *lttng_kmem_summary(gfp_t *gfp_flags)
+{
+	const struct lttng_kmem_aggregation_cpu *cpu;
+	const struct lttng_kmem_aggregation_state *state;
+	int level;
+
+	if (!kmem_aggregation_cpus)
+		return NULL;
+	level = lttng_kmem_aggregation_level();
+	if (level < 0)
+		return NULL;
+	cpu = lttng_duration_this_cpu(kmem_aggregation_cpus);
+	state = &cpu->levels[level];
+	if (!state->summary)
+		return NULL;
+	*gfp_flags = state->gfp_flags;
+	return state->summary;
+}
 
 #include <instrumentation/events/lttng-module/kmem.h>
 
+static const struct lttng_duration_hook kmem_aggregation_hooks[] = {
+	{ "kmalloc", (void *) lttng_kmem_aggregation_alloc },
+	{ "kmem_cache_alloc", (void *) lttng_kmem_aggregation_alloc },
+	{ "kmalloc_node", (void *) lttng_kmem_aggregation_alloc_node },
+	{ "kmem_cache_alloc_node", (void *) lttng_kmem_aggregation_alloc_node },
+	{ "kfree", (void *) lttng_kmem_aggregation_free },
+	{ "kmem_cache_free", (void *) lttng_kmem_aggregation_free },
+};
+
+static
+int lttng_kmem_aggregation_register(void)
+{
+	int ret;
+
+	if (!kmem_aggregation_period_ms)
+		return -EINVAL;
+	kmem_aggregation_period = msecs_to_jiffies(kmem_aggregation_period_ms);
+	kmem_aggregation_cpus = lttng_duration_cpus_alloc(
+			sizeof(struct lttng_kmem_aggregation_cpu));
+	if (!kmem_aggregation_cpus)
+		return -ENOMEM;
+	ret = lttng_duration_hooks_register(kmem_aggregation_hooks,
+			ARRAY_SIZE(kmem_aggregation_hooks));
+	if (ret)
+		lttng_duration_cpus_free(kmem_aggregation_cpus);
+	return ret;
+}
+
+static
+void lttng_kmem_aggregation_unregister(void)
+{
+	lttng_duration_hooks_unregister(kmem_aggregation_hooks,
+			ARRAY_SIZE(kmem_aggregation_hooks));
+	lttng_duration_cpus_free(kmem_aggregation_cpus);
+}
+
+LTTNG_DURATION_PROBE_MODULE(kmem, kmem_aggregation,
+		lttng_kmem_aggregation_register,
+		lttng_kmem_aggregation_unregister);
+
 MODULE_LICENSE("GPL and additional rights");
 MODULE_AUTHOR("Wade Farnsworth <wade_farnsworth@mentor.com>");
 MODULE_AUTHOR("Andrew Gabbasov <andrew_gabbasov@mentor.com>");
@@ -8,7 +8,10 @@
  */
 
 #include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <linux/kvm_host.h>
+#include <linux/hash.h>
+#include <linux/sched.h>
 #include <lttng-tracer.h>
 #include <lttng-kernel-version.h>
 
@@ -25,16 +28,213 @@
 #include <trace/events/kvm.h>
 
 #include <wrapper/tracepoint.h>
+#include <wrapper/trace-clock.h>
+#include <wrapper/vmalloc.h>
+#include <probes/lttng-duration.h>
 
 /*
  * Create LTTng tracepoint probes.
  */
 #define LTTNG_PACKAGE_BUILD
 #define CREATE_TRACE_POINTS
+#define TP_MODULE_NOAUTOLOAD
+
+/*
+ * Exit aggregation mode: hooks on kvm_exit and kvm_entry measure the
+ * time spent in the host by each guest exit, from the exit to the next
+ * entry of the same vcpu thread. The count, total and maximum duration,
+ * and the log2 histogram of the durations, in trace clock units, are
+ * kept per cpu and per (process, vcpu, exit reason) over periods of
+ * kvm_exit_aggregation_period_ms, and recorded as one
+ * kvm_x86_exit_summary event at the first entry following the end of
+ * the period on this cpu.
+ *
+ * A vcpu thread can be preempted and migrated while handling an exit,
+ * so the exits are kept in a lossy global table indexed by thread id.
+ * Each slot is protected by a sequence count, odd while the slot is
+ * being updated, as for the syscall latency mode: exits colliding with
+ * another thread are not measured. The per-cpu statistics are only
+ * updated by the entry hook of their cpu, which runs with preemption
+ * disabled and never nests. Exits which do not find a slot within
+ * KVM_EXIT_MAX_PROBE slots are not measured.
+ */
+#define KVM_EXIT_PENDING_ORDER		10
+#define KVM_EXIT_NR_PENDING		(1U << KVM_EXIT_PENDING_ORDER)
+#define KVM_EXIT_SLOTS_ORDER		8
+#define KVM_EXIT_NR_SLOTS		(1U << KVM_EXIT_SLOTS_ORDER)
+#define KVM_EXIT_MAX_PROBE		8
+
+struct lttng_kvm_exit_pending {
+	unsigned long seq;
+	pid_t tid;			/* 0: free slot */
+	unsigned int exit_reason;
+	uint64_t timestamp;		/* Of the exit */
+};
+
+struct lttng_kvm_exit_slot {
+	pid_t pid;			/* 0: free slot */
+	unsigned int vcpu_id;
+	unsigned int exit_reason;
+	struct lttng_duration_period period;
+};
+
+struct lttng_kvm_exit_cpu {
+	struct lttng_kvm_exit_slot *summary;	/* Period ended by the last entry */
+	struct lttng_kvm_exit_slot slots[KVM_EXIT_NR_SLOTS];
+};
+
+static int kvm_exit_aggregation;
+module_param(kvm_exit_aggregation, int, 0444);
+MODULE_PARM_DESC(kvm_exit_aggregation, "Measure the time spent in the host by guest exits for the exit summary events (0: disabled, 1: enabled)");
+
+static unsigned int kvm_exit_aggregation_period_ms = 1000;
+module_param(kvm_exit_aggregation_period_ms, uint, 0444);
+MODULE_PARM_DESC(kvm_exit_aggregation_period_ms, "Period of the exit summary events, in milliseconds (0: no summary)");
+
+/* In trace clock units. */
+static uint64_t kvm_exit_period;
+
+static struct lttng_kvm_exit_pending kvm_exit_pending[KVM_EXIT_NR_PENDING];
+static void * __percpu *kvm_exit_cpus;
+
+static
+struct lttng_kvm_exit_pending *lttng_kvm_exit_pending_slot(void)
+{
+	return &kvm_exit_pending[hash_32(current->pid, KVM_EXIT_PENDING_ORDER)];
+}
+
+static
+struct lttng_kvm_exit_slot *lttng_kvm_exit_slot(struct lttng_kvm_exit_cpu *cpu,
+		pid_t pid, unsigned int vcpu_id, unsigned int exit_reason)
+{
+	struct lttng_kvm_exit_slot *slot;
+	unsigned int i, h;
+
+	h = hash_32((uint32_t) pid ^ (vcpu_id << 16) ^ exit_reason,
+			KVM_EXIT_SLOTS_ORDER);
+	for (i = 0; i < KVM_EXIT_MAX_PROBE; i++) {
+		slot = &cpu->slots[(h + i) & (KVM_EXIT_NR_SLOTS - 1)];
+		if (slot->pid == pid && slot->vcpu_id == vcpu_id
+				&& slot->exit_reason == exit_reason)
+			return slot;
+		if (!slot->pid) {
+			slot->pid = pid;
+			slot->vcpu_id = vcpu_id;
+			slot->exit_reason = exit_reason;
+			return slot;
+		}
+	}
+	return NULL;
+}
+
+static
+void lttng_kvm_exit_hook(void *data, unsigned int exit_reason,
+		struct kvm_vcpu *vcpu, u32 isa)
+{
+	struct lttng_kvm_exit_pending *pending = lttng_kvm_exit_pending_slot();
+	unsigned long seq;
+
+	seq = READ_ONCE(pending->seq);
+	if ((seq & 1) || cmpxchg(&pending->seq, seq, seq + 1) != seq)
+		return;
+	pending->tid = current->pid;
+	pending->exit_reason = exit_reason;
+	pending->timestamp = trace_clock_read64();
+	smp_wmb();	/* Content before even seq. */
+	WRITE_ONCE(pending->seq, seq + 2);
+}
+
+static
+void lttng_kvm_entry_hook(void *data, unsigned int vcpu_id)
+{
+	struct lttng_kvm_exit_cpu *cpu = lttng_duration_this_cpu(kvm_exit_cpus);
+	struct lttng_kvm_exit_pending *pending = lttng_kvm_exit_pending_slot();
+	struct lttng_kvm_exit_slot *slot;
+	unsigned int exit_reason;
+	uint64_t timestamp, now;
+	unsigned long seq;
+	pid_t tid;
+
+	cpu->summary = NULL;
+	seq = READ_ONCE(pending->seq);
+	if (seq & 1)
+		return;
+	smp_rmb();	/* Even seq before content. */
+	tid = pending->tid;
+	exit_reason = pending->exit_reason;
+	timestamp = pending->timestamp;
+	smp_rmb();	/* Content before seq validation. */
+	if (READ_ONCE(pending->seq) != seq || tid != current->pid)
+		return;
+	/* Free the slot, unless it has been reused meanwhile. */
+	if (cmpxchg(&pending->seq, seq, seq + 1) != seq)
+		return;
+	pending->tid = 0;
+	smp_wmb();	/* Content before even seq. */
+	WRITE_ONCE(pending->seq, seq + 2);
+
+	now = trace_clock_read64();
+	slot = lttng_kvm_exit_slot(cpu, task_tgid_nr(current), vcpu_id,
+			exit_reason);
+	if (!slot)
+		return;
+	if (lttng_duration_period_add(&slot->period, kvm_exit_period, now,
+			now - timestamp))
+		cpu->summary = slot;
+}
+
+/*
+ * Return the slot whose period was ended by the entry which is being
+ * traced on this cpu, or NULL if it did not end a period.
+ */
+static
+const struct lttng_kvm_exit_slot *lttng_kvm_exit_summary(void)
+{
+	const struct lttng_kvm_exit_cpu *cpu;
+
+	if (!kvm_exit_cpus)
+		return NULL;
+	cpu = lttng_duration_this_cpu(kvm_exit_cpus);
+	return cpu->summary;
+}
 
 #define TRACE_INCLUDE_PATH instrumentation/events/lttng-module/arch/x86/kvm
 #include <instrumentation/events/lttng-module/arch/x86/kvm/trace.h>
 
+static const struct lttng_duration_hook kvm_exit_hooks[] = {
+	{ "kvm_exit", (void *) lttng_kvm_exit_hook },
+	{ "kvm_entry", (void *) lttng_kvm_entry_hook },
+};
+
+static
+int lttng_kvm_exit_register(void)
+{
+	int ret;
+
+	kvm_exit_period = lttng_duration_clock(
+		(uint64_t) kvm_exit_aggregation_period_ms * NSEC_PER_MSEC);
+	kvm_exit_cpus = lttng_duration_cpus_alloc(
+			sizeof(struct lttng_kvm_exit_cpu));
+	if (!kvm_exit_cpus)
+		return -ENOMEM;
+	ret = lttng_duration_hooks_register(kvm_exit_hooks,
+			ARRAY_SIZE(kvm_exit_hooks));
+	if (ret)
+		lttng_duration_cpus_free(kvm_exit_cpus);
+	return ret;
+}
+
+static
+void lttng_kvm_exit_unregister(void)
+{
+	lttng_duration_hooks_unregister(kvm_exit_hooks,
+			ARRAY_SIZE(kvm_exit_hooks));
+	lttng_duration_cpus_free(kvm_exit_cpus);
+}
+
+LTTNG_DURATION_PROBE_MODULE(kvm_x86, kvm_exit_aggregation,
+		lttng_kvm_exit_register, lttng_kvm_exit_unregister);
+
 MODULE_LICENSE("GPL and additional rights");
 MODULE_AUTHOR("Mathieu Desnoyers <mathieu.desnoyers@efficios.com>");
 MODULE_DESCRIPTION("LTTng kvm probes");
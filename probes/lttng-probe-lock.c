@@ -9,7 +9,11 @@
  */
 
 #include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <linux/version.h>
+#include <linux/hash.h>
+#include <linux/slab.h>
+#include <linux/hardirq.h>
 #include <lttng-tracer.h>
 
 /*
@@ -18,6 +22,9 @@
  */
 #include <trace/events/lock.h>
 #include <wrapper/tracepoint.h>
+#include <wrapper/trace-clock.h>
+#include <wrapper/vmalloc.h>
+#include <probes/lttng-duration.h>
 
 /*
  * Create LTTng tracepoint probes.
@@ -26,8 +33,302 @@
 #define CREATE_TRACE_POINTS
 #define TRACE_INCLUDE_PATH instrumentation/events/lttng-module
 
+#ifdef CONFIG_LOCK_STAT
+#define TP_MODULE_NOAUTOLOAD
+
+/*
+ * Contention mode: hooks on lock_contended and lock_acquired measure the
+ * time each task waits for a contended lock. The count, total and
+ * maximum wait, and the log2 histogram of the waits, in trace clock
+ * units, are kept per cpu, per lock class and per acquisition call site
+ * over periods of lock_contention_period_ms, and recorded as one
+ * lock_contention_summary event at the first acquisition following the
+ * end of the period on this cpu. Waits of at least
+ * lock_contention_threshold_us are also recorded individually as
+ * lock_wait events.
+ *
+ * The start of each wait is kept in a slot of a global table indexed by
+ * thread and lock, since the waiter may migrate, as for system call
+ * latencies. Colliding waits make the table lossy: an acquisition which
+ * does not find its wait is not measured. So are acquisitions in NMI
+ * context, and those which do not find a slot within
+ * LOCK_CONTENTION_MAX_PROBE slots of the statistics of their cpu.
+ *
+ * The state left by the hooks for the event probes of an acquisition is
+ * kept per cpu and per context level, since acquisitions nest within
+ * interrupt handlers.
+ */
+#define LOCK_WAIT_SLOTS_ORDER		10
+#define LOCK_WAIT_NR_SLOTS		(1U << LOCK_WAIT_SLOTS_ORDER)
+
+#define LOCK_CONTENTION_SLOTS_ORDER	7
+#define LOCK_CONTENTION_NR_SLOTS	(1U << LOCK_CONTENTION_SLOTS_ORDER)
+#define LOCK_CONTENTION_MAX_PROBE	8
+
+/* Task, softirq and hard irq contexts. */
+#define LOCK_CONTENTION_NR_LEVELS	3
+
+struct lttng_lock_wait_slot {
+	unsigned long seq;
+	pid_t tid;
+	struct lockdep_map *lock;
+	uint64_t timestamp;	/* Start of the wait */
+};
+
+struct lttng_lock_contention_slot {
+	struct lock_class_key *key;	/* NULL: free slot */
+	unsigned long ip;
+	struct lttng_duration_period period;
+};
+
+struct lttng_lock_contention_state {
+	uint64_t wait;			/* Of the last acquisition */
+	const struct lttng_duration_stats *summary;
+	int measured;			/* Last acquisition was measured */
+};
+
+struct lttng_lock_contention_cpu {
+	struct lttng_lock_contention_state levels[LOCK_CONTENTION_NR_LEVELS];
+	struct lttng_lock_contention_slot slots[LOCK_CONTENTION_NR_SLOTS];
+};
+
+static int lock_contention;
+module_param(lock_contention, int, 0444);
+MODULE_PARM_DESC(lock_contention, "Measure lock waits for the contention summary and wait events (0: disabled, 1: enabled)");
+
+static unsigned int lock_contention_period_ms = 1000;
+module_param(lock_contention_period_ms, uint, 0444);
+MODULE_PARM_DESC(lock_contention_period_ms, "Period of the lock contention summary events, in milliseconds (0: no summary)");
+
+static unsigned int lock_contention_threshold_us;
+module_param(lock_contention_threshold_us, uint, 0444);
+MODULE_PARM_DESC(lock_contention_threshold_us, "Minimum lock wait recorded individually, in microseconds (0: none)");
+
+/* In trace clock units. */
+static uint64_t lock_contention_period, lock_contention_threshold;
+
+static struct lttng_lock_wait_slot lock_wait_slots[LOCK_WAIT_NR_SLOTS];
+static void * __percpu *lock_contention_cpus;
+
+/* Context level of the caller, -1 in NMI context. */
+static
+int lttng_lock_contention_level(void)
+{
+	if (in_nmi())
+		return -1;
+	if (in_irq())
+		return 2;
+	if (in_serving_softirq())
+		return 1;
+	return 0;
+}
+
+static
+struct lttng_lock_wait_slot *lttng_lock_wait_slot(struct lockdep_map *lock)
+{
+	return &lock_wait_slots[hash_long((unsigned long) lock ^ current->pid,
+			LOCK_WAIT_SLOTS_ORDER)];
+}
+
+static
+void lttng_lock_contention_contended(void *data, struct lockdep_map *lock,
+		unsigned long ip)
+{
+	struct lttng_lock_wait_slot *slot;
+	unsigned long seq;
+
+	if (in_nmi())
+		return;
+	slot = lttng_lock_wait_slot(lock);
+	seq = READ_ONCE(slot->seq);
+	if ((seq & 1) || cmpxchg(&slot->seq, seq, seq + 1) != seq)
+		return;
+	slot->tid = current->pid;
+	slot->lock = lock;
+	slot->timestamp = trace_clock_read64();
+	smp_wmb();	/* Content before even seq. */
+	WRITE_ONCE(slot->seq, seq + 2);
+}
+
+/*
+ * Return false if the start of the wait is not found. Otherwise, free
+ * its slot and return the start of the wait in @timestamp.
+ */
+static
+bool lttng_lock_wait_end(struct lockdep_map *lock, uint64_t *timestamp)
+{
+	struct lttng_lock_wait_slot *slot;
+	struct lockdep_map *slot_lock;
+	unsigned long seq;
+	pid_t tid;
+
+	slot = lttng_lock_wait_slot(lock);
+	seq = READ_ONCE(slot->seq);
+	if (seq & 1)
+		return false;
+	smp_rmb();	/* Even seq before content. */
+	tid = slot->tid;
+	slot_lock = slot->lock;
+	*timestamp = slot->timestamp;
+	smp_rmb();	/* Content before seq validation. */
+	if (READ_ONCE(slot->seq) != seq || tid != current->pid
+			|| slot_lock != lock)
+		return false;
+	/* Free the slot, unless it has been reused meanwhile. */
+	if (cmpxchg(&slot->seq, seq, seq + 1) == seq) {
+		slot->lock = NULL;
+		smp_wmb();	/* Content before even seq. */
+		WRITE_ONCE(slot->seq, seq + 2);
+	}
+	return true;
+}
+
+static
+struct lttng_lock_contention_slot *lttng_lock_contention_slot(
+		struct lttng_lock_contention_cpu *cpu,
+		struct lock_class_key *key, unsigned long ip)
+{
+	struct lttng_lock_contention_slot *slot;
+	unsigned int i, h;
+
+	h = hash_long((unsigned long) key ^ ip, LOCK_CONTENTION_SLOTS_ORDER);
+	for (i = 0; i < LOCK_CONTENTION_MAX_PROBE; i++) {
+		slot = &cpu->slots[(h + i) & (LOCK_CONTENTION_NR_SLOTS - 1)];
+		if (slot->key == key && slot->ip == ip)
+			return slot;
+		if (!slot->key) {
+			slot->key = key;
+			slot->ip = ip;
+			return slot;
+		}
+	}
+	return NULL;
+}
+
+static
+void lttng_lock_contention_acquired(void *data, struct lockdep_map *lock,
+		unsigned long ip)
+{
+	struct lttng_lock_contention_cpu *cpu;
+	struct lttng_lock_contention_state *state;
+	struct lttng_lock_contention_slot *slot;
+	uint64_t start, now, wait;
+	unsigned long flags;
+	int level;
+
+	level = lttng_lock_contention_level();
+	if (level < 0)
+		return;
+	cpu = lttng_duration_this_cpu(lock_contention_cpus);
+	state = &cpu->levels[level];
+	state->measured = 0;
+	state->summary = NULL;
+	if (!lttng_lock_wait_end(lock, &start))
+		return;
+	now = trace_clock_read64();
+	wait = now - start;
+	/* Acquisitions of interrupt handlers update the same statistics. */
+	local_irq_save(flags);
+	slot = lttng_lock_contention_slot(cpu, lock->key, ip);
+	if (!slot)
+		goto end;
+	if (lttng_duration_period_add(&slot->period, lock_contention_period,
+			now, wait))
+		state->summary = &slot->period.last;
+	state->wait = wait;
+	state->measured = 1;
+end:
+	local_irq_restore(flags);
+}
+
+static
+const struct lttng_lock_contention_state *lttng_lock_contention_state(void)
+{
+	struct lttng_lock_contention_cpu *cpu;
+	int level;
+
+	if (!lock_contention_cpus)
+		return NULL;
+	level = lttng_lock_contention_level();
+	if (level < 0)
+		return NULL;
+	cpu = lttng_duration_this_cpu(lock_contention_cpus);
+	return &cpu->levels[level];
+}
+
+/*
+ * Return the statistics of the period ended by the acquisition being
+ * traced, or NULL if it did not end a period.
+ */
+static
+const struct lttng_duration_stats *lttng_lock_contention_summary(void)
+{
+	const struct lttng_lock_contention_state *state;
+
+	state = lttng_lock_contention_state();
+	if (!state || !state->measured)
+		return NULL;
+	return state->summary;
+}
+
+/*
+ * Return the wait of the acquisition being traced, or 0 if it is below
+ * the threshold.
+ */
+static
+uint64_t lttng_lock_wait(void)
+{
+	const struct lttng_lock_contention_state *state;
+
+	state = lttng_lock_contention_state();
+	if (!state || !state->measured || !lock_contention_threshold
+			|| state->wait < lock_contention_threshold)
+		return 0;
+	return max_t(uint64_t, state->wait, 1);
+}
+#endif /* CONFIG_LOCK_STAT */
+
 #include <instrumentation/events/lttng-module/lock.h>
 
+#ifdef CONFIG_LOCK_STAT
+static const struct lttng_duration_hook lock_contention_hooks[] = {
+	{ "lock_contended", (void *) lttng_lock_contention_contended },
+	{ "lock_acquired", (void *) lttng_lock_contention_acquired },
+};
+
+static
+int lttng_lock_contention_register(void)
+{
+	int ret;
+
+	lock_contention_period = lttng_duration_clock(
+		(uint64_t) lock_contention_period_ms * NSEC_PER_MSEC);
+	lock_contention_threshold = lttng_duration_clock(
+		(uint64_t) lock_contention_threshold_us * NSEC_PER_USEC);
+	lock_contention_cpus = lttng_duration_cpus_alloc(
+			sizeof(struct lttng_lock_contention_cpu));
+	if (!lock_contention_cpus)
+		return -ENOMEM;
+	ret = lttng_duration_hooks_register(lock_contention_hooks,
+			ARRAY_SIZE(lock_contention_hooks));
+	if (ret)
+		lttng_duration_cpus_free(lock_contention_cpus);
+	return ret;
+}
+
+static
+void lttng_lock_contention_unregister(void)
+{
+	lttng_duration_hooks_unregister(lock_contention_hooks,
+			ARRAY_SIZE(lock_contention_hooks));
+	lttng_duration_cpus_free(lock_contention_cpus);
+}
+
+LTTNG_DURATION_PROBE_MODULE(lock, lock_contention,
+		lttng_lock_contention_register,
+		lttng_lock_contention_unregister);
+#endif /* CONFIG_LOCK_STAT */
+
 MODULE_LICENSE("GPL and additional rights");
 MODULE_AUTHOR("Wade Farnsworth <wade_farnsworth@mentor.com> and Andrew Gabbasov <andrew_gabbasov@mentor.com>");
 MODULE_DESCRIPTION("LTTng lock probes");
@@ -9,6 +9,19 @@
  */
 
 #include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/skbuff.h>
+#include <linux/netdevice.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+#include <linux/in6.h>
+#include <linux/hash.h>
+#include <linux/jhash.h>
+#include <linux/slab.h>
+#include <linux/jiffies.h>
+#include <linux/hardirq.h>
 #include <lttng-tracer.h>
 
 /*
@@ -17,15 +30,425 @@
  */
 #include <trace/events/net.h>
 
+#include <wrapper/tracepoint.h>
+#include <wrapper/trace-clock.h>
+#include <wrapper/vmalloc.h>
+
 /*
  * Create LTTng tracepoint probes.
  */
 #define LTTNG_PACKAGE_BUILD
 #define CREATE_TRACE_POINTS
 #define TRACE_INCLUDE_PATH instrumentation/events/lttng-module
+#define TP_MODULE_NOAUTOLOAD
+
+/*
+ * Flow aggregation mode: hooks on the transmit and receive tracepoints
+ * count, per cpu and per flow, the packets and bytes transmitted and
+ * received over periods of net_flow_period_ms. A flow is identified by
+ * its network device, direction and 5-tuple: addresses, with IPv4
+ * addresses mapped into IPv6, transport protocol and, for TCP and UDP,
+ * ports. The counters of each period are recorded as one flow summary
+ * event at the first packet of this flow following the end of the
+ * period on this cpu.
+ *
+ * The 5-tuple of a transmitted packet is extracted once, when it is
+ * queued to its device, and kept with its queuing time in a global
+ * table indexed by socket buffer address, since the packet is sent
+ * once the queuing discipline runs, possibly on another cpu, and may
+ * be freed by the driver before net_dev_xmit. Its transmission then
+ * accounts its queuing latency, in trace clock units, to its flow.
+ * Colliding packets make this table lossy: packets which are not found
+ * are not counted. Received packets have no latency.
+ *
+ * Flows which do not find a slot within NET_FLOW_MAX_PROBE slots of
+ * their cpu are not counted, nor are packets handled in NMI context,
+ * non-IP packets, and ports beyond IPv6 extension headers or of IPv4
+ * fragments, which are counted with null ports.
+ *
+ * The state left by the hooks for the event probes of a packet is kept
+ * per cpu and per context level.
+ */
+#define NET_FLOW_SLOTS_ORDER		9
+#define NET_FLOW_NR_SLOTS		(1U << NET_FLOW_SLOTS_ORDER)
+#define NET_FLOW_MAX_PROBE		8
+#define NET_FLOW_QUEUED_ORDER		10
+#define NET_FLOW_NR_QUEUED		(1U << NET_FLOW_QUEUED_ORDER)
+
+/* Task, softirq and hard irq contexts. */
+#define NET_FLOW_NR_LEVELS		3
+
+enum lttng_net_flow_dir {
+	NET_FLOW_TX = 0,
+	NET_FLOW_RX = 1,
+};
+
+/* Hashed as u32 words: no implicit padding. */
+struct lttng_net_flow_key {
+	struct in6_addr saddr;
+	struct in6_addr daddr;
+	__be16 sport;
+	__be16 dport;
+	int ifindex;
+	u8 family;		/* 0: free slot */
+	u8 protocol;
+	u8 dir;
+	u8 padding;
+};
+
+struct lttng_net_flow_stats {
+	uint64_t packets;
+	uint64_t bytes;
+	uint64_t latency_packets;	/* Packets with a queuing latency */
+	uint64_t latency_total;
+	uint64_t latency_max;
+};
+
+struct lttng_net_flow {
+	struct lttng_net_flow_key key;
+	int started;			/* A period is started */
+	unsigned long period_end;	/* In jiffies */
+	struct lttng_net_flow_stats cur;
+	struct lttng_net_flow_stats last;	/* Previous period */
+};
+
+struct lttng_net_flow_state {
+	/* Flow whose period was ended by the last packet, or NULL. */
+	const struct lttng_net_flow *summary;
+};
+
+struct lttng_net_flow_cpu {
+	struct lttng_net_flow_state levels[NET_FLOW_NR_LEVELS];
+	struct lttng_net_flow flows[NET_FLOW_NR_SLOTS];
+};
+
+/* Protected by a sequence count, odd while the slot is in use. */
+struct lttng_net_flow_queued {
+	unsigned long seq;
+	struct sk_buff *skb;
+	uint64_t timestamp;		/* queuing time */
+	struct lttng_net_flow_key key;
+};
+
+static int net_flow;
+module_param(net_flow, int, 0444);
+MODULE_PARM_DESC(net_flow, "Count packets and bytes per flow for the net flow summary events (0: disabled, 1: enabled)");
+
+static unsigned int net_flow_period_ms = 1000;
+module_param(net_flow_period_ms, uint, 0444);
+MODULE_PARM_DESC(net_flow_period_ms, "Period of the net flow summary events, in milliseconds");
+
+static unsigned long net_flow_period;	/* In jiffies */
+
+static void * __percpu *net_flow_cpus;
+static struct lttng_net_flow_queued *net_flow_queued;
+
+/* Context level of the caller, -1 in NMI context. */
+static
+int lttng_net_flow_level(void)
+{
+	if (in_nmi())
+		return -1;
+	if (in_irq())
+		return 2;
+	if (in_serving_softirq())
+		return 1;
+	return 0;
+}
+
+static
+void lttng_net_flow_ports(struct lttng_net_flow_key *key,
+		struct sk_buff *skb, int offset)
+{
+	__be16 _ports[2];
+	const __be16 *ports;
+
+	if (key->protocol != IPPROTO_TCP && key->protocol != IPPROTO_UDP)
+		return;
+	/* Source and destination ports lead both headers. */
+	ports = skb_header_pointer(skb, offset, sizeof(_ports), _ports);
+	if (!ports)
+		return;
+	key->sport = ports[0];
+	key->dport = ports[1];
+}
+
+/*
+ * Extract the 5-tuple of @skb. Returns false if it is not an IP
+ * packet. The network header of received packets may not be set yet,
+ * in which case it starts at the packet data.
+ */
+static
+bool lttng_net_flow_key_init(struct lttng_net_flow_key *key,
+		struct sk_buff *skb, enum lttng_net_flow_dir dir)
+{
+	int offset = 0;
+
+	memset(key, 0, sizeof(*key));
+	if (skb_network_header(skb) != skb->head)
+		offset = skb_network_offset(skb);
+	switch (ntohs(skb->protocol)) {
+	case ETH_P_IP:
+	{
+		struct iphdr _iph;
+		const struct iphdr *iph;
+
+		iph = skb_header_pointer(skb, offset, sizeof(_iph), &_iph);
+		if (!iph || iph->ihl < 5)
+			return false;
+		key->family = AF_INET;
+		key->protocol = iph->protocol;
+		key->saddr.s6_addr32[2] = htonl(0xffff);
+		key->saddr.s6_addr32[3] = iph->saddr;
+		key->daddr.s6_addr32[2] = htonl(0xffff);
+		key->daddr.s6_addr32[3] = iph->daddr;
+		if (!(iph->frag_off & htons(IP_OFFSET)))
+			lttng_net_flow_ports(key, skb, offset + iph->ihl * 4);
+		break;
+	}
+	case ETH_P_IPV6:
+	{
+		struct ipv6hdr _ip6h;
+		const struct ipv6hdr *ip6h;
+
+		ip6h = skb_header_pointer(skb, offset, sizeof(_ip6h), &_ip6h);
+		if (!ip6h)
+			return false;
+		key->family = AF_INET6;
+		key->protocol = ip6h->nexthdr;
+		key->saddr = ip6h->saddr;
+		key->daddr = ip6h->daddr;
+		lttng_net_flow_ports(key, skb, offset + sizeof(*ip6h));
+		break;
+	}
+	default:
+		return false;
+	}
+	key->ifindex = skb->dev ? skb->dev->ifindex : 0;
+	key->dir = dir;
+	return true;
+}
+
+static
+struct lttng_net_flow *lttng_net_flow_slot(struct lttng_net_flow_cpu *cpu,
+		const struct lttng_net_flow_key *key)
+{
+	struct lttng_net_flow *flow;
+	unsigned int i;
+	u32 h;
+
+	h = jhash2((const u32 *) key, sizeof(*key) / sizeof(u32), 0);
+	for (i = 0; i < NET_FLOW_MAX_PROBE; i++) {
+		flow = &cpu->flows[(h + i) & (NET_FLOW_NR_SLOTS - 1)];
+		if (!memcmp(&flow->key, key, sizeof(*key)))
+			return flow;
+		if (!flow->key.family) {
+			flow->key = *key;
+			return flow;
+		}
+	}
+	return NULL;
+}
+
+/* Account a packet of @len bytes, with a @latency if not 0. */
+static
+void lttng_net_flow_account(const struct lttng_net_flow_key *key,
+		unsigned int len, uint64_t latency)
+{
+	struct lttng_net_flow_cpu *cpu;
+	struct lttng_net_flow_state *state;
+	struct lttng_net_flow *flow;
+	unsigned long flags, now = jiffies;
+	int level;
+
+	level = lttng_net_flow_level();
+	if (level < 0)
+		return;
+	cpu = lttng_duration_this_cpu(net_flow_cpus);
+	state = &cpu->levels[level];
+	state->summary = NULL;
+	/* Packets of interrupt handlers update the same counters. */
+	local_irq_save(flags);
+	flow = lttng_net_flow_slot(cpu, key);
+	if (!flow)
+		goto end;
+	if (!flow->started || time_after_eq(now, flow->period_end)) {
+		if (flow->started) {
+			flow->last = flow->cur;
+			state->summary = flow;
+		}
+		memset(&flow->cur, 0, sizeof(flow->cur));
+		flow->period_end = now + net_flow_period;
+		flow->started = 1;
+	}
+	flow->cur.packets++;
+	flow->cur.bytes += len;
+	if (latency) {
+		flow->cur.latency_packets++;
+		flow->cur.latency_total += latency;
+		flow->cur.latency_max = max(flow->cur.latency_max, latency);
+	}
+end:
+	local_irq_restore(flags);
+}
+
+/* The packet being traced is not counted: it ends no period. */
+static
+void lttng_net_flow_no_summary(void)
+{
+	struct lttng_net_flow_cpu *cpu;
+	int level = lttng_net_flow_level();
+
+	if (level < 0)
+		return;
+	cpu = lttng_duration_this_cpu(net_flow_cpus);
+	cpu->levels[level].summary = NULL;
+}
+
+static
+void lttng_net_flow_queue(void *data, struct sk_buff *skb)
+{
+	struct lttng_net_flow_queued *slot;
+	unsigned long seq;
+
+	slot = &net_flow_queued[hash_ptr(skb, NET_FLOW_QUEUED_ORDER)];
+	seq = READ_ONCE(slot->seq);
+	if ((seq & 1) || cmpxchg(&slot->seq, seq, seq + 1) != seq)
+		return;
+	if (lttng_net_flow_key_init(&slot->key, skb, NET_FLOW_TX)) {
+		slot->skb = skb;
+		slot->timestamp = trace_clock_read64();
+	} else {
+		slot->skb = NULL;
+	}
+	smp_wmb();	/* Content before even seq. */
+	WRITE_ONCE(slot->seq, seq + 2);
+}
+
+static
+void lttng_net_flow_xmit(void *data, struct sk_buff *skb, int rc,
+		struct net_device *dev, unsigned int skb_len)
+{
+	struct lttng_net_flow_queued *slot;
+	struct lttng_net_flow_key key;
+	uint64_t timestamp;
+	unsigned long seq;
+
+	slot = &net_flow_queued[hash_ptr(skb, NET_FLOW_QUEUED_ORDER)];
+	seq = READ_ONCE(slot->seq);
+	if ((seq & 1) || cmpxchg(&slot->seq, seq, seq + 1) != seq)
+		goto not_found;
+	if (slot->skb != skb) {
+		WRITE_ONCE(slot->seq, seq + 2);
+		goto not_found;
+	}
+	key = slot->key;
+	timestamp = slot->timestamp;
+	/* Busy devices send the packet again on a later attempt. */
+	if (rc == NETDEV_TX_OK)
+		slot->skb = NULL;
+	smp_wmb();	/* Content before even seq. */
+	WRITE_ONCE(slot->seq, seq + 2);
+	if (rc != NETDEV_TX_OK)
+		goto not_found;
+	lttng_net_flow_account(&key, skb_len,
+		max_t(uint64_t, trace_clock_read64() - timestamp, 1));
+	return;
+
+not_found:
+	lttng_net_flow_no_summary();
+}
+
+static
+void lttng_net_flow_receive(void *data, struct sk_buff *skb)
+{
+	struct lttng_net_flow_key key;
+
+	if (lttng_net_flow_key_init(&key, skb, NET_FLOW_RX))
+		lttng_net_flow_account(&key, skb->len, 0);
+	else
+		lttng_net_flow_no_summary();
+}
+
+/*
+ * Return the flow whose period was ended by the packet being traced,
+ * or NULL if it did not end a period.
+ */
+static
+const struct lttng_net_flow *lttng_net_flow_summary(void)
+{
+	const struct lttng_net_flow_cpu *cpu;
+	int level;
+
+	if (!net_flow_cpus)
+		return NULL;
+	level = lttng_net_flow_level();
+	if (level < 0)
+		return NULL;
+	cpu = lttng_duration_this_cpu(net_flow_cpus);
+	return cpu->levels[level].summary;
+}
 
 #include <instrumentation/events/lttng-module/net.h>
 
+static
+void lttng_net_flow_free_state(void)
+{
+	lttng_duration_cpus_free(net_flow_cpus);
+	lttng_kvfree(net_flow_queued);
+}
+
+static
+int lttng_net_flow_alloc_state(void)
+{
+	net_flow_queued = lttng_kvzalloc(NET_FLOW_NR_QUEUED
+			* sizeof(*net_flow_queued), GFP_KERNEL);
+	if (!net_flow_queued)
+		return -ENOMEM;
+	net_flow_cpus = lttng_duration_cpus_alloc(
+			sizeof(struct lttng_net_flow_cpu));
+	if (!net_flow_cpus) {
+		lttng_kvfree(net_flow_queued);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+static const struct lttng_duration_hook net_flow_hooks[] = {
+	{ "net_dev_queue", (void *) lttng_net_flow_queue },
+	{ "net_dev_xmit", (void *) lttng_net_flow_xmit },
+	{ "netif_receive_skb", (void *) lttng_net_flow_receive },
+};
+
+static
+int lttng_net_flow_register(void)
+{
+	int ret;
+
+	if (!net_flow_period_ms)
+		return -EINVAL;
+	net_flow_period = msecs_to_jiffies(net_flow_period_ms);
+	ret = lttng_net_flow_alloc_state();
+	if (ret)
+		return ret;
+	ret = lttng_duration_hooks_register(net_flow_hooks,
+			ARRAY_SIZE(net_flow_hooks));
+	if (ret)
+		lttng_net_flow_free_state();
+	return ret;
+}
+
+static
+void lttng_net_flow_unregister(void)
+{
+	lttng_duration_hooks_unregister(net_flow_hooks,
+			ARRAY_SIZE(net_flow_hooks));
+	lttng_net_flow_free_state();
+}
+
+LTTNG_DURATION_PROBE_MODULE(net, net_flow,
+		lttng_net_flow_register, lttng_net_flow_unregister);
+
 MODULE_LICENSE("GPL and additional rights");
 MODULE_AUTHOR("Wade Farnsworth <wade_farnsworth@mentor.com>");
 MODULE_DESCRIPTION("LTTng net probes");
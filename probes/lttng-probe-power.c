@@ -9,6 +9,11 @@
  */
 
 #include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/hash.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/cpuidle.h>
 #include <lttng-tracer.h>
 
 /*
@@ -18,6 +23,9 @@
 #include <trace/events/power.h>
 
 #include <wrapper/tracepoint.h>
+#include <wrapper/trace-clock.h>
+#include <wrapper/vmalloc.h>
+#include <probes/lttng-duration.h>
 
 /*
  * Create LTTng tracepoint probes.
@@ -25,9 +33,248 @@
 #define LTTNG_PACKAGE_BUILD
 #define CREATE_TRACE_POINTS
 #define TRACE_INCLUDE_PATH instrumentation/events/lttng-module
+#define TP_MODULE_NOAUTOLOAD
+
+/*
+ * Residency mode: hooks on cpu_idle and cpu_frequency accumulate the
+ * time spent by each cpu in each idle state and at each frequency. The
+ * statistics of the residencies are kept over periods of
+ * power_residency_period_ms, and recorded as one
+ * power_cpu_idle_residency event at the first exit of an idle state
+ * following the end of the period of this state on this cpu, and as one
+ * power_cpu_frequency_residency event at the first change from a
+ * frequency following the end of its period on this cpu.
+ *
+ * Idle transitions are traced on their cpu, with interrupts disabled.
+ * Frequency transitions of a cpu may be traced on any cpu of its
+ * policy: their state is guarded by a lock per cpu, and the statistics
+ * of an ended period copied for the probes on the tracing cpu.
+ * Frequencies which do not find a slot within RESIDENCY_FREQ_MAX_PROBE
+ * slots of their cpu, and idle states beyond CPUIDLE_STATE_MAX, are not
+ * accounted.
+ *
+ * The probes check that the state left by the hooks on their cpu is the
+ * one of their transition, in case a nested transition overwrote it.
+ */
+#define RESIDENCY_FREQ_SLOTS_ORDER	5
+#define RESIDENCY_FREQ_NR_SLOTS		(1U << RESIDENCY_FREQ_SLOTS_ORDER)
+#define RESIDENCY_FREQ_MAX_PROBE	8
+
+struct lttng_residency_freq_slot {
+	unsigned int freq;		/* 0: free slot */
+	struct lttng_duration_period period;
+};
+
+/* Statistics of a period ended by the last transition on this cpu. */
+struct lttng_residency_summary {
+	bool valid;
+	unsigned int arg;		/* State or frequency of the tracepoint */
+	unsigned int cpu_id;
+	unsigned int state;		/* State or frequency accounted */
+	struct lttng_duration_stats stats;
+};
+
+struct lttng_residency_cpu {
+	/* Idle state of the cpu, only updated on the cpu. */
+	unsigned int idle_state;	/* PWR_EVENT_EXIT: not idle */
+	uint64_t idle_start;
+	struct lttng_duration_period idle[CPUIDLE_STATE_MAX];
+
+	/* Frequency of the cpu, updated with freq_lock held. */
+	raw_spinlock_t freq_lock;
+	unsigned int freq;		/* 0: unknown */
+	uint64_t freq_start;
+	struct lttng_residency_freq_slot freq_slots[RESIDENCY_FREQ_NR_SLOTS];
+
+	/* Last transitions traced on this cpu. */
+	struct lttng_residency_summary idle_summary;
+	struct lttng_residency_summary freq_summary;
+};
+
+static int power_residency;
+module_param(power_residency, int, 0444);
+MODULE_PARM_DESC(power_residency, "Accumulate cpu idle state and frequency residencies for the residency events (0: disabled, 1: enabled)");
+
+static unsigned int power_residency_period_ms = 1000;
+module_param(power_residency_period_ms, uint, 0444);
+MODULE_PARM_DESC(power_residency_period_ms, "Period of the residency events, in milliseconds");
+
+/* In trace clock units. */
+static uint64_t power_residency_period;
+
+static void * __percpu *residency_cpus;
+
+static
+void lttng_residency_idle(void *data, unsigned int state, unsigned int cpu_id)
+{
+	struct lttng_residency_cpu *cpu, *rc;
+	struct lttng_duration_period *period;
+	uint64_t now;
+
+	cpu = lttng_duration_this_cpu(residency_cpus);
+	cpu->idle_summary.valid = false;
+	if (cpu_id >= nr_cpu_ids || !cpu_possible(cpu_id))
+		return;
+	rc = lttng_duration_cpu(residency_cpus, cpu_id);
+	now = trace_clock_read64();
+	if (state != (unsigned int) PWR_EVENT_EXIT) {
+		if (state < CPUIDLE_STATE_MAX) {
+			rc->idle_state = state;
+			rc->idle_start = now;
+		}
+		return;
+	}
+	if (rc->idle_state == (unsigned int) PWR_EVENT_EXIT)
+		return;
+	period = &rc->idle[rc->idle_state];
+	if (lttng_duration_period_add(period, power_residency_period, now,
+			now - rc->idle_start)) {
+		cpu->idle_summary.arg = state;
+		cpu->idle_summary.cpu_id = cpu_id;
+		cpu->idle_summary.state = rc->idle_state;
+		cpu->idle_summary.stats = period->last;
+		cpu->idle_summary.valid = true;
+	}
+	rc->idle_state = (unsigned int) PWR_EVENT_EXIT;
+}
+
+static
+struct lttng_residency_freq_slot *lttng_residency_freq_slot(
+		struct lttng_residency_cpu *rc, unsigned int freq)
+{
+	struct lttng_residency_freq_slot *slot;
+	unsigned int i, h;
+
+	h = hash_32(freq, RESIDENCY_FREQ_SLOTS_ORDER);
+	for (i = 0; i < RESIDENCY_FREQ_MAX_PROBE; i++) {
+		slot = &rc->freq_slots[(h + i) & (RESIDENCY_FREQ_NR_SLOTS - 1)];
+		if (slot->freq == freq)
+			return slot;
+		if (!slot->freq) {
+			slot->freq = freq;
+			return slot;
+		}
+	}
+	return NULL;
+}
+
+static
+void lttng_residency_frequency(void *data, unsigned int freq,
+		unsigned int cpu_id)
+{
+	struct lttng_residency_cpu *cpu, *rc;
+	struct lttng_residency_freq_slot *slot;
+	unsigned long flags;
+	uint64_t now;
+
+	cpu = lttng_duration_this_cpu(residency_cpus);
+	cpu->freq_summary.valid = false;
+	if (cpu_id >= nr_cpu_ids || !cpu_possible(cpu_id))
+		return;
+	rc = lttng_duration_cpu(residency_cpus, cpu_id);
+	raw_spin_lock_irqsave(&rc->freq_lock, flags);
+	now = trace_clock_read64();
+	if (rc->freq && rc->freq != freq) {
+		slot = lttng_residency_freq_slot(rc, rc->freq);
+		if (slot && lttng_duration_period_add(&slot->period,
+				power_residency_period, now,
+				now - rc->freq_start)) {
+			cpu->freq_summary.arg = freq;
+			cpu->freq_summary.cpu_id = cpu_id;
+			cpu->freq_summary.state = rc->freq;
+			cpu->freq_summary.stats = slot->period.last;
+			cpu->freq_summary.valid = true;
+		}
+	}
+	if (rc->freq != freq) {
+		rc->freq = freq;
+		rc->freq_start = now;
+	}
+	raw_spin_unlock_irqrestore(&rc->freq_lock, flags);
+}
+
+/*
+ * Return the statistics of the period ended by the transition being
+ * traced, with the idle state or frequency they account for, or NULL if
+ * it did not end a period.
+ */
+static
+const struct lttng_duration_stats *lttng_residency_summary(
+		const struct lttng_residency_summary *summary,
+		unsigned int arg, unsigned int cpu_id, unsigned int *state)
+{
+	if (!summary->valid || summary->arg != arg
+			|| summary->cpu_id != cpu_id)
+		return NULL;
+	*state = summary->state;
+	return &summary->stats;
+}
+
+static
+const struct lttng_duration_stats *lttng_power_cpu_idle_residency(
+		unsigned int arg, unsigned int cpu_id, unsigned int *state)
+{
+	const struct lttng_residency_cpu *cpu;
+
+	if (!residency_cpus)
+		return NULL;
+	cpu = lttng_duration_this_cpu(residency_cpus);
+	return lttng_residency_summary(&cpu->idle_summary, arg, cpu_id, state);
+}
+
+static
+const struct lttng_duration_stats *lttng_power_cpu_frequency_residency(
+		unsigned int arg, unsigned int cpu_id, unsigned int *freq)
+{
+	const struct lttng_residency_cpu *cpu;
+
+	if (!residency_cpus)
+		return NULL;
+	cpu = lttng_duration_this_cpu(residency_cpus);
+	return lttng_residency_summary(&cpu->freq_summary, arg, cpu_id, freq);
+}
 
 #include <instrumentation/events/lttng-module/power.h>
 
+static const struct lttng_duration_hook residency_hooks[] = {
+	{ "cpu_idle", (void *) lttng_residency_idle },
+	{ "cpu_frequency", (void *) lttng_residency_frequency },
+};
+
+static
+int lttng_residency_register(void)
+{
+	struct lttng_residency_cpu *rc;
+	int cpu, ret;
+
+	power_residency_period = lttng_duration_clock(
+		(uint64_t) power_residency_period_ms * NSEC_PER_MSEC);
+	residency_cpus = lttng_duration_cpus_alloc(sizeof(*rc));
+	if (!residency_cpus)
+		return -ENOMEM;
+	for_each_possible_cpu(cpu) {
+		rc = lttng_duration_cpu(residency_cpus, cpu);
+		rc->idle_state = (unsigned int) PWR_EVENT_EXIT;
+		raw_spin_lock_init(&rc->freq_lock);
+	}
+	ret = lttng_duration_hooks_register(residency_hooks,
+			ARRAY_SIZE(residency_hooks));
+	if (ret)
+		lttng_duration_cpus_free(residency_cpus);
+	return ret;
+}
+
+static
+void lttng_residency_unregister(void)
+{
+	lttng_duration_hooks_unregister(residency_hooks,
+			ARRAY_SIZE(residency_hooks));
+	lttng_duration_cpus_free(residency_cpus);
+}
+
+LTTNG_DURATION_PROBE_MODULE(power, power_residency,
+		lttng_residency_register, lttng_residency_unregister);
+
 MODULE_LICENSE("GPL and additional rights");
 MODULE_AUTHOR("Wade Farnsworth <wade_farnsworth@mentor.com>");
 MODULE_AUTHOR("Andrew Gabbasov <andrew_gabbasov@mentor.com>");
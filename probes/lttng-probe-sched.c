@@ -8,7 +8,14 @@
  */
 
 #include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/sched.h>
+#include <linux/stacktrace.h>
+#include <linux/hash.h>
+#include <linux/jhash.h>
+#include <linux/slab.h>
 #include <lttng-tracer.h>
+#include <lttng-kernel-version.h>
 
 /*
  * Create the tracepoint static inlines from the kernel to validate that our
@@ -17,6 +24,10 @@
 #include <trace/events/sched.h>
 
 #include <wrapper/tracepoint.h>
+#include <wrapper/trace-clock.h>
+#include <wrapper/kallsyms.h>
+#include <wrapper/vmalloc.h>
+#include <probes/lttng-duration.h>
 
 /*
  * Create LTTng tracepoint probes.
@@ -25,8 +36,501 @@
 #define CREATE_TRACE_POINTS
 #define TRACE_INCLUDE_PATH instrumentation/events/lttng-module
 
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,4,0))
+/*
+ * Off-cpu mode: a hook on sched_switch saves the kernel stack of each
+ * task which blocks, with the time it is switched out, and accounts
+ * the time it stayed blocked when it is switched in again. Preempted
+ * tasks are not blocked, and are not accounted. The statistics of the
+ * blocked times are kept per cpu and per (process, stack) over periods
+ * of offcpu_period_ms, and recorded as one sched_offcpu_summary event,
+ * with the stack, at the first switch in of a task of this process
+ * blocked in this stack following the end of the period on this cpu.
+ * Stacks are truncated to their innermost OFFCPU_STACK_DEPTH entries.
+ *
+ * Tasks may be woken up on another cpu: the stack and switch out time
+ * of each blocked task are kept in a slot of a global table indexed by
+ * thread, as for system call latencies. Colliding threads make the
+ * table lossy: a task which does not find its slot is not accounted.
+ * Neither are the stacks which do not find a slot within
+ * OFFCPU_MAX_PROBE slots of the statistics of their cpu.
+ *
+ * The scheduler does not nest, so the state left by the hook on a cpu
+ * is not overwritten before the event probes of the same switch read
+ * it.
+ */
+#define TP_MODULE_NOAUTOLOAD
+
+#define OFFCPU_STACK_DEPTH		16
+
+#define OFFCPU_BLOCKED_SLOTS_ORDER	12
+#define OFFCPU_BLOCKED_NR_SLOTS		(1U << OFFCPU_BLOCKED_SLOTS_ORDER)
+
+#define OFFCPU_SLOTS_ORDER		7
+#define OFFCPU_NR_SLOTS			(1U << OFFCPU_SLOTS_ORDER)
+#define OFFCPU_MAX_PROBE		8
+
+struct lttng_offcpu_stack {
+	unsigned int nr_entries;
+	u32 hash;
+	unsigned long entries[OFFCPU_STACK_DEPTH];
+};
+
+struct lttng_offcpu_blocked_slot {
+	unsigned long seq;
+	pid_t tid;			/* 0: free slot */
+	uint64_t timestamp;		/* Switch out */
+	struct lttng_offcpu_stack stack;
+};
+
+struct lttng_offcpu_slot {
+	pid_t pid;			/* 0: free slot */
+	struct lttng_offcpu_stack stack;
+	struct lttng_duration_period period;
+};
+
+struct lttng_offcpu_cpu {
+	/* Stack whose period was ended by the last switch in, or NULL. */
+	const struct lttng_offcpu_slot *summary;
+	struct lttng_offcpu_stack stack;	/* Scratch */
+	struct lttng_offcpu_slot slots[OFFCPU_NR_SLOTS];
+};
+
+static int offcpu;
+module_param(offcpu, int, 0444);
+MODULE_PARM_DESC(offcpu, "Account the blocked time of tasks per stack for the sched_offcpu_summary events (0: disabled, 1: enabled)");
+
+static unsigned int offcpu_period_ms = 1000;
+module_param(offcpu_period_ms, uint, 0444);
+MODULE_PARM_DESC(offcpu_period_ms, "Period of the sched_offcpu_summary events, in milliseconds");
+
+/* In trace clock units. */
+static uint64_t offcpu_period;
+
+static void (*offcpu_save_stack_trace)(struct stack_trace *trace);
+static struct lttng_offcpu_blocked_slot *offcpu_blocked_slots;
+static void * __percpu *offcpu_cpus;
+
+static
+struct lttng_offcpu_blocked_slot *lttng_offcpu_blocked_slot(pid_t tid)
+{
+	return &offcpu_blocked_slots[hash_32(tid, OFFCPU_BLOCKED_SLOTS_ORDER)];
+}
+
+/* Save the stack of the current task, which is blocking. */
+static
+void lttng_offcpu_save_stack(struct lttng_offcpu_stack *stack)
+{
+	struct stack_trace trace = {
+		.max_entries = OFFCPU_STACK_DEPTH,
+		.entries = stack->entries,
+	};
+
+	offcpu_save_stack_trace(&trace);
+	if (trace.nr_entries > 0
+			&& trace.entries[trace.nr_entries - 1] == ULONG_MAX)
+		trace.nr_entries--;
+	stack->nr_entries = trace.nr_entries;
+	stack->hash = jhash(stack->entries,
+		sizeof(unsigned long) * stack->nr_entries, 0);
+}
+
+static
+void lttng_offcpu_switch_out(struct task_struct *prev, uint64_t now)
+{
+	struct lttng_offcpu_blocked_slot *slot;
+	unsigned long seq;
+
+	slot = lttng_offcpu_blocked_slot(prev->pid);
+	seq = READ_ONCE(slot->seq);
+	if ((seq & 1) || cmpxchg(&slot->seq, seq, seq + 1) != seq)
+		return;
+	slot->tid = prev->pid;
+	slot->timestamp = now;
+	lttng_offcpu_save_stack(&slot->stack);
+	smp_wmb();	/* Content before even seq. */
+	WRITE_ONCE(slot->seq, seq + 2);
+}
+
+/*
+ * Return false if the switch out of @next is not found. Otherwise, free
+ * its slot and return true, with its stack copied to @stack and its
+ * switch out time in @timestamp.
+ */
+static
+bool lttng_offcpu_switch_in(struct task_struct *next,
+		struct lttng_offcpu_stack *stack, uint64_t *timestamp)
+{
+	struct lttng_offcpu_blocked_slot *slot;
+	unsigned long seq;
+
+	slot = lttng_offcpu_blocked_slot(next->pid);
+	seq = READ_ONCE(slot->seq);
+	if ((seq & 1) || READ_ONCE(slot->tid) != next->pid
+			|| cmpxchg(&slot->seq, seq, seq + 1) != seq)
+		return false;
+	if (slot->tid != next->pid) {
+		WRITE_ONCE(slot->seq, seq + 2);
+		return false;
+	}
+	*timestamp = slot->timestamp;
+	*stack = slot->stack;
+	slot->tid = 0;
+	smp_wmb();	/* Content before even seq. */
+	WRITE_ONCE(slot->seq, seq + 2);
+	return true;
+}
+
+static
+struct lttng_offcpu_slot *lttng_offcpu_slot(struct lttng_offcpu_cpu *cpu,
+		pid_t pid, const struct lttng_offcpu_stack *stack)
+{
+	struct lttng_offcpu_slot *slot;
+	unsigned int i, h;
+
+	h = hash_32(stack->hash ^ pid, OFFCPU_SLOTS_ORDER);
+	for (i = 0; i < OFFCPU_MAX_PROBE; i++) {
+		slot = &cpu->slots[(h + i) & (OFFCPU_NR_SLOTS - 1)];
+		if (slot->pid == pid && slot->stack.hash == stack->hash
+				&& slot->stack.nr_entries == stack->nr_entries
+				&& !memcmp(slot->stack.entries, stack->entries,
+					sizeof(unsigned long) * stack->nr_entries))
+			return slot;
+		if (!slot->pid) {
+			slot->pid = pid;
+			slot->stack = *stack;
+			return slot;
+		}
+	}
+	return NULL;
+}
+
+static
+void lttng_offcpu_switch(void *data, bool preempt,
+		struct task_struct *prev, struct task_struct *next)
+{
+	struct lttng_offcpu_cpu *cpu;
+	struct lttng_offcpu_slot *slot;
+	uint64_t now, timestamp;
+
+	cpu = lttng_duration_this_cpu(offcpu_cpus);
+	cpu->summary = NULL;
+	now = trace_clock_read64();
+	if (!preempt && prev->state != TASK_RUNNING && prev->pid)
+		lttng_offcpu_switch_out(prev, now);
+	if (!next->pid || !lttng_offcpu_switch_in(next, &cpu->stack, &timestamp))
+		return;
+	slot = lttng_offcpu_slot(cpu, next->tgid, &cpu->stack);
+	if (slot && lttng_duration_period_add(&slot->period,
+			offcpu_period, now, now - timestamp))
+		cpu->summary = slot;
+}
+
+/*
+ * Return the process and stack whose period was ended by the task
+ * being switched in, or NULL if it did not end a period.
+ */
+static
+const struct lttng_offcpu_slot *lttng_sched_offcpu_summary(void)
+{
+	const struct lttng_offcpu_cpu *cpu;
+
+	if (!offcpu_cpus)
+		return NULL;
+	cpu = lttng_duration_this_cpu(offcpu_cpus);
+	return cpu->summary;
+}
+
+/*
+ * Wakeup latency mode: hooks on sched_waking and sched_wakeup_new save
+ * the wakeup time and the waker of each task woken up, and a hook on
+ * sched_switch measures the time the task waited in the run queue when
+ * it is switched in. Latencies of at least wakeup_latency_threshold_us
+ * are recorded as sched_wakeup_latency events. The statistics of the
+ * latencies are kept per cpu over periods of wakeup_latency_period_ms,
+ * and recorded as one sched_wakeup_latency_summary event at the first
+ * switch in following the end of the period on this cpu.
+ *
+ * Tasks are woken up from any cpu: their wakeup is kept in a slot of a
+ * global table indexed by thread. Colliding threads make the table
+ * lossy: a task which does not find its wakeup is not measured. The
+ * latency of a task woken up again before being switched in, as when
+ * it is woken up before it has been switched out, is measured from its
+ * last wakeup.
+ */
+#define WAKEUP_SLOTS_ORDER		10
+#define WAKEUP_NR_SLOTS			(1U << WAKEUP_SLOTS_ORDER)
+
+struct lttng_wakeup_slot {
+	unsigned long seq;
+	pid_t tid;			/* 0: free slot */
+	pid_t waker_tid;
+	uint64_t timestamp;		/* Wakeup */
+};
+
+struct lttng_wakeup_latency_cpu {
+	/* Last task switched in, tid is 0 if it was not measured. */
+	pid_t tid;
+	pid_t waker_tid;
+	uint64_t latency;
+	const struct lttng_duration_stats *summary;
+	struct lttng_duration_period period;
+};
+
+static int wakeup_latency;
+module_param(wakeup_latency, int, 0444);
+MODULE_PARM_DESC(wakeup_latency, "Measure the run queue latency of woken up tasks for the wakeup latency and summary events (0: disabled, 1: enabled)");
+
+static unsigned int wakeup_latency_period_ms = 1000;
+module_param(wakeup_latency_period_ms, uint, 0444);
+MODULE_PARM_DESC(wakeup_latency_period_ms, "Period of the sched_wakeup_latency_summary events, in milliseconds (0: no summary)");
+
+static unsigned int wakeup_latency_threshold_us;
+module_param(wakeup_latency_threshold_us, uint, 0444);
+MODULE_PARM_DESC(wakeup_latency_threshold_us, "Minimum latency of the wakeups recorded individually, in microseconds (0: all)");
+
+/* In trace clock units. */
+static uint64_t wakeup_latency_period, wakeup_latency_threshold;
+
+static struct lttng_wakeup_slot wakeup_slots[WAKEUP_NR_SLOTS];
+static void * __percpu *wakeup_latency_cpus;
+
+static
+struct lttng_wakeup_slot *lttng_wakeup_slot(pid_t tid)
+{
+	return &wakeup_slots[hash_32(tid, WAKEUP_SLOTS_ORDER)];
+}
+
+static
+void lttng_wakeup_latency_waking(void *data, struct task_struct *p)
+{
+	struct lttng_wakeup_slot *slot;
+	unsigned long seq;
+
+	if (!p->pid)
+		return;
+	slot = lttng_wakeup_slot(p->pid);
+	seq = READ_ONCE(slot->seq);
+	if ((seq & 1) || cmpxchg(&slot->seq, seq, seq + 1) != seq)
+		return;
+	slot->tid = p->pid;
+	slot->waker_tid = current->pid;
+	slot->timestamp = trace_clock_read64();
+	smp_wmb();	/* Content before even seq. */
+	WRITE_ONCE(slot->seq, seq + 2);
+}
+
+/*
+ * Return false if the wakeup of @next is not found. Otherwise, free its
+ * slot and return true, with its waker and wakeup time.
+ */
+static
+bool lttng_wakeup_latency_switch_in(struct task_struct *next,
+		pid_t *waker_tid, uint64_t *timestamp)
+{
+	struct lttng_wakeup_slot *slot;
+	unsigned long seq;
+
+	slot = lttng_wakeup_slot(next->pid);
+	seq = READ_ONCE(slot->seq);
+	if ((seq & 1) || READ_ONCE(slot->tid) != next->pid
+			|| cmpxchg(&slot->seq, seq, seq + 1) != seq)
+		return false;
+	if (slot->tid != next->pid) {
+		WRITE_ONCE(slot->seq, seq + 2);
+		return false;
+	}
+	*waker_tid = slot->waker_tid;
+	*timestamp = slot->timestamp;
+	slot->tid = 0;
+	smp_wmb();	/* Content before even seq. */
+	WRITE_ONCE(slot->seq, seq + 2);
+	return true;
+}
+
+static
+void lttng_wakeup_latency_switch(void *data, bool preempt,
+		struct task_struct *prev, struct task_struct *next)
+{
+	struct lttng_wakeup_latency_cpu *cpu;
+	uint64_t now, timestamp;
+	pid_t waker_tid;
+
+	cpu = lttng_duration_this_cpu(wakeup_latency_cpus);
+	cpu->tid = 0;
+	cpu->summary = NULL;
+	if (!next->pid || !lttng_wakeup_latency_switch_in(next, &waker_tid,
+			&timestamp))
+		return;
+	now = trace_clock_read64();
+	cpu->tid = next->pid;
+	cpu->waker_tid = waker_tid;
+	cpu->latency = now - timestamp;
+	if (lttng_duration_period_add(&cpu->period, wakeup_latency_period,
+			now, cpu->latency))
+		cpu->summary = &cpu->period.last;
+}
+
+static
+const struct lttng_wakeup_latency_cpu *lttng_wakeup_latency_cpu(void)
+{
+	if (!wakeup_latency_cpus)
+		return NULL;
+	return lttng_duration_this_cpu(wakeup_latency_cpus);
+}
+
+/*
+ * Return false unless the task being switched in waited at least the
+ * threshold since its wakeup, in which case its latency and waker are
+ * returned.
+ */
+static
+bool lttng_sched_wakeup_latency(uint64_t *latency, pid_t *waker_tid)
+{
+	const struct lttng_wakeup_latency_cpu *cpu = lttng_wakeup_latency_cpu();
+
+	if (!cpu || !cpu->tid || cpu->latency < wakeup_latency_threshold)
+		return false;
+	*latency = cpu->latency;
+	*waker_tid = cpu->waker_tid;
+	return true;
+}
+
+/*
+ * Return the statistics of the period ended by the task being switched
+ * in, or NULL if it did not end a period.
+ */
+static
+const struct lttng_duration_stats *lttng_sched_wakeup_latency_summary(void)
+{
+	const struct lttng_wakeup_latency_cpu *cpu = lttng_wakeup_latency_cpu();
+
+	if (!cpu || !cpu->tid)
+		return NULL;
+	return cpu->summary;
+}
+#endif /* #if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,4,0)) */
+
 #include <instrumentation/events/lttng-module/sched.h>
 
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,4,0))
+static const struct lttng_duration_hook offcpu_hooks[] = {
+	{ "sched_switch", (void *) lttng_offcpu_switch },
+};
+
+static
+void lttng_offcpu_free(void)
+{
+	lttng_duration_cpus_free(offcpu_cpus);
+	lttng_kvfree(offcpu_blocked_slots);
+}
+
+static
+int lttng_offcpu_register(void)
+{
+	unsigned long func;
+	int ret;
+
+	if (!offcpu_period_ms)
+		return -EINVAL;
+	func = kallsyms_lookup_funcptr("save_stack_trace");
+	if (!func) {
+		printk(KERN_WARNING "LTTng: symbol lookup failed: save_stack_trace\n");
+		return -EINVAL;
+	}
+	offcpu_save_stack_trace = (void *) func;
+	offcpu_period = lttng_duration_clock(
+		(uint64_t) offcpu_period_ms * NSEC_PER_MSEC);
+	offcpu_blocked_slots = lttng_kvzalloc(OFFCPU_BLOCKED_NR_SLOTS
+			* sizeof(*offcpu_blocked_slots), GFP_KERNEL);
+	if (!offcpu_blocked_slots)
+		return -ENOMEM;
+	offcpu_cpus = lttng_duration_cpus_alloc(
+			sizeof(struct lttng_offcpu_cpu));
+	if (!offcpu_cpus) {
+		lttng_kvfree(offcpu_blocked_slots);
+		return -ENOMEM;
+	}
+	ret = lttng_duration_hooks_register(offcpu_hooks,
+			ARRAY_SIZE(offcpu_hooks));
+	if (ret)
+		lttng_offcpu_free();
+	return ret;
+}
+
+static
+void lttng_offcpu_unregister(void)
+{
+	lttng_duration_hooks_unregister(offcpu_hooks,
+			ARRAY_SIZE(offcpu_hooks));
+	lttng_offcpu_free();
+}
+
+static const struct lttng_duration_hook wakeup_latency_hooks[] = {
+	{ "sched_waking", (void *) lttng_wakeup_latency_waking },
+	{ "sched_wakeup_new", (void *) lttng_wakeup_latency_waking },
+	{ "sched_switch", (void *) lttng_wakeup_latency_switch },
+};
+
+static
+int lttng_wakeup_latency_register(void)
+{
+	int ret;
+
+	wakeup_latency_period = lttng_duration_clock(
+		(uint64_t) wakeup_latency_period_ms * NSEC_PER_MSEC);
+	wakeup_latency_threshold = lttng_duration_clock(
+		(uint64_t) wakeup_latency_threshold_us * NSEC_PER_USEC);
+	wakeup_latency_cpus = lttng_duration_cpus_alloc(
+			sizeof(struct lttng_wakeup_latency_cpu));
+	if (!wakeup_latency_cpus)
+		return -ENOMEM;
+	ret = lttng_duration_hooks_register(wakeup_latency_hooks,
+			ARRAY_SIZE(wakeup_latency_hooks));
+	if (ret)
+		lttng_duration_cpus_free(wakeup_latency_cpus);
+	return ret;
+}
+
+static
+void lttng_wakeup_latency_unregister(void)
+{
+	lttng_duration_hooks_unregister(wakeup_latency_hooks,
+			ARRAY_SIZE(wakeup_latency_hooks));
+	lttng_duration_cpus_free(wakeup_latency_cpus);
+}
+
+static
+int lttng_sched_hooks_register(void)
+{
+	int ret = 0;
+
+	if (offcpu) {
+		ret = lttng_offcpu_register();
+		if (ret)
+			return ret;
+	}
+	if (wakeup_latency) {
+		ret = lttng_wakeup_latency_register();
+		if (ret && offcpu)
+			lttng_offcpu_unregister();
+	}
+	return ret;
+}
+
+static
+void lttng_sched_hooks_unregister(void)
+{
+	if (wakeup_latency)
+		lttng_wakeup_latency_unregister();
+	if (offcpu)
+		lttng_offcpu_unregister();
+}
+
+LTTNG_DURATION_PROBE_MODULE(sched, offcpu || wakeup_latency,
+		lttng_sched_hooks_register, lttng_sched_hooks_unregister);
+#endif /* #if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,4,0)) */
+
 MODULE_LICENSE("GPL and additional rights");
 MODULE_AUTHOR("Mathieu Desnoyers <mathieu.desnoyers@efficios.com>");
 MODULE_DESCRIPTION("LTTng sched probes");
@@ -8,6 +8,10 @@
  */
 
 #include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/hash.h>
+#include <linux/slab.h>
+#include <linux/hardirq.h>
 #include <lttng-tracer.h>
 
 /*
@@ -19,6 +23,9 @@
 #include <trace/events/timer.h>
 
 #include <wrapper/tracepoint.h>
+#include <wrapper/trace-clock.h>
+#include <wrapper/vmalloc.h>
+#include <probes/lttng-duration.h>
 
 /*
  * Create LTTng tracepoint probes.
@@ -26,9 +33,240 @@
 #define LTTNG_PACKAGE_BUILD
 #define CREATE_TRACE_POINTS
 #define TRACE_INCLUDE_PATH instrumentation/events/lttng-module
+#define TP_MODULE_NOAUTOLOAD
+
+/*
+ * Duration mode: hooks on the expiry entry and exit tracepoints measure
+ * the duration of each timer and hrtimer callback. Callbacks lasting at
+ * least timer_duration_threshold_us are recorded as
+ * timer_callback_duration or timer_hrtimer_callback_duration events.
+ * The statistics of the durations are kept per cpu and per callback
+ * function over periods of timer_duration_period_ms, and recorded as
+ * one timer_callback_summary or timer_hrtimer_callback_summary event at
+ * the first end of a callback of this function following the end of the
+ * period on this cpu.
+ *
+ * Callbacks run on the cpu of their expiry, either from softirq context
+ * or, for hrtimers, from hard irq context, interrupting the former. The
+ * state of each callback is thus kept per cpu and per context level.
+ * Callbacks which do not find a slot within TIMER_DURATION_MAX_PROBE
+ * slots of the statistics of their cpu are not accounted in summaries.
+ */
+#define TIMER_DURATION_SLOTS_ORDER	7
+#define TIMER_DURATION_NR_SLOTS		(1U << TIMER_DURATION_SLOTS_ORDER)
+#define TIMER_DURATION_MAX_PROBE	8
+
+/* Softirq and hard irq contexts. */
+#define TIMER_DURATION_NR_LEVELS	2
+
+struct lttng_timer_duration_slot {
+	void *func;			/* NULL: free slot */
+	struct lttng_duration_period period;
+};
+
+struct lttng_timer_duration_state {
+	void *entry_func;		/* NULL: no callback running */
+	uint64_t entry;
+	/* Last callback end, func is NULL if it was not measured. */
+	void *func;
+	uint64_t duration;
+	const struct lttng_duration_stats *summary;
+};
+
+struct lttng_timer_duration_cpu {
+	struct lttng_timer_duration_state levels[TIMER_DURATION_NR_LEVELS];
+	struct lttng_timer_duration_slot slots[TIMER_DURATION_NR_SLOTS];
+};
+
+static int timer_duration;
+module_param(timer_duration, int, 0444);
+MODULE_PARM_DESC(timer_duration, "Measure timer callback durations for the callback duration and summary events (0: disabled, 1: enabled)");
+
+static unsigned int timer_duration_period_ms = 1000;
+module_param(timer_duration_period_ms, uint, 0444);
+MODULE_PARM_DESC(timer_duration_period_ms, "Period of the timer callback summary events, in milliseconds (0: no summary)");
+
+static unsigned int timer_duration_threshold_us;
+module_param(timer_duration_threshold_us, uint, 0444);
+MODULE_PARM_DESC(timer_duration_threshold_us, "Minimum duration of the timer callbacks recorded individually, in microseconds (0: all)");
+
+/* In trace clock units. */
+static uint64_t timer_duration_period, timer_duration_threshold;
+
+static void * __percpu *timer_duration_cpus;
+
+static
+struct lttng_timer_duration_state *lttng_timer_duration_state(void)
+{
+	struct lttng_timer_duration_cpu *cpu =
+		lttng_duration_this_cpu(timer_duration_cpus);
+
+	return &cpu->levels[in_irq() ? 1 : 0];
+}
+
+static
+struct lttng_timer_duration_slot *lttng_timer_duration_slot(
+		struct lttng_timer_duration_cpu *cpu, void *func)
+{
+	struct lttng_timer_duration_slot *slot;
+	unsigned int i, h;
+
+	h = hash_ptr(func, TIMER_DURATION_SLOTS_ORDER);
+	for (i = 0; i < TIMER_DURATION_MAX_PROBE; i++) {
+		slot = &cpu->slots[(h + i) & (TIMER_DURATION_NR_SLOTS - 1)];
+		if (slot->func == func)
+			return slot;
+		if (!slot->func) {
+			slot->func = func;
+			return slot;
+		}
+	}
+	return NULL;
+}
+
+static
+void lttng_timer_duration_start(void *func)
+{
+	struct lttng_timer_duration_state *state = lttng_timer_duration_state();
+
+	state->entry = trace_clock_read64();
+	state->entry_func = func;
+}
+
+static
+void lttng_timer_duration_end(void)
+{
+	struct lttng_timer_duration_cpu *cpu;
+	struct lttng_timer_duration_state *state;
+	struct lttng_timer_duration_slot *slot;
+	unsigned long flags;
+	uint64_t now;
+
+	cpu = lttng_duration_this_cpu(timer_duration_cpus);
+	state = &cpu->levels[in_irq() ? 1 : 0];
+	state->func = NULL;
+	state->summary = NULL;
+	if (!state->entry_func)
+		return;
+	now = trace_clock_read64();
+	state->func = state->entry_func;
+	state->duration = now - state->entry;
+	state->entry_func = NULL;
+	/* Hrtimer callbacks update the same statistics. */
+	local_irq_save(flags);
+	slot = lttng_timer_duration_slot(cpu, state->func);
+	if (slot && lttng_duration_period_add(&slot->period,
+			timer_duration_period, now, state->duration))
+		state->summary = &slot->period.last;
+	local_irq_restore(flags);
+}
+
+static
+void lttng_timer_duration_expire_entry(void *data, struct timer_list *timer)
+{
+	lttng_timer_duration_start((void *) timer->function);
+}
+
+/* The timer may be freed by its callback: it is not dereferenced. */
+static
+void lttng_timer_duration_expire_exit(void *data, struct timer_list *timer)
+{
+	lttng_timer_duration_end();
+}
+
+static
+void lttng_timer_duration_hrtimer_expire_entry(void *data,
+		struct hrtimer *hrtimer, ktime_t *now)
+{
+	lttng_timer_duration_start((void *) hrtimer->function);
+}
+
+static
+void lttng_timer_duration_hrtimer_expire_exit(void *data,
+		struct hrtimer *hrtimer)
+{
+	lttng_timer_duration_end();
+}
+
+/*
+ * Return false unless the callback which just ended lasted at least the
+ * threshold, in which case its function and duration are returned.
+ */
+static
+bool lttng_timer_callback_duration(void **func, uint64_t *duration)
+{
+	const struct lttng_timer_duration_state *state;
+
+	if (!timer_duration_cpus)
+		return false;
+	state = lttng_timer_duration_state();
+	if (!state->func || state->duration < timer_duration_threshold)
+		return false;
+	*func = state->func;
+	*duration = state->duration;
+	return true;
+}
+
+/*
+ * Return the statistics of the period ended by the callback which just
+ * ended, or NULL if it did not end a period.
+ */
+static
+const struct lttng_duration_stats *lttng_timer_callback_summary(void **func)
+{
+	const struct lttng_timer_duration_state *state;
+
+	if (!timer_duration_cpus)
+		return NULL;
+	state = lttng_timer_duration_state();
+	if (!state->func || !state->summary)
+		return NULL;
+	*func = state->func;
+	return state->summary;
+}
 
 #include <instrumentation/events/lttng-module/timer.h>
 
+static const struct lttng_duration_hook timer_duration_hooks[] = {
+	{ "timer_expire_entry", (void *) lttng_timer_duration_expire_entry },
+	{ "timer_expire_exit", (void *) lttng_timer_duration_expire_exit },
+	{ "hrtimer_expire_entry",
+		(void *) lttng_timer_duration_hrtimer_expire_entry },
+	{ "hrtimer_expire_exit",
+		(void *) lttng_timer_duration_hrtimer_expire_exit },
+};
+
+static
+int lttng_timer_duration_register(void)
+{
+	int ret;
+
+	timer_duration_period = lttng_duration_clock(
+		(uint64_t) timer_duration_period_ms * NSEC_PER_MSEC);
+	timer_duration_threshold = lttng_duration_clock(
+		(uint64_t) timer_duration_threshold_us * NSEC_PER_USEC);
+	timer_duration_cpus = lttng_duration_cpus_alloc(
+			sizeof(struct lttng_timer_duration_cpu));
+	if (!timer_duration_cpus)
+		return -ENOMEM;
+	ret = lttng_duration_hooks_register(timer_duration_hooks,
+			ARRAY_SIZE(timer_duration_hooks));
+	if (ret)
+		lttng_duration_cpus_free(timer_duration_cpus);
+	return ret;
+}
+
+static
+void lttng_timer_duration_unregister(void)
+{
+	lttng_duration_hooks_unregister(timer_duration_hooks,
+			ARRAY_SIZE(timer_duration_hooks));
+	lttng_duration_cpus_free(timer_duration_cpus);
+}
+
+LTTNG_DURATION_PROBE_MODULE(timer, timer_duration,
+		lttng_timer_duration_register, lttng_timer_duration_unregister);
+
 MODULE_LICENSE("GPL and additional rights");
 MODULE_AUTHOR("Mathieu Desnoyers <mathieu.desnoyers@efficios.com>");
 MODULE_DESCRIPTION("LTTng timer probes");
@@ -7,16 +7,32 @@
 
 #include <linux/uaccess.h>
 #include <linux/module.h>
+#include <asm/word-at-a-time.h>
 #include <probes/lttng-probe-user.h>
 
+static
+bool lttng_user_read_inatomic(void *dest, const char *addr, size_t len)
+{
+	if (unlikely(!access_ok(VERIFY_READ,
+			(__force const char __user *) addr, len)))
+		return false;
+	return !__copy_from_user_inatomic(dest,
+			(__force const char __user *) addr, len);
+}
+
 /*
  * Calculate string length. Include final null terminating character if there is
- * one, or ends at first fault. Disabling page faults ensures that we can safely
+ * one, or ends at first fault, or after max_len bytes. Disabling page faults ensures that we can safely
  * call this from pretty much any context, including those where the caller
  * holds mmap_sem, or any lock which nests in mmap_sem.
+ *
+ * The string is read a word at a time once aligned: an aligned word
+ * never crosses a page boundary, so a fault on a word ends the string
+ * where the byte-at-a-time loop would.
  */
-long lttng_strlen_user_inatomic(const char *addr)
+long lttng_strnlen_user_inatomic(const char *addr, long max_len)
 {
+	const struct word_at_a_time constants = WORD_AT_A_TIME_CONSTANTS;
 	long count = 0;
 	mm_segment_t old_fs;
 
@@ -26,26 +42,53 @@ long lttng_strlen_user_inatomic(const char *addr)
 	old_fs = get_fs();
 	set_fs(KERNEL_DS);
 	pagefault_disable();
-	for (;;) {
+	for (; count < max_len && !IS_ALIGNED((unsigned long) &addr[count],
+			sizeof(unsigned long)); count++) {
 		char v;
-		unsigned long ret;
 
-		if (unlikely(!access_ok(VERIFY_READ,
-				(__force const char __user *) addr,
+		if (unlikely(!lttng_user_read_inatomic(&v, &addr[count],
+				sizeof(v))))
+			goto end;
+		if (unlikely(!v)) {
+			count++;
+			goto end;
+		}
+	}
+	for (; max_len - count >= (long) sizeof(unsigned long);
+			count += sizeof(unsigned long)) {
+		unsigned long v, data;
+
+		if (unlikely(!lttng_user_read_inatomic(&v, &addr[count],
+				sizeof(v))))
+			goto end;
+		if (has_zero(v, &data, &constants)) {
+			data = prep_zero_mask(v, data, &constants);
+			data = create_zero_mask(data);
+			/* Include the null terminating character. */
+			count += find_zero(data) + 1;
+			goto end;
+		}
+	}
+	for (; count < max_len; count++) {
+		char v;
+
+		if (unlikely(!lttng_user_read_inatomic(&v, &addr[count],
 				sizeof(v))))
 			break;
-		ret = __copy_from_user_inatomic(&v,
-			(__force const char __user *)(addr),
-			sizeof(v));
-		if (unlikely(ret > 0))
-			break;
-		count++;
-		if (unlikely(!v))
+		if (unlikely(!v)) {
+			count++;
 			break;
-		addr++;
+		}
 	}
+end:
 	pagefault_enable();
 	set_fs(old_fs);
 	return count;
 }
+EXPORT_SYMBOL_GPL(lttng_strnlen_user_inatomic);
+
+long lttng_strlen_user_inatomic(const char *addr)
+{
+	return lttng_strnlen_user_inatomic(addr, LONG_MAX);
+}
 EXPORT_SYMBOL_GPL(lttng_strlen_user_inatomic);
@@ -14,4 +14,9 @@
  */
 long lttng_strlen_user_inatomic(const char *addr);
 
+/*
+ * Same as lttng_strlen_user_inatomic(), scanning at most max_len bytes.
+ */
+long lttng_strnlen_user_inatomic(const char *addr, long max_len);
+
 #endif /* _LTTNG_PROBE_USER_H */
@@ -9,6 +9,7 @@
  */
 
 #include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <lttng-tracer.h>
 
 /*
@@ -18,6 +19,8 @@
 #include <trace/events/vmscan.h>
 
 #include <lttng-kernel-version.h>
+#include <wrapper/tracepoint.h>
+#include <probes/lttng-mm-latency.h>
 
 /*
  * Create LTTng tracepoint probes.
@@ -25,9 +28,128 @@
 #define LTTNG_PACKAGE_BUILD
 #define CREATE_TRACE_POINTS
 #define TRACE_INCLUDE_PATH instrumentation/events/lttng-module
+#define TP_MODULE_NOAUTOLOAD
+
+/*
+ * Latency mode: hooks on mm_vmscan_direct_reclaim_begin and
+ * mm_vmscan_direct_reclaim_end measure the duration of each direct
+ * reclaim. Those lasting at least reclaim_latency_threshold_us are
+ * recorded as mm_vmscan_direct_reclaim_latency events. The statistics
+ * of the durations are kept per cpu, and per cgroup with
+ * reclaim_latency_per_cgroup=1, over periods of
+ * reclaim_latency_period_ms, and recorded as one
+ * mm_vmscan_direct_reclaim_summary event at the first end of a direct
+ * reclaim following the end of the period.
+ */
+static int reclaim_latency;
+module_param(reclaim_latency, int, 0444);
+MODULE_PARM_DESC(reclaim_latency, "Measure direct reclaim durations for the direct reclaim latency and summary events (0: disabled, 1: enabled)");
+
+static unsigned int reclaim_latency_period_ms = 1000;
+module_param(reclaim_latency_period_ms, uint, 0444);
+MODULE_PARM_DESC(reclaim_latency_period_ms, "Period of the direct reclaim summary events, in milliseconds (0: no summary)");
+
+static unsigned int reclaim_latency_threshold_us;
+module_param(reclaim_latency_threshold_us, uint, 0444);
+MODULE_PARM_DESC(reclaim_latency_threshold_us, "Minimum duration of the direct reclaims recorded individually, in microseconds (0: all)");
+
+static int reclaim_latency_per_cgroup;
+module_param(reclaim_latency_per_cgroup, int, 0444);
+MODULE_PARM_DESC(reclaim_latency_per_cgroup, "Keep the direct reclaim summaries per cgroup of the reclaiming task (0: per cpu only, 1: per cgroup)");
+
+static struct lttng_mm_latency reclaim_lat;
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,8,0))
+static
+void lttng_reclaim_latency_begin(void *data, int order, int may_writepage,
+		gfp_t gfp_flags, int classzone_idx)
+#else
+static
+void lttng_reclaim_latency_begin(void *data, int order, int may_writepage,
+		gfp_t gfp_flags)
+#endif
+{
+	struct lttng_mm_start start = {
+		.order = order,
+		.gfp_flags = gfp_flags,
+		.timestamp = trace_clock_read64(),
+	};
+
+	lttng_mm_start_set(&reclaim_lat, &start);
+}
+
+static
+void lttng_reclaim_latency_end(void *data, unsigned long nr_reclaimed)
+{
+	lttng_mm_latency_end(&reclaim_lat);
+}
+
+/*
+ * Return false unless the direct reclaim which just ended lasted at
+ * least the threshold, in which case its order, gfp flags and duration
+ * are returned.
+ */
+static
+bool lttng_vmscan_direct_reclaim_latency(int *order, gfp_t *gfp_flags,
+		uint64_t *duration)
+{
+	const struct lttng_mm_start *start;
+
+	if (!lttng_mm_latency_get(&reclaim_lat, &start, duration))
+		return false;
+	*order = start->order;
+	*gfp_flags = start->gfp_flags;
+	return true;
+}
+
+/*
+ * Return the statistics of the period ended by the direct reclaim which
+ * just ended, or NULL if it did not end a period.
+ */
+static
+const struct lttng_duration_stats *lttng_vmscan_direct_reclaim_summary(
+		uint64_t *cgroup_id)
+{
+	return lttng_mm_latency_summary(&reclaim_lat, cgroup_id);
+}
 
 #include <instrumentation/events/lttng-module/mm_vmscan.h>
 
+static const struct lttng_duration_hook reclaim_latency_hooks[] = {
+	{ "mm_vmscan_direct_reclaim_begin",
+		(void *) lttng_reclaim_latency_begin },
+	{ "mm_vmscan_direct_reclaim_end",
+		(void *) lttng_reclaim_latency_end },
+};
+
+static
+int lttng_reclaim_latency_register(void)
+{
+	int ret;
+
+	ret = lttng_mm_latency_alloc(&reclaim_lat, reclaim_latency_period_ms,
+			reclaim_latency_threshold_us, reclaim_latency_per_cgroup);
+	if (ret)
+		return ret;
+	ret = lttng_duration_hooks_register(reclaim_latency_hooks,
+			ARRAY_SIZE(reclaim_latency_hooks));
+	if (ret)
+		lttng_mm_latency_free(&reclaim_lat);
+	return ret;
+}
+
+static
+void lttng_reclaim_latency_unregister(void)
+{
+	lttng_duration_hooks_unregister(reclaim_latency_hooks,
+			ARRAY_SIZE(reclaim_latency_hooks));
+	lttng_mm_latency_free(&reclaim_lat);
+}
+
+LTTNG_DURATION_PROBE_MODULE(mm_vmscan, reclaim_latency,
+		lttng_reclaim_latency_register,
+		lttng_reclaim_latency_unregister);
+
 MODULE_LICENSE("GPL and additional rights");
 MODULE_AUTHOR("Wade Farnsworth <wade_farnsworth@mentor.com>");
 MODULE_AUTHOR("Paul Woegerer <paul_woegerer@mentor.com>");
@@ -9,7 +9,10 @@
  */
 
 #include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <linux/idr.h>
+#include <linux/hash.h>
+#include <linux/slab.h>
 #include <lttng-tracer.h>
 
 struct cpu_workqueue_struct;
@@ -22,6 +25,9 @@ struct pool_workqueue;
 #include <trace/events/workqueue.h>
 
 #include <wrapper/tracepoint.h>
+#include <wrapper/trace-clock.h>
+#include <wrapper/vmalloc.h>
+#include <probes/lttng-duration.h>
 
 /*
  * Create LTTng tracepoint probes.
@@ -29,9 +35,255 @@ struct pool_workqueue;
 #define LTTNG_PACKAGE_BUILD
 #define CREATE_TRACE_POINTS
 #define TRACE_INCLUDE_PATH instrumentation/events/lttng-module
+#define TP_MODULE_NOAUTOLOAD
+
+/*
+ * Duration mode: hooks on workqueue_execute_start and
+ * workqueue_execute_end measure the duration of each work callback.
+ * Callbacks lasting at least work_duration_threshold_us are recorded as
+ * workqueue_callback_duration events. The statistics of the durations
+ * are kept per cpu and per callback function over periods of
+ * work_duration_period_ms, and recorded as one
+ * workqueue_callback_summary event at the first end of a callback of
+ * this function following the end of the period on this cpu.
+ *
+ * Callbacks may sleep and migrate: their start is kept in a slot of a
+ * global table indexed by thread, as for system call latencies.
+ * Colliding workers make the table lossy: a callback whose start is not
+ * found is not measured. Neither are those which do not find a slot
+ * within WORK_DURATION_MAX_PROBE slots of the statistics of their cpu.
+ *
+ * Callbacks only end in task context, so the state left by the hooks
+ * on a cpu is not overwritten before the event probes of the same
+ * callback end read it.
+ */
+#define WORK_START_SLOTS_ORDER		10
+#define WORK_START_NR_SLOTS		(1U << WORK_START_SLOTS_ORDER)
+
+#define WORK_DURATION_SLOTS_ORDER	7
+#define WORK_DURATION_NR_SLOTS		(1U << WORK_DURATION_SLOTS_ORDER)
+#define WORK_DURATION_MAX_PROBE		8
+
+struct lttng_work_start_slot {
+	unsigned long seq;
+	pid_t tid;
+	struct work_struct *work;
+	work_func_t func;
+	uint64_t timestamp;	/* Start of the callback */
+};
+
+struct lttng_work_duration_slot {
+	work_func_t func;		/* NULL: free slot */
+	struct lttng_duration_period period;
+};
+
+struct lttng_work_duration_cpu {
+	/* Last callback end, func is NULL if it was not measured. */
+	work_func_t func;
+	uint64_t duration;
+	const struct lttng_duration_stats *summary;
+	struct lttng_work_duration_slot slots[WORK_DURATION_NR_SLOTS];
+};
+
+static int work_duration;
+module_param(work_duration, int, 0444);
+MODULE_PARM_DESC(work_duration, "Measure work callback durations for the callback duration and summary events (0: disabled, 1: enabled)");
+
+static unsigned int work_duration_period_ms = 1000;
+module_param(work_duration_period_ms, uint, 0444);
+MODULE_PARM_DESC(work_duration_period_ms, "Period of the work callback summary events, in milliseconds (0: no summary)");
+
+static unsigned int work_duration_threshold_us;
+module_param(work_duration_threshold_us, uint, 0444);
+MODULE_PARM_DESC(work_duration_threshold_us, "Minimum duration of the work callbacks recorded individually, in microseconds (0: all)");
+
+/* In trace clock units. */
+static uint64_t work_duration_period, work_duration_threshold;
+
+static struct lttng_work_start_slot work_start_slots[WORK_START_NR_SLOTS];
+static void * __percpu *work_duration_cpus;
+
+static
+struct lttng_work_start_slot *lttng_work_start_slot(void)
+{
+	return &work_start_slots[hash_32(current->pid, WORK_START_SLOTS_ORDER)];
+}
+
+static
+void lttng_work_duration_start(void *data, struct work_struct *work)
+{
+	struct lttng_work_start_slot *slot;
+	unsigned long seq;
+
+	slot = lttng_work_start_slot();
+	seq = READ_ONCE(slot->seq);
+	if ((seq & 1) || cmpxchg(&slot->seq, seq, seq + 1) != seq)
+		return;
+	slot->tid = current->pid;
+	slot->work = work;
+	slot->func = work->func;
+	slot->timestamp = trace_clock_read64();
+	smp_wmb();	/* Content before even seq. */
+	WRITE_ONCE(slot->seq, seq + 2);
+}
+
+/*
+ * Return NULL if the start of the callback is not found. Otherwise, free
+ * its slot and return the callback function, with the start of the
+ * callback in @timestamp. The work item may be freed by its callback:
+ * it is only compared.
+ */
+static
+work_func_t lttng_work_start_end(struct work_struct *work, uint64_t *timestamp)
+{
+	struct lttng_work_start_slot *slot;
+	struct work_struct *slot_work;
+	work_func_t func;
+	unsigned long seq;
+	pid_t tid;
+
+	slot = lttng_work_start_slot();
+	seq = READ_ONCE(slot->seq);
+	if (seq & 1)
+		return NULL;
+	smp_rmb();	/* Even seq before content. */
+	tid = slot->tid;
+	slot_work = slot->work;
+	func = slot->func;
+	*timestamp = slot->timestamp;
+	smp_rmb();	/* Content before seq validation. */
+	if (READ_ONCE(slot->seq) != seq || tid != current->pid
+			|| slot_work != work)
+		return NULL;
+	/* Free the slot, unless it has been reused meanwhile. */
+	if (cmpxchg(&slot->seq, seq, seq + 1) == seq) {
+		slot->work = NULL;
+		smp_wmb();	/* Content before even seq. */
+		WRITE_ONCE(slot->seq, seq + 2);
+	}
+	return func;
+}
+
+static
+struct lttng_work_duration_slot *lttng_work_duration_slot(
+		struct lttng_work_duration_cpu *cpu, work_func_t func)
+{
+	struct lttng_work_duration_slot *slot;
+	unsigned int i, h;
+
+	h = hash_ptr(func, WORK_DURATION_SLOTS_ORDER);
+	for (i = 0; i < WORK_DURATION_MAX_PROBE; i++) {
+		slot = &cpu->slots[(h + i) & (WORK_DURATION_NR_SLOTS - 1)];
+		if (slot->func == func)
+			return slot;
+		if (!slot->func) {
+			slot->func = func;
+			return slot;
+		}
+	}
+	return NULL;
+}
+
+static
+void lttng_work_duration_end(void *data, struct work_struct *work)
+{
+	struct lttng_work_duration_cpu *cpu;
+	struct lttng_work_duration_slot *slot;
+	uint64_t start, now;
+	work_func_t func;
+
+	cpu = lttng_duration_this_cpu(work_duration_cpus);
+	cpu->func = NULL;
+	cpu->summary = NULL;
+	func = lttng_work_start_end(work, &start);
+	if (!func)
+		return;
+	now = trace_clock_read64();
+	cpu->func = func;
+	cpu->duration = now - start;
+	slot = lttng_work_duration_slot(cpu, func);
+	if (slot && lttng_duration_period_add(&slot->period,
+			work_duration_period, now, cpu->duration))
+		cpu->summary = &slot->period.last;
+}
+
+static
+const struct lttng_work_duration_cpu *lttng_work_duration_cpu(void)
+{
+	if (!work_duration_cpus)
+		return NULL;
+	return lttng_duration_this_cpu(work_duration_cpus);
+}
+
+/*
+ * Return false unless the callback which just ended lasted at least the
+ * threshold, in which case its function and duration are returned.
+ */
+static
+bool lttng_workqueue_callback_duration(void **func, uint64_t *duration)
+{
+	const struct lttng_work_duration_cpu *cpu = lttng_work_duration_cpu();
+
+	if (!cpu || !cpu->func || cpu->duration < work_duration_threshold)
+		return false;
+	*func = (void *) cpu->func;
+	*duration = cpu->duration;
+	return true;
+}
+
+/*
+ * Return the statistics of the period ended by the callback which just
+ * ended, or NULL if it did not end a period.
+ */
+static
+const struct lttng_duration_stats *lttng_workqueue_callback_summary(void **func)
+{
+	const struct lttng_work_duration_cpu *cpu = lttng_work_duration_cpu();
+
+	if (!cpu || !cpu->func || !cpu->summary)
+		return NULL;
+	*func = (void *) cpu->func;
+	return cpu->summary;
+}
 
 #include <instrumentation/events/lttng-module/workqueue.h>
 
+static const struct lttng_duration_hook work_duration_hooks[] = {
+	{ "workqueue_execute_start", (void *) lttng_work_duration_start },
+	{ "workqueue_execute_end", (void *) lttng_work_duration_end },
+};
+
+static
+int lttng_work_duration_register(void)
+{
+	int ret;
+
+	work_duration_period = lttng_duration_clock(
+		(uint64_t) work_duration_period_ms * NSEC_PER_MSEC);
+	work_duration_threshold = lttng_duration_clock(
+		(uint64_t) work_duration_threshold_us * NSEC_PER_USEC);
+	work_duration_cpus = lttng_duration_cpus_alloc(
+			sizeof(struct lttng_work_duration_cpu));
+	if (!work_duration_cpus)
+		return -ENOMEM;
+	ret = lttng_duration_hooks_register(work_duration_hooks,
+			ARRAY_SIZE(work_duration_hooks));
+	if (ret)
+		lttng_duration_cpus_free(work_duration_cpus);
+	return ret;
+}
+
+static
+void lttng_work_duration_unregister(void)
+{
+	lttng_duration_hooks_unregister(work_duration_hooks,
+			ARRAY_SIZE(work_duration_hooks));
+	lttng_duration_cpus_free(work_duration_cpus);
+}
+
+LTTNG_DURATION_PROBE_MODULE(workqueue, work_duration,
+		lttng_work_duration_register, lttng_work_duration_unregister);
+
 MODULE_LICENSE("GPL and additional rights");
 MODULE_AUTHOR("Andrew Gabbasov <andrew_gabbasov@mentor.com>");
 MODULE_DESCRIPTION("LTTng workqueue probes");
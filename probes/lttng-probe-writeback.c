@@ -9,8 +9,14 @@
  */
 
 #include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <linux/device.h>
 #include <linux/mm.h>
+#include <linux/hash.h>
+#include <linux/percpu.h>
+#include <linux/spinlock.h>
+#include <linux/jiffies.h>
+#include <linux/cgroup.h>
 #include <lttng-tracer.h>
 
 /*
@@ -21,6 +27,9 @@
 
 #include <lttng-kernel-version.h>
 #include <wrapper/writeback.h>
+#include <wrapper/tracepoint.h>
+#include <wrapper/vmalloc.h>
+#include <probes/lttng-duration.h>
 
 /* #if <check version number if global_dirty_limit will be exported> */
 
@@ -34,9 +43,340 @@
 #define LTTNG_PACKAGE_BUILD
 #define CREATE_TRACE_POINTS
 #define TRACE_INCLUDE_PATH instrumentation/events/lttng-module
+#define TP_MODULE_NOAUTOLOAD
+
+/*
+ * Summary mode: hooks on the writeback tracepoints accumulate, per
+ * writeback domain, i.e. per backing device and, with
+ * writeback_summary_per_cgroup=1 and cgroup writeback, per memory
+ * cgroup owning the inodes:
+ *
+ * - the pages dirtied (writeback_dirty_page),
+ * - the pages written (writeback_single_inode),
+ * - the time the inodes written waited dirty before their writeback
+ *   started (writeback_single_inode_start),
+ * - the time tasks were throttled while dirtying pages
+ *   (balance_dirty_pages).
+ *
+ * The totals of each period of writeback_summary_period_ms are recorded
+ * as one writeback_bdi_summary event, at the first writeback of an inode
+ * of the domain following the end of the period: dirty pages of a
+ * domain are always written back eventually.
+ *
+ * Domains are kept in a global table indexed by their bdi_writeback,
+ * with counters per cpu. Domains which do not find a slot within
+ * WB_SUMMARY_MAX_PROBE slots are not accounted, and a bdi_writeback
+ * reused after being freed keeps the slot of its previous domain.
+ */
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,3,0))
+#define LTTNG_WRITEBACK_SUMMARY
+#endif
+
+static int writeback_summary;
+module_param(writeback_summary, int, 0444);
+MODULE_PARM_DESC(writeback_summary, "Accumulate the writeback activity of each backing device for the summary events (0: disabled, 1: enabled)");
+
+static unsigned int writeback_summary_period_ms = 1000;
+module_param(writeback_summary_period_ms, uint, 0444);
+MODULE_PARM_DESC(writeback_summary_period_ms, "Period of the writeback summary events, in milliseconds");
+
+static int writeback_summary_per_cgroup;
+module_param(writeback_summary_per_cgroup, int, 0444);
+MODULE_PARM_DESC(writeback_summary_per_cgroup, "Keep the writeback summaries per memory cgroup of the inodes (0: per backing device only, 1: per cgroup)");
+
+#ifdef LTTNG_WRITEBACK_SUMMARY
+
+#define WB_SUMMARY_SLOTS_ORDER		7
+#define WB_SUMMARY_NR_SLOTS		(1U << WB_SUMMARY_SLOTS_ORDER)
+#define WB_SUMMARY_MAX_PROBE		8
+
+enum lttng_wb_counter {
+	LTTNG_WB_DIRTIED,
+	LTTNG_WB_WRITTEN,
+	LTTNG_WB_WAIT_NS,
+	LTTNG_WB_THROTTLE_NS,
+	NR_LTTNG_WB_COUNTERS,
+};
+
+struct lttng_wb_summary {
+	bool valid;
+	struct inode *inode;		/* Inode of the tracepoint */
+	char bdi[32];
+	uint64_t cgroup_id;
+	uint64_t counters[NR_LTTNG_WB_COUNTERS];
+};
+
+struct lttng_wb_slot {
+	struct bdi_writeback *wb;	/* NULL: free slot */
+	bool ready;			/* Domain description set */
+	char bdi[32];
+	uint64_t cgroup_id;
+	spinlock_t lock;		/* Period end */
+	unsigned long period_end;	/* In jiffies */
+	uint64_t last[NR_LTTNG_WB_COUNTERS];	/* Totals at period start */
+};
+
+struct lttng_wb_cpu {
+	uint64_t counters[WB_SUMMARY_NR_SLOTS][NR_LTTNG_WB_COUNTERS];
+	/* Last inode writeback traced on this cpu. */
+	struct lttng_wb_summary summary;
+};
+
+static struct lttng_wb_slot *wb_summary_slots;
+static struct lttng_wb_cpu __percpu *wb_summary_cpus;
+static unsigned long wb_summary_period;	/* In jiffies */
+
+/*
+ * Return the statistics of the period ended by the writeback of @inode,
+ * or NULL if it did not end a period.
+ */
+static
+const struct lttng_wb_summary *lttng_writeback_bdi_summary(struct inode *inode)
+{
+	const struct lttng_wb_summary *summary;
+
+	if (!wb_summary_cpus)
+		return NULL;
+	summary = this_cpu_ptr(&wb_summary_cpus->summary);
+	if (!summary->valid || summary->inode != inode)
+		return NULL;
+	return summary;
+}
+
+#endif /* LTTNG_WRITEBACK_SUMMARY */
 
 #include <instrumentation/events/lttng-module/writeback.h>
 
+#ifdef LTTNG_WRITEBACK_SUMMARY
+
+static
+struct bdi_writeback *lttng_wb_summary_domain(struct inode *inode)
+{
+#ifdef CONFIG_CGROUP_WRITEBACK
+	struct bdi_writeback *wb;
+
+	if (writeback_summary_per_cgroup) {
+		wb = READ_ONCE(inode->i_wb);
+		if (wb)
+			return wb;
+	}
+#endif
+	return &lttng_inode_to_bdi(inode)->wb;
+}
+
+static
+uint64_t lttng_wb_summary_cgroup_id(struct bdi_writeback *wb)
+{
+#if defined(CONFIG_CGROUP_WRITEBACK) && \
+	(LINUX_VERSION_CODE >= KERNEL_VERSION(4,18,0))
+	if (wb->memcg_css)
+		return cgroup_id(wb->memcg_css->cgroup);
+#endif
+	return 0;
+}
+
+/* Return the index of the slot of a domain, or -1 if none is free. */
+static
+int lttng_wb_summary_slot(struct bdi_writeback *wb)
+{
+	struct lttng_wb_slot *slot;
+	struct bdi_writeback *old;
+	unsigned int i, h, idx;
+
+	h = hash_ptr(wb, WB_SUMMARY_SLOTS_ORDER);
+	for (i = 0; i < WB_SUMMARY_MAX_PROBE; i++) {
+		idx = (h + i) & (WB_SUMMARY_NR_SLOTS - 1);
+		slot = &wb_summary_slots[idx];
+		old = READ_ONCE(slot->wb);
+		if (old == wb)
+			return idx;
+		if (old)
+			continue;
+		old = cmpxchg(&slot->wb, NULL, wb);
+		if (old && old != wb)
+			continue;
+		if (!old) {
+			strlcpy(slot->bdi, wb->bdi->dev ?
+				dev_name(wb->bdi->dev) : "(unknown)",
+				sizeof(slot->bdi));
+			slot->cgroup_id = lttng_wb_summary_cgroup_id(wb);
+			slot->period_end = jiffies + wb_summary_period;
+			smp_store_release(&slot->ready, true);
+		}
+		return idx;
+	}
+	return -1;
+}
+
+static
+void lttng_wb_summary_add(struct bdi_writeback *wb,
+		enum lttng_wb_counter counter, uint64_t value)
+{
+	int idx = lttng_wb_summary_slot(wb);
+
+	if (idx < 0)
+		return;
+	this_cpu_add(wb_summary_cpus->counters[idx][counter], value);
+}
+
+/* Account the pages written, and end the period of the domain. */
+static
+void lttng_wb_summary_end(struct inode *inode, long written)
+{
+	struct lttng_wb_summary *summary;
+	struct lttng_wb_slot *slot;
+	uint64_t total;
+	int idx, cpu, i;
+
+	summary = this_cpu_ptr(&wb_summary_cpus->summary);
+	summary->valid = false;
+	idx = lttng_wb_summary_slot(lttng_wb_summary_domain(inode));
+	if (idx < 0)
+		return;
+	if (written > 0)
+		this_cpu_add(wb_summary_cpus->counters[idx][LTTNG_WB_WRITTEN],
+			written);
+	slot = &wb_summary_slots[idx];
+	if (!smp_load_acquire(&slot->ready)
+			|| time_before(jiffies, READ_ONCE(slot->period_end))
+			|| !spin_trylock(&slot->lock))
+		return;
+	if (time_before(jiffies, slot->period_end))
+		goto end;
+	for (i = 0; i < NR_LTTNG_WB_COUNTERS; i++) {
+		total = 0;
+		for_each_possible_cpu(cpu)
+			total += per_cpu_ptr(wb_summary_cpus, cpu)->counters[idx][i];
+		summary->counters[i] = total - slot->last[i];
+		slot->last[i] = total;
+	}
+	WRITE_ONCE(slot->period_end, jiffies + wb_summary_period);
+	memcpy(summary->bdi, slot->bdi, sizeof(summary->bdi));
+	summary->cgroup_id = slot->cgroup_id;
+	summary->inode = inode;
+	summary->valid = true;
+end:
+	spin_unlock(&slot->lock);
+}
+
+static
+void lttng_wb_summary_dirty_page(void *data, struct page *page,
+		struct address_space *mapping)
+{
+	if (!mapping || !mapping->host)
+		return;
+	lttng_wb_summary_add(lttng_wb_summary_domain(mapping->host),
+		LTTNG_WB_DIRTIED, 1);
+}
+
+static
+void lttng_wb_summary_inode_start(void *data, struct inode *inode,
+		struct writeback_control *wbc, unsigned long nr_to_write)
+{
+	if (!(inode->i_state & I_DIRTY))
+		return;
+	lttng_wb_summary_add(lttng_wb_summary_domain(inode), LTTNG_WB_WAIT_NS,
+		jiffies_to_nsecs(jiffies - inode->dirtied_when));
+}
+
+static
+void lttng_wb_summary_inode(void *data, struct inode *inode,
+		struct writeback_control *wbc, unsigned long nr_to_write)
+{
+	lttng_wb_summary_end(inode, nr_to_write - wbc->nr_to_write);
+}
+
+static
+void lttng_wb_summary_balance(void *data, struct bdi_writeback *wb,
+		unsigned long thresh, unsigned long bg_thresh,
+		unsigned long dirty, unsigned long bdi_thresh,
+		unsigned long bdi_dirty, unsigned long dirty_ratelimit,
+		unsigned long task_ratelimit, unsigned long dirtied,
+		unsigned long period, long pause, unsigned long start_time)
+{
+	if (pause <= 0)
+		return;
+	if (!writeback_summary_per_cgroup)
+		wb = &wb->bdi->wb;
+	lttng_wb_summary_add(wb, LTTNG_WB_THROTTLE_NS, jiffies_to_nsecs(pause));
+}
+
+static
+void lttng_wb_summary_free(void)
+{
+	free_percpu(wb_summary_cpus);
+	wb_summary_cpus = NULL;
+	lttng_kvfree(wb_summary_slots);
+	wb_summary_slots = NULL;
+}
+
+static
+int lttng_wb_summary_alloc(void)
+{
+	unsigned int i;
+
+	wb_summary_period = msecs_to_jiffies(writeback_summary_period_ms);
+	wb_summary_slots = lttng_kvzalloc(WB_SUMMARY_NR_SLOTS
+			* sizeof(*wb_summary_slots), GFP_KERNEL);
+	wb_summary_cpus = alloc_percpu(struct lttng_wb_cpu);
+	if (!wb_summary_slots || !wb_summary_cpus) {
+		lttng_wb_summary_free();
+		return -ENOMEM;
+	}
+	for (i = 0; i < WB_SUMMARY_NR_SLOTS; i++)
+		spin_lock_init(&wb_summary_slots[i].lock);
+	return 0;
+}
+
+static const struct lttng_duration_hook lttng_wb_summary_hooks[] = {
+	{ "writeback_dirty_page", (void *) lttng_wb_summary_dirty_page },
+	{ "writeback_single_inode_start", (void *) lttng_wb_summary_inode_start },
+	{ "writeback_single_inode", (void *) lttng_wb_summary_inode },
+	{ "balance_dirty_pages", (void *) lttng_wb_summary_balance },
+};
+
+static
+int lttng_writeback_summary_register(void)
+{
+	int ret;
+
+	ret = lttng_wb_summary_alloc();
+	if (ret)
+		return ret;
+	ret = lttng_duration_hooks_register(lttng_wb_summary_hooks,
+			ARRAY_SIZE(lttng_wb_summary_hooks));
+	if (ret)
+		lttng_wb_summary_free();
+	return ret;
+}
+
+static
+void lttng_writeback_summary_unregister(void)
+{
+	lttng_duration_hooks_unregister(lttng_wb_summary_hooks,
+			ARRAY_SIZE(lttng_wb_summary_hooks));
+	lttng_wb_summary_free();
+}
+
+#else /* LTTNG_WRITEBACK_SUMMARY */
+
+static
+int lttng_writeback_summary_register(void)
+{
+	return -ENOSYS;
+}
+
+static
+void lttng_writeback_summary_unregister(void)
+{
+}
+
+#endif /* LTTNG_WRITEBACK_SUMMARY */
+
+LTTNG_DURATION_PROBE_MODULE(writeback, writeback_summary,
+		lttng_writeback_summary_register,
+		lttng_writeback_summary_unregister);
+
 MODULE_LICENSE("GPL and additional rights");
 MODULE_AUTHOR("Andrew Gabbasov <andrew_gabbasov@mentor.com>");
 MODULE_DESCRIPTION("LTTng writeback probes");
@@ -0,0 +1,266 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * probes/lttng-sampler.c
+ *
+ * LTTng periodic cpu sampling probes, using per-cpu hrtimers.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+/*
+ * Each event arms one pinned hrtimer per online cpu, expiring at the
+ * configured frequency. Each expiry records a sample of the interrupted
+ * context: its instruction pointer, and the pid and tid of the current
+ * task, 0 when the cpu is idle. Stack ids are recorded by adding the
+ * callstack_kernel_id or callstack_user_id context to the channel,
+ * which deduplicates the sampled stacks as for any other event.
+ *
+ * The timers run while the event is registered, samples being recorded
+ * only while it is armed. Cpus brought online after the registration
+ * are not sampled. The timer of a cpu taken offline is migrated by the
+ * hrtimer core: it then expires once on another cpu, where it is not
+ * re-armed, so that no cpu is sampled twice.
+ */
+
+#include <linux/module.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/cpu.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <asm/irq_regs.h>
+#include <asm/ptrace.h>
+#include <lttng-events.h>
+#include <wrapper/ringbuffer/frontend_types.h>
+#include <wrapper/vmalloc.h>
+#include <lttng-tracer.h>
+#include <lttng-kernel-version.h>
+
+/* At most one sample every 100us on each cpu. */
+#define LTTNG_SAMPLER_MAX_FREQUENCY	10000
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5,4,0))
+/* Expire in hard interrupt context, even on PREEMPT_RT. */
+#define LTTNG_SAMPLER_HRTIMER_MODE	HRTIMER_MODE_REL_PINNED_HARD
+#else
+#define LTTNG_SAMPLER_HRTIMER_MODE	HRTIMER_MODE_REL_PINNED
+#endif
+
+struct lttng_sampler_cpu {
+	struct hrtimer timer;
+	struct lttng_sampler *sampler;
+	int cpu;
+};
+
+struct lttng_sampler {
+	struct lttng_event *event;
+	ktime_t period;
+	struct lttng_sampler_cpu __percpu *cpus;
+};
+
+static
+void lttng_sampler_record(struct lttng_event *event, struct pt_regs *regs)
+{
+	struct lttng_probe_ctx lttng_probe_ctx = {
+		.event = event,
+		.interruptible = 0,
+	};
+	struct lttng_channel *chan = event->chan;
+	struct lib_ring_buffer_ctx ctx;
+	struct {
+		unsigned long ip;
+		int pid;
+		int tid;
+	} payload;
+	int ret;
+
+	if (unlikely(!(READ_ONCE(event->armed) & LTTNG_EVENT_ARMED)))
+		return;
+
+	lib_ring_buffer_ctx_init(&ctx, chan->chan, &lttng_probe_ctx,
+				 sizeof(payload), lttng_alignof(payload), -1);
+	ret = chan->ops->event_reserve(&ctx, event->id);
+	if (ret < 0)
+		return;
+	payload.ip = regs ? instruction_pointer(regs) : 0;
+	payload.pid = task_tgid_nr(current);
+	payload.tid = task_pid_nr(current);
+	lib_ring_buffer_align_ctx(&ctx, lttng_alignof(payload));
+	chan->ops->event_write(&ctx, &payload, sizeof(payload));
+	chan->ops->event_commit(&ctx);
+}
+
+static
+enum hrtimer_restart lttng_sampler_timer(struct hrtimer *timer)
+{
+	struct lttng_sampler_cpu *sampler_cpu =
+		container_of(timer, struct lttng_sampler_cpu, timer);
+	struct lttng_sampler *sampler = sampler_cpu->sampler;
+
+	/* Migrated from an offline cpu: its cpu is not sampled anymore. */
+	if (sampler_cpu->cpu != smp_processor_id())
+		return HRTIMER_NORESTART;
+	lttng_sampler_record(sampler->event, get_irq_regs());
+	hrtimer_forward_now(timer, sampler->period);
+	return HRTIMER_RESTART;
+}
+
+/* Called on each cpu, since the timers are pinned. */
+static
+void lttng_sampler_start_cpu(void *info)
+{
+	struct lttng_sampler *sampler = info;
+	struct lttng_sampler_cpu *sampler_cpu = this_cpu_ptr(sampler->cpus);
+
+	hrtimer_start(&sampler_cpu->timer, sampler->period,
+		LTTNG_SAMPLER_HRTIMER_MODE);
+}
+
+static
+void lttng_sampler_init_field(struct lttng_event_field *field,
+		const char *name, size_t size, size_t alignment,
+		bool signedness, unsigned int base)
+{
+	field->name = name;
+	field->type.atype = atype_integer;
+	field->type.u.basic.integer.size = size * CHAR_BIT;
+	field->type.u.basic.integer.alignment = alignment * CHAR_BIT;
+	field->type.u.basic.integer.signedness = signedness;
+	field->type.u.basic.integer.reverse_byte_order = 0;
+	field->type.u.basic.integer.base = base;
+	field->type.u.basic.integer.encoding = lttng_encode_none;
+}
+
+/*
+ * Create event description
+ */
+static
+int lttng_create_sampler_event(const char *name, struct lttng_event *event)
+{
+	struct lttng_event_field *fields;
+	struct lttng_event_desc *desc;
+	int ret;
+
+	desc = kzalloc(sizeof(*event->desc), GFP_KERNEL);
+	if (!desc)
+		return -ENOMEM;
+	desc->name = kstrdup(name, GFP_KERNEL);
+	if (!desc->name) {
+		ret = -ENOMEM;
+		goto error_str;
+	}
+	desc->nr_fields = 3;
+	desc->fields = fields =
+		kzalloc(3 * sizeof(struct lttng_event_field), GFP_KERNEL);
+	if (!desc->fields) {
+		ret = -ENOMEM;
+		goto error_fields;
+	}
+	lttng_sampler_init_field(&fields[0], "ip", sizeof(unsigned long),
+		lttng_alignof(unsigned long),
+		lttng_is_signed_type(unsigned long), 16);
+	lttng_sampler_init_field(&fields[1], "pid", sizeof(int),
+		lttng_alignof(int), lttng_is_signed_type(int), 10);
+	lttng_sampler_init_field(&fields[2], "tid", sizeof(int),
+		lttng_alignof(int), lttng_is_signed_type(int), 10);
+
+	desc->owner = THIS_MODULE;
+	event->desc = desc;
+
+	return 0;
+
+error_fields:
+	kfree(desc->name);
+error_str:
+	kfree(desc);
+	return ret;
+}
+
+int lttng_sampler_register(const char *name,
+			   uint64_t frequency,
+			   struct lttng_event *event)
+{
+	struct lttng_sampler *sampler;
+	int ret, cpu;
+
+	if (!frequency || frequency > LTTNG_SAMPLER_MAX_FREQUENCY)
+		return -EINVAL;
+	ret = lttng_create_sampler_event(name, event);
+	if (ret)
+		goto error;
+
+	sampler = kzalloc(sizeof(*sampler), GFP_KERNEL);
+	if (!sampler) {
+		ret = -ENOMEM;
+		goto sampler_error;
+	}
+	sampler->cpus = alloc_percpu(struct lttng_sampler_cpu);
+	if (!sampler->cpus) {
+		ret = -ENOMEM;
+		goto percpu_error;
+	}
+	sampler->event = event;
+	sampler->period = ns_to_ktime(div64_u64(NSEC_PER_SEC, frequency));
+	for_each_possible_cpu(cpu) {
+		struct lttng_sampler_cpu *sampler_cpu =
+			per_cpu_ptr(sampler->cpus, cpu);
+
+		hrtimer_init(&sampler_cpu->timer, CLOCK_MONOTONIC,
+			LTTNG_SAMPLER_HRTIMER_MODE);
+		sampler_cpu->timer.function = lttng_sampler_timer;
+		sampler_cpu->sampler = sampler;
+		sampler_cpu->cpu = cpu;
+	}
+	event->u.sampler.lttng_sampler = sampler;
+
+	/* Ensure the memory we just allocated don't trigger page faults */
+	wrapper_vmalloc_sync_all();
+
+	get_online_cpus();
+	on_each_cpu(lttng_sampler_start_cpu, sampler, 1);
+	put_online_cpus();
+	return 0;
+
+percpu_error:
+	kfree(sampler);
+sampler_error:
+	kfree(event->desc->fields);
+	kfree(event->desc->name);
+	kfree(event->desc);
+error:
+	return ret;
+}
+EXPORT_SYMBOL_GPL(lttng_sampler_register);
+
+void lttng_sampler_unregister(struct lttng_event *event)
+{
+	struct lttng_sampler *sampler = event->u.sampler.lttng_sampler;
+	int cpu;
+
+	/* Waits for the callbacks in progress. */
+	for_each_possible_cpu(cpu)
+		hrtimer_cancel(&per_cpu_ptr(sampler->cpus, cpu)->timer);
+}
+EXPORT_SYMBOL_GPL(lttng_sampler_unregister);
+
+void lttng_sampler_destroy_private(struct lttng_event *event)
+{
+	struct lttng_sampler *sampler = event->u.sampler.lttng_sampler;
+
+	free_percpu(sampler->cpus);
+	kfree(sampler);
+	kfree(event->desc->fields);
+	kfree(event->desc->name);
+	kfree(event->desc);
+}
+EXPORT_SYMBOL_GPL(lttng_sampler_destroy_private);
+
+MODULE_LICENSE("GPL and additional rights");
+MODULE_AUTHOR("agent <agent@local>");
+MODULE_DESCRIPTION("LTTng cpu sampling probes");
+MODULE_VERSION(__stringify(LTTNG_MODULES_MAJOR_VERSION) "."
+	__stringify(LTTNG_MODULES_MINOR_VERSION) "."
+	__stringify(LTTNG_MODULES_PATCHLEVEL_VERSION)
+	LTTNG_MODULES_EXTRAVERSION);
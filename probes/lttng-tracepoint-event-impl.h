@@ -364,6 +364,10 @@ void __event_template_proto___##_name(void);
 	  .user = _user,					\
 	},
 
+#undef _ctf_string_bounded
+#define _ctf_string_bounded(_item, _src, _max_len, _user, _nowrite) \
+	_ctf_string(_item, _src, _user, _nowrite)
+
 #undef _ctf_enum
 #define _ctf_enum(_name, _type, _item, _src, _user, _nowrite)	\
 	{							\
@@ -425,6 +429,98 @@ void __event_template_proto___##_name(void);
 
 #include TRACE_INCLUDE(TRACE_INCLUDE_FILE)
 
+/*
+ * Stage 2.1 of the trace events.
+ *
+ * Flag the event classes serialized in a single pass: those with bounded
+ * strings.
+ */
+
+/* Reset all macros within TRACEPOINT_EVENT */
+#include <probes/lttng-events-reset.h>
+#include <probes/lttng-events-write.h>
+#include <probes/lttng-events-nowrite.h>
+
+#undef _ctf_string_bounded
+#define _ctf_string_bounded(_item, _src, _max_len, _user, _nowrite)	+ 1
+
+#undef TP_FIELDS
+#define TP_FIELDS(...)	__VA_ARGS__
+
+#undef LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS
+#define LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS(_name, _locvar, _code_pre, _fields, _code_post) \
+	enum { __event_single_pass___##_name = !!(0 _fields) };
+
+#undef LTTNG_TRACEPOINT_EVENT_CLASS_CODE
+#define LTTNG_TRACEPOINT_EVENT_CLASS_CODE(_name, _proto, _args, _locvar, _code_pre, _fields, _code_post) \
+	LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS(_name, _locvar, _code_pre, PARAMS(_fields), _code_post)
+
+#include TRACE_INCLUDE(TRACE_INCLUDE_FILE)
+
+/*
+ * Stage 2.2 of the trace events.
+ *
+ * Flag the event classes with a fixed layout: those only made of kernel
+ * integers and enumerations. Each field ors 1 if it has a fixed size,
+ * and 2 otherwise.
+ */
+
+/* Reset all macros within TRACEPOINT_EVENT */
+#include <probes/lttng-events-reset.h>
+#include <probes/lttng-events-write.h>
+
+#undef _ctf_integer_ext
+#define _ctf_integer_ext(_type, _item, _src, _byte_order, _base, _user, _nowrite) \
+	| ((_user) ? 2 : 1)
+
+#undef _ctf_array_encoded
+#define _ctf_array_encoded(_type, _item, _src, _length, _encoding, _byte_order, _base, _user, _nowrite) \
+	| 2
+
+#undef _ctf_array_bitfield
+#define _ctf_array_bitfield(_type, _item, _src, _length, _user, _nowrite) \
+	| 2
+
+#undef _ctf_sequence_encoded
+#define _ctf_sequence_encoded(_type, _item, _src, _length_type,		\
+			_src_length, _encoding, _byte_order, _base, _user, _nowrite) \
+	| 2
+
+#undef _ctf_sequence_bitfield
+#define _ctf_sequence_bitfield(_type, _item, _src,		\
+			_length_type, _src_length,		\
+			_user, _nowrite)			\
+	| 2
+
+#undef _ctf_string
+#define _ctf_string(_item, _src, _user, _nowrite)	| 2
+
+#undef _ctf_string_bounded
+#define _ctf_string_bounded(_item, _src, _max_len, _user, _nowrite)	| 2
+
+#undef _ctf_enum
+#define _ctf_enum(_name, _type, _item, _src, _user, _nowrite)		\
+	_ctf_integer_ext(_type, _item, _src, __BYTE_ORDER, 10, _user, _nowrite)
+
+#undef ctf_align
+#define ctf_align(_type)	| 2
+
+#undef ctf_custom_field
+#define ctf_custom_field(_type, _item, _code)	| 2
+
+#undef TP_FIELDS
+#define TP_FIELDS(...)	__VA_ARGS__
+
+#undef LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS
+#define LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS(_name, _locvar, _code_pre, _fields, _code_post) \
+	enum { __event_fixed_layout___##_name = ((0 _fields) == 1) };
+
+#undef LTTNG_TRACEPOINT_EVENT_CLASS_CODE
+#define LTTNG_TRACEPOINT_EVENT_CLASS_CODE(_name, _proto, _args, _locvar, _code_pre, _fields, _code_post) \
+	LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS(_name, _locvar, _code_pre, PARAMS(_fields), _code_post)
+
+#include TRACE_INCLUDE(TRACE_INCLUDE_FILE)
+
 /*
  * Stage 3 of the trace events.
  *
@@ -459,12 +555,12 @@ static void __event_probe__##_name(void *__data);
 
 #undef _ctf_integer_ext
 #define _ctf_integer_ext(_type, _item, _src, _byte_order, _base, _user, _nowrite) \
-	__event_len += lib_ring_buffer_align(__event_len, lttng_alignof(_type)); \
+	__event_len += lib_ring_buffer_record_align(__packed, __event_len, lttng_alignof(_type)); \
 	__event_len += sizeof(_type);
 
 #undef _ctf_array_encoded
 #define _ctf_array_encoded(_type, _item, _src, _length, _encoding, _byte_order, _base, _user, _nowrite) \
-	__event_len += lib_ring_buffer_align(__event_len, lttng_alignof(_type)); \
+	__event_len += lib_ring_buffer_record_align(__packed, __event_len, lttng_alignof(_type)); \
 	__event_len += sizeof(_type) * (_length);
 
 #undef _ctf_array_bitfield
@@ -474,12 +570,17 @@ static void __event_probe__##_name(void *__data);
 #undef _ctf_sequence_encoded
 #define _ctf_sequence_encoded(_type, _item, _src, _length_type,			\
 			_src_length, _encoding, _byte_order, _base, _user, _nowrite) \
-	__event_len += lib_ring_buffer_align(__event_len, lttng_alignof(_length_type)); \
+	__event_len += lib_ring_buffer_record_align(__packed, __event_len, lttng_alignof(_length_type)); \
 	__event_len += sizeof(_length_type);				       \
-	__event_len += lib_ring_buffer_align(__event_len, lttng_alignof(_type)); \
+	__event_len += lib_ring_buffer_record_align(__packed, __event_len, lttng_alignof(_type)); \
 	{										\
 		size_t __seqlen = (_src_length);					\
 											\
+		if ((_user) && unlikely(__user_max					\
+				&& __seqlen > __user_max / sizeof(_type))) {		\
+			__seqlen = __user_max / sizeof(_type);				\
+			__probe_ctx->user_truncated = 1;				\
+		}									\
 		if (unlikely(++this_cpu_ptr(&lttng_dynamic_len_stack)->offset >= LTTNG_DYNAMIC_LEN_STACK_SIZE)) \
 			goto error;							\
 		barrier();	/* reserve before use. */				\
@@ -496,7 +597,8 @@ static void __event_probe__##_name(void *__data);
 
 /*
  * ctf_user_string includes \0. If returns 0, it faulted, so we set size to
- * 1 (\0 only).
+ * 1 (\0 only). Strings longer than the channel user capture length are
+ * truncated to it, \0 included.
  */
 #undef _ctf_string
 #define _ctf_string(_item, _src, _user, _nowrite)			       \
@@ -504,20 +606,37 @@ static void __event_probe__##_name(void *__data);
 		goto error;						       \
 	barrier();	/* reserve before use. */			       \
 	if (_user) {							       \
+		size_t __strlen;					       \
+									       \
+		if (unlikely(__user_max)) {				       \
+			__strlen = lttng_strnlen_user_inatomic(_src,	       \
+					__user_max + 1);		       \
+			if (__strlen > __user_max) {			       \
+				__strlen = __user_max;			       \
+				__probe_ctx->user_truncated = 1;	       \
+			}						       \
+		} else {						       \
+			__strlen = lttng_strlen_user_inatomic(_src);	       \
+		}							       \
 		__event_len += this_cpu_ptr(&lttng_dynamic_len_stack)->stack[this_cpu_ptr(&lttng_dynamic_len_stack)->offset - 1] = \
-			max_t(size_t, lttng_strlen_user_inatomic(_src), 1);    \
+			max_t(size_t, __strlen, 1);			       \
 	} else {							       \
 		__event_len += this_cpu_ptr(&lttng_dynamic_len_stack)->stack[this_cpu_ptr(&lttng_dynamic_len_stack)->offset - 1] = \
 			strlen((_src) ? (_src) : __LTTNG_NULL_STRING) + 1; \
 	}
 
+/* Bounded strings are not scanned: count their upper bound. */
+#undef _ctf_string_bounded
+#define _ctf_string_bounded(_item, _src, _max_len, _user, _nowrite)	       \
+	__event_len += (_max_len);
+
 #undef _ctf_enum
 #define _ctf_enum(_name, _type, _item, _src, _user, _nowrite)		       \
 	_ctf_integer_ext(_type, _item, _src, __BYTE_ORDER, 10, _user, _nowrite)
 
 #undef ctf_align
 #define ctf_align(_type)						\
-	__event_len += lib_ring_buffer_align(__event_len, lttng_alignof(_type));
+	__event_len += lib_ring_buffer_record_align(__packed, __event_len, lttng_alignof(_type));
 
 #undef ctf_custom_field
 #define ctf_custom_field(_type, _item, _code)				\
@@ -539,13 +658,22 @@ static void __event_probe__##_name(void *__data);
 
 #undef LTTNG_TRACEPOINT_EVENT_CLASS_CODE
 #define LTTNG_TRACEPOINT_EVENT_CLASS_CODE(_name, _proto, _args, _locvar, _code_pre, _fields, _code_post) \
-static inline ssize_t __event_get_size__##_name(void *__tp_locvar, _proto)     \
+static inline ssize_t __event_get_size__##_name(void *__tp_locvar,	      \
+		int __packed, size_t __user_max,			      \
+		struct lttng_probe_ctx *__probe_ctx, _proto)		      \
 {									      \
 	size_t __event_len = 0;						      \
 	unsigned int __dynamic_len_idx __attribute__((unused)) = 0;	      \
 	struct { _locvar } *tp_locvar __attribute__((unused)) = __tp_locvar;  \
 									      \
 	_fields								      \
+	if (__event_single_pass___##_name) {				      \
+		/* The slack length must fit the reserved payload. */	      \
+		__event_len += lib_ring_buffer_record_align(__packed, __event_len, lttng_alignof(uint16_t)); \
+		__event_len += sizeof(uint16_t);			      \
+		if (unlikely(__event_len > USHRT_MAX))		      \
+			goto error;					      \
+	}								      \
 	return __event_len;						      \
 									      \
 error:									      \
@@ -555,13 +683,22 @@ error:									      \
 
 #undef LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS
 #define LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS(_name, _locvar, _code_pre, _fields, _code_post) \
-static inline ssize_t __event_get_size__##_name(void *__tp_locvar)	      \
+static inline ssize_t __event_get_size__##_name(void *__tp_locvar,	      \
+		int __packed, size_t __user_max,			      \
+		struct lttng_probe_ctx *__probe_ctx)			      \
 {									      \
 	size_t __event_len = 0;						      \
 	unsigned int __dynamic_len_idx __attribute__((unused)) = 0;	      \
 	struct { _locvar } *tp_locvar __attribute__((unused)) = __tp_locvar;  \
 									      \
 	_fields								      \
+	if (__event_single_pass___##_name) {				      \
+		/* The slack length must fit the reserved payload. */	      \
+		__event_len += lib_ring_buffer_record_align(__packed, __event_len, lttng_alignof(uint16_t)); \
+		__event_len += sizeof(uint16_t);			      \
+		if (unlikely(__event_len > USHRT_MAX))		      \
+			goto error;					      \
+	}								      \
 	return __event_len;						      \
 									      \
 error:									      \
@@ -727,6 +864,10 @@ error:									      \
 		__stack_data += sizeof(void *);				       \
 	}
 
+#undef _ctf_string_bounded
+#define _ctf_string_bounded(_item, _src, _max_len, _user, _nowrite)	       \
+	_ctf_string(_item, _src, _user, _nowrite)
+
 #undef _ctf_enum
 #define _ctf_enum(_name, _type, _item, _src, _user, _nowrite)		       \
 	_ctf_integer_ext(_type, _item, _src, __BYTE_ORDER, 10, _user, _nowrite)
@@ -836,6 +977,8 @@ static inline size_t __event_get_align__##_name(void *__tp_locvar, _proto)    \
 	struct { _locvar } *tp_locvar __attribute__((unused)) = __tp_locvar;  \
 									      \
 	_fields								      \
+	if (__event_single_pass___##_name)				      \
+		__event_align = max_t(size_t, __event_align, lttng_alignof(uint16_t)); \
 	return __event_align;						      \
 }
 
@@ -847,11 +990,436 @@ static inline size_t __event_get_align__##_name(void *__tp_locvar)	      \
 	struct { _locvar } *tp_locvar __attribute__((unused)) = __tp_locvar;  \
 									      \
 	_fields								      \
+	if (__event_single_pass___##_name)				      \
+		__event_align = max_t(size_t, __event_align, lttng_alignof(uint16_t)); \
 	return __event_align;						      \
 }
 
 #include TRACE_INCLUDE(TRACE_INCLUDE_FILE)
 
+/*
+ * Stage 5.1 of the trace events.
+ *
+ * Create the payload structure of fixed layout events. Its members are
+ * aligned as the fields are in the ring buffer, so the payload is
+ * written with a single copy.
+ */
+
+/* Reset all macros within TRACEPOINT_EVENT */
+#include <probes/lttng-events-reset.h>
+#include <probes/lttng-events-write.h>
+
+#undef _ctf_integer_ext
+#define _ctf_integer_ext(_type, _item, _src, _byte_order, _base, _user, _nowrite) \
+	_type __field_##_item __attribute__((aligned(lttng_alignof(_type))));
+
+#undef _ctf_enum
+#define _ctf_enum(_name, _type, _item, _src, _user, _nowrite)		\
+	_ctf_integer_ext(_type, _item, _src, __BYTE_ORDER, 10, _user, _nowrite)
+
+#undef TP_FIELDS
+#define TP_FIELDS(...)	__VA_ARGS__
+
+#undef LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS
+#define LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS(_name, _locvar, _code_pre, _fields, _code_post) \
+struct __event_fixed_layout__##_name {					      \
+	_fields								      \
+} __attribute__((packed));
+
+#undef LTTNG_TRACEPOINT_EVENT_CLASS_CODE
+#define LTTNG_TRACEPOINT_EVENT_CLASS_CODE(_name, _proto, _args, _locvar, _code_pre, _fields, _code_post) \
+	LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS(_name, _locvar, _code_pre, PARAMS(_fields), _code_post)
+
+#include TRACE_INCLUDE(TRACE_INCLUDE_FILE)
+
+/*
+ * Stage 5.2 of the trace events.
+ *
+ * Create static inline function that returns the payload structure of
+ * fixed layout events, initialized so that const qualified field types
+ * are accepted.
+ */
+
+/* Reset all macros within TRACEPOINT_EVENT */
+#include <probes/lttng-events-reset.h>
+#include <probes/lttng-events-write.h>
+
+#undef _ctf_integer_ext_isuser0
+#define _ctf_integer_ext_isuser0(_type, _item, _src)			\
+	.__field_##_item = (_src),
+
+/* Not a fixed layout event: never called. */
+#undef _ctf_integer_ext_isuser1
+#define _ctf_integer_ext_isuser1(_type, _item, _user_src)
+
+#undef _ctf_integer_ext
+#define _ctf_integer_ext(_type, _item, _src, _byte_order, _base, _user, _nowrite) \
+	_ctf_integer_ext_isuser##_user(_type, _item, _src)
+
+#undef _ctf_enum
+#define _ctf_enum(_name, _type, _item, _src, _user, _nowrite)		\
+	_ctf_integer_ext(_type, _item, _src, __BYTE_ORDER, 10, _user, _nowrite)
+
+#undef TP_PROTO
+#define TP_PROTO(...)	__VA_ARGS__
+
+#undef TP_FIELDS
+#define TP_FIELDS(...)	__VA_ARGS__
+
+#undef TP_locvar
+#define TP_locvar(...)	__VA_ARGS__
+
+#undef LTTNG_TRACEPOINT_EVENT_CLASS_CODE
+#define LTTNG_TRACEPOINT_EVENT_CLASS_CODE(_name, _proto, _args, _locvar, _code_pre, _fields, _code_post) \
+static inline								      \
+struct __event_fixed_layout__##_name					      \
+__event_fixed_fill__##_name(void *__tp_locvar, _proto)			      \
+{									      \
+	struct { _locvar } *tp_locvar __attribute__((unused)) = __tp_locvar;  \
+									      \
+	return (struct __event_fixed_layout__##_name) { _fields };	      \
+}
+
+#undef LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS
+#define LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS(_name, _locvar, _code_pre, _fields, _code_post) \
+static inline								      \
+struct __event_fixed_layout__##_name					      \
+__event_fixed_fill__##_name(void *__tp_locvar)				      \
+{									      \
+	struct { _locvar } *tp_locvar __attribute__((unused)) = __tp_locvar;  \
+									      \
+	return (struct __event_fixed_layout__##_name) { _fields };	      \
+}
+
+#include TRACE_INCLUDE(TRACE_INCLUDE_FILE)
+
+#ifdef LTTNG_TABLE_SERIALIZER
+
+/*
+ * Stage 5.3 of the trace events.
+ *
+ * Flag the event classes which lttng_event_table_serialize() can
+ * record: those only made of kernel integers, enumerations, arrays,
+ * sequences and strings. Each field ors 1 if it is handled, and 2
+ * otherwise.
+ */
+
+/* Reset all macros within TRACEPOINT_EVENT */
+#include <probes/lttng-events-reset.h>
+#include <probes/lttng-events-write.h>
+
+#undef _ctf_integer_ext
+#define _ctf_integer_ext(_type, _item, _src, _byte_order, _base, _user, _nowrite) \
+	| ((_user) ? 2 : 1)
+
+#undef _ctf_array_encoded
+#define _ctf_array_encoded(_type, _item, _src, _length, _encoding, _byte_order, _base, _user, _nowrite) \
+	| ((_user) ? 2 : 1)
+
+#undef _ctf_sequence_encoded
+#define _ctf_sequence_encoded(_type, _item, _src, _length_type,		\
+			_src_length, _encoding, _byte_order, _base, _user, _nowrite) \
+	| ((_user) ? 2 : 1)
+
+/* Bitfields are byteswapped by the expanded code on big endian. */
+#if (__BYTE_ORDER == __LITTLE_ENDIAN)
+#undef _ctf_array_bitfield
+#define _ctf_array_bitfield(_type, _item, _src, _length, _user, _nowrite) \
+	| ((_user) ? 2 : 1)
+
+#undef _ctf_sequence_bitfield
+#define _ctf_sequence_bitfield(_type, _item, _src,		\
+			_length_type, _src_length,		\
+			_user, _nowrite)			\
+	| ((_user) ? 2 : 1)
+#else /* #if (__BYTE_ORDER == __LITTLE_ENDIAN) */
+#undef _ctf_array_bitfield
+#define _ctf_array_bitfield(_type, _item, _src, _length, _user, _nowrite) \
+	| 2
+
+#undef _ctf_sequence_bitfield
+#define _ctf_sequence_bitfield(_type, _item, _src,		\
+			_length_type, _src_length,		\
+			_user, _nowrite)			\
+	| 2
+#endif /* #else #if (__BYTE_ORDER == __LITTLE_ENDIAN) */
+
+#undef _ctf_string
+#define _ctf_string(_item, _src, _user, _nowrite)	| ((_user) ? 2 : 1)
+
+#undef _ctf_string_bounded
+#define _ctf_string_bounded(_item, _src, _max_len, _user, _nowrite)	| 2
+
+#undef _ctf_enum
+#define _ctf_enum(_name, _type, _item, _src, _user, _nowrite)		\
+	_ctf_integer_ext(_type, _item, _src, __BYTE_ORDER, 10, _user, _nowrite)
+
+#undef ctf_align
+#define ctf_align(_type)	| 2
+
+#undef ctf_custom_field
+#define ctf_custom_field(_type, _item, _code)	| 2
+
+#undef TP_FIELDS
+#define TP_FIELDS(...)	__VA_ARGS__
+
+#undef LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS
+#define LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS(_name, _locvar, _code_pre, _fields, _code_post) \
+	enum { __event_table___##_name = ((0 _fields) == 1) };
+
+#undef LTTNG_TRACEPOINT_EVENT_CLASS_CODE
+#define LTTNG_TRACEPOINT_EVENT_CLASS_CODE(_name, _proto, _args, _locvar, _code_pre, _fields, _code_post) \
+	LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS(_name, _locvar, _code_pre, PARAMS(_fields), _code_post)
+
+#include TRACE_INCLUDE(TRACE_INCLUDE_FILE)
+
+/*
+ * Stage 5.4 of the trace events.
+ *
+ * Create the field sources structure of lttng_event_table_serialize().
+ */
+
+/* Reset all macros within TRACEPOINT_EVENT */
+#include <probes/lttng-events-reset.h>
+#include <probes/lttng-events-write.h>
+
+#undef _ctf_integer_ext
+#define _ctf_integer_ext(_type, _item, _src, _byte_order, _base, _user, _nowrite) \
+	_type __field_##_item;
+
+#undef _ctf_array_encoded
+#define _ctf_array_encoded(_type, _item, _src, _length, _encoding, _byte_order, _base, _user, _nowrite) \
+	const void *__field_##_item;
+
+#undef _ctf_array_bitfield
+#define _ctf_array_bitfield(_type, _item, _src, _length, _user, _nowrite) \
+	const void *__field_##_item;
+
+#undef _ctf_sequence_encoded
+#define _ctf_sequence_encoded(_type, _item, _src, _length_type,		\
+			_src_length, _encoding, _byte_order, _base, _user, _nowrite) \
+	struct lttng_event_table_seq __field_##_item;
+
+#undef _ctf_sequence_bitfield
+#define _ctf_sequence_bitfield(_type, _item, _src,		\
+			_length_type, _src_length,		\
+			_user, _nowrite)			\
+	struct lttng_event_table_seq __field_##_item;
+
+#undef _ctf_string
+#define _ctf_string(_item, _src, _user, _nowrite)			\
+	const char *__field_##_item;
+
+#undef _ctf_enum
+#define _ctf_enum(_name, _type, _item, _src, _user, _nowrite)		\
+	_ctf_integer_ext(_type, _item, _src, __BYTE_ORDER, 10, _user, _nowrite)
+
+#undef TP_FIELDS
+#define TP_FIELDS(...)	__VA_ARGS__
+
+#undef LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS
+#define LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS(_name, _locvar, _code_pre, _fields, _code_post) \
+struct __event_table_src__##_name {					      \
+	_fields								      \
+};
+
+#undef LTTNG_TRACEPOINT_EVENT_CLASS_CODE
+#define LTTNG_TRACEPOINT_EVENT_CLASS_CODE(_name, _proto, _args, _locvar, _code_pre, _fields, _code_post) \
+	LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS(_name, _locvar, _code_pre, PARAMS(_fields), _code_post)
+
+#include TRACE_INCLUDE(TRACE_INCLUDE_FILE)
+
+/*
+ * Stage 5.5 of the trace events.
+ *
+ * Create static inline function that returns the field sources of
+ * lttng_event_table_serialize(). Fields fetched from user-space are
+ * never serialized from the table, and are left out.
+ */
+
+/* Reset all macros within TRACEPOINT_EVENT */
+#include <probes/lttng-events-reset.h>
+#include <probes/lttng-events-write.h>
+
+#undef _ctf_table_fill_isuser0
+#define _ctf_table_fill_isuser0(_item, _src)				\
+	.__field_##_item = (_src),
+
+#undef _ctf_table_fill_isuser1
+#define _ctf_table_fill_isuser1(_item, _src)
+
+#undef _ctf_table_fill_seq_isuser0
+#define _ctf_table_fill_seq_isuser0(_item, _src, _len)			\
+	.__field_##_item = { .ptr = (_src), .len = (_len) },
+
+#undef _ctf_table_fill_seq_isuser1
+#define _ctf_table_fill_seq_isuser1(_item, _src, _len)
+
+#undef _ctf_integer_ext
+#define _ctf_integer_ext(_type, _item, _src, _byte_order, _base, _user, _nowrite) \
+	_ctf_table_fill_isuser##_user(_item, _src)
+
+#undef _ctf_array_encoded
+#define _ctf_array_encoded(_type, _item, _src, _length, _encoding, _byte_order, _base, _user, _nowrite) \
+	_ctf_table_fill_isuser##_user(_item, _src)
+
+#undef _ctf_array_bitfield
+#define _ctf_array_bitfield(_type, _item, _src, _length, _user, _nowrite) \
+	_ctf_table_fill_isuser##_user(_item, _src)
+
+#undef _ctf_sequence_encoded
+#define _ctf_sequence_encoded(_type, _item, _src, _length_type,		\
+			_src_length, _encoding, _byte_order, _base, _user, _nowrite) \
+	_ctf_table_fill_seq_isuser##_user(_item, _src, _src_length)
+
+#undef _ctf_sequence_bitfield
+#define _ctf_sequence_bitfield(_type, _item, _src,		\
+			_length_type, _src_length,		\
+			_user, _nowrite)			\
+	_ctf_table_fill_seq_isuser##_user(_item, _src,		\
+			(_src_length) * sizeof(_type))
+
+#undef _ctf_string
+#define _ctf_string(_item, _src, _user, _nowrite)			\
+	_ctf_table_fill_isuser##_user(_item, _src)
+
+#undef _ctf_enum
+#define _ctf_enum(_name, _type, _item, _src, _user, _nowrite)		\
+	_ctf_integer_ext(_type, _item, _src, __BYTE_ORDER, 10, _user, _nowrite)
+
+#undef TP_PROTO
+#define TP_PROTO(...)	__VA_ARGS__
+
+#undef TP_FIELDS
+#define TP_FIELDS(...)	__VA_ARGS__
+
+#undef TP_locvar
+#define TP_locvar(...)	__VA_ARGS__
+
+#undef LTTNG_TRACEPOINT_EVENT_CLASS_CODE
+#define LTTNG_TRACEPOINT_EVENT_CLASS_CODE(_name, _proto, _args, _locvar, _code_pre, _fields, _code_post) \
+static inline								      \
+struct __event_table_src__##_name					      \
+__event_table_fill__##_name(void *__tp_locvar, _proto)			      \
+{									      \
+	struct { _locvar } *tp_locvar __attribute__((unused)) = __tp_locvar;  \
+									      \
+	return (struct __event_table_src__##_name) { _fields };		      \
+}
+
+#undef LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS
+#define LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS(_name, _locvar, _code_pre, _fields, _code_post) \
+static inline								      \
+struct __event_table_src__##_name					      \
+__event_table_fill__##_name(void *__tp_locvar)				      \
+{									      \
+	struct { _locvar } *tp_locvar __attribute__((unused)) = __tp_locvar;  \
+									      \
+	return (struct __event_table_src__##_name) { _fields };		      \
+}
+
+#include TRACE_INCLUDE(TRACE_INCLUDE_FILE)
+
+/*
+ * Stage 5.6 of the trace events.
+ *
+ * Create static inline function that returns the offsets of the field
+ * sources, one per field of the event descriptor, including the fields
+ * which are not written.
+ */
+
+/* Reset all macros within TRACEPOINT_EVENT */
+#include <probes/lttng-events-reset.h>
+#include <probes/lttng-events-write.h>
+#include <probes/lttng-events-nowrite.h>
+
+#undef _ctf_table_offset_nowrite0
+#define _ctf_table_offset_nowrite0(_item)				\
+	offsetof(__event_table_src_t, __field_##_item),
+
+#undef _ctf_table_offset_nowrite1
+#define _ctf_table_offset_nowrite1(_item)	0,
+
+#undef _ctf_integer_ext
+#define _ctf_integer_ext(_type, _item, _src, _byte_order, _base, _user, _nowrite) \
+	_ctf_table_offset_nowrite##_nowrite(_item)
+
+#undef _ctf_array_encoded
+#define _ctf_array_encoded(_type, _item, _src, _length, _encoding, _byte_order, _base, _user, _nowrite) \
+	_ctf_table_offset_nowrite##_nowrite(_item)
+
+#undef _ctf_array_bitfield
+#define _ctf_array_bitfield(_type, _item, _src, _length, _user, _nowrite) \
+	_ctf_table_offset_nowrite##_nowrite(_item)
+
+#undef _ctf_sequence_encoded
+#define _ctf_sequence_encoded(_type, _item, _src, _length_type,		\
+			_src_length, _encoding, _byte_order, _base, _user, _nowrite) \
+	_ctf_table_offset_nowrite##_nowrite(_item)
+
+#undef _ctf_sequence_bitfield
+#define _ctf_sequence_bitfield(_type, _item, _src,		\
+			_length_type, _src_length,		\
+			_user, _nowrite)			\
+	_ctf_table_offset_nowrite##_nowrite(_item)
+
+#undef _ctf_string
+#define _ctf_string(_item, _src, _user, _nowrite)			\
+	_ctf_table_offset_nowrite##_nowrite(_item)
+
+/* Not serialized from the table: only keeps the field numbering. */
+#undef _ctf_string_bounded
+#define _ctf_string_bounded(_item, _src, _max_len, _user, _nowrite)	0,
+
+#undef _ctf_enum
+#define _ctf_enum(_name, _type, _item, _src, _user, _nowrite)		\
+	_ctf_integer_ext(_type, _item, _src, __BYTE_ORDER, 10, _user, _nowrite)
+
+#undef ctf_custom_field
+#define ctf_custom_field(_type, _item, _code)	0,
+
+#undef TP_FIELDS
+#define TP_FIELDS(...)	__VA_ARGS__
+
+#undef LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS
+#define LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS(_name, _locvar, _code_pre, _fields, _code_post) \
+static inline const size_t *__event_table_offsets__##_name(void)	      \
+{									      \
+	typedef struct __event_table_src__##_name __event_table_src_t;	      \
+	static const size_t __offsets[] = { _fields };			      \
+									      \
+	return __offsets;						      \
+}
+
+#undef LTTNG_TRACEPOINT_EVENT_CLASS_CODE
+#define LTTNG_TRACEPOINT_EVENT_CLASS_CODE(_name, _proto, _args, _locvar, _code_pre, _fields, _code_post) \
+	LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS(_name, _locvar, _code_pre, PARAMS(_fields), _code_post)
+
+#include TRACE_INCLUDE(TRACE_INCLUDE_FILE)
+
+/*
+ * Record cold events of the classes handled by the table-driven
+ * serializer, after their filter. Hot events keep the expanded code.
+ */
+#undef _lttng_table_serialize
+#define _lttng_table_serialize(_name, ...)				      \
+	if (__event_table___##_name					      \
+			&& (__armed & LTTNG_EVENT_ARMED_COLD)) {	      \
+		struct __event_table_src__##_name __table_src =	      \
+			__event_table_fill__##_name(__VA_ARGS__);	      \
+									      \
+		lttng_event_table_serialize(&__lttng_probe_ctx,	      \
+			__event_table_offsets__##_name(), &__table_src);      \
+		goto __post;						      \
+	}
+
+#else /* #ifdef LTTNG_TABLE_SERIALIZER */
+
+#undef _lttng_table_serialize
+#define _lttng_table_serialize(_name, ...)
+
+#endif /* #else #ifdef LTTNG_TABLE_SERIALIZER */
+
 /*
  * Stage 6 of tracepoint event generation.
  *
@@ -1046,6 +1614,18 @@ static inline size_t __event_get_align__##_name(void *__tp_locvar)	      \
 			__get_dynamic_len(dest));			\
 	}
 
+#undef _ctf_string_bounded
+#define _ctf_string_bounded(_item, _src, _max_len, _user, _nowrite)	\
+	if (_user) {							\
+		__chan->ops->event_strscpy_from_user(&__ctx, _src,	\
+			_max_len);					\
+	} else {							\
+		const char *__ctf_tmp_string =				\
+			((_src) ? (_src) : __LTTNG_NULL_STRING);	\
+		__chan->ops->event_strscpy(&__ctx, __ctf_tmp_string,	\
+			_max_len);					\
+	}
+
 #undef _ctf_enum
 #define _ctf_enum(_name, _type, _item, _src, _user, _nowrite)		\
 	_ctf_integer_ext(_type, _item, _src, __BYTE_ORDER, 10, _user, _nowrite)
@@ -1096,6 +1676,283 @@ static inline size_t __event_get_align__##_name(void *__tp_locvar)	      \
 #define _TP_SESSION_CHECK(session, csession)	1
 #endif /* TP_SESSION_CHECK */
 
+#ifdef LTTNG_EVENT_FANOUT
+
+/*
+ * Fan-out probe, registered with a group of events of several sessions
+ * or channels as data. The payload is serialized once into a scratch
+ * buffer, starting at offset 0 which is aligned as a record payload, and
+ * copied into the reservation of each event after its own filter. Packed
+ * channels, and payloads which do not fit the scratch buffer, are
+ * recorded by the probe of each event instead.
+ *
+ * As in the probe of each event, _code_pre may drop the event by jumping
+ * to __post, so that _code_post still runs.
+ */
+#undef _lttng_event_fanout_probe
+#define _lttng_event_fanout_probe(_name, _proto, _args, _locvar, _code_pre, _fields, _code_post) \
+static void __event_fanout__##_name(void *__data, _proto)		      \
+{									      \
+	struct probe_local_vars { _locvar };				      \
+	struct lttng_event_fanout *__fanout = __data;			      \
+	const struct lttng_event_fanout_chan *__chan = &lttng_event_fanout_chan; \
+	struct lttng_event *__event;					      \
+	struct lttng_probe_ctx __lttng_probe_ctx = {			      \
+		.event = NULL,						      \
+		.interruptible = !irqs_disabled(),			      \
+		.sampled = 1,						      \
+	};								      \
+	struct lib_ring_buffer_ctx __ctx;				      \
+	ssize_t __event_len = 0;					      \
+	size_t __event_align = 1;					      \
+	size_t __orig_dynamic_len_offset, __dynamic_len_idx __attribute__((unused)); \
+	union {								      \
+		size_t __dynamic_len_removed[ARRAY_SIZE(__event_fields___##_name)]; \
+		char __filter_stack_data[2 * sizeof(unsigned long) * ARRAY_SIZE(__event_fields___##_name)]; \
+	} __stackvar;							      \
+	int __filter_stack_ready = 0, __payload_failed = 0;		      \
+	int __payload_ready = 0;					      \
+	char *__payload = NULL;						      \
+	struct probe_local_vars __tp_locvar;				      \
+	struct probe_local_vars *tp_locvar __attribute__((unused)) =	      \
+			&__tp_locvar;					      \
+									      \
+	__orig_dynamic_len_offset = this_cpu_ptr(&lttng_dynamic_len_stack)->offset; \
+	__dynamic_len_idx = __orig_dynamic_len_offset;			      \
+	_code_pre							      \
+	lttng_list_for_each_entry_rcu(__event, &__fanout->events, fanout_node) { \
+		struct lttng_channel *__event_chan = __event->chan;	      \
+		struct lttng_session *__session = __event_chan->session;      \
+		struct lttng_pid_tracker *__lpf;			      \
+		unsigned long __armed;					      \
+									      \
+		__armed = READ_ONCE(__event->armed);			      \
+		if (unlikely(!(__armed & LTTNG_EVENT_ARMED)))		      \
+			continue;					      \
+		if (!_TP_SESSION_CHECK(session, __session))		      \
+			continue;					      \
+		if (lttng_session_paused(__session, __armed))		      \
+			continue;					      \
+		if (unlikely(__armed & LTTNG_EVENT_ARMED_PID_TRACKER)) {      \
+			__lpf = lttng_rcu_dereference(__session->pid_tracker); \
+			if (__lpf && !lttng_pid_tracker_lookup(__lpf, current->tgid)) \
+				continue;				      \
+		}							      \
+		if (unlikely(__armed & LTTNG_EVENT_ARMED_ID_TRACKERS)	      \
+				&& !lttng_id_trackers_match(__session))	      \
+			continue;					      \
+		if (unlikely(__armed & LTTNG_EVENT_ARMED_GATE)		      \
+				&& !lttng_gates_match(__event))		      \
+			continue;					      \
+		if (unlikely(__event_chan->packed			      \
+				|| READ_ONCE(__event_chan->user_capture_max) \
+				|| (__armed & LTTNG_EVENT_ARMED_CTX_GUARD))) { \
+			__event_probe__##_name(__event, _args);		      \
+			continue;					      \
+		}							      \
+		/* The payload size is known before the channel is sampled. */ \
+		if (unlikely(!__payload && !__payload_failed)) {	      \
+			__dynamic_len_idx = this_cpu_ptr(&lttng_dynamic_len_stack)->offset; \
+			__event_len = __event_get_size__##_name(tp_locvar, 0, 0, \
+					&__lttng_probe_ctx, _args);	      \
+			if (likely(__event_len >= 0))			      \
+				__payload = lttng_event_fanout_scratch_get(__event_len); \
+			if (unlikely(!__payload))			      \
+				__payload_failed = 1;			      \
+		}							      \
+		/* The probe of the event samples the channel on its own. */  \
+		if (unlikely(__payload_failed)) {			      \
+			__event_probe__##_name(__event, _args);		      \
+			continue;					      \
+		}							      \
+		if (!lttng_channel_sample(__event_chan, smp_processor_id())) \
+			continue;					      \
+		__lttng_probe_ctx.event = __event;			      \
+		if (unlikely(!list_empty(&__event->bytecode_runtime_head))) { \
+			int __filter_record = __event->has_enablers_without_bytecode; \
+									      \
+			if (likely(!__filter_record)) {			      \
+				__filter_record = lttng_event_filter_context(__event, &__lttng_probe_ctx); \
+				if (__filter_record < 0) {		      \
+					if (!__filter_stack_ready) {	      \
+						__event_prepare_filter_stack__##_name(__stackvar.__filter_stack_data, \
+								tp_locvar, _args); \
+						__filter_stack_ready = 1;     \
+					}				      \
+					__filter_record = lttng_event_filter_payload(__event, \
+							&__lttng_probe_ctx, __stackvar.__filter_stack_data); \
+				}					      \
+			}						      \
+			if (likely(!__filter_record))			      \
+				continue;				      \
+		}							      \
+		if (unlikely(__armed & LTTNG_EVENT_ARMED_GATE_ACTION))	      \
+			lttng_gates_act(__event);			      \
+		if (lttng_event_count_hit(__event, __armed))		      \
+			continue;					      \
+		if (unlikely(!__payload_ready)) {			      \
+			__event_align = __event_get_align__##_name(tp_locvar, _args); \
+			lib_ring_buffer_ctx_init(&__ctx, NULL, __payload, __event_len, \
+					__event_align, -1);		      \
+			__ctx.buf_offset = 0;				      \
+			_fields						      \
+			if (__event_single_pass___##_name)		      \
+				__chan->ops->event_shrink(&__ctx);	      \
+			__event_len = __ctx.buf_offset;			      \
+			__payload_ready = 1;				      \
+		}							      \
+		lib_ring_buffer_ctx_init(&__ctx, __event_chan->chan, &__lttng_probe_ctx, \
+				__event_len, __event_align, -1);	      \
+		if (__event_chan->ops->event_reserve(&__ctx, __event->id) < 0) \
+			continue;					      \
+		__event_chan->ops->event_write(&__ctx, __payload, __event_len); \
+		__event_chan->ops->event_commit(&__ctx);		      \
+	}								      \
+__post: __attribute__((unused));					      \
+	if (__payload)							      \
+		lttng_event_fanout_scratch_put(__payload);		      \
+	_code_post							      \
+	barrier();	/* use before un-reserve. */			      \
+	this_cpu_ptr(&lttng_dynamic_len_stack)->offset = __orig_dynamic_len_offset; \
+}
+
+#undef _lttng_event_fanout_probe_noargs
+#define _lttng_event_fanout_probe_noargs(_name, _locvar, _code_pre, _fields, _code_post) \
+static void __event_fanout__##_name(void *__data)			      \
+{									      \
+	struct probe_local_vars { _locvar };				      \
+	struct lttng_event_fanout *__fanout = __data;			      \
+	const struct lttng_event_fanout_chan *__chan = &lttng_event_fanout_chan; \
+	struct lttng_event *__event;					      \
+	struct lttng_probe_ctx __lttng_probe_ctx = {			      \
+		.event = NULL,						      \
+		.interruptible = !irqs_disabled(),			      \
+		.sampled = 1,						      \
+	};								      \
+	struct lib_ring_buffer_ctx __ctx;				      \
+	ssize_t __event_len = 0;					      \
+	size_t __event_align = 1;					      \
+	size_t __orig_dynamic_len_offset, __dynamic_len_idx __attribute__((unused)); \
+	union {								      \
+		size_t __dynamic_len_removed[ARRAY_SIZE(__event_fields___##_name)]; \
+		char __filter_stack_data[2 * sizeof(unsigned long) * ARRAY_SIZE(__event_fields___##_name)]; \
+	} __stackvar;							      \
+	int __filter_stack_ready = 0, __payload_failed = 0;		      \
+	int __payload_ready = 0;					      \
+	char *__payload = NULL;						      \
+	struct probe_local_vars __tp_locvar;				      \
+	struct probe_local_vars *tp_locvar __attribute__((unused)) =	      \
+			&__tp_locvar;					      \
+									      \
+	__orig_dynamic_len_offset = this_cpu_ptr(&lttng_dynamic_len_stack)->offset; \
+	__dynamic_len_idx = __orig_dynamic_len_offset;			      \
+	_code_pre							      \
+	lttng_list_for_each_entry_rcu(__event, &__fanout->events, fanout_node) { \
+		struct lttng_channel *__event_chan = __event->chan;	      \
+		struct lttng_session *__session = __event_chan->session;      \
+		struct lttng_pid_tracker *__lpf;			      \
+		unsigned long __armed;					      \
+									      \
+		__armed = READ_ONCE(__event->armed);			      \
+		if (unlikely(!(__armed & LTTNG_EVENT_ARMED)))		      \
+			continue;					      \
+		if (!_TP_SESSION_CHECK(session, __session))		      \
+			continue;					      \
+		if (lttng_session_paused(__session, __armed))		      \
+			continue;					      \
+		if (unlikely(__armed & LTTNG_EVENT_ARMED_PID_TRACKER)) {      \
+			__lpf = lttng_rcu_dereference(__session->pid_tracker); \
+			if (__lpf && !lttng_pid_tracker_lookup(__lpf, current->tgid)) \
+				continue;				      \
+		}							      \
+		if (unlikely(__armed & LTTNG_EVENT_ARMED_ID_TRACKERS)	      \
+				&& !lttng_id_trackers_match(__session))	      \
+			continue;					      \
+		if (unlikely(__armed & LTTNG_EVENT_ARMED_GATE)		      \
+				&& !lttng_gates_match(__event))		      \
+			continue;					      \
+		if (unlikely(__event_chan->packed			      \
+				|| READ_ONCE(__event_chan->user_capture_max) \
+				|| (__armed & LTTNG_EVENT_ARMED_CTX_GUARD))) { \
+			__event_probe__##_name(__event);		      \
+			continue;					      \
+		}							      \
+		/* The payload size is known before the channel is sampled. */ \
+		if (unlikely(!__payload && !__payload_failed)) {	      \
+			__dynamic_len_idx = this_cpu_ptr(&lttng_dynamic_len_stack)->offset; \
+			__event_len = __event_get_size__##_name(tp_locvar, 0, 0, \
+					&__lttng_probe_ctx);		      \
+			if (likely(__event_len >= 0))			      \
+				__payload = lttng_event_fanout_scratch_get(__event_len); \
+			if (unlikely(!__payload))			      \
+				__payload_failed = 1;			      \
+		}							      \
+		/* The probe of the event samples the channel on its own. */  \
+		if (unlikely(__payload_failed)) {			      \
+			__event_probe__##_name(__event);		      \
+			continue;					      \
+		}							      \
+		if (!lttng_channel_sample(__event_chan, smp_processor_id())) \
+			continue;					      \
+		__lttng_probe_ctx.event = __event;			      \
+		if (unlikely(!list_empty(&__event->bytecode_runtime_head))) { \
+			int __filter_record = __event->has_enablers_without_bytecode; \
+									      \
+			if (likely(!__filter_record)) {			      \
+				__filter_record = lttng_event_filter_context(__event, &__lttng_probe_ctx); \
+				if (__filter_record < 0) {		      \
+					if (!__filter_stack_ready) {	      \
+						__event_prepare_filter_stack__##_name(__stackvar.__filter_stack_data, \
+								tp_locvar);   \
+						__filter_stack_ready = 1;     \
+					}				      \
+					__filter_record = lttng_event_filter_payload(__event, \
+							&__lttng_probe_ctx, __stackvar.__filter_stack_data); \
+				}					      \
+			}						      \
+			if (likely(!__filter_record))			      \
+				continue;				      \
+		}							      \
+		if (unlikely(__armed & LTTNG_EVENT_ARMED_GATE_ACTION))	      \
+			lttng_gates_act(__event);			      \
+		if (lttng_event_count_hit(__event, __armed))		      \
+			continue;					      \
+		if (unlikely(!__payload_ready)) {			      \
+			__event_align = __event_get_align__##_name(tp_locvar); \
+			lib_ring_buffer_ctx_init(&__ctx, NULL, __payload, __event_len, \
+					__event_align, -1);		      \
+			__ctx.buf_offset = 0;				      \
+			_fields						      \
+			if (__event_single_pass___##_name)		      \
+				__chan->ops->event_shrink(&__ctx);	      \
+			__event_len = __ctx.buf_offset;			      \
+			__payload_ready = 1;				      \
+		}							      \
+		lib_ring_buffer_ctx_init(&__ctx, __event_chan->chan, &__lttng_probe_ctx, \
+				__event_len, __event_align, -1);	      \
+		if (__event_chan->ops->event_reserve(&__ctx, __event->id) < 0) \
+			continue;					      \
+		__event_chan->ops->event_write(&__ctx, __payload, __event_len); \
+		__event_chan->ops->event_commit(&__ctx);		      \
+	}								      \
+__post: __attribute__((unused));					      \
+	if (__payload)							      \
+		lttng_event_fanout_scratch_put(__payload);		      \
+	_code_post							      \
+	barrier();	/* use before un-reserve. */			      \
+	this_cpu_ptr(&lttng_dynamic_len_stack)->offset = __orig_dynamic_len_offset; \
+}
+
+#else /* #ifdef LTTNG_EVENT_FANOUT */
+
+#undef _lttng_event_fanout_probe
+#define _lttng_event_fanout_probe(_name, _proto, _args, _locvar, _code_pre, _fields, _code_post)
+
+#undef _lttng_event_fanout_probe_noargs
+#define _lttng_event_fanout_probe_noargs(_name, _locvar, _code_pre, _fields, _code_post)
+
+#endif /* #else #ifdef LTTNG_EVENT_FANOUT */
+
 /*
  * Using twice size for filter stack data to hold size and pointer for
  * each field (worse case). For integers, max size required is 64-bit.
@@ -1105,6 +1962,7 @@ static inline size_t __event_get_align__##_name(void *__tp_locvar)	      \
  */
 #undef LTTNG_TRACEPOINT_EVENT_CLASS_CODE
 #define LTTNG_TRACEPOINT_EVENT_CLASS_CODE(_name, _proto, _args, _locvar, _code_pre, _fields, _code_post) \
+_lttng_event_fanout_probe(_name, PARAMS(_proto), PARAMS(_args), PARAMS(_locvar), PARAMS(_code_pre), PARAMS(_fields), PARAMS(_code_post)) \
 static void __event_probe__##_name(void *__data, _proto)		      \
 {									      \
 	struct probe_local_vars { _locvar };				      \
@@ -1112,6 +1970,7 @@ static void __event_probe__##_name(void *__data, _proto)		      \
 	struct lttng_probe_ctx __lttng_probe_ctx = {				      \
 		.event = __event,				              \
 		.interruptible = !irqs_disabled(),			      \
+		.sampled = 1,						      \
 	};								      \
 	struct lttng_channel *__chan = __event->chan;			      \
 	struct lttng_session *__session = __chan->session;		      \
@@ -1128,36 +1987,68 @@ static void __event_probe__##_name(void *__data, _proto)		      \
 	struct probe_local_vars *tp_locvar __attribute__((unused)) =	      \
 			&__tp_locvar;					      \
 	struct lttng_pid_tracker *__lpf;				      \
+	unsigned long __armed;						      \
+	cycles_t __profile_ts;						      \
 									      \
+	__armed = READ_ONCE(__event->armed);				      \
+	if (unlikely(!(__armed & LTTNG_EVENT_ARMED)))			      \
+		return;							      \
 	if (!_TP_SESSION_CHECK(session, __session))			      \
 		return;							      \
-	if (unlikely(!READ_ONCE(__session->active)))			      \
+	if (lttng_session_paused(__session, __armed))			      \
 		return;							      \
-	if (unlikely(!READ_ONCE(__chan->enabled)))			      \
+	if (unlikely(__armed & LTTNG_EVENT_ARMED_PID_TRACKER)) {	      \
+		__lpf = lttng_rcu_dereference(__session->pid_tracker);	      \
+		if (__lpf && !lttng_pid_tracker_lookup(__lpf, current->tgid)) \
+			return;						      \
+	}								      \
+	if (unlikely(__armed & LTTNG_EVENT_ARMED_ID_TRACKERS)		      \
+			&& !lttng_id_trackers_match(__session))		      \
 		return;							      \
-	if (unlikely(!READ_ONCE(__event->enabled)))			      \
+	if (unlikely(__armed & LTTNG_EVENT_ARMED_GATE)			      \
+			&& !lttng_gates_match(__event))			      \
 		return;							      \
-	__lpf = lttng_rcu_dereference(__session->pid_tracker);		      \
-	if (__lpf && likely(!lttng_pid_tracker_lookup(__lpf, current->tgid))) \
+	if (!lttng_channel_sample(__chan, smp_processor_id()))		      \
 		return;							      \
 	__orig_dynamic_len_offset = this_cpu_ptr(&lttng_dynamic_len_stack)->offset; \
 	__dynamic_len_idx = __orig_dynamic_len_offset;			      \
 	_code_pre							      \
+	__profile_ts = lttng_probe_profile_begin(lttng_event_profile(__event)); \
 	if (unlikely(!list_empty(&__event->bytecode_runtime_head))) {	      \
-		struct lttng_bytecode_runtime *bc_runtime;		      \
 		int __filter_record = __event->has_enablers_without_bytecode; \
 									      \
-		__event_prepare_filter_stack__##_name(__stackvar.__filter_stack_data, \
-				tp_locvar, _args);				      \
-		lttng_list_for_each_entry_rcu(bc_runtime, &__event->bytecode_runtime_head, node) { \
-			if (unlikely(bc_runtime->filter(bc_runtime, &__lttng_probe_ctx,	      \
-					__stackvar.__filter_stack_data) & LTTNG_FILTER_RECORD_FLAG)) \
-				__filter_record = 1;			      \
+		if (likely(!__filter_record)) {				      \
+			__filter_record = lttng_event_filter_context(__event, &__lttng_probe_ctx); \
+			if (__filter_record < 0) {			      \
+				__event_prepare_filter_stack__##_name(__stackvar.__filter_stack_data, \
+						tp_locvar, _args);	      \
+				__lttng_probe_ctx.filter_stack_data =	      \
+					__stackvar.__filter_stack_data;	      \
+				__filter_record = lttng_event_filter_payload(__event, \
+						&__lttng_probe_ctx, __stackvar.__filter_stack_data); \
+			}						      \
 		}							      \
+		__profile_ts = lttng_probe_profile_phase(lttng_event_profile(__event), \
+				LTTNG_PROBE_PROFILE_FILTER, __profile_ts);    \
 		if (likely(!__filter_record))				      \
 			goto __post;					      \
 	}								      \
-	__event_len = __event_get_size__##_name(tp_locvar, _args);	      \
+	if (unlikely(__armed & LTTNG_EVENT_ARMED_GATE_ACTION))		      \
+		lttng_gates_act(__event);				      \
+	if (lttng_event_count_hit(__event, __armed))			      \
+		goto __post;						      \
+	/* Context guards reading the payload run at reservation. */	      \
+	if (unlikely(__armed & LTTNG_EVENT_ARMED_CTX_GUARD)		      \
+			&& !__lttng_probe_ctx.filter_stack_data) {	      \
+		__event_prepare_filter_stack__##_name(__stackvar.__filter_stack_data, \
+				tp_locvar, _args);			      \
+		__lttng_probe_ctx.filter_stack_data =			      \
+			__stackvar.__filter_stack_data;			      \
+	}								      \
+	_lttng_table_serialize(_name, tp_locvar, _args)			      \
+	__event_len = __event_get_size__##_name(tp_locvar,		      \
+			__chan->packed, READ_ONCE(__chan->user_capture_max), \
+			&__lttng_probe_ctx, _args);			      \
 	if (unlikely(__event_len < 0)) {				      \
 		lib_ring_buffer_lost_event_too_big(__chan->chan);	      \
 		goto __post;						      \
@@ -1166,10 +2057,25 @@ static void __event_probe__##_name(void *__data, _proto)		      \
 	lib_ring_buffer_ctx_init(&__ctx, __chan->chan, &__lttng_probe_ctx, __event_len,  \
 				 __event_align, -1);			      \
 	__ret = __chan->ops->event_reserve(&__ctx, __event->id);	      \
+	__profile_ts = lttng_probe_profile_phase(lttng_event_profile(__event), \
+			LTTNG_PROBE_PROFILE_RESERVE, __profile_ts);	      \
 	if (__ret < 0)							      \
 		goto __post;						      \
-	_fields								      \
+	if (__event_fixed_layout___##_name && !__chan->packed) {	      \
+		struct __event_fixed_layout__##_name __fixed =		      \
+			__event_fixed_fill__##_name(tp_locvar, _args);	      \
+									      \
+		__chan->ops->event_write(&__ctx, &__fixed, __event_len);      \
+	} else {							      \
+		_fields							      \
+	}								      \
+	if (__event_single_pass___##_name)				      \
+		__chan->ops->event_shrink(&__ctx);			      \
+	__profile_ts = lttng_probe_profile_phase(lttng_event_profile(__event), \
+			LTTNG_PROBE_PROFILE_SERIALIZE, __profile_ts);	      \
 	__chan->ops->event_commit(&__ctx);				      \
+	lttng_probe_profile_phase(lttng_event_profile(__event),	      \
+			LTTNG_PROBE_PROFILE_COMMIT, __profile_ts);	      \
 __post:									      \
 	_code_post							      \
 	barrier();	/* use before un-reserve. */			      \
@@ -1179,6 +2085,7 @@ __post:									      \
 
 #undef LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS
 #define LTTNG_TRACEPOINT_EVENT_CLASS_CODE_NOARGS(_name, _locvar, _code_pre, _fields, _code_post) \
+_lttng_event_fanout_probe_noargs(_name, PARAMS(_locvar), PARAMS(_code_pre), PARAMS(_fields), PARAMS(_code_post)) \
 static void __event_probe__##_name(void *__data)			      \
 {									      \
 	struct probe_local_vars { _locvar };				      \
@@ -1186,6 +2093,7 @@ static void __event_probe__##_name(void *__data)			      \
 	struct lttng_probe_ctx __lttng_probe_ctx = {				      \
 		.event = __event,				              \
 		.interruptible = !irqs_disabled(),			      \
+		.sampled = 1,						      \
 	};								      \
 	struct lttng_channel *__chan = __event->chan;			      \
 	struct lttng_session *__session = __chan->session;		      \
@@ -1202,36 +2110,68 @@ static void __event_probe__##_name(void *__data)			      \
 	struct probe_local_vars *tp_locvar __attribute__((unused)) =	      \
 			&__tp_locvar;					      \
 	struct lttng_pid_tracker *__lpf;				      \
+	unsigned long __armed;						      \
+	cycles_t __profile_ts;						      \
 									      \
+	__armed = READ_ONCE(__event->armed);				      \
+	if (unlikely(!(__armed & LTTNG_EVENT_ARMED)))			      \
+		return;							      \
 	if (!_TP_SESSION_CHECK(session, __session))			      \
 		return;							      \
-	if (unlikely(!READ_ONCE(__session->active)))			      \
+	if (lttng_session_paused(__session, __armed))			      \
 		return;							      \
-	if (unlikely(!READ_ONCE(__chan->enabled)))			      \
+	if (unlikely(__armed & LTTNG_EVENT_ARMED_PID_TRACKER)) {	      \
+		__lpf = lttng_rcu_dereference(__session->pid_tracker);	      \
+		if (__lpf && !lttng_pid_tracker_lookup(__lpf, current->tgid)) \
+			return;						      \
+	}								      \
+	if (unlikely(__armed & LTTNG_EVENT_ARMED_ID_TRACKERS)		      \
+			&& !lttng_id_trackers_match(__session))		      \
 		return;							      \
-	if (unlikely(!READ_ONCE(__event->enabled)))			      \
+	if (unlikely(__armed & LTTNG_EVENT_ARMED_GATE)			      \
+			&& !lttng_gates_match(__event))			      \
 		return;							      \
-	__lpf = lttng_rcu_dereference(__session->pid_tracker);		      \
-	if (__lpf && likely(!lttng_pid_tracker_lookup(__lpf, current->tgid)))  \
+	if (!lttng_channel_sample(__chan, smp_processor_id()))		      \
 		return;							      \
 	__orig_dynamic_len_offset = this_cpu_ptr(&lttng_dynamic_len_stack)->offset; \
 	__dynamic_len_idx = __orig_dynamic_len_offset;			      \
 	_code_pre							      \
+	__profile_ts = lttng_probe_profile_begin(lttng_event_profile(__event)); \
 	if (unlikely(!list_empty(&__event->bytecode_runtime_head))) {	      \
-		struct lttng_bytecode_runtime *bc_runtime;		      \
 		int __filter_record = __event->has_enablers_without_bytecode; \
 									      \
-		__event_prepare_filter_stack__##_name(__stackvar.__filter_stack_data, \
-				tp_locvar);				      \
-		lttng_list_for_each_entry_rcu(bc_runtime, &__event->bytecode_runtime_head, node) { \
-			if (unlikely(bc_runtime->filter(bc_runtime, &__lttng_probe_ctx,	\
-					__stackvar.__filter_stack_data) & LTTNG_FILTER_RECORD_FLAG)) \
-				__filter_record = 1;			      \
+		if (likely(!__filter_record)) {				      \
+			__filter_record = lttng_event_filter_context(__event, &__lttng_probe_ctx); \
+			if (__filter_record < 0) {			      \
+				__event_prepare_filter_stack__##_name(__stackvar.__filter_stack_data, \
+						tp_locvar);		      \
+				__lttng_probe_ctx.filter_stack_data =	      \
+					__stackvar.__filter_stack_data;	      \
+				__filter_record = lttng_event_filter_payload(__event, \
+						&__lttng_probe_ctx, __stackvar.__filter_stack_data); \
+			}						      \
 		}							      \
+		__profile_ts = lttng_probe_profile_phase(lttng_event_profile(__event), \
+				LTTNG_PROBE_PROFILE_FILTER, __profile_ts);    \
 		if (likely(!__filter_record))				      \
 			goto __post;					      \
 	}								      \
-	__event_len = __event_get_size__##_name(tp_locvar);		      \
+	if (unlikely(__armed & LTTNG_EVENT_ARMED_GATE_ACTION))		      \
+		lttng_gates_act(__event);				      \
+	if (lttng_event_count_hit(__event, __armed))			      \
+		goto __post;						      \
+	/* Context guards reading the payload run at reservation. */	      \
+	if (unlikely(__armed & LTTNG_EVENT_ARMED_CTX_GUARD)		      \
+			&& !__lttng_probe_ctx.filter_stack_data) {	      \
+		__event_prepare_filter_stack__##_name(__stackvar.__filter_stack_data, \
+				tp_locvar);				      \
+		__lttng_probe_ctx.filter_stack_data =			      \
+			__stackvar.__filter_stack_data;			      \
+	}								      \
+	_lttng_table_serialize(_name, tp_locvar)			      \
+	__event_len = __event_get_size__##_name(tp_locvar, __chan->packed,  \
+			READ_ONCE(__chan->user_capture_max),		      \
+			&__lttng_probe_ctx);				      \
 	if (unlikely(__event_len < 0)) {				      \
 		lib_ring_buffer_lost_event_too_big(__chan->chan);	      \
 		goto __post;						      \
@@ -1240,10 +2180,25 @@ static void __event_probe__##_name(void *__data)			      \
 	lib_ring_buffer_ctx_init(&__ctx, __chan->chan, &__lttng_probe_ctx, __event_len,  \
 				 __event_align, -1);			      \
 	__ret = __chan->ops->event_reserve(&__ctx, __event->id);	      \
+	__profile_ts = lttng_probe_profile_phase(lttng_event_profile(__event), \
+			LTTNG_PROBE_PROFILE_RESERVE, __profile_ts);	      \
 	if (__ret < 0)							      \
 		goto __post;						      \
-	_fields								      \
+	if (__event_fixed_layout___##_name && !__chan->packed) {	      \
+		struct __event_fixed_layout__##_name __fixed =		      \
+			__event_fixed_fill__##_name(tp_locvar);	      \
+									      \
+		__chan->ops->event_write(&__ctx, &__fixed, __event_len);      \
+	} else {							      \
+		_fields							      \
+	}								      \
+	if (__event_single_pass___##_name)				      \
+		__chan->ops->event_shrink(&__ctx);			      \
+	__profile_ts = lttng_probe_profile_phase(lttng_event_profile(__event), \
+			LTTNG_PROBE_PROFILE_SERIALIZE, __profile_ts);	      \
 	__chan->ops->event_commit(&__ctx);				      \
+	lttng_probe_profile_phase(lttng_event_profile(__event),	      \
+			LTTNG_PROBE_PROFILE_COMMIT, __profile_ts);	      \
 __post:									      \
 	_code_post							      \
 	barrier();	/* use before un-reserve. */			      \
@@ -1269,6 +2224,13 @@ __post:									      \
 #define TP_PROBE_CB(_template)	&__event_probe__##_template
 #endif
 
+#undef TP_FANOUT_CB
+#ifdef LTTNG_EVENT_FANOUT
+#define TP_FANOUT_CB(_template)	&__event_fanout__##_template
+#else
+#define TP_FANOUT_CB(_template)	NULL
+#endif
+
 #undef LTTNG_TRACEPOINT_EVENT_INSTANCE_MAP_NOARGS
 #define LTTNG_TRACEPOINT_EVENT_INSTANCE_MAP_NOARGS(_template, _name, _map)	\
 static const struct lttng_event_desc __event_desc___##_map = {		\
@@ -1276,8 +2238,10 @@ static const struct lttng_event_desc __event_desc___##_map = {		\
 	.name = #_map,					     		\
 	.kname = #_name,				     		\
 	.probe_callback = (void *) TP_PROBE_CB(_template),   		\
+	.fanout_callback = (void *) TP_FANOUT_CB(_template),		\
 	.nr_fields = ARRAY_SIZE(__event_fields___##_template),		\
 	.owner = THIS_MODULE,				     		\
+	.single_pass = __event_single_pass___##_template,		\
 };
 
 #undef LTTNG_TRACEPOINT_EVENT_INSTANCE_MAP
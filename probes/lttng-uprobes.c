@@ -10,7 +10,9 @@
  */
 
 #include <linux/fdtable.h>
+#include <linux/hash.h>
 #include <linux/list.h>
+#include <linux/math64.h>
 #include <linux/module.h>
 #include <linux/namei.h>
 #include <linux/slab.h>
@@ -18,15 +20,81 @@
 #include <lttng-events.h>
 #include <lttng-tracer.h>
 #include <wrapper/irqflags.h>
+#include <wrapper/list.h>
 #include <wrapper/ringbuffer/frontend_types.h>
+#include <wrapper/trace-clock.h>
 #include <wrapper/uprobes.h>
 #include <wrapper/vmalloc.h>
 
+/*
+ * A single uprobe consumer is registered per instrumented (inode, offset)
+ * pair, whatever the number of events and sessions instrumenting it. The
+ * site dispatches each hit to the handlers of its events, so instrumenting
+ * a callsite already instrumented by another event or session neither
+ * registers a uprobe nor adds a consumer to the uprobe.
+ *
+ * Sites are looked up by (inode, offset) in a hash table when callsites
+ * are added, and never on a hit. The site table and the per-site handler
+ * lists are updated under uprobe_site_mutex; the handler lists are walked
+ * under RCU by the consumer.
+ *
+ * Each handler samples the hits of its callsite before they reach the
+ * ring buffer, so that sampled out hits of hot callsites pay neither
+ * for the reservation nor for the capture of contexts such as the user
+ * callstack. The sampling state is shared by the cpus hitting the
+ * callsite.
+ */
+struct lttng_uprobe_site {
+	struct hlist_node hlist;		/* Site hash table entry */
+	struct inode *inode;
+	loff_t offset;
+	struct uprobe_consumer up_consumer;
+	struct list_head handlers;		/* RCU list of handlers */
+};
+
+#define LTTNG_UPROBE_SITE_HASH_BITS	10
+#define LTTNG_UPROBE_SITE_TABLE_SIZE	(1 << LTTNG_UPROBE_SITE_HASH_BITS)
+
+/* Number of offsets copied from user-space at once. */
+#define LTTNG_UPROBE_CALLSITES_CHUNK	(PAGE_SIZE / sizeof(uint64_t))
+
+static struct hlist_head uprobe_site_table[LTTNG_UPROBE_SITE_TABLE_SIZE];
+static DEFINE_MUTEX(uprobe_site_mutex);
+
+/*
+ * Return whether a hit of the callsite must be recorded, given the
+ * sampling period and interval of its event.
+ */
 static
-int lttng_uprobes_handler_pre(struct uprobe_consumer *uc, struct pt_regs *regs)
+bool lttng_uprobes_sample(struct lttng_uprobe_handler *uprobe_handler)
+{
+	struct lttng_event *event = uprobe_handler->event;
+	unsigned int period = event->u.uprobe.sample_period;
+	uint64_t interval = event->u.uprobe.sample_interval;
+
+	if (period > 1) {
+		if (atomic_inc_return(&uprobe_handler->sample_count) < period)
+			return false;
+		atomic_sub(period, &uprobe_handler->sample_count);
+	}
+	if (interval) {
+		uint64_t now = trace_clock_read64();
+		s64 next = atomic64_read(&uprobe_handler->sample_next);
+
+		if ((int64_t) (now - next) < 0)
+			return false;
+		/* Concurrent hits: a single one claims the interval. */
+		if (atomic64_cmpxchg(&uprobe_handler->sample_next, next,
+				now + interval) != next)
+			return false;
+	}
+	return true;
+}
+
+static
+void lttng_uprobes_record(struct lttng_uprobe_handler *uprobe_handler,
+		struct pt_regs *regs)
 {
-	struct lttng_uprobe_handler *uprobe_handler =
-		container_of(uc, struct lttng_uprobe_handler, up_consumer);
 	struct lttng_event *event = uprobe_handler->event;
 	struct lttng_probe_ctx lttng_probe_ctx = {
 		.event = event,
@@ -40,19 +108,17 @@ int lttng_uprobes_handler_pre(struct uprobe_consumer *uc, struct pt_regs *regs)
 		unsigned long ip;
 	} payload;
 
-	if (unlikely(!READ_ONCE(chan->session->active)))
-		return 0;
-	if (unlikely(!READ_ONCE(chan->enabled)))
-		return 0;
-	if (unlikely(!READ_ONCE(event->enabled)))
-		return 0;
+	if (unlikely(!(READ_ONCE(event->armed) & LTTNG_EVENT_ARMED)))
+		return;
+	if (!lttng_uprobes_sample(uprobe_handler))
+		return;
 
 	lib_ring_buffer_ctx_init(&ctx, chan->chan, &lttng_probe_ctx,
 		sizeof(payload), lttng_alignof(payload), -1);
 
 	ret = chan->ops->event_reserve(&ctx, event->id);
 	if (ret < 0)
-		return 0;
+		return;
 
 	/* Event payload. */
 	payload.ip = (unsigned long)instruction_pointer(regs);
@@ -60,6 +126,19 @@ int lttng_uprobes_handler_pre(struct uprobe_consumer *uc, struct pt_regs *regs)
 	lib_ring_buffer_align_ctx(&ctx, lttng_alignof(payload));
 	chan->ops->event_write(&ctx, &payload, sizeof(payload));
 	chan->ops->event_commit(&ctx);
+}
+
+static
+int lttng_uprobes_handler_pre(struct uprobe_consumer *uc, struct pt_regs *regs)
+{
+	struct lttng_uprobe_site *site =
+		container_of(uc, struct lttng_uprobe_site, up_consumer);
+	struct lttng_uprobe_handler *uprobe_handler;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(uprobe_handler, &site->handlers, site_node)
+		lttng_uprobes_record(uprobe_handler, regs);
+	rcu_read_unlock();
 	return 0;
 }
 
@@ -142,61 +221,173 @@ error:
 	return inode;
 }
 
-int lttng_uprobes_add_callsite(struct lttng_event *event,
-	struct lttng_kernel_event_callsite __user *callsite)
+static
+struct hlist_head *lttng_uprobe_site_bucket(struct inode *inode, loff_t offset)
 {
-	int ret = 0;
-	struct lttng_uprobe_handler *uprobe_handler;
+	return &uprobe_site_table[hash_long((unsigned long) inode ^
+			(unsigned long) offset, LTTNG_UPROBE_SITE_HASH_BITS)];
+}
+
+static
+struct lttng_uprobe_site *lttng_uprobe_site_lookup(struct inode *inode,
+		loff_t offset)
+{
+	struct hlist_head *head = lttng_uprobe_site_bucket(inode, offset);
+	struct lttng_uprobe_site *site;
 
-	if (!event) {
-		ret = -EINVAL;
-		goto end;
+	lttng_hlist_for_each_entry(site, head, hlist) {
+		if (site->inode == inode && site->offset == offset)
+			return site;
 	}
+	return NULL;
+}
+
+/*
+ * Attach a handler of the event to the site of an offset, registering the
+ * uprobe of the site if it is the first handler. Adding an offset already
+ * instrumented by the event is a no-op.
+ * Called with uprobe_site_mutex held.
+ */
+static
+int lttng_uprobes_add_offset(struct lttng_event *event, loff_t offset)
+{
+	struct inode *inode = event->u.uprobe.inode;
+	struct lttng_uprobe_handler *uprobe_handler;
+	struct lttng_uprobe_site *site;
+	int ret;
 
+	site = lttng_uprobe_site_lookup(inode, offset);
+	if (site) {
+		list_for_each_entry(uprobe_handler, &site->handlers, site_node) {
+			if (uprobe_handler->event == event)
+				return 0;
+		}
+	}
 	uprobe_handler = kzalloc(sizeof(struct lttng_uprobe_handler), GFP_KERNEL);
 	if (!uprobe_handler) {
 		printk(KERN_WARNING "Error allocating uprobe_uprobe_handlers");
+		return -ENOMEM;
+	}
+	uprobe_handler->event = event;
+	uprobe_handler->offset = offset;
+	if (site) {
+		/* Ensure the memory we just allocated don't trigger page faults. */
+		wrapper_vmalloc_sync_all();
+		uprobe_handler->site = site;
+		list_add_tail_rcu(&uprobe_handler->site_node, &site->handlers);
+		list_add(&uprobe_handler->node, &event->u.uprobe.head);
+		return 0;
+	}
+
+	site = kzalloc(sizeof(*site), GFP_KERNEL);
+	if (!site) {
 		ret = -ENOMEM;
-		goto end;
+		goto site_error;
+	}
+	site->inode = igrab(inode);
+	if (!site->inode) {
+		ret = -EBADF;
+		goto inode_error;
 	}
+	site->offset = offset;
+	site->up_consumer.handler = lttng_uprobes_handler_pre;
+	INIT_LIST_HEAD(&site->handlers);
+	uprobe_handler->site = site;
+	list_add_tail(&uprobe_handler->site_node, &site->handlers);
 
 	/* Ensure the memory we just allocated don't trigger page faults. */
 	wrapper_vmalloc_sync_all();
 
-	uprobe_handler->event = event;
-	uprobe_handler->up_consumer.handler = lttng_uprobes_handler_pre;
-
-	ret = copy_from_user(&uprobe_handler->offset, &callsite->u.uprobe.offset, sizeof(uint64_t));
-	if (ret) {
-		goto register_error;
-	}
-
-	ret = wrapper_uprobe_register(event->u.uprobe.inode,
-		      uprobe_handler->offset, &uprobe_handler->up_consumer);
+	ret = wrapper_uprobe_register(inode, offset, &site->up_consumer);
 	if (ret) {
 		printk(KERN_WARNING "Error registering probe on inode %lu "
-		       "and offset 0x%llx\n", event->u.uprobe.inode->i_ino,
-		       uprobe_handler->offset);
+		       "and offset 0x%llx\n", inode->i_ino,
+		       (unsigned long long) offset);
 		ret = -1;
 		goto register_error;
 	}
-
+	hlist_add_head(&site->hlist, lttng_uprobe_site_bucket(inode, offset));
 	list_add(&uprobe_handler->node, &event->u.uprobe.head);
-
-	return ret;
+	return 0;
 
 register_error:
+	iput(site->inode);
+inode_error:
+	kfree(site);
+site_error:
 	kfree(uprobe_handler);
-end:
+	return ret;
+}
+
+int lttng_uprobes_add_callsite(struct lttng_event *event,
+	struct lttng_kernel_event_callsite __user *callsite)
+{
+	uint64_t offset;
+	int ret;
+
+	if (!event)
+		return -EINVAL;
+	if (copy_from_user(&offset, &callsite->u.uprobe.offset, sizeof(uint64_t)))
+		return -EFAULT;
+	mutex_lock(&uprobe_site_mutex);
+	ret = lttng_uprobes_add_offset(event, offset);
+	mutex_unlock(&uprobe_site_mutex);
 	return ret;
 }
 EXPORT_SYMBOL_GPL(lttng_uprobes_add_callsite);
 
-int lttng_uprobes_register(const char *name, int fd, struct lttng_event *event)
+/*
+ * On error, the callsites added before the failing one stay instrumented.
+ */
+int lttng_uprobes_add_callsites(struct lttng_event *event,
+	struct lttng_kernel_event_callsites __user *ucallsites)
+{
+	struct lttng_kernel_event_callsites callsites;
+	const uint64_t __user *uoffsets;
+	uint64_t *offsets;
+	uint32_t i, j, nr;
+	int ret = 0;
+
+	if (!event)
+		return -EINVAL;
+	if (copy_from_user(&callsites, ucallsites, sizeof(callsites)))
+		return -EFAULT;
+	if (callsites.nr_callsites > LTTNG_KERNEL_CALLSITES_MAX)
+		return -EINVAL;
+	uoffsets = (const uint64_t __user *) (unsigned long) callsites.offsets;
+	offsets = kmalloc(LTTNG_UPROBE_CALLSITES_CHUNK * sizeof(uint64_t),
+			GFP_KERNEL);
+	if (!offsets)
+		return -ENOMEM;
+	mutex_lock(&uprobe_site_mutex);
+	for (i = 0; i < callsites.nr_callsites; i += nr) {
+		nr = min_t(uint32_t, callsites.nr_callsites - i,
+				LTTNG_UPROBE_CALLSITES_CHUNK);
+		if (copy_from_user(offsets, uoffsets + i, nr * sizeof(uint64_t))) {
+			ret = -EFAULT;
+			goto end;
+		}
+		for (j = 0; j < nr; j++) {
+			ret = lttng_uprobes_add_offset(event, offsets[j]);
+			if (ret)
+				goto end;
+		}
+	}
+end:
+	mutex_unlock(&uprobe_site_mutex);
+	kfree(offsets);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(lttng_uprobes_add_callsites);
+
+int lttng_uprobes_register(const char *name, int fd, uint32_t sample_period,
+		uint64_t sample_interval, struct lttng_event *event)
 {
 	int ret = 0;
 	struct inode *inode;
 
+	if (sample_interval > LTTNG_KERNEL_UPROBE_SAMPLE_INTERVAL_MAX)
+		return -EINVAL;
 	ret = lttng_create_uprobe_event(name, event);
 	if (ret)
 		goto error;
@@ -209,6 +400,12 @@ int lttng_uprobes_register(const char *name, int fd, struct lttng_event *event)
 	}
 	event->u.uprobe.inode = inode;
 	INIT_LIST_HEAD(&event->u.uprobe.head);
+	event->u.uprobe.sample_period = sample_period;
+	/* Microsecond resolution keeps the conversion from overflowing. */
+	if (sample_interval)
+		event->u.uprobe.sample_interval = max_t(uint64_t,
+			div_u64(div_u64(sample_interval, NSEC_PER_USEC)
+				* trace_clock_freq(), USEC_PER_SEC), 1);
 
 	return 0;
 
@@ -223,14 +420,34 @@ EXPORT_SYMBOL_GPL(lttng_uprobes_register);
 void lttng_uprobes_unregister(struct lttng_event *event)
 {
 	struct lttng_uprobe_handler *iter, *tmp;
+	struct lttng_uprobe_site *site;
+	struct hlist_node *next;
+	HLIST_HEAD(unused_sites);
 
 	/*
-	 * Iterate over the list of handler, remove each handler from the list
-	 * and free the struct.
+	 * Detach each handler from its site, and unregister the sites left
+	 * without handlers. Unregistering a uprobe waits for its consumers
+	 * in progress, and the grace period for the sites still in use.
 	 */
+	mutex_lock(&uprobe_site_mutex);
+	list_for_each_entry(iter, &event->u.uprobe.head, node) {
+		site = iter->site;
+		list_del_rcu(&iter->site_node);
+		if (!list_empty(&site->handlers))
+			continue;
+		hlist_del(&site->hlist);
+		wrapper_uprobe_unregister(site->inode, site->offset,
+			&site->up_consumer);
+		hlist_add_head(&site->hlist, &unused_sites);
+	}
+	mutex_unlock(&uprobe_site_mutex);
+	synchronize_rcu();
+
+	lttng_hlist_for_each_entry_safe(site, next, &unused_sites, hlist) {
+		iput(site->inode);
+		kfree(site);
+	}
 	list_for_each_entry_safe(iter, tmp, &event->u.uprobe.head, node) {
-		wrapper_uprobe_unregister(event->u.uprobe.inode, iter->offset,
-			&iter->up_consumer);
 		list_del(&iter->node);
 		kfree(iter);
 	}
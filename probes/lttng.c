@@ -16,6 +16,8 @@
 #include <linux/slab.h>
 #include <linux/mm.h>
 #include <linux/miscdevice.h>
+#include <linux/uio.h>
+#include <linux/version.h>
 #include <wrapper/vmalloc.h>
 #include <lttng-events.h>
 
@@ -31,38 +33,39 @@
 /* Events written through logger are truncated at 1024 bytes */
 #define LTTNG_LOGGER_COUNT_MAX	1024
 #define LTTNG_LOGGER_FILE	"lttng-logger"
+/* Bytes copied at once to find the newlines in lines mode */
+#define LTTNG_LOGGER_SCAN_CHUNK	128
+
+/* iov_iter_iovec() appeared in 3.19. */
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,19,0))
+#define LTTNG_LOGGER_WRITE_ITER
+#endif
 
 DEFINE_TRACE(lttng_logger);
+DEFINE_TRACE(lttng_calibrate);
+
+/* Fired by LTTNG_KERNEL_CALIBRATE_OP_TRACEPOINT. */
+noinline
+void lttng_calibrate_tracepoint(unsigned int iteration)
+{
+	trace_lttng_calibrate(iteration);
+}
 
 static struct proc_dir_entry *lttng_logger_dentry;
 
-/**
- * lttng_logger_write - write a userspace string into the trace system
- * @file: file pointer
- * @user_buf: user string
- * @count: length to copy
- * @ppos: file position
- *
- * Copy a userspace string into a trace event named "lttng:logger".
- * Copies at most @count bytes into the event "msg" dynamic array.
- * Truncates the count at LTTNG_LOGGER_COUNT_MAX. Returns the number of
- * bytes copied from the source.
- * Return -1 on error, with EFAULT errno.
+/*
+ * Trace a message of @count bytes at most LTTNG_LOGGER_COUNT_MAX, after
+ * pinning its pages so that the probe does not fault on it. Returns
+ * @count, or -EFAULT.
  */
 static
-ssize_t lttng_logger_write(struct file *file, const char __user *user_buf,
-		    size_t count, loff_t *ppos)
+ssize_t lttng_logger_trace(const char __user *user_buf, size_t count)
 {
 	int nr_pages = 1, i;
 	unsigned long uaddr = (unsigned long) user_buf;
 	struct page *pages[2];
-	ssize_t written;
 	int ret;
 
-	/* Truncate count */
-	if (unlikely(count > LTTNG_LOGGER_COUNT_MAX))
-		count = LTTNG_LOGGER_COUNT_MAX;
-
 	/* How many pages are we dealing with ? */
 	if (unlikely((uaddr & PAGE_MASK) != ((uaddr + count) & PAGE_MASK)))
 		nr_pages = 2;
@@ -74,23 +77,189 @@ ssize_t lttng_logger_write(struct file *file, const char __user *user_buf,
 			BUG_ON(ret != 1);
 			put_page(pages[0]);
 		}
-		written = -EFAULT;
-		goto end;
+		return -EFAULT;
 	}
 
 	/* Trace the event */
 	trace_lttng_logger(user_buf, count);
-	written = count;
-	*ppos += written;
 
 	for (i = 0; i < nr_pages; i++)
 		put_page(pages[i]);
-end:
+	return count;
+}
+
+/*
+ * Return the length of the line at the beginning of @user_buf, up to
+ * @count bytes, excluding its newline, or -EFAULT.
+ */
+static
+ssize_t lttng_logger_line_len(const char __user *user_buf, size_t count)
+{
+	char chunk[LTTNG_LOGGER_SCAN_CHUNK];
+	size_t pos = 0;
+
+	while (pos < count) {
+		size_t len = min_t(size_t, count - pos, sizeof(chunk));
+		const char *nl;
+
+		if (copy_from_user(chunk, user_buf + pos, len))
+			return -EFAULT;
+		nl = memchr(chunk, '\n', len);
+		if (nl)
+			return pos + (nl - chunk);
+		pos += len;
+	}
+	return count;
+}
+
+/*
+ * Trace each line of @user_buf as one event, truncated at
+ * LTTNG_LOGGER_COUNT_MAX, empty lines being skipped. The last line needs
+ * no newline. Returns the number of bytes consumed, or -EFAULT if none.
+ */
+static
+ssize_t lttng_logger_trace_lines(const char __user *user_buf, size_t count)
+{
+	size_t pos = 0;
+
+	while (pos < count) {
+		ssize_t len, ret;
+
+		len = lttng_logger_line_len(user_buf + pos, count - pos);
+		if (len < 0)
+			return pos ? pos : len;
+		if (len) {
+			ret = lttng_logger_trace(user_buf + pos,
+				min_t(size_t, len, LTTNG_LOGGER_COUNT_MAX));
+			if (ret < 0)
+				return pos ? pos : ret;
+		}
+		/* Skip the newline. */
+		pos += min_t(size_t, len + 1, count - pos);
+		cond_resched();
+	}
+	return pos;
+}
+
+static
+ssize_t lttng_logger_trace_buf(struct file *file,
+		const char __user *user_buf, size_t count)
+{
+	if (READ_ONCE(file->private_data) ==
+			(void *) (unsigned long) LTTNG_KERNEL_LOGGER_MODE_LINES)
+		return lttng_logger_trace_lines(user_buf, count);
+	/* Truncate count */
+	if (unlikely(count > LTTNG_LOGGER_COUNT_MAX))
+		count = LTTNG_LOGGER_COUNT_MAX;
+	return lttng_logger_trace(user_buf, count);
+}
+
+/**
+ * lttng_logger_write - write a userspace string into the trace system
+ * @file: file pointer
+ * @user_buf: user string
+ * @count: length to copy
+ * @ppos: file position
+ *
+ * Copy a userspace string into a trace event named "lttng:logger".
+ * Copies at most @count bytes into the event "msg" dynamic array.
+ * Truncates the count at LTTNG_LOGGER_COUNT_MAX. In lines mode, each
+ * line is copied into its own event, and the whole @count is consumed.
+ * Returns the number of bytes copied from the source.
+ * Return -1 on error, with EFAULT errno.
+ */
+static
+ssize_t lttng_logger_write(struct file *file, const char __user *user_buf,
+		    size_t count, loff_t *ppos)
+{
+	ssize_t written;
+
+	written = lttng_logger_trace_buf(file, user_buf, count);
+	if (written > 0)
+		*ppos += written;
 	return written;
 }
 
+#ifdef LTTNG_LOGGER_WRITE_ITER
+static
+struct iovec lttng_logger_iov(struct iov_iter *from)
+{
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6,4,0))
+	return (struct iovec) {
+		.iov_base = iter_iov_addr(from),
+		.iov_len = iter_iov_len(from),
+	};
+#else
+	return iov_iter_iovec(from);
+#endif
+}
+
+/*
+ * Vectored writes: each segment is handled as a write of its own, so
+ * that writev() emits one event per segment in a single system call.
+ * Stops at the first segment not fully consumed, returning the number
+ * of bytes consumed.
+ */
+static
+ssize_t lttng_logger_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+	ssize_t written = 0;
+
+	while (iov_iter_count(from)) {
+		struct iovec iov = lttng_logger_iov(from);
+		ssize_t ret;
+
+		ret = lttng_logger_trace_buf(iocb->ki_filp,
+				(const char __user *) iov.iov_base, iov.iov_len);
+		if (ret < 0)
+			return written ? written : ret;
+		iov_iter_advance(from, ret);
+		written += ret;
+		if (ret < iov.iov_len)
+			break;
+	}
+	iocb->ki_pos += written;
+	return written;
+}
+#endif /* LTTNG_LOGGER_WRITE_ITER */
+
+static
+int lttng_logger_open(struct inode *inode, struct file *file)
+{
+	/* Holds the logger mode: misc_open() set it to the device. */
+	file->private_data =
+		(void *) (unsigned long) LTTNG_KERNEL_LOGGER_MODE_WRITE;
+	return 0;
+}
+
+static
+long lttng_logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+	switch (cmd) {
+	case LTTNG_KERNEL_LOGGER_MODE:
+		switch ((enum lttng_kernel_logger_mode) arg) {
+		case LTTNG_KERNEL_LOGGER_MODE_WRITE:
+		case LTTNG_KERNEL_LOGGER_MODE_LINES:
+			WRITE_ONCE(file->private_data, (void *) arg);
+			return 0;
+		default:
+			return -EINVAL;
+		}
+	default:
+		return -ENOIOCTLCMD;
+	}
+}
+
 static const struct file_operations lttng_logger_operations = {
+	.open = lttng_logger_open,
 	.write = lttng_logger_write,
+#ifdef LTTNG_LOGGER_WRITE_ITER
+	.write_iter = lttng_logger_write_iter,
+#endif
+	.unlocked_ioctl = lttng_logger_ioctl,
+#ifdef CONFIG_COMPAT
+	.compat_ioctl = lttng_logger_ioctl,
+#endif
 };
 
 static struct miscdevice logger_dev = {
@@ -0,0 +1,334 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-clock-benchmark.c
+ *
+ * LTTng trace clock read cost and cross-cpu monotonicity benchmark.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/workqueue.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/timex.h>
+#include <linux/cpu.h>
+#include <linux/atomic.h>
+#include <linux/math64.h>
+
+#include <lttng-events.h>
+#include <lttng-tracer.h>
+#include <wrapper/trace-clock.h>
+#include <wrapper/vmalloc.h>
+
+/*
+ * Writing to <debugfs>/lttng-clock-benchmark/run measures, for the
+ * mainline monotonic clock wrapper and for the current LTTng trace clock,
+ * the cost of a clock read on each online cpu, and then the monotonicity
+ * of the clock across cpus. Results are read from the "results" file.
+ *
+ * Only one clock plugin can be registered at a time: load the plugin to
+ * evaluate (e.g. lttng-clock-tsc, or the lttng-clock-plugin-test frozen
+ * clock) before writing to "run", and compare with the monotonic clock
+ * line.
+ *
+ * For monotonicity, all cpus read the clock concurrently, each read
+ * being ordered after the load of the largest value read so far by any
+ * cpu. A read returning less than that value reveals a skew between
+ * cpus, and the largest such difference is reported.
+ */
+
+static unsigned int nr_reads = 1000000;
+module_param(nr_reads, uint, 0644);
+MODULE_PARM_DESC(nr_reads, "Number of clock reads per cpu and per clock");
+
+struct benchmark_clock {
+	const char *(*name)(void);
+	u64 (*read64)(void);
+	u64 (*freq)(void);
+};
+
+struct benchmark_result {
+	u64 ns;
+	u64 cycles;
+	u64 inversions;
+	u64 max_skew;		/* Clock units */
+};
+
+struct benchmark_clock_result {
+	char name[LTTNG_KERNEL_SYM_NAME_LEN];
+	u64 freq;
+	unsigned int nr_cpus;
+	struct benchmark_result total;	/* ns, cycles, inversions: summed */
+};
+
+struct benchmark_work {
+	struct work_struct work;
+	const struct benchmark_clock *clock;
+	struct benchmark_result result;
+};
+
+#ifndef CONFIG_HAVE_TRACE_CLOCK
+static
+const char *benchmark_monotonic_name(void)
+{
+	return "monotonic (mainline wrapper)";
+}
+
+static
+u64 benchmark_monotonic_read64(void)
+{
+	return trace_clock_read64_monotonic();
+}
+
+static
+u64 benchmark_monotonic_freq(void)
+{
+	return trace_clock_freq_monotonic();
+}
+#endif /* #ifndef CONFIG_HAVE_TRACE_CLOCK */
+
+static
+const char *benchmark_trace_clock_name(void)
+{
+	return trace_clock_name();
+}
+
+static
+u64 benchmark_trace_clock_read64(void)
+{
+	return trace_clock_read64();
+}
+
+static
+u64 benchmark_trace_clock_freq(void)
+{
+	return trace_clock_freq();
+}
+
+static const struct benchmark_clock benchmark_clocks[] = {
+#ifndef CONFIG_HAVE_TRACE_CLOCK
+	{
+		.name = benchmark_monotonic_name,
+		.read64 = benchmark_monotonic_read64,
+		.freq = benchmark_monotonic_freq,
+	},
+#endif /* #ifndef CONFIG_HAVE_TRACE_CLOCK */
+	{
+		.name = benchmark_trace_clock_name,
+		.read64 = benchmark_trace_clock_read64,
+		.freq = benchmark_trace_clock_freq,
+	},
+};
+
+#define NR_BENCHMARK_CLOCKS	ARRAY_SIZE(benchmark_clocks)
+
+static struct dentry *benchmark_dir;
+static DEFINE_MUTEX(benchmark_mutex);
+static struct benchmark_clock_result benchmark_results[NR_BENCHMARK_CLOCKS];
+static bool benchmark_has_run;
+
+/* Largest clock value read so far by any cpu. */
+static atomic64_t benchmark_last;
+static atomic_t benchmark_arrived;
+static unsigned int benchmark_nr_cpus;
+
+static
+void benchmark_rendezvous(void)
+{
+	atomic_inc(&benchmark_arrived);
+	while (atomic_read(&benchmark_arrived) < benchmark_nr_cpus)
+		cpu_relax();
+}
+
+static
+void benchmark_work_fn(struct work_struct *work)
+{
+	struct benchmark_work *bw = container_of(work, struct benchmark_work, work);
+	const struct benchmark_clock *clock = bw->clock;
+	struct benchmark_result *result = &bw->result;
+	u64 t_begin, c_begin, sink = 0;
+	unsigned int i;
+
+	preempt_disable();
+	t_begin = ktime_get_ns();
+	c_begin = get_cycles();
+	for (i = 0; i < nr_reads; i++)
+		sink += clock->read64();
+	result->cycles = get_cycles() - c_begin;
+	result->ns = ktime_get_ns() - t_begin;
+	preempt_enable();
+	barrier_data(&sink);
+
+	benchmark_rendezvous();
+	preempt_disable();
+	for (i = 0; i < nr_reads; i++) {
+		u64 last, now, old;
+
+		last = atomic64_read(&benchmark_last);
+		/* Read the clock after loading the last value. */
+		smp_mb();
+		now = clock->read64();
+		if ((s64) (last - now) > 0) {
+			result->inversions++;
+			result->max_skew = max(result->max_skew, last - now);
+			continue;
+		}
+		while ((s64) (now - last) > 0) {
+			old = atomic64_cmpxchg(&benchmark_last, last, now);
+			if (old == last)
+				break;
+			last = old;
+		}
+	}
+	preempt_enable();
+}
+
+static
+void benchmark_run_clock(unsigned int c, struct benchmark_work *works)
+{
+	const struct benchmark_clock *clock = &benchmark_clocks[c];
+	struct benchmark_clock_result *cr = &benchmark_results[c];
+	int cpu;
+
+	memset(cr, 0, sizeof(*cr));
+	strlcpy(cr->name, clock->name(), sizeof(cr->name));
+	cr->freq = clock->freq();
+	get_online_cpus();
+	benchmark_nr_cpus = num_online_cpus();
+	atomic_set(&benchmark_arrived, 0);
+	atomic64_set(&benchmark_last, clock->read64());
+	for_each_online_cpu(cpu) {
+		struct benchmark_work *bw = &works[cpu];
+
+		bw->clock = clock;
+		memset(&bw->result, 0, sizeof(bw->result));
+		INIT_WORK(&bw->work, benchmark_work_fn);
+		schedule_work_on(cpu, &bw->work);
+	}
+	for_each_online_cpu(cpu) {
+		struct benchmark_result *result = &works[cpu].result;
+
+		flush_work(&works[cpu].work);
+		cr->total.ns += result->ns;
+		cr->total.cycles += result->cycles;
+		cr->total.inversions += result->inversions;
+		cr->total.max_skew = max(cr->total.max_skew, result->max_skew);
+		cr->nr_cpus++;
+	}
+	put_online_cpus();
+}
+
+static
+ssize_t benchmark_run_write(struct file *file, const char __user *user_buf,
+		size_t count, loff_t *ppos)
+{
+	struct benchmark_work *works;
+	unsigned int c;
+
+	if (!nr_reads)
+		return -EINVAL;
+	works = kcalloc(nr_cpu_ids, sizeof(*works), GFP_KERNEL);
+	if (!works)
+		return -ENOMEM;
+	mutex_lock(&benchmark_mutex);
+	benchmark_has_run = false;
+	/* Keep the clock plugin loaded during the run. */
+	lttng_clock_ref();
+	for (c = 0; c < NR_BENCHMARK_CLOCKS; c++)
+		benchmark_run_clock(c, works);
+	lttng_clock_unref();
+	benchmark_has_run = true;
+	mutex_unlock(&benchmark_mutex);
+	kfree(works);
+	*ppos += count;
+	return count;
+}
+
+static
+int benchmark_results_show(struct seq_file *m, void *v)
+{
+	unsigned int c;
+
+	mutex_lock(&benchmark_mutex);
+	if (!benchmark_has_run)
+		goto end;
+	seq_printf(m, "# nr_reads %u\n", nr_reads);
+	seq_puts(m, "# clock: freq cpus ns/read cycles/read inversions max_skew max_skew_ns\n");
+	for (c = 0; c < NR_BENCHMARK_CLOCKS; c++) {
+		struct benchmark_clock_result *cr = &benchmark_results[c];
+		u64 total = (u64) nr_reads * cr->nr_cpus;
+
+		if (!total)
+			continue;
+		seq_printf(m, "%s: %llu %u %llu %llu %llu %llu %llu\n",
+			cr->name, cr->freq, cr->nr_cpus,
+			div64_u64(cr->total.ns, total),
+			div64_u64(cr->total.cycles, total),
+			cr->total.inversions, cr->total.max_skew,
+			cr->freq ? div64_u64(cr->total.max_skew * NSEC_PER_SEC,
+					cr->freq) : 0);
+	}
+end:
+	mutex_unlock(&benchmark_mutex);
+	return 0;
+}
+
+static
+int benchmark_results_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, benchmark_results_show, NULL);
+}
+
+static const struct file_operations benchmark_run_fops = {
+	.owner = THIS_MODULE,
+	.write = benchmark_run_write,
+};
+
+static const struct file_operations benchmark_results_fops = {
+	.owner = THIS_MODULE,
+	.open = benchmark_results_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static
+int __init lttng_clock_benchmark_init(void)
+{
+	(void) wrapper_lttng_fixup_sig(THIS_MODULE);
+	wrapper_vmalloc_sync_all();
+	benchmark_dir = debugfs_create_dir("lttng-clock-benchmark", NULL);
+	if (IS_ERR_OR_NULL(benchmark_dir)) {
+		printk(KERN_ERR "Error creating LTTng clock benchmark debugfs directory\n");
+		return -ENOMEM;
+	}
+	debugfs_create_file("run", 0200, benchmark_dir, NULL,
+			&benchmark_run_fops);
+	debugfs_create_file("results", 0444, benchmark_dir, NULL,
+			&benchmark_results_fops);
+	return 0;
+}
+
+module_init(lttng_clock_benchmark_init);
+
+static
+void __exit lttng_clock_benchmark_exit(void)
+{
+	debugfs_remove_recursive(benchmark_dir);
+}
+
+module_exit(lttng_clock_benchmark_exit);
+
+MODULE_LICENSE("GPL and additional rights");
+MODULE_AUTHOR("agent <agent@local>");
+MODULE_DESCRIPTION("LTTng trace clock benchmark");
+MODULE_VERSION(__stringify(LTTNG_MODULES_MAJOR_VERSION) "."
+	__stringify(LTTNG_MODULES_MINOR_VERSION) "."
+	__stringify(LTTNG_MODULES_PATCHLEVEL_VERSION)
+	LTTNG_MODULES_EXTRAVERSION);
@@ -0,0 +1,490 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-context-benchmark.c
+ *
+ * LTTng context field cost microbenchmark.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/workqueue.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/timex.h>
+#include <linux/cpu.h>
+#include <linux/smp.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#include <linux/math64.h>
+#include <linux/perf_event.h>
+
+#include <lttng-events.h>
+#include <lttng-tracer.h>
+#include <wrapper/vmalloc.h>
+
+/*
+ * Writing to <debugfs>/lttng-context-benchmark/run records empty events
+ * into an overwrite channel with a single context, for each context
+ * benchmarked, from a work item on each online cpu ("task"), and from
+ * interrupt handlers on each cpu, nesting over the interrupted context
+ * ("irq"). The "none" context measures the channel without context,
+ * which is subtracted from the other ones in the summary. The
+ * get_size callback of fixed size contexts is also timed alone. Results
+ * are read from the "results" file.
+ */
+
+static unsigned int nr_records = 100000;
+module_param(nr_records, uint, 0644);
+MODULE_PARM_DESC(nr_records, "Number of records per cpu and per context, in each mode");
+
+static unsigned int subbuf_size = 262144;
+module_param(subbuf_size, uint, 0644);
+MODULE_PARM_DESC(subbuf_size, "Sub-buffer size, in bytes");
+
+static unsigned int num_subbuf = 4;
+module_param(num_subbuf, uint, 0644);
+MODULE_PARM_DESC(num_subbuf, "Number of sub-buffers per buffer");
+
+static unsigned int callstack_depth = 16;
+module_param(callstack_depth, uint, 0644);
+MODULE_PARM_DESC(callstack_depth, "Maximum depth of callstack contexts");
+
+/* Records per interrupt handler, and timed get_size calls per batch. */
+#define BENCHMARK_IRQ_BATCH	100
+#define BENCHMARK_BATCH		10000
+
+static
+int benchmark_add_callstack_kernel(struct lttng_ctx **ctx)
+{
+	return lttng_add_callstack_to_ctx(ctx,
+			LTTNG_KERNEL_CONTEXT_CALLSTACK_KERNEL, callstack_depth, 0);
+}
+
+static
+int benchmark_add_callstack_kernel_id(struct lttng_ctx **ctx)
+{
+	return lttng_add_callstack_to_ctx(ctx,
+			LTTNG_KERNEL_CONTEXT_CALLSTACK_KERNEL_ID, callstack_depth, 0);
+}
+
+static
+int benchmark_add_callstack_user(struct lttng_ctx **ctx)
+{
+	return lttng_add_callstack_to_ctx(ctx,
+			LTTNG_KERNEL_CONTEXT_CALLSTACK_USER, callstack_depth, 0);
+}
+
+static
+int benchmark_add_perf_cycles(struct lttng_ctx **ctx)
+{
+	return lttng_add_perf_counter_to_ctx(PERF_TYPE_HARDWARE,
+			PERF_COUNT_HW_CPU_CYCLES, "perf_cpu_cpu_cycles", ctx);
+}
+
+static
+int benchmark_add_perf_cpu_clock(struct lttng_ctx **ctx)
+{
+	return lttng_add_perf_counter_to_ctx(PERF_TYPE_SOFTWARE,
+			PERF_COUNT_SW_CPU_CLOCK, "perf_cpu_cpu_clock", ctx);
+}
+
+static
+int benchmark_add_perf_cycles_delta(struct lttng_ctx **ctx)
+{
+	return lttng_add_perf_counter_delta_to_ctx(PERF_TYPE_HARDWARE,
+			PERF_COUNT_HW_CPU_CYCLES, "perf_cpu_cpu_cycles_delta", ctx);
+}
+
+struct benchmark_context {
+	const char *name;
+	int (*add)(struct lttng_ctx **ctx);	/* NULL: no context */
+};
+
+static const struct benchmark_context benchmark_contexts[] = {
+	{ "none", NULL },
+	{ "pid", lttng_add_pid_to_ctx },
+	{ "tid", lttng_add_tid_to_ctx },
+	{ "vpid", lttng_add_vpid_to_ctx },
+	{ "vtid", lttng_add_vtid_to_ctx },
+	{ "ppid", lttng_add_ppid_to_ctx },
+	{ "vppid", lttng_add_vppid_to_ctx },
+	{ "prio", lttng_add_prio_to_ctx },
+	{ "nice", lttng_add_nice_to_ctx },
+	{ "cpu_id", lttng_add_cpu_id_to_ctx },
+	{ "procname", lttng_add_procname_to_ctx },
+	{ "procname_interned", lttng_add_procname_interned_to_ctx },
+	{ "hostname", lttng_add_hostname_to_ctx },
+	{ "hostname_interned", lttng_add_hostname_interned_to_ctx },
+	{ "interruptible", lttng_add_interruptible_to_ctx },
+	{ "need_reschedule", lttng_add_need_reschedule_to_ctx },
+	{ "preemptible", lttng_add_preemptible_to_ctx },
+	{ "migratable", lttng_add_migratable_to_ctx },
+	{ "user_truncated", lttng_add_user_truncated_to_ctx },
+	{ "ratelimit_suppressed", lttng_add_ratelimit_suppressed_to_ctx },
+	{ "callstack_kernel", benchmark_add_callstack_kernel },
+	{ "callstack_kernel_id", benchmark_add_callstack_kernel_id },
+	{ "callstack_user", benchmark_add_callstack_user },
+	{ "perf_cpu_cpu_cycles", benchmark_add_perf_cycles },
+	{ "perf_cpu_cpu_clock", benchmark_add_perf_cpu_clock },
+	{ "perf_cpu_cpu_cycles_delta", benchmark_add_perf_cycles_delta },
+};
+
+#define NR_BENCHMARK_CONTEXTS	ARRAY_SIZE(benchmark_contexts)
+
+struct benchmark_result {
+	u64 records;
+	u64 ns;
+	u64 cycles;
+};
+
+struct benchmark_cpu_result {
+	struct benchmark_result task;
+	struct benchmark_result irq;
+};
+
+struct benchmark_context_result {
+	int ret;			/* Context add result */
+	u64 get_size_ns;		/* Per call, 0: not fixed size */
+};
+
+struct benchmark_work {
+	struct work_struct work;
+	struct lttng_channel *chan;
+	struct benchmark_result *result;
+};
+
+static struct dentry *benchmark_dir;
+static DEFINE_MUTEX(benchmark_mutex);
+/* Indexed by [context * nr_cpu_ids + cpu] */
+static struct benchmark_cpu_result *benchmark_results;
+static struct benchmark_context_result benchmark_context_results[NR_BENCHMARK_CONTEXTS];
+static bool benchmark_has_run;
+static size_t benchmark_size_sink;
+
+static
+void benchmark_record(struct lttng_channel *chan, unsigned int nr,
+		struct benchmark_result *result)
+{
+	struct lttng_event event = {
+		.chan = chan,
+	};
+	struct lttng_probe_ctx probe_ctx = {
+		.event = &event,
+		.interruptible = 0,
+	};
+	u64 t_begin, c_begin;
+	unsigned int i;
+
+	t_begin = ktime_get_ns();
+	c_begin = get_cycles();
+	for (i = 0; i < nr; i++) {
+		struct lib_ring_buffer_ctx ctx;
+
+		lib_ring_buffer_ctx_init(&ctx, chan->chan, &probe_ctx,
+				0, lttng_alignof(uint32_t), -1);
+		if (chan->ops->event_reserve(&ctx, 0) < 0)
+			continue;
+		chan->ops->event_commit(&ctx);
+		result->records++;
+	}
+	result->cycles += get_cycles() - c_begin;
+	result->ns += ktime_get_ns() - t_begin;
+}
+
+static
+void benchmark_work_fn(struct work_struct *work)
+{
+	struct benchmark_work *bw = container_of(work, struct benchmark_work, work);
+
+	benchmark_record(bw->chan, nr_records, bw->result);
+}
+
+static
+void benchmark_irq_fn(void *info)
+{
+	struct benchmark_work *bw = info;
+
+	benchmark_record(bw->chan, BENCHMARK_IRQ_BATCH, bw->result);
+}
+
+/*
+ * Time the get_size callback of a fixed size context field alone, on
+ * the current cpu.
+ */
+static
+u64 benchmark_get_size(struct lttng_ctx_field *field)
+{
+	u64 t_begin, ns = 0;
+	unsigned int i = 0, batch;
+	size_t size = 0;
+
+	if (field->get_size_arg || !field->get_size)
+		return 0;
+	while (i < nr_records) {
+		batch = min_t(unsigned int, nr_records - i, BENCHMARK_BATCH);
+		preempt_disable();
+		t_begin = ktime_get_ns();
+		for (; batch; batch--, i++)
+			size += field->get_size(size & 7);
+		ns += ktime_get_ns() - t_begin;
+		preempt_enable();
+		cond_resched();
+	}
+	/* Keep the calls. */
+	WRITE_ONCE(benchmark_size_sink, size);
+	return div64_u64(ns, nr_records);
+}
+
+static
+int benchmark_run_context(unsigned int c)
+{
+	const struct benchmark_context *context = &benchmark_contexts[c];
+	struct benchmark_context_result *context_result =
+		&benchmark_context_results[c];
+	struct benchmark_work *works;
+	struct lttng_session *session;
+	struct lttng_channel *chan;
+	int cpu, ret = 0;
+
+	memset(context_result, 0, sizeof(*context_result));
+	memset(&benchmark_results[c * nr_cpu_ids], 0,
+		nr_cpu_ids * sizeof(*benchmark_results));
+	session = lttng_session_create();
+	if (!session)
+		return -ENOMEM;
+	chan = lttng_channel_create(session, "relay-overwrite", NULL,
+			subbuf_size, num_subbuf, 0, 0, 0, LTTNG_KERNEL_NUMA_LOCAL,
+			-1, 0, NULL, PER_CPU_CHANNEL);
+	if (!chan) {
+		/* Client module not loaded. */
+		ret = -ENOENT;
+		goto end_session;
+	}
+	chan->header_type = 1;	/* compact */
+	if (context->add) {
+		context_result->ret = context->add(&chan->ctx);
+		/* Contexts not available on this kernel are reported. */
+		if (context_result->ret)
+			goto end_session;
+		context_result->get_size_ns =
+			benchmark_get_size(&chan->ctx->fields[0]);
+	}
+
+	works = kcalloc(nr_cpu_ids, sizeof(*works), GFP_KERNEL);
+	if (!works) {
+		ret = -ENOMEM;
+		goto end_session;
+	}
+	get_online_cpus();
+	for_each_online_cpu(cpu) {
+		struct benchmark_work *bw = &works[cpu];
+
+		bw->chan = chan;
+		bw->result = &benchmark_results[c * nr_cpu_ids + cpu].task;
+		INIT_WORK(&bw->work, benchmark_work_fn);
+		schedule_work_on(cpu, &bw->work);
+	}
+	for_each_online_cpu(cpu)
+		flush_work(&works[cpu].work);
+	for_each_online_cpu(cpu) {
+		struct benchmark_work *bw = &works[cpu];
+		unsigned int i;
+
+		bw->result = &benchmark_results[c * nr_cpu_ids + cpu].irq;
+		for (i = 0; i < nr_records; i += BENCHMARK_IRQ_BATCH) {
+			ret = smp_call_function_single(cpu, benchmark_irq_fn,
+					bw, 1);
+			if (ret)
+				break;
+			cond_resched();
+		}
+		if (ret)
+			break;
+	}
+	put_online_cpus();
+	kfree(works);
+
+end_session:
+	lttng_session_destroy(session);
+	return ret;
+}
+
+static
+ssize_t benchmark_run_write(struct file *file, const char __user *user_buf,
+		size_t count, loff_t *ppos)
+{
+	unsigned int c;
+	int ret = 0;
+
+	if (!nr_records)
+		return -EINVAL;
+	mutex_lock(&benchmark_mutex);
+	benchmark_has_run = false;
+	for (c = 0; c < NR_BENCHMARK_CONTEXTS; c++) {
+		ret = benchmark_run_context(c);
+		if (ret)
+			goto end;
+	}
+	benchmark_has_run = true;
+end:
+	mutex_unlock(&benchmark_mutex);
+	if (ret)
+		return ret;
+	*ppos += count;
+	return count;
+}
+
+static
+u64 benchmark_ns_per_record(const struct benchmark_result *result)
+{
+	return result->records ? div64_u64(result->ns, result->records) : 0;
+}
+
+static
+u64 benchmark_cycles_per_record(const struct benchmark_result *result)
+{
+	return result->records ? div64_u64(result->cycles, result->records) : 0;
+}
+
+/* Sum of the results of a context over all cpus. */
+static
+void benchmark_context_sum(unsigned int c, struct benchmark_cpu_result *sum)
+{
+	int cpu;
+
+	memset(sum, 0, sizeof(*sum));
+	for_each_possible_cpu(cpu) {
+		struct benchmark_cpu_result *result =
+			&benchmark_results[c * nr_cpu_ids + cpu];
+
+		sum->task.records += result->task.records;
+		sum->task.ns += result->task.ns;
+		sum->task.cycles += result->task.cycles;
+		sum->irq.records += result->irq.records;
+		sum->irq.ns += result->irq.ns;
+		sum->irq.cycles += result->irq.cycles;
+	}
+}
+
+static
+int benchmark_results_show(struct seq_file *m, void *v)
+{
+	struct benchmark_cpu_result base, sum;
+	unsigned int c;
+	int cpu;
+
+	mutex_lock(&benchmark_mutex);
+	if (!benchmark_has_run)
+		goto end;
+	seq_printf(m, "# nr_records %u, callstack_depth %u\n",
+		nr_records, callstack_depth);
+	seq_puts(m, "# context cpu task_ns/record task_cycles/record irq_ns/record irq_cycles/record\n");
+	for (c = 0; c < NR_BENCHMARK_CONTEXTS; c++) {
+		if (benchmark_context_results[c].ret)
+			continue;
+		for_each_possible_cpu(cpu) {
+			struct benchmark_cpu_result *result =
+				&benchmark_results[c * nr_cpu_ids + cpu];
+
+			if (!result->task.records && !result->irq.records)
+				continue;
+			seq_printf(m, "%s %d %llu %llu %llu %llu\n",
+				benchmark_contexts[c].name, cpu,
+				benchmark_ns_per_record(&result->task),
+				benchmark_cycles_per_record(&result->task),
+				benchmark_ns_per_record(&result->irq),
+				benchmark_cycles_per_record(&result->irq));
+		}
+	}
+	/* Cost of each context over the channel without context. */
+	seq_puts(m, "# context get_size_ns task_ns/record irq_ns/record\n");
+	benchmark_context_sum(0, &base);
+	for (c = 1; c < NR_BENCHMARK_CONTEXTS; c++) {
+		struct benchmark_context_result *context_result =
+			&benchmark_context_results[c];
+
+		if (context_result->ret) {
+			seq_printf(m, "%s error %d\n",
+				benchmark_contexts[c].name,
+				context_result->ret);
+			continue;
+		}
+		benchmark_context_sum(c, &sum);
+		seq_printf(m, "%s %llu %lld %lld\n",
+			benchmark_contexts[c].name,
+			context_result->get_size_ns,
+			(long long) (benchmark_ns_per_record(&sum.task)
+				- benchmark_ns_per_record(&base.task)),
+			(long long) (benchmark_ns_per_record(&sum.irq)
+				- benchmark_ns_per_record(&base.irq)));
+	}
+end:
+	mutex_unlock(&benchmark_mutex);
+	return 0;
+}
+
+static
+int benchmark_results_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, benchmark_results_show, NULL);
+}
+
+static const struct file_operations benchmark_run_fops = {
+	.owner = THIS_MODULE,
+	.write = benchmark_run_write,
+};
+
+static const struct file_operations benchmark_results_fops = {
+	.owner = THIS_MODULE,
+	.open = benchmark_results_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static
+int __init lttng_context_benchmark_init(void)
+{
+	(void) wrapper_lttng_fixup_sig(THIS_MODULE);
+	wrapper_vmalloc_sync_all();
+	benchmark_results = kcalloc(NR_BENCHMARK_CONTEXTS * nr_cpu_ids,
+			sizeof(*benchmark_results), GFP_KERNEL);
+	if (!benchmark_results)
+		return -ENOMEM;
+	benchmark_dir = debugfs_create_dir("lttng-context-benchmark", NULL);
+	if (IS_ERR_OR_NULL(benchmark_dir)) {
+		printk(KERN_ERR "Error creating LTTng context benchmark debugfs directory\n");
+		kfree(benchmark_results);
+		return -ENOMEM;
+	}
+	debugfs_create_file("run", 0200, benchmark_dir, NULL,
+			&benchmark_run_fops);
+	debugfs_create_file("results", 0444, benchmark_dir, NULL,
+			&benchmark_results_fops);
+	return 0;
+}
+
+module_init(lttng_context_benchmark_init);
+
+static
+void __exit lttng_context_benchmark_exit(void)
+{
+	debugfs_remove_recursive(benchmark_dir);
+	kfree(benchmark_results);
+}
+
+module_exit(lttng_context_benchmark_exit);
+
+MODULE_LICENSE("GPL and additional rights");
+MODULE_AUTHOR("agent <agent@local>");
+MODULE_DESCRIPTION("LTTng context benchmark");
+MODULE_VERSION(__stringify(LTTNG_MODULES_MAJOR_VERSION) "."
+	__stringify(LTTNG_MODULES_MINOR_VERSION) "."
+	__stringify(LTTNG_MODULES_PATCHLEVEL_VERSION)
+	LTTNG_MODULES_EXTRAVERSION);
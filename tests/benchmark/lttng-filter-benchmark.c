@@ -0,0 +1,707 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-filter-benchmark.c
+ *
+ * LTTng filter bytecode microbenchmark.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/timex.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#include <linux/math64.h>
+
+#include <lttng-events.h>
+#include <lttng-filter.h>
+#include <lttng-tracer.h>
+#include <wrapper/vmalloc.h>
+
+/*
+ * Writing to <debugfs>/lttng-filter-benchmark/run links a corpus of
+ * filter bytecodes to a synthetic event, through the validation,
+ * specialization and compilation of session events, and runs each of
+ * them against a synthetic filter stack data on the writing cpu. The
+ * "results" file reports the time per evaluation of each bytecode, the
+ * backend which ran it (native code, register IR, stack interpreter or
+ * per-task memo), and the mean time per evaluation of each class.
+ */
+
+static unsigned int nr_evaluations = 1000000;
+module_param(nr_evaluations, uint, 0644);
+MODULE_PARM_DESC(nr_evaluations, "Number of evaluations of each bytecode");
+
+/* Evaluations run with preemption disabled, between two reschedules. */
+#define BENCHMARK_BATCH		10000
+
+#define BENCHMARK_CODE_LEN	256
+#define BENCHMARK_RELOC_LEN	256
+
+enum benchmark_class {
+	BENCHMARK_CLASS_INTEGER,
+	BENCHMARK_CLASS_STRING,
+	BENCHMARK_CLASS_GLOB,
+	BENCHMARK_CLASS_FIELD,
+	BENCHMARK_CLASS_CONTEXT,
+	NR_BENCHMARK_CLASSES,
+};
+
+static const char *benchmark_class_names[NR_BENCHMARK_CLASSES] = {
+	[BENCHMARK_CLASS_INTEGER] = "integer",
+	[BENCHMARK_CLASS_STRING] = "string",
+	[BENCHMARK_CLASS_GLOB] = "glob",
+	[BENCHMARK_CLASS_FIELD] = "field",
+	[BENCHMARK_CLASS_CONTEXT] = "context",
+};
+
+/* Bytecode being assembled: code, followed by its relocation table. */
+struct benchmark_bytecode {
+	char code[BENCHMARK_CODE_LEN];
+	char reloc[BENCHMARK_RELOC_LEN];
+	uint16_t len;
+	uint16_t reloc_len;
+	int error;
+};
+
+struct benchmark_entry {
+	const char *name;
+	const char *expr;		/* Equivalent filter expression */
+	enum benchmark_class class;
+	void (*build)(struct benchmark_bytecode *b);
+};
+
+struct benchmark_result {
+	int ret;			/* Link result */
+	const char *backend;
+	u64 accepts;
+	u64 ns;
+	u64 cycles;
+};
+
+static const struct lttng_event_field benchmark_fields[] = {
+	{
+		.name = "intfield",
+		.type = __type_integer(int, 0, 0, -1, __BYTE_ORDER, 10, none),
+	},
+	{
+		.name = "longfield",
+		.type = __type_integer(long, 0, 0, -1, __BYTE_ORDER, 10, none),
+	},
+	{
+		.name = "stringfield",
+		.type = {
+			.atype = atype_string,
+			.u.basic.string.encoding = lttng_encode_UTF8,
+		},
+	},
+	{
+		.name = "arrfield",
+		.type = {
+			.atype = atype_array,
+			.u.array.elem_type = __type_integer(long, 0, 0, -1,
+					__BYTE_ORDER, 10, none),
+			.u.array.length = 3,
+		},
+	},
+	{
+		.name = "seqfield",
+		.type = {
+			.atype = atype_sequence,
+			.u.sequence.length_type = __type_integer(unsigned int,
+					0, 0, -1, __BYTE_ORDER, 10, none),
+			.u.sequence.elem_type = __type_integer(char, 0, 0, -1,
+					__BYTE_ORDER, 10, UTF8),
+		},
+	},
+};
+
+static const struct lttng_event_desc benchmark_desc = {
+	.name = "lttng_filter_benchmark",
+	.fields = benchmark_fields,
+	.nr_fields = ARRAY_SIZE(benchmark_fields),
+	.owner = THIS_MODULE,
+};
+
+/* Filter stack layout of benchmark_fields. */
+struct benchmark_stack_data {
+	int64_t intfield;
+	int64_t longfield;
+	const char *stringfield;
+	unsigned long arrfield_len;
+	const long *arrfield;
+	unsigned long seqfield_len;
+	const char *seqfield;
+};
+
+static const long benchmark_arr[3] = { 1, 2, 3 };
+static const char benchmark_seq[] = { 'l', 't', 't', 'n', 'g' };
+
+static const struct benchmark_stack_data benchmark_stack = {
+	.intfield = 42,
+	.longfield = -1000,
+	.stringfield = "benchmark_string",
+	.arrfield_len = ARRAY_SIZE(benchmark_arr),
+	.arrfield = benchmark_arr,
+	.seqfield_len = ARRAY_SIZE(benchmark_seq),
+	.seqfield = benchmark_seq,
+};
+
+static
+void emit(struct benchmark_bytecode *b, const void *p, size_t len)
+{
+	if (b->len + len > BENCHMARK_CODE_LEN) {
+		b->error = -ENOSPC;
+		return;
+	}
+	memcpy(&b->code[b->len], p, len);
+	b->len += len;
+}
+
+static
+void emit_op(struct benchmark_bytecode *b, filter_opcode_t op)
+{
+	emit(b, &op, sizeof(op));
+}
+
+static
+void emit_u16(struct benchmark_bytecode *b, uint16_t v)
+{
+	emit(b, &v, sizeof(v));
+}
+
+/*
+ * Add a relocation of the instruction about to be emitted to @name.
+ * Returns the offset of the name within the relocation table, as used
+ * by get_symbol instructions.
+ */
+static
+uint16_t emit_reloc(struct benchmark_bytecode *b, const char *name)
+{
+	uint16_t insn = b->len, offset;
+	size_t len = strlen(name) + 1;
+
+	if (b->reloc_len + sizeof(insn) + len > BENCHMARK_RELOC_LEN) {
+		b->error = -ENOSPC;
+		return 0;
+	}
+	memcpy(&b->reloc[b->reloc_len], &insn, sizeof(insn));
+	offset = b->reloc_len + sizeof(insn);
+	memcpy(&b->reloc[offset], name, len);
+	b->reloc_len = offset + len;
+	return offset;
+}
+
+static
+void emit_field_ref(struct benchmark_bytecode *b, const char *name)
+{
+	emit_reloc(b, name);
+	emit_op(b, FILTER_OP_LOAD_FIELD_REF);
+	emit_u16(b, 0);
+}
+
+static
+void emit_context_ref(struct benchmark_bytecode *b, const char *name)
+{
+	emit_reloc(b, name);
+	emit_op(b, FILTER_OP_GET_CONTEXT_REF);
+	emit_u16(b, 0);
+}
+
+static
+void emit_get_symbol(struct benchmark_bytecode *b, const char *name)
+{
+	uint16_t offset = emit_reloc(b, name);
+
+	emit_op(b, FILTER_OP_GET_SYMBOL);
+	emit_u16(b, offset);
+}
+
+static
+void emit_s64(struct benchmark_bytecode *b, int64_t v)
+{
+	emit_op(b, FILTER_OP_LOAD_S64);
+	emit(b, &v, sizeof(v));
+}
+
+static
+void emit_string(struct benchmark_bytecode *b, filter_opcode_t op,
+		const char *s)
+{
+	emit_op(b, op);
+	emit(b, s, strlen(s) + 1);
+}
+
+/* Emit a logical operator, returning the offset of its skip target. */
+static
+uint16_t emit_logical(struct benchmark_bytecode *b, filter_opcode_t op)
+{
+	emit_op(b, op);
+	emit_u16(b, 0);
+	return b->len - sizeof(uint16_t);
+}
+
+static
+void patch_skip(struct benchmark_bytecode *b, uint16_t skip)
+{
+	memcpy(&b->code[skip], &b->len, sizeof(b->len));
+}
+
+/* intfield == 42 */
+static
+void build_int_eq(struct benchmark_bytecode *b)
+{
+	emit_field_ref(b, "intfield");
+	emit_s64(b, 42);
+	emit_op(b, FILTER_OP_EQ);
+	emit_op(b, FILTER_OP_RETURN);
+}
+
+/* intfield > 10 && longfield < 0 && (intfield & 1) == 0 */
+static
+void build_int_and(struct benchmark_bytecode *b)
+{
+	uint16_t skip1, skip2;
+
+	emit_field_ref(b, "intfield");
+	emit_s64(b, 10);
+	emit_op(b, FILTER_OP_GT);
+	skip1 = emit_logical(b, FILTER_OP_AND);
+	emit_field_ref(b, "longfield");
+	emit_s64(b, 0);
+	emit_op(b, FILTER_OP_LT);
+	skip2 = emit_logical(b, FILTER_OP_AND);
+	emit_field_ref(b, "intfield");
+	emit_s64(b, 1);
+	emit_op(b, FILTER_OP_BIT_AND);
+	emit_s64(b, 0);
+	emit_op(b, FILTER_OP_EQ);
+	patch_skip(b, skip2);
+	patch_skip(b, skip1);
+	emit_op(b, FILTER_OP_RETURN);
+}
+
+/* intfield == 1 || intfield == 7 || intfield == 42 || intfield == 100 */
+static
+void build_int_set(struct benchmark_bytecode *b)
+{
+	static const int64_t values[] = { 1, 7, 42, 100 };
+	struct set_op insn = {
+		.op = FILTER_OP_IN_SET_S64,
+		.nr_values = ARRAY_SIZE(values),
+	};
+
+	emit_field_ref(b, "intfield");
+	emit(b, &insn, sizeof(insn));
+	emit(b, values, sizeof(values));
+	emit_op(b, FILTER_OP_RETURN);
+}
+
+/* stringfield == "benchmark_string" */
+static
+void build_string_eq(struct benchmark_bytecode *b)
+{
+	emit_field_ref(b, "stringfield");
+	emit_string(b, FILTER_OP_LOAD_STRING, "benchmark_string");
+	emit_op(b, FILTER_OP_EQ);
+	emit_op(b, FILTER_OP_RETURN);
+}
+
+/* seqfield != "tracing" */
+static
+void build_sequence_ne(struct benchmark_bytecode *b)
+{
+	emit_field_ref(b, "seqfield");
+	emit_string(b, FILTER_OP_LOAD_STRING, "tracing");
+	emit_op(b, FILTER_OP_NE);
+	emit_op(b, FILTER_OP_RETURN);
+}
+
+/* stringfield == "bench*" */
+static
+void build_glob_prefix(struct benchmark_bytecode *b)
+{
+	emit_field_ref(b, "stringfield");
+	emit_string(b, FILTER_OP_LOAD_STAR_GLOB_STRING, "bench*");
+	emit_op(b, FILTER_OP_EQ);
+	emit_op(b, FILTER_OP_RETURN);
+}
+
+/* stringfield == "*mark*str*" */
+static
+void build_glob_infix(struct benchmark_bytecode *b)
+{
+	emit_field_ref(b, "stringfield");
+	emit_string(b, FILTER_OP_LOAD_STAR_GLOB_STRING, "*mark*str*");
+	emit_op(b, FILTER_OP_EQ);
+	emit_op(b, FILTER_OP_RETURN);
+}
+
+/* $payload.longfield == -1000 */
+static
+void build_field_payload(struct benchmark_bytecode *b)
+{
+	emit_op(b, FILTER_OP_GET_PAYLOAD_ROOT);
+	emit_get_symbol(b, "longfield");
+	emit_op(b, FILTER_OP_LOAD_FIELD);
+	emit_s64(b, -1000);
+	emit_op(b, FILTER_OP_EQ);
+	emit_op(b, FILTER_OP_RETURN);
+}
+
+/* arrfield[1] == 2 && arrfield[2] > arrfield[0] */
+static
+void build_field_index(struct benchmark_bytecode *b)
+{
+	uint16_t skip;
+	unsigned int i;
+	static const uint16_t index[] = { 2, 0 };
+
+	emit_op(b, FILTER_OP_GET_PAYLOAD_ROOT);
+	emit_get_symbol(b, "arrfield");
+	emit_op(b, FILTER_OP_GET_INDEX_U16);
+	emit_u16(b, 1);
+	emit_op(b, FILTER_OP_LOAD_FIELD);
+	emit_s64(b, 2);
+	emit_op(b, FILTER_OP_EQ);
+	skip = emit_logical(b, FILTER_OP_AND);
+	for (i = 0; i < ARRAY_SIZE(index); i++) {
+		emit_op(b, FILTER_OP_GET_PAYLOAD_ROOT);
+		emit_get_symbol(b, "arrfield");
+		emit_op(b, FILTER_OP_GET_INDEX_U16);
+		emit_u16(b, index[i]);
+		emit_op(b, FILTER_OP_LOAD_FIELD);
+	}
+	emit_op(b, FILTER_OP_GT);
+	patch_skip(b, skip);
+	emit_op(b, FILTER_OP_RETURN);
+}
+
+/* $ctx.prio >= 0 && $ctx.cpu_id != -1 */
+static
+void build_context_ref(struct benchmark_bytecode *b)
+{
+	uint16_t skip;
+
+	emit_context_ref(b, "prio");
+	emit_s64(b, 0);
+	emit_op(b, FILTER_OP_GE);
+	skip = emit_logical(b, FILTER_OP_AND);
+	emit_context_ref(b, "cpu_id");
+	emit_s64(b, -1);
+	emit_op(b, FILTER_OP_NE);
+	patch_skip(b, skip);
+	emit_op(b, FILTER_OP_RETURN);
+}
+
+/* $ctx.procname == "lttng*" */
+static
+void build_context_procname(struct benchmark_bytecode *b)
+{
+	emit_op(b, FILTER_OP_GET_CONTEXT_ROOT);
+	emit_get_symbol(b, "procname");
+	emit_op(b, FILTER_OP_LOAD_FIELD);
+	emit_string(b, FILTER_OP_LOAD_STAR_GLOB_STRING, "lttng*");
+	emit_op(b, FILTER_OP_EQ);
+	emit_op(b, FILTER_OP_RETURN);
+}
+
+/* $ctx.procname == "lttng*" && intfield == 42 */
+static
+void build_context_payload(struct benchmark_bytecode *b)
+{
+	uint16_t skip;
+
+	emit_op(b, FILTER_OP_GET_CONTEXT_ROOT);
+	emit_get_symbol(b, "procname");
+	emit_op(b, FILTER_OP_LOAD_FIELD);
+	emit_string(b, FILTER_OP_LOAD_STAR_GLOB_STRING, "lttng*");
+	emit_op(b, FILTER_OP_EQ);
+	skip = emit_logical(b, FILTER_OP_AND);
+	emit_field_ref(b, "intfield");
+	emit_s64(b, 42);
+	emit_op(b, FILTER_OP_EQ);
+	patch_skip(b, skip);
+	emit_op(b, FILTER_OP_RETURN);
+}
+
+static const struct benchmark_entry benchmark_corpus[] = {
+	{ "int_eq", "intfield == 42",
+		BENCHMARK_CLASS_INTEGER, build_int_eq },
+	{ "int_and", "intfield > 10 && longfield < 0 && (intfield & 1) == 0",
+		BENCHMARK_CLASS_INTEGER, build_int_and },
+	{ "int_set", "intfield in { 1, 7, 42, 100 }",
+		BENCHMARK_CLASS_INTEGER, build_int_set },
+	{ "string_eq", "stringfield == \"benchmark_string\"",
+		BENCHMARK_CLASS_STRING, build_string_eq },
+	{ "sequence_ne", "seqfield != \"tracing\"",
+		BENCHMARK_CLASS_STRING, build_sequence_ne },
+	{ "glob_prefix", "stringfield == \"bench*\"",
+		BENCHMARK_CLASS_GLOB, build_glob_prefix },
+	{ "glob_infix", "stringfield == \"*mark*str*\"",
+		BENCHMARK_CLASS_GLOB, build_glob_infix },
+	{ "field_payload", "$payload.longfield == -1000",
+		BENCHMARK_CLASS_FIELD, build_field_payload },
+	{ "field_index", "arrfield[1] == 2 && arrfield[2] > arrfield[0]",
+		BENCHMARK_CLASS_FIELD, build_field_index },
+	{ "context_ref", "$ctx.prio >= 0 && $ctx.cpu_id != -1",
+		BENCHMARK_CLASS_CONTEXT, build_context_ref },
+	{ "context_procname", "$ctx.procname == \"lttng*\"",
+		BENCHMARK_CLASS_CONTEXT, build_context_procname },
+	{ "context_payload", "$ctx.procname == \"lttng*\" && intfield == 42",
+		BENCHMARK_CLASS_CONTEXT, build_context_payload },
+};
+
+#define NR_BENCHMARK_ENTRIES	ARRAY_SIZE(benchmark_corpus)
+
+static struct dentry *benchmark_dir;
+static DEFINE_MUTEX(benchmark_mutex);
+static struct benchmark_result benchmark_results[NR_BENCHMARK_ENTRIES];
+static bool benchmark_has_run;
+
+static
+struct lttng_filter_bytecode_node *benchmark_bytecode_node(
+		const struct benchmark_entry *entry)
+{
+	struct lttng_filter_bytecode_node *node;
+	struct benchmark_bytecode *b;
+
+	b = kzalloc(sizeof(*b), GFP_KERNEL);
+	if (!b)
+		return ERR_PTR(-ENOMEM);
+	entry->build(b);
+	if (b->error) {
+		node = ERR_PTR(b->error);
+		goto end;
+	}
+	node = kzalloc(sizeof(*node) + b->len + b->reloc_len, GFP_KERNEL);
+	if (!node) {
+		node = ERR_PTR(-ENOMEM);
+		goto end;
+	}
+	node->bc.len = b->len + b->reloc_len;
+	node->bc.reloc_offset = b->len;
+	memcpy(node->bc.data, b->code, b->len);
+	memcpy(node->bc.data + b->len, b->reloc, b->reloc_len);
+end:
+	kfree(b);
+	return node;
+}
+
+static
+const char *benchmark_backend(struct lttng_bytecode_runtime *p)
+{
+	struct bytecode_runtime *runtime =
+		container_of(p, struct bytecode_runtime, p);
+
+	if (runtime->memo_id)
+		return "memo";
+	if (runtime->jit_image)
+		return "jit";
+	if (runtime->reg_code)
+		return "regs";
+	return "interpreter";
+}
+
+static
+void benchmark_measure(struct lttng_bytecode_runtime *runtime,
+		struct lttng_probe_ctx *probe_ctx,
+		struct benchmark_result *result)
+{
+	const char *stack_data = (const char *) &benchmark_stack;
+	unsigned int i = 0, batch;
+
+	while (i < nr_evaluations) {
+		u64 t_begin, c_begin;
+
+		batch = min_t(unsigned int, nr_evaluations - i,
+				BENCHMARK_BATCH);
+		preempt_disable();
+		t_begin = ktime_get_ns();
+		c_begin = get_cycles();
+		for (; batch; batch--, i++) {
+			if (runtime->filter(runtime, probe_ctx, stack_data)
+					& LTTNG_FILTER_RECORD_FLAG)
+				result->accepts++;
+		}
+		result->cycles += get_cycles() - c_begin;
+		result->ns += ktime_get_ns() - t_begin;
+		preempt_enable();
+		cond_resched();
+	}
+}
+
+static
+int benchmark_run_entry(const struct benchmark_entry *entry,
+		struct benchmark_result *result)
+{
+	struct lttng_filter_bytecode_node *node;
+	struct lttng_bytecode_runtime *runtime;
+	struct lttng_probe_ctx probe_ctx = {
+		.interruptible = 0,
+	};
+	struct lttng_event *event;
+	int ret = 0;
+
+	memset(result, 0, sizeof(*result));
+	event = kzalloc(sizeof(*event), GFP_KERNEL);
+	if (!event)
+		return -ENOMEM;
+	event->desc = &benchmark_desc;
+	INIT_LIST_HEAD(&event->bytecode_runtime_head);
+	INIT_LIST_HEAD(&event->ctx_guard_runtime_head);
+	probe_ctx.event = event;
+	node = benchmark_bytecode_node(entry);
+	if (IS_ERR(node)) {
+		ret = PTR_ERR(node);
+		goto end_event;
+	}
+	result->ret = lttng_filter_event_link_standalone(event, node);
+	if (result->ret)
+		goto end_runtime;
+	runtime = list_first_entry(&event->bytecode_runtime_head,
+			struct lttng_bytecode_runtime, node);
+	result->backend = benchmark_backend(runtime);
+	benchmark_measure(runtime, &probe_ctx, result);
+
+end_runtime:
+	lttng_free_event_filter_runtime(event);
+	kfree(node);
+end_event:
+	kfree(event);
+	return ret;
+}
+
+static
+ssize_t benchmark_run_write(struct file *file, const char __user *user_buf,
+		size_t count, loff_t *ppos)
+{
+	unsigned int i;
+	int ret = 0;
+
+	if (!nr_evaluations)
+		return -EINVAL;
+	mutex_lock(&benchmark_mutex);
+	benchmark_has_run = false;
+	for (i = 0; i < NR_BENCHMARK_ENTRIES; i++) {
+		ret = benchmark_run_entry(&benchmark_corpus[i],
+				&benchmark_results[i]);
+		if (ret)
+			goto end;
+	}
+	benchmark_has_run = true;
+end:
+	mutex_unlock(&benchmark_mutex);
+	if (ret)
+		return ret;
+	*ppos += count;
+	return count;
+}
+
+static
+int benchmark_results_show(struct seq_file *m, void *v)
+{
+	u64 class_ns[NR_BENCHMARK_CLASSES] = { 0 };
+	unsigned int class_nr[NR_BENCHMARK_CLASSES] = { 0 };
+	unsigned int i;
+
+	mutex_lock(&benchmark_mutex);
+	if (!benchmark_has_run)
+		goto end;
+	seq_printf(m, "# nr_evaluations %u\n", nr_evaluations);
+	seq_puts(m, "# bytecode class backend accepts ns/eval cycles/eval\n");
+	for (i = 0; i < NR_BENCHMARK_ENTRIES; i++) {
+		const struct benchmark_entry *entry = &benchmark_corpus[i];
+		struct benchmark_result *result = &benchmark_results[i];
+
+		if (result->ret) {
+			seq_printf(m, "%s %s link-error %d\n", entry->name,
+				benchmark_class_names[entry->class],
+				result->ret);
+			continue;
+		}
+		seq_printf(m, "%s %s %s %llu %llu %llu\n", entry->name,
+			benchmark_class_names[entry->class], result->backend,
+			result->accepts,
+			div64_u64(result->ns, nr_evaluations),
+			div64_u64(result->cycles, nr_evaluations));
+		class_ns[entry->class] += result->ns;
+		class_nr[entry->class]++;
+	}
+	seq_puts(m, "# class bytecodes ns/eval\n");
+	for (i = 0; i < NR_BENCHMARK_CLASSES; i++) {
+		if (!class_nr[i])
+			continue;
+		seq_printf(m, "%s %u %llu\n", benchmark_class_names[i],
+			class_nr[i],
+			div64_u64(class_ns[i], (u64) class_nr[i] * nr_evaluations));
+	}
+	seq_puts(m, "# bytecode expression\n");
+	for (i = 0; i < NR_BENCHMARK_ENTRIES; i++)
+		seq_printf(m, "%s %s\n", benchmark_corpus[i].name,
+			benchmark_corpus[i].expr);
+end:
+	mutex_unlock(&benchmark_mutex);
+	return 0;
+}
+
+static
+int benchmark_results_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, benchmark_results_show, NULL);
+}
+
+static const struct file_operations benchmark_run_fops = {
+	.owner = THIS_MODULE,
+	.write = benchmark_run_write,
+};
+
+static const struct file_operations benchmark_results_fops = {
+	.owner = THIS_MODULE,
+	.open = benchmark_results_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static
+int __init lttng_filter_benchmark_init(void)
+{
+	(void) wrapper_lttng_fixup_sig(THIS_MODULE);
+	wrapper_vmalloc_sync_all();
+	benchmark_dir = debugfs_create_dir("lttng-filter-benchmark", NULL);
+	if (IS_ERR_OR_NULL(benchmark_dir)) {
+		printk(KERN_ERR "Error creating LTTng filter benchmark debugfs directory\n");
+		return -ENOMEM;
+	}
+	debugfs_create_file("run", 0200, benchmark_dir, NULL,
+			&benchmark_run_fops);
+	debugfs_create_file("results", 0444, benchmark_dir, NULL,
+			&benchmark_results_fops);
+	return 0;
+}
+
+module_init(lttng_filter_benchmark_init);
+
+static
+void __exit lttng_filter_benchmark_exit(void)
+{
+	debugfs_remove_recursive(benchmark_dir);
+}
+
+module_exit(lttng_filter_benchmark_exit);
+
+MODULE_LICENSE("GPL and additional rights");
+MODULE_AUTHOR("agent <agent@local>");
+MODULE_DESCRIPTION("LTTng filter benchmark");
+MODULE_VERSION(__stringify(LTTNG_MODULES_MAJOR_VERSION) "."
+	__stringify(LTTNG_MODULES_MINOR_VERSION) "."
+	__stringify(LTTNG_MODULES_PATCHLEVEL_VERSION)
+	LTTNG_MODULES_EXTRAVERSION);
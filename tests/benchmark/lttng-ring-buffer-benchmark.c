@@ -0,0 +1,320 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-ring-buffer-benchmark.c
+ *
+ * LTTng ring buffer reserve/commit microbenchmark.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/workqueue.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/timex.h>
+#include <linux/cpu.h>
+#include <linux/string.h>
+
+#include <lttng-events.h>
+#include <lttng-tracer.h>
+#include <wrapper/vmalloc.h>
+
+/*
+ * Writing to <debugfs>/lttng-ring-buffer-benchmark/run hammers
+ * event_reserve/event_commit from all online cpus, for each ring buffer
+ * client (discard, overwrite and their mmap variants). No consumer is
+ * attached: discard channels fill up and then lose events, which is
+ * accounted for separately. Results are read from the "results" file.
+ */
+
+static unsigned int nr_events = 100000;
+module_param(nr_events, uint, 0644);
+MODULE_PARM_DESC(nr_events, "Number of events emitted per cpu and per client");
+
+static unsigned int payload_size = 32;
+module_param(payload_size, uint, 0644);
+MODULE_PARM_DESC(payload_size, "Event payload size, in bytes");
+
+static unsigned int subbuf_size = 262144;
+module_param(subbuf_size, uint, 0644);
+MODULE_PARM_DESC(subbuf_size, "Sub-buffer size, in bytes");
+
+static unsigned int num_subbuf = 4;
+module_param(num_subbuf, uint, 0644);
+MODULE_PARM_DESC(num_subbuf, "Number of sub-buffers per buffer");
+
+static char *contexts = "";
+module_param(contexts, charp, 0644);
+MODULE_PARM_DESC(contexts, "Comma-separated channel contexts (pid,tid,vpid,vtid,prio,procname,cpu_id)");
+
+static const char *benchmark_transports[] = {
+	"relay-discard",
+	"relay-overwrite",
+	"relay-discard-mmap",
+	"relay-overwrite-mmap",
+};
+
+#define NR_BENCHMARK_TRANSPORTS	ARRAY_SIZE(benchmark_transports)
+
+struct benchmark_result {
+	u64 events;
+	u64 lost;
+	u64 ns;
+	u64 cycles;
+};
+
+struct benchmark_work {
+	struct work_struct work;
+	struct lttng_channel *chan;
+	struct benchmark_result *result;
+};
+
+static struct dentry *benchmark_dir;
+static DEFINE_MUTEX(benchmark_mutex);
+/* Indexed by [transport * nr_cpu_ids + cpu] */
+static struct benchmark_result *benchmark_results;
+static bool benchmark_transport_run[NR_BENCHMARK_TRANSPORTS];
+
+static
+int benchmark_add_contexts(struct lttng_ctx **ctx)
+{
+	char *list, *iter, *name;
+	int ret = 0;
+
+	list = kstrdup(contexts, GFP_KERNEL);
+	if (!list)
+		return -ENOMEM;
+	iter = list;
+	while ((name = strsep(&iter, ",")) != NULL) {
+		if (!*name)
+			continue;
+		if (!strcmp(name, "pid"))
+			ret = lttng_add_pid_to_ctx(ctx);
+		else if (!strcmp(name, "tid"))
+			ret = lttng_add_tid_to_ctx(ctx);
+		else if (!strcmp(name, "vpid"))
+			ret = lttng_add_vpid_to_ctx(ctx);
+		else if (!strcmp(name, "vtid"))
+			ret = lttng_add_vtid_to_ctx(ctx);
+		else if (!strcmp(name, "prio"))
+			ret = lttng_add_prio_to_ctx(ctx);
+		else if (!strcmp(name, "procname"))
+			ret = lttng_add_procname_to_ctx(ctx);
+		else if (!strcmp(name, "cpu_id"))
+			ret = lttng_add_cpu_id_to_ctx(ctx);
+		else
+			ret = -EINVAL;
+		if (ret)
+			break;
+	}
+	kfree(list);
+	return ret;
+}
+
+static
+void benchmark_work_fn(struct work_struct *work)
+{
+	struct benchmark_work *bw = container_of(work, struct benchmark_work, work);
+	struct lttng_channel *chan = bw->chan;
+	struct lttng_event event = {
+		.chan = chan,
+	};
+	struct lttng_probe_ctx probe_ctx = {
+		.event = &event,
+		.interruptible = 0,
+	};
+	struct benchmark_result *result = bw->result;
+	u64 t_begin, c_begin;
+	unsigned int i;
+
+	t_begin = ktime_get_ns();
+	c_begin = get_cycles();
+	for (i = 0; i < nr_events; i++) {
+		struct lib_ring_buffer_ctx ctx;
+		int ret;
+
+		lib_ring_buffer_ctx_init(&ctx, chan->chan, &probe_ctx,
+				payload_size, lttng_alignof(uint64_t), -1);
+		ret = chan->ops->event_reserve(&ctx, 0);
+		if (ret < 0) {
+			result->lost++;
+			continue;
+		}
+		chan->ops->event_memset(&ctx, 0, payload_size);
+		chan->ops->event_commit(&ctx);
+		result->events++;
+	}
+	result->cycles = get_cycles() - c_begin;
+	result->ns = ktime_get_ns() - t_begin;
+}
+
+static
+int benchmark_run_transport(unsigned int t)
+{
+	struct benchmark_work *works;
+	struct lttng_session *session;
+	struct lttng_channel *chan;
+	int cpu, ret = 0;
+
+	session = lttng_session_create();
+	if (!session)
+		return -ENOMEM;
+	chan = lttng_channel_create(session, benchmark_transports[t], NULL,
+			subbuf_size, num_subbuf, 0, 0, 0, LTTNG_KERNEL_NUMA_LOCAL,
+			-1, 0, NULL, PER_CPU_CHANNEL);
+	if (!chan) {
+		/* Client module not loaded. */
+		ret = -ENOENT;
+		goto end_session;
+	}
+	chan->header_type = 1;	/* compact */
+	ret = benchmark_add_contexts(&chan->ctx);
+	if (ret)
+		goto end_session;
+
+	works = kcalloc(nr_cpu_ids, sizeof(*works), GFP_KERNEL);
+	if (!works) {
+		ret = -ENOMEM;
+		goto end_session;
+	}
+	get_online_cpus();
+	for_each_online_cpu(cpu) {
+		struct benchmark_work *bw = &works[cpu];
+
+		bw->chan = chan;
+		bw->result = &benchmark_results[t * nr_cpu_ids + cpu];
+		memset(bw->result, 0, sizeof(*bw->result));
+		INIT_WORK(&bw->work, benchmark_work_fn);
+		schedule_work_on(cpu, &bw->work);
+	}
+	for_each_online_cpu(cpu)
+		flush_work(&works[cpu].work);
+	put_online_cpus();
+	kfree(works);
+	benchmark_transport_run[t] = true;
+
+end_session:
+	lttng_session_destroy(session);
+	return ret;
+}
+
+static
+ssize_t benchmark_run_write(struct file *file, const char __user *user_buf,
+		size_t count, loff_t *ppos)
+{
+	unsigned int t;
+	int ret;
+
+	if (!payload_size || !nr_events)
+		return -EINVAL;
+	mutex_lock(&benchmark_mutex);
+	for (t = 0; t < NR_BENCHMARK_TRANSPORTS; t++) {
+		benchmark_transport_run[t] = false;
+		ret = benchmark_run_transport(t);
+		if (ret && ret != -ENOENT)
+			goto end;
+	}
+	ret = 0;
+end:
+	mutex_unlock(&benchmark_mutex);
+	if (ret)
+		return ret;
+	*ppos += count;
+	return count;
+}
+
+static
+int benchmark_results_show(struct seq_file *m, void *v)
+{
+	unsigned int t;
+	int cpu;
+
+	mutex_lock(&benchmark_mutex);
+	seq_printf(m, "# payload_size %u, nr_events %u, contexts \"%s\"\n",
+		payload_size, nr_events, contexts);
+	seq_puts(m, "# transport cpu events lost ns/event cycles/event\n");
+	for (t = 0; t < NR_BENCHMARK_TRANSPORTS; t++) {
+		if (!benchmark_transport_run[t])
+			continue;
+		for_each_possible_cpu(cpu) {
+			struct benchmark_result *result =
+				&benchmark_results[t * nr_cpu_ids + cpu];
+			u64 total = result->events + result->lost;
+
+			if (!total)
+				continue;
+			seq_printf(m, "%s %d %llu %llu %llu %llu\n",
+				benchmark_transports[t], cpu,
+				result->events, result->lost,
+				div64_u64(result->ns, total),
+				div64_u64(result->cycles, total));
+		}
+	}
+	mutex_unlock(&benchmark_mutex);
+	return 0;
+}
+
+static
+int benchmark_results_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, benchmark_results_show, NULL);
+}
+
+static const struct file_operations benchmark_run_fops = {
+	.owner = THIS_MODULE,
+	.write = benchmark_run_write,
+};
+
+static const struct file_operations benchmark_results_fops = {
+	.owner = THIS_MODULE,
+	.open = benchmark_results_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static
+int __init lttng_ring_buffer_benchmark_init(void)
+{
+	(void) wrapper_lttng_fixup_sig(THIS_MODULE);
+	wrapper_vmalloc_sync_all();
+	benchmark_results = kcalloc(NR_BENCHMARK_TRANSPORTS * nr_cpu_ids,
+			sizeof(*benchmark_results), GFP_KERNEL);
+	if (!benchmark_results)
+		return -ENOMEM;
+	benchmark_dir = debugfs_create_dir("lttng-ring-buffer-benchmark", NULL);
+	if (IS_ERR_OR_NULL(benchmark_dir)) {
+		printk(KERN_ERR "Error creating LTTng ring buffer benchmark debugfs directory\n");
+		kfree(benchmark_results);
+		return -ENOMEM;
+	}
+	debugfs_create_file("run", 0200, benchmark_dir, NULL,
+			&benchmark_run_fops);
+	debugfs_create_file("results", 0444, benchmark_dir, NULL,
+			&benchmark_results_fops);
+	return 0;
+}
+
+module_init(lttng_ring_buffer_benchmark_init);
+
+static
+void __exit lttng_ring_buffer_benchmark_exit(void)
+{
+	debugfs_remove_recursive(benchmark_dir);
+	kfree(benchmark_results);
+}
+
+module_exit(lttng_ring_buffer_benchmark_exit);
+
+MODULE_LICENSE("GPL and additional rights");
+MODULE_AUTHOR("agent <agent@local>");
+MODULE_DESCRIPTION("LTTng ring buffer benchmark");
+MODULE_VERSION(__stringify(LTTNG_MODULES_MAJOR_VERSION) "."
+	__stringify(LTTNG_MODULES_MINOR_VERSION) "."
+	__stringify(LTTNG_MODULES_PATCHLEVEL_VERSION)
+	LTTNG_MODULES_EXTRAVERSION);
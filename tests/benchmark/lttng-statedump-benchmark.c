@@ -0,0 +1,373 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * lttng-statedump-benchmark.c
+ *
+ * LTTng statedump scaling benchmark.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/anon_inodes.h>
+#include <linux/file.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+
+#include <lttng-events.h>
+#include <lttng-tracer.h>
+#include <wrapper/file.h>
+#include <wrapper/vmalloc.h>
+#include <wrapper/ringbuffer/frontend.h>
+
+/*
+ * Writing to <debugfs>/lttng-statedump-benchmark/run starts nr_threads
+ * sleeping kernel threads, and installs nr_fds anonymous files into the
+ * file descriptor table shared by kernel threads, so each kernel thread
+ * dumps at least nr_fds file descriptors. It then enables a session
+ * recording the lttng_statedump_* events into a discard channel, which
+ * runs its statedump. The "results" file reports the time spent in each
+ * statedump phase, and the records and bytes written to the channel,
+ * packet headers included.
+ *
+ * Kernel threads have no memory mappings, and memory maps are not part
+ * of the statedump yet. Events are only recorded when the statedump
+ * probe module is loaded, and are lost once the channel is full.
+ */
+
+static unsigned int nr_threads = 1000;
+module_param(nr_threads, uint, 0644);
+MODULE_PARM_DESC(nr_threads, "Number of synthetic kernel threads");
+
+static unsigned int nr_fds = 16;
+module_param(nr_fds, uint, 0644);
+MODULE_PARM_DESC(nr_fds, "Number of file descriptors in the kernel thread file table");
+
+static unsigned int subbuf_size = 1048576;
+module_param(subbuf_size, uint, 0644);
+MODULE_PARM_DESC(subbuf_size, "Sub-buffer size, in bytes");
+
+static unsigned int num_subbuf = 8;
+module_param(num_subbuf, uint, 0644);
+MODULE_PARM_DESC(num_subbuf, "Number of sub-buffers per buffer");
+
+static const char *benchmark_phase_names[NR_LTTNG_STATEDUMP_PHASES] = {
+	[LTTNG_STATEDUMP_PHASE_PROCESS] = "process",
+	[LTTNG_STATEDUMP_PHASE_FD] = "fd",
+	[LTTNG_STATEDUMP_PHASE_INTERRUPT] = "interrupt",
+	[LTTNG_STATEDUMP_PHASE_NETIF] = "netif",
+	[LTTNG_STATEDUMP_PHASE_BLOCK_DEVICE] = "block_device",
+	[LTTNG_STATEDUMP_PHASE_CPU_TOPOLOGY] = "cpu_topology",
+};
+
+struct benchmark_thread {
+	struct task_struct *task;
+	struct completion ready;
+	unsigned int nr_fds;		/* Installed by this thread */
+	int *fds;
+	int ret;
+};
+
+struct benchmark_result {
+	struct lttng_statedump_stats stats;
+	unsigned int nr_threads;
+	unsigned int nr_fds;
+	u64 records;
+	u64 lost;
+	u64 bytes;
+};
+
+static struct dentry *benchmark_dir;
+static DEFINE_MUTEX(benchmark_mutex);
+static struct benchmark_result benchmark_result;
+static bool benchmark_has_run;
+
+static const struct file_operations benchmark_fd_fops = {
+	.owner = THIS_MODULE,
+};
+
+static
+int benchmark_install_fds(struct benchmark_thread *thread)
+{
+	unsigned int i;
+
+	for (i = 0; i < thread->nr_fds; i++) {
+		struct file *file;
+		int fd;
+
+		fd = lttng_get_unused_fd();
+		if (fd < 0)
+			return fd;
+		file = anon_inode_getfile("[lttng_statedump_benchmark]",
+				&benchmark_fd_fops, NULL, O_RDONLY);
+		if (IS_ERR(file)) {
+			put_unused_fd(fd);
+			return PTR_ERR(file);
+		}
+		fd_install(fd, file);
+		thread->fds[i] = fd;
+	}
+	return 0;
+}
+
+static
+int benchmark_thread_fn(void *data)
+{
+	struct benchmark_thread *thread = data;
+	unsigned int i;
+
+	if (thread->nr_fds)
+		thread->ret = benchmark_install_fds(thread);
+	complete(&thread->ready);
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop())
+			break;
+		schedule();
+	}
+	__set_current_state(TASK_RUNNING);
+	for (i = 0; i < thread->nr_fds; i++) {
+		if (thread->fds[i] >= 0)
+			lttng_close_fd(thread->fds[i]);
+	}
+	return 0;
+}
+
+static
+void benchmark_stop_threads(struct benchmark_thread *threads,
+		unsigned int nr)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr; i++)
+		kthread_stop(threads[i].task);
+}
+
+static
+struct benchmark_thread *benchmark_start_threads(unsigned int *nr)
+{
+	struct benchmark_thread *threads;
+	unsigned int i;
+
+	*nr = 0;
+	threads = lttng_kvzalloc(nr_threads * sizeof(*threads), GFP_KERNEL);
+	if (!threads)
+		return ERR_PTR(-ENOMEM);
+	threads[0].fds = kmalloc_array(nr_fds, sizeof(int), GFP_KERNEL);
+	if (!threads[0].fds) {
+		lttng_kvfree(threads);
+		return ERR_PTR(-ENOMEM);
+	}
+	memset(threads[0].fds, -1, nr_fds * sizeof(int));
+	threads[0].nr_fds = nr_fds;
+	for (i = 0; i < nr_threads; i++) {
+		struct benchmark_thread *thread = &threads[i];
+		struct task_struct *task;
+
+		init_completion(&thread->ready);
+		task = kthread_run(benchmark_thread_fn, thread,
+				"lttng-sdbench/%u", i);
+		if (IS_ERR(task)) {
+			benchmark_stop_threads(threads, *nr);
+			kfree(threads[0].fds);
+			lttng_kvfree(threads);
+			return ERR_CAST(task);
+		}
+		thread->task = task;
+		(*nr)++;
+	}
+	/* The file descriptors are installed before the first thread sleeps. */
+	wait_for_completion(&threads[0].ready);
+	return threads;
+}
+
+static
+void benchmark_channel_stats(struct lttng_channel *lttng_chan,
+		struct benchmark_result *result)
+{
+	struct channel *chan = lttng_chan->chan;
+	const struct lib_ring_buffer_config *config = &chan->backend.config;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct lib_ring_buffer *buf =
+			channel_get_ring_buffer(config, chan, cpu);
+
+		if (!buf->backend.allocated)
+			continue;
+		result->records += lib_ring_buffer_get_records_count(config, buf);
+		result->lost += lib_ring_buffer_get_records_lost_full(config, buf)
+			+ lib_ring_buffer_get_records_lost_wrap(config, buf)
+			+ lib_ring_buffer_get_records_lost_big(config, buf);
+		result->bytes += lib_ring_buffer_get_offset(config, buf);
+	}
+}
+
+static
+int benchmark_run(struct benchmark_result *result)
+{
+	struct lttng_kernel_event event_param;
+	struct benchmark_thread *threads;
+	struct lttng_enabler *enabler;
+	struct lttng_session *session;
+	struct lttng_channel *chan;
+	unsigned int nr;
+	int ret;
+
+	memset(result, 0, sizeof(*result));
+	threads = benchmark_start_threads(&nr);
+	if (IS_ERR(threads))
+		return PTR_ERR(threads);
+	ret = threads[0].ret;
+	if (ret)
+		goto end_threads;
+	session = lttng_session_create();
+	if (!session) {
+		ret = -ENOMEM;
+		goto end_threads;
+	}
+	chan = lttng_channel_create(session, "relay-discard", NULL,
+			subbuf_size, num_subbuf, 0, 0, 0, LTTNG_KERNEL_NUMA_LOCAL,
+			-1, 0, NULL, PER_CPU_CHANNEL);
+	if (!chan) {
+		/* Client module not loaded. */
+		ret = -ENOENT;
+		goto end_session;
+	}
+	memset(&event_param, 0, sizeof(event_param));
+	strcpy(event_param.name, "lttng_statedump_*");
+	event_param.instrumentation = LTTNG_KERNEL_TRACEPOINT;
+	enabler = lttng_enabler_create(LTTNG_ENABLER_STAR_GLOB, &event_param,
+			chan);
+	if (!enabler) {
+		ret = -ENOMEM;
+		goto end_session;
+	}
+	ret = lttng_enabler_enable(enabler);
+	if (ret)
+		goto end_session;
+	/* Runs the statedump. */
+	ret = lttng_session_enable(session);
+	if (ret)
+		goto end_session;
+	lttng_statedump_get_stats(&result->stats);
+	ret = lttng_session_disable(session);
+	if (ret)
+		goto end_session;
+	benchmark_channel_stats(chan, result);
+	result->nr_threads = nr;
+	result->nr_fds = nr_fds;
+
+end_session:
+	lttng_session_destroy(session);
+end_threads:
+	benchmark_stop_threads(threads, nr);
+	kfree(threads[0].fds);
+	lttng_kvfree(threads);
+	return ret;
+}
+
+static
+ssize_t benchmark_run_write(struct file *file, const char __user *user_buf,
+		size_t count, loff_t *ppos)
+{
+	int ret;
+
+	if (!nr_threads)
+		return -EINVAL;
+	mutex_lock(&benchmark_mutex);
+	benchmark_has_run = false;
+	ret = benchmark_run(&benchmark_result);
+	if (!ret)
+		benchmark_has_run = true;
+	mutex_unlock(&benchmark_mutex);
+	if (ret)
+		return ret;
+	*ppos += count;
+	return count;
+}
+
+static
+int benchmark_results_show(struct seq_file *m, void *v)
+{
+	struct benchmark_result *result = &benchmark_result;
+	unsigned int i;
+
+	mutex_lock(&benchmark_mutex);
+	if (!benchmark_has_run)
+		goto end;
+	seq_printf(m, "# nr_threads %u, nr_fds %u\n",
+		result->nr_threads, result->nr_fds);
+	seq_puts(m, "# phase ns (process and fd: sum over cpus)\n");
+	for (i = 0; i < NR_LTTNG_STATEDUMP_PHASES; i++)
+		seq_printf(m, "%s %llu\n", benchmark_phase_names[i],
+			result->stats.phase_ns[i]);
+	seq_printf(m, "total %llu\n", result->stats.total_ns);
+	seq_puts(m, "# records lost bytes\n");
+	seq_printf(m, "%llu %llu %llu\n", result->records, result->lost,
+		result->bytes);
+end:
+	mutex_unlock(&benchmark_mutex);
+	return 0;
+}
+
+static
+int benchmark_results_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, benchmark_results_show, NULL);
+}
+
+static const struct file_operations benchmark_run_fops = {
+	.owner = THIS_MODULE,
+	.write = benchmark_run_write,
+};
+
+static const struct file_operations benchmark_results_fops = {
+	.owner = THIS_MODULE,
+	.open = benchmark_results_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static
+int __init lttng_statedump_benchmark_init(void)
+{
+	(void) wrapper_lttng_fixup_sig(THIS_MODULE);
+	wrapper_vmalloc_sync_all();
+	benchmark_dir = debugfs_create_dir("lttng-statedump-benchmark", NULL);
+	if (IS_ERR_OR_NULL(benchmark_dir)) {
+		printk(KERN_ERR "Error creating LTTng statedump benchmark debugfs directory\n");
+		return -ENOMEM;
+	}
+	debugfs_create_file("run", 0200, benchmark_dir, NULL,
+			&benchmark_run_fops);
+	debugfs_create_file("results", 0444, benchmark_dir, NULL,
+			&benchmark_results_fops);
+	return 0;
+}
+
+module_init(lttng_statedump_benchmark_init);
+
+static
+void __exit lttng_statedump_benchmark_exit(void)
+{
+	debugfs_remove_recursive(benchmark_dir);
+}
+
+module_exit(lttng_statedump_benchmark_exit);
+
+MODULE_LICENSE("GPL and additional rights");
+MODULE_AUTHOR("agent <agent@local>");
+MODULE_DESCRIPTION("LTTng statedump benchmark");
+MODULE_VERSION(__stringify(LTTNG_MODULES_MAJOR_VERSION) "."
+	__stringify(LTTNG_MODULES_MINOR_VERSION) "."
+	__stringify(LTTNG_MODULES_PATCHLEVEL_VERSION)
+	LTTNG_MODULES_EXTRAVERSION);
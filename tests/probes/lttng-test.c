@@ -10,6 +10,16 @@
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/workqueue.h>
+#include <linux/percpu.h>
+#include <linux/cpu.h>
+#include <linux/mutex.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
 #include <linux/byteorder/generic.h>
 #include <asm/byteorder.h>
 
@@ -26,12 +36,24 @@
 #include <instrumentation/events/lttng-module/lttng-test.h>
 
 DEFINE_TRACE(lttng_test_filter_event);
+DEFINE_TRACE(lttng_test_event_integers);
+DEFINE_TRACE(lttng_test_event_string);
+DEFINE_TRACE(lttng_test_event_string_bounded);
+DEFINE_TRACE(lttng_test_event_user_string);
+DEFINE_TRACE(lttng_test_event_sequence);
+DEFINE_TRACE(lttng_test_event_array);
+DEFINE_TRACE(lttng_test_event_enum);
 
 #define LTTNG_TEST_FILTER_EVENT_FILE	"lttng-test-filter-event"
+#define LTTNG_TEST_EVENT_LOOP_FILE	"lttng-test-event-loop"
 
 #define LTTNG_WRITE_COUNT_MAX	64
 
+#define LTTNG_TEST_STRING_MAX	512
+#define LTTNG_TEST_SEQUENCE_LEN	16
+
 static struct proc_dir_entry *lttng_test_filter_event_dentry;
+static struct proc_dir_entry *lttng_test_event_loop_dentry;
 
 static
 void trace_test_event(unsigned int nr_iter)
@@ -85,6 +107,243 @@ static const struct file_operations lttng_test_filter_event_operations = {
 	.write = lttng_test_filter_event_write,
 };
 
+/*
+ * Writing "<class> <nr>" to the lttng-test-event-loop proc file fires <nr>
+ * events of <class> on each online cpu in parallel, from one work item
+ * per cpu, and reading it back reports the throughput of the last loop.
+ * The user_string class reads the written buffer itself, so it is fired
+ * by the writing task alone: run one writer per cpu to load all cpus.
+ */
+enum lttng_test_loop_class {
+	LTTNG_TEST_LOOP_FILTER,
+	LTTNG_TEST_LOOP_INTEGERS,
+	LTTNG_TEST_LOOP_STRING_8,
+	LTTNG_TEST_LOOP_STRING_64,
+	LTTNG_TEST_LOOP_STRING_512,
+	LTTNG_TEST_LOOP_STRING_BOUNDED_64,
+	LTTNG_TEST_LOOP_SEQUENCE,
+	LTTNG_TEST_LOOP_ARRAY,
+	LTTNG_TEST_LOOP_ENUM,
+	LTTNG_TEST_LOOP_USER_STRING,
+	NR_LTTNG_TEST_LOOP_CLASSES,
+};
+
+static const char *lttng_test_loop_class_names[NR_LTTNG_TEST_LOOP_CLASSES] = {
+	[LTTNG_TEST_LOOP_FILTER] = "filter",
+	[LTTNG_TEST_LOOP_INTEGERS] = "integers",
+	[LTTNG_TEST_LOOP_STRING_8] = "string_8",
+	[LTTNG_TEST_LOOP_STRING_64] = "string_64",
+	[LTTNG_TEST_LOOP_STRING_512] = "string_512",
+	[LTTNG_TEST_LOOP_STRING_BOUNDED_64] = "string_bounded_64",
+	[LTTNG_TEST_LOOP_SEQUENCE] = "sequence",
+	[LTTNG_TEST_LOOP_ARRAY] = "array",
+	[LTTNG_TEST_LOOP_ENUM] = "enum",
+	[LTTNG_TEST_LOOP_USER_STRING] = "user_string",
+};
+
+struct lttng_test_loop_work {
+	struct work_struct work;
+	enum lttng_test_loop_class class;
+	unsigned int nr_iter;
+	u64 ns;
+};
+
+struct lttng_test_loop_result {
+	enum lttng_test_loop_class class;
+	unsigned int nr_iter;
+	unsigned int nr_cpus;
+	u64 wall_ns;
+	u64 cpu_ns;		/* Sum over cpus */
+};
+
+static DEFINE_PER_CPU(struct lttng_test_loop_work, lttng_test_loop_works);
+static DEFINE_MUTEX(lttng_test_loop_mutex);
+static struct lttng_test_loop_result lttng_test_loop_result;
+static bool lttng_test_loop_has_run;
+
+/* LTTNG_TEST_STRING_MAX characters followed by '\0'. */
+static char lttng_test_text[LTTNG_TEST_STRING_MAX + 1];
+
+static
+const char *lttng_test_string(size_t len)
+{
+	return &lttng_test_text[LTTNG_TEST_STRING_MAX - len];
+}
+
+static
+void lttng_test_loop(enum lttng_test_loop_class class, unsigned int nr_iter,
+		const char __user *user_str)
+{
+	uint32_t seq_values[LTTNG_TEST_SEQUENCE_LEN];
+	uint64_t arr_values[16];
+	unsigned int i;
+
+	for (i = 0; i < LTTNG_TEST_SEQUENCE_LEN; i++)
+		seq_values[i] = i;
+	for (i = 0; i < ARRAY_SIZE(arr_values); i++)
+		arr_values[i] = i;
+	if (class == LTTNG_TEST_LOOP_FILTER) {
+		trace_test_event(nr_iter);
+		return;
+	}
+	for (i = 0; i < nr_iter; i++) {
+		switch (class) {
+		case LTTNG_TEST_LOOP_INTEGERS:
+			trace_lttng_test_event_integers(i);
+			break;
+		case LTTNG_TEST_LOOP_STRING_8:
+			trace_lttng_test_event_string(lttng_test_string(8));
+			break;
+		case LTTNG_TEST_LOOP_STRING_64:
+			trace_lttng_test_event_string(lttng_test_string(64));
+			break;
+		case LTTNG_TEST_LOOP_STRING_512:
+			trace_lttng_test_event_string(lttng_test_string(512));
+			break;
+		case LTTNG_TEST_LOOP_STRING_BOUNDED_64:
+			trace_lttng_test_event_string_bounded(lttng_test_string(64));
+			break;
+		case LTTNG_TEST_LOOP_SEQUENCE:
+			trace_lttng_test_event_sequence(seq_values,
+				LTTNG_TEST_SEQUENCE_LEN);
+			break;
+		case LTTNG_TEST_LOOP_ARRAY:
+			trace_lttng_test_event_array(arr_values);
+			break;
+		case LTTNG_TEST_LOOP_ENUM:
+			trace_lttng_test_event_enum(i & 0xFF);
+			break;
+		case LTTNG_TEST_LOOP_USER_STRING:
+			trace_lttng_test_event_user_string(user_str);
+			break;
+		default:
+			return;
+		}
+		if (!(i % 1024))
+			cond_resched();
+	}
+}
+
+static
+void lttng_test_loop_work_func(struct work_struct *work)
+{
+	struct lttng_test_loop_work *lw =
+		container_of(work, struct lttng_test_loop_work, work);
+	u64 start;
+
+	start = ktime_get_ns();
+	lttng_test_loop(lw->class, lw->nr_iter, NULL);
+	lw->ns = ktime_get_ns() - start;
+}
+
+static
+void lttng_test_loop_run(enum lttng_test_loop_class class,
+		unsigned int nr_iter, const char __user *user_str,
+		struct lttng_test_loop_result *result)
+{
+	u64 start;
+	int cpu;
+
+	memset(result, 0, sizeof(*result));
+	result->class = class;
+	result->nr_iter = nr_iter;
+	if (class == LTTNG_TEST_LOOP_USER_STRING) {
+		start = ktime_get_ns();
+		lttng_test_loop(class, nr_iter, user_str);
+		result->wall_ns = result->cpu_ns = ktime_get_ns() - start;
+		result->nr_cpus = 1;
+		return;
+	}
+	get_online_cpus();
+	start = ktime_get_ns();
+	for_each_online_cpu(cpu) {
+		struct lttng_test_loop_work *lw =
+			per_cpu_ptr(&lttng_test_loop_works, cpu);
+
+		lw->class = class;
+		lw->nr_iter = nr_iter;
+		lw->ns = 0;
+		INIT_WORK(&lw->work, lttng_test_loop_work_func);
+		queue_work_on(cpu, system_highpri_wq, &lw->work);
+	}
+	for_each_online_cpu(cpu) {
+		struct lttng_test_loop_work *lw =
+			per_cpu_ptr(&lttng_test_loop_works, cpu);
+
+		flush_work(&lw->work);
+		result->cpu_ns += lw->ns;
+		result->nr_cpus++;
+	}
+	result->wall_ns = ktime_get_ns() - start;
+	put_online_cpus();
+}
+
+static
+ssize_t lttng_test_event_loop_write(struct file *file,
+		const char __user *user_buf, size_t count, loff_t *ppos)
+{
+	char buf[LTTNG_WRITE_COUNT_MAX];
+	char name[LTTNG_WRITE_COUNT_MAX];
+	unsigned int nr_iter;
+	int i;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, user_buf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+	if (sscanf(buf, "%63s %u", name, &nr_iter) != 2)
+		return -EINVAL;
+	for (i = 0; i < NR_LTTNG_TEST_LOOP_CLASSES; i++) {
+		if (!strcmp(name, lttng_test_loop_class_names[i]))
+			break;
+	}
+	if (i == NR_LTTNG_TEST_LOOP_CLASSES)
+		return -EINVAL;
+	mutex_lock(&lttng_test_loop_mutex);
+	lttng_test_loop_run(i, nr_iter, user_buf, &lttng_test_loop_result);
+	lttng_test_loop_has_run = true;
+	mutex_unlock(&lttng_test_loop_mutex);
+	*ppos += count;
+	return count;
+}
+
+static
+int lttng_test_event_loop_show(struct seq_file *m, void *v)
+{
+	struct lttng_test_loop_result *result = &lttng_test_loop_result;
+	u64 nr_events;
+
+	mutex_lock(&lttng_test_loop_mutex);
+	if (!lttng_test_loop_has_run)
+		goto end;
+	nr_events = (u64) result->nr_iter * result->nr_cpus;
+	seq_puts(m, "# class nr_cpus events wall_ns ns_per_event events_per_sec\n");
+	seq_printf(m, "%s %u %llu %llu %llu %llu\n",
+		lttng_test_loop_class_names[result->class],
+		result->nr_cpus, nr_events, result->wall_ns,
+		nr_events ? div64_u64(result->cpu_ns, nr_events) : 0,
+		result->wall_ns ?
+			div64_u64(nr_events * NSEC_PER_SEC, result->wall_ns) : 0);
+end:
+	mutex_unlock(&lttng_test_loop_mutex);
+	return 0;
+}
+
+static
+int lttng_test_event_loop_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, lttng_test_event_loop_show, NULL);
+}
+
+static const struct file_operations lttng_test_event_loop_operations = {
+	.open = lttng_test_event_loop_open,
+	.read = seq_read,
+	.write = lttng_test_event_loop_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static
 int __init lttng_test_init(void)
 {
@@ -92,6 +351,7 @@ int __init lttng_test_init(void)
 
 	(void) wrapper_lttng_fixup_sig(THIS_MODULE);
 	wrapper_vmalloc_sync_all();
+	memset(lttng_test_text, 'x', LTTNG_TEST_STRING_MAX);
 	lttng_test_filter_event_dentry =
 			proc_create_data(LTTNG_TEST_FILTER_EVENT_FILE,
 				S_IRUGO | S_IWUGO, NULL,
@@ -101,12 +361,23 @@ int __init lttng_test_init(void)
 		ret = -ENOMEM;
 		goto error;
 	}
+	lttng_test_event_loop_dentry =
+			proc_create_data(LTTNG_TEST_EVENT_LOOP_FILE,
+				S_IRUGO | S_IWUGO, NULL,
+				&lttng_test_event_loop_operations, NULL);
+	if (!lttng_test_event_loop_dentry) {
+		printk(KERN_ERR "Error creating LTTng test event loop file\n");
+		ret = -ENOMEM;
+		goto error_loop;
+	}
 	ret = __lttng_events_init__lttng_test();
 	if (ret)
 		goto error_events;
 	return ret;
 
 error_events:
+	remove_proc_entry(LTTNG_TEST_EVENT_LOOP_FILE, NULL);
+error_loop:
 	remove_proc_entry(LTTNG_TEST_FILTER_EVENT_FILE, NULL);
 error:
 	return ret;
@@ -118,6 +389,8 @@ static
 void __exit lttng_test_exit(void)
 {
 	__lttng_events_exit__lttng_test();
+	if (lttng_test_event_loop_dentry)
+		remove_proc_entry(LTTNG_TEST_EVENT_LOOP_FILE, NULL);
 	if (lttng_test_filter_event_dentry)
 		remove_proc_entry(LTTNG_TEST_FILTER_EVENT_FILE, NULL);
 }
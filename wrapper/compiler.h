@@ -9,6 +9,7 @@
 #define _LTTNG_WRAPPER_COMPILER_H
 
 #include <linux/compiler.h>
+#include <linux/version.h>
 
 /*
  * Don't allow compiling with buggy compiler.
@@ -39,4 +40,16 @@
 # define WRITE_ONCE(x, val)	({ ACCESS_ONCE(x) = val; })
 #endif
 
+/*
+ * read_word_at_a_time was introduced in kernel 4.16. It reads a whole
+ * aligned word, possibly past the end of the object containing @addr,
+ * without being reported by KASAN.
+ */
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,16,0))
+# define lttng_read_word_at_a_time(addr)	read_word_at_a_time(addr)
+#else
+# define lttng_read_word_at_a_time(addr)	\
+	READ_ONCE(*(const unsigned long *) (addr))
+#endif
+
 #endif /* _LTTNG_WRAPPER_COMPILER_H */
@@ -0,0 +1,119 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * wrapper/fgraph.h
+ *
+ * wrapper around the function graph tracer hooks. Using KALLSYMS to get
+ * their address when available, else we need to have a kernel that
+ * exports these functions to GPL modules.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#ifndef _LTTNG_WRAPPER_FGRAPH_H
+#define _LTTNG_WRAPPER_FGRAPH_H
+
+#include <linux/ftrace.h>
+#include <lttng-kernel-version.h>
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5,0,0))
+/* Function graph hooks are registered through a struct fgraph_ops. */
+#define LTTNG_FGRAPH_OPS
+#endif
+
+#ifdef CONFIG_KALLSYMS
+
+#include <linux/kallsyms.h>
+#include <wrapper/kallsyms.h>
+
+#ifdef LTTNG_FGRAPH_OPS
+static inline
+int wrapper_register_ftrace_graph(struct fgraph_ops *gops)
+{
+	int (*register_ftrace_graph_sym)(struct fgraph_ops *gops);
+
+	register_ftrace_graph_sym = (void *) kallsyms_lookup_funcptr("register_ftrace_graph");
+	if (register_ftrace_graph_sym) {
+		return register_ftrace_graph_sym(gops);
+	} else {
+		printk_once(KERN_WARNING "LTTng: register_ftrace_graph symbol lookup failed.\n");
+		return -EINVAL;
+	}
+}
+
+static inline
+void wrapper_unregister_ftrace_graph(struct fgraph_ops *gops)
+{
+	void (*unregister_ftrace_graph_sym)(struct fgraph_ops *gops);
+
+	unregister_ftrace_graph_sym = (void *) kallsyms_lookup_funcptr("unregister_ftrace_graph");
+	if (unregister_ftrace_graph_sym) {
+		unregister_ftrace_graph_sym(gops);
+	} else {
+		printk_once(KERN_WARNING "LTTng: unregister_ftrace_graph symbol lookup failed.\n");
+		WARN_ON(1);
+	}
+}
+#else /* #ifdef LTTNG_FGRAPH_OPS */
+static inline
+int wrapper_register_ftrace_graph(trace_func_graph_ret_t retfunc,
+		trace_func_graph_ent_t entryfunc)
+{
+	int (*register_ftrace_graph_sym)(trace_func_graph_ret_t retfunc,
+			trace_func_graph_ent_t entryfunc);
+
+	register_ftrace_graph_sym = (void *) kallsyms_lookup_funcptr("register_ftrace_graph");
+	if (register_ftrace_graph_sym) {
+		return register_ftrace_graph_sym(retfunc, entryfunc);
+	} else {
+		printk_once(KERN_WARNING "LTTng: register_ftrace_graph symbol lookup failed.\n");
+		return -EINVAL;
+	}
+}
+
+static inline
+void wrapper_unregister_ftrace_graph(void)
+{
+	void (*unregister_ftrace_graph_sym)(void);
+
+	unregister_ftrace_graph_sym = (void *) kallsyms_lookup_funcptr("unregister_ftrace_graph");
+	if (unregister_ftrace_graph_sym) {
+		unregister_ftrace_graph_sym();
+	} else {
+		printk_once(KERN_WARNING "LTTng: unregister_ftrace_graph symbol lookup failed.\n");
+		WARN_ON(1);
+	}
+}
+#endif /* #else #ifdef LTTNG_FGRAPH_OPS */
+
+#else /* #ifdef CONFIG_KALLSYMS */
+
+#ifdef LTTNG_FGRAPH_OPS
+static inline
+int wrapper_register_ftrace_graph(struct fgraph_ops *gops)
+{
+	return register_ftrace_graph(gops);
+}
+
+static inline
+void wrapper_unregister_ftrace_graph(struct fgraph_ops *gops)
+{
+	unregister_ftrace_graph(gops);
+}
+#else /* #ifdef LTTNG_FGRAPH_OPS */
+static inline
+int wrapper_register_ftrace_graph(trace_func_graph_ret_t retfunc,
+		trace_func_graph_ent_t entryfunc)
+{
+	return register_ftrace_graph(retfunc, entryfunc);
+}
+
+static inline
+void wrapper_unregister_ftrace_graph(void)
+{
+	unregister_ftrace_graph();
+}
+#endif /* #else #ifdef LTTNG_FGRAPH_OPS */
+
+#endif /* #else #ifdef CONFIG_KALLSYMS */
+
+#endif /* _LTTNG_WRAPPER_FGRAPH_H */
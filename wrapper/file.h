@@ -35,4 +35,25 @@ inline int lttng_get_unused_fd(void)
 
 #endif /* #else #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,19,0) */
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,11,0)
+
+static
+inline int lttng_close_fd(unsigned int fd)
+{
+	return close_fd(fd);
+}
+
+#else /* #if LINUX_VERSION_CODE >= KERNEL_VERSION(5,11,0) */
+
+#include <linux/sched.h>
+#include <linux/fdtable.h>
+
+static
+inline int lttng_close_fd(unsigned int fd)
+{
+	return __close_fd(current->files, fd);
+}
+
+#endif /* #else #if LINUX_VERSION_CODE >= KERNEL_VERSION(5,11,0) */
+
 #endif /* _LTTNG_WRAPPER_FILE_H */
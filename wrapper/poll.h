@@ -11,10 +11,16 @@
 #include <linux/poll.h>
 
 /*
- * Note: poll_wait_set_exclusive() is defined as no-op. Thundering herd
- * effect can be noticed with large number of consumer threads.
+ * Note: poll_wait_set_exclusive() is defined as no-op: the poll table
+ * queueing is owned by poll/select and epoll. With Linux 4.5+, consumer
+ * threads sharing a stream or channel descriptor avoid the thundering
+ * herd by adding it to their epoll set with EPOLLEXCLUSIVE: data
+ * wakeups (wake_up_interruptible()) then wake a single exclusive waiter.
+ * Hang-ups use lttng_wake_up_hangup(), which wakes all of them.
  */
 
 #define poll_wait_set_exclusive(poll_table)
 
+#define lttng_wake_up_hangup(wq)	wake_up_interruptible_all(wq)
+
 #endif /* _LTTNG_WRAPPER_POLL_H */
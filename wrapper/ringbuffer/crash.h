@@ -0,0 +1,2 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1) */
+#include <lib/ringbuffer/crash.h>
@@ -11,6 +11,8 @@
 #ifndef _LTTNG_TRACE_CLOCK_H
 #define _LTTNG_TRACE_CLOCK_H
 
+#include <linux/jiffies.h>
+
 #ifdef CONFIG_HAVE_TRACE_CLOCK
 #include <linux/trace-clock.h>
 #else /* CONFIG_HAVE_TRACE_CLOCK */
@@ -225,4 +227,29 @@ static inline const char *trace_clock_description(void)
 
 #endif /* CONFIG_HAVE_TRACE_CLOCK */
 
+/*
+ * Coarse clock of the channels created with
+ * LTTNG_KERNEL_CHANNEL_FLAG_COARSE_CLOCK: the jiffies counter. Its
+ * lockless read is only NMI-safe on 64-bit architectures.
+ */
+static inline u64 trace_clock_read64_coarse(void)
+{
+	return get_jiffies_64();
+}
+
+static inline u64 trace_clock_freq_coarse(void)
+{
+	return (u64) HZ;
+}
+
+static inline const char *trace_clock_name_coarse(void)
+{
+	return "coarse";
+}
+
+static inline const char *trace_clock_description_coarse(void)
+{
+	return "Coarse clock (jiffies)";
+}
+
 #endif /* _LTTNG_TRACE_CLOCK_H */
@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * wrapper/vmcoreinfo.c
+ *
+ * wrapper around vmcoreinfo_append_str. Using KALLSYMS to get its address
+ * when available, since it is not exported to modules.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <linux/errno.h>
+#include <wrapper/vmcoreinfo.h>
+
+#if (defined(CONFIG_KALLSYMS) \
+	&& (defined(CONFIG_CRASH_CORE) || defined(CONFIG_KEXEC_CORE) \
+		|| defined(CONFIG_KEXEC)))
+
+#include <linux/kallsyms.h>
+#include <linux/printk.h>
+#include <wrapper/kallsyms.h>
+
+static
+void (*vmcoreinfo_append_str_sym)(const char *fmt, ...);
+
+int wrapper_vmcoreinfo_append(const char *str)
+{
+	if (!vmcoreinfo_append_str_sym)
+		vmcoreinfo_append_str_sym =
+			(void *) kallsyms_lookup_funcptr("vmcoreinfo_append_str");
+	if (vmcoreinfo_append_str_sym) {
+		vmcoreinfo_append_str_sym("%s", str);
+		return 0;
+	} else {
+		printk_once(KERN_WARNING "LTTng: vmcoreinfo_append_str symbol lookup failed.\n");
+		return -ENOSYS;
+	}
+}
+
+#else
+
+int wrapper_vmcoreinfo_append(const char *str)
+{
+	return -ENOSYS;
+}
+
+#endif
@@ -0,0 +1,21 @@
+/* SPDX-License-Identifier: (GPL-2.0 or LGPL-2.1)
+ *
+ * wrapper/vmcoreinfo.h
+ *
+ * wrapper around vmcoreinfo_append_str. Using KALLSYMS to get its address
+ * when available, since it is not exported to modules.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#ifndef _LTTNG_WRAPPER_VMCOREINFO_H
+#define _LTTNG_WRAPPER_VMCOREINFO_H
+
+/*
+ * Append a preformatted "KEY=value\n" line to the vmcoreinfo note.
+ * Returns -ENOSYS if the kernel has no vmcoreinfo, or if the symbol
+ * lookup fails.
+ */
+int wrapper_vmcoreinfo_append(const char *str);
+
+#endif /* _LTTNG_WRAPPER_VMCOREINFO_H */